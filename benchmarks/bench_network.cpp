@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+#include <QBuffer>
+#include <opencv2/opencv.hpp>
+#include "network/networkpacket.h"
+#include "network/protocol/driverprotocol.h"
+#include "commons/frame.h"
+#include "commons/framepool.h"
+
+using namespace std;
+
+namespace {
+FrameConstPtr planet(int width, int height, int type) {
+  cv::Mat mat(height, width, type, cv::Scalar{0});
+  cv::randn(mat, CV_MAT_DEPTH(type) == CV_16U ? 4000 : 16, CV_MAT_DEPTH(type) == CV_16U ? 500 : 2);
+  cv::circle(mat, {width / 2, height / 2}, height / 4, cv::Scalar::all(CV_MAT_DEPTH(type) == CV_16U ? 50000 : 200), -1);
+  return make_shared<Frame>(CV_MAT_CN(type) == 1 ? Frame::Mono : Frame::BGR, mat, Frame::LittleEndian);
+}
+
+DriverProtocol::FormatParameters parameters(Configuration::NetworkImageFormat format) {
+  DriverProtocol::FormatParameters parameters{};
+  parameters.format = format;
+  parameters.jpegQuality = 85;
+  return parameters;
+}
+}
+
+static void BM_PacketRoundTrip(benchmark::State &state) {
+  const QByteArray payload(state.range(0), 'x');
+  QBuffer buffer;
+  for(auto _: state) {
+    NetworkPacket packet{"benchmark"};
+    packet.setPayload(payload);
+    buffer.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    packet.sendTo(&buffer);
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    NetworkPacket received;
+    received.receiveFrom(&buffer);
+    buffer.close();
+    benchmark::DoNotOptimize(received.payload().size());
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_PacketRoundTrip)->Arg(64)->Arg(64 << 10)->Arg(4 << 20);
+
+static void BM_SendFrame(benchmark::State &state) {
+  auto frame = planet(state.range(1), state.range(2), CV_16UC1);
+  auto format = parameters(static_cast<Configuration::NetworkImageFormat>(state.range(0)));
+  for(auto _: state)
+    benchmark::DoNotOptimize(DriverProtocol::sendFrame(frame, format));
+  state.SetBytesProcessed(state.iterations() * frame->size());
+}
+BENCHMARK(BM_SendFrame)
+  ->Args({Configuration::Network_RAW, 640, 480})->Args({Configuration::Network_RAW, 1936, 1096})
+  ->Args({Configuration::Network_JPEG, 640, 480})->Args({Configuration::Network_JPEG, 1936, 1096});
+
+// Encoding, sending over an in memory device, receiving and decoding, as a remote client does
+static void BM_FrameRoundTrip(benchmark::State &state) {
+  auto frame = planet(state.range(1), state.range(2), CV_16UC1);
+  auto format = parameters(static_cast<Configuration::NetworkImageFormat>(state.range(0)));
+  DriverProtocol::setFormatParameters(format);
+  auto pool = make_shared<FramePool>();
+  const NetworkPacket::BodySinks sinks{{DriverProtocol::SendRawFrame, DriverProtocol::rawFrameSink(pool)}};
+  QBuffer buffer;
+  for(auto _: state) {
+    buffer.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    DriverProtocol::sendFrame(frame, format)->sendTo(&buffer);
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    auto received = make_shared<NetworkPacket>();
+    received->receiveFrom(&buffer, sinks);
+    buffer.close();
+    benchmark::DoNotOptimize(DriverProtocol::decodeFrame(received));
+  }
+  state.SetBytesProcessed(state.iterations() * frame->size());
+}
+BENCHMARK(BM_FrameRoundTrip)
+  ->Args({Configuration::Network_RAW, 640, 480})->Args({Configuration::Network_RAW, 1936, 1096})
+  ->Args({Configuration::Network_JPEG, 640, 480})->Args({Configuration::Network_JPEG, 1936, 1096});
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+#include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/pixel_kernels.h"
+#include "commons/tracking.h"
+
+using namespace std;
+
+// Sizes: a typical planetary ROI, and a full frame of a common CMOS sensor
+#define FRAME_SIZES ->Args({640, 480})->Args({1936, 1096})
+
+namespace {
+cv::Mat noise(int width, int height, int type) {
+  cv::Mat mat(height, width, type);
+  cv::randu(mat, 0, CV_MAT_DEPTH(type) == CV_16U ? 65535 : 255);
+  return mat;
+}
+
+void setPixels(benchmark::State &state, const cv::Mat &mat) {
+  state.SetBytesProcessed(state.iterations() * mat.total() * mat.elemSize());
+}
+}
+
+static void BM_FrameCopy(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(make_shared<Frame>(Frame::Mono, mat));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_FrameCopy) FRAME_SIZES;
+
+static void BM_FrameShared(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(make_shared<Frame>(Frame::Mono, mat, Frame::LittleEndian, Frame::ShareBuffer));
+}
+BENCHMARK(BM_FrameShared) FRAME_SIZES;
+
+static void BM_FramePool(benchmark::State &state) {
+  auto pool = make_shared<FramePool>();
+  const QSize resolution(state.range(0), state.range(1));
+  for(auto _: state)
+    benchmark::DoNotOptimize(pool->acquire(16, Frame::Mono, resolution));
+}
+BENCHMARK(BM_FramePool) FRAME_SIZES;
+
+// Byte order correction of 16 bit frames from big endian cameras
+static void BM_Swap16(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(PixelKernels::swap16(mat));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_Swap16) FRAME_SIZES;
+
+static void BM_To8Bit(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(PixelKernels::to8bit(mat, true));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_To8Bit) FRAME_SIZES;
+
+static void BM_Debayer(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_8UC1);
+  cv::Mat rgb;
+  for(auto _: state) {
+    cv::cvtColor(mat, rgb, cv::COLOR_BayerRG2RGB);
+    benchmark::DoNotOptimize(rgb.data);
+  }
+  setPixels(state, mat);
+}
+BENCHMARK(BM_Debayer) FRAME_SIZES;
+
+static void BM_Histogram8(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_8UC3);
+  for(auto _: state)
+    benchmark::DoNotOptimize(PixelKernels::histogram(mat));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_Histogram8) FRAME_SIZES;
+
+static void BM_Histogram16(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(PixelKernels::histogram(mat, true));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_Histogram16) FRAME_SIZES;
+
+static void BM_Centroid(benchmark::State &state) {
+  auto mat = noise(state.range(0), state.range(1), CV_16UC1);
+  cv::circle(mat, {mat.cols / 3, mat.rows / 2}, 50, cv::Scalar{65535}, -1);
+  for(auto _: state)
+    benchmark::DoNotOptimize(findCentroidSubpixel(mat));
+  setPixels(state, mat);
+}
+BENCHMARK(BM_Centroid) FRAME_SIZES;
+
+// Block matching search (as done by ImgTracker): a 64x64 block within a +/-32 pixels window, at full resolution and two pyramid levels down
+static void BM_BlockMatching(benchmark::State &state) {
+  auto image = noise(160, 160, CV_32FC1);
+  cv::GaussianBlur(image, image, {5, 5}, 0);
+  const int scale = 1 << state.range(0);
+  cv::Mat search, block, result;
+  cv::resize(image, search, {}, 1. / scale, 1. / scale, cv::INTER_AREA);
+  block = search(cv::Rect{16 / scale, 16 / scale, 64 / scale, 64 / scale}).clone();
+  for(auto _: state) {
+    cv::matchTemplate(search, block, result, cv::TM_SQDIFF);
+    cv::Point best;
+    cv::minMaxLoc(result, nullptr, nullptr, &best);
+    benchmark::DoNotOptimize(best);
+  }
+}
+BENCHMARK(BM_BlockMatching)->Arg(0)->Arg(1)->Arg(2);
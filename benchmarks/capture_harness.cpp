@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * End to end capture benchmark: the simulator, at full speed, recording SER files to a directory (tmpfs by default, so that
+ * the disk isn't measured), for a fixed time. Reports sustained capture and recording rates, dropped frames and latencies.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QDir>
+#include <iostream>
+#include "drivers/simulator/simulatorimager.h"
+#include "image_handlers/backend/local_saveimages.h"
+#include "commons/configuration.h"
+#include "commons/frame.h"
+#include "commons/metrics.h"
+
+using namespace std;
+
+namespace {
+void setControl(Imager *imager, const QString &name, const QVariant &value) {
+  for(auto control: imager->controls()) {
+    if(control.name != name)
+      continue;
+    for(auto choice: control.choices)
+      if(choice.label.compare(value.toString(), Qt::CaseInsensitive) == 0)
+        control.value = choice.value;
+    if(control.choices.isEmpty() || control.type == Imager::Control::Bool)
+      control.value = value;
+    imager->setControl(control);
+  }
+}
+
+void printLatency(const QString &name, const QString &label) {
+  auto snapshot = Metrics::instance().histogram(name, {}).snapshot();
+  cout << label.toStdString() << ": p50 " << snapshot.percentile_us(0.5) << "us, p99 " << snapshot.percentile_us(0.99)
+       << "us, max " << snapshot.max_us << "us" << endl;
+}
+}
+
+int main(int argc, char **argv)
+{
+  qRegisterMetaType<FramePtr>("FramePtr");
+  qRegisterMetaType<FrameConstPtr>("FrameConstPtr");
+  qRegisterMetaType<Imager*>("Imager*");
+  QCoreApplication app(argc, argv);
+  // Keeps the benchmark settings apart from the user ones
+  app.setApplicationName("PlanetaryImagerBenchmark");
+
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  parser.addOptions({
+    {"duration", "Recording duration, in seconds (default: 10)", "seconds", "10"},
+    {"directory", "Directory for the recorded files (default: /dev/shm, or the temporary directory)", "directory", QDir{"/dev/shm"}.exists() ? "/dev/shm" : QDir::tempPath()},
+    {"bpp", "Simulator bits per pixel: 8, 16 (default: 16)", "bpp", "16"},
+    {"bin", "Simulator binning: 1-4 (default: 1)", "bin", "1"},
+    {"format", "Simulator format: mono, bgr, bayer (default: mono)", "format", "mono"},
+    {"max-memory", "Recording queue size, in MB (default: 256)", "megabytes", "256"},
+    {"synthetic", "Pre-rendered frames of this resolution (i.e. 1920x1080) instead of the simulated planet", "resolution"},
+    {"fps", "Synthetic frames rate (default: 0, as fast as possible)", "fps", "0"},
+  });
+  parser.process(app);
+
+  QTemporaryDir directory{parser.value("directory") + "/planetaryimager-benchmark-XXXXXX"};
+  if(! directory.isValid()) {
+    cerr << "Unable to create a directory in " << parser.value("directory").toStdString() << endl;
+    return 1;
+  }
+
+  Configuration configuration;
+  configuration.set_save_directory(directory.path());
+  configuration.set_save_format(Configuration::SER);
+  configuration.set_recording_limit_type(Configuration::Infinite);
+  configuration.set_save_info_file(false);
+  configuration.set_save_json_info_file(false);
+  configuration.set_max_memory_usage(parser.value("max-memory").toLongLong() * 1024 * 1024);
+  configuration.set_recording_queue_overflow(Configuration::QueueDropNewest);
+
+  auto save_images = make_shared<LocalSaveImages>(configuration);
+  auto imager = new SimulatorImager(save_images);
+  setControl(imager, "max_speed", true);
+  setControl(imager, "bpp", parser.value("bpp"));
+  setControl(imager, "bin", QString{"%1x%1"}.arg(parser.value("bin")));
+  setControl(imager, "format", parser.value("format"));
+  if(parser.isSet("synthetic")) {
+    auto resolution = parser.value("synthetic").split('x');
+    setControl(imager, "synthetic", true);
+    setControl(imager, "synthetic_width", resolution.value(0).toInt());
+    setControl(imager, "synthetic_height", resolution.value(1).toInt());
+    setControl(imager, "target_fps", parser.value("fps").toDouble());
+  }
+
+  auto &captured = Metrics::instance().counter("driver_frames_total", {});
+  auto &recorded = Metrics::instance().counter("recording_frames_total", {});
+  auto &recorded_bytes = Metrics::instance().counter("recording_bytes_total", {});
+  auto &dropped = Metrics::instance().counter("recording_dropped_frames_total", {});
+
+  QElapsedTimer elapsed;
+  imager->startLive();
+  save_images->startRecording(imager);
+  elapsed.start();
+
+  QTimer::singleShot(parser.value("duration").toDouble() * 1000, [&]{
+    save_images->endRecording();
+    imager->destroy();
+    const double seconds = elapsed.elapsed() / 1000.;
+    cout << "Recorded for " << seconds << "s to " << directory.path().toStdString() << endl;
+    cout << "Captured: " << captured.value() << " frames, " << captured.value() / seconds << " fps" << endl;
+    cout << "Recorded: " << recorded.value() << " frames, " << recorded.value() / seconds << " fps, "
+         << recorded_bytes.value() / seconds / 1024 / 1024 << " MB/s" << endl;
+    cout << "Dropped: " << dropped.value() << " frames" << endl;
+    printLatency("driver_shoot_seconds", "Capture");
+    printLatency("handler_dispatch_seconds", "Dispatch");
+    printLatency("recording_queue_wait_seconds", "Recording queue");
+    printLatency("recording_write_seconds", "Write");
+    app.quit();
+  });
+  return app.exec();
+}
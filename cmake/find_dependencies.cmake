@@ -28,6 +28,44 @@ else()
     set(HAVE_LIBINDI Off CACHE INTERNAL "")
 endif()
 
+# FFmpeg, for the lossless/hardware video writer
+pkg_check_modules(LIBAV libavcodec>=58 libavformat>=58 libavutil>=56 libswscale>=5)
+if(LIBAV_FOUND)
+    set(HAVE_LIBAV On CACHE INTERNAL "")
+else()
+    set(HAVE_LIBAV Off CACHE INTERNAL "")
+endif()
+
+# zstd, for compressed SER files
+pkg_check_modules(ZSTD libzstd)
+if(ZSTD_FOUND)
+    set(HAVE_ZSTD On CACHE INTERNAL "")
+    include_directories(${ZSTD_INCLUDE_DIRS})
+    link_directories(${ZSTD_LIBRARY_DIRS})
+else()
+    set(HAVE_ZSTD Off CACHE INTERNAL "")
+endif()
+
+# LZ4, for the compressed recording queue
+pkg_check_modules(LZ4 liblz4)
+if(LZ4_FOUND)
+    set(HAVE_LZ4 On CACHE INTERNAL "")
+    include_directories(${LZ4_INCLUDE_DIRS})
+    link_directories(${LZ4_LIBRARY_DIRS})
+else()
+    set(HAVE_LZ4 Off CACHE INTERNAL "")
+endif()
+
+# libjpeg-turbo, for the JPEG network previews
+pkg_check_modules(TURBOJPEG libturbojpeg)
+if(TURBOJPEG_FOUND)
+    set(HAVE_TURBOJPEG On CACHE INTERNAL "")
+    include_directories(${TURBOJPEG_INCLUDE_DIRS})
+    link_directories(${TURBOJPEG_LIBRARY_DIRS})
+else()
+    set(HAVE_TURBOJPEG Off CACHE INTERNAL "")
+endif()
+
 
 include_directories(${OpenCV_INCLUDE_DIRS})
 
@@ -47,6 +47,18 @@ function(add_driver)
   set(enabled_drivers ${enabled_drivers} ${add_driver_NAME} CACHE INTERNAL "")
 endfunction()
 
+# Optional parts of the application, loaded on first use (see commons/modules.h)
+function(add_module)
+  set(oneValueArgs NAME)
+  set(multiValueArgs SRCS LINK)
+  cmake_parse_arguments(add_module "" "${oneValueArgs}" "${multiValueArgs}" ${ARGN})
+  add_library(${add_module_NAME} MODULE ${add_module_SRCS})
+  target_link_libraries(${add_module_NAME} image_handlers planetaryimager-commons GuLinux_Qt_Commons GuLinux_c++_Commons ${add_module_LINK} Qt5::Core ${OpenCV_LIBS})
+  # All in one directory, so that the build tree can load them too
+  set_target_properties(${add_module_NAME} PROPERTIES PREFIX "module_" LIBRARY_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/src/modules)
+  install(TARGETS ${add_module_NAME} LIBRARY DESTINATION ${modules_destination})
+endfunction()
+
 function(external_project_download IN_FILE OUT_DIR)
   configure_file(${IN_FILE} ${OUT_DIR}_download/CMakeLists.txt)
   execute_process(COMMAND ${CMAKE_COMMAND} -G "${CMAKE_GENERATOR}" .
@@ -15,12 +15,22 @@ message("Extra libraries for linking: ${EXTRA_LIBRARIES}")
 # Unit tests
 option(ENABLE_PLANETARYIMAGER_TESTING "Enable Planetary Imager unit tests" Off)
 
+# Benchmarks ("benchmarks" target): microbenchmarks need Google Benchmark
+option(ENABLE_PLANETARYIMAGER_BENCHMARKS "Enable Planetary Imager benchmarks" Off)
+
 # Search for drivers in current directory
 option(ADD_DRIVERS_BUILD_DIRECTORY "Search for drivers in the current build directory (developer option)" OFF)
 
 # Developer mode: log all message to stderr
 option(DEVELOPER_MODE "Force logging mode to debug" OFF)
 option(DEBUG_NETWORK_PACKETS "Debug network packets" OFF)
+
+# Release builds: qDebug() messages are compiled out, unless in developer mode
+option(RELEASE_STRIP_DEBUG_LOGS "Remove qDebug() messages from Release builds" ON)
+if(RELEASE_STRIP_DEBUG_LOGS AND NOT DEVELOPER_MODE)
+  set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -DQT_NO_DEBUG_OUTPUT")
+  set(CMAKE_CXX_FLAGS_MINSIZEREL "${CMAKE_CXX_FLAGS_MINSIZEREL} -DQT_NO_DEBUG_OUTPUT")
+endif()
 option(DISABLE_TRACKING "Disable tracking implementation" ON)
 
 # Extra executables to be built
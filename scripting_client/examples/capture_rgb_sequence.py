@@ -0,0 +1,34 @@
+from planetaryimager import PlanetaryImagerClient
+import sys
+
+# Same captures as capture_rgb.py, run by the server itself: no network round trips between them.
+# The filter is just a file name suffix here; with a filter wheel, move it where the sequence logs the filter.
+
+SEQUENCE = '''
+var profiles = [
+    { filter: 'R', exposure: 25000 },
+    { filter: 'G', exposure: 35000 },
+    { filter: 'B', exposure: 65000 },
+];
+var rounds = ROUNDS;
+pi.setConfiguration('recording_limit_type', 2);
+pi.setConfiguration('recording_seconds_limit', 60);
+pi.setConfiguration('save_file_prefix', 'Mars');
+for (var round = 0; round < rounds && !pi.aborted(); round++) {
+    for (var i = 0; i < profiles.length && !pi.aborted(); i++) {
+        var profile = profiles[i];
+        pi.log('Round ' + (round + 1) + ', filter ' + profile.filter);
+        pi.setControl('Exposure', profile.exposure);
+        pi.setConfiguration('save_file_suffix', profile.filter);
+        pi.log('Recorded ' + pi.record());
+    }
+}
+'done'
+'''
+
+rounds = int(sys.argv[1]) if len(sys.argv) > 1 else 1
+planetary_imager = PlanetaryImagerClient()
+try:
+    print(planetary_imager.run_sequence(SEQUENCE.replace('ROUNDS', str(rounds)), name='capture_rgb_sequence.js'))
+except KeyboardInterrupt:
+    planetary_imager.abort_sequence()
@@ -34,6 +34,11 @@ class Capture:
 
         - on_dropped_frames: Sets a callback function to be invoked when receiving dropped frames info.
            - Callbacks signature: function(int)
+
+        - on_write_throughput: Sets a callback function to be invoked when receiving write throughput info.
+           - Callbacks signature: function(float), bytes per second
+
+    The server sends all of these together a few times per second, not once per frame.
     """
     def __init__(self, client):
         """Mean fps on saving frames."""
@@ -44,6 +49,14 @@ class Capture:
         self.saved_frames = 0
         """Total frames dropped."""
         self.dropped_frames = 0
+        """Bytes per second written to disk."""
+        self.write_throughput = 0
+        """Recording queue usage in bytes: current, peak, and maximum allowed."""
+        self.queue_usage = (0, 0, 0)
+        """Pre-trigger ring buffer fill level, while waiting for a trigger: (bytes, seconds)."""
+        self.pretrigger_buffer = (0, 0)
+        """Burst to RAM recordings: bytes in memory still to be written, and bytes of memory left."""
+        self.deferred_writes = (0, 0)
         """Boolean flag to indicate if Planetary Imager is currently recording."""
         self.is_recording = False
         self.__recording_filename = None
@@ -54,10 +67,7 @@ class Capture:
 
         self.__saveprotocol.on_signal_recording(self.__handle_signal_start_recording)
         self.__saveprotocol.on_signal_end_recording(self.__handle_signal_end_recording)
-        self.__saveprotocol.on_signal_mean_fps(self.__handle_mean_fps)
-        self.__saveprotocol.on_signal_save_fps(self.__handle_save_fps)
-        self.__saveprotocol.on_signal_saved_frames(self.__handle_saved_frames)
-        self.__saveprotocol.on_signal_dropped_frames(self.__handle_dropped_frames)
+        self.__saveprotocol.on_signal_recording_status(self.__handle_recording_status)
 
     def start_recording(self):
         self.__saveprotocol.start_recording()
@@ -71,6 +81,12 @@ class Capture:
     def resume(self):
         self.__saveprotocol.set_paused(False)
 
+    def trigger(self, event=None):
+        """Pre-trigger recording: saves the frames buffered in memory, and the following ones.
+
+        An optional event dict (for instance {'x': 120, 'y': 80}) is logged into the recording information."""
+        self.__saveprotocol.trigger(event)
+
     @property
     def recording_filename(self):
         return self.__recording_filename
@@ -81,6 +97,9 @@ class Capture:
         self.save_fps = 0
         self.saved_frames = 0
         self.dropped_frames = 0
+        self.write_throughput = 0
+        self.queue_usage = (0, 0, 0)
+        self.deferred_writes = (0, 0)
 
         self.__recording_filename = filename
         self.__invoke_callback('on_recording_started', filename)
@@ -90,21 +109,28 @@ class Capture:
         self.__recording_filename = None
         self.__invoke_callback('on_recording_finished')
 
-    def __handle_mean_fps(self, fps):
-        self.mean_save_fps = fps
-        self.__invoke_callback('on_save_mean_fps', fps)
-
-    def __handle_save_fps(self, fps):
-        self.save_fps = fps
-        self.__invoke_callback('on_save_fps', fps)
-
-    def __handle_saved_frames(self, frames):
-        self.saved_frames = frames
-        self.__invoke_callback('on_saved_frames', frames)
-
-    def __handle_dropped_frames(self, frames):
-        self.dropped_frames = frames
-        self.__invoke_callback('on_dropped_frames', frames)
+    def __handle_recording_status(self, status):
+        if 'saveFPS' in status:
+            self.save_fps = status['saveFPS']
+            self.__invoke_callback('on_save_fps', self.save_fps)
+        if 'meanFPS' in status:
+            self.mean_save_fps = status['meanFPS']
+            self.__invoke_callback('on_save_mean_fps', self.mean_save_fps)
+        if 'savedFrames' in status:
+            self.saved_frames = status['savedFrames']
+            self.__invoke_callback('on_saved_frames', self.saved_frames)
+        if 'droppedFrames' in status:
+            self.dropped_frames = status['droppedFrames']
+            self.__invoke_callback('on_dropped_frames', self.dropped_frames)
+        if 'queueBytes' in status:
+            self.queue_usage = (status['queueBytes'], status.get('queuePeakBytes', 0), status.get('queueMaxBytes', 0))
+        if 'writeThroughput' in status:
+            self.write_throughput = status['writeThroughput']
+            self.__invoke_callback('on_write_throughput', self.write_throughput)
+        if 'preTriggerBytes' in status:
+            self.pretrigger_buffer = (status['preTriggerBytes'], status.get('preTriggerSeconds', 0))
+        if 'deferredPendingBytes' in status:
+            self.deferred_writes = (status['deferredPendingBytes'], status.get('deferredAvailableBytes', 0))
 
     def __invoke_callback(self, name, *args, **kwargs):
         if name in self.callbacks:
@@ -0,0 +1,42 @@
+import time
+from .network import FocusProtocol
+
+
+class Focus:
+    """Focus measurements of Planetary Imager, for autofocus routines.
+
+    The server measures a focus metric on every frame it can (see the `focus_assist` configuration entries):
+    'laplacian' or 'brenner' for extended targets, where higher is sharper, 'hfd' or 'fwhm' for stars, where lower is sharper.
+
+    Each measurement is a dict with 'sequence' (frame number), 'time' (capture time, milliseconds since epoch),
+    'metric' and 'value', and for stars 'x' and 'y', the star centroid in frame pixels.
+    """
+    def __init__(self, client):
+        self.focus_protocol = FocusProtocol(client)
+        self.last_sequence = 0
+
+    def measurements(self):
+        """Measurements since the previous call, oldest first."""
+        measurements = self.focus_protocol.get(after=self.last_sequence)
+        if measurements:
+            self.last_sequence = measurements[-1]['sequence']
+        return measurements
+
+    def measure(self, frames=10, timeout=10):
+        """Waits for the measurements of the next frames, and returns their median value.
+
+        Call it after each focuser move has completed, so that frames taken meanwhile are left out.
+
+        :param frames: number of frames to measure (default: 10).
+        :param timeout: seconds to wait for them (default: 10), raises TimeoutError past it.
+        """
+        self.measurements()
+        values = []
+        started = time.time()
+        while len(values) < frames:
+            if time.time() - started > timeout:
+                raise TimeoutError('Got {} focus measurements out of {}: is focus assist enabled?'.format(len(values), frames))
+            values += [measurement['value'] for measurement in self.measurements()]
+            time.sleep(0.05)
+        values = sorted(values[:frames])
+        return values[len(values) // 2]
@@ -1,4 +1,5 @@
-from .network import DriverProtocol
+import collections
+from .network import DriverProtocol, StatusProtocol
 
 def check_connection(f):
     def wrap(*args, **kwargs):
@@ -22,6 +23,7 @@ class Imager:
         self.fps = None
         self.temperature = None
         self.driver_protocol = DriverProtocol(client)
+        self.status_protocol = StatusProtocol(client)
         self.driver_protocol.on_signal_fps(self.__on_fps)
         self.driver_protocol.on_signal_temperature(self.__on_temperature)
         self.driver_protocol.on_control_changed(self.__on_control_changed)
@@ -89,6 +91,36 @@ class Imager:
         """Clear the previously set ROI."""
         self.driver_protocol.clear_roi()
 
+    @check_connection
+    def frames(self, force8bit=False, max_frame_rate=0, timeout=30):
+        """Receive the live frames, as raw uncompressed images.
+
+        This is a generator: frames are requested to the server when iterating starts, and no more are sent
+        once it's closed (i.e. the loop ends)::
+
+            for frame in imager.frames(max_frame_rate=5):
+                analyse(frame.image)
+
+        Every frame is a Frame tuple as in `shared_frames`, its image a numpy array on the received data,
+        without copies. The server sends frames as fast as they're acknowledged: slow consumers get fewer frames, not a backlog.
+
+        :param force8bit: have 16 bit frames scaled down to 8 bit by the server.
+        :param max_frame_rate: upper limit for frames per second (0: as many as the link allows).
+        :param timeout: seconds to wait for each frame before raising an error (None: forever).
+        """
+        # Frames received by other requests (i.e. pings) while waiting for their replies are queued here
+        received = collections.deque()
+        self.driver_protocol.on_frame(received.append)
+        self.status_protocol.hello(frames=True, force8bit=force8bit, max_frame_rate=max_frame_rate)
+        try:
+            while True:
+                while received:
+                    yield received.popleft()
+                yield self.driver_protocol.wait_frame(timeout)
+        finally:
+            self.status_protocol.hello()
+            self.driver_protocol.remove_frame_callback()
+
     @property
     @check_connection
     def properties(self):
@@ -5,5 +5,9 @@ from .status_protocol import StatusProtocol
 from .driver_protocol import DriverProtocol
 from .configuration_protocol import ConfigurationProtocol
 from .save_protocol import SaveProtocol
+from .focus_protocol import FocusProtocol
+from .filesystem_protocol import FilesystemProtocol
+from .sequence_protocol import SequenceProtocol
 
 from .client import Client
+from .async_client import AsyncClient
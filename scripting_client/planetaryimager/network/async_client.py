@@ -0,0 +1,131 @@
+import asyncio
+from . import NetworkPacket, StatusProtocol, DriverProtocol, ConfigurationProtocol
+from . import controls_codec
+from .driver_protocol import Camera
+
+
+class AsyncClient:
+    """asyncio client, with any number of requests in flight.
+
+    Every request is tagged with an id, which the server copies to its reply: replies are matched to their
+    requests whatever their order, so independent requests don't wait for each other's round trip::
+
+        client = AsyncClient('telescope.local', 19232)
+        await client.connect()
+        controls, properties, exposure = await asyncio.gather(client.controls(), client.properties(), client.setting('exposure'))
+
+    Packets that aren't replies to a request go to the handlers added with add_handler.
+    """
+    def __init__(self, host, port):
+        self.host = host
+        self.port = port
+        self.handlers = {}
+        self.__reader = None
+        self.__writer = None
+        self.__reader_task = None
+        self.__pending = {}
+        self.__last_request_id = 0
+        # Only used as packet factories
+        self.__status = StatusProtocol(self)
+        self.__driver = DriverProtocol(self)
+        self.__configuration = ConfigurationProtocol(self)
+
+    async def connect(self):
+        self.__reader, self.__writer = await asyncio.open_connection(self.host, self.port)
+        self.__reader_task = asyncio.ensure_future(self.__read_packets())
+        return (await self.request(self.__status.packet_hello.packet(variant={
+            'format': 2,
+            'compression': False,
+            'force8bit': False,
+            'jpegQuality': 10,
+        }), self.__status.packet_helloreply)).named_tuple
+
+    async def disconnect(self):
+        if not self.connected:
+            return
+        self.__writer.close()
+        await self.__reader_task
+        self.__writer = None
+
+    @property
+    def connected(self):
+        return self.__writer is not None
+
+    def send(self, packet):
+        """Sends packet without waiting for anything: requests sent this way get untagged replies, dispatched to the handlers."""
+        if not self.connected:
+            raise RuntimeError('Not connected')
+        if self.__reader_task.done():
+            raise ConnectionError('Connection to PlanetaryImager closed')
+        self.__writer.write(packet.to_bytes())
+
+    async def request(self, packet, expected, timeout=30):
+        """Sends packet, and returns its reply, of the `expected` type."""
+        # 0 means "no request": skipped on wrap around, as the server does
+        self.__last_request_id = self.__last_request_id % 0xFFFFFFFF + 1
+        packet.request_id = self.__last_request_id
+        reply = asyncio.get_event_loop().create_future()
+        self.__pending[packet.request_id] = reply
+        try:
+            self.send(packet)
+            received = await asyncio.wait_for(reply, timeout)
+        finally:
+            self.__pending.pop(packet.request_id, None)
+        if received.name != expected.packet_name:
+            raise RuntimeError('Unexpected reply: expecting {}, got {}'.format(expected.packet_name, received.name))
+        return received
+
+    def add_handler(self, callback, name=None, packet=None):
+        if name is None and packet is not None:
+            name = packet.packet_name
+        self.handlers[name] = callback
+
+    def remove_handler(self, name=None, packet=None):
+        if name is None and packet is not None:
+            name = packet.packet_name
+        self.handlers.pop(name, None)
+
+    async def ping(self):
+        await self.request(self.__status.packet_ping.packet(), self.__status.packet_pong)
+
+    async def camera_list(self):
+        reply = await self.request(self.__driver.packet_cameralist.packet(), self.__driver.packet_cameralistreply)
+        return [Camera(x) for x in reply.variant]
+
+    async def camera_name(self):
+        return (await self.request(self.__driver.packet_getcameraname.packet(), self.__driver.packet_getcameranamereply)).variant
+
+    async def controls(self):
+        reply = await self.request(self.__driver.packet_getcontrols.packet(), self.__driver.packet_getcontrolsreply)
+        return [dict(control) for control in controls_codec.decode(bytes(reply.payload))]
+
+    async def properties(self):
+        return (await self.request(self.__driver.packet_getproperties.packet(), self.__driver.packet_getpropertiesreply)).variant
+
+    async def setting(self, name):
+        return (await self.request(self.__configuration.packet_get.packet(variant=name), self.__configuration.packet_getreply)).variant
+
+    def set_control(self, control):
+        self.send(self.__driver.packet_setcontrol.packet(payload=controls_codec.encode([control])))
+
+    def set_setting(self, name, value):
+        self.send(self.__configuration.packet_set.packet(variant={'name': name, 'value': value}))
+
+    async def __read_packets(self):
+        try:
+            while True:
+                packet = NetworkPacket()
+                await packet.receive_from_stream(self.__reader)
+                reply = self.__pending.pop(packet.request_id, None) if packet.request_id else None
+                if reply is not None:
+                    if not reply.done():
+                        reply.set_result(packet)
+                elif packet.name in self.handlers:
+                    self.handlers[packet.name](packet)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            for reply in self.__pending.values():
+                if not reply.done():
+                    reply.set_exception(ConnectionError('Connection to PlanetaryImager closed'))
+            self.__pending.clear()
@@ -9,19 +9,28 @@ class Client:
         self.host = host
         self.port = port
         self.__sock = None
-        self.__sock_lock = threading.RLock()
+        # Separate locks: sending (pings, frame acknowledgements) must not wait for a large frame being received
+        self.__send_lock = threading.RLock()
+        self.__receive_lock = threading.RLock()
         self.handlers = {}
         self.interval = Interval(daemon=True)
 
     def connect(self):
-        with self.__sock_lock:
+        with self.__send_lock, self.__receive_lock:
             self.__sock = socket.create_connection((self.host, self.port))
         self.interval.start(2, self.__ping)
 
     def round_trip(self, packet, expected, timeout=30):
         self.send(packet)
-        sent = time.time()
-        while time.time() - sent < timeout:
+        return self.wait_for(expected, timeout)
+
+    def wait_for(self, expected, timeout=30):
+        """Handles incoming packets until one of the `expected` type arrives, and returns it.
+
+        A `timeout` of None waits forever.
+        """
+        started = time.time()
+        while timeout is None or time.time() - started < timeout:
             received = self.receive()
             if received.name == expected.packet_name:
                 return received
@@ -30,14 +39,14 @@ class Client:
 
     def send(self, packet):
         self.__check_connection()
-        with self.__sock_lock:
+        with self.__send_lock:
             if not self.connected:
                 raise RuntimeError('not connected')
             packet.send_to(self.__sock)
 
     def receive(self):
         self.__check_connection()
-        with self.__sock_lock:
+        with self.__receive_lock:
             received = NetworkPacket()
             received.receive_from(self.__sock)
             return received
@@ -47,7 +56,7 @@ class Client:
             return
 
         self.interval.stop()
-        with self.__sock_lock:
+        with self.__send_lock:
             self.__sock.shutdown(socket.SHUT_RDWR)
             self.__sock.close()
         self.__sock = None
@@ -0,0 +1,211 @@
+"""Compact binary encoding of camera controls, as in src/network/protocol/controlscodec.h.
+
+Controls are dictionaries with the keys used since the first protocol version: id, name, val, def, type, min, max, step,
+choices (a list of label/val dictionaries), decimals, is_duration, has_auto, is_auto, ro, duration_unit, and is_exposure,
+has_onoff, is_onoff.
+"""
+import struct
+
+VERSION = 1
+
+VARINT, DOUBLE, BYTES = 0, 1, 2
+ID, NAME, VALUE, DEFAULT, TYPE, MIN, MAX, STEP, CHOICE, DECIMALS, FLAGS, DURATION_UNIT, VALUE_FLAGS = range(1, 14)
+CHOICE_LABEL, CHOICE_VALUE = 1, 2
+FLAGS_KEYS = [('is_duration', 1), ('has_auto', 2), ('ro', 4), ('is_exposure', 8), ('has_onoff', 16)]
+VALUE_FLAGS_KEYS = [('is_auto', 1), ('is_onoff', 2)]
+
+
+class _Writer:
+    def __init__(self):
+        self.data = bytearray()
+
+    def varint(self, value):
+        while value >= 0x80:
+            self.data.append((value & 0x7f) | 0x80)
+            value >>= 7
+        self.data.append(value)
+
+    def key(self, field, wire):
+        self.varint(field << 3 | wire)
+
+    def integer(self, field, value):
+        value = int(value)
+        self.key(field, VARINT)
+        self.varint(((value << 1) ^ (value >> 63)) & 0xffffffffffffffff)
+
+    def bytes(self, field, value):
+        self.key(field, BYTES)
+        self.varint(len(value))
+        self.data += value
+
+    def typed(self, field, value):
+        if value is None:
+            return
+        if isinstance(value, float):
+            self.key(field, DOUBLE)
+            self.data += struct.pack('<d', value)
+        elif isinstance(value, str):
+            self.bytes(field, value.encode('utf-8'))
+        else:
+            self.integer(field, value)
+
+
+class _Reader:
+    def __init__(self, data):
+        self.data = bytes(data)
+        self.position = 0
+
+    def at_end(self):
+        return self.position >= len(self.data)
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            if self.position >= len(self.data) or shift >= 64:
+                raise ValueError('Truncated varint')
+            byte = self.data[self.position]
+            self.position += 1
+            value |= (byte & 0x7f) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+
+    def integer(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def real(self):
+        if self.position + 8 > len(self.data):
+            raise ValueError('Truncated double')
+        value = struct.unpack_from('<d', self.data, self.position)[0]
+        self.position += 8
+        return value
+
+    def bytes(self):
+        size = self.varint()
+        if self.position + size > len(self.data):
+            raise ValueError('Truncated field')
+        value = self.data[self.position:self.position + size]
+        self.position += size
+        return value
+
+    def typed(self, wire):
+        return {VARINT: self.integer, DOUBLE: self.real, BYTES: lambda: self.bytes().decode('utf-8')}[wire]()
+
+    def fields(self):
+        """(field, wire) pairs: the caller reads each payload, or calls skip(wire)."""
+        while not self.at_end():
+            key = self.varint()
+            yield key >> 3, key & 0x7
+
+    def skip(self, wire):
+        if wire not in (VARINT, DOUBLE, BYTES):
+            raise ValueError('Unknown wire type {}'.format(wire))
+        {VARINT: self.varint, DOUBLE: self.real, BYTES: self.bytes}[wire]()
+
+
+def _message(controls, encode):
+    writer = _Writer()
+    writer.data.append(VERSION)
+    writer.varint(len(controls))
+    for control in controls:
+        fields = _Writer()
+        encode(fields, control)
+        writer.varint(len(fields.data))
+        writer.data += fields.data
+    return bytes(writer.data)
+
+
+def _messages(data):
+    data = bytes(data)
+    if not data or data[0] != VERSION:
+        raise ValueError('Unsupported controls encoding')
+    reader = _Reader(data)
+    reader.position = 1
+    for _ in range(reader.varint()):
+        yield _Reader(reader.bytes())
+
+
+def _flags(control, keys):
+    return sum(bit for key, bit in keys if control.get(key))
+
+
+def encode(controls):
+    """Full descriptors, as sent with SetControl."""
+    def encode_control(writer, control):
+        writer.integer(ID, control['id'])
+        writer.bytes(NAME, control.get('name', '').encode('utf-8'))
+        writer.typed(VALUE, control.get('val'))
+        writer.typed(DEFAULT, control.get('def'))
+        writer.integer(TYPE, control.get('type', 0))
+        writer.typed(MIN, control.get('min'))
+        writer.typed(MAX, control.get('max'))
+        writer.typed(STEP, control.get('step'))
+        for choice in control.get('choices', []):
+            fields = _Writer()
+            fields.bytes(CHOICE_LABEL, choice['label'].encode('utf-8'))
+            fields.typed(CHOICE_VALUE, choice.get('val'))
+            writer.bytes(CHOICE, fields.data)
+        writer.integer(DECIMALS, control.get('decimals', 0))
+        writer.integer(FLAGS, _flags(control, FLAGS_KEYS))
+        writer.key(DURATION_UNIT, DOUBLE)
+        writer.data += struct.pack('<d', float(control.get('duration_unit', 0)))
+        writer.integer(VALUE_FLAGS, _flags(control, VALUE_FLAGS_KEYS))
+    return _message(controls, encode_control)
+
+
+def decode(data):
+    """Full descriptors, as in GetControlsReply and in the imager changes."""
+    controls = []
+    for reader in _messages(data):
+        control = {'choices': []}
+        for field, wire in reader.fields():
+            if field == CHOICE and wire == BYTES:
+                choice_reader, choice = _Reader(reader.bytes()), {}
+                for choice_field, choice_wire in choice_reader.fields():
+                    if choice_field == CHOICE_LABEL and choice_wire == BYTES:
+                        choice['label'] = choice_reader.bytes().decode('utf-8')
+                    elif choice_field == CHOICE_VALUE:
+                        choice['val'] = choice_reader.typed(choice_wire)
+                    else:
+                        choice_reader.skip(choice_wire)
+                control['choices'].append(choice)
+            elif field == NAME and wire == BYTES:
+                control['name'] = reader.bytes().decode('utf-8')
+            elif field in (VALUE, DEFAULT, MIN, MAX, STEP):
+                control[{VALUE: 'val', DEFAULT: 'def', MIN: 'min', MAX: 'max', STEP: 'step'}[field]] = reader.typed(wire)
+            elif field == DURATION_UNIT and wire == DOUBLE:
+                control['duration_unit'] = reader.real()
+            elif wire == VARINT and field in (ID, TYPE, DECIMALS):
+                control[{ID: 'id', TYPE: 'type', DECIMALS: 'decimals'}[field]] = reader.integer()
+            elif wire == VARINT and field in (FLAGS, VALUE_FLAGS):
+                flags = reader.integer()
+                for key, bit in FLAGS_KEYS if field == FLAGS else VALUE_FLAGS_KEYS:
+                    control[key] = bool(flags & bit)
+            else:
+                reader.skip(wire)
+        controls.append(control)
+    return controls
+
+
+def apply_values(data, known):
+    """Applies value only changes to the known controls (a dictionary by id), returning the updated ones."""
+    changed = []
+    for reader in _messages(data):
+        values = {'val': None}
+        for field, wire in reader.fields():
+            if field == VALUE:
+                values['val'] = reader.typed(wire)
+            elif wire == VARINT and field == ID:
+                values['id'] = reader.integer()
+            elif wire == VARINT and field == VALUE_FLAGS:
+                flags = reader.integer()
+                for key, bit in VALUE_FLAGS_KEYS:
+                    values[key] = bool(flags & bit)
+            else:
+                reader.skip(wire)
+        control = known.get(values.get('id'))
+        if control is not None:
+            control.update(values)
+            changed.append(control)
+    return changed
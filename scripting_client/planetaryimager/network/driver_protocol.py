@@ -1,5 +1,32 @@
 from .protocol import *
+from . import controls_codec
+from ..shared_frames import Frame, COLOR_FORMATS
 import PyQt5
+import struct
+import numpy
+
+# SendRawFrame header (RawFrameHeader in src/network/protocol/driverprotocol.cpp), followed by the frame pixels
+# Version 3: then gain, temperature (NaN if unknown), driver sequence, ROI offset (-1 if unknown) and bin (0 if unknown)
+_RAW_FRAME_HEADER = struct.Struct('>BiiBBBdqQqddQiiH')
+_RAW_FRAME_VERSION = 3
+
+
+def decode_raw_frame(packet):
+    """Decodes a SendRawFrame packet into a Frame.
+
+    The image is a numpy array on the packet payload itself: no pixel is copied.
+    """
+    version, width, height, bpp, color_format, byte_order, exposure, created_utc, sequence, _, _, _, _, _, _, _ = _RAW_FRAME_HEADER.unpack_from(packet.payload)
+    if version != _RAW_FRAME_VERSION:
+        raise RuntimeError('Unsupported raw frame version: {}'.format(version))
+    channels = 3 if COLOR_FORMATS[color_format] in ('RGB', 'BGR') else 1
+    if bpp == 8:
+        dtype = numpy.uint8
+    else:
+        dtype = '<u2' if byte_order == 1 else '>u2'
+    shape = (height, width) if channels == 1 else (height, width, channels)
+    image = numpy.frombuffer(packet.payload, dtype, count=width * height * channels, offset=_RAW_FRAME_HEADER.size).reshape(shape)
+    return Frame(sequence, image, bpp, COLOR_FORMATS[color_format], exposure, created_utc)
 
 
 class Camera:
@@ -15,10 +42,14 @@ class Camera:
 
 
 @protocol(area='Driver', packets=['CameraList', 'CameraListReply', 'GetCameraName', 'GetCameraNameReply', 'ConnectCamera', 'ConnectCameraReply', \
-                                  'CloseCamera', 'signalDisconnected', 'signalCameraConnected', 'signalFPS', 'signalTemperature', 'signalControlChanged', \
+                                  'CloseCamera', 'signalDisconnected', 'signalCameraConnected', 'signalImagerChanges', \
                                   'GetControls', 'GetControlsReply', 'GetProperties', 'GetPropertiesReply', 'StartLive', 'StartLiveReply', 'SetControl', \
-                                  'SetROI', 'ClearROI'])
+                                  'SetROI', 'ClearROI', 'SendRawFrame', 'FrameReceived'])
 class DriverProtocol:
+    def __init__(self):
+        self.__changes_callbacks = {}
+        # Changes only carry values: these are the descriptors they apply to, by id
+        self.__controls = {}
 
     def camera_list(self):
         return [Camera(x) for x in self.client.round_trip(self.packet_cameralist.packet(), self.packet_cameralistreply).variant]
@@ -33,10 +64,12 @@ class DriverProtocol:
         return self.client.round_trip(self.packet_getcameraname.packet(), self.packet_getcameranamereply).variant
 
     def get_controls(self):
-        return self.client.round_trip(self.packet_getcontrols.packet(), self.packet_getcontrolsreply).variant
+        controls = controls_codec.decode(self.client.round_trip(self.packet_getcontrols.packet(), self.packet_getcontrolsreply).payload)
+        self.__controls = {control['id']: dict(control) for control in controls}
+        return controls
 
     def set_control(self, control):
-        self.client.send(self.packet_setcontrol.packet(variant=control))
+        self.client.send(self.packet_setcontrol.packet(payload=controls_codec.encode([control])))
 
     def set_roi(self, x, y, width, height):
         self.client.send(self.packet_setroi.packet(variant=PyQt5.QtCore.QRect(x, y, width, height)))
@@ -50,9 +83,53 @@ class DriverProtocol:
     def start_live(self):
         return self.client.round_trip(self.packet_startlive.packet(), self.packet_startlivereply)
 
+    def wait_frame(self, timeout=30):
+        """Waits for the next raw frame; the server only sends them after a Hello asking for them."""
+        packet = self.client.wait_for(self.packet_sendrawframe, timeout)
+        self.__frame_received()
+        return decode_raw_frame(packet)
+
+    def on_frame(self, callback):
+        """Raw frames arriving while waiting for other replies are passed to callback."""
+        def dispatch(packet):
+            self.__frame_received()
+            callback(decode_raw_frame(packet))
+        Protocol.register_packet_handler(self.client, self.packet_sendrawframe, dispatch)
+
+    def remove_frame_callback(self):
+        self.client.remove_handler(packet=self.packet_sendrawframe)
+
+    def __frame_received(self):
+        # The server paces frames on these acknowledgements, sending more only when the previous ones arrived
+        self.client.send(self.packet_framereceived.packet())
+
+    def __on_changes(self, key, callback):
+        """fps, temperature and controls changes come batched in one packet, every callback gets its own part."""
+        self.__changes_callbacks[key] = callback
+
+        def dispatch(packet):
+            changes = packet.variant
+            controls = []
+            if 'controls' in changes:
+                for control in controls_codec.decode(bytes(changes.pop('controls'))):
+                    self.__controls[control['id']] = control
+                    controls.append(dict(control))
+            if 'control_values' in changes:
+                controls += [dict(control) for control in controls_codec.apply_values(bytes(changes.pop('control_values')), self.__controls)]
+            if controls:
+                changes['controls'] = controls
+            for name, changes_callback in self.__changes_callbacks.items():
+                if name not in changes:
+                    continue
+                if name == 'controls':
+                    for control in changes[name]:
+                        changes_callback(control)
+                else:
+                    changes_callback(changes[name])
+        Protocol.register_packet_handler(self.client, self.packet_signalimagerchanges, dispatch)
+
     def on_signal_fps(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signalfps, dispatch)
+        self.__on_changes('fps', callback)
 
     def on_camera_connected(self, callback):
         def dispatch(_): callback()
@@ -63,10 +140,8 @@ class DriverProtocol:
         Protocol.register_packet_handler(self.client, self.packet_signaldisconnected, dispatch)
 
     def on_signal_temperature(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signaltemperature, dispatch)
+        self.__on_changes('temperature', callback)
 
     def on_control_changed(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signalcontrolchanged, dispatch)
+        self.__on_changes('controls', callback)
 
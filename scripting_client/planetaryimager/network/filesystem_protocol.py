@@ -0,0 +1,51 @@
+import os
+import struct
+import time
+import zlib
+from .protocol import *
+
+
+@protocol(area='Filesystem', packets=['ReadFile', 'ReadFileReply', 'ListDirectory', 'ListDirectoryReply'])
+class FilesystemProtocol:
+    ERROR = 1
+    END_OF_FILE = 2
+    GROWING = 4
+    CHUNK_SIZE = 1024 * 1024
+
+    def read_chunk(self, path, offset, size=CHUNK_SIZE):
+        """Reads a chunk of a file in the server save directory: returns (data, file_size, flags)."""
+        reply = self.client.round_trip(self.packet_readfile.packet(variant={'path': path, 'offset': offset, 'size': size}),
+                                       self.packet_readfilereply)
+        chunk_offset, file_size, crc, flags = struct.unpack('>QQII', bytes(reply.payload[:24]))
+        data = bytes(reply.payload[24:])
+        if flags & FilesystemProtocol.ERROR:
+            raise RuntimeError(data.decode('utf-8'))
+        if chunk_offset != offset or zlib.crc32(data) & 0xffffffff != crc:
+            raise RuntimeError('Corrupted chunk at offset {} of {}'.format(offset, path))
+        return data, file_size, flags
+
+    def list_directory(self, path, directories_only=False, patterns=None, page_size=200):
+        """Lists a server directory a page at a time, directories first: yields dicts with name, path, isFile and isDir.
+        patterns (i.e. ['*.ser']) filter file names on the server."""
+        offset = 0
+        while True:
+            listing = {'path': path, 'directoriesOnly': directories_only, 'patterns': patterns or [], 'offset': offset, 'limit': page_size}
+            reply = self.client.round_trip(self.packet_listdirectory.packet(variant=listing), self.packet_listdirectoryreply).variant
+            for entry in reply['entries']:
+                yield entry
+            offset += len(reply['entries'])
+            if not reply['entries'] or offset >= reply['total']:
+                return
+
+    def download(self, path, local_path, tail=False, poll_interval=1):
+        """Downloads path into local_path, resuming from an existing local file.
+        With tail, a file still being written is followed until the server stops reporting it as growing."""
+        with open(local_path, 'ab') as local_file:
+            while True:
+                data, file_size, flags = self.read_chunk(path, local_file.tell())
+                local_file.write(data)
+                if not flags & FilesystemProtocol.END_OF_FILE:
+                    continue
+                if not tail or not flags & FilesystemProtocol.GROWING:
+                    return local_file.tell()
+                time.sleep(poll_interval)
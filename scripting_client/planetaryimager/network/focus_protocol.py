@@ -0,0 +1,8 @@
+from .protocol import *
+
+
+@protocol(area='Focus', packets=['GetFocus', 'GetFocusReply'])
+class FocusProtocol:
+
+    def get(self, after=0):
+        return self.client.round_trip(self.packet_getfocus.packet(variant=after), self.packet_getfocusreply).variant
@@ -5,31 +5,63 @@ import collections
 class NetworkPacket:
     NAME_BYTES = 1
     PAYLOAD_LENGTH_BYTES = 4
+    REQUEST_ID_BYTES = 4
+    REQUEST_ID_FLAG = 0x80
 
     def __init__(self, name = None):
         self.name = name
         self.payload = bytearray()
+        self.request_id = 0
 
     def send_to(self, sock):
+        data = self.to_bytes()
+        sock.sendall(data)
+        return len(data)
+
+    def to_bytes(self):
         if self.name is None:
             raise RuntimeError('Name should be assigned before sending a packet')
         name_ba = self.name.encode('utf-8')
-        sent = 0
-        sent += sock.send(NetworkPacket.__num2hex(len(name_ba), NetworkPacket.NAME_BYTES))
-        sent += sock.send(name_ba)
-        sent += sock.send(NetworkPacket.__num2hex(len(self.payload), NetworkPacket.PAYLOAD_LENGTH_BYTES))
-        sent += sock.send(self.payload)
-        return sent
+        name_size = len(name_ba) | (NetworkPacket.REQUEST_ID_FLAG if self.request_id else 0)
+        data = bytearray(NetworkPacket.__num2hex(name_size, NetworkPacket.NAME_BYTES))
+        data += name_ba
+        if self.request_id:
+            data += NetworkPacket.__num2hex(self.request_id, NetworkPacket.REQUEST_ID_BYTES)
+        data += NetworkPacket.__num2hex(len(self.payload), NetworkPacket.PAYLOAD_LENGTH_BYTES)
+        data += self.payload
+        return data
 
     def receive_from(self, sock):
-        name_size = NetworkPacket.__hex2num(sock.recv(NetworkPacket.NAME_BYTES))
-        self.name = sock.recv(name_size).decode()
-        payload_size = NetworkPacket.__hex2num(sock.recv(NetworkPacket.PAYLOAD_LENGTH_BYTES))
-        self.payload = bytearray()
-        while len(self.payload) < payload_size:
-            remaining_bytes = payload_size - len(self.payload)
-            chunk_size = min(remaining_bytes, 1024)
-            self.payload += sock.recv(chunk_size)
+        name_size = NetworkPacket.__hex2num(NetworkPacket.__receive_exactly(sock, NetworkPacket.NAME_BYTES))
+        self.name = bytes(NetworkPacket.__receive_exactly(sock, name_size & ~NetworkPacket.REQUEST_ID_FLAG)).decode()
+        self.request_id = 0
+        if name_size & NetworkPacket.REQUEST_ID_FLAG:
+            self.request_id = NetworkPacket.__hex2num(NetworkPacket.__receive_exactly(sock, NetworkPacket.REQUEST_ID_BYTES))
+        payload_size = NetworkPacket.__hex2num(NetworkPacket.__receive_exactly(sock, NetworkPacket.PAYLOAD_LENGTH_BYTES))
+        # Frames are megabytes: read them straight into their final buffer, with no intermediate copies
+        self.payload = NetworkPacket.__receive_exactly(sock, payload_size)
+
+    async def receive_from_stream(self, reader):
+        """Same as receive_from, on an asyncio StreamReader."""
+        name_size = NetworkPacket.__hex2num(await reader.readexactly(NetworkPacket.NAME_BYTES))
+        self.name = (await reader.readexactly(name_size & ~NetworkPacket.REQUEST_ID_FLAG)).decode()
+        self.request_id = 0
+        if name_size & NetworkPacket.REQUEST_ID_FLAG:
+            self.request_id = NetworkPacket.__hex2num(await reader.readexactly(NetworkPacket.REQUEST_ID_BYTES))
+        payload_size = NetworkPacket.__hex2num(await reader.readexactly(NetworkPacket.PAYLOAD_LENGTH_BYTES))
+        self.payload = await reader.readexactly(payload_size)
+
+    @staticmethod
+    def __receive_exactly(sock, size):
+        buffer = bytearray(size)
+        view = memoryview(buffer)
+        received = 0
+        while received < size:
+            chunk = sock.recv_into(view[received:], size - received)
+            if not chunk:
+                raise ConnectionError('Connection closed by PlanetaryImager')
+            received += chunk
+        return buffer
 
     @property
     def named_tuple(self):
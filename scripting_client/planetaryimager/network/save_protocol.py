@@ -2,8 +2,7 @@ from .protocol import *
 
 
 @protocol(area='SaveFile', packets=['StartRecording', 'EndRecording', 'signalRecording', 'signalFinished',
-                                    'slotSetPaused', 'signalSaveFPS', 'signalMeanFPS', 'signalSavedFrames',
-                                    'signalDroppedFrames'])
+                                    'slotSetPaused', 'signalRecordingStatus', 'Trigger'])
 class SaveProtocol:
 
     def start_recording(self):
@@ -14,21 +13,10 @@ class SaveProtocol:
             callback(packet.variant)
         Protocol.register_packet_handler(self.client, self.packet_signalrecording, dispatch)
 
-    def on_signal_save_fps(self, callback):
+    def on_signal_recording_status(self, callback):
+        """Periodic recording status: a dict with only the values changed since the previous status."""
         def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signalsavefps, dispatch)
-
-    def on_signal_mean_fps(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signalmeanfps, dispatch)
-
-    def on_signal_saved_frames(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signalsavedframes, dispatch)
-
-    def on_signal_dropped_frames(self, callback):
-        def dispatch(packet): callback(packet.variant)
-        Protocol.register_packet_handler(self.client, self.packet_signaldroppedframes, dispatch)
+        Protocol.register_packet_handler(self.client, self.packet_signalrecordingstatus, dispatch)
 
     def end_recording(self):
         self.client.send(self.packet_endrecording.packet())
@@ -40,3 +28,9 @@ class SaveProtocol:
     def set_paused(self, paused):
         self.client.send(self.packet_slotsetpaused.packet(variant=paused))
 
+    def trigger(self, event=None):
+        if event:
+            self.client.send(self.packet_trigger.packet(variant=event))
+        else:
+            self.client.send(self.packet_trigger.packet())
+
@@ -0,0 +1,21 @@
+from .protocol import *
+
+
+@protocol(area='Sequence', packets=['RunSequence', 'RunSequenceReply', 'AbortSequence', 'signalSequenceLog', 'signalSequenceFinished'])
+class SequenceProtocol:
+
+    def run(self, script, name):
+        """Uploads a sequence script; returns an error message, or None when the server started it."""
+        reply = self.client.round_trip(self.packet_runsequence.packet(variant={'script': script, 'name': name}), self.packet_runsequencereply).variant
+        return None if reply['started'] else reply['error']
+
+    def abort(self):
+        self.client.send(self.packet_abortsequence.packet())
+
+    def on_log(self, callback):
+        def dispatch(packet): callback(packet.variant)
+        Protocol.register_packet_handler(self.client, self.packet_signalsequencelog, dispatch)
+
+    def wait_finished(self, timeout=None):
+        """Waits for the end of the running sequence: a dict with 'name', 'success' and 'result'."""
+        return self.client.wait_for(self.packet_signalsequencefinished, timeout).variant
@@ -2,12 +2,19 @@ from .protocol import *
 
 @protocol(area='Network', packets=['Hello', 'HelloReply', 'ping', 'pong'])
 class StatusProtocol:
-    def hello(self):
+    def hello(self, frames=False, force8bit=False, max_frame_rate=0):
+        """Greets the server, also setting which frames it sends to this client.
+
+        :param frames: receive raw, uncompressed frames (SendRawFrame packets); by default none are sent.
+        :param force8bit: have 16 bit frames scaled down to 8 bit before sending them.
+        :param max_frame_rate: upper limit for frames per second (0: as many as the link allows).
+        """
         packet = self.packet_hello.packet(variant={
-            'format': 2,
+            'format': 0 if frames else 2,
             'compression': False,
-            'force8bit': False,
-            'jpegQuality': 10
+            'force8bit': force8bit,
+            'jpegQuality': 10,
+            'maxFrameRate': float(max_frame_rate),
         })
 
         return self.client.round_trip(packet, self.packet_helloreply).named_tuple
@@ -2,10 +2,11 @@
 
 This module allows you to control Planetary Imager with a simple Python API interface.
 """
-from .network import Client, DriverProtocol, StatusProtocol
+from .network import Client, DriverProtocol, StatusProtocol, FilesystemProtocol, SequenceProtocol
 from .configuration import Configuration
 from .capture import Capture
 from .imager import Imager
+from .focus import Focus
 
 class PlanetaryImagerClient:
     """Main entrypoint for PlanetaryImager scripting.
@@ -19,6 +20,9 @@ class PlanetaryImagerClient:
      * imager: sets the current camera, and interact with it.
      * configuration: manage PlanetaryImager configuration.
      * capture: manage capturing to file.
+     * focus: focus measurements, for autofocus.
+     * download: copy a recording from the server save directory.
+     * run_sequence: run a JavaScript capture sequence on the server, with no round trips between its steps.
      * status: get current status.
      * disconnect: detach from PlanetaryImager instance.
     """
@@ -33,6 +37,7 @@ class PlanetaryImagerClient:
         self.__configuration = Configuration(self.client)
         self.__capture = Capture(self.client)
         self.__imager = Imager(self.client)
+        self.__focus = Focus(self.client)
         if autoconnect:
             self.connect()
 
@@ -74,7 +79,47 @@ class PlanetaryImagerClient:
         """Start and stops capture, monitoring capture status."""
         return self.__capture
 
+    @property
+    def focus(self):
+        """Focus measurements of the latest frames."""
+        return self.__focus
+
+    def download(self, remote_path, local_path, tail=False):
+        """Downloads a file from the server save directory, resuming from an existing local file.
 
+        :param remote_path: path of the file on the server, i.e. the file reported by capture when recording.
+        :param local_path: destination file.
+        :param tail: keep following a file still being written, until its recording ends (default: False).
+        :return: the size of the downloaded file.
+        """
+        return FilesystemProtocol(self.client).download(remote_path, local_path, tail=tail)
 
+    def run_sequence(self, script, name='sequence', wait=True, on_log=print, timeout=None):
+        """Runs a capture sequence on the server, next to the camera.
 
+        The script is JavaScript, calling the server through its global `pi` object: see SequenceRunner in the
+        Planetary Imager sources for the available calls.
 
+        :param script: the sequence source code.
+        :param name: shown in the server log and in error messages (default: 'sequence').
+        :param wait: wait for the sequence to end (default: True).
+        :param on_log: called with each line the script logs with pi.log (default: print).
+        :param timeout: seconds to wait for the end of the sequence (default: None, no timeout).
+        :return: the value of the script when waiting for it, raising RuntimeError if it failed; None otherwise.
+        """
+        sequence = SequenceProtocol(self.client)
+        if on_log:
+            sequence.on_log(on_log)
+        error = sequence.run(script, name)
+        if error:
+            raise RuntimeError(error)
+        if not wait:
+            return None
+        finished = sequence.wait_finished(timeout)
+        if not finished['success']:
+            raise RuntimeError(finished['result'])
+        return finished['result']
+
+    def abort_sequence(self):
+        """Stops the running capture sequence at its next call to the server."""
+        SequenceProtocol(self.client).abort()
@@ -0,0 +1,146 @@
+"""Zero copy access to the frames published by a local PlanetaryImager daemon.
+
+Start the daemon with ``--shared-memory-frames /planetaryimager-frames``, then::
+
+    from planetaryimager.shared_frames import SharedFrames
+    frames = SharedFrames('/planetaryimager-frames')
+    while True:
+        frame = frames.wait_next()
+        analyse(frame.image)          # numpy array mapped on the shared memory, no copies
+        if not frames.is_valid(frame):
+            print('frame overwritten while analysing it, results discarded')
+
+The layout is documented in src/image_handlers/backend/sharedmemoryframes.h.
+"""
+import mmap
+import os
+import struct
+import time
+from collections import namedtuple
+
+import numpy
+
+_HEADER = struct.Struct('=8sIIQQI')
+_SLOT = struct.Struct('=QIIBBBBIdqQ')
+_SEQUENCE = struct.Struct('=Q')
+_HEADER_SIZE = 64
+_SLOT_HEADER_SIZES = {1: 64, 2: 128}
+_LATEST_OFFSET = 24
+_FLAGS_OFFSET = 32
+_FLAG_STALE = 1
+
+COLOR_FORMATS = ['Mono', 'RGB', 'BGR', 'Bayer_RGGB', 'Bayer_GRBG', 'Bayer_GBRG', 'Bayer_BGGR']
+
+Frame = namedtuple('Frame', ['sequence', 'image', 'bpp', 'color_format', 'exposure', 'timestamp'])
+"""A published frame.
+
+ - sequence: frame number, increasing by one for every captured frame.
+ - image: numpy array (height x width, or height x width x channels), read only unless copied.
+ - bpp: bits per pixel (8 or 16).
+ - color_format: one of COLOR_FORMATS.
+ - exposure: exposure in seconds.
+ - timestamp: capture time, milliseconds since epoch (UTC).
+"""
+
+
+def _open_segment(name):
+    path = '/dev/shm/' + name.lstrip('/')
+    if os.path.exists(path):
+        return os.open(path, os.O_RDONLY)
+    import _posixshmem
+    return _posixshmem.shm_open('/' + name.lstrip('/'), os.O_RDONLY)
+
+
+class SharedFrames:
+    """Reader for the shared memory frames ring written by the daemon.
+
+    Images are mapped directly on the shared memory: they stay valid until the daemon writes
+    as many new frames as the ring holds. Use is_valid() after using them, or pass copy=True.
+    """
+    def __init__(self, name='/planetaryimager-frames'):
+        """Map the shared memory segment.
+
+        :param name: name given to the daemon with --shared-memory-frames.
+        """
+        self.name = name
+        self.__last_sequence = 0
+        self.__map = None
+        self.__open()
+
+    def __open(self):
+        fd = _open_segment(self.name)
+        try:
+            # No close: images still mapped on a previous segment keep it alive
+            self.__map = mmap.mmap(fd, os.fstat(fd).st_size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        magic, version, self.slots, self.slot_size, _, _ = _HEADER.unpack_from(self.__map, 0)
+        if magic != b'PIFRAMES' or version not in _SLOT_HEADER_SIZES:
+            raise RuntimeError('{} is not a PlanetaryImager frames segment'.format(self.name))
+        # Version 2 appends monotonic/device timestamps and camera metadata to the slot header, ignored here
+        self.__slot_header_size = _SLOT_HEADER_SIZES[version]
+
+    def __sequence_at(self, offset):
+        return _SEQUENCE.unpack_from(self.__map, offset)[0]
+
+    def __check_stale(self):
+        flags = struct.unpack_from('=I', self.__map, _FLAGS_OFFSET)[0]
+        if flags & _FLAG_STALE:
+            self.__open()
+
+    @property
+    def latest_sequence(self):
+        """Sequence number of the last complete frame (0: none yet)."""
+        self.__check_stale()
+        return self.__sequence_at(_LATEST_OFFSET)
+
+    def __slot_offset(self, sequence):
+        return _HEADER_SIZE + ((sequence - 1) % self.slots) * self.slot_size
+
+    def frame(self, sequence=None, copy=False):
+        """Get a frame, by default the latest one.
+
+        :param sequence: frame sequence number; it has to be one of the last frames kept in the ring.
+        :param copy: copy the image out of the shared memory, so that it can't be overwritten.
+        :return: a Frame, or None if not available (anymore).
+        """
+        if sequence is None:
+            sequence = self.latest_sequence
+        if sequence <= 0:
+            return None
+        offset = self.__slot_offset(sequence)
+        slot_sequence, width, height, bpp, channels, color_format, byte_order, _, exposure, timestamp, _ = _SLOT.unpack_from(self.__map, offset)
+        if slot_sequence != sequence:
+            return None
+        if bpp == 8:
+            dtype = numpy.uint8
+        else:
+            dtype = '<u2' if byte_order == 1 else '>u2'
+        shape = (height, width) if channels == 1 else (height, width, channels)
+        image = numpy.frombuffer(self.__map, dtype, count=width * height * channels, offset=offset + self.__slot_header_size).reshape(shape)
+        if copy:
+            image = image.copy()
+        if self.__sequence_at(offset) != sequence:
+            return None
+        return Frame(sequence, image, bpp, COLOR_FORMATS[color_format], exposure, timestamp)
+
+    def is_valid(self, frame):
+        """Check that the daemon didn't overwrite a frame image since it was obtained."""
+        return self.__sequence_at(self.__slot_offset(frame.sequence)) == frame.sequence
+
+    def wait_next(self, timeout=None, copy=False, poll_interval=0.001):
+        """Wait for a frame newer than the last one returned by this method.
+
+        :param timeout: seconds to wait (default: forever).
+        :return: the newest Frame, or None on timeout.
+        """
+        started = time.time()
+        while timeout is None or time.time() - started < timeout:
+            latest = self.latest_sequence
+            if latest > self.__last_sequence:
+                frame = self.frame(latest, copy=copy)
+                if frame is not None:
+                    self.__last_sequence = latest
+                    return frame
+            time.sleep(poll_interval)
+        return None
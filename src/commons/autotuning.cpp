@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "autotuning.h"
+#include "commons/pixel_kernels.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+#include <vector>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace {
+const qint64 MB = 1024 * 1024;
+// A full HD frame: what the display and network recommendations are sized for
+const double frame_pixels = 1920. * 1080.;
+// Displaying a frame costs about this many 16 to 8 bit conversions of it (debayer, scaling, painting)
+const double display_conversions = 10;
+
+qint64 physical_memory()
+{
+#if defined(Q_OS_WIN)
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  return GlobalMemoryStatusEx(&status) ? static_cast<qint64>(status.ullTotalPhys) : 0;
+#elif defined(_SC_PHYS_PAGES)
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGE_SIZE);
+  return pages > 0 && page_size > 0 ? static_cast<qint64>(pages) * page_size : 0;
+#else
+  return 0;
+#endif
+}
+
+double conversion_speed()
+{
+  typedef chrono::steady_clock Clock;
+  vector<uint16_t> source(static_cast<size_t>(frame_pixels));
+  vector<uint8_t> destination(source.size());
+  for(size_t index = 0; index < source.size(); index++)
+    source[index] = static_cast<uint16_t>(index * 2654435761u >> 16);
+  PixelKernels::to8bit(source.data(), destination.data(), source.size(), false);
+  size_t pixels = 0;
+  const auto started = Clock::now();
+  while(Clock::now() - started < chrono::milliseconds{200}) {
+    PixelKernels::to8bit(source.data(), destination.data(), source.size(), false);
+    pixels += source.size();
+  }
+  const chrono::duration<double> elapsed = Clock::now() - started;
+  return pixels / max(elapsed.count(), 1e-6);
+}
+}
+
+AutoTuning::Host AutoTuning::probe(const QString &save_directory)
+{
+  Host host;
+  host.cores = max(1, QThread::idealThreadCount());
+  host.simd = QString::fromLatin1(PixelKernels::implementation());
+  host.memory = physical_memory();
+  host.pixels_per_second = conversion_speed();
+  // Frames of a typical 16 bit full HD camera
+  host.disk = StorageProbe::run(save_directory, static_cast<qint64>(frame_pixels) * 2, chrono::seconds{2}, 512 * MB);
+  return host;
+}
+
+AutoTuning::Settings AutoTuning::recommend(const Host &host)
+{
+  Settings settings;
+  // A quarter of the RAM for the recording queue: the rest is for the system, the frame pools and the spool
+  settings.max_memory_usage = host.memory > 0 ? min(max(host.memory / 4, 256 * MB), 16 * 1024 * MB) : 1024 * MB;
+  // Disks this fast keep up with direct writes; slower ones (i.e. SD cards, USB sticks) do better with larger buffered writes
+  settings.buffered_output = ! (host.disk.valid() && host.disk.bytes_per_second >= 400 * MB);
+  // The display gets half a core for itself, a quarter on machines with one or two cores
+  const double display_share = host.cores > 2 ? 0.5 : 0.25;
+  const double display_fps = host.pixels_per_second / (frame_pixels * display_conversions) * display_share;
+  settings.max_display_fps = host.pixels_per_second > 0 ? min(max(static_cast<int>(display_fps), 10), 60) : 30;
+  settings.max_display_fps_recording = host.pixels_per_second > 0 ? min(max(settings.max_display_fps / 2, 5), 30) : 15;
+  settings.histogram_timeout = host.cores >= 8 ? 1000 : host.cores >= 4 ? 2000 : 4000;
+  settings.histogram_timeout_recording = settings.histogram_timeout * 2;
+  return settings;
+}
+
+AutoTuning::NetworkSettings AutoTuning::recommend(const Link &link)
+{
+  if(! link.valid())
+    return { Configuration::Network_JPEG, 85, 0 };
+  // Every frame is acknowledged before the next one is sent: at most one frame per round trip
+  const double fps = link.rtt.count() > 0 ? min(30., 1000. / link.rtt.count()) : 30.;
+  const double frame_bytes = link.bytes_per_second / fps;
+  if(frame_bytes >= frame_pixels)
+    return { Configuration::Network_RAW, 85, 0 };
+  if(frame_bytes >= 400 * 1024)
+    return { Configuration::Network_JPEG, 90, 0 };
+  if(frame_bytes >= 100 * 1024)
+    return { Configuration::Network_JPEG, 80, 1280 };
+  return { Configuration::Network_JPEG, 70, 800 };
+}
+
+void AutoTuning::apply(const Settings &settings, Configuration &configuration)
+{
+  configuration.set_max_memory_usage(settings.max_memory_usage);
+  configuration.set_buffered_output(settings.buffered_output);
+  configuration.set_max_display_fps(settings.max_display_fps);
+  configuration.set_max_display_fps_recording(settings.max_display_fps_recording);
+  configuration.set_histogram_timeout(settings.histogram_timeout);
+  configuration.set_histogram_timeout_recording(settings.histogram_timeout_recording);
+}
+
+void AutoTuning::apply(const NetworkSettings &settings, Configuration &configuration)
+{
+  configuration.set_server_image_format(settings.server_image_format);
+  configuration.set_server_jpeg_quality(settings.server_jpeg_quality);
+  configuration.set_server_preview_max_size(settings.server_preview_max_size);
+}
+
+void AutoTuning::configure(Configuration &configuration)
+{
+  const auto host = probe(configuration.save_directory());
+  qWarning() << "Auto configuration:" << host.cores << "cores," << host.simd << "kernels at" << host.pixels_per_second / 1e6 << "Mpixels/s,"
+             << host.memory / MB << "MB of RAM, save directory at" << host.disk.bytes_per_second / MB << "MB/s" << host.disk.error;
+  const auto settings = recommend(host);
+  apply(settings, configuration);
+  qWarning() << "Auto configuration settings:" << values(settings);
+}
+
+QVariantMap AutoTuning::values(const Settings &settings)
+{
+  return {
+    {"max_memory_usage", settings.max_memory_usage},
+    {"buffered_output", settings.buffered_output},
+    {"max_display_fps", settings.max_display_fps},
+    {"max_display_fps_recording", settings.max_display_fps_recording},
+    {"histogram_timeout", settings.histogram_timeout},
+    {"histogram_timeout_recording", settings.histogram_timeout_recording},
+  };
+}
+
+QVariantMap AutoTuning::values(const NetworkSettings &settings)
+{
+  return {
+    {"server_image_format", static_cast<int>(settings.server_image_format)},
+    {"server_jpeg_quality", settings.server_jpeg_quality},
+    {"server_preview_max_size", settings.server_preview_max_size},
+  };
+}
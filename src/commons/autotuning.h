@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef AUTOTUNING_H
+#define AUTOTUNING_H
+
+#include "commons/configuration.h"
+#include "commons/storageprobe.h"
+#include <QString>
+#include <QVariantMap>
+#include <chrono>
+
+/**
+ * Performance settings recommended for this machine, instead of static defaults tuned by hand on every new capture node.
+ * probe() measures the cores, the pixel kernels implementation and their speed, the RAM and the save directory throughput (see StorageProbe);
+ * clients measure the link to a daemon (see NetworkClient::probeLink). recommend() maps the measures to settings, and apply() writes them.
+ * Running it again measures again: results only depend on the last run.
+ */
+namespace AutoTuning {
+  struct Host {
+    int cores = 1;
+    /// See PixelKernels::implementation
+    QString simd;
+    /// Physical RAM, 0 if unknown
+    qint64 memory = 0;
+    /// 16 to 8 bit conversions on a single core, the main cost of displaying a frame
+    double pixels_per_second = 0;
+    StorageProbe::Result disk;
+  };
+  struct Link {
+    /// Daemon to client throughput, 0 if unknown
+    double bytes_per_second = 0;
+    std::chrono::duration<double, std::milli> rtt{0};
+    bool valid() const { return bytes_per_second > 0; }
+  };
+
+  struct Settings {
+    long long max_memory_usage;
+    bool buffered_output;
+    int max_display_fps;
+    int max_display_fps_recording;
+    long long histogram_timeout;
+    long long histogram_timeout_recording;
+  };
+  struct NetworkSettings {
+    Configuration::NetworkImageFormat server_image_format;
+    int server_jpeg_quality;
+    int server_preview_max_size;
+  };
+
+  /// Measures this machine, writing for a few seconds in save_directory. Blocking: meant for startup, or a background thread
+  Host probe(const QString &save_directory);
+  Settings recommend(const Host &host);
+  NetworkSettings recommend(const Link &link);
+  void apply(const Settings &settings, Configuration &configuration);
+  void apply(const NetworkSettings &settings, Configuration &configuration);
+  /// Probes this machine, writing in the configured save directory, and applies the recommended settings, logging both. Blocking
+  void configure(Configuration &configuration);
+  /// By setting name, for logs and clients
+  QVariantMap values(const Settings &settings);
+  QVariantMap values(const NetworkSettings &settings);
+}
+
+#endif // AUTOTUNING_H
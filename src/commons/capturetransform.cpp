@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "capturetransform.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <boost/endian/conversion.hpp>
+#include <opencv2/opencv.hpp>
+#include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/pixel_kernels.h"
+
+using namespace std;
+
+// Output rows per parallel stripe
+#define CAPTURE_TRANSFORM_STRIPE_ROWS 16
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+
+bool is_bayer(Frame::ColorFormat color_format) {
+  return color_format != Frame::Mono && color_format != Frame::RGB && color_format != Frame::BGR;
+}
+
+/**
+ * Bins source (already cropped) into destination, bin x bin samples per output value.
+ * Samples of an output value are 'stride' pixels apart: 1, or 2 for Bayer frames, where the output keeps the 2x2 pattern.
+ * Output value (x, y) reads columns (x / stride) * bin * stride + x % stride + k * stride, and the same for rows.
+ */
+template<typename T>
+void bin_image(const cv::Mat &source, cv::Mat &destination, int bin, int stride, bool swap, CaptureTransform::Mode mode) {
+  const int channels = source.channels();
+  const size_t source_values = static_cast<size_t>(source.cols) * channels;
+  const uint32_t samples = bin * bin;
+  const uint32_t max_value = numeric_limits<T>::max();
+  const int stripes = (destination.rows + CAPTURE_TRANSFORM_STRIPE_ROWS - 1) / CAPTURE_TRANSFORM_STRIPE_ROWS;
+  cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+    vector<uint32_t> sums(source_values);
+    vector<uint16_t> swapped(swap ? source_values : 0);
+    const int first = stripe * CAPTURE_TRANSFORM_STRIPE_ROWS;
+    const int last = min(destination.rows, first + CAPTURE_TRANSFORM_STRIPE_ROWS);
+    for(int y = first; y < last; y++) {
+      // Vertical pass: whole rows at once, vectorised
+      fill(sums.begin(), sums.end(), 0);
+      const int source_y = (y / stride) * bin * stride + y % stride;
+      for(int k = 0; k < bin; k++) {
+        const T *row = source.ptr<T>(source_y + k * stride);
+        if(swap) {
+          PixelKernels::swap16(reinterpret_cast<const uint16_t*>(row), swapped.data(), source_values);
+          row = reinterpret_cast<const T*>(swapped.data());
+        }
+        PixelKernels::accumulate(row, sums.data(), source_values);
+      }
+      // Horizontal pass: one output value every bin input values
+      T *output = destination.ptr<T>(y);
+      for(int x = 0; x < destination.cols; x++) {
+        const int source_x = (x / stride) * bin * stride + x % stride;
+        for(int channel = 0; channel < channels; channel++) {
+          uint32_t sum = 0;
+          for(int k = 0; k < bin; k++)
+            sum += sums[(source_x + k * stride) * channels + channel];
+          output[x * channels + channel] = static_cast<T>(mode == CaptureTransform::Sum ? min(sum, max_value) : (sum + samples / 2) / samples);
+        }
+      }
+    }
+  }});
+}
+}
+
+FramePtr CaptureTransform::apply(const FramePtr &frame, const Settings &settings, const FramePoolPtr &pool)
+{
+  if(! settings.active())
+    return frame;
+  const cv::Mat &image = frame->mat();
+  const bool bayer = is_bayer(frame->colorFormat());
+  cv::Rect rect{0, 0, image.cols, image.rows};
+  if(! settings.roi.isEmpty()) {
+    rect &= cv::Rect{settings.roi.x(), settings.roi.y(), settings.roi.width(), settings.roi.height()};
+    if(bayer) {
+      // Even offsets keep the bayer pattern of the cropped frame unchanged
+      rect.x &= ~1;
+      rect.y &= ~1;
+    }
+  }
+  const int bin = max(1, min(settings.bin, 4));
+  const int stride = bayer ? 2 : 1;
+  const int cell = bin * stride;
+  const cv::Size size{(rect.width / cell) * stride, (rect.height / cell) * stride};
+  if(size.area() == 0)
+    return frame;
+  if(bin == 1 && rect.size() == image.size())
+    return frame;
+
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  const Frame::ByteOrder native_order = native_little_endian ? Frame::LittleEndian : Frame::BigEndian;
+  const bool swap = bin > 1 && image.depth() == CV_16U && frame->byteOrder() != native_order;
+  const Frame::ByteOrder byte_order = bin > 1 ? native_order : frame->byteOrder();
+  const QSize resolution{size.width, size.height};
+  FramePtr transformed = pool ? pool->acquire(frame->bpp(), frame->colorFormat(), resolution, byte_order)
+                              : make_shared<Frame>(frame->bpp(), frame->colorFormat(), resolution, byte_order);
+  const cv::Mat source = image(cv::Rect{rect.x, rect.y, size.width * bin, size.height * bin});
+  if(bin == 1)
+    source.copyTo(transformed->mat());
+  else if(image.depth() == CV_16U)
+    bin_image<uint16_t>(source, transformed->mat(), bin, stride, swap, settings.mode);
+  else
+    bin_image<uint8_t>(source, transformed->mat(), bin, stride, false, settings.mode);
+  transformed->copy_metadata(*frame);
+  auto &metadata = transformed->metadata();
+  if(metadata.has_roi_offset()) {
+    metadata.roi_x = (metadata.roi_x + rect.x) / bin;
+    metadata.roi_y = (metadata.roi_y + rect.y) / bin;
+  }
+  if(metadata.bin)
+    metadata.bin *= bin;
+  return transformed;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CAPTURETRANSFORM_H
+#define CAPTURETRANSFORM_H
+
+#include <QRect>
+#include "commons/fwd.h"
+
+FWD_PTR(Frame)
+FWD_PTR(FramePool)
+
+/**
+ * Software ROI and binning, on the capture thread, for cameras that can't do them in hardware.
+ * Cropping and binning happen in one pass over the frame, so every handler downstream gets the smaller frame.
+ * Bayer frames are binned by colour: each output pixel sums pixels under the same filter, and the output keeps the Bayer pattern.
+ * Binned frames are in native byte order. ROIs are moved to even coordinates on Bayer frames.
+ */
+namespace CaptureTransform {
+  enum Mode { Average = 0, Sum = 1 };
+  struct Settings {
+    /// Crop rectangle, in camera pixels (empty: whole frame)
+    QRect roi;
+    /// Binning factor, 1 to 4
+    int bin = 1;
+    /// Sums saturate at the frame bit depth
+    Mode mode = Average;
+    bool active() const { return ! roi.isEmpty() || bin > 1; }
+  };
+  /// Cropped and binned copy of frame, with its metadata (ROI offset and bin updated); pool, when set, provides the pixel buffer.
+  /// The frame itself is returned when the settings change nothing.
+  FramePtr apply(const FramePtr &frame, const Settings &settings, const FramePoolPtr &pool = {});
+}
+
+#endif // CAPTURETRANSFORM_H
@@ -43,6 +43,7 @@ void CommandLine::Private::loggingOptions()
   transform(begin(levels_string), end(levels_string), back_inserter(levels), bind(&QString::fromStdString, _1));
   parser.addOption({"console-log-level", "Console logging level (one of %1)"_q % levels.join(", "), "level", QString::fromStdString(LogHandler::log_levels()[QtWarningMsg]) });
   parser.addOption({"log-file", "Log file path", "log_file", "%1/%2.log"_q % QStandardPaths::writableLocation(QStandardPaths::CacheLocation) % app.applicationName() });
+  parser.addOption({"trace-file", "Record a per-frame pipeline trace, and write it to this file on exit (Chrome trace format)", "trace_file"});
 }
 
 
@@ -64,6 +65,14 @@ CommandLine & CommandLine::backend()
     driversDirectory = QCoreApplication::applicationDirPath() + "/" + DRIVERS_DIRECTORY;
   }
   d->parser.addOption({"drivers", "Drivers directory", "drivers_directory_path", driversDirectory});
+  QString modulesDirectory = MODULES_DIRECTORY;
+  if(OSX_BUNDLE == 1) {
+    modulesDirectory = QCoreApplication::applicationDirPath() + "/" + MODULES_DIRECTORY;
+  }
+  d->parser.addOption({"modules", "Modules directory (writers for formats other than SER)", "modules_directory_path", modulesDirectory});
+  d->parser.addOption({"plugins", "Image handler plugins directory (third party processing stages)", "plugins_directory_path", modulesDirectory + "/image_handlers"});
+  d->parser.addOption({"isolate-drivers", "run each driver in a helper process of its own, restarted if it crashes"});
+  d->parser.addOption({"auto-configure", "measure this computer (cores, RAM, save directory throughput) and write the recommended performance settings"});
   d->loggingOptions();
   return *this;
 }
@@ -77,6 +86,23 @@ CommandLine & CommandLine::daemon(const QString &listenAddress)
   d->parser.addOptions({
     { {"a", "address"}, "listening address for server (default: %1)"_q % listenAddress, "address", "%1"_q % listenAddress},
   });
+  d->parser.addOptions({
+    { "shared-memory-frames", "also publish frames to this POSIX shared memory segment, for local scripts (i.e. /planetaryimager-frames)", "name"},
+    { "shared-memory-slots", "frames kept in the shared memory segment (default: 8)", "slots", "8"},
+  });
+  d->parser.addOptions({
+    { "metrics-port", "serve metrics for Prometheus over HTTP on this port, at /metrics (default: disabled)", "port", "0"},
+  });
+  d->parser.addOptions({
+    { "preview-port", "serve a live view for web browsers over HTTP on this port, as an MJPEG stream (default: disabled)", "port", "0"},
+    { "preview-fps", "frames per second of the browser live view (default: 10)", "fps", "10"},
+  });
+  d->parser.addOptions({
+    { "secondary-camera", "also open the camera whose name contains this text, recording along with the main one (can be repeated)", "name"},
+  });
+  d->parser.addOptions({
+    { "driver-host", "only load this driver (i.e. driver_zwo_asi), publishing frames to --shared-memory-frames only: used by --isolate-drivers", "driver"},
+  });
   return *this;
 }
 
@@ -96,6 +122,7 @@ CommandLine & CommandLine::scripting()
 CommandLine & CommandLine::frontend()
 {
   d->loggingOptions();
+  d->parser.addOption({"auto-configure", "measure the link to the daemon when connecting, and pick the preview format and quality for it"});
   return *this;
 }
 
@@ -117,6 +144,24 @@ QStringList CommandLine::driversDirectories() const
   return drivers;
 }
 
+QStringList CommandLine::modulesDirectories() const
+{
+  QStringList modules(d->parser.value("modules"));
+  if(ADD_DRIVERS_BUILD_DIRECTORY == 1) {
+      modules << ADDITIONAL_MODULES_DIRECTORY;
+  }
+  return modules;
+}
+
+QStringList CommandLine::pluginsDirectories() const
+{
+  QStringList plugins(d->parser.value("plugins"));
+  if(ADD_DRIVERS_BUILD_DIRECTORY == 1) {
+      plugins << ADDITIONAL_MODULES_DIRECTORY "/image_handlers";
+  }
+  return plugins;
+}
+
 int CommandLine::port() const
 {
   bool port_ok;
@@ -138,8 +183,57 @@ QString CommandLine::logfile() const
   return d->parser.value("log-file");
 }
 
+QString CommandLine::traceFile() const
+{
+  return d->parser.value("trace-file");
+}
+
 QString CommandLine::address() const
 {
   return d->parser.value("address");
 }
 
+QString CommandLine::sharedMemoryFrames() const
+{
+  return d->parser.value("shared-memory-frames");
+}
+
+int CommandLine::sharedMemorySlots() const
+{
+  return d->parser.value("shared-memory-slots").toInt();
+}
+
+int CommandLine::metricsPort() const
+{
+  return d->parser.value("metrics-port").toInt();
+}
+
+int CommandLine::previewPort() const
+{
+  return d->parser.value("preview-port").toInt();
+}
+
+int CommandLine::previewFps() const
+{
+  return d->parser.value("preview-fps").toInt();
+}
+
+QStringList CommandLine::secondaryCameras() const
+{
+  return d->parser.values("secondary-camera");
+}
+
+bool CommandLine::isolateDrivers() const
+{
+  return d->parser.isSet("isolate-drivers");
+}
+
+bool CommandLine::autoConfigure() const
+{
+  return d->parser.isSet("auto-configure");
+}
+
+QString CommandLine::driverHost() const
+{
+  return d->parser.value("driver-host");
+}
@@ -21,6 +21,7 @@
 #define COMMANDLINE_H
 #include "c++/dptr.h"
 #include <QString>
+#include <QStringList>
 class QCoreApplication;
 
 class CommandLine
@@ -36,10 +37,22 @@ public:
   CommandLine &process();
   
   QStringList driversDirectories() const;
+  QStringList modulesDirectories() const;
+  QStringList pluginsDirectories() const;
   int port() const;
   QString logfile() const;
+  QString traceFile() const;
   QtMsgType consoleLogLevel() const;
   QString address() const;
+  QString sharedMemoryFrames() const;
+  int sharedMemorySlots() const;
+  int metricsPort() const;
+  int previewPort() const;
+  int previewFps() const;
+  QStringList secondaryCameras() const;
+  bool isolateDrivers() const;
+  bool autoConfigure() const;
+  QString driverHost() const;
 private:
   DPTR
 };
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "compressedframesqueue.h"
+#include "commons/definitions.h"
+#include "commons/frame.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstring>
+#include <deque>
+#include <thread>
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+
+using namespace std;
+
+namespace {
+  struct Entry {
+    quint64 id;
+    // Until compressed; afterwards only its metadata is kept, in a frame without pixels
+    FrameConstPtr frame;
+    FramePtr header;
+    QByteArray compressed;
+    QSize resolution;
+    bool is_compressed() const { return ! compressed.isEmpty(); }
+  };
+
+  QByteArray compress(const Frame &frame) {
+#if HAVE_LZ4
+    const cv::Mat &mat = frame.mat();
+    QByteArray continuous;
+    const char *pixels = reinterpret_cast<const char*>(mat.data);
+    if(! mat.isContinuous()) {
+      continuous.resize(static_cast<int>(frame.size()));
+      const size_t row_bytes = mat.cols * mat.elemSize();
+      for(int row = 0; row < mat.rows; row++)
+        memcpy(continuous.data() + row * row_bytes, mat.ptr(row), row_bytes);
+      pixels = continuous.constData();
+    }
+    const int size = static_cast<int>(frame.size());
+    QByteArray compressed(LZ4_compressBound(size), Qt::Uninitialized);
+    const int compressed_size = LZ4_compress_default(pixels, compressed.data(), size, compressed.size());
+    // Not worth it: the raw frame stays
+    if(compressed_size <= 0 || compressed_size >= size)
+      return {};
+    compressed.resize(compressed_size);
+    return compressed;
+#else
+    Q_UNUSED(frame);
+    return {};
+#endif
+  }
+
+  bool decompress(const QByteArray &compressed, Frame &frame) {
+#if HAVE_LZ4
+    const int size = static_cast<int>(frame.size());
+    return LZ4_decompress_safe(compressed.constData(), reinterpret_cast<char*>(frame.data()), compressed.size(), size) == size;
+#else
+    Q_UNUSED(compressed);
+    Q_UNUSED(frame);
+    return false;
+#endif
+  }
+}
+
+DPTR_IMPL(CompressedFramesQueue) {
+  const size_t max_bytes;
+  const size_t max_pending;
+  mutable QMutex mutex;
+  QWaitCondition changed;
+  deque<Entry> entries;
+  quint64 next_id = 0;
+  // Entries from the front up to this id have been through the helper
+  quint64 compressed_until = 0;
+  size_t pending_bytes = 0;
+  size_t compressed_bytes = 0;
+  quint64 raw_total = 0;
+  quint64 compressed_total = 0;
+  quint64 lost = 0;
+  bool running = true;
+  thread compressor;
+  void compress_frames();
+  Entry *find(quint64 id);
+};
+
+CompressedFramesQueue::CompressedFramesQueue(size_t max_bytes, size_t max_pending) : dptr(max_bytes, max_pending)
+{
+  d->compressor = thread{&Private::compress_frames, d.get()};
+}
+
+CompressedFramesQueue::~CompressedFramesQueue()
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    d->running = false;
+  }
+  d->changed.wakeAll();
+  d->compressor.join();
+}
+
+bool CompressedFramesQueue::available()
+{
+  return HAVE_LZ4;
+}
+
+Entry *CompressedFramesQueue::Private::find(quint64 id)
+{
+  if(entries.empty() || id < entries.front().id)
+    return nullptr;
+  return &entries[id - entries.front().id];
+}
+
+void CompressedFramesQueue::Private::compress_frames()
+{
+  while(true) {
+    FrameConstPtr frame;
+    quint64 id;
+    {
+      QMutexLocker lock(&mutex);
+      // Frames popped before their turn came are skipped
+      while(running && (entries.empty() || compressed_until > entries.back().id))
+        changed.wait(&mutex);
+      if(! running)
+        return;
+      id = max(compressed_until, entries.front().id);
+      frame = find(id)->frame;
+    }
+    auto compressed = compress(*frame);
+    auto header = make_shared<Frame>(frame->bpp(), frame->colorFormat(), QSize{0, 0}, frame->byteOrder());
+    header->copy_metadata(*frame);
+    {
+      QMutexLocker lock(&mutex);
+      compressed_until = id + 1;
+      auto entry = find(id);
+      if(! entry || compressed.isEmpty())
+        continue;
+      pending_bytes -= frame->size();
+      compressed_bytes += compressed.size();
+      raw_total += frame->size();
+      compressed_total += compressed.size();
+      entry->resolution = frame->resolution();
+      entry->header = header;
+      entry->compressed = compressed;
+      entry->frame.reset();
+    }
+  }
+}
+
+bool CompressedFramesQueue::push(const FrameConstPtr &frame)
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    const size_t size = frame->size();
+    // Always room for one frame, as in FramesQueue
+    if(! d->entries.empty()) {
+      if(d->max_bytes > 0 && d->pending_bytes + d->compressed_bytes + size > d->max_bytes)
+        return false;
+      if(d->max_pending > 0 && d->pending_bytes > 0 && d->pending_bytes + size > d->max_pending)
+        return false;
+    }
+    d->entries.push_back({d->next_id++, frame, {}, {}, {}});
+    d->pending_bytes += size;
+  }
+  d->changed.wakeAll();
+  return true;
+}
+
+FrameConstPtr CompressedFramesQueue::pop(const chrono::milliseconds &timeout)
+{
+  QMutexLocker lock(&d->mutex);
+  QElapsedTimer elapsed;
+  elapsed.start();
+  while(d->entries.empty()) {
+    const qint64 remaining = timeout.count() - elapsed.elapsed();
+    if(remaining <= 0 || ! d->changed.wait(&d->mutex, remaining))
+      return {};
+  }
+  Entry entry = d->entries.front();
+  d->entries.pop_front();
+  if(! entry.is_compressed()) {
+    d->pending_bytes -= entry.frame->size();
+    return entry.frame;
+  }
+  d->compressed_bytes -= entry.compressed.size();
+  lock.unlock();
+  auto frame = make_shared<Frame>(entry.header->bpp(), entry.header->colorFormat(), entry.resolution, entry.header->byteOrder());
+  frame->copy_metadata(*entry.header);
+  if(decompress(entry.compressed, *frame))
+    return frame;
+  qWarning() << "Error decompressing frame" << frame->sequence() << "from the recording queue, dropping it";
+  lock.relock();
+  ++d->lost;
+  return {};
+}
+
+bool CompressedFramesQueue::empty() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->entries.empty();
+}
+
+size_t CompressedFramesQueue::size() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->entries.size();
+}
+
+size_t CompressedFramesQueue::bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->pending_bytes + d->compressed_bytes;
+}
+
+double CompressedFramesQueue::ratio() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->compressed_total > 0 ? static_cast<double>(d->raw_total) / d->compressed_total : 1.;
+}
+
+quint64 CompressedFramesQueue::lost() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->lost;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef COMPRESSEDFRAMESQUEUE_H
+#define COMPRESSEDFRAMESQUEUE_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <QtGlobal>
+#include <chrono>
+
+FWD_PTR(Frame)
+FWD_PTR(CompressedFramesQueue)
+
+/**
+ * Middle tier for the recording queue: frames compressed in memory with LZ4, so that the same memory holds several times as many of them during disk stalls.
+ * One producer pushes (the caller serialises producers), one consumer pops, in order. Pushing only queues the frame: a helper thread compresses it,
+ * and pop() decompresses it on the consumer thread. A frame popped before the helper got to it is handed over as it is.
+ */
+class CompressedFramesQueue
+{
+public:
+  /// Built with LZ4
+  static bool available();
+  /// max_bytes bounds the frames in the queue, compressed or waiting for the helper; max_pending bounds the ones waiting (0: no limit)
+  CompressedFramesQueue(std::size_t max_bytes, std::size_t max_pending);
+  ~CompressedFramesQueue();
+  /// false if the frame is dropped: no room left
+  bool push(const FrameConstPtr &frame);
+  /// Oldest frame in the queue; an empty pointer if none is ready within timeout
+  FrameConstPtr pop(const std::chrono::milliseconds &timeout);
+  bool empty() const;
+  std::size_t size() const;
+  /// Compressed bytes, plus the pixel bytes of the frames waiting for the helper
+  std::size_t bytes() const;
+  /// Pixel bytes over compressed bytes for the frames compressed so far (1 before the first one)
+  double ratio() const;
+  /// Frames accepted by push() and lost afterwards, because decompression failed
+  quint64 lost() const;
+private:
+  DPTR
+};
+
+#endif // COMPRESSEDFRAMESQUEUE_H
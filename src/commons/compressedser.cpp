@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "compressedser.h"
+#include "commons/definitions.h"
+#include "commons/packedpixels.h"
+#include <QFile>
+#include <QObject>
+#include <QDebug>
+#include <cstring>
+#include <boost/endian/conversion.hpp>
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+bool CompressedSER_Header::valid() const
+{
+  return ::memcmp(magic, CompressedSER_Header{}.magic, sizeof(magic)) == 0 && (codec == Zstd || codec == ZstdPacked);
+}
+
+bool CompressedSER::available()
+{
+  return HAVE_ZSTD;
+}
+
+QByteArray CompressedSER::compress(const uint8_t* data, size_t size, int level)
+{
+#if HAVE_ZSTD
+  QByteArray compressed(static_cast<int>(ZSTD_compressBound(size)), Qt::Uninitialized);
+  auto compressed_size = ZSTD_compress(compressed.data(), compressed.size(), data, size, level);
+  if(ZSTD_isError(compressed_size)) {
+    qWarning() << "Error compressing frame: " << ZSTD_getErrorName(compressed_size);
+    return {};
+  }
+  compressed.resize(static_cast<int>(compressed_size));
+  return compressed;
+#else
+  Q_UNUSED(data);
+  Q_UNUSED(size);
+  Q_UNUSED(level);
+  return {};
+#endif
+}
+
+bool CompressedSER::decompress(const QByteArray& compressed, uint8_t* destination, size_t size)
+{
+#if HAVE_ZSTD
+  auto decompressed_size = ZSTD_decompress(destination, size, compressed.constData(), compressed.size());
+  return ! ZSTD_isError(decompressed_size) && decompressed_size == size;
+#else
+  Q_UNUSED(compressed);
+  Q_UNUSED(destination);
+  Q_UNUSED(size);
+  return false;
+#endif
+}
+
+DPTR_IMPL(CompressedSERReader) {
+  QFile file;
+  QString error;
+  CompressedSER_Header header;
+  vector<CompressedSER_IndexEntry> index;
+  vector<uint8_t> packed;
+  bool open();
+};
+
+CompressedSERReader::CompressedSERReader(const QString& filename) : dptr()
+{
+  d->file.setFileName(filename);
+  if(! d->open())
+    d->file.close();
+}
+
+CompressedSERReader::~CompressedSERReader()
+{
+}
+
+bool CompressedSERReader::Private::open()
+{
+  if(! CompressedSER::available()) {
+    error = QObject::tr("Compressed SER support not available (built without zstd)");
+    return false;
+  }
+  if(! file.open(QIODevice::ReadOnly)) {
+    error = file.errorString();
+    return false;
+  }
+  if(file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header) || ! header.valid()) {
+    error = QObject::tr("Invalid compressed SER file");
+    return false;
+  }
+  qint64 index_size = header.ser.frames * sizeof(CompressedSER_IndexEntry);
+  if(header.index_offset < sizeof(header) || static_cast<qint64>(header.index_offset) + index_size > file.size() || ! file.seek(header.index_offset)) {
+    error = QObject::tr("Compressed SER file index missing, the recording was probably interrupted");
+    return false;
+  }
+  index.resize(header.ser.frames);
+  if(file.read(reinterpret_cast<char*>(index.data()), index_size) != index_size) {
+    error = file.errorString();
+    return false;
+  }
+  return true;
+}
+
+bool CompressedSERReader::is_compressed(const QString& filename)
+{
+  QFile file(filename);
+  CompressedSER_Header header;
+  return file.open(QIODevice::ReadOnly) && file.read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header) && header.valid();
+}
+
+bool CompressedSERReader::isOpen() const
+{
+  return d->file.isOpen();
+}
+
+QString CompressedSERReader::errorString() const
+{
+  return d->error;
+}
+
+const SER_Header & CompressedSERReader::header() const
+{
+  return d->header.ser;
+}
+
+vector<SER_Timestamp> CompressedSERReader::timestamps() const
+{
+  vector<SER_Timestamp> timestamps;
+  qint64 timestamps_offset = d->header.index_offset + d->index.size() * sizeof(CompressedSER_IndexEntry);
+  qint64 timestamps_size = d->index.size() * sizeof(SER_Timestamp);
+  if(! isOpen() || d->file.size() != timestamps_offset + timestamps_size || ! d->file.seek(timestamps_offset))
+    return timestamps;
+  timestamps.resize(d->index.size());
+  if(d->file.read(reinterpret_cast<char*>(timestamps.data()), timestamps_size) != timestamps_size)
+    timestamps.clear();
+  return timestamps;
+}
+
+bool CompressedSERReader::read_frame(quint32 index, uint8_t* destination)
+{
+  if(! isOpen() || index >= d->index.size())
+    return false;
+  auto entry = d->index[index];
+  if(! d->file.seek(entry.offset))
+    return false;
+  auto compressed = d->file.read(entry.size);
+  if(compressed.size() != static_cast<int>(entry.size))
+    return false;
+  const auto frame_size = d->header.ser.frame_size();
+  if(d->header.codec != CompressedSER_Header::ZstdPacked || entry.reserved == 0)
+    return CompressedSER::decompress(compressed, destination, frame_size);
+  const auto layout = PackedPixels::Layout::from_code(entry.reserved);
+  if(! layout.packed() || d->header.ser.pixelDepth <= 8)
+    return false;
+  const size_t count = frame_size / sizeof(uint16_t);
+  d->packed.resize(PackedPixels::packed_size(count, layout));
+  if(! CompressedSER::decompress(compressed, d->packed.data(), d->packed.size()))
+    return false;
+  // Packed values are native, frames read back in the file byte order: same inverted endian flag as SERWriter
+  const bool little_endian = d->header.ser.endian == SER_Header::BigEndian;
+  const bool swap = little_endian != (boost::endian::order::native == boost::endian::order::little);
+  PackedPixels::unpack(d->packed.data(), reinterpret_cast<uint16_t*>(destination), count, layout, swap);
+  return true;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COMPRESSEDSER_H
+#define COMPRESSEDSER_H
+
+#include "ser_header.h"
+#include "c++/dptr.h"
+#include <QString>
+#include <QByteArray>
+#include <vector>
+
+/**
+ * Compressed SER container (.zser): a plain SER header, followed by independently compressed frames,
+ * an index of the compressed frames, and the usual SER timestamps trailer.
+ *
+ *   CompressedSER_Header | frame 1 | frame 2 | ... | CompressedSER_IndexEntry * frames | SER_Timestamp * frames
+ *
+ * Frames being compressed one by one, they can be compressed in parallel, and read back in any order.
+ * With the ZstdPacked codec, 10 and 12 bit frames are packed (see PackedPixels) before compressing, and each index entry
+ * keeps the layout code of its frame: 0 for frames stored unpacked.
+ */
+struct CompressedSER_Header {
+    char magic[8] = {'P', 'I', 'Z', 'S', 'E', 'R', '0', '1'};
+    enum Codec { Zstd = 1, ZstdPacked = 2 };
+    quint32 codec = Zstd;
+    quint32 reserved = 0;
+    quint64 index_offset = 0;
+    SER_Header ser;
+    bool valid() const;
+} __attribute__ ((__packed__));
+
+static_assert(sizeof(CompressedSER_Header) == 202, "Wrong CompressedSER_Header size");
+
+struct CompressedSER_IndexEntry {
+    quint64 offset = 0;
+    quint32 size = 0;
+    /// PackedPixels::Layout code, ZstdPacked only
+    quint32 reserved = 0;
+} __attribute__ ((__packed__));
+
+namespace CompressedSER {
+  /// False when built without zstd support
+  bool available();
+  /// Returns an empty array on failure
+  QByteArray compress(const uint8_t *data, std::size_t size, int level);
+  bool decompress(const QByteArray &compressed, uint8_t *destination, std::size_t size);
+}
+
+class CompressedSERReader
+{
+public:
+  CompressedSERReader(const QString &filename);
+  ~CompressedSERReader();
+  static bool is_compressed(const QString &filename);
+  bool isOpen() const;
+  QString errorString() const;
+  const SER_Header &header() const;
+  /// Empty if the file has no timestamps trailer
+  std::vector<SER_Timestamp> timestamps() const;
+  /// Decompresses frame number index (0 based) into destination, which must hold header().frame_size() bytes
+  bool read_frame(quint32 index, uint8_t *destination);
+private:
+  DPTR
+};
+
+#endif // COMPRESSEDSER_H
@@ -29,30 +29,147 @@
 #include <QFileInfo>
 #include <QJsonDocument>
 #include <QTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QThread>
 
 using namespace std;
 using namespace std::placeholders;
+
+namespace {
+// Slider drags set the same keys many times a second: they reach QSettings (and the Windows registry) in one batch, this often at most
+const int SETTINGS_FLUSH_MSECS = 1000;
+
+/**
+ * Write-behind buffer in front of QSettings, shared by all the Configuration instances of the process, so that they see each other's
+ * changes before they're written. Setters only touch memory; a timer writes the pending changes in a single batch,
+ * as does quitting, and exit() (the crash handler exits too) through the static instance destructor.
+ */
+class SettingsStore : public QObject {
+public:
+  static shared_ptr<SettingsStore> instance();
+  ~SettingsStore();
+  QVariant value(const QString &key, const QVariant &defaultValue = {}) const;
+  void setValue(const QString &key, const QVariant &value);
+  void remove(const QString &key);
+  void flush();
+private:
+  SettingsStore();
+  mutable QMutex mutex;
+  QSettings settings;
+  QHash<QString, QVariant> pending;
+  QSet<QString> removed;
+  QTimer flush_timer;
+  void schedule_flush();
+};
+
+shared_ptr<SettingsStore> SettingsStore::instance()
+{
+  static shared_ptr<SettingsStore> store{new SettingsStore};
+  return store;
+}
+
+SettingsStore::SettingsStore() : settings{"GuLinux", qApp->applicationName()}
+{
+  flush_timer.setSingleShot(true);
+  flush_timer.setInterval(SETTINGS_FLUSH_MSECS);
+  connect(&flush_timer, &QTimer::timeout, this, &SettingsStore::flush);
+  connect(qApp, &QCoreApplication::aboutToQuit, this, &SettingsStore::flush);
+}
+
+SettingsStore::~SettingsStore()
+{
+  flush();
+}
+
+QVariant SettingsStore::value(const QString &key, const QVariant &defaultValue) const
+{
+  QMutexLocker lock(&mutex);
+  if(pending.contains(key))
+    return pending[key];
+  if(removed.contains(key))
+    return defaultValue;
+  return settings.value(key, defaultValue);
+}
+
+void SettingsStore::setValue(const QString &key, const QVariant &value)
+{
+  {
+    QMutexLocker lock(&mutex);
+    pending[key] = value;
+    removed.remove(key);
+  }
+  schedule_flush();
+}
+
+void SettingsStore::remove(const QString &key)
+{
+  {
+    QMutexLocker lock(&mutex);
+    pending.remove(key);
+    removed.insert(key);
+  }
+  schedule_flush();
+}
+
+void SettingsStore::schedule_flush()
+{
+  if(QThread::currentThread() != thread())
+    QMetaObject::invokeMethod(&flush_timer, "start", Qt::QueuedConnection);
+  else if(! flush_timer.isActive())
+    flush_timer.start();
+}
+
+void SettingsStore::flush()
+{
+  if(QThread::currentThread() == thread())
+    flush_timer.stop();
+  QMutexLocker lock(&mutex);
+  if(pending.isEmpty() && removed.isEmpty())
+    return;
+  for(auto key: removed)
+    settings.remove(key);
+  for(auto it = pending.begin(); it != pending.end(); ++it)
+    settings.setValue(it.key(), it.value());
+  pending.clear();
+  removed.clear();
+  settings.sync();
+}
+}
+
 DPTR_IMPL(Configuration) {
-  shared_ptr<QSettings> settings;
+  shared_ptr<SettingsStore> settings;
   Configuration *q;
   template<typename T> T value(const QString &key, const T &defaultValue = {}) const;
   template<typename T> void set(const QString &key, const T &value);
+  void reset(const QString &key);
   mutable QHash<QString, QVariant> values_cache;
   QDir profilesPath;
   QString presetPath(const QString &name) const;
   
   QStringList latest_presets(const QString &configName);
   void preset_added(const QString &path, const QString &configName);
+  // Only accessed through atomic_load/atomic_store
+  SnapshotPtr current_snapshot;
+  quint64 snapshot_version = 0;
 };
 
 const int Configuration::DefaultServerPort = 19232;
 
-Configuration::Configuration() : dptr(make_shared<QSettings>("GuLinux", qApp->applicationName()), this)
+Configuration::Configuration() : dptr(SettingsStore::instance(), this)
 {
   QDir appDataPath{QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)};
   d->profilesPath.setPath(appDataPath.path() + "/profiles");
   if(! d->profilesPath.exists())
     d->profilesPath.mkpath(".");
+  static bool metatypes_registered = false;
+  if(!metatypes_registered) {
+    metatypes_registered = true;
+    qRegisterMetaType<Configuration::SnapshotPtr>("Configuration::SnapshotPtr");
+  }
+  publish_snapshot();
+  connect(this, &Configuration::settings_changed, this, &Configuration::publish_snapshot);
 }
 
 Configuration::~Configuration()
@@ -79,8 +196,97 @@ template<typename T> void Configuration::Private::set(const QString& key, const
   emit this->q->settings_changed();
 }
 
+void Configuration::Private::reset(const QString& key)
+{
+  settings->remove(key);
+  values_cache.remove(key);
+  emit q->settings_changed();
+}
+
+void Configuration::reload()
+{
+  d->values_cache.clear();
+  emit settings_changed();
+}
+
+ThreadPlacement::Placement Configuration::thread_placement() const
+{
+  // CPUs don't come and go while running, or not often enough to matter
+  static const auto topology = ThreadPlacement::Topology::system();
+  ThreadPlacement::Settings settings;
+  settings.capture = capture_thread_cpu();
+  settings.recording = recording_thread_cpu();
+  settings.display = display_thread_cpu();
+  settings.network = network_thread_cpu();
+  settings.automatic = automatic_thread_placement();
+  return ThreadPlacement::resolve(settings, topology);
+}
+
+Configuration::SnapshotPtr Configuration::snapshot() const
+{
+  return atomic_load(&d->current_snapshot);
+}
+
+void Configuration::publish_snapshot()
+{
+  // Getters are virtual: a remote configuration fills the snapshot with the server values
+  auto snapshot = make_shared<Snapshot>();
+  snapshot->version = ++d->snapshot_version;
+  snapshot->debayer = debayer();
+  snapshot->limit_fps = limit_fps();
+  snapshot->max_display_fps = max_display_fps();
+  snapshot->limit_fps_recording = limit_fps_recording();
+  snapshot->max_display_fps_recording = max_display_fps_recording();
+  snapshot->edge_algorithm = edge_algorithm();
+  snapshot->sobel_kernel = sobel_kernel();
+  snapshot->sobel_blur_size = sobel_blur_size();
+  snapshot->sobel_delta = sobel_delta();
+  snapshot->sobel_scale = sobel_scale();
+  snapshot->canny_kernel_size = canny_kernel_size();
+  snapshot->canny_blur_size = canny_blur_size();
+  snapshot->canny_low_threshold = canny_low_threshold();
+  snapshot->canny_threshold_ratio = canny_threshold_ratio();
+  snapshot->display_opencl = display_opencl();
+  snapshot->display_debayer_algorithm = display_debayer_algorithm();
+  snapshot->histogram_disable_on_recording = histogram_disable_on_recording();
+  snapshot->histogram_timeout = histogram_timeout();
+  snapshot->histogram_timeout_recording = histogram_timeout_recording();
+  snapshot->histogram_sampling_step = histogram_sampling_step();
+  snapshot->histogram_cpu_budget = histogram_cpu_budget();
+  snapshot->histogram_region = histogram_region();
+  snapshot->histogram_region_rect = histogram_region_rect();
+  snapshot->histogram_region_size = histogram_region_size();
+  snapshot->histogram_debayer = histogram_debayer();
+  snapshot->recording_pause_stops_timer = recording_pause_stops_timer();
+  snapshot->flash_detector = flash_detector();
+  snapshot->flash_detector_sigma = flash_detector_sigma();
+  snapshot->flash_detector_history = flash_detector_history();
+  snapshot->flash_detector_frames = flash_detector_frames();
+  snapshot->flash_detector_pixels = flash_detector_pixels();
+  snapshot->flash_detector_roi_size = flash_detector_roi_size();
+  snapshot->calibration = calibration();
+  snapshot->calibration_directory = calibration_directory();
+  snapshot->hot_pixels = hot_pixels();
+  snapshot->hot_pixels_frames = hot_pixels_frames();
+  snapshot->hot_pixels_sigma = hot_pixels_sigma();
+  snapshot->auto_exposure = auto_exposure();
+  snapshot->auto_exposure_target = auto_exposure_target();
+  snapshot->auto_exposure_max_exposure = auto_exposure_max_exposure();
+  snapshot->auto_exposure_gain_per_doubling = auto_exposure_gain_per_doubling();
+  snapshot->auto_exposure_roi_size = auto_exposure_roi_size();
+  snapshot->roi_follow = roi_follow();
+  snapshot->roi_follow_margin = roi_follow_margin();
+  snapshot->focus_assist = focus_assist();
+  snapshot->focus_assist_metric = focus_assist_metric();
+  snapshot->focus_assist_roi_size = focus_assist_roi_size();
+  snapshot->display_cpus = thread_placement().display;
+  SnapshotPtr published = snapshot;
+  atomic_store(&d->current_snapshot, published);
+  emit snapshot_changed(published);
+}
+
 
-#define define_setting_reset(name) void Configuration::reset_ ##name() { d->settings->remove(#name); d->values_cache.remove(#name); }
+#define define_setting_reset(name) void Configuration::reset_ ##name() { d->reset(#name); }
 #define define_setting_set(name, type) void Configuration::set_ ##name(const type &value) { d->set<type>( #name, value); }
 #define define_setting_enum_set(name, type) void Configuration::set_ ##name(const type &value) { d->set<int>( #name, static_cast<int>(value) ); }
 #define define_setting_get(name, type, default_value) type Configuration::name() const { return d->value<type>(#name, default_value); }
@@ -92,11 +298,62 @@ template<typename T> void Configuration::Private::set(const QString& key, const
 define_setting(dock_status, QByteArray, {})
 define_setting(main_window_geometry, QByteArray, {})
 define_setting(max_memory_usage, long long, 1024*1024*1024)
+define_setting_enum(recording_queue_overflow, Configuration::RecordingQueueOverflow, Configuration::QueueDropNewest)
+define_setting(recording_queue_block_msecs, int, 20)
+define_setting(load_shedding, int, 2)
+define_setting(load_shedding_display_fps, int, 2)
+define_setting(cpu_governor, bool, false)
+define_setting(cpu_governor_reserve, int, 50)
+define_setting(cpu_governor_priorities, QStringList, (QStringList{"frontend", "network", "histogram", "preview", "focus assist"}))
+define_setting(pipeline, QString, {})
+define_setting(recording_spool_directory, QString, {})
+define_setting(recording_spool_threshold, int, 75)
+define_setting(recording_spool_max_size, long long, 16ll*1024*1024*1024)
+define_setting(recording_queue_compression, bool, false)
+define_setting(recording_queue_compression_threshold, int, 50)
+define_setting(recording_armed, bool, false)
+define_setting(recording_index, bool, true)
+define_setting(recording_pretrigger, bool, false)
+define_setting(pretrigger_seconds, double, 5)
+define_setting(posttrigger_seconds, double, 5)
+define_setting(pretrigger_max_memory_usage, long long, 1024*1024*1024)
+define_setting(recording_burst_to_ram, bool, false)
+define_setting(burst_max_memory_usage, long long, 4ll*1024*1024*1024)
+define_setting(burst_huge_pages, bool, false)
+define_setting(burst_lock_memory, bool, false)
+define_setting(frame_buffers_huge_pages, bool, false)
+define_setting(frame_buffers_lock_memory, bool, false)
+define_setting(memory_budget, long long, 0)
+define_setting(flash_detector, bool, false)
+define_setting(flash_detector_sigma, double, 5)
+define_setting(flash_detector_history, int, 100)
+define_setting(flash_detector_frames, int, 2)
+define_setting(flash_detector_pixels, int, 3)
+define_setting(flash_detector_roi_size, int, 512)
 define_setting(buffered_output, bool, true)
+define_setting(direct_io_output, bool, false)
+define_setting(ser_frames_metadata, bool, true)
+define_setting(ser_frame_hashes, bool, false)
+define_setting(ser_segment_max_size, long long, 0)
+define_setting(ser_segment_max_frames, long long, 0)
+define_setting(ser_stripe_directories, QStringList, {})
+define_setting(recording_sinks, QStringList, {})
+define_setting(recording_sinks_max_memory_usage, long long, 256*1024*1024)
+define_setting(image_writer_threads, int, 0)
+define_setting(compressed_ser_level, int, 1)
+define_setting(compressed_ser_pack_pixels, bool, false)
+define_setting_enum(fits_compression, Configuration::FITSCompression, Configuration::FITSUncompressed)
+define_setting(fits_hcompress_scale, int, 0)
+define_setting(png_compression_level, int, 1)
+define_setting(tiff_compression, bool, false)
+define_setting(recording_crop_size, int, 0)
+define_setting(recording_keep_best_percent, int, 0)
+define_setting(recording_quality_window, int, 200)
 define_setting(max_display_fps, int, 30)
 define_setting(max_display_fps_recording, int, 15)
 define_setting(limit_fps, bool, true)
 define_setting(debayer, bool, true)
+define_setting(opengl_live_view, bool, false)
 define_setting(limit_fps_recording, bool, true)
 
 define_setting_enum(recording_limit_type, Configuration::RecordingLimit, Configuration::FramesNumber)
@@ -117,6 +374,9 @@ define_setting(sobel_kernel, int, 3)
 define_setting(sobel_blur_size, int, 3)
 define_setting(canny_low_threshold, double, 1)
 define_setting(canny_threshold_ratio, double, 3)
+define_setting(display_opencl, bool, true)
+define_setting_enum(display_debayer_algorithm, Configuration::DebayerAlgorithm, Configuration::DebayerBilinear)
+define_setting_enum(save_debayer_algorithm, Configuration::DebayerAlgorithm, Configuration::DebayerEdgeAware)
 define_setting(sobel_delta, double, 0)
 define_setting(sobel_scale, double, 1)
 define_setting(canny_kernel_size, int, 7)
@@ -140,14 +400,28 @@ void Configuration::resetSobelAdvancedSettings()
 
 define_setting_enum(save_format, Configuration::SaveFormat, Configuration::SER)
 define_setting(video_codec, QString, "HFYU")
+define_setting(ffmpeg_video_codec, QString, "ffv1")
 define_setting(save_json_info_file, bool, true)
 define_setting(save_info_file, bool, true)
+define_setting(save_debayered, bool, false)
+define_setting_enum(save_depth, Configuration::SaveDepth, Configuration::SaveDepthNative)
+define_setting(save_depth_black, int, 0)
+define_setting(save_depth_white, int, 65535)
+define_setting(save_depth_dither, bool, true)
 define_setting(widgets_setup_first_run, bool, false)
 define_setting(histogram_bins, int, 255)
 define_setting(histogram_logarithmic, bool, true)
 define_setting(histogram_disable_on_recording, bool, false)
 define_setting(histogram_timeout, long long, 2'000)
 define_setting(histogram_timeout_recording, long long, 4'000)
+define_setting(histogram_sampling_step, int, 1)
+define_setting(histogram_cpu_budget, int, 0)
+define_setting_enum(histogram_region, Configuration::HistogramRegion, Configuration::HistogramWholeFrame)
+define_setting(histogram_region_rect, QRect, {})
+define_setting(histogram_region_size, int, 512)
+define_setting(histogram_debayer, bool, false)
+define_setting(live_stacking_keep_best_percent, int, 0)
+define_setting(live_stacking_sigma, double, 3.0)
 define_setting(last_controls_folder, QString, QString(qgetenv("HOME")))
 
 define_setting(server_host, QString, "localhost")
@@ -156,15 +430,54 @@ define_setting_enum(server_image_format, Configuration::NetworkImageFormat, Conf
 define_setting(server_compression, bool, false)
 define_setting(server_force8bit, bool, true)
 define_setting(server_jpeg_quality, int, 85)
+define_setting(server_preview_max_size, int, 0)
+define_setting(server_udp_preview, bool, false)
+define_setting(server_multicast_group, QString, {})
+define_setting(server_local_frames, bool, true)
+define_setting(server_recording_status_rate, int, 5)
+define_setting(record_on_client, bool, false)
+define_setting(dashboard_daemons, QStringList, {})
+define_setting(dashboard_thumbnail_fps, double, 1)
+define_setting(dashboard_thumbnail_size, int, 240)
 
 define_setting(timelapse_mode, bool, false)
 define_setting(timelapse_msecs, qlonglong, 1000)
+define_setting(timelapse_pause_capture, bool, true)
 
 define_setting(filter_presets_by_camera, bool, true)
 define_setting(deprecated_video_warning_shown, bool, false)
 define_setting(recording_pause_stops_timer, bool, false)
 
 define_setting_enum(capture_endianess, Configuration::CaptureEndianess, Configuration::CaptureEndianess::CameraDefault)
+define_setting(capture_native_byte_order, bool, false)
+define_setting(capture_thread_realtime, bool, false)
+define_setting(capture_batch_frames, int, 1)
+define_setting(camera_controls_cache, bool, true)
+define_setting(capture_thread_cpu, int, -1)
+define_setting(recording_thread_cpu, int, -1)
+define_setting(display_thread_cpu, int, -1)
+define_setting(network_thread_cpu, int, -1)
+define_setting(automatic_thread_placement, bool, false)
+define_setting(secondary_max_memory_usage, long long, 512*1024*1024)
+define_setting(software_bin, int, 1)
+define_setting_enum(software_bin_mode, Configuration::SoftwareBinMode, Configuration::SoftwareBinAverage)
+define_setting(software_roi, QRect, {})
+define_setting(calibration, bool, false)
+define_setting(calibration_directory, QString, {})
+define_setting(hot_pixels, bool, false)
+define_setting(hot_pixels_frames, int, 16)
+define_setting(hot_pixels_sigma, double, 8)
+define_setting(auto_exposure, bool, false)
+define_setting(auto_exposure_target, double, 70)
+define_setting(auto_exposure_max_exposure, double, 20)
+define_setting(auto_exposure_gain_per_doubling, double, 0)
+define_setting(auto_exposure_roi_size, int, 512)
+define_setting(roi_follow, bool, false)
+define_setting(roi_follow_margin, double, 20)
+define_setting(focus_assist, bool, false)
+define_setting_enum(focus_assist_metric, Configuration::FocusMetric, Configuration::FocusLaplacian)
+define_setting(focus_assist_roi_size, int, 256)
+define_setting(parallel_image_handlers, bool, true)
 
 define_setting(immediate_controls, bool, false)
 
@@ -173,6 +486,9 @@ QString Configuration::savefile() const
   QMap<SaveFormat, QString> extension {
     { SER, ".ser" },
     { Video, ".mkv" },
+    { FFmpegVideo, ".mkv" },
+    { CompressedSER, ".zser" },
+    { FITSCube, ".fits" },
   };
   return "%1%2%3%4%5%6"_q
     % save_directory()
@@ -19,8 +19,11 @@
 #ifndef CONFIGURATION_H
 #define CONFIGURATION_H
 #include "dptr.h"
+#include "commons/threadplacement.h"
 #include <QString>
+#include <QRect>
 #include <QObject>
+#include <memory>
 
 class QSettings;
 class Configuration : public QObject
@@ -41,9 +44,111 @@ public:
     declare_setting(limit_fps_recording, bool)
     declare_setting(debayer, bool)
     declare_setting(limit_fps, bool)
+    /// Draw the live view with OpenGL shaders from the raw frames (applied on restart)
+    declare_setting(opengl_live_view, bool)
     
     declare_setting(buffered_output, bool )
+    /// Write SER files bypassing the OS page cache (Linux only)
+    declare_setting(direct_io_output, bool )
+    /// Write a side-car file with each frame gain, temperature, ROI offset, bin and sequence next to SER recordings (see SER_FrameRecord)
+    declare_setting(ser_frames_metadata, bool )
+    /// Write a side-car file with the CRC32C of each frame next to SER recordings, for ser_tool verify (see SER_HashesHeader)
+    declare_setting(ser_frame_hashes, bool )
+    /// Split SER recordings in segments of at most this size in bytes (0: don't split)
+    declare_setting(ser_segment_max_size, long long )
+    /// Split SER recordings in segments of at most this number of frames (0: don't split)
+    declare_setting(ser_segment_max_frames, long long )
+    /// Stripe SER recordings across these directories, ideally on different disks, one frame each in turn (empty: don't stripe). See StripedSERWriter
+    declare_setting(ser_stripe_directories, QStringList)
+    /// Extra files for each recording, as FORMAT:EVERY entries (i.e. PNG:100, one PNG every 100 frames saved), written alongside the main one. See MultiSinkWriter
+    declare_setting(recording_sinks, QStringList)
+    /// Memory for the frames waiting to be written by the extra recording sinks, shared among them
+    declare_setting(recording_sinks_max_memory_usage, long long)
+    /// Threads encoding PNG/TIFF/FITS frames, or compressing SER frames (0: one per core)
+    declare_setting(image_writer_threads, int )
+    /// zstd compression level for compressed SER files
+    declare_setting(compressed_ser_level, int )
+    /// Packs 10 and 12 bit frames before compressing them
+    declare_setting(compressed_ser_pack_pixels, bool )
+    /// cfitsio tile compression for FITS images: Rice is lossless, HCOMPRESS is lossy with a non zero scale
+    enum FITSCompression { FITSUncompressed=0, FITSRice=1, FITSHCompress=2 };
+    declare_setting(fits_compression, FITSCompression)
+    /// HCOMPRESS scale, in units of the image noise (0: lossless)
+    declare_setting(fits_hcompress_scale, int )
+    /// zlib level for PNG images (0: uncompressed, 9: smallest)
+    declare_setting(png_compression_level, int )
+    /// Deflate compression for TIFF images: uncompressed TIFFs are the fastest to write
+    declare_setting(tiff_compression, bool )
+    /// Save only a window of this size around the planet centroid (0: save full frames)
+    declare_setting(recording_crop_size, int )
+    /// Lucky imaging: save only the frames whose sharpness ranks in this top percentage (0: save all frames)
+    declare_setting(recording_keep_best_percent, int )
+    /// Number of recent frames the sharpness rank is computed against
+    declare_setting(recording_quality_window, int )
     declare_setting(max_memory_usage, long long )
+    /// What to do with incoming frames when the recording queue (bounded by max_memory_usage) is full
+    enum RecordingQueueOverflow { QueueDropNewest=0, QueueDropOldest=1, QueueBlockProducer=2 };
+    declare_setting(recording_queue_overflow, RecordingQueueOverflow)
+    declare_setting(recording_queue_block_msecs, int)
+    /// Last LoadShedding step taken while the recording writer falls behind (0: never shed anything, and drop frames instead)
+    declare_setting(load_shedding, int)
+    /// Display rate at the LoadShedding::SlowDisplay step
+    declare_setting(load_shedding_display_fps, int)
+    /// Rate limits for the optional frames consumers while the CPU runs short (see CpuGovernor)
+    declare_setting(cpu_governor, bool)
+    /// Percentage of the cores always kept for capture, recording and the rest of the machine
+    declare_setting(cpu_governor_reserve, int)
+    /// Frames consumers the CPU governor may slow down, highest priority first
+    declare_setting(cpu_governor_priorities, QStringList)
+    /// Policy, depth and CPUs of the frames consumers, read on startup (see PipelineGraph). Empty: as built in
+    declare_setting(pipeline, QString)
+    /// Overflow tier for the recording queue, on a fast secondary disk or tmpfs (empty: none). See FramesSpool
+    declare_setting(recording_spool_directory, QString)
+    /// Frames go to the spool once the recording queue holds this percentage of max_memory_usage; the rest of the budget is for frames waiting to be spooled
+    declare_setting(recording_spool_threshold, int)
+    /// Bytes of frames the spool can hold (0: no limit)
+    declare_setting(recording_spool_max_size, long long)
+    /// Frames past recording_queue_compression_threshold percent of max_memory_usage are kept LZ4 compressed in the rest of the budget (see CompressedFramesQueue)
+    declare_setting(recording_queue_compression, bool)
+    declare_setting(recording_queue_compression_threshold, int)
+    /// Keeps the next recording ready while idle, file already open with the name it gets when armed, so that it starts on the very next frame
+    declare_setting(recording_armed, bool)
+    /// Thumbnail, frames, duration, quality and performance of each recording kept in an index of the save directory (see RecordingIndex), for fast browsing
+    declare_setting(recording_index, bool)
+    /// Start recording arms a RAM ring buffer instead: nothing is written until a trigger, which saves the buffered and following frames
+    declare_setting(recording_pretrigger, bool)
+    /// Seconds of frames kept before a trigger
+    declare_setting(pretrigger_seconds, double)
+    /// Seconds of frames saved after a trigger
+    declare_setting(posttrigger_seconds, double)
+    /// Memory budget of the pre-trigger ring buffer, in bytes
+    declare_setting(pretrigger_max_memory_usage, long long)
+    /// Burst to RAM: frames are kept in memory, and written by a low priority thread, so that recording doesn't wait on the disk
+    declare_setting(recording_burst_to_ram, bool)
+    /// Memory for burst to RAM recordings, in bytes
+    declare_setting(burst_max_memory_usage, long long)
+    /// Back burst to RAM memory with huge pages (Linux only)
+    declare_setting(burst_huge_pages, bool)
+    /// Lock burst to RAM memory, so that it's never swapped out (needs a large enough memlock limit)
+    declare_setting(burst_lock_memory, bool)
+    /// Frame buffers on huge pages, for fewer page faults and TLB misses (Linux: vm.nr_hugepages, or transparent huge pages; Windows: "Lock pages in memory" privilege)
+    declare_setting(frame_buffers_huge_pages, bool)
+    /// Locks frame buffers in RAM up to the recording queue budget (max_memory_usage), so that queued frames are never swapped out
+    declare_setting(frame_buffers_lock_memory, bool)
+    /// Process memory budget, in bytes, shared by the frame pools, queues, pre-trigger buffer and network send buffers (see MemoryGovernor); 0 for none
+    declare_setting(memory_budget, long long)
+    /// Impact flash detector: triggers the recording when a transient brightening appears on the planet
+    declare_setting(flash_detector, bool)
+    /// Pixels brighter than their running background by this many standard deviations are flagged
+    declare_setting(flash_detector_sigma, double)
+    /// Frames the running background is averaged over
+    declare_setting(flash_detector_history, int)
+    /// Consecutive frames with flagged pixels needed for a detection
+    declare_setting(flash_detector_frames, int)
+    /// Flagged pixels needed in a frame
+    declare_setting(flash_detector_pixels, int)
+    /// Side of the window around the planet centroid the detector watches (0: whole frame)
+    declare_setting(flash_detector_roi_size, int)
     
     enum RecordingLimit { Infinite=0, FramesNumber=1, Duration=2, FileSize=3};
     declare_setting(recording_limit_type, RecordingLimit)
@@ -57,11 +162,22 @@ public:
     declare_setting(save_file_prefix, QString)
     declare_setting(save_file_suffix, QString )
 
-    enum SaveFormat { SER=0, Video=1, PNG=2, FITS=3 };
+    enum SaveFormat { SER=0, Video=1, PNG=2, FITS=3, FFmpegVideo=4, CompressedSER=5, FITSCube=6, TIFF=7 };
     declare_setting(save_format, SaveFormat)
     declare_setting(video_codec, QString)
+    /// FFmpeg encoder name, for FFmpegVideo recordings
+    declare_setting(ffmpeg_video_codec, QString)
     declare_setting(save_json_info_file, bool)
     declare_setting(save_info_file, bool)
+    /// Recordings of Bayer cameras get RGB frames, interpolated with save_debayer_algorithm, instead of the raw ones
+    declare_setting(save_debayered, bool)
+    /// 16 bit recordings saved as 8 bit ones (see DepthReduction): between save_depth_black and save_depth_white, or between points taken from the first frame histogram
+    enum SaveDepth { SaveDepthNative=0, SaveDepth8BitFixed=1, SaveDepth8BitHistogram=2 };
+    declare_setting(save_depth, SaveDepth)
+    declare_setting(save_depth_black, int)
+    declare_setting(save_depth_white, int)
+    /// Blue noise dither instead of rounding, when saving 8 bit frames from 16 bit ones
+    declare_setting(save_depth_dither, bool)
 
     declare_setting(observer, QString)
     declare_setting(telescope, QString)
@@ -76,6 +192,12 @@ public:
     declare_setting(canny_threshold_ratio, double)
     declare_setting(canny_kernel_size, int)
     declare_setting(canny_blur_size, int)
+    /// Edge detection on an OpenCL device when there is one (see EdgeDetection)
+    declare_setting(display_opencl, bool)
+    /// Colour interpolation of Bayer frames (see Debayer::Algorithm): binned previews always use superpixels
+    enum DebayerAlgorithm { DebayerSuperpixel=0, DebayerBilinear=1, DebayerEdgeAware=2 };
+    declare_setting(display_debayer_algorithm, DebayerAlgorithm)
+    declare_setting(save_debayer_algorithm, DebayerAlgorithm)
 
     void resetCannyAdvancedSettings();
     void resetSobelAdvancedSettings();
@@ -86,21 +208,56 @@ public:
     declare_setting(histogram_disable_on_recording, bool)
     declare_setting(histogram_timeout, long long)
     declare_setting(histogram_timeout_recording, long long)
+    /// Histogram counts one pixel every this many columns and rows (1: all pixels)
+    declare_setting(histogram_sampling_step, int)
+    /// Maximum share of one core, in percent, used by the histogram worker (0: no limit)
+    declare_setting(histogram_cpu_budget, int)
+    /// Part of the frame the histogram counts: all of it, histogram_region_rect, or a window around the tracked target or the brightness centroid
+    enum HistogramRegion { HistogramWholeFrame=0, HistogramRectangle=1, HistogramTracked=2, HistogramCentroid=3 };
+    declare_setting(histogram_region, HistogramRegion)
+    declare_setting(histogram_region_rect, QRect)
+    /// Side of the window around the tracked target or the centroid
+    declare_setting(histogram_region_size, int)
+    /// Histogram of Bayer frames counts red, green and blue (from 2x2 superpixels) instead of the raw samples
+    declare_setting(histogram_debayer, bool)
+    /// Live stacking merges only the frames whose sharpness ranks in this top percentage (0: all frames)
+    declare_setting(live_stacking_keep_best_percent, int)
+    /// Live stacking rejects pixel values further than this many standard deviations from the mean (0: no clipping)
+    declare_setting(live_stacking_sigma, double)
     
     static const int DefaultServerPort;
     declare_setting(server_host, QString)
     declare_setting(server_port, int)
     
-    enum NetworkImageFormat { Network_RAW=0, Network_JPEG=1, Network_NoImage=2 };
+    enum NetworkImageFormat { Network_RAW=0, Network_JPEG=1, Network_NoImage=2, Network_WebP=3, Network_TileDelta=4 };
     declare_setting(server_image_format, NetworkImageFormat)
     declare_setting(server_compression, bool)
     declare_setting(server_force8bit, bool)
     declare_setting(server_jpeg_quality, int)
+    /// Remote preview frames are scaled down on the server to fit this many pixels on their longest side (0: full resolution)
+    declare_setting(server_preview_max_size, int)
+    /// Remote preview frames come over UDP, dropped instead of retransmitted when datagrams are lost. Control and recording stay on TCP.
+    declare_setting(server_udp_preview, bool)
+    /// Multicast group (address:port) for the UDP preview, so that many viewers share one stream (empty: unicast)
+    declare_setting(server_multicast_group, QString)
+    /// Frames from a server on this computer come through shared memory, full rate and bit depth, instead of the network
+    declare_setting(server_local_frames, bool)
+    /// Recording counters, fps and queue usage are sent to remote clients as one status packet, this many times per second
+    declare_setting(server_recording_status_rate, int)
+    /// Remote recordings are written by the client, with its own save directory and format, from frames streamed lossless by the server
+    declare_setting(record_on_client, bool)
+    /// Daemons (host:port) watched together on the frontend dashboard
+    declare_setting(dashboard_daemons, QStringList)
+    /// Dashboard thumbnails come at most this many times per second, fitting this many pixels on their longest side
+    declare_setting(dashboard_thumbnail_fps, double)
+    declare_setting(dashboard_thumbnail_size, int)
     
     declare_setting(last_controls_folder, QString)
     
     declare_setting(timelapse_mode, bool)
     declare_setting(timelapse_msecs, qlonglong)
+    /// Timelapse recordings shoot once per interval, with the camera idle in between, instead of discarding the frames
+    declare_setting(timelapse_pause_capture, bool)
     
     declare_setting(filter_presets_by_camera, bool)
     declare_setting(deprecated_video_warning_shown, bool)
@@ -109,10 +266,123 @@ public:
     /// Defines how to interpret multi-byte data coming from camera (CameraDefault = as reported by the camera; may be unreliable)
     enum class CaptureEndianess { CameraDefault=0, Little=1, Big=2};
     declare_setting(capture_endianess, CaptureEndianess)
+    /// 16 bit frames swapped once to the native byte order on capture, so that no later stage has to
+    declare_setting(capture_native_byte_order, bool)
+    /// Real time scheduling for the capture thread, where allowed (Linux: SCHED_FIFO, needs CAP_SYS_NICE or an rtprio limit)
+    declare_setting(capture_thread_realtime, bool)
+    /// Frames handed down the processing chain together when capturing tiny ROIs at thousands of fps (1: one at a time)
+    declare_setting(capture_batch_frames, int)
+    /// Camera controls from the last session on open, checked against the driver once the UI is up (see ControlsCache)
+    declare_setting(camera_controls_cache, bool)
+    /// Pins the capture thread to this CPU, away from the frame consumers (-1: any CPU, Linux only)
+    declare_setting(capture_thread_cpu, int)
+    /// Pins the recording writer, display and network encoder threads as well (-1: any CPU, Linux and Windows only)
+    declare_setting(recording_thread_cpu, int)
+    declare_setting(display_thread_cpu, int)
+    declare_setting(network_thread_cpu, int)
+    /// Places the threads left on any CPU from the machine topology: isolated CPUs (isolcpus) and NUMA nodes (see ThreadPlacement)
+    declare_setting(automatic_thread_placement, bool)
+    /// CPUs for each thread role, from the settings above
+    ThreadPlacement::Placement thread_placement() const;
+    /// Recording queue budget of every camera recorded alongside the main one (see MultiCameraSaveImages); the main camera keeps max_memory_usage
+    declare_setting(secondary_max_memory_usage, long long)
+    /// Software binning on the capture thread, for cameras without hardware binning (1: off, up to 4)
+    declare_setting(software_bin, int)
+    enum SoftwareBinMode { SoftwareBinAverage=0, SoftwareBinSum=1 };
+    declare_setting(software_bin_mode, SoftwareBinMode)
+    /// Software crop on the capture thread, before binning, in camera pixels (empty: whole frame)
+    declare_setting(software_roi, QRect)
+    /// Dark, flat and bad pixel calibration of every frame, with the masters in calibration_directory (see Calibration)
+    declare_setting(calibration, bool)
+    declare_setting(calibration_directory, QString)
+    /// Hot pixel map learnt from the first hot_pixels_frames frames, then applied to the next ones (see HotPixelMap)
+    declare_setting(hot_pixels, bool)
+    declare_setting(hot_pixels_frames, int)
+    /// Hot pixels stay brighter than their neighbours by more than this many standard deviations of the frame noise
+    declare_setting(hot_pixels_sigma, double)
+    /// Closed loop auto exposure on the highlights of the frames (see AutoExposure)
+    declare_setting(auto_exposure, bool)
+    /// Highlights level to keep, percent of the full scale
+    declare_setting(auto_exposure_target, double)
+    /// Longest exposure to use in milliseconds, gain takes over past it
+    declare_setting(auto_exposure_max_exposure, double)
+    /// Gain units doubling the brightness (60 for cameras in 0.1 dB units), 0 to leave gain alone
+    declare_setting(auto_exposure_gain_per_doubling, double)
+    /// Side of the window around the target centroid to measure (0: whole frame)
+    declare_setting(auto_exposure_roi_size, int)
+    /// Hardware ROI moving with the target as it drifts, for drivers that can move it while capturing (see ROIFollower)
+    declare_setting(roi_follow, bool)
+    /// Distance from the ROI edges where the target gets the ROI moving, percent of the ROI size
+    declare_setting(roi_follow_margin, double)
+    /// Focus metric measured on every frame, plotted in the focus panel and served to network clients (see FocusAssist)
+    declare_setting(focus_assist, bool)
+    /// Laplacian and Brenner are for extended targets (higher is sharper), HFD and FWHM for stars (lower is sharper)
+    enum FocusMetric { FocusLaplacian=0, FocusBrenner=1, FocusHFD=2, FocusFWHM=3 };
+    declare_setting(focus_assist_metric, FocusMetric)
+    /// Side of the window around the target centroid to measure (0: whole frame)
+    declare_setting(focus_assist_roi_size, int)
+    /// Frames go to display, histogram, stacking and tracking at the same time instead of one after another
+    declare_setting(parallel_image_handlers, bool)
 
     /// If true, camera control changes are applied immediately (no need to click "Apply")
     declare_setting(immediate_controls, bool);
 
+    /// Typed copy of the settings read for every frame, immutable once published
+    struct Snapshot {
+      quint64 version;
+      bool debayer;
+      bool limit_fps;
+      int max_display_fps;
+      bool limit_fps_recording;
+      int max_display_fps_recording;
+      EdgeAlgorithm edge_algorithm;
+      int sobel_kernel;
+      int sobel_blur_size;
+      double sobel_delta;
+      double sobel_scale;
+      int canny_kernel_size;
+      int canny_blur_size;
+      double canny_low_threshold;
+      double canny_threshold_ratio;
+      bool display_opencl;
+      DebayerAlgorithm display_debayer_algorithm;
+      bool histogram_disable_on_recording;
+      long long histogram_timeout;
+      long long histogram_timeout_recording;
+      int histogram_sampling_step;
+      int histogram_cpu_budget;
+      HistogramRegion histogram_region;
+      QRect histogram_region_rect;
+      int histogram_region_size;
+      bool histogram_debayer;
+      bool recording_pause_stops_timer;
+      bool flash_detector;
+      double flash_detector_sigma;
+      int flash_detector_history;
+      int flash_detector_frames;
+      int flash_detector_pixels;
+      int flash_detector_roi_size;
+      bool calibration;
+      QString calibration_directory;
+      bool hot_pixels;
+      int hot_pixels_frames;
+      double hot_pixels_sigma;
+      bool auto_exposure;
+      double auto_exposure_target;
+      double auto_exposure_max_exposure;
+      double auto_exposure_gain_per_doubling;
+      int auto_exposure_roi_size;
+      bool roi_follow;
+      double roi_follow_margin;
+      bool focus_assist;
+      FocusMetric focus_assist_metric;
+      int focus_assist_roi_size;
+      QList<int> display_cpus;
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+    /// Latest published snapshot: a single atomic load, safe from any thread
+    SnapshotPtr snapshot() const;
+
     struct Preset {
       QString path;
       QString name;
@@ -133,6 +403,8 @@ public:
     void remove_preset(const QString &name);
     
     QString savefile() const;
+    /// Drops the cached values, to see the changes made through another Configuration on the same settings
+    void reload();
     
 public slots:
     void preset_saved(const QString &file);
@@ -141,9 +413,15 @@ signals:
   void presets_changed();
   void recording_presets_changed();
   void settings_changed();
+  void snapshot_changed(const Configuration::SnapshotPtr &snapshot);
+protected:
+  /// Rebuilds the snapshot from the getters; called on every setting change
+  void publish_snapshot();
 private:
     DPTR
 };
 
 
+Q_DECLARE_METATYPE(Configuration::SnapshotPtr)
+
 #endif // CONFIGURATION_H
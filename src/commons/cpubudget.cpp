@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cpubudget.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+CpuBudget::CpuBudget(int cores) : CpuBudget{Settings{}, cores}
+{
+}
+
+CpuBudget::CpuBudget(const Settings &settings, int cores) : settings{settings}, cores{max(cores, 1)}
+{
+}
+
+vector<double> CpuBudget::update(double busy, const vector<Stage> &stages)
+{
+  _costs.resize(stages.size(), 0);
+  for(size_t i = 0; i < stages.size(); i++) {
+    if(stages[i].handled_fps <= 0)
+      continue;
+    const double cost = stages[i].cpu / stages[i].handled_fps;
+    _costs[i] = _costs[i] > 0 ? _costs[i] + settings.smoothing * (cost - _costs[i]) : cost;
+  }
+  const double governed = accumulate(stages.begin(), stages.end(), 0., [](double total, const Stage &stage) { return total + stage.cpu; });
+  const double others = max(0., busy - governed);
+  _budget = max(0., cores - max(others, settings.reserve * cores));
+
+  vector<double> rates(stages.size(), 0);
+  double left = _budget;
+  for(size_t i = 0; i < stages.size(); i++) {
+    const double needed = _costs[i] * stages[i].offered_fps;
+    // Within rounding: on a saturated machine the stages get back exactly what they used
+    if(needed <= left + 1e-9) {
+      left -= needed;
+      continue;
+    }
+    rates[i] = max(settings.min_fps, left / _costs[i]);
+    left = max(0., left - rates[i] * _costs[i]);
+  }
+  return rates;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CPUBUDGET_H
+#define CPUBUDGET_H
+
+#include <vector>
+
+/**
+ * Rate budgets for the optional frames consumers (display, previews, focus measures), so that capture and recording keep their CPU on small machines.
+ * Every interval the governor measures how many cores each optional stage used, over the frames it handled, and how busy the whole machine was.
+ * What the rest (capture, saving, other processes) used, or the reserved share if higher, is set aside: the remaining cores go to the stages
+ * in priority order, each getting the rate it was offered as long as its measured per frame cost fits, and a lower one (never below min_fps) otherwise.
+ * The rates themselves are applied by CpuGovernor.
+ */
+class CpuBudget
+{
+public:
+  struct Settings {
+    /// Share of all the cores always kept for what is not governed
+    double reserve = 0.5;
+    /// Limited stages still get this rate, so that they keep showing something
+    double min_fps = 1;
+    /// Weight of the latest measure in the per frame cost averages
+    double smoothing = 0.3;
+  };
+  /// A governed stage over the last interval
+  struct Stage {
+    /// Frames offered to the stage, and handled by it, per second
+    double offered_fps;
+    double handled_fps;
+    /// Cores used by the stage: CPU seconds per second
+    double cpu;
+  };
+  CpuBudget(int cores);
+  CpuBudget(const Settings &settings, int cores);
+  /**
+   * busy: cores used by the whole machine over the interval, the stages included; stages in priority order, highest first.
+   * Returns the rate of each stage, 0 for no limit.
+   */
+  std::vector<double> update(double busy, const std::vector<Stage> &stages);
+  /// Cores left to the stages by the last update
+  double budget() const { return _budget; }
+  /// Averaged CPU seconds per frame of each stage, 0 while unknown
+  const std::vector<double> &costs() const { return _costs; }
+private:
+  Settings settings;
+  const int cores;
+  std::vector<double> _costs;
+  double _budget = 0;
+};
+
+#endif // CPUBUDGET_H
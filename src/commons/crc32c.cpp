@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "crc32c.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
+using namespace std;
+
+namespace {
+  // Reflected Castagnoli polynomial
+  const uint32_t polynomial = 0x82f63b78;
+
+  struct Tables {
+    uint32_t values[8][256];
+    Tables() {
+      for(uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for(int bit = 0; bit < 8; bit++)
+          crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        values[0][byte] = crc;
+      }
+      for(uint32_t byte = 0; byte < 256; byte++)
+        for(int slice = 1; slice < 8; slice++)
+          values[slice][byte] = (values[slice - 1][byte] >> 8) ^ values[0][values[slice - 1][byte] & 0xff];
+    }
+  };
+
+  uint32_t update_table(uint32_t crc, const uint8_t *data, size_t size) {
+    static const Tables tables;
+    const auto &t = tables.values;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Slicing by 8 reads words in little endian order; big endian machines go a byte at a time
+    for(; size >= 8; size -= 8, data += 8) {
+      uint32_t low, high;
+      memcpy(&low, data, 4);
+      memcpy(&high, data + 4, 4);
+      low ^= crc;
+      crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+          ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    }
+#endif
+    for(; size > 0; size--, data++)
+      crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+    return crc;
+  }
+
+#ifdef CRC32C_X86
+  __attribute__((target("sse4.2"))) uint32_t update_sse42(uint32_t crc, const uint8_t *data, size_t size) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for(; size >= 8; size -= 8, data += 8) {
+      uint64_t word;
+      memcpy(&word, data, 8);
+      crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for(; size >= 4; size -= 4, data += 4) {
+      uint32_t word;
+      memcpy(&word, data, 4);
+      crc = _mm_crc32_u32(crc, word);
+    }
+    for(; size > 0; size--, data++)
+      crc = _mm_crc32_u8(crc, *data);
+    return crc;
+  }
+#endif
+
+#ifdef CRC32C_ARM
+  uint32_t update_armv8(uint32_t crc, const uint8_t *data, size_t size) {
+    for(; size >= 8; size -= 8, data += 8) {
+      uint64_t word;
+      memcpy(&word, data, 8);
+      crc = __crc32cd(crc, word);
+    }
+    for(; size > 0; size--, data++)
+      crc = __crc32cb(crc, *data);
+    return crc;
+  }
+#endif
+
+  struct Implementation {
+    const char *name;
+    uint32_t (*update)(uint32_t, const uint8_t*, size_t);
+  };
+
+  Implementation select_implementation() {
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2"))
+      return {"sse4.2", update_sse42};
+#endif
+#ifdef CRC32C_ARM
+    return {"armv8", update_armv8};
+#endif
+    return {"table", update_table};
+  }
+
+  const Implementation &implementation() {
+    static const Implementation selected = select_implementation();
+    return selected;
+  }
+}
+
+const char *CRC32C::implementation()
+{
+  return ::implementation().name;
+}
+
+uint32_t CRC32C::update(uint32_t crc, const void *data, size_t size)
+{
+  return ~::implementation().update(~crc, static_cast<const uint8_t*>(data), size);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * CRC32C (Castagnoli), as in iSCSI, ext4 and btrfs: used to verify SER frames end to end (see SER_HashesHeader).
+ * The implementation is chosen at runtime: the SSE 4.2 crc32 instruction on x86, the ARMv8 CRC extension when built for it,
+ * a slicing by 8 table otherwise.
+ */
+namespace CRC32C {
+  /// Name of the implementation in use ("sse4.2", "armv8", "table")
+  const char *implementation();
+  /// Continues crc (0 to start) over size bytes
+  uint32_t update(uint32_t crc, const void *data, std::size_t size);
+  inline uint32_t checksum(const void *data, std::size_t size) { return update(0, data, size); }
+}
+
+#endif // CRC32C_H
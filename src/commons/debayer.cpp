@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "commons/debayer.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstdlib>
+#include <QHash>
+#include <boost/endian/conversion.hpp>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+// Output rows per parallel stripe
+#define DEBAYER_STRIPE_ROWS 16
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+
+void for_each_row(int rows, const function<void(int)> &row) {
+  const int stripes = (rows + DEBAYER_STRIPE_ROWS - 1) / DEBAYER_STRIPE_ROWS;
+  cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+    const int last = min(rows, (stripe + 1) * DEBAYER_STRIPE_ROWS);
+    for(int y = stripe * DEBAYER_STRIPE_ROWS; y < last; y++)
+      row(y);
+  }});
+}
+
+// Mirrored around the border pixel: -1 reads 1, so that the neighbour has the same colour as the missing one
+inline int mirror(int i, int size) {
+  while(i < 0 || i >= size)
+    i = i < 0 ? -i : 2 * size - 2 - i;
+  return i;
+}
+
+template<typename In, bool Swap> inline int load(const In *row, int x) {
+  const In value = row[x];
+  return Swap ? static_cast<uint16_t>((value >> 8) | (value << 8)) : value;
+}
+
+template<typename In, typename Out> inline Out store(int value) {
+  value = max(0, min<int>(value, numeric_limits<In>::max()));
+  // Same rounding as PixelKernels::to8bit
+  if(sizeof(In) > sizeof(Out))
+    return static_cast<Out>(min(255, (value + 128) >> 8));
+  return static_cast<Out>(value);
+}
+
+template<typename In, typename Out> inline void store_rgb(Out *pixel, int r, int g, int b) {
+  pixel[0] = store<In, Out>(r);
+  pixel[1] = store<In, Out>(g);
+  pixel[2] = store<In, Out>(b);
+}
+
+// Red sample of the 2x2 cell at (red.x, red.y); blue on the opposite corner, green on the other two
+struct Pattern {
+  cv::Point red;
+  bool red_row(int y) const { return (y & 1) == red.y; }
+  bool red_column(int x) const { return (x & 1) == red.x; }
+};
+
+template<typename In, typename Out, bool Swap> void superpixel(const cv::Mat &bayer, cv::Mat &rgb, const Pattern &pattern) {
+  const cv::Point red = pattern.red, blue{1 - red.x, 1 - red.y};
+  for_each_row(rgb.rows, [&](int y) {
+    const In *cell[] = { bayer.ptr<In>(y * 2), bayer.ptr<In>(y * 2 + 1) };
+    Out *pixel = rgb.ptr<Out>(y);
+    for(int x = 0; x < rgb.cols * 2; x += 2, pixel += 3)
+      store_rgb<In, Out>(pixel,
+        load<In, Swap>(cell[red.y], x + red.x),
+        (load<In, Swap>(cell[red.y], x + blue.x) + load<In, Swap>(cell[blue.y], x + red.x) + 1) / 2,
+        load<In, Swap>(cell[blue.y], x + blue.x));
+  });
+}
+
+template<typename In, typename Out, bool Swap> void bilinear(const cv::Mat &bayer, cv::Mat &rgb, const Pattern &pattern) {
+  const int rows = bayer.rows, cols = bayer.cols;
+  for_each_row(rows, [&](int y) {
+    const In *above = bayer.ptr<In>(mirror(y - 1, rows)), *row = bayer.ptr<In>(y), *below = bayer.ptr<In>(mirror(y + 1, rows));
+    const bool red_row = pattern.red_row(y);
+    Out *pixel = rgb.ptr<Out>(y);
+    for(int x = 0; x < cols; x++, pixel += 3) {
+      const int left = mirror(x - 1, cols), right = mirror(x + 1, cols);
+      const int value = load<In, Swap>(row, x);
+      if(red_row != pattern.red_column(x)) {
+        // Green: the row colour left and right, the other one above and below
+        const int horizontal = (load<In, Swap>(row, left) + load<In, Swap>(row, right) + 1) / 2;
+        const int vertical = (load<In, Swap>(above, x) + load<In, Swap>(below, x) + 1) / 2;
+        store_rgb<In, Out>(pixel, red_row ? horizontal : vertical, value, red_row ? vertical : horizontal);
+      } else {
+        const int cross = (load<In, Swap>(row, left) + load<In, Swap>(row, right) + load<In, Swap>(above, x) + load<In, Swap>(below, x) + 2) / 4;
+        const int diagonals = (load<In, Swap>(above, left) + load<In, Swap>(above, right) + load<In, Swap>(below, left) + load<In, Swap>(below, right) + 2) / 4;
+        store_rgb<In, Out>(pixel, red_row ? value : diagonals, cross, red_row ? diagonals : value);
+      }
+    }
+  });
+}
+
+template<typename In, typename Out, bool Swap> void edge_aware(const cv::Mat &bayer, cv::Mat &rgb, const Pattern &pattern) {
+  const int rows = bayer.rows, cols = bayer.cols;
+  const int max_value = numeric_limits<In>::max();
+  // First pass: the whole green plane, which the second pass needs around each pixel
+  cv::Mat green(rows, cols, CV_32SC1);
+  for_each_row(rows, [&](int y) {
+    const In *row = bayer.ptr<In>(y);
+    const In *above = bayer.ptr<In>(mirror(y - 1, rows)), *above2 = bayer.ptr<In>(mirror(y - 2, rows));
+    const In *below = bayer.ptr<In>(mirror(y + 1, rows)), *below2 = bayer.ptr<In>(mirror(y + 2, rows));
+    const bool red_row = pattern.red_row(y);
+    int *g = green.ptr<int>(y);
+    for(int x = 0; x < cols; x++) {
+      const int value = load<In, Swap>(row, x);
+      if(red_row != pattern.red_column(x)) {
+        g[x] = value;
+        continue;
+      }
+      const int west = load<In, Swap>(row, mirror(x - 1, cols)), east = load<In, Swap>(row, mirror(x + 1, cols));
+      const int west2 = load<In, Swap>(row, mirror(x - 2, cols)), east2 = load<In, Swap>(row, mirror(x + 2, cols));
+      const int north = load<In, Swap>(above, x), south = load<In, Swap>(below, x);
+      const int north2 = load<In, Swap>(above2, x), south2 = load<In, Swap>(below2, x);
+      // Gradients from the green neighbours and from the second derivative of the centre colour
+      const int horizontal_gradient = abs(west - east) + abs(2 * value - west2 - east2);
+      const int vertical_gradient = abs(north - south) + abs(2 * value - north2 - south2);
+      const int horizontal = (2 * (west + east) + 2 * value - west2 - east2) / 4;
+      const int vertical = (2 * (north + south) + 2 * value - north2 - south2) / 4;
+      const int interpolated = horizontal_gradient < vertical_gradient ? horizontal : vertical_gradient < horizontal_gradient ? vertical : (horizontal + vertical) / 2;
+      g[x] = max(0, min(interpolated, max_value));
+    }
+  });
+  // Second pass: red and blue from the colour differences with green, which vary slowly even across edges
+  for_each_row(rows, [&](int y) {
+    const int y_above = mirror(y - 1, rows), y_below = mirror(y + 1, rows);
+    const In *above = bayer.ptr<In>(y_above), *row = bayer.ptr<In>(y), *below = bayer.ptr<In>(y_below);
+    const int *g_above = green.ptr<int>(y_above), *g = green.ptr<int>(y), *g_below = green.ptr<int>(y_below);
+    const bool red_row = pattern.red_row(y);
+    Out *pixel = rgb.ptr<Out>(y);
+    for(int x = 0; x < cols; x++, pixel += 3) {
+      const int left = mirror(x - 1, cols), right = mirror(x + 1, cols);
+      const int value = load<In, Swap>(row, x);
+      if(red_row != pattern.red_column(x)) {
+        const int horizontal = value + ((load<In, Swap>(row, left) - g[left]) + (load<In, Swap>(row, right) - g[right])) / 2;
+        const int vertical = value + ((load<In, Swap>(above, x) - g_above[x]) + (load<In, Swap>(below, x) - g_below[x])) / 2;
+        store_rgb<In, Out>(pixel, red_row ? horizontal : vertical, value, red_row ? vertical : horizontal);
+      } else {
+        const int diagonals = g[x] + ((load<In, Swap>(above, left) - g_above[left]) + (load<In, Swap>(above, right) - g_above[right])
+                                    + (load<In, Swap>(below, left) - g_below[left]) + (load<In, Swap>(below, right) - g_below[right])) / 4;
+        store_rgb<In, Out>(pixel, red_row ? value : diagonals, g[x], red_row ? diagonals : value);
+      }
+    }
+  });
+}
+
+template<typename In, typename Out, bool Swap> void run(const cv::Mat &bayer, const Pattern &pattern, Debayer::Algorithm algorithm, cv::Mat &rgb) {
+  const int type = CV_MAKETYPE(sizeof(Out) == 1 ? CV_8U : CV_16U, 3);
+  if(algorithm == Debayer::Superpixel) {
+    rgb.create(bayer.rows / 2, bayer.cols / 2, type);
+    superpixel<In, Out, Swap>(bayer, rgb, pattern);
+  } else {
+    rgb.create(bayer.rows, bayer.cols, type);
+    if(algorithm == Debayer::EdgeAware)
+      edge_aware<In, Out, Swap>(bayer, rgb, pattern);
+    else
+      bilinear<In, Out, Swap>(bayer, rgb, pattern);
+  }
+}
+}
+
+bool Debayer::is_bayer(Frame::ColorFormat format)
+{
+  return format == Frame::Bayer_RGGB || format == Frame::Bayer_GRBG || format == Frame::Bayer_GBRG || format == Frame::Bayer_BGGR;
+}
+
+bool Debayer::needs_swap(const Frame &frame)
+{
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  return frame.mat().depth() == CV_16U && (native_little_endian ? frame.byteOrder() == Frame::BigEndian : frame.byteOrder() == Frame::LittleEndian);
+}
+
+cv::Mat Debayer::debayer(const cv::Mat &bayer, Frame::ColorFormat format, const Options &options)
+{
+  cv::Mat rgb;
+  debayer(bayer, format, options, rgb);
+  return rgb;
+}
+
+void Debayer::debayer(const cv::Mat &bayer, Frame::ColorFormat format, const Options &options, cv::Mat &rgb)
+{
+  if(! is_bayer(format) || bayer.channels() != 1 || bayer.rows < 2 || bayer.cols < 2 || (bayer.depth() != CV_8U && bayer.depth() != CV_16U)) {
+    rgb.release();
+    return;
+  }
+  static const QHash<int, cv::Point> red_positions {
+    {Frame::Bayer_RGGB, {0, 0}},
+    {Frame::Bayer_GRBG, {1, 0}},
+    {Frame::Bayer_GBRG, {0, 1}},
+    {Frame::Bayer_BGGR, {1, 1}},
+  };
+  const Pattern pattern{red_positions[format]};
+  if(bayer.depth() == CV_8U)
+    run<uint8_t, uint8_t, false>(bayer, pattern, options.algorithm, rgb);
+  else if(options.to8bit)
+    options.swap ? run<uint16_t, uint8_t, true>(bayer, pattern, options.algorithm, rgb) : run<uint16_t, uint8_t, false>(bayer, pattern, options.algorithm, rgb);
+  else
+    options.swap ? run<uint16_t, uint16_t, true>(bayer, pattern, options.algorithm, rgb) : run<uint16_t, uint16_t, false>(bayer, pattern, options.algorithm, rgb);
+}
+
+FrameConstPtr Debayer::debayer(const FrameConstPtr &frame, Algorithm algorithm)
+{
+  if(! is_bayer(frame->colorFormat()))
+    return frame;
+  auto rgb = debayer(frame->mat(), frame->colorFormat(), {algorithm, needs_swap(*frame), false});
+  if(rgb.empty())
+    return frame;
+  const auto native = boost::endian::order::native == boost::endian::order::little ? Frame::LittleEndian : Frame::BigEndian;
+  auto debayered = make_shared<Frame>(Frame::RGB, rgb, native, Frame::ShareBuffer);
+  debayered->copy_metadata(*frame);
+  return debayered;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DEBAYER_H
+#define DEBAYER_H
+
+#include <opencv2/core/core.hpp>
+#include "commons/frame.h"
+
+/**
+ * Colour interpolation of Bayer frames, run in parallel over row stripes.
+ * 16 bit input is read in either byte order, and can be brought to 8 bit on the way: no separate swap or conversion pass.
+ * Borders are mirrored two pixels at a time, keeping the pattern. Output is always RGB.
+ */
+namespace Debayer {
+  enum Algorithm {
+    Superpixel = 0, ///< One RGB pixel for each 2x2 cell, half width and height: no interpolation at all, the cheapest
+    Bilinear = 1, ///< Average of the nearest samples of each colour, as cv::COLOR_Bayer*2BGR
+    EdgeAware = 2, ///< Green along the smoother direction (Hamilton-Adams), then red and blue from colour differences: fewer zippers on edges
+  };
+  struct Options {
+    Algorithm algorithm;
+    /// 16 bit input with its bytes in the non native order
+    bool swap;
+    /// CV_8UC3 output, rounded as PixelKernels::to8bit; otherwise the output has the input depth
+    bool to8bit;
+  };
+  bool is_bayer(Frame::ColorFormat format);
+  /// Whether the 16 bit values of frame need their bytes swapped to be read on this machine
+  bool needs_swap(const Frame &frame);
+  /**
+   * RGB image of bayer, a CV_8UC1 or CV_16UC1 area starting on an even row and column of a frame in format.
+   * Superpixel output drops the last row and column when they're odd. Empty for other formats, or areas smaller than 2x2.
+   */
+  cv::Mat debayer(const cv::Mat &bayer, Frame::ColorFormat format, const Options &options);
+  /// As above, into rgb: its memory is reused when it already has the output size and type
+  void debayer(const cv::Mat &bayer, Frame::ColorFormat format, const Options &options, cv::Mat &rgb);
+  /// RGB frame in native byte order, with the metadata of frame; frames not in a Bayer format are returned as they are
+  FrameConstPtr debayer(const FrameConstPtr &frame, Algorithm algorithm);
+}
+
+#endif // DEBAYER_H
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DEBAYER_H
+#include "commons/depthreduction.h"
+#include "commons/pixel_kernels.h"
+#include "commons/debayer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+using namespace std;
+
+// Left out of the histogram range on either side: hot pixels and dead ones
+#define DEPTH_REDUCTION_CLIP 0.0001
+// Pixels counted for the histogram range: one every so many rows and columns
+#define DEPTH_REDUCTION_HISTOGRAM_STEP 4
+
+namespace {
+// Void and cluster (Ulichney, 1993) on a torus: a gaussian energy around each point finds the tightest cluster of points, or the largest void between them.
+// Points are ranked by removing clusters from, and filling voids in, an evenly spread pattern: every threshold level is then as evenly spread as the pattern.
+vector<uint8_t> void_and_cluster(int size) {
+  const int cells = size * size;
+  const float sigma = 1.5;
+  // Rows are repeated twice, so that the energy update runs over contiguous values
+  vector<float> kernel(cells * 2);
+  for(int y = 0; y < size; y++)
+    for(int x = 0; x < size * 2; x++) {
+      const int dx = min(x % size, size - x % size), dy = min(y, size - y);
+      kernel[y * size * 2 + x] = exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+    }
+  vector<float> energy(cells, 0);
+  vector<bool> points(cells, false);
+  auto toggle = [&](int cell) {
+    points[cell] = !points[cell];
+    const float sign = points[cell] ? 1 : -1;
+    const int cell_x = cell % size, cell_y = cell / size;
+    for(int y = 0; y < size; y++) {
+      const float *row = kernel.data() + ((y - cell_y + size) % size) * size * 2 + size - cell_x;
+      float *row_energy = energy.data() + y * size;
+      for(int x = 0; x < size; x++)
+        row_energy[x] += sign * row[x];
+    }
+  };
+  auto tightest_cluster = [&] {
+    int found = -1;
+    for(int cell = 0; cell < cells; cell++)
+      if(points[cell] && (found < 0 || energy[cell] > energy[found]))
+        found = cell;
+    return found;
+  };
+  auto largest_void = [&] {
+    int found = -1;
+    for(int cell = 0; cell < cells; cell++)
+      if(!points[cell] && (found < 0 || energy[cell] < energy[found]))
+        found = cell;
+    return found;
+  };
+
+  // Initial pattern: random points, spread out by moving the tightest cluster to the largest void until it moves right back
+  const int initial = cells / 10;
+  mt19937 random{1};
+  for(int added = 0; added < initial;) {
+    const int cell = random() % cells;
+    if(!points[cell]) {
+      toggle(cell);
+      added++;
+    }
+  }
+  for(int moves = 0; moves < cells; moves++) {
+    const int cluster = tightest_cluster();
+    toggle(cluster);
+    const int empty = largest_void();
+    toggle(empty);
+    if(empty == cluster)
+      break;
+  }
+
+  vector<int> ranks(cells);
+  const auto initial_points = points;
+  const auto initial_energy = energy;
+  for(int rank = initial - 1; rank >= 0; rank--) {
+    const int cluster = tightest_cluster();
+    ranks[cluster] = rank;
+    toggle(cluster);
+  }
+  points = initial_points;
+  energy = initial_energy;
+  // Past half of the cells, the largest void of the points is also the tightest cluster of the empty cells: their energies add up to a constant
+  for(int rank = initial; rank < cells; rank++) {
+    const int empty = largest_void();
+    ranks[empty] = rank;
+    toggle(empty);
+  }
+  vector<uint8_t> thresholds(cells);
+  for(int cell = 0; cell < cells; cell++)
+    thresholds[cell] = static_cast<uint8_t>(ranks[cell] * 256 / cells);
+  return thresholds;
+}
+}
+
+DPTR_IMPL(DepthReduction) {
+  const Mapping mapping;
+  const PixelKernels::Scale8 scale;
+  // One row of thresholds for every sample of a frame row, for each row of the blue noise tile (a single row of roundings without dither)
+  int samples = 0;
+  vector<uint8_t> thresholds;
+  const uint8_t *row_thresholds(int y, int width, int channels);
+};
+
+const uint8_t *DepthReduction::Private::row_thresholds(int y, int width, int channels)
+{
+  if(samples != width * channels) {
+    samples = width * channels;
+    if(mapping.dither) {
+      const auto &noise = blue_noise();
+      thresholds.resize(static_cast<size_t>(samples) * blue_noise_size);
+      // Same threshold for all the channels of a pixel: the dither is in the luminance, without colour noise
+      for(int row = 0; row < blue_noise_size; row++)
+        for(int x = 0; x < width; x++)
+          fill_n(thresholds.begin() + row * samples + x * channels, channels, noise[row * blue_noise_size + x % blue_noise_size]);
+    } else {
+      thresholds.assign(samples, 128);
+    }
+  }
+  return thresholds.data() + (mapping.dither ? (y % blue_noise_size) * samples : 0);
+}
+
+DepthReduction::DepthReduction(const Mapping &mapping) : dptr(mapping, PixelKernels::scale8(mapping.black, mapping.white))
+{
+}
+
+DepthReduction::~DepthReduction()
+{
+}
+
+DepthReduction::Mapping DepthReduction::mapping() const
+{
+  return d->mapping;
+}
+
+QVariantMap DepthReduction::Mapping::asMap() const
+{
+  return {
+    {"bpp", 8},
+    {"black", black},
+    {"white", white},
+    {"dither", dither ? "blue-noise" : "none"},
+  };
+}
+
+DepthReduction::Mapping DepthReduction::from_histogram(const vector<vector<uint32_t>> &histogram, bool dither)
+{
+  vector<uint64_t> counts(65536, 0);
+  for(const auto &channel: histogram)
+    for(size_t value = 0; value < min(channel.size(), counts.size()); value++)
+      counts[value] += channel[value];
+  const uint64_t total = accumulate(counts.begin(), counts.end(), uint64_t{0});
+  Mapping mapping;
+  mapping.dither = dither;
+  if(total == 0)
+    return mapping;
+  const uint64_t clipped = static_cast<uint64_t>(total * DEPTH_REDUCTION_CLIP);
+  uint64_t below = 0;
+  size_t black = 0;
+  while(below + counts[black] <= clipped)
+    below += counts[black++];
+  uint64_t above = 0;
+  size_t white = counts.size() - 1;
+  while(above + counts[white] <= clipped)
+    above += counts[white--];
+  mapping.black = static_cast<uint16_t>(min<size_t>(black, 65534));
+  mapping.white = static_cast<uint16_t>(max<size_t>(white, mapping.black + 1));
+  return mapping;
+}
+
+DepthReduction::Mapping DepthReduction::from_frame(const Frame &frame, bool dither)
+{
+  if(frame.bpp() != 16)
+    return Mapping{0, 255, dither};
+  return from_histogram(PixelKernels::histogram(frame.mat(), Debayer::needs_swap(frame), DEPTH_REDUCTION_HISTOGRAM_STEP), dither);
+}
+
+FrameConstPtr DepthReduction::reduce(const FrameConstPtr &frame)
+{
+  if(frame->bpp() != 16)
+    return frame;
+  auto reduced = make_shared<Frame>(8, frame->colorFormat(), frame->resolution(), frame->byteOrder());
+  reduced->copy_metadata(*frame);
+  const cv::Mat &source = frame->mat();
+  cv::Mat &destination = reduced->mat();
+  const bool swap = Debayer::needs_swap(*frame);
+  const int channels = source.channels();
+  for(int y = 0; y < source.rows; y++)
+    PixelKernels::scale8(source.ptr<uint16_t>(y), destination.ptr<uint8_t>(y), static_cast<size_t>(source.cols) * channels, swap, d->scale, d->row_thresholds(y, source.cols, channels));
+  return reduced;
+}
+
+const vector<uint8_t> &DepthReduction::blue_noise()
+{
+  static const vector<uint8_t> noise = void_and_cluster(blue_noise_size);
+  return noise;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DEBAYER_H
+#ifndef DEPTHREDUCTION_H
+#define DEPTHREDUCTION_H
+
+#include <cstdint>
+#include <vector>
+#include <QVariantMap>
+#include "commons/frame.h"
+#include "c++/dptr.h"
+
+/**
+ * 16 bit frames saved as 8 bit ones, for sensors sending more bits than they resolve (10 or 12 bit sensors, or high gain noise): half the disk bandwidth.
+ * Values between the black and white points are scaled linearly (see PixelKernels::scale8), and dithered with blue noise instead of plainly rounded
+ * when enabled, so that smooth gradients don't band. All the frames of a recording share the same mapping: a fixed one, or one from the first frame histogram.
+ */
+class DepthReduction
+{
+public:
+  struct Mapping {
+    uint16_t black = 0;
+    uint16_t white = 65535;
+    bool dither = true;
+    /// For the recording information
+    QVariantMap asMap() const;
+  };
+  /// Black and white points leaving out the darkest and the brightest 0.01% of the values counted in histogram (see PixelKernels::histogram), all channels together
+  static Mapping from_histogram(const std::vector<std::vector<uint32_t>> &histogram, bool dither);
+  /// As above, from a sample of the pixels of a 16 bit frame
+  static Mapping from_frame(const Frame &frame, bool dither);
+  DepthReduction(const Mapping &mapping);
+  ~DepthReduction();
+  Mapping mapping() const;
+  /// 8 bit frame in the same colour format, with the metadata of frame; 8 bit frames are returned as they are
+  FrameConstPtr reduce(const FrameConstPtr &frame);
+  /// Dither thresholds: a tile of blue_noise_size² values, row by row, with each value from 0 to 255 equally often (void and cluster)
+  static constexpr int blue_noise_size = 64;
+  static const std::vector<uint8_t> &blue_noise();
+private:
+  DPTR
+};
+
+#endif // DEPTHREDUCTION_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "executor.h"
+#include "commons/threadplacement.h"
+#include "Qt/qt_strings_helper.h"
+#include <QThread>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+Executor &Executor::instance(Kind kind)
+{
+  static const int cores = max(2, QThread::idealThreadCount());
+  switch(kind) {
+    case CaptureCritical: {
+      static Executor executor{"capture_critical", cores, cores * 4, -5};
+      return executor;
+    }
+    case Analysis: {
+      static Executor executor{"analysis", max(2, cores / 2), cores * 2, 5};
+      return executor;
+    }
+    case NetworkEncode: {
+      static Executor executor{"network_encode", max(2, cores / 2), 8, 0};
+      return executor;
+    }
+    default: {
+      static Executor executor{"background_io", max(8, cores), 256, 10};
+      return executor;
+    }
+  }
+}
+
+Executor::Executor(const QString &name, int threads, int capacity, int nice)
+  : name{name}, capacity{capacity}, nice{nice},
+    queue_time(Metrics::instance().histogram("executor_queue_seconds", "Time jobs wait in the executor queue before running", "executor=\"%1\""_q % name)),
+    queue_length(Metrics::instance().gauge("executor_queued_jobs", "Jobs queued or running on the executor", "executor=\"%1\""_q % name)),
+    rejected(Metrics::instance().counter("executor_rejected_total", "Jobs dropped because the executor queue was full", "executor=\"%1\""_q % name))
+{
+  pool.setMaxThreadCount(threads);
+  pool.setExpiryTimeout(30000);
+}
+
+Executor::~Executor()
+{
+  pool.waitForDone();
+}
+
+void Executor::setCpus(const QList<int> &cpus)
+{
+  QMutexLocker lock(&cpus_mutex);
+  if(cpus == this->cpus)
+    return;
+  this->cpus = cpus;
+  cpus_version++;
+}
+
+void Executor::pending_jobs(int change)
+{
+  queue_length.set(pending.fetch_add(change) + change);
+}
+
+Executor::Running::Running(Executor &executor, const chrono::steady_clock::time_point &queued) : executor(executor)
+{
+  executor.queue_time.record(chrono::duration_cast<Metrics::Histogram::Duration>(chrono::steady_clock::now() - queued));
+  // Every pool has threads of its own: the placement they got is the one of this executor
+  static thread_local int cpus_version = 0;
+  if(cpus_version != executor.cpus_version.load()) {
+    QMutexLocker lock(&executor.cpus_mutex);
+    cpus_version = executor.cpus_version;
+    ThreadPlacement::apply(executor.name, executor.cpus);
+  }
+  // Pool threads are created lazily: set their priority the first time they run one of our jobs
+  static thread_local bool prioritised = false;
+  if(prioritised)
+    return;
+  prioritised = true;
+#ifdef Q_OS_LINUX
+  // Linux threads have their own niceness, while QThread::setPriority is a no-op with the default scheduler
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), executor.nice);
+#else
+  QThread::currentThread()->setPriority(executor.nice < 0 ? QThread::HighPriority : executor.nice > 0 ? QThread::LowPriority : QThread::NormalPriority);
+#endif
+}
+
+Executor::Running::~Running()
+{
+  executor.pending_jobs(-1);
+}
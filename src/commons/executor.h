@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+#include <QThreadPool>
+#include <QMutex>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include "commons/metrics.h"
+
+/**
+ * A named thread pool, with its own threads, OS priority and bounded queue, so that a burst of one kind of work
+ * (i.e. network frame encodes) can't starve the others (histograms, camera scans).
+ * Queue times, queued jobs and rejected jobs are exported as executor_* metrics, labelled with the executor name.
+ */
+class Executor
+{
+public:
+  enum Kind {
+    CaptureCritical, ///< Frame handlers the capture waits for
+    Analysis, ///< Best effort frame analysis: histogram, focus, stacking
+    NetworkEncode, ///< Frames encoded for, or decoded from, the network
+    BackgroundIO, ///< Camera scans, opening drivers, files opened and closed away from the writer
+  };
+  static Executor &instance(Kind kind);
+
+  /// nice is the Unix niceness of the pool threads (lower values need privileges, and are silently ignored without them)
+  Executor(const QString &name, int threads, int capacity, int nice);
+  ~Executor();
+
+  /// Queues the job, whatever the length of the queue: for callers bounding their own work (i.e. waiting on the futures)
+  template<typename F> auto run(F job) -> QFuture<decltype(job())> {
+    auto queued = std::chrono::steady_clock::now();
+    pending_jobs(1);
+    return QtConcurrent::run(&pool, [this, job, queued]() mutable {
+      Running running{*this, queued};
+      return job();
+    });
+  }
+  /// Queues the job only if there are less than capacity jobs queued or running; false when the job is dropped
+  template<typename F> bool tryRun(F job) {
+    if(pending.load() >= capacity) {
+      rejected.add();
+      return false;
+    }
+    run(job);
+    return true;
+  }
+  /// Runs job on the pool, then on_done with its result in the thread of context (unless context is gone by then)
+  template<typename T> void run(const std::function<T()> &job, const std::function<void(const T&)> &on_done, QObject *context) {
+    auto watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, on_done] {
+      on_done(watcher->result());
+      watcher->deleteLater();
+    });
+    watcher->setFuture(run(job));
+  }
+  int queued() const { return pending.load(); }
+  /// Pins the pool threads to cpus (empty: any CPU), each one before its next job
+  void setCpus(const QList<int> &cpus);
+  void waitForDone() { pool.waitForDone(); }
+private:
+  struct Running {
+    Running(Executor &executor, const std::chrono::steady_clock::time_point &queued);
+    ~Running();
+    Executor &executor;
+  };
+  void pending_jobs(int change);
+  const QString name;
+  const int capacity;
+  const int nice;
+  QThreadPool pool;
+  std::atomic_int pending{0};
+  QMutex cpus_mutex;
+  QList<int> cpus;
+  std::atomic_int cpus_version{0};
+  Metrics::Histogram &queue_time;
+  Metrics::Gauge &queue_length;
+  Metrics::Counter &rejected;
+};
+
+#endif // EXECUTOR_H
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "exposurecontrol.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+// Brightness change of a single step, and highlights level above which the frame is taken as saturated
+const double max_step = 2;
+const double saturated = 0.995;
+}
+
+ExposureControl::ExposureControl(double target, double tolerance) : target{target}, tolerance{tolerance}
+{
+}
+
+ExposureControl::Point ExposureControl::next(const Point &current, double level, const Limits &limits)
+{
+  const double error = level / target - 1;
+  if(fabs(error) <= (_adjusting ? tolerance : 3 * tolerance) / target) {
+    _adjusting = false;
+    return current;
+  }
+  _adjusting = true;
+  // Saturated highlights say nothing about how far off we are: halve
+  double factor = level >= saturated ? 1 / max_step : (level <= 0 ? max_step : target / level);
+  factor = max(1 / max_step, min(max_step, factor));
+
+  const bool use_gain = limits.gain_per_doubling > 0;
+  Point next = current;
+  if(factor > 1) {
+    next.exposure = min(limits.max_exposure, max(limits.min_exposure, current.exposure * factor));
+    const double left = factor * current.exposure / next.exposure;
+    if(use_gain && left > 1)
+      next.gain = min(limits.max_gain, current.gain + log2(left) * limits.gain_per_doubling);
+  } else {
+    if(use_gain)
+      next.gain = max(limits.min_gain, current.gain + log2(factor) * limits.gain_per_doubling);
+    const double left = use_gain ? factor / exp2((next.gain - current.gain) / limits.gain_per_doubling) : factor;
+    next.exposure = min(limits.max_exposure, max(limits.min_exposure, current.exposure * left));
+  }
+  return next;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef EXPOSURECONTROL_H
+#define EXPOSURECONTROL_H
+
+/**
+ * Auto exposure decisions, from the highlights level of each frame (see AutoExposure).
+ * Corrections start when the level is off target by more than 3 tolerances, and go on until it's back within one:
+ * the band in between keeps the loop from hunting on seeing noise. Each step changes brightness by at most a factor of 2.
+ * Brighter: exposure first, up to its limit (short exposures freeze the seeing), then gain. Darker: gain first, then exposure.
+ */
+class ExposureControl
+{
+public:
+  struct Point {
+    double exposure; ///< seconds
+    double gain;     ///< camera units
+  };
+  struct Limits {
+    double min_exposure, max_exposure;
+    double min_gain, max_gain;
+    /// Gain units doubling the brightness (60 for 0.1 dB units): 0 leaves gain alone
+    double gain_per_doubling;
+  };
+  /// target and tolerance: fractions of the full scale
+  ExposureControl(double target = 0.7, double tolerance = 0.05);
+  /// Exposure and gain to use after a frame taken at current, with highlights at level (0 to 1); current itself when nothing is to be done
+  Point next(const Point &current, double level, const Limits &limits);
+  /// Whether the level was last seen out of the tolerance band
+  bool adjusting() const { return _adjusting; }
+  void reset() { _adjusting = false; }
+private:
+  double target;
+  double tolerance;
+  bool _adjusting = false;
+};
+
+#endif // EXPOSURECONTROL_H
@@ -0,0 +1,76 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "exposureprogress.h"
+#include <algorithm>
+
+using namespace std;
+
+chrono::duration<double> ExposureProgress::Status::remaining() const
+{
+  return state == Exposing ? max(exposure - elapsed, chrono::duration<double>{0}) : chrono::duration<double>{0};
+}
+
+void ExposureProgress::started(const chrono::duration<double> &exposure, Clock::time_point at)
+{
+  write(Exposing, at.time_since_epoch().count(), exposure.count(), true);
+}
+
+void ExposureProgress::reading_out()
+{
+  // Workers don't know whether the shot is a long exposure: only those that were marked as started are followed
+  if(state.load(memory_order_relaxed) != Exposing)
+    return;
+  write(ReadingOut, start.load(memory_order_relaxed), exposure.load(memory_order_relaxed), false);
+}
+
+void ExposureProgress::finished()
+{
+  write(Idle, start.load(memory_order_relaxed), exposure.load(memory_order_relaxed), false);
+}
+
+void ExposureProgress::write(State state, Clock::rep start, double exposure, bool new_shot)
+{
+  const auto version = this->version.load(memory_order_relaxed);
+  this->version.store(version + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  this->state.store(state, memory_order_relaxed);
+  this->start.store(start, memory_order_relaxed);
+  this->exposure.store(exposure, memory_order_relaxed);
+  if(new_shot)
+    shot.store(shot.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  this->version.store(version + 2, memory_order_release);
+}
+
+ExposureProgress::Status ExposureProgress::status(Clock::time_point now) const
+{
+  Status status;
+  Clock::rep start;
+  quint64 version;
+  do {
+    version = this->version.load(memory_order_acquire);
+    status.state = static_cast<State>(state.load(memory_order_relaxed));
+    start = this->start.load(memory_order_relaxed);
+    status.exposure = chrono::duration<double>{exposure.load(memory_order_relaxed)};
+    status.shot = shot.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while((version & 1) || version != this->version.load(memory_order_relaxed));
+  if(status.state != Idle)
+    status.elapsed = max(chrono::duration<double>{now - Clock::time_point{Clock::duration{start}}}, chrono::duration<double>{0});
+  return status;
+}
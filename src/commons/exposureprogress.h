@@ -0,0 +1,66 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EXPOSUREPROGRESS_H
+#define EXPOSUREPROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <QtGlobal>
+#include "commons/fwd.h"
+
+FWD_PTR(ExposureProgress)
+
+/**
+ * Exposure in progress on the capture thread, for readers polling it when they repaint (i.e. on UpdatesCoalescer ticks):
+ * a start time and an exposure length, written with a few atomic stores, instead of signals and timers for every shot.
+ * Drivers that know when the sensor is read out report it, so that the remaining time doesn't run past zero while downloading.
+ * One writer (the capture thread, drivers included), any number of readers.
+ */
+class ExposureProgress
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  enum State { Idle = 0, Exposing = 1, ReadingOut = 2 };
+  struct Status {
+    State state = Idle;
+    std::chrono::duration<double> exposure{0};
+    std::chrono::duration<double> elapsed{0};
+    /// Exposures started so far: a different value from the previous status means a new one
+    quint64 shot = 0;
+    /// Down to 0 when the exposure is over, and while reading out
+    std::chrono::duration<double> remaining() const;
+  };
+  void started(const std::chrono::duration<double> &exposure, Clock::time_point at = Clock::now());
+  /// The sensor is done exposing and the frame is being downloaded; ignored when no exposure was started
+  void reading_out();
+  void finished();
+  Status status(Clock::time_point now = Clock::now()) const;
+private:
+  void write(State state, Clock::rep start, double exposure, bool new_shot);
+  // Odd while being written: readers retry
+  std::atomic<quint64> version{0};
+  std::atomic<int> state{Idle};
+  std::atomic<Clock::rep> start{0};
+  std::atomic<double> exposure{0};
+  std::atomic<quint64> shot{0};
+};
+
+#endif // EXPOSUREPROGRESS_H
@@ -18,29 +18,22 @@
  */
 
 #include "exposuretimer.h"
-#include <QTimer>
-#include <functional>
-#include <QElapsedTimer>
+#include "exposureprogress.h"
+#include "updatescoalescer.h"
 #include "drivers/imager.h"
 
 using namespace std;
-using namespace std::placeholders;
 
 DPTR_IMPL(ExposureTimer) {
-  QTimer *timer;
   ExposureTimer *q;
-  QElapsedTimer elapsed;
-  double exposure;
-  void started(double exposure);
-  void progress();
-  void finished();
+  ExposureProgressPtr exposure_progress;
+  ExposureProgress::State state = ExposureProgress::Idle;
+  void poll();
 };
 
-ExposureTimer::ExposureTimer(QObject* parent) : QObject{parent}, dptr(new QTimer{this}, this)
+ExposureTimer::ExposureTimer(QObject* parent) : QObject{parent}, dptr(this)
 {
-  d->timer->setSingleShot(false);
-  d->timer->setInterval(100);
-  connect(d->timer, &QTimer::timeout, this, bind(&Private::progress, d.get()));
+  UpdatesCoalescer::instance().add(this, [this]{ d->poll(); });
 }
 
 ExposureTimer::~ExposureTimer()
@@ -51,28 +44,26 @@ void ExposureTimer::set_imager(Imager* imager)
 {
   if(!imager)
     return;
-  connect(imager, &Imager::long_exposure_started, this, bind(&Private::started, d.get(), _1), Qt::QueuedConnection);
-  connect(imager, &Imager::long_exposure_ended, this, bind(&Private::finished, d.get()), Qt::QueuedConnection);
+  d->exposure_progress = imager->exposure_progress();
 }
 
-
-void ExposureTimer::Private::progress()
-{
-  double elapsed = static_cast<double>(this->elapsed.elapsed()) / 1000.;
-  emit q->progress(exposure, elapsed, exposure - elapsed);
-}
-
-
-void ExposureTimer::Private::started(double exposure)
+void ExposureTimer::Private::poll()
 {
-  this->exposure = exposure;
-  elapsed.restart();
-  progress();
-  timer->start();
-}
-
-void ExposureTimer::Private::finished()
-{
-  timer->stop();
-  emit q->finished();
+  if(! exposure_progress)
+    return;
+  const auto status = exposure_progress->status();
+  const bool was_idle = state == ExposureProgress::Idle;
+  state = status.state;
+  switch(status.state) {
+  case ExposureProgress::Exposing:
+    emit q->progress(status.exposure.count(), status.elapsed.count(), status.remaining().count());
+    break;
+  case ExposureProgress::ReadingOut:
+    emit q->readingOut(status.exposure.count());
+    break;
+  case ExposureProgress::Idle:
+    if(! was_idle)
+      emit q->finished();
+    break;
+  }
 }
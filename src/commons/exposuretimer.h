@@ -24,6 +24,10 @@
 #include "c++/dptr.h"
 
 class Imager;
+/**
+ * Long exposure progress for the GUI, read from Imager::exposure_progress on every UpdatesCoalescer tick.
+ * Signals are emitted on the main thread, only while an exposure is going on and once when it's over.
+ */
 class ExposureTimer : public QObject
 {
     Q_OBJECT
@@ -33,6 +37,8 @@ public:
   void set_imager(Imager *imager);
 signals:
   void progress(double total, double elapsed, double remaining);
+  /// The camera reported the end of the exposure: the frame is being downloaded
+  void readingOut(double total);
   void finished();
 private:
   DPTR
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FOCUSSOURCE_H
+#define FOCUSSOURCE_H
+#include <QObject>
+#include <QVariantList>
+#include "commons/fwd.h"
+
+FWD_PTR(FocusSource)
+
+/**
+ * Where the focus panel gets the focus measurements from: this process, or the server of a remote session.
+ * Each measurement is a map with "sequence", "time" (capture time, msecs since epoch), "metric" and "value",
+ * and for stars "x" and "y", the star centroid in frame pixels.
+ */
+class FocusSource : public QObject
+{
+  Q_OBJECT
+public slots:
+  /// Asks for the measurements since the previous refresh, emitted with measurements() (possibly later, for remote sources)
+  void refresh();
+signals:
+  void measurements(const QVariantList &measurements);
+protected:
+  /// Asks for the measurements of the frames after sequence, to be passed on to received()
+  virtual void request(quint64 after) = 0;
+  void received(const QVariantList &batch);
+private:
+  quint64 last_sequence = 0;
+};
+
+#endif // FOCUSSOURCE_H
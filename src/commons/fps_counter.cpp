@@ -74,7 +74,12 @@ fps_counter::fps_counter ( const OnFPS& onFPS, fps_counter::Mode mode, int fps_t
 
 fps_counter& fps_counter::operator++()
 {
-  ++d->frames;
+  return *this += 1;
+}
+
+fps_counter& fps_counter::operator+=(uint64_t frames)
+{
+  d->frames += frames;
   if(d->mode == Elapsed && d->count_time.elapsed() >= d->fps_trigger_milliseconds)
     d->timeout();
   return *this;
@@ -31,6 +31,7 @@ public:
   ~fps_counter();
   fps_counter(const OnFPS& onFPS, Mode mode = Timer, int fps_trigger_milliseconds = 1000, bool mean = false, QObject* parent = 0);
   fps_counter &operator++();
+  fps_counter &operator+=(uint64_t frames);
 
 private:
     DPTR
@@ -20,121 +20,84 @@
 #include "commons/frame.h"
 using namespace std;
 
-DPTR_IMPL(Frame) {
-  Private(uint8_t bpp, ColorFormat colorFormat, const QSize &resolution, ByteOrder byteOrder);
-  Private(ColorFormat colorFormat, const cv::Mat &image, ByteOrder byteOrder);
-  const QDateTime created_utc;
-  const ColorFormat color_format;
-  const uint8_t bpp;
-  const QSize resolution;
-  cv::Mat mat;
-  ByteOrder byteOrder;
-  Seconds exposure = Seconds::zero();
-  
-  static int cv_type(uint8_t bpp, ColorFormat format);
-};
-
-
-int Frame::Private::cv_type(uint8_t bpp, Frame::ColorFormat format)
-{
-  return CV_MAKETYPE( bpp == 8 ? CV_8U : CV_16U, format == RGB || format == BGR ? 3 : 1);
+namespace {
+  int cv_type(uint8_t bpp, Frame::ColorFormat format)
+  {
+    return CV_MAKETYPE( bpp == 8 ? CV_8U : CV_16U, format == Frame::RGB || format == Frame::BGR ? 3 : 1);
+  }
 }
 
-
-
-Frame::Private::Private(uint8_t bpp, Frame::ColorFormat colorFormat, const QSize &resolution, ByteOrder byteOrder)
-  : created_utc{QDateTime::currentDateTimeUtc()},
-  color_format{colorFormat},
-  bpp{bpp},
-  resolution{resolution},
-  byteOrder{byteOrder}
+Frame::Frame(uint8_t bpp, Frame::ColorFormat colorFormat, const QSize& resolution, ByteOrder byteOrder)
+  : _mat(resolution.height(), resolution.width(), cv_type(bpp, colorFormat)),
+  _created_utc{QDateTime::currentMSecsSinceEpoch()},
+  _color_format{colorFormat},
+  _byte_order{byteOrder}
 {
-    mat.create(resolution.height(), resolution.width(), Private::cv_type(bpp, colorFormat));
 }
 
-Frame::Private::Private(Frame::ColorFormat colorFormat, const cv::Mat& image, ByteOrder byteOrder)
-  : created_utc{QDateTime::currentDateTimeUtc()},
-  color_format{colorFormat},
-  bpp{image.depth() == CV_8U || image.depth() == CV_8S ? uint8_t{8} : uint8_t{16}},
-  resolution{image.cols, image.rows},
-  byteOrder{byteOrder}
+Frame::Frame(Frame::ColorFormat colorFormat, const cv::Mat& image, ByteOrder byteOrder, BufferMode bufferMode)
+  : _created_utc{QDateTime::currentMSecsSinceEpoch()},
+  _color_format{colorFormat},
+  _byte_order{byteOrder}
 {
-  image.copyTo(mat);
+  if(bufferMode == ShareBuffer)
+    _mat = image;
+  else
+    image.copyTo(_mat);
 }
 
-
-
-Frame::Frame(uint8_t bpp, Frame::ColorFormat colorFormat, const QSize& resolution, ByteOrder byteOrder) : dptr(bpp, colorFormat, resolution, byteOrder)
+Frame::Frame(const Frame& other, const cv::Rect& rect)
+  : _created_utc{other._created_utc},
+  _exposure{other._exposure},
+  _captured{other._captured},
+  _device_timestamp{other._device_timestamp},
+  _sequence{other._sequence},
+  _metadata{other._metadata},
+  _color_format{other._color_format},
+  _byte_order{other._byte_order},
+  _has_device_timestamp{other._has_device_timestamp}
 {
+  cv::Mat(other._mat, rect).copyTo(_mat);
+  if(_metadata.has_roi_offset()) {
+    _metadata.roi_x += rect.x;
+    _metadata.roi_y += rect.y;
+  }
 }
 
-Frame::Frame(Frame::ColorFormat colorFormat, const cv::Mat& image, ByteOrder byteOrder) : dptr(colorFormat, image, byteOrder)
-{
-}
-
-
-
 Frame::~Frame()
 {
+  if(auto recycler = _recycler.lock())
+    recycler->give_back(std::move(_mat));
 }
 
-uint8_t * Frame::data()
-{
-  return d->mat.data;
-}
-
-
-cv::Mat Frame::mat() const
-{
-  return d->mat;
-}
-
-QSize Frame::resolution() const
-{
-  return d->resolution;
-}
-
-std::size_t Frame::size() const
+FramePtr Frame::cropped(const cv::Rect& rect) const
 {
-  return d->mat.total()* d->mat.elemSize();
-}
-
-uint8_t Frame::bpp() const
-{
-  return d->bpp;
-}
-
-uint8_t Frame::channels() const
-{
-  return d->mat.channels();
+  return FramePtr{new Frame(*this, rect)};
 }
 
 QDateTime Frame::created_utc() const
 {
-  return d->created_utc;
-}
-
-Frame::ColorFormat Frame::colorFormat() const
-{
-  return d->color_format;
-}
-
-Frame::Seconds Frame::exposure() const
-{
-  return d->exposure;
+  return QDateTime::fromMSecsSinceEpoch(_created_utc, Qt::UTC);
 }
 
-void Frame::set_exposure(const Frame::Seconds& exposure)
+void Frame::set_created_utc(const QDateTime& created_utc)
 {
-  d->exposure = exposure;
+  _created_utc = created_utc.toMSecsSinceEpoch();
 }
 
-Frame::ByteOrder Frame::byteOrder() const
+void Frame::set_device_timestamp(const Timestamp& timestamp)
 {
-  return d->byteOrder;
+  _device_timestamp = timestamp;
+  _has_device_timestamp = true;
 }
 
-void Frame::overrideByteOrder(ByteOrder byteOrder)
+void Frame::copy_metadata(const Frame& source)
 {
-    d->byteOrder = byteOrder;
+  _created_utc = source._created_utc;
+  _exposure = source._exposure;
+  _captured = source._captured;
+  _has_device_timestamp = source._has_device_timestamp;
+  _device_timestamp = source._device_timestamp;
+  _sequence = source._sequence;
+  _metadata = source._metadata;
 }
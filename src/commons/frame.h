@@ -21,15 +21,21 @@
 #define FRAME_H
 
 #include <opencv2/opencv.hpp>
-#include "c++/dptr.h"
 #include <QSize>
 #include <QDateTime>
 #include <QVariantMap>
 #include <chrono>
 #include "commons/fwd.h"
+#include "commons/framemetadata.h"
 
 FWD_PTR(Frame)
+class FrameAnalysis;
 
+/**
+ * A captured image with its capture metadata.
+ * Everything is stored inline, with the capture time as milliseconds since epoch, so that creating a frame
+ * costs a single allocation besides the pixels (see FramePool, which also recycles those).
+ */
 class Frame
 {
 public:
@@ -43,28 +49,89 @@ public:
       Bayer_BGGR,
     };
   enum ByteOrder { BigEndian, LittleEndian };
-  Frame(ColorFormat colorFormat, const cv::Mat &image, ByteOrder byteOrder = BigEndian);
+  enum BufferMode { CopyBuffer, ShareBuffer };
+  Frame(ColorFormat colorFormat, const cv::Mat &image, ByteOrder byteOrder = BigEndian, BufferMode bufferMode = CopyBuffer);
   Frame(uint8_t bpp, ColorFormat colorFormat, const QSize &resolution, ByteOrder byteOrder = BigEndian);
   ~Frame();
-  std::size_t size() const;
-  uint8_t *data();
-  QSize resolution() const;
-  cv::Mat mat() const;
-  const cv::Mat cmat() const { return mat(); }
-  uint8_t channels() const;
-  uint8_t bpp() const;
+  std::size_t size() const { return _mat.total() * _mat.elemSize(); }
+  uint8_t *data() { return _mat.data; }
+  QSize resolution() const { return {_mat.cols, _mat.rows}; }
+  const cv::Mat &mat() const { return _mat; }
+  cv::Mat &mat() { return _mat; }
+  const cv::Mat &cmat() const { return _mat; }
+  uint8_t channels() const { return _mat.channels(); }
+  /// 8 or 16, from the pixel buffer depth
+  uint8_t bpp() const { return _mat.depth() == CV_8U || _mat.depth() == CV_8S ? 8 : 16; }
   QDateTime created_utc() const;
-  ColorFormat colorFormat() const;
-  ByteOrder byteOrder() const;
+  qint64 created_utc_msecs() const { return _created_utc; }
+  /// Capture time, when the frame is rebuilt away from where it was captured (i.e. received over the network)
+  void set_created_utc(const QDateTime &created_utc);
+  ColorFormat colorFormat() const { return _color_format; }
+  ByteOrder byteOrder() const { return _byte_order; }
 
   QVariantMap const as_variant();
   static FramePtr from_variant(const QVariantMap &map);
   typedef std::chrono::duration<double> Seconds;
-  Seconds exposure() const;
-  void set_exposure(const Seconds &exposure);
-  void overrideByteOrder(ByteOrder byteOrder);
+  Seconds exposure() const { return _exposure; }
+  void set_exposure(const Seconds &exposure) { _exposure = exposure; }
+  void overrideByteOrder(ByteOrder byteOrder) { _byte_order = byteOrder; }
+  typedef std::chrono::steady_clock Clock;
+  /// Monotonic capture time, taken when the frame is created unless the driver knows better
+  Clock::time_point captured() const { return _captured; }
+  void set_captured(const Clock::time_point &captured) { _captured = captured; }
+  typedef std::chrono::microseconds Timestamp;
+  /// Timestamp from the camera or its transport (sensor, USB, bus clock), when the driver reports one
+  bool has_device_timestamp() const { return _has_device_timestamp; }
+  Timestamp device_timestamp() const { return _device_timestamp; }
+  void set_device_timestamp(const Timestamp &timestamp);
+  /// Position of this frame in the imager output, starting from 1; gaps are frames dropped on the way. 0 if unknown
+  quint64 sequence() const { return _sequence; }
+  void set_sequence(quint64 sequence) { _sequence = sequence; }
+  /// Camera state when the frame was taken (see FrameMetadata)
+  typedef FrameMetadata Metadata;
+  const Metadata &metadata() const { return _metadata; }
+  Metadata &metadata() { return _metadata; }
+  void set_metadata(const Metadata &metadata) { _metadata = metadata; }
+  /// DMABUF file descriptor holding the pixels, when they are a driver buffer exported for zero copy GPU import (i.e. V4L2 VIDIOC_EXPBUF); -1 otherwise.
+  /// Not owned by the frame, and only valid while it lives. Never copied to derived frames.
+  int dmabuf() const { return _dmabuf; }
+  void set_dmabuf(int dmabuf) { _dmabuf = dmabuf; }
+  /// Products of the frame pixels computed once and shared by all the analysis stages (see FrameAnalysis)
+  FrameAnalysis &analysis() const;
+  /// Copies capture time, exposure, timestamps, sequence and metadata from the frame this one was derived from
+  void copy_metadata(const Frame &source);
+  /// Copy of a region of this frame, keeping capture metadata (with the ROI offset moved to the region) and byte order
+  FramePtr cropped(const cv::Rect &rect) const;
+
+  /// Gets the pixel buffer of a frame when it's destroyed
+  class Recycler {
+  public:
+    virtual ~Recycler() = default;
+    virtual void give_back(cv::Mat &&mat) = 0;
+  };
 private:
-  DPTR
+  friend class FramePool;
+  Frame(const Frame &other, const cv::Rect &rect);
+  cv::Mat _mat;
+  qint64 _created_utc;
+  Seconds _exposure = Seconds::zero();
+  Clock::time_point _captured = Clock::now();
+  Timestamp _device_timestamp = Timestamp::zero();
+  quint64 _sequence = 0;
+  Metadata _metadata;
+  std::weak_ptr<Recycler> _recycler;
+  ColorFormat _color_format;
+  ByteOrder _byte_order;
+  bool _has_device_timestamp = false;
+  int _dmabuf = -1;
+  // Created by the first analysis() call (in frameanalysis.cpp); copies start without one, as their pixels may change
+  struct AnalysisSlot {
+    std::shared_ptr<FrameAnalysis> analysis;
+    AnalysisSlot() = default;
+    AnalysisSlot(const AnalysisSlot &) {}
+    AnalysisSlot &operator=(const AnalysisSlot &) { analysis.reset(); return *this; }
+  };
+  mutable AnalysisSlot _analysis;
 };
 
 
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "frame_quality.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <boost/endian/conversion.hpp>
+#include <opencv2/opencv.hpp>
+#include "commons/frame.h"
+#include "commons/pixel_kernels.h"
+
+using namespace std;
+
+// Rows per parallel stripe
+#define FRAME_QUALITY_STRIPE_ROWS 64
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+}
+
+double FrameQuality::laplacianVariance(const cv::Mat &image) {
+  if(image.rows < 3 || image.cols < 3)
+    return 0;
+  // Each stripe filters its rows plus one above and below, and only sums the inner pixels, so that borders are never counted
+  const int inner_rows = image.rows - 2;
+  const int stripes = (inner_rows + FRAME_QUALITY_STRIPE_ROWS - 1) / FRAME_QUALITY_STRIPE_ROWS;
+  double sum = 0, squares_sum = 0, brightness = 0;
+  mutex sums_mutex;
+  cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+    const int first = 1 + stripe * FRAME_QUALITY_STRIPE_ROWS;
+    const int last = min(image.rows - 1, first + FRAME_QUALITY_STRIPE_ROWS);
+    cv::Mat laplacian;
+    cv::Laplacian(image.rowRange(first - 1, last + 1), laplacian, CV_32F, 1);
+    const cv::Mat inner = laplacian(cv::Range{1, laplacian.rows - 1}, cv::Range{1, laplacian.cols - 1});
+    const cv::Mat source = image(cv::Range{first, last}, cv::Range{1, image.cols - 1});
+    const double stripe_sum = cv::sum(inner)[0], stripe_squares = inner.dot(inner), stripe_brightness = cv::sum(source)[0];
+    lock_guard<mutex> lock(sums_mutex);
+    sum += stripe_sum;
+    squares_sum += stripe_squares;
+    brightness += stripe_brightness;
+  }});
+  const double pixels = static_cast<double>(inner_rows) * (image.cols - 2);
+  const double mean = sum / pixels, mean_brightness = brightness / pixels;
+  if(mean_brightness <= 0)
+    return 0;
+  return (squares_sum / pixels - mean * mean) / (mean_brightness * mean_brightness);
+}
+
+cv::Mat FrameQuality::gray(const Frame &frame, const cv::Rect &window) {
+  cv::Mat image = frame.mat();
+  const bool bayer = image.channels() == 1 && frame.colorFormat() != Frame::Mono;
+  if(window.area() > 0) {
+    cv::Rect crop = window;
+    if(bayer) {
+      crop.x &= ~1;
+      crop.y &= ~1;
+      crop.width = (window.x + window.width - crop.x + 1) & ~1;
+      crop.height = (window.y + window.height - crop.y + 1) & ~1;
+    }
+    crop &= cv::Rect{0, 0, image.cols, image.rows};
+    image = image(crop);
+  }
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  if(image.depth() == CV_16U && (native_little_endian ? frame.byteOrder() == Frame::BigEndian : frame.byteOrder() == Frame::LittleEndian))
+    image = PixelKernels::swap16(image);
+  cv::Mat gray;
+  image.convertTo(gray, CV_32F);
+  if(gray.channels() == 3)
+    cv::cvtColor(gray, gray, cv::COLOR_BGR2GRAY);
+  else if(bayer)
+    // Averaging each 2x2 Bayer cell removes the colour filter pattern, which would otherwise dominate the Laplacian
+    cv::resize(gray, gray, cv::Size{gray.cols / 2, gray.rows / 2}, 0, 0, cv::INTER_AREA);
+  return gray;
+}
+
+double FrameQuality::sharpness(const FrameConstPtr &frame) {
+  return laplacianVariance(gray(frame));
+}
+
+double FrameQuality::brenner(const cv::Mat &image) {
+  if(image.cols < 3 || image.rows < 1)
+    return 0;
+  const cv::Mat difference = image.colRange(2, image.cols) - image.colRange(0, image.cols - 2);
+  const double pixels = static_cast<double>(difference.rows) * difference.cols;
+  const double mean_brightness = cv::mean(image)[0];
+  if(mean_brightness <= 0)
+    return 0;
+  return difference.dot(difference) / pixels / (mean_brightness * mean_brightness);
+}
+
+FrameQuality::Star FrameQuality::star(const cv::Mat &image) {
+  Star result{0, 0, {}};
+  if(image.rows < 5 || image.cols < 5)
+    return result;
+  // Stars cover few pixels, so the median is the sky background even on a crowded window
+  vector<float> values(image.begin<float>(), image.end<float>());
+  auto median = values.begin() + values.size() / 2;
+  nth_element(values.begin(), median, values.end());
+  const double background = *median;
+
+  // The peak of a slightly smoothed image, so that a hot pixel doesn't pass for the star
+  cv::Mat smooth;
+  cv::GaussianBlur(image, smooth, cv::Size{3, 3}, 0);
+  double peak;
+  cv::Point peak_at;
+  cv::minMaxLoc(smooth, nullptr, &peak, nullptr, &peak_at);
+  const double amplitude = peak - background;
+  if(amplitude <= 0)
+    return result;
+
+  // Only pixels around the peak, so that other stars in the window count as little as possible
+  const int radius = min(image.rows, image.cols) / 2;
+  const cv::Rect area = cv::Rect{peak_at.x - radius, peak_at.y - radius, 2 * radius + 1, 2 * radius + 1} & cv::Rect{0, 0, image.cols, image.rows};
+  struct Sample { double distance, flux; };
+  vector<Sample> samples;
+  samples.reserve(area.area());
+  double flux = 0, flux_x = 0, flux_y = 0;
+  int above_half = 0;
+  for(int y = area.y; y < area.y + area.height; y++) {
+    const float *row = image.ptr<float>(y), *smooth_row = smooth.ptr<float>(y);
+    for(int x = area.x; x < area.x + area.width; x++) {
+      if((x - peak_at.x) * (x - peak_at.x) + (y - peak_at.y) * (y - peak_at.y) > radius * radius)
+        continue;
+      if(smooth_row[x] - background >= amplitude / 2)
+        above_half++;
+      const double pixel_flux = max(0., row[x] - background);
+      flux += pixel_flux;
+      flux_x += pixel_flux * x;
+      flux_y += pixel_flux * y;
+    }
+  }
+  if(flux <= 0)
+    return result;
+  result.fwhm = 2 * sqrt(above_half / M_PI);
+  result.centre = {flux_x / flux, flux_y / flux};
+
+  // Half flux diameter within an aperture a few FWHM wide around the centroid, interpolated between pixel distances
+  const double aperture = min<double>(radius, max(3., 3 * result.fwhm));
+  double aperture_flux = 0;
+  for(int y = area.y; y < area.y + area.height; y++) {
+    const float *row = image.ptr<float>(y);
+    for(int x = area.x; x < area.x + area.width; x++) {
+      const double distance = hypot(x - result.centre.x, y - result.centre.y);
+      const double pixel_flux = max(0., row[x] - background);
+      if(distance > aperture || pixel_flux <= 0)
+        continue;
+      samples.push_back({distance, pixel_flux});
+      aperture_flux += pixel_flux;
+    }
+  }
+  sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.distance < b.distance; });
+  double enclosed = 0, previous_distance = 0;
+  for(const auto &sample : samples) {
+    if(enclosed + sample.flux >= aperture_flux / 2) {
+      const double fraction = (aperture_flux / 2 - enclosed) / sample.flux;
+      result.hfd = 2 * (previous_distance + fraction * (sample.distance - previous_distance));
+      break;
+    }
+    enclosed += sample.flux;
+    previous_distance = sample.distance;
+  }
+  return result;
+}
+
+FrameQuality::Selector::Selector(int percent, size_t window) : percent{percent}, window{max<size_t>(1, window)} {
+}
+
+bool FrameQuality::Selector::keep(double score) {
+  scores.push_back(score);
+  if(scores.size() > window)
+    scores.pop_front();
+  const auto better = count_if(scores.begin(), scores.end(), [score](double other) { return other > score; });
+  // Always true for the best frame, so that at least one in each window is kept
+  return better * 100 < static_cast<long>(scores.size()) * percent;
+}
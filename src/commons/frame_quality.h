@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAME_QUALITY_H
+#define FRAME_QUALITY_H
+
+#include <deque>
+#include <opencv2/core/core.hpp>
+#include "commons/fwd.h"
+
+FWD_PTR(Frame)
+
+/**
+ * Lucky imaging: frame sharpness scores, and selection of the best frames while recording.
+ */
+namespace FrameQuality {
+  /// Variance of the Laplacian of the frame brightness, divided by the squared mean brightness: higher is sharper
+  /** Bayer frames are scored on 2x2 superpixels, colour frames on their gray level. Rows are processed in parallel. */
+  double sharpness(const FrameConstPtr &frame);
+  /// As sharpness(), on a single channel CV_32F image
+  double laplacianVariance(const cv::Mat &image);
+
+  /// The frame brightness as a single channel CV_32F image, as scored by sharpness(), optionally cropped to window first
+  /** window is in frame pixels (an empty one means the whole frame); Bayer windows are widened to whole 2x2 cells. */
+  cv::Mat gray(const Frame &frame, const cv::Rect &window = {});
+  inline cv::Mat gray(const FrameConstPtr &frame, const cv::Rect &window = {}) { return gray(*frame, window); }
+  /// Brenner gradient: mean squared difference between pixels two columns apart, divided by the squared mean brightness
+  /** Cheaper than the Laplacian variance, and less sensitive to noise on planetary and lunar detail. */
+  double brenner(const cv::Mat &image);
+
+  /// Size of the brightest star in a single channel CV_32F image, in pixels of that image
+  struct Star {
+    double hfd; ///< half flux diameter: the diameter of the circle holding half of the star flux above the background
+    double fwhm; ///< full width at half maximum, from the area brighter than half the peak
+    cv::Point2d centre; ///< flux weighted centroid
+  };
+  /// Both sizes are 0 when there is no star brighter than the (median) background
+  Star star(const cv::Mat &image);
+
+  /// Keeps a frame if its score ranks in the top 'percent' of the last 'window' scores, the frame itself included
+  /** Decides as soon as each score arrives, so frames never need to be held back. */
+  class Selector {
+  public:
+    Selector(int percent, std::size_t window);
+    bool keep(double score);
+  private:
+    const int percent;
+    const std::size_t window;
+    std::deque<double> scores;
+  };
+}
+
+#endif // FRAME_QUALITY_H
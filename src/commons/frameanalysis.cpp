@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "frameanalysis.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "commons/frame.h"
+#include "commons/debayer.h"
+#include "commons/frame_quality.h"
+#include "commons/metrics.h"
+#include "commons/pixel_kernels.h"
+#include "commons/tracking.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+namespace {
+  enum Product { ProductHistogram, ProductSuperpixelsHistogram, ProductStatistics, ProductCentroid, ProductGray, ProductSharpness, ProductBrenner, ProductNativeEndian, Product8bit, ProductDebayeredHalf, Products };
+  const char *product_names[Products] = {"histogram", "superpixels_histogram", "statistics", "centroid", "gray", "sharpness", "brenner", "native_endian", "8bit", "debayered_half"};
+
+  struct ProductMetrics {
+    Metrics::Counter *computed[Products];
+    Metrics::Counter *reused[Products];
+    ProductMetrics() {
+      for(int product = 0; product < Products; product++) {
+        const QString labels = "product=\"%1\""_q % product_names[product];
+        computed[product] = &Metrics::instance().counter("frame_analysis_computed_total", "Per frame analysis products computed", labels);
+        reused[product] = &Metrics::instance().counter("frame_analysis_reused_total", "Per frame analysis products served from the frame cache", labels);
+      }
+    }
+  };
+
+  const ProductMetrics &metrics() {
+    static const ProductMetrics product_metrics;
+    return product_metrics;
+  }
+
+  /// Product, area and one more parameter
+  typedef tuple<int, int, int, int, int, int> Key;
+
+  struct SlotBase {
+    virtual ~SlotBase() = default;
+    once_flag once;
+  };
+  template<typename T> struct Slot : SlotBase {
+    T value;
+  };
+}
+
+DPTR_IMPL(FrameAnalysis) {
+  const Frame &frame;
+  mutex slots_mutex;
+  map<Key, unique_ptr<SlotBase>> slots;
+  cv::Rect clipped(const cv::Rect &area) const;
+  template<typename T, typename Compute> const T &memoised(Product product, const cv::Rect &area, int parameter, Compute compute);
+};
+
+template<typename T, typename Compute> const T &FrameAnalysis::Private::memoised(Product product, const cv::Rect &area, int parameter, Compute compute)
+{
+  Slot<T> *slot;
+  {
+    lock_guard<mutex> lock{slots_mutex};
+    auto &stored = slots[Key{product, area.x, area.y, area.width, area.height, parameter}];
+    if(! stored)
+      stored.reset(new Slot<T>);
+    slot = static_cast<Slot<T>*>(stored.get());
+  }
+  // Outside the lock: only the stages waiting for this very product wait for it
+  bool computed = false;
+  call_once(slot->once, [&]{
+    slot->value = compute();
+    computed = true;
+  });
+  (computed ? metrics().computed : metrics().reused)[product]->add();
+  return slot->value;
+}
+
+cv::Rect FrameAnalysis::Private::clipped(const cv::Rect &area) const
+{
+  const cv::Rect whole{0, 0, frame.mat().cols, frame.mat().rows};
+  return area.area() > 0 ? area & whole : whole;
+}
+
+FrameAnalysis::FrameAnalysis(const Frame &frame) : dptr(frame)
+{
+}
+
+FrameAnalysis::~FrameAnalysis()
+{
+}
+
+FrameAnalysis &Frame::analysis() const
+{
+  auto analysis = atomic_load(&_analysis.analysis);
+  if(! analysis) {
+    auto created = make_shared<FrameAnalysis>(*this);
+    // Two stages asking at the same time: the one losing the race uses the other's
+    analysis = atomic_compare_exchange_strong(&_analysis.analysis, &analysis, created) ? created : analysis;
+  }
+  return *analysis;
+}
+
+const FrameAnalysis::Counts &FrameAnalysis::histogram(const cv::Rect &area, int step, bool superpixels)
+{
+  step = max(step, 1);
+  if(superpixels && Debayer::is_bayer(d->frame.colorFormat())) {
+    // Superpixels on an even origin, to keep the pattern: colours from the samples as they are, no interpolated values
+    const auto clipped = d->clipped(area);
+    const auto even = d->clipped({clipped.x & ~1, clipped.y & ~1, clipped.width + (clipped.x & 1), clipped.height + (clipped.y & 1)});
+    return d->memoised<Counts>(ProductSuperpixelsHistogram, even, step, [&]{
+      const auto rgb = Debayer::debayer(d->frame.mat()(even), d->frame.colorFormat(), {Debayer::Superpixel, Debayer::needs_swap(d->frame), false});
+      return rgb.empty() ? histogram(even, step) : PixelKernels::histogram(rgb, false, step);
+    });
+  }
+  const auto clipped = d->clipped(area);
+  return d->memoised<Counts>(ProductHistogram, clipped, step, [&]{
+    return PixelKernels::histogram(d->frame.mat()(clipped), Debayer::needs_swap(d->frame), step);
+  });
+}
+
+const vector<FrameAnalysis::Statistics> &FrameAnalysis::statistics(const cv::Rect &area, int step)
+{
+  step = max(step, 1);
+  const auto clipped = d->clipped(area);
+  return d->memoised<vector<Statistics>>(ProductStatistics, clipped, step, [&]{
+    vector<FrameAnalysis::Statistics> channels;
+    for(const auto &counts: histogram(clipped, step)) {
+      FrameAnalysis::Statistics channel;
+      double total = 0, sum = 0, squares = 0;
+      bool first = true;
+      for(size_t value = 0; value < counts.size(); value++) {
+        if(! counts[value])
+          continue;
+        if(first)
+          channel.minimum = value;
+        first = false;
+        channel.maximum = value;
+        total += counts[value];
+        sum += static_cast<double>(counts[value]) * value;
+        squares += static_cast<double>(counts[value]) * value * value;
+      }
+      if(total > 0) {
+        channel.mean = sum / total;
+        channel.stddev = sqrt(max(0., squares / total - channel.mean * channel.mean));
+      }
+      channels.push_back(channel);
+    }
+    return channels;
+  });
+}
+
+QPointF FrameAnalysis::centroid(int step)
+{
+  step = max(step, 1);
+  return d->memoised<QPointF>(ProductCentroid, {}, step, [&]{ return findCentroidSubpixel(d->frame.mat(), step); });
+}
+
+cv::Rect FrameAnalysis::centred_window(int size)
+{
+  const cv::Mat &image = d->frame.mat();
+  if(size <= 0 || (size >= image.cols && size >= image.rows))
+    return {0, 0, image.cols, image.rows};
+  const int width = min(size, image.cols), height = min(size, image.rows);
+  const QPointF centre = centroid();
+  int x = max(0, min(static_cast<int>(centre.x()) - width / 2, image.cols - width));
+  int y = max(0, min(static_cast<int>(centre.y()) - height / 2, image.rows - height));
+  if(Debayer::is_bayer(d->frame.colorFormat())) {
+    // Even offsets keep each pixel on the same colour filter as the window moves
+    x &= ~1;
+    y &= ~1;
+  }
+  return {x, y, width, height};
+}
+
+const cv::Mat &FrameAnalysis::gray(const cv::Rect &window)
+{
+  const auto clipped = d->clipped(window);
+  return d->memoised<cv::Mat>(ProductGray, clipped, 0, [&]{ return FrameQuality::gray(d->frame, clipped); });
+}
+
+double FrameAnalysis::sharpness(const cv::Rect &window)
+{
+  const auto clipped = d->clipped(window);
+  return d->memoised<double>(ProductSharpness, clipped, 0, [&]{ return FrameQuality::laplacianVariance(gray(clipped)); });
+}
+
+double FrameAnalysis::brenner(const cv::Rect &window)
+{
+  const auto clipped = d->clipped(window);
+  return d->memoised<double>(ProductBrenner, clipped, 0, [&]{ return FrameQuality::brenner(gray(clipped)); });
+}
+
+const cv::Mat &FrameAnalysis::native_endian()
+{
+  return d->memoised<cv::Mat>(ProductNativeEndian, {}, 0, [&]{
+    return Debayer::needs_swap(d->frame) ? PixelKernels::swap16(d->frame.mat()) : d->frame.mat();
+  });
+}
+
+const cv::Mat &FrameAnalysis::as_8bit()
+{
+  return d->memoised<cv::Mat>(Product8bit, {}, 0, [&]{
+    // Swapping while converting: one pass, whether or not native_endian() is around
+    return PixelKernels::to8bit(d->frame.mat(), Debayer::needs_swap(d->frame));
+  });
+}
+
+const cv::Mat &FrameAnalysis::debayered_half()
+{
+  return d->memoised<cv::Mat>(ProductDebayeredHalf, {}, 0, [&]{
+    if(! Debayer::is_bayer(d->frame.colorFormat()))
+      return cv::Mat{};
+    return Debayer::debayer(d->frame.mat(), d->frame.colorFormat(), {Debayer::Superpixel, Debayer::needs_swap(d->frame), true});
+  });
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FRAMEANALYSIS_H
+#define FRAMEANALYSIS_H
+
+#include <cstdint>
+#include <vector>
+#include <QPointF>
+#include <opencv2/core/core.hpp>
+#include "c++/dptr.h"
+
+class Frame;
+
+/**
+ * Per frame products shared by the analysis stages (histogram, auto exposure, focus assist, lucky imaging, flash detector),
+ * and format views shared by the consumers of the frame pixels (display, preview, network, writers):
+ * each one is computed at most once for each frame and set of parameters, by whichever stage asks first, and then served from memory.
+ * Thread safe: stages asking for a product still being computed wait for it, products with different parameters are computed in parallel.
+ * Reached through Frame::analysis(), and freed with the frame.
+ * Products describe the pixels as they were when first asked for: frames are modified in place (calibration) before anybody looks at them.
+ * Areas are in frame pixels, clipped to the frame; an empty one is the whole frame.
+ * Views are read only: they may be the frame pixels themselves, and other consumers are reading them too.
+ */
+class FrameAnalysis
+{
+public:
+  typedef std::vector<std::vector<uint32_t>> Counts;
+  struct Statistics {
+    double minimum = 0;
+    double maximum = 0;
+    double mean = 0;
+    double stddev = 0;
+  };
+  FrameAnalysis(const Frame &frame);
+  ~FrameAnalysis();
+  /// PixelKernels::histogram of area, in native byte order, counting a pixel every step. With superpixels, Bayer areas are counted as RGB 2x2 cells
+  const Counts &histogram(const cv::Rect &area = {}, int step = 1, bool superpixels = false);
+  /// Minimum, maximum, mean and standard deviation of each channel, from histogram(area, step)
+  const std::vector<Statistics> &statistics(const cv::Rect &area = {}, int step = 1);
+  /// findCentroidSubpixel of the frame, reading a pixel every step columns and rows
+  QPointF centroid(int step = 4);
+  /// Window of at most size x size pixels centred on centroid(), inside the frame, on an even origin for Bayer frames (size 0: the whole frame)
+  cv::Rect centred_window(int size);
+  /// FrameQuality::gray of window
+  const cv::Mat &gray(const cv::Rect &window = {});
+  /// FrameQuality::laplacianVariance of gray(window): FrameQuality::sharpness for the whole frame
+  double sharpness(const cv::Rect &window = {});
+  /// FrameQuality::brenner of gray(window)
+  double brenner(const cv::Rect &window = {});
+
+  /// The frame pixels in native byte order: the frame matrix itself, unless its 16 bit values need swapping
+  const cv::Mat &native_endian();
+  /// 8 bit copy of the frame pixels, as PixelKernels::to8bit of native_endian(); the frame matrix itself for 8 bit frames
+  const cv::Mat &as_8bit();
+  /// 8 bit RGB of Bayer frames, one pixel for each 2x2 cell (Debayer::Superpixel); empty for frames not in a Bayer format
+  const cv::Mat &debayered_half();
+private:
+  DPTR
+};
+
+#endif // FRAMEANALYSIS_H
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "commons/framearena.h"
+#include "commons/frame.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QDebug>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace {
+constexpr size_t ALIGNMENT = 64;
+}
+
+DPTR_IMPL(FrameArena) {
+  const size_t capacity;
+  bool huge_pages;
+  bool locked = false;
+  uint8_t *memory = nullptr;
+  struct Block {
+    size_t offset;
+    size_t size;
+    bool released;
+  };
+  mutable QMutex mutex;
+  QWaitCondition released;
+  deque<Block> blocks;
+  size_t used = 0;
+  bool allocate(size_t size, size_t &offset);
+  void release(size_t offset);
+};
+
+FrameArena::FrameArena(size_t capacity, bool huge_pages, bool lock_memory) : dptr(capacity, huge_pages)
+{
+#ifdef Q_OS_UNIX
+  void *memory = MAP_FAILED;
+#ifdef Q_OS_LINUX
+  if(huge_pages) {
+    // Explicit huge pages need a reserved pool (vm.nr_hugepages): otherwise, ask for transparent ones
+    memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(memory == MAP_FAILED) {
+      memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(memory != MAP_FAILED && madvise(memory, capacity, MADV_HUGEPAGE) != 0)
+        d->huge_pages = false;
+    }
+  }
+#else
+  d->huge_pages = false;
+#endif
+  if(memory == MAP_FAILED)
+    memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(memory == MAP_FAILED)
+    throw std::bad_alloc{};
+  d->memory = reinterpret_cast<uint8_t*>(memory);
+  if(lock_memory) {
+    // Needs CAP_IPC_LOCK, or a RLIMIT_MEMLOCK at least as large as the arena
+    d->locked = mlock(d->memory, capacity) == 0;
+    if(!d->locked)
+      qWarning() << "Unable to lock" << capacity << "bytes of frame buffers in RAM:" << strerror(errno);
+  }
+#else
+  d->huge_pages = false;
+  d->memory = new uint8_t[capacity];
+  if(lock_memory)
+    qWarning() << "Locking frame buffers in RAM is not supported on this platform";
+#endif
+}
+
+FrameArena::~FrameArena()
+{
+#ifdef Q_OS_UNIX
+  if(d->locked)
+    munlock(d->memory, d->capacity);
+  munmap(d->memory, d->capacity);
+#else
+  delete [] d->memory;
+#endif
+}
+
+bool FrameArena::Private::allocate(size_t size, size_t &offset)
+{
+  size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  if(blocks.empty()) {
+    if(size > capacity)
+      return false;
+    offset = 0;
+  } else {
+    const size_t tail = blocks.front().offset;
+    const size_t head = blocks.back().offset + blocks.back().size;
+    if(blocks.back().offset >= tail) {
+      // Free room at the end, then at the beginning: a frame never straddles the end of the region
+      if(capacity - head >= size)
+        offset = head;
+      else if(tail >= size)
+        offset = 0;
+      else
+        return false;
+    } else if(tail - head >= size) {
+      offset = head;
+    } else {
+      return false;
+    }
+  }
+  blocks.push_back({offset, size, false});
+  used += size;
+  return true;
+}
+
+void FrameArena::Private::release(size_t offset)
+{
+  QMutexLocker lock(&mutex);
+  // Usually the oldest block: writers may still finish frames out of order
+  auto block = find_if(blocks.begin(), blocks.end(), [offset](const Block &block) { return block.offset == offset && !block.released; });
+  if(block == blocks.end())
+    return;
+  block->released = true;
+  used -= block->size;
+  while(!blocks.empty() && blocks.front().released)
+    blocks.pop_front();
+  released.wakeAll();
+}
+
+FramePtr FrameArena::store(const FrameConstPtr &frame)
+{
+  size_t offset;
+  {
+    QMutexLocker lock(&d->mutex);
+    if(!d->allocate(frame->size(), offset))
+      return {};
+  }
+  const cv::Mat &source = frame->mat();
+  cv::Mat mat{source.rows, source.cols, source.type(), d->memory + offset};
+  source.copyTo(mat);
+  Private *arena = d.get();
+  FramePtr copy{new Frame{frame->colorFormat(), mat, frame->byteOrder(), Frame::ShareBuffer}, [arena, offset](Frame *frame) {
+    delete frame;
+    arena->release(offset);
+  }};
+  copy->copy_metadata(*frame);
+  return copy;
+}
+
+void FrameArena::wait_for_release(const chrono::milliseconds &timeout)
+{
+  QMutexLocker lock(&d->mutex);
+  d->released.wait(&d->mutex, timeout.count());
+}
+
+size_t FrameArena::capacity() const
+{
+  return d->capacity;
+}
+
+size_t FrameArena::used() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->used;
+}
+
+bool FrameArena::huge_pages() const
+{
+  return d->huge_pages;
+}
+
+bool FrameArena::locked() const
+{
+  return d->locked;
+}
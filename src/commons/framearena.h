@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <chrono>
+
+FWD_PTR(Frame)
+
+/**
+ * One large memory region holding copies of frames, allocated as a ring: frames are copied in at the head,
+ * and their room is given back when the copies are destroyed, usually oldest first.
+ * The region can be backed by huge pages, and locked in RAM so that buffered frames are never swapped out.
+ * store() and the release of stored frames can happen on different threads.
+ * The arena must outlive the frames it stores.
+ */
+class FrameArena
+{
+public:
+  FrameArena(std::size_t capacity, bool huge_pages = false, bool lock_memory = false);
+  ~FrameArena();
+  /// Copy of the frame, pixels and metadata, in arena memory; an empty pointer if there's no room for it now
+  FramePtr store(const FrameConstPtr &frame);
+  /// Waits up to timeout for stored frames to give their room back
+  void wait_for_release(const std::chrono::milliseconds &timeout);
+  std::size_t capacity() const;
+  /// Bytes taken by the stored frames
+  std::size_t used() const;
+  bool huge_pages() const;
+  bool locked() const;
+private:
+  DPTR
+};
+
+#endif // FRAMEARENA_H
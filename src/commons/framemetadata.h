@@ -0,0 +1,49 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMEMETADATA_H
+#define FRAMEMETADATA_H
+
+#include <QtGlobal>
+#include <cmath>
+#include <limits>
+
+/**
+ * Camera state when a frame was taken, from what the imager already knows: filling it costs no camera query.
+ * Fixed layout with no pointers, so that writers can dump it as it is (see SERWriter's metadata side-car): NaN, 0 and -1 mean unknown.
+ */
+struct FrameMetadata {
+  double gain = std::numeric_limits<double>::quiet_NaN();
+  /// Sensor temperature, in Celsius
+  double temperature = std::numeric_limits<double>::quiet_NaN();
+  /// Frame counter as reported by the camera or its SDK
+  quint64 driver_sequence = 0;
+  /// Top left corner of the frame on the sensor, in the frame own (binned) pixels, as ROIs are given to the camera
+  qint32 roi_x = -1;
+  qint32 roi_y = -1;
+  quint16 bin = 0;
+  quint16 reserved[3] = {};
+  bool has_gain() const { return ! std::isnan(gain); }
+  bool has_temperature() const { return ! std::isnan(temperature); }
+  bool has_roi_offset() const { return roi_x >= 0 && roi_y >= 0; }
+};
+
+static_assert(sizeof(FrameMetadata) == 40, "FrameMetadata layout changed: bump the SER metadata side-car version");
+
+#endif // FRAMEMETADATA_H
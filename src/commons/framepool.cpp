@@ -0,0 +1,571 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "commons/framepool.h"
+#include "commons/metrics.h"
+#include "commons/memorygovernor.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QFile>
+#include <QCoreApplication>
+#include <QDebug>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <new>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+// OpenCV 2.4 has no UMatData: there, buffers always come from the heap
+#ifndef CV_VERSION_EPOCH
+#define HAVE_PAGED_FRAME_BUFFERS
+#endif
+
+using namespace std;
+
+namespace {
+struct Buffers : public Frame::Recycler {
+  Buffers(size_t max_free);
+  ~Buffers();
+  const size_t max_free;
+  QMutex mutex;
+  list<cv::Mat> free;
+  int type = -1;
+  cv::Size size;
+  atomic_size_t allocations{0};
+  atomic_size_t recycled{0};
+  // Free buffers are only worth keeping within the process budget, and are the first memory given back
+  MemoryGovernor::Account &memory;
+  unique_ptr<MemoryGovernor::Reclaimer> reclaimer;
+
+  static size_t bytes(const cv::Mat &mat) { return mat.total() * mat.elemSize(); }
+  cv::Mat take_free();
+  void clear_free();
+  void reshape(int type, const cv::Size &size);
+  void give_back(cv::Mat &&mat) override;
+};
+
+// Frame objects (with the shared_ptr control block) all have the same size: freed blocks are kept for the next frames
+struct Arena {
+  static constexpr size_t max_free = 64;
+  QMutex mutex;
+  size_t block_size = 0;
+  vector<void*> free;
+  ~Arena();
+  void *allocate(size_t bytes);
+  void deallocate(void *block, size_t bytes);
+};
+constexpr size_t Arena::max_free;
+
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag MatAccessFlags;
+#else
+typedef int MatAccessFlags;
+#endif
+
+enum PageKind { HugePages = 0, TransparentHugePages = 1, RegularPages = 2, HostBuffers = 3 };
+struct Mapping {
+  size_t length;
+  PageKind kind;
+  bool locked;
+  FramePool::BufferAllocatorPtr host;
+};
+// Page aligned, as DMA registration usually wants
+const size_t HOST_BUFFER_ALIGNMENT = 4096;
+
+// Buffers mapped straight from the system, so that they can get huge pages and be locked, still reference counted by cv::Mat
+class PagesAllocator : public cv::MatAllocator {
+public:
+  static PagesAllocator &instance();
+  bool enabled() const { return huge_pages || lock_bytes > 0 || has_host; }
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, MatAccessFlags, cv::UMatUsageFlags) const override;
+  bool allocate(cv::UMatData *data, MatAccessFlags, cv::UMatUsageFlags) const override;
+  void deallocate(cv::UMatData *data) const override;
+  atomic_bool huge_pages{false};
+  atomic<size_t> lock_bytes{0};
+  void set_host(const FramePool::BufferAllocatorPtr &host);
+  Metrics::Gauge *bytes[4];
+  Metrics::Gauge &locked;
+private:
+  PagesAllocator();
+  void *map(size_t size, Mapping &mapping) const;
+  void lock(void *memory, Mapping &mapping) const;
+  void unmap(void *memory, const Mapping &mapping) const;
+  mutable atomic<size_t> locked_bytes{0};
+  mutable atomic_bool huge_pages_warned{false};
+  mutable atomic_bool lock_warned{false};
+  mutable QMutex host_mutex;
+  FramePool::BufferAllocatorPtr host;
+  atomic_bool has_host{false};
+  void *acquire_host(size_t size, Mapping &mapping) const;
+};
+#endif
+
+template<typename T> struct ArenaAllocator {
+  typedef T value_type;
+  shared_ptr<Arena> arena;
+  ArenaAllocator(const shared_ptr<Arena> &arena) : arena{arena} {}
+  template<typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena{other.arena} {}
+  T *allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T))); }
+  void deallocate(T *p, size_t n) { arena->deallocate(p, n * sizeof(T)); }
+  template<typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+  template<typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+}
+
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+namespace {
+size_t round_up(size_t size, size_t page) {
+  return (size + page - 1) / page * page;
+}
+
+#ifdef Q_OS_LINUX
+// MAP_HUGETLB mappings get the default huge page size (2MB, or 1GB with default_hugepagesz=1G), and must be a multiple of it
+size_t system_huge_page_size() {
+  QFile meminfo{"/proc/meminfo"};
+  if(meminfo.open(QIODevice::ReadOnly)) {
+    for(auto line: meminfo.readAll().split('\n'))
+      if(line.startsWith("Hugepagesize:"))
+        return line.mid(13).trimmed().split(' ').first().toULongLong() * 1024;
+  }
+  return 2 * 1024 * 1024;
+}
+#endif
+}
+
+PagesAllocator &PagesAllocator::instance()
+{
+  // Never destroyed: frames can be released after the static objects are gone.
+  // Drivers are plugins with their own copy of this library, and allocate the captured frames: they share the application allocator
+  static PagesAllocator *allocator = []{
+    auto app = QCoreApplication::instance();
+    if(! app)
+      return new PagesAllocator;
+    auto shared = app->property("planetaryimager_frame_buffers_allocator");
+    if(shared.isValid())
+      return reinterpret_cast<PagesAllocator *>(shared.value<quintptr>());
+    auto created = new PagesAllocator;
+    app->setProperty("planetaryimager_frame_buffers_allocator", QVariant::fromValue<quintptr>(reinterpret_cast<quintptr>(created)));
+    return created;
+  }();
+  return *allocator;
+}
+
+PagesAllocator::PagesAllocator()
+  : bytes{
+      &Metrics::instance().gauge("frame_buffers_bytes", "Frame pool buffers allocated with huge pages or locking enabled, by the pages backing them", "backing=\"huge_pages\""),
+      &Metrics::instance().gauge("frame_buffers_bytes", "Frame pool buffers allocated with huge pages or locking enabled, by the pages backing them", "backing=\"transparent_huge_pages\""),
+      &Metrics::instance().gauge("frame_buffers_bytes", "Frame pool buffers allocated with huge pages or locking enabled, by the pages backing them", "backing=\"regular\""),
+      &Metrics::instance().gauge("frame_buffers_bytes", "Frame pool buffers allocated with huge pages or locking enabled, by the pages backing them", "backing=\"host\""),
+    },
+    locked(Metrics::instance().gauge("frame_buffers_locked_bytes", "Frame pool buffers locked in RAM"))
+{
+}
+
+cv::UMatData *PagesAllocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step, MatAccessFlags, cv::UMatUsageFlags) const
+{
+  // Same layout as the OpenCV default allocator: continuous rows
+  size_t total = CV_ELEM_SIZE(type);
+  for(int i = dims - 1; i >= 0; i--) {
+    if(step) {
+      if(data && step[i] != cv::Mat::AUTO_STEP)
+        total = step[i];
+      else
+        step[i] = total;
+    }
+    total *= sizes[i];
+  }
+  auto u = new cv::UMatData(this);
+  u->size = total;
+  if(data) {
+    u->data = u->origdata = static_cast<uchar*>(data);
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+    return u;
+  }
+  auto mapping = new Mapping{};
+  try {
+    u->data = u->origdata = static_cast<uchar*>(map(total, *mapping));
+  } catch(const std::bad_alloc &) {
+    delete mapping;
+    delete u;
+    throw;
+  }
+  u->userdata = mapping;
+  return u;
+}
+
+bool PagesAllocator::allocate(cv::UMatData *data, MatAccessFlags, cv::UMatUsageFlags) const
+{
+  return data != nullptr;
+}
+
+void PagesAllocator::deallocate(cv::UMatData *u) const
+{
+  if(! u)
+    return;
+  if(! (u->flags & cv::UMatData::USER_ALLOCATED)) {
+    auto mapping = static_cast<Mapping*>(u->userdata);
+    unmap(u->origdata, *mapping);
+    delete mapping;
+  }
+  delete u;
+}
+
+void PagesAllocator::set_host(const FramePool::BufferAllocatorPtr &host)
+{
+  QMutexLocker lock(&host_mutex);
+  this->host = host;
+  has_host = static_cast<bool>(host);
+}
+
+void *PagesAllocator::acquire_host(size_t size, Mapping &mapping) const
+{
+  FramePool::BufferAllocatorPtr host;
+  {
+    QMutexLocker lock(&host_mutex);
+    host = this->host;
+  }
+  void *memory = host ? host->acquire(size, HOST_BUFFER_ALIGNMENT) : nullptr;
+  if(memory) {
+    // Locking and page sizes are up to the host
+    mapping = {size, HostBuffers, false, host};
+    bytes[HostBuffers]->add(size);
+  }
+  return memory;
+}
+
+void *PagesAllocator::map(size_t size, Mapping &mapping) const
+{
+  void *memory = has_host ? acquire_host(size, mapping) : nullptr;
+  if(memory)
+    return memory;
+  mapping = {size, RegularPages, false, {}};
+#ifdef Q_OS_UNIX
+  void *pages = MAP_FAILED;
+#ifdef Q_OS_LINUX
+  if(huge_pages) {
+    // Explicit huge pages need a reserved pool (vm.nr_hugepages): otherwise, ask for transparent ones
+    static const size_t huge_page_size = system_huge_page_size();
+    const size_t length = round_up(size, huge_page_size);
+    pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(pages != MAP_FAILED)
+      mapping = {length, HugePages, false};
+    else if(! huge_pages_warned.exchange(true))
+      qWarning() << "No huge pages reserved for" << size << "bytes frame buffers (vm.nr_hugepages): using transparent huge pages";
+  }
+#endif
+  if(pages == MAP_FAILED)
+    pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(pages == MAP_FAILED)
+    throw std::bad_alloc{};
+#ifdef Q_OS_LINUX
+  if(huge_pages && mapping.kind == RegularPages && madvise(pages, size, MADV_HUGEPAGE) == 0)
+    mapping.kind = TransparentHugePages;
+#endif
+  memory = pages;
+#elif defined(Q_OS_WIN)
+  const size_t large_page_size = GetLargePageMinimum();
+  if(huge_pages && large_page_size) {
+    const size_t length = round_up(size, large_page_size);
+    memory = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if(memory)
+      mapping = {length, HugePages, false};
+    else if(! huge_pages_warned.exchange(true))
+      qWarning() << "Large pages for frame buffers need the \"Lock pages in memory\" privilege: using regular pages";
+  }
+  if(! memory)
+    memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if(! memory)
+    throw std::bad_alloc{};
+#else
+  memory = ::operator new(size);
+#endif
+  lock(memory, mapping);
+  bytes[mapping.kind]->add(mapping.length);
+  return memory;
+}
+
+void PagesAllocator::lock(void *memory, Mapping &mapping) const
+{
+  // Within the budget only, so that a resolution change or a few extra pools can't lock the whole RAM
+  if(locked_bytes.fetch_add(mapping.length) + mapping.length > lock_bytes) {
+    locked_bytes -= mapping.length;
+    return;
+  }
+#ifdef Q_OS_UNIX
+  // Needs CAP_IPC_LOCK, or a large enough RLIMIT_MEMLOCK
+  mapping.locked = mlock(memory, mapping.length) == 0;
+  if(! mapping.locked && ! lock_warned.exchange(true))
+    qWarning() << "Unable to lock frame buffers in RAM (memlock limit too low?):" << strerror(errno);
+#elif defined(Q_OS_WIN)
+  mapping.locked = VirtualLock(memory, mapping.length);
+  if(! mapping.locked && ! lock_warned.exchange(true))
+    qWarning() << "Unable to lock frame buffers in RAM: error" << GetLastError();
+#else
+  Q_UNUSED(memory)
+  if(! lock_warned.exchange(true))
+    qWarning() << "Locking frame buffers in RAM is not supported on this platform";
+#endif
+  if(mapping.locked)
+    locked.add(mapping.length);
+  else
+    locked_bytes -= mapping.length;
+}
+
+void PagesAllocator::unmap(void *memory, const Mapping &mapping) const
+{
+  bytes[mapping.kind]->add(-static_cast<qint64>(mapping.length));
+  if(mapping.host) {
+    mapping.host->release(memory, mapping.length);
+    return;
+  }
+  if(mapping.locked) {
+    locked_bytes -= mapping.length;
+    locked.add(-static_cast<qint64>(mapping.length));
+  }
+#ifdef Q_OS_UNIX
+  if(mapping.locked)
+    munlock(memory, mapping.length);
+  munmap(memory, mapping.length);
+#elif defined(Q_OS_WIN)
+  if(mapping.locked)
+    VirtualUnlock(memory, mapping.length);
+  VirtualFree(memory, 0, MEM_RELEASE);
+#else
+  ::operator delete(memory);
+#endif
+}
+#endif
+
+namespace {
+// Empty unless a backing is set: the frame then allocates its buffer from the heap, as cv::Mat does
+cv::Mat paged_buffer(int type, const QSize &resolution)
+{
+  cv::Mat buffer;
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+  auto &pages = PagesAllocator::instance();
+  if(pages.enabled()) {
+    buffer.allocator = &pages;
+    buffer.create(resolution.height(), resolution.width(), type);
+  }
+#else
+  Q_UNUSED(type)
+  Q_UNUSED(resolution)
+#endif
+  return buffer;
+}
+}
+
+DPTR_IMPL(FramePool) {
+  shared_ptr<Buffers> buffers;
+  // Shared with the frames, which give their block back when they go, even after the pool
+  shared_ptr<Arena> arena;
+};
+
+FramePool::FramePool(size_t max_free_buffers) : dptr(make_shared<Buffers>(max_free_buffers), make_shared<Arena>())
+{
+}
+
+FramePool::~FramePool()
+{
+}
+
+Arena::~Arena()
+{
+  for(auto block: free)
+    ::operator delete(block);
+}
+
+void *Arena::allocate(size_t bytes)
+{
+  {
+    QMutexLocker lock(&mutex);
+    if(block_size == 0)
+      block_size = bytes;
+    if(bytes == block_size && ! free.empty()) {
+      auto block = free.back();
+      free.pop_back();
+      return block;
+    }
+  }
+  return ::operator new(bytes);
+}
+
+void Arena::deallocate(void *block, size_t bytes)
+{
+  {
+    QMutexLocker lock(&mutex);
+    if(bytes == block_size && free.size() < max_free) {
+      free.push_back(block);
+      return;
+    }
+  }
+  ::operator delete(block);
+}
+
+Buffers::Buffers(size_t max_free) : max_free{max_free}, memory(MemoryGovernor::instance().account("frame pool", MemoryGovernor::Cache))
+{
+  reclaimer = make_unique<MemoryGovernor::Reclaimer>(memory, [this](size_t wanted) {
+    QMutexLocker lock(&mutex);
+    size_t reclaimed = 0;
+    while(! free.empty() && reclaimed < wanted) {
+      reclaimed += bytes(free.front());
+      take_free();
+    }
+  });
+}
+
+Buffers::~Buffers()
+{
+  reclaimer.reset();
+  clear_free();
+}
+
+cv::Mat Buffers::take_free()
+{
+  auto buffer = std::move(free.front());
+  free.pop_front();
+  memory.release(bytes(buffer));
+  return buffer;
+}
+
+void Buffers::clear_free()
+{
+  while(! free.empty())
+    take_free();
+}
+
+void Buffers::reshape(int type, const cv::Size& size)
+{
+  if(type == this->type && size == this->size)
+    return;
+  clear_free();
+  this->type = type;
+  this->size = size;
+}
+
+void Buffers::give_back(cv::Mat &&mat)
+{
+  // Only recycle buffers nobody else is still referencing (for instance a cv::Mat header copied out of the frame)
+  if(! mat.u || mat.u->refcount > 1)
+    return;
+  QMutexLocker lock(&mutex);
+  if(mat.type() != type || mat.size() != size || free.size() >= max_free || ! memory.reserve(bytes(mat)))
+    return;
+  free.push_back(std::move(mat));
+}
+
+FramePtr FramePool::acquire(uint8_t bpp, Frame::ColorFormat colorFormat, const QSize& resolution, Frame::ByteOrder byteOrder)
+{
+  auto buffers = d->buffers;
+  int type = CV_MAKETYPE( bpp == 8 ? CV_8U : CV_16U, colorFormat == Frame::RGB || colorFormat == Frame::BGR ? 3 : 1);
+  cv::Mat buffer;
+  {
+    QMutexLocker lock(&buffers->mutex);
+    buffers->reshape(type, {resolution.width(), resolution.height()});
+    if(! buffers->free.empty())
+      buffer = buffers->take_free();
+  }
+  FramePtr frame;
+  ArenaAllocator<Frame> allocator{d->arena};
+  if(buffer.empty()) {
+    ++buffers->allocations;
+    buffer = paged_buffer(type, resolution);
+  } else {
+    ++buffers->recycled;
+  }
+  if(buffer.empty()) {
+    frame = allocate_shared<Frame>(allocator, bpp, colorFormat, resolution, byteOrder);
+  } else {
+    frame = allocate_shared<Frame>(allocator, colorFormat, buffer, byteOrder, Frame::ShareBuffer);
+    buffer.release();
+  }
+  frame->_recycler = buffers;
+  return frame;
+}
+
+void FramePool::clear()
+{
+  QMutexLocker lock(&d->buffers->mutex);
+  d->buffers->clear_free();
+}
+
+size_t FramePool::free_buffers() const
+{
+  QMutexLocker lock(&d->buffers->mutex);
+  return d->buffers->free.size();
+}
+
+size_t FramePool::allocations() const
+{
+  return d->buffers->allocations;
+}
+
+size_t FramePool::recycled() const
+{
+  return d->buffers->recycled;
+}
+
+void FramePool::set_backing(const Backing &backing)
+{
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+  auto &pages = PagesAllocator::instance();
+  pages.huge_pages = backing.huge_pages;
+#ifdef Q_OS_WIN
+  // VirtualLock can't go beyond the minimum working set: make room for the locked buffers
+  const size_t added = backing.lock_bytes > pages.lock_bytes ? backing.lock_bytes - pages.lock_bytes : 0;
+  SIZE_T minimum, maximum;
+  if(added && GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum))
+    SetProcessWorkingSetSize(GetCurrentProcess(), minimum + added, maximum + added);
+#endif
+  pages.lock_bytes = backing.lock_bytes;
+#else
+  if(backing.huge_pages || backing.lock_bytes)
+    qWarning() << "Huge pages and locked frame buffers need OpenCV 3 or later";
+#endif
+}
+
+FramePool::BackingStats FramePool::backing_stats()
+{
+  BackingStats stats;
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+  auto &pages = PagesAllocator::instance();
+  stats.huge_pages = static_cast<size_t>(pages.bytes[HugePages]->value());
+  stats.transparent_huge_pages = static_cast<size_t>(pages.bytes[TransparentHugePages]->value());
+  stats.regular = static_cast<size_t>(pages.bytes[RegularPages]->value());
+  stats.locked = static_cast<size_t>(pages.locked.value());
+  stats.host = static_cast<size_t>(pages.bytes[HostBuffers]->value());
+#endif
+  return stats;
+}
+
+void FramePool::set_buffer_allocator(const BufferAllocatorPtr &allocator)
+{
+#ifdef HAVE_PAGED_FRAME_BUFFERS
+  PagesAllocator::instance().set_host(allocator);
+#else
+  if(allocator)
+    qWarning() << "Host allocated frame buffers need OpenCV 3 or later";
+#endif
+}
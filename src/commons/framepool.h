@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "commons/frame.h"
+
+FWD_PTR(FramePool)
+
+/**
+ * Recycles frame buffers between captures.
+ * Frames handed out by acquire() give their pixel buffer back to the pool when the last holder releases them,
+ * so that, in steady state, capturing doesn't allocate (and page fault) a whole new image for every frame.
+ * The Frame objects themselves come from a small arena of recycled blocks, so they don't hit the heap either.
+ * Buffers are kept only while resolution and pixel type don't change; any change drops the recycled buffers.
+ * acquire() and frame releases can happen on different threads.
+ *
+ * Buffers can be backed by huge pages and locked in RAM (see set_backing): fewer page faults and TLB misses on the first
+ * touch of each frame, and queued frames that can't be swapped out. What was actually obtained is exported as the
+ * frame_buffers_bytes and frame_buffers_locked_bytes metrics.
+ * The host application can also provide the memory itself (see set_buffer_allocator).
+ *
+ * Drivers capture into the pool their worker gets from the capture thread (ImagerThread::Worker::frames_pool): backing and
+ * allocator are shared with the drivers plugins, so the host decides where every captured frame lives.
+ */
+class FramePool
+{
+public:
+  FramePool(std::size_t max_free_buffers = 10);
+  ~FramePool();
+  FramePtr acquire(uint8_t bpp, Frame::ColorFormat colorFormat, const QSize &resolution, Frame::ByteOrder byteOrder = Frame::BigEndian);
+  void clear();
+  std::size_t free_buffers() const;
+  std::size_t allocations() const;
+  std::size_t recycled() const;
+
+  struct Backing {
+    /// Explicit huge pages of the system default size (vm.nr_hugepages), then transparent ones, then regular pages
+    bool huge_pages = false;
+    /// Bytes of buffers to lock in RAM, all pools together; beyond them buffers stay pageable
+    std::size_t lock_bytes = 0;
+  };
+  /// Backing of the buffers allocated from now on, by every pool: missing privileges only give a warning, and pageable memory
+  static void set_backing(const Backing &backing);
+  /**
+   * Memory for frame buffers chosen by the host (i.e. pinned, or registered with a GPU for DMA), instead of the set_backing one.
+   * Called from the capture threads for new buffers, and from any thread when a buffer goes away.
+   */
+  class BufferAllocator {
+  public:
+    virtual ~BufferAllocator() = default;
+    /// nullptr when out of memory: the buffer then gets the set_backing pages
+    virtual void *acquire(std::size_t size, std::size_t alignment) = 0;
+    virtual void release(void *buffer, std::size_t size) = 0;
+  };
+  typedef std::shared_ptr<BufferAllocator> BufferAllocatorPtr;
+  /// Allocator of the buffers allocated from now on, by every pool (nullptr: back to set_backing). Buffers go back to the allocator they came from.
+  static void set_buffer_allocator(const BufferAllocatorPtr &allocator);
+  struct BackingStats {
+    std::size_t huge_pages = 0;
+    std::size_t transparent_huge_pages = 0;
+    std::size_t regular = 0;
+    std::size_t locked = 0;
+    /// From the set_buffer_allocator one
+    std::size_t host = 0;
+  };
+  /// Bytes of the buffers allocated with a backing set, as they are now
+  static BackingStats backing_stats();
+private:
+  DPTR
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016 Marco Gulino (marco AT gulinux.net)
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+#ifndef FRAMESEQUENCE_H
+#define FRAMESEQUENCE_H
+
+#include <QtGlobal>
+
+/// Counts the frames missing from a stream, using the gaps between sequence numbers (Frame::sequence, or a driver counter)
+class FrameSequence
+{
+public:
+  /// Frames missing between the previous sequence number and this one. A sequence starting over (i.e. a new imager thread) is not a gap.
+  quint64 next(quint64 sequence) {
+    quint64 missing = 0;
+    if(sequence == 0)
+      return missing;
+    if(last > 0 && sequence > last)
+      missing = sequence - last - 1;
+    last = sequence;
+    ++_received;
+    _missing += missing;
+    return missing;
+  }
+  quint64 received() const { return _received; }
+  quint64 missing() const { return _missing; }
+private:
+  quint64 last = 0;
+  quint64 _received = 0;
+  quint64 _missing = 0;
+};
+
+#endif // FRAMESEQUENCE_H
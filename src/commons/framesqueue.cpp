@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "commons/framesqueue.h"
+#include "commons/frame.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <deque>
+
+using namespace std;
+
+DPTR_IMPL(FramesQueue) {
+  const size_t max_frames;
+  OverflowPolicy policy;
+  chrono::milliseconds block_timeout;
+  size_t max_bytes = 0;
+  size_t bytes = 0;
+  size_t peak_bytes = 0;
+  mutable QMutex mutex;
+  QWaitCondition not_empty;
+  QWaitCondition not_full;
+  deque<FrameConstPtr> frames;
+  MemoryGovernor::Account *account = nullptr;
+  bool full_for(const FrameConstPtr &frame) const;
+  bool admit(const FrameConstPtr &frame);
+  void pop_front();
+};
+
+bool FramesQueue::Private::full_for(const FrameConstPtr& frame) const
+{
+  if(max_frames > 0 && frames.size() >= max_frames)
+    return true;
+  return max_bytes > 0 && ! frames.empty() && bytes + frame->size() > max_bytes;
+}
+
+bool FramesQueue::Private::admit(const FrameConstPtr& frame)
+{
+  if(full_for(frame))
+    return false;
+  if(! account)
+    return true;
+  // Always room for one frame, as with max_bytes: the budget decides how many more
+  if(frames.empty()) {
+    account->charge(frame->size());
+    return true;
+  }
+  return account->reserve(frame->size());
+}
+
+void FramesQueue::Private::pop_front()
+{
+  if(account)
+    account->release(frames.front()->size());
+  bytes -= frames.front()->size();
+  frames.pop_front();
+  not_full.wakeAll();
+}
+
+FramesQueue::FramesQueue(size_t max_frames, OverflowPolicy policy, const chrono::milliseconds &block_timeout)
+  : dptr(max_frames, policy, block_timeout)
+{
+}
+
+FramesQueue::~FramesQueue()
+{
+  clear();
+}
+
+bool FramesQueue::push(const FrameConstPtr& frame)
+{
+  QMutexLocker lock(&d->mutex);
+  bool dropped = false;
+  if(! d->admit(frame)) {
+    switch(d->policy) {
+      case DropNewest:
+        return false;
+      case DropOldest:
+        do
+          d->pop_front();
+        while(! d->admit(frame));
+        dropped = true;
+        break;
+      case BlockProducer: {
+        QElapsedTimer elapsed;
+        elapsed.start();
+        bool admitted = false;
+        while(! admitted && elapsed.elapsed() < d->block_timeout.count()) {
+          d->not_full.wait(&d->mutex, d->block_timeout.count() - elapsed.elapsed());
+          admitted = d->admit(frame);
+        }
+        if(! admitted)
+          return false;
+        break;
+      }
+    }
+  }
+  d->frames.push_back(frame);
+  d->bytes += frame->size();
+  d->peak_bytes = max(d->peak_bytes, d->bytes);
+  d->not_empty.wakeOne();
+  return !dropped;
+}
+
+FrameConstPtr FramesQueue::pop(const chrono::milliseconds& timeout)
+{
+  QMutexLocker lock(&d->mutex);
+  if(d->frames.empty())
+    d->not_empty.wait(&d->mutex, timeout.count());
+  if(d->frames.empty())
+    return {};
+  auto frame = d->frames.front();
+  d->pop_front();
+  return frame;
+}
+
+void FramesQueue::clear()
+{
+  QMutexLocker lock(&d->mutex);
+  if(d->account)
+    d->account->release(d->bytes);
+  d->frames.clear();
+  d->bytes = 0;
+  d->not_full.wakeAll();
+}
+
+void FramesQueue::set_max_bytes(size_t max_bytes)
+{
+  QMutexLocker lock(&d->mutex);
+  d->max_bytes = max_bytes;
+  d->not_full.wakeAll();
+}
+
+void FramesQueue::set_memory_account(MemoryGovernor::Account &account)
+{
+  QMutexLocker lock(&d->mutex);
+  if(d->account)
+    d->account->release(d->bytes);
+  d->account = &account;
+  d->account->charge(d->bytes);
+}
+
+void FramesQueue::set_overflow_policy(OverflowPolicy policy, const chrono::milliseconds& block_timeout)
+{
+  QMutexLocker lock(&d->mutex);
+  d->policy = policy;
+  d->block_timeout = block_timeout;
+}
+
+size_t FramesQueue::size() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->frames.size();
+}
+
+size_t FramesQueue::max_frames() const
+{
+  return d->max_frames;
+}
+
+size_t FramesQueue::max_bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->max_bytes;
+}
+
+size_t FramesQueue::bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->bytes;
+}
+
+size_t FramesQueue::peak_bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->peak_bytes;
+}
+
+void FramesQueue::reset_peak_bytes()
+{
+  QMutexLocker lock(&d->mutex);
+  d->peak_bytes = d->bytes;
+}
+
+FramesQueue::OverflowPolicy FramesQueue::policy() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->policy;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FRAMESQUEUE_H
+#define FRAMESQUEUE_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <chrono>
+#include "commons/memorygovernor.h"
+
+FWD_PTR(Frame)
+
+/**
+ * Bounded frames queue: any number of producers, one consumer.
+ * The consumer blocks on pop() until a frame is available (or the timeout expires), instead of polling.
+ * The queue can be bounded by number of frames, by bytes (sum of queued Frame::size()), or both; 0 means no limit.
+ * A byte-bounded queue always accepts at least one frame, whatever its size.
+ * When the queue is full, the overflow policy decides which frame gets lost.
+ */
+class FramesQueue
+{
+public:
+  enum OverflowPolicy {
+    DropNewest = 0,    ///< Refuse the incoming frame
+    DropOldest = 1,    ///< Discard the frame at the head of the queue to make room
+    BlockProducer = 2, ///< Wait up to block_timeout for room, then refuse the incoming frame
+  };
+  FramesQueue(std::size_t max_frames, OverflowPolicy policy = DropNewest, const std::chrono::milliseconds &block_timeout = std::chrono::milliseconds{0});
+  ~FramesQueue();
+  /// Returns false if a frame was dropped, either the pushed one or an older one, depending on the policy
+  bool push(const FrameConstPtr &frame);
+  /// Returns an empty pointer if no frame arrived within timeout
+  FrameConstPtr pop(const std::chrono::milliseconds &timeout);
+  void clear();
+  void set_max_bytes(std::size_t max_bytes);
+  /// Queued frames are charged to account: a frame the process budget refuses counts as full, as with max_bytes
+  void set_memory_account(MemoryGovernor::Account &account);
+  void set_overflow_policy(OverflowPolicy policy, const std::chrono::milliseconds &block_timeout = std::chrono::milliseconds{0});
+  std::size_t size() const;
+  std::size_t max_frames() const;
+  std::size_t max_bytes() const;
+  /// Sum of the sizes of the queued frames
+  std::size_t bytes() const;
+  /// Highest value reached by bytes() since construction or the last reset_peak_bytes()
+  std::size_t peak_bytes() const;
+  void reset_peak_bytes();
+  OverflowPolicy policy() const;
+private:
+  DPTR
+};
+
+#endif // FRAMESQUEUE_H
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "commons/framesspool.h"
+#include "commons/frame.h"
+#include <QTemporaryFile>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <deque>
+#include <thread>
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+  // Written and read by the same process: native layout
+  struct RecordHeader {
+    qint32 width;
+    qint32 height;
+    quint8 bpp;
+    quint8 color_format;
+    quint8 byte_order;
+    quint8 has_device_timestamp;
+    quint32 reserved = 0;
+    double exposure;
+    qint64 created_utc;
+    Frame::Clock::rep captured;
+    Frame::Timestamp::rep device_timestamp;
+    quint64 sequence;
+    FrameMetadata metadata;
+  };
+}
+
+DPTR_IMPL(FramesSpool) {
+  const qint64 max_bytes;
+  const size_t max_pending;
+  QTemporaryFile log;
+  QFile reader;
+  mutable QMutex mutex;
+  QWaitCondition changed;
+  deque<FrameConstPtr> pending;
+  size_t pending_bytes = 0;
+  // Frame being appended by the spooler thread
+  bool writing = false;
+  size_t writing_bytes = 0;
+  // Records from read_offset to committed are on disk, waiting to be read
+  qint64 committed = 0;
+  qint64 read_offset = 0;
+  size_t disk_frames = 0;
+  qint64 disk_bytes = 0;
+  quint64 lost = 0;
+  bool running = true;
+  thread spooler;
+  void spool();
+  bool append(const Frame &frame, qint64 offset, qint64 &end);
+  FrameConstPtr read(qint64 offset, qint64 &end);
+  void truncate_if_drained();
+  size_t frames() const { return pending.size() + (writing ? 1 : 0) + disk_frames; }
+};
+
+FramesSpool::FramesSpool(const QString &directory, qint64 max_bytes, size_t max_pending)
+  : dptr(max_bytes, max_pending)
+{
+  d->log.setFileTemplate(QDir{directory}.filePath("planetaryimager-spool-XXXXXX"));
+  if(! d->log.open())
+    return;
+  d->reader.setFileName(d->log.fileName());
+  if(! d->reader.open(QIODevice::ReadOnly)) {
+    d->log.close();
+    return;
+  }
+  qDebug() << "Recording spool:" << d->log.fileName() << ", max bytes:" << max_bytes;
+  d->spooler = thread{&Private::spool, d.get()};
+}
+
+FramesSpool::~FramesSpool()
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    d->running = false;
+  }
+  d->changed.wakeAll();
+  if(d->spooler.joinable())
+    d->spooler.join();
+}
+
+bool FramesSpool::isOpen() const
+{
+  return d->log.isOpen();
+}
+
+QString FramesSpool::errorString() const
+{
+  return d->log.isOpen() ? d->reader.errorString() : d->log.errorString();
+}
+
+QString FramesSpool::filename() const
+{
+  return d->log.fileName();
+}
+
+void FramesSpool::Private::spool()
+{
+#ifdef Q_OS_LINUX
+  // Lowest CPU priority: capture, display and the main recording writer come first
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+  while(true) {
+    FrameConstPtr frame;
+    qint64 offset;
+    {
+      QMutexLocker lock(&mutex);
+      while(running && pending.empty())
+        changed.wait(&mutex);
+      // Whatever is left is dropped with the spool
+      if(! running)
+        return;
+      frame = pending.front();
+      pending.pop_front();
+      pending_bytes -= frame->size();
+      writing = true;
+      writing_bytes = frame->size();
+      offset = committed;
+    }
+    qint64 end;
+    const bool written = append(*frame, offset, end);
+    {
+      QMutexLocker lock(&mutex);
+      writing = false;
+      if(written) {
+        committed = end;
+        ++disk_frames;
+        disk_bytes += frame->size();
+      } else {
+        ++lost;
+      }
+    }
+    changed.wakeAll();
+  }
+}
+
+bool FramesSpool::Private::append(const Frame &frame, qint64 offset, qint64 &end)
+{
+  RecordHeader header;
+  header.width = frame.resolution().width();
+  header.height = frame.resolution().height();
+  header.bpp = frame.bpp();
+  header.color_format = frame.colorFormat();
+  header.byte_order = frame.byteOrder();
+  header.has_device_timestamp = frame.has_device_timestamp();
+  header.exposure = frame.exposure().count();
+  header.created_utc = frame.created_utc_msecs();
+  header.captured = frame.captured().time_since_epoch().count();
+  header.device_timestamp = frame.device_timestamp().count();
+  header.sequence = frame.sequence();
+  header.metadata = frame.metadata();
+  if(! log.seek(offset) || log.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header))
+    return false;
+  const cv::Mat &mat = frame.mat();
+  const qint64 row_bytes = mat.cols * mat.elemSize();
+  if(mat.isContinuous()) {
+    if(log.write(reinterpret_cast<const char*>(mat.data), frame.size()) != static_cast<qint64>(frame.size()))
+      return false;
+  } else {
+    for(int row = 0; row < mat.rows; row++)
+      if(log.write(reinterpret_cast<const char*>(mat.ptr(row)), row_bytes) != row_bytes)
+        return false;
+  }
+  // Visible to the reader from here on
+  if(! log.flush())
+    return false;
+  end = offset + sizeof(header) + frame.size();
+  return true;
+}
+
+FrameConstPtr FramesSpool::Private::read(qint64 offset, qint64 &end)
+{
+  RecordHeader header;
+  if(! reader.seek(offset) || reader.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header))
+    return {};
+  auto frame = make_shared<Frame>(header.bpp, static_cast<Frame::ColorFormat>(header.color_format), QSize{header.width, header.height},
+                                  static_cast<Frame::ByteOrder>(header.byte_order));
+  if(reader.read(reinterpret_cast<char*>(frame->data()), frame->size()) != static_cast<qint64>(frame->size()))
+    return {};
+  frame->set_exposure(Frame::Seconds{header.exposure});
+  frame->set_created_utc(QDateTime::fromMSecsSinceEpoch(header.created_utc, Qt::UTC));
+  frame->set_captured(Frame::Clock::time_point{Frame::Clock::duration{header.captured}});
+  if(header.has_device_timestamp)
+    frame->set_device_timestamp(Frame::Timestamp{header.device_timestamp});
+  frame->set_sequence(header.sequence);
+  frame->set_metadata(header.metadata);
+  end = offset + sizeof(header) + frame->size();
+  return frame;
+}
+
+bool FramesSpool::push(const FrameConstPtr &frame)
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    if(! d->log.isOpen())
+      return false;
+    const size_t size = frame->size();
+    const qint64 spooled = d->disk_bytes + (d->writing ? d->writing_bytes : 0) + d->pending_bytes;
+    if(d->max_bytes > 0 && spooled + static_cast<qint64>(size) > d->max_bytes)
+      return false;
+    // Always room for one frame, as in FramesQueue
+    if(d->max_pending > 0 && ! d->pending.empty() && d->pending_bytes + size > d->max_pending)
+      return false;
+    d->pending.push_back(frame);
+    d->pending_bytes += size;
+  }
+  d->changed.wakeAll();
+  return true;
+}
+
+FrameConstPtr FramesSpool::pop(const chrono::milliseconds &timeout)
+{
+  QMutexLocker lock(&d->mutex);
+  QElapsedTimer elapsed;
+  elapsed.start();
+  // Frames on disk first, then the one being written, then the ones still in memory
+  while(d->read_offset >= d->committed && (d->writing || d->pending.empty())) {
+    const qint64 remaining = timeout.count() - elapsed.elapsed();
+    if(remaining <= 0 || ! d->changed.wait(&d->mutex, remaining))
+      return {};
+  }
+  if(d->read_offset < d->committed) {
+    const qint64 offset = d->read_offset;
+    // Only this thread reads, or moves the read offset: the spooler keeps appending meanwhile
+    lock.unlock();
+    qint64 end;
+    auto frame = d->read(offset, end);
+    lock.relock();
+    if(! frame) {
+      qWarning() << "Error reading recording spool" << d->reader.fileName() << ":" << d->reader.errorString() << ", dropping" << d->disk_frames << "frames";
+      d->lost += d->disk_frames;
+      d->disk_frames = 0;
+      d->disk_bytes = 0;
+      d->read_offset = d->committed;
+    } else {
+      d->read_offset = end;
+      --d->disk_frames;
+      d->disk_bytes -= frame->size();
+    }
+    d->truncate_if_drained();
+    return frame;
+  }
+  // Nothing on disk, nor being written: older than anything that could come later
+  auto frame = d->pending.front();
+  d->pending.pop_front();
+  d->pending_bytes -= frame->size();
+  d->truncate_if_drained();
+  return frame;
+}
+
+void FramesSpool::Private::truncate_if_drained()
+{
+  // Start over from an empty log, so that it doesn't grow for the whole recording. The spooler appends at committed, read when it takes a frame
+  if(read_offset < committed || writing || committed == 0)
+    return;
+  log.resize(0);
+  read_offset = committed = 0;
+}
+
+bool FramesSpool::empty() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->frames() == 0;
+}
+
+size_t FramesSpool::size() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->frames();
+}
+
+qint64 FramesSpool::bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->disk_bytes + (d->writing ? d->writing_bytes : 0) + d->pending_bytes;
+}
+
+quint64 FramesSpool::lost() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->lost;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMESSPOOL_H
+#define FRAMESSPOOL_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <QString>
+#include <chrono>
+
+FWD_PTR(Frame)
+FWD_PTR(FramesSpool)
+
+/**
+ * Overflow tier for the recording queue: frames that don't fit in memory are appended to a log file on a secondary disk
+ * (a second SSD, or tmpfs), and read back in the same order.
+ * One producer pushes (the caller serialises producers), one consumer pops. Pushing only queues the frame in memory:
+ * a low priority thread appends it to the log, so that the producer never waits on the spool disk.
+ * The log is truncated whenever it's drained, and removed on destruction.
+ */
+class FramesSpool
+{
+public:
+  /// max_bytes bounds the frames in the spool, on disk or waiting to be written; max_pending bounds the ones waiting in memory (0: no limit)
+  FramesSpool(const QString &directory, qint64 max_bytes, std::size_t max_pending);
+  ~FramesSpool();
+  bool isOpen() const;
+  QString errorString() const;
+  QString filename() const;
+  /// false if the frame is dropped: no room left, or the log couldn't be written
+  bool push(const FrameConstPtr &frame);
+  /// Oldest frame in the spool; an empty pointer if none is ready within timeout
+  FrameConstPtr pop(const std::chrono::milliseconds &timeout);
+  bool empty() const;
+  /// Frames pushed and not popped yet
+  std::size_t size() const;
+  /// Pixel bytes of the frames in the spool, on disk or waiting to be written
+  qint64 bytes() const;
+  /// Frames accepted by push() and lost afterwards, because writing or reading the log failed
+  quint64 lost() const;
+private:
+  DPTR
+};
+
+#endif // FRAMESSPOOL_H
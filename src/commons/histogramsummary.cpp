@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "histogramsummary.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+const size_t summary_bins = 256;
+
+void put(vector<uint8_t> &data, uint64_t value)
+{
+  while(value >= 0x80) {
+    data.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  data.push_back(static_cast<uint8_t>(value));
+}
+
+bool get(const vector<uint8_t> &data, size_t &position, uint64_t &value)
+{
+  value = 0;
+  for(int shift = 0; shift < 64 && position < data.size(); shift += 7) {
+    const uint8_t byte = data[position++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if(! (byte & 0x80))
+      return true;
+  }
+  return false;
+}
+}
+
+HistogramSummary HistogramSummary::from_counts(const vector<uint32_t> &counts, int bpp)
+{
+  HistogramSummary summary;
+  summary.bpp = bpp;
+  summary.bins.resize(summary_bins, 0);
+  const bool sixteen_bit = counts.size() > summary_bins;
+  int min_value = -1, max_value = 0;
+  for(size_t value = 0; value < counts.size(); value++) {
+    if(counts[value] == 0)
+      continue;
+    if(min_value < 0)
+      min_value = value;
+    max_value = value;
+    summary.pixels += counts[value];
+    const int eight_bit = sixteen_bit ? min<int>((value + 128) >> 8, 255) : value;
+    summary.bins[eight_bit] += counts[value];
+  }
+  min_value = max(min_value, 0);
+  summary.shadows_value = min_value;
+  summary.shadows_count = counts.empty() ? 0 : counts[min_value];
+  summary.highlights_value = max_value;
+  summary.highlights_count = counts.empty() ? 0 : counts[max_value];
+  return summary;
+}
+
+vector<uint8_t> HistogramSummary::encode() const
+{
+  vector<uint8_t> data;
+  data.reserve(summary_bins + 16);
+  for(uint64_t value: {static_cast<uint64_t>(bpp), static_cast<uint64_t>(shadows_value), static_cast<uint64_t>(shadows_count),
+                       static_cast<uint64_t>(highlights_value), static_cast<uint64_t>(highlights_count), pixels})
+    put(data, value);
+  for(size_t bin = 0; bin < summary_bins; bin++)
+    put(data, bin < bins.size() ? bins[bin] : 0);
+  return data;
+}
+
+bool HistogramSummary::decode(const vector<uint8_t> &data, HistogramSummary &summary)
+{
+  HistogramSummary decoded;
+  size_t position = 0;
+  uint64_t fields[6];
+  for(auto &field: fields)
+    if(! get(data, position, field))
+      return false;
+  if(fields[0] == 0 || fields[0] > 16)
+    return false;
+  decoded.bpp = static_cast<int>(fields[0]);
+  decoded.shadows_value = static_cast<int>(fields[1]);
+  decoded.shadows_count = static_cast<uint32_t>(fields[2]);
+  decoded.highlights_value = static_cast<int>(fields[3]);
+  decoded.highlights_count = static_cast<uint32_t>(fields[4]);
+  decoded.pixels = fields[5];
+  decoded.bins.resize(summary_bins);
+  for(auto &bin: decoded.bins) {
+    uint64_t value;
+    if(! get(data, position, value))
+      return false;
+    bin = static_cast<uint32_t>(value);
+  }
+  if(position != data.size())
+    return false;
+  summary = decoded;
+  return true;
+}
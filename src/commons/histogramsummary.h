@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTOGRAMSUMMARY_H
+#define HISTOGRAMSUMMARY_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * What the histogram panel shows of a channel: counts of the 8 bit values (as in the 8 bit conversion of the frame),
+ * with shadows and highlights at the full depth. Computed wherever the raw frame is, and plotted by Histogram at the bins the panel asks for:
+ * remote sessions get it from the server (see HistogramForwarder) in a few hundred bytes, instead of counting the decoded previews.
+ */
+struct HistogramSummary {
+  /// 256 counts
+  std::vector<uint32_t> bins;
+  int bpp = 8;
+  int shadows_value = 0;
+  uint32_t shadows_count = 0;
+  int highlights_value = 0;
+  uint32_t highlights_count = 0;
+  uint64_t pixels = 0;
+  /// From the counts of each value (PixelKernels::histogram)
+  static HistogramSummary from_counts(const std::vector<uint32_t> &counts, int bpp);
+  /// Varints: bpp, shadows, highlights, pixels, then the 256 bins; empty bins take a byte
+  std::vector<uint8_t> encode() const;
+  /// false on truncated or malformed data
+  static bool decode(const std::vector<uint8_t> &data, HistogramSummary &summary);
+};
+
+#endif // HISTOGRAMSUMMARY_H
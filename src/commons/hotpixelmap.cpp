@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "hotpixelmap.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+// Rows per parallel stripe, while learning
+#define HOT_PIXEL_MAP_STRIPE_ROWS 32
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+
+/// Robust noise estimate: median absolute difference of horizontal same-colour neighbours, as a standard deviation
+template<typename T> double noise(const cv::Mat &image, int stride) {
+  const int channels = image.channels();
+  vector<int> differences;
+  differences.reserve(static_cast<size_t>(image.rows / 4 + 1) * image.cols * channels);
+  // One row every 4 is plenty for a median
+  for(int y = 0; y < image.rows; y += 4) {
+    const T *row = image.ptr<T>(y);
+    for(int x = 0; x + stride < image.cols; x++)
+      for(int channel = 0; channel < channels; channel++)
+        differences.push_back(abs(static_cast<int>(row[x * channels + channel]) - static_cast<int>(row[(x + stride) * channels + channel])));
+  }
+  if(differences.empty())
+    return 1;
+  auto median = differences.begin() + differences.size() / 2;
+  nth_element(differences.begin(), median, differences.end());
+  return max(1., 1.4826 * *median / sqrt(2.));
+}
+
+/// Lowers each excess to the pixel value minus its second brightest same-colour neighbour, if smaller
+template<typename T> void update_excess(const cv::Mat &image, cv::Mat &excess, int stride) {
+  const int channels = image.channels();
+  const int stripes = (image.rows + HOT_PIXEL_MAP_STRIPE_ROWS - 1) / HOT_PIXEL_MAP_STRIPE_ROWS;
+  cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+    const int last = min(image.rows, (stripe + 1) * HOT_PIXEL_MAP_STRIPE_ROWS);
+    for(int y = stripe * HOT_PIXEL_MAP_STRIPE_ROWS; y < last; y++) {
+      int *row_excess = excess.ptr<int>(y);
+      for(int x = 0; x < image.cols; x++) {
+        for(int channel = 0; channel < channels; channel++) {
+          int first = INT_MIN, second = INT_MIN;
+          for(int dy = -stride; dy <= stride; dy += stride) {
+            const int ny = y + dy;
+            if(ny < 0 || ny >= image.rows)
+              continue;
+            const T *row = image.ptr<T>(ny);
+            for(int dx = -stride; dx <= stride; dx += stride) {
+              const int nx = x + dx;
+              if((dx == 0 && dy == 0) || nx < 0 || nx >= image.cols)
+                continue;
+              const int value = row[nx * channels + channel];
+              if(value > first) {
+                second = first;
+                first = value;
+              } else if(value > second) {
+                second = value;
+              }
+            }
+          }
+          // Fewer than two neighbours: never hot
+          const int pixel_excess = second == INT_MIN ? INT_MIN : image.ptr<T>(y)[x * channels + channel] - second;
+          int &value = row_excess[x * channels + channel];
+          value = min(value, pixel_excess);
+        }
+      }
+    }
+  }});
+}
+
+/// Median of the unmapped same-colour neighbours, for every mapped pixel
+template<typename T> void correct_pixels(cv::Mat &image, const cv::Mat &mask, const vector<cv::Point> &pixels, int stride) {
+  const int channels = image.channels();
+  int values[8];
+  for(const auto &point: pixels) {
+    for(int channel = 0; channel < channels; channel++) {
+      int count = 0;
+      for(int dy = -stride; dy <= stride; dy += stride) {
+        const int ny = point.y + dy;
+        if(ny < 0 || ny >= image.rows)
+          continue;
+        for(int dx = -stride; dx <= stride; dx += stride) {
+          const int nx = point.x + dx;
+          if((dx == 0 && dy == 0) || nx < 0 || nx >= image.cols || mask.at<uint8_t>(ny, nx))
+            continue;
+          values[count++] = image.ptr<T>(ny)[nx * channels + channel];
+        }
+      }
+      if(count == 0)
+        continue;
+      int *middle = values + count / 2;
+      nth_element(values, middle, values + count);
+      // Even counts: mean of the two middle values, rounded
+      const int median = count % 2 ? *middle : (*max_element(values, middle) + *middle + 1) / 2;
+      image.ptr<T>(point.y)[point.x * channels + channel] = static_cast<T>(median);
+    }
+  }
+}
+}
+
+DPTR_IMPL(HotPixelMap) {
+  int frames = 0;
+  double sigma = 0;
+  int learnt = 0;
+  bool ready = false;
+  double noise = 0;
+  cv::Mat excess;  ///< CV_32S, one value per channel: lowest excess over the learning frames so far
+  cv::Mat mask;    ///< CV_8U, non zero for mapped pixels
+  vector<cv::Point> pixels;
+  void finish();
+};
+
+HotPixelMap::HotPixelMap() : dptr()
+{
+}
+
+HotPixelMap::~HotPixelMap()
+{
+}
+
+void HotPixelMap::set(const cv::Mat &mask)
+{
+  const int channels = mask.channels();
+  cv::Mat nonzero;
+  cv::compare(mask.reshape(1), 0, nonzero, cv::CMP_NE);
+  d->mask = cv::Mat::zeros(mask.rows, mask.cols, CV_8U);
+  for(int y = 0; y < mask.rows; y++)
+    for(int x = 0; x < mask.cols; x++)
+      for(int channel = 0; channel < channels; channel++)
+        if(nonzero.at<uint8_t>(y, x * channels + channel))
+          d->mask.at<uint8_t>(y, x) = 255;
+  d->frames = 0;
+  d->finish();
+}
+
+void HotPixelMap::learn(int frames, double sigma)
+{
+  d->frames = max(1, frames);
+  d->sigma = sigma;
+  d->learnt = 0;
+  d->ready = false;
+  d->excess.release();
+  d->mask.release();
+  d->pixels.clear();
+}
+
+bool HotPixelMap::add(const cv::Mat &image, int stride)
+{
+  if(d->ready || d->frames == 0)
+    return d->ready;
+  const cv::Size size{image.cols * image.channels(), image.rows};
+  if(d->learnt == 0 || d->excess.size() != size) {
+    d->learnt = 0;
+    d->excess = cv::Mat(size, CV_32S, cv::Scalar::all(INT_MAX));
+    d->noise = image.depth() == CV_16U ? noise<uint16_t>(image, stride) : noise<uint8_t>(image, stride);
+  }
+  if(image.depth() == CV_16U)
+    update_excess<uint16_t>(image, d->excess, stride);
+  else
+    update_excess<uint8_t>(image, d->excess, stride);
+  if(++d->learnt < d->frames)
+    return false;
+
+  const int channels = image.channels();
+  const double threshold = d->sigma * d->noise;
+  d->mask = cv::Mat::zeros(image.rows, image.cols, CV_8U);
+  for(int y = 0; y < image.rows; y++) {
+    const int *row = d->excess.ptr<int>(y);
+    for(int x = 0; x < image.cols; x++)
+      for(int channel = 0; channel < channels; channel++)
+        if(row[x * channels + channel] > threshold)
+          d->mask.at<uint8_t>(y, x) = 255;
+  }
+  d->excess.release();
+  d->finish();
+  return true;
+}
+
+void HotPixelMap::Private::finish()
+{
+  pixels.clear();
+  if(cv::countNonZero(mask) > 0)
+    cv::findNonZero(mask, pixels);
+  ready = true;
+}
+
+bool HotPixelMap::ready() const
+{
+  return d->ready;
+}
+
+const vector<cv::Point> &HotPixelMap::pixels() const
+{
+  return d->pixels;
+}
+
+void HotPixelMap::correct(cv::Mat &image, int stride) const
+{
+  if(d->pixels.empty() || d->mask.size() != image.size())
+    return;
+  if(image.depth() == CV_16U)
+    correct_pixels<uint16_t>(image, d->mask, d->pixels, stride);
+  else
+    correct_pixels<uint8_t>(image, d->mask, d->pixels, stride);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HOTPIXELMAP_H
+#define HOTPIXELMAP_H
+
+#include "c++/dptr.h"
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Sparse map of hot or dead pixels, and their correction.
+ * The map comes from a bad pixel image, or is learnt from the frames themselves: a pixel is hot when, in every one of the
+ * learning frames, it stays brighter than all but one of its 8 same-colour neighbours by more than sigma times the frame noise.
+ * Stars, limbs and planetary detail move with the seeing and fail that test; hot pixels don't. A short dark sequence works best.
+ * Correction replaces each mapped pixel with the median of its unmapped same-colour neighbours: its cost is O(mapped pixels).
+ * Images are CV_8U or CV_16U in native byte order; stride is 2 for Bayer images (same colour neighbours), 1 otherwise.
+ * Not thread safe.
+ */
+class HotPixelMap
+{
+public:
+  HotPixelMap();
+  ~HotPixelMap();
+  /// Maps the non zero pixels of mask (any channel): the map is ready right away
+  void set(const cv::Mat &mask);
+  /// Starts learning a new map from the next frames
+  void learn(int frames, double sigma);
+  /// Feeds a learning frame: returns true when the map is complete. Frames of another size restart the learning
+  bool add(const cv::Mat &image, int stride);
+  bool ready() const;
+  const std::vector<cv::Point> &pixels() const;
+  void correct(cv::Mat &image, int stride) const;
+private:
+  DPTR
+};
+
+#endif // HOTPIXELMAP_H
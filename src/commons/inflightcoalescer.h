@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef INFLIGHTCOALESCER_H
+#define INFLIGHTCOALESCER_H
+
+#include <utility>
+
+/**
+ * At most one value in flight to a receiver that acknowledges it, the latest one winning meanwhile (i.e. camera controls while dragging a slider):
+ * updates go out as fast as the round trip allows, with no stale values queueing up behind a slow receiver, and the last value always goes out.
+ * Lost acknowledgments are up to the caller: acknowledge on a timeout.
+ */
+template<typename T>
+class InFlightCoalescer
+{
+public:
+  /// true: send value now. false: one is in flight already, and value replaces any other waiting for it
+  bool offer(const T &value) {
+    if(_in_flight) {
+      waiting = value;
+      has_waiting = true;
+      return false;
+    }
+    _in_flight = true;
+    return true;
+  }
+  /// The value in flight arrived: true, with the latest value offered meanwhile, to offer again
+  bool acknowledged(T &next) {
+    _in_flight = false;
+    if(! has_waiting)
+      return false;
+    next = std::move(waiting);
+    has_waiting = false;
+    return true;
+  }
+  bool in_flight() const { return _in_flight; }
+private:
+  bool _in_flight = false;
+  bool has_waiting = false;
+  T waiting{};
+};
+
+#endif // INFLIGHTCOALESCER_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "loadshedding.h"
+
+LoadShedding::LoadShedding() : LoadShedding{Settings{}}
+{
+}
+
+LoadShedding::LoadShedding(const Settings &settings) : settings{settings}
+{
+}
+
+LoadShedding::Level LoadShedding::update(double pressure, const Clock::time_point &now)
+{
+  // In between the thresholds, the level holds and both clocks start over
+  if(pressure < settings.high)
+    above = false;
+  if(pressure > settings.low)
+    below = false;
+  if(pressure >= settings.high && _level < settings.max_level) {
+    if(! above) {
+      above = true;
+      above_since = now;
+    } else if(now - above_since >= settings.escalate) {
+      _level = static_cast<Level>(_level + 1);
+      // Each further step waits for the previous one to have a chance
+      above_since = now;
+    }
+  } else if(pressure <= settings.low && _level > Normal) {
+    if(! below) {
+      below = true;
+      below_since = now;
+    } else if(now - below_since >= settings.recover) {
+      _level = static_cast<Level>(_level - 1);
+      below_since = now;
+    }
+  }
+  // A lowered maximum takes effect right away
+  if(_level > settings.max_level)
+    _level = settings.max_level;
+  return _level;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOADSHEDDING_H
+#define LOADSHEDDING_H
+
+#include <chrono>
+
+/**
+ * Graceful degradation while the recording writer falls behind: rather than dropping frames once its queue is full,
+ * work the recording doesn't need is given up, a step at a time, and taken back once the writer keeps up again.
+ * Pressure is the writer queue fill, or the time spent writing over the time elapsed, whichever is higher (1: the writer can't keep up).
+ * Above high for the escalate time, the next step is taken; below low for the recover time, the last one is undone.
+ * The steps themselves are taken by LoadShedder.
+ */
+class LoadShedding
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  enum Level {
+    Normal,
+    /// No network previews, histogram refreshes or focus measures
+    NoPreviews,
+    /// The display gets a few frames per second
+    SlowDisplay,
+    /// No display at all: the recording gets the machine to itself
+    NoDisplay,
+  };
+  struct Settings {
+    /// Last step that can be taken, Normal to never shed anything
+    Level max_level = SlowDisplay;
+    double high = 0.5;
+    double low = 0.2;
+    std::chrono::milliseconds escalate{1000};
+    std::chrono::milliseconds recover{5000};
+  };
+  LoadShedding();
+  LoadShedding(const Settings &settings);
+  /// Latest pressure measured; returns the level to apply
+  Level update(double pressure, const Clock::time_point &now);
+  Level level() const { return _level; }
+private:
+  Settings settings;
+  Level _level = Normal;
+  Clock::time_point above_since, below_since;
+  bool above = false, below = false;
+};
+
+#endif // LOADSHEDDING_H
@@ -27,19 +27,96 @@
 #include "commons/commandline.h"
 #include <QMutex>
 #include <QMutexLocker>
+#include <QThread>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <list>
+#include <boost/lockfree/spsc_queue.hpp>
 #include "commons/definitions.h"
+#include "Qt/qt_strings_helper.h"
 
 using namespace std;
 using namespace std::placeholders;
 
+/*
+ * Logging goes through a ring for each thread, drained by a background flusher, so that a thread logging
+ * never waits on formatting, the console or the disk. When a ring is full, messages are counted and dropped.
+ * The flusher also folds messages repeated back to back, and rate limits each function.
+ */
 DPTR_IMPL(LogHandler) {
-   static Output::list outputs;
-   static void log_handler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
-   static Output output(std::ostream &stream, QtMsgType level);
-   ofstream logfile;
+  static constexpr size_t RING_SIZE = 1024;
+  // Messages from a single function in a second, before the rest of them are only counted
+  static constexpr int MAX_MESSAGES_PER_FUNCTION = 20;
+  static constexpr qint64 RATE_WINDOW_MSECS = 1000;
+  struct Message {
+    quint64 sequence;
+    QtMsgType type;
+    QByteArray function;
+    QString text;
+  };
+  struct ThreadRing {
+    boost::lockfree::spsc_queue<Message> messages{RING_SIZE};
+    atomic<quint64> dropped{0};
+  };
+  class Flusher;
+
+  static Output::list outputs;
+  static Private *instance;
+  static void log_handler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+  static Output output(std::ostream &stream, QtMsgType level);
+  static void write(QtMsgType type, const QByteArray &function, const QString &msg);
+  static shared_ptr<ThreadRing> thread_ring();
+
+  ofstream logfile;
+  QMutex rings_mutex;
+  list<shared_ptr<ThreadRing>> rings;
+  atomic<quint64> sequence{0};
+  // Only used by the thread currently flushing, under flush_mutex
+  QMutex flush_mutex;
+  struct {
+    bool valid = false;
+    QtMsgType type;
+    QByteArray function;
+    QString text;
+    quint64 repeated = 0;
+  } last;
+  struct FunctionRate {
+    int messages;
+    quint64 suppressed;
+  };
+  QHash<QByteArray, FunctionRate> rates;
+  QElapsedTimer rate_window;
+  unique_ptr<Flusher> flusher;
+
+  void flush();
+  void write_pending_summaries();
+  void write_message(const Message &message);
 };
 
+constexpr size_t LogHandler::Private::RING_SIZE;
 LogHandler::Output::list LogHandler::Private::outputs = {};
+LogHandler::Private *LogHandler::Private::instance = nullptr;
+
+class LogHandler::Private::Flusher : public QThread {
+public:
+  Flusher(LogHandler::Private *d) : d{d} { setObjectName("log flusher"); start(); }
+  ~Flusher() { wake.release(); wait(); }
+  QSemaphore wake;
+private:
+  void run() override;
+  LogHandler::Private *d;
+};
+
+void LogHandler::Private::Flusher::run()
+{
+  // Any token stops the thread: producers never signal, the flusher just wakes up periodically
+  while(! wake.tryAcquire(1, 50))
+    d->flush();
+  d->flush();
+}
 
 QHash<QtMsgType, string> LogHandler::log_levels()
 {
@@ -53,8 +130,33 @@ QHash<QtMsgType, string> LogHandler::log_levels()
   return levels;
 }
 
+shared_ptr<LogHandler::Private::ThreadRing> LogHandler::Private::thread_ring()
+{
+  thread_local shared_ptr<ThreadRing> ring;
+  if(! ring) {
+    ring = make_shared<ThreadRing>();
+    QMutexLocker lock(&instance->rings_mutex);
+    instance->rings.push_back(ring);
+  }
+  return ring;
+}
 
 void LogHandler::Private::log_handler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+  QByteArray function{context.function ? context.function : ""};
+  // Fatal messages are followed by abort(): everything still queued must be out before returning
+  if(! instance || type == QtFatalMsg) {
+    if(instance)
+      instance->flush();
+    write(type, function, msg);
+    return;
+  }
+  auto ring = thread_ring();
+  if(! ring->messages.push({++instance->sequence, type, function, msg}))
+    ++ring->dropped;
+}
+
+void LogHandler::Private::write(QtMsgType type, const QByteArray &function, const QString &msg)
 {
   static QMutex log_mutex;
   
@@ -65,22 +167,76 @@ void LogHandler::Private::log_handler(QtMsgType type, const QMessageLogContext &
     {QtInfoMsg    , 40},
     {QtDebugMsg   , 50},
   };
+  QMutexLocker lock(&log_mutex);
   for(auto output: outputs) {
 #if DEVELOPER_MODE == 0
     if(priority[type] > priority[output.level])
       continue;
 #endif
-    QString position;
-    if(context.file && context.line) {
-      position = QString("%1:%2").arg(context.file).arg(context.line).replace(SRC_DIR, "");
-    }
-    QString function = context.function ? context.function : "";
-    QMutexLocker lock(&log_mutex);
-    output.stream.get() << setw(8) << LogHandler::log_levels()[type] << " - " /*<< qPrintable(position) << "@"*/<< qPrintable(function) << " " << qPrintable(msg) << endl;
+    output.stream.get() << setw(8) << LogHandler::log_levels()[type] << " - " << function.constData() << " " << qPrintable(msg) << endl;
     output.stream.get().flush();
   }
 }
 
+void LogHandler::Private::flush()
+{
+  QMutexLocker lock(&flush_mutex);
+  vector<Message> messages;
+  quint64 dropped = 0;
+  {
+    QMutexLocker lock(&rings_mutex);
+    for(auto it = rings.begin(); it != rings.end(); ) {
+      auto &ring = *it;
+      ring->messages.consume_all([&](const Message &message){ messages.push_back(message); });
+      dropped += ring->dropped.exchange(0);
+      // Only referenced here: its thread is gone, and so are its messages
+      if(ring.use_count() == 1 && ring->messages.read_available() == 0)
+        it = rings.erase(it);
+      else
+        ++it;
+    }
+  }
+  // Rings are per thread: merge them back to the order messages were logged in
+  sort(messages.begin(), messages.end(), [](const Message &a, const Message &b){ return a.sequence < b.sequence; });
+  for(const auto &message: messages)
+    write_message(message);
+  if(! rate_window.isValid() || rate_window.elapsed() >= RATE_WINDOW_MSECS)
+    write_pending_summaries();
+  if(dropped > 0)
+    write(QtWarningMsg, "LogHandler", "%1 log messages dropped, logging can't keep up"_q % dropped);
+}
+
+void LogHandler::Private::write_message(const Message &message)
+{
+  if(last.valid && last.type == message.type && last.function == message.function && last.text == message.text) {
+    ++last.repeated;
+    return;
+  }
+  auto &rate = rates[message.function];
+  if(message.type != QtCriticalMsg && ++rate.messages > MAX_MESSAGES_PER_FUNCTION) {
+    ++rate.suppressed;
+    return;
+  }
+  if(last.repeated > 0)
+    write(last.type, last.function, "last message repeated %1 times"_q % last.repeated);
+  last = {true, message.type, message.function, message.text, 0};
+  write(message.type, message.function, message.text);
+}
+
+void LogHandler::Private::write_pending_summaries()
+{
+  if(last.repeated > 0) {
+    write(last.type, last.function, "last message repeated %1 times"_q % last.repeated);
+    last.repeated = 0;
+  }
+  for(auto it = rates.begin(); it != rates.end(); ++it) {
+    if(it.value().suppressed > 0)
+      write(QtWarningMsg, it.key(), "%1 more messages suppressed in the last second"_q % it.value().suppressed);
+  }
+  rates.clear();
+  rate_window.restart();
+}
+
 void LogHandler::log(QtMsgType type, const QMessageLogContext& context, const QString& msg)
 {
     Private::log_handler(type, context, msg);
@@ -96,12 +252,19 @@ LogHandler::LogHandler(const CommandLine &commandLine) : dptr()
   d->logfile.open(commandLine.logfile().toStdString(), ios::out | ios::trunc);
   
   d->outputs.push_back(LogHandler::Private::output(d->logfile, QtDebugMsg));
+  Private::instance = d.get();
+  d->flusher = make_unique<Private::Flusher>(d.get());
   qInstallMessageHandler(&Private::log_handler);
 }
 
 LogHandler::~LogHandler()
 {
   qInstallMessageHandler(nullptr);
+  // Last flush included
+  d->flusher.reset();
+  d->write_pending_summaries();
+  Private::instance = nullptr;
+  d->outputs.clear();
 }
 
 
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "memorygovernor.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVariant>
+#include <algorithm>
+#include <list>
+#include <vector>
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+struct MemoryGovernor::Reclaimer::Registration {
+  Registration(Account &account, const Reclaim &reclaim) : account(account), reclaim{reclaim} {}
+  Account &account;
+  Reclaim reclaim;
+  // Held while the reclaimer runs, so that unregistering waits for it
+  QMutex mutex;
+};
+
+DPTR_IMPL(MemoryGovernor) {
+  atomic<size_t> budget{0};
+  atomic<size_t> used{0};
+  mutable QMutex mutex;
+  list<unique_ptr<Account>> accounts;
+  vector<shared_ptr<Reclaimer::Registration>> reclaimers;
+  Metrics::Gauge &budget_metric = Metrics::instance().gauge("memory_budget_bytes", "Process memory budget of the subsystems holding frames, 0 for none");
+  Metrics::Gauge &used_metric = Metrics::instance().gauge("memory_used_bytes", "Memory charged to the process budget, all subsystems together");
+  bool admit(size_t bytes);
+  void add_used(size_t bytes);
+  void remove_used(size_t bytes);
+};
+
+bool MemoryGovernor::Private::admit(size_t bytes)
+{
+  const size_t limit = budget.load(memory_order_relaxed);
+  size_t current = used.load(memory_order_relaxed);
+  do {
+    if(limit > 0 && current + bytes > limit)
+      return false;
+  } while(! used.compare_exchange_weak(current, current + bytes, memory_order_relaxed));
+  used_metric.set(static_cast<qint64>(current + bytes));
+  return true;
+}
+
+void MemoryGovernor::Private::add_used(size_t bytes)
+{
+  used_metric.set(static_cast<qint64>(used.fetch_add(bytes, memory_order_relaxed) + bytes));
+}
+
+void MemoryGovernor::Private::remove_used(size_t bytes)
+{
+  used_metric.set(static_cast<qint64>(used.fetch_sub(bytes, memory_order_relaxed) - bytes));
+}
+
+MemoryGovernor::MemoryGovernor() : dptr()
+{
+}
+
+MemoryGovernor::~MemoryGovernor()
+{
+}
+
+MemoryGovernor &MemoryGovernor::instance()
+{
+  // Drivers are plugins, each one with its own copy of this library: they all share the governor of the application loading them
+  static MemoryGovernor *governor = []{
+    auto app = QCoreApplication::instance();
+    if(! app)
+      return new MemoryGovernor;
+    auto shared = app->property("planetaryimager_memory_governor");
+    if(shared.isValid())
+      return reinterpret_cast<MemoryGovernor *>(shared.value<quintptr>());
+    auto created = new MemoryGovernor;
+    app->setProperty("planetaryimager_memory_governor", QVariant::fromValue<quintptr>(reinterpret_cast<quintptr>(created)));
+    return created;
+  }();
+  return *governor;
+}
+
+void MemoryGovernor::set_budget(size_t bytes)
+{
+  // Memory already charged above a lowered budget is not taken back: the next reservations reclaim it
+  d->budget = bytes;
+  d->budget_metric.set(static_cast<qint64>(bytes));
+}
+
+size_t MemoryGovernor::budget() const
+{
+  return d->budget;
+}
+
+size_t MemoryGovernor::used() const
+{
+  return d->used;
+}
+
+MemoryGovernor::Account &MemoryGovernor::account(const QString &name, Priority priority)
+{
+  QMutexLocker lock(&d->mutex);
+  auto found = find_if(d->accounts.begin(), d->accounts.end(), [&](const unique_ptr<Account> &account) { return account->name == name; });
+  if(found != d->accounts.end())
+    return **found;
+  d->accounts.push_back(unique_ptr<Account>{new Account{*this, name, priority}});
+  return *d->accounts.back();
+}
+
+QList<MemoryGovernor::Usage> MemoryGovernor::usage() const
+{
+  QList<Usage> usage;
+  {
+    QMutexLocker lock(&d->mutex);
+    for(const auto &account: d->accounts)
+      usage.push_back({account->name, account->priority, account->current(), account->peak()});
+  }
+  stable_sort(usage.begin(), usage.end(), [](const Usage &a, const Usage &b) { return a.priority < b.priority; });
+  return usage;
+}
+
+bool MemoryGovernor::reserve(Account &account, size_t bytes)
+{
+  if(d->admit(bytes))
+    return true;
+  vector<shared_ptr<Reclaimer::Registration>> reclaimers;
+  {
+    QMutexLocker lock(&d->mutex);
+    for(const auto &registration: d->reclaimers)
+      if(registration->account.priority < account.priority)
+        reclaimers.push_back(registration);
+  }
+  stable_sort(reclaimers.begin(), reclaimers.end(), [](const shared_ptr<Reclaimer::Registration> &a, const shared_ptr<Reclaimer::Registration> &b) {
+    return a->account.priority < b->account.priority;
+  });
+  for(const auto &registration: reclaimers) {
+    const size_t limit = d->budget, used = d->used;
+    if(limit == 0 || used + bytes <= limit) {
+      if(d->admit(bytes))
+        return true;
+      continue;
+    }
+    QMutexLocker lock(&registration->mutex);
+    if(! registration->reclaim)
+      continue;
+    auto &reclaimed = registration->account;
+    const size_t before = reclaimed.current();
+    registration->reclaim(used + bytes - limit);
+    const size_t after = reclaimed.current();
+    if(after < before)
+      reclaimed.reclaimed_metric.add(before - after);
+    if(d->admit(bytes))
+      return true;
+  }
+  if(d->admit(bytes))
+    return true;
+  account.refused_metric.add();
+  return false;
+}
+
+MemoryGovernor::Account::Account(MemoryGovernor &governor, const QString &name, Priority priority)
+  : name{name}, priority{priority}, governor(governor),
+  current_metric(Metrics::instance().gauge("memory_bytes", "Memory held by each subsystem, as charged to the process budget", "subsystem=\"%1\""_q % name)),
+  peak_metric(Metrics::instance().gauge("memory_peak_bytes", "Highest memory held by each subsystem", "subsystem=\"%1\""_q % name)),
+  refused_metric(Metrics::instance().counter("memory_refused_total", "Reservations refused by the process memory budget", "subsystem=\"%1\""_q % name)),
+  reclaimed_metric(Metrics::instance().counter("memory_reclaimed_bytes_total", "Bytes each subsystem gave back for higher priority ones", "subsystem=\"%1\""_q % name))
+{
+}
+
+void MemoryGovernor::Account::charged(size_t bytes)
+{
+  const size_t current = _current.fetch_add(bytes, memory_order_relaxed) + bytes;
+  current_metric.set(static_cast<qint64>(current));
+  size_t peak = _peak.load(memory_order_relaxed);
+  while(current > peak && ! _peak.compare_exchange_weak(peak, current, memory_order_relaxed));
+  if(current > peak)
+    peak_metric.set(static_cast<qint64>(current));
+}
+
+bool MemoryGovernor::Account::reserve(size_t bytes)
+{
+  if(! governor.reserve(*this, bytes))
+    return false;
+  charged(bytes);
+  return true;
+}
+
+void MemoryGovernor::Account::charge(size_t bytes)
+{
+  governor.d->add_used(bytes);
+  charged(bytes);
+}
+
+void MemoryGovernor::Account::release(size_t bytes)
+{
+  governor.d->remove_used(bytes);
+  current_metric.set(static_cast<qint64>(_current.fetch_sub(bytes, memory_order_relaxed) - bytes));
+}
+
+bool MemoryGovernor::Account::fits(size_t bytes)
+{
+  if(! governor.reserve(*this, bytes))
+    return false;
+  governor.d->remove_used(bytes);
+  return true;
+}
+
+MemoryGovernor::Reclaimer::Reclaimer(Account &account, const Reclaim &reclaim)
+  : registration{make_shared<Registration>(account, reclaim)}
+{
+  auto &governor = account.governor;
+  QMutexLocker lock(&governor.d->mutex);
+  governor.d->reclaimers.push_back(registration);
+}
+
+MemoryGovernor::Reclaimer::~Reclaimer()
+{
+  auto &governor = registration->account.governor;
+  {
+    QMutexLocker lock(&governor.d->mutex);
+    auto &reclaimers = governor.d->reclaimers;
+    reclaimers.erase(remove(reclaimers.begin(), reclaimers.end(), registration), reclaimers.end());
+  }
+  // A reservation may have picked it up just before: wait for it to finish
+  QMutexLocker lock(&registration->mutex);
+  registration->reclaim = nullptr;
+}
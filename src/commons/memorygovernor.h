@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <QString>
+#include <QList>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "c++/dptr.h"
+#include "commons/metrics.h"
+
+/**
+ * Process wide memory budget, shared by the subsystems holding frames (pool, queues, pre-trigger ring, network send buffers).
+ * Each subsystem charges what it holds to an account; when a reservation doesn't fit the budget, the governor asks the accounts
+ * of lower priority to give memory back, lowest first, before refusing it: previews go first, the recording last.
+ * Usage and peaks of every account are published as the memory_bytes and memory_peak_bytes metrics, by subsystem, with the
+ * reservations refused (memory_refused_total) and the bytes given back on request (memory_reclaimed_bytes_total).
+ * A frame held by two subsystems is charged to both: the budget errs on the safe side.
+ */
+class MemoryGovernor
+{
+public:
+  /// Reclamation order, first to last
+  enum Priority {
+    Cache,      ///< Memory kept only to be reused (free pool buffers)
+    Preview,    ///< Browser and remote previews
+    Analysis,   ///< Focus assist, auto exposure, flash detection
+    Display,
+    Network,    ///< Frames forwarded to clients, and their send buffers
+    PreTrigger, ///< Frames waiting for a trigger
+    Recording,
+  };
+
+  /// Called to give back at least bytes, if possible; memory freed must be released from the account as usual
+  typedef std::function<void(std::size_t bytes)> Reclaim;
+
+  class Account {
+  public:
+    const QString name;
+    const Priority priority;
+    /**
+     * Charges bytes if they fit the budget, reclaiming from the accounts with a lower priority if needed.
+     * Callers may hold their own locks: only lower priority reclaimers run, so locks are always taken in priority order.
+     */
+    bool reserve(std::size_t bytes);
+    /// Charges bytes whether or not they fit, for memory already taken (i.e. by a socket)
+    void charge(std::size_t bytes);
+    void release(std::size_t bytes);
+    /// Whether a reservation of bytes would succeed now, reclaiming as reserve() does, without charging anything
+    bool fits(std::size_t bytes);
+    std::size_t current() const { return _current.load(std::memory_order_relaxed); }
+    /// Highest current() so far
+    std::size_t peak() const { return _peak.load(std::memory_order_relaxed); }
+  private:
+    friend class MemoryGovernor;
+    Account(MemoryGovernor &governor, const QString &name, Priority priority);
+    MemoryGovernor &governor;
+    std::atomic<std::size_t> _current{0};
+    std::atomic<std::size_t> _peak{0};
+    Metrics::Gauge &current_metric;
+    Metrics::Gauge &peak_metric;
+    Metrics::Counter &refused_metric;
+    Metrics::Counter &reclaimed_metric;
+    void charged(std::size_t bytes);
+  };
+
+  /**
+   * Registration of a reclaimer for an account, until destroyed. Reclaimers run on the thread of the reservation that needs the memory.
+   * Destruction waits for a running reclaimer: don't destroy it with a lock the reclaimer takes held.
+   */
+  class Reclaimer {
+  public:
+    Reclaimer(Account &account, const Reclaim &reclaim);
+    ~Reclaimer();
+    struct Registration;
+  private:
+    std::shared_ptr<Registration> registration;
+  };
+
+  /// The governor of the application, shared with the drivers it loads
+  static MemoryGovernor &instance();
+  /// Process budget in bytes; 0 for no budget, where reservations always succeed
+  void set_budget(std::size_t bytes);
+  std::size_t budget() const;
+  /// Bytes charged to all the accounts
+  std::size_t used() const;
+  /// The account of a subsystem, created on first use and living as long as the process
+  Account &account(const QString &name, Priority priority);
+
+  struct Usage {
+    QString name;
+    Priority priority;
+    std::size_t current;
+    std::size_t peak;
+  };
+  /// Every account, by priority
+  QList<Usage> usage() const;
+private:
+  MemoryGovernor();
+  ~MemoryGovernor();
+  bool reserve(Account &account, std::size_t bytes);
+  DPTR
+};
+
+#endif // MEMORYGOVERNOR_H
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "metrics.h"
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QCoreApplication>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+constexpr int Metrics::Histogram::SUB_BUCKET_BITS;
+constexpr int Metrics::Histogram::SUB_BUCKETS;
+constexpr int Metrics::Histogram::MAX_VALUE_BITS;
+constexpr int Metrics::Histogram::BUCKETS;
+
+DPTR_IMPL(Metrics) {
+  struct Entry {
+    QString name;
+    QString labels;
+    QString help;
+    shared_ptr<Counter> counter;
+    shared_ptr<Gauge> gauge;
+    shared_ptr<Histogram> histogram;
+  };
+  mutable QMutex mutex;
+  // Keyed by name, then labels, so that snapshots come out grouped by family
+  QMap<QPair<QString, QString>, Entry> entries;
+  Entry &entry(const QString &name, const QString &help, const QString &labels);
+};
+
+namespace {
+int most_significant_bit(quint64 value) {
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(value);
+#else
+  int bit = 0;
+  while(value >>= 1)
+    ++bit;
+  return bit;
+#endif
+}
+}
+
+Metrics::Histogram::Histogram()
+{
+  for(auto &bucket: _buckets)
+    bucket.store(0, memory_order_relaxed);
+}
+
+int Metrics::Histogram::bucket(quint64 value_us)
+{
+  value_us = min<quint64>(value_us, (quint64{1} << MAX_VALUE_BITS) - 1);
+  if(value_us < SUB_BUCKETS)
+    return static_cast<int>(value_us);
+  int shift = most_significant_bit(value_us) - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + static_cast<int>((value_us >> shift) - SUB_BUCKETS);
+}
+
+quint64 Metrics::Histogram::bucket_upper_bound(int bucket)
+{
+  if(bucket < SUB_BUCKETS)
+    return bucket;
+  int shift = bucket / SUB_BUCKETS - 1;
+  quint64 lower = static_cast<quint64>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return lower + (quint64{1} << shift) - 1;
+}
+
+void Metrics::Histogram::record(const Duration &duration)
+{
+  quint64 value = static_cast<quint64>(max<Duration::rep>(duration.count(), 0));
+  _buckets[bucket(value)].fetch_add(1, memory_order_relaxed);
+  _count.fetch_add(1, memory_order_relaxed);
+  _sum_us.fetch_add(value, memory_order_relaxed);
+  auto current_max = _max_us.load(memory_order_relaxed);
+  while(value > current_max && ! _max_us.compare_exchange_weak(current_max, value, memory_order_relaxed));
+}
+
+Metrics::Histogram::Snapshot Metrics::Histogram::snapshot() const
+{
+  Snapshot snapshot;
+  snapshot.buckets.resize(BUCKETS);
+  // Buckets are read one at a time while recording goes on: count is taken from them, so that the two agree
+  for(int i = 0; i < BUCKETS; i++) {
+    snapshot.buckets[i] = _buckets[i].load(memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum_us = _sum_us.load(memory_order_relaxed);
+  snapshot.max_us = _max_us.load(memory_order_relaxed);
+  return snapshot;
+}
+
+quint64 Metrics::Histogram::Snapshot::percentile_us(double fraction) const
+{
+  if(count == 0)
+    return 0;
+  auto target = max<quint64>(1, static_cast<quint64>(ceil(fraction * count)));
+  quint64 seen = 0;
+  for(size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if(seen >= target)
+      return min(bucket_upper_bound(static_cast<int>(i)), max_us);
+  }
+  return max_us;
+}
+
+quint64 Metrics::Histogram::Snapshot::count_below(quint64 value_us) const
+{
+  quint64 below = 0;
+  for(size_t i = 0; i < buckets.size() && bucket_upper_bound(static_cast<int>(i)) <= value_us; i++)
+    below += buckets[i];
+  return below;
+}
+
+Metrics::Metrics() : dptr()
+{
+}
+
+Metrics::~Metrics()
+{
+}
+
+Metrics &Metrics::instance()
+{
+  // Drivers are plugins, each one with its own copy of this library: they all share the registry of the application loading them
+  static Metrics *metrics = []{
+    auto app = QCoreApplication::instance();
+    if(! app)
+      return new Metrics;
+    auto shared = app->property("planetaryimager_metrics");
+    if(shared.isValid())
+      return reinterpret_cast<Metrics *>(shared.value<quintptr>());
+    auto created = new Metrics;
+    app->setProperty("planetaryimager_metrics", QVariant::fromValue<quintptr>(reinterpret_cast<quintptr>(created)));
+    return created;
+  }();
+  return *metrics;
+}
+
+Metrics::Private::Entry &Metrics::Private::entry(const QString &name, const QString &help, const QString &labels)
+{
+  auto key = qMakePair(name, labels);
+  auto it = entries.find(key);
+  if(it == entries.end())
+    it = entries.insert(key, {name, labels, help, {}, {}, {}});
+  return it.value();
+}
+
+Metrics::Counter &Metrics::counter(const QString &name, const QString &help, const QString &labels)
+{
+  QMutexLocker lock(&d->mutex);
+  auto &entry = d->entry(name, help, labels);
+  if(! entry.counter)
+    entry.counter = make_shared<Counter>();
+  return *entry.counter;
+}
+
+Metrics::Gauge &Metrics::gauge(const QString &name, const QString &help, const QString &labels)
+{
+  QMutexLocker lock(&d->mutex);
+  auto &entry = d->entry(name, help, labels);
+  if(! entry.gauge)
+    entry.gauge = make_shared<Gauge>();
+  return *entry.gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(const QString &name, const QString &help, const QString &labels)
+{
+  QMutexLocker lock(&d->mutex);
+  auto &entry = d->entry(name, help, labels);
+  if(! entry.histogram)
+    entry.histogram = make_shared<Histogram>();
+  return *entry.histogram;
+}
+
+vector<quint64> Metrics::bucket_bounds_us()
+{
+  return {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+}
+
+QVariantList Metrics::snapshot() const
+{
+  QVariantList metrics;
+  QMutexLocker lock(&d->mutex);
+  for(const auto &entry: d->entries) {
+    QVariantMap metric{
+      {"name", entry.name},
+      {"labels", entry.labels},
+      {"help", entry.help},
+    };
+    if(entry.counter) {
+      metric["type"] = "counter";
+      metric["value"] = entry.counter->value();
+    } else if(entry.gauge) {
+      metric["type"] = "gauge";
+      metric["value"] = entry.gauge->value();
+    } else if(entry.histogram) {
+      auto histogram = entry.histogram->snapshot();
+      QVariantList buckets;
+      for(auto bound: bucket_bounds_us())
+        buckets.push_back(histogram.count_below(bound));
+      metric["type"] = "histogram";
+      metric["count"] = histogram.count;
+      metric["sum_us"] = histogram.sum_us;
+      metric["max_us"] = histogram.max_us;
+      metric["p50_us"] = histogram.percentile_us(0.5);
+      metric["p90_us"] = histogram.percentile_us(0.9);
+      metric["p99_us"] = histogram.percentile_us(0.99);
+      metric["p999_us"] = histogram.percentile_us(0.999);
+      metric["buckets"] = buckets;
+    }
+    metrics.push_back(metric);
+  }
+  return metrics;
+}
+
+QByteArray Metrics::exposition(const QVariantList &snapshot)
+{
+  QByteArray text;
+  QTextStream stream(&text);
+  auto seconds = [](const QVariant &us) { return QString::number(us.toULongLong() / 1e6, 'g', 9); };
+  auto with_labels = [](const QString &labels, const QString &extra = {}) {
+    QStringList all;
+    for(auto label: {labels, extra})
+      if(! label.isEmpty())
+        all.push_back(label);
+    return all.isEmpty() ? QString{} : "{%1}"_q % all.join(',');
+  };
+  // Each family once, with all of its series, whatever the snapshot order (i.e. merged from more sources)
+  QStringList families;
+  QHash<QString, QList<QVariantMap>> series;
+  for(const auto &variant: snapshot) {
+    auto metric = variant.toMap();
+    auto name = metric["name"].toString();
+    if(! series.contains(name))
+      families.push_back(name);
+    series[name].push_back(metric);
+  }
+  for(const auto &name: families) {
+    const auto &first = series[name].first();
+    stream << "# HELP " << name << " " << first["help"].toString() << "\n";
+    stream << "# TYPE " << name << " " << first["type"].toString() << "\n";
+    for(const auto &metric: series[name]) {
+      auto labels = metric["labels"].toString();
+      auto type = metric["type"].toString();
+      if(type == "histogram") {
+        auto bounds = bucket_bounds_us();
+        auto buckets = metric["buckets"].toList();
+        for(size_t i = 0; i < bounds.size() && static_cast<int>(i) < buckets.size(); i++)
+          stream << name << "_bucket" << with_labels(labels, "le=\"%1\""_q % seconds(bounds[i])) << " " << buckets[i].toULongLong() << "\n";
+        stream << name << "_bucket" << with_labels(labels, "le=\"+Inf\"") << " " << metric["count"].toULongLong() << "\n";
+        stream << name << "_sum" << with_labels(labels) << " " << seconds(metric["sum_us"]) << "\n";
+        stream << name << "_count" << with_labels(labels) << " " << metric["count"].toULongLong() << "\n";
+      } else {
+        stream << name << with_labels(labels) << " " << metric["value"].toString() << "\n";
+      }
+    }
+  }
+  stream.flush();
+  return text;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVariantList>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <vector>
+#include "c++/dptr.h"
+
+/**
+ * Process wide registry of pipeline counters, gauges and latency histograms.
+ * Metrics are created on first use and live as long as the process, so hot paths look them up once and keep the reference.
+ * Updating a metric is lock free: only registration and snapshots take a lock.
+ * Names follow the Prometheus conventions: snake_case, counters ending in _total, histograms in _seconds.
+ */
+class Metrics
+{
+public:
+  class Counter {
+  public:
+    void add(quint64 amount = 1) { _value.fetch_add(amount, std::memory_order_relaxed); }
+    quint64 value() const { return _value.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<quint64> _value{0};
+  };
+
+  class Gauge {
+  public:
+    void set(qint64 value) { _value.store(value, std::memory_order_relaxed); }
+    void add(qint64 amount) { _value.fetch_add(amount, std::memory_order_relaxed); }
+    qint64 value() const { return _value.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<qint64> _value{0};
+  };
+
+  /**
+   * Latency histogram with log-linear buckets, HDR style: values up to 15us are exact,
+   * larger ones keep 4 significant bits (about 6% precision), up to roughly 25 days.
+   */
+  class Histogram {
+  public:
+    typedef std::chrono::microseconds Duration;
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_VALUE_BITS = 41;
+    static constexpr int BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    struct Snapshot {
+      quint64 count = 0;
+      quint64 sum_us = 0;
+      quint64 max_us = 0;
+      std::vector<quint64> buckets;
+      /// Highest value of the bucket reaching the given fraction (0-1) of the recorded values; never above max_us
+      quint64 percentile_us(double fraction) const;
+      /// Recorded values not above value_us, to the bucket precision
+      quint64 count_below(quint64 value_us) const;
+    };
+    Histogram();
+    void record(const Duration &duration);
+    Snapshot snapshot() const;
+    static int bucket(quint64 value_us);
+    /// Highest value falling in bucket
+    static quint64 bucket_upper_bound(int bucket);
+  private:
+    std::array<std::atomic<quint64>, BUCKETS> _buckets;
+    std::atomic<quint64> _count{0};
+    std::atomic<quint64> _sum_us{0};
+    std::atomic<quint64> _max_us{0};
+  };
+
+  /// Records the time elapsed from construction to destruction
+  class Timer {
+  public:
+    Timer(Histogram &histogram) : histogram(histogram), started{std::chrono::steady_clock::now()} {}
+    ~Timer() { histogram.record(std::chrono::duration_cast<Histogram::Duration>(std::chrono::steady_clock::now() - started)); }
+  private:
+    Histogram &histogram;
+    const std::chrono::steady_clock::time_point started;
+  };
+
+  /// The registry of the application, shared with the drivers it loads
+  static Metrics &instance();
+  /**
+   * Returns the metric, creating it on first use.
+   * labels are in the exposition form (i.e. consumer="network"): metrics sharing a name with different labels are a single family.
+   */
+  Counter &counter(const QString &name, const QString &help, const QString &labels = {});
+  Gauge &gauge(const QString &name, const QString &help, const QString &labels = {});
+  Histogram &histogram(const QString &name, const QString &help, const QString &labels = {});
+
+  /**
+   * All the metrics, sorted by name, as maps with "name", "labels", "help" and "type" ("counter", "gauge" or "histogram").
+   * Counters and gauges have a "value"; histograms have "count", "sum_us", "max_us", "p50_us", "p90_us", "p99_us", "p999_us",
+   * and "buckets", the cumulative counts for each of bucket_bounds_us().
+   */
+  QVariantList snapshot() const;
+  /// Upper bounds of the histogram buckets in snapshots and in the text exposition
+  static std::vector<quint64> bucket_bounds_us();
+  /// Snapshot in the Prometheus text exposition format (version 0.0.4), which OpenMetrics scrapers also accept
+  static QByteArray exposition(const QVariantList &snapshot);
+private:
+  Metrics();
+  ~Metrics();
+  DPTR
+};
+
+#endif // METRICS_H
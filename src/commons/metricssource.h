@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICSSOURCE_H
+#define METRICSSOURCE_H
+#include <QObject>
+#include <QVariantList>
+#include "commons/fwd.h"
+
+FWD_PTR(MetricsSource)
+
+/// Where the diagnostics panel gets the metrics from: this process, or the server of a remote session
+class MetricsSource : public QObject
+{
+  Q_OBJECT
+public:
+  virtual bool isLocal() const = 0;
+public slots:
+  /// Asks for a new snapshot, emitted with metrics() (possibly later, for remote sources)
+  virtual void refresh() = 0;
+signals:
+  void metrics(const QVariantList &snapshot);
+};
+
+class LocalMetricsSource : public MetricsSource
+{
+  Q_OBJECT
+public:
+  bool isLocal() const override { return true; }
+public slots:
+  void refresh() override;
+};
+
+#endif // METRICSSOURCE_H
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "modules.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLibrary>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <memory>
+
+using namespace std;
+
+DPTR_IMPL(Modules) {
+  QStringList directories;
+  mutable QMutex mutex;
+  QMap<QString, shared_ptr<QLibrary>> libraries;
+  QString find(const QString &module) const;
+};
+
+QString Modules::Private::find(const QString &module) const
+{
+  for(const auto &directory: directories) {
+    for(const auto &entry: QDir{directory}.entryInfoList(QDir::Files)) {
+      if(entry.baseName() == module && QLibrary::isLibrary(entry.fileName()))
+        return entry.absoluteFilePath();
+    }
+  }
+  return {};
+}
+
+Modules::Modules() : dptr()
+{
+}
+
+Modules::~Modules()
+{
+}
+
+Modules &Modules::instance()
+{
+  static Modules modules;
+  return modules;
+}
+
+void Modules::set_directories(const QStringList &directories)
+{
+  QMutexLocker lock(&d->mutex);
+  d->directories = directories;
+}
+
+QFunctionPointer Modules::resolve(const QString &module, const char *symbol)
+{
+  QMutexLocker lock(&d->mutex);
+  auto library = d->libraries.value(module);
+  if(! library) {
+    const QString path = d->find(module);
+    if(path.isEmpty()) {
+      qWarning() << "[ERR] Module" << module << "not found in" << d->directories;
+      return nullptr;
+    }
+    qDebug() << "Loading module" << path;
+    library = make_shared<QLibrary>(path);
+    if(! library->load()) {
+      qWarning() << "[ERR] Error loading module" << path << ":" << library->errorString();
+      return nullptr;
+    }
+    d->libraries[module] = library;
+  }
+  auto function = library->resolve(symbol);
+  if(! function)
+    qWarning() << "[ERR] Module" << module << "has no" << symbol << ":" << library->errorString();
+  return function;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MODULES_H
+#define MODULES_H
+
+#include <QStringList>
+#include "c++/dptr.h"
+
+/**
+ * Optional parts of the application (i.e. writers for formats other than SER) packaged as libraries of their own, like drivers.
+ * A module is looked for and loaded the first time one of its symbols is needed, so that a daemon that never uses it
+ * doesn't pay for its code and dependencies. Loaded modules stay loaded until the process exits.
+ */
+class Modules
+{
+public:
+  static Modules &instance();
+  /// Where modules are looked for, in order; set at startup, before any module is needed
+  void set_directories(const QStringList &directories);
+  /// symbol from module (library base name, i.e. "module_video_writer"), loading it on first use; nullptr if the module or symbol is missing
+  QFunctionPointer resolve(const QString &module, const char *symbol);
+private:
+  Modules();
+  ~Modules();
+  DPTR
+};
+
+#endif // MODULES_H
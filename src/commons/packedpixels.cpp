@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "packedpixels.h"
+#include "commons/pixel_kernels.h"
+#include "commons/frame.h"
+#include <boost/endian/conversion.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+
+  // Swapped values go through a buffer this large: a multiple of 4, so that each block packs to whole bytes
+  const size_t swap_block = 4096;
+}
+
+bool PackedPixels::Layout::valid() const
+{
+  return bits == 16 ? shift == 0 : (bits == 10 || bits == 12) && shift + bits <= 16;
+}
+
+uint16_t PackedPixels::Layout::code() const
+{
+  return packed() ? static_cast<uint16_t>(bits | shift << 8) : 0;
+}
+
+PackedPixels::Layout PackedPixels::Layout::from_code(uint16_t code)
+{
+  if(code == 0)
+    return {};
+  const Layout layout{static_cast<uint8_t>(code & 0xff), static_cast<uint8_t>(code >> 8)};
+  return layout.valid() && layout.packed() ? layout : Layout{0, 0};
+}
+
+PackedPixels::Layout PackedPixels::layout(const uint16_t *values, size_t count, bool swap)
+{
+  uint16_t used = PixelKernels::used_bits(values, count);
+  if(swap)
+    used = static_cast<uint16_t>((used >> 8) | (used << 8));
+  if(used == 0)
+    return {10, 0};
+  const int lowest = __builtin_ctz(used);
+  const int width = 32 - __builtin_clz(used) - lowest;
+  for(int bits: {10, 12})
+    if(width <= bits)
+      return {static_cast<uint8_t>(bits), static_cast<uint8_t>(min(lowest, 16 - bits))};
+  return {};
+}
+
+size_t PackedPixels::packed_size(size_t count, const Layout &layout)
+{
+  return layout.packed() ? PixelKernels::packed_size(count, layout.bits) : count * sizeof(uint16_t);
+}
+
+void PackedPixels::pack(const uint16_t *source, uint8_t *destination, size_t count, const Layout &layout, bool swap)
+{
+  if(! layout.packed()) {
+    if(swap)
+      PixelKernels::swap16(source, reinterpret_cast<uint16_t*>(destination), count);
+    else
+      memcpy(destination, source, count * sizeof(uint16_t));
+    return;
+  }
+  if(! swap) {
+    PixelKernels::pack(source, destination, count, layout.bits, layout.shift);
+    return;
+  }
+  uint16_t native[swap_block];
+  for(size_t i = 0; i < count; i += swap_block) {
+    const size_t block = min(swap_block, count - i);
+    PixelKernels::swap16(source + i, native, block);
+    PixelKernels::pack(native, destination, block, layout.bits, layout.shift);
+    destination += PixelKernels::packed_size(block, layout.bits);
+  }
+}
+
+void PackedPixels::unpack(const uint8_t *source, uint16_t *destination, size_t count, const Layout &layout, bool swap)
+{
+  if(! layout.packed())
+    memcpy(destination, source, count * sizeof(uint16_t));
+  else
+    PixelKernels::unpack(source, destination, count, layout.bits, layout.shift);
+  if(swap)
+    PixelKernels::swap16(destination, destination, count);
+}
+
+PackedPixels::Layout PackedPixels::layout(const Frame &frame)
+{
+  if(frame.bpp() != 16 || ! frame.mat().isContinuous())
+    return {};
+  return layout(reinterpret_cast<const uint16_t*>(frame.mat().data), frame.size() / sizeof(uint16_t), needs_swap(frame));
+}
+
+QByteArray PackedPixels::pack(const Frame &frame, const Layout &layout)
+{
+  if(! layout.packed())
+    return QByteArray{reinterpret_cast<const char*>(frame.mat().data), static_cast<int>(frame.size())};
+  const size_t count = frame.size() / sizeof(uint16_t);
+  QByteArray packed(static_cast<int>(packed_size(count, layout)), Qt::Uninitialized);
+  // The packed stream holds native values: unpack() swaps them back to the frame byte order
+  pack(reinterpret_cast<const uint16_t*>(frame.mat().data), reinterpret_cast<uint8_t*>(packed.data()), count, layout, needs_swap(frame));
+  return packed;
+}
+
+bool PackedPixels::needs_swap(const Frame &frame)
+{
+  return frame.bpp() == 16 && (native_little_endian ? frame.byteOrder() == Frame::BigEndian : frame.byteOrder() == Frame::LittleEndian);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PACKEDPIXELS_H
+#define PACKEDPIXELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <QByteArray>
+
+class Frame;
+
+/**
+ * 10 and 12 bit sensors send 16 bit values, with 4 or 6 bits always 0: packed, they take 1.25 or 1.5 bytes instead of 2.
+ * The layout is picked from the bits the values actually use, so that packing never loses anything: low aligned (values up to 4095),
+ * high aligned (multiples of 16), or anything in between. Values using more than 12 bits are left as they are.
+ * Packed data is a little endian bit stream (see PixelKernels::pack), whatever the byte order of the values.
+ */
+namespace PackedPixels {
+  struct Layout {
+    /// 10 or 12; 16 for values left unpacked
+    uint8_t bits = 16;
+    /// Right shift before packing, left shift after unpacking
+    uint8_t shift = 0;
+    bool packed() const { return bits < 16; }
+    bool valid() const;
+    /// For file and packet headers: 0 for unpacked values
+    uint16_t code() const;
+    /// An invalid layout for unknown codes
+    static Layout from_code(uint16_t code);
+    bool operator==(const Layout &other) const { return bits == other.bits && shift == other.shift; }
+  };
+  /// Narrowest lossless layout for count values, byte swapped if swap is true
+  Layout layout(const uint16_t *values, std::size_t count, bool swap);
+  /// Bytes taken by count values
+  std::size_t packed_size(std::size_t count, const Layout &layout);
+  /// destination holds packed_size(count, layout) bytes. Values are byte swapped before packing, or after unpacking, if swap is true
+  void pack(const uint16_t *source, uint8_t *destination, std::size_t count, const Layout &layout, bool swap);
+  void unpack(const uint8_t *source, uint16_t *destination, std::size_t count, const Layout &layout, bool swap);
+
+  /// Narrowest lossless layout for the pixels of frame: unpacked for 8 bit frames, or frames with a non continuous matrix
+  Layout layout(const Frame &frame);
+  /// The frame pixels as they are for unpacked layouts
+  QByteArray pack(const Frame &frame, const Layout &layout);
+  /// Whether the frame pixels need swapping to and from the native values packed
+  bool needs_swap(const Frame &frame);
+}
+
+#endif // PACKEDPIXELS_H
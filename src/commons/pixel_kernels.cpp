@@ -0,0 +1,786 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_KERNELS_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_KERNELS_NEON 1
+#endif
+
+using namespace std;
+
+namespace {
+  inline uint16_t swapped(uint16_t value) {
+    return static_cast<uint16_t>((value >> 8) | (value << 8));
+  }
+
+  inline uint8_t rounded_8bit(uint16_t value) {
+    return static_cast<uint8_t>(min<uint32_t>((static_cast<uint32_t>(value) + 128) >> 8, 255));
+  }
+
+  void swap16_scalar(const uint16_t *source, uint16_t *destination, size_t count) {
+    for(size_t i = 0; i < count; i++)
+      destination[i] = swapped(source[i]);
+  }
+
+  // Byte order is a template parameter in the to8bit kernels: each instantiation has a branch free inner loop
+  template<bool Swap> void to8bit_scalar(const uint16_t *source, uint8_t *destination, size_t count) {
+    for(size_t i = 0; i < count; i++)
+      destination[i] = rounded_8bit(Swap ? swapped(source[i]) : source[i]);
+  }
+
+  // Offsets from black, clipped to the range, are scaled in 16 bit lanes: shifted up to use all 16 bits, then multiplied by a gain keeping the high half,
+  // which leaves the 8 bit value with 7 fractional bits for the dither threshold
+  template<bool Swap> void scale8_scalar(const uint16_t *source, uint8_t *destination, size_t count, const PixelKernels::Scale8 &scale, const uint8_t *dither) {
+    for(size_t i = 0; i < count; i++) {
+      const uint16_t value = Swap ? swapped(source[i]) : source[i];
+      const uint32_t offset = min<uint32_t>(value > scale.black ? value - scale.black : 0, scale.range) << scale.shift;
+      destination[i] = static_cast<uint8_t>(min<uint32_t>(((offset * scale.gain >> 16) + (dither[i] >> 1)) >> 7, 255));
+    }
+  }
+
+  size_t background_update_scalar(const float *values, float *mean, float *variance, uint8_t *flags, size_t count, float k2, float min_variance, float alpha) {
+    size_t flagged = 0;
+    for(size_t i = 0; i < count; i++) {
+      const float difference = values[i] - mean[i];
+      const float squared = difference * difference;
+      const bool flag = difference > 0 && squared > k2 * max(variance[i], min_variance);
+      flags[i] = flag ? 255 : 0;
+      flagged += flag;
+      if(!flag) {
+        mean[i] += alpha * difference;
+        variance[i] += alpha * (squared - variance[i]);
+      }
+    }
+    return flagged;
+  }
+
+  template<typename T> void accumulate_scalar(const T *source, uint32_t *sums, size_t count) {
+    for(size_t i = 0; i < count; i++)
+      sums[i] += source[i];
+  }
+
+  void calibrate16_scalar(const uint16_t *source, const uint16_t *dark, const uint16_t *gain, uint16_t *destination, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+      const uint32_t value = source[i] > dark[i] ? source[i] - dark[i] : 0;
+      destination[i] = static_cast<uint16_t>(min<uint32_t>((value * gain[i]) >> PixelKernels::calibration_gain_bits, 65535));
+    }
+  }
+
+  void yuyv_luminance_scalar(const uint8_t *source, uint8_t *destination, size_t count) {
+    for(size_t i = 0; i < count; i++)
+      destination[i] = source[i * 2];
+  }
+
+  uint16_t used_bits_scalar(const uint16_t *source, size_t count) {
+    uint16_t used = 0;
+    for(size_t i = 0; i < count; i++)
+      used |= source[i];
+    return used;
+  }
+
+  // Packed values are a little endian bit stream: every 4 values fill 5 (10 bit) or 6 (12 bit) bytes exactly
+  template<int Bits> void pack_scalar(const uint16_t *source, uint8_t *destination, size_t count, int shift) {
+    const uint32_t mask = (1u << Bits) - 1;
+    uint32_t pending = 0;
+    int pending_bits = 0;
+    for(size_t i = 0; i < count; i++) {
+      pending |= ((source[i] >> shift) & mask) << pending_bits;
+      for(pending_bits += Bits; pending_bits >= 8; pending_bits -= 8, pending >>= 8)
+        *destination++ = static_cast<uint8_t>(pending);
+    }
+    if(pending_bits > 0)
+      *destination = static_cast<uint8_t>(pending);
+  }
+
+  template<int Bits> void unpack_scalar(const uint8_t *source, uint16_t *destination, size_t count, int shift) {
+    const uint32_t mask = (1u << Bits) - 1;
+    uint32_t pending = 0;
+    int pending_bits = 0;
+    for(size_t i = 0; i < count; i++) {
+      for(; pending_bits < Bits; pending_bits += 8)
+        pending |= static_cast<uint32_t>(*source++) << pending_bits;
+      destination[i] = static_cast<uint16_t>((pending & mask) << shift);
+      pending >>= Bits;
+      pending_bits -= Bits;
+    }
+  }
+
+#ifdef PIXEL_KERNELS_X86
+  // SSE2 is part of the x86_64 baseline; on 32 bit x86 it still needs to be enabled for these functions
+  __attribute__((target("sse2"))) void swap16_sse2(const uint16_t *source, uint16_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+      v = _mm_or_si128(_mm_srli_epi16(v, 8), _mm_slli_epi16(v, 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), v);
+    }
+    swap16_scalar(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> __attribute__((target("sse2"))) void to8bit_sse2(const uint16_t *source, uint8_t *destination, size_t count) {
+    const __m128i half = _mm_set1_epi16(128);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+      __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i + 8));
+      if(Swap) {
+        low = _mm_or_si128(_mm_srli_epi16(low, 8), _mm_slli_epi16(low, 8));
+        high = _mm_or_si128(_mm_srli_epi16(high, 8), _mm_slli_epi16(high, 8));
+      }
+      // Saturating add: values close to 65535 round to 255, not to 0
+      low = _mm_srli_epi16(_mm_adds_epu16(low, half), 8);
+      high = _mm_srli_epi16(_mm_adds_epu16(high, half), 8);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(low, high));
+    }
+    to8bit_scalar<Swap>(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> __attribute__((target("sse2"))) __m128i scale8_lanes_sse2(__m128i value, const __m128i &black, const __m128i &range, const __m128i &shift, const __m128i &gain, const __m128i &threshold) {
+    if(Swap)
+      value = _mm_or_si128(_mm_srli_epi16(value, 8), _mm_slli_epi16(value, 8));
+    value = _mm_subs_epu16(value, black);
+    // Unsigned minimum without SSE4.1: a - max(a - b, 0)
+    value = _mm_sub_epi16(value, _mm_subs_epu16(value, range));
+    value = _mm_mulhi_epu16(_mm_sll_epi16(value, shift), gain);
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(threshold, 1)), 7);
+  }
+
+  template<bool Swap> __attribute__((target("sse2"))) void scale8_sse2(const uint16_t *source, uint8_t *destination, size_t count, const PixelKernels::Scale8 &scale, const uint8_t *dither) {
+    const __m128i black = _mm_set1_epi16(scale.black), range = _mm_set1_epi16(scale.range), gain = _mm_set1_epi16(scale.gain);
+    const __m128i shift = _mm_cvtsi32_si128(scale.shift), zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      const __m128i thresholds = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dither + i));
+      const __m128i low = scale8_lanes_sse2<Swap>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)), black, range, shift, gain, _mm_unpacklo_epi8(thresholds, zero));
+      const __m128i high = scale8_lanes_sse2<Swap>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i + 8)), black, range, shift, gain, _mm_unpackhi_epi8(thresholds, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(low, high));
+    }
+    scale8_scalar<Swap>(source + i, destination + i, count - i, scale, dither + i);
+  }
+
+  __attribute__((target("sse2"))) size_t background_update_sse2(const float *values, float *mean, float *variance, uint8_t *flags, size_t count, float k2, float min_variance, float alpha) {
+    const __m128 k = _mm_set1_ps(k2), floor = _mm_set1_ps(min_variance), weight = _mm_set1_ps(alpha), zero = _mm_setzero_ps();
+    size_t flagged = 0, i = 0;
+    for(; i + 4 <= count; i += 4) {
+      const __m128 value = _mm_loadu_ps(values + i), m = _mm_loadu_ps(mean + i), v = _mm_loadu_ps(variance + i);
+      const __m128 difference = _mm_sub_ps(value, m), squared = _mm_mul_ps(difference, difference);
+      const __m128 flag = _mm_and_ps(_mm_cmpgt_ps(difference, zero), _mm_cmpgt_ps(squared, _mm_mul_ps(k, _mm_max_ps(v, floor))));
+      // Flagged values get a zero weight instead of a branch
+      const __m128 step = _mm_andnot_ps(flag, weight);
+      _mm_storeu_ps(mean + i, _mm_add_ps(m, _mm_mul_ps(step, difference)));
+      _mm_storeu_ps(variance + i, _mm_add_ps(v, _mm_mul_ps(step, _mm_sub_ps(squared, v))));
+      // All ones lanes narrow to 0xff bytes
+      __m128i bytes = _mm_castps_si128(flag);
+      bytes = _mm_packs_epi16(_mm_packs_epi32(bytes, bytes), bytes);
+      const int32_t packed = _mm_cvtsi128_si32(bytes);
+      memcpy(flags + i, &packed, 4);
+      flagged += __builtin_popcount(_mm_movemask_ps(flag));
+    }
+    return flagged + background_update_scalar(values + i, mean + i, variance + i, flags + i, count - i, k2, min_variance, alpha);
+  }
+
+  __attribute__((target("sse2"))) void accumulate8_sse2(const uint8_t *source, uint32_t *sums, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+      const __m128i low = _mm_unpacklo_epi8(v, zero), high = _mm_unpackhi_epi8(v, zero);
+      const __m128i parts[4] = {_mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero), _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)};
+      for(int part = 0; part < 4; part++) {
+        __m128i *sum = reinterpret_cast<__m128i*>(sums + i + 4 * part);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), parts[part]));
+      }
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  __attribute__((target("sse2"))) void accumulate16_sse2(const uint16_t *source, uint32_t *sums, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+      __m128i *low = reinterpret_cast<__m128i*>(sums + i), *high = reinterpret_cast<__m128i*>(sums + i + 4);
+      _mm_storeu_si128(low, _mm_add_epi32(_mm_loadu_si128(low), _mm_unpacklo_epi16(v, zero)));
+      _mm_storeu_si128(high, _mm_add_epi32(_mm_loadu_si128(high), _mm_unpackhi_epi16(v, zero)));
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  // The 32 bit products are never unpacked: (high << 16 | low) >> bits is rebuilt from the two 16 bit halves, and saturated when high >> bits isn't 0
+  __attribute__((target("sse2"))) void calibrate16_sse2(const uint16_t *source, const uint16_t *dark, const uint16_t *gain, uint16_t *destination, size_t count) {
+    const __m128i zero = _mm_setzero_si128(), saturated = _mm_set1_epi16(-1);
+    const int bits = PixelKernels::calibration_gain_bits;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const __m128i value = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(dark + i)));
+      const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gain + i));
+      const __m128i low = _mm_mullo_epi16(value, g), high = _mm_mulhi_epu16(value, g);
+      const __m128i result = _mm_or_si128(_mm_slli_epi16(high, 16 - bits), _mm_srli_epi16(low, bits));
+      const __m128i in_range = _mm_cmpeq_epi16(_mm_srli_epi16(high, bits), zero);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_or_si128(result, _mm_andnot_si128(in_range, saturated)));
+    }
+    calibrate16_scalar(source + i, dark + i, gain + i, destination + i, count - i);
+  }
+
+  __attribute__((target("avx2"))) void swap16_avx2(const uint16_t *source, uint16_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+      v = _mm256_or_si256(_mm256_srli_epi16(v, 8), _mm256_slli_epi16(v, 8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), v);
+    }
+    swap16_scalar(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> __attribute__((target("avx2"))) void to8bit_avx2(const uint16_t *source, uint8_t *destination, size_t count) {
+    const __m256i half = _mm256_set1_epi16(128);
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32) {
+      __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+      __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i + 16));
+      if(Swap) {
+        low = _mm256_or_si256(_mm256_srli_epi16(low, 8), _mm256_slli_epi16(low, 8));
+        high = _mm256_or_si256(_mm256_srli_epi16(high, 8), _mm256_slli_epi16(high, 8));
+      }
+      low = _mm256_srli_epi16(_mm256_adds_epu16(low, half), 8);
+      high = _mm256_srli_epi16(_mm256_adds_epu16(high, half), 8);
+      // packus works on 128 bit lanes: restore the original order afterwards
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), packed);
+    }
+    to8bit_scalar<Swap>(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> __attribute__((target("avx2"))) __m256i scale8_lanes_avx2(__m256i value, const __m256i &black, const __m256i &range, const __m128i &shift, const __m256i &gain, const __m256i &threshold) {
+    if(Swap)
+      value = _mm256_or_si256(_mm256_srli_epi16(value, 8), _mm256_slli_epi16(value, 8));
+    value = _mm256_min_epu16(_mm256_subs_epu16(value, black), range);
+    value = _mm256_mulhi_epu16(_mm256_sll_epi16(value, shift), gain);
+    return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(threshold, 1)), 7);
+  }
+
+  template<bool Swap> __attribute__((target("avx2"))) void scale8_avx2(const uint16_t *source, uint8_t *destination, size_t count, const PixelKernels::Scale8 &scale, const uint8_t *dither) {
+    const __m256i black = _mm256_set1_epi16(scale.black), range = _mm256_set1_epi16(scale.range), gain = _mm256_set1_epi16(scale.gain);
+    const __m128i shift = _mm_cvtsi32_si128(scale.shift);
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32) {
+      const __m256i low_thresholds = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dither + i)));
+      const __m256i high_thresholds = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dither + i + 16)));
+      const __m256i low = scale8_lanes_avx2<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i)), black, range, shift, gain, low_thresholds);
+      const __m256i high = scale8_lanes_avx2<Swap>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i + 16)), black, range, shift, gain, high_thresholds);
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), packed);
+    }
+    scale8_scalar<Swap>(source + i, destination + i, count - i, scale, dither + i);
+  }
+
+  __attribute__((target("avx2"))) void accumulate8_avx2(const uint8_t *source, uint32_t *sums, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i)));
+      __m256i *sum = reinterpret_cast<__m256i*>(sums + i);
+      _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum), v));
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  __attribute__((target("avx2"))) void accumulate16_avx2(const uint16_t *source, uint32_t *sums, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+      __m256i *sum = reinterpret_cast<__m256i*>(sums + i);
+      _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum), v));
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  __attribute__((target("avx2"))) void calibrate16_avx2(const uint16_t *source, const uint16_t *dark, const uint16_t *gain, uint16_t *destination, size_t count) {
+    const __m256i zero = _mm256_setzero_si256(), saturated = _mm256_set1_epi16(-1);
+    const int bits = PixelKernels::calibration_gain_bits;
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      const __m256i value = _mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dark + i)));
+      const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gain + i));
+      const __m256i low = _mm256_mullo_epi16(value, g), high = _mm256_mulhi_epu16(value, g);
+      const __m256i result = _mm256_or_si256(_mm256_slli_epi16(high, 16 - bits), _mm256_srli_epi16(low, bits));
+      const __m256i in_range = _mm256_cmpeq_epi16(_mm256_srli_epi16(high, bits), zero);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_or_si256(result, _mm256_andnot_si256(in_range, saturated)));
+    }
+    calibrate16_scalar(source + i, dark + i, gain + i, destination + i, count - i);
+  }
+
+  __attribute__((target("sse2"))) void yuyv_luminance_sse2(const uint8_t *source, uint8_t *destination, size_t count) {
+    const __m128i luminance = _mm_set1_epi16(0x00ff);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      const __m128i low = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 2)), luminance);
+      const __m128i high = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 2 + 16)), luminance);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(low, high));
+    }
+    yuyv_luminance_scalar(source + i * 2, destination + i, count - i);
+  }
+
+  __attribute__((target("avx2"))) void yuyv_luminance_avx2(const uint8_t *source, uint8_t *destination, size_t count) {
+    const __m256i luminance = _mm256_set1_epi16(0x00ff);
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32) {
+      const __m256i low = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i * 2)), luminance);
+      const __m256i high = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i * 2 + 32)), luminance);
+      // packus works on 128 bit lanes: put the quarters back in order
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8));
+    }
+    yuyv_luminance_sse2(source + i * 2, destination + i, count - i);
+  }
+
+  __attribute__((target("sse2"))) uint16_t or_lanes_sse2(__m128i used) {
+    used = _mm_or_si128(used, _mm_srli_si128(used, 8));
+    used = _mm_or_si128(used, _mm_srli_si128(used, 4));
+    used = _mm_or_si128(used, _mm_srli_si128(used, 2));
+    return static_cast<uint16_t>(_mm_cvtsi128_si32(used));
+  }
+
+  __attribute__((target("sse2"))) uint16_t used_bits_sse2(const uint16_t *source, size_t count) {
+    __m128i used = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+      used = _mm_or_si128(used, _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+    return or_lanes_sse2(used) | used_bits_scalar(source + i, count - i);
+  }
+
+  __attribute__((target("avx2"))) uint16_t used_bits_avx2(const uint16_t *source, size_t count) {
+    __m256i used = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+      used = _mm256_or_si256(used, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i)));
+    return or_lanes_sse2(_mm_or_si128(_mm256_castsi256_si128(used), _mm256_extracti128_si256(used, 1))) | used_bits_sse2(source + i, count - i);
+  }
+
+  // Values mask in each of the four 16 bit lanes of a 64 bit group: lane k moves from bit 16k to bit Bits·k, so that a group
+  // of four packed values takes the Bits / 2 low bytes of its 64 bits, gathered (or scattered back) with a byte shuffle
+  template<int Bits> struct PackLanes {
+    static const int group_bytes = Bits / 2;
+    __m128i masks[4];
+    __m128i gather, scatter;
+    __attribute__((target("ssse3"))) PackLanes() {
+      for(int lane = 0; lane < 4; lane++)
+        masks[lane] = _mm_set1_epi64x(static_cast<long long>((1ull << Bits) - 1) << (16 * lane));
+      alignas(16) int8_t gather_order[16], scatter_order[16];
+      for(int byte = 0; byte < 16; byte++) {
+        gather_order[byte] = byte < group_bytes ? byte : byte < 2 * group_bytes ? 8 + byte - group_bytes : -1;
+        scatter_order[byte] = byte % 8 < group_bytes ? (byte / 8) * group_bytes + byte % 8 : -1;
+      }
+      gather = _mm_load_si128(reinterpret_cast<const __m128i*>(gather_order));
+      scatter = _mm_load_si128(reinterpret_cast<const __m128i*>(scatter_order));
+    }
+  };
+
+  // 8 values at a time, while at least 8 more follow: the 16 bytes stores (and loads) never go past the packed data
+  template<int Bits> __attribute__((target("ssse3"))) void pack_ssse3(const uint16_t *source, uint8_t *destination, size_t count, int shift) {
+    static const PackLanes<Bits> lanes;
+    const int step = 16 - Bits;
+    const __m128i shift_count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 8, destination += 2 * lanes.group_bytes) {
+      const __m128i v = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)), shift_count);
+      const __m128i packed = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(v, lanes.masks[0]), _mm_srli_epi64(_mm_and_si128(v, lanes.masks[1]), step)),
+        _mm_or_si128(_mm_srli_epi64(_mm_and_si128(v, lanes.masks[2]), 2 * step), _mm_srli_epi64(_mm_and_si128(v, lanes.masks[3]), 3 * step)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_shuffle_epi8(packed, lanes.gather));
+    }
+    pack_scalar<Bits>(source + i, destination, count - i, shift);
+  }
+
+  template<int Bits> __attribute__((target("ssse3"))) void unpack_ssse3(const uint8_t *source, uint16_t *destination, size_t count, int shift) {
+    static const PackLanes<Bits> lanes;
+    const int step = 16 - Bits;
+    const __m128i shift_count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 8, source += 2 * lanes.group_bytes) {
+      const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)), lanes.scatter);
+      const __m128i unpacked = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(v, lanes.masks[0]), _mm_and_si128(_mm_slli_epi64(v, step), lanes.masks[1])),
+        _mm_or_si128(_mm_and_si128(_mm_slli_epi64(v, 2 * step), lanes.masks[2]), _mm_and_si128(_mm_slli_epi64(v, 3 * step), lanes.masks[3])));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_sll_epi16(unpacked, shift_count));
+    }
+    unpack_scalar<Bits>(source, destination + i, count - i, shift);
+  }
+
+  __attribute__((target("avx2"))) size_t background_update_avx2(const float *values, float *mean, float *variance, uint8_t *flags, size_t count, float k2, float min_variance, float alpha) {
+    const __m256 k = _mm256_set1_ps(k2), floor = _mm256_set1_ps(min_variance), weight = _mm256_set1_ps(alpha), zero = _mm256_setzero_ps();
+    size_t flagged = 0, i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const __m256 value = _mm256_loadu_ps(values + i), m = _mm256_loadu_ps(mean + i), v = _mm256_loadu_ps(variance + i);
+      const __m256 difference = _mm256_sub_ps(value, m), squared = _mm256_mul_ps(difference, difference);
+      const __m256 flag = _mm256_and_ps(_mm256_cmp_ps(difference, zero, _CMP_GT_OQ),
+                                        _mm256_cmp_ps(squared, _mm256_mul_ps(k, _mm256_max_ps(v, floor)), _CMP_GT_OQ));
+      const __m256 step = _mm256_andnot_ps(flag, weight);
+      _mm256_storeu_ps(mean + i, _mm256_add_ps(m, _mm256_mul_ps(step, difference)));
+      _mm256_storeu_ps(variance + i, _mm256_add_ps(v, _mm256_mul_ps(step, _mm256_sub_ps(squared, v))));
+      // packs works on 128 bit lanes: the first four bytes of each lane hold its four flags
+      __m256i bytes = _mm256_castps_si256(flag);
+      bytes = _mm256_packs_epi16(_mm256_packs_epi32(bytes, bytes), bytes);
+      const int32_t low = _mm_cvtsi128_si32(_mm256_castsi256_si128(bytes));
+      const int32_t high = _mm_cvtsi128_si32(_mm256_extracti128_si256(bytes, 1));
+      memcpy(flags + i, &low, 4);
+      memcpy(flags + i + 4, &high, 4);
+      flagged += __builtin_popcount(_mm256_movemask_ps(flag));
+    }
+    return flagged + background_update_scalar(values + i, mean + i, variance + i, flags + i, count - i, k2, min_variance, alpha);
+  }
+#endif
+
+#ifdef PIXEL_KERNELS_NEON
+  void swap16_neon(const uint16_t *source, uint16_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      uint16x8_t v = vld1q_u16(source + i);
+      vst1q_u16(destination + i, vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v))));
+    }
+    swap16_scalar(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> void to8bit_neon(const uint16_t *source, uint8_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      uint16x8_t low = vld1q_u16(source + i);
+      uint16x8_t high = vld1q_u16(source + i + 8);
+      if(Swap) {
+        low = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(low)));
+        high = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(high)));
+      }
+      // Rounding, saturating narrowing shift: (v + 128) >> 8, clamped to 255
+      vst1q_u8(destination + i, vcombine_u8(vqrshrn_n_u16(low, 8), vqrshrn_n_u16(high, 8)));
+    }
+    to8bit_scalar<Swap>(source + i, destination + i, count - i);
+  }
+
+  template<bool Swap> uint8x8_t scale8_lanes_neon(uint16x8_t value, const uint16x8_t &black, const uint16x8_t &range, const int16x8_t &shift, uint16_t gain, const uint8x8_t &threshold) {
+    if(Swap)
+      value = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(value)));
+    value = vshlq_u16(vminq_u16(vqsubq_u16(value, black), range), shift);
+    // High halves of the 32 bit products
+    value = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(value), gain), 16), vshrn_n_u32(vmull_n_u16(vget_high_u16(value), gain), 16));
+    return vqshrn_n_u16(vaddq_u16(value, vshrq_n_u16(vmovl_u8(threshold), 1)), 7);
+  }
+
+  template<bool Swap> void scale8_neon(const uint16_t *source, uint8_t *destination, size_t count, const PixelKernels::Scale8 &scale, const uint8_t *dither) {
+    const uint16x8_t black = vdupq_n_u16(scale.black), range = vdupq_n_u16(scale.range);
+    const int16x8_t shift = vdupq_n_s16(scale.shift);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+      const uint8x16_t thresholds = vld1q_u8(dither + i);
+      const uint8x8_t low = scale8_lanes_neon<Swap>(vld1q_u16(source + i), black, range, shift, scale.gain, vget_low_u8(thresholds));
+      const uint8x8_t high = scale8_lanes_neon<Swap>(vld1q_u16(source + i + 8), black, range, shift, scale.gain, vget_high_u8(thresholds));
+      vst1q_u8(destination + i, vcombine_u8(low, high));
+    }
+    scale8_scalar<Swap>(source + i, destination + i, count - i, scale, dither + i);
+  }
+
+  void accumulate8_neon(const uint8_t *source, uint32_t *sums, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const uint16x8_t v = vmovl_u8(vld1_u8(source + i));
+      vst1q_u32(sums + i, vaddw_u16(vld1q_u32(sums + i), vget_low_u16(v)));
+      vst1q_u32(sums + i + 4, vaddw_u16(vld1q_u32(sums + i + 4), vget_high_u16(v)));
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  void accumulate16_neon(const uint16_t *source, uint32_t *sums, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const uint16x8_t v = vld1q_u16(source + i);
+      vst1q_u32(sums + i, vaddw_u16(vld1q_u32(sums + i), vget_low_u16(v)));
+      vst1q_u32(sums + i + 4, vaddw_u16(vld1q_u32(sums + i + 4), vget_high_u16(v)));
+    }
+    accumulate_scalar(source + i, sums + i, count - i);
+  }
+
+  void calibrate16_neon(const uint16_t *source, const uint16_t *dark, const uint16_t *gain, uint16_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+      const uint16x8_t value = vqsubq_u16(vld1q_u16(source + i), vld1q_u16(dark + i)), g = vld1q_u16(gain + i);
+      const uint32x4_t low = vmull_u16(vget_low_u16(value), vget_low_u16(g)), high = vmull_u16(vget_high_u16(value), vget_high_u16(g));
+      vst1q_u16(destination + i, vcombine_u16(vqshrn_n_u32(low, PixelKernels::calibration_gain_bits), vqshrn_n_u32(high, PixelKernels::calibration_gain_bits)));
+    }
+    calibrate16_scalar(source + i, dark + i, gain + i, destination + i, count - i);
+  }
+
+  void yuyv_luminance_neon(const uint8_t *source, uint8_t *destination, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+      vst1q_u8(destination + i, vld2q_u8(source + i * 2).val[0]);
+    yuyv_luminance_scalar(source + i * 2, destination + i, count - i);
+  }
+
+  uint16_t used_bits_neon(const uint16_t *source, size_t count) {
+    uint16x8_t used = vdupq_n_u16(0);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+      used = vorrq_u16(used, vld1q_u16(source + i));
+    const uint16x4_t half = vorr_u16(vget_low_u16(used), vget_high_u16(used));
+    return vget_lane_u16(half, 0) | vget_lane_u16(half, 1) | vget_lane_u16(half, 2) | vget_lane_u16(half, 3) | used_bits_scalar(source + i, count - i);
+  }
+
+  size_t background_update_neon(const float *values, float *mean, float *variance, uint8_t *flags, size_t count, float k2, float min_variance, float alpha) {
+    const float32x4_t k = vdupq_n_f32(k2), floor = vdupq_n_f32(min_variance), zero = vdupq_n_f32(0);
+    const uint32x4_t weight = vreinterpretq_u32_f32(vdupq_n_f32(alpha));
+    uint32x4_t flagged_lanes = vdupq_n_u32(0);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+      const float32x4_t value = vld1q_f32(values + i), m = vld1q_f32(mean + i), v = vld1q_f32(variance + i);
+      const float32x4_t difference = vsubq_f32(value, m), squared = vmulq_f32(difference, difference);
+      const uint32x4_t flag = vandq_u32(vcgtq_f32(difference, zero), vcgtq_f32(squared, vmulq_f32(k, vmaxq_f32(v, floor))));
+      const float32x4_t step = vreinterpretq_f32_u32(vbicq_u32(weight, flag));
+      vst1q_f32(mean + i, vmlaq_f32(m, step, difference));
+      vst1q_f32(variance + i, vmlaq_f32(v, step, vsubq_f32(squared, v)));
+      const uint16x4_t narrow = vmovn_u32(flag);
+      const uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(narrow, narrow))), 0);
+      memcpy(flags + i, &packed, 4);
+      flagged_lanes = vaddq_u32(flagged_lanes, vshrq_n_u32(flag, 31));
+    }
+    const size_t flagged = vgetq_lane_u32(flagged_lanes, 0) + vgetq_lane_u32(flagged_lanes, 1) + vgetq_lane_u32(flagged_lanes, 2) + vgetq_lane_u32(flagged_lanes, 3);
+    return flagged + background_update_scalar(values + i, mean + i, variance + i, flags + i, count - i, k2, min_variance, alpha);
+  }
+#endif
+
+  struct Kernels {
+    const char *name;
+    void (*swap16)(const uint16_t*, uint16_t*, size_t);
+    /// Native and byte swapped
+    void (*to8bit[2])(const uint16_t*, uint8_t*, size_t);
+    void (*scale8[2])(const uint16_t*, uint8_t*, size_t, const PixelKernels::Scale8&, const uint8_t*);
+    size_t (*background_update)(const float*, float*, float*, uint8_t*, size_t, float, float, float);
+    void (*accumulate8)(const uint8_t*, uint32_t*, size_t);
+    void (*accumulate16)(const uint16_t*, uint32_t*, size_t);
+    void (*calibrate16)(const uint16_t*, const uint16_t*, const uint16_t*, uint16_t*, size_t);
+    void (*yuyv_luminance)(const uint8_t*, uint8_t*, size_t);
+    uint16_t (*used_bits)(const uint16_t*, size_t);
+    /// 10 and 12 bit
+    void (*pack[2])(const uint16_t*, uint8_t*, size_t, int);
+    void (*unpack[2])(const uint8_t*, uint16_t*, size_t, int);
+  };
+
+  Kernels select_kernels() {
+#ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+    // Packing needs SSSE3 byte shuffles, which every AVX2 CPU has
+    const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if(__builtin_cpu_supports("avx2"))
+      return {"avx2", swap16_avx2, {to8bit_avx2<false>, to8bit_avx2<true>}, {scale8_avx2<false>, scale8_avx2<true>}, background_update_avx2, accumulate8_avx2, accumulate16_avx2, calibrate16_avx2, yuyv_luminance_avx2,
+              used_bits_avx2, {pack_ssse3<10>, pack_ssse3<12>}, {unpack_ssse3<10>, unpack_ssse3<12>}};
+    if(__builtin_cpu_supports("sse2"))
+      return {"sse2", swap16_sse2, {to8bit_sse2<false>, to8bit_sse2<true>}, {scale8_sse2<false>, scale8_sse2<true>}, background_update_sse2, accumulate8_sse2, accumulate16_sse2, calibrate16_sse2, yuyv_luminance_sse2,
+              used_bits_sse2, {ssse3 ? pack_ssse3<10> : pack_scalar<10>, ssse3 ? pack_ssse3<12> : pack_scalar<12>}, {ssse3 ? unpack_ssse3<10> : unpack_scalar<10>, ssse3 ? unpack_ssse3<12> : unpack_scalar<12>}};
+#endif
+#ifdef PIXEL_KERNELS_NEON
+    return {"neon", swap16_neon, {to8bit_neon<false>, to8bit_neon<true>}, {scale8_neon<false>, scale8_neon<true>}, background_update_neon, accumulate8_neon, accumulate16_neon, calibrate16_neon, yuyv_luminance_neon,
+            used_bits_neon, {pack_scalar<10>, pack_scalar<12>}, {unpack_scalar<10>, unpack_scalar<12>}};
+#endif
+    return {"scalar", swap16_scalar, {to8bit_scalar<false>, to8bit_scalar<true>}, {scale8_scalar<false>, scale8_scalar<true>}, background_update_scalar, accumulate_scalar<uint8_t>, accumulate_scalar<uint16_t>, calibrate16_scalar, yuyv_luminance_scalar,
+            used_bits_scalar, {pack_scalar<10>, pack_scalar<12>}, {unpack_scalar<10>, unpack_scalar<12>}};
+  }
+
+  const Kernels &kernels() {
+    static const Kernels selected = select_kernels();
+    return selected;
+  }
+
+  void copy8_row(const void *source, uint8_t *destination, size_t count) {
+    memcpy(destination, source, count);
+  }
+
+  template<bool Swap> void to8bit_row(const void *source, uint8_t *destination, size_t count) {
+    kernels().to8bit[Swap](static_cast<const uint16_t*>(source), destination, count);
+  }
+}
+
+const char *PixelKernels::implementation()
+{
+  return kernels().name;
+}
+
+void PixelKernels::swap16(const uint16_t* source, uint16_t* destination, size_t count)
+{
+  kernels().swap16(source, destination, count);
+}
+
+void PixelKernels::to8bit(const uint16_t* source, uint8_t* destination, size_t count, bool swap)
+{
+  kernels().to8bit[swap](source, destination, count);
+}
+
+PixelKernels::Scale8 PixelKernels::scale8(uint16_t black, uint16_t white)
+{
+  Scale8 scale;
+  // At least 255 values wide, still within 16 bits
+  scale.black = min<uint16_t>(black, 65535 - 255);
+  scale.range = static_cast<uint16_t>(max<uint32_t>(white > scale.black ? white - scale.black : 0, 255));
+  while((static_cast<uint32_t>(scale.range) << (scale.shift + 1)) <= 65535)
+    scale.shift++;
+  scale.gain = static_cast<uint16_t>((255u << 23) / (static_cast<uint32_t>(scale.range) << scale.shift));
+  return scale;
+}
+
+void PixelKernels::scale8(const uint16_t* source, uint8_t* destination, size_t count, bool swap, const Scale8& scale, const uint8_t* dither)
+{
+  kernels().scale8[swap](source, destination, count, scale, dither);
+}
+
+void PixelKernels::to8bit_lut(const uint16_t* source, uint8_t* destination, size_t count, bool swap, const uint8_t* lut)
+{
+  // Table lookups don't vectorise well: convert in cache sized blocks, then map in place
+  static const size_t block = 4096;
+  const auto convert = kernels().to8bit[swap];
+  for(size_t i = 0; i < count; i += block) {
+    size_t block_count = min(block, count - i);
+    convert(source + i, destination + i, block_count);
+    for(size_t j = i; j < i + block_count; j++)
+      destination[j] = lut[destination[j]];
+  }
+}
+
+size_t PixelKernels::background_update(const float* values, float* mean, float* variance, uint8_t* flags, size_t count, float k2, float min_variance, float alpha)
+{
+  return kernels().background_update(values, mean, variance, flags, count, k2, min_variance, alpha);
+}
+
+void PixelKernels::accumulate(const uint8_t* source, uint32_t* sums, size_t count)
+{
+  kernels().accumulate8(source, sums, count);
+}
+
+void PixelKernels::accumulate(const uint16_t* source, uint32_t* sums, size_t count)
+{
+  kernels().accumulate16(source, sums, count);
+}
+
+void PixelKernels::calibrate16(const uint16_t* source, const uint16_t* dark, const uint16_t* gain, uint16_t* destination, size_t count)
+{
+  kernels().calibrate16(source, dark, gain, destination, count);
+}
+
+void PixelKernels::yuyv_luminance(const uint8_t* source, uint8_t* destination, size_t count)
+{
+  kernels().yuyv_luminance(source, destination, count);
+}
+
+uint16_t PixelKernels::used_bits(const uint16_t* source, size_t count)
+{
+  return kernels().used_bits(source, count);
+}
+
+size_t PixelKernels::packed_size(size_t count, int bits)
+{
+  return (count * bits + 7) / 8;
+}
+
+void PixelKernels::pack(const uint16_t* source, uint8_t* destination, size_t count, int bits, int shift)
+{
+  kernels().pack[bits == 12](source, destination, count, shift);
+}
+
+void PixelKernels::unpack(const uint8_t* source, uint16_t* destination, size_t count, int bits, int shift)
+{
+  kernels().unpack[bits == 12](source, destination, count, shift);
+}
+
+cv::Mat PixelKernels::swap16(const cv::Mat& source)
+{
+  cv::Mat destination(source.rows, source.cols, source.type());
+  const size_t row_values = source.cols * source.channels();
+  for(int row = 0; row < source.rows; row++)
+    swap16(source.ptr<uint16_t>(row), destination.ptr<uint16_t>(row), row_values);
+  return destination;
+}
+
+PixelKernels::RowConverter PixelKernels::row_converter(int depth, bool swap)
+{
+  if(depth != CV_16U && depth != CV_16S)
+    return copy8_row;
+  if(swap)
+    return to8bit_row<true>;
+  return to8bit_row<false>;
+}
+
+cv::Mat PixelKernels::to8bit(const cv::Mat& source, bool swap)
+{
+  if(source.depth() != CV_16U && source.depth() != CV_16S)
+    return source;
+  cv::Mat destination(source.rows, source.cols, CV_MAKETYPE(CV_8U, source.channels()));
+  to8bit(source, destination, row_converter(source.depth(), swap));
+  return destination;
+}
+
+void PixelKernels::to8bit(const cv::Mat& source, cv::Mat& destination, RowConverter convert)
+{
+  destination.create(source.rows, source.cols, CV_MAKETYPE(CV_8U, source.channels()));
+  const size_t row_values = source.cols * source.channels();
+  if(source.isContinuous() && destination.isContinuous()) {
+    convert(source.data, destination.data, row_values * source.rows);
+    return;
+  }
+  for(int row = 0; row < source.rows; row++)
+    convert(source.ptr(row), destination.ptr<uint8_t>(row), row_values);
+}
+
+namespace {
+// Scatter increments don't vectorise: alternate pixels count into two tables instead,
+// so that runs of equal values (dark sky, saturated disks) don't serialise on a single counter
+template<typename T>
+vector<vector<uint32_t>> count_values(const cv::Mat &source, bool swap, int step) {
+  const int channels = source.channels();
+  const size_t values = size_t{1} << (8 * sizeof(T));
+  vector<uint32_t> tables(2 * channels * values, 0);
+  vector<uint16_t> swapped_row(swap ? source.cols * channels : 0);
+  for(int row = 0; row < source.rows; row += step) {
+    const T *pixel = source.ptr<T>(row);
+    if(swap) {
+      PixelKernels::swap16(reinterpret_cast<const uint16_t*>(pixel), swapped_row.data(), swapped_row.size());
+      pixel = reinterpret_cast<const T*>(swapped_row.data());
+    }
+    for(int column = 0; column < source.cols; column += step, pixel += step * channels) {
+      uint32_t *table = tables.data() + ((column / step) & 1) * channels * values;
+      for(int channel = 0; channel < channels; channel++)
+        ++table[channel * values + pixel[channel]];
+    }
+  }
+  vector<vector<uint32_t>> histograms(channels, vector<uint32_t>(values));
+  for(int channel = 0; channel < channels; channel++) {
+    const uint32_t *even = tables.data() + channel * values;
+    const uint32_t *odd = even + channels * values;
+    for(size_t value = 0; value < values; value++)
+      histograms[channel][value] = even[value] + odd[value];
+  }
+  return histograms;
+}
+}
+
+vector<vector<uint32_t>> PixelKernels::histogram(const cv::Mat& source, bool swap, int step)
+{
+  step = max(step, 1);
+  if(source.depth() == CV_16U || source.depth() == CV_16S)
+    return count_values<uint16_t>(source, swap, step);
+  return count_values<uint8_t>(source, false, step);
+}
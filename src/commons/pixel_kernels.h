@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Pixel format kernels shared by display, histogram, network and writers.
+ * The implementation is chosen at runtime: AVX2 or SSE2 on x86, NEON on ARM, scalar otherwise.
+ * 16 to 8 bit conversions round to the nearest value, like cv::Mat::convertTo(dest, CV_8U, 1./256.).
+ */
+namespace PixelKernels {
+  /// Name of the implementation in use ("avx2", "sse2", "neon", "scalar")
+  const char *implementation();
+  /// Swaps the bytes of count 16 bit values; source and destination may be the same buffer
+  void swap16(const uint16_t *source, uint16_t *destination, std::size_t count);
+  /// Converts count 16 bit values to 8 bit, swapping their bytes first if swap is true
+  void to8bit(const uint16_t *source, uint8_t *destination, std::size_t count, bool swap);
+  /// As to8bit, then maps the result through a 256 entries lookup table (for instance a stretch curve)
+  void to8bit_lut(const uint16_t *source, uint8_t *destination, std::size_t count, bool swap, const uint8_t *lut);
+  /// Linear mapping of a 16 bit range to 8 bit, in the fixed point form the scale8 kernels use
+  struct Scale8 {
+    uint16_t black = 0;
+    /// white - black, at least 255
+    uint16_t range = 65535;
+    uint8_t shift = 0;
+    uint16_t gain = 0;
+  };
+  /// black maps to 0, white to 255; values outside of the range are clipped
+  Scale8 scale8(uint16_t black, uint16_t white);
+  /// Converts count 16 bit values to 8 bit through scale, swapping their bytes first if swap is true. dither[i] / 256 is added to each scaled value
+  /// before dropping its fraction: 128 everywhere rounds to the nearest, a threshold pattern (i.e. blue noise) trades banding for fine grained noise
+  void scale8(const uint16_t *source, uint8_t *destination, std::size_t count, bool swap, const Scale8 &scale, const uint8_t *dither);
+  /// Adds count 8 or 16 bit values to 32 bit sums, element by element (binning, stacking)
+  void accumulate(const uint8_t *source, uint32_t *sums, std::size_t count);
+  void accumulate(const uint16_t *source, uint32_t *sums, std::size_t count);
+  /// Fixed point flat field gains: 1.0 is 1 << calibration_gain_bits
+  constexpr int calibration_gain_bits = 12;
+  /// Dark and flat calibration of count 16 bit values: destination = (source - dark) · gain >> calibration_gain_bits,
+  /// with source - dark clamped to 0 and the result saturated to 65535. Source and destination may be the same buffer
+  void calibrate16(const uint16_t *source, const uint16_t *dark, const uint16_t *gain, uint16_t *destination, std::size_t count);
+  /// Luminance of count packed YUYV (YUV 4:2:2) pixels: the Y bytes, without the interleaved chroma
+  void yuyv_luminance(const uint8_t *source, uint8_t *destination, std::size_t count);
+  /// Updates an exponentially weighted background (mean and variance, with weight alpha) with count values.
+  /// Values brighter than the mean by more than k sigma, that is difference² > k2 · max(variance, min_variance), are flagged with 255
+  /// and left out of the update; the others are flagged with 0. Returns the number of flagged values.
+  std::size_t background_update(const float *values, float *mean, float *variance, uint8_t *flags, std::size_t count, float k2, float min_variance, float alpha);
+  /// Bitwise or of count 16 bit values: the bits used by any of them
+  uint16_t used_bits(const uint16_t *source, std::size_t count);
+  /// Bytes taken by count values packed to bits bits
+  std::size_t packed_size(std::size_t count, int bits);
+  /// Packs count 16 bit values, shifted right by shift, to bits (10 or 12) bits each, as a little endian bit stream of packed_size(count, bits) bytes.
+  /// Bits left outside of the packed ones are lost: see used_bits
+  void pack(const uint16_t *source, uint8_t *destination, std::size_t count, int bits, int shift);
+  /// Back from pack, shifted left by shift
+  void unpack(const uint8_t *source, uint16_t *destination, std::size_t count, int bits, int shift);
+
+  /// Byte swapped copy of a 16 bit matrix
+  cv::Mat swap16(const cv::Mat &source);
+  /// 8 bit copy of a 16 bit matrix, with the same channels; 8 bit matrices are returned unchanged
+  cv::Mat to8bit(const cv::Mat &source, bool swap = false);
+
+  /// Converts count samples to 8 bit, for one source depth and byte order, with no per call or per sample format branches
+  typedef void (*RowConverter)(const void *source, uint8_t *destination, std::size_t count);
+  /// Converter for CV_8U (a plain copy) or CV_16U samples (byte swapped first if swap is true): pick it once, when the stream format changes
+  RowConverter row_converter(int depth, bool swap);
+  /// 8 bit copy of source into destination (reusing its memory when it fits), with a converter from row_converter
+  void to8bit(const cv::Mat &source, cv::Mat &destination, RowConverter convert);
+
+  /// Counts of each value (256 or 65536 bins) for every channel of a CV_8U or CV_16U matrix, swapping 16 bit values first if swap is true.
+  /// With step > 1 only one pixel every step columns, on one row every step rows, is counted.
+  std::vector<std::vector<uint32_t>> histogram(const cv::Mat &source, bool swap = false, int step = 1);
+}
+
+#endif // PIXEL_KERNELS_H
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "commons/pretriggerbuffer.h"
+#include "commons/frame.h"
+#include <QMutex>
+#include <QMutexLocker>
+
+using namespace std;
+
+DPTR_IMPL(PreTriggerBuffer) {
+  const size_t max_bytes;
+  const chrono::duration<double> window;
+  deque<FrameConstPtr> frames;
+  size_t bytes = 0;
+  size_t evicted_over_budget = 0;
+  // Reclaimers evict frames from other threads
+  mutable QMutex mutex;
+  MemoryGovernor::Account *account = nullptr;
+  unique_ptr<MemoryGovernor::Reclaimer> reclaimer;
+  void pop_front();
+  void reclaim(size_t wanted);
+  void release_all();
+};
+
+void PreTriggerBuffer::Private::pop_front()
+{
+  if(account)
+    account->release(frames.front()->size());
+  bytes -= frames.front()->size();
+  frames.pop_front();
+}
+
+void PreTriggerBuffer::Private::reclaim(size_t wanted)
+{
+  QMutexLocker lock(&mutex);
+  size_t reclaimed = 0;
+  while(! frames.empty() && reclaimed < wanted) {
+    reclaimed += frames.front()->size();
+    pop_front();
+    ++evicted_over_budget;
+  }
+}
+
+void PreTriggerBuffer::Private::release_all()
+{
+  if(account)
+    account->release(bytes);
+  bytes = 0;
+}
+
+PreTriggerBuffer::PreTriggerBuffer(size_t max_bytes, const chrono::duration<double> &window) : dptr(max_bytes, window)
+{
+}
+
+PreTriggerBuffer::~PreTriggerBuffer()
+{
+  // Without the frames lock: it waits for a reclaimer running, which takes it
+  d->reclaimer.reset();
+  clear();
+}
+
+void PreTriggerBuffer::set_memory_account(MemoryGovernor::Account &account)
+{
+  d->reclaimer.reset();
+  {
+    QMutexLocker lock(&d->mutex);
+    if(d->account)
+      d->account->release(d->bytes);
+    d->account = &account;
+    d->account->charge(d->bytes);
+  }
+  d->reclaimer = make_unique<MemoryGovernor::Reclaimer>(account, [this](size_t bytes) { d->reclaim(bytes); });
+}
+
+void PreTriggerBuffer::push(const FrameConstPtr &frame)
+{
+  QMutexLocker lock(&d->mutex);
+  while(! d->frames.empty() && frame->captured() - d->frames.front()->captured() > d->window)
+    d->pop_front();
+  // Like the recording queue, the newest frame is always kept, whatever its size
+  while(d->max_bytes > 0 && ! d->frames.empty() && d->bytes + frame->size() > d->max_bytes) {
+    d->pop_front();
+    ++d->evicted_over_budget;
+  }
+  if(d->account) {
+    while(! d->frames.empty() && ! d->account->reserve(frame->size())) {
+      d->pop_front();
+      ++d->evicted_over_budget;
+    }
+    if(d->frames.empty())
+      d->account->charge(frame->size());
+  }
+  d->frames.push_back(frame);
+  d->bytes += frame->size();
+}
+
+deque<FrameConstPtr> PreTriggerBuffer::take()
+{
+  QMutexLocker lock(&d->mutex);
+  deque<FrameConstPtr> frames;
+  swap(frames, d->frames);
+  d->release_all();
+  return frames;
+}
+
+void PreTriggerBuffer::clear()
+{
+  QMutexLocker lock(&d->mutex);
+  d->frames.clear();
+  d->release_all();
+}
+
+size_t PreTriggerBuffer::size() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->frames.size();
+}
+
+size_t PreTriggerBuffer::bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->bytes;
+}
+
+chrono::duration<double> PreTriggerBuffer::span() const
+{
+  QMutexLocker lock(&d->mutex);
+  if(d->frames.empty())
+    return {};
+  return d->frames.back()->captured() - d->frames.front()->captured();
+}
+
+size_t PreTriggerBuffer::evicted_over_budget() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->evicted_over_budget;
+}
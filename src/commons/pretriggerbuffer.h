@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PRETRIGGERBUFFER_H
+#define PRETRIGGERBUFFER_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <chrono>
+#include <deque>
+#include "commons/memorygovernor.h"
+
+FWD_PTR(Frame)
+
+/**
+ * In-memory ring of the latest frames, kept while waiting for a recording trigger.
+ * Frames older than the window (by capture time, relative to the newest frame) are released first,
+ * then the oldest ones exceeding the memory budget. Released pooled frames give their buffers back to the pool,
+ * so that, in steady state, the ring runs on recycled buffers.
+ * Meant to be owned by the recording thread; locked only so that higher priority subsystems can reclaim its frames.
+ */
+class PreTriggerBuffer
+{
+public:
+  PreTriggerBuffer(std::size_t max_bytes, const std::chrono::duration<double> &window);
+  ~PreTriggerBuffer();
+  /// Buffered frames are charged to account, and evicted oldest first when a higher priority subsystem needs the memory
+  void set_memory_account(MemoryGovernor::Account &account);
+  void push(const FrameConstPtr &frame);
+  /// Hands over the buffered frames, oldest first, and empties the buffer
+  std::deque<FrameConstPtr> take();
+  void clear();
+  std::size_t size() const;
+  std::size_t bytes() const;
+  /// Capture time between the oldest and the newest buffered frames
+  std::chrono::duration<double> span() const;
+  /// Frames released because of the memory budgets (this buffer's, or the process one) rather than the window, since construction
+  std::size_t evicted_over_budget() const;
+private:
+  DPTR
+};
+
+#endif // PRETRIGGERBUFFER_H
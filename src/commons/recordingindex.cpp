@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "recordingindex.h"
+#include "commons/frame.h"
+#include "commons/debayer.h"
+#include "commons/pixel_kernels.h"
+#include "commons/ser_header.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+const QString RecordingIndex::IndexDirectory = ".planetaryimager";
+const int RecordingIndex::ThumbnailSize;
+
+namespace {
+  const int INDEX_VERSION = 1;
+  const char INDEX_FILE[] = "index.json";
+  const char THUMBNAILS[] = "thumbnails";
+  const int JPEG_QUALITY = 85;
+  // Files modified more recently than this are taken as still being written
+  const int GROWING_FILE_SECONDS = 5;
+  // SER timestamps count 100 ns ticks
+  const double SER_TICKS_PER_SECOND = 1e7;
+  // Index files are read, changed and written back as a whole: by the recordings ending and the directory scans, on any thread
+  QMutex index_mutex;
+
+  void set_file_state(QVariantMap &entry, const QFileInfo &info) {
+    entry["size"] = info.size();
+    entry["modified"] = info.lastModified().toMSecsSinceEpoch();
+  }
+  bool current(const QVariantMap &entry, const QFileInfo &info) {
+    return entry["size"].toLongLong() == info.size() && entry["modified"].toLongLong() == info.lastModified().toMSecsSinceEpoch();
+  }
+}
+
+RecordingIndex::RecordingIndex(const QString &directory) : _directory{directory}
+{
+}
+
+RecordingIndex::Entries RecordingIndex::load() const
+{
+  QFile file{QDir{_directory}.filePath(IndexDirectory + "/" + INDEX_FILE)};
+  if(! file.open(QIODevice::ReadOnly))
+    return {};
+  const auto index = QJsonDocument::fromJson(file.readAll()).toVariant().toMap();
+  if(index["version"].toInt() != INDEX_VERSION)
+    return {};
+  Entries entries;
+  const auto recordings = index["recordings"].toMap();
+  for(auto recording = recordings.begin(); recording != recordings.end(); ++recording)
+    entries[recording.key()] = recording.value().toMap();
+  return entries;
+}
+
+bool RecordingIndex::save(const Entries &entries) const
+{
+  QDir dir{_directory};
+  if(! dir.mkpath(IndexDirectory)) {
+    qWarning() << "Unable to create the recordings index in" << _directory;
+    return false;
+  }
+  QVariantMap recordings;
+  for(auto entry = entries.begin(); entry != entries.end(); ++entry)
+    recordings[entry.key()] = entry.value();
+  // Readers (i.e. remote clients) never see half an index
+  QSaveFile file{dir.filePath(IndexDirectory + "/" + INDEX_FILE)};
+  if(! file.open(QIODevice::WriteOnly)) {
+    qWarning() << "Unable to write the recordings index" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+  file.write(QJsonDocument::fromVariant(QVariantMap{{"version", INDEX_VERSION}, {"recordings", recordings}}).toJson(QJsonDocument::Compact));
+  return file.commit();
+}
+
+RecordingIndex::Entries RecordingIndex::entries() const
+{
+  QMutexLocker lock(&index_mutex);
+  return load();
+}
+
+void RecordingIndex::add(const QString &file, const QVariantMap &information, const cv::Mat &thumbnail)
+{
+  auto entry = RecordingIndex::entry(information);
+  set_file_state(entry, QFileInfo{QDir{_directory}.filePath(file)});
+  const auto thumbnail_file = store_thumbnail(file, thumbnail);
+  if(! thumbnail_file.isEmpty())
+    entry["thumbnail"] = thumbnail_file;
+  QMutexLocker lock(&index_mutex);
+  auto entries = load();
+  entries[file] = entry;
+  save(entries);
+}
+
+int RecordingIndex::update()
+{
+  const QDir dir{_directory};
+  const auto indexed = entries();
+  const auto now = QDateTime::currentDateTime();
+  // Built without the lock: reading frames of many files takes a while, and recordings ending meanwhile shouldn't wait for it
+  Entries updated;
+  for(const auto &info: dir.entryInfoList(QStringList{"*.ser"}, QDir::Files)) {
+    const auto name = info.fileName();
+    if((indexed.contains(name) && current(indexed[name], info)) || info.lastModified().secsTo(now) < GROWING_FILE_SECONDS)
+      continue;
+    auto entry = ser_entry(name);
+    if(entry.isEmpty())
+      continue;
+    set_file_state(entry, info);
+    updated[name] = entry;
+  }
+  QMutexLocker lock(&index_mutex);
+  auto entries = load();
+  bool changed = ! updated.isEmpty();
+  for(auto entry = entries.begin(); entry != entries.end(); ) {
+    if(QFileInfo::exists(dir.filePath(entry.key()))) {
+      ++entry;
+      continue;
+    }
+    const auto thumbnail = thumbnail_path(entry.value());
+    if(! thumbnail.isEmpty())
+      QFile::remove(thumbnail);
+    entry = entries.erase(entry);
+    changed = true;
+  }
+  for(auto entry = updated.begin(); entry != updated.end(); ++entry)
+    entries[entry.key()] = entry.value();
+  if(changed)
+    save(entries);
+  return updated.size();
+}
+
+QString RecordingIndex::thumbnail_path(const QVariantMap &entry) const
+{
+  const auto thumbnail = entry["thumbnail"].toString();
+  return thumbnail.isEmpty() ? QString{} : QDir{_directory}.filePath(thumbnail);
+}
+
+QString RecordingIndex::store_thumbnail(const QString &file, const cv::Mat &thumbnail) const
+{
+  if(thumbnail.empty())
+    return {};
+  const auto thumbnails = IndexDirectory + "/" + THUMBNAILS;
+  const QString relative = thumbnails + "/" + file + ".jpg";
+  vector<uchar> data;
+  QDir dir{_directory};
+  if(! dir.mkpath(thumbnails) || ! cv::imencode(".jpg", thumbnail, data, {cv::IMWRITE_JPEG_QUALITY, JPEG_QUALITY}))
+    return {};
+  QSaveFile out{dir.filePath(relative)};
+  if(! out.open(QIODevice::WriteOnly) || out.write(reinterpret_cast<const char*>(data.data()), data.size()) != static_cast<qint64>(data.size()) || ! out.commit()) {
+    qWarning() << "Unable to write the thumbnail" << out.fileName() << ":" << out.errorString();
+    return {};
+  }
+  return relative;
+}
+
+QVariantMap RecordingIndex::entry(const QVariantMap &information)
+{
+  QVariantMap entry;
+  for(auto key: {"started", "ended", "camera", "width", "height", "bpp", "channels", "mean-fps", "dropped-frames", "performance"})
+    if(information.contains(key))
+      entry[key] = information[key];
+  if(information.contains("total-frames"))
+    entry["frames"] = information["total-frames"];
+  const auto started = QDateTime::fromString(information["started"].toString(), Qt::ISODate);
+  const auto ended = QDateTime::fromString(information["ended"].toString(), Qt::ISODate);
+  if(started.isValid() && ended.isValid())
+    entry["duration"] = started.msecsTo(ended) / 1000.;
+  const auto scores = information["quality"].toMap()["scores"].toList();
+  if(! scores.isEmpty())
+    entry["quality"] = quality_summary(scores);
+  return entry;
+}
+
+QVariantMap RecordingIndex::quality_summary(const QVariantList &scores, int bins)
+{
+  vector<double> values;
+  transform(scores.begin(), scores.end(), back_inserter(values), [](const QVariant &score) { return score.toDouble(); });
+  if(values.empty() || bins < 1)
+    return {};
+  sort(values.begin(), values.end());
+  const double low = values.front(), high = values.back();
+  const double step = (high - low) / bins;
+  vector<int> counts(bins, 0);
+  for(auto value: values)
+    counts[step > 0 ? min(bins - 1, static_cast<int>((value - low) / step)) : 0]++;
+  QVariantList histogram;
+  copy(counts.begin(), counts.end(), back_inserter(histogram));
+  const auto middle = values.size() / 2;
+  return {
+    {"scores", static_cast<qulonglong>(values.size())},
+    {"min", low},
+    {"max", high},
+    {"median", values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2},
+    {"histogram", histogram},
+  };
+}
+
+cv::Mat RecordingIndex::thumbnail(const Frame &frame, int size)
+{
+  if(frame.mat().empty() || size < 1)
+    return {};
+  const bool swap = frame.bpp() == 16 && Debayer::needs_swap(frame);
+  cv::Mat image;
+  if(Debayer::is_bayer(frame.colorFormat())) {
+    // Already half size, and in colour: the cheapest interpolation is plenty for a thumbnail
+    image = Debayer::debayer(frame.mat(), frame.colorFormat(), {Debayer::Superpixel, swap, true});
+  } else {
+    image = PixelKernels::to8bit(frame.mat(), swap);
+  }
+  if(image.empty())
+    return {};
+  // 8 bit frames come back from to8bit as they are: converted into a new image, not in place
+  if(image.channels() == 3 && frame.colorFormat() != Frame::BGR) {
+    cv::Mat bgr;
+    cv::cvtColor(image, bgr, cv::COLOR_RGB2BGR);
+    image = bgr;
+  }
+  const double scale = min(1., static_cast<double>(size) / max(image.cols, image.rows));
+  cv::Mat thumbnail;
+  if(scale < 1)
+    cv::resize(image, thumbnail, cv::Size{max(1, cvRound(image.cols * scale)), max(1, cvRound(image.rows * scale))}, 0, 0, cv::INTER_AREA);
+  else
+    thumbnail = image.clone();
+  // Planets on a black sky, or a dim Moon: stretched, or the thumbnails would all look black
+  cv::normalize(thumbnail, thumbnail, 0, 255, cv::NORM_MINMAX);
+  return thumbnail;
+}
+
+QVariantMap RecordingIndex::ser_entry(const QString &file) const
+{
+  QFile ser{QDir{_directory}.filePath(file)};
+  SER_Header header;
+  if(! ser.open(QIODevice::ReadOnly) || ser.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+    || memcmp(header.fileId, SER_Header{}.fileId, sizeof(header.fileId)) != 0)
+    return {};
+  QVariantMap information;
+  QFile json{ser.fileName() + ".json"};
+  if(json.open(QIODevice::ReadOnly))
+    information = QJsonDocument::fromJson(json.readAll()).toVariant().toMap();
+  auto entry = RecordingIndex::entry(information);
+  // The header is right even for recordings trimmed or rebuilt after their information was written
+  entry["frames"] = header.frames;
+  entry["width"] = header.imageWidth;
+  entry["height"] = header.imageHeight;
+  entry["bpp"] = header.pixelDepth;
+  entry["channels"] = header.channels();
+  if(! entry.contains("camera"))
+    entry["camera"] = QString::fromLatin1(header.camera, static_cast<int>(strnlen(header.camera, sizeof(header.camera)))).trimmed();
+  if(! entry.contains("started") && header.datetime_utc > 0)
+    entry["started"] = SER_Header::qdatetime(header.datetime_utc).toString(Qt::ISODate);
+  const qint64 frame_size = header.frame_size();
+  const qint64 trailer = sizeof(header) + header.frames * frame_size;
+  if(! entry.contains("duration") && header.frames > 1 && ser.size() >= trailer + header.frames * static_cast<qint64>(sizeof(SER_Timestamp))) {
+    SER_Timestamp first = 0, last = 0;
+    if(ser.seek(trailer) && ser.read(reinterpret_cast<char*>(&first), sizeof(first)) == sizeof(first)
+      && ser.seek(trailer + (header.frames - 1) * sizeof(SER_Timestamp)) && ser.read(reinterpret_cast<char*>(&last), sizeof(last)) == sizeof(last) && last > first)
+      entry["duration"] = (last - first) / SER_TICKS_PER_SECOND;
+  }
+  if(header.frames == 0 || frame_size == 0 || ! ser.seek(sizeof(header) + (header.frames / 2) * frame_size))
+    return entry;
+  auto data = ser.read(frame_size);
+  if(data.size() != frame_size)
+    return entry;
+  const cv::Mat pixels(header.imageHeight, header.imageWidth, CV_MAKETYPE(header.pixelDepth <= 8 ? CV_8U : CV_16U, header.channels()), data.data());
+  // The SER endianness flag is read the other way around by most tools, and written so by SERWriter
+  const Frame frame{header.frame_color_format(), pixels, header.endian == SER_Header::LittleEndian ? Frame::BigEndian : Frame::LittleEndian};
+  const auto thumbnail_file = store_thumbnail(file, thumbnail(frame));
+  if(! thumbnail_file.isEmpty())
+    entry["thumbnail"] = thumbnail_file;
+  return entry;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RECORDINGINDEX_H
+#define RECORDINGINDEX_H
+
+#include <QMap>
+#include <QString>
+#include <QVariantMap>
+#include <opencv2/core/core.hpp>
+#include "commons/fwd.h"
+
+class Frame;
+
+/**
+ * Small summary of each recording in a directory, so that browsing a night of captures doesn't open the recordings at all:
+ * frame count, duration, size, camera, a thumbnail, the quality scores histogram and the performance summary, when the recording information has them.
+ * Kept in "<directory>/.planetaryimager/index.json", with the thumbnails as JPEG files next to it: remote clients can read them as any other
+ * file in the save directory. Entries are keyed by file name, and go stale when the file size or modification time changes.
+ * Index files are only updated under a process wide lock; all the calls read or write the disk, so keep them off the GUI thread.
+ */
+class RecordingIndex
+{
+public:
+  typedef QMap<QString, QVariantMap> Entries;
+  static const QString IndexDirectory;
+  static const int ThumbnailSize = 160;
+  RecordingIndex(const QString &directory);
+  QString directory() const { return _directory; }
+  /// By file name; empty when there is no index yet, or it can't be read
+  Entries entries() const;
+  /// Adds or replaces the entry of file, a recording in this directory, from its recording information (see RecordingInformation). thumbnail may be empty
+  void add(const QString &file, const QVariantMap &information, const cv::Mat &thumbnail);
+  /**
+   * Indexes the SER files not in the index yet, or changed since, from their header, their JSON information file when there is one,
+   * and their middle frame; files still being written are left for later. Entries of files gone are dropped. Returns the entries updated.
+   */
+  int update();
+  /// Path of the thumbnail of entry, empty when it has none
+  QString thumbnail_path(const QVariantMap &entry) const;
+  /// The entry fields taken from a recording information map
+  static QVariantMap entry(const QVariantMap &information);
+  /// Sharpness scores counted in bins equal steps between the lowest and the highest one, with their median
+  static QVariantMap quality_summary(const QVariantList &scores, int bins = 10);
+  /// 8 bit BGR or grey image of frame, fitting in size pixels and stretched to the full range: empty for empty frames
+  static cv::Mat thumbnail(const Frame &frame, int size = ThumbnailSize);
+private:
+  const QString _directory;
+  Entries load() const;
+  bool save(const Entries &entries) const;
+  QString store_thumbnail(const QString &file, const cv::Mat &thumbnail) const;
+  QVariantMap ser_entry(const QString &file) const;
+};
+
+#endif // RECORDINGINDEX_H
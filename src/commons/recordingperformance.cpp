@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "recordingperformance.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void RecordingPerformance::captured(const Clock::time_point &when, quint64 frames)
+{
+  capture_rate.add(when, frames);
+}
+
+void RecordingPerformance::written(const Clock::time_point &when, const Clock::duration &write_time)
+{
+  save_rate.add(when, 1);
+  write_latency.record(chrono::duration_cast<Metrics::Histogram::Duration>(write_time));
+}
+
+void RecordingPerformance::add_drops(Stage stage, quint64 frames)
+{
+  drops[stage] += frames;
+}
+
+void RecordingPerformance::set_queue_peak(quint64 bytes, quint64 max_bytes)
+{
+  queue_peak_bytes = max(queue_peak_bytes, bytes);
+  queue_max_bytes = max_bytes;
+}
+
+void RecordingPerformance::Rate::add(const Clock::time_point &when, quint64 frames)
+{
+  if(windows.empty())
+    start = when;
+  // Frames timestamped before the first one (i.e. flushed from another queue) count in the first second
+  const auto window = static_cast<size_t>(max<Clock::rep>(0, chrono::duration_cast<chrono::seconds>(when - start).count()));
+  if(window >= windows.size())
+    windows.resize(window + 1, 0);
+  windows[window] += static_cast<quint32>(frames);
+  total += frames;
+  last = max(last, when);
+}
+
+QVariantMap RecordingPerformance::Rate::summary() const
+{
+  const double seconds = chrono::duration<double>(last - start).count();
+  // The last second is cut short by the end of the recording
+  vector<quint32> full(windows.begin(), windows.size() > 1 ? windows.end() - 1 : windows.end());
+  sort(full.begin(), full.end());
+  auto percentile = [&](double fraction) -> double {
+    if(full.empty())
+      return 0;
+    return full[min(full.size() - 1, static_cast<size_t>(floor(fraction * (full.size() - 1) + 0.5)))];
+  };
+  return {
+    {"mean", seconds > 0 ? total / seconds : 0.},
+    {"p5", percentile(0.05)},
+    {"p50", percentile(0.5)},
+    {"p95", percentile(0.95)},
+  };
+}
+
+QVariantMap RecordingPerformance::summary() const
+{
+  const auto latency = write_latency.snapshot();
+  auto ms = [](quint64 us) { return us / 1000.; };
+  return {
+    {"capture-fps", capture_rate.summary()},
+    {"save-fps", save_rate.summary()},
+    {"write-latency-ms", QVariantMap{
+      {"mean", latency.count > 0 ? ms(latency.sum_us) / latency.count : 0.},
+      {"p50", ms(latency.percentile_us(0.5))},
+      {"p99", ms(latency.percentile_us(0.99))},
+      {"p999", ms(latency.percentile_us(0.999))},
+      {"max", ms(latency.max_us)},
+    }},
+    {"drops", QVariantMap{
+      {"sdk", drops[SDK]},
+      // Frames refused by the queue leave gaps in the capture sequence too
+      {"capture", drops[Capture] - min(drops[Capture], drops[Queue])},
+      {"queue", drops[Queue]},
+      {"writer", drops[Writer]},
+    }},
+    {"queue-peak-bytes", queue_peak_bytes},
+    {"queue-max-bytes", queue_max_bytes},
+    {"load-shedding-steps", load_shedding_steps},
+  };
+}
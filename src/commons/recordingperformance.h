@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RECORDINGPERFORMANCE_H
+#define RECORDINGPERFORMANCE_H
+
+#include <chrono>
+#include <vector>
+#include <QVariantMap>
+#include "commons/metrics.h"
+
+/**
+ * Running aggregates of a recording pipeline health, cheap enough to update on every frame, summarised in the recording information.
+ * Rates are counted in one second windows, so that their percentiles show stalls a mean would hide; write latencies go to a histogram.
+ * Dropped frames are told apart by stage: lost by the camera SDK (driver sequence gaps), before the recording queue (capture sequence gaps
+ * not explained by the queue), refused by the full recording queue, and dropped by the file writers.
+ */
+class RecordingPerformance
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  enum Stage { SDK, Capture, Queue, Writer };
+  /// Frames captured at when: the one reaching the recording, and frames missing right before it
+  void captured(const Clock::time_point &when, quint64 frames = 1);
+  /// A frame done writing at when, after write_time in the file writer
+  void written(const Clock::time_point &when, const Clock::duration &write_time);
+  /// Capture drops are the sequence gaps: the queue drops are taken out of them in the summary
+  void add_drops(Stage stage, quint64 frames);
+  void set_queue_peak(quint64 bytes, quint64 max_bytes);
+  void add_load_shedding_step() { ++load_shedding_steps; }
+  /**
+   * "capture-fps" and "save-fps" (mean, p5, p50 and p95 of the full seconds), "write-latency-ms" (mean, p50, p99, p999, max),
+   * "drops" by stage ("sdk", "capture", "queue", "writer"), "queue-peak-bytes", "queue-max-bytes", "load-shedding-steps".
+   */
+  QVariantMap summary() const;
+private:
+  class Rate {
+  public:
+    void add(const Clock::time_point &when, quint64 frames);
+    QVariantMap summary() const;
+  private:
+    Clock::time_point start;
+    Clock::time_point last;
+    std::vector<quint32> windows;
+    quint64 total = 0;
+  };
+  Rate capture_rate, save_rate;
+  Metrics::Histogram write_latency;
+  quint64 drops[Writer + 1] = {};
+  quint64 queue_peak_bytes = 0;
+  quint64 queue_max_bytes = 0;
+  int load_shedding_steps = 0;
+};
+
+#endif // RECORDINGPERFORMANCE_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "roifollow.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+ROIFollow::ROIFollow(double margin) : margin{max(0., min(margin, 0.45))}
+{
+}
+
+QPoint ROIFollow::shift(const QPointF &target, const QSize &frame) const
+{
+  if(frame.isEmpty())
+    return {};
+  const double left = frame.width() * margin, top = frame.height() * margin;
+  const bool near_edge = target.x() < left || target.x() > frame.width() - left || target.y() < top || target.y() > frame.height() - top;
+  if(! near_edge)
+    return {};
+  return {static_cast<int>(lround(target.x() - frame.width() / 2.)), static_cast<int>(lround(target.y() - frame.height() / 2.))};
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef ROIFOLLOW_H
+#define ROIFOLLOW_H
+
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+
+/**
+ * Hardware ROI moves keeping a drifting target (i.e. a planet) inside a small ROI, instead of a big one sized for the drift (see ROIFollower).
+ * Nothing moves while the target stays away from the edges; once it comes within the margin of one, the ROI is moved to centre it again,
+ * on both axes at once, so that moves stay rare.
+ */
+class ROIFollow
+{
+public:
+  /// margin: fraction of the frame width and height, on each side, where the target starts a move (at most 0.45)
+  ROIFollow(double margin = 0.2);
+  /// ROI move, in frame pixels, centring target in a frame of size frame; a null point when the target is well inside
+  QPoint shift(const QPointF &target, const QSize &frame) const;
+private:
+  double margin;
+};
+
+#endif // ROIFOLLOW_H
@@ -18,6 +18,10 @@
 #include "ser_header.h"
 #include <map>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
 using namespace std;
 
 namespace {
@@ -85,3 +89,66 @@ QDateTime SER_Header::qdatetime(const SER_Timestamp& timestamp)
   return reference_datetime.addMSecs(qFromLittleEndian(timestamp) / 10000);
 }
 
+SER_FramesHeader::SER_FramesHeader() : recordSize{sizeof(SER_FrameRecord)}
+{
+}
+
+SER_FrameRecord::SER_FrameRecord(const Frame &frame) : sequence{frame.sequence()}, exposure{frame.exposure().count()}, metadata(frame.metadata())
+{
+}
+
+namespace {
+const QString stripes_file_id = "PISTRIPES 1";
+}
+
+pair<int, qint64> SER_StripesIndex::locate(qint64 frame) const
+{
+  return {static_cast<int>(frame % stripes.size()), frame / stripes.size()};
+}
+
+bool SER_StripesIndex::save(const QString &filename, QString &error) const
+{
+  QFile file{filename};
+  if(! file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+    error = file.errorString();
+    return false;
+  }
+  QTextStream stream{&file};
+  stream.setCodec("UTF-8");
+  stream << stripes_file_id << endl;
+  for(const auto &stripe: stripes)
+    stream << stripe << endl;
+  stream.flush();
+  if(file.error() != QFile::NoError) {
+    error = file.errorString();
+    return false;
+  }
+  return true;
+}
+
+bool SER_StripesIndex::load(const QString &filename, QString &error)
+{
+  QFile file{filename};
+  if(! file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    error = file.errorString();
+    return false;
+  }
+  QTextStream stream{&file};
+  stream.setCodec("UTF-8");
+  if(stream.readLine() != stripes_file_id) {
+    error = "not a stripes index";
+    return false;
+  }
+  const QDir directory = QFileInfo{filename}.absoluteDir();
+  stripes.clear();
+  while(! stream.atEnd()) {
+    const auto line = stream.readLine();
+    if(! line.isEmpty())
+      stripes.push_back(QDir::cleanPath(directory.absoluteFilePath(line)));
+  }
+  if(stripes.isEmpty()) {
+    error = "no stripes listed";
+    return false;
+  }
+  return true;
+}
@@ -20,6 +20,8 @@
 #include "frame.h"
 #include <QDateTime>
 #include <QtEndian>
+#include <QStringList>
+#include <utility>
 // TODO: stop using a packed struct, and use accessors + QtEndian helpers for better compat
 
 typedef uint64_t SER_Timestamp;
@@ -61,4 +63,58 @@ struct SER_Header {
 } __attribute__ ((__packed__));
 
 static_assert(sizeof(SER_Header) == 178, "Wrong SER_Header size");
+
+/**
+ * Metadata side-car of a SER file ("<file>.ser.frames"): this header, then one SER_FrameRecord for each SER frame, in the same order.
+ * Records are in the byte order of the machine that wrote them, as told by the header.
+ */
+struct SER_FramesHeader {
+  char fileId[8] = {'P', 'I', 'F', 'R', 'A', 'M', 'E', 'S'};
+  quint32 version = 1;
+  quint32 littleEndian = Q_BYTE_ORDER == Q_LITTLE_ENDIAN;
+  quint32 recordSize;
+  quint32 reserved = 0;
+  SER_FramesHeader();
+} __attribute__ ((__packed__));
+
+struct SER_FrameRecord {
+  /// Frame::sequence
+  quint64 sequence = 0;
+  /// Seconds
+  double exposure = 0;
+  FrameMetadata metadata;
+  SER_FrameRecord() = default;
+  SER_FrameRecord(const Frame &frame);
+} __attribute__ ((__packed__));
+
+static_assert(sizeof(SER_FramesHeader) == 24, "Wrong SER_FramesHeader size");
+static_assert(sizeof(SER_FrameRecord) == 56, "Wrong SER_FrameRecord size");
+
+/**
+ * Integrity side-car of a SER file ("<file>.ser.hashes"): this header, then the CRC32C of each SER frame pixels, in the same order,
+ * as little endian 32 bit values. Checked by ser_tool verify.
+ */
+struct SER_HashesHeader {
+  enum Algorithm : quint32 { CRC32C = 1 };
+  char fileId[8] = {'P', 'I', 'H', 'A', 'S', 'H', 'E', 'S'};
+  quint32 version = 1;
+  Algorithm algorithm = CRC32C;
+  quint32 recordSize = sizeof(quint32);
+  quint32 reserved = 0;
+} __attribute__ ((__packed__));
+
+static_assert(sizeof(SER_HashesHeader) == 24, "Wrong SER_HashesHeader size");
+
+/**
+ * Index of a SER recording striped across disks ("<file>.ser.stripes"): a "PISTRIPES 1" line, then the stripe files, one per line.
+ * Each stripe is a complete SER file, and frames go to the stripes in turn: frame n is frame n / stripes of stripe n % stripes.
+ * Relative stripe paths are relative to the index directory.
+ */
+struct SER_StripesIndex {
+  QStringList stripes;
+  /// Stripe, and frame in that stripe, of a recording frame (0 based)
+  std::pair<int, qint64> locate(qint64 frame) const;
+  bool save(const QString &filename, QString &error) const;
+  bool load(const QString &filename, QString &error);
+};
 #endif
@@ -0,0 +1,145 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "storageprobe.h"
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+const qint64 alignment = 4096;
+
+QMutex cache_mutex;
+QMap<QPair<QString, qint64>, StorageProbe::Result> cache;
+
+/// Timed writes of block, until duration or max_bytes; the writer returns false on errors
+template<typename Write, typename Sync>
+StorageProbe::Result timed_writes(const char *block, qint64 block_size, chrono::milliseconds duration, qint64 max_bytes, Write write, Sync sync)
+{
+  typedef chrono::steady_clock Clock;
+  StorageProbe::Result result;
+  result.block_size = block_size;
+  vector<double> latencies;
+  const auto started = Clock::now();
+  while(Clock::now() - started < duration && result.bytes + block_size <= max(max_bytes, block_size)) {
+    const auto write_started = Clock::now();
+    if(! write(block, block_size)) {
+      result.error = QString::fromLocal8Bit(strerror(errno));
+      return result;
+    }
+    latencies.push_back(chrono::duration<double, milli>{Clock::now() - write_started}.count());
+    result.bytes += block_size;
+  }
+  // Whatever is still in the page cache is part of the cost of writing it
+  if(! sync()) {
+    result.error = QString::fromLocal8Bit(strerror(errno));
+    return result;
+  }
+  const chrono::duration<double> elapsed = Clock::now() - started;
+  result.bytes_per_second = result.bytes / max(elapsed.count(), 1e-6);
+  result.latency_p99 = chrono::duration<double, milli>{StorageProbe::percentile(latencies, 99)};
+  return result;
+}
+}
+
+double StorageProbe::percentile(vector<double> values, double percent)
+{
+  if(values.empty())
+    return 0;
+  const size_t rank = static_cast<size_t>(ceil(percent / 100. * values.size()));
+  const size_t index = min(values.size() - 1, rank > 0 ? rank - 1 : 0);
+  nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+QString StorageProbe::device(const QString &directory)
+{
+#ifdef Q_OS_UNIX
+  struct stat info;
+  if(::stat(QFile::encodeName(directory).constData(), &info) == 0)
+    return QString::number(static_cast<qulonglong>(info.st_dev));
+#endif
+  return QDir{directory}.absolutePath();
+}
+
+StorageProbe::Result StorageProbe::cached(const QString &directory, qint64 block_size)
+{
+  QMutexLocker lock(&cache_mutex);
+  return cache.value({device(directory), block_size});
+}
+
+StorageProbe::Result StorageProbe::run(const QString &directory, qint64 block_size, chrono::milliseconds duration, qint64 max_bytes)
+{
+  Result result;
+  QTemporaryFile file{QDir{directory}.filePath(".planetaryimager-probe-XXXXXX")};
+  if(! file.open()) {
+    result.error = file.errorString();
+    return result;
+  }
+  // Frames are rarely page multiples: the padding is what direct I/O recordings pay too
+  const qint64 aligned_size = max(alignment, (block_size + alignment - 1) / alignment * alignment);
+  vector<char> buffer(aligned_size + alignment);
+  char *block = buffer.data() + (alignment - reinterpret_cast<quintptr>(buffer.data()) % alignment) % alignment;
+  // Not zeros: some filesystems and controllers compress them away
+  quint32 seed = 2463534242u;
+  for(qint64 index = 0; index < aligned_size; index++) {
+    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+    block[index] = static_cast<char>(seed);
+  }
+#ifdef Q_OS_LINUX
+  file.close();
+  const auto path = QFile::encodeName(file.fileName());
+  int fd = ::open(path.constData(), O_WRONLY | O_TRUNC | O_DIRECT);
+  if(fd == -1 && errno == EINVAL)
+    fd = ::open(path.constData(), O_WRONLY | O_TRUNC);
+  if(fd == -1) {
+    result.error = QString::fromLocal8Bit(strerror(errno));
+    return result;
+  }
+  result = timed_writes(block, aligned_size, duration, max_bytes,
+    [fd](const char *data, qint64 size) { return ::write(fd, data, size) == size; },
+    [fd] { return ::fdatasync(fd) == 0; });
+  ::close(fd);
+#else
+  result = timed_writes(block, aligned_size, duration, max_bytes,
+    [&file](const char *data, qint64 size) { return file.write(data, size) == size; },
+    [&file] { return file.flush(); });
+#endif
+  if(result.valid()) {
+    QMutexLocker lock(&cache_mutex);
+    cache[{device(directory), block_size}] = result;
+  }
+  return result;
+}
@@ -0,0 +1,62 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STORAGEPROBE_H
+#define STORAGEPROBE_H
+
+#include <QString>
+#include <QtGlobal>
+#include <chrono>
+#include <vector>
+
+/**
+ * Quick check of what a recording directory can sustain, before recording there: a few seconds of page aligned writes
+ * of the frame size to a temporary file (O_DIRECT on Linux where supported, buffered and synced at the end elsewhere),
+ * measuring the throughput, including the final sync, and the 99th percentile of the write latencies.
+ * Results are kept for the process lifetime, per device of the directory and block size: recordings on the same disk reuse them.
+ */
+namespace StorageProbe {
+  struct Result {
+    double bytes_per_second = 0;
+    std::chrono::duration<double, std::milli> latency_p99{0};
+    qint64 block_size = 0;
+    qint64 bytes = 0;
+    QString error;
+    bool valid() const { return error.isEmpty() && bytes_per_second > 0; }
+  };
+
+  /// Writes for duration at most, and max_bytes at most. Blocking: meant for a background thread
+  Result run(const QString &directory, qint64 block_size, std::chrono::milliseconds duration = std::chrono::seconds{3}, qint64 max_bytes = 2ll * 1024 * 1024 * 1024);
+  /// Last valid result for the device of directory and this block size; an invalid result if it wasn't probed yet
+  Result cached(const QString &directory, qint64 block_size);
+  /// Device directory is on (st_dev on Unix), the directory itself elsewhere
+  QString device(const QString &directory);
+
+  /// Bandwidth needed to record frames of frame_size bytes at fps
+  inline double required_bytes_per_second(double fps, qint64 frame_size) { return fps * frame_size; }
+  /// Enough bandwidth, with some headroom for the other writes and the disk getting slower as it fills up
+  const double headroom = 1.2;
+  inline bool sustains(const Result &result, double required_bytes_per_second) { return result.bytes_per_second >= required_bytes_per_second * headroom; }
+  /// Highest frame rate sustained for frames of frame_size bytes
+  inline double sustained_fps(const Result &result, qint64 frame_size) { return frame_size > 0 ? result.bytes_per_second / headroom / frame_size : 0; }
+  /// Nearest rank percentile, 0 for no values
+  double percentile(std::vector<double> values, double percent);
+}
+
+#endif // STORAGEPROBE_H
@@ -0,0 +1,175 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "threadplacement.h"
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+using namespace std;
+
+QList<int> ThreadPlacement::parse_cpu_list(const QString &list)
+{
+  QList<int> cpus;
+  for(auto range: list.trimmed().split(',', QString::SkipEmptyParts)) {
+    auto bounds = range.split('-');
+    bool first_ok = false, last_ok = false;
+    const int first = bounds[0].toInt(&first_ok);
+    const int last = bounds.size() == 2 ? bounds[1].toInt(&last_ok) : first;
+    if(! first_ok || (bounds.size() == 2 && ! last_ok) || bounds.size() > 2)
+      continue;
+    for(int cpu = first; cpu <= last; cpu++)
+      if(! cpus.contains(cpu))
+        cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+ThreadPlacement::Topology ThreadPlacement::Topology::system()
+{
+  Topology topology;
+  topology.cpus = max(1, QThread::idealThreadCount());
+#ifdef Q_OS_LINUX
+  QFile isolated{"/sys/devices/system/cpu/isolated"};
+  if(isolated.open(QIODevice::ReadOnly))
+    topology.isolated = parse_cpu_list(QString::fromLatin1(isolated.readAll()));
+  for(int cpu = 0; cpu < topology.cpus; cpu++) {
+    auto nodes = QDir{QString{"/sys/devices/system/cpu/cpu%1"}.arg(cpu)}.entryList({"node*"}, QDir::Dirs);
+    topology.nodes.push_back(nodes.isEmpty() ? 0 : nodes.first().mid(4).toInt());
+  }
+#endif
+  return topology;
+}
+
+ThreadPlacement::Placement ThreadPlacement::resolve(const Settings &settings, const Topology &topology)
+{
+  auto valid = [&](int cpu) { return cpu >= 0 && cpu < topology.cpus ? cpu : -1; };
+  Placement placement;
+  placement.capture = valid(settings.capture);
+  placement.recording = valid(settings.recording);
+  if(valid(settings.display) >= 0)
+    placement.display = {settings.display};
+  if(valid(settings.network) >= 0)
+    placement.network = {settings.network};
+  // With two CPUs or less there's nothing left to keep apart
+  if(! settings.automatic || topology.cpus < 3)
+    return placement;
+
+  auto taken = [&](int cpu) { return cpu == placement.capture || cpu == placement.recording; };
+  auto isolated = [&](int cpu) { return topology.isolated.contains(cpu); };
+  // Highest numbers first: CPU 0 gets most of the interrupts
+  auto pick = [&](const function<bool(int)> &accept) {
+    for(int cpu = topology.cpus - 1; cpu >= 0; cpu--)
+      if(! taken(cpu) && accept(cpu))
+        return cpu;
+    return -1;
+  };
+  if(placement.capture < 0) {
+    auto first_isolated = find_if(topology.isolated.begin(), topology.isolated.end(), [&](int cpu) { return valid(cpu) >= 0 && ! taken(cpu); });
+    placement.capture = first_isolated != topology.isolated.end() ? *first_isolated : pick([](int) { return true; });
+  }
+  if(placement.recording < 0) {
+    const int node = topology.node(placement.capture);
+    for(auto accept: QList<function<bool(int)>>{
+      [&](int cpu) { return isolated(cpu) && topology.node(cpu) == node; },
+      [&](int cpu) { return topology.node(cpu) == node; },
+      [](int) { return true; },
+    }) {
+      if((placement.recording = pick(accept)) >= 0)
+        break;
+    }
+  }
+  QList<int> others;
+  for(int cpu = 0; cpu < topology.cpus; cpu++)
+    if(! taken(cpu) && ! isolated(cpu))
+      others.push_back(cpu);
+  if(placement.display.isEmpty())
+    placement.display = others;
+  if(placement.network.isEmpty())
+    placement.network = others;
+  return placement;
+}
+
+void ThreadPlacement::apply(const QString &name, const QList<int> &cpus, bool realtime)
+{
+#ifdef Q_OS_LINUX
+  // SCHED_FIFO needs CAP_SYS_NICE (or an rtprio limit): without it, fall back to the highest normal priority
+  if(realtime) {
+    sched_param parameters{};
+    parameters.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    if(int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters)) {
+      qWarning() << "Unable to set real time priority for the" << name << "thread:" << strerror(error);
+      QThread::currentThread()->setPriority(QThread::TimeCriticalPriority);
+    }
+  }
+  // What the thread had before we pinned it (i.e. from taskset): given back when it doesn't need a place anymore
+  static thread_local bool pinned = false;
+  static thread_local cpu_set_t original;
+  if(cpus.isEmpty()) {
+    if(pinned && pthread_setaffinity_np(pthread_self(), sizeof(original), &original) == 0)
+      pinned = false;
+    return;
+  }
+  if(! pinned && pthread_getaffinity_np(pthread_self(), sizeof(original), &original) != 0)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(auto cpu: cpus)
+    CPU_SET(cpu, &set);
+  if(int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    qWarning() << "Unable to pin the" << name << "thread to CPUs" << cpus << ":" << strerror(error);
+  else
+    pinned = true;
+#elif defined(Q_OS_WIN)
+  // TimeCriticalPriority is THREAD_PRIORITY_TIME_CRITICAL
+  if(realtime)
+    QThread::currentThread()->setPriority(QThread::TimeCriticalPriority);
+  static thread_local DWORD_PTR original = 0;
+  DWORD_PTR mask = 0;
+  for(auto cpu: cpus)
+    if(cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+      mask |= DWORD_PTR{1} << cpu;
+  if(! mask) {
+    if(original && SetThreadAffinityMask(GetCurrentThread(), original))
+      original = 0;
+    return;
+  }
+  auto previous = SetThreadAffinityMask(GetCurrentThread(), mask);
+  if(! previous)
+    qWarning() << "Unable to pin the" << name << "thread to CPUs" << cpus;
+  else if(! original)
+    original = previous;
+#else
+  if(realtime)
+    QThread::currentThread()->setPriority(QThread::TimeCriticalPriority);
+  if(! cpus.isEmpty())
+    qWarning() << "Pinning the" << name << "thread to CPUs is only supported on Linux and Windows";
+#endif
+}
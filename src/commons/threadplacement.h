@@ -0,0 +1,78 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+#include <QList>
+#include <QString>
+
+/**
+ * CPUs for the long running threads: capture, recording writer, display and network encoders.
+ *
+ * Each role goes where its *_thread_cpu setting says (-1: anywhere). With automatic placement, the roles left anywhere get:
+ *  - capture: the first CPU isolated from the scheduler (isolcpus), otherwise the last CPU;
+ *  - recording: another CPU on the capture NUMA node (isolated ones first), so that it reads the frames from local memory;
+ *  - display and network: all the CPUs left, away from the two above and from the isolated ones.
+ * Frame buffers are allocated and first written on the capture thread: with Linux first touch allocation they're local to its node already.
+ */
+namespace ThreadPlacement {
+  struct Settings {
+    int capture = -1;
+    int recording = -1;
+    int display = -1;
+    int network = -1;
+    bool automatic = false;
+  };
+
+  struct Topology {
+    int cpus = 1;
+    QList<int> isolated;
+    /// NUMA node of each CPU (empty: a single node)
+    QList<int> nodes;
+    int node(int cpu) const { return cpu >= 0 && cpu < nodes.size() ? nodes[cpu] : 0; }
+    /// This machine, from /sys on Linux
+    static Topology system();
+  };
+
+  struct Placement {
+    int capture = -1;
+    int recording = -1;
+    QList<int> display;
+    QList<int> network;
+    bool operator==(const Placement &other) const {
+      return capture == other.capture && recording == other.recording && display == other.display && network == other.network;
+    }
+  };
+
+  Placement resolve(const Settings &settings, const Topology &topology);
+
+  /// Linux CPU list format, as in /sys/devices/system/cpu/isolated ("0-2,5")
+  QList<int> parse_cpu_list(const QString &list);
+
+  /**
+   * Pins the calling thread to cpus, with real time priority if asked (Linux: SCHED_FIFO, falling back to the highest normal priority;
+   * elsewhere: QThread::TimeCriticalPriority). Empty cpus give back the affinity the thread had before it was first pinned.
+   * name is only used in warnings.
+   */
+  void apply(const QString &name, const QList<int> &cpus, bool realtime = false);
+  inline QList<int> cpu(int cpu) { return cpu >= 0 ? QList<int>{cpu} : QList<int>{}; }
+}
+
+#endif // THREADPLACEMENT_H
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QMap>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDebug>
+#include <QVariant>
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+DPTR_IMPL(Tracing) {
+  static constexpr quint64 RING_SIZE = 1 << 16;
+  struct Event {
+    // Index of the span in this slot, plus one; 0 while it's being written
+    atomic<quint64> sequence;
+    atomic<const char *> name;
+    atomic<quint64> frame;
+    atomic<qint64> begin_ns;
+    atomic<qint64> duration_ns;
+    atomic<int> thread;
+  };
+  // Allocated the first time tracing is enabled, and never released: spans may still be recorded while it's being disabled
+  atomic<Event *> ring{nullptr};
+  atomic<quint64> next{0};
+  const Clock::time_point epoch = Clock::now();
+  QMutex threads_mutex;
+  QMap<int, QString> threads;
+  int thread_id();
+};
+
+constexpr quint64 Tracing::Private::RING_SIZE;
+
+Tracing::Tracing() : dptr()
+{
+}
+
+Tracing::~Tracing()
+{
+}
+
+Tracing &Tracing::instance()
+{
+  // Drivers are plugins, each one with its own copy of this library: they all share the tracer of the application loading them
+  static Tracing *tracing = []{
+    auto app = QCoreApplication::instance();
+    if(! app)
+      return new Tracing;
+    auto shared = app->property("planetaryimager_tracing");
+    if(shared.isValid())
+      return reinterpret_cast<Tracing *>(shared.value<quintptr>());
+    auto created = new Tracing;
+    app->setProperty("planetaryimager_tracing", QVariant::fromValue<quintptr>(reinterpret_cast<quintptr>(created)));
+    return created;
+  }();
+  return *tracing;
+}
+
+void Tracing::set_enabled(bool enabled)
+{
+  if(enabled && ! d->ring.load()) {
+    auto ring = new Private::Event[Private::RING_SIZE];
+    for(quint64 i = 0; i < Private::RING_SIZE; i++)
+      ring[i].sequence.store(0, memory_order_relaxed);
+    Private::Event *expected = nullptr;
+    if(! d->ring.compare_exchange_strong(expected, ring))
+      delete [] ring;
+  }
+  _enabled = enabled;
+}
+
+int Tracing::Private::thread_id()
+{
+  static atomic_int threads_count{0};
+  thread_local int id = 0;
+  if(id == 0) {
+    id = ++threads_count;
+    auto name = QThread::currentThread() ? QThread::currentThread()->objectName() : QString{};
+    QMutexLocker lock(&threads_mutex);
+    threads[id] = name.isEmpty() ? "thread %1"_q % id : name;
+  }
+  return id;
+}
+
+void Tracing::record(const char *name, quint64 frame, const Clock::time_point &begin, const Clock::time_point &end)
+{
+  auto ring = d->ring.load(memory_order_acquire);
+  if(! ring)
+    return;
+  auto index = d->next.fetch_add(1, memory_order_relaxed);
+  auto &event = ring[index % Private::RING_SIZE];
+  event.sequence.store(0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  event.name.store(name, memory_order_relaxed);
+  event.frame.store(frame, memory_order_relaxed);
+  event.begin_ns.store(chrono::duration_cast<chrono::nanoseconds>(begin - d->epoch).count(), memory_order_relaxed);
+  event.duration_ns.store(chrono::duration_cast<chrono::nanoseconds>(end - begin).count(), memory_order_relaxed);
+  event.thread.store(d->thread_id(), memory_order_relaxed);
+  event.sequence.store(index + 1, memory_order_release);
+}
+
+QByteArray Tracing::chrome_trace() const
+{
+  QJsonArray events;
+  {
+    QMutexLocker lock(&d->threads_mutex);
+    for(auto it = d->threads.begin(); it != d->threads.end(); ++it)
+      events.append(QJsonObject{
+        {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", it.key()}, {"args", QJsonObject{{"name", it.value()}}},
+      });
+  }
+  if(auto ring = d->ring.load(memory_order_acquire)) {
+    const auto next = d->next.load(memory_order_relaxed);
+    for(auto index = next > Private::RING_SIZE ? next - Private::RING_SIZE : 0; index < next; index++) {
+      const auto &event = ring[index % Private::RING_SIZE];
+      const auto sequence = event.sequence.load(memory_order_acquire);
+      const char *name = event.name.load(memory_order_relaxed);
+      const auto frame = event.frame.load(memory_order_relaxed);
+      const auto begin_ns = event.begin_ns.load(memory_order_relaxed);
+      const auto duration_ns = event.duration_ns.load(memory_order_relaxed);
+      const auto thread = event.thread.load(memory_order_relaxed);
+      atomic_thread_fence(memory_order_acquire);
+      // Still being written, or already overwritten by a newer span
+      if(sequence != index + 1 || event.sequence.load(memory_order_relaxed) != sequence)
+        continue;
+      events.append(QJsonObject{
+        {"name", name},
+        {"cat", "frame"},
+        {"ph", "X"},
+        {"pid", 1},
+        {"tid", thread},
+        {"ts", begin_ns / 1000.},
+        {"dur", duration_ns / 1000.},
+        {"args", QJsonObject{{"frame", static_cast<qint64>(frame)}}},
+      });
+    }
+  }
+  return QJsonDocument{QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}}}.toJson(QJsonDocument::Compact);
+}
+
+bool Tracing::dump(const QString &path) const
+{
+  QFile file{path};
+  if(! file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(chrome_trace()) < 0) {
+    qWarning() << "Unable to write pipeline trace to" << path << ":" << file.errorString();
+    return false;
+  }
+  qDebug() << "Pipeline trace written to" << path;
+  return true;
+}
+
+Tracing::Session::Session(const QString &path) : path{path}
+{
+  if(! path.isEmpty())
+    Tracing::instance().set_enabled(true);
+}
+
+Tracing::Session::~Session()
+{
+  if(path.isEmpty())
+    return;
+  Tracing::instance().set_enabled(false);
+  Tracing::instance().dump(path);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+#include <chrono>
+#include "c++/dptr.h"
+
+/**
+ * Optional per-frame pipeline tracing, exported in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+ * Spans are tagged with the frame sequence number, so that each frame can be followed across capture, handlers, recording and network.
+ * The latest spans are kept in a fixed size ring: recording a span is a handful of relaxed atomic stores, and nothing at all while disabled.
+ */
+class Tracing
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /// Records a span from construction to destruction, if tracing is enabled. name must outlive the trace (i.e. a literal).
+  class Span {
+  public:
+    Span(const char *name, quint64 frame) : name{name}, frame{frame}, active{Tracing::instance().enabled()} {
+      if(active)
+        begin = Clock::now();
+    }
+    ~Span() {
+      if(active)
+        Tracing::instance().record(name, frame, begin, Clock::now());
+    }
+  private:
+    const char *name;
+    const quint64 frame;
+    const bool active;
+    Clock::time_point begin;
+  };
+
+  /// Enables tracing for its lifetime, and writes the trace to path when destroyed (nothing happens for an empty path)
+  class Session {
+  public:
+    Session(const QString &path);
+    ~Session();
+  private:
+    const QString path;
+  };
+
+  /// Shared by the application and the drivers it loads
+  static Tracing &instance();
+  bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+  void set_enabled(bool enabled);
+  void record(const char *name, quint64 frame, const Clock::time_point &begin, const Clock::time_point &end);
+  /// The spans still in the ring, oldest first, as Chrome trace JSON
+  QByteArray chrome_trace() const;
+  bool dump(const QString &path) const;
+private:
+  Tracing();
+  ~Tracing();
+  std::atomic_bool _enabled{false};
+  DPTR
+};
+
+#endif // TRACING_H
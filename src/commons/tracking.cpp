@@ -19,8 +19,14 @@
 #include <opencv2/opencv.hpp>
 #include <QDebug>
 #include <QtCore/qrect.h>
+#include <memory>
 #include <mutex>
-#include <numeric>
+#include <thread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+#include <functional>
 #include <vector>
 
 #include "tracking.h"
@@ -32,131 +38,386 @@ cv::Rect toCvRect(const QRect &qr)
 }
 
 
-/// Finds new position of 'refBlock' in 'img' using block matching
-QPoint findNewPos(const QPoint &oldPos, ///< Old position of 'refBlock's center in 'img'
-                  cv::Mat refBlock,
-                  cv::Mat img)
+namespace
 {
-    // At first using a coarse step when trying to match 'refBlock'
-    // with 'img' at different positions. Once an approximate matching
-    // position is determined, the search continues around it repeatedly
-    // using a smaller step, until the step becomes 1.
-    unsigned searchStep = 4;
-    const int searchRadius = 32; // TODO: make it configurable
+/// Pyramid levels above full resolution used by block matching; each one halves the resolution
+constexpr int BLOCK_MATCHING_PYRAMID_LEVELS = 2;
+constexpr int BLOCK_MATCHING_SEARCH_RADIUS = 32; // TODO: make it configurable
+/// Search radius around the match found on the coarser level, in pixels of the current level
+constexpr int BLOCK_MATCHING_REFINE_RADIUS = 2;
+
+/// Floating point image and its BLOCK_MATCHING_PYRAMID_LEVELS downscaled versions
+std::vector<cv::Mat> buildPyramid(const cv::Mat &image)
+{
+    std::vector<cv::Mat> levels(1);
+    image.convertTo(levels[0], CV_32F);
+    for (int level = 0; level < BLOCK_MATCHING_PYRAMID_LEVELS; level++)
+    {
+        cv::Mat downscaled;
+        cv::pyrDown(levels.back(), downscaled);
+        levels.push_back(downscaled);
+    }
+    return levels;
+}
 
-    // Range of positions where 'refBlock' will be match-tested with 'img'.
-    struct
+/// Top-left position of the best match of 'templ' in 'image' (minimum sum of squared differences)
+cv::Point bestMatch(const cv::Mat &image, const cv::Mat &templ)
+{
+    cv::Mat result;
+    cv::matchTemplate(image, templ, result, cv::TM_SQDIFF);
+    cv::Point best;
+    cv::minMaxLoc(result, nullptr, nullptr, &best);
+    return best;
+}
+
+class ParallelTargets: public cv::ParallelLoopBody
+{
+public:
+    ParallelTargets(const std::function<void(int)> &body): body(body) { }
+    void operator()(const cv::Range &range) const override
     {
-        int xmin, ymin; // inclusive
-        int xmax, ymax; // exclusive
-    } searchRange = { .xmin = oldPos.x() - searchRadius,
-                      .ymin = oldPos.y() - searchRadius,
-                      .xmax = oldPos.x() + searchRadius,
-                      .ymax = oldPos.y() + searchRadius };
+        for (int i = range.start; i < range.end; i++)
+            body(i);
+    }
+private:
+    std::function<void(int)> body;
+};
+}
 
-    const int rbwidth = refBlock.cols;
-    const int rbheight = refBlock.rows;
 
-    QPoint bestPos{ 0, 0 };
+struct BlockMatchingTarget
+{
+    /// Target position; corresponds with the middle of 'refBlock'
+    QPoint pos;
+    cv::Mat refBlock; ///< Reference block
+    std::vector<cv::Mat> refPyramid; ///< 'refBlock' pyramid, as built by buildPyramid()
+};
 
-    cv::Mat absDiff = cv::Mat(refBlock.rows, refBlock.cols, refBlock.type());
 
-    while (searchStep)
-    {
-        // Min. sum of absolute differences between pixel values of
-        // the reference block and the image at candidate positions.
-        double minDiffSum = DBL_MAX;
+/// Finds new position of 'target' in 'img' using block matching
+/** The whole search area is matched at the coarsest pyramid level only; each finer level then just
+    refines the position around the previous match. Returns 'false' if the search area no longer fits
+    the reference block (target moved outside the image). */
+bool findNewPos(BlockMatchingTarget &target, const cv::Mat &img)
+{
+    const cv::Size blockSize = target.refBlock.size();
+    const cv::Rect searchArea = cv::Rect{ target.pos.x() - BLOCK_MATCHING_SEARCH_RADIUS - blockSize.width/2,
+                                          target.pos.y() - BLOCK_MATCHING_SEARCH_RADIUS - blockSize.height/2,
+                                          blockSize.width + 2 * BLOCK_MATCHING_SEARCH_RADIUS,
+                                          blockSize.height + 2 * BLOCK_MATCHING_SEARCH_RADIUS }
+                                & cv::Rect{ 0, 0, img.cols, img.rows };
+    if (searchArea.width < blockSize.width || searchArea.height < blockSize.height)
+        return false;
 
-        // (x, y) = position in 'img' for which a block match test is performed
-        for (int y = searchRange.ymin; y < searchRange.ymax;  y += searchStep)
-            for (int x = searchRange.xmin; x < searchRange.xmax;  x += searchStep)
-            {
-                cv::absdiff(refBlock,
-                            cv::Mat(img, cv::Rect{ x - rbwidth/2, y - rbheight/2, rbwidth, rbheight }),
-                            absDiff);
+    const auto levels = buildPyramid(cv::Mat(img, searchArea));
+    cv::Point best = bestMatch(levels.back(), target.refPyramid.back());
+    for (int level = BLOCK_MATCHING_PYRAMID_LEVELS - 1; level >= 0; level--)
+    {
+        const cv::Mat &image = levels[level];
+        const cv::Mat &templ = target.refPyramid[level];
+        best *= 2;
+        cv::Rect refineArea = cv::Rect{ best.x - BLOCK_MATCHING_REFINE_RADIUS, best.y - BLOCK_MATCHING_REFINE_RADIUS,
+                                        templ.cols + 2 * BLOCK_MATCHING_REFINE_RADIUS, templ.rows + 2 * BLOCK_MATCHING_REFINE_RADIUS }
+                              & cv::Rect{ 0, 0, image.cols, image.rows };
+        if (refineArea.width < templ.cols || refineArea.height < templ.rows)
+            refineArea = cv::Rect{ 0, 0, image.cols, image.rows };
+        best = refineArea.tl() + bestMatch(cv::Mat(image, refineArea), templ);
+    }
 
-                const auto sumAbsDiffChannels = cv::sum(absDiff);
-                const double sumAbsDiffs = std::accumulate(sumAbsDiffChannels.val, sumAbsDiffChannels.val + 4, 0.0);
+    target.pos = QPoint{ searchArea.x + best.x + blockSize.width/2, searchArea.y + best.y + blockSize.height/2 };
+    return true;
+}
 
-                if (sumAbsDiffs < minDiffSum)
-                {
-                    minDiffSum = sumAbsDiffs;
-                    bestPos = QPoint{ x, y };
-                }
-            }
 
-        searchRange.xmin = bestPos.x() - searchStep;
-        searchRange.ymin = bestPos.y() - searchStep;
-        searchRange.xmax = bestPos.x() + searchStep;
-        searchRange.ymax = bestPos.y() + searchStep;
+namespace
+{
+template<typename T>
+QPointF thresholdedCentroid(const cv::Mat &img, int step)
+{
+    const int channels = img.channels();
+    auto brightness = [channels](const T *pixel) {
+        uint32_t value = 0;
+        for (int channel = 0; channel < channels; channel++)
+            value += pixel[channel];
+        return value;
+    };
+
+    // Background level: the mean brightness of the area. Only what is above it contributes to the moments,
+    // so that sky glow and noise don't pull the centroid towards the centre of the area.
+    uint64_t total = 0;
+    uint64_t samples = 0;
+    for (int y = 0; y < img.rows; y += step)
+    {
+        const T *row = img.ptr<T>(y);
+        for (int x = 0; x < img.cols; x += step, samples++)
+            total += brightness(row + x * channels);
+    }
+    const uint32_t background = samples ? total / samples : 0;
 
-        searchStep /= 2;
+    // Integer moments; the inner loop has no dependency between pixels, so that it can be vectorised
+    uint64_t m00 = 0, m10 = 0, m01 = 0;
+    for (int y = 0; y < img.rows; y += step)
+    {
+        const T *row = img.ptr<T>(y);
+        uint64_t rowSum = 0, rowMoment = 0;
+        for (int x = 0; x < img.cols; x += step)
+        {
+            const uint32_t value = brightness(row + x * channels);
+            const uint32_t weight = value > background ? value - background : 0;
+            rowSum += weight;
+            rowMoment += static_cast<uint64_t>(weight) * x;
+        }
+        m00 += rowSum;
+        m10 += rowMoment;
+        m01 += rowSum * y;
     }
+    if (m00 == 0)
+        return QPointF{ (img.cols - 1) / 2.0, (img.rows - 1) / 2.0 };
+    return QPointF{ static_cast<double>(m10) / m00, static_cast<double>(m01) / m00 };
+}
+
+/// Centroid areas are subsampled down to about this many pixels per side
+constexpr int CENTROID_MAX_SAMPLES_SIDE = 256;
+
+int centroidStep(const QRect &area)
+{
+    return std::max(1, std::max(area.width(), area.height()) / CENTROID_MAX_SAMPLES_SIDE);
+}
+}
 
-    return bestPos;
+
+QPointF findCentroidSubpixel(const cv::Mat &img, int step)
+{
+    step = std::max(step, 1);
+    if (img.depth() == CV_16U || img.depth() == CV_16S)
+        return thresholdedCentroid<uint16_t>(img, step);
+    return thresholdedCentroid<uint8_t>(img, step);
 }
 
 
 QPoint findCentroid(cv::Mat img)
 {
+    return findCentroidSubpixel(img).toPoint();
+}
+
+
+FrameConstPtr cropAroundCentroid(const FrameConstPtr &frame, int size)
+{
+    const cv::Mat img = frame->mat();
+    const int width = std::min(size, img.cols);
+    const int height = std::min(size, img.rows);
+    if (width == img.cols && height == img.rows)
+        return frame;
+
+    const QPoint centroid = findCentroid(img);
+    int x = std::max(0, std::min(centroid.x() - width / 2, img.cols - width));
+    int y = std::max(0, std::min(centroid.y() - height / 2, img.rows - height));
+    switch (frame->colorFormat())
+    {
+    case Frame::Bayer_RGGB:
+    case Frame::Bayer_GRBG:
+    case Frame::Bayer_GBRG:
+    case Frame::Bayer_BGGR:
+        // Even offsets keep the bayer pattern of the cropped frame unchanged
+        x &= ~1;
+        y &= ~1;
+        break;
+    default:
+        break;
+    }
+    return frame->cropped(cv::Rect{ x, y, width, height });
+}
+
+
+namespace
+{
+/// Phase correlation peaks below this are noise: the surface no longer matches the reference
+constexpr double PHASE_CORRELATION_MIN_RESPONSE = 0.02;
+}
+
+
+PhaseCorrelation::PhaseCorrelation(int maxSide): maxSide(std::max(maxSide, 16))
+{
+}
+
+
+void PhaseCorrelation::spectrum(const cv::Mat &img, cv::Mat &output)
+{
+    // Colour frames as brightness; raw Bayer data is averaged out by the downsampling
+    const cv::Mat *source = &img;
     if (img.channels() > 1)
-        cv::cvtColor(img, img, cv::COLOR_RGB2GRAY);
-
-    const auto moments = cv::moments(img);
-    if (moments.m00 == 0.0)
-        return QPoint{ 0, 0 };
-    else
-        return QPoint{ static_cast<int>(moments.m10 / moments.m00),
-                       static_cast<int>(moments.m01 / moments.m00) };
+    {
+        cv::cvtColor(img, gray, img.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        source = &gray;
+    }
+    cv::resize(*source, small, smallSize, 0, 0, cv::INTER_AREA);
+    small.convertTo(smallFloat, CV_32F);
+    // No DC, and no edges: the window fades the frame borders out, so that they don't correlate with themselves
+    cv::subtract(smallFloat, cv::mean(smallFloat), smallFloat);
+    cv::multiply(smallFloat, window, smallFloat);
+    cv::copyMakeBorder(smallFloat, padded, 0, padded.rows - smallSize.height, 0, padded.cols - smallSize.width, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::dft(padded, output, cv::DFT_COMPLEX_OUTPUT);
 }
 
 
-struct BlockMatchingTarget
+bool PhaseCorrelation::setReference(const cv::Mat &img)
 {
-    /// Target position; corresponds with the middle of 'refBlock'
-    QPoint pos;
-    cv::Mat refBlock; ///< Reference block
-};
+    reference.release();
+    if (img.cols < 16 || img.rows < 16)
+        return false;
+    frameSize = img.size();
+    const double scale = std::min(1.0, static_cast<double>(maxSide) / std::max(img.cols, img.rows));
+    smallSize = cv::Size{ std::max(8, cvRound(img.cols * scale)), std::max(8, cvRound(img.rows * scale)) };
+    cv::createHanningWindow(window, smallSize, CV_32F);
+    padded.create(cv::getOptimalDFTSize(smallSize.height), cv::getOptimalDFTSize(smallSize.width), CV_32F);
+    spectrum(img, reference);
+    return true;
+}
+
+
+bool PhaseCorrelation::findShift(const cv::Mat &img, cv::Point2d &shift, double &response)
+{
+    if (reference.empty() || img.size() != frameSize)
+        return false;
+
+    spectrum(img, current);
+    // Normalised cross power spectrum: a single peak at the shift once transformed back
+    cv::mulSpectrums(current, reference, crossPower, 0, true);
+    for (int y = 0; y < crossPower.rows; y++)
+    {
+        cv::Vec2f *row = crossPower.ptr<cv::Vec2f>(y);
+        for (int x = 0; x < crossPower.cols; x++)
+        {
+            const float magnitude = std::sqrt(row[x][0] * row[x][0] + row[x][1] * row[x][1]) + 1e-12f;
+            row[x] /= magnitude;
+        }
+    }
+    cv::idft(crossPower, correlation, cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+
+    cv::Point peak;
+    cv::minMaxLoc(correlation, nullptr, &response, nullptr, &peak);
+
+    // Sub-pixel peak: centroid of the 3x3 neighbourhood, wrapping around the edges as the correlation does
+    double sum = 0, sumX = 0, sumY = 0;
+    for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            const int x = (peak.x + dx + correlation.cols) % correlation.cols;
+            const int y = (peak.y + dy + correlation.rows) % correlation.rows;
+            const double value = std::max(0.0f, correlation.at<float>(y, x));
+            sum += value;
+            sumX += value * dx;
+            sumY += value * dy;
+        }
+    cv::Point2d smallShift{ static_cast<double>(peak.x), static_cast<double>(peak.y) };
+    if (sum > 0)
+        smallShift += cv::Point2d{ sumX / sum, sumY / sum };
+    // Peaks past the middle are negative shifts
+    if (smallShift.x > correlation.cols / 2.0)
+        smallShift.x -= correlation.cols;
+    if (smallShift.y > correlation.rows / 2.0)
+        smallShift.y -= correlation.rows;
+
+    shift = cv::Point2d{ smallShift.x * frameSize.width / smallSize.width, smallShift.y * frameSize.height / smallSize.height };
+    return true;
+}
 
 
 DPTR_IMPL(ImgTracker)
 {
+    ImgTracker *q;
     TrackingMode mode = TrackingMode::Disabled;
 
-    std::mutex guard; ///< Synchronizes accesses to 'targets' and 'centroid'
+    std::mutex guard; ///< Synchronizes accesses to 'mode', 'targets' and 'centroid' between the worker and the setters
     std::vector<BlockMatchingTarget> targets;
     struct
     {
         /// Fragment of the image to calculate the centroid for
         /** Keeps its position (upper-left corner) constant relative to 'pos'. */
         QRect area;
-        QPoint pos; ///< Desired position of the 'area's centroid relative to area's origin
+        QPointF pos; ///< Desired position of the 'area's centroid relative to area's origin
+        QPointF position; ///< Last centroid position in the frame, with sub-pixel accuracy
     } centroid;
 
+    struct
+    {
+        PhaseCorrelation correlation;
+        QPointF origin; ///< Centre of the reference frame
+        QPointF position; ///< Where the reference frame centre is now
+    } phase;
+
     /** Initially equals (0, 0) and corresponds to the first element in 'targets'. If the first element
         later gets removed, the value will change to the new first element's coordinates and will be
         updated with it, so that GetTrackingPosition()'s result does not suddenly change. */
     QPoint blockMatchingReportedOffset = QPoint{ 0, 0 };
 
-    FrameConstPtr prevFrame;
+    /// Tracking state as last published by the worker or the setters; read without locking
+    struct Snapshot
+    {
+        TrackingMode mode;
+        std::vector<QPoint> positions;
+        QRect centroidArea;
+        QPointF centroidPos;
+        QPointF centroidPosition;
+        QPoint blockMatchingReportedOffset;
+        QPointF phasePosition;
+    };
+    std::shared_ptr<const Snapshot> snapshot = std::make_shared<const Snapshot>(Snapshot{ TrackingMode::Disabled, {}, {}, {}, {}, {}, {} });
+    /// Publishes the current state; must be called with 'guard' held
+    void publish();
+
+    // Single slot mailbox: a frame arriving while the previous one is tracked replaces the waiting one
+    QMutex mailbox_mutex;
+    QWaitCondition mailbox_changed;
+    FrameConstPtr pending;
+    FrameConstPtr prevFrame; ///< Last received frame, also under 'mailbox_mutex'
+    bool running = true;
+    FrameConstPtr lastFrame();
+    void run();
+    void track(const FrameConstPtr &frame);
+    std::thread worker;
 };
 
 #define LOCK()  std::lock_guard<std::mutex> lock(d->guard)
 
 
-ImgTracker::ImgTracker(): dptr()
+ImgTracker::ImgTracker(): dptr(this)
 {
+    d->worker = std::thread{ &Private::run, d.get() };
 }
 
 
 ImgTracker::~ImgTracker()
 {
+    {
+        QMutexLocker lock(&d->mailbox_mutex);
+        d->running = false;
+    }
+    d->mailbox_changed.wakeAll();
+    d->worker.join();
+}
+
+
+void ImgTracker::Private::publish()
+{
+    Snapshot next{ mode, {}, centroid.area, centroid.pos, centroid.position, blockMatchingReportedOffset, phase.position };
+    for (const auto &target: targets)
+        next.positions.push_back(target.pos);
+    std::atomic_store(&snapshot, std::make_shared<const Snapshot>(std::move(next)));
+}
+
+
+FrameConstPtr ImgTracker::Private::lastFrame()
+{
+    QMutexLocker lock(&mailbox_mutex);
+    return prevFrame;
 }
 
 
 bool ImgTracker::addBlockMatchingTarget(const QPoint &pos)
 {
-    if (!d->prevFrame)
+    const auto prevFrame = d->lastFrame();
+    if (!prevFrame)
     {
         qWarning() << "Attempted to start tracking before any image has been received";
         return false;
@@ -168,7 +429,7 @@ bool ImgTracker::addBlockMatchingTarget(const QPoint &pos)
                                             static_cast<int>(pos.y() - BBOX_SIZE/2),
                                             BBOX_SIZE, BBOX_SIZE };
 
-    const cv::Rect frameRect = cv::Rect{ 0, 0, d->prevFrame->mat().size[1], d->prevFrame->mat().size[0] };
+    const cv::Rect frameRect = cv::Rect{ 0, 0, prevFrame->mat().size[1], prevFrame->mat().size[0] };
 
     const auto intersection = frameRect & refBlockRect;
 
@@ -180,11 +441,13 @@ bool ImgTracker::addBlockMatchingTarget(const QPoint &pos)
     }
 
     //TODO: change frame fragment's endianess if needed
-    BlockMatchingTarget newTarget{ pos, cv::Mat(d->prevFrame->mat(), refBlockRect).clone() };
+    const cv::Mat refBlock = cv::Mat(prevFrame->mat(), refBlockRect).clone();
+    BlockMatchingTarget newTarget{ pos, refBlock, buildPyramid(refBlock) };
 
     LOCK();
     d->mode = TrackingMode::BlockMatching;
     d->targets.push_back(newTarget);
+    d->publish();
 
     return true;
 }
@@ -192,39 +455,106 @@ bool ImgTracker::addBlockMatchingTarget(const QPoint &pos)
 
 void ImgTracker::doHandle(FrameConstPtr frame)
 {
-    //TODO: change frame fragments' endianess if needed
+    // Capture thread: just hand the frame over to the worker
+    {
+        QMutexLocker lock(&d->mailbox_mutex);
+        d->prevFrame = frame;
+        if (std::atomic_load(&d->snapshot)->mode == TrackingMode::Disabled)
+            return;
+        d->pending = frame;
+    }
+    d->mailbox_changed.wakeOne();
+}
 
-    d->prevFrame = frame;
-    if (d->mode == TrackingMode::Disabled)
-        return;
 
-    LOCK();
+void ImgTracker::Private::run()
+{
+    while (true)
+    {
+        FrameConstPtr frame;
+        {
+            QMutexLocker lock(&mailbox_mutex);
+            while (running && !pending)
+                mailbox_changed.wait(&mailbox_mutex);
+            if (!running)
+                return;
+            std::swap(frame, pending);
+        }
+        track(frame);
+        if (std::atomic_load(&snapshot)->mode != TrackingMode::Disabled)
+            emit q->trackingPositionChanged(q->getTrackingPosition(), frame->created_utc());
+    }
+}
+
+
+void ImgTracker::Private::track(const FrameConstPtr &frame)
+{
+    //TODO: change frame fragments' endianess if needed
 
-    switch (d->mode) {
+    std::lock_guard<std::mutex> lock(guard);
+
+    switch (mode) {
         case TrackingMode::BlockMatching:
-            for (auto &target: d->targets)
-                target.pos = findNewPos(target.pos, target.refBlock, frame->mat());
+            {
+                const cv::Mat img = frame->mat();
+                std::vector<char> found(targets.size());
+                cv::parallel_for_(cv::Range{ 0, static_cast<int>(targets.size()) }, ParallelTargets{ [&](int i) {
+                    found[i] = findNewPos(targets[i], img);
+                }});
+                if (std::find(found.begin(), found.end(), false) != found.end())
+                {
+                    qWarning() << "Block matching target outside image";
+                    emit q->targetLost();
+                    mode = TrackingMode::Disabled;
+                }
+            }
             break;
 
         case TrackingMode::Centroid:
             {
-                const QPoint newPos = findCentroid(cv::Mat(frame->mat(), toCvRect(d->centroid.area)));
-                const QPoint delta = newPos - d->centroid.pos;
-                const QRect oldArea = d->centroid.area;
-                d->centroid.area.moveTopLeft(d->centroid.area.topLeft() + delta);
-                const QRect intersection = d->centroid.area.intersected(QRect{ 0, 0, frame->mat().size[1], frame->mat().size[0] });
+                // The area follows the planet by whole pixels, keeping the centroid near its initial position inside it
+                const QPointF newPos = findCentroidSubpixel(cv::Mat(frame->mat(), toCvRect(centroid.area)), centroidStep(centroid.area));
+                centroid.position = QPointF{ centroid.area.topLeft() } + newPos;
+                const QPoint delta = (newPos - centroid.pos).toPoint();
+                const QRect oldArea = centroid.area;
+                centroid.area.moveTopLeft(centroid.area.topLeft() + delta);
+                const QRect intersection = centroid.area.intersected(QRect{ 0, 0, frame->mat().size[1], frame->mat().size[0] });
                 if (intersection.width() != oldArea.width() ||
                     intersection.height() != oldArea.height())
                 {
                     qWarning() << "Centroid calculation rect outside image";
-                    emit targetLost();
-                    d->mode = TrackingMode::Disabled;
+                    emit q->targetLost();
+                    mode = TrackingMode::Disabled;
+                }
+            }
+            break;
+
+        case TrackingMode::PhaseCorrelation:
+            {
+                cv::Point2d shift;
+                double response = 0;
+                const QRect frameRect{ 0, 0, frame->mat().cols, frame->mat().rows };
+                if (!phase.correlation.findShift(frame->mat(), shift, response) || response < PHASE_CORRELATION_MIN_RESPONSE)
+                {
+                    qWarning() << "Phase correlation lost the surface, peak:" << response;
+                    emit q->targetLost();
+                    mode = TrackingMode::Disabled;
+                    break;
+                }
+                phase.position = phase.origin + QPointF{ shift.x, shift.y };
+                if (!frameRect.contains(phase.position.toPoint()))
+                {
+                    qWarning() << "Phase correlation reference moved outside image";
+                    emit q->targetLost();
+                    mode = TrackingMode::Disabled;
                 }
             }
             break;
+
         default:
             return;
     }
+    publish();
 }
 
 
@@ -233,38 +563,40 @@ void ImgTracker::clear()
     LOCK();
     d->mode = TrackingMode::Disabled;
     d->targets.clear();
+    d->publish();
 }
 
 
 /// Returns current positions of block matching targets
 std::vector<QPoint> ImgTracker::getBlockMatchingTargetPositions()
 {
-    LOCK();
-    std::vector<QPoint> result;
-    for (const auto &target: d->targets)
-        result.push_back(target.pos);
-
-    return result;
+    return std::atomic_load(&d->snapshot)->positions;
 }
 
 
 ImgTracker::TrackingMode ImgTracker::getTrackingMode() const
 {
-    LOCK();
-    return d->mode;
+    return std::atomic_load(&d->snapshot)->mode;
 }
 
 
-QPoint ImgTracker::getTrackingPosition() const
+QPointF ImgTracker::getTrackingPosition() const
 {
-    LOCK();
+    const auto snapshot = std::atomic_load(&d->snapshot);
 
-    switch (d->mode)
+    switch (snapshot->mode)
     {
-        //case TrackingMode::Centroid: return m_Centroid.area.GetTopLeft() + m_Centroid.pos;
+        case TrackingMode::Centroid:
+            return snapshot->centroidPosition;
 
         case TrackingMode::BlockMatching:
-            return d->targets.at(0).pos - d->blockMatchingReportedOffset;
+            return snapshot->positions.at(0) - snapshot->blockMatchingReportedOffset;
+
+        case TrackingMode::PhaseCorrelation:
+            return snapshot->phasePosition;
+
+        default:
+            break;
     }
 
     return { 0, 0 };
@@ -273,13 +605,14 @@ QPoint ImgTracker::getTrackingPosition() const
 
 bool ImgTracker::setCentroidCalcRect(const QRect &rect)
 {
-    if (!d->prevFrame)
+    const auto prevFrame = d->lastFrame();
+    if (!prevFrame)
     {
         qWarning() << "Attempted to start tracking before any image has been received";
         return false;
     }
 
-    const cv::Rect frameRect = cv::Rect{ 0, 0, d->prevFrame->mat().size[1], d->prevFrame->mat().size[0] };
+    const cv::Rect frameRect = cv::Rect{ 0, 0, prevFrame->mat().size[1], prevFrame->mat().size[0] };
     const cv::Rect intersection = frameRect & cv::Rect{ rect.x(), rect.y(), rect.width(), rect.height() };
     if (intersection.width != rect.width() ||
         intersection.height != rect.height())
@@ -294,13 +627,43 @@ bool ImgTracker::setCentroidCalcRect(const QRect &rect)
     d->blockMatchingReportedOffset = QPoint{ 0, 0 };
     d->centroid.area = rect;
     //TODO: change frame fragment's endianess if needed
-    d->centroid.pos = findCentroid(cv::Mat(d->prevFrame->mat(), toCvRect(rect)));
+    d->centroid.pos = findCentroidSubpixel(cv::Mat(prevFrame->mat(), toCvRect(rect)), centroidStep(rect));
+    d->centroid.position = QPointF{ rect.topLeft() } + d->centroid.pos;
+    d->publish();
+
+    return true;
+}
+
+
+bool ImgTracker::setPhaseCorrelation()
+{
+    const auto prevFrame = d->lastFrame();
+    if (!prevFrame)
+    {
+        qWarning() << "Attempted to start tracking before any image has been received";
+        return false;
+    }
+
+    LOCK();
+    //TODO: change frame endianess if needed
+    if (!d->phase.correlation.setReference(prevFrame->mat()))
+    {
+        qWarning() << "Frame too small for phase correlation";
+        return false;
+    }
+    d->targets.clear();
+    d->mode = TrackingMode::PhaseCorrelation;
+    d->blockMatchingReportedOffset = QPoint{ 0, 0 };
+    d->phase.origin = QPointF{ (prevFrame->mat().cols - 1) / 2.0, (prevFrame->mat().rows - 1) / 2.0 };
+    d->phase.position = d->phase.origin;
+    d->publish();
 
     return true;
 }
 
 
-std::tuple<QRect, QPoint> ImgTracker::getCentroidAreaAndPos() const
+std::tuple<QRect, QPointF> ImgTracker::getCentroidAreaAndPos() const
 {
-    return std::make_tuple(d->centroid.area, d->centroid.pos);
+    const auto snapshot = std::atomic_load(&d->snapshot);
+    return std::make_tuple(snapshot->centroidArea, snapshot->centroidPos);
 }
@@ -20,18 +20,62 @@
 #define TRACKING_H
 
 #include <QtCore/qpoint.h>
+#include <QDateTime>
 #include <tuple>
 
 #include "commons/frame.h"
 #include "image_handlers/imagehandler.h"
 
 
+/// Returns the sub-pixel centroid of the image brightness above its mean (the background), or the image centre if flat
+/** Works on raw mono, Bayer or colour data, 8 or 16 bit, reading one pixel every 'step' columns and rows. */
+QPointF findCentroidSubpixel(const cv::Mat &img, int step = 1);
+
+/// Returns the centroid of the image brightness, rounded to whole pixels
+QPoint findCentroid(cv::Mat img);
+
+/// Returns a window of at most size x size pixels, centred on the frame centroid and kept inside the frame
+/** Meant for planet-centred recordings; frames already smaller than the window are returned unchanged. */
+FrameConstPtr cropAroundCentroid(const FrameConstPtr &frame, int size);
+
+/// Global shift of frames against a reference frame, by phase correlation of downsampled, windowed copies
+/** Meant for surfaces filling the frame (Moon, Sun), where there is no centroid to follow. The reference
+    spectrum, the window and all the work buffers are kept between frames: each frame then costs
+    a downsampling, one forward and one inverse transform. Frames must all have the reference size. */
+class PhaseCorrelation
+{
+public:
+    /// Frames are downsampled so that their longest side is at most maxSide pixels
+    explicit PhaseCorrelation(int maxSide = 256);
+
+    /// Returns 'false' for frames too small to correlate
+    bool setReference(const cv::Mat &img);
+    bool hasReference() const { return !reference.empty(); }
+
+    /// Sub-pixel shift of the image contents against the reference, in full resolution pixels
+    /** 'response' is the correlation peak, from 0 (no match) to 1 (same image, shifted). Returns 'false' if
+        there is no reference, or the image size differs from it. */
+    bool findShift(const cv::Mat &img, cv::Point2d &shift, double &response);
+
+private:
+    void spectrum(const cv::Mat &img, cv::Mat &output);
+
+    const int maxSide;
+    cv::Size frameSize;
+    cv::Size smallSize;
+    cv::Mat window;
+    cv::Mat reference; ///< Spectrum of the reference frame
+    // Work buffers, reused by every frame
+    cv::Mat gray, small, smallFloat, padded, current, crossPower, correlation;
+};
+
 /// Tracks image movement
-/** Works in block matching or centroid mode. In case of block matching, multiple tracking targets
+/** Works in block matching, centroid or phase correlation mode. In case of block matching, multiple tracking targets
     may be specified (to protect against local disturbances, e.g. due to a passing bird/satellite).
-    Centroid mode is best suited for planets.
+    Centroid mode is best suited for planets, phase correlation for lunar and solar surfaces filling the frame.
 
-    Tracking position is updated on every call to ImageHandler::doHandle().
+    Frames passed to ImageHandler::doHandle() are tracked on a worker thread, always the latest one;
+    positions are read from the last published state without blocking.
 */
 class ImgTracker: public QObject, public ImageHandler
 {
@@ -40,7 +84,7 @@ class ImgTracker: public QObject, public ImageHandler
 
 public:
 
-    enum class TrackingMode { Disabled, Centroid, BlockMatching };
+    enum class TrackingMode { Disabled, Centroid, BlockMatching, PhaseCorrelation };
 
     ImgTracker();
     ~ImgTracker();
@@ -56,11 +100,16 @@ public:
     /** Removes any block-matching targets. Returns 'false' on failure. */
     bool setCentroidCalcRect(const QRect &rect);
 
-    /// Returns either the centroid position or the block matching targets' common position
-    QPoint getTrackingPosition() const;
+    /// Tracks the whole frame by phase correlation against the latest frame (see PhaseCorrelation)
+    /** Removes any other target. Returns 'false' on failure. */
+    bool setPhaseCorrelation();
+
+    /// Returns either the centroid position, the block matching targets' common position
+    /// or, in phase correlation mode, where the centre of the reference frame moved
+    QPointF getTrackingPosition() const;
 
     /// Returns centroid calculation area and centroid position in the image
-    std::tuple<QRect, QPoint> getCentroidAreaAndPos() const;
+    std::tuple<QRect, QPointF> getCentroidAreaAndPos() const;
 
     /// Adds new target to track via block matching
     /** Cancels centroid tracking (if enabled). Returns 'false' on failure. */
@@ -76,6 +125,9 @@ signals:
     /// Emitted when tracking target is lost (moves outside image or moves away too fast)
     void targetLost();
 
+    /// Emitted from the worker thread after each tracked frame, with the frame's capture time
+    void trackingPositionChanged(const QPointF &position, const QDateTime &frameTime);
+
 private:
     void doHandle(FrameConstPtr  frame) override;
 };
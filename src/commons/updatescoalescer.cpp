@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "updatescoalescer.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QTimer>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const int tick_msecs = 100;
+}
+
+DPTR_IMPL(UpdatesCoalescer) {
+  struct Poll {
+    QPointer<QObject> context;
+    function<void()> poll;
+  };
+  QMutex mutex;
+  vector<Poll> polls;
+  QTimer *timer;
+};
+
+UpdatesCoalescer &UpdatesCoalescer::instance()
+{
+  // Never destroyed: its timer must not outlive the application during static destruction
+  static auto coalescer = new UpdatesCoalescer;
+  return *coalescer;
+}
+
+UpdatesCoalescer::UpdatesCoalescer() : dptr()
+{
+  // Whoever asks first, the ticks belong to the main thread
+  moveToThread(QCoreApplication::instance()->thread());
+  d->timer = new QTimer{this};
+  d->timer->setInterval(tick_msecs);
+  connect(d->timer, &QTimer::timeout, this, &UpdatesCoalescer::poll);
+  QMetaObject::invokeMethod(d->timer, "start", Qt::QueuedConnection);
+}
+
+UpdatesCoalescer::~UpdatesCoalescer()
+{
+}
+
+void UpdatesCoalescer::add(QObject *context, const function<void()> &poll)
+{
+  QMutexLocker lock{&d->mutex};
+  d->polls.push_back({context, poll});
+}
+
+void UpdatesCoalescer::flushLater()
+{
+  QMetaObject::invokeMethod(this, "poll", Qt::QueuedConnection);
+}
+
+void UpdatesCoalescer::poll()
+{
+  vector<Private::Poll> polls;
+  {
+    QMutexLocker lock{&d->mutex};
+    d->polls.erase(remove_if(d->polls.begin(), d->polls.end(), [](const Private::Poll &poll) { return poll.context.isNull(); }), d->polls.end());
+    polls = d->polls;
+  }
+  // Outside the lock: receivers may well add polls of their own
+  for(const auto &poll: polls)
+    if(poll.context)
+      poll.poll();
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef UPDATESCOALESCER_H
+#define UPDATESCOALESCER_H
+
+#include <QObject>
+#include <atomic>
+#include <functional>
+#include "c++/dptr.h"
+
+/**
+ * Status values published at any rate from any thread, delivered at most once per tick (10 times a second) on the main thread.
+ * Publishers only store into a Published slot, and a single timer polls all of them: a fast camera or recording
+ * costs the GUI one update per tick, rather than a queued signal per frame for every label showing a counter.
+ */
+class UpdatesCoalescer : public QObject
+{
+  Q_OBJECT
+public:
+  static UpdatesCoalescer &instance();
+  ~UpdatesCoalescer();
+  /// Calls poll on the main thread on every tick, until context is destroyed
+  void add(QObject *context, const std::function<void()> &poll);
+  /// Polls everything once more, after the events already queued to the main thread by the calling thread
+  /** Call it before signalling the end of something (i.e. a recording), so that the final values come first. */
+  void flushLater();
+private slots:
+  void poll();
+private:
+  UpdatesCoalescer();
+  DPTR
+};
+
+/// Latest value of a status item, stored from any thread and read back on the next tick only if it changed
+template<typename T>
+class Published {
+public:
+  void publish(const T &value) {
+    this->value = value;
+    changed = true;
+  }
+  /// Calls receiver with the latest value, if one was published since the previous call
+  template<typename Receiver> void take(Receiver receiver) {
+    if(changed.exchange(false))
+      receiver(value.load());
+  }
+private:
+  std::atomic<T> value{T{}};
+  std::atomic_bool changed{false};
+};
+
+#endif // UPDATESCOALESCER_H
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "usbhotplug.h"
+#include <QSocketNotifier>
+#include <QHash>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+UsbHotplug::UsbHotplug(QObject *parent) : QObject{parent}
+{
+#ifdef Q_OS_LINUX
+  fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if(fd < 0) {
+    qWarning() << "Unable to open the uevent netlink socket:" << strerror(errno);
+    return;
+  }
+  sockaddr_nl address{};
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = 1; // kernel events: udev rebroadcasts them on group 2, with its own header
+  if(::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+    qWarning() << "Unable to bind the uevent netlink socket:" << strerror(errno);
+    ::close(fd);
+    fd = -1;
+    return;
+  }
+  notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+  connect(notifier, &QSocketNotifier::activated, this, &UsbHotplug::read);
+#endif
+}
+
+UsbHotplug::~UsbHotplug()
+{
+#ifdef Q_OS_LINUX
+  if(fd >= 0)
+    ::close(fd);
+#endif
+}
+
+bool UsbHotplug::isValid() const
+{
+  return fd >= 0;
+}
+
+void UsbHotplug::read()
+{
+#ifdef Q_OS_LINUX
+  char buffer[8192];
+  while(true) {
+    sockaddr_nl sender{};
+    socklen_t sender_size = sizeof(sender);
+    auto size = ::recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&sender), &sender_size);
+    if(size <= 0)
+      break;
+    // Anyone can send on the group: only trust the kernel
+    if(sender.nl_pid != 0)
+      continue;
+    auto event = parse(QByteArray{buffer, static_cast<int>(size)});
+    if(event.valid)
+      emit changed(event.action, event.device, event.vendor);
+  }
+#endif
+}
+
+UsbHotplug::Event UsbHotplug::parse(const QByteArray &uevent)
+{
+  Event event{false, Added, {}, {}};
+  auto fields = uevent.split('\0');
+  if(fields.isEmpty() || ! fields[0].contains('@'))
+    return event;
+  QHash<QByteArray, QByteArray> values;
+  for(int index = 1; index < fields.size(); index++) {
+    auto separator = fields[index].indexOf('=');
+    if(separator > 0)
+      values[fields[index].left(separator)] = fields[index].mid(separator + 1);
+  }
+  if(values.value("SUBSYSTEM") != "usb" || values.value("DEVTYPE") != "usb_device")
+    return event;
+  const auto action = values.value("ACTION");
+  if(action != "add" && action != "remove")
+    return event;
+  event.action = action == "add" ? Added : Removed;
+  const auto devpath = QString::fromLatin1(values.value("DEVPATH"));
+  event.device = devpath.mid(devpath.lastIndexOf('/') + 1);
+  // PRODUCT is vendor/product/bcdDevice, in hex without leading zeros
+  bool ok = false;
+  auto vendor = values.value("PRODUCT").split('/').value(0).toInt(&ok, 16);
+  if(ok)
+    event.vendor = QString::number(vendor, 16).rightJustified(4, '0');
+  event.valid = ! event.device.isEmpty();
+  return event;
+}
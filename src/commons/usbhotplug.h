@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef USBHOTPLUG_H
+#define USBHOTPLUG_H
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+class QSocketNotifier;
+
+/**
+ * USB devices plugged or unplugged, as notified by the kernel: on Linux, uevents read from a netlink socket, so there's
+ * no wakeup without an actual change. Where there's no such backend (other platforms, or the socket can't be opened,
+ * e.g. in some containers) isValid() is false, and the caller has to fall back to polling.
+ */
+class UsbHotplug : public QObject
+{
+  Q_OBJECT
+public:
+  enum Action { Added, Removed };
+  struct Event {
+    bool valid;
+    Action action;
+    QString device; ///< the device entry in /sys/bus/usb/devices, i.e. "1-1.2"
+    QString vendor; ///< as idVendor in sysfs: 4 lowercase hex digits, empty if unknown
+  };
+  UsbHotplug(QObject *parent = nullptr);
+  ~UsbHotplug();
+  bool isValid() const;
+  /// Decodes a kernel uevent ("action@devpath", then NUL separated KEY=VALUE pairs): only usb_device add and remove are valid
+  static Event parse(const QByteArray &uevent);
+signals:
+  void changed(UsbHotplug::Action action, const QString &device, const QString &vendor);
+private:
+  int fd = -1;
+  QSocketNotifier *notifier = nullptr;
+  void read();
+};
+
+#endif // USBHOTPLUG_H
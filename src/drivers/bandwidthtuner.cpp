@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "bandwidthtuner.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+// A faster setting may cost a few fps to noise, but not more than this
+const double FPS_TOLERANCE = 0.95;
+}
+
+BandwidthTuner::BandwidthTuner(const Range &range) : range{range}
+{
+  this->range.step = max(this->range.step, 1l);
+  reset();
+}
+
+long BandwidthTuner::reset()
+{
+  _value = slowest();
+  has_stable = false;
+  _settled = false;
+  discard = true;
+  best_fps = 0;
+  window_start = {};
+  return _value;
+}
+
+bool BandwidthTuner::frame(const Clock::time_point &now, uint64_t sdk_dropped, long &value)
+{
+  if(window_start == Clock::time_point{}) {
+    start_window(now, sdk_dropped);
+    return false;
+  }
+  window_frames++;
+  if(now - window_start < range.window)
+    return false;
+  const double fps = window_frames / chrono::duration<double>(now - window_start).count();
+  const bool dropping = sdk_dropped > window_dropped;
+  start_window(now, sdk_dropped);
+  if(discard) {
+    discard = false;
+    return false;
+  }
+  if(_settled) {
+    if(! dropping || _value == slowest())
+      return false;
+    value = _value = slower(_value);
+    discard = true;
+    return true;
+  }
+  if(! dropping && fps >= best_fps * FPS_TOLERANCE) {
+    stable = _value;
+    has_stable = true;
+    best_fps = max(best_fps, fps);
+    if(_value == fastest()) {
+      _settled = true;
+      return false;
+    }
+    value = _value = faster(_value);
+    discard = true;
+    return true;
+  }
+  // Too fast for the host: back to the last value that kept up, or one step slower when none did yet
+  _settled = true;
+  const long previous = _value;
+  value = _value = has_stable ? stable : slower(_value);
+  discard = true;
+  return _value != previous;
+}
+
+void BandwidthTuner::start_window(const Clock::time_point &now, uint64_t sdk_dropped)
+{
+  window_start = now;
+  window_frames = 0;
+  window_dropped = sdk_dropped;
+}
+
+long BandwidthTuner::slowest() const
+{
+  return range.higher_is_faster ? range.min : range.max;
+}
+
+long BandwidthTuner::fastest() const
+{
+  return range.higher_is_faster ? range.max : range.min;
+}
+
+long BandwidthTuner::faster(long value) const
+{
+  return range.higher_is_faster ? min(value + range.step, range.max) : max(value - range.step, range.min);
+}
+
+long BandwidthTuner::slower(long value) const
+{
+  return range.higher_is_faster ? max(value - range.step, range.min) : min(value + range.step, range.max);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DRIVERS_BANDWIDTHTUNER_H
+#define DRIVERS_BANDWIDTHTUNER_H
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Finds the fastest stable setting of a camera USB bandwidth control (i.e. ASI bandwidth overload, QHY USB traffic)
+ * for the current ROI, depth and host controller.
+ * Starting from the slowest value, it steps towards the fastest one a window at a time, as long as the SDK doesn't drop
+ * frames and the delivered rate doesn't get worse; then it goes back to the last stable value and settles there.
+ * Once settled, drops in a window make it step back once more.
+ * Fed from the capture thread with every frame the worker delivers; start over (reset) when ROI or depth change.
+ */
+class BandwidthTuner
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  struct Range {
+    long min = 0;
+    long max = 0;
+    long step = 1;
+    /// ASI bandwidth gets faster going up, QHY USB traffic going down
+    bool higher_is_faster = true;
+    /// Measurement window for each value; the first one after a change is discarded, while the SDK settles
+    std::chrono::milliseconds window{2000};
+  };
+  BandwidthTuner(const Range &range);
+  /// Starts over from the slowest value, returned
+  long reset();
+  /**
+   * Called for every delivered frame, with the SDK dropped frames count so far.
+   * Returns true, with the new value, when the control should change.
+   */
+  bool frame(const Clock::time_point &now, std::uint64_t sdk_dropped, long &value);
+  long value() const { return _value; }
+  bool settled() const { return _settled; }
+private:
+  Range range;
+  long _value;
+  long stable;
+  bool has_stable = false;
+  bool _settled = false;
+  bool discard = true;
+  double best_fps = 0;
+  Clock::time_point window_start;
+  std::uint64_t window_frames = 0;
+  std::uint64_t window_dropped = 0;
+  long slowest() const;
+  long fastest() const;
+  long faster(long value) const;
+  long slower(long value) const;
+  void start_window(const Clock::time_point &now, std::uint64_t sdk_dropped);
+};
+
+#endif // DRIVERS_BANDWIDTHTUNER_H
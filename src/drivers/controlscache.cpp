@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "controlscache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+const quint32 MAGIC = 0x50494343; // "PICC"
+const quint8 VERSION = 1;
+
+QDataStream &operator<<(QDataStream &stream, const Imager::Control &control) {
+  stream << control.id << control.name << static_cast<qint32>(control.type) << control.value << control.default_value
+         << control.range.min << control.range.max << control.range.step << static_cast<qint32>(control.choices.size());
+  for(const auto &choice: control.choices)
+    stream << choice.label << choice.value;
+  return stream << control.decimals << control.is_duration << control.supports_auto << control.value_auto << control.readonly
+                << control.duration_unit.count() << control.is_exposure << control.supports_onOff << control.value_onOff;
+}
+
+QDataStream &operator>>(QDataStream &stream, Imager::Control &control) {
+  qint32 type, choices;
+  stream >> control.id >> control.name >> type >> control.value >> control.default_value
+         >> control.range.min >> control.range.max >> control.range.step >> choices;
+  control.type = static_cast<Imager::Control::Type>(type);
+  control.choices.clear();
+  for(qint32 index = 0; index < choices && stream.status() == QDataStream::Ok; index++) {
+    Imager::Control::Choice choice;
+    stream >> choice.label >> choice.value;
+    control.choices.push_back(choice);
+  }
+  double duration_unit;
+  stream >> control.decimals >> control.is_duration >> control.supports_auto >> control.value_auto >> control.readonly
+         >> duration_unit >> control.is_exposure >> control.supports_onOff >> control.value_onOff;
+  control.duration_unit = std::chrono::duration<double>{duration_unit};
+  return stream;
+}
+}
+
+ControlsCache::ControlsCache(const QString &directory) : directory{directory}
+{
+}
+
+QString ControlsCache::default_directory()
+{
+  return QDir{QStandardPaths::writableLocation(QStandardPaths::CacheLocation)}.filePath("camera-controls");
+}
+
+QString ControlsCache::key(const QString &name, const Imager::Properties &properties)
+{
+  QStringList parts{name};
+  for(const auto &property: properties.properties)
+    if(property.name.contains("serial", Qt::CaseInsensitive) || property.name.contains("firmware", Qt::CaseInsensitive))
+      parts.push_back(property.name + '=' + property.value.toString());
+  return parts.join('\n');
+}
+
+QString ControlsCache::path(const QString &key) const
+{
+  return QDir{directory}.filePath(QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex()) + ".dat");
+}
+
+bool ControlsCache::load(const QString &key, Imager::Controls &controls) const
+{
+  QFile file{path(key)};
+  if(! file.open(QIODevice::ReadOnly))
+    return false;
+  QDataStream stream{&file};
+  stream.setVersion(QDataStream::Qt_5_0);
+  quint32 magic;
+  quint8 version;
+  QString stored_key;
+  qint32 count;
+  stream >> magic >> version >> stored_key >> count;
+  // Hash collisions, or an older file layout
+  if(stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION || stored_key != key || count < 0)
+    return false;
+  Imager::Controls loaded;
+  for(qint32 index = 0; index < count; index++) {
+    Imager::Control control;
+    stream >> control;
+    if(stream.status() != QDataStream::Ok)
+      return false;
+    loaded.push_back(control);
+  }
+  controls = loaded;
+  return true;
+}
+
+bool ControlsCache::store(const QString &key, const Imager::Controls &controls) const
+{
+  if(! QDir{}.mkpath(directory))
+    return false;
+  // Written aside and renamed: another instance may be reading it
+  QSaveFile file{path(key)};
+  if(! file.open(QIODevice::WriteOnly))
+    return false;
+  QDataStream stream{&file};
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << MAGIC << VERSION << key << static_cast<qint32>(controls.size());
+  for(const auto &control: controls)
+    stream << control;
+  return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool ControlsCache::same_descriptor(const Imager::Control &a, const Imager::Control &b)
+{
+  auto same_choices = [&]{
+    if(a.choices.size() != b.choices.size())
+      return false;
+    for(int index = 0; index < a.choices.size(); index++)
+      if(a.choices[index].label != b.choices[index].label || a.choices[index].value != b.choices[index].value)
+        return false;
+    return true;
+  };
+  return a.id == b.id && a.name == b.name && a.type == b.type && a.default_value == b.default_value
+    && a.range.min == b.range.min && a.range.max == b.range.max && a.range.step == b.range.step && same_choices()
+    && a.decimals == b.decimals && a.is_duration == b.is_duration && a.supports_auto == b.supports_auto && a.readonly == b.readonly
+    && a.duration_unit == b.duration_unit && a.is_exposure == b.is_exposure && a.supports_onOff == b.supports_onOff;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTROLSCACHE_H
+#define CONTROLSCACHE_H
+
+#include "imager.h"
+#include <QString>
+
+/**
+ * Camera controls descriptors kept on disk between sessions, one file per camera, so that the controls UI is built on open
+ * without waiting for the driver: Imager::controls_snapshot starts from them, and checks them against the driver in the background.
+ * Cameras are told apart by name, then serial and firmware when their properties have them (see key).
+ */
+class ControlsCache
+{
+public:
+  ControlsCache(const QString &directory = default_directory());
+  /// camera-controls, in the user cache directory
+  static QString default_directory();
+  static QString key(const QString &name, const Imager::Properties &properties);
+  /// false if there is no cache file for key, or it's unreadable or from another version
+  bool load(const QString &key, Imager::Controls &controls) const;
+  bool store(const QString &key, const Imager::Controls &controls) const;
+  /// Everything but the values: id, name, type, default, range, choices and flags
+  static bool same_descriptor(const Imager::Control &a, const Imager::Control &b);
+private:
+  const QString directory;
+  QString path(const QString &key) const;
+};
+
+#endif // CONTROLSCACHE_H
@@ -22,3 +22,8 @@ using namespace std;
 void Driver::aboutToQuit()
 {
 }
+
+QList<Driver::Source> Driver::sources() const
+{
+  return { Source{ {}, {}, true, false, [this] { return cameras(); } } };
+}
@@ -19,6 +19,8 @@
 #define PLANETARY_IMAGER_DRIVER_H
 #include <QList>
 #include <QString>
+#include <QStringList>
+#include <functional>
 #include "imager.h"
 #include "dptr.h"
 #include "commons/fwd.h"
@@ -35,8 +37,21 @@ public:
 class Driver : public QObject {
   Q_OBJECT
 public:
+  /// Part of a driver enumerating its own cameras (i.e. a driver library), so that it can be scanned in parallel with the others
+  struct Source {
+    QString name;
+    /// USB vendor ids (hex, as in sysfs idVendor) of the cameras found by this source; empty if any USB device could be one
+    QStringList usb_vendors;
+    /// false if USB devices coming and going never change the cameras found (i.e. simulators)
+    bool hotplug;
+    /// true if cameras can only be on USB, identified by usb_vendors: without any of those plugged in, there's no need to scan (or load) it
+    bool usb_only;
+    std::function<QList<CameraPtr>()> cameras;
+  };
   virtual void aboutToQuit();
   virtual QList<CameraPtr> cameras() const = 0;
+  /// By default the whole driver is a single source
+  virtual QList<Source> sources() const;
 };
 typedef Driver *(*LoadDriverFunction)();
 
@@ -28,6 +28,7 @@
 #include "fc2_exception.h"
 #include "fc2_imager.h"
 #include "fc2_worker.h"
+#include "commons/frame.h"
 #include "Qt/qt_strings_helper.h"
 
 
@@ -45,7 +46,13 @@ enum ControlID: qlonglong
     PixelFormat,
 
     // FC2_WHITE_BALANCE is actually a pair of values, so expose two custom IDs
-    WhiteBalanceRed, WhiteBalanceBlue
+    WhiteBalanceRed, WhiteBalanceBlue,
+
+    // Number of frames the driver can buffer while a frame is being processed
+    CaptureBuffers,
+
+    // Bayer pattern of mono and raw pixel formats, when the camera doesn't report it
+    BayerPattern
 };
 
 static std::map<fc2PixelFormat, const char *> PIXEL_FORMAT_NAME =
@@ -162,6 +169,9 @@ DPTR_IMPL(FC2Imager)
 
     bool temperatureAvailable;
 
+    unsigned numBuffers = FC2ImagerWorker::DEFAULT_NUM_BUFFERS;
+    int rawColorFormat = -1; ///< Frame::ColorFormat, or -1 for the camera default
+
     Control enumerateVideoModes();
 
     /// Returns a combo control listing all pixel formats for 'currentVidMode'
@@ -182,6 +192,9 @@ DPTR_IMPL(FC2Imager)
     /// Caller must check if the result is valid()
     Control createControlFromFC2Property(const fc2PropertyInfo &propInfo);
 
+    /// Edges the trigger input can start an exposure on; empty if the camera can't be triggered
+    QList<ImagerThread::Trigger::Mode> triggerModes() const;
+
 
     LOG_C_SCOPE(FC2Imager);
 };
@@ -391,6 +404,9 @@ FC2Imager::FC2Imager(const fc2PGRGuid &guid, const ImageHandlerPtr &handler)
     }
     else
         d->currentPixFmt = VID_MODE_PIX_FMT[(fc2VideoMode)d->currentVidMode];
+
+    if (supports(Temperature))
+        add_sensor(TemperatureSensor, std::chrono::seconds{2}, [=] { return read_temperature(); });
 }
 
 FC2Imager::~FC2Imager()
@@ -508,6 +524,9 @@ Imager::Properties FC2Imager::properties() const
         properties << Temperature;
     }
 
+    if (!d->triggerModes().isEmpty())
+        properties << ExternalTrigger;
+
     return properties;
 }
 
@@ -556,6 +575,9 @@ void FC2Imager::setControl(const Imager::Control& control)
 {
     LOG_F_SCOPE
 
+    if (set_trigger_control(control))
+        return;
+
     if (control.id == ControlID::VideoMode)
     {
         const auto newMode = control.get_value_enum<FC2VideoMode>();
@@ -584,6 +606,16 @@ void FC2Imager::setControl(const Imager::Control& control)
         d->currentPixFmt = control.get_value_enum<fc2PixelFormat>();
         startLive();
     }
+    else if (control.id == ControlID::CaptureBuffers)
+    {
+        d->numBuffers = static_cast<unsigned>(control.get_value<int>());
+        startLive();
+    }
+    else if (control.id == ControlID::BayerPattern)
+    {
+        d->rawColorFormat = control.get_value<int>();
+        startLive();
+    }
     else
     {
         fc2Property prop;
@@ -667,23 +699,18 @@ void FC2Imager::setControl(const Imager::Control& control)
     }
 }
 
-void FC2Imager::readTemperature()
+double FC2Imager::read_temperature()
 {
-    if (d->temperatureAvailable)
-    {
-        fc2Property prop;
-        prop.type = FC2_TEMPERATURE;
-        FC2_CHECK << fc2GetProperty(d->context, &prop)
-                  << "fc2GetProperty";
-
-        // Calculation as in CamSettingsPage.cpp from FlyCapture2 SDK. Strangely, both "absolute capable"
-        // and "unit abbreviation" fields are not taken into account (e.g. on Chameleon3 CM3-U3-13S2M the indicated
-        // unit is Celsius; yet, the formula below must be used anyway).
+    fc2Property prop;
+    prop.type = FC2_TEMPERATURE;
+    FC2_CHECK << fc2GetProperty(d->context, &prop)
+              << "fc2GetProperty";
 
-        double tempCelsius = prop.valueA / 10.0 - 273.15;
+    // Calculation as in CamSettingsPage.cpp from FlyCapture2 SDK. Strangely, both "absolute capable"
+    // and "unit abbreviation" fields are not taken into account (e.g. on Chameleon3 CM3-U3-13S2M the indicated
+    // unit is Celsius; yet, the formula below must be used anyway).
 
-        emit temperature(tempCelsius);
-    }
+    return prop.valueA / 10.0 - 273.15;
 }
 
 static void UpdateRangeAndStep(Imager::Control &control, const fc2PropertyInfo &propInfo)
@@ -805,6 +832,18 @@ Imager::Control FC2Imager::Private::createControlFromFC2Property(const fc2Proper
     return control;
 }
 
+QList<ImagerThread::Trigger::Mode> FC2Imager::Private::triggerModes() const
+{
+    fc2TriggerModeInfo info;
+    FC2_CHECK << fc2GetTriggerModeInfo(context, &info)
+              << "fc2GetTriggerModeInfo";
+    if (!info.present)
+        return {};
+    if (!info.polaritySupported)
+        return { ImagerThread::Trigger::RisingEdge };
+    return { ImagerThread::Trigger::RisingEdge, ImagerThread::Trigger::FallingEdge };
+}
+
 Imager::Controls FC2Imager::controls() const
 {
     Controls controls;
@@ -815,6 +854,20 @@ Imager::Controls FC2Imager::controls() const
 
     controls.push_back(d->getFrameRates(d->currentVidMode));
 
+    controls.push_back(Control{ ControlID::CaptureBuffers, "Capture buffers" }.set_range(2, 64, 1)
+                                                                             .set_value(static_cast<int>(d->numBuffers))
+                                                                             .set_default_value(static_cast<int>(FC2ImagerWorker::DEFAULT_NUM_BUFFERS)));
+
+    controls.push_back(Control{ ControlID::BayerPattern, "Bayer pattern", Control::Combo }
+                       .add_choice("Camera default", -1)
+                       .add_choice_enum("None (mono)", Frame::Mono)
+                       .add_choice_enum("RGGB", Frame::Bayer_RGGB)
+                       .add_choice_enum("GRBG", Frame::Bayer_GRBG)
+                       .add_choice_enum("GBRG", Frame::Bayer_GBRG)
+                       .add_choice_enum("BGGR", Frame::Bayer_BGGR)
+                       .set_value(d->rawColorFormat)
+                       .set_default_value(-1));
+
     // FC2_WHITE_BALANCE is handled after this loop
     for (fc2PropertyType propType: { FC2_BRIGHTNESS,
                                      FC2_AUTO_EXPOSURE,
@@ -829,7 +882,6 @@ Imager::Controls FC2Imager::controls() const
                                      FC2_TILT,
                                      FC2_SHUTTER,
                                      FC2_GAIN,
-                                     FC2_TRIGGER_MODE,
                                      FC2_TRIGGER_DELAY,
                                      FC2_FRAME_RATE })
     {
@@ -863,6 +915,11 @@ Imager::Controls FC2Imager::controls() const
     controls.push_back(d->ctrlWhiteBalanceRed);
     controls.push_back(d->ctrlWhiteBalanceBlue);
 
+    // Replaces the FC2_TRIGGER_MODE property, whose on/off state the capture thread has to know about
+    const auto modes = d->triggerModes();
+    if (!modes.isEmpty())
+        controls.push_back(trigger_control(modes));
+
     return controls;
 }
 
@@ -881,7 +938,7 @@ void FC2Imager::setROI(const QRect &roi)
 
 void FC2Imager::startLive()
 {
-    restart([this] { return std::make_shared<FC2ImagerWorker>(d->context, d->currentVidMode, d->currentFrameRate, d->currentPixFmt, d->currentROI); });
+    restart([this] { return std::make_shared<FC2ImagerWorker>(d->context, d->currentVidMode, d->currentFrameRate, d->currentPixFmt, d->currentROI, d->numBuffers, d->rawColorFormat); });
     qDebug() << "Video streaming started successfully";
 }
 
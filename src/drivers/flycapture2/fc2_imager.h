@@ -52,9 +52,8 @@ public slots:
 
     void setControl(const Control& control) override;
 
-    void readTemperature() override;
-
 private:
+    double read_temperature();
 
     DPTR
 };
@@ -21,6 +21,7 @@
 #include "fc2_exception.h"
 #include "fc2_worker.h"
 #include "commons/frame.h"
+#include "commons/framepool.h"
 
 
 // Captured frames may be "inconsistent" (have damaged contents), e.g. sometimes when using GigE cameras
@@ -35,8 +36,10 @@ FC2ImagerWorker::FC2ImagerWorker(
     fc2FrameRate frameRate,
     fc2PixelFormat pixFmt,
     /// Must be already validated; also used as the initial frame size for Format7 modes
-    const QRect &roi)
-: context(_context)
+    const QRect &roi,
+    unsigned numBuffers,
+    int _rawColorFormat)
+: context(_context), rawColorFormat(_rawColorFormat)
 {
     frameInfo.initialized = false;
 
@@ -60,6 +63,16 @@ FC2ImagerWorker::FC2ImagerWorker(
                   << "fc2SetVideoModeAndFrameRate";
     }
 
+    // Keep every frame in the driver buffers until it's retrieved, instead of only the most recent one
+    fc2Config config;
+    FC2_CHECK << fc2GetConfiguration(context, &config)
+              << "fc2GetConfiguration";
+    config.grabMode = FC2_BUFFER_FRAMES;
+    config.numBuffers = numBuffers;
+    defaultGrabTimeout = config.grabTimeout;
+    FC2_CHECK << fc2SetConfiguration(context, &config)
+              << "fc2SetConfiguration";
+
     FC2_CHECK << fc2StartCapture(context)
               << "fc2StartCapture";
 
@@ -98,16 +111,26 @@ void FC2ImagerWorker::initFrameInfo()
     case FC2_PIXEL_FORMAT_RAW8:
     case FC2_PIXEL_FORMAT_RAW12:
     case FC2_PIXEL_FORMAT_RAW16:
+        frameInfo.colorFormat = Frame::ColorFormat::Mono;
         switch (image.bayerFormat)
         {
         case FC2_BT_RGGB: frameInfo.colorFormat = Frame::ColorFormat::Bayer_RGGB; break;
         case FC2_BT_BGGR: frameInfo.colorFormat = Frame::ColorFormat::Bayer_BGGR; break;
         case FC2_BT_GBRG: frameInfo.colorFormat = Frame::ColorFormat::Bayer_GBRG; break;
         case FC2_BT_GRBG: frameInfo.colorFormat = Frame::ColorFormat::Bayer_GRBG; break;
+        default: break;
         }
         break;
+
+    default:
+        frameInfo.colorFormat = Frame::ColorFormat::Mono; break;
     }
 
+    // Frames stay raw all the way (recording included), debayering is left to the display:
+    // many Bayer cameras stream "mono" formats, or don't report the right pattern
+    if (rawColorFormat >= 0 && frameInfo.colorFormat != Frame::ColorFormat::RGB)
+        frameInfo.colorFormat = static_cast<Frame::ColorFormat>(rawColorFormat);
+
     unsigned int bpch;
     FC2_CHECK << fc2DetermineBitsPerPixel(image.format, &bpch)
               << "fc2DetermineBitsPerPixel";
@@ -136,6 +159,18 @@ FramePtr FC2ImagerWorker::shoot()
 {
 //    //TODO: fail gracefully if cannot capture
 
+    // After the first frame the geometry is known: the SDK can copy the next ones straight into a pooled frame
+    FramePtr frame;
+    if (frameInfo.initialized)
+    {
+        frame = frames_pool->acquire(frameInfo.bitsPerChannel,
+                                     frameInfo.colorFormat,
+                                     QSize(image.cols, image.rows),
+                                     Frame::ByteOrder::LittleEndian);
+        FC2_CHECK << fc2SetImageData(&image, frame->data(), frame->size())
+                  << "fc2SetImageData";
+    }
+
     int badFrameCounter = 0;
     fc2Error result;
     while (badFrameCounter < MAX_NUM_INCONSISTENT_FRAMES_TO_SKIP &&
@@ -145,6 +180,9 @@ FramePtr FC2ImagerWorker::shoot()
         badFrameCounter++;
     }
 
+    if (triggered && result == FC2_ERROR_TIMEOUT)
+        return {};
+
     FC2_CHECK << result << "fc2RetrieveBuffer";
 
     if (!frameInfo.initialized)
@@ -153,26 +191,94 @@ FramePtr FC2ImagerWorker::shoot()
         frameInfo.initialized = true;
     }
 
-    auto frame = std::make_shared<Frame>(frameInfo.bitsPerChannel,
-                                         frameInfo.colorFormat,
-                                         QSize(image.cols, image.rows),
-                                         Frame::ByteOrder::LittleEndian);
+    const bool retrievedIntoFrame = frame &&
+                                    image.pData == frame->data() &&
+                                    QSize(image.cols, image.rows) == frame->resolution() &&
+                                    image.stride == frame->mat().step[0];
+    if (!retrievedIntoFrame)
+    {
+        const uint8_t *srcLine = image.pData;
+        const ptrdiff_t srcStride = image.stride;
 
-    const uint8_t *srcLine = image.pData;
-    const ptrdiff_t srcStride = image.stride;
+        // Copying from the buffer the SDK owns, or from a frame with a different geometry
+        auto source = frame;
+        frame = frames_pool->acquire(frameInfo.bitsPerChannel,
+                                     frameInfo.colorFormat,
+                                     QSize(image.cols, image.rows),
+                                     Frame::ByteOrder::LittleEndian);
 
-    uint8_t *destLine = frame->mat().data;
-    const size_t destStride = frame->mat().step[0];
-    size_t numDestCopyBytes; // Number of bytes per line to copy into 'frame'
+        uint8_t *destLine = frame->mat().data;
+        const size_t destStride = frame->mat().step[0];
+        size_t numDestCopyBytes; // Number of bytes per line to copy into 'frame'
 
-    numDestCopyBytes = std::min(destStride, (size_t)srcStride);
+        numDestCopyBytes = std::min(destStride, (size_t)srcStride);
 
-    for (int y = 0; y < frame->mat().rows; y++)
+        for (int y = 0; y < frame->mat().rows; y++)
+        {
+            memcpy(destLine, srcLine, numDestCopyBytes);
+            srcLine += srcStride;
+            destLine += destStride;
+        }
+    }
+
+    const fc2TimeStamp timestamp = fc2GetImageTimeStamp(&image);
+    // Bus cycle time (1394 clock, or the embedded camera timestamp): 8000 cycles per second, 3072 offsets per cycle, wrapping every 128 seconds
+    if (timestamp.cycleSeconds || timestamp.cycleCount || timestamp.cycleOffset)
+        frame->set_device_timestamp(Frame::Timestamp{ timestamp.cycleSeconds * 1000000ll +
+                                                      timestamp.cycleCount * 125ll +
+                                                      timestamp.cycleOffset * 125ll / 3072 });
+    // System time the image was received by the driver
+    if (timestamp.seconds > 0)
     {
-        memcpy(destLine, srcLine, numDestCopyBytes);
-        srcLine += srcStride;
-        destLine += destStride;
+        const auto created_utc = QDateTime::fromMSecsSinceEpoch(timestamp.seconds * 1000ll + timestamp.microSeconds / 1000, Qt::UTC);
+        const qint64 age_msecs = created_utc.msecsTo(QDateTime::currentDateTimeUtc());
+        if (age_msecs >= 0)
+        {
+            frame->set_created_utc(created_utc);
+            frame->set_captured(Frame::Clock::now() - std::chrono::milliseconds{ age_msecs });
+        }
     }
 
     return frame;
 }
+
+bool FC2ImagerWorker::set_trigger(const ImagerThread::Trigger &trigger)
+{
+    fc2TriggerModeInfo info;
+    FC2_CHECK << fc2GetTriggerModeInfo(context, &info)
+              << "fc2GetTriggerModeInfo";
+    if (!info.present)
+        return !trigger.active();
+    if (trigger.mode == ImagerThread::Trigger::FallingEdge && !info.polaritySupported)
+        return false;
+
+    fc2TriggerMode mode;
+    FC2_CHECK << fc2GetTriggerMode(context, &mode)
+              << "fc2GetTriggerMode";
+    mode.onOff = trigger.active();
+    mode.mode = 0;
+    mode.source = 0;
+    if (info.polaritySupported)
+        mode.polarity = trigger.mode == ImagerThread::Trigger::FallingEdge ? 0 : 1;
+    FC2_CHECK << fc2SetTriggerMode(context, &mode)
+              << "fc2SetTriggerMode";
+
+    // The grab waits for the trigger and then the exposure: poll time plus the shutter
+    fc2Config config;
+    FC2_CHECK << fc2GetConfiguration(context, &config)
+              << "fc2GetConfiguration";
+    config.grabTimeout = defaultGrabTimeout;
+    if (trigger.active())
+    {
+        fc2Property shutter;
+        shutter.type = FC2_SHUTTER;
+        FC2_CHECK << fc2GetProperty(context, &shutter)
+                  << "fc2GetProperty";
+        config.grabTimeout = static_cast<int>(trigger.poll.count() + shutter.absValue);
+    }
+    FC2_CHECK << fc2SetConfiguration(context, &config)
+              << "fc2SetConfiguration";
+
+    triggered = trigger.active();
+    return true;
+}
@@ -64,9 +64,14 @@ public:
 class FC2ImagerWorker: public ImagerThread::Worker
 {
     fc2Context context;
+    int rawColorFormat;
 
     fc2Image image;
 
+    /// Set by set_trigger: no frame within the grab timeout is not an error then
+    bool triggered = false;
+    int defaultGrabTimeout;
+
     struct
     {
         bool initialized; ///< If 'false', the remaining fields have not been set yet
@@ -83,15 +88,24 @@ class FC2ImagerWorker: public ImagerThread::Worker
 
 public:
 
+    /// Frames the driver can hold while we're busy: at 120 fps, 16 buffers give about 130 ms before frames are dropped
+    static constexpr unsigned DEFAULT_NUM_BUFFERS = 16;
+
     FC2ImagerWorker(fc2Context _context,
                     FC2VideoMode vidMode,
                     fc2FrameRate frameRate,
                     fc2PixelFormat pixFmt,
                     /// Must be already validated; also used as the initial frame size for Format7 modes
-                    const QRect &roi);
+                    const QRect &roi,
+                    unsigned numBuffers = DEFAULT_NUM_BUFFERS,
+                    /// Frame::ColorFormat for mono and raw pixel formats, i.e. a Bayer pattern the camera doesn't report; -1 to use the camera one
+                    int rawColorFormat = -1);
 
     FramePtr shoot() override;
 
+    /// External trigger on GPIO0 (trigger mode 0: one exposure per edge)
+    bool set_trigger(const ImagerThread::Trigger &trigger) override;
+
     virtual ~FC2ImagerWorker();
 };
 
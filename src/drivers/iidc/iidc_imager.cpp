@@ -40,7 +40,13 @@ enum ControlID: qlonglong
     FrameRate,
 
     // Used to select pixel format (color coding) for the current video mode (non-Format7 modes have only one pixel format)
-    PixelFormat
+    PixelFormat,
+
+    // Number of DMA buffers the driver can fill while a frame is being processed
+    CaptureBuffers,
+
+    // Bayer pattern of mono and raw pixel formats, when the camera doesn't report it
+    BayerPattern
 };
 
 struct EnumHash
@@ -95,6 +101,9 @@ DPTR_IMPL(IIDCImager)
     bool temperatureAvailable;
     bool temperatureAbsSupported;
 
+    uint32_t numDMABuffers = IIDCImagerWorker::DEFAULT_DMA_BUFFERS;
+    int rawColorFormat = -1; ///< Frame::ColorFormat, or -1 for the camera default
+
     /// Returns a combo control listing all video modes, with 'currentVidMode' selected
     Control enumerateVideoModes();
 
@@ -115,6 +124,9 @@ DPTR_IMPL(IIDCImager)
 
     void updateShutterCtrl();
 
+    /// Edges the trigger input can start an exposure on; empty if the camera can't be triggered
+    QList<ImagerThread::Trigger::Mode> triggerModes() const;
+
 
     LOG_C_SCOPE(IIDCImager);
 };
@@ -258,6 +270,9 @@ IIDCImager::IIDCImager(std::unique_ptr<dc1394camera_t, Deleters::camera> camera,
 
     IIDC_CHECK << dc1394_feature_get_all(d->camera.get(), &d->features)
                << "Get all features";
+
+    if (supports(Temperature))
+        add_sensor(TemperatureSensor, std::chrono::seconds{2}, [=] { return read_temperature(); });
 }
 
 IIDCImager::~IIDCImager()
@@ -287,6 +302,9 @@ Imager::Properties IIDCImager::properties() const
         properties << Temperature;
     }
 
+    if (!d->triggerModes().isEmpty())
+        properties << ExternalTrigger;
+
     QString iidcVersion;
     switch (d->camera.get()->iidc_version)
     {
@@ -369,6 +387,9 @@ void IIDCImager::setControl(const Imager::Control& control)
 {
     LOG_F_SCOPE
 
+    if (set_trigger_control(control))
+        return;
+
     if (control.id == ControlID::VideoMode)
     {
         const dc1394video_mode_t newMode = control.get_value_enum<dc1394video_mode_t>();
@@ -407,6 +428,16 @@ void IIDCImager::setControl(const Imager::Control& control)
         d->currentPixFmt = control.get_value_enum<dc1394color_coding_t>();
         startLive();
     }
+    else if (control.id == ControlID::CaptureBuffers)
+    {
+        d->numDMABuffers = static_cast<uint32_t>(control.get_value<int>());
+        startLive();
+    }
+    else if (control.id == ControlID::BayerPattern)
+    {
+        d->rawColorFormat = control.get_value<int>();
+        startLive();
+    }
     else
     {
         if (control.supports_auto)
@@ -468,30 +499,27 @@ void IIDCImager::setControl(const Imager::Control& control)
     }
 }
 
-void IIDCImager::readTemperature()
+double IIDCImager::read_temperature()
 {
-    if (d->temperatureAvailable)
-    {
-        double tempCelsius;
+    double tempCelsius;
 
-        // IIDC does not report units of temperature; my camera returns values in kelvins
-        if (d->temperatureAbsSupported)
-        {
-            float absVal;
-            IIDC_CHECK << dc1394_feature_get_absolute_value(d->camera.get(), DC1394_FEATURE_TEMPERATURE, &absVal)
-                       << "Get feature absolute value";
-            tempCelsius = absVal - 273.15;
-        }
-        else
-        {
-            uint32_t rawVal;
-            IIDC_CHECK << dc1394_feature_get_value(d->camera.get(), DC1394_FEATURE_TEMPERATURE, &rawVal)
-                       << "Get feature value";
-            tempCelsius = rawVal - 273;
-        }
-
-        emit temperature(tempCelsius);
+    // IIDC does not report units of temperature; my camera returns values in kelvins
+    if (d->temperatureAbsSupported)
+    {
+        float absVal;
+        IIDC_CHECK << dc1394_feature_get_absolute_value(d->camera.get(), DC1394_FEATURE_TEMPERATURE, &absVal)
+                   << "Get feature absolute value";
+        tempCelsius = absVal - 273.15;
+    }
+    else
+    {
+        uint32_t rawVal;
+        IIDC_CHECK << dc1394_feature_get_value(d->camera.get(), DC1394_FEATURE_TEMPERATURE, &rawVal)
+                   << "Get feature value";
+        tempCelsius = rawVal - 273;
     }
+
+    return tempCelsius;
 }
 
 
@@ -546,6 +574,20 @@ Imager::Controls IIDCImager::controls() const
     if (DC1394_FALSE == dc1394_is_video_mode_scalable(d->currentVidMode))
         controls.push_back(d->getFrameRates(d->currentVidMode));
 
+    controls.push_back(Control{ ControlID::CaptureBuffers, "Capture buffers" }.set_range(2, 64, 1)
+                                                                             .set_value(static_cast<int>(d->numDMABuffers))
+                                                                             .set_default_value(static_cast<int>(IIDCImagerWorker::DEFAULT_DMA_BUFFERS)));
+
+    controls.push_back(Control{ ControlID::BayerPattern, "Bayer pattern", Control::Combo }
+                       .add_choice("Camera default", -1)
+                       .add_choice_enum("None (mono)", Frame::Mono)
+                       .add_choice_enum("RGGB", Frame::Bayer_RGGB)
+                       .add_choice_enum("GRBG", Frame::Bayer_GRBG)
+                       .add_choice_enum("GBRG", Frame::Bayer_GBRG)
+                       .add_choice_enum("BGGR", Frame::Bayer_BGGR)
+                       .set_value(d->rawColorFormat)
+                       .set_default_value(-1));
+
     for (const dc1394feature_info_t &feature: d->features.feature)
         if (DC1394_TRUE == feature.available)
         {
@@ -579,14 +621,9 @@ Imager::Controls IIDCImager::controls() const
                 case DC1394_FEATURE_FOCUS:           control.name = "Focus"; break;
                 case DC1394_FEATURE_TEMPERATURE:     control.name = "Temperature"; break;
 
-                // TODO: requires special handling
-                // case DC1394_FEATURE_TRIGGER:         control.name = "Trigger"; break;
+                // DC1394_FEATURE_TRIGGER is the "Trigger" combo after the features, see triggerModes()
 
-                // TODO: uncomment when DC1394_FEATURE_TRIGGER is implemented
-                // case DC1394_FEATURE_TRIGGER_DELAY:
-                //     control.name = "Trigger delay";
-                //     control.is_duration = true;
-                //     break;
+                case DC1394_FEATURE_TRIGGER_DELAY:   control.name = "Trigger delay"; break;
 
                 //TODO: this is in fact a triple of controls
                 //case DC1394_FEATURE_WHITE_SHADING:   control.name = "White shading"; break;
@@ -656,7 +693,7 @@ Imager::Controls IIDCImager::controls() const
                 else
                     control.value = absMin;
 
-                if (feature.id == DC1394_FEATURE_SHUTTER)
+                if (feature.id == DC1394_FEATURE_SHUTTER || feature.id == DC1394_FEATURE_TRIGGER_DELAY)
                 {
                     control.is_duration = true;
                     // No way to check the unit using IIDC API, but PGR Firefly MV (FMVU-03MTM) and Chameleon3 (CM3-U3-13S2M) both use seconds
@@ -689,9 +726,25 @@ Imager::Controls IIDCImager::controls() const
             controls.push_back(std::move(control));
         }
 
+    const auto modes = d->triggerModes();
+    if (!modes.isEmpty())
+        controls.push_back(trigger_control(modes));
+
     return controls;
 }
 
+QList<ImagerThread::Trigger::Mode> IIDCImager::Private::triggerModes() const
+{
+    const auto featEnd = features.feature + DC1394_FEATURE_NUM;
+    const auto trigger = std::find_if(&features.feature[0], featEnd,
+            [](const dc1394feature_info_t &feat) { return DC1394_FEATURE_TRIGGER == feat.id && feat.available; });
+    if (trigger == featEnd)
+        return {};
+    if (DC1394_TRUE != trigger->polarity_capable)
+        return { ImagerThread::Trigger::RisingEdge };
+    return { ImagerThread::Trigger::RisingEdge, ImagerThread::Trigger::FallingEdge };
+}
+
 
 void IIDCImager::clearROI()
 {
@@ -706,7 +759,7 @@ void IIDCImager::setROI(const QRect &roi)
 
 void IIDCImager::startLive()
 {
-    restart([this] { return std::make_shared<IIDCImagerWorker>(d->camera.get(), d->currentVidMode, d->currentPixFmt, d->currentROI); });
+    restart([this] { return std::make_shared<IIDCImagerWorker>(d->camera.get(), d->currentVidMode, d->currentPixFmt, d->currentROI, d->numDMABuffers, d->rawColorFormat); });
     qDebug() << "Video streaming started successfully";
 }
 
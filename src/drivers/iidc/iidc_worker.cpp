@@ -19,12 +19,15 @@
 #include "iidc_exception.h"
 #include "iidc_worker.h"
 #include <QRect>
+#include <QElapsedTimer>
+#include <QThread>
 #include "commons/frame.h"
+#include "commons/framepool.h"
 
 
 IIDCImagerWorker::IIDCImagerWorker(dc1394camera_t *_camera, dc1394video_mode_t _vidMode,
-                                   dc1394color_coding_t _pixFmt, const QRect &roi)
-: camera(_camera), nativeFrame(nullptr), vidMode(_vidMode), pixFmt(_pixFmt)
+                                   dc1394color_coding_t _pixFmt, const QRect &roi, uint32_t numDMABuffers, int _rawColorFormat)
+: camera(_camera), nativeFrame(nullptr), vidMode(_vidMode), pixFmt(_pixFmt), rawColorFormat(_rawColorFormat)
 {
     frameInfo.initialized = false;
 
@@ -39,7 +42,7 @@ IIDCImagerWorker::IIDCImagerWorker(dc1394camera_t *_camera, dc1394video_mode_t _
 
     setROI(roi);
 
-    IIDC_CHECK << dc1394_capture_setup(camera, NUM_DMA_BUFFERS, DC1394_CAPTURE_FLAGS_DEFAULT)
+    IIDC_CHECK << dc1394_capture_setup(camera, numDMABuffers, DC1394_CAPTURE_FLAGS_DEFAULT)
                << "Setup capture";
 
     IIDC_CHECK << dc1394_video_set_transmission(camera, DC1394_ON)
@@ -75,6 +78,7 @@ void IIDCImagerWorker::initFrameInfo()
 
     case DC1394_COLOR_CODING_RAW8:
     case DC1394_COLOR_CODING_RAW16:
+        frameInfo.colorFormat = Frame::ColorFormat::Mono;
         switch (nativeFrame->color_filter)
         {
         case DC1394_COLOR_FILTER_RGGB: frameInfo.colorFormat = Frame::ColorFormat::Bayer_RGGB; break;
@@ -85,6 +89,11 @@ void IIDCImagerWorker::initFrameInfo()
         break;
     }
 
+    // Frames stay raw all the way (recording included), debayering is left to the display:
+    // many Bayer cameras stream "mono" formats, or don't report the right filter
+    if (rawColorFormat >= 0 && frameInfo.colorFormat != Frame::ColorFormat::RGB)
+        frameInfo.colorFormat = static_cast<Frame::ColorFormat>(rawColorFormat);
+
     frameInfo.bitsPerChannel = nativeFrame->data_depth;
     frameInfo.byteOrder = (nativeFrame->little_endian ? Frame::ByteOrder::LittleEndian : Frame::ByteOrder::BigEndian);
 
@@ -108,8 +117,25 @@ static bool isYUV(dc1394color_coding_t colorCoding)
 FramePtr IIDCImagerWorker::shoot()
 {
     //TODO: fail gracefully if cannot capture
-    IIDC_CHECK << dc1394_capture_dequeue(camera, DC1394_CAPTURE_POLICY_WAIT, &nativeFrame)
-               << "Capture dequeue";
+    if (trigger.active())
+    {
+        // Frames keep their bus timestamp: polling doesn't add to the trigger jitter
+        QElapsedTimer waiting;
+        waiting.start();
+        do
+        {
+            IIDC_CHECK << dc1394_capture_dequeue(camera, DC1394_CAPTURE_POLICY_POLL, &nativeFrame)
+                       << "Capture dequeue";
+            if (!nativeFrame)
+                QThread::usleep(500);
+        } while (!nativeFrame && waiting.elapsed() < trigger.poll.count());
+
+        if (!nativeFrame)
+            return {};
+    }
+    else
+        IIDC_CHECK << dc1394_capture_dequeue(camera, DC1394_CAPTURE_POLICY_WAIT, &nativeFrame)
+                   << "Capture dequeue";
 
     if (!frameInfo.initialized)
     {
@@ -119,8 +145,8 @@ FramePtr IIDCImagerWorker::shoot()
         if (isYUV(nativeFrame->color_coding))
         {
             frameInfo.needsYUVtoRGBconversion = true;
-            conversionBuf.src = std::make_unique<uint8_t[]>(nativeFrame->total_bytes); // Pass 'total_bytes' for simplicity; we may use less
-            conversionBuf.dest = std::make_unique<uint8_t[]>(nativeFrame->size[0] * nativeFrame->size[1] * 3); // 3 bytes/pixel (R, G, B)
+            if (nativeFrame->stride != frameInfo.srcBytesPerLine)
+                condensedYUV = std::make_unique<uint8_t[]>(nativeFrame->total_bytes); // Pass 'total_bytes' for simplicity; we may use less
         }
         else
             frameInfo.needsYUVtoRGBconversion = false;
@@ -129,57 +155,59 @@ FramePtr IIDCImagerWorker::shoot()
     const size_t imgWidth = nativeFrame->size[0],
                  imgHeight = nativeFrame->size[1];
 
-    auto frame = std::make_shared<Frame>(frameInfo.bitsPerChannel,
-                                         frameInfo.colorFormat,
-                                         QSize{ (int)imgWidth, (int)imgHeight },
-                                         frameInfo.byteOrder);
-
-    uint8_t *srcLine;
-    size_t srcLineStep;
+    auto frame = frames_pool->acquire(frameInfo.bitsPerChannel,
+                                      frameInfo.colorFormat,
+                                      QSize{ (int)imgWidth, (int)imgHeight },
+                                      frameInfo.byteOrder);
 
     uint8_t *destLine = frame->mat().data;
     const size_t destLineStep = frame->mat().step[0];
-    size_t numDestCopyBytes; // Number of bytes per line to copy into 'frame'
 
     if (frameInfo.needsYUVtoRGBconversion)
     {
-        //
-        // 1) Condense source data from 'nativeFrame' into 'conversionBuf.src'
-        //
-
-        for (size_t y = 0; y < imgHeight; y++)
-            memcpy(conversionBuf.src.get() + y*frameInfo.srcBytesPerLine,
-                   nativeFrame->image + y * nativeFrame->stride,
-                   frameInfo.srcBytesPerLine);
-
-        //
-        // 2) Convert
-        //
+        // The frame is continuous, with 3 bytes/pixel (R, G, B): the conversion can write it directly
+        const uint8_t *yuv = nativeFrame->image;
+        if (condensedYUV)
+        {
+            for (size_t y = 0; y < imgHeight; y++)
+                memcpy(condensedYUV.get() + y*frameInfo.srcBytesPerLine,
+                       nativeFrame->image + y * nativeFrame->stride,
+                       frameInfo.srcBytesPerLine);
+            yuv = condensedYUV.get();
+        }
 
-        dc1394_convert_to_RGB8(conversionBuf.src.get(), conversionBuf.dest.get(), imgWidth, imgHeight,
+        dc1394_convert_to_RGB8(const_cast<uint8_t *>(yuv), destLine, imgWidth, imgHeight,
                                nativeFrame->yuv_byte_order, nativeFrame->color_coding, 8);
-
-        //
-        // 3) Prepare to copy converted data to 'frame'
-        //
-
-        srcLine = conversionBuf.dest.get();
-        srcLineStep = imgWidth * 3;
-        numDestCopyBytes = std::min(destLineStep, imgWidth * 3);
+    }
+    else if (destLineStep == nativeFrame->stride)
+    {
+        memcpy(destLine, nativeFrame->image, frame->size());
     }
     else
     {
-        srcLine = nativeFrame->image;
-        srcLineStep = nativeFrame->stride;
-        numDestCopyBytes = std::min(destLineStep, (size_t)nativeFrame->stride);
+        const uint8_t *srcLine = nativeFrame->image;
+        const size_t numDestCopyBytes = std::min(destLineStep, (size_t)nativeFrame->stride); // Number of bytes per line to copy into 'frame'
+        for (int y = 0; y < frame->mat().rows; y++)
+        {
+            memcpy(destLine, srcLine, numDestCopyBytes);
+
+            srcLine += nativeFrame->stride;
+            destLine += destLineStep;
+        }
     }
 
-    for (int y = 0; y < frame->mat().rows; y++)
+    // Unix time, in microseconds, the frame reached the driver ring buffer
+    if (nativeFrame->timestamp > 0)
     {
-        memcpy(destLine, srcLine, numDestCopyBytes);
-
-        srcLine += srcLineStep;
-        destLine += destLineStep;
+        const Frame::Timestamp timestamp{ static_cast<Frame::Timestamp::rep>(nativeFrame->timestamp) };
+        frame->set_device_timestamp(timestamp);
+        const auto created_utc = QDateTime::fromMSecsSinceEpoch(std::chrono::duration_cast<std::chrono::milliseconds>(timestamp).count(), Qt::UTC);
+        const qint64 age_msecs = created_utc.msecsTo(QDateTime::currentDateTimeUtc());
+        if (age_msecs >= 0)
+        {
+            frame->set_created_utc(created_utc);
+            frame->set_captured(Frame::Clock::now() - std::chrono::milliseconds{ age_msecs });
+        }
     }
 
     IIDC_CHECK << dc1394_capture_enqueue(camera, nativeFrame)
@@ -189,6 +217,33 @@ FramePtr IIDCImagerWorker::shoot()
     return frame;
 }
 
+bool IIDCImagerWorker::set_trigger(const ImagerThread::Trigger &trigger)
+{
+    dc1394feature_info_t feature;
+    feature.id = DC1394_FEATURE_TRIGGER;
+    IIDC_CHECK << dc1394_feature_get(camera, &feature)
+               << "Get trigger feature";
+    if (DC1394_TRUE != feature.available)
+        return !trigger.active();
+    if (trigger.mode == ImagerThread::Trigger::FallingEdge && DC1394_TRUE != feature.polarity_capable)
+        return false;
+
+    if (trigger.active())
+    {
+        IIDC_CHECK << dc1394_external_trigger_set_mode(camera, DC1394_TRIGGER_MODE_0)
+                   << "Set trigger mode";
+        if (DC1394_TRUE == feature.polarity_capable)
+            IIDC_CHECK << dc1394_external_trigger_set_polarity(camera, trigger.mode == ImagerThread::Trigger::FallingEdge ? DC1394_TRIGGER_ACTIVE_LOW
+                                                                                                                      : DC1394_TRIGGER_ACTIVE_HIGH)
+                       << "Set trigger polarity";
+    }
+    IIDC_CHECK << dc1394_external_trigger_set_power(camera, trigger.active() ? DC1394_ON : DC1394_OFF)
+               << "Set trigger on/off state";
+
+    this->trigger = trigger;
+    return true;
+}
+
 void IIDCImagerWorker::setROI(const QRect &roi)
 {
     if (dc1394_is_video_mode_scalable(vidMode))
@@ -31,6 +31,8 @@ class IIDCImagerWorker: public ImagerThread::Worker
     dc1394video_frame_t *nativeFrame; ///< The most recently captured frame
     dc1394video_mode_t vidMode;
     dc1394color_coding_t pixFmt;
+    int rawColorFormat;
+    ImagerThread::Trigger trigger;
 
     struct
     {
@@ -43,13 +45,10 @@ class IIDCImagerWorker: public ImagerThread::Worker
         size_t srcBytesPerLine; ///< Set only for YUV formats
     } frameInfo;
 
-    /// Used for YUV->RGB conversion
-    /** Required, because conversion function expects buffers without line padding,
-        which may be present in a dequeued capture buffer. */
-    struct
-    {
-        std::unique_ptr<uint8_t[]> src, dest;
-    } conversionBuf;
+    /// Used for YUV->RGB conversion, only when the dequeued capture buffer has line padding
+    /** Required, because conversion function expects buffers without line padding.
+        The converted image is written directly into the frame. */
+    std::unique_ptr<uint8_t[]> condensedYUV;
 
     void initFrameInfo();
 
@@ -60,14 +59,21 @@ class IIDCImagerWorker: public ImagerThread::Worker
 
 public:
 
-    static constexpr uint32_t NUM_DMA_BUFFERS = 4;
+    /// Frames the driver can hold while we're busy: at 120 fps, 16 buffers give about 130 ms before frames are dropped
+    static constexpr uint32_t DEFAULT_DMA_BUFFERS = 16;
 
     IIDCImagerWorker(dc1394camera_t *_camera, dc1394video_mode_t _vidMode, dc1394color_coding_t _pixFmt,
                      /// Must be already validated; also used as the initial frame size for Format7 modes
-                     const QRect &roi);
+                     const QRect &roi,
+                     uint32_t numDMABuffers = DEFAULT_DMA_BUFFERS,
+                     /// Frame::ColorFormat for mono and raw pixel formats, i.e. a Bayer pattern the camera doesn't report; -1 to use the camera one
+                     int rawColorFormat = -1);
 
     FramePtr shoot() override;
 
+    /// External trigger in mode 0 (one exposure per edge); frames are then polled for, instead of waited for
+    bool set_trigger(const ImagerThread::Trigger &trigger) override;
+
     virtual ~IIDCImagerWorker();
 };
 
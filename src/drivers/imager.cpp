@@ -21,6 +21,13 @@
 #include "commons/utils.h"
 #include <QCoreApplication>
 #include <QMutex>
+#include <QTimer>
+#include <algorithm>
+#include <exception>
+#include "commons/exposureprogress.h"
+#include "sensorpoller.h"
+#include "controlscache.h"
+#include "commons/metrics.h"
 using namespace std;
 using namespace std::placeholders;
 
@@ -31,8 +38,44 @@ DPTR_IMPL(Imager) {
   unique_ptr<QHash<Imager::Capability, bool>> capabilities;
   bool destroyed = false;
   Configuration::CaptureEndianess captureEndianess = Configuration::CaptureEndianess::CameraDefault;
+  bool native_byte_order = false;
+  bool realtime_capture = false;
+  int capture_cpu = -1;
+  int capture_batch = 1;
+  // The running worker can't move its ROI: no point asking again until the next one
+  bool shift_unsupported = false;
+  std::chrono::milliseconds capture_interval{0};
+  ImagerThread::Trigger trigger;
+  CaptureTransform::Settings transform;
+  ExposureProgressPtr exposure_progress = make_shared<ExposureProgress>();
+  QMutex snapshot_mutex;
+  Controls snapshot;
+  bool has_snapshot = false;
+  bool controls_cache = false;
+  FrameMetadata metadata;
+  // Periodic driver reads, one imager thread job per tick for all of them (see add_sensor)
+  struct Sensor {
+    QString name;
+    function<double()> read;
+  };
+  vector<Sensor> sensors;
+  SensorPoller sensor_poller;
+  QTimer *sensors_timer;
+  ImagerThread::PendingJobPtr sensors_job;
+  mutable QMutex sensor_values_mutex;
+  QMap<QString, double> sensor_values;
+  // Time to first frame right after opening the camera counts from the imager creation, the driver being already initialised by then
+  chrono::steady_clock::time_point created = chrono::steady_clock::now();
+  bool started = false;
+  chrono::steady_clock::time_point first_frame_since(const chrono::steady_clock::time_point &now) {
+    const bool first = ! started;
+    started = true;
+    return first ? created : now;
+  }
 };
 
+const QString Imager::TemperatureSensor = "temperature";
+
 Imager::Imager(const ImageHandlerPtr& image_handler) : QObject(nullptr), dptr(image_handler)
 {
   static bool metatypes_registered = false;
@@ -40,7 +83,32 @@ Imager::Imager(const ImageHandlerPtr& image_handler) : QObject(nullptr), dptr(im
     metatypes_registered = true;
     qRegisterMetaType<Imager::Control>("Imager::Control");
   }
+  // Direct, so that the snapshot is already current when the queued handlers below run
+  connect(this, &Imager::changed, this, [=](const Imager::Control &c) {
+    QMutexLocker lock{&d->snapshot_mutex};
+    auto control = find_if(d->snapshot.begin(), d->snapshot.end(), [&](const Control &s) { return s.id == c.id; });
+    if(control != d->snapshot.end())
+      *control = c;
+  }, Qt::DirectConnection);
   connect(this, &Imager::changed, this, [=](const Imager::Control &c) { if(c.is_exposure) update_exposure(); });
+  connect(this, &Imager::changed, this, [=](const Imager::Control &c) {
+    if(is_gain(c)) {
+      d->metadata.gain = c.value.toDouble();
+      update_metadata();
+    }
+  });
+  connect(this, &Imager::temperature, this, [=](double celsius) {
+    d->metadata.temperature = celsius;
+    update_metadata();
+  });
+  // Started once the imager is in its own thread (drivers are created elsewhere, then moved)
+  d->sensors_timer = new QTimer{this};
+  connect(d->sensors_timer, &QTimer::timeout, this, &Imager::poll_sensors);
+}
+
+bool Imager::is_gain(const Control &control)
+{
+  return ! control.is_exposure && control.type == Control::Number && control.name.compare("gain", Qt::CaseInsensitive) == 0;
 }
 
 Imager::~Imager()
@@ -56,7 +124,7 @@ void Imager::import_controls(const QVariantList& controls, bool by_id)
     QVariantMap map = item.toMap();
     return make_pair(by_id ? map["id"] : map["name"], map);
   });
-  auto device_controls = this->controls();
+  auto device_controls = controls_snapshot();
   Controls changed_controls;
   for(auto &control: device_controls) {
     QVariant key = by_id ? QVariant{static_cast<qlonglong>(control.id)} : QVariant{control.name};
@@ -73,6 +141,57 @@ void Imager::import_controls(const QVariantList& controls, bool by_id)
   setControls(changed_controls);
 }
 
+Imager::Controls Imager::controls_snapshot() const
+{
+  {
+    QMutexLocker lock{&d->snapshot_mutex};
+    if(d->has_snapshot)
+      return d->snapshot;
+  }
+  Controls cached;
+  const auto cache_key = d->controls_cache ? ControlsCache::key(name(), properties()) : QString{};
+  if(d->controls_cache && ControlsCache{}.load(cache_key, cached)) {
+    {
+      QMutexLocker lock{&d->snapshot_mutex};
+      if(d->has_snapshot)
+        return d->snapshot;
+      d->snapshot = cached;
+      d->has_snapshot = true;
+    }
+    // Once the caller is done (i.e. the controls UI is built): the driver may have changed since the cache was written
+    QTimer::singleShot(0, this, [this, cached, cache_key]{
+      const auto controls = this->controls();
+      ControlsCache{}.store(cache_key, controls);
+      bool stale = controls.size() != cached.size();
+      for(const auto &control: controls) {
+        auto known = find_if(cached.begin(), cached.end(), [&](const Control &c) { return c.id == control.id; });
+        if(known == cached.end()) {
+          stale = true;
+          emit control_added(control);
+        } else if(! ControlsCache::same_descriptor(*known, control) || ! known->same_value(control)) {
+          stale |= ! ControlsCache::same_descriptor(*known, control);
+          emit changed(control);
+        }
+      }
+      {
+        QMutexLocker lock{&d->snapshot_mutex};
+        d->snapshot = controls;
+      }
+      if(stale)
+        qDebug() << "Cached controls of" << name() << "were out of date";
+    });
+    return cached;
+  }
+  // Not holding the lock: drivers may wait on the imager thread, which can be emitting changed
+  auto controls = this->controls();
+  if(d->controls_cache)
+    ControlsCache{}.store(cache_key, controls);
+  QMutexLocker lock{&d->snapshot_mutex};
+  d->snapshot = controls;
+  d->has_snapshot = true;
+  return controls;
+}
+
 void Imager::setControls(const Controls& controls)
 {
   for(auto control: controls) {
@@ -84,7 +203,7 @@ void Imager::setControls(const Controls& controls)
 QVariantList Imager::export_controls() const
 {
   QVariantList controls_qvariant;
-  auto controls = this->controls();
+  auto controls = controls_snapshot();
   transform(controls.begin(), controls.end(), back_inserter(controls_qvariant), bind(&Control::asMap, _1));
   return controls_qvariant;
 }
@@ -104,20 +223,194 @@ void Imager::destroy()
 
 void Imager::readTemperature()
 {
+  for(size_t id = 0; id < d->sensors.size(); id++)
+    if(d->sensors[id].name == TemperatureSensor)
+      d->sensor_poller.poll_now(static_cast<int>(id));
+}
+
+void Imager::setRecording(bool recording)
+{
+  d->sensor_poller.set_recording(recording);
+}
+
+void Imager::add_sensor(const QString &name, chrono::milliseconds interval, const function<double()> &read)
+{
+  d->sensors.push_back({name, read});
+  d->sensor_poller.add({interval});
+  if(d->sensors.size() == 1)
+    QMetaObject::invokeMethod(d->sensors_timer, "start", Qt::QueuedConnection, Q_ARG(int, static_cast<int>(d->sensor_poller.tick_interval().count())));
+}
+
+void Imager::poll_sensors()
+{
+  // The imager thread is busy (i.e. on a long exposure): the wheel waits, and catches up afterwards
+  if(! d->imager_thread || (d->sensors_job && d->sensors_job->pending()))
+    return;
+  const auto due = d->sensor_poller.tick(SensorPoller::Clock::now());
+  if(due.empty())
+    return;
+  vector<Private::Sensor> sensors;
+  for(auto id: due)
+    sensors.push_back(d->sensors[id]);
+  d->sensors_job = push_job_on_thread([=]{
+    for(auto sensor: sensors) {
+      double value;
+      try {
+        value = sensor.read();
+      } catch(const std::exception &e) {
+        qWarning() << "Error reading sensor" << sensor.name << ":" << e.what();
+        continue;
+      }
+      {
+        QMutexLocker lock(&d->sensor_values_mutex);
+        d->sensor_values[sensor.name] = value;
+      }
+      emit this->sensor(sensor.name, value);
+      if(sensor.name == TemperatureSensor)
+        emit temperature(value);
+    }
+  });
+}
+
+QMap<QString, double> Imager::sensors() const
+{
+  QMutexLocker lock(&d->sensor_values_mutex);
+  return d->sensor_values;
 }
 
 void Imager::restart(const ImagerThread::Worker::factory& worker)
 {
   LOG_F_SCOPE
+  const auto since = d->first_frame_since(chrono::steady_clock::now());
+  d->shift_unsupported = false;
+  for(auto control: controls_snapshot())
+    if(is_gain(control))
+      d->metadata.gain = control.value.toDouble();
+  // Warm restart: same capture thread and frame buffers, only the worker is new
+  if(d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    auto error = make_shared<exception_ptr>();
+    auto job = push_job_on_thread([=]{
+      try {
+        imager_thread->replace_worker(worker);
+        imager_thread->expect_first_frame(since);
+      } catch(...) {
+        *error = current_exception();
+      }
+    }, true);
+    if(wait_for(job) && ! *error) {
+      update_exposure();
+      update_metadata();
+      return;
+    }
+    if(*error) {
+      try {
+        rethrow_exception(*error);
+      } catch(const std::exception &e) {
+        qWarning() << "Warm capture restart failed, starting a new capture thread:" << e.what();
+      }
+    }
+  }
   d->imager_thread.reset();
   d->imager_thread = make_shared<ImagerThread>(worker(), this, d->image_handler, d->captureEndianess);
+  d->imager_thread->set_scheduling(d->realtime_capture, d->capture_cpu);
+  d->imager_thread->set_batch(d->capture_batch);
+  d->imager_thread->set_native_byte_order(d->native_byte_order);
+  d->imager_thread->set_capture_interval(d->capture_interval);
+  d->imager_thread->set_trigger(d->trigger);
+  d->imager_thread->set_transform(d->transform);
+  d->imager_thread->set_exposure_progress(d->exposure_progress);
+  d->imager_thread->expect_first_frame(since);
   update_exposure();
+  d->imager_thread->set_metadata(d->metadata);
   d->imager_thread->start();
 }
 
+void Imager::reconfigure(const QRect &roi, int bin, int format, const ImagerThread::Worker::factory &worker)
+{
+  d->metadata.roi_x = roi.x();
+  d->metadata.roi_y = roi.y();
+  d->metadata.bin = bin;
+  if(d->imager_thread) {
+    const auto since = chrono::steady_clock::now();
+    auto imager_thread = d->imager_thread;
+    auto reconfigured = make_shared<bool>(false);
+    auto job = push_job_on_thread([=]{
+      try {
+        *reconfigured = imager_thread->worker()->reconfigure(roi, bin, format);
+        if(*reconfigured)
+          imager_thread->expect_first_frame(since);
+      } catch(const std::exception &e) {
+        qWarning() << "In place reconfiguration failed, restarting:" << e.what();
+      }
+    }, true);
+    if(wait_for(job) && *reconfigured) {
+      update_exposure();
+      update_metadata();
+      return;
+    }
+  }
+  restart(worker);
+}
+
+void Imager::shiftROI(const QPoint &shift)
+{
+  if(! d->imager_thread || d->shift_unsupported || shift.isNull())
+    return;
+  auto imager_thread = d->imager_thread;
+  auto origin = make_shared<QPoint>();
+  auto moved = make_shared<bool>(false);
+  auto failed = make_shared<bool>(false);
+  // Not urgent: a move is no reason to cut an exposure short
+  auto job = push_job_on_thread([=]{
+    try {
+      *moved = imager_thread->shift_roi(shift, *origin);
+    } catch(const std::exception &e) {
+      *failed = true;
+      qWarning() << "ROI move failed:" << e.what();
+    }
+  });
+  if(! wait_for(job))
+    return;
+  if(! *moved) {
+    d->shift_unsupported = ! *failed;
+    return;
+  }
+  // Kept for the metadata handed over later on, i.e. on gain changes
+  d->metadata.roi_x = origin->x();
+  d->metadata.roi_y = origin->y();
+}
+
+void Imager::guidePulse(ImagerThread::GuideDirection direction, std::chrono::milliseconds duration)
+{
+  if(! d->imager_thread || duration.count() <= 0)
+    return;
+  static Metrics::Histogram &latency = Metrics::instance().histogram("camera_guide_pulse_latency_seconds", "Time from a guide pulse request to the camera guide port switching on");
+  auto imager_thread = d->imager_thread;
+  const auto requested = chrono::steady_clock::now();
+  // Urgent, so that the correction measured on a frame is on its way before the next one
+  imager_thread->push_job([=]{
+    try {
+      auto worker = imager_thread->worker();
+      if(! worker || ! worker->guide_pulse(direction, duration)) {
+        qWarning() << "Guide pulses not supported by the camera";
+        return;
+      }
+      latency.record(chrono::duration_cast<Metrics::Histogram::Duration>(chrono::steady_clock::now() - requested));
+    } catch(const std::exception &e) {
+      qWarning() << "Guide pulse failed:" << e.what();
+    }
+  }, true, false);
+}
+
+ExposureProgressPtr Imager::exposure_progress() const
+{
+  return d->exposure_progress;
+}
+
 void Imager::update_exposure()
 {
-  for(auto control: controls()) {
+  for(auto control: controls_snapshot()) {
     if(control.is_duration && control.is_exposure) {
       const chrono::duration<double> exposure = control.seconds();
       qDebug() << "Setting exposure: " << exposure.count();
@@ -129,23 +422,30 @@ void Imager::update_exposure()
   }
 }
 
-void Imager::wait_for(const std::shared_ptr<QWaitCondition>& wait_condition) const
+void Imager::update_metadata()
 {
-  if(! wait_condition)
+  if(! d->imager_thread)
     return;
-  QMutex wait_mutex;
-  wait_mutex.lock();
-  wait_condition->wait(&wait_mutex);
+  auto imager_thread = d->imager_thread;
+  auto metadata = d->metadata;
+  push_job_on_thread([=]{ imager_thread->set_metadata(metadata); });
+}
+
+bool Imager::wait_for(const ImagerThread::PendingJobPtr& job, chrono::milliseconds timeout) const
+{
+  if(! job)
+    return false;
+  return job->wait(timeout);
 }
 
 
-shared_ptr<QWaitCondition> Imager::push_job_on_thread(const ImagerThread::Job& job)
+ImagerThread::PendingJobPtr Imager::push_job_on_thread(const ImagerThread::Job& job, bool urgent)
 {
   if(! d->imager_thread) {
     qWarning() << "Requested job without imager thread started";
     return {};
   }
-  return d->imager_thread->push_job(job);
+  return d->imager_thread->push_job(job, urgent);
 }
 
 bool Imager::supports(Capability capability) const
@@ -166,3 +466,91 @@ void Imager::setCaptureEndianess(Configuration::CaptureEndianess captureEndianes
         wait_for(push_job_on_thread([=]() { d->imager_thread->setCaptureEndianess(d->captureEndianess); }));
 }
 
+void Imager::setNativeByteOrder(bool native)
+{
+  d->native_byte_order = native;
+  if (d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    push_job_on_thread([=]() { imager_thread->set_native_byte_order(native); });
+  }
+}
+
+void Imager::setCaptureThreadScheduling(bool realtime, int cpu)
+{
+  d->realtime_capture = realtime;
+  d->capture_cpu = cpu;
+  if (d->imager_thread)
+    wait_for(push_job_on_thread([=]() { d->imager_thread->set_scheduling(realtime, cpu); }));
+}
+
+void Imager::setControlsCache(bool enabled)
+{
+  d->controls_cache = enabled;
+}
+
+void Imager::setCaptureBatch(int frames)
+{
+  d->capture_batch = std::max(frames, 1);
+  if (d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    const int batch = d->capture_batch;
+    push_job_on_thread([=]() { imager_thread->set_batch(batch); });
+  }
+}
+
+void Imager::setCaptureInterval(chrono::milliseconds interval)
+{
+  d->capture_interval = interval;
+  if (d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    push_job_on_thread([=]() { imager_thread->set_capture_interval(interval); });
+  }
+}
+
+void Imager::setCaptureTrigger(const ImagerThread::Trigger &trigger)
+{
+  d->trigger = trigger;
+  if (d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    push_job_on_thread([=]() { imager_thread->set_trigger(trigger); }, true);
+  }
+}
+
+const qlonglong Imager::TriggerControlID = 30000;
+
+Imager::Control Imager::trigger_control(const QList<ImagerThread::Trigger::Mode> &modes) const
+{
+  static const QHash<ImagerThread::Trigger::Mode, QString> labels {
+    {ImagerThread::Trigger::FreeRun, "Free running"},
+    {ImagerThread::Trigger::RisingEdge, "Rising edge"},
+    {ImagerThread::Trigger::FallingEdge, "Falling edge"},
+  };
+  Control control{TriggerControlID, "Trigger", Control::Combo};
+  control.add_choice_enum(labels[ImagerThread::Trigger::FreeRun], ImagerThread::Trigger::FreeRun);
+  for(auto mode: modes)
+    if(mode != ImagerThread::Trigger::FreeRun)
+      control.add_choice_enum(labels[mode], mode);
+  control.set_default_value_enum(ImagerThread::Trigger::FreeRun);
+  control.set_value_enum(d->trigger.mode);
+  return control;
+}
+
+bool Imager::set_trigger_control(const Control &control)
+{
+  if(control.id != TriggerControlID)
+    return false;
+  auto trigger = d->trigger;
+  trigger.mode = control.get_value_enum<ImagerThread::Trigger::Mode>();
+  setCaptureTrigger(trigger);
+  emit changed(control);
+  return true;
+}
+
+void Imager::setSoftwareTransform(const CaptureTransform::Settings &transform)
+{
+  d->transform = transform;
+  if (d->imager_thread) {
+    auto imager_thread = d->imager_thread;
+    push_job_on_thread([=]() { imager_thread->set_transform(transform); });
+  }
+}
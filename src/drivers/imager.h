@@ -25,6 +25,9 @@
 #include <QObject>
 #include <QDebug>
 #include <QSet>
+#include <QPoint>
+#include <QMap>
+#include <functional>
 #include "imagerthread.h"
 #include "c++/dptr.h"
 #include <QWaitCondition>
@@ -37,44 +40,92 @@ public:
   virtual ~Imager();
   struct Control;
   struct Properties;
-  enum Capability { ROI, Temperature, LiveStream, StillPicture, };
+  enum Capability { ROI, Temperature, LiveStream, StillPicture, ExternalTrigger, GuidePort, };
   typedef QList<Control> Controls;
 
   virtual Controls controls() const = 0;  
+  /// Last known controls, kept current through the changed signal: no driver call after the first one. Use it where a slightly stale auto value is fine (recording metadata, presets, frame handlers)
+  Controls controls_snapshot() const;
   virtual QString name() const = 0;
   virtual Properties properties() const = 0;
   bool supports(Capability capability) const;
   
   void setCaptureEndianess(Configuration::CaptureEndianess captureEndianess);
+  /// 16 bit frames swapped to the native byte order once, on the capture thread, see ImagerThread::set_native_byte_order
+  void setNativeByteOrder(bool native);
+  /// Real time priority and CPU pinning (cpu < 0: any CPU) for the capture thread, see ImagerThread::set_scheduling
+  void setCaptureThreadScheduling(bool realtime, int cpu);
+  /// Frames handed to the image handlers together at very high frame rates, see ImagerThread::set_batch (1: one at a time)
+  void setCaptureBatch(int frames);
+  /// Timelapse: one frame per interval, see ImagerThread::set_capture_interval (0: as fast as possible)
+  void setCaptureInterval(std::chrono::milliseconds interval);
+  /// Frames started by the camera trigger input, see ImagerThread::set_trigger; kept across capture restarts
+  void setCaptureTrigger(const ImagerThread::Trigger &trigger);
+  /// Software ROI and binning on the capture thread, for cameras without hardware support (see CaptureTransform)
+  void setSoftwareTransform(const CaptureTransform::Settings &transform);
+  /// The first controls snapshot comes from the descriptors saved by the last session (see ControlsCache), checked against the driver right after. Call before controls_snapshot
+  void setControlsCache(bool enabled);
+  /// Long exposure in progress, to be polled (i.e. by ExposureTimer); the same object across capture restarts
+  ExposureProgressPtr exposure_progress() const;
+  /// Last values read from the driver sensors (see add_sensor), by name: no driver call
+  QMap<QString, double> sensors() const;
+  /// Sensor emitting temperature() too, and kept in the frames metadata
+  static const QString TemperatureSensor;
 
 protected:
+  /// New worker from the factory: swapped on the running capture thread when there is one (see ImagerThread::replace_worker), otherwise on a new thread
   void restart(const ImagerThread::Worker::factory &worker);
-  std::shared_ptr<QWaitCondition> push_job_on_thread(const ImagerThread::Job &job);
+  /// ROI, bin or format change: done in place when the running worker supports it (see ImagerThread::Worker::reconfigure), otherwise through restart
+  void reconfigure(const QRect &roi, int bin, int format, const ImagerThread::Worker::factory &worker);
+  /// Urgent jobs (i.e. control changes) go first, aborting long exposures in progress when the driver supports it
+  ImagerThread::PendingJobPtr push_job_on_thread(const ImagerThread::Job &job, bool urgent = false);
   void update_exposure();
-  void wait_for(const std::shared_ptr<QWaitCondition> &wait_condition) const;
+  /// Hands the camera state known so far (gain, temperature, ROI and bin, see FrameMetadata) to the capture thread, for the frames to come
+  void update_metadata();
+  /// false on timeout, or if the job was cancelled (i.e. the imager thread stopped)
+  bool wait_for(const ImagerThread::PendingJobPtr &job, std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) const;
+  /**
+   * Slowly changing camera state (temperature, cooler power...) read every interval, or less often while recording (see setRecording):
+   * all the sensors due are read in the same imager thread job, and a tick is skipped while the previous one hasn't run yet.
+   * read runs on the imager thread; exceptions just skip that value. Values are published with the sensor signal, and kept for sensors().
+   */
+  void add_sensor(const QString &name, std::chrono::milliseconds interval, const std::function<double()> &read);
+  /// "Trigger" combo for drivers supporting ExternalTrigger: append it to controls(), and hand their setControl argument to set_trigger_control first
+  static const qlonglong TriggerControlID;
+  Control trigger_control(const QList<ImagerThread::Trigger::Mode> &modes) const;
+  /// true if control was the trigger one (and then it's applied)
+  bool set_trigger_control(const Control &control);
   // Call this at the end of each subclass constructor. Still have to find a better way for it, but whatever...
 private:
+  static bool is_gain(const Control &control);
+  void poll_sensors();
   DPTR
   
 public slots:
   virtual void setROI(const QRect &) = 0;
   virtual void clearROI() = 0;
+  /// Moves the hardware ROI by shift frame pixels without restarting the capture, when the driver supports it (see ImagerThread::Worker::shift_roi)
+  void shiftROI(const QPoint &shift);
+  /// Guide pulse through the camera guide port (ST4), for drivers supporting GuidePort: it jumps the imager thread queue, without cutting the exposure short
+  void guidePulse(ImagerThread::GuideDirection direction, std::chrono::milliseconds duration);
   virtual void setControl(const Imager::Control &control) = 0;
+  /// Applies a batch of controls in order, as a single transaction: drivers overriding it should restart the acquisition at most once, and reach the camera in as few imager thread jobs as possible. The default implementation just calls setControl for each one.
   virtual void setControls(const Imager::Controls &controls);
   void import_controls(const QVariantList &controls, bool by_id = true);
   virtual void startLive() = 0;
   virtual void destroy();
   QVariantList export_controls() const;
-  /// If the camera supports temperature reporting, derived classes should perform the readout and emit the 'temperature' signal
+  /// Reads the temperature sensor on the next sensors tick, instead of waiting for its turn (see add_sensor)
   virtual void readTemperature();
+  /// Sensors are read less often while recording, as every driver call competes with the capture
+  void setRecording(bool recording);
 signals:
   void fps(double rate);
   void temperature(double celsius);
+  void sensor(const QString &name, double value);
   void changed(const Imager::Control &control);
   void disconnected();
   void exposure_changed(const Imager::Control &control);
-  void long_exposure_started(double exposure_seconds);
-  void long_exposure_ended();
   void control_added(const Imager::Control &control);
 };
 
@@ -24,19 +24,52 @@
 #include "commons/utils.h"
 #include "commons/fps_counter.h"
 #include <atomic>
-#include <boost/lockfree/spsc_queue.hpp>
+#include <deque>
+#include <climits>
+#include <vector>
 #include "stlutils.h"
 #include "Qt/benchmark.h"
 #include "Qt/qt_strings_helper.h"
 #include "imagerexception.h"
 #include <QElapsedTimer>
+#include <QPoint>
 #include "commons/messageslogger.h"
 #include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+#include "commons/threadplacement.h"
+#include "commons/exposureprogress.h"
+#include "commons/pixel_kernels.h"
+#include <boost/endian/conversion.hpp>
 
 
 using namespace std;
 using namespace std::chrono_literals;
 
+// Longest time a frame waits in a capture batch
+#define CAPTURE_BATCH_MSECS 20
+// Longest wait for jobs between two exposure status polls
+#define EXPOSURE_POLL_MSECS 50
+
+namespace {
+void to_native_byte_order(Frame &frame)
+{
+  const Frame::ByteOrder native_order = boost::endian::order::native == boost::endian::order::little ? Frame::LittleEndian : Frame::BigEndian;
+  cv::Mat &image = frame.mat();
+  if(image.depth() != CV_16U || frame.byteOrder() == native_order)
+    return;
+  const size_t row_values = image.cols * image.channels();
+  if(image.isContinuous()) {
+    PixelKernels::swap16(image.ptr<uint16_t>(), image.ptr<uint16_t>(), row_values * image.rows);
+  } else {
+    for(int row = 0; row < image.rows; row++)
+      PixelKernels::swap16(image.ptr<uint16_t>(row), image.ptr<uint16_t>(row), row_values);
+  }
+  frame.overrideByteOrder(native_order);
+}
+}
+
 DPTR_IMPL(ImagerThread) : public QObject {
   Q_OBJECT
 public:
@@ -44,15 +77,63 @@ public:
   Worker::ptr worker;
   Imager *imager;
   ImageHandlerPtr imageHandler;
+  FramePoolPtr frames_pool;
   fps_counter fps;
   atomic_bool running;
   QThread thread;
-  boost::lockfree::spsc_queue<Job> jobs_queue;
+  QMutex jobs_mutex;
+  QWaitCondition jobs_queued;
+  deque<PendingJobPtr> jobs;
+  PendingJobPtr next_job();
+  atomic_bool shooting;
   bool long_exposure_mode = false;
+  // Worker exposing on its own (see Worker::start_exposure), until found not supporting it
+  bool async_exposures = true;
+  atomic_bool exposing;
+  ExposureProgressPtr exposure_progress = make_shared<ExposureProgress>();
+  // Written under jobs_mutex, and read under it away from the capture thread (see push_job)
   chrono::duration<double> exposure;
+  quint64 sequence = 0;
+  FrameMetadata metadata;
   Configuration::CaptureEndianess captureEndianess = Configuration::CaptureEndianess::CameraDefault;
+  bool native_byte_order = false;
+  bool realtime = false;
+  int cpu = -1;
+  chrono::milliseconds capture_interval{0};
+  bool single_shot = false;
+  // Tiny ROIs at very high frame rates: frames go to the image handlers batch_frames at a time, see set_batch
+  size_t batch_frames = 1;
+  FrameBatch batch;
+  QElapsedTimer batch_age;
+  bool batching() const { return batch_frames > 1 && capture_interval <= 0ms && ! trigger.active(); }
+  void dispatch(const FramePtr &frame);
+  void dispatch_batch();
+  // Streaming cameras may still hold frames exposed before the pause: the first one after it is thrown away
+  bool flush_frame = false;
+  chrono::steady_clock::time_point next_shot;
+  // When the camera was asked for frames (open, restart, reconfigure), until the first one comes: see expect_first_frame
+  chrono::steady_clock::time_point first_frame_since;
+  Trigger trigger;
+  Frame::Clock::time_point last_trigger;
+  CaptureTransform::Settings transform;
+  // Transformed frames have their own size: sharing the driver pool would reshape it back and forth
+  FramePoolPtr transform_pool = make_shared<FramePool>();
+  Metrics::Counter &frames_metric = Metrics::instance().counter("driver_frames_total", "Frames captured");
+  Metrics::Counter &errors_metric = Metrics::instance().counter("driver_errors_total", "Failed frame captures");
+  Metrics::Histogram &shoot_metric = Metrics::instance().histogram("driver_shoot_seconds", "Time spent by the driver capturing a frame");
+  Metrics::Histogram &dispatch_metric = Metrics::instance().histogram("handler_dispatch_seconds", "Time spent handing a captured frame to the image handlers");
+  Metrics::Histogram &trigger_interval_metric = Metrics::instance().histogram("driver_trigger_interval_seconds", "Time between consecutive triggered frames");
+  Metrics::Histogram &first_frame_metric = Metrics::instance().histogram("capture_time_to_first_frame_seconds", "Time from opening, restarting or reconfiguring the capture to its first frame");
 
   void thread_started();
+  void run_jobs();
+  bool start_exposure();
+  FramePtr expose();
+  void stop_exposure();
+  void apply_scheduling();
+  void apply_capture_interval();
+  void apply_trigger();
+  bool wait_for_next_shot();
 
   LOG_C_SCOPE(ImagerThread);
 };
@@ -61,10 +142,14 @@ ImagerThread::Private::Private(const ImagerThread::Worker::ptr& worker, Imager*
   : worker{worker},
   imager{imager},
   imageHandler{imageHandler},
+  frames_pool{make_shared<FramePool>()},
   fps{[=](double rate){ emit imager->fps(rate);}, fps_counter::Mode::Elapsed},
   running{false},
-  jobs_queue{20}
+  shooting{false},
+  exposing{false}
 {
+  worker->set_frames_pool(frames_pool);
+  worker->set_exposure_progress(exposure_progress);
   connect(&thread, &QThread::started, this, &Private::thread_started);
   moveToThread(&thread);
 }
@@ -90,8 +175,15 @@ void ImagerThread::start()
 void ImagerThread::stop()
 {
   d->running = false;
+  {
+    QMutexLocker lock(&d->jobs_mutex);
+    d->jobs_queued.wakeAll();
+  }
   d->thread.quit();
   d->thread.wait();
+  // Nobody is going to run them anymore: don't leave anyone waiting
+  while(auto job = d->next_job())
+    job->cancel();
 }
 
 void ImagerThread::Private::thread_started()
@@ -99,35 +191,85 @@ void ImagerThread::Private::thread_started()
   QElapsedTimer firstErrorOccured;
   int errors_since_last_success = 0;
   int error_messages_since_last_success = 0;
+  apply_scheduling();
+  apply_trigger();
+  apply_capture_interval();
   running = true;
   while(running) {
-    Job queued_job;
-    while(jobs_queue.pop(queued_job)) {
-      if(queued_job) {
-        try {
-          queued_job();
-        } catch(const std::exception &e) {
-          MessagesLogger::queue(MessagesLogger::Warning, tr("Error on imager task"), tr("An error occurred during an imager operation for %1:\n%2")
-            % imager->name()
-            % e.what());
-          qWarning() << e.what();
-        }
-      }
-    }
+    run_jobs();
+    // A job may have stopped the capture, i.e. a failed replace_worker
+    if(! running)
+      break;
+    // The exposure of a triggered frame starts when the trigger comes, not when waiting for it
+    const bool async_exposure = long_exposure_mode && ! trigger.active() && async_exposures;
+    // Started before the last frame was handed over, with settings changed since then
+    if(exposing && ! async_exposure)
+      stop_exposure();
+    if(! exposing && ! wait_for_next_shot())
+      continue;
+    // Exposures run by the worker itself are tracked by expose()
+    const bool track_exposure = long_exposure_mode && ! trigger.active() && ! async_exposure;
+    const auto shoot = [&]{ return async_exposure ? expose() : worker->shoot(); };
     try {
-      if(long_exposure_mode)
-        imager->long_exposure_started(exposure.count() );
-      if(auto frame = worker->shoot()) {
+      if(track_exposure)
+        exposure_progress->started(exposure);
+      shooting = true;
+      GuLinux::Scope shot{[this]{ shooting = false; }};
+      FramePtr frame;
+      const auto shoot_begin = Tracing::Clock::now();
+      {
+        Metrics::Timer timer{shoot_metric};
+        frame = shoot();
+      }
+      if(frame && flush_frame) {
+        flush_frame = false;
+        frame = shoot();
+      }
+      if(frame && trigger.active()) {
+        if(! frame->has_device_timestamp())
+          frame->set_captured(Frame::Clock::now());
+        if(last_trigger != Frame::Clock::time_point{})
+          trigger_interval_metric.record(chrono::duration_cast<Metrics::Histogram::Duration>(frame->captured() - last_trigger));
+        last_trigger = frame->captured();
+      }
+      if(frame) {
           frame->set_exposure(exposure);
+          frame->set_sequence(++sequence);
+          const auto driver_sequence = frame->metadata().driver_sequence;
+          frame->set_metadata(metadata);
+          frame->metadata().driver_sequence = driver_sequence;
+          // The sequence number is only known once the frame is shot, so this span can't be scoped
+          if(Tracing::instance().enabled())
+            Tracing::instance().record("Worker::shoot", sequence, shoot_begin, Tracing::Clock::now());
           if (captureEndianess != Configuration::CaptureEndianess::CameraDefault)
               frame->overrideByteOrder(captureEndianess == Configuration::CaptureEndianess::Little ? Frame::ByteOrder::LittleEndian
                                                                                                    : Frame::ByteOrder::BigEndian);
-          imageHandler->handle(frame);
-        ++fps;
+          if(native_byte_order)
+            to_native_byte_order(*frame);
+          if(transform.active()) {
+            Tracing::Span span{"CaptureTransform::apply", sequence};
+            frame = CaptureTransform::apply(frame, transform, transform_pool);
+          }
+          if(first_frame_since != chrono::steady_clock::time_point{}) {
+            const auto elapsed = chrono::steady_clock::now() - first_frame_since;
+            first_frame_metric.record(chrono::duration_cast<Metrics::Histogram::Duration>(elapsed));
+            qDebug() << "First frame after" << chrono::duration_cast<chrono::milliseconds>(elapsed).count() << "ms";
+            first_frame_since = {};
+          }
+          dispatch(frame);
         errors_since_last_success = 0;
+      } else {
+        // Triggers not coming, or an aborted exposure: nothing to wait for
+        dispatch_batch();
       }
     } catch(const Imager::exception &e) {
       qWarning() << e.what();
+      dispatch_batch();
+      if(exposing) {
+        exposing = false;
+        exposure_progress->finished();
+      }
+      errors_metric.add();
       if(e.imagerDisconnected()) {
         running = false;
         imager->destroy();
@@ -154,35 +296,386 @@ void ImagerThread::Private::thread_started()
           return;
       }
     }
-    if(long_exposure_mode)
-      imager->long_exposure_ended();
+    if(track_exposure)
+      exposure_progress->finished();
+  }
+  if(exposing)
+    stop_exposure();
+  // Frames still batched when capture stops are handed over all the same
+  dispatch_batch();
+}
+
+void ImagerThread::Private::run_jobs()
+{
+  while(auto job = next_job()) {
+    // Frames shot before a control change reach the handlers before it takes effect
+    dispatch_batch();
+    try {
+      job->run();
+    } catch(const std::exception &e) {
+      MessagesLogger::queue(MessagesLogger::Warning, tr("Error on imager task"), tr("An error occurred during an imager operation for %1:\n%2")
+        % imager->name()
+        % e.what());
+      qWarning() << e.what();
+    }
   }
 }
 
-shared_ptr<QWaitCondition> ImagerThread::push_job(const Job& job)
+bool ImagerThread::Private::start_exposure()
 {
-  auto wait_condition = make_shared<QWaitCondition>();
-  auto job_sync = [wait_condition, job]{
-    GuLinux::Scope wake{[=]{ wait_condition->wakeAll();}};
-    job();
-  };
-  if(! d->jobs_queue.push(job_sync) )
+  if(! worker->start_exposure()) {
+    async_exposures = false;
+    qDebug() << "Worker exposing on its own not supported: blocking shots";
+    return false;
+  }
+  exposing = true;
+  exposure_progress->started(exposure);
+  return true;
+}
+
+FramePtr ImagerThread::Private::expose()
+{
+  if(! exposing && ! start_exposure()) {
+    exposure_progress->started(exposure);
+    GuLinux::Scope finished{[this]{ exposure_progress->finished(); }};
+    return worker->shoot();
+  }
+  while(running) {
+    const auto status = worker->exposure_status();
+    if(status == Worker::Idle) {
+      // Aborted, or the camera mode changed by a job: starting over
+      exposing = false;
+      exposure_progress->finished();
+      return {};
+    }
+    if(status == Worker::Exposed) {
+      exposing = false;
+      exposure_progress->reading_out();
+      auto frame = worker->readout();
+      // Continuous capture: the next exposure runs while this frame goes down the image handlers chain
+      bool next = frame && running && capture_interval <= 0ms;
+      {
+        // Jobs first: they may change the settings of the next exposure
+        QMutexLocker lock(&jobs_mutex);
+        next = next && jobs.empty();
+      }
+      if(! next || ! start_exposure())
+        exposure_progress->finished();
+      return frame;
+    }
+    run_jobs();
+    QMutexLocker lock(&jobs_mutex);
+    if(running && jobs.empty())
+      jobs_queued.wait(&jobs_mutex, EXPOSURE_POLL_MSECS);
+  }
+  stop_exposure();
+  return {};
+}
+
+void ImagerThread::Private::stop_exposure()
+{
+  try {
+    worker->abort_exposure();
+  } catch(const std::exception &e) {
+    qWarning() << "Unable to stop the exposure:" << e.what();
+  }
+  exposing = false;
+  exposure_progress->finished();
+}
+
+void ImagerThread::Private::dispatch(const FramePtr &frame)
+{
+  if(! batching()) {
+    dispatch_batch();
+    {
+      Metrics::Timer timer{dispatch_metric};
+      imageHandler->handle(frame);
+    }
+    ++fps;
+    frames_metric.add();
+    return;
+  }
+  if(batch.empty())
+    batch_age.start();
+  batch.push_back(frame);
+  // Bounded in time too, so that the display and analysis never lag behind by much
+  if(batch.size() >= batch_frames || batch_age.elapsed() >= CAPTURE_BATCH_MSECS)
+    dispatch_batch();
+}
+
+void ImagerThread::Private::dispatch_batch()
+{
+  if(batch.empty())
+    return;
+  {
+    Metrics::Timer timer{dispatch_metric};
+    imageHandler->handle_batch(batch);
+  }
+  fps += batch.size();
+  frames_metric.add(batch.size());
+  batch.clear();
+}
+
+void ImagerThread::Private::apply_capture_interval()
+{
+  try {
+    single_shot = worker->set_single_shot(capture_interval > 0ms && ! trigger.active());
+  } catch(const std::exception &e) {
+    qWarning() << "Unable to switch single shot mode:" << e.what();
+    single_shot = false;
+  }
+  next_shot = chrono::steady_clock::now();
+  qDebug() << "Capture interval:" << capture_interval.count() << "ms, single shot:" << single_shot;
+}
+
+void ImagerThread::Private::apply_trigger()
+{
+  last_trigger = {};
+  try {
+    if(worker->set_trigger(trigger)) {
+      qDebug() << "Capture trigger mode:" << trigger.mode;
+      return;
+    }
+  } catch(const std::exception &e) {
+    qWarning() << "Unable to set the trigger mode:" << e.what();
+  }
+  if(! trigger.active())
+    return;
+  MessagesLogger::queue(MessagesLogger::Warning, tr("Trigger"), tr("%1 can't be triggered in this mode: capture keeps free running") % imager->name());
+  trigger = {};
+  try {
+    worker->set_trigger(trigger);
+  } catch(const std::exception &e) {
+    qWarning() << "Unable to restore free running capture:" << e.what();
+  }
+}
+
+bool ImagerThread::Private::wait_for_next_shot()
+{
+  if(capture_interval <= 0ms || trigger.active())
+    return true;
+  {
+    // Jobs and stop requests wake the thread up early: control changes don't wait for the next shot
+    QMutexLocker lock(&jobs_mutex);
+    for(auto now = chrono::steady_clock::now(); now < next_shot; now = chrono::steady_clock::now()) {
+      if(! running || ! jobs.empty())
+        return false;
+      jobs_queued.wait(&jobs_mutex, static_cast<unsigned long>(chrono::duration_cast<chrono::milliseconds>(next_shot - now).count() + 1));
+    }
+  }
+  // Fixed schedule, so that intervals don't drift by the exposure time; shots running late don't queue up
+  next_shot = max(next_shot + capture_interval, chrono::steady_clock::now());
+  flush_frame = ! single_shot;
+  return true;
+}
+
+void ImagerThread::Private::apply_scheduling()
+{
+  ThreadPlacement::apply("capture", ThreadPlacement::cpu(cpu), realtime);
+}
+
+ImagerThread::PendingJobPtr ImagerThread::push_job(const Job& job, bool urgent, bool abort)
+{
+  auto pending = make_shared<PendingJob>(job);
+  chrono::duration<double> exposure;
+  {
+    QMutexLocker lock(&d->jobs_mutex);
+    if(urgent)
+      d->jobs.push_front(pending);
+    else
+      d->jobs.push_back(pending);
+    exposure = d->exposure;
+    d->jobs_queued.wakeAll();
+  }
+  // The frame being exposed now is lost, but waiting for it would make control changes as slow as the exposure
+  if(urgent && abort && (d->shooting || d->exposing) && exposure >= 1s)
+    d->worker->abort_exposure();
+  return pending;
+}
+
+ImagerThread::PendingJobPtr ImagerThread::Private::next_job()
+{
+  QMutexLocker lock(&jobs_mutex);
+  if(jobs.empty())
     return {};
-  return wait_condition;
+  auto job = jobs.front();
+  jobs.pop_front();
+  return job;
 }
 
+void ImagerThread::PendingJob::run()
+{
+  {
+    QMutexLocker lock(&mutex);
+    if(state == Cancelled)
+      return;
+    state = Running;
+  }
+  GuLinux::Scope finished{[this]{
+    QMutexLocker lock(&mutex);
+    state = Done;
+    changed.wakeAll();
+  }};
+  job();
+}
+
+bool ImagerThread::PendingJob::wait(chrono::milliseconds timeout)
+{
+  QMutexLocker lock(&mutex);
+  const bool forever = timeout == chrono::milliseconds::max();
+  // Against a deadline: wakeups that don't end the job don't start the timeout again
+  const auto deadline = chrono::steady_clock::now() + (forever ? chrono::milliseconds::zero() : timeout);
+  while(state == Queued || state == Running) {
+    unsigned long wait_msecs = ULONG_MAX;
+    if(! forever) {
+      const auto remaining = deadline - chrono::steady_clock::now();
+      if(remaining <= remaining.zero())
+        return false;
+      // Rounded up, so that the last wait doesn't end just short of the deadline
+      wait_msecs = static_cast<unsigned long>(chrono::duration_cast<chrono::milliseconds>(remaining + chrono::milliseconds{1} - chrono::nanoseconds{1}).count());
+    }
+    changed.wait(&mutex, wait_msecs);
+  }
+  return state == Done;
+}
+
+void ImagerThread::PendingJob::cancel()
+{
+  QMutexLocker lock(&mutex);
+  if(state == Queued) {
+    state = Cancelled;
+    changed.wakeAll();
+  }
+}
+
+bool ImagerThread::PendingJob::done() const
+{
+  QMutexLocker lock(&mutex);
+  return state == Done;
+}
+
+bool ImagerThread::PendingJob::pending() const
+{
+  QMutexLocker lock(&mutex);
+  return state == Queued || state == Running;
+}
 
 void ImagerThread::set_exposure(const std::chrono::duration<double> &exposure)
 {
   d->long_exposure_mode = ( exposure >= 2s);
-  d->exposure = exposure;
+  {
+    QMutexLocker lock(&d->jobs_mutex);
+    d->exposure = exposure;
+  }
   qDebug() << "Exposure: " << exposure.count() << "s; long exposure: " << d->long_exposure_mode;
 }
 
+void ImagerThread::set_exposure_progress(const ExposureProgressPtr &exposure_progress)
+{
+  d->exposure_progress = exposure_progress;
+  d->worker->set_exposure_progress(exposure_progress);
+}
+
+FramePoolPtr ImagerThread::frames_pool() const
+{
+  return d->frames_pool;
+}
+
+ImagerThread::Worker::ptr ImagerThread::worker() const
+{
+  return d->worker;
+}
+
 void ImagerThread::setCaptureEndianess(Configuration::CaptureEndianess captureEndianess)
 {
     d->captureEndianess = captureEndianess;
     qDebug() << "Capture endianess changed to " << static_cast<int>(captureEndianess);
 }
 
+void ImagerThread::set_native_byte_order(bool native)
+{
+  d->native_byte_order = native;
+  qDebug() << "Capture native byte order:" << native;
+}
+
+void ImagerThread::set_scheduling(bool realtime, int cpu)
+{
+  d->realtime = realtime;
+  d->cpu = cpu;
+  if(QThread::currentThread() == &d->thread)
+    d->apply_scheduling();
+}
+
+void ImagerThread::set_capture_interval(chrono::milliseconds interval)
+{
+  d->capture_interval = interval;
+  if(QThread::currentThread() == &d->thread)
+    d->apply_capture_interval();
+}
+
+void ImagerThread::set_trigger(const Trigger &trigger)
+{
+  d->trigger = trigger;
+  if(QThread::currentThread() == &d->thread) {
+    d->apply_trigger();
+    d->apply_capture_interval();
+  }
+}
+
+void ImagerThread::replace_worker(const Worker::factory &factory)
+{
+  if(d->exposing)
+    d->stop_exposure();
+  d->dispatch_batch();
+  // The camera stream may only be opened by one worker at a time
+  d->worker.reset();
+  try {
+    d->worker = factory();
+  } catch(...) {
+    // Nothing left to shoot with: the imager starts a new thread instead
+    d->running = false;
+    throw;
+  }
+  d->worker->set_frames_pool(d->frames_pool);
+  d->worker->set_exposure_progress(d->exposure_progress);
+  d->async_exposures = true;
+  d->flush_frame = false;
+  d->apply_trigger();
+  d->apply_capture_interval();
+}
+
+void ImagerThread::expect_first_frame(const chrono::steady_clock::time_point &since)
+{
+  d->first_frame_since = since;
+}
+
+void ImagerThread::set_metadata(const FrameMetadata &metadata)
+{
+  d->metadata = metadata;
+}
+
+bool ImagerThread::shift_roi(const QPoint &shift, QPoint &origin)
+{
+  if(! d->worker->shift_roi(shift, origin))
+    return false;
+  d->metadata.roi_x = origin.x();
+  d->metadata.roi_y = origin.y();
+  // Streaming cameras may still hold a frame exposed at the old position
+  d->flush_frame = ! d->single_shot;
+  return true;
+}
+
+void ImagerThread::set_batch(size_t frames)
+{
+  d->batch_frames = max<size_t>(frames, 1);
+  d->batch.reserve(d->batch_frames);
+  qDebug() << "Capture batch:" << d->batch_frames << "frames";
+}
+
+void ImagerThread::set_transform(const CaptureTransform::Settings &transform)
+{
+  d->transform = transform;
+  qDebug() << "Capture transform: roi=" << transform.roi << ", bin=" << transform.bin << ", mode=" << transform.mode;
+}
+
 #include "imagerthread.moc"
@@ -23,33 +23,162 @@
 #include <functional>
 #include "dptr.h"
 #include <chrono>
+#include <QMutex>
+#include <QWaitCondition>
 #include "commons/fwd.h"
+#include "commons/capturetransform.h"
+#include "commons/framemetadata.h"
+class QRect;
+class QPoint;
 FWD_PTR(Frame)
 FWD(Imager)
 FWD_PTR(ImagerThread)
-FWD_PTR(QWaitCondition)
 FWD_PTR(ImageHandler)
+FWD_PTR(FramePool)
+FWD_PTR(ExposureProgress)
 
 class ImagerThread
 {
   public:
   typedef std::function<void()> Job;
+  class PendingJob;
+  typedef std::shared_ptr<PendingJob> PendingJobPtr;
+  /// Frames started by a signal on the camera trigger input (i.e. from another camera strobe output, or a chopper), instead of free running
+  struct Trigger {
+    enum Mode { FreeRun, RisingEdge, FallingEdge };
+    Mode mode = FreeRun;
+    /// Longest wait for a trigger in a single shoot(): jobs run in between
+    std::chrono::milliseconds poll{250};
+    bool active() const { return mode != FreeRun; }
+  };
+  /// Guide port (ST4) output, as wired to the mount
+  enum class GuideDirection { North, South, East, West };
   class Worker {
   public:
     virtual FramePtr shoot() = 0;
+    /**
+     * Called from another thread to cut short the exposure shoot() is waiting for, so that urgent jobs don't wait for it.
+     * shoot() should then return early, with a null frame. Workers that can't do it just keep the default.
+     */
+    virtual void abort_exposure() {}
+    /**
+     * Changes ROI, bin and (driver specific) image format in place, on the capture thread, keeping the thread and the frame buffers.
+     * Returns false when not supported, and the imager starts a new worker instead.
+     */
+    virtual bool reconfigure(const QRect &, int, int) { return false; }
+    /**
+     * Moves the hardware ROI by the given pixels, as seen in the frames, keeping its size and the capture running (i.e. to follow a drifting target).
+     * The move may be clamped to the sensor and the camera alignment: the second argument gets the new top left corner, as ROIs are given to the camera.
+     * Called on the capture thread. Returns false when not supported.
+     */
+    virtual bool shift_roi(const QPoint &, QPoint &) { return false; }
+    /**
+     * Timelapse: when single_shot is true, shoot() should start a single exposure and wait for it, leaving the camera idle between calls
+     * instead of streaming. Called on the capture thread. Returns false when not supported: frames then keep streaming between shots.
+     */
+    virtual bool set_single_shot(bool) { return false; }
+    /**
+     * Triggered capture: shoot() waits up to trigger.poll for the trigger input, returning a null frame when none came. Called on the capture thread.
+     * Returns false when the mode is not supported (free running always is).
+     */
+    virtual bool set_trigger(const Trigger &trigger) { return ! trigger.active(); }
+    enum ExposureStatus { Idle, Exposing, Exposed };
+    /**
+     * Long exposures, one phase at a time instead of a blocking shoot(), so that jobs keep running during the exposure, and the next exposure
+     * starts before the last frame goes down the image handlers chain: start_exposure() starts a single exposure and returns right away,
+     * exposure_status() is polled until Exposed, then readout() downloads the frame. abort_exposure(), or any camera mode change, brings the
+     * status back to Idle without a frame. Errors are thrown as in shoot(). Called on the capture thread.
+     * start_exposure() returns false when not supported: shoot() is used instead.
+     */
+    virtual bool start_exposure() { return false; }
+    virtual ExposureStatus exposure_status() { return Idle; }
+    virtual FramePtr readout() { return {}; }
+    /**
+     * Starts a pulse on the camera guide port (ST4) and returns right away: the worker ends it after duration, without holding the capture thread
+     * (see PulseTimer). A pulse on an axis already pulsing replaces it. Called on the capture thread. Returns false when not supported.
+     */
+    virtual bool guide_pulse(GuideDirection, std::chrono::milliseconds) { return false; }
     typedef std::shared_ptr<Worker> ptr;
     typedef std::function<ptr()> factory;
+    void set_frames_pool(const FramePoolPtr &frames_pool) { this->frames_pool = frames_pool; }
+    void set_exposure_progress(const ExposureProgressPtr &exposure_progress) { this->exposure_progress = exposure_progress; }
+  protected:
+    /// Buffers chosen by the host (recycled, huge pages, or its own allocator: see FramePool). shoot() should capture into frames acquired here,
+    /// rather than allocating them or keeping a ring of its own. Set before the first shoot().
+    FramePoolPtr frames_pool;
+    /// Long exposures are marked as started before shoot(): workers knowing when the sensor is read out can report it here
+    ExposureProgressPtr exposure_progress;
   };
   ImagerThread(const Worker::ptr& worker, Imager* imager, const ImageHandlerPtr& imageHandler, Configuration::CaptureEndianess captureEndianess);
   ~ImagerThread();
   void stop();
   void start();
-  QWaitConditionPtr push_job(const Job &job);
+  /**
+   * Jobs run on the capture thread, between shots, or during long exposures when the worker polls them (see Worker::start_exposure).
+   * Urgent ones go first, and abort long exposures in progress (see Worker::abort_exposure) unless abort is false.
+   */
+  PendingJobPtr push_job(const Job &job, bool urgent = false, bool abort = true);
   void set_exposure(const std::chrono::duration<double> &exposure);
   void setCaptureEndianess(Configuration::CaptureEndianess captureEndianess);
+  /**
+   * 16 bit frames not in the native byte order (after the capture endianess override) are swapped in place, right after the shot:
+   * the image handlers then only see native frames, and none of them has to swap again. Call from the capture thread, or before start.
+   */
+  void set_native_byte_order(bool native);
+  /// Real time priority and CPU pinning for the capture thread (cpu < 0: any CPU). Applied right away when called from the capture thread, otherwise on start.
+  void set_scheduling(bool realtime, int cpu);
+  /// Timelapse: one shot per interval, with the camera in single shot mode when the worker supports it (interval 0: as fast as possible).
+  /// Applied right away when called from the capture thread, otherwise on start.
+  void set_capture_interval(std::chrono::milliseconds interval);
+  /// Triggered capture (see Worker::set_trigger): the trigger sets the pace, and the capture interval is ignored. Frames without a device timestamp
+  /// are timestamped when the worker returns them, after the wait. Applied right away when called from the capture thread, otherwise on start.
+  void set_trigger(const Trigger &trigger);
+  /**
+   * Frames handed to the image handlers together (see ImageHandler::handle_batch), for tiny ROIs at very high frame rates:
+   * per frame costs down the handlers chain are paid once per batch. A frame waits at most a few milliseconds in a batch;
+   * with 1, or with a capture interval or trigger, frames go one by one. Call from the capture thread, or before start.
+   */
+  void set_batch(std::size_t frames);
+  /// Moves the hardware ROI (see Worker::shift_roi), recording its new origin in the metadata of the frames after it; the first frame after a move is thrown away. Call from the capture thread.
+  bool shift_roi(const QPoint &shift, QPoint &origin);
+  /// Software ROI and binning, applied to every frame before the image handlers get it (see CaptureTransform). Call from the capture thread, or before start.
+  void set_transform(const CaptureTransform::Settings &transform);
+  /// Camera state copied into every frame (see Frame::Metadata); a driver sequence set by the worker is kept. Call from the capture thread, or before start.
+  void set_metadata(const FrameMetadata &metadata);
+  /**
+   * Swaps the worker for a new one from factory, keeping the capture thread, its scheduling and the frame buffers warm: the old worker is
+   * destroyed first, then the capture settings are applied to the new one. Errors from the factory are thrown. Call from the capture thread.
+   */
+  void replace_worker(const Worker::factory &factory);
+  /// The next frame handed to the image handlers is timed against since (capture_time_to_first_frame_seconds). Call from the capture thread, or before start.
+  void expect_first_frame(const std::chrono::steady_clock::time_point &since);
+  FramePoolPtr frames_pool() const;
+  Worker::ptr worker() const;
+  /// Where long exposures (2 seconds or more) are tracked, shared with the worker. Call before start.
+  void set_exposure_progress(const ExposureProgressPtr &exposure_progress);
 private:
   DPTR
 
 };
 
+class ImagerThread::PendingJob {
+public:
+  PendingJob(const Job &job) : job{job} {}
+  /// false on timeout, or when cancelled before running
+  bool wait(std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+  /// Jobs not started yet won't run at all anymore
+  void cancel();
+  bool done() const;
+  /// Queued or running
+  bool pending() const;
+private:
+  friend class ImagerThread;
+  void run();
+  enum State { Queued, Running, Done, Cancelled };
+  const Job job;
+  State state = Queued;
+  mutable QMutex mutex;
+  QWaitCondition changed;
+};
+
 #endif // IMAGERTHREAD_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pulsetimer.h"
+#include <algorithm>
+
+using namespace std;
+
+PulseTimer::PulseTimer() : thread{&PulseTimer::run, this}
+{
+}
+
+PulseTimer::~PulseTimer()
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  changed.notify_all();
+  thread.join();
+  stop_all();
+}
+
+template<typename Predicate> vector<PulseTimer::Pulse> PulseTimer::take(Predicate predicate)
+{
+  vector<Pulse> taken;
+  auto kept = stable_partition(pulses.begin(), pulses.end(), [&](const Pulse &pulse) { return ! predicate(pulse); });
+  move(kept, pulses.end(), back_inserter(taken));
+  pulses.erase(kept, pulses.end());
+  return taken;
+}
+
+void PulseTimer::switch_off(const vector<Pulse> &pulses)
+{
+  for(const auto &pulse: pulses) {
+    try {
+      pulse.off();
+    } catch(...) {
+    }
+  }
+}
+
+void PulseTimer::start(int axis, Clock::duration duration, const Action &on, const Action &off)
+{
+  lock_guard<std::mutex> switching(actions);
+  vector<Pulse> previous;
+  {
+    lock_guard<std::mutex> lock(mutex);
+    previous = take([=](const Pulse &pulse) { return pulse.axis == axis; });
+  }
+  switch_off(previous);
+  on();
+  {
+    lock_guard<std::mutex> lock(mutex);
+    pulses.push_back({axis, Clock::now() + duration, off});
+  }
+  changed.notify_all();
+}
+
+void PulseTimer::stop_all()
+{
+  lock_guard<std::mutex> switching(actions);
+  vector<Pulse> all;
+  {
+    lock_guard<std::mutex> lock(mutex);
+    all.swap(pulses);
+  }
+  switch_off(all);
+}
+
+size_t PulseTimer::running() const
+{
+  lock_guard<std::mutex> lock(mutex);
+  return pulses.size();
+}
+
+void PulseTimer::run()
+{
+  unique_lock<std::mutex> lock(mutex);
+  while(! stopped) {
+    if(pulses.empty()) {
+      changed.wait(lock);
+      continue;
+    }
+    const auto next = min_element(pulses.begin(), pulses.end(), [](const Pulse &a, const Pulse &b) { return a.end < b.end; })->end;
+    if(Clock::now() < next) {
+      changed.wait_until(lock, next);
+      continue;
+    }
+    // Taken again with the switching lock held: start() may have replaced the pulse meanwhile
+    lock.unlock();
+    {
+      lock_guard<std::mutex> switching(actions);
+      vector<Pulse> due;
+      {
+        lock_guard<std::mutex> state(mutex);
+        const auto now = Clock::now();
+        due = take([=](const Pulse &pulse) { return pulse.end <= now; });
+      }
+      switch_off(due);
+    }
+    lock.lock();
+  }
+}
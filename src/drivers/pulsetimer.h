@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DRIVERS_PULSETIMER_H
+#define DRIVERS_PULSETIMER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Ends guide pulses on time for cameras whose guide port is only switched on and off (i.e. the ZWO ST4 port), off the capture thread:
+ * a pulse is switched on by start(), and switched off from the timer thread when its duration is over.
+ * A new pulse on an axis already pulsing ends the previous one first, so that the latest correction wins. Switching on and off never overlap.
+ */
+class PulseTimer
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::function<void()> Action;
+  PulseTimer();
+  /// Pulses still running are switched off right away
+  ~PulseTimer();
+  /// Calls on, then off after duration. Errors from on are thrown, and the pulse is not scheduled; off should report its own errors, as they're ignored
+  void start(int axis, Clock::duration duration, const Action &on, const Action &off);
+  /// Switches off all the pulses running now
+  void stop_all();
+  std::size_t running() const;
+private:
+  struct Pulse {
+    int axis;
+    Clock::time_point end;
+    Action off;
+  };
+  // Lock order: actions, then mutex
+  std::mutex actions;
+  mutable std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Pulse> pulses;
+  bool stopped = false;
+  std::thread thread;
+  void run();
+  // Under mutex: the pulses matching, removed from the list
+  template<typename Predicate> std::vector<Pulse> take(Predicate predicate);
+  static void switch_off(const std::vector<Pulse> &pulses);
+};
+
+#endif // DRIVERS_PULSETIMER_H
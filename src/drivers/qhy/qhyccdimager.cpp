@@ -40,6 +40,10 @@ using namespace std;
 using namespace std::placeholders;
 using namespace std::chrono_literals;
 
+namespace {
+const qlonglong AutoUSBTrafficControlID = 10000;
+}
+
 DPTR_IMPL(QHYCCDImager) {
   QString name;
   QString id;
@@ -48,6 +52,10 @@ DPTR_IMPL(QHYCCDImager) {
     Properties chip;
   QList<QHYControlPtr> controls;
   QHYImagingWorkerPtr imaging_worker;
+  QHYControlPtr usb_traffic_control;
+  bool auto_usb_traffic = false;
+  void tune_usb_traffic(QHYImagingWorker &worker);
+  void set_auto_usb_traffic(bool enabled);
 };
 
 
@@ -72,6 +80,9 @@ QHYCCDImager::QHYCCDImager(const QString &cameraName, const char *id, const Imag
   d->chip << LiveStream;
   qDebug() << d->chip;
   d->controls = QHYControl::availableControls(d->handle);
+  auto usb_traffic = find_if(begin(d->controls), end(d->controls), [](const auto &c) { return c->id() == CONTROL_USBTRAFFIC; });
+  if(usb_traffic != end(d->controls) && ! (*usb_traffic)->control().readonly)
+    d->usb_traffic_control = *usb_traffic;
   qDebug() << "Finished initializing QHY camera" << d->name;
 }
 
@@ -96,13 +107,28 @@ QString QHYCCDImager::name() const
 QList<Imager::Control> QHYCCDImager::controls() const
 {
     QList< Imager::Control > controls;
-    transform(begin(d->controls), end(d->controls), back_inserter(controls), [](const auto &c) { return c->control(); });
+    transform(begin(d->controls), end(d->controls), back_inserter(controls), [this](const auto &c) {
+      if(c != d->usb_traffic_control || ! d->auto_usb_traffic)
+        return c->control();
+      // Driven by the tuner
+      c->reload();
+      auto control = c->control();
+      control.readonly = true;
+      return control;
+    });
+  if(d->usb_traffic_control)
+    controls.push_back(Control{AutoUSBTrafficControlID, "Auto USB traffic", Control::Bool}.set_value(d->auto_usb_traffic));
   return controls;
 }
 
 
 void QHYCCDImager::setControl(const Imager::Control& control)
 {
+    if(control.id == AutoUSBTrafficControlID) {
+      d->set_auto_usb_traffic(control.get_value<bool>());
+      emit changed(control);
+      return;
+    }
     auto qhyControlIt = find_if(begin(d->controls), end(d->controls), [&](const auto &c) { return c->id() == control.id; });
     if(qhyControlIt == end(d->controls))
     // TODO: error check?
@@ -112,13 +138,51 @@ void QHYCCDImager::setControl(const Imager::Control& control)
       qhyControl->setValue(control.value.toDouble());
       qhyControl->reload();
       emit changed(qhyControl->control());
-  }));
+  }, true));
 }
 
 
 void QHYCCDImager::startLive()
 {
-  restart([=] { return d->imaging_worker = make_shared<QHYImagingWorker>(d->handle); });
+  restart([=] {
+    d->imaging_worker = make_shared<QHYImagingWorker>(d->handle);
+    if(d->auto_usb_traffic)
+      d->tune_usb_traffic(*d->imaging_worker);
+    return d->imaging_worker;
+  });
+}
+
+void QHYCCDImager::Private::tune_usb_traffic(QHYImagingWorker &worker)
+{
+  auto control = usb_traffic_control->control();
+  BandwidthTuner::Range range;
+  range.min = control.range.min.toLongLong();
+  range.max = control.range.max.toLongLong();
+  range.step = max<long>(control.range.step.toLongLong(), (range.max - range.min) / 10);
+  range.higher_is_faster = false;
+  worker.tune_usb_traffic(range, [this](long) {
+    usb_traffic_control->reload();
+    emit q->changed(usb_traffic_control->control());
+  });
+}
+
+void QHYCCDImager::Private::set_auto_usb_traffic(bool enabled)
+{
+  if(! usb_traffic_control || enabled == auto_usb_traffic)
+    return;
+  auto_usb_traffic = enabled;
+  if(! imaging_worker)
+    return;
+  // The tuned value stays when switching back to manual
+  auto worker = imaging_worker;
+  q->wait_for(q->push_job_on_thread([=]{
+    if(enabled)
+      tune_usb_traffic(*worker);
+    else
+      worker->stop_usb_traffic_tuning();
+    usb_traffic_control->reload();
+    emit q->changed(usb_traffic_control->control());
+  }, true));
 }
 
 void QHYCCDImager::setROI(const QRect&)
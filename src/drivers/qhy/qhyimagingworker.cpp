@@ -21,18 +21,29 @@
 #include "qhyexception.h"
 #include "qhyccd.h"
 #include <QDebug>
+#include <cstring>
+#include <algorithm>
 #include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/metrics.h"
 
 using namespace std;
 
 DPTR_IMPL(QHYImagingWorker) {
   qhyccd_handle *handle;
   QHYImagingWorker *q;
-  uint32_t w, h, bpp, channels;
+  uint32_t w = 0, h = 0, bpp = 0, channels = 0;
   
   Frame::ColorFormat color_format;
+  // Only used when the frame geometry isn't known yet: see shoot()
   vector<uint8_t> buffer;
-  static bool is_zero(uint8_t b);
+  static bool is_empty(const uint8_t *data, size_t size);
+  // The SDK has no dropped frames counter: incomplete USB transfers come out as blank frames
+  uint64_t sdk_dropped = 0;
+  Metrics::Counter &sdk_dropped_metric = Metrics::instance().counter("driver_sdk_dropped_frames_total", "Frames the camera SDK dropped before handing them to the driver", "driver=\"qhy\"");
+  unique_ptr<BandwidthTuner> usb_traffic_tuner;
+  BandwidthTuned usb_traffic_tuned;
+  void set_usb_traffic(long value);
 };
 
 QHYImagingWorker::QHYImagingWorker(qhyccd_handle *handle) : dptr(handle, this)
@@ -64,24 +75,78 @@ QHYImagingWorker::~QHYImagingWorker()
 
 FramePtr QHYImagingWorker::shoot()
 {
-  QHY_CHECK << GetQHYCCDLiveFrame(d->handle,&d->w,&d->h,&d->bpp,&d->channels,d->buffer.data()) << "Capturing live frame";
+  // Resolution, binning and debayering never change while streaming, only the depth does: when it didn't,
+  // the frame has the same geometry as the previous one, and the SDK can write it directly in a pooled frame.
+  const bool same_geometry = d->w > 0 && static_cast<uint32_t>(GetQHYCCDParam(d->handle, CONTROL_TRANSFERBIT)) == d->bpp;
+  // The fastest stable USB traffic depends on the frame size
+  if(d->usb_traffic_tuner && d->w > 0 && ! same_geometry)
+    d->set_usb_traffic(d->usb_traffic_tuner->reset());
+  FramePtr frame;
+  uint8_t *data = d->buffer.data();
+  if(same_geometry) {
+    frame = frames_pool->acquire(d->bpp, d->channels == 3 ? Frame::BGR : d->color_format, {static_cast<int>(d->w), static_cast<int>(d->h)});
+    data = frame->data();
+  }
+  QHY_CHECK << GetQHYCCDLiveFrame(d->handle,&d->w,&d->h,&d->bpp,&d->channels,data) << "Capturing live frame";
+  if(same_geometry && (frame->resolution() != QSize{static_cast<int>(d->w), static_cast<int>(d->h)} || frame->bpp() != d->bpp)) {
+    qWarning() << "Unexpected frame geometry change, skipping";
+    d->w = 0;
+    return {};
+  }
+  if(! frame) {
+    frame = frames_pool->acquire(d->bpp, d->channels == 3 ? Frame::BGR : d->color_format, {static_cast<int>(d->w), static_cast<int>(d->h)});
+    copy(d->buffer.begin(), d->buffer.begin() + frame->size(), frame->data());
+  }
   
-  if(all_of(d->buffer.begin(), d->buffer.end(), &Private::is_zero )) {
+  if(Private::is_empty(frame->data(), frame->size())) {
     qWarning() << "Frame is all empty, skipping";
+    d->sdk_dropped++;
+    d->sdk_dropped_metric.add();
     return {};
-  } else {
-    int type = d->bpp==8 ? CV_8UC1 : CV_16UC1;
-    if(d->channels == 3)
-      type = d->bpp==8 ? CV_8UC3 : CV_16UC3;
-    cv::Mat image(cv::Size{static_cast<int>(d->w), static_cast<int>(d->h)}, type, d->buffer.data());
-    cv::Mat copy;
-    image.copyTo(copy); // TODO: is copy necessary?
-    return make_shared<Frame>(d->color_format, copy); //TODO port to new constructor
-     // TODO: Properly handle with debayer setting, I guess... find a tester!
   }
+  long usb_traffic;
+  if(d->usb_traffic_tuner && d->usb_traffic_tuner->frame(frame->captured(), d->sdk_dropped, usb_traffic))
+    d->set_usb_traffic(usb_traffic);
+  return frame;
+  // TODO: Properly handle with debayer setting, I guess... find a tester!
+}
+
+void QHYImagingWorker::Private::set_usb_traffic(long value)
+{
+  QHY_CHECK << SetQHYCCDParam(handle, CONTROL_USBTRAFFIC, value) << "Setting USB traffic";
+  qDebug() << "USB traffic tuning: traffic=" << value << ", settled:" << usb_traffic_tuner->settled() << ", SDK dropped frames:" << sdk_dropped;
+  if(usb_traffic_tuned)
+    usb_traffic_tuned(value);
 }
 
-bool QHYImagingWorker::Private::is_zero(uint8_t b)
+void QHYImagingWorker::tune_usb_traffic(const BandwidthTuner::Range &range, const BandwidthTuned &tuned)
 {
-  return b == 0;
+  d->usb_traffic_tuner = make_unique<BandwidthTuner>(range);
+  d->usb_traffic_tuned = tuned;
+  d->set_usb_traffic(d->usb_traffic_tuner->value());
+}
+
+void QHYImagingWorker::stop_usb_traffic_tuning()
+{
+  d->usb_traffic_tuner.reset();
+  d->usb_traffic_tuned = {};
+}
+
+bool QHYImagingWorker::Private::is_empty(const uint8_t *data, size_t size)
+{
+  // Real frames have signal (or at least noise) nearly everywhere: a few samples are usually enough to tell
+  static constexpr size_t samples = 256;
+  const size_t stride = max<size_t>(1, size / samples);
+  for(size_t i = 0; i < size; i += stride)
+    if(data[i] != 0)
+      return false;
+  // Looks empty: make sure, a word at a time
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    if(word != 0)
+      return false;
+  }
+  return all_of(data + i, data + size, [](uint8_t b) { return b == 0; });
 }
@@ -21,6 +21,7 @@
 #define QHYIMAGINGWORKER_H
 
 #include "drivers/imagerthread.h"
+#include "drivers/bandwidthtuner.h"
 #include "c++/dptr.h"
 #include "qhyccd.h"
 #include "commons/fwd.h"
@@ -32,6 +33,13 @@ public:
   QHYImagingWorker(qhyccd_handle *handle);
   ~QHYImagingWorker();
   FramePtr shoot() override;
+  typedef std::function<void(long)> BandwidthTuned;
+  /**
+   * Ramps CONTROL_USBTRAFFIC down while watching the frames the SDK drops (blank ones) and the delivered rate (see BandwidthTuner),
+   * starting over on depth changes. tuned is called on the capture thread with every value set. Call from the capture thread.
+   */
+  void tune_usb_traffic(const BandwidthTuner::Range &range, const BandwidthTuned &tuned);
+  void stop_usb_traffic_tuning();
 private:
   DPTR
 };
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sensorpoller.h"
+#include <algorithm>
+
+using namespace std;
+
+SensorPoller::SensorPoller(chrono::milliseconds tick, size_t slots) : _tick{max(tick, chrono::milliseconds{1})}, slots(max<size_t>(slots, 1))
+{
+}
+
+int SensorPoller::add(const Sensor &sensor)
+{
+  sensors.push_back(sensor);
+  const int id = static_cast<int>(sensors.size()) - 1;
+  place(id, 0);
+  return id;
+}
+
+void SensorPoller::poll_now(int id)
+{
+  if(id < 0 || id >= static_cast<int>(sensors.size()))
+    return;
+  for(auto &slot: slots)
+    slot.erase(remove_if(slot.begin(), slot.end(), [=](const Entry &entry) { return entry.id == id; }), slot.end());
+  place(id, 0);
+}
+
+void SensorPoller::set_recording(bool recording)
+{
+  _recording = recording;
+}
+
+vector<int> SensorPoller::tick(const Clock::time_point &now)
+{
+  vector<int> due;
+  if(next_tick == Clock::time_point{})
+    next_tick = now;
+  // After a long stall a single turn of the wheel sees every sensor: even the slowest ones don't get read more than once
+  for(size_t steps = 0; next_tick <= now && steps < slots.size(); steps++, next_tick += _tick) {
+    vector<Entry> slot;
+    slot.swap(slots[cursor]);
+    cursor = (cursor + 1) % slots.size();
+    for(auto entry: slot) {
+      if(entry.rounds > 0) {
+        entry.rounds--;
+        slots[(cursor + slots.size() - 1) % slots.size()].push_back(entry);
+        continue;
+      }
+      if(find(due.begin(), due.end(), entry.id) == due.end())
+        due.push_back(entry.id);
+      place(entry.id, interval_ticks(sensors[entry.id]) - 1);
+    }
+  }
+  if(next_tick <= now)
+    next_tick = now + _tick;
+  return due;
+}
+
+void SensorPoller::place(int id, size_t ticks)
+{
+  slots[(cursor + ticks) % slots.size()].push_back({id, ticks / slots.size()});
+}
+
+size_t SensorPoller::interval_ticks(const Sensor &sensor) const
+{
+  const auto interval = _recording ? sensor.interval * max(sensor.recording_factor, 1) : sensor.interval;
+  return max<size_t>(1, static_cast<size_t>((interval.count() + _tick.count() - 1) / _tick.count()));
+}
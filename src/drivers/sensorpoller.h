@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DRIVERS_SENSORPOLLER_H
+#define DRIVERS_SENSORPOLLER_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Schedules the periodic reads of slowly changing camera state (temperature, cooler power, humidity...) on a timer wheel:
+ * each tick gives all the sensors due at once, so that a single imager thread job reads them all, instead of a timer and a job per sensor.
+ * While recording, sensors are read recording_factor times less often, as every SDK call competes with the capture.
+ * Intervals are rounded up to whole ticks. Not thread safe: ticked and changed from one thread.
+ */
+class SensorPoller
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  struct Sensor {
+    std::chrono::milliseconds interval{2000};
+    /// Read that many times less often while recording
+    int recording_factor = 4;
+  };
+  SensorPoller(std::chrono::milliseconds tick = std::chrono::milliseconds{500}, std::size_t slots = 64);
+  /// Returns the sensor id; it's due on the next tick
+  int add(const Sensor &sensor);
+  /// Moves the sensor to the next tick, i.e. when its value is asked for out of schedule
+  void poll_now(int id);
+  /// Applied to each sensor from its next read
+  void set_recording(bool recording);
+  bool recording() const { return _recording; }
+  /// Advances the wheel to now, catching up with the ticks missed, and returns the sensors due, each once
+  std::vector<int> tick(const Clock::time_point &now);
+  std::chrono::milliseconds tick_interval() const { return _tick; }
+  bool empty() const { return sensors.empty(); }
+private:
+  struct Entry {
+    int id;
+    std::size_t rounds;
+  };
+  const std::chrono::milliseconds _tick;
+  std::vector<std::vector<Entry>> slots;
+  std::vector<Sensor> sensors;
+  std::size_t cursor = 0;
+  Clock::time_point next_tick;
+  bool _recording = false;
+  // ticks after the next one
+  void place(int id, std::size_t ticks);
+  std::size_t interval_ticks(const Sensor &sensor) const;
+};
+
+#endif // DRIVERS_SENSORPOLLER_H
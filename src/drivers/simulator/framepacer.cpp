@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "framepacer.h"
+#include <algorithm>
+
+using namespace std;
+
+FramePacer::FramePacer(uint32_t seed) : random{seed}
+{
+}
+
+FramePacer::Clock::time_point FramePacer::next(const Settings &settings, const Clock::time_point &now)
+{
+  frames++;
+  if(settings.burst_every > 0 && frames % settings.burst_every == 0)
+    burst_remaining = settings.burst_length;
+  if(burst_remaining > 0) {
+    burst_remaining--;
+    deadline = now;
+  } else if(settings.fps > 0 && deadline != Clock::time_point{}) {
+    const chrono::duration<double> interval{1. / settings.fps};
+    const double jitter = uniform_real_distribution<double>{-1, 1}(random) * min(max(settings.jitter, 0.), 1.);
+    // When late by more than a frame interval, the rate restarts from now instead of catching up with a burst
+    deadline = max(deadline + chrono::duration_cast<Clock::duration>(interval * (1 + jitter)), now - chrono::duration_cast<Clock::duration>(interval));
+  } else {
+    deadline = now;
+  }
+  if(settings.stall_every > 0 && frames % settings.stall_every == 0)
+    deadline = max(deadline, now) + settings.stall;
+  return deadline;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SIMULATOR_FRAMEPACER_H
+#define SIMULATOR_FRAMEPACER_H
+
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+/**
+ * Decides when the simulator emits each frame: at a target rate (or flat out), with random jitter,
+ * and with periodic bursts (frames back to back) and stalls (no frames for a while), to load test the pipeline.
+ */
+class FramePacer
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  struct Settings {
+    /// Target frame rate (0: as fast as possible)
+    double fps = 0;
+    /// Random variation of each frame interval, as a fraction of it (0-1)
+    double jitter = 0;
+    /// Every burst_every frames, burst_length frames are emitted without waiting (0: no bursts)
+    int burst_every = 0;
+    int burst_length = 0;
+    /// Every stall_every frames, the next one is delayed by stall (0: no stalls)
+    int stall_every = 0;
+    std::chrono::milliseconds stall{0};
+  };
+  FramePacer(std::uint32_t seed = std::random_device{}());
+  /// When the next frame should be emitted, called once per frame with the current time
+  Clock::time_point next(const Settings &settings, const Clock::time_point &now);
+private:
+  Clock::time_point deadline;
+  std::uint64_t frames = 0;
+  int burst_remaining = 0;
+  std::mt19937 random;
+};
+
+#endif // SIMULATOR_FRAMEPACER_H
@@ -20,79 +20,215 @@
 #include "drivers/imagerthread.h"
 #include <QFile>
 #include "commons/ser_header.h"
+#include "commons/compressedser.h"
 #include <QDebug>
 #include <QThread>
-#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QMap>
+#include <chrono>
+#include <cstring>
+#include <thread>
 #include "commons/frame.h"
+#include "commons/framepool.h"
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
+using namespace std::chrono_literals;
+
+typedef QMap<QString, Imager::Control> SERPlayerSettings;
+class SERImagerWorker;
 
 DPTR_IMPL(SERImager) {
+  SERPlayerSettings settings;
+  shared_ptr<SERImagerWorker> worker;
 };
 
 
 class SERImagerWorker : public ImagerThread::Worker {
 public:
-  SERImagerWorker(const QString &file);
+  SERImagerWorker(const QString &file, SERPlayerSettings &settings);
   ~SERImagerWorker();
   FramePtr shoot() override;
+  void seek(int frame);
+  int frames() const { return header.frames; }
 private:
+  typedef chrono::steady_clock Clock;
+  /// SER timestamps unit
+  typedef chrono::duration<qint64, ratio<1, 10000000>> Ticks;
+  /// Frames read ahead of the current one, on memory mapped files
+  static constexpr int READAHEAD_FRAMES = 8;
+  SERPlayerSettings &settings;
   QFile file;
+  /// Whole file, when it can be memory mapped (nullptr: frames are read through file)
+  const uchar *mapped = nullptr;
   SER_Header header;
   size_t frame_size;
   Frame::ColorFormat color_format;
   QSize resolution;
   int pixel_depth;
   int current_frame = 0;
-  double fps = 30;
-  vector<SER_Timestamp> timestamps;
+  bool has_timestamps = false;
+  vector<SER_Timestamp> compressed_timestamps;
+  unique_ptr<CompressedSERReader> compressed;
+  // Playback clock: frame playback_first was shown at playback_start, at playback_speed
+  int playback_first = -1;
+  Clock::time_point playback_start;
+  double playback_speed = 1;
+  qint64 trailer_start() const { return sizeof(SER_Header) + static_cast<qint64>(header.frames) * frame_size; }
+  SER_Timestamp timestamp(int frame) const;
+  bool read_frame(int index, uint8_t *destination);
+  void readahead(int index);
+  void wait_for(int frame);
 };
 
-SERImagerWorker::SERImagerWorker(const QString& file) : file{file}
+SERImagerWorker::SERImagerWorker(const QString& file, SERPlayerSettings &settings) : settings{settings}, file{file}
 {
-  this->file.open(QIODevice::ReadOnly);
-  this->file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if(CompressedSERReader::is_compressed(file)) {
+    compressed = make_unique<CompressedSERReader>(file);
+    if(! compressed->isOpen())
+      qWarning() << "Unable to open compressed SER file: " << compressed->errorString();
+    header = compressed->header();
+    compressed_timestamps = compressed->timestamps();
+    has_timestamps = compressed_timestamps.size() == header.frames;
+  } else {
+    this->file.open(QIODevice::ReadOnly);
+    this->file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    mapped = this->file.map(0, this->file.size());
+    if(mapped) {
+#ifdef Q_OS_UNIX
+      madvise(const_cast<uchar*>(mapped), this->file.size(), MADV_SEQUENTIAL);
+#endif
+    } else {
+      qWarning() << "Unable to memory map" << file << ":" << this->file.errorString() << ", reading frames from file";
+    }
+  }
   frame_size = header.frame_size();
   color_format = header.frame_color_format();
   resolution = {static_cast<int>(header.imageWidth), static_cast<int>(header.imageHeight)};
   pixel_depth = header.pixelDepth;
-  size_t trailer_start = sizeof(SER_Header) + header.frames * frame_size;
-  if(this->file.size() == trailer_start + sizeof(SER_Timestamp) * header.frames) {
-    this->file.seek(trailer_start);
-    timestamps.resize(header.frames);
-    for(auto &timestamp: timestamps) {
-      this->file.read(reinterpret_cast<char*>(&timestamp), sizeof(SER_Timestamp));
-    }
-    auto timestamps_diff = static_cast<double>(*timestamps.rbegin() - *timestamps.begin()) / 10000.;
-    fps = 1000. /  (timestamps_diff / static_cast<double>(timestamps.size()) );
-    qDebug() << "Have timestamps: duration in msecs=" << timestamps_diff << ", fps: " << fps;
+  if(! compressed)
+    has_timestamps = file.size() == trailer_start() + static_cast<qint64>(sizeof(SER_Timestamp)) * header.frames;
+  if(has_timestamps && header.frames > 1) {
+    auto duration = chrono::duration_cast<chrono::milliseconds>(Ticks{timestamp(header.frames - 1) - timestamp(0)});
+    qDebug() << "Have timestamps: duration in msecs=" << duration.count() << ", fps: " << 1000. * (header.frames - 1) / duration.count();
   }
-  qDebug() << "Opened SER file: " << header.frames << " frames";
+  settings["position"].set_range(0, max<int>(header.frames, 1) - 1, 1);
+  qDebug() << "Opened SER file: " << header.frames << " frames" << (compressed ? ", compressed" : "") << (mapped ? ", memory mapped" : "");
+}
+
+SER_Timestamp SERImagerWorker::timestamp(int frame) const
+{
+  if(compressed)
+    return compressed_timestamps[frame];
+  SER_Timestamp timestamp;
+  const qint64 offset = trailer_start() + static_cast<qint64>(sizeof(SER_Timestamp)) * frame;
+  if(mapped) {
+    memcpy(&timestamp, mapped + offset, sizeof(timestamp));
+  } else {
+    auto &file = const_cast<QFile&>(this->file);
+    file.seek(offset);
+    file.read(reinterpret_cast<char*>(&timestamp), sizeof(timestamp));
+  }
+  return timestamp;
+}
+
+bool SERImagerWorker::read_frame(int index, uint8_t *destination)
+{
+  if(compressed)
+    return compressed->read_frame(index, destination);
+  const qint64 offset = sizeof(header) + static_cast<qint64>(frame_size) * index;
+  if(mapped) {
+    // Frames outlive the worker (and the mapping) in queues and recordings, so pixels are copied out into pooled frames
+    memcpy(destination, mapped + offset, frame_size);
+    readahead(index + READAHEAD_FRAMES);
+    return true;
+  }
+  return file.seek(offset) && file.read(reinterpret_cast<char*>(destination), frame_size) == static_cast<qint64>(frame_size);
+}
+
+void SERImagerWorker::readahead(int index)
+{
+#ifdef Q_OS_UNIX
+  if(index >= static_cast<int>(header.frames))
+    return;
+  static const qint64 page_size = sysconf(_SC_PAGESIZE);
+  const qint64 offset = sizeof(header) + static_cast<qint64>(frame_size) * index;
+  const qint64 aligned = offset - offset % page_size;
+  madvise(const_cast<uchar*>(mapped) + aligned, frame_size + (offset - aligned), MADV_WILLNEED);
+#else
+  Q_UNUSED(index)
+#endif
+}
+
+void SERImagerWorker::seek(int frame)
+{
+  current_frame = qBound<int>(0, frame, max<int>(header.frames, 1) - 1);
+  playback_first = -1;
+}
+
+void SERImagerWorker::wait_for(int frame)
+{
+  const double speed = settings["speed"].get_value<double>();
+  if(playback_first < 0 || frame < playback_first || speed != playback_speed) {
+    playback_first = frame;
+    playback_start = Clock::now();
+    playback_speed = speed;
+    return;
+  }
+  Clock::duration offset;
+  if(has_timestamps)
+    offset = chrono::duration_cast<Clock::duration>(Ticks{static_cast<qint64>(timestamp(frame) - timestamp(playback_first))});
+  else
+    offset = chrono::duration_cast<Clock::duration>(chrono::duration<double>{(frame - playback_first) / settings["fps"].get_value<double>()});
+  const auto deadline = playback_start + chrono::duration_cast<Clock::duration>(offset / speed);
+  // Timestamps going back, or long gaps (i.e. a paused recording): the playback clock restarts from this frame
+  if(offset < Clock::duration::zero() || deadline - Clock::now() > 10s) {
+    playback_first = frame;
+    playback_start = Clock::now();
+    return;
+  }
+  this_thread::sleep_until(deadline);
 }
 
 FramePtr SERImagerWorker::shoot()
 {
-  QElapsedTimer elapsed;
-  elapsed.start();
-  auto frame = make_shared<Frame>(pixel_depth, color_format, resolution);
-  file.seek(sizeof(header) + (frame_size * current_frame++) );
-  file.read(reinterpret_cast<char*>(frame->data()), frame_size);
-  if(current_frame >= header.frames)
-    current_frame = 0;
-  auto sleep_time = (1.0 / fps * 1000.) - elapsed.elapsed();
-  QThread::currentThread()->msleep( max(1, static_cast<int>(sleep_time)) );
+  if(current_frame >= static_cast<int>(header.frames)) {
+    if(! settings["loop"].get_value<bool>() || header.frames == 0) {
+      QThread::msleep(100);
+      return {};
+    }
+    seek(0);
+  }
+  auto frame = frames_pool->acquire(pixel_depth, color_format, resolution);
+  if(! read_frame(current_frame, frame->data()))
+    qWarning() << "Error reading frame " << current_frame;
+  if(! settings["max_speed"].get_value<bool>())
+    wait_for(current_frame);
+  current_frame++;
   return frame;
 }
 
 SERImagerWorker::~SERImagerWorker()
 {
+  if(mapped)
+    file.unmap(const_cast<uchar*>(mapped));
 }
 
 
 
 SERImager::SERImager(const ImageHandlerPtr& handler) : Imager{handler}, dptr()
 {
+  d->settings = {
+    {"speed", Control{1l, "speed"}.set_range(0.1, 100., 0.1).set_value(1.).set_decimals(1) },
+    {"max_speed", Control{2l, "max_speed", Control::Bool}.set_value(false) },
+    {"loop", Control{3l, "loop", Control::Bool}.set_value(true) },
+    {"position", Control{4l, "position"}.set_range(0, 0, 1).set_value(0).set_decimals(0) },
+    // Only used for files without timestamps
+    {"fps", Control{5l, "fps"}.set_range(1., 1000., 1.).set_value(30.).set_decimals(0) },
+  };
 }
 
 SERImager::~SERImager()
@@ -114,7 +250,7 @@ void SERImager::setROI(const QRect&)
 
 Imager::Controls SERImager::controls() const
 {
-  return {};
+  return d->settings.values();
 }
 
 QString SERImager::name() const
@@ -124,6 +260,12 @@ QString SERImager::name() const
 
 void SERImager::setControl(const Imager::Control& setting)
 {
+  wait_for(push_job_on_thread([=]{
+    d->settings[setting.name] = setting;
+    if(setting.name == "position" && d->worker)
+      d->worker->seek(setting.value.toInt());
+    emit changed(setting);
+  }, true));
 }
 
 void SERImager::startLive()
@@ -131,7 +273,7 @@ void SERImager::startLive()
   std::cout << "SERImager: please enter the full path of the SER file:\n";
   std::string ser_file;
   cin >> ser_file;
-  restart([=]{ return make_shared<SERImagerWorker>(QString::fromStdString(ser_file)); });
+  restart([=]{ return d->worker = make_shared<SERImagerWorker>(QString::fromStdString(ser_file), d->settings); });
 }
 
 
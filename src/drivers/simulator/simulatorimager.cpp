@@ -24,9 +24,15 @@
 #include "commons/opencv_utils.h"
 #include <QTimer>
 #include <QRect>
+#include <QMutex>
+#include <QWaitCondition>
 #include "drivers/imagerthread.h"
 #include "drivers/roi.h"
 #include "commons/frame.h"
+#include "commons/framepool.h"
+#include "syntheticframes.h"
+#include "framepacer.h"
+#include <thread>
 
 using namespace std;
 using namespace std::chrono_literals;
@@ -47,18 +53,34 @@ public:
   SimulatorImagerWorker(SimulatorSettings &settings);
   
   FramePtr shoot() override;
+  void abort_exposure() override;
+  /// Frames are rendered on demand: there's no stream to stop between timelapse shots
+  bool set_single_shot(bool) override { return true; }
   void setROI(const QRect &roi);
   enum ImageType{ BGR = 0, Mono = 10, Bayer = 20};
   QRect ROI() const { return roi; }
 private:
+  /// Load testing mode: pre-rendered frames, emitted at the configured rate instead of the exposure
+  FramePtr shoot_synthetic();
   SimulatorSettings &settings;
   QHash<int, cv::Mat> images;
   QRect roi;
+  QMutex exposure_mutex;
+  QWaitCondition exposure_aborted;
+  bool aborted = false;
+  SyntheticFrames synthetic;
+  FramePacer pacer;
   LOG_C_SCOPE(SimulatorImagerWorker);
 };
 
 Q_DECLARE_METATYPE(SimulatorImagerWorker::ImageType)
 
+static const map<SimulatorImagerWorker::ImageType, Frame::ColorFormat> simulator_formats {
+  {SimulatorImagerWorker::Mono, Frame::Mono},
+  {SimulatorImagerWorker::BGR, Frame::BGR},
+  {SimulatorImagerWorker::Bayer, Frame::Bayer_RGGB},
+};
+
 SimulatorImager::SimulatorImager(const ImageHandlerPtr& handler) : Imager(handler), dptr()
 {
   d->roi_validator = make_shared<ROIValidator>(list<ROIValidator::Rule>{
@@ -80,8 +102,20 @@ SimulatorImager::SimulatorImager(const ImageHandlerPtr& handler) : Imager(handle
     {"bpp",	 Control{6l, "bpp", Control::Combo}.set_value(8).add_choice("8", 8).add_choice("16", 16)}, 
     {"reject",	 Control{7l, "reject", Control::Combo}.set_value(0).add_choice("Never", 0).add_choice("1 out of 10", 10).add_choice("1 out of 5", 5).add_choice("1 out of 3", 3).add_choice("1 out of 2", 2)}, 
     {"max_speed",	 Control{8l, "max_speed", Control::Bool}.set_value(false) }, 
+    // Synthetic mode, for load testing: format and bpp still apply, everything else is replaced by these
+    {"synthetic",	 Control{9l, "synthetic", Control::Bool}.set_value(false) },
+    {"synthetic_width",	 Control{10l, "synthetic_width"}.set_range(64, 8192, 4).set_value(1920).set_decimals(0) },
+    {"synthetic_height",	 Control{11l, "synthetic_height"}.set_range(64, 8192, 2).set_value(1080).set_decimals(0) },
+    {"synthetic_frames",	 Control{12l, "synthetic_frames"}.set_range(1, 256, 1).set_value(16).set_decimals(0) },
+    {"target_fps",	 Control{13l, "target_fps"}.set_range(0., 10000., 1.).set_value(0.).set_decimals(0) },
+    {"jitter_percent",	 Control{14l, "jitter_percent"}.set_range(0, 100, 1).set_value(0).set_decimals(0) },
+    {"burst_every",	 Control{15l, "burst_every"}.set_range(0, 100000, 1).set_value(0).set_decimals(0) },
+    {"burst_frames",	 Control{16l, "burst_frames"}.set_range(0, 10000, 1).set_value(0).set_decimals(0) },
+    {"stall_every",	 Control{17l, "stall_every"}.set_range(0, 100000, 1).set_value(0).set_decimals(0) },
+    {"stall_duration",	 Control{18l, "stall_duration"}.set_range(0., 10000., 1.).set_value(0.).set_is_duration(true).set_duration_unit(1ms) },
   };
   qDebug() << "Max speed: " << d->settings["max_speed"];
+  add_sensor(TemperatureSensor, 2s, []{ return SimulatorImager::rand(200, 500) / 10.; });
 }
 
 SimulatorImager::~SimulatorImager()
@@ -94,7 +128,7 @@ Imager::Properties SimulatorImager::properties() const
     // Simulating ASI 178mm chip: 2.4x2.4 um pixels, sensor size 7.4x5mm, resolution 3096x2080
   // return Imager::Chip().set_pixelsize_chipsize(2.4, 2.4, 7.4, 5);
   // return Imager::Chip().set_resolution_chipsize({3096, 2080}, 7.4, 5);
-  return Imager::Properties().set_resolution_pixelsize({3096, 2080}, 2.4, 2.4) << ROI << LiveStream << Temperature;
+  return Imager::Properties().set_resolution_pixelsize({3096, 2080}, 2.4, 2.4) << ROI << LiveStream << StillPicture << Temperature;
 }
 
 QString SimulatorImager::name() const
@@ -115,15 +149,7 @@ void SimulatorImager::setControl(const Imager::Control& setting)
     }
     d->settings[setting.name] = setting;
     emit changed(setting);
-  }));
-}
-
-void SimulatorImager::readTemperature()
-{
-    push_job_on_thread([&]{
-       double celsius = SimulatorImager::rand(200, 500) / 10.;
-       emit temperature(celsius);
-     });
+  }, true));
 }
 
 Imager::Controls SimulatorImager::controls() const
@@ -167,11 +193,8 @@ SimulatorImagerWorker::SimulatorImagerWorker(SimulatorSettings &settings) : sett
 
 FramePtr SimulatorImagerWorker::shoot()
 {
-  static map<SimulatorImagerWorker::ImageType, Frame::ColorFormat> formats {
-    {Mono, Frame::Mono},
-    {BGR, Frame::BGR},
-    {Bayer, Frame::Bayer_RGGB},
-  };
+  if(settings["synthetic"].get_value<bool>())
+    return shoot_synthetic();
   auto rand = [](int a, int b) { return qrand() % ((b + 1) - a) + a; };
   cv::Mat cropped, blurred, result;
   Imager::Control exposure, seeing, bpp;
@@ -208,17 +231,60 @@ FramePtr SimulatorImagerWorker::shoot()
 
   if(bpp.value == 16)
       result.convertTo(result, result.channels() == 1 ? CV_16UC1 : CV_16UC3, BITS_8_TO_16);
-  auto frame_format = formats[format];
-  auto frame = make_shared<Frame>( bpp.value.toInt(), frame_format, QSize{result.cols, result.rows} );
+  auto frame_format = simulator_formats.at(format);
+  auto frame = frames_pool->acquire( bpp.value.toInt(), frame_format, QSize{result.cols, result.rows} );
   move(result.data, result.data + frame->size(), frame->data());
   if(settings["max_speed"].get_value<bool>())
     return frame;
-  Scope sleep{[=]{
-    QThread::usleep(exposure.value.toDouble() * 1000.);
-  } };
+  // Simulated exposure time: long exposures can be cut short by urgent jobs
+  QMutexLocker lock(&exposure_mutex);
+  if(! aborted)
+    exposure_aborted.wait(&exposure_mutex, static_cast<unsigned long>(exposure.value.toDouble()));
+  if(aborted) {
+    aborted = false;
+    return {};
+  }
   return frame;
 }
 
+FramePtr SimulatorImagerWorker::shoot_synthetic()
+{
+  synthetic.configure({
+    {settings["synthetic_width"].get_value<int>(), settings["synthetic_height"].get_value<int>()},
+    settings["bpp"].get_value<int>(),
+    simulator_formats.at(static_cast<ImageType>(settings["format"].get_value<int>())),
+    settings["synthetic_frames"].get_value<int>(),
+  });
+  FramePacer::Settings pacing;
+  pacing.fps = settings["target_fps"].get_value<double>();
+  pacing.jitter = settings["jitter_percent"].get_value<double>() / 100.;
+  pacing.burst_every = settings["burst_every"].get_value<int>();
+  pacing.burst_length = settings["burst_frames"].get_value<int>();
+  pacing.stall_every = settings["stall_every"].get_value<int>();
+  pacing.stall = chrono::milliseconds{settings["stall_duration"].get_value<int>()};
+  const auto deadline = pacer.next(pacing, FramePacer::Clock::now());
+  {
+    // Long waits (stalls, low rates) can be cut short by urgent jobs, as exposures are
+    QMutexLocker lock(&exposure_mutex);
+    while(! aborted && FramePacer::Clock::now() + 2ms < deadline)
+      exposure_aborted.wait(&exposure_mutex, max<long>(1, chrono::duration_cast<chrono::milliseconds>(deadline - FramePacer::Clock::now()).count() - 1));
+    if(aborted) {
+      aborted = false;
+      return {};
+    }
+  }
+  // The last couple of milliseconds: condition variables are too coarse for rates of hundreds of fps
+  this_thread::sleep_until(deadline);
+  return synthetic.next(roi);
+}
+
+void SimulatorImagerWorker::abort_exposure()
+{
+  QMutexLocker lock(&exposure_mutex);
+  aborted = true;
+  exposure_aborted.wakeAll();
+}
+
 void SimulatorImager::clearROI()
 {
   d->worker->setROI({});
@@ -38,7 +38,6 @@ public slots:
     void setROI(const QRect &) override;
     void clearROI() override;
     void setControl(const Control& setting) override;
-    void readTemperature() override;
 private:
   DPTR
 };
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "syntheticframes.h"
+#include <QRect>
+#include <QDebug>
+#include <cmath>
+
+using namespace std;
+
+void SyntheticFrames::configure(const Parameters &parameters)
+{
+  if(parameters == this->parameters)
+    return;
+  this->parameters = parameters;
+  ring.clear();
+  index = 0;
+  for(int frame = 0; frame < parameters.count; frame++)
+    ring.push_back(render(frame));
+  qDebug() << "Rendered" << parameters.count << "synthetic frames, resolution:" << parameters.resolution << ", bpp:" << parameters.bpp << ", format:" << parameters.format;
+}
+
+FramePtr SyntheticFrames::next(const QRect &roi)
+{
+  if(ring.empty())
+    return {};
+  const auto &mat = ring[index++ % ring.size()];
+  if(roi.isValid()) {
+    const auto area = cv::Rect{roi.x(), roi.y(), roi.width(), roi.height()} & cv::Rect{0, 0, mat.cols, mat.rows};
+    return make_shared<Frame>(parameters.format, mat(area), Frame::LittleEndian);
+  }
+  return make_shared<Frame>(parameters.format, mat, Frame::LittleEndian, Frame::ShareBuffer);
+}
+
+cv::Mat SyntheticFrames::render(int frame) const
+{
+  const int width = parameters.resolution.width(), height = parameters.resolution.height();
+  const double radius = min(width, height) / 4.;
+  const double angle = 2 * M_PI * frame / max(parameters.count, 1);
+  const double centre_x = width / 2. + cos(angle) * radius / 20, centre_y = height / 2. + sin(angle) * radius / 20;
+
+  // Limb darkened disc with horizontal bands, on a dark background
+  cv::Mat luminance(height, width, CV_32FC1);
+  for(int y = 0; y < height; y++) {
+    auto row = luminance.ptr<float>(y);
+    const double band = 1 - 0.2 * pow(sin((y - centre_y) / radius * 9), 2);
+    for(int x = 0; x < width; x++) {
+      const double distance = hypot(x - centre_x, y - centre_y) / radius;
+      row[x] = distance < 1 ? 0.05 + 0.85 * band * pow(1 - distance * distance, 0.3) : 0.05;
+    }
+  }
+  cv::Mat noise(height, width, CV_32FC1);
+  cv::randn(noise, 0, 0.01);
+  luminance += noise;
+
+  // Channel gains: Jupiter is warmer than white
+  const float gains[] = {0.75f, 0.9f, 1.f}; // B, G, R
+  cv::Mat image;
+  if(parameters.format == Frame::Mono) {
+    image = luminance;
+  } else if(parameters.format == Frame::BGR) {
+    cv::merge(vector<cv::Mat>{luminance * gains[0], luminance * gains[1], luminance * gains[2]}, image);
+  } else {
+    // RGGB mosaic
+    image = luminance.clone();
+    for(int y = 0; y < height; y++) {
+      auto row = image.ptr<float>(y);
+      for(int x = 0; x < width; x++)
+        row[x] *= gains[y % 2 == 0 ? (x % 2 == 0 ? 2 : 1) : (x % 2 == 0 ? 1 : 0)];
+    }
+  }
+  cv::Mat result;
+  image.convertTo(result, parameters.bpp == 16 ? CV_16U : CV_8U, parameters.bpp == 16 ? 65535 : 255);
+  return result;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SIMULATOR_SYNTHETICFRAMES_H
+#define SIMULATOR_SYNTHETICFRAMES_H
+
+#include <QSize>
+#include <vector>
+#include "commons/frame.h"
+
+/**
+ * Ring of pre-rendered frames (a banded planet moving in a small circle, with noise), emitted in turn.
+ * Frames share the pre-rendered pixels, so the simulator can produce them as fast as the pipeline takes them.
+ */
+class SyntheticFrames
+{
+public:
+  struct Parameters {
+    QSize resolution;
+    int bpp;
+    Frame::ColorFormat format;
+    int count;
+    bool operator==(const Parameters &other) const {
+      return resolution == other.resolution && bpp == other.bpp && format == other.format && count == other.count;
+    }
+  };
+  /// Renders the ring again, if parameters changed
+  void configure(const Parameters &parameters);
+  /// The next frame of the ring, cropped to roi if valid
+  FramePtr next(const QRect &roi = {});
+private:
+  Parameters parameters{{}, 8, Frame::Mono, 0};
+  std::vector<cv::Mat> ring;
+  std::size_t index = 0;
+  cv::Mat render(int frame) const;
+};
+
+#endif // SIMULATOR_SYNTHETICFRAMES_H
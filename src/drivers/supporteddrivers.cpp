@@ -35,9 +35,14 @@ struct SupportedDriver {
   SupportedDriver(const QString &name, const QVariantMap &info, const shared_ptr<QLibrary> &library) : name(name), info(info), library(library) {}
     QString name;
     QVariantMap info;
+    /// Not loaded until the driver is first needed: vendor SDKs are heavy, and most of them won't have a camera plugged in
     shared_ptr<QLibrary> library;
     shared_ptr<Driver> _driver;
+    bool load_failed = false;
+    // SDKs are not expected to enumerate (or load) concurrently with themselves
+    QMutex mutex;
     shared_ptr<Driver> driver();
+    QList<CameraPtr> cameras();
 };
 
 typedef int (*LoadDriverFunctionReady)();
@@ -45,10 +50,16 @@ typedef int (*LoadDriverFunctionReady)();
 
 std::shared_ptr<Driver> SupportedDriver::driver()
 {
-  if(!_driver) {
+  if(!_driver && !load_failed) {
     qDebug() << "Initializing driver" << library->fileName();
+    auto load_driver = library->load() ? reinterpret_cast<LoadDriverFunction>(library->resolve(PLANETARY_IMAGER_DRIVER_LOAD_F)) : nullptr;
+    if(! load_driver) {
+      qWarning() << "[ERR] Error loading driver" << library->fileName() << ":" << library->errorString();
+      load_failed = true;
+      return {};
+    }
     try {
-      Driver *driverptr = ((LoadDriverFunction) library->resolve(PLANETARY_IMAGER_DRIVER_LOAD_F))();
+      Driver *driverptr = load_driver();
       qDebug() << "Loaded driver address: " << (uint64_t)driverptr;
       _driver = shared_ptr<Driver>(driverptr);
     } catch(const Imager::exception &e) {
@@ -59,21 +70,33 @@ std::shared_ptr<Driver> SupportedDriver::driver()
   return _driver;
 }
 
+QList<CameraPtr> SupportedDriver::cameras()
+{
+  QMutexLocker lock(&mutex);
+  qDebug() << "Checking cameras on driver " << name;
+  if(! driver()) {
+    qWarning() << "Driver" << name << "doesn't seem to be correctly loaded";
+    return {};
+  }
+  auto driver_cameras = driver()->cameras();
+  qDebug() << "Found" << driver_cameras.size() << "on driver" << name;
+  return driver_cameras;
+}
+
 
 
 DPTR_IMPL(SupportedDrivers) {
   SupportedDrivers *q;
+  const QStringList only_drivers;
   QList<SupportedDriver::ptr> supported_drivers;
-  shared_ptr<QMutex> drivers_scan_mutex;
 
   void find_drivers(const QString &directory);
   void load_driver(const QString &filename);
 };
 
 
-SupportedDrivers::SupportedDrivers(const QStringList &driversPath) : dptr(this)
+SupportedDrivers::SupportedDrivers(const QStringList &driversPath, const QStringList &onlyDrivers) : dptr(this, onlyDrivers)
 {
-  d->drivers_scan_mutex = make_shared<QMutex>();
   for(const QString &path: driversPath)
     d->find_drivers(path);
 }
@@ -97,29 +120,23 @@ void SupportedDrivers::Private::load_driver(const QString& filename)
   }
   QString library_name = filename;
   library_name.remove(".json");
+  if(! only_drivers.isEmpty() && ! only_drivers.contains(QFileInfo(library_name).baseName()))
+    return;
 
-  qDebug() << "[??] trying " << filename << ": " << library_name;
-
-  auto driver = make_shared<QLibrary>(library_name);
-  if(driver->load()) {
-    qDebug() << "[OK] Driver " << library_name << " loaded successfully";
-    if(driver->resolve(PLANETARY_IMAGER_DRIVER_LOAD_F)) {
-        QFile json_file(filename);
-        json_file.open(QIODevice::ReadOnly);
-        QVariantMap driver_info = QJsonDocument::fromJson(json_file.readAll()).toVariant().toMap();
-        
-        qDebug() << "[OK] PlanetaryImager_loadDriver resolved on " << library_name;
-        supported_drivers.push_back(make_shared<SupportedDriver>(
-          QFileInfo(library_name).baseName(),
-          driver_info,
-          driver
-        ));
-    } else {
-        qWarning() << "[ERR] Error resolving PlanetaryImager_loadDriver function on " << library_name << ":" << driver->errorString();
-    }
-  } else {
-    qWarning() << "[ERR] Error loading driver" << library_name << ":" << driver->errorString();
+  // Only the description is read here: the library itself is loaded when its cameras are first looked for
+  QFile json_file(filename);
+  if(! json_file.open(QIODevice::ReadOnly)) {
+    qWarning() << "[ERR] Unable to read driver description" << filename << ":" << json_file.errorString();
+    return;
   }
+  QVariantMap driver_info = QJsonDocument::fromJson(json_file.readAll()).toVariant().toMap();
+  auto library = make_shared<QLibrary>(library_name);
+  qDebug() << "[OK] Driver" << library_name << "found:" << driver_info.value("name").toString();
+  supported_drivers.push_back(make_shared<SupportedDriver>(
+    QFileInfo(library_name).baseName(),
+    driver_info,
+    library
+  ));
 }
 
 
@@ -129,30 +146,40 @@ SupportedDrivers::~SupportedDrivers()
 
 void SupportedDrivers::aboutToQuit()
 {
-  for(auto supported_driver: d->supported_drivers)
-    if(supported_driver->driver()) {
-      supported_driver->driver()->aboutToQuit();
+  for(auto supported_driver: d->supported_drivers) {
+    QMutexLocker lock(&supported_driver->mutex);
+    // Drivers never loaded have nothing to clean up
+    if(supported_driver->_driver) {
+      supported_driver->_driver->aboutToQuit();
     } 
+  }
 }
 
 
 QList<CameraPtr> SupportedDrivers::cameras() const
 {
-  QMutexLocker lock(d->drivers_scan_mutex.get());
   qDebug() << "Detecting active cameras";
   QList<CameraPtr> cameras;
-  for(auto supported_driver: d->supported_drivers) {
-    qDebug() << "Checking cameras on driver " << supported_driver->name;
-    if(supported_driver->driver()) {
-      auto driver_cameras = supported_driver->driver()->cameras();
-      qDebug() << "Found" << driver_cameras.size() << "on driver" << supported_driver->name;
-      cameras.append(driver_cameras);
-    } else {
-      qWarning() << "Driver" << supported_driver->name << "doesn't seem to be correctly loaded";
-    }
-  }
+  for(auto supported_driver: d->supported_drivers)
+    cameras.append(supported_driver->cameras());
   qDebug() << "Detected cameras: " << cameras.size();
   return cameras;
 }
 
-
+QList<Driver::Source> SupportedDrivers::sources() const
+{
+  QList<Source> sources;
+  for(auto supported_driver: d->supported_drivers) {
+    QStringList usb_vendors;
+    for(auto vendor: supported_driver->info.value("usb_vendors").toStringList())
+      usb_vendors.push_back(vendor.toLower());
+    sources.push_back({
+      supported_driver->name,
+      usb_vendors,
+      supported_driver->info.value("hotplug", true).toBool(),
+      supported_driver->info.value("usb_only", false).toBool(),
+      [supported_driver] { return supported_driver->cameras(); },
+    });
+  }
+  return sources;
+}
@@ -24,9 +24,12 @@
 class QString;
 class SupportedDrivers : public Driver {
 public:
-  SupportedDrivers(const QStringList &driversPath = {});
+  /// Drivers found in driversPath; only the ones named (library base name, i.e. "driver_zwo_asi") in onlyDrivers, when given
+  SupportedDrivers(const QStringList &driversPath = {}, const QStringList &onlyDrivers = {});
   ~SupportedDrivers();
   virtual QList<CameraPtr> cameras() const;
+  /// One source for each driver library: "usb_vendors" and "hotplug" come from its json description
+  QList<Source> sources() const override;
   void aboutToQuit() override;
 private:
   DPTR;
@@ -19,7 +19,11 @@
 #include "v4l2buffer.h"
 #include "v4l2exception.h"
 #include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "v4l2device.h"
+#include <QDebug>
+#include <cstring>
 
 using namespace std;
 
@@ -27,6 +31,7 @@ DPTR_IMPL(V4LBuffer) {
   V4L2DevicePtr v4ldevice;
   v4l2_buffer bufferinfo;
   char *memory;
+  int dmabuf = -1;
 };
 
 
@@ -49,6 +54,43 @@ void V4LBuffer::queue()
   d->v4ldevice->ioctl(VIDIOC_QBUF, &d->bufferinfo, "queuing buffer");
 }
 
+bool V4LBuffer::export_dmabuf()
+{
+  if(d->dmabuf >= 0)
+    return true;
+  v4l2_exportbuffer exportbuffer;
+  memset(&exportbuffer, 0, sizeof(exportbuffer));
+  exportbuffer.type = d->bufferinfo.type;
+  exportbuffer.index = d->bufferinfo.index;
+  exportbuffer.flags = O_RDONLY | O_CLOEXEC;
+  if(d->v4ldevice->xioctl(VIDIOC_EXPBUF, &exportbuffer, "exporting buffer") < 0)
+    return false;
+  d->dmabuf = exportbuffer.fd;
+  return true;
+}
+
+int V4LBuffer::dmabuf() const
+{
+  return d->dmabuf;
+}
+
+bool V4LBuffer::detach()
+{
+  auto memory = mmap(NULL, d->bufferinfo.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(memory == MAP_FAILED) {
+    qWarning() << "error allocating memory to detach v4l2 buffer:" << strerror(errno);
+    return false;
+  }
+  memcpy(memory, d->memory, d->bufferinfo.length);
+  // Replaces the driver mapping in a single step: readers never see the address unmapped
+  if(mremap(memory, d->bufferinfo.length, d->bufferinfo.length, MREMAP_MAYMOVE | MREMAP_FIXED, d->memory) == MAP_FAILED) {
+    qWarning() << "error detaching v4l2 buffer:" << strerror(errno);
+    munmap(memory, d->bufferinfo.length);
+    return false;
+  }
+  return true;
+}
+
 std::shared_ptr< V4LBuffer > V4LBuffer::List::dequeue(const shared_ptr<V4L2Device> &device) const
 {
     v4l2_buffer bufferinfo;
@@ -64,6 +106,8 @@ std::shared_ptr< V4LBuffer > V4LBuffer::List::dequeue(const shared_ptr<V4L2Devic
 
 V4LBuffer::~V4LBuffer()
 {
+  if(d->dmabuf >= 0)
+    ::close(d->dmabuf);
   try {
   V4L2_CHECK << munmap(d->memory, d->bufferinfo.length) << "unmapping memory";
   }
@@ -88,3 +132,18 @@ uint32_t V4LBuffer::type() const
 {
   return d->bufferinfo.type;
 }
+
+timeval V4LBuffer::timestamp() const
+{
+  return d->bufferinfo.timestamp;
+}
+
+uint32_t V4LBuffer::sequence() const
+{
+  return d->bufferinfo.sequence;
+}
+
+uint32_t V4LBuffer::flags() const
+{
+  return d->bufferinfo.flags;
+}
@@ -36,9 +36,23 @@ public:
     public:
         std::shared_ptr< V4LBuffer > dequeue(const V4L2DevicePtr& device) const;
     };
+    /// VIDIOC_EXPBUF: the same memory as a DMABUF file descriptor, closed with the buffer. false if the driver can't export it
+    bool export_dmabuf();
+    /// -1 unless exported
+    int dmabuf() const;
+    /**
+     * Moves the pixels to private memory at the same address, dropping the driver mapping, so that the driver can free its buffers
+     * while frames still point into this one. The buffer can't be queued anymore. false, keeping the mapping, on errors.
+     */
+    bool detach();
     char *bytes() const;
     uint32_t type() const;
     uint32_t size() const;
+    /// Driver timestamp of the last dequeued frame; its clock depends on flags()
+    timeval timestamp() const;
+    /// Driver frame counter of the last dequeued frame: gaps are frames the driver dropped
+    uint32_t sequence() const;
+    uint32_t flags() const;
 private:
   DPTR
 };
@@ -43,6 +43,7 @@ V4L2Device::V4L2Device(const QString& path) : dptr(path)
     V4L2_CHECK << d->fd << "opening device '%1'"_q % d->path;
     DESCRIBE_IOCTL(VIDIOC_DQBUF)
     DESCRIBE_IOCTL(VIDIOC_ENUM_FMT)
+    DESCRIBE_IOCTL(VIDIOC_EXPBUF)
     DESCRIBE_IOCTL(VIDIOC_ENUM_FRAMEINTERVALS)
     DESCRIBE_IOCTL(VIDIOC_ENUM_FRAMESIZES)
     DESCRIBE_IOCTL(VIDIOC_G_CTRL)
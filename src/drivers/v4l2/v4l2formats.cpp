@@ -20,6 +20,7 @@
 #include "v4l2formats.h"
 #include <linux/videodev2.h>
 #include <QDebug>
+#include <algorithm>
 #include "v4l2utils.h"
 #include "Qt/qt_strings_helper.h"
 #include "v4l2device.h"
@@ -41,6 +42,7 @@ DPTR_IMPL(V4L2Resolution) {
   v4l2_frmsizeenum frmsizeenum;
   V4L2DevicePtr device;
   V4L2Format &format;
+  double max_fps = 0;
 };
 
 QDebug operator<<(QDebug dbg, const V4L2Resolution &resolution) {
@@ -140,6 +142,20 @@ QList<V4L2FormatPtr> V4L2Formats::formats() const {
 
 V4L2Resolution::V4L2Resolution(const v4l2_frmsizeenum& frmsizeenum, const V4L2DevicePtr& device, V4L2Format &format) : dptr(frmsizeenum, device, format)
 {
+  auto fps = [](const v4l2_fract &interval) { return interval.numerator > 0 ? static_cast<double>(interval.denominator) / interval.numerator : 0.; };
+  v4l2_frmivalenum interval;
+  interval.pixel_format = frmsizeenum.pixel_format;
+  interval.width = frmsizeenum.discrete.width;
+  interval.height = frmsizeenum.discrete.height;
+  for(interval.index = 0; device->xioctl(VIDIOC_ENUM_FRAMEINTERVALS, &interval) >= 0; interval.index++) {
+    if(interval.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+      d->max_fps = max(d->max_fps, fps(interval.discrete));
+    else {
+      // Continuous or stepwise: a single entry, with the shortest interval first
+      d->max_fps = max(d->max_fps, fps(interval.stepwise.min));
+      break;
+    }
+  }
 }
 
 V4L2Format & V4L2Resolution::format()
@@ -152,6 +168,11 @@ QSize V4L2Resolution::size() const
   return {static_cast<int>(d->frmsizeenum.discrete.width), static_cast<int>(d->frmsizeenum.discrete.height)};
 }
 
+double V4L2Resolution::max_fps() const
+{
+  return d->max_fps;
+}
+
 std::size_t V4L2Resolution::area() const
 {
   return size().width() * size().height();
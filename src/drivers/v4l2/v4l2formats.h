@@ -50,6 +50,8 @@ public:
   ~V4L2Resolution();
   QSize size() const;
   std::size_t area() const;
+  /// Highest frame rate the camera offers at this size and format; 0 when it doesn't tell
+  double max_fps() const;
   V4L2Format &format();
   void set();
   uint32_t index() const;
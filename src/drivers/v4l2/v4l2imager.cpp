@@ -27,15 +27,21 @@
 #include "v4l2formats.h"
 #include "v4l2control.h"
 #include "v4l2imager_rules.h"
+#include "v4l2modes.h"
 #include <QThread>
 
 using namespace std;
 using namespace GuLinux;
 
 
+#define MODE_SELECTION_CONTROL_ID -11
 #define PIXEL_FORMAT_CONTROL_ID -10
 #define RESOLUTIONS_CONTROL_ID -9
 #define FPS_CONTROL_ID -8
+#define BUFFERS_CONTROL_ID -7
+// MJPEG and YUYV
+#define COLOUR_DECODING_CONTROL_ID -6
+#define MJPEG_SCALE_CONTROL_ID -5
 
 
 DPTR_IMPL(V4L2Imager)
@@ -54,6 +60,16 @@ DPTR_IMPL(V4L2Imager)
     QList<V4L2ControlPtr> controls;
     QString driver, bus, cameraname;
     QString dev_name;
+    int buffers_count = 8;
+    V4L2MJPEGDecoder::Settings decoding;
+    /// 0 for manual, otherwise 1 + V4L2Modes::Goal
+    int mode_selection = 0;
+    /// Index in resolutions of the best mode for goal, -1 if none
+    int best_resolution(V4L2Modes::Goal goal) const;
+    Imager::Control resolutions_control() const;
+    Imager::Control mode_selection_control() const;
+    bool has_format(uint32_t fourcc) const;
+    ImagerThread::Worker::ptr worker() const;
     void find_controls();
 };
 
@@ -141,17 +157,19 @@ Imager::Controls V4L2Imager::controls() const
 {
     Imager::Controls _settings;
     transform(begin(d->controls), end(d->controls), back_inserter(_settings), [](const V4L2ControlPtr &c) { return c->control(); } );
-    auto current_resolution = d->v4l2formats->current_resolution();
-    
-    Control resolutions_setting{RESOLUTIONS_CONTROL_ID, "Resolution", Control::Combo};
-    int index = 0;
-    for(auto resolution: d->resolutions) {
-      resolutions_setting.add_choice("%1 %2x%3"_q % resolution->format().name() % resolution->size().width() % resolution->size().height(), index);
-      if(resolution == current_resolution)
-        resolutions_setting.set_value(index);
-      index++;
+    _settings.push_back(d->resolutions_control());
+    _settings.push_back(d->mode_selection_control());
+    _settings.push_back(Control{BUFFERS_CONTROL_ID, "Capture buffers"}.set_range(2, 32, 1).set_value(d->buffers_count).set_default_value(8));
+    if(d->has_format(V4L2_PIX_FMT_MJPEG) || d->has_format(V4L2_PIX_FMT_YUYV))
+      _settings.push_back(Control{COLOUR_DECODING_CONTROL_ID, "Colour decoding", Control::Combo}
+        .add_choice("Colour", false)
+        .add_choice("Grayscale (luminance only)", true)
+        .set_value(d->decoding.grayscale).set_default_value(false));
+    if(d->has_format(V4L2_PIX_FMT_MJPEG)) {
+      _settings.push_back(Control{MJPEG_SCALE_CONTROL_ID, "MJPEG scale", Control::Combo}
+        .add_choice("1:1", 1).add_choice("1:2", 2).add_choice("1:4", 4).add_choice("1:8", 8)
+        .set_value(d->decoding.scale).set_default_value(1));
     }
-    _settings.push_back(resolutions_setting);
     
     std::sort(begin(_settings), end(_settings), [](const Control &a, const Control &b){ return a.id < b.id; });
     _settings.erase(std::unique(begin(_settings), end(_settings), [](const Control &a, const Control &b){ return a.id == b.id; }), end(_settings));
@@ -162,14 +180,30 @@ Imager::Controls V4L2Imager::controls() const
 
 void V4L2Imager::setControl(const Control &setting)
 {
+  if(setting.id == MODE_SELECTION_CONTROL_ID) {
+    const int selection = setting.get_value<int>();
+    const int best = selection > 0 ? d->best_resolution(static_cast<V4L2Modes::Goal>(selection - 1)) : -1;
+    if(best >= 0) {
+      qDebug() << "Selected mode" << d->resolutions[best]->format().name() << d->resolutions[best]->size() << "at" << d->resolutions[best]->max_fps() << "fps";
+      setControl(d->resolutions_control().set_value(best));
+    }
+    d->mode_selection = selection;
+    emit changed(d->mode_selection_control());
+    return;
+  }
   if(setting.id == RESOLUTIONS_CONTROL_ID) {
+    // Picking a resolution goes back to manual selection
+    if(d->mode_selection > 0) {
+      d->mode_selection = 0;
+      emit changed(d->mode_selection_control());
+    }
     restart([=]{
       try {
         d->resolutions[setting.get_value<int>()]->set();
       } catch(const V4L2Exception &e) {
         qWarning() << "Unable to set resolution: " << e.what();
       }
-      return make_shared<V4L2ImagingWorker>(d->device, d->v4l2formats->current_v4l2_format());
+      return d->worker();
     });
 
     auto current = d->v4l2formats->current_resolution();
@@ -178,6 +212,21 @@ void V4L2Imager::setControl(const Control &setting)
     emit changed(new_value);
     return;
   }
+  if(setting.id == COLOUR_DECODING_CONTROL_ID || setting.id == MJPEG_SCALE_CONTROL_ID) {
+    if(setting.id == COLOUR_DECODING_CONTROL_ID)
+      d->decoding.grayscale = setting.get_value<bool>();
+    else
+      d->decoding.scale = setting.get_value<int>();
+    startLive();
+    emit changed(setting);
+    return;
+  }
+  if(setting.id == BUFFERS_CONTROL_ID) {
+    d->buffers_count = setting.get_value<int>();
+    startLive();
+    emit changed(Control{setting}.set_value(d->buffers_count));
+    return;
+  }
   auto control = find_if(begin(d->controls), end(d->controls), [=](const V4L2ControlPtr &c) { return setting.id == c->control().id; });
   if(control != end(d->controls)) {
     wait_for(push_job_on_thread([=]{
@@ -187,11 +236,55 @@ void V4L2Imager::setControl(const Control &setting)
         qWarning() << e.what();
       }
       emit changed((*control)->update());
-    }));
+    }, true));
   }
 }
 
+Imager::Control V4L2Imager::Private::resolutions_control() const
+{
+  auto current_resolution = v4l2formats->current_resolution();
+  Control resolutions_setting{RESOLUTIONS_CONTROL_ID, "Resolution", Control::Combo};
+  int index = 0;
+  for(auto resolution: resolutions) {
+    if(resolution->max_fps() > 0)
+      resolutions_setting.add_choice("%1 %2x%3 (%4 fps)"_q % resolution->format().name() % resolution->size().width() % resolution->size().height() % resolution->max_fps(), index);
+    else
+      resolutions_setting.add_choice("%1 %2x%3"_q % resolution->format().name() % resolution->size().width() % resolution->size().height(), index);
+    if(resolution == current_resolution)
+      resolutions_setting.set_value(index);
+    index++;
+  }
+  return resolutions_setting;
+}
+
+Imager::Control V4L2Imager::Private::mode_selection_control() const
+{
+  return Control{MODE_SELECTION_CONTROL_ID, "Mode selection", Control::Combo}
+    .add_choice("Manual", 0)
+    .add_choice("Max fps", 1 + V4L2Modes::MaxFps)
+    .add_choice("Max quality", 1 + V4L2Modes::MaxQuality)
+    .set_value(mode_selection).set_default_value(0);
+}
+
+int V4L2Imager::Private::best_resolution(V4L2Modes::Goal goal) const
+{
+  vector<V4L2Modes::Mode> modes;
+  for(const auto &resolution: resolutions)
+    modes.push_back({resolution->format().fourcc(), resolution->size().width(), resolution->size().height(), resolution->max_fps()});
+  return V4L2Modes::best(modes, goal, V4L2MJPEGDecoder::accelerated());
+}
+
+bool V4L2Imager::Private::has_format(uint32_t fourcc) const
+{
+  return any_of(begin(resolutions), end(resolutions), [=](const V4L2ResolutionPtr &r){ return r->format().fourcc() == fourcc; });
+}
+
+ImagerThread::Worker::ptr V4L2Imager::Private::worker() const
+{
+  return make_shared<V4L2ImagingWorker>(device, v4l2formats->current_v4l2_format(), buffers_count, decoding);
+}
+
 void V4L2Imager::startLive()
 {
-  restart([=]{ return make_shared<V4L2ImagingWorker>(d->device, d->v4l2formats->current_v4l2_format()); });
+  restart([=]{ return d->worker(); });
 }
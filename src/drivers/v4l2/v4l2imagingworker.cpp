@@ -18,7 +18,7 @@
 
 #include "v4l2imagingworker.h"
 #include <linux/videodev2.h>
-#include "Qt/benchmark.h"
+#include "commons/metrics.h"
 #include "v4l2buffer.h"
 #include "v4l2utils.h"
 #include <QDebug>
@@ -28,69 +28,207 @@
 #include "c++/stringbuilder.h"
 #include "commons/frame.h"
 #include "v4l2device.h"
+#include "commons/framepool.h"
+#include "commons/framesequence.h"
+#include "commons/pixel_kernels.h"
+#include <atomic>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace std::placeholders;
 
 
 
+// Buffers that must stay queued in the driver: below this, frames are copied instead of borrowing the mmap'd buffer
+#define V4L2_MIN_QUEUED_BUFFERS 2
+// Longest wait for a buffer in a single shoot()
+#define V4L2_DEQUEUE_TIMEOUT_MS 250
+
+// OpenCV 2.4 has no UMatData: there, frames are always copied out of the driver buffers
+#ifndef CV_VERSION_EPOCH
+#define HAVE_BORROWED_BUFFERS
+namespace {
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag MatAccessFlags;
+#else
+typedef int MatAccessFlags;
+#endif
+
+// Driver buffer pixels, reference counted by cv::Mat like any other buffer: release runs when the last Mat sharing them goes,
+// even when copies of the frame Mat outlive the frame
+class BorrowedBuffers : public cv::MatAllocator {
+public:
+  typedef function<void()> Release;
+  // Never destroyed: frames can be released after the static objects are gone
+  static BorrowedBuffers &instance() { static auto allocator = new BorrowedBuffers; return *allocator; }
+  cv::Mat wrap(int rows, int cols, int type, char *data, const Release &release) {
+    cv::Mat mat{rows, cols, type, data};
+    auto u = new cv::UMatData(this);
+    u->data = u->origdata = mat.data;
+    u->size = mat.total() * mat.elemSize();
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+    u->userdata = new Release{release};
+    u->refcount = 1;
+    mat.u = u;
+    mat.allocator = this;
+    return mat;
+  }
+  cv::UMatData *allocate(int, const int *, int, void *, size_t *, MatAccessFlags, cv::UMatUsageFlags) const override { return nullptr; }
+  bool allocate(cv::UMatData *data, MatAccessFlags, cv::UMatUsageFlags) const override { return data != nullptr; }
+  void deallocate(cv::UMatData *u) const override {
+    if(! u)
+      return;
+    auto release = static_cast<Release*>(u->userdata);
+    (*release)();
+    delete release;
+    delete u;
+  }
+};
+}
+#endif
+
 DPTR_IMPL(V4L2ImagingWorker) {
   V4L2DevicePtr device;
   v4l2_format format;
+  int buffers_count;
   V4LBuffer::List buffers;
   uint32_t bufferinfo_type;
+  struct Borrowed {
+    atomic_bool streaming{true};
+    atomic_int frames{0};
+  };
+  shared_ptr<Borrowed> borrowed = make_shared<Borrowed>();
+  FrameSequence driver_sequence;
+  unique_ptr<V4L2MJPEGDecoder> mjpeg;
+  // Written by abort_exposure, to interrupt the poll on the device
+  int wake_fd = -1;
+  bool wait_for_buffer();
+  void export_buffers();
   void adjust_framerate();
   int request_buffers(int count);
-  function<FramePtr(const V4LBufferPtr)> get_frame;
-  FramePtr import_frame(const V4LBufferPtr &buffer);
-  FramePtr create_frame(const V4LBufferPtr &buffer, int cv_type, Frame::ColorFormat color_format);
-  FramePtr convert_frame(const V4LBufferPtr &buffer, int cv_type, int cv_conversion_format, Frame::ColorFormat color_format);
+  typedef function<FramePtr(const V4LBufferPtr &, FramePool &)> GetFrame;
+  GetFrame get_frame;
+  FramePtr import_frame(const V4LBufferPtr &buffer, FramePool &frames_pool);
+  FramePtr create_frame(const V4LBufferPtr &buffer, FramePool &frames_pool, int cv_type, Frame::ColorFormat color_format);
+  FramePtr convert_frame(const V4LBufferPtr &buffer, FramePool &frames_pool, int cv_type, int cv_conversion_format, Frame::ColorFormat color_format);
+  FramePtr yuyv_luminance(const V4LBufferPtr &buffer, FramePool &frames_pool);
+  struct BufferTiming {
+    timeval timestamp;
+    uint32_t flags;
+    uint32_t sequence;
+  };
+  void set_timing(Frame &frame, const BufferTiming &timing);
 };
 
-V4L2ImagingWorker::V4L2ImagingWorker(const V4L2DevicePtr& device, const v4l2_format& format) : dptr(device, format)
+V4L2ImagingWorker::V4L2ImagingWorker(const V4L2DevicePtr& device, const v4l2_format& format, int buffers_count, const V4L2MJPEGDecoder::Settings &decoding)
+  : dptr(device, format, buffers_count)
 {
-  QHash<uint32_t, function<FramePtr(const V4LBufferPtr)>> formats = {
+  QHash<uint32_t, Private::GetFrame> formats = {
     // Mono Formats
-    {V4L2_PIX_FMT_GREY, bind(&Private::create_frame, d.get(), _1, CV_8UC1, Frame::Mono)},
-    {V4L2_PIX_FMT_Y16, bind(&Private::create_frame, d.get(), _1, CV_16UC1, Frame::Mono)},
+    {V4L2_PIX_FMT_GREY, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC1, Frame::Mono)},
+    {V4L2_PIX_FMT_Y16, bind(&Private::create_frame, d.get(), _1, _2, CV_16UC1, Frame::Mono)},
     // RGB/BGR
-    {V4L2_PIX_FMT_BGR24, bind(&Private::create_frame, d.get(), _1, CV_8UC3, Frame::BGR)},
-    {V4L2_PIX_FMT_RGB24, bind(&Private::create_frame, d.get(), _1, CV_8UC3, Frame::RGB)},
+    {V4L2_PIX_FMT_BGR24, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC3, Frame::BGR)},
+    {V4L2_PIX_FMT_RGB24, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC3, Frame::RGB)},
     // Bayer 8bit
-    {V4L2_PIX_FMT_SBGGR8, bind(&Private::create_frame, d.get(), _1, CV_8UC1, Frame::Bayer_BGGR)},
-    {V4L2_PIX_FMT_SGBRG8, bind(&Private::create_frame, d.get(), _1, CV_8UC1, Frame::Bayer_GBRG)},
-    {V4L2_PIX_FMT_SGRBG8, bind(&Private::create_frame, d.get(), _1, CV_8UC1, Frame::Bayer_GRBG)},
-    {V4L2_PIX_FMT_SRGGB8, bind(&Private::create_frame, d.get(), _1, CV_8UC1, Frame::Bayer_RGGB)},
+    {V4L2_PIX_FMT_SBGGR8, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC1, Frame::Bayer_BGGR)},
+    {V4L2_PIX_FMT_SGBRG8, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC1, Frame::Bayer_GBRG)},
+    {V4L2_PIX_FMT_SGRBG8, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC1, Frame::Bayer_GRBG)},
+    {V4L2_PIX_FMT_SRGGB8, bind(&Private::create_frame, d.get(), _1, _2, CV_8UC1, Frame::Bayer_RGGB)},
     // Bayer 16bit
-    {V4L2_PIX_FMT_SBGGR16, bind(&Private::create_frame, d.get(), _1, CV_16UC1, Frame::Bayer_BGGR)},
+    {V4L2_PIX_FMT_SBGGR16, bind(&Private::create_frame, d.get(), _1, _2, CV_16UC1, Frame::Bayer_BGGR)},
     // Compressed formats
-    {V4L2_PIX_FMT_MJPEG, bind(&Private::import_frame, d.get(), _1)},
+    {V4L2_PIX_FMT_MJPEG, bind(&Private::import_frame, d.get(), _1, _2)},
     // YUV Colorspace
-    {V4L2_PIX_FMT_YUYV, bind(&Private::convert_frame, d.get(), _1, CV_8UC2, cv::COLOR_YUV2RGB_YUYV, Frame::RGB)},
+    {V4L2_PIX_FMT_YUYV, bind(&Private::convert_frame, d.get(), _1, _2, CV_8UC2, cv::COLOR_YUV2RGB_YUYV, Frame::RGB)},
   };
   auto pixelformat = format.fmt.pix.pixelformat;
   if(!formats.contains(pixelformat))
     throw V4L2Exception(V4L2Exception::unimplemented_error, GuLinux::stringbuilder() << "Requested format " << FOURCC2QS(pixelformat).toStdString() << " (" << pixelformat << ") not yet supported. Please report this error message for help");
   d->get_frame = formats[pixelformat];
+  if(pixelformat == V4L2_PIX_FMT_MJPEG)
+    d->mjpeg = make_unique<V4L2MJPEGDecoder>(decoding);
+  if(pixelformat == V4L2_PIX_FMT_YUYV && decoding.grayscale)
+    d->get_frame = bind(&Private::yuyv_luminance, d.get(), _1, _2);
   
   qDebug() << "Starting v4l2 worker with format=" << FOURCC2QS(pixelformat) << ", res=" << "%1x%2"_q % format.fmt.pix.width % format.fmt.pix.height;
   d->adjust_framerate();
-  int buffers = d->request_buffers(4);
+  int buffers = d->request_buffers(d->buffers_count);
+  qDebug() << "requested" << d->buffers_count << "buffers, got" << buffers;
+  if(buffers <= 0)
+    throw V4L2Exception(V4L2Exception::v4l2_error, "The driver granted no buffers", "requesting buffers");
   for(uint32_t i=0; i< buffers; i++) {
     d->buffers.push_back( make_shared<V4LBuffer>(i, d->device));
     d->buffers[i]->queue();
   }
   d->bufferinfo_type = d->buffers[0]->type();
+  d->export_buffers();
+  d->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  V4L2_CHECK << d->wake_fd << "creating wake up event";
   d->device->ioctl(VIDIOC_STREAMON, &d->bufferinfo_type, "starting streaming");
 }
 
 V4L2ImagingWorker::~V4L2ImagingWorker()
 {
+  d->borrowed->streaming = false;
   d->device->ioctl(VIDIOC_STREAMOFF, &d->bufferinfo_type, "stopping live");
-  d->buffers.clear();
+  if(d->wake_fd >= 0)
+    ::close(d->wake_fd);
   qDebug() << "live stopped";
-  d->request_buffers(0);
-  qDebug() << "requested  0 buffers";
+  // The driver refuses to release mapped buffers: the ones frames still borrow move to private memory, where the frames keep using them
+  if(d->borrowed->frames > 0) {
+    qDebug() << d->borrowed->frames << "frames still borrowing v4l2 buffers, detaching them";
+    for(auto buffer: d->buffers)
+      if(buffer.use_count() > 1)
+        buffer->detach();
+  }
+  d->buffers.clear();
+  try {
+    d->request_buffers(0);
+    qDebug() << "requested  0 buffers";
+  } catch(const V4L2Exception &e) {
+    qWarning() << "error releasing v4l2 buffers:" << e.what();
+  }
+}
+
+void V4L2ImagingWorker::Private::export_buffers()
+{
+  // Drivers without videobuf2 DMABUF support refuse all of them: no need to ask for each one
+  for(auto buffer: buffers)
+    if(! buffer->export_dmabuf()) {
+      qDebug() << "v4l2 buffers can't be exported as DMABUF, frames will only be available in memory";
+      return;
+    }
+  qDebug() << "exported" << buffers.size() << "v4l2 buffers as DMABUF";
+}
+
+bool V4L2ImagingWorker::Private::wait_for_buffer()
+{
+  pollfd fds[] = {
+    {device->descriptor(), POLLIN, 0},
+    {wake_fd, POLLIN, 0},
+  };
+  int result = ::poll(fds, 2, V4L2_DEQUEUE_TIMEOUT_MS);
+  if(result < 0 && errno == EINTR)
+    return false;
+  V4L2_CHECK << result << "waiting for a buffer";
+  if(fds[1].revents & POLLIN) {
+    uint64_t wakeups;
+    while(::read(wake_fd, &wakeups, sizeof(wakeups)) > 0);
+    return false;
+  }
+  // Errors (i.e. the device going away) are reported by the dequeue
+  return fds[0].revents & (POLLIN | POLLERR);
+}
+
+void V4L2ImagingWorker::abort_exposure()
+{
+  uint64_t wakeup = 1;
+  if(::write(d->wake_fd, &wakeup, sizeof(wakeup)) < 0)
+    qWarning() << "error waking up v4l2 capture:" << strerror(errno);
 }
 
 void V4L2ImagingWorker::Private::adjust_framerate()
@@ -108,6 +246,11 @@ void V4L2ImagingWorker::Private::adjust_framerate()
     }
     auto ratio = [=](const v4l2_frmivalenum &a) { return static_cast<double>(a.discrete.numerator)/static_cast<double>(a.discrete.denominator); };
     sort(begin(rates), end(rates), [&](const v4l2_frmivalenum &a, const v4l2_frmivalenum &b){ return ratio(a) < ratio(b);} );
+    if(rates.isEmpty() || rates[0].type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+      // Continuous and stepwise intervals: the driver default rate is kept
+      qDebug() << "no discrete frame intervals, keeping the current frame rate";
+      return;
+    }
     v4l2_streamparm streamparam;
     streamparam.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
      device->ioctl(VIDIOC_G_PARM, &streamparam, "getting stream parameters");
@@ -132,37 +275,108 @@ int V4L2ImagingWorker::Private::request_buffers(int count)
 
 FramePtr V4L2ImagingWorker::shoot()
 {
-  QBENCH(dequeue_buffer)->every(100)->ms();
-  auto buffer = d->buffers.dequeue(d->device);
-  BENCH_END(dequeue_buffer);
-  QBENCH(decode_image)->every(100)->ms();
-
-  auto frame = d->get_frame(buffer);
-  BENCH_END(decode_image);
-  buffer->queue(); // TODO: other types?
+  static auto &dequeue_metric = Metrics::instance().histogram("v4l2_dequeue_seconds", "Time spent waiting for the V4L2 driver to fill a buffer");
+  static auto &decode_metric = Metrics::instance().histogram("v4l2_decode_seconds", "Time spent converting a V4L2 buffer to a frame");
+  shared_ptr<V4LBuffer> buffer;
+  {
+    Metrics::Timer timer{dequeue_metric};
+    if(! d->wait_for_buffer())
+      return {};
+    buffer = d->buffers.dequeue(d->device);
+  }
+  // Read before get_frame gives the buffer back to the driver
+  Private::BufferTiming timing{buffer->timestamp(), buffer->flags(), buffer->sequence()};
+  FramePtr frame;
+  {
+    Metrics::Timer timer{decode_metric};
+    frame = d->get_frame(buffer, *frames_pool);
+  }
+  if(frame)
+    d->set_timing(*frame, timing);
   return frame;
 }
 
-FramePtr V4L2ImagingWorker::Private::import_frame(const V4LBufferPtr& buffer)
+void V4L2ImagingWorker::Private::set_timing(Frame &frame, const BufferTiming &timing)
 {
-  cv::InputArray inputArray{buffer->bytes(),  static_cast<int>(buffer->size())};
-  cv::Mat image = cv::imdecode(inputArray, -1);
-  return make_shared<Frame>(Frame::BGR, image);
+  // Driver sequence starts from 0
+  if(auto missing = driver_sequence.next(quint64{timing.sequence} + 1))
+    qDebug() << "V4L2 driver dropped" << missing << "frames," << driver_sequence.missing() << "since streaming started";
+  frame.metadata().driver_sequence = quint64{timing.sequence} + 1;
+  auto timestamp = chrono::seconds{timing.timestamp.tv_sec} + chrono::microseconds{timing.timestamp.tv_usec};
+  if(timestamp == chrono::microseconds::zero())
+    return;
+  frame.set_device_timestamp(timestamp);
+  // Monotonic timestamps share the clock with steady_clock: they give the capture time as seen by the driver, before our own dequeue and conversion
+  if((timing.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+    auto captured = Frame::Clock::time_point{chrono::duration_cast<Frame::Clock::duration>(timestamp)};
+    auto now = Frame::Clock::now();
+    if(captured > now)
+      return;
+    frame.set_captured(captured);
+    frame.set_created_utc(QDateTime::currentDateTimeUtc().addMSecs(-chrono::duration_cast<chrono::milliseconds>(now - captured).count()));
+  }
+}
+
+FramePtr V4L2ImagingWorker::Private::import_frame(const V4LBufferPtr& buffer, FramePool &frames_pool)
+{
+  auto frame = mjpeg->decode(buffer->bytes(), buffer->size(), frames_pool);
+  buffer->queue();
+  return frame;
 }
 
 
-FramePtr V4L2ImagingWorker::Private::convert_frame(const V4LBufferPtr& buffer, int cv_type, int cv_conversion_format, Frame::ColorFormat color_format)
+FramePtr V4L2ImagingWorker::Private::convert_frame(const V4LBufferPtr& buffer, FramePool &frames_pool, int cv_type, int cv_conversion_format, Frame::ColorFormat color_format)
 {
   cv::Mat image{static_cast<int>(format.fmt.pix.height), static_cast<int>(format.fmt.pix.width), cv_type, buffer->bytes()};
-  cv::cvtColor(image, image, cv_conversion_format);
-  return make_shared<Frame>(color_format, image);
+  auto frame = frames_pool.acquire(8, color_format, {image.cols, image.rows});
+  cv::Mat destination = frame->mat();
+  cv::cvtColor(image, destination, cv_conversion_format);
+  buffer->queue();
+  return frame;
 }
 
-FramePtr V4L2ImagingWorker::Private::create_frame(const V4LBufferPtr& buffer, int cv_type, Frame::ColorFormat color_format)
+FramePtr V4L2ImagingWorker::Private::yuyv_luminance(const V4LBufferPtr& buffer, FramePool &frames_pool)
 {
-    cv::Mat image = cv::Mat{static_cast<int>(format.fmt.pix.height), static_cast<int>(format.fmt.pix.width), cv_type, buffer->bytes()};
-    // copy(buffer->bytes(), buffer->bytes() + buffer->size(), image.begin<uint8_t>());
-    // move(buffer->bytes(), buffer->bytes() + buffer->size(), image.begin<uint8_t>());
-    return make_shared<Frame>(color_format, image);
+  const int width = format.fmt.pix.width, height = format.fmt.pix.height;
+  const size_t stride = format.fmt.pix.bytesperline ? format.fmt.pix.bytesperline : width * 2;
+  auto frame = frames_pool.acquire(8, Frame::Mono, {width, height});
+  cv::Mat &destination = frame->mat();
+  auto source = reinterpret_cast<const uint8_t*>(buffer->bytes());
+  for(int row = 0; row < height; row++)
+    PixelKernels::yuyv_luminance(source + row * stride, destination.ptr<uint8_t>(row), width);
+  buffer->queue();
+  return frame;
+}
+
+FramePtr V4L2ImagingWorker::Private::create_frame(const V4LBufferPtr& buffer, FramePool &frames_pool, int cv_type, Frame::ColorFormat color_format)
+{
+    const int rows = format.fmt.pix.height, cols = format.fmt.pix.width;
+#ifdef HAVE_BORROWED_BUFFERS
+    const int borrowable = buffers.size() - V4L2_MIN_QUEUED_BUFFERS;
+    if(borrowable > 0 && borrowed->frames < borrowable) {
+      // Zero copy: the frame points straight into the mmap'd buffer, which is queued back to the driver when the last Mat sharing it is released
+      auto borrowed = this->borrowed;
+      ++borrowed->frames;
+      auto image = BorrowedBuffers::instance().wrap(rows, cols, cv_type, buffer->bytes(), [buffer, borrowed]{
+        --borrowed->frames;
+        if(! borrowed->streaming)
+          return;
+        try {
+          buffer->queue();
+        } catch(const V4L2Exception &e) {
+          qWarning() << "error queuing borrowed buffer:" << e.what();
+        }
+      });
+      auto frame = make_shared<Frame>(color_format, image, Frame::BigEndian, Frame::ShareBuffer);
+      frame->set_dmabuf(buffer->dmabuf());
+      return frame;
+    }
+#endif
+    const cv::Mat image{rows, cols, cv_type, buffer->bytes()};
+    auto frame = frames_pool.acquire(CV_MAT_DEPTH(cv_type) == CV_8U ? 8 : 16, color_format, {image.cols, image.rows});
+    cv::Mat destination = frame->mat();
+    image.copyTo(destination);
+    buffer->queue();
+    return frame;
 }
 
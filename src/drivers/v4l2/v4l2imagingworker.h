@@ -21,6 +21,7 @@
 #include "drivers/imagerthread.h"
 #include "c++/dptr.h"
 #include "commons/fwd.h"
+#include "v4l2mjpegdecoder.h"
 
 FWD_PTR(V4L2Device)
 
@@ -28,9 +29,13 @@ struct v4l2_format;
 class V4L2ImagingWorker : public ImagerThread::Worker
 {
 public:
-  V4L2ImagingWorker(const V4L2DevicePtr &device, const v4l2_format &format);
+  /// decoding applies to MJPEG, and its grayscale setting to YUYV too (luminance only, instead of RGB)
+  V4L2ImagingWorker(const V4L2DevicePtr &device, const v4l2_format &format, int buffers_count = 8, const V4L2MJPEGDecoder::Settings &decoding = {});
   virtual ~V4L2ImagingWorker();
+  /// Waits for a filled buffer at most V4L2_DEQUEUE_TIMEOUT_MS, returning no frame on timeout so that queued jobs can run
   FramePtr shoot() override;
+  /// Wakes up a shoot() waiting for a buffer (i.e. for an urgent job during a long exposure)
+  void abort_exposure() override;
 private:
   DPTR
 };
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "v4l2mjpegdecoder.h"
+#include "commons/definitions.h"
+#include "commons/frame.h"
+#include "commons/framepool.h"
+#include <QDebug>
+#include <QHash>
+#if HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+using namespace std;
+
+DPTR_IMPL(V4L2MJPEGDecoder) {
+  const Settings settings;
+#if HAVE_TURBOJPEG
+  tjhandle decompressor = tjInitDecompress();
+#endif
+  FramePtr imdecode(const char *data, size_t size) const;
+};
+
+V4L2MJPEGDecoder::V4L2MJPEGDecoder(const Settings &settings) : dptr(settings)
+{
+}
+
+V4L2MJPEGDecoder::~V4L2MJPEGDecoder()
+{
+#if HAVE_TURBOJPEG
+  if(d->decompressor)
+    tjDestroy(d->decompressor);
+#endif
+}
+
+bool V4L2MJPEGDecoder::accelerated()
+{
+  return HAVE_TURBOJPEG;
+}
+
+FramePtr V4L2MJPEGDecoder::decode(const char *data, size_t size, FramePool &frames_pool)
+{
+#if HAVE_TURBOJPEG
+  if(! d->decompressor)
+    return d->imdecode(data, size);
+  auto jpeg = reinterpret_cast<const unsigned char *>(data);
+  int width, height, subsampling, colorspace;
+  if(tjDecompressHeader3(d->decompressor, jpeg, size, &width, &height, &subsampling, &colorspace) != 0) {
+    qDebug() << "Invalid MJPEG frame:" << tjGetErrorStr();
+    return {};
+  }
+  const tjscalingfactor factor{1, d->settings.scale};
+  const bool grayscale = d->settings.grayscale || colorspace == TJCS_GRAY;
+  auto frame = frames_pool.acquire(8, grayscale ? Frame::Mono : Frame::BGR, {TJSCALED(width, factor), TJSCALED(height, factor)});
+  cv::Mat destination = frame->mat();
+  // Destination geometry selects the DCT scaling
+  if(tjDecompress2(d->decompressor, jpeg, size, destination.data, destination.cols, static_cast<int>(destination.step), destination.rows,
+                   grayscale ? TJPF_GRAY : TJPF_BGR, TJFLAG_FASTDCT) != 0) {
+#ifdef TJFLAG_STOPONWARNING
+    // Warnings (i.e. a few corrupt MCUs at the end of a USB transfer) still give a usable frame
+    if(tjGetErrorCode(d->decompressor) != TJERR_WARNING) {
+      qDebug() << "MJPEG decoding failed:" << tjGetErrorStr2(d->decompressor);
+      return {};
+    }
+#else
+    qDebug() << "MJPEG decoding failed:" << tjGetErrorStr();
+    return {};
+#endif
+  }
+  return frame;
+#else
+  Q_UNUSED(frames_pool)
+  return d->imdecode(data, size);
+#endif
+}
+
+FramePtr V4L2MJPEGDecoder::Private::imdecode(const char *data, size_t size) const
+{
+  static const QHash<int, int> reduced_colour{{2, cv::IMREAD_REDUCED_COLOR_2}, {4, cv::IMREAD_REDUCED_COLOR_4}, {8, cv::IMREAD_REDUCED_COLOR_8}};
+  static const QHash<int, int> reduced_grayscale{{2, cv::IMREAD_REDUCED_GRAYSCALE_2}, {4, cv::IMREAD_REDUCED_GRAYSCALE_4}, {8, cv::IMREAD_REDUCED_GRAYSCALE_8}};
+  const int flags = settings.grayscale ? reduced_grayscale.value(settings.scale, cv::IMREAD_GRAYSCALE) : reduced_colour.value(settings.scale, cv::IMREAD_COLOR);
+  cv::Mat image = cv::imdecode(cv::InputArray{data, static_cast<int>(size)}, flags);
+  if(image.empty())
+    return {};
+  return make_shared<Frame>(image.channels() == 1 ? Frame::Mono : Frame::BGR, image, Frame::BigEndian, Frame::ShareBuffer);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef V4L2MJPEGDECODER_H
+#define V4L2MJPEGDECODER_H
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <cstddef>
+
+FWD_PTR(Frame)
+class FramePool;
+
+/**
+ * MJPEG frames from UVC webcams, decoded with libjpeg-turbo straight into pooled frames (OpenCV imdecode when it's not available).
+ * Grayscale decodes the luminance plane only, skipping chroma and colour conversion; scale (1, 2, 4 or 8) uses the DCT scaling,
+ * for a smaller frame at a fraction of the cost. Both apply to all the frame consumers, recording included.
+ * Not thread safe: one decoder per capture thread.
+ */
+class V4L2MJPEGDecoder
+{
+public:
+  struct Settings {
+    bool grayscale = false;
+    int scale = 1;
+  };
+  V4L2MJPEGDecoder(const Settings &settings);
+  ~V4L2MJPEGDecoder();
+  /// Null frame if the data can't be decoded (i.e. a truncated frame)
+  FramePtr decode(const char *data, std::size_t size, FramePool &frames_pool);
+  static bool accelerated();
+private:
+  DPTR
+};
+
+#endif // V4L2MJPEGDECODER_H
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "v4l2modes.h"
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+// Same formats as V4L2ImagingWorker captures
+enum Class { Unsupported, Raw, Deep, YUV, Compressed };
+
+Class format_class(uint32_t fourcc) {
+  switch(fourcc) {
+    case V4L2_PIX_FMT_GREY:
+    case V4L2_PIX_FMT_BGR24:
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_SBGGR8:
+    case V4L2_PIX_FMT_SGBRG8:
+    case V4L2_PIX_FMT_SGRBG8:
+    case V4L2_PIX_FMT_SRGGB8:
+      return Raw;
+    case V4L2_PIX_FMT_Y16:
+    case V4L2_PIX_FMT_SBGGR16:
+      return Deep;
+    case V4L2_PIX_FMT_YUYV:
+      return YUV;
+    case V4L2_PIX_FMT_MJPEG:
+      return Compressed;
+    default:
+      return Unsupported;
+  }
+}
+
+// Higher is better for MaxQuality: lossless and deeper first
+int quality_rank(Class format) {
+  switch(format) {
+    case Deep: return 4;
+    case Raw: return 3;
+    case YUV: return 2;
+    case Compressed: return 1;
+    default: return 0;
+  }
+}
+
+// Modes within this ratio of each other count as the same rate, and the larger frame wins
+constexpr double SAME_FPS = 0.95;
+}
+
+double V4L2Modes::pixel_cost_ns(uint32_t fourcc, bool accelerated_mjpeg)
+{
+  // Rough figures for a single core of a small PC: a copy, a colour conversion, a JPEG decode
+  switch(format_class(fourcc)) {
+    case Raw:
+    case Deep:
+      return 0.3;
+    case YUV:
+      return 1.5;
+    case Compressed:
+      return accelerated_mjpeg ? 5 : 12;
+    default:
+      return 0;
+  }
+}
+
+double V4L2Modes::deliverable_fps(const Mode &mode, bool accelerated_mjpeg)
+{
+  const double cost = pixel_cost_ns(mode.fourcc, accelerated_mjpeg);
+  const double pixels = static_cast<double>(mode.width) * mode.height;
+  if(cost <= 0 || pixels <= 0)
+    return 0;
+  return min(mode.fps, 1e9 / (cost * pixels));
+}
+
+int V4L2Modes::best(const vector<Mode> &modes, Goal goal, bool accelerated_mjpeg)
+{
+  int best = -1;
+  double best_fps = 0;
+  bool best_usable = false;
+  for(int index = 0; index < static_cast<int>(modes.size()); index++) {
+    const auto &mode = modes[index];
+    const double fps = deliverable_fps(mode, accelerated_mjpeg);
+    if(fps <= 0)
+      continue;
+    const long area = static_cast<long>(mode.width) * mode.height;
+    const int rank = quality_rank(format_class(mode.fourcc));
+    const double cost = pixel_cost_ns(mode.fourcc, accelerated_mjpeg);
+    bool better = best < 0;
+    if(! better) {
+      const auto &current = modes[best];
+      const long current_area = static_cast<long>(current.width) * current.height;
+      const int current_rank = quality_rank(format_class(current.fourcc));
+      const double current_cost = pixel_cost_ns(current.fourcc, accelerated_mjpeg);
+      if(goal == MaxFps) {
+        if(fps * SAME_FPS > best_fps)
+          better = true;
+        else if(fps > best_fps * SAME_FPS)
+          better = make_tuple(area, -cost, fps) > make_tuple(current_area, -current_cost, best_fps);
+      } else {
+        const bool usable = fps >= MinQualityFps;
+        if(usable != best_usable)
+          better = usable;
+        else
+          better = make_tuple(area, rank, fps) > make_tuple(current_area, current_rank, best_fps);
+      }
+    }
+    if(better) {
+      best = index;
+      best_fps = fps;
+      best_usable = fps >= MinQualityFps;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef V4L2MODES_H
+#define V4L2MODES_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Ranks the (format, size, frame rate) triples a webcam offers, for picking a mode without trial and error.
+ * The rate a mode delivers is the lowest of the camera rate and what the capture thread can process in that format:
+ * raw formats are copied as they are, YUYV needs a colour conversion, MJPEG a full decode, several times slower.
+ */
+class V4L2Modes
+{
+public:
+  struct Mode {
+    std::uint32_t fourcc;
+    int width;
+    int height;
+    /// Highest frame rate the camera offers for this format and size
+    double fps;
+  };
+  enum Goal {
+    /// Highest deliverable frame rate, then the largest frame
+    MaxFps,
+    /// Largest frame at a usable rate (see MinQualityFps), uncompressed and deeper formats first, then the frame rate
+    MaxQuality,
+  };
+  /// Frames per second below which MaxQuality gives a mode up for a smaller one
+  static constexpr double MinQualityFps = 5;
+  /// Processing cost of a pixel, in nanoseconds; 0 for formats the driver can't capture
+  static double pixel_cost_ns(std::uint32_t fourcc, bool accelerated_mjpeg);
+  /// Frame rate the capture thread can keep up with, at most the camera one
+  static double deliverable_fps(const Mode &mode, bool accelerated_mjpeg);
+  /// Index of the best mode for goal, -1 when none can be captured
+  static int best(const std::vector<Mode> &modes, Goal goal, bool accelerated_mjpeg);
+};
+
+#endif // V4L2MODES_H
@@ -19,10 +19,17 @@
 #include "asiimagingworker.h"
 #include "zwoexception.h"
 #include <atomic>
+#include <algorithm>
+#include <map>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QThread>
 #include "commons/frame.h"
-#include <array>
+#include "commons/framepool.h"
+#include "commons/exposureprogress.h"
+#include "commons/metrics.h"
 
-#define FRAMES_BUFFER 5
 using namespace std;
 
 DPTR_IMPL(ASIImagingWorker) {
@@ -31,18 +38,41 @@ DPTR_IMPL(ASIImagingWorker) {
   int bin;
   QRect roi;
   atomic_long exposure_timeout;
+  // Video capture stopped from another thread, to interrupt ASIGetVideoData
+  QMutex abort_mutex;
+  bool aborted = false;
+  // Timelapse: one ASIStartExposure per shot instead of video capture
+  bool single_shot = false;
+  // Video capture is stopped for single exposures, long ones included (see start_exposure), and started again by the next video shot
+  bool streaming = false;
+  // Under abort_mutex, as abort_exposure() stops it
+  bool exposing = false;
+  QElapsedTimer exposure_elapsed;
+  ImagerThread::Trigger trigger;
+  void start_exposure();
+  ImagerThread::Worker::ExposureStatus exposure_status();
+  FramePtr readout(FramePool &frames_pool);
+  FramePtr snap(ExposureProgress &progress, FramePool &frames_pool);
+  // Whichever is running, returning whether it was video capture
+  bool stop_capture();
+  // ASIGetDroppedFrames counts from the last ASIStartVideoCapture
+  int sdk_dropped_since_start = 0;
+  uint64_t sdk_dropped = 0;
+  Metrics::Counter &sdk_dropped_metric = Metrics::instance().counter("driver_sdk_dropped_frames_total", "Frames the camera SDK dropped before handing them to the driver", "driver=\"zwo_asi\"");
+  void start_video_capture(const char *what);
+  void count_sdk_dropped();
+  unique_ptr<BandwidthTuner> bandwidth_tuner;
+  BandwidthTuned bandwidth_tuned;
+  void set_bandwidth(long value);
+  // ST4 pulses are only switched on and off by the SDK: ended from the timer thread, created on the first pulse
+  unique_ptr<PulseTimer> guide_pulses;
 
   std::vector<uint8_t> buffer;
   size_t calcBufferSize();
   int getCVImageType();
   Frame::ColorFormat color_format;
   Frame::ColorFormat colorFormat() const;
-#ifdef FRAMES_BUFFER
-  array<FramePtr, FRAMES_BUFFER> frames;
-#endif
-  uint8_t current_frame = 0;
-  FramePtr new_frame() const;
-  uint8_t next_index();
+  FramePtr new_frame(FramePool &frames_pool) const;
 };
 
 ASIImagingWorker::ASIImagingWorker(const QRect& roi, int bin, const ASI_CAMERA_INFO& info, ASI_IMG_TYPE format)
@@ -51,7 +81,7 @@ ASIImagingWorker::ASIImagingWorker(const QRect& roi, int bin, const ASI_CAMERA_I
     qDebug() << "Starting imaging: imageFormat=" << d->format << ", d->roi: " << d->roi << ", bin: " << d->bin;
     ASI_CHECK << ASISetROIFormat(d->info.CameraID, d->roi.width(), d->roi.height(), d->bin, d->format) << "Set format";
     ASI_CHECK << ASISetStartPos(d->info.CameraID, d->roi.x(), d->roi.y()) << "Set ROI position";
-    ASI_CHECK << ASIStartVideoCapture(d->info.CameraID) << "Start video capture";
+    d->start_video_capture("Start video capture");
     d->buffer.resize(d->calcBufferSize());
     qDebug() << "Imaging started: imageFormat=" << d->format << ", roi: " << d->roi << ", bin: " << d->bin;
     
@@ -67,28 +97,17 @@ ASIImagingWorker::ASIImagingWorker(const QRect& roi, int bin, const ASI_CAMERA_I
     d->color_format = Frame::Mono;
   }
   calc_exposure_timeout();
-#ifdef FRAMES_BUFFER
-  generate(begin(d->frames), end(d->frames), bind(&Private::new_frame, d.get()));
-#endif
 }
 
-FramePtr ASIImagingWorker::Private::new_frame() const {
-  // ASI CAMs are little endian
-  return make_shared<Frame>( format == ASI_IMG_RAW16 ? 16 : 8,  colorFormat(), QSize{roi.width(), roi.height()}, Frame::LittleEndian);
-}
-
-uint8_t ASIImagingWorker::Private::next_index() {
-#ifdef FRAMES_BUFFER
-    return (current_frame++) % frames.size();
-#else
-    return 0;
-#endif
+FramePtr ASIImagingWorker::Private::new_frame(FramePool &frames_pool) const {
+  // ASI CAMs are little endian. The SDK writes straight into the pool buffers, recycled once the frames are gone downstream.
+  return frames_pool.acquire( format == ASI_IMG_RAW16 ? 16 : 8,  colorFormat(), QSize{roi.width(), roi.height()}, Frame::LittleEndian);
 }
 
 ASIImagingWorker::~ASIImagingWorker()
 {
-    ASI_CHECK << ASIStopVideoCapture(d->info.CameraID) << "Stop capture";
-    qDebug() << "Imaging stopped.";
+  d->stop_capture();
+  qDebug() << "Imaging stopped.";
 }
 
 void ASIImagingWorker::calc_exposure_timeout()
@@ -107,15 +126,297 @@ void ASIImagingWorker::calc_exposure_timeout()
 
 FramePtr ASIImagingWorker::shoot()
 {
-#ifdef FRAMES_BUFFER
-  FramePtr frame = d->frames[d->next_index()];
-#else
-  FramePtr frame = d->new_frame();
-#endif
-  ASI_CHECK << ASIGetVideoData(d->info.CameraID, frame->data(), frame->size(), d->exposure_timeout) << "Capture frame";
+  if(d->single_shot)
+    return d->snap(*exposure_progress, *frames_pool);
+  {
+    // After single exposures, or aborted before the shot even started: jobs run first then
+    QMutexLocker lock(&d->abort_mutex);
+    const bool aborted = d->aborted;
+    if(! d->streaming)
+      d->start_video_capture("Restart video capture");
+    if(aborted)
+      return {};
+  }
+  FramePtr frame = d->new_frame(*frames_pool);
+  // Triggered: the frame comes at most an exposure after the trigger, and no trigger within the poll time is not an error
+  long timeout = d->exposure_timeout;
+  if(d->trigger.active())
+    timeout = d->trigger.poll.count() + max(timeout, 0l);
+  auto result = ASIGetVideoData(d->info.CameraID, frame->data(), frame->size(), timeout);
+  {
+    QMutexLocker lock(&d->abort_mutex);
+    if(d->aborted) {
+      d->aborted = false;
+      d->start_video_capture("Restart video capture");
+      return {};
+    }
+  }
+  if(result == ASI_ERROR_TIMEOUT && d->trigger.active())
+    return {};
+  ASI_CHECK << result << "Capture frame";
+  d->count_sdk_dropped();
+  long bandwidth;
+  // Triggered frames come at the trigger pace, whatever the bandwidth
+  if(d->bandwidth_tuner && ! d->trigger.active() && d->bandwidth_tuner->frame(frame->captured(), d->sdk_dropped, bandwidth))
+    d->set_bandwidth(bandwidth);
+  return frame;
+}
+
+void ASIImagingWorker::Private::start_video_capture(const char *what)
+{
+  ASI_CHECK << ASIStartVideoCapture(info.CameraID) << what;
+  streaming = true;
+  aborted = false;
+  sdk_dropped_since_start = 0;
+}
+
+bool ASIImagingWorker::Private::stop_capture()
+{
+  if(exposing) {
+    exposing = false;
+    ASI_CHECK << ASIStopExposure(info.CameraID) << "Stop exposure";
+  }
+  if(! streaming)
+    return false;
+  streaming = false;
+  ASI_CHECK << ASIStopVideoCapture(info.CameraID) << "Stop capture";
+  return true;
+}
+
+void ASIImagingWorker::Private::count_sdk_dropped()
+{
+  int dropped;
+  if(ASIGetDroppedFrames(info.CameraID, &dropped) != ASI_SUCCESS || dropped <= sdk_dropped_since_start)
+    return;
+  sdk_dropped += dropped - sdk_dropped_since_start;
+  sdk_dropped_metric.add(dropped - sdk_dropped_since_start);
+  sdk_dropped_since_start = dropped;
+}
+
+void ASIImagingWorker::Private::set_bandwidth(long value)
+{
+  ASI_CHECK << ASISetControlValue(info.CameraID, ASI_BANDWIDTHOVERLOAD, value, ASI_FALSE) << "Set bandwidth";
+  qDebug() << "Bandwidth tuning: bandwidth=" << value << ", settled:" << bandwidth_tuner->settled() << ", SDK dropped frames:" << sdk_dropped;
+  if(bandwidth_tuned)
+    bandwidth_tuned(value);
+}
+
+void ASIImagingWorker::tune_bandwidth(const BandwidthTuner::Range &range, const BandwidthTuned &tuned)
+{
+  d->bandwidth_tuner = make_unique<BandwidthTuner>(range);
+  d->bandwidth_tuned = tuned;
+  d->set_bandwidth(d->bandwidth_tuner->value());
+}
+
+void ASIImagingWorker::stop_bandwidth_tuning()
+{
+  d->bandwidth_tuner.reset();
+  d->bandwidth_tuned = {};
+}
+
+void ASIImagingWorker::Private::start_exposure()
+{
+  QMutexLocker lock(&abort_mutex);
+  // Single exposures can't run with video capture
+  if(streaming) {
+    streaming = false;
+    ASI_CHECK << ASIStopVideoCapture(info.CameraID) << "Stop video capture";
+  }
+  ASI_CHECK << ASIStartExposure(info.CameraID, ASI_FALSE) << "Start exposure";
+  exposing = true;
+  exposure_elapsed.start();
+}
+
+ImagerThread::Worker::ExposureStatus ASIImagingWorker::Private::exposure_status()
+{
+  QMutexLocker lock(&abort_mutex);
+  if(! exposing)
+    return ImagerThread::Worker::Idle;
+  ASI_EXPOSURE_STATUS status;
+  ASI_CHECK << ASIGetExpStatus(info.CameraID, &status) << "Get exposure status";
+  if(status == ASI_EXP_WORKING && exposure_timeout >= 0 && exposure_elapsed.elapsed() > exposure_timeout) {
+    exposing = false;
+    ASIStopExposure(info.CameraID);
+    ASI_CHECK << ASI_ERROR_TIMEOUT << "Exposure";
+  }
+  if(status == ASI_EXP_WORKING)
+    return ImagerThread::Worker::Exposing;
+  if(status != ASI_EXP_SUCCESS) {
+    exposing = false;
+    ASI_CHECK << ASI_ERROR_GENERAL_ERROR << "Exposure";
+  }
+  return ImagerThread::Worker::Exposed;
+}
+
+FramePtr ASIImagingWorker::Private::readout(FramePool &frames_pool)
+{
+  FramePtr frame = new_frame(frames_pool);
+  QMutexLocker lock(&abort_mutex);
+  // Aborted after the exposure was over
+  if(! exposing)
+    return {};
+  exposing = false;
+  ASI_CHECK << ASIGetDataAfterExp(info.CameraID, frame->data(), frame->size()) << "Get exposure data";
   return frame;
 }
 
+FramePtr ASIImagingWorker::Private::snap(ExposureProgress &progress, FramePool &frames_pool)
+{
+  start_exposure();
+  for(auto status = exposure_status(); status != ImagerThread::Worker::Exposed; status = exposure_status()) {
+    if(status == ImagerThread::Worker::Idle)
+      return {};
+    QThread::msleep(2);
+  }
+  progress.reading_out();
+  return readout(frames_pool);
+}
+
+bool ASIImagingWorker::start_exposure()
+{
+  d->start_exposure();
+  return true;
+}
+
+ImagerThread::Worker::ExposureStatus ASIImagingWorker::exposure_status()
+{
+  return d->exposure_status();
+}
+
+FramePtr ASIImagingWorker::readout()
+{
+  return d->readout(*frames_pool);
+}
+
+bool ASIImagingWorker::set_single_shot(bool single_shot)
+{
+  QMutexLocker lock(&d->abort_mutex);
+  if(single_shot == d->single_shot)
+    return true;
+  d->stop_capture();
+  if(! single_shot)
+    d->start_video_capture("Start video capture");
+  d->single_shot = single_shot;
+  d->aborted = false;
+  qDebug() << "Single shot mode:" << single_shot;
+  return true;
+}
+
+bool ASIImagingWorker::guide_pulse(ImagerThread::GuideDirection direction, chrono::milliseconds duration)
+{
+  if(! d->info.ST4Port)
+    return false;
+  static const map<ImagerThread::GuideDirection, ASI_GUIDE_DIRECTION> directions {
+    {ImagerThread::GuideDirection::North, ASI_GUIDE_NORTH},
+    {ImagerThread::GuideDirection::South, ASI_GUIDE_SOUTH},
+    {ImagerThread::GuideDirection::East, ASI_GUIDE_EAST},
+    {ImagerThread::GuideDirection::West, ASI_GUIDE_WEST},
+  };
+  if(! d->guide_pulses)
+    d->guide_pulses = make_unique<PulseTimer>();
+  const auto camera = d->info.CameraID;
+  const auto asi_direction = directions.at(direction);
+  const int axis = direction == ImagerThread::GuideDirection::North || direction == ImagerThread::GuideDirection::South ? 0 : 1;
+  d->guide_pulses->start(axis, duration, [=]{
+    ASI_CHECK << ASIPulseGuideOn(camera, asi_direction) << "Guide pulse on";
+  }, [=]{
+    const auto result = ASIPulseGuideOff(camera, asi_direction);
+    if(result != ASI_SUCCESS)
+      qWarning() << "ZWO guide pulse off failed:" << result;
+  });
+  return true;
+}
+
+bool ASIImagingWorker::set_trigger(const ImagerThread::Trigger &trigger)
+{
+  if(! d->info.IsTriggerCam)
+    return ! trigger.active();
+  static const map<ImagerThread::Trigger::Mode, ASI_CAMERA_MODE> modes {
+    {ImagerThread::Trigger::FreeRun, ASI_MODE_NORMAL},
+    {ImagerThread::Trigger::RisingEdge, ASI_MODE_TRIG_RISE_EDGE},
+    {ImagerThread::Trigger::FallingEdge, ASI_MODE_TRIG_FALL_EDGE},
+  };
+  const auto mode = modes.at(trigger.mode);
+  ASI_SUPPORTED_MODE supported;
+  ASI_CHECK << ASIGetCameraSupportMode(d->info.CameraID, &supported) << "Get camera supported modes";
+  auto supported_end = find(begin(supported.SupportedCameraMode), end(supported.SupportedCameraMode), ASI_MODE_END);
+  if(find(begin(supported.SupportedCameraMode), supported_end, mode) == supported_end)
+    return false;
+  // Triggers reach the camera in video capture only
+  if(trigger.active() && d->single_shot)
+    set_single_shot(false);
+  QMutexLocker lock(&d->abort_mutex);
+  // The camera mode can only change with the capture stopped
+  d->stop_capture();
+  d->aborted = false;
+  ASI_CHECK << ASISetCameraMode(d->info.CameraID, mode) << "Set camera mode";
+  if(! d->single_shot)
+    d->start_video_capture("Start video capture");
+  d->trigger = trigger;
+  qDebug() << "Camera mode:" << mode;
+  return true;
+}
+
+bool ASIImagingWorker::reconfigure(const QRect &roi, int bin, int format)
+{
+  qDebug() << "Reconfiguring imaging: imageFormat=" << format << ", roi: " << roi << ", bin: " << bin;
+  QMutexLocker lock(&d->abort_mutex);
+  const bool streaming = d->stop_capture();
+  d->aborted = false;
+  ASI_CHECK << ASISetROIFormat(d->info.CameraID, roi.width(), roi.height(), bin, static_cast<ASI_IMG_TYPE>(format)) << "Set format";
+  ASI_CHECK << ASISetStartPos(d->info.CameraID, roi.x(), roi.y()) << "Set ROI position";
+  if(streaming)
+    d->start_video_capture("Start video capture");
+  const bool same_size = roi.size() == d->roi.size() && static_cast<int>(d->format) == format;
+  d->roi = roi;
+  d->bin = bin;
+  d->format = static_cast<ASI_IMG_TYPE>(format);
+  d->buffer.resize(d->calcBufferSize());
+  calc_exposure_timeout();
+  // The fastest stable bandwidth depends on the frame size
+  if(d->bandwidth_tuner && ! same_size)
+    d->set_bandwidth(d->bandwidth_tuner->reset());
+  return true;
+}
+
+bool ASIImagingWorker::shift_roi(const QPoint &shift, QPoint &origin)
+{
+  long flip = ASI_FLIP_NONE;
+  ASI_BOOL is_auto;
+  ASI_CHECK << ASIGetControlValue(d->info.CameraID, ASI_FLIP, &flip, &is_auto) << "Get flip";
+  // Start positions are on the sensor, before the camera flips the frames
+  const int dx = (flip == ASI_FLIP_HORIZ || flip == ASI_FLIP_BOTH) ? -shift.x() : shift.x();
+  const int dy = (flip == ASI_FLIP_VERT || flip == ASI_FLIP_BOTH) ? -shift.y() : shift.y();
+  // Same alignment as ZWO_ASI_Imager's ROI validator: even start positions
+  const int max_x = (static_cast<int>(d->info.MaxWidth) / d->bin - d->roi.width()) & ~1;
+  const int max_y = (static_cast<int>(d->info.MaxHeight) / d->bin - d->roi.height()) & ~1;
+  const QPoint moved{max(0, min(max_x, (d->roi.x() + dx) & ~1)), max(0, min(max_y, (d->roi.y() + dy) & ~1))};
+  if(moved != d->roi.topLeft()) {
+    // The SDK moves the ROI while streaming: no need to stop the capture
+    ASI_CHECK << ASISetStartPos(d->info.CameraID, moved.x(), moved.y()) << "Move ROI";
+    d->roi.moveTopLeft(moved);
+    qDebug() << "ROI moved to" << d->roi;
+  }
+  origin = d->roi.topLeft();
+  return true;
+}
+
+void ASIImagingWorker::abort_exposure()
+{
+  QMutexLocker lock(&d->abort_mutex);
+  // Single exposures just go back to Idle
+  if(d->exposing) {
+    d->exposing = false;
+    ASI_CHECK << ASIStopExposure(d->info.CameraID) << "Abort exposure";
+    return;
+  }
+  if(d->aborted || ! d->streaming)
+    return;
+  d->aborted = true;
+  d->streaming = false;
+  ASI_CHECK << ASIStopVideoCapture(d->info.CameraID) << "Abort exposure";
+}
+
 size_t ASIImagingWorker::Private::calcBufferSize()
 {
     auto base_size = roi.width() * roi.height();
@@ -22,6 +22,8 @@
 #include "ASICamera2.h"
 #include <vector>
 #include "drivers/imagerthread.h"
+#include "drivers/bandwidthtuner.h"
+#include "drivers/pulsetimer.h"
 #include <QRect>
 #include "commons/fwd.h"
 
@@ -32,6 +34,22 @@ public:
   ASIImagingWorker(const QRect &roi, int bin, const ASI_CAMERA_INFO &info, ASI_IMG_TYPE format);
   ~ASIImagingWorker();
   FramePtr shoot() override;
+  void abort_exposure() override;
+  bool reconfigure(const QRect &roi, int bin, int format) override;
+  bool shift_roi(const QPoint &shift, QPoint &origin) override;
+  bool set_single_shot(bool single_shot) override;
+  bool set_trigger(const ImagerThread::Trigger &trigger) override;
+  bool start_exposure() override;
+  ExposureStatus exposure_status() override;
+  FramePtr readout() override;
+  bool guide_pulse(ImagerThread::GuideDirection direction, std::chrono::milliseconds duration) override;
+  typedef std::function<void(long)> BandwidthTuned;
+  /**
+   * Free running video: ramps ASI_BANDWIDTHOVERLOAD while watching the SDK dropped frames and the delivered rate (see BandwidthTuner),
+   * starting over on ROI or format changes. tuned is called on the capture thread with every value set. Call from the capture thread.
+   */
+  void tune_bandwidth(const BandwidthTuner::Range &range, const BandwidthTuned &tuned);
+  void stop_bandwidth_tuning();
 
   QRect roi() const;
   ASI_IMG_TYPE format() const;
@@ -21,6 +21,7 @@
 #include <stringbuilder.h>
 #include <QObject>
 #include <set>
+#include <vector>
 #include <QThread>
 #include "commons/fps_counter.h"
 #include <QRect>
@@ -44,6 +45,7 @@ using namespace GuLinux;
 namespace {
 const int64_t ImgTypeControlID = 10000;
 const int64_t BinControlID = 10001;
+const int64_t AutoBandwidthControlID = 10002;
 }
 
 
@@ -55,12 +57,19 @@ DPTR_IMPL(ZWO_ASI_Imager) {
 
     ASIControl::vector controls;
     ASIControlPtr temperature_control;
+    ASIControlPtr cooler_power_control;
+    ASIControlPtr bandwidth_control;
+    bool auto_bandwidth = false;
+    void tune_bandwidth(ASIImagingWorker &worker);
+    void set_auto_bandwidth(bool enabled);
+    QList<ImagerThread::Trigger::Mode> trigger_modes;
     
     weak_ptr<ASIImagingWorker> worker;
     ROIValidatorPtr roi_validator;
     QRect maxROI(int bin) const;
     void restart_worker(int bin, const QRect &roi, ASI_IMG_TYPE format);
     void update_worker_exposure_timeout();
+    void load_controls();
     ASI_IMG_TYPE format() { return worker.expired() ? ASI_IMG_END : worker.lock()->format(); }
     int bin() { return worker.expired() ? -1 : worker.lock()->bin(); }
     QRect roi() { return worker.expired() ? QRect{} : worker.lock()->roi(); }
@@ -94,9 +103,23 @@ ZWO_ASI_Imager::ZWO_ASI_Imager(const ASI_CAMERA_INFO &info, const ImageHandlerPt
     
     d->properties << Properties::Property{"ElecPerADU", info.ElecPerADU};
     d->properties << Properties::Property{"ASI SDK Version", ASI_SDK_VERSION};
-    d->properties << LiveStream << ROI << Temperature;
+    d->properties << LiveStream << StillPicture << ROI << Temperature;
     ASI_CHECK << ASIOpenCamera(info.CameraID) << "Open Camera";
     ASI_CHECK << ASIInitCamera(info.CameraID) << "Init Camera";
+    d->load_controls();
+    if(! d->trigger_modes.isEmpty())
+      d->properties << ExternalTrigger;
+    if(info.ST4Port)
+      d->properties << GuidePort;
+    if(d->temperature_control)
+      add_sensor(TemperatureSensor, 2s, [=]{ return d->temperature_control->reload().control().value.toDouble(); });
+    // Shown with the controls too: kept current there
+    if(d->cooler_power_control)
+      add_sensor("cooler_power", 10s, [=]{
+        auto control = d->cooler_power_control->reload().control();
+        emit changed(control);
+        return control.value.toDouble();
+      });
     connect(this, &Imager::exposure_changed, this, bind(&Private::update_worker_exposure_timeout, d.get()));
 }
 
@@ -110,14 +133,6 @@ void ZWO_ASI_Imager::destroy() {
     ASI_CHECK << ASICloseCamera(d->info.CameraID) << "Close Camera";
 }
 
-void ZWO_ASI_Imager::readTemperature() {
-    qDebug() << "Refreshing ASI_TEMPERATURE if found..";
-    if(d->temperature_control)
-        push_job_on_thread([=]{
-           emit temperature(d->temperature_control->reload().control().value.toDouble());
-        });
-}
-
 Imager::Properties ZWO_ASI_Imager::properties() const
 {
     return d->properties;
@@ -135,20 +150,49 @@ void ZWO_ASI_Imager::Private::update_worker_exposure_timeout()
 }
 
 
+void ZWO_ASI_Imager::Private::load_controls()
+{
+  // Capabilities never change for an open camera: query them once
+  int controls_number;
+  ASI_CHECK << ASIGetNumOfControls(info.CameraID, &controls_number) << "Get controls";
+  controls = ASIControl::vector(controls_number);
+  for(int control_index = 0; control_index < controls_number; control_index++) {
+    auto control = make_shared<ASIControl>(control_index, info.CameraID);
+    controls[control_index] = control;
+    if(control->caps.ControlType == ASI_TEMPERATURE)
+      temperature_control = control;
+    if(control->caps.ControlType == ASI_COOLER_POWER_PERC)
+      cooler_power_control = control;
+    if(control->caps.ControlType == ASI_BANDWIDTHOVERLOAD && control->caps.IsWritable)
+      bandwidth_control = control;
+  }
+  if(! info.IsTriggerCam)
+    return;
+  ASI_SUPPORTED_MODE supported;
+  ASI_CHECK << ASIGetCameraSupportMode(info.CameraID, &supported) << "Get camera supported modes";
+  for(auto mode: supported.SupportedCameraMode) {
+    if(mode == ASI_MODE_END)
+      break;
+    if(mode == ASI_MODE_TRIG_RISE_EDGE)
+      trigger_modes.push_back(ImagerThread::Trigger::RisingEdge);
+    if(mode == ASI_MODE_TRIG_FALL_EDGE)
+      trigger_modes.push_back(ImagerThread::Trigger::FallingEdge);
+  }
+}
+
 Imager::Controls ZWO_ASI_Imager::controls() const
 {
     Controls controls;
-    int controls_number;
-    ASI_CHECK << ASIGetNumOfControls(d->info.CameraID, &controls_number) << "Get controls";
-    d->controls = ASIControl::vector(controls_number);
-
-    for(int control_index = 0; control_index < controls_number; control_index++) {
-      auto control = make_shared<ASIControl>(control_index, d->info.CameraID);
-      d->controls[control_index] = control;
-      if(control->caps.ControlType == ASI_TEMPERATURE)
-        d->temperature_control = control;
-      else
-        controls.push_back(control->control());
+    for(auto control: d->controls) {
+      if(control == d->temperature_control)
+        continue;
+      // Values are kept current by set(); only the ones the SDK (or the bandwidth tuner) drives by itself need reading back
+      const bool tuned = control == d->bandwidth_control && d->auto_bandwidth;
+      if(control->is_auto || tuned)
+        control->reload();
+      auto camera_control = control->control();
+      camera_control.readonly |= tuned;
+      controls.push_back(camera_control);
     }
 
     static map<ASI_IMG_TYPE, QString> format_names {
@@ -174,6 +218,10 @@ Imager::Controls ZWO_ASI_Imager::controls() const
         bin.add_choice("%1x%1"_q % bin_value, bin_value);
     }
     controls.push_front(bin);
+    if(! d->trigger_modes.isEmpty())
+      controls.push_back(trigger_control(d->trigger_modes));
+    if(d->bandwidth_control)
+      controls.push_back(Control{AutoBandwidthControlID, "Auto bandwidth", Control::Bool}.set_value(d->auto_bandwidth));
     return controls;
 }
 
@@ -181,6 +229,8 @@ Imager::Controls ZWO_ASI_Imager::controls() const
 void ZWO_ASI_Imager::setControl(const Control& control)
 {
   LOG_F_SCOPE
+  if(set_trigger_control(control))
+    return;
   if(control.id == ImgTypeControlID) {
     d->restart_worker(d->bin(), d->roi(), control.get_value_enum<ASI_IMG_TYPE>());
     emit changed(control);
@@ -192,6 +242,11 @@ void ZWO_ASI_Imager::setControl(const Control& control)
     emit changed(control);
     return;
   }
+  if(control.id == AutoBandwidthControlID) {
+    d->set_auto_bandwidth(control.get_value<bool>());
+    emit changed(control);
+    return;
+  }
   auto camera_control_it = find_if(d->controls.begin(), d->controls.end(),
 			  [&](const ASIControlPtr &c){ return c->caps.ControlType == static_cast<ASI_CONTROL_TYPE>(control.id); });
   if(camera_control_it != d->controls.end()) {
@@ -201,11 +256,55 @@ void ZWO_ASI_Imager::setControl(const Control& control)
       camera_control->set(control.get_value<qlonglong>(), control.value_auto);
       qDebug() << "Changed control " << camera_control->control();
       emit changed(*camera_control);
-    }));
+    }, true));
   }
 }
 
-
+void ZWO_ASI_Imager::setControls(const Imager::Controls& controls)
+{
+  LOG_F_SCOPE
+  auto bin = d->bin();
+  auto format = d->format();
+  Controls worker_controls;
+  vector<pair<ASIControlPtr, Control>> camera_controls;
+  for(auto control: controls) {
+    if(set_trigger_control(control))
+      continue;
+    if(control.id == ImgTypeControlID) {
+      format = control.get_value_enum<ASI_IMG_TYPE>();
+      worker_controls.push_back(control);
+      continue;
+    }
+    if(control.id == BinControlID) {
+      bin = control.get_value<int>();
+      worker_controls.push_back(control);
+      continue;
+    }
+    if(control.id == AutoBandwidthControlID) {
+      d->set_auto_bandwidth(control.get_value<bool>());
+      worker_controls.push_back(control);
+      continue;
+    }
+    auto camera_control_it = find_if(d->controls.begin(), d->controls.end(),
+                            [&](const ASIControlPtr &c){ return c->caps.ControlType == static_cast<ASI_CONTROL_TYPE>(control.id); });
+    if(camera_control_it != d->controls.end())
+      camera_controls.push_back({*camera_control_it, control});
+  }
+  // Bin and format both restart the worker: do it only once, with their final values
+  if(bin != d->bin() || format != d->format())
+    d->restart_worker(bin, bin != d->bin() ? d->maxROI(bin) : d->roi(), format);
+  for(auto control: worker_controls)
+    emit changed(control);
+  if(camera_controls.empty())
+    return;
+  qDebug() << "Changing" << camera_controls.size() << "controls";
+  wait_for(push_job_on_thread([=]{
+    for(auto camera_control: camera_controls) {
+      camera_control.first->set(camera_control.second.get_value<qlonglong>(), camera_control.second.value_auto);
+      emit changed(*camera_control.first);
+    }
+  }, true));
+}
 
 
 void ZWO_ASI_Imager::Private::restart_worker(int bin, const QRect& roi, ASI_IMG_TYPE format)
@@ -213,10 +312,43 @@ void ZWO_ASI_Imager::Private::restart_worker(int bin, const QRect& roi, ASI_IMG_
   auto factory = [=] {
     auto worker = make_shared<ASIImagingWorker>(roi, bin, info, format);
     this->worker = worker;
+    if(auto_bandwidth)
+      tune_bandwidth(*worker);
     return worker;
   };
-  worker.reset();
-  q->restart(factory);
+  // Only ROI, bin and format change: the running worker just reissues them to the camera
+  q->reconfigure(roi, bin, format, factory);
+}
+
+void ZWO_ASI_Imager::Private::tune_bandwidth(ASIImagingWorker &worker)
+{
+  BandwidthTuner::Range range;
+  range.min = bandwidth_control->caps.MinValue;
+  range.max = bandwidth_control->caps.MaxValue;
+  range.step = (range.max - range.min) / 10;
+  worker.tune_bandwidth(range, [this](long) {
+    emit q->changed(bandwidth_control->reload());
+  });
+}
+
+void ZWO_ASI_Imager::Private::set_auto_bandwidth(bool enabled)
+{
+  if(! bandwidth_control || enabled == auto_bandwidth)
+    return;
+  auto_bandwidth = enabled;
+  if(worker.expired())
+    return;
+  // The tuned value stays when switching back to manual
+  q->wait_for(q->push_job_on_thread([=]{
+    auto worker = this->worker.lock();
+    if(! worker)
+      return;
+    if(enabled)
+      tune_bandwidth(*worker);
+    else
+      worker->stop_bandwidth_tuning();
+    emit q->changed(bandwidth_control->reload());
+  }, true));
 }
 
 
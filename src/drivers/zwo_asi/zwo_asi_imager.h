@@ -33,11 +33,11 @@ public:
     Imager::Controls controls() const override;
 public slots:
     void setControl(const Imager::Control& control) override;
+    void setControls(const Imager::Controls &controls) override;
     void startLive() override;
     void setROI(const QRect &) override;
     void clearROI() override;
     void destroy() override;
-    void readTemperature() override;
 private:
     DPTR
 };
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "autoexposure.h"
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "commons/exposurecontrol.h"
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+namespace {
+// Highlights level: the brightest 0.5% of the window, high enough for a small planet to fill it
+const double highlights_percentile = 99.5;
+const double tolerance = 0.05;
+const chrono::milliseconds min_interval{250};
+
+/// Level of the highlights percentile, 0 to 1 of the full scale, on the brightest channel
+double highlights(const FrameAnalysis::Counts &histogram) {
+  double level = 0;
+  for(const auto &counts: histogram) {
+    const double full_scale = counts.size() - 1;
+    uint64_t total = 0;
+    for(auto count: counts)
+      total += count;
+    const uint64_t above = static_cast<uint64_t>(total * (100 - highlights_percentile) / 100);
+    uint64_t seen = 0;
+    size_t value = counts.size();
+    while(value > 0 && seen <= above)
+      seen += counts[--value];
+    level = max(level, value / full_scale);
+  }
+  return level;
+}
+
+Imager::Control with_value(Imager::Control control, double value) {
+  const double min = control.range.min.toDouble(), max = control.range.max.toDouble(), step = control.range.step.toDouble();
+  if(step > 0)
+    value = min + round((value - min) / step) * step;
+  value = std::max(min, std::min(max, value));
+  const int type = control.value.userType();
+  control.value = value;
+  control.value.convert(type);
+  return control;
+}
+}
+
+DPTR_IMPL(AutoExposure) {
+  const Configuration &configuration;
+  AutoExposure *q;
+  QMutex mutex;
+  QPointer<Imager> imager;
+  QMetaObject::Connection changed_connection, adjust_connection;
+  bool has_exposure = false, has_gain = false;
+  Imager::Control exposure, gain;
+  ExposureControl control;
+  double control_target = -1;
+  /// Frames captured before this still show the settings before the latest change
+  Frame::Clock::time_point settled;
+  Metrics::Counter &adjustments_metric = Metrics::instance().counter("auto_exposure_adjustments_total", "Exposure and gain changes made by auto exposure");
+  void update(const Imager::Control &control);
+};
+
+AutoExposure::AutoExposure(const Configuration &configuration, QObject *parent) : QObject{parent}, dptr(configuration, this)
+{
+}
+
+AutoExposure::~AutoExposure()
+{
+}
+
+void AutoExposure::Private::update(const Imager::Control &control)
+{
+  if(control.is_exposure) {
+    exposure = control;
+    has_exposure = true;
+  } else if(control.name.compare("gain", Qt::CaseInsensitive) == 0) {
+    gain = control;
+    has_gain = true;
+  }
+}
+
+void AutoExposure::setImager(Imager *imager)
+{
+  // Drivers may wait on the capture thread for the controls: not while holding the lock the changed() handler needs
+  const auto controls = imager ? imager->controls_snapshot() : Imager::Controls{};
+  QMutexLocker lock{&d->mutex};
+  disconnect(d->changed_connection);
+  disconnect(d->adjust_connection);
+  d->imager = imager;
+  d->has_exposure = d->has_gain = false;
+  d->control.reset();
+  d->settled = {};
+  if(! imager)
+    return;
+  for(const auto &control: controls)
+    d->update(control);
+  d->changed_connection = connect(imager, &Imager::changed, this, [this](const Imager::Control &control) {
+    QMutexLocker lock{&d->mutex};
+    d->update(control);
+  }, Qt::DirectConnection);
+  d->adjust_connection = connect(this, &AutoExposure::adjust, imager, &Imager::setControl, Qt::QueuedConnection);
+}
+
+void AutoExposure::doHandle(FrameConstPtr frame)
+{
+  auto settings = d->configuration.snapshot();
+  if(! settings->auto_exposure) {
+    d->control.reset();
+    return;
+  }
+  {
+    QMutexLocker lock{&d->mutex};
+    if(! d->imager || ! d->has_exposure || d->exposure.readonly || d->exposure.value_auto || frame->captured() < d->settled)
+      return;
+  }
+  Tracing::Span span{"AutoExposure::handle", frame->sequence()};
+
+  auto &analysis = frame->analysis();
+  const cv::Rect window = analysis.centred_window(settings->auto_exposure_roi_size);
+  const double level = highlights(analysis.histogram(window, 2));
+
+  Imager::Controls changes;
+  {
+    QMutexLocker lock{&d->mutex};
+    if(! d->imager || ! d->has_exposure)
+      return;
+    if(settings->auto_exposure_target != d->control_target) {
+      d->control_target = settings->auto_exposure_target;
+      d->control = ExposureControl{d->control_target / 100, tolerance};
+    }
+    const double unit = d->exposure.duration_unit.count() > 0 ? d->exposure.duration_unit.count() : 1;
+    const bool drive_gain = d->has_gain && ! d->gain.readonly && ! d->gain.value_auto && settings->auto_exposure_gain_per_doubling > 0;
+    const ExposureControl::Limits limits{
+      d->exposure.range.min.toDouble() * unit,
+      min(d->exposure.range.max.toDouble() * unit, settings->auto_exposure_max_exposure / 1000.),
+      drive_gain ? d->gain.range.min.toDouble() : 0,
+      drive_gain ? d->gain.range.max.toDouble() : 0,
+      drive_gain ? settings->auto_exposure_gain_per_doubling : 0,
+    };
+    const ExposureControl::Point current{d->exposure.value.toDouble() * unit, drive_gain ? d->gain.value.toDouble() : 0};
+    const auto next = d->control.next(current, level, limits);
+
+    const auto exposure = with_value(d->exposure, next.exposure / unit);
+    if(exposure.value != d->exposure.value)
+      changes.push_back(d->exposure = exposure);
+    if(drive_gain) {
+      const auto gain = with_value(d->gain, next.gain);
+      if(gain.value != d->gain.value)
+        changes.push_back(d->gain = gain);
+    }
+    if(changes.isEmpty())
+      return;
+    const auto settle = chrono::duration_cast<Frame::Clock::duration>(chrono::duration<double>{3 * max(current.exposure, next.exposure)});
+    d->settled = Frame::Clock::now() + max<Frame::Clock::duration>(settle, min_interval);
+    qDebug() << "auto exposure: highlights at" << level << ", exposure" << current.exposure << "->" << next.exposure << "s, gain" << current.gain << "->" << next.gain;
+  }
+  d->adjustments_metric.add();
+  for(const auto &control: changes)
+    emit adjust(control);
+}
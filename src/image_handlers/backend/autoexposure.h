@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef AUTOEXPOSURE_H
+#define AUTOEXPOSURE_H
+
+#include <QObject>
+#include "image_handlers/imagehandler.h"
+#include "commons/configuration.h"
+#include "drivers/imager.h"
+#include "c++/dptr.h"
+
+FWD_PTR(AutoExposure)
+
+/**
+ * Closed loop auto exposure and gain, for small bright targets on a black sky, where the cameras' own auto modes do badly.
+ * Each frame's highlights level (a high percentile of a subsampled histogram of the window around the target centroid)
+ * goes through ExposureControl, and the resulting exposure and gain go to the imager through adjust().
+ * After a change, frames are ignored until the new settings show up in them: at least 3 exposures, and 250ms.
+ * The camera's own auto exposure, when on, is left alone. Settings come from the configuration snapshot of each frame.
+ */
+class AutoExposure : public QObject, public ImageHandler
+{
+  Q_OBJECT
+public:
+  AutoExposure(const Configuration &configuration, QObject *parent = nullptr);
+  ~AutoExposure();
+  /// Imager to drive, nullptr for none. Call from the thread the imager lives in
+  void setImager(Imager *imager);
+signals:
+  /// Queued to Imager::setControl, where drivers push it as an urgent job to the capture thread
+  void adjust(const Imager::Control &control);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // AUTOEXPOSURE_H
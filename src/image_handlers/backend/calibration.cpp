@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "calibration.h"
+#include <QDebug>
+#include <QDir>
+#include <functional>
+#include <map>
+#include <tuple>
+#include <valarray>
+#include <vector>
+#include <boost/endian/conversion.hpp>
+#include <opencv2/opencv.hpp>
+#include <CCfits/CCfits>
+#include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/hotpixelmap.h"
+#include "commons/pixel_kernels.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+// Rows per parallel stripe
+#define CALIBRATION_STRIPE_ROWS 32
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+
+bool is_bayer(Frame::ColorFormat color_format) {
+  return color_format != Frame::Mono && color_format != Frame::RGB && color_format != Frame::BGR;
+}
+
+/// Master image as read from disk: float values, on the 8 or 16 bit scale of the file
+struct MasterFile {
+  enum Kind { Dark, Flat, BadPixels };
+  Kind kind;
+  QString path;
+  cv::Mat image;
+  int bits;
+};
+
+/// Masters prepared for one frame shape, all with the frame size and channels
+struct Masters {
+  cv::Mat dark;  ///< CV_16U, on the frame scale
+  cv::Mat gain;  ///< CV_16U, fixed point (PixelKernels::calibration_gain_bits)
+  HotPixelMap bad_pixels;
+};
+typedef shared_ptr<const Masters> MastersPtr;
+
+cv::Mat read_fits(const QString &path, int &bits) {
+  CCfits::FITS fits{path.toStdString(), CCfits::Read, true};
+  auto &hdu = fits.pHDU();
+  if(hdu.axes() != 2)
+    return {};
+  valarray<float> data;
+  hdu.read(data);
+  // Rows in file order, as ImageFileWriter saves them
+  cv::Mat image(static_cast<int>(hdu.axis(1)), static_cast<int>(hdu.axis(0)), CV_32F);
+  copy(begin(data), end(data), image.begin<float>());
+  bits = hdu.bitpix() == BYTE_IMG ? 8 : 16;
+  return image;
+}
+
+cv::Mat read_image(const QString &path, int &bits) {
+  cv::Mat image = cv::imread(path.toStdString(), cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+  if(image.empty())
+    return {};
+  bits = image.depth() == CV_8U ? 8 : 16;
+  image.convertTo(image, CV_32F);
+  return image;
+}
+}
+
+DPTR_IMPL(Calibration) {
+  const Configuration &configuration;
+  ImageHandlerPtr next;
+  bool loaded = false;
+  QString directory;
+  vector<MasterFile> files;
+  /// width, height, channels, bpp, bayer
+  typedef tuple<int, int, int, int, bool> Shape;
+  map<Shape, MastersPtr> cache;
+  // Map learnt from the frames, for the shape and settings it was learnt with
+  HotPixelMap hot_pixels;
+  bool hot_pixels_learning = false;
+  Shape hot_pixels_shape;
+  int hot_pixels_frames = 0;
+  double hot_pixels_sigma = 0;
+  FramePoolPtr pool = make_shared<FramePool>();
+  Metrics::Histogram &calibration_metric = Metrics::instance().histogram("calibration_seconds", "Time spent calibrating a frame with darks and flats");
+  void load(const QString &directory);
+  void unload();
+  MastersPtr masters(const Shape &shape);
+  MastersPtr prepare(const Shape &shape) const;
+  /// The learnt map, if it is usable for frames of this shape; learning starts again on new shapes or settings
+  const HotPixelMap *learnt_hot_pixels(const Shape &shape, const Configuration::Snapshot &settings);
+};
+
+Calibration::Calibration(const Configuration &configuration, const ImageHandlerPtr &next) : dptr(configuration, next)
+{
+}
+
+Calibration::~Calibration()
+{
+}
+
+void Calibration::Private::unload()
+{
+  loaded = false;
+  directory.clear();
+  files.clear();
+  cache.clear();
+}
+
+void Calibration::Private::load(const QString &directory)
+{
+  unload();
+  loaded = true;
+  this->directory = directory;
+  if(directory.isEmpty())
+    return;
+  const QStringList filters{"*.fits", "*.fit", "*.fts", "*.tif", "*.tiff", "*.png"};
+  for(const auto &info: QDir{directory}.entryInfoList(filters, QDir::Files, QDir::Name)) {
+    const QString name = info.fileName().toLower();
+    MasterFile file{MasterFile::Dark, info.absoluteFilePath(), {}, 16};
+    if(name.startsWith("dark"))
+      file.kind = MasterFile::Dark;
+    else if(name.startsWith("flat"))
+      file.kind = MasterFile::Flat;
+    else if(name.startsWith("badpixels"))
+      file.kind = MasterFile::BadPixels;
+    else
+      continue;
+    try {
+      file.image = info.suffix().toLower().startsWith("f") ? read_fits(file.path, file.bits) : read_image(file.path, file.bits);
+    } catch(const CCfits::FitsException &e) {
+      qWarning() << "calibration: error reading" << file.path << QString::fromStdString(e.message());
+    } catch(const cv::Exception &e) {
+      qWarning() << "calibration: error reading" << file.path << e.what();
+    }
+    if(file.image.empty()) {
+      qWarning() << "calibration: skipping" << file.path;
+      continue;
+    }
+    qDebug() << "calibration: master" << file.path << file.image.cols << "x" << file.image.rows << ", channels:" << file.image.channels();
+    files.push_back(file);
+  }
+}
+
+MastersPtr Calibration::Private::masters(const Shape &shape)
+{
+  auto found = cache.find(shape);
+  if(found == cache.end())
+    found = cache.emplace(shape, prepare(shape)).first;
+  return found->second;
+}
+
+MastersPtr Calibration::Private::prepare(const Shape &shape) const
+{
+  int width, height, channels, bpp;
+  bool bayer;
+  tie(width, height, channels, bpp, bayer) = shape;
+  // A master per kind: the first one of the frame size, in file name order
+  auto find = [&](MasterFile::Kind kind) -> const MasterFile * {
+    for(const auto &file: files)
+      if(file.kind == kind && file.image.cols == width && file.image.rows == height && file.image.channels() == channels)
+        return &file;
+    return nullptr;
+  };
+  const MasterFile *dark = find(MasterFile::Dark), *flat = find(MasterFile::Flat), *bad_pixels = find(MasterFile::BadPixels);
+  if(! dark && ! flat && ! bad_pixels)
+    return {};
+
+  auto masters = make_shared<Masters>();
+  const int type = CV_16UC(channels);
+  const uint16_t unit_gain = 1 << PixelKernels::calibration_gain_bits;
+  if(dark) {
+    const double scale = bpp == dark->bits ? 1. : (bpp > dark->bits ? 256. : 1./256.);
+    dark->image.convertTo(masters->dark, type, scale);
+  } else {
+    masters->dark = cv::Mat::zeros(height, width, type);
+  }
+
+  masters->gain = cv::Mat(height, width, type, cv::Scalar::all(unit_gain));
+  if(flat) {
+    // Means per colour: each Bayer position and channel on its own
+    const int stride = bayer ? 2 : 1;
+    const auto colour = [&](int x, int y, int channel) { return ((y % stride) * stride + x % stride) * channels + channel; };
+    vector<double> sums(stride * stride * channels), counts(stride * stride * channels);
+    for(int y = 0; y < height; y++) {
+      const float *row = flat->image.ptr<float>(y);
+      for(int x = 0; x < width; x++)
+        for(int channel = 0; channel < channels; channel++) {
+          if(row[x * channels + channel] > 0) {
+            sums[colour(x, y, channel)] += row[x * channels + channel];
+            counts[colour(x, y, channel)]++;
+          }
+        }
+    }
+    for(int y = 0; y < height; y++) {
+      const float *row = flat->image.ptr<float>(y);
+      uint16_t *gain = masters->gain.ptr<uint16_t>(y);
+      for(int x = 0; x < width; x++)
+        for(int channel = 0; channel < channels; channel++) {
+          const float value = row[x * channels + channel];
+          const double mean = sums[colour(x, y, channel)] / max(1., counts[colour(x, y, channel)]);
+          if(value > 0)
+            gain[x * channels + channel] = cv::saturate_cast<uint16_t>(mean / value * unit_gain);
+        }
+    }
+  }
+
+  if(bad_pixels)
+    masters->bad_pixels.set(bad_pixels->image);
+  qDebug() << "calibration: masters ready for" << width << "x" << height << (dark ? dark->path : QString{"no dark"}) << (flat ? flat->path : QString{"no flat"})
+           << masters->bad_pixels.pixels().size() << "bad pixels";
+  return masters;
+}
+
+const HotPixelMap *Calibration::Private::learnt_hot_pixels(const Shape &shape, const Configuration::Snapshot &settings)
+{
+  if(! settings.hot_pixels) {
+    hot_pixels_learning = false;
+    return nullptr;
+  }
+  if(! hot_pixels_learning || shape != hot_pixels_shape || settings.hot_pixels_frames != hot_pixels_frames || settings.hot_pixels_sigma != hot_pixels_sigma) {
+    hot_pixels_learning = true;
+    hot_pixels_shape = shape;
+    hot_pixels_frames = settings.hot_pixels_frames;
+    hot_pixels_sigma = settings.hot_pixels_sigma;
+    hot_pixels.learn(hot_pixels_frames, hot_pixels_sigma);
+    qDebug() << "hot pixels: learning a new map over" << hot_pixels_frames << "frames";
+  }
+  return &hot_pixels;
+}
+
+void Calibration::doHandle(FrameConstPtr frame)
+{
+  d->next->handle(calibrate(frame));
+}
+
+void Calibration::doHandleBatch(const FrameBatch &batch)
+{
+  FrameBatch calibrated;
+  calibrated.reserve(batch.size());
+  for(const auto &frame: batch)
+    calibrated.push_back(calibrate(frame));
+  d->next->handle_batch(calibrated);
+}
+
+FrameConstPtr Calibration::calibrate(const FrameConstPtr &frame)
+{
+  auto settings = d->configuration.snapshot();
+  if(! settings->calibration) {
+    if(d->loaded)
+      d->unload();
+  } else if(! d->loaded || settings->calibration_directory != d->directory) {
+    d->load(settings->calibration_directory);
+  }
+  const cv::Mat &image = frame->mat();
+  const Private::Shape shape{image.cols, image.rows, image.channels(), frame->bpp(), is_bayer(frame->colorFormat())};
+  auto masters = settings->calibration ? d->masters(shape) : MastersPtr{};
+  auto hot_pixels = d->learnt_hot_pixels(shape, *settings);
+  if(! masters && ! hot_pixels)
+    return frame;
+
+  FramePtr calibrated;
+  {
+    Tracing::Span span{"Calibration::handle", frame->sequence()};
+    Metrics::Timer timer{d->calibration_metric};
+    const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+    const bool wide = image.depth() == CV_16U;
+    const bool swap = wide && (native_little_endian ? frame->byteOrder() == Frame::BigEndian : frame->byteOrder() == Frame::LittleEndian);
+    const Frame::ByteOrder byte_order = wide ? (native_little_endian ? Frame::LittleEndian : Frame::BigEndian) : frame->byteOrder();
+    calibrated = d->pool->acquire(frame->bpp(), frame->colorFormat(), frame->resolution(), byte_order);
+    cv::Mat &output = calibrated->mat();
+    const size_t values = static_cast<size_t>(image.cols) * image.channels();
+    if(! masters) {
+      // Hot pixels only: a plain copy in native byte order to correct
+      if(swap) {
+        for(int y = 0; y < image.rows; y++)
+          PixelKernels::swap16(image.ptr<uint16_t>(y), output.ptr<uint16_t>(y), values);
+      } else {
+        image.copyTo(output);
+      }
+    } else {
+      const int stripes = (image.rows + CALIBRATION_STRIPE_ROWS - 1) / CALIBRATION_STRIPE_ROWS;
+      cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+        // 8 bit rows are widened to 16 bit for the kernel, and saturated back
+        vector<uint16_t> widened(wide ? 0 : values);
+        const int last = min(image.rows, (stripe + 1) * CALIBRATION_STRIPE_ROWS);
+        for(int y = stripe * CALIBRATION_STRIPE_ROWS; y < last; y++) {
+          const uint16_t *dark = masters->dark.ptr<uint16_t>(y), *gain = masters->gain.ptr<uint16_t>(y);
+          if(wide) {
+            const uint16_t *source = image.ptr<uint16_t>(y);
+            uint16_t *destination = output.ptr<uint16_t>(y);
+            if(swap) {
+              PixelKernels::swap16(source, destination, values);
+              source = destination;
+            }
+            PixelKernels::calibrate16(source, dark, gain, destination, values);
+          } else {
+            const uint8_t *source = image.ptr<uint8_t>(y);
+            uint8_t *destination = output.ptr<uint8_t>(y);
+            copy(source, source + values, widened.begin());
+            PixelKernels::calibrate16(widened.data(), dark, gain, widened.data(), values);
+            for(size_t i = 0; i < values; i++)
+              destination[i] = static_cast<uint8_t>(min<uint16_t>(widened[i], 255));
+          }
+        }
+      }});
+    }
+    const int stride = is_bayer(frame->colorFormat()) ? 2 : 1;
+    if(masters)
+      masters->bad_pixels.correct(output, stride);
+    if(hot_pixels) {
+      if(hot_pixels->ready())
+        hot_pixels->correct(output, stride);
+      else if(d->hot_pixels.add(output, stride))
+        qDebug() << "hot pixels: map ready," << d->hot_pixels.pixels().size() << "pixels";
+    }
+    calibrated->copy_metadata(*frame);
+  }
+  return calibrated;
+}
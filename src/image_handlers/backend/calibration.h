@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "image_handlers/imagehandler.h"
+#include "commons/configuration.h"
+#include "c++/dptr.h"
+
+FWD_PTR(Calibration)
+
+/**
+ * Dark, flat and bad pixel calibration of every frame, before it reaches recording, display and the network.
+ * Masters are the FITS, TIFF or PNG images in calibration_directory whose names start with "dark", "flat" or "badpixels".
+ * Frames carry no ROI, binning or gain, so each master is used for frames of its own size: one set per ROI and binning,
+ * and one directory per gain and exposure. Masters are prepared once per frame shape and cached, so switching back and forth is free.
+ * Frames are then calibrated as (raw - dark) · mean(flat) / flat, the flat mean taken per Bayer colour, and bad pixels
+ * (non zero in the map) replaced by the mean of their good neighbours of the same colour.
+ * With hot_pixels on, a hot pixel map is also learnt from the next hot_pixels_frames frames (see HotPixelMap), and
+ * applied to the following ones; it's learnt again when the frame shape or the settings change.
+ * Frames without masters of their size or a hot pixel map, and all of them when both are off, go to the next handler unchanged.
+ */
+class Calibration : public ImageHandler
+{
+public:
+  Calibration(const Configuration &configuration, const ImageHandlerPtr &next);
+  ~Calibration();
+private:
+  void doHandle(FrameConstPtr frame) override;
+  void doHandleBatch(const FrameBatch &batch) override;
+  FrameConstPtr calibrate(const FrameConstPtr &frame);
+  DPTR
+};
+
+#endif // CALIBRATION_H
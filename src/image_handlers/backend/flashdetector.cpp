@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "flashdetector.h"
+#include <QDateTime>
+#include <QDebug>
+#include <cfloat>
+#include <functional>
+#include <numeric>
+#include <vector>
+#include <boost/endian/conversion.hpp>
+#include <opencv2/opencv.hpp>
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/pixel_kernels.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+// Rows per parallel stripe
+#define FLASH_DETECTOR_STRIPE_ROWS 32
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override {
+    for(int index = range.start; index < range.end; index++)
+      stripe(index);
+  }
+private:
+  function<void(int)> stripe;
+};
+}
+
+DPTR_IMPL(FlashDetector) {
+  const Configuration &configuration;
+  FlashDetector *q;
+  cv::Mat values, mean, variance, flags;
+  int background_frames = 0;
+  int consecutive_frames = 0;
+  bool detected = false;
+  Metrics::Histogram &detector_metric = Metrics::instance().histogram("flash_detector_seconds", "Time spent looking for impact flashes in a frame");
+  Metrics::Counter &events_metric = Metrics::instance().counter("flash_detector_events_total", "Impact flashes detected");
+  void reset();
+};
+
+FlashDetector::FlashDetector(const Configuration &configuration, QObject *parent) : QObject{parent}, dptr(configuration, this)
+{
+}
+
+FlashDetector::~FlashDetector()
+{
+}
+
+void FlashDetector::Private::reset()
+{
+  mean.release();
+  variance.release();
+  flags.release();
+  background_frames = 0;
+  consecutive_frames = 0;
+  detected = false;
+}
+
+void FlashDetector::doHandle(FrameConstPtr frame)
+{
+  auto settings = d->configuration.snapshot();
+  if(!settings->flash_detector) {
+    if(!d->mean.empty())
+      d->reset();
+    return;
+  }
+  Tracing::Span span{"FlashDetector::handle", frame->sequence()};
+  Metrics::Timer timer{d->detector_metric};
+
+  const cv::Rect window = frame->analysis().centred_window(settings->flash_detector_roi_size);
+  const cv::Mat image = frame->mat()(window);
+  if(d->mean.size() != image.size())
+    d->reset();
+  d->values.create(image.rows, image.cols, CV_32F);
+  if(d->mean.empty()) {
+    d->mean = cv::Mat::zeros(image.rows, image.cols, CV_32F);
+    d->variance = cv::Mat::zeros(image.rows, image.cols, CV_32F);
+    d->flags.create(image.rows, image.cols, CV_8U);
+  }
+
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  const bool swap = image.depth() == CV_16U && (native_little_endian ? frame->byteOrder() == Frame::BigEndian : frame->byteOrder() == Frame::LittleEndian);
+  // Noise floor of one 8 bit step, so that a perfectly flat background doesn't flag every bit of read noise
+  const float min_sigma = image.depth() == CV_16U ? 257.f : 1.f;
+  const int history = max(settings->flash_detector_history, 2);
+  // While the background builds up it's a plain average of all the frames so far, and nothing is flagged
+  const bool warming_up = d->background_frames < history;
+  const float alpha = warming_up ? 1.f / (d->background_frames + 1) : 1.f / history;
+  const float k2 = warming_up ? FLT_MAX : static_cast<float>(settings->flash_detector_sigma * settings->flash_detector_sigma);
+
+  const int stripes = (image.rows + FLASH_DETECTOR_STRIPE_ROWS - 1) / FLASH_DETECTOR_STRIPE_ROWS;
+  vector<size_t> stripe_flagged(stripes, 0);
+  cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int stripe) {
+    const int first = stripe * FLASH_DETECTOR_STRIPE_ROWS;
+    const int last = min(image.rows, first + FLASH_DETECTOR_STRIPE_ROWS);
+    cv::Mat source = image.rowRange(first, last);
+    if(swap)
+      source = PixelKernels::swap16(source);
+    if(source.channels() == 3)
+      cv::cvtColor(source, source, cv::COLOR_BGR2GRAY);
+    cv::Mat stripe_values = d->values.rowRange(first, last);
+    source.convertTo(stripe_values, CV_32F);
+    // Background and flags matrices are continuous: a stripe is a single run of pixels
+    stripe_flagged[stripe] = PixelKernels::background_update(stripe_values.ptr<float>(), d->mean.ptr<float>(first), d->variance.ptr<float>(first),
+                                                             d->flags.ptr<uint8_t>(first), static_cast<size_t>(last - first) * image.cols, k2, min_sigma * min_sigma, alpha);
+  }});
+  if(warming_up) {
+    ++d->background_frames;
+    return;
+  }
+
+  const size_t flagged = accumulate(stripe_flagged.begin(), stripe_flagged.end(), size_t{0});
+  if(flagged < static_cast<size_t>(max(settings->flash_detector_pixels, 1))) {
+    d->consecutive_frames = 0;
+    d->detected = false;
+    return;
+  }
+  ++d->consecutive_frames;
+  if(!d->detected && d->consecutive_frames >= settings->flash_detector_frames) {
+    d->detected = true;
+    const cv::Moments moments = cv::moments(d->flags, true);
+    const QVariantMap event{
+      {"type", "flash"},
+      {"x", window.x + moments.m10 / moments.m00},
+      {"y", window.y + moments.m01 / moments.m00},
+      {"pixels", static_cast<qulonglong>(flagged)},
+      {"frames", d->consecutive_frames},
+      {"sigma", settings->flash_detector_sigma},
+      {"sequence", frame->sequence()},
+      {"time", frame->created_utc().toString("yyyy-MM-dd'T'HH:mm:ss.zzz'Z'")},
+    };
+    qDebug() << "flash detected:" << event;
+    d->events_metric.add();
+    emit flash(event);
+  }
+  // Flagged pixels stay out of the background: a lasting change (a moon entering the window) would be flagged forever
+  if(d->consecutive_frames >= history)
+    d->reset();
+}
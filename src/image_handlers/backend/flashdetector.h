@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FLASHDETECTOR_H
+#define FLASHDETECTOR_H
+
+#include <QObject>
+#include <QVariantMap>
+#include "image_handlers/imagehandler.h"
+#include "commons/configuration.h"
+#include "c++/dptr.h"
+
+FWD_PTR(FlashDetector)
+
+/**
+ * Impact flash detector. It keeps a running background of every pixel around the planet centroid:
+ * a mean and a variance, exponentially weighted over flash_detector_history frames.
+ * Pixels more than flash_detector_sigma standard deviations above their background are flagged, and kept out of it.
+ * A flash is detected when at least flash_detector_pixels pixels stay flagged for flash_detector_frames frames in a row.
+ * flash() is emitted once per event (meant for SaveImages::trigger).
+ * Settings come from the configuration snapshot of each frame. The background restarts when the watched window changes size.
+ */
+class FlashDetector : public QObject, public ImageHandler
+{
+  Q_OBJECT
+public:
+  FlashDetector(const Configuration &configuration, QObject *parent = nullptr);
+  ~FlashDetector();
+signals:
+  /// Event keys: "type" ("flash"), "x", "y" (centroid of the flagged pixels, frame coordinates), "pixels", "frames", "sigma",
+  /// "sequence" and "time" (capture time of the frame completing the detection, ISO 8601 UTC)
+  void flash(const QVariantMap &event);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // FLASHDETECTOR_H
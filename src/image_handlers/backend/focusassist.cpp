@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "focusassist.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVariantMap>
+#include <algorithm>
+#include <deque>
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/frame_quality.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+namespace {
+// A minute at 60fps, enough for the plot and for an autofocus run to catch up after a slow move
+const size_t max_measurements = 4096;
+
+QString metric_name(Configuration::FocusMetric metric) {
+  switch(metric) {
+    case Configuration::FocusBrenner:
+      return "brenner";
+    case Configuration::FocusHFD:
+      return "hfd";
+    case Configuration::FocusFWHM:
+      return "fwhm";
+    default:
+      return "laplacian";
+  }
+}
+}
+
+DPTR_IMPL(FocusAssist) {
+  const Configuration &configuration;
+  mutable QMutex mutex;
+  deque<QVariantMap> measurements;
+  Metrics::Histogram &seconds_metric = Metrics::instance().histogram("focus_assist_seconds", "Time measuring the focus of a frame");
+};
+
+FocusAssist::FocusAssist(const Configuration &configuration) : dptr(configuration)
+{
+}
+
+FocusAssist::~FocusAssist()
+{
+}
+
+void FocusAssist::doHandle(FrameConstPtr frame)
+{
+  auto settings = d->configuration.snapshot();
+  if(! settings->focus_assist)
+    return;
+  Tracing::Span span{"FocusAssist::handle", frame->sequence()};
+  Metrics::Timer timer{d->seconds_metric};
+
+  // Shared with the other stages: lucky imaging scores the whole frame with the same gray image
+  auto &analysis = frame->analysis();
+  const cv::Rect window = analysis.centred_window(settings->focus_assist_roi_size);
+  const cv::Mat &gray = analysis.gray(window);
+  // Bayer frames are measured on 2x2 superpixels: star sizes and positions are scaled back to frame pixels
+  const double scale = static_cast<double>(window.width) / gray.cols;
+
+  QVariantMap measurement{
+    {"sequence", static_cast<qulonglong>(frame->sequence())},
+    {"time", frame->created_utc_msecs()},
+    {"metric", metric_name(settings->focus_assist_metric)},
+  };
+  switch(settings->focus_assist_metric) {
+    case Configuration::FocusBrenner:
+      measurement["value"] = analysis.brenner(window);
+      break;
+    case Configuration::FocusHFD:
+    case Configuration::FocusFWHM: {
+      const auto star = FrameQuality::star(gray);
+      if(star.hfd <= 0)
+        return;
+      measurement["value"] = (settings->focus_assist_metric == Configuration::FocusHFD ? star.hfd : star.fwhm) * scale;
+      measurement["x"] = window.x + star.centre.x * scale;
+      measurement["y"] = window.y + star.centre.y * scale;
+      break;
+    }
+    default:
+      measurement["value"] = analysis.sharpness(window);
+  }
+
+  QMutexLocker lock{&d->mutex};
+  // A restarted camera counts frames from the start again
+  if(! d->measurements.empty() && d->measurements.back().value("sequence").toULongLong() >= frame->sequence())
+    d->measurements.clear();
+  d->measurements.push_back(measurement);
+  if(d->measurements.size() > max_measurements)
+    d->measurements.pop_front();
+}
+
+QVariantList FocusAssist::measurements(quint64 after) const
+{
+  QMutexLocker lock{&d->mutex};
+  QVariantList result;
+  if(d->measurements.empty())
+    return result;
+  if(d->measurements.back().value("sequence").toULongLong() < after)
+    after = 0;
+  // Sequences only grow between restarts: the newest measurements are found from the back
+  auto first = d->measurements.end();
+  while(first != d->measurements.begin() && prev(first)->value("sequence").toULongLong() > after)
+    --first;
+  for(auto it = first; it != d->measurements.end(); ++it)
+    result.append(*it);
+  return result;
+}
+
+LocalFocusSource::LocalFocusSource(const FocusAssistPtr &focus_assist) : focus_assist{focus_assist}
+{
+}
+
+void LocalFocusSource::request(quint64 after)
+{
+  received(focus_assist->measurements(after));
+}
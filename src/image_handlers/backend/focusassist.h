@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FOCUSASSIST_H
+#define FOCUSASSIST_H
+
+#include <QVariantList>
+#include "image_handlers/imagehandler.h"
+#include "commons/configuration.h"
+#include "commons/focussource.h"
+#include "c++/dptr.h"
+
+FWD_PTR(FocusAssist)
+
+/**
+ * Focus metric of every frame, on the window around the target centroid: Laplacian variance or Brenner gradient
+ * for extended targets, half flux diameter or FWHM of the brightest star for stars (see FrameQuality).
+ * Meant to be fed the latest frame only, so that it never holds the capture back: frames coming in while it's
+ * still busy are skipped, and the plot simply gets fewer points.
+ * The latest measurements are kept for the focus panel and for network clients (i.e. scripted autofocus).
+ */
+class FocusAssist : public ImageHandler
+{
+public:
+  FocusAssist(const Configuration &configuration);
+  ~FocusAssist();
+  /// Measurements of the frames after sequence, oldest first (see FocusSource)
+  /** Everything kept is returned when the latest sequence is below after, that is when the camera was restarted. */
+  QVariantList measurements(quint64 after = 0) const;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+/// Focus measurements of this process
+class LocalFocusSource : public FocusSource
+{
+  Q_OBJECT
+public:
+  LocalFocusSource(const FocusAssistPtr &focus_assist);
+protected:
+  void request(quint64 after) override;
+private:
+  const FocusAssistPtr focus_assist;
+};
+
+#endif // FOCUSASSIST_H
@@ -17,32 +17,61 @@
  */
 
 #include "local_saveimages.h"
+#include <QDir>
 #include <QFile>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QPointer>
+#include <QTimer>
 #include <QDebug>
+#include <QDateTime>
 #include <functional>
 #include "commons/utils.h"
 
 #include <QtConcurrent/QtConcurrent>
 #include <functional>
 #include <cstring>
+#include <list>
 #include "commons/fps_counter.h"
 #include "commons/configuration.h"
-#include <boost/lockfree/spsc_queue.hpp>
+#include "commons/framesqueue.h"
+#include "commons/framesspool.h"
+#include "commons/compressedframesqueue.h"
+#include "commons/framepool.h"
 #include "commons/opencv_utils.h"
 #include <Qt/qt_strings_helper.h>
 #include "output_writers/filewriter.h"
+#include "output_writers/deferredfilewriter.h"
+#include "output_writers/multisinkwriter.h"
 #include "recordinginformation.h"
 #include <atomic>
 #include "c++/stlutils.h"
 #include "commons/messageslogger.h"
 #include "commons/elapsedtimer.h"
 #include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/framesequence.h"
+#include "commons/recordingperformance.h"
+#include "commons/recordingindex.h"
+#include "commons/tracking.h"
+#include "commons/frame_quality.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+#include "commons/pretriggerbuffer.h"
+#include "commons/updatescoalescer.h"
+#include "commons/executor.h"
+#include "commons/debayer.h"
+#include "commons/depthreduction.h"
+#include "commons/storageprobe.h"
+#include "commons/loadshedding.h"
 
 using namespace std;
 using namespace std::placeholders;
+using namespace std::chrono_literals;
 namespace {
 class WriterThreadWorker;
+struct RecordingParameters;
 };
 
 DPTR_IMPL(LocalSaveImages) {
@@ -50,17 +79,66 @@ DPTR_IMPL(LocalSaveImages) {
     WriterThreadWorker *worker;
     QThread *recordingThread;
     LocalSaveImages *q;
+    // Timelapse recordings slow the camera down to one shot per interval, until they finish
+    QPointer<Imager> paced_imager;
+    // Capture rate and frame size, for the storage probe: updated on the capture thread
+    atomic<qint64> frame_size{0};
+    atomic<double> capture_fps{0};
+    Frame::Clock::time_point last_captured{};
     FileWriter::Factory writerFactory();
+    struct SinkFormat {
+      QString name;
+      Configuration::SaveFormat format;
+      int every;
+      FileWriter::Factory factory;
+    };
+    /// The extra sinks in the settings that can be written; the others are skipped, with a warning
+    QList<SinkFormat> sink_formats() const;
+    void track_capture(const FrameConstPtr &frame);
+    void check_storage();
+    RecordingParameters parameters(Imager *imager, const Frame::Clock::time_point &start);
+    // Armed recordings (see armRecording): the camera they're for, and the re-arming after settings changes, coalesced
+    QPointer<Imager> armed_imager;
+    QTimer *arm_timer;
+    void arm();
+    void disarm();
+    // Recordings from before the index, or from other tools, indexed once per save directory
+    QString indexed_directory;
+    void index_directory();
 };
 
 
 namespace {
-typedef boost::lockfree::spsc_queue<FrameConstPtr> FramesQueue;
 typedef function< FileWriterPtr() > CreateFileWriter;
 
+// Same settings as the recording, except for the format, and a suffix telling its files apart from the main one
+class SinkConfiguration : public Configuration {
+public:
+  SinkConfiguration(const Configuration &main, Configuration::SaveFormat format, int every) : main{main}, format{format}, every{every} {}
+  SaveFormat save_format() const override { return format; }
+  QString save_file_suffix() const override {
+    const QString sink = "%1_every%2"_q % format_name(format).toLower() % every;
+    const auto suffix = main.save_file_suffix();
+    return suffix.isEmpty() ? sink : "%1%2%3"_q % suffix % save_file_prefix_suffix_separator() % sink;
+  }
+  static const QMap<Configuration::SaveFormat, QString> &format_names() {
+    static const QMap<Configuration::SaveFormat, QString> names{
+      {SER, "SER"}, {Video, "Video"}, {PNG, "PNG"}, {FITS, "FITS"}, {FFmpegVideo, "FFmpegVideo"}, {CompressedSER, "CompressedSER"}, {FITSCube, "FITSCube"}, {TIFF, "TIFF"},
+    };
+    return names;
+  }
+  static QString format_name(Configuration::SaveFormat format) { return format_names().value(format); }
+private:
+  // The main configuration may be another kind of Configuration (i.e. a secondary camera one): file names go through it
+  const Configuration &main;
+  const Configuration::SaveFormat format;
+  const int every;
+};
+
 struct RecordingParameters {
   CreateFileWriter fileWriterFactory;
-  RecordingInformationPtr recording_information;
+  // A pre-trigger recording opens a new file, with its own information, for every trigger
+  function< RecordingInformationPtr() > recording_information;
   Configuration::RecordingLimit limit_type;
   int64_t max_frames;
   std::chrono::duration<double> max_seconds;
@@ -70,11 +148,36 @@ struct RecordingParameters {
   bool timelapse;
   qlonglong timelapse_msecs;
   Configuration *configuration = nullptr;
-  RecordingInformation::Writer::ptr recording_information_writer(const FileWriterPtr &file_writer) const;
+  int crop_size = 0;
+  int keep_best_percent = 0;
+  int quality_window = 0;
+  bool pretrigger = false;
+  std::chrono::duration<double> pretrigger_seconds;
+  std::chrono::duration<double> posttrigger_seconds;
+  qlonglong pretrigger_max_memory_usage = 0;
+  bool timelapse_paced = false;
+  Frame::Clock::time_point start = Frame::Clock::time_point::min();
+  int cpu = -1;
+  bool debayer = false;
+  Configuration::DebayerAlgorithm debayer_algorithm = Configuration::DebayerEdgeAware;
+  Configuration::SaveDepth save_depth = Configuration::SaveDepthNative;
+  // Black and white points are only used with SaveDepth8BitFixed
+  DepthReduction::Mapping depth_mapping;
+  // Empty: no spool
+  QString spool_directory;
+  int spool_threshold = 100;
+  qlonglong spool_max_size = 0;
+  bool queue_compression = false;
+  int queue_compression_threshold = 50;
+  LoadShedding::Level load_shedding = LoadShedding::Normal;
+  bool index = false;
+  RecordingInformation::Writer::ptr recording_information_writer(const FileWriterPtr &file_writer, const shared_ptr<const cv::Mat> &thumbnail) const;
 };
 
-RecordingInformation::Writer::ptr RecordingParameters::recording_information_writer(const FileWriterPtr &file_writer) const {
+RecordingInformation::Writer::ptr RecordingParameters::recording_information_writer(const FileWriterPtr &file_writer, const shared_ptr<const cv::Mat> &thumbnail) const {
   QList<RecordingInformation::Writer::ptr> writers;
+  if(index)
+    writers.push_back(RecordingInformation::index(file_writer->filename(), thumbnail));
   if(write_txt_info)
     writers.push_back(RecordingInformation::txt(file_writer->filename()));
   if(write_json_info)
@@ -82,28 +185,90 @@ RecordingInformation::Writer::ptr RecordingParameters::recording_information_wri
   return RecordingInformation::composite(writers);
 }
 
+/// Files closed or discarded on the shared background pool, still pending: other users of the pool (i.e. camera scans) aren't waited for
+class BackgroundJobs {
+public:
+  void run(const function<void()> &job) {
+    QMutexLocker lock(&mutex);
+    pending.remove_if([](const QFuture<void> &future) { return future.isFinished(); });
+    pending.push_back(Executor::instance(Executor::BackgroundIO).run(job));
+  }
+  void waitForDone() {
+    QMutexLocker lock(&mutex);
+    for(auto &future: pending)
+      future.waitForFinished();
+    pending.clear();
+  }
+private:
+  QMutex mutex;
+  list<QFuture<void>> pending;
+};
+
+/// Published from the writer thread on every frame, signalled on the main thread at most once per tick
+struct RecordingCounters {
+  Published<long> saved_frames, dropped_frames;
+  Published<double> save_fps, mean_fps;
+};
+
 class Recording {
 public:
   typedef shared_ptr<Recording> ptr;
-    Recording(const RecordingParameters &parameters, LocalSaveImages *saveImagesObject);
+  /// Opens the file: the recording itself starts with begin(), possibly much later (see WriterThreadWorker::prepare)
+  Recording(const RecordingParameters &parameters, LocalSaveImages *saveImagesObject, RecordingCounters &counters, BackgroundJobs &background_jobs);
   ~Recording();
+  /// With the parameters of the actual start; the file and the frame selection set up by the constructor are kept
+  void begin(const RecordingParameters &parameters);
   RecordingParameters parameters() const { return _parameters; }
   void evaluate(FrameConstPtr frame);
   bool accepting_frames() const;
   void handle(FrameConstPtr frame);
+  /// No frames coming for now: frames batched by the writer go to disk
+  void flush() { file_writer->flush(); }
   inline void stop() { isRecording = false; }
   void setPaused(bool paused);
+  void add_events(const QVariantList &events) { this->events += events; }
+  void add_load_shedding(int level, double pressure);
+  /// Queue statistics, drops and peak, only known to the writer thread worker
+  RecordingPerformance &performance() { return _performance; }
+  /// Time spent in the file writer since the last call
+  chrono::duration<double> take_write_time();
+  uint64_t written_bytes() const { return _written_bytes; }
+  DeferredFileWriterPtr deferred_writer() const {
+    auto sinks = dynamic_pointer_cast<MultiSinkWriter>(file_writer);
+    return dynamic_pointer_cast<DeferredFileWriter>(sinks ? sinks->primary() : file_writer);
+  }
 private:
-  const RecordingParameters _parameters;
+  RecordingParameters _parameters;
+  // Null until begin()
+  RecordingInformationPtr recording_information;
   LocalSaveImages *saveImagesObject;
+  RecordingCounters &counters;
+  BackgroundJobs &background_jobs;
   atomic_bool isRecording;
   atomic_bool isPaused;
-  fps_counter savefps, meanfps;
+  unique_ptr<fps_counter> savefps, meanfps;
   FileWriterPtr file_writer;
   ElapsedTimer elapsed;
   size_t frames = 0;
+  uint64_t _written_bytes = 0;
   FrameConstPtr reference;
   QDateTime timelapse_last_shot;
+  unique_ptr<FrameQuality::Selector> selector;
+  // Set up on the first 16 bit frame, and kept for the whole recording
+  unique_ptr<DepthReduction> depth_reduction;
+  size_t scored_frames = 0;
+  QVariantList scores;
+  QVariantList events;
+  QVariantList load_shedding;
+  chrono::duration<double> write_time{0};
+  FrameSequence captured_sequence;
+  FrameSequence driver_sequence;
+  RecordingPerformance _performance;
+  // Made from the first frame saved while the file closes, for the recordings index
+  shared_ptr<cv::Mat> thumbnail = make_shared<cv::Mat>();
+  Metrics::Histogram &write_metric = Metrics::instance().histogram("recording_write_seconds", "Time spent writing a frame to the recording file");
+  Metrics::Counter &frames_metric = Metrics::instance().counter("recording_frames_total", "Frames written to recording files");
+  Metrics::Counter &bytes_metric = Metrics::instance().counter("recording_bytes_total", "Frame bytes written to recording files");
 };
 
 class WriterThreadWorker : public QObject {
@@ -112,16 +277,74 @@ public:
   WriterThreadWorker ( LocalSaveImages *saveImages, QObject* parent = 0 );
   virtual ~WriterThreadWorker();
   void stop();
+  void trigger(const QVariantMap &event);
+  /// The whole batch under a single lock
+  void queue(const FrameBatch &batch);
 public slots:
   virtual void queue(FrameConstPtr frame);
-  void start(const RecordingParameters &recording, qlonglong max_memory_usage);
+  void start(const RecordingParameters &recording, qlonglong max_memory_usage, int overflow_policy, int block_msecs);
+  /// Armed recording: the queue set up and the file open, start() then only has to begin it. Nothing happens while recording, or when already armed
+  void prepare(const RecordingParameters &recording, qlonglong max_memory_usage, int overflow_policy, int block_msecs);
+  void disarm();
   void setPaused(bool paused);
+public:
+  /// An armed recording is waiting for start()
+  bool ready() const { return _ready; }
+  /// Called right before start() is queued, when ready: frames are queued from now on, instead of once start() runs
+  void accept_frames() { accepting = true; }
+  /// The recordings closed so far, done closing
+  void wait_closed() { background_jobs.waitForDone(); }
 private:
-  unique_ptr<FramesQueue> framesQueue;
+  // Before the recordings: closing one queues its job
+  BackgroundJobs background_jobs;
+  unique_ptr<Recording> prepared;
+  atomic_bool _ready{false};
+  atomic_bool accepting{false};
+  void setup_queue(const RecordingParameters &recording_parameters, qlonglong max_memory_usage, int overflow_policy);
+  FramesQueue framesQueue{0};
+  // Frames beyond spool_threshold bytes in memory go to the spool; held with queue_mutex by producers, so that they keep their order
+  QMutex queue_mutex;
+  FramesSpoolPtr spool;
+  size_t spool_threshold = 0;
+  quint64 spool_lost = 0;
+  // Likewise, frames beyond compression_threshold bytes in memory go to the compressed queue, and from there to the spool when it's full
+  CompressedFramesQueuePtr compressed;
+  size_t compression_threshold = 0;
+  quint64 compressed_lost = 0;
   LocalSaveImages *saveImages;
-  size_t max_memory_usage;
-  uint64_t dropped_frames;
+  RecordingCounters counters;
+  // Written by producers, and by the writer thread for frames lost in the spool or the compressed queue
+  atomic<uint64_t> dropped_frames{0};
   unique_ptr<Recording> recording;
+  // Queue drops before the current recording started, for its performance summary
+  quint64 dropped_before_recording = 0;
+  /// Hands the queue statistics over to the recording, and closes it
+  void end_recording();
+  atomic_bool armed{false};
+  atomic_bool triggered{false};
+  atomic<Frame::Clock::rep> triggered_at{0};
+  QMutex events_mutex;
+  QVariantList events;
+  QVariantList take_events();
+  /// With queue_mutex held
+  void enqueue(const FrameConstPtr &frame);
+  void record(const RecordingParameters &recording_parameters);
+  void record_pretrigger(const RecordingParameters &recording_parameters);
+  FramesSpoolPtr open_spool(const RecordingParameters &recording_parameters, qlonglong max_memory_usage) const;
+  CompressedFramesQueuePtr open_compressed_queue(const RecordingParameters &recording_parameters, qlonglong max_memory_usage) const;
+  FrameConstPtr next_frame();
+  void emit_queue_usage();
+  void emit_deferred_writes();
+  LoadShedding load_shedding;
+  LoadShedding::Level shed_level = LoadShedding::Normal;
+  /// Every half second or so while recording, elapsed since the last call
+  void shed_load(qint64 elapsed_msecs);
+  Metrics::Histogram &queue_wait_metric = Metrics::instance().histogram("recording_queue_wait_seconds", "Time from capture to the recording thread picking the frame up");
+  Metrics::Counter &dropped_metric = Metrics::instance().counter("recording_dropped_frames_total", "Frames dropped because the recording queue was full");
+  Metrics::Gauge &queue_bytes_metric = Metrics::instance().gauge("recording_queue_bytes", "Memory used by frames waiting to be recorded");
+  Metrics::Gauge &queue_frames_metric = Metrics::instance().gauge("recording_queue_frames", "Frames waiting to be recorded");
+  Metrics::Gauge &spool_bytes_metric = Metrics::instance().gauge("recording_spool_bytes", "Memory and disk used by frames waiting in the recording spool");
+  Metrics::Gauge &compressed_bytes_metric = Metrics::instance().gauge("recording_compressed_queue_bytes", "Memory used by frames waiting in the compressed recording queue");
 };
 
 
@@ -129,23 +352,36 @@ private:
 Q_DECLARE_METATYPE(RecordingParameters)
 
 
-Recording::Recording(const RecordingParameters &parameters, LocalSaveImages *saveImagesObject) :
+Recording::Recording(const RecordingParameters &parameters, LocalSaveImages *saveImagesObject, RecordingCounters &counters, BackgroundJobs &background_jobs) :
   _parameters{parameters},
   saveImagesObject{saveImagesObject},
+  counters(counters),
+  background_jobs(background_jobs),
             isRecording(true),
             isPaused(false),
-  savefps{[=](double fps){ emit saveImagesObject->saveFPS(fps);}, fps_counter::Elapsed},
-  meanfps{[=](double fps){ emit saveImagesObject->meanFPS(fps);}, fps_counter::Elapsed, 1000, true},
   file_writer{parameters.fileWriterFactory()}
 {
+  if(parameters.keep_best_percent > 0 && parameters.keep_best_percent < 100)
+    selector = make_unique<FrameQuality::Selector>(parameters.keep_best_percent, parameters.quality_window);
+  // The dither tile takes a while to build the first time: not on the first frame
+  if(parameters.save_depth != Configuration::SaveDepthNative && parameters.depth_mapping.dither)
+    DepthReduction::blue_noise();
+}
+
+void Recording::begin(const RecordingParameters &parameters) {
+  _parameters = parameters;
+  // Started, and with the camera controls, as of now rather than when the file was opened
+  recording_information = _parameters.recording_information();
+  recording_information->set_writer(_parameters.recording_information_writer(file_writer, thumbnail));
+  savefps = make_unique<fps_counter>([=](double fps){ this->counters.save_fps.publish(fps);}, fps_counter::Elapsed);
+  meanfps = make_unique<fps_counter>([=](double fps){ this->counters.mean_fps.publish(fps);}, fps_counter::Elapsed, 1000, true);
   elapsed.start();
-  _parameters.recording_information->set_writer(_parameters.recording_information_writer(file_writer));
   emit saveImagesObject->recording(file_writer->filename());
 }
 
 void Recording::setPaused(bool paused) {
   isPaused = paused;
-  if(_parameters.configuration->recording_pause_stops_timer()) {
+  if(_parameters.configuration->snapshot()->recording_pause_stops_timer) {
     if(paused)
       elapsed.pause();
     else
@@ -155,20 +391,59 @@ void Recording::setPaused(bool paused) {
 
 
 void Recording::handle(FrameConstPtr frame) {
-  file_writer->handle(frame);
-  ++savefps;
-  ++meanfps;
-  emit saveImagesObject->savedFrames(++frames);
+  Tracing::Span span{"Recording::handle", frame->sequence()};
+  // Planet-centred recording: only a window around the frame centroid is saved
+  if(_parameters.crop_size > 0)
+    frame = cropAroundCentroid(frame, _parameters.crop_size);
+  // Lucky imaging: dropped frames don't count towards the recording limits
+  if(selector) {
+    const double score = frame->analysis().sharpness();
+    ++scored_frames;
+    if(!selector->keep(score))
+      return;
+    scores.push_back(score);
+  }
+  // After cropping and selection: only the frames actually saved are interpolated
+  if(_parameters.debayer)
+    frame = Debayer::debayer(frame, static_cast<Debayer::Algorithm>(_parameters.debayer_algorithm));
+  if(_parameters.save_depth != Configuration::SaveDepthNative && frame->bpp() == 16) {
+    if(!depth_reduction)
+      depth_reduction = make_unique<DepthReduction>(_parameters.save_depth == Configuration::SaveDepth8BitHistogram ?
+        DepthReduction::from_frame(*frame, _parameters.depth_mapping.dither) : _parameters.depth_mapping);
+    frame = depth_reduction->reduce(frame);
+  }
+  if(frames == 0)
+    reference = frame;
+  {
+    Metrics::Timer timer{write_metric};
+    const auto write_begin = chrono::steady_clock::now();
+    file_writer->handle(frame);
+    const auto write_end = chrono::steady_clock::now();
+    write_time += write_end - write_begin;
+    _performance.written(write_end, write_end - write_begin);
+  }
+  frames_metric.add();
+  bytes_metric.add(frame->size());
+  _written_bytes += frame->size();
+  ++*savefps;
+  ++*meanfps;
+  counters.saved_frames.publish(++frames);
 }
 
 void Recording::evaluate(FrameConstPtr frame) {
+  // Still in the pipeline when the recording started
+  if(frame->captured() < _parameters.start)
+    return;
+  const auto missing = captured_sequence.next(frame->sequence());
+  _performance.captured(frame->captured(), 1 + missing);
+  _performance.add_drops(RecordingPerformance::Capture, missing);
+  _performance.add_drops(RecordingPerformance::SDK, driver_sequence.next(frame->metadata().driver_sequence));
   if(isPaused)
     return;
-  if(frames == 0) {
-    reference = frame;
-  }
   if(parameters().timelapse) {
-    if(frames == 0 || (timelapse_last_shot.msecsTo(frame->created_utc()) >= parameters().timelapse_msecs )) {
+    // Paced cameras shoot once per interval, give or take the exposure jitter: only frames still streaming in before pacing starts are skipped
+    const qlonglong interval = parameters().timelapse_paced ? parameters().timelapse_msecs / 2 : parameters().timelapse_msecs;
+    if(frames == 0 || (timelapse_last_shot.msecsTo(frame->created_utc()) >= interval )) {
       timelapse_last_shot = frame->created_utc();
       handle(frame);
     }
@@ -177,6 +452,21 @@ void Recording::evaluate(FrameConstPtr frame) {
   }
 }
 
+void Recording::add_load_shedding(int level, double pressure) {
+  _performance.add_load_shedding_step();
+  load_shedding.push_back(QVariantMap{
+    {"time", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+    {"level", level},
+    {"pressure", pressure},
+  });
+}
+
+chrono::duration<double> Recording::take_write_time() {
+  chrono::duration<double> taken{0};
+  swap(taken, write_time);
+  return taken;
+}
+
 bool Recording::accepting_frames() const {
   return
         isRecording && (
@@ -188,9 +478,76 @@ bool Recording::accepting_frames() const {
 }
 
 Recording::~Recording() {
+  // Armed and never started: the file opened ahead of time goes away
+  if(! recording_information) {
+    auto discarded = make_shared<FileWriterPtr>(move(file_writer));
+    background_jobs.run([discarded] {
+      if(auto sinks = dynamic_pointer_cast<MultiSinkWriter>(*discarded))
+        sinks->close();
+      const auto files = (*discarded)->files();
+      discarded->reset();
+      for(const auto &file: files)
+        QFile::remove(file);
+    });
+    return;
+  }
   if(reference)
-    _parameters.recording_information->set_ended(frames, reference->resolution().width(), reference->resolution().height(), reference->bpp(), reference->channels());
+    recording_information->set_ended(frames, reference->resolution().width(), reference->resolution().height(), reference->bpp(), reference->channels());
+  // The extra sinks may still be writing: their files are known once they're done
+  const bool sinks = bool(dynamic_pointer_cast<MultiSinkWriter>(file_writer));
+  if(!sinks && file_writer->files() != QStringList{file_writer->filename()})
+    recording_information->set_files(file_writer->files());
+  if(captured_sequence.received() > 0)
+    recording_information->set_dropped_frames(captured_sequence.missing());
+  if(selector)
+    recording_information->set_quality(_parameters.keep_best_percent, _parameters.quality_window, scored_frames, scores);
+  if(!events.isEmpty())
+    recording_information->set_events(events);
+  if(!load_shedding.isEmpty())
+    recording_information->set_load_shedding(load_shedding);
+  if(depth_reduction) {
+    auto mapping = depth_reduction->mapping().asMap();
+    mapping["range"] = _parameters.save_depth == Configuration::SaveDepth8BitHistogram ? "histogram" : "fixed";
+    recording_information->set_depth_reduction(mapping);
+  }
     isRecording = false;
+  // Closing the file (i.e. SER trailers, deferred frames) and writing the recording information happen on a background thread, so the next recording can start right away
+  // Held through a shared pair, since the job is copied around: only the reset in the job releases them
+  auto closing = make_shared<pair<FileWriterPtr, RecordingInformationPtr>>(move(file_writer), move(recording_information));
+  auto performance = _performance.summary();
+  auto thumbnail = _parameters.index && reference ? this->thumbnail : shared_ptr<cv::Mat>{};
+  auto first_frame = reference;
+  background_jobs.run([closing, performance, thumbnail, first_frame]() mutable {
+    if(auto sinks = dynamic_pointer_cast<MultiSinkWriter>(closing->first)) {
+      sinks->close();
+      QVariantList stats;
+      quint64 dropped = 0;
+      for(const auto &sink: sinks->stats()) {
+        dropped += sink.dropped;
+        qDebug() << "Recording sink" << sink.name << ":" << sink.written << "frames written," << sink.dropped << "dropped," << sink.mean_fps << "fps";
+        stats.push_back(QVariantMap{
+          {"name", sink.name},
+          {"files", sink.files},
+          {"frames", sink.written},
+          {"dropped-frames", sink.dropped},
+          {"mean-fps", sink.mean_fps},
+          {"failed", sink.failed},
+        });
+      }
+      closing->second->set_files(sinks->files());
+      closing->second->set_sinks(stats);
+      // Only known once the sinks are done
+      auto drops = performance["drops"].toMap();
+      drops["writer"] = drops["writer"].toULongLong() + dropped;
+      performance["drops"] = drops;
+    }
+    closing->second->set_performance(performance);
+    if(thumbnail)
+      *thumbnail = RecordingIndex::thumbnail(*first_frame);
+    first_frame.reset();
+    closing->first.reset();
+    closing->second.reset();
+  });
 }
 
 WriterThreadWorker::WriterThreadWorker (LocalSaveImages *saveImages, QObject* parent )
@@ -201,6 +558,12 @@ WriterThreadWorker::WriterThreadWorker (LocalSaveImages *saveImages, QObject* pa
       metatypes_registered = true;
       qRegisterMetaType<RecordingParameters>();
     }
+    UpdatesCoalescer::instance().add(this, [this]{
+      counters.saved_frames.take([this](long frames) { emit this->saveImages->savedFrames(frames); });
+      counters.dropped_frames.take([this](long frames) { emit this->saveImages->droppedFrames(frames); });
+      counters.save_fps.take([this](double fps) { emit this->saveImages->saveFPS(fps); });
+      counters.mean_fps.take([this](double fps) { emit this->saveImages->meanFPS(fps); });
+    });
 }
 
 WriterThreadWorker::~WriterThreadWorker()
@@ -209,10 +572,29 @@ WriterThreadWorker::~WriterThreadWorker()
 
 void WriterThreadWorker::stop()
 {
+  armed = false;
   if(recording)
     recording->stop();
 }
 
+void WriterThreadWorker::trigger(const QVariantMap &event)
+{
+  if(!event.isEmpty() && (recording || armed)) {
+    QMutexLocker lock{&events_mutex};
+    events.append(event);
+  }
+  triggered_at = Frame::Clock::now().time_since_epoch().count();
+  triggered = true;
+}
+
+QVariantList WriterThreadWorker::take_events()
+{
+  QMutexLocker lock{&events_mutex};
+  QVariantList taken;
+  taken.swap(events);
+  return taken;
+}
+
 void WriterThreadWorker::setPaused(bool paused) {
   if(recording)
     recording->setPaused(paused);
@@ -221,47 +603,344 @@ void WriterThreadWorker::setPaused(bool paused) {
 
 void WriterThreadWorker::queue(FrameConstPtr frame)
 {
-  if(!recording)
+  if(!recording && !armed && !accepting)
     return;
-  if(!framesQueue  ) {
-    framesQueue.reset(new FramesQueue{ std::max(max_memory_usage/frame->size(), size_t{1})  } );
-    qDebug() << "allocated framesqueue with " << max_memory_usage << " bytes capacity (" << max_memory_usage/frame->size()<< " frames)";
-  }
+  Tracing::Span span{"WriterThreadWorker::queue", frame->sequence()};
+  QMutexLocker lock{&queue_mutex};
+  enqueue(frame);
+}
+
+void WriterThreadWorker::queue(const FrameBatch &batch)
+{
+  if((!recording && !armed && !accepting) || batch.empty())
+    return;
+  Tracing::Span span{"WriterThreadWorker::queue", batch.front()->sequence()};
+  QMutexLocker lock{&queue_mutex};
+  for(const auto &frame: batch)
+    enqueue(frame);
+}
 
-  if(!framesQueue->push(frame)) {
+void WriterThreadWorker::enqueue(const FrameConstPtr &frame)
+{
+  auto above = [&](size_t threshold) { return framesQueue.size() > 0 && framesQueue.bytes() + frame->size() > threshold; };
+  // Once frames go to a later tier, the next ones follow them until it's drained: the raw ones in memory are always the oldest, then the compressed ones, then the spooled ones
+  bool to_spool = spool && (! spool->empty() || (! compressed && above(spool_threshold)));
+  bool compressed_full = false;
+  if(! to_spool && compressed && (! compressed->empty() || above(compression_threshold))) {
+    if(compressed->push(frame))
+      return;
+    to_spool = bool(spool);
+    compressed_full = ! spool;
+  }
+  if(to_spool) {
+    if(spool->push(frame))
+      return;
+    qWarning() << "Frames spool full, dropping frame";
+  } else if(compressed_full) {
+    qWarning() << "Compressed frames queue full, dropping frame";
+  } else if(framesQueue.push(frame)) {
+    return;
+  } else {
     qWarning() << "Frames queue too high, dropping frame";
-    emit saveImages->droppedFrames(++dropped_frames);
   }
+  dropped_metric.add();
+  counters.dropped_frames.publish(++dropped_frames);
 }
 
-void WriterThreadWorker::start(const RecordingParameters & recording_parameters, qlonglong max_memory_usage)
+FramesSpoolPtr WriterThreadWorker::open_spool(const RecordingParameters &recording_parameters, qlonglong max_memory_usage) const
 {
-  this->max_memory_usage = static_cast<size_t>(max_memory_usage);
-  dropped_frames = 0;
-  framesQueue.reset();
+  if(recording_parameters.spool_directory.isEmpty())
+    return {};
+  const qlonglong threshold = max_memory_usage * recording_parameters.spool_threshold / 100;
+  // The memory budget left above the threshold is for the frames waiting to be spooled
+  auto spool = make_shared<FramesSpool>(recording_parameters.spool_directory, recording_parameters.spool_max_size, static_cast<size_t>(max(max_memory_usage - threshold, 1ll)));
+  if(! spool->isOpen()) {
+    MessagesLogger::instance()->queue(MessagesLogger::Warning, tr("Recording spool"), tr("Unable to create the recording spool in %1: %2. Frames will be dropped when the recording queue is full.")
+      % recording_parameters.spool_directory % spool->errorString());
+    return {};
+  }
+  return spool;
+}
+
+CompressedFramesQueuePtr WriterThreadWorker::open_compressed_queue(const RecordingParameters &recording_parameters, qlonglong max_memory_usage) const
+{
+  if(! recording_parameters.queue_compression)
+    return {};
+  if(! CompressedFramesQueue::available()) {
+    MessagesLogger::instance()->queue(MessagesLogger::Warning, tr("Recording queue"), tr("Compressed recording queue not available: PlanetaryImager was built without LZ4."));
+    return {};
+  }
+  const qlonglong threshold = max_memory_usage * recording_parameters.queue_compression_threshold / 100;
+  // The memory budget left above the threshold is for the compressed frames, and the ones waiting to be compressed
+  return make_shared<CompressedFramesQueue>(static_cast<size_t>(max(max_memory_usage - threshold, 1ll)), 0);
+}
+
+FrameConstPtr WriterThreadWorker::next_frame()
+{
+  // Compressed frames are newer than any in memory, and spooled frames newer than any compressed one
+  if(framesQueue.size() == 0) {
+    if(compressed && ! compressed->empty())
+      return compressed->pop(100ms);
+    if(spool && ! spool->empty())
+      return spool->pop(100ms);
+  }
+  // Bounded wait, so that stop requests and duration limits are still honoured when no frames arrive
+  return framesQueue.pop(100ms);
+}
+
+void WriterThreadWorker::setup_queue(const RecordingParameters &recording_parameters, qlonglong max_memory_usage, int overflow_policy)
+{
+  // Budget in bytes rather than frames, so that ROI or binning changes during a recording don't change the memory actually used
+  framesQueue.clear();
+  framesQueue.set_max_bytes(static_cast<size_t>(max_memory_usage));
+  // Last to give memory back to the process budget: everything else is reclaimed first
+  framesQueue.set_memory_account(MemoryGovernor::instance().account("recording queue", MemoryGovernor::Recording));
+  framesQueue.reset_peak_bytes();
+  auto spool = open_spool(recording_parameters, max_memory_usage);
+  auto compressed = open_compressed_queue(recording_parameters, max_memory_usage);
+  {
+    QMutexLocker lock{&queue_mutex};
+    this->spool = spool;
+    spool_threshold = static_cast<size_t>(max_memory_usage * recording_parameters.spool_threshold / 100);
+    spool_lost = 0;
+    this->compressed = compressed;
+    compression_threshold = static_cast<size_t>(max_memory_usage * recording_parameters.queue_compression_threshold / 100);
+    compressed_lost = 0;
+    dropped_frames = 0;
+  }
+  qDebug() << "recording queue: " << max_memory_usage << " bytes capacity, overflow policy: " << overflow_policy;
+}
+
+void WriterThreadWorker::prepare(const RecordingParameters &recording_parameters, qlonglong max_memory_usage, int overflow_policy, int block_msecs)
+{
+  if(prepared || recording || armed)
+    return;
+  framesQueue.set_overflow_policy(static_cast<FramesQueue::OverflowPolicy>(overflow_policy), chrono::milliseconds{block_msecs});
+  setup_queue(recording_parameters, max_memory_usage, overflow_policy);
+  try {
+    prepared = make_unique<Recording>(recording_parameters, saveImages, counters, background_jobs);
+  } catch(const std::exception &e) {
+    // Not armed: the recording will open its file when it starts, and report the error then
+    qWarning() << "Unable to arm the next recording:" << e.what();
+    return;
+  }
+  _ready = true;
+  qDebug() << "Next recording armed";
+}
+
+void WriterThreadWorker::disarm()
+{
+  _ready = false;
+  prepared.reset();
+}
+
+void WriterThreadWorker::start(const RecordingParameters & recording_parameters, qlonglong max_memory_usage, int overflow_policy, int block_msecs)
+{
+  framesQueue.set_overflow_policy(static_cast<FramesQueue::OverflowPolicy>(overflow_policy), chrono::milliseconds{block_msecs});
+  if(recording_parameters.pretrigger)
+    disarm();
+  // Armed: the queue is set up already, and may hold the first frames
+  if(! prepared)
+    setup_queue(recording_parameters, max_memory_usage, overflow_policy);
+  load_shedding = LoadShedding{LoadShedding::Settings{recording_parameters.load_shedding}};
+  shed_level = LoadShedding::Normal;
+  triggered = false;
+  take_events();
+  // The writer thread outlives recordings: placed again for each one, in case the settings changed
+  ThreadPlacement::apply("recording", ThreadPlacement::cpu(recording_parameters.cpu));
 
   GuLinux::Scope cleanup{[this]{
+    emit_queue_usage();
+    if(shed_level != LoadShedding::Normal) {
+      shed_level = LoadShedding::Normal;
+      emit saveImages->loadShedding(shed_level);
+    }
+    UpdatesCoalescer::instance().flushLater();
     emit saveImages->finished();
-    recording.reset();
+    end_recording();
+    prepared.reset();
+    _ready = false;
+    accepting = false;
+    QMutexLocker lock{&queue_mutex};
+    framesQueue.clear();
+    this->spool.reset();
+    if(this->compressed)
+      qDebug() << "Compressed recording queue: frames compressed to 1 /" << this->compressed->ratio();
+    this->compressed.reset();
   }};
   try {
-    recording = make_unique<Recording>(recording_parameters, saveImages);
-    while(recording->accepting_frames() ) {
-      FrameConstPtr frame;
-      if(framesQueue && framesQueue->pop(frame)) {
-          recording->evaluate(frame);
-      } else {
-        QThread::msleep(1);
-      }
-    }
+    if(recording_parameters.pretrigger)
+      record_pretrigger(recording_parameters);
+    else
+      record(recording_parameters);
   } catch(const SaveImages::Error &e) {
     qWarning() << e.what();
     MessagesLogger::instance()->queue(MessagesLogger::Error, tr("Capture error"), e.what());
+    armed = false;
     if(recording)
       recording->stop();
   }
 }
 
+void WriterThreadWorker::record(const RecordingParameters &recording_parameters)
+{
+  _ready = false;
+  recording = prepared ? move(prepared) : make_unique<Recording>(recording_parameters, saveImages, counters, background_jobs);
+  dropped_before_recording = dropped_frames;
+  recording->begin(recording_parameters);
+  QElapsedTimer usage_timer;
+  usage_timer.start();
+  uint64_t last_written_bytes = 0;
+  while(recording->accepting_frames() ) {
+    if(auto frame = next_frame()) {
+      queue_wait_metric.record(chrono::duration_cast<Metrics::Histogram::Duration>(Frame::Clock::now() - frame->captured()));
+      recording->evaluate(frame);
+    } else {
+      recording->flush();
+    }
+    // Outside pre-trigger mode triggers only log their events
+    if(triggered.exchange(false))
+      recording->add_events(take_events());
+    if(usage_timer.elapsed() >= 500) {
+      emit_queue_usage();
+      emit_deferred_writes();
+      shed_load(usage_timer.elapsed());
+      emit saveImages->writeThroughput((recording->written_bytes() - last_written_bytes) * 1000. / usage_timer.elapsed());
+      last_written_bytes = recording->written_bytes();
+      usage_timer.restart();
+    }
+  }
+  // Burst to RAM: the recording is over once the frames still in memory are on disk
+  if(auto deferred = recording->deferred_writer()) {
+    while(!deferred->wait_flushed(500ms))
+      emit_deferred_writes();
+    emit_deferred_writes();
+  }
+}
+
+void WriterThreadWorker::record_pretrigger(const RecordingParameters &recording_parameters)
+{
+  // Nothing reaches the disk until a trigger: frames wait in a ring bounded by time and memory
+  PreTriggerBuffer buffer{static_cast<size_t>(recording_parameters.pretrigger_max_memory_usage), recording_parameters.pretrigger_seconds};
+  buffer.set_memory_account(MemoryGovernor::instance().account("pre-trigger buffer", MemoryGovernor::PreTrigger));
+  const auto posttrigger = chrono::duration_cast<Frame::Clock::duration>(recording_parameters.posttrigger_seconds);
+  Frame::Clock::time_point record_until;
+  armed = true;
+  triggered = false;
+  emit saveImages->recording({});
+  QElapsedTimer usage_timer;
+  usage_timer.start();
+  uint64_t last_written_bytes = 0;
+  while(armed) {
+    auto frame = next_frame();
+    if(frame)
+      queue_wait_metric.record(chrono::duration_cast<Metrics::Histogram::Duration>(Frame::Clock::now() - frame->captured()));
+    if(triggered.exchange(false)) {
+      // A trigger during the saved window extends it
+      record_until = Frame::Clock::time_point{Frame::Clock::duration{triggered_at}} + posttrigger;
+      if(!recording) {
+        qDebug() << "pre-trigger recording: saving" << buffer.size() << "buffered frames," << buffer.span().count() << "seconds";
+        recording = make_unique<Recording>(recording_parameters, saveImages, counters, background_jobs);
+        recording->begin(recording_parameters);
+        dropped_before_recording = dropped_frames;
+        last_written_bytes = 0;
+        for(auto buffered: buffer.take())
+          recording->evaluate(buffered);
+      }
+      recording->add_events(take_events());
+    }
+    if(recording) {
+      const bool window_ended = frame ? frame->captured() > record_until : Frame::Clock::now() > record_until;
+      if(window_ended || !recording->accepting_frames()) {
+        // Closes the file and writes the recording information, then waits for the next trigger
+        end_recording();
+        emit saveImages->recording({});
+      } else if(frame) {
+        recording->evaluate(frame);
+        frame.reset();
+      } else {
+        recording->flush();
+      }
+    }
+    if(frame)
+      buffer.push(frame);
+    if(usage_timer.elapsed() >= 500) {
+      emit_queue_usage();
+      if(recording) {
+        emit_deferred_writes();
+        shed_load(usage_timer.elapsed());
+        emit saveImages->writeThroughput((recording->written_bytes() - last_written_bytes) * 1000. / usage_timer.elapsed());
+        last_written_bytes = recording->written_bytes();
+      } else {
+        emit saveImages->preTriggerBuffer(buffer.bytes(), buffer.span().count());
+      }
+      usage_timer.restart();
+    }
+  }
+}
+
+
+void WriterThreadWorker::end_recording()
+{
+  if(! recording)
+    return;
+  recording->performance().add_drops(RecordingPerformance::Queue, dropped_frames - dropped_before_recording);
+  recording->performance().set_queue_peak(framesQueue.peak_bytes(), framesQueue.max_bytes());
+  recording.reset();
+}
+
+void WriterThreadWorker::emit_deferred_writes()
+{
+  if(!recording)
+    return;
+  if(auto deferred = recording->deferred_writer())
+    emit saveImages->deferredWrites(deferred->pending_bytes(), deferred->available_bytes());
+}
+
+void WriterThreadWorker::emit_queue_usage()
+{
+  queue_bytes_metric.set(framesQueue.bytes());
+  queue_frames_metric.set(framesQueue.size());
+  emit saveImages->queueUsage(framesQueue.bytes(), framesQueue.peak_bytes(), framesQueue.max_bytes());
+  if(compressed) {
+    compressed_bytes_metric.set(compressed->bytes());
+    if(const quint64 lost = compressed->lost() - compressed_lost) {
+      compressed_lost += lost;
+      dropped_metric.add(lost);
+      counters.dropped_frames.publish(dropped_frames += lost);
+    }
+  }
+  if(! spool)
+    return;
+  spool_bytes_metric.set(spool->bytes());
+  // Frames accepted by the spool, then lost writing or reading it
+  if(const quint64 lost = spool->lost() - spool_lost) {
+    spool_lost += lost;
+    dropped_metric.add(lost);
+    counters.dropped_frames.publish(dropped_frames += lost);
+  }
+}
+
+void WriterThreadWorker::shed_load(qint64 elapsed_msecs)
+{
+  if(! recording || elapsed_msecs <= 0)
+    return;
+  const double busy = recording->take_write_time().count() * 1000. / elapsed_msecs;
+  // Frames going to the spool: memory is full already
+  // The compressed queue takes the memory budget left above its threshold
+  const size_t queued_bytes = framesQueue.bytes() + (compressed ? compressed->bytes() : 0);
+  double fill = framesQueue.max_bytes() > 0 ? min(1., static_cast<double>(queued_bytes) / framesQueue.max_bytes()) : 0;
+  if(spool && ! spool->empty())
+    fill = 1;
+  const double pressure = max(busy, fill);
+  const auto level = load_shedding.update(pressure, LoadShedding::Clock::now());
+  if(level == shed_level)
+    return;
+  qDebug() << "Recording writer pressure" << pressure << "(queue" << fill << ", writing" << busy << "of the time): load shedding" << shed_level << "->" << level;
+  shed_level = level;
+  recording->add_load_shedding(level, pressure);
+  emit saveImages->loadShedding(level);
+}
 
 FileWriter::Factory LocalSaveImages::Private::writerFactory()
 {
@@ -269,7 +948,134 @@ FileWriter::Factory LocalSaveImages::Private::writerFactory()
     return {};
   }
 
-  return FileWriter::factories()[configuration.save_format()];
+  return FileWriter::factory(configuration.save_format());
+}
+
+QList<LocalSaveImages::Private::SinkFormat> LocalSaveImages::Private::sink_formats() const
+{
+  QList<SinkFormat> sinks;
+  for(const auto &entry: configuration.recording_sinks()) {
+    const auto parts = entry.split(':');
+    const auto format = SinkConfiguration::format_names().key(parts.value(0), static_cast<Configuration::SaveFormat>(-1));
+    bool every_valid = parts.size() == 1;
+    const int every = parts.size() == 1 ? 1 : parts.value(1).toInt(&every_valid);
+    const bool duplicate = find_if(sinks.begin(), sinks.end(), [&](const SinkFormat &sink) { return sink.format == format && sink.every == every; }) != sinks.end();
+    if(parts.size() > 2 || format == static_cast<Configuration::SaveFormat>(-1) || !every_valid || every < 1 || duplicate) {
+      MessagesLogger::queue(MessagesLogger::Warning, LocalSaveImages::tr("Recording"),
+        LocalSaveImages::tr("Skipping the extra recording sink %1: expected a single FORMAT:EVERY entry for each sink, i.e. PNG:100") % entry);
+      continue;
+    }
+    auto factory = FileWriter::factory(format);
+    if(!factory) {
+      MessagesLogger::queue(MessagesLogger::Warning, LocalSaveImages::tr("Recording"), LocalSaveImages::tr("Skipping the extra recording sink %1: format not available") % entry);
+      continue;
+    }
+    sinks.push_back({entry, format, every, factory});
+  }
+  return sinks;
+}
+
+RecordingParameters LocalSaveImages::Private::parameters(Imager *imager, const Frame::Clock::time_point &start)
+{
+  const auto writerFactory = this->writerFactory();
+  // Captured by the writer factories and the recording information, on the writer thread
+  Configuration *settings = &configuration;
+  const bool pretrigger = configuration.recording_pretrigger();
+  const bool timelapse_paced = configuration.timelapse_mode() && configuration.timelapse_pause_capture() && ! pretrigger;
+  const CreateFileWriter directWriter = bind(writerFactory, imager->name(), &configuration);
+  CreateFileWriter createFileWriter = directWriter;
+  if(configuration.recording_burst_to_ram()) {
+    const size_t memory = static_cast<size_t>(configuration.burst_max_memory_usage());
+    const bool huge_pages = configuration.burst_huge_pages();
+    const bool lock_memory = configuration.burst_lock_memory();
+    createFileWriter = [=]{ return make_shared<DeferredFileWriter>(directWriter(), memory, huge_pages, lock_memory); };
+  }
+  const auto sinks = sink_formats();
+  if(!sinks.isEmpty()) {
+    // Split among the sinks: their queues hold frames shared with the recording, whose buffers stay in use until written
+    const size_t sink_bytes = static_cast<size_t>(configuration.recording_sinks_max_memory_usage()) / sinks.size();
+    const CreateFileWriter primaryWriter = createFileWriter;
+    const QString device = imager->name();
+    createFileWriter = [=]{
+      // The primary writer first: its file name is the recording one, the sinks follow it
+      auto primary = primaryWriter();
+      vector<MultiSinkWriter::Sink> writers;
+      for(const auto &sink: sinks) {
+        auto sink_configuration = make_shared<SinkConfiguration>(*settings, sink.format, sink.every);
+        try {
+          writers.push_back({sink.name, sink_configuration, sink.factory(device, sink_configuration.get()), sink.every, sink_bytes});
+        } catch(const std::exception &e) {
+          // Not worth losing the main file for
+          MessagesLogger::queue(MessagesLogger::Warning, LocalSaveImages::tr("Recording"),
+            LocalSaveImages::tr("Unable to start the extra recording sink %1: %2") % sink.name % QString::fromLocal8Bit(e.what()));
+        }
+      }
+      return make_shared<MultiSinkWriter>(primary, writers);
+    };
+  }
+  return {
+    createFileWriter,
+    [settings, imager]{ return make_shared<RecordingInformation>(*settings, imager); },
+    // The trigger windows decide how much a pre-trigger recording saves
+    pretrigger ? Configuration::Infinite : configuration.recording_limit_type(),
+    configuration.recording_frames_limit(),
+    chrono::duration<double>{configuration.recording_seconds_limit()},
+    configuration.save_info_file(),
+    configuration.save_json_info_file(),
+    0,
+    configuration.timelapse_mode(),
+    configuration.timelapse_msecs(),
+    &configuration,
+    configuration.recording_crop_size(),
+    configuration.recording_keep_best_percent(),
+    configuration.recording_quality_window(),
+    pretrigger,
+    chrono::duration<double>{configuration.pretrigger_seconds()},
+    chrono::duration<double>{configuration.posttrigger_seconds()},
+    configuration.pretrigger_max_memory_usage(),
+    timelapse_paced,
+    // The pre-trigger buffer is there to keep frames from before the start
+    pretrigger ? Frame::Clock::time_point::min() : start,
+    configuration.thread_placement().recording,
+    configuration.save_debayered(),
+    configuration.save_debayer_algorithm(),
+    configuration.save_depth(),
+    {static_cast<uint16_t>(qBound(0, configuration.save_depth_black(), 65535)), static_cast<uint16_t>(qBound(0, configuration.save_depth_white(), 65535)), configuration.save_depth_dither()},
+    configuration.recording_spool_directory(),
+    configuration.recording_spool_threshold(),
+    configuration.recording_spool_max_size(),
+    configuration.recording_queue_compression(),
+    configuration.recording_queue_compression_threshold(),
+    static_cast<LoadShedding::Level>(qBound(0, configuration.load_shedding(), static_cast<int>(LoadShedding::NoDisplay))),
+    configuration.recording_index(),
+  };
+}
+
+void LocalSaveImages::Private::arm()
+{
+  if(! armed_imager || ! configuration.recording_armed() || configuration.recording_pretrigger() || ! writerFactory())
+    return;
+  QMetaObject::invokeMethod(worker, "prepare", Q_ARG(RecordingParameters, parameters(armed_imager, Frame::Clock::time_point::min())), Q_ARG(qlonglong, configuration.max_memory_usage()),
+                            Q_ARG(int, static_cast<int>(configuration.recording_queue_overflow())), Q_ARG(int, configuration.recording_queue_block_msecs()));
+}
+
+void LocalSaveImages::Private::disarm()
+{
+  QMetaObject::invokeMethod(worker, "disarm");
+}
+
+void LocalSaveImages::Private::index_directory()
+{
+  const auto directory = configuration.save_directory();
+  if(! configuration.recording_index() || directory == indexed_directory || ! QDir{directory}.exists())
+    return;
+  indexed_directory = directory;
+  // A header and a frame for each recording not indexed yet: a while for a full directory, so away from the GUI and the writer
+  Executor::instance(Executor::BackgroundIO).run([directory]{
+    const int indexed = RecordingIndex{directory}.update();
+    if(indexed > 0)
+      qDebug() << "Indexed" << indexed << "recordings in" << directory;
+  });
 }
 
 LocalSaveImages::LocalSaveImages(Configuration &configuration, QObject* parent)
@@ -277,6 +1083,23 @@ LocalSaveImages::LocalSaveImages(Configuration &configuration, QObject* parent)
 {
   d->worker->moveToThread(d->recordingThread);
   d->recordingThread->start();
+  connect(this, &SaveImages::finished, this, [this]{
+    if(d->paced_imager)
+      d->paced_imager->setCaptureInterval(0ms);
+    d->paced_imager.clear();
+    d->arm();
+  });
+  d->arm_timer = new QTimer{this};
+  d->arm_timer->setSingleShot(true);
+  d->arm_timer->setInterval(1000);
+  connect(d->arm_timer, &QTimer::timeout, this, [this]{ d->arm(); });
+  // The armed file may not match the new settings anymore
+  connect(&configuration, &Configuration::settings_changed, this, [this]{
+    d->disarm();
+    d->arm_timer->start();
+    d->index_directory();
+  });
+  d->index_directory();
 }
 
 
@@ -285,43 +1108,113 @@ LocalSaveImages::~LocalSaveImages()
   endRecording();
   d->recordingThread->quit();
   d->recordingThread->wait();
+  // The last recording may still be closing, and its information writer refers to the configuration
+  d->worker->wait_closed();
 }
 
 
+void LocalSaveImages::Private::track_capture(const FrameConstPtr &frame)
+{
+  frame_size = frame->size();
+  if(last_captured != Frame::Clock::time_point{} && frame->captured() > last_captured) {
+    const double fps = 1. / chrono::duration<double>{frame->captured() - last_captured}.count();
+    // Smoothed over the last few dozen frames
+    capture_fps = capture_fps == 0 ? fps : capture_fps * 0.95 + fps * 0.05;
+  }
+  last_captured = frame->captured();
+}
+
+void LocalSaveImages::Private::check_storage()
+{
+  // Only from an earlier probe: starting a recording doesn't wait for the disk to be measured
+  const auto probe = StorageProbe::cached(configuration.save_directory(), frame_size);
+  const double required = StorageProbe::required_bytes_per_second(capture_fps, frame_size);
+  if(! probe.valid() || required <= 0 || StorageProbe::sustains(probe, required) || configuration.timelapse_mode())
+    return;
+  auto mb = [](double bytes) { return QString::number(bytes / 1024. / 1024., 'f', 1); };
+  MessagesLogger::queue(MessagesLogger::Warning, LocalSaveImages::tr("Recording"),
+    LocalSaveImages::tr("The save directory disk writes %1 MB/s, the camera sends %2 MB/s: frames will be dropped once the recording queue is full. "
+                        "Consider a smaller ROI, a lower bit depth, or burst to RAM.") % mb(probe.bytes_per_second) % mb(required));
+}
+
+void LocalSaveImages::probeStorage()
+{
+  const double capture_fps = d->capture_fps;
+  const qint64 frame_size = d->frame_size;
+  const auto directory = d->configuration.save_directory();
+  // Before the first frame, a block as large as a big frame
+  const qint64 block_size = frame_size > 0 ? frame_size : 8 * 1024 * 1024;
+  Executor::instance(Executor::BackgroundIO).run<StorageProbe::Result>([=] { return StorageProbe::run(directory, block_size); },
+    [this, directory, capture_fps, frame_size](const StorageProbe::Result &result) {
+      if(! result.valid())
+        MessagesLogger::queue(MessagesLogger::Error, tr("Disk speed"), tr("Unable to write to %1: %2") % directory % result.error);
+      emit storageProbed(result.valid() ? result.bytes_per_second : 0, result.latency_p99.count(), capture_fps, frame_size);
+    }, this);
+}
+
 void LocalSaveImages::doHandle(FrameConstPtr frame)
 {
+  d->track_capture(frame);
   d->worker->queue(frame);
 //   QtConcurrent::run(bind(&WriterThreadWorker::handle, d->worker, frame));
 }
 
+void LocalSaveImages::doHandleBatch(const FrameBatch &batch)
+{
+  for(const auto &frame: batch)
+    d->track_capture(frame);
+  d->worker->queue(batch);
+}
+
 void LocalSaveImages::startRecording(Imager *imager)
 {
-  auto writerFactory = d->writerFactory();
-  if(writerFactory) {
-    RecordingInformationPtr recording_information;
-
-    RecordingParameters recording{
-      bind(writerFactory, imager->name(), &d->configuration),
-      make_shared<RecordingInformation>(d->configuration, imager),
-      d->configuration.recording_limit_type(),
-      d->configuration.recording_frames_limit(),
-      chrono::duration<double>{d->configuration.recording_seconds_limit()},
-      d->configuration.save_info_file(),
-      d->configuration.save_json_info_file(),
-      0,
-      d->configuration.timelapse_mode(),
-      d->configuration.timelapse_msecs(),
-      &d->configuration
-    };
-    QMetaObject::invokeMethod(d->worker, "start", Q_ARG(RecordingParameters, recording), Q_ARG(qlonglong, d->configuration.max_memory_usage() ));
+  startRecording(imager, Frame::Clock::time_point::min());
+}
+
+void LocalSaveImages::startRecording(Imager *imager, const Frame::Clock::time_point &start)
+{
+  if(! d->writerFactory())
+    return;
+  d->check_storage();
+  const auto recording = d->parameters(imager, start);
+  if(recording.timelapse_paced) {
+    d->paced_imager = imager;
+    imager->setCaptureInterval(chrono::milliseconds{d->configuration.timelapse_msecs()});
+  }
+  d->arm_timer->stop();
+  if(imager != d->armed_imager)
+    d->disarm();
+  else if(d->worker->ready())
+    d->worker->accept_frames();
+  QMetaObject::invokeMethod(d->worker, "start", Q_ARG(RecordingParameters, recording), Q_ARG(qlonglong, d->configuration.max_memory_usage() ),
+                            Q_ARG(int, static_cast<int>(d->configuration.recording_queue_overflow())), Q_ARG(int, d->configuration.recording_queue_block_msecs()));
+  if(d->configuration.frame_buffers_huge_pages() || d->configuration.frame_buffers_lock_memory()) {
+    const auto backing = FramePool::backing_stats();
+    qDebug() << "Frame buffers:" << backing.huge_pages << "bytes on huge pages," << backing.transparent_huge_pages << "on transparent huge pages,"
+             << backing.regular << "on regular pages," << backing.locked << "locked";
   }
 }
 
+void LocalSaveImages::armRecording(Imager *imager)
+{
+  if(imager != d->armed_imager)
+    d->disarm();
+  d->armed_imager = imager;
+  if(imager)
+    connect(imager, &Imager::disconnected, this, [this]{ d->disarm(); });
+  d->arm();
+}
+
 void LocalSaveImages::setPaused(bool paused)
 {
   d->worker->setPaused(paused);
 }
 
+void LocalSaveImages::trigger(const QVariantMap &event)
+{
+  d->worker->trigger(event);
+}
+
 
 
 
@@ -23,6 +23,7 @@
 #include "c++/dptr.h"
 
 #include "commons/configuration.h"
+#include "commons/frame.h"
 class LocalSaveImages : public SaveImages
 {
   Q_OBJECT
@@ -31,11 +32,19 @@ public:
     ~LocalSaveImages();
 public slots:
   void startRecording(Imager *imager);
+  /// Only records the frames captured from start on (Frame::captured), i.e. to start several cameras at the same instant
+  void startRecording(Imager *imager, const Frame::Clock::time_point &start);
   void endRecording();
   void setPaused(bool paused);
+  void trigger(const QVariantMap &event = {});
+  /// Probes the save directory with frames of the last captured size; results are reused at the start of recordings on the same disk
+  void probeStorage() override;
+  /// Opens the next recording file and sets up the queue ahead of time, when Configuration::recording_armed is set; again after each recording, and after settings changes
+  void armRecording(Imager *imager) override;
 private:
 
   void doHandle(FrameConstPtr frame) override;
+  void doHandleBatch(const FrameBatch &batch) override;
 
   DPTR
 };
@@ -0,0 +1,247 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "multicamerasaveimages.h"
+#include "local_saveimages.h"
+#include "image_handlers/framesfanout.h"
+#include "drivers/driver.h"
+#include "drivers/imager.h"
+#include "commons/executor.h"
+#include "commons/frame.h"
+#include "commons/messageslogger.h"
+#include "Qt/qt_strings_helper.h"
+#include <QThread>
+#include <QRegularExpression>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+// Same settings as the main camera, except for the recording queue budget and the file names
+class SecondaryConfiguration : public Configuration {
+public:
+  SecondaryConfiguration(Configuration &main, const QString &camera_name) : main{main}, camera_name{camera_name} {
+    this->camera_name.replace(QRegularExpression{"[^A-Za-z0-9_-]+"}, "_");
+    // Another instance on the same settings: it doesn't see the changes made through the main one
+    QObject::connect(&main, &Configuration::settings_changed, this, &Configuration::reload);
+  }
+  long long max_memory_usage() const override { return main.secondary_max_memory_usage(); }
+  QString save_file_suffix() const override {
+    auto suffix = Configuration::save_file_suffix();
+    return suffix.isEmpty() ? camera_name : "%1%2%3"_q % suffix % save_file_prefix_suffix_separator() % camera_name;
+  }
+private:
+  Configuration &main;
+  QString camera_name;
+};
+
+struct Pipeline {
+  CameraPtr camera;
+  // Declared first: recordings refer to it until the save images are gone
+  unique_ptr<SecondaryConfiguration> configuration;
+  LocalSaveImagesPtr save_images;
+  shared_ptr<FramesFanout> handlers;
+  Imager *imager = nullptr;
+};
+typedef shared_ptr<Pipeline> PipelinePtr;
+}
+
+DPTR_IMPL(MultiCameraSaveImages) {
+  LocalSaveImagesPtr main;
+  Configuration &configuration;
+  MultiCameraSaveImages *q;
+  QList<PipelinePtr> pipelines;
+  int capture_cpu(int index) const;
+  void remove(Imager *imager);
+};
+
+MultiCameraSaveImages::MultiCameraSaveImages(const LocalSaveImagesPtr &main, Configuration &configuration, QObject *parent)
+  : SaveImages{parent}, dptr(main, configuration, this)
+{
+  connect(main.get(), &SaveImages::saveFPS, this, &SaveImages::saveFPS);
+  connect(main.get(), &SaveImages::meanFPS, this, &SaveImages::meanFPS);
+  connect(main.get(), &SaveImages::savedFrames, this, &SaveImages::savedFrames);
+  connect(main.get(), &SaveImages::droppedFrames, this, &SaveImages::droppedFrames);
+  connect(main.get(), &SaveImages::queueUsage, this, &SaveImages::queueUsage);
+  connect(main.get(), &SaveImages::writeThroughput, this, &SaveImages::writeThroughput);
+  connect(main.get(), &SaveImages::recording, this, &SaveImages::recording);
+  connect(main.get(), &SaveImages::preTriggerBuffer, this, &SaveImages::preTriggerBuffer);
+  connect(main.get(), &SaveImages::deferredWrites, this, &SaveImages::deferredWrites);
+  connect(main.get(), &SaveImages::storageProbed, this, &SaveImages::storageProbed);
+  connect(main.get(), &SaveImages::loadShedding, this, &SaveImages::loadShedding);
+  connect(main.get(), &SaveImages::finished, this, &SaveImages::finished);
+}
+
+MultiCameraSaveImages::~MultiCameraSaveImages()
+{
+  closeSecondaries();
+}
+
+QList<Imager *> MultiCameraSaveImages::secondaryImagers() const
+{
+  QList<Imager *> imagers;
+  for(auto pipeline: d->pipelines)
+    if(pipeline->imager)
+      imagers.push_back(pipeline->imager);
+  return imagers;
+}
+
+QStringList MultiCameraSaveImages::openSecondaries(const QStringList &names, const QList<CameraPtr> &cameras)
+{
+  QStringList missing;
+  for(auto name: names) {
+    auto camera = find_if(cameras.begin(), cameras.end(), [&](const CameraPtr &c) { return c->name().contains(name, Qt::CaseInsensitive); });
+    if(camera == cameras.end())
+      missing.push_back(name);
+    else
+      openSecondary(*camera);
+  }
+  return missing;
+}
+
+int MultiCameraSaveImages::Private::capture_cpu(int index) const
+{
+  const int main_cpu = configuration.thread_placement().capture;
+  if(main_cpu < 0)
+    return -1;
+  return (main_cpu + 1 + index) % max(1, QThread::idealThreadCount());
+}
+
+void MultiCameraSaveImages::openSecondary(const CameraPtr &camera)
+{
+  auto pipeline = make_shared<Pipeline>();
+  pipeline->camera = camera;
+  pipeline->configuration = make_unique<SecondaryConfiguration>(d->configuration, camera->name());
+  pipeline->save_images = make_shared<LocalSaveImages>(*pipeline->configuration);
+  pipeline->handlers = make_shared<FramesFanout>();
+  pipeline->handlers->add("recording", pipeline->save_images, FramesFanout::Inline);
+  d->pipelines.push_back(pipeline);
+  const bool realtime = d->configuration.capture_thread_realtime();
+  const int cpu = d->capture_cpu(d->pipelines.size() - 1);
+  const auto endianess = d->configuration.capture_endianess();
+  const bool native_byte_order = d->configuration.capture_native_byte_order();
+
+  auto openImager = [this, pipeline, realtime, cpu, endianess, native_byte_order] () -> Imager * {
+    try {
+      auto imager = pipeline->camera->imager(pipeline->handlers);
+      imager->setCaptureEndianess(endianess);
+      imager->setNativeByteOrder(native_byte_order);
+      imager->setCaptureThreadScheduling(realtime, cpu);
+      imager->moveToThread(this->thread());
+      imager->setParent(this);
+      return imager;
+    } catch(const std::exception &e) {
+      MessagesLogger::queue(MessagesLogger::Error, tr("Initialization Error"), tr("Error initializing imager %1: \n%2") % pipeline->camera->name() % e.what());
+      return nullptr;
+    }
+  };
+  auto onImagerOpened = [this, pipeline](Imager *imager) {
+    if(! imager) {
+      d->pipelines.removeAll(pipeline);
+      return;
+    }
+    // The imager keeps its handlers until it's deleted, and their recordings refer to the pipeline configuration
+    connect(imager, &QObject::destroyed, [pipeline] {});
+    // Closed while opening
+    if(! d->pipelines.contains(pipeline)) {
+      imager->destroy();
+      imager->deleteLater();
+      return;
+    }
+    pipeline->imager = imager;
+    connect(imager, &Imager::disconnected, this, [this, imager] { d->remove(imager); });
+    imager->startLive();
+    emit secondaryCamerasChanged();
+  };
+  Executor::instance(Executor::BackgroundIO).run<Imager *>(openImager, onImagerOpened, this);
+}
+
+void MultiCameraSaveImages::closeSecondary(Imager *imager)
+{
+  if(! imager)
+    return;
+  imager->destroy();
+  d->remove(imager);
+}
+
+void MultiCameraSaveImages::Private::remove(Imager *imager)
+{
+  auto pipeline = find_if(pipelines.begin(), pipelines.end(), [imager](const PipelinePtr &p) { return p->imager == imager; });
+  if(pipeline == pipelines.end())
+    return;
+  (*pipeline)->save_images->endRecording();
+  pipelines.erase(pipeline);
+  imager->deleteLater();
+  emit q->secondaryCamerasChanged();
+}
+
+void MultiCameraSaveImages::closeSecondaries()
+{
+  for(auto imager: secondaryImagers())
+    closeSecondary(imager);
+  // Still opening: dropped when they're ready
+  d->pipelines.clear();
+}
+
+void MultiCameraSaveImages::startRecording(Imager *imager)
+{
+  // One instant for all the cameras, whatever each pipeline still has queued
+  const auto start = Frame::Clock::now();
+  d->main->startRecording(imager, start);
+  for(auto pipeline: d->pipelines)
+    if(pipeline->imager)
+      pipeline->save_images->startRecording(pipeline->imager, start);
+}
+
+void MultiCameraSaveImages::endRecording()
+{
+  d->main->endRecording();
+  for(auto pipeline: d->pipelines)
+    pipeline->save_images->endRecording();
+}
+
+void MultiCameraSaveImages::setPaused(bool paused)
+{
+  d->main->setPaused(paused);
+  for(auto pipeline: d->pipelines)
+    pipeline->save_images->setPaused(paused);
+}
+
+void MultiCameraSaveImages::trigger(const QVariantMap &event)
+{
+  d->main->trigger(event);
+  for(auto pipeline: d->pipelines)
+    pipeline->save_images->trigger(event);
+}
+
+void MultiCameraSaveImages::probeStorage()
+{
+  d->main->probeStorage();
+}
+
+void MultiCameraSaveImages::armRecording(Imager *imager)
+{
+  d->main->armRecording(imager);
+}
+
+void MultiCameraSaveImages::doHandle(FrameConstPtr frame)
+{
+  // The main camera frames, if it's used as a handler instead of the main save images
+  d->main->handle(frame);
+}
@@ -0,0 +1,72 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTICAMERASAVEIMAGES_H
+#define MULTICAMERASAVEIMAGES_H
+
+#include "image_handlers/saveimages.h"
+#include "c++/dptr.h"
+#include "commons/configuration.h"
+#include "commons/fwd.h"
+
+FWD_PTR(LocalSaveImages)
+FWD_PTR(Camera)
+FWD_PTR(MultiCameraSaveImages)
+
+/**
+ * Recordings of the main camera together with the cameras opened alongside it (i.e. a guide or luminance camera next to the colour one).
+ * Every secondary camera has a pipeline of its own: imager and capture thread, handlers, recording queue and writer,
+ * so that a slow disk or a busy camera doesn't hold back the others.
+ * Secondary capture threads are pinned to the CPUs after the main capture one (Configuration::thread_placement), when that is set.
+ * Their recording queues are bounded by secondary_max_memory_usage each, and their files get the camera name in the suffix.
+ *
+ * Starting, pausing, triggering and stopping apply to all the cameras; recordings all start from the same instant of the
+ * frames monotonic clock (Frame::captured), skipping the frames captured before it.
+ * Signals are the main recording ones. Slots are meant for the main thread.
+ */
+class MultiCameraSaveImages : public SaveImages
+{
+  Q_OBJECT
+public:
+  MultiCameraSaveImages(const LocalSaveImagesPtr &main, Configuration &configuration, QObject *parent = nullptr);
+  ~MultiCameraSaveImages();
+  QList<Imager *> secondaryImagers() const;
+  /// Opens the cameras whose name contains one of names; returns the names that didn't match any of them
+  QStringList openSecondaries(const QStringList &names, const QList<CameraPtr> &cameras);
+public slots:
+  /// Opens camera in the background, then starts its live capture
+  void openSecondary(const CameraPtr &camera);
+  void closeSecondary(Imager *imager);
+  void closeSecondaries();
+  void startRecording(Imager *imager) override;
+  void endRecording() override;
+  void setPaused(bool paused) override;
+  void trigger(const QVariantMap &event = {}) override;
+  /// The main camera disk
+  void probeStorage() override;
+  /// The main camera recording only
+  void armRecording(Imager *imager) override;
+signals:
+  void secondaryCamerasChanged();
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // MULTICAMERASAVEIMAGES_H
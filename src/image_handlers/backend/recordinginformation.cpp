@@ -24,6 +24,8 @@
 #include <QJsonDocument>
 #include "commons/configuration.h"
 #include <QFile>
+#include <QFileInfo>
+#include "commons/recordingindex.h"
 #include "Qt/qt_strings_helper.h"
 
 using namespace std;
@@ -41,7 +43,7 @@ RecordingInformation::RecordingInformation(const Configuration &configuration, I
   d->properties["observer"] = configuration.observer();
   d->properties["telescope"] = configuration.telescope();
   QVariantList controls;
-  for(auto control: imager->controls()) {
+  for(auto control: imager->controls_snapshot()) {
     controls.push_back(control.asMap());
   }
   d->properties["controls"] = controls;
@@ -60,6 +62,55 @@ void RecordingInformation::set_ended(int total_frames, int width, int height, ui
   d->properties["mean-fps"] = static_cast<double>(total_frames) / static_cast<double>(elapsed);
 }
 
+void RecordingInformation::set_files(const QStringList& files)
+{
+  QVariantList list;
+  for(auto file: files)
+    list.push_back(file);
+  d->properties["files"] = list;
+}
+
+void RecordingInformation::set_dropped_frames(quint64 dropped_frames)
+{
+  d->properties["dropped-frames"] = dropped_frames;
+}
+
+void RecordingInformation::set_events(const QVariantList &events)
+{
+  d->properties["events"] = events;
+}
+
+void RecordingInformation::set_load_shedding(const QVariantList &changes)
+{
+  d->properties["load-shedding"] = changes;
+}
+
+void RecordingInformation::set_sinks(const QVariantList &sinks)
+{
+  d->properties["sinks"] = sinks;
+}
+
+void RecordingInformation::set_depth_reduction(const QVariantMap &mapping)
+{
+  d->properties["depth-reduction"] = mapping;
+}
+
+void RecordingInformation::set_performance(const QVariantMap &performance)
+{
+  d->properties["performance"] = performance;
+}
+
+void RecordingInformation::set_quality(int keep_best_percent, int window, int scored_frames, const QVariantList &scores)
+{
+  d->properties["quality"] = QVariantMap{
+    {"metric", "laplacian-variance"},
+    {"keep-best-percent", keep_best_percent},
+    {"window", window},
+    {"scored-frames", scored_frames},
+    {"scores", scores},
+  };
+}
+
 void RecordingInformation::set_writer(const Writer::ptr& writer)
 {
   d->writer = writer;
@@ -91,6 +142,15 @@ namespace {
     const QString file_base_name;
   };
   
+  class IndexRecordingInformationWriter : public RecordingInformation::Writer {
+  public:
+    IndexRecordingInformationWriter(const QString &file, const shared_ptr<const cv::Mat> &thumbnail);
+    virtual void write(const QVariantMap &information);
+  private:
+    const QString file;
+    const shared_ptr<const cv::Mat> thumbnail;
+  };
+  
   class CompositeRecordingInformationWriter : public RecordingInformation::Writer {
   public:
     CompositeRecordingInformationWriter(const QList<ptr> &writers);
@@ -156,6 +216,15 @@ void TXTRecordingInformationWriter::write(const QVariantMap &information) {
 }
 
 
+IndexRecordingInformationWriter::IndexRecordingInformationWriter(const QString &file, const shared_ptr<const cv::Mat> &thumbnail) : file{file}, thumbnail{thumbnail} {
+}
+
+void IndexRecordingInformationWriter::write(const QVariantMap &information) {
+  const QFileInfo info{file};
+  RecordingIndex{info.absolutePath()}.add(info.fileName(), information, thumbnail ? *thumbnail : cv::Mat{});
+}
+
+
 CompositeRecordingInformationWriter::CompositeRecordingInformationWriter(const QList<ptr> &writers) : writers{writers} {
 }
 
@@ -176,6 +245,11 @@ RecordingInformation::Writer::ptr RecordingInformation::txt(const QString& file_
   return make_shared<TXTRecordingInformationWriter>(file_base_name);
 }
 
+RecordingInformation::Writer::ptr RecordingInformation::index(const QString &file, const shared_ptr<const cv::Mat> &thumbnail)
+{
+  return make_shared<IndexRecordingInformationWriter>(file, thumbnail);
+}
+
 RecordingInformation::Writer::ptr RecordingInformation::composite(const QList<RecordingInformation::Writer::ptr> &writers)
 {
   return make_shared<CompositeRecordingInformationWriter>(writers);
@@ -28,6 +28,7 @@
 
 
 FWD(Imager)
+namespace cv { class Mat; }
 FWD_PTR(RecordingInformation)
 
 class RecordingInformation
@@ -42,8 +43,25 @@ public:
   ~RecordingInformation();
   void set_writer(const Writer::ptr &writer);
   void set_ended(int total_frames, int width, int height, uint8_t bpp, uint8_t channels);
+  void set_files(const QStringList &files);
+  /// Lucky imaging summary: selection settings, and the sharpness score of each saved frame
+  void set_quality(int keep_best_percent, int window, int scored_frames, const QVariantList &scores);
+  /// Frames captured during the recording that never reached the file writer, from gaps in frame sequence numbers
+  void set_dropped_frames(quint64 dropped_frames);
+  /// Events logged with the triggers of the recording, for instance detected impact flashes
+  void set_events(const QVariantList &events);
+  /// Load shedding steps taken while the writer fell behind (see LoadShedding): when, to which level, and under which pressure
+  void set_load_shedding(const QVariantList &changes);
+  /// Extra files written from the same frames (see MultiSinkWriter): name, files, frames written and dropped, mean fps of each sink
+  void set_sinks(const QVariantList &sinks);
+  /// 16 bit frames saved as 8 bit ones (see DepthReduction): range source, black and white points, dither
+  void set_depth_reduction(const QVariantMap &mapping);
+  /// Pipeline health during the recording: rates, write latencies, drops by stage, queue peak (see RecordingPerformance::summary)
+  void set_performance(const QVariantMap &performance);
   static Writer::ptr json(const QString &file_base_name, Configuration &configuration);
   static Writer::ptr txt(const QString &file_base_name);
+  /// Adds the recording file to the index of its directory (see RecordingIndex), with thumbnail as it is when the information is written
+  static Writer::ptr index(const QString &file, const std::shared_ptr<const cv::Mat> &thumbnail);
   static Writer::ptr composite(const QList<Writer::ptr> &writers);
 private:
   DPTR
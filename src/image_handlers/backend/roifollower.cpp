@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "roifollower.h"
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/roifollow.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+namespace {
+// Longest wait for the first frame at the new origin: moves clamped at the sensor edge are then retried
+const chrono::seconds move_timeout{1};
+}
+
+DPTR_IMPL(ROIFollower) {
+  const Configuration &configuration;
+  QMutex mutex;
+  QPointer<Imager> imager;
+  QMetaObject::Connection shift_connection;
+  bool moving = false;
+  QPoint moved_from;
+  Frame::Clock::time_point move_deadline;
+  Metrics::Counter &moves_metric = Metrics::instance().counter("roi_follow_moves_total", "Hardware ROI moves following the target");
+};
+
+ROIFollower::ROIFollower(const Configuration &configuration, QObject *parent) : QObject{parent}, dptr(configuration)
+{
+}
+
+ROIFollower::~ROIFollower()
+{
+}
+
+void ROIFollower::setImager(Imager *imager)
+{
+  QMutexLocker lock{&d->mutex};
+  disconnect(d->shift_connection);
+  d->imager = imager;
+  d->moving = false;
+  if(imager)
+    d->shift_connection = connect(this, &ROIFollower::shift, imager, &Imager::shiftROI, Qt::QueuedConnection);
+}
+
+void ROIFollower::doHandle(FrameConstPtr frame)
+{
+  auto settings = d->configuration.snapshot();
+  const auto &metadata = frame->metadata();
+  // Drivers not reporting the ROI origin can't have it moved either
+  if(! settings->roi_follow || ! metadata.has_roi_offset())
+    return;
+  const QPoint origin{metadata.roi_x, metadata.roi_y};
+  {
+    QMutexLocker lock{&d->mutex};
+    if(! d->imager)
+      return;
+    // Still the origin the last move started from: the target is where it was before it
+    if(d->moving && origin == d->moved_from && Frame::Clock::now() < d->move_deadline)
+      return;
+    d->moving = false;
+  }
+  Tracing::Span span{"ROIFollower::handle", frame->sequence()};
+  const QPointF target = frame->analysis().centroid();
+  const QPoint move = ROIFollow{settings->roi_follow_margin / 100}.shift(target, frame->resolution());
+  if(move.isNull())
+    return;
+  {
+    QMutexLocker lock{&d->mutex};
+    if(! d->imager)
+      return;
+    d->moving = true;
+    d->moved_from = origin;
+    d->move_deadline = Frame::Clock::now() + move_timeout;
+  }
+  qDebug() << "ROI follow: target at" << target << "in" << frame->resolution() << ", moving ROI from" << origin << "by" << move;
+  d->moves_metric.add();
+  emit shift(move);
+}
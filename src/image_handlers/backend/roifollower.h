@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef ROIFOLLOWER_H
+#define ROIFOLLOWER_H
+
+#include <QObject>
+#include <QPoint>
+#include "image_handlers/imagehandler.h"
+#include "commons/configuration.h"
+#include "drivers/imager.h"
+#include "c++/dptr.h"
+
+FWD_PTR(ROIFollower)
+
+/**
+ * Hardware ROI following the target, for the frame rates a small ROI allows: the ROI moves on the sensor as the target drifts,
+ * instead of being sized for the drift. The target is the frame brightness centroid (as ImgTracker's centroid mode finds it);
+ * when it nears an edge (see ROIFollow), the move goes to the imager through shift(), with no capture restart.
+ * Each frame carries the ROI origin it was taken at in its metadata (saved with the recording, see SERWriter), for stacking to realign.
+ * After a move, frames still at the old origin are ignored, for at most a second. Settings come from the configuration snapshot of each frame.
+ */
+class ROIFollower : public QObject, public ImageHandler
+{
+  Q_OBJECT
+public:
+  ROIFollower(const Configuration &configuration, QObject *parent = nullptr);
+  ~ROIFollower();
+  /// Imager to drive, nullptr for none. Call from the thread the imager lives in
+  void setImager(Imager *imager);
+signals:
+  /// Queued to Imager::shiftROI, in frame pixels
+  void shift(const QPoint &shift);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // ROIFOLLOWER_H
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "image_handlers/backend/sharedmemoryframes.h"
+#include "commons/frame.h"
+#include "commons/framepool.h"
+#include "commons/metrics.h"
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <climits>
+#include <ctime>
+#endif
+
+using namespace std;
+
+namespace {
+  const int HEADER_SIZE = 64;
+  const int SLOT_HEADER_SIZE = 128;
+  const uint32_t VERSION = 2;
+  const uint32_t FLAG_STALE = 1;
+  const uint32_t SLOT_FLAG_DEVICE_TIMESTAMP = 1;
+  const size_t PAGE = 4096;
+  // Readers wait at most this long for a frame, so that they notice a stale or missing segment
+  const auto READER_WAIT = chrono::milliseconds{100};
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint64_t slot_size;
+    atomic<uint64_t> latest;
+    atomic<uint32_t> flags;
+    atomic<uint32_t> waiters;
+    atomic<uint32_t> published;
+  };
+  struct SlotHeader {
+    atomic<uint64_t> sequence;
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t channels;
+    uint8_t color_format;
+    uint8_t byte_order;
+    uint32_t flags;
+    double exposure;
+    int64_t created_utc;
+    uint64_t data_size;
+    int64_t captured;
+    int64_t device_timestamp;
+    uint64_t frame_sequence;
+    FrameMetadata metadata;
+  };
+  static_assert(sizeof(atomic<uint64_t>) == sizeof(uint64_t) && sizeof(atomic<uint32_t>) == sizeof(uint32_t), "shared memory layout needs plain atomics");
+  static_assert(sizeof(Header) <= HEADER_SIZE && sizeof(SlotHeader) <= SLOT_HEADER_SIZE, "shared memory headers too large");
+
+  // Process shared futex on the published counter: readers sleep on it instead of polling
+  void wake_readers(Header *header) {
+#ifdef Q_OS_LINUX
+    if(header->waiters.load(memory_order_seq_cst) > 0)
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->published), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    Q_UNUSED(header);
+#endif
+  }
+
+  void wait_published(Header *header, uint32_t seen) {
+#ifdef Q_OS_LINUX
+    header->waiters.fetch_add(1, memory_order_seq_cst);
+    if(header->published.load(memory_order_seq_cst) == seen) {
+      const timespec timeout{0, chrono::duration_cast<chrono::nanoseconds>(READER_WAIT).count()};
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->published), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+    }
+    header->waiters.fetch_sub(1, memory_order_seq_cst);
+#else
+    Q_UNUSED(header);
+    Q_UNUSED(seen);
+    this_thread::sleep_for(chrono::milliseconds{1});
+#endif
+  }
+}
+
+DPTR_IMPL(SharedMemoryFrames) {
+  const QString name;
+  const int slots;
+  uint8_t *memory = nullptr;
+  size_t size = 0;
+  size_t slot_size = 0;
+  uint64_t sequence = 0;
+  bool open(size_t data_size);
+  void close(bool stale);
+  Header *header() const { return reinterpret_cast<Header*>(memory); }
+};
+
+SharedMemoryFrames::SharedMemoryFrames(const QString& name, int slots) : dptr(name, max(slots, 2))
+{
+#ifndef Q_OS_UNIX
+  qWarning() << "Shared memory frames are only available on POSIX systems";
+#endif
+}
+
+SharedMemoryFrames::~SharedMemoryFrames()
+{
+  d->close(true);
+}
+
+bool SharedMemoryFrames::Private::open(size_t data_size)
+{
+#ifdef Q_OS_UNIX
+  slot_size = (SLOT_HEADER_SIZE + data_size + PAGE - 1) / PAGE * PAGE;
+  size = HEADER_SIZE + slot_size * slots;
+  const auto shm_name = name.toLocal8Bit();
+  shm_unlink(shm_name.constData());
+  int fd = shm_open(shm_name.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if(fd < 0) {
+    qWarning() << "Unable to create shared memory frames" << name << ":" << strerror(errno);
+    return false;
+  }
+  if(ftruncate(fd, size) != 0) {
+    qWarning() << "Unable to size shared memory frames" << name << ":" << strerror(errno);
+    ::close(fd);
+    shm_unlink(shm_name.constData());
+    return false;
+  }
+  auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(mapped == MAP_FAILED) {
+    qWarning() << "Unable to map shared memory frames" << name << ":" << strerror(errno);
+    shm_unlink(shm_name.constData());
+    return false;
+  }
+  memory = reinterpret_cast<uint8_t*>(mapped);
+  // ftruncate zero fills: all slots start empty
+  memcpy(header()->magic, "PIFRAMES", 8);
+  header()->version = VERSION;
+  header()->slots = slots;
+  header()->slot_size = slot_size;
+  header()->latest.store(0, memory_order_release);
+  qDebug() << "Publishing frames to shared memory" << name << ":" << slots << "slots of" << slot_size << "bytes";
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SharedMemoryFrames::Private::close(bool stale)
+{
+#ifdef Q_OS_UNIX
+  if(! memory)
+    return;
+  if(stale) {
+    header()->flags.fetch_or(FLAG_STALE, memory_order_release);
+    header()->published.fetch_add(1, memory_order_seq_cst);
+    wake_readers(header());
+  }
+  munmap(memory, size);
+  shm_unlink(name.toLocal8Bit().constData());
+  memory = nullptr;
+#endif
+}
+
+void SharedMemoryFrames::remove(const QString &name)
+{
+#ifdef Q_OS_UNIX
+  shm_unlink(name.toLocal8Bit().constData());
+#else
+  Q_UNUSED(name);
+#endif
+}
+
+void SharedMemoryFrames::doHandle(FrameConstPtr frame)
+{
+  const size_t data_size = frame->size();
+  if(! d->memory || SLOT_HEADER_SIZE + data_size > d->slot_size) {
+    d->close(true);
+    if(! d->open(data_size))
+      return;
+  }
+  const uint64_t sequence = ++d->sequence;
+  auto slot = reinterpret_cast<SlotHeader*>(d->memory + HEADER_SIZE + ((sequence - 1) % d->slots) * d->slot_size);
+  // Seqlock: readers seeing 0, or a different sequence after reading, discard what they read
+  slot->sequence.store(0, memory_order_release);
+  atomic_thread_fence(memory_order_release);
+  slot->width = frame->resolution().width();
+  slot->height = frame->resolution().height();
+  slot->bpp = frame->bpp();
+  slot->channels = frame->channels();
+  slot->color_format = frame->colorFormat();
+  slot->byte_order = frame->byteOrder();
+  slot->exposure = frame->exposure().count();
+  slot->created_utc = frame->created_utc().toMSecsSinceEpoch();
+  slot->data_size = data_size;
+  slot->flags = frame->has_device_timestamp() ? SLOT_FLAG_DEVICE_TIMESTAMP : 0;
+  slot->captured = chrono::duration_cast<chrono::nanoseconds>(frame->captured().time_since_epoch()).count();
+  slot->device_timestamp = frame->device_timestamp().count();
+  slot->frame_sequence = frame->sequence();
+  slot->metadata = frame->metadata();
+  const cv::Mat mat = frame->mat();
+  if(mat.isContinuous()) {
+    memcpy(reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE, mat.data, data_size);
+  } else {
+    cv::Mat destination(mat.rows, mat.cols, mat.type(), reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE);
+    mat.copyTo(destination);
+  }
+  slot->sequence.store(sequence, memory_order_release);
+  d->header()->latest.store(sequence, memory_order_release);
+  d->header()->published.fetch_add(1, memory_order_seq_cst);
+  wake_readers(d->header());
+}
+
+
+DPTR_IMPL(SharedMemoryFramesReader) {
+  const QString name;
+  const ImageHandlerPtr image_handler;
+  atomic_bool running{true};
+  FramePoolPtr pool = make_shared<FramePool>();
+  Metrics::Counter &missed_metric = Metrics::instance().counter("shared_memory_frames_missed_total", "Frames overwritten in a shared memory ring before its reader got them");
+  Metrics::Counter &read_metric = Metrics::instance().counter("shared_memory_frames_read_total", "Frames read from a shared memory ring");
+  uint8_t *memory = nullptr;
+  size_t size = 0;
+  thread reader;
+  bool open();
+  void close();
+  void run();
+  FramePtr read(uint64_t sequence);
+  Header *header() const { return reinterpret_cast<Header*>(memory); }
+};
+
+SharedMemoryFramesReader::SharedMemoryFramesReader(const QString &name, const ImageHandlerPtr &image_handler) : dptr(name, image_handler)
+{
+#ifdef Q_OS_UNIX
+  d->reader = thread{[this]{ d->run(); }};
+#else
+  qWarning() << "Shared memory frames are only available on POSIX systems";
+#endif
+}
+
+SharedMemoryFramesReader::~SharedMemoryFramesReader()
+{
+  d->running = false;
+  if(d->reader.joinable())
+    d->reader.join();
+  d->close();
+}
+
+bool SharedMemoryFramesReader::Private::open()
+{
+#ifdef Q_OS_UNIX
+  int fd = shm_open(name.toLocal8Bit().constData(), O_RDWR, 0);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  // Read-write: waiting readers register themselves in the header
+  auto mapped = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(mapped == MAP_FAILED)
+    return false;
+  memory = reinterpret_cast<uint8_t*>(mapped);
+  size = st.st_size;
+  if(memcmp(header()->magic, "PIFRAMES", 8) != 0 || header()->version != VERSION
+    || HEADER_SIZE + header()->slot_size * header()->slots > size || (header()->flags.load(memory_order_acquire) & FLAG_STALE)) {
+    close();
+    return false;
+  }
+  qDebug() << "Reading frames from shared memory" << name << ":" << header()->slots << "slots of" << header()->slot_size << "bytes";
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SharedMemoryFramesReader::Private::close()
+{
+#ifdef Q_OS_UNIX
+  if(! memory)
+    return;
+  munmap(memory, size);
+  memory = nullptr;
+#endif
+}
+
+void SharedMemoryFramesReader::Private::run()
+{
+  uint64_t last = 0;
+  while(running) {
+    if(! memory) {
+      if(! open()) {
+        this_thread::sleep_for(READER_WAIT);
+        continue;
+      }
+      // Start from what's being published now, not from the older frames still in the ring
+      last = header()->latest.load(memory_order_acquire);
+    }
+    const uint32_t seen = header()->published.load(memory_order_seq_cst);
+    if(header()->flags.load(memory_order_acquire) & FLAG_STALE) {
+      close();
+      continue;
+    }
+    const uint64_t latest = header()->latest.load(memory_order_acquire);
+    if(latest == last) {
+      wait_published(header(), seen);
+      continue;
+    }
+    // Too far behind: jump to the oldest frame still in the ring
+    uint64_t next = last + 1;
+    if(latest - last > header()->slots) {
+      missed_metric.add(latest - header()->slots - last);
+      next = latest - header()->slots + 1;
+    }
+    for(; next <= latest && running; next++) {
+      auto frame = read(next);
+      if(! frame) {
+        missed_metric.add();
+        continue;
+      }
+      read_metric.add();
+      image_handler->handle(frame);
+    }
+    last = latest;
+  }
+}
+
+FramePtr SharedMemoryFramesReader::Private::read(uint64_t sequence)
+{
+  auto slot = reinterpret_cast<SlotHeader*>(memory + HEADER_SIZE + ((sequence - 1) % header()->slots) * header()->slot_size);
+  if(slot->sequence.load(memory_order_acquire) != sequence)
+    return {};
+  const auto data_size = slot->data_size;
+  if(SLOT_HEADER_SIZE + data_size > header()->slot_size || (slot->bpp != 8 && slot->bpp != 16))
+    return {};
+  auto frame = pool->acquire(slot->bpp, static_cast<Frame::ColorFormat>(slot->color_format), {static_cast<int>(slot->width), static_cast<int>(slot->height)},
+                             static_cast<Frame::ByteOrder>(slot->byte_order));
+  if(frame->channels() != slot->channels || frame->size() != data_size)
+    return {};
+  memcpy(frame->data(), reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE, data_size);
+  frame->set_exposure(Frame::Seconds{slot->exposure});
+  frame->set_created_utc(QDateTime::fromMSecsSinceEpoch(slot->created_utc, Qt::UTC));
+  frame->set_captured(Frame::Clock::time_point{chrono::duration_cast<Frame::Clock::duration>(chrono::nanoseconds{slot->captured})});
+  if(slot->flags & SLOT_FLAG_DEVICE_TIMESTAMP)
+    frame->set_device_timestamp(Frame::Timestamp{slot->device_timestamp});
+  frame->set_sequence(slot->frame_sequence);
+  frame->set_metadata(slot->metadata);
+  // The writer got to this slot again while we were copying
+  atomic_thread_fence(memory_order_acquire);
+  if(slot->sequence.load(memory_order_acquire) != sequence)
+    return {};
+  return frame;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SHAREDMEMORYFRAMES_H
+#define SHAREDMEMORYFRAMES_H
+
+#include "image_handlers/imagehandler.h"
+#include "c++/dptr.h"
+#include <QString>
+
+FWD_PTR(SharedMemoryFrames)
+FWD_PTR(SharedMemoryFramesReader)
+
+/**
+ * Publishes every frame into a POSIX shared memory ring, so that local scripts (or a host process) can map them.
+ * Layout (native byte order, version 2): a 64 bytes header
+ *   magic "PIFRAMES", u32 version, u32 slots, u64 slot size, u64 latest sequence, u32 flags (1: stale, reopen),
+ *   u32 waiting readers, u32 published (futex word: bumped, and readers woken, with every frame)
+ * followed by 'slots' slots of 'slot size' bytes each. Every slot has a 128 bytes header
+ *   u64 sequence (0 while being written), u32 width, u32 height, u8 bpp, u8 channels, u8 color format, u8 byte order,
+ *   u32 flags (1: device timestamp), f64 exposure (seconds), i64 capture time (msecs since epoch, UTC), u64 data size,
+ *   i64 monotonic capture time (steady clock nanoseconds), i64 device timestamp (usecs), u64 imager sequence, FrameMetadata (40 bytes)
+ * followed by the pixels. Frame n goes into slot (n - 1) % slots: readers compare the slot sequence before and after reading.
+ * Version 1 had 64 bytes slot headers, ending with the data size, and no readers wake up.
+ * The segment is recreated, and the old one flagged as stale, when frames grow larger than a slot.
+ * See scripting_client/planetaryimager/shared_frames.py for the Python reader, and SharedMemoryFramesReader.
+ */
+class SharedMemoryFrames : public ImageHandler
+{
+public:
+  SharedMemoryFrames(const QString &name, int slots = 8);
+  ~SharedMemoryFrames();
+  /// Removes a segment left behind by a writer that died without closing it
+  static void remove(const QString &name);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+/**
+ * Follows a SharedMemoryFrames segment written by another process (i.e. a driver helper process, see IsolatedDrivers), handing every frame to
+ * image_handler from a thread of its own, as soon as it's published. Frames are copied out of the ring into pooled buffers, with
+ * their capture metadata; the ones overwritten before being read are skipped, and counted in shared_memory_frames_missed_total.
+ * The segment can be created (or recreated) after the reader, which keeps looking for it.
+ */
+class SharedMemoryFramesReader
+{
+public:
+  SharedMemoryFramesReader(const QString &name, const ImageHandlerPtr &image_handler);
+  ~SharedMemoryFramesReader();
+private:
+  DPTR
+};
+
+#endif // SHAREDMEMORYFRAMES_H
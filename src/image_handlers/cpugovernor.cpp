@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "cpugovernor.h"
+#include <QTimer>
+#include <QFile>
+#include <QHash>
+#include <QDebug>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include "framesfanout.h"
+#include "commons/cpubudget.h"
+#include "commons/metrics.h"
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+const int interval_msecs = 1000;
+
+// CPU time used so far by the whole machine, from /proc/stat where available, or by this process only
+chrono::nanoseconds busy_time()
+{
+#ifdef Q_OS_LINUX
+  QFile stat{"/proc/stat"};
+  if(stat.open(QIODevice::ReadOnly)) {
+    // cpu user nice system idle iowait irq softirq steal ...: idle and iowait aside, in clock ticks
+    const auto fields = QString::fromLatin1(stat.readLine()).simplified().split(' ');
+    if(fields.size() > 5 && fields[0] == "cpu") {
+      qint64 ticks = 0;
+      for(int i = 1; i < min(fields.size(), 9); i++)
+        if(i != 4 && i != 5)
+          ticks += fields[i].toLongLong();
+      return chrono::nanoseconds{ticks * (1000000000ll / sysconf(_SC_CLK_TCK))};
+    }
+  }
+#endif
+  return chrono::nanoseconds{static_cast<int64_t>(clock() * (1e9 / CLOCKS_PER_SEC))};
+}
+}
+
+DPTR_IMPL(CpuGovernor) {
+  const shared_ptr<FramesFanout> fanout;
+  const Configuration &configuration;
+  QTimer *timer;
+  unique_ptr<CpuBudget> budget;
+  double reserve = -1;
+  // Consumers with a limit currently set
+  QStringList limited;
+  QHash<QString, FramesFanout::Usage> last_usage;
+  chrono::nanoseconds last_busy;
+  chrono::steady_clock::time_point last_update;
+  Metrics::Gauge &budget_metric = Metrics::instance().gauge("cpu_governor_budget_millicores", "Thousandths of a core left to the optional frames consumers by the CPU governor");
+  void update();
+  void set_limit(const QString &name, double fps);
+};
+
+CpuGovernor::CpuGovernor(const shared_ptr<FramesFanout> &fanout, const Configuration &configuration, QObject *parent)
+  : QObject{parent}, dptr(fanout, configuration)
+{
+  d->last_busy = busy_time();
+  d->last_update = chrono::steady_clock::now();
+  d->timer = new QTimer{this};
+  connect(d->timer, &QTimer::timeout, this, [this]{ d->update(); });
+  d->timer->start(interval_msecs);
+}
+
+CpuGovernor::~CpuGovernor()
+{
+}
+
+void CpuGovernor::Private::set_limit(const QString &name, double fps)
+{
+  if(fps > 0 && ! limited.contains(name))
+    limited.append(name);
+  else if(fps <= 0 && ! limited.removeAll(name))
+    return;
+  fanout->set_governed_fps(name, fps);
+}
+
+void CpuGovernor::Private::update()
+{
+  const auto now = chrono::steady_clock::now();
+  const auto busy = busy_time();
+  const double elapsed = chrono::duration<double>(now - last_update).count();
+  const double machine = chrono::duration<double>(busy - last_busy).count() / elapsed;
+  last_update = now;
+  last_busy = busy;
+  QHash<QString, FramesFanout::Usage> usage;
+  for(const auto &consumer: fanout->usage())
+    usage[consumer.name] = consumer;
+  const auto previous = last_usage;
+  last_usage = usage;
+
+  if(! configuration.cpu_governor()) {
+    for(const auto &name: QStringList{limited})
+      set_limit(name, 0);
+    return;
+  }
+  const double wanted_reserve = configuration.cpu_governor_reserve() / 100.;
+  if(! budget || wanted_reserve != reserve) {
+    reserve = wanted_reserve;
+    CpuBudget::Settings settings;
+    settings.reserve = reserve;
+    budget = make_unique<CpuBudget>(settings, static_cast<int>(max(thread::hardware_concurrency(), 1u)));
+  }
+  QStringList names;
+  vector<CpuBudget::Stage> stages;
+  for(const auto &name: configuration.cpu_governor_priorities()) {
+    if(! usage.contains(name) || ! previous.contains(name) || names.contains(name))
+      continue;
+    const auto &current = usage[name], &last = previous[name];
+    names.append(name);
+    stages.push_back({(current.offered - last.offered) / elapsed, (current.handled - last.handled) / elapsed, chrono::duration<double>(current.cpu - last.cpu).count() / elapsed});
+  }
+  const auto rates = budget->update(machine, stages);
+  budget_metric.set(static_cast<qint64>(budget->budget() * 1000));
+  // Consumers no longer listed get their frames back
+  for(const auto &name: QStringList{limited})
+    if(! names.contains(name))
+      set_limit(name, 0);
+  for(int i = 0; i < names.size(); i++) {
+    if((rates[i] > 0) != limited.contains(names[i]))
+      qDebug() << "CPU governor:" << names[i] << "rate limit" << rates[i] << "fps (0: none), budget" << budget->budget() << "cores";
+    set_limit(names[i], rates[i]);
+  }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CPUGOVERNOR_H
+#define CPUGOVERNOR_H
+
+#include <QObject>
+#include <memory>
+#include "c++/dptr.h"
+#include "commons/configuration.h"
+
+class FramesFanout;
+
+/**
+ * Slows the optional frames consumers down while the machine runs out of CPU, keeping a share of it for capture and recording (see CpuBudget).
+ * Once a second, the CPU time of the consumers listed in the cpu_governor_priorities setting, highest priority first, and the load of the whole
+ * machine are measured, and each consumer gets its rate limit. Consumers not listed (recording, and what drives it) are never governed.
+ * The display consumer also runs the histogram and the frontend handlers, which are then governed with it.
+ * Limits add to the LoadShedder ones: the lowest rate wins.
+ */
+class CpuGovernor : public QObject
+{
+  Q_OBJECT
+public:
+  CpuGovernor(const std::shared_ptr<FramesFanout> &fanout, const Configuration &configuration, QObject *parent = nullptr);
+  ~CpuGovernor();
+private:
+  DPTR
+};
+
+#endif // CPUGOVERNOR_H
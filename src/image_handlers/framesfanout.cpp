@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "framesfanout.h"
+#include <QThread>
+#include <QSemaphore>
+#include <QDebug>
+#include <QVariantMap>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "commons/frame.h"
+#include "commons/metrics.h"
+#include "commons/threadplacement.h"
+#include "Qt/qt_strings_helper.h"
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+namespace {
+// CPU time of the calling thread
+chrono::nanoseconds thread_cpu_time()
+{
+#ifdef Q_OS_WIN
+  FILETIME creation, exit, kernel, user;
+  if(! GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+    return {};
+  const auto ticks = [](const FILETIME &time) { return (static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+  return chrono::nanoseconds{(ticks(kernel) + ticks(user)) * 100};
+#else
+  timespec now;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+    return {};
+  return chrono::seconds{now.tv_sec} + chrono::nanoseconds{now.tv_nsec};
+#endif
+}
+}
+
+DPTR_IMPL(FramesFanout) {
+  class Consumer;
+  vector<unique_ptr<Consumer>> consumers;
+  PipelineGraph graph;
+  Consumer *consumer(const QString &name) const;
+};
+
+class FramesFanout::Private::Consumer : public QThread {
+public:
+  Consumer(const QString &name, const ImageHandlerPtr &handler, DropPolicy policy, size_t capacity, MemoryGovernor::Priority priority, const QList<int> &cpus);
+  ~Consumer();
+  QVariantMap describe() const;
+  void push(const FrameConstPtr &frame);
+  void push(const FrameBatch &batch);
+  const QString name;
+  atomic<quint64> dropped{0};
+  atomic_bool suspended{false};
+  // Nanoseconds between frames, 0 for no limit: from set_max_fps, and from the CPU governor
+  atomic<int64_t> min_interval{0};
+  atomic<int64_t> governed_interval{0};
+  bool threaded() const { return policy != Inline; }
+  atomic<quint64> offered{0};
+  atomic<quint64> handled{0};
+  atomic<int64_t> cpu_time{0};
+private:
+  void drop(quint64 frames = 1) { dropped += frames; dropped_metric.add(frames); }
+  bool enqueue(const FrameConstPtr &frame);
+  /// Whether the frames go through suspension and rate limit; on the thread pushing frames
+  bool admit(quint64 frames = 1);
+  chrono::steady_clock::time_point last_admitted;
+  Metrics::Counter &dropped_metric;
+  Metrics::Counter &shed_metric;
+  MemoryGovernor::Account &memory;
+  void run() override;
+  FrameConstPtr pop();
+  const ImageHandlerPtr handler;
+  const DropPolicy policy;
+  const size_t capacity;
+  const QList<int> cpus;
+  boost::lockfree::spsc_queue<FrameConstPtr> ring;
+  // One for each frame in the ring
+  QSemaphore queued;
+  atomic_bool running{true};
+};
+
+FramesFanout::Private::Consumer::Consumer(const QString &name, const ImageHandlerPtr &handler, DropPolicy policy, size_t capacity, MemoryGovernor::Priority priority, const QList<int> &cpus)
+  : name{name}, dropped_metric(Metrics::instance().counter("fanout_dropped_frames_total", "Frames dropped by each frames consumer", "consumer=\"%1\""_q % name)),
+  shed_metric(Metrics::instance().counter("fanout_shed_frames_total", "Frames kept from each frames consumer while suspended or slowed down under load", "consumer=\"%1\""_q % name)),
+  memory(MemoryGovernor::instance().account("%1 fanout"_q % name, priority)),
+  handler{handler}, policy{policy}, capacity{max<size_t>(capacity, 1)}, cpus{cpus}, ring{max<size_t>(capacity, 1)}
+{
+  setObjectName(name);
+  if(policy != Inline)
+    start();
+}
+
+FramesFanout::Private::Consumer::~Consumer()
+{
+  running = false;
+  wait();
+  while(queued.tryAcquire())
+    pop();
+  if(dropped > 0)
+    qDebug() << "frames consumer" << name << "dropped" << dropped << "frames";
+}
+
+void FramesFanout::Private::Consumer::push(const FrameConstPtr &frame)
+{
+  if(policy == Inline) {
+    handler->handle(frame);
+    return;
+  }
+  if(admit() && enqueue(frame))
+    queued.release();
+}
+
+void FramesFanout::Private::Consumer::push(const FrameBatch &batch)
+{
+  if(policy == Inline) {
+    handler->handle_batch(batch);
+    return;
+  }
+  if(policy == Latest) {
+    // The consumer would skip all but the newest one anyway
+    drop(batch.size() - 1);
+    push(batch.back());
+    return;
+  }
+  if(min_interval > 0 || governed_interval > 0) {
+    for(const auto &frame: batch)
+      push(frame);
+    return;
+  }
+  if(! admit(batch.size()))
+    return;
+  int queued_frames = 0;
+  for(const auto &frame: batch)
+    queued_frames += enqueue(frame) ? 1 : 0;
+  if(queued_frames > 0)
+    queued.release(queued_frames);
+}
+
+bool FramesFanout::Private::Consumer::admit(quint64 frames)
+{
+  offered += frames;
+  if(suspended) {
+    shed_metric.add(frames);
+    return false;
+  }
+  const chrono::nanoseconds interval{max(min_interval.load(), governed_interval.load())};
+  if(interval.count() <= 0)
+    return true;
+  const auto now = chrono::steady_clock::now();
+  if(now - last_admitted < interval) {
+    shed_metric.add(frames);
+    return false;
+  }
+  last_admitted = now;
+  return true;
+}
+
+bool FramesFanout::Private::Consumer::enqueue(const FrameConstPtr &frame)
+{
+  if(! memory.reserve(frame->size())) {
+    drop();
+    return false;
+  }
+  if(ring.push(frame))
+    return true;
+  memory.release(frame->size());
+  drop();
+  return false;
+}
+
+FrameConstPtr FramesFanout::Private::Consumer::pop()
+{
+  FrameConstPtr frame;
+  ring.pop(frame);
+  memory.release(frame->size());
+  return frame;
+}
+
+void FramesFanout::Private::Consumer::run()
+{
+  if(! cpus.isEmpty())
+    ThreadPlacement::apply(name, cpus);
+  while(running) {
+    // Bounded wait, so that stopping doesn't depend on frames coming in
+    if(! queued.tryAcquire(1, 100))
+      continue;
+    auto frame = pop();
+    if(policy == Latest) {
+      while(queued.tryAcquire()) {
+        frame = pop();
+        drop();
+      }
+    }
+    const auto cpu_start = thread_cpu_time();
+    handler->handle(frame);
+    cpu_time += (thread_cpu_time() - cpu_start).count();
+    handled++;
+  }
+}
+
+FramesFanout::FramesFanout() : dptr()
+{
+}
+
+FramesFanout::~FramesFanout()
+{
+}
+
+QVariantMap FramesFanout::Private::Consumer::describe() const
+{
+  static const QStringList policies{"inline", "queue", "latest"};
+  QVariantList cpus_list;
+  for(const auto cpu: cpus)
+    cpus_list.push_back(cpu);
+  const auto fps = [](int64_t interval) { return interval > 0 ? 1e9 / interval : 0.; };
+  return {
+    {"name", name},
+    {"policy", policies.value(policy)},
+    {"depth", static_cast<qulonglong>(capacity)},
+    {"cpus", cpus_list},
+    {"suspended", suspended.load()},
+    {"max_fps", fps(min_interval)},
+    {"governed_fps", fps(governed_interval)},
+    {"offered", offered.load()},
+    {"handled", handled.load()},
+    {"dropped", dropped.load()},
+    {"cpu_seconds", cpu_time / 1e9},
+  };
+}
+
+void FramesFanout::set_graph(const PipelineGraph &graph)
+{
+  d->graph = graph;
+}
+
+void FramesFanout::add(const QString &name, const ImageHandlerPtr &handler, DropPolicy policy, size_t capacity, MemoryGovernor::Priority priority)
+{
+  const auto node = d->graph.node(name);
+  if(policy == Inline && node.policy != PipelineGraph::Default) {
+    qWarning() << "frames consumer" << name << "needs every frame: keeping it inline";
+  } else if(policy != Inline) {
+    static const QList<DropPolicy> policies{policy, Inline, Queue, Latest};
+    if(node.policy == PipelineGraph::Off) {
+      qDebug() << "frames consumer" << name << "turned off in the pipeline graph";
+      return;
+    }
+    policy = policies.value(node.policy, policy);
+    capacity = node.depth > 0 ? node.depth : capacity;
+  }
+  d->consumers.push_back(make_unique<Private::Consumer>(name, handler, policy, capacity, priority, policy != Inline ? node.cpus : QList<int>{}));
+}
+
+FramesFanout::Private::Consumer *FramesFanout::Private::consumer(const QString &name) const
+{
+  for(const auto &consumer: consumers)
+    if(consumer->name == name)
+      return consumer.get();
+  return nullptr;
+}
+
+void FramesFanout::set_suspended(const QString &name, bool suspended)
+{
+  if(auto consumer = d->consumer(name))
+    consumer->suspended = suspended;
+}
+
+void FramesFanout::set_max_fps(const QString &name, double fps)
+{
+  if(auto consumer = d->consumer(name))
+    consumer->min_interval = fps > 0 ? static_cast<int64_t>(1e9 / fps) : 0;
+}
+
+void FramesFanout::set_governed_fps(const QString &name, double fps)
+{
+  if(auto consumer = d->consumer(name))
+    consumer->governed_interval = fps > 0 ? static_cast<int64_t>(1e9 / fps) : 0;
+}
+
+QList<QPair<QString, quint64>> FramesFanout::dropped_frames() const
+{
+  QList<QPair<QString, quint64>> dropped;
+  for(const auto &consumer: d->consumers)
+    dropped.push_back({consumer->name, consumer->dropped});
+  return dropped;
+}
+
+QList<FramesFanout::Usage> FramesFanout::usage() const
+{
+  QList<Usage> usage;
+  for(const auto &consumer: d->consumers)
+    if(consumer->threaded())
+      usage.push_back({consumer->name, consumer->offered, consumer->handled, chrono::nanoseconds{consumer->cpu_time.load()}});
+  return usage;
+}
+
+QVariantList FramesFanout::describe() const
+{
+  QVariantList consumers;
+  for(const auto &consumer: d->consumers)
+    consumers.push_back(consumer->describe());
+  return consumers;
+}
+
+void FramesFanout::doHandle(FrameConstPtr frame)
+{
+  for(const auto &consumer: d->consumers)
+    consumer->push(frame);
+}
+
+void FramesFanout::doHandleBatch(const FrameBatch &batch)
+{
+  if(batch.empty())
+    return;
+  for(const auto &consumer: d->consumers)
+    consumer->push(batch);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMESFANOUT_H
+#define FRAMESFANOUT_H
+#include <QString>
+#include <QList>
+#include <QPair>
+#include <QVariantList>
+#include <chrono>
+#include "c++/dptr.h"
+#include "image_handlers/imagehandler.h"
+#include "commons/memorygovernor.h"
+#include "image_handlers/pipelinegraph.h"
+
+/**
+ * Hands each frame to its consumers without waiting for them, so that the capture thread keeps draining the camera at sensor speed.
+ * Every consumer gets a bounded lock-free ring and a thread of its own, and drops frames by its own policy when it can't keep up.
+ * Frames in a ring are charged to the "<name> fanout" memory account, with the consumer priority: over budget, new frames are dropped.
+ * Frames must all come from the same thread. In a batch, Latest consumers only get the newest frame, and Queue ones are woken up once.
+ * Under load (see LoadShedder), consumers can be suspended or slowed down: the frames they don't get are counted apart from the dropped ones.
+ * The CPU time each consumer thread spends in its handler is measured, for CpuGovernor, which slows optional consumers down on its own limit.
+ * Policy, depth and CPUs of each consumer can be overridden by a PipelineGraph, from the pipeline setting.
+ */
+class FramesFanout : public ImageHandler
+{
+public:
+  enum DropPolicy {
+    /// No ring and no thread: handled right away, for consumers already queueing frames on their own (i.e. recording)
+    Inline,
+    /// Every frame, in order: new frames are dropped while the ring is full
+    Queue,
+    /// Only the most recent frame: older ones still in the ring are skipped
+    Latest,
+  };
+  FramesFanout();
+  ~FramesFanout();
+  /// Overrides for the consumers added from now on. Consumers added as Inline queue frames on their own and need every one: they're left alone
+  void set_graph(const PipelineGraph &graph);
+  /// Consumers must all be added before the first frame
+  void add(const QString &name, const ImageHandlerPtr &handler, DropPolicy policy, std::size_t capacity = 4,
+           MemoryGovernor::Priority priority = MemoryGovernor::Display);
+  /// No frames at all for the consumer, until resumed; Inline consumers are never suspended. Unknown names are ignored. Any thread
+  void set_suspended(const QString &name, bool suspended);
+  /// At most fps frames per second for the consumer, 0 for no limit; Inline consumers are never limited. Unknown names are ignored. Any thread
+  void set_max_fps(const QString &name, double fps);
+  /// Rate limit from CpuGovernor, on top of set_max_fps: the lowest one wins. Same rules as set_max_fps
+  void set_governed_fps(const QString &name, double fps);
+  /// Frames each consumer dropped so far, by consumer name
+  QList<QPair<QString, quint64>> dropped_frames() const;
+  /// What a consumer did since it was added: frames offered to it (before suspension and rate limits), frames it handled, CPU time spent handling them
+  struct Usage {
+    QString name;
+    quint64 offered;
+    quint64 handled;
+    std::chrono::nanoseconds cpu;
+  };
+  /// Consumers with a thread of their own only, in the order they were added
+  QList<Usage> usage() const;
+  /// Every consumer as it is now, with its policy, depth, CPUs, limits and counters, for inspection (see MetricsEndpoint)
+  QVariantList describe() const;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  void doHandleBatch(const FrameBatch &batch) override;
+  DPTR
+};
+
+#endif // FRAMESFANOUT_H
@@ -16,15 +16,19 @@
  *
  */
 
-#include <boost/endian/conversion.hpp>
 #include "displayimage.h"
+#include "displaystages.h"
+#include "edgedetection.h"
+#include "displaysurface.h"
 #include "commons/configuration.h"
 #include "commons/fps_counter.h"
 #include <QThread>
 #include <QElapsedTimer>
 #include <QRect>
 #include <QImage>
-#include <boost/lockfree/spsc_queue.hpp>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
 #include <QDebug>
 #include "Qt/qt_strings_helper.h"
 #include "commons/utils.h"
@@ -32,13 +36,32 @@
 #include "commons/opencv_utils.h"
 #include "c++/stlutils.h"
 #include <atomic>
-#include "Qt/benchmark.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
 #include <atomic>
 #include "commons/utils.h"
 #include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/pixel_kernels.h"
+#include "commons/debayer.h"
 
 using namespace std;
-using namespace std::placeholders;
+
+// A converted image not acknowledged by the GUI within this time is considered lost
+#define DISPLAY_IMAGE_SHOWN_TIMEOUT_MS 250
+#define DISPLAY_IMAGE_MAX_BINNING 8
+// Extra pixels processed around the visible area, so that debayering and edge kernels have their neighbours
+#define DISPLAY_IMAGE_VISIBLE_MARGIN 8
+
+namespace {
+cv::Mat binned(const cv::Mat &source, int binning) {
+  if(binning <= 1)
+    return source;
+  cv::Mat destination;
+  cv::resize(source, destination, {}, 1. / binning, 1. / binning, cv::INTER_AREA);
+  return destination;
+}
+}
 
 DPTR_IMPL(DisplayImage) {
   const Configuration &configuration;
@@ -47,46 +70,66 @@ DPTR_IMPL(DisplayImage) {
   atomic_bool recording;
   atomic_bool running;
 
-  // settings
-  atomic_bool limit_fps;
-  atomic_long min_milliseconds_elapsed;
-  // settings - edge detection
-  atomic_bool edge_detection_sobel;
-  atomic_int sobel_blur_size;
-  atomic_int sobel_kernel;
-  atomic<double> sobel_scale;
-  atomic<double> sobel_delta;
-
-  atomic_bool edge_detection_canny;
-  atomic_int canny_kernel_size;
-  atomic_int canny_blur;
-  atomic<double> canny_threshold_ratio;
-  atomic<double> canny_low_threshold;
-
-  atomic_bool debayer;
-
-//         d->sobel(*cv_image, d->configuration.sobel_blur_size(), d->configuration.sobel_kernel(), d->configuration.sobel_scale(), d->configuration.sobel_delta());
+  // Settings for the frame being converted, loaded once per frame by the conversion thread
+  Configuration::SnapshotPtr settings;
+  atomic_bool raw_frames;
 
   QElapsedTimer elapsed;
   QRect imageRect;
-  boost::lockfree::spsc_queue<FrameConstPtr, boost::lockfree::capacity<50>> queue;
+  // Last view state from the GUI
+  QMutex viewport_mutex;
+  double zoom = 1;
+  QRectF visible;
+  // Single slot mailbox: the newest frame replaces any frame not yet converted
+  QMutex mailbox_mutex;
+  QWaitCondition mailbox_changed;
+  FrameConstPtr latest;
+  // Live frames are ignored while a frozen frame is shown
+  bool frozen = false;
+  // One image at a time in the GUI: the next conversion waits for imageShown()
+  bool image_pending = false;
+  QElapsedTimer image_pending_since;
   atomic_bool detectEdges;
-  QVector<QRgb> grayScale;
 
   atomic_bool histogramEqualization;
   atomic_bool maximumSaturation;
+  DisplayStages stages;
+  EdgeDetection edges;
+  DisplaySurfacePtr surface;
+  // Bayer cells of binned views, before they're downscaled
+  cv::Mat superpixels;
 
   bool should_display_frame() const;
-  void canny(cv::Mat& source, int lowThreshold = 1, int ratio = 3, int kernel_size = 3, int blurSize = 3);
-  void sobel( cv::Mat& source, int blur_size = 3, int ker_size = 3, int scale = 1, int delta = 0 );
 
-  void bayer2rgb(FrameConstPtr frame, cv::Mat &image);
-  void bgr2rgb(FrameConstPtr frame, cv::Mat &image);
-  void rgb2rgb(FrameConstPtr frame, cv::Mat &image);
-  void gray2rgb(FrameConstPtr frame, cv::Mat &image);
-
-  /// If 'src's endianess is not native, returns a copy of 'src' with bytes swapped; otherwise, returns 'src'
-  cv::Mat getEndianCorrectMat(const cv::Mat &src, Frame::ByteOrder srcByteOrder);
+  /// Part of the frame to process, and the binning factor bringing it close to screen pixels
+  struct View {
+    cv::Rect area;
+    int binning;
+  };
+  View view(FrameConstPtr frame);
+
+  typedef void (Private::*Converter)(FrameConstPtr frame, const View &view, cv::Mat &image);
+  /// What the converters depend on: they are picked again only when it changes, not for every frame
+  struct StreamFormat {
+    Frame::ColorFormat color_format;
+    int depth;
+    bool swap;
+    bool operator==(const StreamFormat &other) const { return color_format == other.color_format && depth == other.depth && swap == other.swap; }
+  };
+  StreamFormat stream_format{Frame::Mono, -1, false};
+  Converter converter = nullptr;
+  PixelKernels::RowConverter row_converter = nullptr;
+  void select_converters(const Frame &frame);
+
+  void bayer2rgb(FrameConstPtr frame, const View &view, cv::Mat &image);
+  void bgr2rgb(FrameConstPtr frame, const View &view, cv::Mat &image);
+  void rgb2rgb(FrameConstPtr frame, const View &view, cv::Mat &image);
+  void gray2gray(FrameConstPtr frame, const View &view, cv::Mat &image);
+
+  /// 8 bit image of a frame area, with bytes swapped first if the frame endianess is not native
+  cv::Mat displayMat(FrameConstPtr frame, const cv::Rect &area);
+  /// Binned displayMat into image, never sharing the frame buffer, so that it can be processed in place; image memory is reused when it fits
+  void ownedDisplayMat(FrameConstPtr frame, const View &view, cv::Mat &image);
 };
 
 
@@ -105,182 +148,254 @@ DisplayImage::DisplayImage(const Configuration &configuration, QObject* parent)
   d->detectEdges = false;
   d->maximumSaturation = false;
   d->histogramEqualization = false;
+  d->raw_frames = false;
+  d->surface = make_shared<DisplaySurface>();
   setRecording(false);
-  for(int i=0; i<0xff; i++)
-    d->grayScale.push_back(qRgb(i, i, i));
-  read_settings();
   d->elapsed.restart();
 }
 
 void DisplayImage::setRecording(bool recording)
 {
   d->recording = recording;
-  read_settings();
 }
 
 bool DisplayImage::Private::should_display_frame() const
 {
-  if(!limit_fps)
+  const auto settings = configuration.snapshot();
+  if(! (recording ? settings->limit_fps_recording : settings->limit_fps))
     return true;
-  return elapsed.elapsed() > min_milliseconds_elapsed;
-}
-
-void DisplayImage::read_settings()
-{
-  d->limit_fps = d->recording ? d->configuration.limit_fps_recording() : d->configuration.limit_fps();
-  d->min_milliseconds_elapsed = 1000/(d->recording ? d->configuration.max_display_fps_recording() : d->configuration.max_display_fps() );
-
-  d->edge_detection_sobel =  d->configuration.edge_algorithm() == Configuration::Sobel;
-  d->sobel_kernel = d->configuration.sobel_kernel();
-  d->sobel_blur_size = d->configuration.sobel_blur_size();
-  d->sobel_delta = d->configuration.sobel_delta();
-  d->sobel_scale = d->configuration.sobel_scale();
-
-  d->edge_detection_canny =  d->configuration.edge_algorithm() == Configuration::Canny;
-  d->canny_blur = d->configuration.canny_blur_size();
-  d->canny_kernel_size = d->configuration.canny_kernel_size();
-  d->canny_low_threshold = d->configuration.canny_low_threshold();
-  d->canny_threshold_ratio = d->configuration.canny_threshold_ratio();
-  d->debayer = d->configuration.debayer();
+  return elapsed.elapsed() > 1000 / (recording ? settings->max_display_fps_recording : settings->max_display_fps);
 }
 
-
 void DisplayImage::doHandle(FrameConstPtr frame)
 {
   if( ! d->should_display_frame()  || !frame->mat().data ) {
     return;
   }
-  if(! d->queue.push(frame)) {
-    qDebug() << "Display queue full, skipping frame";
-    return;
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    if(d->frozen)
+      return;
+    d->latest = frame;
   }
+  d->mailbox_changed.wakeOne();
   d->elapsed.restart();
 }
 
+void DisplayImage::freeze(const FrameConstPtr &frame)
+{
+  if(! frame || ! frame->mat().data)
+    return;
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    d->frozen = true;
+    d->latest = frame;
+  }
+  d->mailbox_changed.wakeOne();
+}
+
+void DisplayImage::unfreeze()
+{
+  QMutexLocker lock(&d->mailbox_mutex);
+  d->frozen = false;
+}
+
+void DisplayImage::imageShown()
+{
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    d->image_pending = false;
+  }
+  d->mailbox_changed.wakeOne();
+}
+
 void DisplayImage::create_qimages()
 {
-  FrameConstPtr frame;
+  // A global pool thread: not pinned anymore when the display is done with it
+  QList<int> display_cpus;
+  GuLinux::Scope unpin{[]{ ThreadPlacement::apply("display", {}); }};
   while(d->running) {
-    if(!d->queue.pop(frame)) {
-      QThread::msleep(1);
-      continue;
+    FrameConstPtr frame;
+    {
+      QMutexLocker lock(&d->mailbox_mutex);
+      auto waiting = [this] {
+        if(d->image_pending && d->image_pending_since.elapsed() > DISPLAY_IMAGE_SHOWN_TIMEOUT_MS)
+          d->image_pending = false;
+        return ! d->latest || d->image_pending;
+      };
+      while(d->running && waiting())
+        d->mailbox_changed.wait(&d->mailbox_mutex, DISPLAY_IMAGE_SHOWN_TIMEOUT_MS);
+      if(! d->running)
+        break;
+      swap(frame, d->latest);
+      d->image_pending = true;
+      d->image_pending_since.start();
     }
 
+    Tracing::Span span{"DisplayImage::create_qimages", frame->sequence()};
+    d->settings = d->configuration.snapshot();
+    if(d->settings->display_cpus != display_cpus) {
+      display_cpus = d->settings->display_cpus;
+      ThreadPlacement::apply("display", display_cpus);
+    }
     ++*d->displayFps;
-    auto cv_image = new cv::Mat;
-    static QHash<Frame::ColorFormat, std::function<void(FrameConstPtr, cv::Mat&)>> converters {
-      {Frame::Mono, bind(&Private::gray2rgb, d.get(), _1, _2)},
-      {Frame::RGB, bind(&Private::rgb2rgb, d.get(), _1, _2)},
-      {Frame::BGR, bind(&Private::bgr2rgb, d.get(), _1, _2)},
-      {Frame::Bayer_RGGB, bind(&Private::bayer2rgb, d.get(), _1, _2)},
-      {Frame::Bayer_GRBG, bind(&Private::bayer2rgb, d.get(), _1, _2)},
-      {Frame::Bayer_GBRG, bind(&Private::bayer2rgb, d.get(), _1, _2)},
-      {Frame::Bayer_BGGR, bind(&Private::bayer2rgb, d.get(), _1, _2)},
-    };
-    converters[frame->colorFormat()](frame, *cv_image);
+    if(d->raw_frames) {
+      d->imageRect = QRect{{0, 0}, frame->resolution()};
+      emit gotFrame(frame);
+      continue;
+    }
+    // Rendered in place: the surface back buffer keeps its memory from the frame it had before
+    cv::Mat *cv_image = &d->surface->back();
+    d->select_converters(*frame);
+    const auto view = d->view(frame);
+    (d.get()->*d->converter)(frame, view, *cv_image);
 
 
     if(cv_image->depth() != CV_8U && cv_image->depth() != CV_8S) {
       cv_image->convertTo(*cv_image, CV_8UC3, BITS_16_TO_8);
     }
     if(d->detectEdges) {
-      if(d->edge_detection_sobel) {
-        QBENCH(sobel)->every(200)->ms();
-        d->sobel(*cv_image, d->sobel_blur_size, d->sobel_kernel, d->sobel_scale, d->sobel_delta);
-      } else if(d->edge_detection_canny) {
-        QBENCH(canny)->every(200)->ms();
-        d->canny(*cv_image, d->canny_low_threshold, d->canny_threshold_ratio, d->canny_kernel_size, d->canny_blur);
-      }
-    }
-    if(d->histogramEqualization) {
-      vector<cv::Mat> r_g_b;
-      cv::split(*cv_image, r_g_b);
-      for(auto &channel: r_g_b) {
-        cv::equalizeHist(channel, channel);
+      d->edges.setOpenCL(d->settings->display_opencl);
+      if(d->settings->edge_algorithm == Configuration::Sobel) {
+        static auto &sobel_metric = Metrics::instance().histogram("display_edge_detection_seconds", "Time spent on edge detection for display", "method=\"sobel\"");
+        Metrics::Timer timer{sobel_metric};
+        d->edges.sobel(*cv_image, d->settings->sobel_blur_size, d->settings->sobel_kernel, d->settings->sobel_scale, d->settings->sobel_delta);
+      } else if(d->settings->edge_algorithm == Configuration::Canny) {
+        static auto &canny_metric = Metrics::instance().histogram("display_edge_detection_seconds", "Time spent on edge detection for display", "method=\"canny\"");
+        Metrics::Timer timer{canny_metric};
+        d->edges.canny(*cv_image, d->settings->canny_low_threshold, d->settings->canny_threshold_ratio, d->settings->canny_kernel_size, d->settings->canny_blur_size);
       }
-      cv::merge(r_g_b, *cv_image);
-    }
-    if(d->maximumSaturation) {
-      cv::Mat hsv;
-      cv::cvtColor(*cv_image, hsv, cv::COLOR_RGB2HSV);
-      vector<cv::Mat> h_s_v;
-      cv::split(hsv, h_s_v);
-      h_s_v[1].setTo(cv::Scalar(255));
-      cv::merge(h_s_v, hsv);
-      cv::cvtColor(hsv, *cv_image, cv::COLOR_HSV2RGB);
     }
-    QImage image{cv_image->data, cv_image->cols, cv_image->rows, static_cast<int>(cv_image->step), cv_image->channels() == 1 ? QImage::Format_Grayscale8: QImage::Format_RGB888,
-      [](void *data){ delete reinterpret_cast<cv::Mat*>(data); }, cv_image};
-    if(cv_image->channels() == 1) {
-      image.setColorTable(d->grayScale);
-    }
-    d->imageRect = image.rect();
-    emit gotImage(image);
+    d->stages.setHistogramEqualization(d->histogramEqualization);
+    d->stages.setMaximumSaturation(d->maximumSaturation);
+    d->stages.apply(*cv_image);
+    d->imageRect = QRect{{0, 0}, frame->resolution()};
+    d->surface->publish(QRect{view.area.x, view.area.y, view.area.width, view.area.height}, frame->resolution());
+    emit imageReady();
   }
   QThread::currentThread()->quit();
 }
 
-cv::Mat DisplayImage::Private::getEndianCorrectMat(const cv::Mat &src, Frame::ByteOrder srcByteOrder)
+DisplayImage::Private::View DisplayImage::Private::view(FrameConstPtr frame)
 {
-    if (src.depth() == CV_16U &&
-        (boost::endian::order::native == boost::endian::order::little && srcByteOrder == Frame::ByteOrder::BigEndian ||
-         boost::endian::order::native == boost::endian::order::big    && srcByteOrder == Frame::ByteOrder::LittleEndian))
-    {
-        cv::Mat srcSwapped(src.rows, src.cols, src.type());
-
-        const uint16_t *srcRow = (const uint16_t *)src.data;
-        const ptrdiff_t srcStep = src.step[0];
-
-        uint16_t *destRow = (uint16_t *)srcSwapped.data;
-        const ptrdiff_t destStep = srcSwapped.step[0];
-
-        for (int row = 0; row < src.rows; row++)
-        {
-            for (int valIdx = 0; valIdx < src.cols * src.channels(); valIdx++)
-                destRow[valIdx] = boost::endian::endian_reverse(srcRow[valIdx]);
+  const cv::Rect full{0, 0, frame->mat().cols, frame->mat().rows};
+  QMutexLocker lock(&viewport_mutex);
+  View view{full, 1};
+  while(view.binning < DISPLAY_IMAGE_MAX_BINNING && zoom * view.binning * 2 <= 1.)
+    view.binning *= 2;
+  if(visible.isValid()) {
+    auto rect = visible.toAlignedRect().adjusted(-DISPLAY_IMAGE_VISIBLE_MARGIN, -DISPLAY_IMAGE_VISIBLE_MARGIN, DISPLAY_IMAGE_VISIBLE_MARGIN, DISPLAY_IMAGE_VISIBLE_MARGIN);
+    // Even origin, to keep the bayer pattern
+    cv::Rect area{rect.x() & ~1, rect.y() & ~1, rect.width() + 1, rect.height() + 1};
+    area &= full;
+    if(area.area() > 0)
+      view.area = area;
+  }
+  return view;
+}
 
-            srcRow = (const uint16_t *)((const uint8_t *)srcRow + srcStep);
-            destRow = (uint16_t *)((uint8_t *)destRow + destStep);
-        }
+void DisplayImage::Private::select_converters(const Frame &frame)
+{
+  const StreamFormat format{frame.colorFormat(), frame.mat().depth(), Debayer::needs_swap(frame)};
+  if(converter && format == stream_format)
+    return;
+  stream_format = format;
+  row_converter = PixelKernels::row_converter(format.depth, format.swap);
+  switch(format.color_format) {
+    case Frame::Mono:
+      converter = &Private::gray2gray;
+      break;
+    case Frame::RGB:
+      converter = &Private::rgb2rgb;
+      break;
+    case Frame::BGR:
+      converter = &Private::bgr2rgb;
+      break;
+    default:
+      converter = &Private::bayer2rgb;
+  }
+}
 
-        return srcSwapped;
-    }
-    else
-        return src;
+cv::Mat DisplayImage::Private::displayMat(FrameConstPtr frame, const cv::Rect &area)
+{
+  const cv::Mat source = frame->mat()(area);
+  if(source.depth() == CV_8U)
+    return source;
+  // The whole frame: the 8 bit view other consumers (preview, network) may have converted already
+  if(area.size() == frame->mat().size())
+    return frame->analysis().as_8bit();
+  // One fused pass for byte swapping and 16 to 8 bit conversion; colour conversions then work on 8 bit data
+  cv::Mat converted;
+  PixelKernels::to8bit(source, converted, row_converter);
+  return converted;
 }
 
-void DisplayImage::Private::bayer2rgb(FrameConstPtr frame, cv::Mat& image)
+void DisplayImage::Private::bayer2rgb(FrameConstPtr frame, const View &view, cv::Mat& image)
 {
-  if(! debayer) {
-    gray2rgb(frame, image);
+  if(! settings->debayer) {
+    gray2gray(frame, view, image);
     return;
   }
-  static QHash<Frame::ColorFormat, int> bayer_patterns {
-    // For some strange reason, opencv is confusing RGB and BGR
-    {Frame::Bayer_RGGB, cv::COLOR_BayerRG2BGR},
-    {Frame::Bayer_GBRG, cv::COLOR_BayerGB2BGR},
-    {Frame::Bayer_GRBG, cv::COLOR_BayerGR2BGR},
-    {Frame::Bayer_BGGR, cv::COLOR_BayerBG2BGR},
-  };
-  cv::cvtColor(getEndianCorrectMat(frame->mat(), frame->byteOrder()), image, bayer_patterns[frame->colorFormat()]);
+  // Straight from the raw samples: byte swap and 8 bit conversion happen while interpolating.
+  // Binned views get one pixel for each bayer cell: no interpolation, and a quarter of the pixels for the following stages
+  const auto algorithm = view.binning > 1 ? Debayer::Superpixel : static_cast<Debayer::Algorithm>(settings->display_debayer_algorithm);
+  const Debayer::Options options{algorithm, Debayer::needs_swap(*frame), true};
+  const bool whole_frame = view.area.size() == frame->mat().size();
+  if(view.binning > 1 && whole_frame) {
+    // Shared with the other consumers of the frame, such as the browser preview: read only, resized into our own buffer
+    const cv::Mat &rgb = frame->analysis().debayered_half();
+    if(! rgb.empty()) {
+      cv::resize(rgb, image, {}, 2. / view.binning, 2. / view.binning, cv::INTER_AREA);
+      return;
+    }
+  }
+  cv::Mat &rgb = view.binning > 1 ? superpixels : image;
+  Debayer::debayer(frame->mat()(view.area), frame->colorFormat(), options, rgb);
+  // Visible area too small for a bayer cell
+  if(rgb.empty())
+    gray2gray(frame, view, image);
+  else if(view.binning > 1)
+    cv::resize(superpixels, image, {}, 2. / view.binning, 2. / view.binning, cv::INTER_AREA);
+}
+
+void DisplayImage::Private::bgr2rgb(FrameConstPtr frame, const View &view, cv::Mat& image)
+{
+  cv::cvtColor(binned(displayMat(frame, view.area), view.binning), image, cv::COLOR_BGR2RGB);
+}
+
+void DisplayImage::Private::ownedDisplayMat(FrameConstPtr frame, const View &view, cv::Mat &image)
+{
+  const cv::Mat area = frame->mat()(view.area);
+  if(view.binning > 1)
+    cv::resize(displayMat(frame, view.area), image, {}, 1. / view.binning, 1. / view.binning, cv::INTER_AREA);
+  else
+    PixelKernels::to8bit(area, image, row_converter);
 }
 
-void DisplayImage::Private::bgr2rgb(FrameConstPtr frame, cv::Mat& image)
+void DisplayImage::Private::gray2gray(FrameConstPtr frame, const View &view, cv::Mat& image)
 {
-  cv::cvtColor(getEndianCorrectMat(frame->mat(), frame->byteOrder()), image, cv::COLOR_BGR2RGB);
+  // Mono frames stay single channel all the way to the Format_Grayscale8 QImage
+  ownedDisplayMat(frame, view, image);
 }
 
-void DisplayImage::Private::gray2rgb(FrameConstPtr frame, cv::Mat& image)
+void DisplayImage::Private::rgb2rgb(FrameConstPtr frame, const View &view, cv::Mat& image)
 {
-  cv::cvtColor(getEndianCorrectMat(frame->mat(), frame->byteOrder()), image, cv::COLOR_GRAY2RGB);
+  ownedDisplayMat(frame, view, image);
 }
 
-void DisplayImage::Private::rgb2rgb(FrameConstPtr frame, cv::Mat& image)
+void DisplayImage::setViewport(double zoom, const QRectF& visible)
 {
-  getEndianCorrectMat(frame->mat(), frame->byteOrder()).copyTo(image);
+  QMutexLocker lock(&d->viewport_mutex);
+  d->zoom = zoom;
+  d->visible = visible;
 }
 
 
+DisplaySurfacePtr DisplayImage::surface() const
+{
+  return d->surface;
+}
+
 QRect DisplayImage::imageRect() const
 {
   return d->imageRect;
@@ -289,6 +404,7 @@ QRect DisplayImage::imageRect() const
 void DisplayImage::quit()
 {
   d->running = false;
+  d->mailbox_changed.wakeAll();
 }
 
 
@@ -307,33 +423,7 @@ void DisplayImage::maximumSaturation(bool enable)
   d->maximumSaturation = enable;
 }
 
-void DisplayImage::Private::canny( cv::Mat &source, int lowThreshold, int ratio, int kernel_size, int blurSize )
-{
-  cv::Mat src_gray, detected_edges, dst;
-  cv::cvtColor( source, src_gray, cv::COLOR_RGB2GRAY);
-  cv::blur( src_gray, detected_edges, {blurSize,blurSize} );
-  cv::Canny( detected_edges, detected_edges, lowThreshold, lowThreshold*ratio, kernel_size );
-  dst.create( source.size(), source.type() );
-  dst = cv::Scalar::all(0);
-  source.copyTo(dst, detected_edges);
-  source = dst;
-}
-
-
-void DisplayImage::Private::sobel( cv::Mat &source, int blur_size, int ker_size, int scale, int delta )
+void DisplayImage::setRawFrames(bool raw)
 {
-  cv::Mat blurred, blurred_gray, grad;
-  cv::GaussianBlur(source, blurred, {blur_size, blur_size}, 0, 0);
-  cv::cvtColor( blurred, blurred_gray, cv::COLOR_RGB2GRAY );
-  cv::Mat grad_x, grad_y;
-  cv::Mat abs_grad_x, abs_grad_y;
-
-  /// Gradient X
-  cv::Sobel( blurred_gray, grad_x, CV_32F, 1, 0, ker_size, scale, delta );
-  /// Gradient Y
-  cv::Sobel( blurred_gray, grad_y, CV_32F, 0, 1, ker_size, scale, delta );
-  cv::convertScaleAbs( grad_x, abs_grad_x );
-  cv::convertScaleAbs( grad_y, abs_grad_y );
-  cv::addWeighted( abs_grad_x, 0.5, abs_grad_y, 0.5, 0, source );
+  d->raw_frames = raw;
 }
-
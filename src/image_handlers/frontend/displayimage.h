@@ -20,9 +20,14 @@
 #define DISPLAYIMAGE_H
 
 #include <QObject>
+#include <QRect>
+#include <QSize>
 #include "dptr.h"
 #include "image_handlers/imagehandler.h"
 #include "commons/configuration.h"
+#include "commons/fwd.h"
+
+FWD_PTR(DisplaySurface)
 
 class DisplayImage : public QObject, public ImageHandler
 {
@@ -32,16 +37,30 @@ public:
     DisplayImage(const Configuration &configuration, QObject* parent = 0);
     void setRecording(bool recording);
     QRect imageRect() const;
+    /// Where the converted images go: swap it in front when imageReady is emitted
+    DisplaySurfacePtr surface() const;
 signals:
-  void gotImage(const QImage &);
+  /// A new image was published on surface()
+  void imageReady();
+  /// Emitted instead of imageReady when raw frames are requested
+  void gotFrame(const FrameConstPtr &frame);
   void displayFPS(double fps);
 public slots:
   void create_qimages();
+  /// To be called by the GUI once the last image from imageReady has been shown, to pace conversions with repaints
+  void imageShown();
   void detectEdges(bool detect);
   void histogramEqualization(bool enable);
   void maximumSaturation(bool enable);
+  /// Hand frames to the GUI as they are, for views processing them on the GPU
+  void setRawFrames(bool raw);
+  /// Current zoom and visible part of the frame (an invalid rect for all of it): frames are converted only as far as they can be seen
+  void setViewport(double zoom, const QRectF &visible);
+  /// Shows this frame instead of the live ones (i.e. a frame from the history of a remote imager), until unfreeze()
+  void freeze(const FrameConstPtr &frame);
+  /// Back to the live frames
+  void unfreeze();
   void quit();
-  void read_settings();
 private:
 
   void doHandle(FrameConstPtr frame) override;
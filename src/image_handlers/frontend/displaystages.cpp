@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "displaystages.h"
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <functional>
+#include <mutex>
+
+using namespace std;
+
+// Rows per tile: small enough for a tile to stay in cache between the stages fused on it
+#define DISPLAY_STAGES_TILE_ROWS 32
+
+namespace {
+typedef array<uint32_t, 256> Histogram;
+typedef array<uint8_t, 256> LookupTable;
+
+class TilesLoop : public cv::ParallelLoopBody {
+public:
+  TilesLoop(const function<void(int, int)> &tile) : tile{tile} {}
+  void operator()(const cv::Range &range) const override { tile(range.start, range.end); }
+  static void run(int rows, const function<void(int, int)> &tile) {
+    int tiles = (rows + DISPLAY_STAGES_TILE_ROWS - 1) / DISPLAY_STAGES_TILE_ROWS;
+    cv::parallel_for_(cv::Range{0, tiles}, TilesLoop{[&](int first, int last) {
+      tile(first * DISPLAY_STAGES_TILE_ROWS, min(rows, last * DISPLAY_STAGES_TILE_ROWS));
+    }});
+  }
+private:
+  function<void(int, int)> tile;
+};
+
+// Same mapping as cv::equalizeHist
+void equalization_lut(const Histogram &histogram, uint32_t total, LookupTable &lut) {
+  int first = 0;
+  while(first < 255 && histogram[first] == 0)
+    ++first;
+  if(histogram[first] == total) {
+    lut.fill(static_cast<uint8_t>(first));
+    return;
+  }
+  float scale = 255.f / (total - histogram[first]);
+  uint32_t sum = 0;
+  for(int i = 0; i < first; i++)
+    lut[i] = 0;
+  lut[first] = 0;
+  for(int i = first + 1; i < 256; i++) {
+    sum += histogram[i];
+    lut[i] = cv::saturate_cast<uint8_t>(sum * scale);
+  }
+}
+
+// HSV with S=255: the brightest channel is kept, the darkest goes to 0 and the middle one is rescaled to keep the hue.
+// Gray pixels have hue 0 in OpenCV, so they turn red, as with the HSV round trip.
+inline void saturate(uint8_t *pixel) {
+  uint8_t &r = pixel[0], &g = pixel[1], &b = pixel[2];
+  const int maximum = max(r, max(g, b));
+  const int minimum = min(r, min(g, b));
+  if(maximum == minimum) {
+    g = b = 0;
+    return;
+  }
+  auto rescale = [=](uint8_t &channel) {
+    channel = channel == maximum ? maximum : static_cast<uint8_t>((maximum * (channel - minimum) + (maximum - minimum) / 2) / (maximum - minimum));
+  };
+  rescale(r);
+  rescale(g);
+  rescale(b);
+}
+}
+
+DPTR_IMPL(DisplayStages) {
+  bool histogram_equalization = false;
+  bool maximum_saturation = false;
+  array<Histogram, 3> histograms;
+  array<LookupTable, 3> luts;
+  mutex histograms_mutex;
+
+  void compute_luts(const cv::Mat &image);
+};
+
+DisplayStages::DisplayStages() : dptr()
+{
+}
+
+DisplayStages::~DisplayStages()
+{
+}
+
+void DisplayStages::setHistogramEqualization(bool enable)
+{
+  d->histogram_equalization = enable;
+}
+
+void DisplayStages::setMaximumSaturation(bool enable)
+{
+  d->maximum_saturation = enable;
+}
+
+void DisplayStages::Private::compute_luts(const cv::Mat& image)
+{
+  const int channels = image.channels();
+  for(auto &histogram: histograms)
+    histogram.fill(0);
+  TilesLoop::run(image.rows, [&](int first_row, int last_row) {
+    array<Histogram, 3> tile_histograms{};
+    for(int row = first_row; row < last_row; row++) {
+      const uint8_t *pixel = image.ptr<uint8_t>(row);
+      for(int column = 0; column < image.cols; column++)
+        for(int channel = 0; channel < channels; channel++)
+          ++tile_histograms[channel][*pixel++];
+    }
+    lock_guard<mutex> lock(histograms_mutex);
+    for(int channel = 0; channel < channels; channel++)
+      for(int value = 0; value < 256; value++)
+        histograms[channel][value] += tile_histograms[channel][value];
+  });
+  for(int channel = 0; channel < channels; channel++)
+    equalization_lut(histograms[channel], image.total(), luts[channel]);
+}
+
+void DisplayStages::apply(cv::Mat& image)
+{
+  const int channels = image.channels();
+  const bool saturation = d->maximum_saturation && channels == 3;
+  if(image.depth() != CV_8U || image.empty() || (! d->histogram_equalization && ! saturation))
+    return;
+  if(d->histogram_equalization)
+    d->compute_luts(image);
+  // The only full image sweep: lookup and saturation are done on each pixel while it's in registers
+  TilesLoop::run(image.rows, [&](int first_row, int last_row) {
+    for(int row = first_row; row < last_row; row++) {
+      uint8_t *pixel = image.ptr<uint8_t>(row);
+      for(int column = 0; column < image.cols; column++, pixel += channels) {
+        if(d->histogram_equalization)
+          for(int channel = 0; channel < channels; channel++)
+            pixel[channel] = d->luts[channel][pixel[channel]];
+        if(saturation)
+          saturate(pixel);
+      }
+    }
+  });
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISPLAYSTAGES_H
+#define DISPLAYSTAGES_H
+
+#include "dptr.h"
+
+namespace cv {
+  class Mat;
+}
+
+/**
+ * Post processing chain for 8 bit display images, applied in place.
+ * Enabled per pixel stages are fused into a single sweep over horizontal tiles,
+ * and histogram and lookup buffers are reused across frames.
+ */
+class DisplayStages
+{
+public:
+  DisplayStages();
+  ~DisplayStages();
+  /// Per channel histogram equalization, matching cv::equalizeHist
+  void setHistogramEqualization(bool enable);
+  /// Saturation pushed to its maximum, keeping hue and value (as setting S to 255 in HSV space)
+  void setMaximumSaturation(bool enable);
+  /// Runs the enabled stages on a CV_8UC1 or CV_8UC3 (RGB) image. Saturation is ignored on grayscale images.
+  void apply(cv::Mat &image);
+private:
+  DPTR
+};
+
+#endif // DISPLAYSTAGES_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "displaysurface.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+namespace {
+struct Buffer {
+  cv::Mat mat;
+  DisplaySurface::Image image;
+};
+}
+
+DPTR_IMPL(DisplaySurface) {
+  Buffer buffers[3];
+  QMutex mutex;
+  // Only the worker moves back, only the view moves front: ready is exchanged by both, under the mutex
+  int back = 0;
+  int ready = 1;
+  int front = 2;
+  bool published = false;
+};
+
+DisplaySurface::DisplaySurface() : dptr()
+{
+}
+
+DisplaySurface::~DisplaySurface()
+{
+}
+
+cv::Mat &DisplaySurface::back()
+{
+  return d->buffers[d->back].mat;
+}
+
+void DisplaySurface::publish(const QRect &frameRect, const QSize &frameSize)
+{
+  auto &buffer = d->buffers[d->back];
+  const cv::Mat &mat = buffer.mat;
+  // Not owning the pixels: the buffer keeps them until it's the back one again
+  buffer.image = {
+    QImage{mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), mat.channels() == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888},
+    frameRect,
+    frameSize,
+  };
+  QMutexLocker lock(&d->mutex);
+  std::swap(d->back, d->ready);
+  d->published = true;
+}
+
+bool DisplaySurface::swap()
+{
+  QMutexLocker lock(&d->mutex);
+  if(! d->published)
+    return false;
+  std::swap(d->front, d->ready);
+  d->published = false;
+  return true;
+}
+
+const DisplaySurface::Image &DisplaySurface::front() const
+{
+  return d->buffers[d->front].image;
+}
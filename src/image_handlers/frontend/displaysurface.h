@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISPLAYSURFACE_H
+#define DISPLAYSURFACE_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <memory>
+#include "dptr.h"
+#include "commons/fwd.h"
+
+namespace cv {
+  class Mat;
+}
+
+FWD_PTR(DisplaySurface)
+
+/**
+ * Triple buffered display images, shared by the display worker and the view.
+ * The worker renders into the back buffer and publishes it; the view swaps the latest published buffer in front when it repaints.
+ * The worker never touches the front buffer, so the view can paint it straight from its pixels, without copies,
+ * and buffers are kept across frames: rendering into back() with OpenCV functions writing to an output matrix reuses their memory.
+ * back() and publish() are meant for one worker thread, swap() and front() for the GUI thread.
+ */
+class DisplaySurface
+{
+public:
+  struct Image {
+    /// CV_8UC1 or CV_8UC3 (RGB) pixels, as Format_Grayscale8 or Format_RGB888; valid until the next swap()
+    QImage image;
+    /// Part of the frame shown by image, in frame pixels (image may be downscaled)
+    QRect frameRect;
+    QSize frameSize;
+  };
+  DisplaySurface();
+  ~DisplaySurface();
+  cv::Mat &back();
+  /// The back buffer becomes the latest image, replacing one published before and not swapped in front yet
+  void publish(const QRect &frameRect, const QSize &frameSize);
+  /// Brings the latest published image in front; false if nothing was published since the last swap
+  bool swap();
+  const Image &front() const;
+private:
+  DPTR
+};
+
+#endif // DISPLAYSURFACE_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "edgedetection.h"
+#include "commons/metrics.h"
+#include "Qt/qt_strings_helper.h"
+#include <opencv2/opencv.hpp>
+#include <QDebug>
+#include <array>
+// OpenCV 2.4 has no transparent API: there, everything stays on the CPU
+#ifndef CV_VERSION_EPOCH
+#include <opencv2/core/ocl.hpp>
+#endif
+
+using namespace std;
+
+namespace {
+#ifdef CV_VERSION_EPOCH
+typedef cv::Mat Buffer;
+#else
+typedef cv::UMat Buffer;
+#endif
+
+enum Stage { Upload, Blur, Gray, Gradient, Edges, Compose, Download, Stages };
+const array<const char*, Stages> stage_names{{"upload", "blur", "gray", "gradient", "edges", "compose", "download"}};
+}
+
+DPTR_IMPL(EdgeDetection) {
+  bool opencl = false;
+  bool opencl_changed = true;
+  bool opencl_enabled = true;
+  Buffer source, blurred, gray, grad_x, grad_y, abs_grad_x, abs_grad_y, edges, result;
+  // Looked up once: per device, then per stage
+  array<array<Metrics::Histogram*, Stages>, 2> metrics;
+  void update_device();
+  template<typename F> void stage(Stage stage, F run);
+};
+
+EdgeDetection::EdgeDetection() : dptr()
+{
+  for(int device = 0; device < 2; device++)
+    for(int stage = 0; stage < Stages; stage++)
+      d->metrics[device][stage] = &Metrics::instance().histogram("display_edge_detection_stage_seconds", "Time spent on each stage of the display edge detection",
+        "stage=\"%1\",device=\"%2\""_q % stage_names[stage] % (device ? "opencl" : "cpu"));
+}
+
+EdgeDetection::~EdgeDetection()
+{
+}
+
+void EdgeDetection::setOpenCL(bool enable)
+{
+  d->opencl_changed = d->opencl_changed || enable != d->opencl_enabled;
+  d->opencl_enabled = enable;
+}
+
+void EdgeDetection::Private::update_device()
+{
+  if(! opencl_changed)
+    return;
+  opencl_changed = false;
+#ifndef CV_VERSION_EPOCH
+  // OpenCV keeps this switch per thread: other threads using the transparent API aren't affected
+  cv::ocl::setUseOpenCL(opencl_enabled && cv::ocl::haveOpenCL());
+  opencl = cv::ocl::useOpenCL();
+  if(opencl)
+    qDebug() << "Edge detection on OpenCL device" << cv::ocl::Device::getDefault().name().c_str();
+#endif
+}
+
+template<typename F> void EdgeDetection::Private::stage(Stage stage, F run)
+{
+  Metrics::Timer timer{*metrics[opencl][stage]};
+  run();
+#ifndef CV_VERSION_EPOCH
+  // OpenCL calls are only queued: wait for them, so that each stage gets its own time
+  if(opencl)
+    cv::ocl::finish();
+#endif
+}
+
+void EdgeDetection::sobel(cv::Mat &image, int blur_size, int kernel_size, double scale, double delta)
+{
+  d->update_device();
+  d->stage(Upload, [&]{ image.copyTo(d->source); });
+  d->stage(Blur, [&]{ cv::GaussianBlur(d->source, d->blurred, {blur_size, blur_size}, 0, 0); });
+  // Pointing to the gray image rather than sharing buffers, so that a buffer is never input and output of the same stage
+  Buffer *gray = &d->blurred;
+  d->stage(Gray, [&]{
+    if(d->blurred.channels() != 1) {
+      cv::cvtColor(d->blurred, d->gray, cv::COLOR_RGB2GRAY);
+      gray = &d->gray;
+    }
+  });
+  d->stage(Gradient, [&]{
+    cv::Sobel(*gray, d->grad_x, CV_32F, 1, 0, kernel_size, scale, delta);
+    cv::Sobel(*gray, d->grad_y, CV_32F, 0, 1, kernel_size, scale, delta);
+  });
+  d->stage(Compose, [&]{
+    cv::convertScaleAbs(d->grad_x, d->abs_grad_x);
+    cv::convertScaleAbs(d->grad_y, d->abs_grad_y);
+    cv::addWeighted(d->abs_grad_x, 0.5, d->abs_grad_y, 0.5, 0, d->result);
+  });
+  d->stage(Download, [&]{ d->result.copyTo(image); });
+}
+
+void EdgeDetection::canny(cv::Mat &image, double low_threshold, double ratio, int kernel_size, int blur_size)
+{
+  d->update_device();
+  d->stage(Upload, [&]{ image.copyTo(d->source); });
+  Buffer *gray = &d->source;
+  d->stage(Gray, [&]{
+    if(d->source.channels() != 1) {
+      cv::cvtColor(d->source, d->gray, cv::COLOR_RGB2GRAY);
+      gray = &d->gray;
+    }
+  });
+  d->stage(Blur, [&]{ cv::blur(*gray, d->blurred, {blur_size, blur_size}); });
+  d->stage(Edges, [&]{ cv::Canny(d->blurred, d->edges, low_threshold, low_threshold * ratio, kernel_size); });
+  d->stage(Compose, [&]{
+    d->result.create(d->source.size(), d->source.type());
+    d->result.setTo(cv::Scalar::all(0));
+    d->source.copyTo(d->result, d->edges);
+  });
+  d->stage(Download, [&]{ d->result.copyTo(image); });
+}
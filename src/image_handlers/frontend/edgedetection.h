@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EDGEDETECTION_H
+#define EDGEDETECTION_H
+
+#include "dptr.h"
+
+namespace cv {
+  class Mat;
+}
+
+/**
+ * Sobel and Canny edge previews for 8 bit display images, on OpenCV transparent API buffers:
+ * with an OpenCL device (integrated GPUs included) the stages run there, otherwise on the CPU, with the same results.
+ * Intermediate buffers are kept across frames, and reallocated only when the image size or type changes.
+ * Each stage is timed in the display_edge_detection_stage_seconds metric, labelled with the stage and the device.
+ * Not thread safe: meant for the display thread only.
+ */
+class EdgeDetection
+{
+public:
+  EdgeDetection();
+  ~EdgeDetection();
+  /// Uses OpenCL if enabled and a device is there; takes effect on the calling thread, with the next image
+  void setOpenCL(bool enable);
+  /// Replaces image with its gradient magnitude (CV_8UC1)
+  void sobel(cv::Mat &image, int blur_size, int kernel_size, double scale, double delta);
+  /// Keeps only the image pixels on the Canny edges, the others go black
+  void canny(cv::Mat &image, double low_threshold, double ratio, int kernel_size, int blur_size);
+private:
+  DPTR
+};
+
+#endif // EDGEDETECTION_H
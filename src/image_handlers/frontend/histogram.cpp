@@ -20,18 +20,22 @@
 #include <functional>
 #include <opencv2/opencv.hpp>
 
-#include <QtConcurrent/QtConcurrent>
 #include "commons/configuration.h"
 #include "commons/frame.h"
+#include "commons/frameanalysis.h"
 #include <atomic>
+#include <thread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
 #include "c++/stringbuilder.h"
 
-#include <opencv2/opencv.hpp>
-#include <QImage>
 #include <cmath>
 #include "c++/stlutils.h"
-#include <QColor>
-#include "histLib.h"
+#include "commons/pixel_kernels.h"
+#include "commons/debayer.h"
+#include "commons/metrics.h"
+#include "commons/tracking.h"
 
 using namespace std;
 
@@ -39,51 +43,63 @@ DPTR_IMPL(Histogram) {
   const Configuration &configuration;
   Histogram *q;
   atomic_bool recording;
-  atomic_bool histogram_disable_on_recording;
-  atomic_long histogram_timeout;
-  atomic_long histogram_timeout_recording;
   QElapsedTimer last;
-  size_t bins_size;
-  bool should_read_frame() const;
-  bool logarithmic = false;
-  Channel channel = All;
+  atomic<size_t> bins_size;
+  bool should_read_frame();
+  atomic_bool logarithmic{false};
+  atomic<Channel> channel{All};
+  atomic_bool suspended{false};
+  // Single slot mailbox for the worker: a frame arriving while one is processed replaces the waiting one
+  QMutex mailbox_mutex;
+  QWaitCondition mailbox_changed;
   FrameConstPtr last_frame;
+  FrameConstPtr pending;
+  bool running = true;
+  atomic<qint64> last_duration_ms{0};
+  QMutex tracked_mutex;
+  QPointF tracked;
+  QElapsedTimer tracked_at;
+  /// Part of the frame to count, as configured
+  cv::Rect region(const FrameConstPtr &frame, const Configuration::Snapshot &settings);
+  void post(const FrameConstPtr &frame);
+  void run();
   void handle(FrameConstPtr frame);
   struct HistogramOutput {
-    cv::Mat histogram;
+    QVector<float> bins;
     QVariantMap stats;
   };
-  HistogramOutput calcHistogram(const cv::Mat &source, int bpp);
-  HistogramOutput calcHistogramStats(const cv::Mat &source, cv::Mat &histogram, int bpp);
-  cv::Mat getHistogramImage(const cv::Mat &source) const;
-  CHistLib histLib;
+  atomic_bool remote{false};
+  QMutex summaries_mutex;
+  QMap<Channel, HistogramSummary> last_summaries;
+  /// Plot bins and statistics of the shown channels
+  void present(const QMap<Channel, HistogramSummary> &summaries);
+  /// Plot bins and statistics of a channel
+  HistogramOutput calcHistogramStats(const HistogramSummary &summary);
+  thread worker;
 };
 
-cv::Mat Histogram::Private::getHistogramImage(const cv::Mat& source) const
-{
-  qDebug() << "histogram frame bpp: " << source.depth();
-  if(source.depth() == CV_8U || source.depth() == CV_8S)
-    return source;
-  cv::Mat dest;
-  source.convertTo(dest, CV_8U, 1. / 256);
-  return dest;
-}
-
 
 Histogram::~Histogram()
 {
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    d->running = false;
+  }
+  d->mailbox_changed.wakeAll();
+  d->worker.join();
 }
 
 Histogram::Histogram(const Configuration &configuration, QObject* parent) : QObject(parent), dptr(configuration, this)
 {
   d->last.start();
   d->recording = false;
-  read_settings();
+  d->worker = thread{&Private::run, d.get()};
   static bool metatypes_registered = false;
   if(!metatypes_registered) {
     metatypes_registered = true;
     qRegisterMetaType<Histogram::Channel>("Histogram::Channel");
     qRegisterMetaType<QMap<Histogram::Channel, QVariantMap>>("QMap<Histogram::Channel, QVariantMap>");
+    qRegisterMetaType<QMap<Histogram::Channel, QVector<float>>>("QMap<Histogram::Channel, QVector<float>>");
   }
 }
 
@@ -92,113 +108,178 @@ void Histogram::doHandle(FrameConstPtr frame)
   if( ! d->should_read_frame() )
     return;
   d->last.restart();
-  QtConcurrent::run(bind(&Private::handle, d.get(), frame));
-  d->last_frame = frame;
+  d->post(frame);
 }
 
-void Histogram::Private::handle(FrameConstPtr frame)
+void Histogram::Private::post(const FrameConstPtr& frame)
 {
-  BENCH(_histogram)->every(5)->ms();
-  cv::Mat source;
+  {
+    QMutexLocker lock(&mailbox_mutex);
+    pending = frame;
+    last_frame = frame;
+  }
+  mailbox_changed.wakeOne();
+}
 
-  static const  int hist_h = 600;
-  histLib.SetHistImageHeight(hist_h);
-  histLib.SetDrawSpreadOut(true);
+void Histogram::Private::run()
+{
+  while(true) {
+    FrameConstPtr frame;
+    {
+      QMutexLocker lock(&mailbox_mutex);
+      while(running && ! pending)
+        mailbox_changed.wait(&mailbox_mutex);
+      if(! running)
+        return;
+      swap(frame, pending);
+    }
+    QElapsedTimer duration;
+    duration.start();
+    handle(frame);
+    last_duration_ms = duration.elapsed();
+  }
+}
 
-  cv::Mat plot;
-  QMap<Histogram::Channel, QVariantMap> histogramStats;
+void Histogram::Private::handle(FrameConstPtr frame)
+{
+  static auto &histogram_metric = Metrics::instance().histogram("histogram_compute_seconds", "Time spent computing the histogram");
+  Metrics::Timer timer{histogram_metric};
 
-  vector<cv::Mat> channels(3);
   static map<Frame::ColorFormat, map<Channel, int>> channel_indexes {
     {Frame::RGB, { {Red, 0}, {Green, 1 }, {Blue, 2} }},
     {Frame::BGR, { {Red, 2}, {Green, 1 }, {Blue, 0} }},
   };
 
-  frame->mat().copyTo(source);
-  if(frame->channels() == 1) {
-    channel = Grayscale;
-  }
-  else {
-    cv::split(source, channels);
+  // The only pass over the frame: everything else is derived from the counts of each value
+  const auto settings = configuration.snapshot();
+  const auto area = region(frame, *settings);
+  // Superpixels: colours from the samples as they are, no interpolated values
+  const auto &counts = frame->analysis().histogram(area, settings->histogram_sampling_step, settings->histogram_debayer);
+  auto format = frame->colorFormat();
+  if(counts.size() == 3 && Debayer::is_bayer(format))
+    format = Frame::RGB;
+  QMap<Channel, HistogramSummary> summaries;
+  if(counts.size() == 1)
+    summaries[Grayscale] = HistogramSummary::from_counts(counts[0], frame->bpp());
+  else
+    for(auto shown: {Red, Green, Blue})
+      summaries[shown] = HistogramSummary::from_counts(counts[channel_indexes[format][shown]], frame->bpp());
+  present(summaries);
+}
+
+void Histogram::received(const QList<HistogramSummary> &channels)
+{
+  d->remote = true;
+  QMap<Channel, HistogramSummary> summaries;
+  if(channels.size() == 1)
+    summaries[Grayscale] = channels[0];
+  else if(channels.size() == 3)
+    summaries = {{Red, channels[0]}, {Green, channels[1]}, {Blue, channels[2]}};
+  else
+    return;
+  d->present(summaries);
+}
+
+void Histogram::Private::present(const QMap<Channel, HistogramSummary> &summaries)
+{
+  {
+    QMutexLocker lock(&summaries_mutex);
+    last_summaries = summaries;
   }
-  if(channel != Grayscale && channel != All) {
-    source = channels[ channel_indexes[frame->colorFormat()][channel] ];
+  if(summaries.contains(Grayscale))
+    this->channel = Grayscale;
+  else if(this->channel == Grayscale)
+    this->channel = All;
+  const Channel channel = this->channel;
+  QMap<Histogram::Channel, QVector<float>> bins;
+  QMap<Histogram::Channel, QVariantMap> histogramStats;
+  for(auto shown: channel == All ? QList<Channel>{Red, Green, Blue} : QList<Channel>{channel}) {
+    auto out = calcHistogramStats(summaries[shown]);
+    bins[shown] = out.bins;
+    histogramStats[shown] = out.stats;
   }
+  emit q->histogram(bins, histogramStats, channel);
+}
 
-  if(channel !=  All) {
-    static QMap<Channel, cv::Scalar> colors {
-      {Grayscale, HIST_LIB_COLOR_WHITE},
-      {Red, HIST_LIB_COLOR_RED},
-      {Green, HIST_LIB_COLOR_GREEN},
-      {Blue, HIST_LIB_COLOR_BLUE},
-    };
-    histLib.SetPlotColor(colors[channel]);
-    cv::MatND hist;
-    histLib.ComputeHistogramValue(getHistogramImage(source), hist);
-
-    HistogramOutput out = calcHistogramStats(source, hist, frame->bpp());
-    histogramStats[channel] = out.stats;
-
-    histLib.DrawHistogramValue(out.histogram, plot);
+cv::Rect Histogram::Private::region(const FrameConstPtr &frame, const Configuration::Snapshot &settings)
+{
+  const cv::Mat &image = frame->mat();
+  const cv::Rect whole{0, 0, image.cols, image.rows};
+  cv::Rect region;
+  switch(settings.histogram_region) {
+    case Configuration::HistogramRectangle: {
+      const QRect &rect = settings.histogram_region_rect;
+      region = cv::Rect{rect.x(), rect.y(), rect.width(), rect.height()} & whole;
+      break;
+    }
+    case Configuration::HistogramTracked:
+    case Configuration::HistogramCentroid: {
+      const int size = settings.histogram_region_size;
+      if(size <= 0)
+        break;
+      QPointF centre;
+      bool tracking = false;
+      if(settings.histogram_region == Configuration::HistogramTracked) {
+        // A position the tracker hasn't updated for a while belongs to a lost, or cleared, target
+        QMutexLocker lock(&tracked_mutex);
+        tracking = tracked_at.isValid() && tracked_at.elapsed() < 2000;
+        centre = tracked;
+      }
+      if(! tracking)
+        return frame->analysis().centred_window(size);
+      region.width = min(size, image.cols);
+      region.height = min(size, image.rows);
+      region.x = max(0, min(static_cast<int>(centre.x()) - region.width / 2, image.cols - region.width));
+      region.y = max(0, min(static_cast<int>(centre.y()) - region.height / 2, image.rows - region.height));
+      break;
+    }
+    default:
+      break;
   }
-  else {
-    cv::MatND histB, histR, histG;
-    histLib.ComputeHistogramBGR(getHistogramImage(source), histB, histG, histR);
-
-    histogramStats[Red]  = calcHistogramStats(channels[ channel_indexes[frame->colorFormat()][Red] ], histR, frame->bpp()).stats;
-    histogramStats[Green]  = calcHistogramStats(channels[ channel_indexes[frame->colorFormat()][Green] ], histG, frame->bpp()).stats;
-    histogramStats[Blue]  = calcHistogramStats(channels[ channel_indexes[frame->colorFormat()][Blue] ], histB, frame->bpp()).stats;
-
-    histLib.DrawHistogramBGR(histB, histG, histR, plot);
+  if(region.area() <= 0)
+    return whole;
+  // Whole Bayer cells, so that the colours keep their proportions
+  if(image.channels() == 1 && frame->colorFormat() != Frame::Mono) {
+    region.x &= ~1;
+    region.y &= ~1;
   }
-  QImage hist_qimage(plot.data, plot.cols, plot.rows, static_cast<int>(plot.step), QImage::Format_RGB888);
-  emit q->histogram(hist_qimage.rgbSwapped(), histogramStats, channel);
+  return region;
 }
 
-
-Histogram::Private::HistogramOutput Histogram::Private::calcHistogram(const cv::Mat& source, int bpp)
+void Histogram::trackingPositionChanged(const QPointF &position, const QDateTime &)
 {
-  cv::Mat hist;
-  int nimages = 1;
-  int channels[]{0};
-  int dims = 1;
-  int bins []{static_cast<int>(bins_size)};
-  float range[]{0, static_cast<float>( pow(2, bpp)-1 ) };
-  const float *ranges[]{range};
-
-  cv::calcHist(&source, nimages, channels, cv::Mat{}, hist, dims, bins, ranges);
-  return calcHistogramStats(source, hist, bpp);
+  QMutexLocker lock(&d->tracked_mutex);
+  d->tracked = position;
+  d->tracked_at.start();
 }
 
-Histogram::Private::HistogramOutput Histogram::Private::calcHistogramStats(const cv::Mat& source, cv::Mat& histogram, int bpp)
+Histogram::Private::HistogramOutput Histogram::Private::calcHistogramStats(const HistogramSummary &summary)
 {
-  auto maxBin =  pow(2, bpp)-1;
-  auto top_bin_it = max_element(histogram.begin<float>(), histogram.end<float>());
-  auto top_bin_position = top_bin_it - histogram.begin<float>();
+  auto maxBin =  pow(2, summary.bpp)-1;
+  // Same bins as calcHist over the 8 bit conversion of the frame
+  QVector<float> histogram(static_cast<int>(bins_size), 0);
+  for(size_t bin = 0; bin < summary.bins.size(); bin++)
+    histogram[bin * bins_size / 256] += summary.bins[bin];
+
+  auto top_bin_it = max_element(histogram.begin(), histogram.end());
+  auto top_bin_position = top_bin_it - histogram.begin();
   auto top_bin_value_min = maxBin/bins_size * top_bin_position;
   auto top_bin_value_max = top_bin_value_min + (maxBin/bins_size);
 
   if(logarithmic)
-    transform(histogram.begin<float>(), histogram.end<float>(), histogram.begin<float>(), [](float n){ return n==0?0:log10(n); });
-
-
-  vector<uint16_t> mat_data;
-  source.reshape(1, 1).copyTo(mat_data);
-  uint16_t min_value = *min_element(begin(mat_data), end(mat_data));
-  uint16_t max_value = *max_element(begin(mat_data), end(mat_data));
-
+    transform(histogram.begin(), histogram.end(), histogram.begin(), [](float n){ return n==0?0:log10(n); });
 
   QVariantMap stats{
-    {"shadows_value", min_value},
-    {"shadows_count", static_cast<int>(count(begin(mat_data), end(mat_data), min_value))},
-    {"highlights_value", max_value},
-    {"highlights_count", static_cast<int>(count(begin(mat_data), end(mat_data), max_value))},
+    {"shadows_value", summary.shadows_value},
+    {"shadows_count", static_cast<int>(summary.shadows_count)},
+    {"highlights_value", summary.highlights_value},
+    {"highlights_count", static_cast<int>(summary.highlights_count)},
     {"maximum_value_min", top_bin_value_min},
     {"maximum_value_max", top_bin_value_max},
     {"maximum_value_percent", 100. * top_bin_position / bins_size},
     {"range_min", 0},
     {"range_max", maxBin},
-    {"pixels", source.rows * source.cols},
+    {"pixels", static_cast<int>(summary.pixels)},
   };
   return {histogram, stats};
 }
@@ -206,8 +287,8 @@ Histogram::Private::HistogramOutput Histogram::Private::calcHistogramStats(const
 
 void Histogram::set_bins(size_t bins_size)
 {
+  // Only read by the worker, which picks up the new size on its next run
   d->bins_size = bins_size;
-  d->histLib.SetBinCount(bins_size);
 }
 
 void Histogram::setRecording(bool recording)
@@ -215,19 +296,28 @@ void Histogram::setRecording(bool recording)
   d->recording = recording;
 }
 
-void Histogram::read_settings()
+void Histogram::setSuspended(bool suspended)
 {
-  d->histogram_disable_on_recording = d->configuration.histogram_disable_on_recording();
-  d->histogram_timeout = d->configuration.histogram_timeout();
-  d->histogram_timeout_recording = d->configuration.histogram_timeout_recording();
+  d->suspended = suspended;
 }
 
-
-bool Histogram::Private::should_read_frame() const // TODO read limits only once, when changed
+bool Histogram::Private::should_read_frame()
 {
-  if( recording && histogram_disable_on_recording  )
+  if( suspended || remote )
     return false;
-  return !last_frame || last.elapsed() >= (recording ? histogram_timeout_recording : histogram_timeout );
+  const auto settings = configuration.snapshot();
+  if( recording && settings->histogram_disable_on_recording  )
+    return false;
+  qint64 interval = recording ? settings->histogram_timeout_recording : settings->histogram_timeout;
+  // Space runs so that the worker stays within its share of one core
+  if(settings->histogram_cpu_budget > 0)
+    interval = max<qint64>(interval, last_duration_ms * 100 / settings->histogram_cpu_budget);
+  bool has_frame;
+  {
+    QMutexLocker lock(&mailbox_mutex);
+    has_frame = static_cast<bool>(last_frame);
+  }
+  return ! has_frame || last.elapsed() >= interval;
 }
 
 void Histogram::setLogarithmic(bool logarithmic)
@@ -243,6 +333,21 @@ Histogram::Channel Histogram::channel() const
 void Histogram::setChannel(Histogram::Channel channel)
 {
   d->channel = channel;
-  if(d->last_frame)
-    d->handle(d->last_frame);
+  if(d->remote) {
+    QMap<Channel, HistogramSummary> summaries;
+    {
+      QMutexLocker lock(&d->summaries_mutex);
+      summaries = d->last_summaries;
+    }
+    if(! summaries.isEmpty())
+      d->present(summaries);
+    return;
+  }
+  FrameConstPtr last_frame;
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    last_frame = d->last_frame;
+  }
+  if(last_frame)
+    d->post(last_frame);
 }
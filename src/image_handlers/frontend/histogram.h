@@ -20,10 +20,12 @@
 #define HISTOGRAM_H
 
 #include <QtCore>
+#include <QVector>
 #include "image_handlers/imagehandler.h"
 #include "dptr.h"
 #include "commons/configuration.h"
 #include "commons/fwd.h"
+#include "commons/histogramsummary.h"
 
 FWD_PTR(Histogram)
 
@@ -42,13 +44,22 @@ public:
   Histogram(const Configuration &configuration, QObject* parent = 0);
   void set_bins(std::size_t bins_size);
   void setRecording(bool recording);
+  /// No refreshes at all while suspended, i.e. while the recording writer falls behind
+  void setSuspended(bool suspended);
   void setLogarithmic(bool logarithmic);
   Channel channel() const;
+  /// Meant for a direct connection to ImgTracker::trackingPositionChanged, for the HistogramTracked region
+  void trackingPositionChanged(const QPointF &position, const QDateTime &frameTime);
+  /**
+   * Summaries computed where the raw frames are (the server, for remote sessions: see HistogramForwarder), one for grayscale frames,
+   * red, green and blue otherwise. From then on, frames handled here are ignored. Any thread
+   */
+  void received(const QList<HistogramSummary> &channels);
 public slots:
-  void read_settings();
   void setChannel(Channel channel);
 signals:
-  void histogram(const QImage &, const QMap<Histogram::Channel, QVariantMap> &, Histogram::Channel channel);
+  /// Bins of each channel shown (logarithmic if so set), with their statistics: plotting is left to the widget, at its own size
+  void histogram(const QMap<Histogram::Channel, QVector<float>> &bins, const QMap<Histogram::Channel, QVariantMap> &stats, Histogram::Channel channel);
 private:
 
   void doHandle(FrameConstPtr frame) override;
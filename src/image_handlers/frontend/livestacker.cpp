@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "livestacker.h"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <thread>
+#include <boost/endian/conversion.hpp>
+#include "commons/frame.h"
+#include "commons/frame_quality.h"
+#include "commons/pixel_kernels.h"
+#include "commons/tracking.h"
+
+using namespace std;
+
+// Rows per parallel stripe of the accumulator update
+#define LIVE_STACKER_STRIPE_ROWS 32
+// Frames kept while waiting for the tracker to report their position
+#define LIVE_STACKER_UNTRACKED_FRAMES 8
+// Frames the sharpness rank is computed against
+#define LIVE_STACKER_QUALITY_WINDOW 100
+// Frames merged before sigma clipping starts
+#define LIVE_STACKER_CLIPPING_MIN_FRAMES 3
+
+namespace {
+class StripesLoop : public cv::ParallelLoopBody {
+public:
+  StripesLoop(const function<void(int, int)> &stripe) : stripe{stripe} {}
+  void operator()(const cv::Range &range) const override { stripe(range.start, range.end); }
+  static void run(int rows, const function<void(int, int)> &stripe) {
+    int stripes = (rows + LIVE_STACKER_STRIPE_ROWS - 1) / LIVE_STACKER_STRIPE_ROWS;
+    cv::parallel_for_(cv::Range{0, stripes}, StripesLoop{[&](int first, int last) {
+      stripe(first * LIVE_STACKER_STRIPE_ROWS, min(rows, last * LIVE_STACKER_STRIPE_ROWS));
+    }});
+  }
+private:
+  function<void(int, int)> stripe;
+};
+
+struct Aligned {
+  FrameConstPtr frame;
+  QPointF position;
+  bool tracked;
+};
+}
+
+DPTR_IMPL(LiveStacker) {
+  const Configuration &configuration;
+  const ImgTrackerPtr tracker;
+  const ImageHandlerPtr output;
+  LiveStacker *q;
+  atomic_bool enabled{false};
+
+  // Mailbox for the worker; frames waiting for their tracked position are kept in 'untracked'
+  QMutex mailbox_mutex;
+  QWaitCondition mailbox_changed;
+  deque<FrameConstPtr> untracked;
+  Aligned pending;
+  bool reset_requested = false;
+  bool running = true;
+
+  // Worker only
+  struct Stack {
+    cv::Mat mean;  ///< Running mean of each pixel and channel
+    cv::Mat m2;    ///< Running sum of squared deviations from the mean (Welford)
+    cv::Mat count; ///< Samples merged into each pixel and channel
+    QPointF reference;
+    bool tracked = false;
+    int depth = CV_8U;
+    int frames = 0;
+    int rejected = 0;
+    QElapsedTimer published;
+  } stack;
+  unique_ptr<FrameQuality::Selector> selector;
+
+  void run();
+  void add(const Aligned &aligned);
+  cv::Mat toFloat(const FrameConstPtr &frame) const;
+  void merge(const cv::Mat &image, const cv::Rect &area);
+  void publish();
+  thread worker;
+};
+
+LiveStacker::~LiveStacker()
+{
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    d->running = false;
+  }
+  d->mailbox_changed.wakeAll();
+  d->worker.join();
+}
+
+LiveStacker::LiveStacker(const Configuration &configuration, const ImgTrackerPtr &tracker, const ImageHandlerPtr &output, QObject* parent)
+  : QObject(parent), dptr(configuration, tracker, output, this)
+{
+  d->worker = thread{&Private::run, d.get()};
+}
+
+bool LiveStacker::enabled() const
+{
+  return d->enabled;
+}
+
+void LiveStacker::setEnabled(bool enabled)
+{
+  // Each stacking session starts from scratch: the old reference position is meaningless by now
+  if(enabled)
+    reset();
+  d->enabled = enabled;
+}
+
+void LiveStacker::reset()
+{
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    d->reset_requested = true;
+    d->pending = {};
+    d->untracked.clear();
+  }
+  d->mailbox_changed.wakeOne();
+}
+
+void LiveStacker::doHandle(FrameConstPtr frame)
+{
+  if(! d->enabled || ! frame->mat().data)
+    return;
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    if(d->tracker->getTrackingMode() != ImgTracker::TrackingMode::Disabled) {
+      d->untracked.push_back(frame);
+      if(d->untracked.size() > LIVE_STACKER_UNTRACKED_FRAMES)
+        d->untracked.pop_front();
+      return;
+    }
+    d->untracked.clear();
+    d->pending = {frame, {}, false};
+  }
+  d->mailbox_changed.wakeOne();
+}
+
+void LiveStacker::trackingPositionChanged(const QPointF &position, const QDateTime &frameTime)
+{
+  if(! d->enabled)
+    return;
+  {
+    QMutexLocker lock(&d->mailbox_mutex);
+    auto frame = find_if(d->untracked.begin(), d->untracked.end(), [&](const FrameConstPtr &f) { return f->created_utc() == frameTime; });
+    if(frame == d->untracked.end())
+      return;
+    d->pending = {*frame, position, true};
+    // Older frames will not be tracked anymore: the tracker always works on the latest one
+    d->untracked.erase(d->untracked.begin(), frame + 1);
+  }
+  d->mailbox_changed.wakeOne();
+}
+
+void LiveStacker::Private::run()
+{
+  while(true) {
+    Aligned aligned{};
+    bool reset;
+    {
+      QMutexLocker lock(&mailbox_mutex);
+      while(running && ! pending.frame && ! reset_requested)
+        mailbox_changed.wait(&mailbox_mutex);
+      if(! running)
+        return;
+      swap(aligned, pending);
+      reset = reset_requested;
+      reset_requested = false;
+    }
+    if(reset) {
+      stack = {};
+      selector.reset();
+      emit q->stacked(0, 0);
+    }
+    if(aligned.frame)
+      add(aligned);
+  }
+}
+
+cv::Mat LiveStacker::Private::toFloat(const FrameConstPtr &frame) const
+{
+  cv::Mat image = frame->mat();
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  if(image.depth() == CV_16U && (native_little_endian ? frame->byteOrder() == Frame::BigEndian : frame->byteOrder() == Frame::LittleEndian))
+    image = PixelKernels::swap16(image);
+  static const map<Frame::ColorFormat, int> bayer_patterns {
+    // Same mapping as DisplayImage
+    {Frame::Bayer_RGGB, cv::COLOR_BayerRG2BGR},
+    {Frame::Bayer_GBRG, cv::COLOR_BayerGB2BGR},
+    {Frame::Bayer_GRBG, cv::COLOR_BayerGR2BGR},
+    {Frame::Bayer_BGGR, cv::COLOR_BayerBG2BGR},
+  };
+  auto pattern = bayer_patterns.find(frame->colorFormat());
+  if(pattern != bayer_patterns.end())
+    cv::cvtColor(image, image, pattern->second);
+  else if(frame->colorFormat() == Frame::RGB)
+    cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+  cv::Mat result;
+  image.convertTo(result, CV_MAKETYPE(CV_32F, image.channels()));
+  return result;
+}
+
+void LiveStacker::Private::add(const Aligned &aligned)
+{
+  const int percent = configuration.live_stacking_keep_best_percent();
+  if(percent > 0 && percent < 100) {
+    if(! selector)
+      selector = make_unique<FrameQuality::Selector>(percent, LIVE_STACKER_QUALITY_WINDOW);
+    if(! selector->keep(FrameQuality::sharpness(aligned.frame))) {
+      emit q->stacked(stack.frames, ++stack.rejected);
+      return;
+    }
+  }
+
+  const cv::Mat image = toFloat(aligned.frame);
+  if(stack.mean.size() != image.size() || stack.mean.type() != image.type() || stack.tracked != aligned.tracked) {
+    // First frame, or the ROI, format or tracking changed: start over with this frame as the reference
+    stack = {};
+    stack.mean = image.clone();
+    stack.m2 = cv::Mat::zeros(image.size(), image.type());
+    stack.count = cv::Mat(image.size(), image.type(), cv::Scalar::all(1));
+    stack.reference = aligned.position;
+    stack.tracked = aligned.tracked;
+    stack.depth = aligned.frame->mat().depth();
+    stack.frames = 1;
+    publish();
+    return;
+  }
+
+  const QPointF shift = stack.reference - aligned.position;
+  cv::Mat shifted;
+  const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, shift.x(), 0, 1, shift.y());
+  cv::warpAffine(image, shifted, translation, image.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+  // Only the pixels actually covered by the shifted frame, with a one pixel margin for the interpolation
+  const cv::Rect covered = cv::Rect{0, 0, image.cols, image.rows} &
+                           cv::Rect{static_cast<int>(ceil(shift.x())) + 1, static_cast<int>(ceil(shift.y())) + 1, image.cols - 3, image.rows - 3};
+  if(covered.area() == 0) {
+    emit q->stacked(stack.frames, ++stack.rejected);
+    return;
+  }
+  merge(shifted(covered), covered);
+  ++stack.frames;
+  emit q->stacked(stack.frames, stack.rejected);
+  if(stack.published.elapsed() >= 500)
+    publish();
+}
+
+void LiveStacker::Private::merge(const cv::Mat &image, const cv::Rect &area)
+{
+  // Welford's running mean and variance; samples further than 'sigma' standard deviations from the mean are clipped.
+  // One unit of variance is always allowed, so that noiseless early samples don't reject everything after them.
+  const float sigma = static_cast<float>(configuration.live_stacking_sigma());
+  const float sigma2 = sigma * sigma;
+  const bool clip = sigma > 0;
+  const int values = area.width * image.channels();
+  cv::Mat mean = stack.mean(area), m2 = stack.m2(area), count = stack.count(area);
+  StripesLoop::run(area.height, [&](int first_row, int last_row) {
+    for(int row = first_row; row < last_row; row++) {
+      const float *sample = image.ptr<float>(row);
+      float *pixel_mean = mean.ptr<float>(row);
+      float *pixel_m2 = m2.ptr<float>(row);
+      float *pixel_count = count.ptr<float>(row);
+      for(int i = 0; i < values; i++) {
+        const float n = pixel_count[i];
+        const float delta = sample[i] - pixel_mean[i];
+        if(clip && n >= LIVE_STACKER_CLIPPING_MIN_FRAMES && delta * delta > sigma2 * (pixel_m2[i] / (n - 1) + 1))
+          continue;
+        pixel_count[i] = n + 1;
+        pixel_mean[i] += delta / (n + 1);
+        pixel_m2[i] += delta * (sample[i] - pixel_mean[i]);
+      }
+    }
+  });
+}
+
+void LiveStacker::Private::publish()
+{
+  stack.published.restart();
+  cv::Mat result;
+  stack.mean.convertTo(result, CV_MAKETYPE(stack.depth, stack.mean.channels()));
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  output->handle(make_shared<Frame>(result.channels() == 3 ? Frame::BGR : Frame::Mono, result,
+                                    native_little_endian ? Frame::LittleEndian : Frame::BigEndian, Frame::ShareBuffer));
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIVESTACKER_H
+#define LIVESTACKER_H
+
+#include <QtCore>
+#include "image_handlers/imagehandler.h"
+#include "dptr.h"
+#include "commons/configuration.h"
+#include "commons/fwd.h"
+
+FWD_PTR(LiveStacker)
+FWD_PTR(ImgTracker)
+
+/**
+ * Live align and stack for the preview.
+ * Frames are aligned on the ImgTracker positions (or stacked as they are when tracking is disabled),
+ * filtered by sharpness, and merged into a running per-pixel mean with sigma clipping.
+ * The stack is handed to the output handler, typically a DisplayImage, at most twice per second.
+ * All the work happens on a worker thread, always on the latest aligned frame.
+ */
+class LiveStacker : public QObject, public ImageHandler
+{
+  Q_OBJECT
+public:
+  ~LiveStacker();
+  LiveStacker(const Configuration &configuration, const ImgTrackerPtr &tracker, const ImageHandlerPtr &output, QObject* parent = 0);
+  bool enabled() const;
+public slots:
+  void setEnabled(bool enabled);
+  /// Discards the stack; the next frame becomes the new reference
+  void reset();
+  /// Meant for a direct connection to ImgTracker::trackingPositionChanged
+  void trackingPositionChanged(const QPointF &position, const QDateTime &frameTime);
+signals:
+  /// Number of frames merged so far, and of frames rejected as not sharp enough
+  void stacked(int frames, int rejected);
+private:
+
+  void doHandle(FrameConstPtr frame) override;
+
+  DPTR
+};
+
+#endif // LIVESTACKER_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "imagehandler.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <array>
+#include <atomic>
+#include "commons/frame.h"
+#include "Qt/qt_strings_helper.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+#include "commons/executor.h"
+
+using namespace std;
+
+namespace {
+struct Handler {
+  ImageHandlerPtr handler;
+  ImageHandlers::Class handler_class;
+  QString name;
+  atomic_bool busy{false};
+  atomic<quint64> frames{0};
+  atomic<quint64> skipped{0};
+  // Latest handling times, in microseconds
+  QMutex samples_mutex;
+  array<qint64, 256> samples;
+  size_t samples_count = 0;
+  size_t next_sample = 0;
+  Metrics::Histogram &latency_metric;
+  Metrics::Counter &skipped_metric;
+
+  Handler(const ImageHandlerPtr &handler, ImageHandlers::Class handler_class, const QString &name)
+    : handler{handler}, handler_class{handler_class}, name{name},
+    latency_metric(Metrics::instance().histogram("image_handler_seconds", "Time spent by each image handler on a frame", "handler=\"%1\""_q % name)),
+    skipped_metric(Metrics::instance().counter("image_handler_skipped_frames_total", "Frames skipped by best effort image handlers still busy", "handler=\"%1\""_q % name)) {}
+  void handle(const FrameConstPtr &frame);
+  ImageHandlers::Latency latency();
+};
+typedef shared_ptr<Handler> HandlerPtr;
+}
+
+DPTR_IMPL(ImageHandlers) {
+  mutable QMutex mutex;
+  QList<HandlerPtr> handlers;
+  bool parallel = false;
+  QElapsedTimer log_timer;
+  void log_latencies();
+};
+
+void Handler::handle(const FrameConstPtr &frame)
+{
+  QElapsedTimer elapsed;
+  elapsed.start();
+  handler->handle(frame);
+  const auto usecs = elapsed.nsecsElapsed() / 1000;
+  latency_metric.record(chrono::microseconds{usecs});
+  ++frames;
+  QMutexLocker lock(&samples_mutex);
+  samples[next_sample] = usecs;
+  next_sample = (next_sample + 1) % samples.size();
+  samples_count = min(samples_count + 1, samples.size());
+}
+
+ImageHandlers::Latency Handler::latency()
+{
+  vector<qint64> sorted;
+  {
+    QMutexLocker lock(&samples_mutex);
+    sorted.assign(samples.begin(), samples.begin() + samples_count);
+  }
+  sort(sorted.begin(), sorted.end());
+  auto percentile = [&](double p) {
+    return chrono::microseconds{sorted.empty() ? 0 : sorted[min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))]};
+  };
+  return {name, handler_class, percentile(0.5), percentile(0.99), frames, skipped};
+}
+
+ImageHandlers::ImageHandlers(const QList<ImageHandlerPtr> &handlers) : dptr()
+{
+  for(auto handler: handlers)
+    push_back(handler);
+  d->log_timer.start();
+}
+
+ImageHandlers::~ImageHandlers()
+{
+  // Best effort handlers may still be running on the thread pool: they hold their own references, nothing to wait for
+}
+
+void ImageHandlers::push_back(const ImageHandlerPtr &handler, Class handler_class, const QString &name)
+{
+  QMutexLocker lock(&d->mutex);
+  d->handlers.push_back(make_shared<Handler>(handler, handler_class, name.isEmpty() ? "handler %1"_q % d->handlers.size() : name));
+}
+
+void ImageHandlers::clear()
+{
+  QMutexLocker lock(&d->mutex);
+  d->handlers.clear();
+}
+
+void ImageHandlers::setParallel(bool parallel)
+{
+  QMutexLocker lock(&d->mutex);
+  d->parallel = parallel;
+}
+
+QList<ImageHandlers::Latency> ImageHandlers::latencies() const
+{
+  QList<HandlerPtr> handlers;
+  {
+    QMutexLocker lock(&d->mutex);
+    handlers = d->handlers;
+  }
+  QList<Latency> latencies;
+  for(auto handler: handlers)
+    latencies.push_back(handler->latency());
+  return latencies;
+}
+
+void ImageHandlers::doHandle(FrameConstPtr frame)
+{
+  Tracing::Span span{"ImageHandlers::doHandle", frame->sequence()};
+  QList<HandlerPtr> handlers;
+  bool parallel;
+  {
+    QMutexLocker lock(&d->mutex);
+    handlers = d->handlers;
+    parallel = d->parallel;
+    if(d->log_timer.elapsed() > 60 * 1000) {
+      d->log_timer.restart();
+      d->log_latencies();
+    }
+  }
+  if(! parallel) {
+    for(auto handler: handlers)
+      handler->handle(frame);
+    return;
+  }
+  QList<QFuture<void>> must_complete;
+  for(auto handler: handlers) {
+    if(handler->handler_class == BestEffort) {
+      if(handler->busy.exchange(true)) {
+        ++handler->skipped;
+        handler->skipped_metric.add();
+        continue;
+      }
+      Executor::instance(Executor::Analysis).run([handler, frame]{
+        handler->handle(frame);
+        handler->busy = false;
+      });
+    } else {
+      must_complete.push_back(Executor::instance(Executor::CaptureCritical).run([handler, frame]{ handler->handle(frame); }));
+    }
+  }
+  // Tasks not started yet are run right here, instead of waiting for a pool thread to pick them up
+  for(auto &future: must_complete)
+    future.waitForFinished();
+}
+
+void ImageHandlers::Private::log_latencies()
+{
+  for(auto handler: handlers) {
+    auto latency = handler->latency();
+    if(latency.frames > 0)
+      qDebug().noquote() << "image handler %1: p50 %2ms, p99 %3ms, %4 frames, %5 skipped"_q
+        % latency.name % (latency.p50.count() / 1000.) % (latency.p99.count() / 1000.) % latency.frames % latency.skipped;
+  }
+}
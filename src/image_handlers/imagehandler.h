@@ -19,34 +19,57 @@
 #define IMAGE_HANDLER_H
 
 #include <memory>
+#include <vector>
 #include <QList>
 #include <algorithm>
+#include <chrono>
+#include <QString>
+#include "c++/dptr.h"
 #include "commons/fwd.h"
 FWD_PTR(Frame)
 FWD_PTR(ImageHandler)
 FWD_PTR(ImageHandlers)
 
+/// Consecutive frames handed over together, oldest first (see ImagerThread::set_batch)
+typedef std::vector<FrameConstPtr> FrameBatch;
+
 class ImageHandler {
 protected:
     virtual void doHandle(FrameConstPtr frame) = 0;
+    /// One frame after the other by default: handlers with fixed costs on every call (locks, wake ups) take the whole batch at once
+    virtual void doHandleBatch(const FrameBatch &batch) { for(const auto &frame: batch) doHandle(frame); }
 
 public:
   void handle(FrameConstPtr frame) { doHandle(frame); }
+  void handle_batch(const FrameBatch &batch) { doHandleBatch(batch); }
 };
 
 class ImageHandlers : public ImageHandler {
 public:
-  ImageHandlers(const QList<ImageHandlerPtr> &handlers = {}) : handlers{handlers} {}
+  /**
+   * MustComplete handlers are done with a frame before the next one comes in.
+   * BestEffort ones skip frames while still busy with a previous one, in parallel mode.
+   */
+  enum Class { MustComplete, BestEffort };
+  struct Latency {
+    QString name;
+    Class handler_class;
+    std::chrono::microseconds p50;
+    std::chrono::microseconds p99;
+    quint64 frames;
+    quint64 skipped;
+  };
+  ImageHandlers(const QList<ImageHandlerPtr> &handlers = {});
+  ~ImageHandlers();
 
-  void push_back(const ImageHandlerPtr &handler) { handlers.push_back(handler); }
-  void clear() { handlers.clear(); }
+  void push_back(const ImageHandlerPtr &handler, Class handler_class = MustComplete, const QString &name = {});
+  void clear();
+  /// Frames go to all the handlers at the same time on the global thread pool, instead of one after another
+  void setParallel(bool parallel);
+  /// Handling time of each handler, over its latest frames
+  QList<Latency> latencies() const;
 private:
-
-  void doHandle(FrameConstPtr frame) override {
-    for(auto handler: handlers)
-      handler->handle(frame);
-  }
-
-  QList<ImageHandlerPtr> handlers;
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
 };
 #endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "loadshedder.h"
+#include <QDebug>
+#include "framesfanout.h"
+#include "commons/loadshedding.h"
+#include "commons/metrics.h"
+
+using namespace std;
+
+namespace {
+const QStringList previews{"network", "histogram", "preview", "focus assist"};
+const QString display{"frontend"};
+}
+
+DPTR_IMPL(LoadShedder) {
+  const shared_ptr<FramesFanout> fanout;
+  const Configuration &configuration;
+  int level = LoadShedding::Normal;
+  Metrics::Gauge &level_metric = Metrics::instance().gauge("load_shedding_level", "Work given up while the recording writer falls behind: 0 none, 1 previews, 2 display rate, 3 display");
+};
+
+LoadShedder::LoadShedder(const shared_ptr<FramesFanout> &fanout, const Configuration &configuration, QObject *parent)
+  : QObject{parent}, dptr(fanout, configuration)
+{
+}
+
+LoadShedder::~LoadShedder()
+{
+}
+
+void LoadShedder::setLevel(int level)
+{
+  if(level == d->level)
+    return;
+  qDebug() << "Load shedding level:" << d->level << "->" << level;
+  d->level = level;
+  d->level_metric.set(level);
+  for(const auto &name: previews)
+    d->fanout->set_suspended(name, level >= LoadShedding::NoPreviews);
+  d->fanout->set_max_fps(display, level >= LoadShedding::SlowDisplay ? d->configuration.load_shedding_display_fps() : 0);
+  d->fanout->set_suspended(display, level >= LoadShedding::NoDisplay);
+}
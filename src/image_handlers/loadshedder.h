@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOADSHEDDER_H
+#define LOADSHEDDER_H
+
+#include <QObject>
+#include <memory>
+#include "c++/dptr.h"
+#include "commons/configuration.h"
+
+class FramesFanout;
+
+/**
+ * Takes the LoadShedding steps on the frames consumers, as the recording writer asks for them (see SaveImages::loadShedding):
+ * network previews, remote histograms and focus measures are suspended first, then the display rate goes down, then the display stops.
+ * The histogram follows the same signal on its own (Histogram::setSuspended). The recording, and whatever drives it
+ * (auto exposure, flash detection, ROI follow), is never shed. Consumers missing from the fanout (i.e. the display, in the daemon) are skipped.
+ */
+class LoadShedder : public QObject
+{
+  Q_OBJECT
+public:
+  LoadShedder(const std::shared_ptr<FramesFanout> &fanout, const Configuration &configuration, QObject *parent = nullptr);
+  ~LoadShedder();
+public slots:
+  /// A LoadShedding::Level
+  void setLevel(int level);
+private:
+  DPTR
+};
+
+#endif // LOADSHEDDER_H
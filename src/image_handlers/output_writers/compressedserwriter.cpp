@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "compressedserwriter.h"
+#include <QFile>
+#include <QDebug>
+#include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QFuture>
+#include <cstring>
+#include <deque>
+#include "image_handlers/saveimages.h"
+#include "commons/compressedser.h"
+#include "commons/frame.h"
+#include "commons/packedpixels.h"
+
+using namespace std;
+
+namespace {
+struct Compressed {
+  QByteArray data;
+  quint32 layout;
+};
+}
+
+DPTR_IMPL(CompressedSERWriter) {
+  const int level;
+  const bool pack;
+  CompressedSERWriter *q;
+  QFile file;
+  CompressedSER_Header header;
+  struct Pending {
+    QFuture<Compressed> data;
+    SER_Timestamp timestamp;
+    size_t raw_size;
+  };
+  deque<Pending> pending;
+  size_t max_pending = 1;
+  vector<CompressedSER_IndexEntry> index;
+  vector<SER_Timestamp> timestamps;
+  qint64 written = 0;
+  qint64 raw_bytes = 0;
+  QThreadPool pool;
+  void write_next();
+};
+
+CompressedSERWriter::CompressedSERWriter(const QString& deviceName, const Configuration& configuration) : dptr(configuration.compressed_ser_level(), configuration.compressed_ser_pack_pixels(), this)
+{
+  d->file.setFileName(configuration.savefile());
+  if(! CompressedSER::available())
+    throw SaveImages::Error::openingFile(d->file.fileName(), QObject::tr("Compressed SER support not available (built without zstd)"));
+  if(! d->file.open(QIODevice::WriteOnly))
+    throw SaveImages::Error::openingFile(d->file.fileName(), d->file.errorString());
+  int threads = configuration.image_writer_threads() > 0 ? configuration.image_writer_threads() : QThread::idealThreadCount();
+  d->pool.setMaxThreadCount(max(threads, 1));
+  d->max_pending = 2 * d->pool.maxThreadCount();
+  d->header.codec = d->pack ? CompressedSER_Header::ZstdPacked : CompressedSER_Header::Zstd;
+  d->header.ser.datetime = SER_Header::timestamp(QDateTime::currentDateTime());
+  d->header.ser.datetime_utc = SER_Header::timestamp(QDateTime::currentDateTimeUtc());
+  ::strcpy(d->header.ser.camera, deviceName.left(40).toLatin1());
+  ::strcpy(d->header.ser.observer, configuration.observer().left(40).toLatin1());
+  ::strcpy(d->header.ser.telescope, configuration.telescope().left(40).toLatin1());
+  // Placeholder header, written again on close with the frames count and index offset
+  d->written = d->file.write(reinterpret_cast<char*>(&d->header), sizeof(d->header));
+  qDebug() << "Compressed SER: level " << d->level << ", packed pixels: " << d->pack << ", threads: " << d->pool.maxThreadCount();
+}
+
+CompressedSERWriter::~CompressedSERWriter()
+{
+  try {
+    while(! d->pending.empty())
+      d->write_next();
+  } catch(const SaveImages::Error &e) {
+    qWarning() << e.what();
+    d->pending.clear();
+    d->pool.waitForDone();
+  }
+  d->header.ser.frames = d->index.size();
+  d->header.index_offset = d->written;
+  d->file.write(reinterpret_cast<const char*>(d->index.data()), d->index.size() * sizeof(CompressedSER_IndexEntry));
+  d->file.write(reinterpret_cast<const char*>(d->timestamps.data()), d->timestamps.size() * sizeof(SER_Timestamp));
+  d->file.seek(0);
+  d->file.write(reinterpret_cast<const char*>(&d->header), sizeof(d->header));
+  d->file.close();
+  qDebug() << "Compressed SER closed: " << d->index.size() << " frames, " << d->raw_bytes << " bytes compressed to " << d->written;
+}
+
+QString CompressedSERWriter::filename() const
+{
+  return d->file.fileName();
+}
+
+void CompressedSERWriter::doHandle(FrameConstPtr frame)
+{
+  if(! d->header.ser.imageWidth) {
+    // Same endianness convention as SERWriter
+    d->header.ser.endian = (frame->byteOrder() == Frame::BigEndian ? SER_Header::LittleEndian : SER_Header::BigEndian);
+    d->header.ser.set_color_format(frame->colorFormat());
+    d->header.ser.pixelDepth = frame->bpp();
+    d->header.ser.imageWidth = frame->resolution().width();
+    d->header.ser.imageHeight = frame->resolution().height();
+  }
+  int level = d->level;
+  bool pack = d->pack;
+  d->pending.push_back({QtConcurrent::run(&d->pool, [frame, level, pack]{
+    // Packing first leaves less to compress, and is much cheaper than compressing
+    const auto layout = pack ? PackedPixels::layout(*frame) : PackedPixels::Layout{};
+    if(! layout.packed())
+      return Compressed{CompressedSER::compress(frame->mat().data, frame->size(), level), 0};
+    const auto packed = PackedPixels::pack(*frame, layout);
+    return Compressed{CompressedSER::compress(reinterpret_cast<const uint8_t*>(packed.constData()), packed.size(), level), layout.code()};
+  }), SER_Header::timestamp(frame->created_utc()), frame->size()});
+  // Bounded in-flight frames; completed frames are written in order
+  while(d->pending.size() > d->max_pending || (! d->pending.empty() && d->pending.front().data.isFinished()))
+    d->write_next();
+}
+
+void CompressedSERWriter::Private::write_next()
+{
+  auto next = pending.front();
+  pending.pop_front();
+  auto compressed = next.data.result();
+  const auto &data = compressed.data;
+  if(data.isEmpty())
+    throw SaveImages::Error(QObject::tr("Error compressing frame"));
+  if(file.write(data) != data.size())
+    throw SaveImages::Error::openingFile(file.fileName(), file.errorString());
+  index.push_back({static_cast<quint64>(written), static_cast<quint32>(data.size()), compressed.layout});
+  timestamps.push_back(next.timestamp);
+  written += data.size();
+  raw_bytes += next.raw_size;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COMPRESSEDSERWRITER_H
+#define COMPRESSEDSERWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+
+/**
+ * Writes compressed SER files (see commons/compressedser.h).
+ * Frames are compressed on a thread pool, and written in capture order.
+ */
+class CompressedSERWriter : public FileWriter
+{
+public:
+  CompressedSERWriter(const QString &deviceName, const Configuration &configuration);
+  ~CompressedSERWriter();
+  QString filename() const override;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // COMPRESSEDSERWRITER_H
@@ -23,6 +23,7 @@
 #include "commons/opencv_utils.h"
 #include "image_handlers/saveimages.h"
 #include "commons/frame.h"
+#include "commons/frameanalysis.h"
 
 using namespace std;
 
@@ -58,8 +59,17 @@ void cvVideoWriter::doHandle(FrameConstPtr frame)
     if(! d->videoWriter.isOpened()) {
       throw SaveImages::Error::openingFile(d->filename, QObject::tr("Check that output directory exists, and that the selected video encoder is supported by your system."));
     }
-    d->videoWriter << frame->mat();
+    // Video encoders only take 8 bit frames
+    d->videoWriter << frame->analysis().as_8bit();
   } catch(cv::Exception &e) {
     qWarning() << "error on handle:" << e.msg << e.code << e.file << e.line << e.func;
   }
 }
+
+DECLARE_WRITER_MODULE_CREATE
+{
+  Q_UNUSED(deviceName)
+  if(format != Configuration::Video)
+    return {};
+  return make_shared<cvVideoWriter>(*configuration);
+}
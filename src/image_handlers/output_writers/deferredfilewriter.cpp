@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "deferredfilewriter.h"
+#include "commons/framearena.h"
+#include "commons/frame.h"
+#include "image_handlers/saveimages.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QDebug>
+#include <deque>
+#include <thread>
+#include <exception>
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace std::chrono_literals;
+
+DPTR_IMPL(DeferredFileWriter) {
+  // Declared first, destroyed last: frames the writer is still holding point into the arena
+  const unique_ptr<FrameArena> arena;
+  const FileWriterPtr writer;
+  mutable QMutex mutex;
+  QWaitCondition changed;
+  deque<FramePtr> pending;
+  size_t pending_bytes = 0;
+  bool writing = false;
+  bool running = true;
+  exception_ptr error;
+  thread flusher;
+  void flush();
+  void rethrow_error();
+};
+
+DeferredFileWriter::DeferredFileWriter(const FileWriterPtr &writer, size_t max_memory, bool huge_pages, bool lock_memory)
+  : dptr(make_unique<FrameArena>(max_memory, huge_pages, lock_memory), writer)
+{
+  qDebug() << "Burst to RAM recording:" << max_memory << "bytes, huge pages:" << d->arena->huge_pages() << ", locked:" << d->arena->locked();
+  d->flusher = thread{&Private::flush, d.get()};
+}
+
+DeferredFileWriter::~DeferredFileWriter()
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    d->running = false;
+  }
+  d->changed.wakeAll();
+  d->flusher.join();
+}
+
+void DeferredFileWriter::Private::flush()
+{
+#ifdef Q_OS_LINUX
+  // Lowest CPU and I/O priority for this thread only: capture and display come first
+  const pid_t tid = syscall(SYS_gettid);
+  setpriority(PRIO_PROCESS, tid, 19);
+  syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, (2 << 13) | 7 /* best effort, lowest level */);
+#endif
+  while(true) {
+    FramePtr frame;
+    bool failed, drained;
+    {
+      QMutexLocker lock(&mutex);
+      while(running && pending.empty())
+        changed.wait(&mutex);
+      // Frames still in memory are written even when stopping
+      if(pending.empty())
+        return;
+      frame = pending.front();
+      pending.pop_front();
+      drained = pending.empty();
+      writing = true;
+      failed = bool(error);
+    }
+    const size_t size = frame->size();
+    exception_ptr write_error;
+    try {
+      // After an error, frames are only given back
+      if(!failed) {
+        writer->handle(frame);
+        // Batched frames hold on to the arena: they're written as soon as there's nothing to batch them with
+        if(drained)
+          writer->flush();
+      }
+    } catch(...) {
+      write_error = current_exception();
+    }
+    // Room in the arena comes back as soon as the writer lets the frame go
+    frame.reset();
+    {
+      QMutexLocker lock(&mutex);
+      pending_bytes -= size;
+      writing = false;
+      if(write_error && !error)
+        error = write_error;
+    }
+    changed.wakeAll();
+  }
+}
+
+void DeferredFileWriter::Private::rethrow_error()
+{
+  QMutexLocker lock(&mutex);
+  if(error)
+    rethrow_exception(error);
+}
+
+void DeferredFileWriter::doHandle(FrameConstPtr frame)
+{
+  d->rethrow_error();
+  if(frame->size() > d->arena->capacity())
+    throw SaveImages::Error(QObject::tr("Frame too large for the burst memory (%1 bytes)").arg(static_cast<qulonglong>(frame->size())));
+  FramePtr stored;
+  while(!(stored = d->arena->store(frame))) {
+    d->arena->wait_for_release(100ms);
+    d->rethrow_error();
+  }
+  {
+    QMutexLocker lock(&d->mutex);
+    d->pending.push_back(stored);
+    d->pending_bytes += stored->size();
+  }
+  d->changed.wakeAll();
+}
+
+bool DeferredFileWriter::wait_flushed(const chrono::milliseconds &timeout)
+{
+  {
+    QMutexLocker lock(&d->mutex);
+    if(!d->pending.empty() || d->writing)
+      d->changed.wait(&d->mutex, timeout.count());
+  }
+  d->rethrow_error();
+  QMutexLocker lock(&d->mutex);
+  return d->pending.empty() && !d->writing;
+}
+
+QString DeferredFileWriter::filename() const
+{
+  return d->writer->filename();
+}
+
+QStringList DeferredFileWriter::files() const
+{
+  return d->writer->files();
+}
+
+size_t DeferredFileWriter::pending_bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->pending_bytes;
+}
+
+size_t DeferredFileWriter::available_bytes() const
+{
+  return d->arena->capacity() - d->arena->used();
+}
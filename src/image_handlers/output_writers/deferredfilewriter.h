@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEFERREDFILEWRITER_H
+#define DEFERREDFILEWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+#include <chrono>
+
+FWD_PTR(DeferredFileWriter)
+
+/**
+ * Burst to RAM: frames are copied into a FrameArena, and a low priority thread hands them to the actual writer,
+ * so that recording never waits on the disk while there's room in memory.
+ * When the arena is full, frames wait for room, and the recording queue in front of the writer takes over.
+ * Errors from the actual writer come back on the next frame, or from wait_flushed().
+ * The destructor writes whatever is still in memory.
+ */
+class DeferredFileWriter : public FileWriter
+{
+public:
+  DeferredFileWriter(const FileWriterPtr &writer, std::size_t max_memory, bool huge_pages, bool lock_memory);
+  ~DeferredFileWriter();
+  QString filename() const override;
+  QStringList files() const override;
+  /// Bytes of frames in memory, not yet written
+  std::size_t pending_bytes() const;
+  /// Room left in memory for new frames
+  std::size_t available_bytes() const;
+  /// Waits up to timeout for all the frames in memory to be written; true if there are none left
+  bool wait_flushed(const std::chrono::milliseconds &timeout);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // DEFERREDFILEWRITER_H
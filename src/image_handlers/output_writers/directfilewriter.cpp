@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "directfilewriter.h"
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define DIRECT_IO_ALIGNMENT 4096
+#define DIRECT_IO_PREALLOCATE_STEP (256l * 1024l * 1024l)
+
+namespace {
+struct Chunk {
+  char *data;
+  size_t used;
+  off_t offset;
+};
+}
+
+DPTR_IMPL(DirectFileWriter) {
+  const QString filename;
+  const size_t chunk_size;
+  int fd = -1;
+  quint64 written = 0;
+  off_t preallocated = 0;
+  QString error;
+  bool closed = false;
+
+  vector<char*> buffers;
+  Chunk *current = nullptr;
+  vector<Chunk> chunks;
+  QMutex mutex;
+  QWaitCondition changed;
+  deque<Chunk*> free_chunks;
+  deque<Chunk*> pending;
+  bool stopping = false;
+  thread io_thread;
+
+  void io_loop();
+  bool submit(Chunk *chunk);
+  Chunk *acquire();
+  void set_error(const QString &message);
+};
+
+DirectFileWriter::DirectFileWriter(const QString& filename, size_t chunk_size, size_t chunks)
+  : dptr(filename, (max(chunk_size, size_t{DIRECT_IO_ALIGNMENT}) / DIRECT_IO_ALIGNMENT) * DIRECT_IO_ALIGNMENT)
+{
+  auto path = filename.toLocal8Bit();
+  d->fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if(d->fd == -1 && errno == EINVAL) {
+    qWarning() << "O_DIRECT not supported on" << filename << ", falling back to cached I/O";
+    d->fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if(d->fd == -1) {
+    d->error = QString::fromLocal8Bit(strerror(errno));
+    return;
+  }
+  d->chunks.resize(max(chunks, size_t{2}));
+  for(auto &chunk: d->chunks) {
+    void *buffer = nullptr;
+    if(posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, d->chunk_size) != 0) {
+      d->error = "unable to allocate aligned I/O buffers";
+      ::close(d->fd);
+      d->fd = -1;
+      return;
+    }
+    d->buffers.push_back(reinterpret_cast<char*>(buffer));
+    chunk = {reinterpret_cast<char*>(buffer), 0, 0};
+    d->free_chunks.push_back(&chunk);
+  }
+  d->io_thread = thread{&Private::io_loop, d.get()};
+}
+
+DirectFileWriter::~DirectFileWriter()
+{
+  close();
+  for(auto buffer: d->buffers)
+    free(buffer);
+}
+
+bool DirectFileWriter::isOpen() const
+{
+  return d->fd != -1 && ! d->closed;
+}
+
+QString DirectFileWriter::fileName() const
+{
+  return d->filename;
+}
+
+QString DirectFileWriter::errorString() const
+{
+  return d->error;
+}
+
+quint64 DirectFileWriter::size() const
+{
+  return d->written;
+}
+
+void DirectFileWriter::Private::set_error(const QString& message)
+{
+  QMutexLocker lock(&mutex);
+  if(error.isEmpty())
+    error = message;
+}
+
+Chunk *DirectFileWriter::Private::acquire()
+{
+  QMutexLocker lock(&mutex);
+  while(free_chunks.empty())
+    changed.wait(&mutex);
+  auto chunk = free_chunks.front();
+  free_chunks.pop_front();
+  chunk->used = 0;
+  chunk->offset = written;
+  return chunk;
+}
+
+bool DirectFileWriter::Private::submit(Chunk* chunk)
+{
+  QMutexLocker lock(&mutex);
+  pending.push_back(chunk);
+  changed.wakeAll();
+  return error.isEmpty();
+}
+
+void DirectFileWriter::Private::io_loop()
+{
+  while(true) {
+    Chunk *chunk;
+    {
+      QMutexLocker lock(&mutex);
+      while(pending.empty() && ! stopping)
+        changed.wait(&mutex);
+      if(pending.empty())
+        return;
+      chunk = pending.front();
+      pending.pop_front();
+    }
+    // O_DIRECT requires aligned lengths: a partial (last) chunk is zero padded, and the padding is truncated away on close
+    size_t length = (chunk->used + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    memset(chunk->data + chunk->used, 0, length - chunk->used);
+    {
+      QMutexLocker lock(&mutex);
+      if(chunk->offset + static_cast<off_t>(length) > preallocated) {
+        preallocated = chunk->offset + length + DIRECT_IO_PREALLOCATE_STEP;
+        posix_fallocate(fd, chunk->offset, preallocated - chunk->offset);
+      }
+    }
+    size_t done = 0;
+    while(done < length) {
+      auto result = ::pwrite(fd, chunk->data + done, length - done, chunk->offset + done);
+      if(result < 0 && errno == EINTR)
+        continue;
+      if(result <= 0) {
+        set_error(QString::fromLocal8Bit(strerror(errno)));
+        break;
+      }
+      done += result;
+    }
+    QMutexLocker lock(&mutex);
+    free_chunks.push_back(chunk);
+    changed.wakeAll();
+  }
+}
+
+void DirectFileWriter::preallocate(quint64 size)
+{
+  if(! isOpen())
+    return;
+  QMutexLocker lock(&d->mutex);
+  if(static_cast<off_t>(size) <= d->preallocated)
+    return;
+  auto result = posix_fallocate(d->fd, 0, size);
+  if(result != 0) {
+    qWarning() << "unable to preallocate" << size << "bytes for" << d->filename << ":" << strerror(result);
+    return;
+  }
+  d->preallocated = size;
+}
+
+bool DirectFileWriter::write(const char* data, size_t size)
+{
+  if(! isOpen())
+    return false;
+  while(size > 0) {
+    if(! d->current)
+      d->current = d->acquire();
+    size_t copy_size = min(size, d->chunk_size - d->current->used);
+    memcpy(d->current->data + d->current->used, data, copy_size);
+    d->current->used += copy_size;
+    d->written += copy_size;
+    data += copy_size;
+    size -= copy_size;
+    if(d->current->used == d->chunk_size) {
+      auto chunk = d->current;
+      d->current = nullptr;
+      if(! d->submit(chunk))
+        return false;
+    }
+  }
+  QMutexLocker lock(&d->mutex);
+  return d->error.isEmpty();
+}
+
+void DirectFileWriter::close()
+{
+  if(d->fd == -1 || d->closed)
+    return;
+  d->closed = true;
+  if(d->current && d->current->used > 0)
+    d->submit(d->current);
+  d->current = nullptr;
+  {
+    QMutexLocker lock(&d->mutex);
+    d->stopping = true;
+    d->changed.wakeAll();
+  }
+  d->io_thread.join();
+  if(::ftruncate(d->fd, d->written) != 0)
+    d->set_error(QString::fromLocal8Bit(strerror(errno)));
+  ::close(d->fd);
+  if(! d->error.isEmpty())
+    qWarning() << "error writing" << d->filename << ":" << d->error;
+}
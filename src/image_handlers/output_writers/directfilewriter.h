@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DIRECTFILEWRITER_H
+#define DIRECTFILEWRITER_H
+
+#include "c++/dptr.h"
+#include <QString>
+
+/**
+ * Sequential file writer bypassing the page cache (O_DIRECT), for sustained high bandwidth recordings.
+ * Data is copied into page aligned chunks, which are written by a dedicated I/O thread while the caller keeps filling
+ * the next one; write() only blocks when all the chunks are in flight.
+ * The file is preallocated in large steps to limit fragmentation, and truncated to the data actually written on close().
+ * Falls back to regular (cached) I/O if the filesystem doesn't support O_DIRECT.
+ * Linux only.
+ */
+class DirectFileWriter
+{
+public:
+  DirectFileWriter(const QString &filename, std::size_t chunk_size = 8 * 1024 * 1024, std::size_t chunks = 4);
+  ~DirectFileWriter();
+  bool isOpen() const;
+  bool write(const char *data, std::size_t size);
+  /// Reserves disk space for a file of the given total size, when it's known in advance
+  void preallocate(quint64 size);
+  /// Flushes pending data, waits for the I/O thread and truncates the file to size(). Called by the destructor.
+  void close();
+  /// Bytes written so far (excluding alignment padding)
+  quint64 size() const;
+  QString fileName() const;
+  QString errorString() const;
+private:
+  DPTR
+};
+
+#endif // DIRECTFILEWRITER_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "faultyfilewriter.h"
+#include "image_handlers/saveimages.h"
+#include "commons/frame.h"
+#include "Qt/qt_strings_helper.h"
+#include <QDebug>
+#include <thread>
+
+using namespace std;
+
+DPTR_IMPL(FaultyFileWriter) {
+  const FileWriterPtr writer;
+  WriteFaults faults;
+  WriteFaults::Clock::duration delayed{0};
+  uint64_t failed = 0;
+};
+
+FaultyFileWriter::FaultyFileWriter(const FileWriterPtr &writer, const WriteFaults::Settings &faults) : dptr(writer, faults)
+{
+}
+
+FaultyFileWriter::~FaultyFileWriter()
+{
+  qDebug() << "Injected write faults for" << d->writer->filename() << ":" << d->faults.frames() << "frames,"
+           << chrono::duration_cast<chrono::milliseconds>(d->delayed).count() << "ms of delays," << d->failed << "errors";
+}
+
+QString FaultyFileWriter::filename() const
+{
+  return d->writer->filename();
+}
+
+QStringList FaultyFileWriter::files() const
+{
+  return d->writer->files();
+}
+
+void FaultyFileWriter::flush()
+{
+  d->writer->flush();
+}
+
+void FaultyFileWriter::doHandle(FrameConstPtr frame)
+{
+  const auto fault = d->faults.next(frame->size(), WriteFaults::Clock::now());
+  if(fault.delay > WriteFaults::Clock::duration::zero()) {
+    this_thread::sleep_for(fault.delay);
+    d->delayed += fault.delay;
+  }
+  if(fault.fail) {
+    d->failed++;
+    throw SaveImages::Error("Injected write error on frame %1 of %2"_q % d->faults.frames() % d->writer->filename());
+  }
+  d->writer->handle(frame);
+}
+
+WriteFaults::Settings FaultyFileWriter::from_environment()
+{
+  WriteFaults::Settings settings;
+  const QString spec = QString::fromLocal8Bit(qgetenv("PLANETARYIMAGER_WRITER_FAULTS"));
+  if(spec.isEmpty())
+    return settings;
+  QString error;
+  if(! WriteFaults::parse(spec, settings, error)) {
+    qWarning() << "Ignoring PLANETARYIMAGER_WRITER_FAULTS:" << error;
+    return {};
+  }
+  qWarning() << "Injecting write faults in every writer:" << spec;
+  return settings;
+}
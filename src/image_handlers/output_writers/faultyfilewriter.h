@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FAULTYFILEWRITER_H
+#define FAULTYFILEWRITER_H
+
+#include "filewriter.h"
+#include "writefaults.h"
+#include "c++/dptr.h"
+
+/**
+ * Developer builds only: a real writer behind the slow or failing disk described by WriteFaults, for soak tests of the recording path.
+ * Every frame waits for its injected delay on the recording thread before reaching the writer; injected errors are thrown as write errors.
+ * FileWriter::factory wraps all the writers in it when PLANETARYIMAGER_WRITER_FAULTS holds a faults spec.
+ */
+class FaultyFileWriter : public FileWriter
+{
+public:
+  FaultyFileWriter(const FileWriterPtr &writer, const WriteFaults::Settings &faults);
+  ~FaultyFileWriter();
+  QString filename() const override;
+  QStringList files() const override;
+  void flush() override;
+  /// The faults spec from the environment: inactive settings when unset or invalid
+  static WriteFaults::Settings from_environment();
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // FAULTYFILEWRITER_H
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "ffmpegvideowriter.h"
+#include <QDebug>
+#include <QObject>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include "Qt/qt_strings_helper.h"
+#include "image_handlers/saveimages.h"
+#include "commons/frame.h"
+#include "commons/framesqueue.h"
+#include "commons/pixel_kernels.h"
+#include "c++/stlutils.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace std;
+
+// Frames waiting for the encoder thread
+#define FFMPEG_QUEUE_FRAMES 16
+// The stream frame rate is measured on the first frames, before opening the encoder
+#define FFMPEG_FPS_PROBE_FRAMES 10
+#define FFMPEG_FPS_PROBE_MSECS 1000
+#define FFMPEG_FALLBACK_FPS 25
+
+namespace {
+  struct CodecInfo {
+    bool lossless;
+    AVHWDeviceType hw_device;
+  };
+
+  const QMap<QString, CodecInfo> supported_codecs {
+    {"ffv1", {true, AV_HWDEVICE_TYPE_NONE}},
+    {"utvideo", {true, AV_HWDEVICE_TYPE_NONE}},
+    {"h264_nvenc", {false, AV_HWDEVICE_TYPE_NONE}},
+    {"hevc_nvenc", {false, AV_HWDEVICE_TYPE_NONE}},
+    {"h264_qsv", {false, AV_HWDEVICE_TYPE_NONE}},
+    {"hevc_qsv", {false, AV_HWDEVICE_TYPE_NONE}},
+    {"h264_vaapi", {false, AV_HWDEVICE_TYPE_VAAPI}},
+    {"hevc_vaapi", {false, AV_HWDEVICE_TYPE_VAAPI}},
+  };
+
+  const QMap<Frame::ColorFormat, int> debayer_conversions {
+    {Frame::Bayer_RGGB, cv::COLOR_BayerRG2BGR},
+    {Frame::Bayer_GBRG, cv::COLOR_BayerGB2BGR},
+    {Frame::Bayer_GRBG, cv::COLOR_BayerGR2BGR},
+    {Frame::Bayer_BGGR, cv::COLOR_BayerBG2BGR},
+  };
+
+  const QMap<Frame::ColorFormat, QString> bayer_names {
+    {Frame::Bayer_RGGB, "RGGB"},
+    {Frame::Bayer_GBRG, "GBRG"},
+    {Frame::Bayer_GRBG, "GRBG"},
+    {Frame::Bayer_BGGR, "BGGR"},
+  };
+
+  QString av_error(int error) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(error, buffer, sizeof(buffer));
+    return QString::fromLocal8Bit(buffer);
+  }
+
+  struct CodecContextDeleter { void operator()(AVCodecContext *c) { avcodec_free_context(&c); } };
+  struct FrameDeleter { void operator()(AVFrame *f) { av_frame_free(&f); } };
+  struct PacketDeleter { void operator()(AVPacket *p) { av_packet_free(&p); } };
+  struct BufferDeleter { void operator()(AVBufferRef *b) { av_buffer_unref(&b); } };
+  struct SwsDeleter { void operator()(SwsContext *s) { sws_freeContext(s); } };
+}
+
+DPTR_IMPL(FFmpegVideoWriter) {
+  const QString filename;
+  const QString codec_name;
+  FFmpegVideoWriter *q;
+  FramesQueue queue{FFMPEG_QUEUE_FRAMES, FramesQueue::BlockProducer, chrono::milliseconds{500}};
+  atomic_bool stopping{false};
+  QMutex error_mutex;
+  QString error;
+  thread encoder_thread;
+
+  CodecInfo codec_info;
+  AVFormatContext *format_context = nullptr;
+  AVStream *stream = nullptr;
+  unique_ptr<AVCodecContext, CodecContextDeleter> codec_context;
+  unique_ptr<AVBufferRef, BufferDeleter> hw_device;
+  unique_ptr<AVBufferRef, BufferDeleter> hw_frames;
+  unique_ptr<AVFrame, FrameDeleter> sw_frame;
+  unique_ptr<AVFrame, FrameDeleter> hw_frame;
+  unique_ptr<AVPacket, PacketDeleter> packet;
+  unique_ptr<SwsContext, SwsDeleter> sws;
+  AVPixelFormat sw_format = AV_PIX_FMT_NONE;
+  QDateTime first_frame_time;
+  int64_t last_pts = -1;
+  bool header_written = false;
+
+  void run();
+  void check_error();
+  /// Pixels to encode, in byte_order
+  cv::Mat prepare(const FrameConstPtr &frame, Frame::ByteOrder &byte_order) const;
+  AVPixelFormat source_format(const cv::Mat &image, Frame::ColorFormat color_format, Frame::ByteOrder byte_order) const;
+  AVPixelFormat encoder_format(const cv::Mat &image) const;
+  void open(const deque<FrameConstPtr> &probe);
+  void encode(const FrameConstPtr &frame);
+  void send(AVFrame *frame);
+  void close();
+};
+
+FFmpegVideoWriter::FFmpegVideoWriter(const Configuration &configuration) : dptr(configuration.savefile(), configuration.ffmpeg_video_codec(), this)
+{
+  if(! supported_codecs.contains(d->codec_name))
+    throw SaveImages::Error::openingFile(d->filename, QObject::tr("Unsupported video codec: %1").arg(d->codec_name));
+  if(! avcodec_find_encoder_by_name(d->codec_name.toLatin1().constData()))
+    throw SaveImages::Error::openingFile(d->filename, QObject::tr("Video codec %1 is not available in this FFmpeg build").arg(d->codec_name));
+  d->codec_info = supported_codecs[d->codec_name];
+  qDebug() << "writing to " << filename() << ", codec: " << d->codec_name;
+  d->encoder_thread = thread{&Private::run, d.get()};
+}
+
+FFmpegVideoWriter::~FFmpegVideoWriter()
+{
+  d->stopping = true;
+  d->encoder_thread.join();
+  if(! d->error.isEmpty())
+    qWarning() << "Error encoding video: " << d->error;
+}
+
+QString FFmpegVideoWriter::filename() const
+{
+  return d->filename;
+}
+
+void FFmpegVideoWriter::doHandle(FrameConstPtr frame)
+{
+  d->check_error();
+  // Blocks while the encoder is behind, letting the recording queue absorb the backlog
+  while(! d->queue.push(frame))
+    d->check_error();
+}
+
+void FFmpegVideoWriter::Private::check_error()
+{
+  QMutexLocker lock(&error_mutex);
+  if(! error.isEmpty())
+    throw SaveImages::Error(error);
+}
+
+void FFmpegVideoWriter::Private::run()
+{
+  try {
+    deque<FrameConstPtr> probe;
+    while(true) {
+      auto frame = queue.pop(chrono::milliseconds{100});
+      if(! frame) {
+        if(stopping)
+          break;
+        continue;
+      }
+      if(codec_context) {
+        encode(frame);
+        continue;
+      }
+      probe.push_back(frame);
+      if(probe.size() < FFMPEG_FPS_PROBE_FRAMES && probe.front()->created_utc().msecsTo(probe.back()->created_utc()) < FFMPEG_FPS_PROBE_MSECS)
+        continue;
+      open(probe);
+      for(auto probed: probe)
+        encode(probed);
+      probe.clear();
+    }
+    // Short recordings might end before the frame rate probe is complete
+    if(! codec_context && ! probe.empty()) {
+      open(probe);
+      for(auto probed: probe)
+        encode(probed);
+    }
+  } catch(const SaveImages::Error &e) {
+    QMutexLocker lock(&error_mutex);
+    error = QString::fromStdString(e.what());
+  }
+  try {
+    close();
+  } catch(const SaveImages::Error &e) {
+    QMutexLocker lock(&error_mutex);
+    if(error.isEmpty())
+      error = QString::fromStdString(e.what());
+  }
+}
+
+cv::Mat FFmpegVideoWriter::Private::prepare(const FrameConstPtr &frame, Frame::ByteOrder &byte_order) const
+{
+  byte_order = frame->byteOrder();
+  // Lossless codecs store bayer data as it is, lossy codecs would smear the pattern
+  if(codec_info.lossless || ! debayer_conversions.contains(frame->colorFormat()))
+    return frame->mat();
+  // Debayering interpolates the pixel values: they must be in the machine byte order
+  const Frame::ByteOrder native = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? Frame::LittleEndian : Frame::BigEndian;
+  const bool swap = frame->mat().depth() == CV_16U && byte_order != native;
+  cv::Mat debayered;
+  cv::cvtColor(swap ? PixelKernels::swap16(frame->mat()) : frame->mat(), debayered, debayer_conversions[frame->colorFormat()]);
+  byte_order = native;
+  return debayered;
+}
+
+AVPixelFormat FFmpegVideoWriter::Private::source_format(const cv::Mat &image, Frame::ColorFormat color_format, Frame::ByteOrder byte_order) const
+{
+  bool rgb = color_format == Frame::RGB;
+  // 16 bit frames in the frame byte order, whatever the machine one: swscale swaps them if needed
+  bool little_endian = byte_order == Frame::LittleEndian;
+  switch(image.type()) {
+    case CV_8UC1:
+      return AV_PIX_FMT_GRAY8;
+    case CV_16UC1:
+      return little_endian ? AV_PIX_FMT_GRAY16LE : AV_PIX_FMT_GRAY16BE;
+    case CV_8UC3:
+      return rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24;
+    case CV_16UC3:
+      if(rgb)
+        return little_endian ? AV_PIX_FMT_RGB48LE : AV_PIX_FMT_RGB48BE;
+      return little_endian ? AV_PIX_FMT_BGR48LE : AV_PIX_FMT_BGR48BE;
+  }
+  throw SaveImages::Error::openingFile(filename, QObject::tr("Unsupported image format for video encoding"));
+}
+
+AVPixelFormat FFmpegVideoWriter::Private::encoder_format(const cv::Mat &image) const
+{
+  bool is_16bit = image.depth() == CV_16U;
+  bool mono = image.channels() == 1;
+  if(codec_name == "ffv1") {
+    if(mono)
+      return is_16bit ? AV_PIX_FMT_GRAY16LE : AV_PIX_FMT_GRAY8;
+    return is_16bit ? AV_PIX_FMT_GBRP16LE : AV_PIX_FMT_BGR0;
+  }
+  if(codec_name == "utvideo") {
+    if(is_16bit)
+      throw SaveImages::Error::openingFile(filename, QObject::tr("utvideo only supports 8 bit images, use ffv1 for 16 bit recordings"));
+    // Mono frames are replicated on the three planes, which is still lossless
+    return AV_PIX_FMT_GBRP;
+  }
+  // Hardware encoders: 8 bit 4:2:0, good enough for quick-look videos
+  return AV_PIX_FMT_NV12;
+}
+
+void FFmpegVideoWriter::Private::open(const deque<FrameConstPtr> &probe)
+{
+  auto check = [this](int result, const QString &what) {
+    if(result < 0)
+      throw SaveImages::Error::openingFile(filename, "%1: %2"_q % what % av_error(result));
+  };
+  auto first = probe.front();
+  first_frame_time = first->created_utc();
+  auto probe_msecs = first_frame_time.msecsTo(probe.back()->created_utc());
+  double fps = probe.size() > 1 && probe_msecs > 0 ? (probe.size() - 1) * 1000. / probe_msecs : FFMPEG_FALLBACK_FPS;
+  Frame::ByteOrder byte_order;
+  auto image = prepare(first, byte_order);
+  sw_format = encoder_format(image);
+
+  check(avformat_alloc_output_context2(&format_context, nullptr, "matroska", filename.toLocal8Bit().constData()), "allocating output");
+  auto codec = avcodec_find_encoder_by_name(codec_name.toLatin1().constData());
+  stream = avformat_new_stream(format_context, nullptr);
+  codec_context.reset(avcodec_alloc_context3(codec));
+  if(! stream || ! codec_context)
+    throw SaveImages::Error::openingFile(filename, QObject::tr("Unable to allocate video encoder"));
+  codec_context->width = image.cols;
+  codec_context->height = image.rows;
+  codec_context->pix_fmt = sw_format;
+  // Millisecond time base: timestamps come from the capture time of each frame, so a variable frame rate is preserved
+  codec_context->time_base = AVRational{1, 1000};
+  codec_context->framerate = av_d2q(fps, 100000);
+  codec_context->thread_count = 0;
+  if(codec_name == "ffv1") {
+    // Level 3 allows 16 bit RGB, and slices, which are encoded in parallel
+    av_opt_set(codec_context->priv_data, "level", "3", 0);
+    av_opt_set(codec_context->priv_data, "slicecrc", "1", 0);
+    codec_context->thread_type = FF_THREAD_SLICE;
+  }
+  if(codec_info.hw_device != AV_HWDEVICE_TYPE_NONE) {
+    AVBufferRef *device = nullptr;
+    check(av_hwdevice_ctx_create(&device, codec_info.hw_device, nullptr, nullptr, 0), "opening hardware device");
+    hw_device.reset(device);
+    hw_frames.reset(av_hwframe_ctx_alloc(hw_device.get()));
+    auto frames_context = reinterpret_cast<AVHWFramesContext*>(hw_frames->data);
+    frames_context->format = AV_PIX_FMT_VAAPI;
+    frames_context->sw_format = sw_format;
+    frames_context->width = image.cols;
+    frames_context->height = image.rows;
+    frames_context->initial_pool_size = 20;
+    check(av_hwframe_ctx_init(hw_frames.get()), "initialising hardware frames");
+    codec_context->pix_fmt = AV_PIX_FMT_VAAPI;
+    codec_context->hw_frames_ctx = av_buffer_ref(hw_frames.get());
+    hw_frame.reset(av_frame_alloc());
+  }
+  if(format_context->oformat->flags & AVFMT_GLOBALHEADER)
+    codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  check(avcodec_open2(codec_context.get(), codec, nullptr), "opening codec %1"_q % codec_name);
+  check(avcodec_parameters_from_context(stream->codecpar, codec_context.get()), "setting stream parameters");
+  stream->time_base = codec_context->time_base;
+  stream->avg_frame_rate = codec_context->framerate;
+  if(codec_info.lossless && bayer_names.contains(first->colorFormat()))
+    av_dict_set(&stream->metadata, "BAYER_PATTERN", bayer_names[first->colorFormat()].toLatin1().constData(), 0);
+
+  sw_frame.reset(av_frame_alloc());
+  packet.reset(av_packet_alloc());
+  sw_frame->format = sw_format;
+  sw_frame->width = image.cols;
+  sw_frame->height = image.rows;
+  check(av_frame_get_buffer(sw_frame.get(), 0), "allocating frame");
+
+  check(avio_open(&format_context->pb, filename.toLocal8Bit().constData(), AVIO_FLAG_WRITE), "opening file");
+  check(avformat_write_header(format_context, nullptr), "writing header");
+  header_written = true;
+  qDebug() << "Encoding " << image.cols << "x" << image.rows << " with " << codec_name << ", measured fps: " << fps;
+}
+
+void FFmpegVideoWriter::Private::encode(const FrameConstPtr &frame)
+{
+  Frame::ByteOrder byte_order;
+  auto image = prepare(frame, byte_order);
+  auto source = source_format(image, frame->colorFormat(), byte_order);
+  // Frames with a different resolution (ROI changes) get scaled to the stream size
+  sws.reset(sws_getCachedContext(sws.release(), image.cols, image.rows, source, codec_context->width, codec_context->height, sw_format, SWS_POINT, nullptr, nullptr, nullptr));
+  if(! sws)
+    throw SaveImages::Error(QObject::tr("Unable to convert frame to %1 pixel format").arg(av_get_pix_fmt_name(sw_format)));
+  if(av_frame_make_writable(sw_frame.get()) < 0)
+    throw SaveImages::Error(QObject::tr("Unable to allocate video frame"));
+  const uint8_t *source_data[4] = {image.data, nullptr, nullptr, nullptr};
+  const int source_stride[4] = {static_cast<int>(image.step), 0, 0, 0};
+  sws_scale(sws.get(), source_data, source_stride, 0, image.rows, sw_frame->data, sw_frame->linesize);
+
+  AVFrame *encoder_frame = sw_frame.get();
+  if(hw_frames) {
+    av_frame_unref(hw_frame.get());
+    if(av_hwframe_get_buffer(hw_frames.get(), hw_frame.get(), 0) < 0 || av_hwframe_transfer_data(hw_frame.get(), sw_frame.get(), 0) < 0)
+      throw SaveImages::Error(QObject::tr("Unable to upload frame to the hardware encoder"));
+    encoder_frame = hw_frame.get();
+  }
+  // Capture timestamps have millisecond resolution: keep them strictly increasing
+  encoder_frame->pts = max<int64_t>(first_frame_time.msecsTo(frame->created_utc()), last_pts + 1);
+  last_pts = encoder_frame->pts;
+  send(encoder_frame);
+}
+
+void FFmpegVideoWriter::Private::send(AVFrame *frame)
+{
+  int result = avcodec_send_frame(codec_context.get(), frame);
+  if(result < 0)
+    throw SaveImages::Error(QObject::tr("Error encoding frame: %1").arg(av_error(result)));
+  while(true) {
+    result = avcodec_receive_packet(codec_context.get(), packet.get());
+    if(result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+      return;
+    if(result < 0)
+      throw SaveImages::Error(QObject::tr("Error encoding frame: %1").arg(av_error(result)));
+    av_packet_rescale_ts(packet.get(), codec_context->time_base, stream->time_base);
+    packet->stream_index = stream->index;
+    result = av_interleaved_write_frame(format_context, packet.get());
+    if(result < 0)
+      throw SaveImages::Error::openingFile(filename, av_error(result));
+  }
+}
+
+void FFmpegVideoWriter::Private::close()
+{
+  GuLinux::Scope cleanup{[this]{
+    if(format_context) {
+      avio_closep(&format_context->pb);
+      avformat_free_context(format_context);
+      format_context = nullptr;
+    }
+    codec_context.reset();
+  }};
+  if(header_written) {
+    // Flush the frames still inside the encoder
+    send(nullptr);
+    av_write_trailer(format_context);
+  }
+}
+
+DECLARE_WRITER_MODULE_CREATE
+{
+  Q_UNUSED(deviceName)
+  if(format != Configuration::FFmpegVideo)
+    return {};
+  return make_shared<FFmpegVideoWriter>(*configuration);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FFMPEGVIDEOWRITER_H
+#define FFMPEGVIDEOWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+
+/**
+ * Video writer backed by libavcodec/libavformat, writing Matroska files.
+ * Lossless codecs (ffv1, utvideo) keep mono and raw bayer data untouched, ffv1 also at 16 bit;
+ * hardware codecs (nvenc, qsv, vaapi) are meant for quick-look videos.
+ * Frames are timed from their capture timestamps, and encoded on a separate thread.
+ */
+class FFmpegVideoWriter : public FileWriter
+{
+public:
+  FFmpegVideoWriter(const Configuration &configuration);
+  ~FFmpegVideoWriter();
+  QString filename() const override;
+
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // FFMPEGVIDEOWRITER_H
@@ -18,16 +18,65 @@
 #include "filewriter.h"
 
 #include "serwriter.h"
-#include "cvvideowriter.h"
-#include "imagefilewriter.h"
+#include "segmentedserwriter.h"
+#include "stripedserwriter.h"
+#include "compressedserwriter.h"
+#include "commons/definitions.h"
+#include "commons/modules.h"
+#if DEVELOPER_MODE == 1
+#include "faultyfilewriter.h"
+#endif
 
 using namespace std;
-QMap< Configuration::SaveFormat, FileWriter::Factory > FileWriter::factories()
+
+namespace {
+FileWriter::Factory writer_factory(Configuration::SaveFormat format)
 {
-  return {
-    {Configuration::SER, [](const QString &deviceName, const Configuration *configuration){ return make_shared<SERWriter>(deviceName, *configuration); }},
-    {Configuration::Video, [](const QString &, const Configuration *configuration){ return make_shared<cvVideoWriter>(*configuration); }},
-    {Configuration::PNG, [](const QString &, const Configuration *configuration){ return make_shared<ImageFileWriter>(ImageFileWriter::PNG, *configuration); }},
-    {Configuration::FITS, [](const QString &, const Configuration *configuration){ return make_shared<ImageFileWriter>(ImageFileWriter::FITS, *configuration); }},
+  switch(format) {
+    case Configuration::SER:
+      return [](const QString &deviceName, const Configuration *configuration) -> FileWriterPtr {
+        if(! configuration->ser_stripe_directories().isEmpty())
+          return make_shared<StripedSERWriter>(deviceName, *configuration);
+        if(configuration->ser_segment_max_size() > 0 || configuration->ser_segment_max_frames() > 0)
+          return make_shared<SegmentedSERWriter>(deviceName, *configuration);
+        return make_shared<SERWriter>(deviceName, *configuration);
+      };
+#if HAVE_ZSTD
+    case Configuration::CompressedSER:
+      return [](const QString &deviceName, const Configuration *configuration) -> FileWriterPtr { return make_shared<CompressedSERWriter>(deviceName, *configuration); };
+#endif
+    default:
+      break;
+  }
+  static const QMap<Configuration::SaveFormat, QString> modules {
+    {Configuration::Video, "module_video_writer"},
+    {Configuration::PNG, "module_image_file_writer"},
+    {Configuration::FITS, "module_image_file_writer"},
+    {Configuration::TIFF, "module_image_file_writer"},
+    {Configuration::FITSCube, "module_image_file_writer"},
+#if HAVE_LIBAV
+    {Configuration::FFmpegVideo, "module_ffmpeg_video_writer"},
+#endif
   };
+  if(! modules.contains(format))
+    return {};
+  auto create = reinterpret_cast<CreateFileWriterFunction>(Modules::instance().resolve(modules[format], PLANETARY_IMAGER_WRITER_CREATE_F));
+  if(! create)
+    return {};
+  return [create, format](const QString &deviceName, const Configuration *configuration) { return create(format, deviceName, configuration); };
+}
+}
+
+FileWriter::Factory FileWriter::factory(Configuration::SaveFormat format)
+{
+  auto factory = writer_factory(format);
+#if DEVELOPER_MODE == 1
+  // Soak testing: every writer, extra recording sinks included, behind a slow or failing disk
+  static const WriteFaults::Settings faults = FaultyFileWriter::from_environment();
+  if(factory && faults.active())
+    return [factory](const QString &deviceName, const Configuration *configuration) -> FileWriterPtr {
+      return make_shared<FaultyFileWriter>(factory(deviceName, configuration), faults);
+    };
+#endif
+  return factory;
 }
@@ -22,6 +22,7 @@
 #include <memory>
 #include <functional>
 #include <QString>
+#include <QStringList>
 #include "commons/configuration.h"
 #include "commons/fwd.h"
 
@@ -31,8 +32,27 @@ class FileWriter : public ImageHandler {
 public:
   typedef std::function<FileWriterPtr(const QString &deviceName, const Configuration *configuration)> Factory;
   virtual QString filename() const = 0;
-  static QMap<Configuration::SaveFormat, Factory> factories();
+  /// All the files written by this writer, for writers splitting the recording in more files
+  virtual QStringList files() const { return {filename()}; }
+  /**
+   * Writers may keep the frames handed to handle() and write several of them at once, releasing them (and their pooled
+   * buffers) once written. flush() writes out the frames kept so far: the recording calls it when no frames are coming.
+   * Destroying the writer writes them too.
+   */
+  virtual void flush() {}
+  /**
+   * The writer factory for format, or an empty one if the format isn't available.
+   * SER writers are built in; the other formats come from modules, loaded here the first time they're asked for.
+   * Developer builds wrap them all in a FaultyFileWriter when PLANETARYIMAGER_WRITER_FAULTS is set.
+   */
+  static Factory factory(Configuration::SaveFormat format);
 };
 
+/// Exported by writer modules: they create their writers themselves, since FileWriter can't be deleted through its base
+typedef FileWriterPtr (*CreateFileWriterFunction)(Configuration::SaveFormat format, const QString &deviceName, const Configuration *configuration);
+#define PLANETARY_IMAGER_WRITER_CREATE_F "PlanetaryImager_createWriter"
+#define DECLARE_WRITER_MODULE_CREATE \
+extern "C" Q_DECL_EXPORT FileWriterPtr PlanetaryImager_createWriter(Configuration::SaveFormat format, const QString &deviceName, const Configuration *configuration)
+
 
 #endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COMPRESSEDSERWRITER_H
+#include "fitscubewriter.h"
+#include <QFile>
+#include <QDebug>
+#include <QDateTime>
+#include <QtEndian>
+#include <QHash>
+#include <cstring>
+#include <vector>
+#include "Qt/qt_strings_helper.h"
+#include "image_handlers/saveimages.h"
+#include "commons/frame.h"
+#include "commons/tracing.h"
+
+using namespace std;
+
+namespace {
+  // FITS files are made of 2880 bytes blocks, and headers of 80 characters cards
+  const qint64 BLOCK_SIZE = 2880;
+  const int CARD_SIZE = 80;
+  // MJD of 1970-01-01: the FRAMES table times are seconds since then, in UTC
+  const double UNIX_EPOCH_MJD = 40587.0;
+
+  QByteArray card(const QString &key, const QString &value, const QString &comment = {}) {
+    // Fixed format: the value ends at column 30, so it can be patched in place
+    auto text = "%1= %2"_q % key.leftJustified(8) % value.rightJustified(20);
+    if(! comment.isEmpty())
+      text += " / " + comment;
+    return text.leftJustified(CARD_SIZE, ' ', true).toLatin1();
+  }
+  QByteArray card(const QString &key, qint64 value, const QString &comment = {}) { return card(key, QString::number(value), comment); }
+  QByteArray card(const QString &key, double value, const QString &comment = {}) {
+    auto number = QString::number(value, 'G', 15);
+    return card(key, number.contains('.') || number.contains('E') ? number : number + '.', comment);
+  }
+  QByteArray logical_card(const QString &key, bool value, const QString &comment = {}) { return card(key, value ? "T" : "F", comment); }
+  QByteArray quoted_card(const QString &key, const QString &value, const QString &comment = {}) {
+    // Quoted, at least 8 characters, left justified from column 11
+    auto quoted = "'%1'"_q % QString{value}.replace("'", "''").left(66).leftJustified(8);
+    auto text = "%1= %2"_q % key.leftJustified(8) % quoted.leftJustified(20);
+    if(! comment.isEmpty())
+      text += " / " + comment;
+    return text.leftJustified(CARD_SIZE, ' ', true).toLatin1();
+  }
+  QByteArray end_header(QByteArray header) {
+    header += QByteArray{"END"}.leftJustified(CARD_SIZE);
+    if(auto remainder = header.size() % BLOCK_SIZE)
+      header += QByteArray(BLOCK_SIZE - remainder, ' ');
+    return header;
+  }
+  void put_double(char *out, double value) {
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToBigEndian(bits, reinterpret_cast<uchar *>(out));
+  }
+}
+
+DPTR_IMPL(FITSCubeWriter) {
+  const QString deviceName;
+  const Configuration &configuration;
+  QFile file;
+  struct FrameInfo {
+    double time;
+    double exposure;
+    // NaN when unknown
+    double gain;
+    double temperature;
+  };
+  vector<FrameInfo> frames;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  int bpp = 0;
+  Frame::ColorFormat color_format = Frame::Mono;
+  // Position of the frames axis card in the primary header, rewritten on close
+  qint64 frames_card_pos = 0;
+  QString frames_axis;
+  vector<char> buffer;
+  void write_header(const FrameConstPtr &frame);
+  void encode(const FrameConstPtr &frame);
+  void write_table();
+  void write(const char *data, qint64 size);
+  void pad(char fill = '\0');
+};
+
+FITSCubeWriter::FITSCubeWriter(const QString& deviceName, const Configuration& configuration) : dptr(deviceName, configuration)
+{
+  d->file.setFileName(configuration.savefile());
+  if(! d->file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    throw SaveImages::Error::openingFile(d->file.fileName(), d->file.errorString());
+}
+
+FITSCubeWriter::~FITSCubeWriter()
+{
+  try {
+    if(d->width > 0) {
+      d->pad();
+      d->write_table();
+      d->file.seek(d->frames_card_pos);
+      d->file.write(card(d->frames_axis, static_cast<qint64>(d->frames.size()), "Frames"));
+    }
+  } catch(const SaveImages::Error &e) {
+    qWarning() << e.what();
+  }
+  d->file.close();
+  qDebug() << "FITS cube closed: " << d->frames.size() << "frames";
+}
+
+QString FITSCubeWriter::filename() const
+{
+  return d->file.fileName();
+}
+
+void FITSCubeWriter::Private::write(const char* data, qint64 size)
+{
+  if(file.write(data, size) != size)
+    throw SaveImages::Error("Error writing FITS file %1: %2"_q % file.fileName() % file.errorString());
+}
+
+void FITSCubeWriter::Private::pad(char fill)
+{
+  if(auto remainder = file.pos() % BLOCK_SIZE) {
+    QByteArray padding(BLOCK_SIZE - remainder, fill);
+    write(padding.constData(), padding.size());
+  }
+}
+
+void FITSCubeWriter::Private::write_header(const FrameConstPtr& frame)
+{
+  width = frame->resolution().width();
+  height = frame->resolution().height();
+  channels = frame->channels();
+  bpp = frame->bpp();
+  color_format = frame->colorFormat();
+  const bool colour = channels == 3;
+  frames_axis = colour ? "NAXIS4" : "NAXIS3";
+  QByteArray header;
+  header += logical_card("SIMPLE", true, "file does conform to FITS standard");
+  header += card("BITPIX", static_cast<qint64>(bpp == 8 ? 8 : 16), "number of bits per data pixel");
+  header += card("NAXIS", static_cast<qint64>(colour ? 4 : 3), "number of data axes");
+  header += card("NAXIS1", static_cast<qint64>(width), "Width");
+  header += card("NAXIS2", static_cast<qint64>(height), "Height");
+  if(colour)
+    header += card("NAXIS3", static_cast<qint64>(3), "R, G, B planes");
+  frames_card_pos = header.size();
+  header += card(frames_axis, static_cast<qint64>(0), "Frames");
+  header += logical_card("EXTEND", true, "FITS dataset may contain extensions");
+  if(bpp != 8) {
+    header += card("BZERO", 32768.0, "offset data range to that of unsigned short");
+    header += card("BSCALE", 1.0, "default scaling factor");
+  }
+  header += quoted_card("INSTRUME", deviceName, "Camera");
+  if(! configuration.observer().isEmpty())
+    header += quoted_card("OBSERVER", configuration.observer());
+  if(! configuration.telescope().isEmpty())
+    header += quoted_card("TELESCOP", configuration.telescope());
+  static const QHash<Frame::ColorFormat, QString> bayer_patterns {
+    {Frame::Bayer_RGGB, "RGGB"}, {Frame::Bayer_GRBG, "GRBG"}, {Frame::Bayer_GBRG, "GBRG"}, {Frame::Bayer_BGGR, "BGGR"},
+  };
+  if(bayer_patterns.contains(color_format))
+    header += quoted_card("BAYERPAT", bayer_patterns[color_format], "Bayer color pattern");
+  header += quoted_card("DATE-OBS", frame->created_utc().toString("yyyy-MM-ddTHH:mm:ss.zzz"), "UTC start date of observation");
+  // Geometry can't change during the recording; gain and temperature of each frame are in the FRAMES table
+  const auto &metadata = frame->metadata();
+  if(metadata.bin) {
+    header += card("XBINNING", static_cast<qint64>(metadata.bin), "Binning factor in width");
+    header += card("YBINNING", static_cast<qint64>(metadata.bin), "Binning factor in height");
+  }
+  if(metadata.has_roi_offset()) {
+    header += card("XORGSUBF", static_cast<qint64>(metadata.roi_x), "Subframe origin on X axis (binned pixels)");
+    header += card("YORGSUBF", static_cast<qint64>(metadata.roi_y), "Subframe origin on Y axis (binned pixels)");
+  }
+  header = end_header(header);
+  write(header.constData(), header.size());
+  // Big endian, and planar for colour frames
+  buffer.resize(frame->size());
+}
+
+void FITSCubeWriter::Private::encode(const FrameConstPtr& frame)
+{
+  const auto &mat = frame->mat();
+  const size_t plane = static_cast<size_t>(width) * height;
+  if(bpp == 8) {
+    auto out = reinterpret_cast<uint8_t *>(buffer.data());
+    for(int row = 0; row < height; row++) {
+      auto in = mat.ptr<uint8_t>(row);
+      if(channels == 1) {
+        memcpy(out + row * width, in, width);
+        continue;
+      }
+      for(int c = 0; c < 3; c++) {
+        auto source = color_format == Frame::BGR ? 2 - c : c;
+        auto plane_row = out + c * plane + row * width;
+        for(int x = 0; x < width; x++)
+          plane_row[x] = in[x * 3 + source];
+      }
+    }
+    return;
+  }
+  // Stored as signed shorts with BZERO 32768: flipping the sign bit and swapping bytes is a single vectorizable pass
+  auto out = reinterpret_cast<uint16_t *>(buffer.data());
+  for(int row = 0; row < height; row++) {
+    auto in = mat.ptr<uint16_t>(row);
+    if(channels == 1) {
+      auto plane_row = out + row * width;
+      for(int x = 0; x < width; x++)
+        plane_row[x] = qToBigEndian<uint16_t>(in[x] ^ 0x8000);
+      continue;
+    }
+    for(int c = 0; c < 3; c++) {
+      auto source = color_format == Frame::BGR ? 2 - c : c;
+      auto plane_row = out + c * plane + row * width;
+      for(int x = 0; x < width; x++)
+        plane_row[x] = qToBigEndian<uint16_t>(in[x * 3 + source] ^ 0x8000);
+    }
+  }
+}
+
+void FITSCubeWriter::Private::write_table()
+{
+  static const int ROW_SIZE = 4 * sizeof(double);
+  QByteArray header;
+  header += quoted_card("XTENSION", "BINTABLE", "binary table extension");
+  header += card("BITPIX", static_cast<qint64>(8));
+  header += card("NAXIS", static_cast<qint64>(2));
+  header += card("NAXIS1", static_cast<qint64>(ROW_SIZE), "bytes per row");
+  header += card("NAXIS2", static_cast<qint64>(frames.size()), "Frames");
+  header += card("PCOUNT", static_cast<qint64>(0));
+  header += card("GCOUNT", static_cast<qint64>(1));
+  header += card("TFIELDS", static_cast<qint64>(4));
+  header += quoted_card("TTYPE1", "TIME", "Capture time");
+  header += quoted_card("TFORM1", "1D");
+  header += quoted_card("TUNIT1", "s");
+  header += quoted_card("TTYPE2", "EXPTIME", "Exposure time");
+  header += quoted_card("TFORM2", "1D");
+  header += quoted_card("TUNIT2", "s");
+  header += quoted_card("TTYPE3", "GAIN", "Camera gain, NaN if unknown");
+  header += quoted_card("TFORM3", "1D");
+  header += quoted_card("TTYPE4", "CCD-TEMP", "CCD temperature, NaN if unknown");
+  header += quoted_card("TFORM4", "1D");
+  header += quoted_card("TUNIT4", "Celsius");
+  header += quoted_card("EXTNAME", "FRAMES");
+  header += quoted_card("TIMESYS", "UTC");
+  header += card("MJDREF", UNIX_EPOCH_MJD, "TIME is in seconds since 1970-01-01");
+  header = end_header(header);
+  write(header.constData(), header.size());
+  QByteArray rows(frames.size() * ROW_SIZE, '\0');
+  for(size_t i = 0; i < frames.size(); i++) {
+    put_double(rows.data() + i * ROW_SIZE, frames[i].time);
+    put_double(rows.data() + i * ROW_SIZE + sizeof(double), frames[i].exposure);
+    put_double(rows.data() + i * ROW_SIZE + 2 * sizeof(double), frames[i].gain);
+    put_double(rows.data() + i * ROW_SIZE + 3 * sizeof(double), frames[i].temperature);
+  }
+  write(rows.constData(), rows.size());
+  pad();
+}
+
+void FITSCubeWriter::doHandle(FrameConstPtr frame)
+{
+  Tracing::Span span{"FITSCubeWriter::doHandle", frame->sequence()};
+  if(frame->channels() != 1 && frame->channels() != 3)
+    throw SaveImages::Error("Unsupported number of channels for FITS cubes: %1"_q % frame->channels());
+  if(d->width == 0) {
+    d->write_header(frame);
+  } else if(frame->resolution() != QSize{d->width, d->height} || frame->channels() != d->channels || frame->bpp() != d->bpp) {
+    qWarning() << "Skipping frame: the FITS cube geometry can't change during a recording";
+    return;
+  }
+  d->encode(frame);
+  d->write(d->buffer.data(), d->buffer.size());
+  d->frames.push_back({frame->created_utc_msecs() / 1000.0, frame->exposure().count(), frame->metadata().gain, frame->metadata().temperature});
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COMPRESSEDSERWRITER_H
+#ifndef FITSCUBEWRITER_H
+#define FITSCUBEWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+
+/**
+ * Writes the whole recording as a single FITS file: frames are the planes of a data cube in the primary HDU
+ * (NAXIS3, or NAXIS4 for colour frames, with R, G, B on NAXIS3), patched to the number of frames on close.
+ * A binary table extension (FRAMES) stores the capture time, exposure, gain and temperature of every frame.
+ */
+class FITSCubeWriter : public FileWriter
+{
+public:
+  FITSCubeWriter(const QString &deviceName, const Configuration &configuration);
+  ~FITSCubeWriter();
+  QString filename() const override;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // FITSCUBEWRITER_H
@@ -17,26 +17,54 @@
  */
 
 #include "imagefilewriter.h"
+#include "fitscubewriter.h"
 #include <functional>
 #include "Qt/qt_strings_helper.h"
 #include <opencv2/opencv.hpp>
 #include <QDir>
-#include <CCfits/CCfits>
+#include <QFile>
+#include <fitsio.h>
 #include "image_handlers/saveimages.h"
 #include "commons/frame.h"
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
 
 using namespace std;
 using namespace std::placeholders;
 
+// Files in each numbered subdirectory
+static const quint64 FILES_PER_DIRECTORY = 10000;
+static const char *MANIFEST_FILE = "frames.csv";
+
 DPTR_IMPL(ImageFileWriter) {
   const Configuration &configuration;
   QString filename;
   ImageFileWriter *q;
-  function<void(FrameConstPtr)> writer;
-  QString savename(FrameConstPtr frame, const QString &extension) const;
+  function<void(FrameConstPtr, QString)> writer;
+  QString extension;
   QDir savedir;
-  void saveFITS(FrameConstPtr frame) const;
-  void saveCV(FrameConstPtr frame, const QString &extension) const;
+  // Files are numbered, and sharded in subdirectories: names can't collide, and directories stay small
+  quint64 frames = 0;
+  QFile manifest;
+  QString savename(quint64 index, const FrameConstPtr &frame);
+  void saveFITS(FrameConstPtr frame, const QString &filename) const;
+  // Read once: frames are saved from the pool threads
+  Configuration::FITSCompression fits_compression = Configuration::FITSUncompressed;
+  int fits_hcompress_scale = 0;
+  void saveCV(FrameConstPtr frame, const QString &filename, const vector<int> &parameters) const;
+
+  // Every frame is a separate file, so encoding can be fanned out to a pool of threads
+  int max_in_flight = 1;
+  int in_flight = 0;
+  QString error;
+  QMutex mutex;
+  QWaitCondition frame_done;
+  QThreadPool pool;
+  void submit(const FrameConstPtr &frame);
+  void wait_all();
 };
 
 ImageFileWriter::ImageFileWriter(ImageFileWriter::Format format, const Configuration &configuration) : dptr(configuration, configuration.savefile(), this)
@@ -44,19 +72,43 @@ ImageFileWriter::ImageFileWriter(ImageFileWriter::Format format, const Configura
   qDebug() << "Format: " << format;
   switch(format) {
     case PNG:
-      d->writer = bind(&Private::saveCV, d.get(), _1, "png");
+      d->extension = "png";
+      d->writer = bind(&Private::saveCV, d.get(), _1, _2, vector<int>{cv::IMWRITE_PNG_COMPRESSION, configuration.png_compression_level()});
+      break;
+    case TIFF:
+      // 1: no compression, 8: Adobe deflate (libtiff's COMPRESSION_NONE and COMPRESSION_ADOBE_DEFLATE)
+      d->extension = "tiff";
+      d->writer = bind(&Private::saveCV, d.get(), _1, _2, vector<int>{cv::IMWRITE_TIFF_COMPRESSION, configuration.tiff_compression() ? 8 : 1});
       break;
     case FITS:
-      d->writer = bind(&Private::saveFITS, d.get(), _1);
+      d->extension = "fits";
+      d->writer = bind(&Private::saveFITS, d.get(), _1, _2);
       break;
   }
+  d->fits_compression = configuration.fits_compression();
+  d->fits_hcompress_scale = configuration.fits_hcompress_scale();
   d->savedir.mkpath(d->filename);
   d->savedir.cd(d->filename);
+  d->manifest.setFileName(d->savedir.filePath(MANIFEST_FILE));
+  if(d->manifest.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    d->manifest.write("index,file,timestamp_utc,exposure_seconds\n");
+  else
+    qWarning() << "Unable to write frames manifest " << d->manifest.fileName() << ": " << d->manifest.errorString();
+  int threads = configuration.image_writer_threads() > 0 ? configuration.image_writer_threads() : QThread::idealThreadCount();
+  d->pool.setMaxThreadCount(max(threads, 1));
+  // Bounded in-flight frames: keep the pool busy, but let the recording queue absorb the backlog
+  d->max_in_flight = 2 * d->pool.maxThreadCount();
+  qDebug() << "Image writer threads: " << d->pool.maxThreadCount() << ", max in-flight frames: " << d->max_in_flight;
 }
 
 ImageFileWriter::~ImageFileWriter()
 {
-  if(d->savedir.count() == 0) {
+  d->wait_all();
+  if(! d->error.isEmpty())
+    qWarning() << "Error saving frames: " << d->error;
+  d->manifest.close();
+  if(d->frames == 0) {
+    d->manifest.remove();
     d->savedir.cdUp();
     d->savedir.rmpath(d->filename);
   }
@@ -66,7 +118,44 @@ ImageFileWriter::~ImageFileWriter()
 void ImageFileWriter::doHandle(FrameConstPtr frame)
 {
   if(d->writer)
-    d->writer(frame);
+    d->submit(frame);
+}
+
+void ImageFileWriter::Private::submit(const FrameConstPtr& frame)
+{
+  {
+    QMutexLocker lock(&mutex);
+    while(in_flight >= max_in_flight && error.isEmpty())
+      frame_done.wait(&mutex);
+    // Errors from the pool threads are reported on the next frame, on the writer thread
+    if(! error.isEmpty()) {
+      auto message = error;
+      error.clear();
+      throw SaveImages::Error(message);
+    }
+    ++in_flight;
+  }
+  auto filename = savename(frames++, frame);
+  QtConcurrent::run(&pool, [this, frame, filename]{
+    QString failure;
+    try {
+      writer(frame, filename);
+    } catch(const SaveImages::Error &e) {
+      failure = QString::fromStdString(e.what());
+    }
+    QMutexLocker lock(&mutex);
+    --in_flight;
+    if(! failure.isEmpty() && error.isEmpty())
+      error = failure;
+    frame_done.wakeAll();
+  });
+}
+
+void ImageFileWriter::Private::wait_all()
+{
+  QMutexLocker lock(&mutex);
+  while(in_flight > 0)
+    frame_done.wait(&mutex);
 }
 
 QString ImageFileWriter::filename() const
@@ -74,9 +163,17 @@ QString ImageFileWriter::filename() const
   return d->filename;
 }
 
-QString ImageFileWriter::Private::savename(FrameConstPtr frame, const QString& extension) const
+QString ImageFileWriter::Private::savename(quint64 index, const FrameConstPtr &frame)
 {
-  return "%1/%2.%3"_q % filename % frame->created_utc().toString("yyyy-MM-ddTHHmmss.zzz-UTC") % extension;
+  // Called on the writer thread, in frame order: each shard directory is created once, before its first frame
+  auto shard = QString::number(index / FILES_PER_DIRECTORY).rightJustified(5, '0');
+  if(index % FILES_PER_DIRECTORY == 0)
+    savedir.mkdir(shard);
+  auto timestamp = frame->created_utc().toString("yyyy-MM-ddTHHmmss.zzz-UTC");
+  auto name = "%1/%2_%3.%4"_q % shard % QString::number(index).rightJustified(8, '0') % timestamp % extension;
+  if(manifest.isOpen())
+    manifest.write(("%1,%2,%3,%4\n"_q % index % name % timestamp % frame->exposure().count()).toUtf8());
+  return savedir.filePath(name);
 }
 
 /* Sample FITS header by INDI - try to add as much fields as possible
@@ -104,42 +201,118 @@ FOCALLEN=                1280. / Focal Length (mm)
 COMMENT Generated by INDI
 END
 */
-void ImageFileWriter::Private::saveFITS(FrameConstPtr frame) const
+void ImageFileWriter::Private::saveFITS(FrameConstPtr frame, const QString &filename) const
 {
-  auto filename = savename(frame, "fits");
-  if(frame->channels() != 1) {
-    throw SaveImages::Error::openingFile(filename, QObject::tr("Colour images are currently unsupported for FITS writer"));
+  const auto &mat = frame->mat();
+  const bool colour = frame->channels() == 3;
+  if(frame->channels() != 1 && ! colour) {
+    throw SaveImages::Error::openingFile(filename, QObject::tr("Unsupported number of channels for FITS writer: %1").arg(frame->channels()));
   }
-  long naxes[2] = { frame->resolution().width(), frame->resolution().height() };
-  try {
-    CCfits::FITS fits{filename.toStdString(), frame->bpp() == 8 ? BYTE_IMG : USHORT_IMG, 2, naxes};
-    valarray<long> data(frame->resolution().width() * frame->resolution().height());
-    auto mat = frame->mat();
-    if(frame->bpp() == 8) {
-      copy(mat.begin<uint8_t>(), mat.end<uint8_t>(), begin(data));
-    } else {
-      copy(mat.begin<uint16_t>(), mat.end<uint16_t>(), begin(data));
+  // Colour frames are stored as R, G, B planes (NAXIS3)
+  long naxes[3] = { mat.cols, mat.rows, 3 };
+  // 16 bit frames are written as unsigned shorts: cfitsio stores them as BITPIX 16 with BZERO 32768, offsetting and swapping them in its own buffers
+  const int bitpix = frame->bpp() == 8 ? BYTE_IMG : USHORT_IMG;
+  const int datatype = frame->bpp() == 8 ? TBYTE : TUSHORT;
+  // cfitsio built without reentrancy support can't be used from more pool threads at once
+  static QMutex non_reentrant_mutex;
+  unique_ptr<QMutexLocker> non_reentrant_lock;
+  if(! fits_is_reentrant())
+    non_reentrant_lock = make_unique<QMutexLocker>(&non_reentrant_mutex);
+
+  fitsfile *fits = nullptr;
+  int status = 0;
+  auto write_rows = [&](const cv::Mat &plane, LONGLONG first) {
+    // Straight from the frame buffer, in a single call when there's no row padding
+    if(plane.isContinuous()) {
+      fits_write_img(fits, datatype, first, plane.total(), const_cast<uchar *>(plane.data), &status);
+      return;
     }
-    if(frame->exposure() != Frame::Seconds::zero()) {
-      fits.pHDU().addKey("EXPTIME", frame->exposure().count(), "Total Exposure Time (s)");
+    for(int row = 0; row < plane.rows && ! status; row++)
+      fits_write_img(fits, datatype, first + static_cast<LONGLONG>(row) * plane.cols, plane.cols, const_cast<uchar *>(plane.ptr(row)), &status);
+  };
+  // '!' overwrites an existing file
+  fits_create_file(&fits, ("!" + filename).toLocal8Bit().constData(), &status);
+  // Tile compressed images are stored in a binary table extension, and compressed by cfitsio while writing them, on the pool thread
+  if(fits_compression == Configuration::FITSRice) {
+    fits_set_compression_type(fits, RICE_1, &status);
+  } else if(fits_compression == Configuration::FITSHCompress) {
+    // HCOMPRESS works on 2D tiles: a whole plane each
+    long tile[3] = { mat.cols, mat.rows, 1 };
+    fits_set_compression_type(fits, HCOMPRESS_1, &status);
+    fits_set_tile_dim(fits, colour ? 3 : 2, tile, &status);
+    fits_set_hcomp_scale(fits, static_cast<float>(fits_hcompress_scale), &status);
+  }
+  fits_create_img(fits, bitpix, colour ? 3 : 2, naxes, &status);
+  if(frame->exposure() != Frame::Seconds::zero()) {
+    double exposure = frame->exposure().count();
+    fits_write_key(fits, TDOUBLE, "EXPTIME", &exposure, "Total Exposure Time (s)", &status);
+  }
+  auto date_obs = frame->created_utc().toString(Qt::ISODate).toLatin1();
+  fits_write_key(fits, TSTRING, "DATE-OBS", date_obs.data(), "UTC start date of observation", &status);
+  auto metadata = frame->metadata();
+  if(metadata.has_gain())
+    fits_write_key(fits, TDOUBLE, "GAIN", &metadata.gain, "Camera gain", &status);
+  if(metadata.has_temperature())
+    fits_write_key(fits, TDOUBLE, "CCD-TEMP", &metadata.temperature, "CCD Temperature (Celsius)", &status);
+  if(metadata.bin) {
+    int bin = metadata.bin;
+    fits_write_key(fits, TINT, "XBINNING", &bin, "Binning factor in width", &status);
+    fits_write_key(fits, TINT, "YBINNING", &bin, "Binning factor in height", &status);
+  }
+  if(metadata.has_roi_offset()) {
+    fits_write_key(fits, TINT, "XORGSUBF", &metadata.roi_x, "Subframe origin on X axis (binned pixels)", &status);
+    fits_write_key(fits, TINT, "YORGSUBF", &metadata.roi_y, "Subframe origin on Y axis (binned pixels)", &status);
+  }
+  if(colour) {
+    cv::Mat plane;
+    const LONGLONG plane_size = static_cast<LONGLONG>(mat.cols) * mat.rows;
+    for(int fits_plane = 0; fits_plane < 3 && ! status; fits_plane++) {
+      int channel = frame->colorFormat() == Frame::BGR ? 2 - fits_plane : fits_plane;
+      cv::extractChannel(mat, plane, channel);
+      write_rows(plane, 1 + fits_plane * plane_size);
     }
-    fits.pHDU().addKey("DATE-OBS", frame->created_utc().toString(Qt::ISODate).toStdString(), "UTC start date of observation");
-    fits.pHDU().write(1, data.size(), data);
-    fits.flush();
+  } else {
+    write_rows(mat, 1);
   }
-  catch(const CCfits::FitsException &e) {
-    throw SaveImages::Error(QString::fromStdString(e.message()));
+  // Closed even after an error, keeping the first status
+  int close_status = 0;
+  if(fits)
+    fits_close_file(fits, status ? &close_status : &status);
+  if(status) {
+    char message[FLEN_STATUS];
+    fits_get_errstatus(status, message);
+    throw SaveImages::Error("Error writing FITS file %1: %2"_q % filename % QString::fromLatin1(message));
   }
 }
 
-void ImageFileWriter::Private::saveCV(FrameConstPtr frame, const QString& extension) const
+void ImageFileWriter::Private::saveCV(FrameConstPtr frame, const QString& filename, const vector<int> &parameters) const
 {
-  const QString filename = savename(frame, extension);
+  // Encoded in memory, and written with a single call: OpenCV's encoders would otherwise do many small writes
+  thread_local vector<uchar> encoded;
   try {
-    if(!cv::imwrite(filename.toStdString(), frame->mat()))
+    if(!cv::imencode("." + extension.toStdString(), frame->mat(), encoded, parameters))
       throw SaveImages::Error::openingFile(filename);
-  } catch(const exception &e) {
+  } catch(const cv::Exception &e) {
     throw SaveImages::Error(QString::fromStdString(e.what()));
   }
+  QFile file(filename);
+  if(! file.open(QIODevice::WriteOnly | QIODevice::Unbuffered) || file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size()) != static_cast<qint64>(encoded.size()))
+    throw SaveImages::Error::openingFile(filename, file.errorString());
 }
 
+DECLARE_WRITER_MODULE_CREATE
+{
+  // The same module writes FITS cubes: both need cfitsio, SER recordings don't
+  switch(format) {
+    case Configuration::PNG:
+      return make_shared<ImageFileWriter>(ImageFileWriter::PNG, *configuration);
+    case Configuration::FITS:
+      return make_shared<ImageFileWriter>(ImageFileWriter::FITS, *configuration);
+    case Configuration::TIFF:
+      return make_shared<ImageFileWriter>(ImageFileWriter::TIFF, *configuration);
+    case Configuration::FITSCube:
+      return make_shared<FITSCubeWriter>(deviceName, *configuration);
+    default:
+      return {};
+  }
+}
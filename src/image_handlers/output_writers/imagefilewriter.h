@@ -25,7 +25,7 @@
 class ImageFileWriter : public FileWriter
 {
 public:
-  enum Format {PNG, FITS};
+  enum Format {PNG, FITS, TIFF};
   ImageFileWriter(Format format, const Configuration &configuration);
   QString filename() const override;
   ~ImageFileWriter();
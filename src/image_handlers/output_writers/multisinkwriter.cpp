@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "multisinkwriter.h"
+#include "commons/frame.h"
+#include "commons/framesqueue.h"
+#include "commons/metrics.h"
+#include "commons/messageslogger.h"
+#include "Qt/qt_strings_helper.h"
+#include <QDebug>
+#include <QObject>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+struct RunningSink {
+  RunningSink(const MultiSinkWriter::Sink &sink) : sink{sink},
+    written_metric{Metrics::instance().counter("recording_sink_frames_total", "Frames written by the extra sinks of a recording", "sink=\"%1\""_q % sink.name)},
+    dropped_metric{Metrics::instance().counter("recording_sink_dropped_frames_total", "Frames an extra recording sink was too slow for", "sink=\"%1\""_q % sink.name)}
+  {
+    queue.set_max_bytes(sink.max_bytes);
+  }
+  const MultiSinkWriter::Sink sink;
+  FramesQueue queue{0};
+  // Held while writing: files() may be asked from another thread
+  mutable mutex writer_mutex;
+  quint64 seen = 0;
+  atomic<quint64> written{0};
+  atomic<quint64> dropped{0};
+  atomic_bool failed{false};
+  atomic_bool stopping{false};
+  chrono::steady_clock::time_point first_write, last_write;
+  Metrics::Counter &written_metric;
+  Metrics::Counter &dropped_metric;
+  thread worker;
+  void drop();
+  void run();
+};
+}
+
+DPTR_IMPL(MultiSinkWriter) {
+  const FileWriterPtr primary;
+  vector<unique_ptr<RunningSink>> sinks;
+  bool closed = false;
+};
+
+void RunningSink::drop()
+{
+  ++dropped;
+  dropped_metric.add();
+}
+
+void RunningSink::run()
+{
+  while(true) {
+    auto frame = queue.pop(100ms);
+    if(!frame) {
+      if(stopping)
+        return;
+      continue;
+    }
+    // Queued before the failure: given up too
+    if(failed) {
+      drop();
+      continue;
+    }
+    try {
+      lock_guard<mutex> lock{writer_mutex};
+      sink.writer->handle(frame);
+      frame.reset();
+      // Batching writers hold on to pooled buffers: written as soon as there's nothing to batch them with
+      if(queue.size() == 0)
+        sink.writer->flush();
+      last_write = chrono::steady_clock::now();
+      if(written++ == 0)
+        first_write = last_write;
+    } catch(const std::exception &e) {
+      failed = true;
+      drop();
+      MessagesLogger::queue(MessagesLogger::Warning, QObject::tr("Recording"),
+        QObject::tr("Recording sink %1 stopped, the main file is still being recorded: %2") % sink.name % QString::fromLocal8Bit(e.what()));
+      continue;
+    }
+    written_metric.add();
+  }
+}
+
+MultiSinkWriter::MultiSinkWriter(const FileWriterPtr &primary, const vector<Sink> &sinks) : dptr(primary)
+{
+  for(const auto &sink: sinks) {
+    d->sinks.push_back(make_unique<RunningSink>(sink));
+    auto &running = *d->sinks.back();
+    running.worker = thread{&RunningSink::run, &running};
+    qDebug() << "Recording sink" << sink.name << "every" << sink.every << "frames:" << sink.writer->filename();
+  }
+}
+
+MultiSinkWriter::~MultiSinkWriter()
+{
+  close();
+}
+
+void MultiSinkWriter::doHandle(FrameConstPtr frame)
+{
+  // Sinks first: the primary writer may take a while, and the frame is already in memory anyway
+  for(auto &sink: d->sinks) {
+    if(sink->seen++ % sink->sink.every != 0)
+      continue;
+    if(d->closed || sink->failed || !sink->queue.push(frame))
+      sink->drop();
+  }
+  d->primary->handle(frame);
+}
+
+void MultiSinkWriter::flush()
+{
+  d->primary->flush();
+}
+
+void MultiSinkWriter::close()
+{
+  if(d->closed)
+    return;
+  d->closed = true;
+  // All the sinks drain their queues at once
+  for(auto &sink: d->sinks)
+    sink->stopping = true;
+  for(auto &sink: d->sinks) {
+    sink->worker.join();
+    lock_guard<mutex> lock{sink->writer_mutex};
+    sink->sink.writer->flush();
+  }
+}
+
+QString MultiSinkWriter::filename() const
+{
+  return d->primary->filename();
+}
+
+QStringList MultiSinkWriter::files() const
+{
+  auto files = d->primary->files();
+  for(const auto &sink: d->sinks) {
+    lock_guard<mutex> lock{sink->writer_mutex};
+    files += sink->sink.writer->files();
+  }
+  return files;
+}
+
+FileWriterPtr MultiSinkWriter::primary() const
+{
+  return d->primary;
+}
+
+vector<MultiSinkWriter::SinkStats> MultiSinkWriter::stats() const
+{
+  vector<SinkStats> stats;
+  for(const auto &sink: d->sinks) {
+    lock_guard<mutex> lock{sink->writer_mutex};
+    const double seconds = chrono::duration<double>{sink->last_write - sink->first_write}.count();
+    const quint64 written = sink->written;
+    stats.push_back({sink->sink.name, sink->sink.writer->files(), written, sink->dropped, written > 1 && seconds > 0 ? (written - 1) / seconds : 0, sink->failed});
+  }
+  return stats;
+}
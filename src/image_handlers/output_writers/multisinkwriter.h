@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTISINKWRITER_H
+#define MULTISINKWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+#include <vector>
+
+FWD_PTR(MultiSinkWriter)
+
+/**
+ * One recording, several files: the primary writer gets every frame, on the recording thread, as a plain writer would.
+ * Each sink keeps one frame every so many, and writes it from a thread and a bounded queue of its own: frames are shared,
+ * not copied, and a sink falling behind drops its own frames only, never slowing down the primary writer.
+ * A sink failing to write is given up, with a warning; the primary writer errors still come from handle().
+ * filename() is the primary one, files() are those of all the writers.
+ */
+class MultiSinkWriter : public FileWriter
+{
+public:
+  struct Sink {
+    QString name;
+    /// The configuration the writer was created with, if it's the sink's own: kept as long as the writer
+    std::shared_ptr<const Configuration> configuration;
+    FileWriterPtr writer;
+    /// Keeps the first frame, then one in every this many
+    int every;
+    /// Frames waiting for this sink; the oldest ones are kept when it's full
+    std::size_t max_bytes;
+  };
+  struct SinkStats {
+    QString name;
+    QStringList files;
+    quint64 written;
+    quint64 dropped;
+    double mean_fps;
+    bool failed;
+  };
+  MultiSinkWriter(const FileWriterPtr &primary, const std::vector<Sink> &sinks);
+  ~MultiSinkWriter();
+  QString filename() const override;
+  QStringList files() const override;
+  void flush() override;
+  FileWriterPtr primary() const;
+  /// Writes the frames still queued for the sinks, and closes them; the writer handles no more frames after this
+  void close();
+  std::vector<SinkStats> stats() const;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // MULTISINKWRITER_H
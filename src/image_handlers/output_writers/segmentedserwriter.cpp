@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "segmentedserwriter.h"
+#include "serwriter.h"
+#include "image_handlers/saveimages.h"
+#include "commons/frame.h"
+#include "Qt/qt_strings_helper.h"
+#include "commons/executor.h"
+#include <QFuture>
+#include <QFile>
+#include <QDebug>
+
+using namespace std;
+
+DPTR_IMPL(SegmentedSERWriter) {
+  const QString deviceName;
+  const Configuration &configuration;
+  QString base_name;
+  qint64 max_bytes;
+  qint64 max_frames;
+  qint64 frames_limit;
+  int index = 0;
+  qint64 total_frames = 0;
+  SERWriterPtr current;
+  QFuture<SERWriterPtr> next;
+  QList<QFuture<void>> closing;
+  QStringList files;
+
+  QString segment_name(int index) const;
+  /// Header frames count for a segment starting after written frames
+  qint64 expected_frames(qint64 written) const;
+  SERWriterPtr open_segment(int index, qint64 expected) const;
+  void open_next();
+  void close_current();
+  bool needs_rollover(const FrameConstPtr &frame) const;
+};
+
+SegmentedSERWriter::SegmentedSERWriter(const QString& deviceName, const Configuration& configuration)
+  : dptr(deviceName, configuration, configuration.savefile(), configuration.ser_segment_max_size(), configuration.ser_segment_max_frames(),
+         configuration.recording_limit_type() == Configuration::FramesNumber ? configuration.recording_frames_limit() : 0)
+{
+  if(d->base_name.endsWith(".ser", Qt::CaseInsensitive))
+    d->base_name.chop(4);
+  qDebug() << "Segmented SER recording: " << d->base_name << ", max size: " << d->max_bytes << ", max frames: " << d->max_frames;
+  // First segment opened synchronously, so that opening errors are reported straight away
+  d->current = d->open_segment(++d->index, d->expected_frames(0));
+  d->files.push_back(d->current->filename());
+  d->open_next();
+}
+
+SegmentedSERWriter::~SegmentedSERWriter()
+{
+  d->close_current();
+  if(auto unused = d->next.result()) {
+    auto name = unused->filename();
+    unused.reset();
+    QFile::remove(name);
+  }
+  for(auto &future: d->closing)
+    future.waitForFinished();
+}
+
+QString SegmentedSERWriter::Private::segment_name(int index) const
+{
+  return "%1_%2.ser"_q % base_name % QString::number(index).rightJustified(4, '0');
+}
+
+qint64 SegmentedSERWriter::Private::expected_frames(qint64 written) const
+{
+  qint64 expected = max_frames;
+  if(frames_limit > 0)
+    expected = expected > 0 ? min(expected, frames_limit - written) : frames_limit - written;
+  return max<qint64>(expected, 0);
+}
+
+SERWriterPtr SegmentedSERWriter::Private::open_segment(int index, qint64 expected) const
+{
+  auto writer = make_shared<SERWriter>(deviceName, configuration, segment_name(index));
+  writer->set_expected_frames(expected);
+  return writer;
+}
+
+void SegmentedSERWriter::Private::open_next()
+{
+  int next_index = ++index;
+  // Computed here, as doHandle keeps counting frames while the segment opens: the next segment starts after the current one is full
+  const qint64 expected = expected_frames(total_frames + max_frames);
+  next = Executor::instance(Executor::BackgroundIO).run([this, next_index, expected]() -> SERWriterPtr {
+    try {
+      return open_segment(next_index, expected);
+    } catch(const SaveImages::Error &e) {
+      qWarning() << e.what();
+      return {};
+    }
+  });
+}
+
+void SegmentedSERWriter::Private::close_current()
+{
+  if(! current)
+    return;
+  // Writing the trailer of a big segment takes a while: let the helper thread do it
+  auto finished = current;
+  current.reset();
+  closing.push_back(Executor::instance(Executor::BackgroundIO).run([finished]() mutable { finished.reset(); }));
+}
+
+bool SegmentedSERWriter::Private::needs_rollover(const FrameConstPtr& frame) const
+{
+  if(current->frames() == 0)
+    return false;
+  return (max_frames > 0 && current->frames() >= max_frames) ||
+         (max_bytes > 0 && current->size() + static_cast<qint64>(frame->size()) > max_bytes);
+}
+
+QString SegmentedSERWriter::filename() const
+{
+  return "%1.ser"_q % d->base_name;
+}
+
+QStringList SegmentedSERWriter::files() const
+{
+  return d->files;
+}
+
+void SegmentedSERWriter::flush()
+{
+  if(d->current)
+    d->current->flush();
+}
+
+void SegmentedSERWriter::doHandle(FrameConstPtr frame)
+{
+  if(d->needs_rollover(frame)) {
+    d->close_current();
+    d->current = d->next.result();
+    if(! d->current)
+      throw SaveImages::Error::openingFile(d->segment_name(d->index));
+    d->files.push_back(d->current->filename());
+    d->open_next();
+  }
+  d->current->handle(frame);
+  ++d->total_frames;
+}
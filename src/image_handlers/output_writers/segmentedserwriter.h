@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SEGMENTEDSERWRITER_H
+#define SEGMENTEDSERWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+
+/**
+ * Splits a SER recording into numbered segments (name_0001.ser, name_0002.ser, ...), each one a complete SER file,
+ * rolling over when a segment reaches the configured size or frames count.
+ * The next segment is opened ahead of time, and finished segments are closed, on a helper thread,
+ * so that the switch doesn't stall the recording.
+ */
+class SegmentedSERWriter : public FileWriter
+{
+public:
+  SegmentedSERWriter(const QString &deviceName, const Configuration &configuration);
+  ~SegmentedSERWriter();
+  QString filename() const override;
+  QStringList files() const override;
+  void flush() override;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // SEGMENTEDSERWRITER_H
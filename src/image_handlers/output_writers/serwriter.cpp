@@ -20,27 +20,341 @@
 #include <QFile>
 #include <QDebug>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <cstring>
+#include <limits>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "image_handlers/saveimages.h"
 #include "commons/ser_header.h"
+#include "commons/crc32c.h"
 #include "commons/frame.h"
+#include "commons/tracing.h"
+#ifdef Q_OS_LINUX
+#include "directfilewriter.h"
+#include <fcntl.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 using namespace std;
 using namespace std::placeholders;
 
+// Growth step for recordings whose final size isn't known in advance
+#define SER_PREALLOCATE_STEP (256ll * 1024ll * 1024ll)
+// Timestamps kept in memory before being spilled to the journal (512KiB)
+#define SER_TIMESTAMPS_BLOCK (64 * 1024)
+// Checkpoints happen at most this often...
+#define SER_CHECKPOINT_INTERVAL_MS 5000
+// ... and less often when syncing is slow: at most 1/SER_CHECKPOINT_BUDGET of the recording time goes to them
+#define SER_CHECKPOINT_BUDGET 50
+// Frames waiting to be hashed before the writer waits for the hashing thread
+#define SER_HASHES_QUEUE 32
+// Frames gathered into a single writev(), at most (well below IOV_MAX)...
+#define SER_BATCH_FRAMES 256
+// ... or this many bytes...
+#define SER_BATCH_BYTES (4ll * 1024ll * 1024ll)
+// ... or for this long, so that slow streams still reach the disk promptly
+#define SER_BATCH_MSECS 50
+
+namespace {
+bool sync_data(int fd) {
+#if defined(Q_OS_LINUX)
+  return fdatasync(fd) == 0;
+#elif defined(Q_OS_UNIX)
+  return fsync(fd) == 0;
+#else
+  Q_UNUSED(fd);
+  return true;
+#endif
+}
+
+/// Hashes side-car writer (see SER_HashesHeader): frames are hashed in order on a thread of its own, so that the writer only hands them over
+class FrameHashes {
+public:
+  FrameHashes(const QString &filename);
+  ~FrameHashes();
+  bool isOpen() const { return file.isOpen(); }
+  void add(const FrameConstPtr &frame);
+private:
+  QFile file;
+  mutex queue_mutex;
+  condition_variable changed;
+  deque<FrameConstPtr> queue;
+  bool stopped = false;
+  thread worker;
+  void run();
+};
+
+FrameHashes::FrameHashes(const QString &filename) : file{filename}
+{
+  SER_HashesHeader header;
+  if(! file.open(QIODevice::WriteOnly) || file.write(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) {
+    qWarning() << "Unable to write frame hashes file " << file.fileName() << ": " << file.errorString();
+    file.close();
+    return;
+  }
+  worker = thread{&FrameHashes::run, this};
+}
+
+FrameHashes::~FrameHashes()
+{
+  if(! worker.joinable())
+    return;
+  {
+    lock_guard<mutex> lock{queue_mutex};
+    stopped = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+void FrameHashes::add(const FrameConstPtr &frame)
+{
+  unique_lock<mutex> lock{queue_mutex};
+  // Hashing is much faster than any disk: this only waits when the machine is starved of CPU, and keeps pooled frames from piling up
+  changed.wait(lock, [this]{ return queue.size() < SER_HASHES_QUEUE; });
+  queue.push_back(frame);
+  lock.unlock();
+  changed.notify_all();
+}
+
+void FrameHashes::run()
+{
+  unique_lock<mutex> lock{queue_mutex};
+  while(true) {
+    changed.wait(lock, [this]{ return stopped || ! queue.empty(); });
+    if(queue.empty())
+      return;
+    auto frame = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    changed.notify_all();
+    const quint32 hash = qToLittleEndian(CRC32C::checksum(frame->mat().data, frame->size()));
+    frame.reset();
+    file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    lock.lock();
+  }
+}
+}
 
 DPTR_IMPL(SERWriter) {
   SERWriter *q;
   QFile file;
   SER_Header *header;
   uint32_t frames = 0;
-  vector<QDateTime> frames_datetimes;
+  vector<SER_Timestamp> timestamps;
+  /// "<file>.timestamps": every timestamp not in memory anymore, removed once the trailer is written. See checkpoint()
+  QFile journal;
+  bool journal_failed = false;
+  QElapsedTimer since_checkpoint;
+  qint64 checkpoint_interval = SER_CHECKPOINT_INTERVAL_MS;
+  bool spill_timestamps();
+  void checkpoint();
+  // Frame records side-car, see SER_FrameRecord; not open when disabled, or when it couldn't be created
+  QFile frames_file;
+  // Frame hashes side-car, when enabled
+  unique_ptr<FrameHashes> hashes;
+  void add_timestamp(const QDateTime &datetime);
+  void write_trailer();
+  qint64 expected_frames = 0;
+  qint64 written = 0;
+  qint64 allocated = 0;
+  void reserve(qint64 size);
+#ifdef Q_OS_LINUX
+  // Direct I/O: the header is kept in memory, and written back by close_direct() once the data is on disk
+  unique_ptr<DirectFileWriter> direct_file;
+  SER_Header direct_header;
+  void close_direct();
+#endif
+  qint64 write(const char *data, qint64 size);
+  // Small frames at high frame rates: frames are gathered and written with one system call, see doHandle()
+  bool batching = false;
+  vector<FrameConstPtr> batch;
+  qint64 batch_bytes = 0;
+  QElapsedTimer batch_age;
+  void flush_batch();
+  /// Bookkeeping of a frame completely written to the file
+  void written_frame(const FrameConstPtr &frame);
 };
 
-SERWriter::SERWriter ( const QString& deviceName, const Configuration &configuration ) : dptr(this)
+void SERWriter::Private::add_timestamp(const QDateTime& datetime)
+{
+  timestamps.push_back(SER_Header::timestamp(datetime));
+  // Long recordings: keep memory flat by moving full blocks of timestamps to the journal
+  if(timestamps.size() >= SER_TIMESTAMPS_BLOCK)
+    spill_timestamps();
+}
+
+bool SERWriter::Private::spill_timestamps()
+{
+  if(journal_failed)
+    return false;
+  if(! journal.isOpen()) {
+    journal.setFileName(file.fileName() + ".timestamps");
+    if(! journal.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+      qWarning() << "Unable to open timestamps journal: " << journal.errorString() << ", keeping timestamps in memory";
+      journal_failed = true;
+      return false;
+    }
+  }
+  const qint64 size = timestamps.size() * sizeof(SER_Timestamp);
+  if(journal.write(reinterpret_cast<const char*>(timestamps.data()), size) != size || ! journal.flush()) {
+    qWarning() << "Error writing timestamps journal: " << journal.errorString() << ", keeping timestamps in memory";
+    journal_failed = true;
+    return false;
+  }
+  timestamps.clear();
+  return true;
+}
+
+void SERWriter::Private::checkpoint()
+{
+  // Crash consistency without syncing every frame: every few seconds the frames written so far reach the disk, then the
+  // header frames count and the timestamps journal are updated to match. A recording that never got closed can be rebuilt
+  // up to the last checkpoint (see ser_tool recover).
+  QElapsedTimer elapsed;
+  elapsed.start();
+  spill_timestamps();
+#ifdef Q_OS_LINUX
+  // Direct I/O chunks are still in flight, and its header is written on close only: the journal is all there is
+  if(! direct_file)
+#endif
+  {
+    file.flush();
+    if(sync_data(file.handle())) {
+      header->frames = frames;
+#ifdef Q_OS_UNIX
+      msync(header, sizeof(SER_Header), MS_SYNC);
+#endif
+    }
+  }
+  if(journal.isOpen())
+    sync_data(journal.handle());
+  if(frames_file.isOpen())
+    frames_file.flush();
+  checkpoint_interval = max<qint64>(SER_CHECKPOINT_INTERVAL_MS, elapsed.elapsed() * SER_CHECKPOINT_BUDGET);
+  since_checkpoint.start();
+}
+
+void SERWriter::Private::write_trailer()
+{
+  if(journal.isOpen()) {
+    journal.seek(0);
+    while(! journal.atEnd())
+      file.write(journal.read(SER_TIMESTAMPS_BLOCK * sizeof(SER_Timestamp) * 8));
+  }
+  file.write(reinterpret_cast<const char*>(timestamps.data()), timestamps.size() * sizeof(SER_Timestamp));
+  timestamps.clear();
+}
+
+void SERWriter::Private::reserve(qint64 size)
+{
+#ifdef Q_OS_LINUX
+  if(direct_file) {
+    direct_file->preallocate(size);
+    return;
+  }
+  auto result = posix_fallocate(file.handle(), 0, size);
+  if(result != 0)
+    qWarning() << "Unable to preallocate " << size << " bytes: " << strerror(result);
+#else
+  file.resize(size);
+  file.seek(written);
+#endif
+  allocated = size;
+}
+
+qint64 SERWriter::Private::write(const char* data, qint64 size)
+{
+#ifdef Q_OS_LINUX
+  if(direct_file)
+    return direct_file->write(data, size) ? size : -1;
+#endif
+  return file.write(data, size);
+}
+
+void SERWriter::Private::written_frame(const FrameConstPtr &frame)
+{
+  ++frames;
+  written += frame->size();
+  add_timestamp(frame->created_utc());
+  if(frames_file.isOpen()) {
+    const SER_FrameRecord record{*frame};
+    frames_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  }
+  if(hashes)
+    hashes->add(frame);
+}
+
+void SERWriter::Private::flush_batch()
+{
+#ifdef Q_OS_UNIX
+  if(batch.empty())
+    return;
+  Tracing::Span span{"SERWriter::flush_batch", batch.front()->sequence()};
+  vector<iovec> buffers(batch.size());
+  for(size_t i = 0; i < batch.size(); i++)
+    buffers[i] = {const_cast<uchar*>(batch[i]->mat().data), batch[i]->size()};
+  // Whatever QFile still buffers (i.e. the header) goes first: frames go straight to the descriptor, at the end of the file
+  file.flush();
+  size_t next = 0;
+  while(next < buffers.size()) {
+    const auto result = ::writev(file.handle(), buffers.data() + next, static_cast<int>(buffers.size() - next));
+    if(result < 0 && errno == EINTR)
+      continue;
+    if(result <= 0) {
+      qWarning() << "Error writing frames: " << strerror(errno) << ", " << (batch.size() - next) << " frames lost";
+      break;
+    }
+    size_t remaining = static_cast<size_t>(result);
+    while(next < buffers.size() && remaining >= buffers[next].iov_len) {
+      remaining -= buffers[next].iov_len;
+      written_frame(batch[next++]);
+    }
+    if(next < buffers.size()) {
+      buffers[next].iov_base = static_cast<char*>(buffers[next].iov_base) + remaining;
+      buffers[next].iov_len -= remaining;
+    }
+  }
+  // Back in sync with QFile, past the last complete frame: a partially written one gets overwritten
+  file.seek(written);
+  // Written frames are released here, and pooled buffers go back to the pool
+  batch.clear();
+  batch_bytes = 0;
+#endif
+}
+
+#ifdef Q_OS_LINUX
+void SERWriter::Private::close_direct()
+{
+  direct_file->close();
+  if(! file.open(QIODevice::ReadWrite))
+    throw SaveImages::Error::openingFile(file.fileName(), file.errorString());
+  file.write(reinterpret_cast<char*>(header), sizeof(SER_Header));
+  file.seek(file.size());
+}
+#endif
+
+SERWriter::SERWriter ( const QString& deviceName, const Configuration &configuration, const QString &filename ) : dptr(this)
 {
-  d->file.setFileName(configuration.savefile());
-  qDebug() << "Using buffered output: " << configuration.buffered_output();
+  d->file.setFileName(filename.isEmpty() ? configuration.savefile() : filename);
+  qDebug() << "Using buffered output: " << configuration.buffered_output() << ", direct I/O: " << configuration.direct_io_output();
   bool couldOpen = false;
+#ifdef Q_OS_LINUX
+  if(configuration.direct_io_output()) {
+    d->direct_file.reset(new DirectFileWriter(d->file.fileName()));
+    couldOpen = d->direct_file->isOpen();
+    if(! couldOpen)
+      throw SaveImages::Error::openingFile(d->file.fileName(), d->direct_file->errorString());
+  } else
+#endif
   if(configuration.buffered_output()) {
     couldOpen = d->file.open(QIODevice::ReadWrite);
   }
@@ -49,30 +363,75 @@ SERWriter::SERWriter ( const QString& deviceName, const Configuration &configura
   }
   if(! couldOpen)
     throw SaveImages::Error::openingFile(d->file.fileName());
+  if(configuration.recording_limit_type() == Configuration::FramesNumber)
+    d->expected_frames = configuration.recording_frames_limit();
   SER_Header empty_header;
   empty_header.datetime = SER_Header::timestamp(QDateTime::currentDateTime());
   empty_header.datetime_utc = SER_Header::timestamp(QDateTime::currentDateTimeUtc());
   ::strcpy(empty_header.camera, deviceName.left(40).toLatin1());
   ::strcpy(empty_header.observer, configuration.observer().left(40).toLatin1());
   ::strcpy(empty_header.telescope, configuration.telescope().left(40).toLatin1());
-  d->file.write(reinterpret_cast<char*>(&empty_header), sizeof(empty_header));
+  if(configuration.ser_frames_metadata()) {
+    d->frames_file.setFileName(d->file.fileName() + ".frames");
+    SER_FramesHeader frames_header;
+    if(! d->frames_file.open(QIODevice::WriteOnly) || d->frames_file.write(reinterpret_cast<char*>(&frames_header), sizeof(frames_header)) != sizeof(frames_header)) {
+      qWarning() << "Unable to write frames metadata file " << d->frames_file.fileName() << ": " << d->frames_file.errorString();
+      d->frames_file.close();
+    }
+  }
+  if(configuration.ser_frame_hashes()) {
+    d->hashes.reset(new FrameHashes(d->file.fileName() + ".hashes"));
+    if(! d->hashes->isOpen())
+      d->hashes.reset();
+  }
+  d->written = d->write(reinterpret_cast<char*>(&empty_header), sizeof(empty_header));
+#ifdef Q_OS_LINUX
+  if(d->direct_file) {
+    d->direct_header = empty_header;
+    d->header = &d->direct_header;
+    // DirectFileWriter grows the file by itself
+    d->allocated = numeric_limits<qint64>::max();
+    return;
+  }
+#endif
   d->file.flush();
   d->header = reinterpret_cast<SER_Header*>(d->file.map(0, sizeof(SER_Header)));
   if(!d->header) {
     qDebug() << d->file.errorString();
   }
+#ifdef Q_OS_UNIX
+  // Direct I/O writes chunks of its own
+  d->batching = true;
+#endif
 }
 
 
 SERWriter::~SERWriter()
 {
   qDebug() << "closing file..";
+  d->flush_batch();
+  // Waits for the last frames to be hashed
+  d->hashes.reset();
   d->header->frames = d->frames;
-  for(auto datetime: d->frames_datetimes) {
-    SER_Timestamp timestamp = SER_Header::timestamp(datetime);
-    d->file.write(reinterpret_cast<char*>(&timestamp), sizeof(timestamp));
+#ifdef Q_OS_LINUX
+  if(d->direct_file) {
+    try {
+      d->close_direct();
+    } catch(const SaveImages::Error &e) {
+      qWarning() << e.what();
+      return;
+    }
   }
+#endif
+  d->write_trailer();
+  // Drop any space preallocated but not used
+  d->file.flush();
+  d->file.resize(d->file.pos());
   d->file.close();
+  d->frames_file.close();
+  // The file is complete: nothing to recover from anymore
+  if(d->journal.isOpen())
+    d->journal.remove();
   qDebug() << "file correctly closed.";
 }
 
@@ -81,8 +440,29 @@ QString SERWriter::filename() const
   return d->file.fileName();
 }
 
+void SERWriter::set_expected_frames(qint64 frames)
+{
+  d->expected_frames = frames;
+}
+
+qint64 SERWriter::frames() const
+{
+  return d->frames + d->batch.size();
+}
+
+qint64 SERWriter::size() const
+{
+  return d->written + d->batch_bytes;
+}
+
+void SERWriter::flush()
+{
+  d->flush_batch();
+}
+
 void SERWriter::doHandle(FrameConstPtr frame)
 {
+  Tracing::Span span{"SERWriter::doHandle", frame->sequence()};
   if(! d->header->imageWidth) {
       // Force incorrect ENDIAN Type for compatibility with most readers ...
     // d->header->endian = (frame->byteOrder() == Frame::BigEndian ? SER_Header::BigEndian : SER_Header::LittleEndian);
@@ -92,13 +472,32 @@ void SERWriter::doHandle(FrameConstPtr frame)
     qDebug() << "SER PixelDepth set to " << d->header->pixelDepth << "bpp" << ", bytesPerPixels: " << d->header->bytesPerPixel();
     d->header->imageWidth = frame->resolution().width();
     d->header->imageHeight = frame->resolution().height();
+    d->since_checkpoint.start();
+    // With a frames limit the final size is known: allocate it in one go, to avoid fragmentation and metadata updates on every write
+    if(d->expected_frames > 0)
+      d->reserve(sizeof(SER_Header) + d->expected_frames * (frame->size() + sizeof(SER_Timestamp)));
   }
-  d->frames_datetimes.push_back(frame->created_utc());
-  auto frame_bytes = frame->size();
-  size_t wrote_bytes = d->file.write(reinterpret_cast<const char*>(frame->mat().data), frame->size());
-  if(wrote_bytes == frame->size() ) {
-    ++d->frames;
+  const qint64 end = size() + frame->size();
+  if(end > d->allocated)
+    d->reserve(end + SER_PREALLOCATE_STEP);
+  if(d->batching) {
+    if(d->batch.empty())
+      d->batch_age.start();
+    d->batch.push_back(frame);
+    d->batch_bytes += frame->size();
+    if(d->batch.size() >= SER_BATCH_FRAMES || d->batch_bytes >= SER_BATCH_BYTES || d->batch_age.elapsed() >= SER_BATCH_MSECS)
+      d->flush_batch();
   } else {
-    qWarning() << "Error writing frame: wrote only " << wrote_bytes << " instead of " << frame_bytes;
+    auto frame_bytes = frame->size();
+    size_t wrote_bytes = d->write(reinterpret_cast<const char*>(frame->mat().data), frame->size());
+    if(wrote_bytes == frame->size())
+      d->written_frame(frame);
+    else
+      qWarning() << "Error writing frame: wrote only " << wrote_bytes << " instead of " << frame_bytes;
+  }
+  if(d->since_checkpoint.elapsed() >= d->checkpoint_interval) {
+    // Checkpoints cover the frames handed over so far
+    d->flush_batch();
+    d->checkpoint();
   }
 }
@@ -22,12 +22,21 @@
 #include "filewriter.h"
 #include "c++/dptr.h"
 
+FWD_PTR(SERWriter)
+
 class SERWriter : public FileWriter
 {
 public:
- SERWriter(const QString &deviceName, const Configuration &configuration);
+ /// If filename is empty, Configuration::savefile() is used
+ SERWriter(const QString &deviceName, const Configuration &configuration, const QString &filename = {});
  ~SERWriter();
  QString filename() const override;
+ /// Frames expected in this file, used to preallocate it; must be called before the first frame.
+ void set_expected_frames(qint64 frames);
+ /// Frames and bytes handed to the writer so far, including the ones still waiting in a batch
+ qint64 frames() const;
+ qint64 size() const;
+ void flush() override;
 
 private:
 
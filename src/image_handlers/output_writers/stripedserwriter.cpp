@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "stripedserwriter.h"
+#include "serwriter.h"
+#include "image_handlers/saveimages.h"
+#include "commons/frame.h"
+#include "commons/ser_header.h"
+#include "Qt/qt_strings_helper.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QDebug>
+#include <deque>
+#include <thread>
+#include <exception>
+
+using namespace std;
+
+namespace {
+/// One SER file and its writer thread
+struct Stripe {
+  // Frames handed to a stripe, but not yet written: just enough to keep its disk busy, the recording queue holds the rest
+  static constexpr size_t max_pending = 4;
+  SERWriterPtr writer;
+  QMutex mutex;
+  QWaitCondition changed;
+  deque<FrameConstPtr> pending;
+  bool running = true;
+  exception_ptr error;
+  thread worker;
+
+  explicit Stripe(const SERWriterPtr &writer);
+  ~Stripe();
+  void write();
+  void stop();
+  void push(const FrameConstPtr &frame);
+};
+}
+
+DPTR_IMPL(StripedSERWriter) {
+  QString index_file;
+  QList<shared_ptr<Stripe>> stripes;
+  qint64 frames = 0;
+};
+
+Stripe::Stripe(const SERWriterPtr &writer) : writer{writer}
+{
+  worker = thread{&Stripe::write, this};
+}
+
+Stripe::~Stripe()
+{
+  stop();
+  worker.join();
+}
+
+void Stripe::stop()
+{
+  {
+    QMutexLocker lock(&mutex);
+    running = false;
+  }
+  changed.wakeAll();
+}
+
+void Stripe::write()
+{
+  while(true) {
+    FrameConstPtr frame;
+    bool drained;
+    {
+      QMutexLocker lock(&mutex);
+      while(running && pending.empty())
+        changed.wait(&mutex);
+      // Frames already handed out are written even when stopping
+      if(pending.empty())
+        return;
+      frame = pending.front();
+      drained = pending.size() == 1;
+      if(error) {
+        pending.clear();
+        changed.wakeAll();
+        continue;
+      }
+    }
+    exception_ptr write_error;
+    try {
+      writer->handle(frame);
+      // Nothing else to batch with for now
+      if(drained)
+        writer->flush();
+    } catch(...) {
+      write_error = current_exception();
+    }
+    {
+      QMutexLocker lock(&mutex);
+      pending.pop_front();
+      if(write_error && ! error)
+        error = write_error;
+    }
+    changed.wakeAll();
+  }
+}
+
+void Stripe::push(const FrameConstPtr &frame)
+{
+  QMutexLocker lock(&mutex);
+  while(pending.size() >= max_pending && ! error)
+    changed.wait(&mutex);
+  if(error)
+    rethrow_exception(error);
+  pending.push_back(frame);
+  changed.wakeAll();
+}
+
+StripedSERWriter::StripedSERWriter(const QString& deviceName, const Configuration& configuration) : dptr()
+{
+  const auto savefile = configuration.savefile();
+  d->index_file = savefile + ".stripes";
+  auto base_name = QFileInfo{savefile}.fileName();
+  if(base_name.endsWith(".ser", Qt::CaseInsensitive))
+    base_name.chop(4);
+  const auto directories = configuration.ser_stripe_directories();
+  const qint64 frames_limit = configuration.recording_limit_type() == Configuration::FramesNumber ? configuration.recording_frames_limit() : 0;
+  SER_StripesIndex index;
+  for(int stripe = 0; stripe < directories.size(); stripe++) {
+    const auto filename = QDir{directories[stripe]}.filePath("%1.stripe%2.ser"_q % base_name % (stripe + 1));
+    auto writer = make_shared<SERWriter>(deviceName, configuration, filename);
+    if(frames_limit > 0)
+      writer->set_expected_frames((frames_limit - stripe + directories.size() - 1) / directories.size());
+    d->stripes.push_back(make_shared<Stripe>(writer));
+    index.stripes.push_back(filename);
+  }
+  // Written before the first frame, so that the stripes of an interrupted recording can be merged too
+  QString error;
+  if(! index.save(d->index_file, error))
+    throw SaveImages::Error::openingFile(d->index_file, error);
+  qDebug() << "Striped SER recording:" << d->index_file << ", stripes:" << index.stripes;
+}
+
+StripedSERWriter::~StripedSERWriter()
+{
+  // All the stripes drain their frames together, then close one after the other
+  for(auto stripe: d->stripes)
+    stripe->stop();
+}
+
+QString StripedSERWriter::filename() const
+{
+  return d->index_file;
+}
+
+QStringList StripedSERWriter::files() const
+{
+  QStringList files{d->index_file};
+  for(auto stripe: d->stripes)
+    files.push_back(stripe->writer->filename());
+  return files;
+}
+
+void StripedSERWriter::doHandle(FrameConstPtr frame)
+{
+  d->stripes[d->frames % d->stripes.size()]->push(frame);
+  ++d->frames;
+}
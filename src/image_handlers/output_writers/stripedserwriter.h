@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef STRIPEDSERWRITER_H
+#define STRIPEDSERWRITER_H
+
+#include "filewriter.h"
+#include "c++/dptr.h"
+
+/**
+ * Stripes a SER recording across the Configuration::ser_stripe_directories, ideally each on its own disk:
+ * frames go to the stripes in turn (name.stripe1.ser, name.stripe2.ser, ...), each one a complete SER file, with a writer thread of its own,
+ * so that the recording rate adds up the disks bandwidth. Stripes honour the direct I/O and metadata side-car settings like any SER file.
+ * The index (name.ser.stripes, in the save directory, see SER_StripesIndex) lists the stripes in order: ser_tool merge turns them into a single SER file.
+ * Errors from a stripe come back on a later frame.
+ */
+class StripedSERWriter : public FileWriter
+{
+public:
+  StripedSERWriter(const QString &deviceName, const Configuration &configuration);
+  ~StripedSERWriter();
+  /// The index file
+  QString filename() const override;
+  QStringList files() const override;
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // STRIPEDSERWRITER_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "writefaults.h"
+#include <QStringList>
+#include <algorithm>
+
+using namespace std;
+
+bool WriteFaults::Settings::active() const
+{
+  return latency.count() > 0 || jitter.count() > 0 || (stall_every > 0 && stall.count() > 0) || fail_every > 0 || mb_per_second > 0;
+}
+
+bool WriteFaults::parse(const QString &spec, Settings &settings, QString &error)
+{
+  Settings parsed;
+  for(const auto &entry: spec.split(',', QString::SkipEmptyParts)) {
+    const auto parts = entry.split('=');
+    const auto key = parts.value(0).trimmed();
+    bool valid = false;
+    const double value = parts.value(1).trimmed().toDouble(&valid);
+    if(parts.size() != 2 || ! valid || value < 0) {
+      error = QString{"bad value in %1"}.arg(entry);
+      return false;
+    }
+    if(key == "latency")
+      parsed.latency = Milliseconds{value};
+    else if(key == "jitter")
+      parsed.jitter = Milliseconds{value};
+    else if(key == "stall")
+      parsed.stall = Milliseconds{value};
+    else if(key == "stall_every")
+      parsed.stall_every = static_cast<uint64_t>(value);
+    else if(key == "fail_every")
+      parsed.fail_every = static_cast<uint64_t>(value);
+    else if(key == "mbps")
+      parsed.mb_per_second = value;
+    else if(key == "seed")
+      parsed.seed = static_cast<uint32_t>(value);
+    else {
+      error = QString{"unknown key %1"}.arg(key);
+      return false;
+    }
+  }
+  settings = parsed;
+  return true;
+}
+
+WriteFaults::WriteFaults(const Settings &settings)
+  : settings{settings}, random{settings.seed}, jitter{settings.jitter.count() > 0 ? 1. / settings.jitter.count() : 1.}
+{
+}
+
+WriteFaults::Fault WriteFaults::next(size_t bytes, const Clock::time_point &now)
+{
+  Fault fault;
+  _frames++;
+  Milliseconds delay = settings.latency;
+  if(settings.jitter.count() > 0)
+    delay += Milliseconds{jitter(random)};
+  if(settings.stall_every > 0 && _frames % settings.stall_every == 0)
+    delay += settings.stall;
+  fault.delay = chrono::duration_cast<Clock::duration>(delay);
+  if(settings.mb_per_second > 0) {
+    const chrono::duration<double> transfer{bytes / (settings.mb_per_second * 1000. * 1000.)};
+    busy_until = max(busy_until, now) + chrono::duration_cast<Clock::duration>(transfer);
+    fault.delay += busy_until - now;
+  }
+  fault.fail = settings.fail_every > 0 && _frames % settings.fail_every == 0;
+  return fault;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef WRITEFAULTS_H
+#define WRITEFAULTS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <QString>
+
+/**
+ * A slow or failing disk on demand, for repeatable soak tests of the recording path (queue backpressure, spooling, load shedding).
+ * Faults come from a spec such as "latency=2,jitter=10,stall_every=500,stall=3000,mbps=40,fail_every=0,seed=1": times in milliseconds,
+ * jitter exponentially distributed with that mean, stalls every so many frames, throughput capped in MB/s, a write error every so many frames.
+ * The same spec gives the same delays and errors, frame by frame. See FaultyFileWriter.
+ */
+class WriteFaults
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+  struct Settings {
+    Milliseconds latency{0};
+    Milliseconds jitter{0};
+    Milliseconds stall{0};
+    std::uint64_t stall_every = 0;
+    std::uint64_t fail_every = 0;
+    double mb_per_second = 0;
+    std::uint32_t seed = 1;
+    bool active() const;
+  };
+  /// false, with a message, on unknown keys or bad values
+  static bool parse(const QString &spec, Settings &settings, QString &error);
+  struct Fault {
+    Clock::duration delay{0};
+    bool fail = false;
+  };
+  WriteFaults(const Settings &settings);
+  /// For the next frame, of bytes, handed over at now
+  Fault next(std::size_t bytes, const Clock::time_point &now);
+  std::uint64_t frames() const { return _frames; }
+private:
+  const Settings settings;
+  std::mt19937 random;
+  std::exponential_distribution<double> jitter;
+  std::uint64_t _frames = 0;
+  // Throughput cap: when the bytes handed over so far are through
+  Clock::time_point busy_until;
+};
+
+#endif // WRITEFAULTS_H
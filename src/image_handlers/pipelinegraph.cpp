@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pipelinegraph.h"
+#include <QStringList>
+#include <QDebug>
+#include "commons/threadplacement.h"
+
+using namespace std;
+
+bool PipelineGraph::parse(const QString &spec, PipelineGraph &graph, QString &error)
+{
+  PipelineGraph parsed;
+  for(const auto &entry: spec.split(';', QString::SkipEmptyParts)) {
+    if(entry.trimmed().isEmpty())
+      continue;
+    const auto separator = entry.indexOf(':');
+    Node node;
+    node.name = entry.left(separator).trimmed();
+    if(separator < 0 || node.name.isEmpty()) {
+      error = QString{"missing consumer name in %1"}.arg(entry);
+      return false;
+    }
+    for(const auto &option: entry.mid(separator + 1).split(' ', QString::SkipEmptyParts)) {
+      const auto key = option.section('=', 0, 0), value = option.section('=', 1);
+      bool valid = true;
+      if(option == "inline")
+        node.policy = Inline;
+      else if(option == "queue")
+        node.policy = Queue;
+      else if(option == "latest")
+        node.policy = Latest;
+      else if(option == "off")
+        node.policy = Off;
+      else if(key == "depth") {
+        const int depth = value.toInt(&valid);
+        valid = valid && depth > 0;
+        node.depth = valid ? static_cast<size_t>(depth) : 0;
+      } else if(key == "cpus") {
+        node.cpus = ThreadPlacement::parse_cpu_list(value);
+        valid = ! node.cpus.isEmpty();
+      } else
+        valid = false;
+      if(! valid) {
+        error = QString{"bad option %1 for %2"}.arg(option, node.name);
+        return false;
+      }
+    }
+    parsed._nodes.push_back(node);
+  }
+  graph = parsed;
+  return true;
+}
+
+PipelineGraph PipelineGraph::from_setting(const QString &spec)
+{
+  PipelineGraph graph;
+  QString error;
+  if(! parse(spec, graph, error))
+    qWarning() << "Ignoring the pipeline setting:" << error;
+  else if(! graph._nodes.isEmpty())
+    qDebug() << "Frames consumers from the pipeline setting:" << spec;
+  return graph;
+}
+
+PipelineGraph::Node PipelineGraph::node(const QString &name) const
+{
+  for(const auto &node: _nodes)
+    if(node.name == name)
+      return node;
+  Node node;
+  node.name = name;
+  return node;
+}
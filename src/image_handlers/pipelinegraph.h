@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PIPELINEGRAPH_H
+#define PIPELINEGRAPH_H
+
+#include <QList>
+#include <QString>
+#include <cstddef>
+
+/**
+ * How each frames consumer is fed, from the pipeline setting instead of the code, so that deployments can be tuned without rebuilding.
+ * Frames go from the capture thread, through calibration, to every consumer of the FramesFanout: each node here describes one of them
+ * by name (recording, network, recording stream, histogram, flash detector, auto exposure, roi follower, focus assist, frontend, shared memory, preview).
+ * The spec holds nodes separated by ';', each one a name, ':', then space separated options, i.e. "frontend: latest depth=3 cpus=2-3; focus assist: off":
+ *  - inline, queue or latest: the drop policy (see FramesFanout::DropPolicy); inline consumers run on the capture thread;
+ *  - off: the consumer gets no frames at all;
+ *  - depth=N: frames in its ring;
+ *  - cpus=list: CPUs for its thread, in the Linux CPU list format.
+ * Consumers not described keep what the code gives them.
+ */
+class PipelineGraph
+{
+public:
+  enum Policy { Default, Inline, Queue, Latest, Off };
+  struct Node {
+    QString name;
+    Policy policy = Default;
+    /// 0: the default depth
+    std::size_t depth = 0;
+    /// Empty: any CPU
+    QList<int> cpus;
+  };
+  /// false, with a message, on bad options; the graph is left untouched
+  static bool parse(const QString &spec, PipelineGraph &graph, QString &error);
+  /// The graph of the pipeline setting: empty, with a warning, when invalid
+  static PipelineGraph from_setting(const QString &spec);
+  /// The description of a consumer, with defaults everywhere when there is none
+  Node node(const QString &name) const;
+  QList<Node> nodes() const { return _nodes; }
+private:
+  QList<Node> _nodes;
+};
+
+#endif // PIPELINEGRAPH_H
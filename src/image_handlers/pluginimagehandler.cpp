@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pluginimagehandler.h"
+#include "commons/frame.h"
+#include "commons/metrics.h"
+#include "Qt/qt_strings_helper.h"
+#include <QDebug>
+#include <QDir>
+#include <QLibrary>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+PIFrame frame_view(const FrameConstPtr &frame, FrameConstPtr *handle) {
+  PIFrame view;
+  const auto &mat = frame->mat();
+  view.data = mat.data;
+  view.width = mat.cols;
+  view.height = mat.rows;
+  view.channels = frame->channels();
+  view.bpp = frame->bpp();
+  view.stride = mat.step[0];
+  view.color_format = static_cast<PIColorFormat>(frame->colorFormat());
+  view.byte_order = static_cast<PIByteOrder>(frame->byteOrder());
+  view.sequence = frame->sequence();
+  view.created_utc_ms = frame->created_utc_msecs();
+  view.captured_ns = chrono::duration_cast<chrono::nanoseconds>(frame->captured().time_since_epoch()).count();
+  view.exposure_seconds = frame->exposure().count();
+  view.has_device_timestamp = frame->has_device_timestamp() ? 1 : 0;
+  view.device_timestamp_us = frame->device_timestamp().count();
+  view.gain = frame->metadata().gain;
+  view.temperature = frame->metadata().temperature;
+  view.roi_x = frame->metadata().roi_x;
+  view.roi_y = frame->metadata().roi_y;
+  view.bin = frame->metadata().bin;
+  view.handle = handle;
+  return view;
+}
+
+// Prometheus names: anything but letters, digits and underscores becomes an underscore
+QString metric_name(const char *name) {
+  QString sanitized = "plugin_%1"_q % QString::fromUtf8(name).toLower();
+  for(auto &c: sanitized)
+    if(! (c.isLetterOrNumber() && c.unicode() < 128) && c != '_')
+      c = '_';
+  return sanitized;
+}
+}
+
+DPTR_IMPL(PluginImageHandler) {
+  const PIImageHandlerPlugin *plugin;
+  const shared_ptr<QLibrary> library;
+  PIHost host;
+  void *instance = nullptr;
+  QString name;
+  QString labels;
+  Metrics::Counter *frames = nullptr;
+  Metrics::Histogram *latency = nullptr;
+  static Private *self(void *context) { return reinterpret_cast<Private*>(context); }
+};
+
+PluginImageHandler::PluginImageHandler(const PIImageHandlerPlugin *plugin, const shared_ptr<QLibrary> &library) : dptr(plugin, library)
+{
+  if(! plugin || plugin->abi_version != PI_IMAGE_HANDLER_PLUGIN_ABI_VERSION)
+    throw runtime_error("incompatible image handler plugin ABI version");
+  if(! plugin->name || ! plugin->create || ! plugin->destroy || ! plugin->handle)
+    throw runtime_error("incomplete image handler plugin descriptor");
+  d->name = QString::fromUtf8(plugin->name);
+  d->labels = "plugin=\"%1\""_q % QString{d->name}.remove('"').remove('\\');
+  d->frames = &Metrics::instance().counter("plugin_frames_total", "Frames handed to image handler plugins", d->labels);
+  d->latency = &Metrics::instance().histogram("plugin_handle_seconds", "Time image handler plugins spent on each frame", d->labels);
+  d->host.context = d.get();
+  d->host.counter_add = [](void *context, const char *name, uint64_t value) {
+    Metrics::instance().counter(metric_name(name), "Reported by an image handler plugin", Private::self(context)->labels).add(value);
+  };
+  d->host.gauge_set = [](void *context, const char *name, int64_t value) {
+    Metrics::instance().gauge(metric_name(name), "Reported by an image handler plugin", Private::self(context)->labels).set(value);
+  };
+  d->host.duration_record = [](void *context, const char *name, uint64_t microseconds) {
+    Metrics::instance().histogram(metric_name(name), "Reported by an image handler plugin", Private::self(context)->labels)
+      .record(Metrics::Histogram::Duration{microseconds});
+  };
+  d->host.log = [](void *context, int level, const char *message) {
+    const auto line = "[%1] %2"_q % Private::self(context)->name % QString::fromUtf8(message);
+    switch(level) {
+      case 0: qDebug().noquote() << line; break;
+      case 1: qInfo().noquote() << line; break;
+      case 2: qWarning().noquote() << line; break;
+      default: qCritical().noquote() << line;
+    }
+  };
+  d->host.retain = [](void *, const PIFrame *frame) {
+    auto retained = new PIFrame(*frame);
+    retained->handle = new FrameConstPtr(*reinterpret_cast<FrameConstPtr*>(frame->handle));
+    return retained;
+  };
+  d->host.release = [](void *, PIFrame *frame) {
+    if(! frame)
+      return;
+    delete reinterpret_cast<FrameConstPtr*>(frame->handle);
+    delete frame;
+  };
+  d->instance = plugin->create(&d->host);
+  if(! d->instance)
+    throw runtime_error("image handler plugin failed to start");
+}
+
+PluginImageHandler::~PluginImageHandler()
+{
+  d->plugin->destroy(d->instance);
+}
+
+QString PluginImageHandler::name() const
+{
+  return d->name;
+}
+
+FramesFanout::DropPolicy PluginImageHandler::policy() const
+{
+  switch(d->plugin->execution) {
+    case PI_EXECUTION_INLINE:
+      return FramesFanout::Inline;
+    case PI_EXECUTION_ASYNC:
+      return FramesFanout::Queue;
+    default:
+      return FramesFanout::Latest;
+  }
+}
+
+size_t PluginImageHandler::capacity() const
+{
+  if(policy() == FramesFanout::Latest)
+    return 1;
+  return d->plugin->queue_depth > 0 ? static_cast<size_t>(d->plugin->queue_depth) : 4;
+}
+
+void PluginImageHandler::doHandle(FrameConstPtr frame)
+{
+  Metrics::Timer timer{*d->latency};
+  const PIFrame view = frame_view(frame, &frame);
+  d->plugin->handle(d->instance, &view);
+  d->frames->add();
+}
+
+void PluginImageHandler::load(const QStringList &directories, FramesFanout &fanout)
+{
+  for(const auto &directory: directories) {
+    for(const auto &entry: QDir{directory}.entryInfoList(QDir::Files, QDir::Name)) {
+      if(! QLibrary::isLibrary(entry.fileName()))
+        continue;
+      auto library = make_shared<QLibrary>(entry.absoluteFilePath());
+      if(! library->load()) {
+        qWarning() << "[ERR] Error loading image handler plugin" << entry.absoluteFilePath() << ":" << library->errorString();
+        continue;
+      }
+      auto descriptor = reinterpret_cast<PIImageHandlerPluginFunction>(library->resolve(PI_IMAGE_HANDLER_PLUGIN_SYMBOL));
+      if(! descriptor) {
+        qWarning() << "[ERR] Not an image handler plugin:" << entry.absoluteFilePath();
+        continue;
+      }
+      try {
+        auto handler = make_shared<PluginImageHandler>(descriptor(), library);
+        const auto priority = handler->policy() == FramesFanout::Latest ? MemoryGovernor::Preview : MemoryGovernor::Analysis;
+        fanout.add("plugin %1"_q % handler->name(), handler, handler->policy(), handler->capacity(), priority);
+        qDebug() << "Loaded image handler plugin" << handler->name() << "from" << entry.absoluteFilePath();
+      } catch(const std::exception &e) {
+        qWarning() << "[ERR] Error starting image handler plugin" << entry.absoluteFilePath() << ":" << e.what();
+      }
+    }
+  }
+}
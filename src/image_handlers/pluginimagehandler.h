@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLUGINIMAGEHANDLER_H
+#define PLUGINIMAGEHANDLER_H
+
+#include "imagehandler.h"
+#include "framesfanout.h"
+#include "plugins/imagehandlerplugin.h"
+#include "c++/dptr.h"
+#include <QStringList>
+
+class QLibrary;
+
+/**
+ * A third party processing stage, behind the C plugin interface (see imagehandlerplugin.h).
+ * Frames go to the plugin in place, with no copy; its telemetry lands in Metrics, labelled with the plugin name,
+ * next to the frames and time the handler itself spent (plugin_frames_total, plugin_handle_seconds).
+ */
+class PluginImageHandler : public ImageHandler
+{
+public:
+  /// The plugin must outlive the handler, as must library when given. Throws std::runtime_error if the plugin is incompatible or fails to create its instance
+  PluginImageHandler(const PIImageHandlerPlugin *plugin, const std::shared_ptr<QLibrary> &library = {});
+  ~PluginImageHandler();
+  QString name() const;
+  /// Where FramesFanout runs the plugin, from its execution class
+  FramesFanout::DropPolicy policy() const;
+  std::size_t capacity() const;
+  /// Loads all the plugins in directories, adding them to fanout; plugins that can't be loaded are skipped with a warning
+  static void load(const QStringList &directories, FramesFanout &fanout);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // PLUGINIMAGEHANDLER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLANETARYIMAGER_IMAGEHANDLERPLUGIN_H
+#define PLANETARYIMAGER_IMAGEHANDLERPLUGIN_H
+
+/**
+ * Processing stages from third parties, built apart from PlanetaryImager and loaded from the --plugins directories.
+ * Plain C, so that plugins don't depend on the compiler, the Qt or the OpenCV PlanetaryImager was built with: a plugin exports
+ * PI_IMAGE_HANDLER_PLUGIN_SYMBOL, a function returning its PIImageHandlerPlugin descriptor.
+ *
+ * Frames are the capture buffers themselves, in place (see PIFrame): read only, and only valid during the handle() call,
+ * unless retained through the host. Structs only grow at the end, and abi_version changes when a layout does.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PI_IMAGE_HANDLER_PLUGIN_ABI_VERSION 1
+#define PI_IMAGE_HANDLER_PLUGIN_SYMBOL "planetaryimager_image_handler_plugin"
+
+#if defined(_WIN32)
+#define PI_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define PI_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/// Same values as Frame::ColorFormat
+typedef enum {
+  PI_COLOR_MONO = 0,
+  PI_COLOR_RGB = 1,
+  PI_COLOR_BGR = 2,
+  PI_COLOR_BAYER_RGGB = 3,
+  PI_COLOR_BAYER_GRBG = 4,
+  PI_COLOR_BAYER_GBRG = 5,
+  PI_COLOR_BAYER_BGGR = 6,
+} PIColorFormat;
+
+/// Same values as Frame::ByteOrder
+typedef enum {
+  PI_BIG_ENDIAN = 0,
+  PI_LITTLE_ENDIAN = 1,
+} PIByteOrder;
+
+/// Where the plugin runs, and which frames it gets
+typedef enum {
+  /// On the capture thread, every frame: handle() must be faster than the frame rate, or the capture slows down
+  PI_EXECUTION_INLINE = 0,
+  /// On a thread of its own, every frame in order, with up to queue_depth frames waiting: newer ones are dropped while full
+  PI_EXECUTION_ASYNC = 1,
+  /// On a thread of its own, the most recent frame only: frames come while it's idle, and it gives way first when memory or CPU run short
+  PI_EXECUTION_BEST_EFFORT = 2,
+} PIExecutionClass;
+
+/// A frame as captured, after calibration and the software ROI: all the pointers are owned by the host
+typedef struct {
+  /// First pixel, rows stride bytes apart, channels interleaved; 16 bit samples are in byte_order
+  const uint8_t *data;
+  int32_t width;
+  int32_t height;
+  int32_t channels;
+  /// 8 or 16
+  int32_t bpp;
+  size_t stride;
+  PIColorFormat color_format;
+  PIByteOrder byte_order;
+  /// Position in the imager output, from 1; gaps are dropped frames. 0 if unknown
+  uint64_t sequence;
+  /// UTC capture time, in milliseconds since epoch
+  int64_t created_utc_ms;
+  /// Monotonic capture time, in nanoseconds on the host steady clock
+  int64_t captured_ns;
+  double exposure_seconds;
+  /// From the camera or its transport, in microseconds; has_device_timestamp is 0 without one
+  int64_t device_timestamp_us;
+  int32_t has_device_timestamp;
+  /// NaN when unknown
+  double gain;
+  /// Celsius, NaN when unknown
+  double temperature;
+  /// Top left corner on the sensor, in the frame own pixels: -1 when unknown
+  int32_t roi_x;
+  int32_t roi_y;
+  /// 0 when unknown
+  int32_t bin;
+  /// For the host retain() only
+  void *handle;
+} PIFrame;
+
+/// Services of the host, valid from create() to destroy(); all of them can be called from any thread
+typedef struct {
+  void *context;
+  /// Telemetry, in the host metrics registry: names are prefixed with plugin_ and labelled with the plugin name
+  void (*counter_add)(void *context, const char *name, uint64_t value);
+  void (*gauge_set)(void *context, const char *name, int64_t value);
+  /// Duration of some work of the plugin, in microseconds (i.e. a detection step), as a histogram
+  void (*duration_record)(void *context, const char *name, uint64_t microseconds);
+  /// level: 0 debug, 1 info, 2 warning, 3 error
+  void (*log)(void *context, int level, const char *message);
+  /**
+   * Keeps the frame, and its pixels, alive after handle() returns (i.e. to process it on a thread of the plugin), until released:
+   * returns a copy of the frame owned by the plugin. Retained frames are not recycled, so keep as few as possible.
+   */
+  PIFrame *(*retain)(void *context, const PIFrame *frame);
+  void (*release)(void *context, PIFrame *frame);
+} PIHost;
+
+typedef struct {
+  /// PI_IMAGE_HANDLER_PLUGIN_ABI_VERSION, as the plugin was built with
+  int32_t abi_version;
+  /// Unique, used for the consumer name, the metrics labels and the pipeline setting
+  const char *name;
+  PIExecutionClass execution;
+  /// Frames waiting for PI_EXECUTION_ASYNC plugins; 0 for the default
+  int32_t queue_depth;
+  /// An instance for the host, or NULL on errors; the host is valid until destroy()
+  void *(*create)(const PIHost *host);
+  void (*destroy)(void *instance);
+  /// One frame, never called concurrently for the same instance
+  void (*handle)(void *instance, const PIFrame *frame);
+} PIImageHandlerPlugin;
+
+typedef const PIImageHandlerPlugin *(*PIImageHandlerPluginFunction)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLANETARYIMAGER_IMAGEHANDLERPLUGIN_H
@@ -22,6 +22,7 @@
 #include "image_handlers/imagehandler.h"
 #include "drivers/imager.h"
 #include <QObject>
+#include <QVariantMap>
 #include "commons/fwd.h"
 
 #include "commons/configuration.h"
@@ -37,12 +38,32 @@ public slots:
   virtual void startRecording(Imager *imager) = 0;
   virtual void endRecording() = 0;
   virtual void setPaused(bool paused) = 0;
+  /// Pre-trigger recording: saves the buffered frames, and the ones following for the configured time
+  /** A non empty event (for instance a detector position and time) is logged into the information of the recording it falls in. */
+  virtual void trigger(const QVariantMap &event = {}) = 0;
+  /// Checks that the recording disk keeps up with the camera (see StorageProbe): storageProbed comes a few seconds later
+  virtual void probeStorage() = 0;
+  /// Keeps the next recording of imager ready while idle (see Configuration::recording_armed), so that startRecording only has to let the frames in
+  virtual void armRecording(Imager *imager) = 0;
 signals:
   void saveFPS(double fps);
   void meanFPS(double fps);
   void savedFrames(long frames);
   void droppedFrames(long frames);
+  /// Recording queue fill level: bytes currently queued, highest level reached during this recording, configured budget
+  void queueUsage(qint64 bytes, qint64 peak_bytes, qint64 max_bytes);
+  /// Bytes handed to the file writer per second, over the last half second or so
+  void writeThroughput(double bytes_per_second);
+  /// A file was opened; an empty filename means a pre-trigger recording waiting for a trigger
   void recording(const QString &filename);
+  /// Pre-trigger ring buffer fill level, while waiting for a trigger
+  void preTriggerBuffer(qint64 bytes, double seconds);
+  /// Burst to RAM recordings: bytes of frames in memory still to be written, and room left for new ones
+  void deferredWrites(qint64 pending_bytes, qint64 available_bytes);
+  /// Save directory sustained write rate (0 if it couldn't be written) and write latency, with the current capture rate and frame size
+  void storageProbed(double bytes_per_second, double latency_p99_ms, double capture_fps, qint64 frame_bytes);
+  /// Work given up while the writer falls behind (a LoadShedding::Level, see LoadShedder), on changes; back to 0 once the recording ends
+  void loadShedding(int level);
   void finished();
 };
 
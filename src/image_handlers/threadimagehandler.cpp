@@ -18,56 +18,85 @@
 
 #include "threadimagehandler.h"
 #include <QThread>
+#include <QDebug>
+#include <atomic>
 #include "commons/frame.h"
 
 using namespace std;
 
 DPTR_IMPL(ThreadImageHandler) {
   ThreadImageHandler *q;
-  unique_ptr<QThread> thread;
+  ImageHandlerPtr imageHandler;
+  unique_ptr<FramesQueue> queue;
   class Worker;
   unique_ptr<Worker> worker;
+  atomic<quint64> dropped{0};
 };
 
-class ThreadImageHandler::Private::Worker : public QObject {
-  Q_OBJECT
-
+class ThreadImageHandler::Private::Worker : public QThread {
 public:
-  Worker(const ImageHandlerPtr &imageHandler, QObject *parent = nullptr);
-public slots:
-  void handle(FrameConstPtr frame);
+  Worker(ThreadImageHandler::Private *d) : d{d} {}
+  ~Worker();
 private:
-  ImageHandlerPtr imageHandler;
+  void run() override;
+  ThreadImageHandler::Private *d;
+  atomic_bool running{true};
 };
 
-ThreadImageHandler::Private::Worker::Worker(const ImageHandlerPtr& imageHandler, QObject* parent)
-  : QObject{parent}, imageHandler{imageHandler}
+ThreadImageHandler::Private::Worker::~Worker()
+{
+  running = false;
+  wait();
+}
+
+void ThreadImageHandler::Private::Worker::run()
+{
+  while(running) {
+    // Bounded wait, so that stopping doesn't depend on frames coming in
+    auto frame = d->queue->pop(chrono::milliseconds{100});
+    if(frame)
+      d->imageHandler->handle(frame);
+  }
+}
+
+ThreadImageHandler::ThreadImageHandler(const ImageHandlerPtr &imageHandler, size_t max_frames, size_t max_bytes, FramesQueue::OverflowPolicy policy, QObject *parent)
+  : QObject{parent}, dptr(this, imageHandler, make_unique<FramesQueue>(max_frames, policy))
 {
+  d->queue->set_max_bytes(max_bytes);
+  d->worker = make_unique<Private::Worker>(d.get());
+  d->worker->start();
 }
 
+ThreadImageHandler::~ThreadImageHandler()
+{
+  d->worker.reset();
+  d->queue->clear();
+  if(d->dropped > 0)
+    qDebug() << "ThreadImageHandler dropped" << d->dropped << "frames, peak queue memory:" << d->queue->peak_bytes() << "bytes";
+}
 
-void ThreadImageHandler::Private::Worker::handle(FrameConstPtr frame)
+size_t ThreadImageHandler::queue_depth() const
 {
-  imageHandler->handle(frame);
+  return d->queue->size();
 }
 
+size_t ThreadImageHandler::queue_bytes() const
+{
+  return d->queue->bytes();
+}
 
-ThreadImageHandler::ThreadImageHandler(const ImageHandlerPtr &imageHandler) : dptr(this, make_unique<QThread>())
+size_t ThreadImageHandler::peak_queue_bytes() const
 {
-  d->worker = make_unique<Private::Worker>(imageHandler);
-  d->worker->moveToThread(d->thread.get());
-  d->thread->start();
+  return d->queue->peak_bytes();
 }
 
-ThreadImageHandler::~ThreadImageHandler()
+quint64 ThreadImageHandler::dropped_frames() const
 {
-  d->thread->quit();
-  d->thread->wait();
+  return d->dropped;
 }
 
 void ThreadImageHandler::doHandle(FrameConstPtr frame)
 {
-  QMetaObject::invokeMethod(d->worker.get(), "handle", Qt::QueuedConnection, Q_ARG(FrameConstPtr, frame));
+  if(! d->queue->push(frame))
+    emit droppedFrames(++d->dropped);
 }
-
-#include "threadimagehandler.moc"
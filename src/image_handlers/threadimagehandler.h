@@ -21,12 +21,31 @@
 #include <QObject>
 #include "c++/dptr.h"
 #include "image_handlers/imagehandler.h"
+#include "commons/framesqueue.h"
 
-class ThreadImageHandler : public ImageHandler
+/**
+ * Hands frames to the wrapped handler on a thread of its own, through a bounded FramesQueue.
+ * When the handler can't keep up, frames are dropped according to the overflow policy instead of piling up in memory.
+ */
+class ThreadImageHandler : public QObject, public ImageHandler
 {
+  Q_OBJECT
 public:
-  ThreadImageHandler(const  ImageHandlerPtr &imageHandler);
+  /// max_frames and max_bytes bound the queue; 0 means no limit, but at least one of them should be set
+  ThreadImageHandler(const  ImageHandlerPtr &imageHandler, std::size_t max_frames = 4, std::size_t max_bytes = 0,
+                     FramesQueue::OverflowPolicy policy = FramesQueue::DropOldest, QObject *parent = nullptr);
   virtual ~ThreadImageHandler();
+  /// Frames waiting to be handled
+  std::size_t queue_depth() const;
+  /// Memory held by the frames waiting to be handled
+  std::size_t queue_bytes() const;
+  /// Highest queue_bytes() so far
+  std::size_t peak_queue_bytes() const;
+  quint64 dropped_frames() const;
+
+signals:
+  /// Emitted from the producer thread every time a frame is lost, with the total so far
+  void droppedFrames(quint64 total);
 
 private:
 
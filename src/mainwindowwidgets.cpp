@@ -105,6 +105,17 @@ void MainWindowWidgets::add_dock(QDockWidget *widget) {
     d->docks.push_back({widget});
 }
 
+void MainWindowWidgets::add_dock(QDockWidget *widget, const std::function<QWidget*()> &create_contents) {
+    add_dock(widget);
+    auto created = make_shared<QMetaObject::Connection>();
+    *created = QObject::connect(widget, &QDockWidget::visibilityChanged, widget, [=](bool visible) {
+        if(! visible)
+            return;
+        QObject::disconnect(*created);
+        widget->setWidget(create_contents());
+    });
+}
+
 void MainWindowWidgets::add_toolbar(QToolBar *toolbar, bool add_to_main_window) {
     d->toolbars.push_back(toolbar);
     if(add_to_main_window) {
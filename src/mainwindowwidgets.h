@@ -18,10 +18,12 @@
 
 #include "dptr.h"
 #include "commons/fwd.h"
+#include <functional>
 
 FWD_PTR(MainWindowWidgets)
 FWD(QMainWindow)
 FWD(QDockWidget)
+FWD(QWidget)
 FWD(QToolBar)
 FWD(QMenu)
 FWD(Configuration)
@@ -31,6 +33,8 @@ public:
     MainWindowWidgets(QMainWindow *main_window, QMenu *windowMenu, Configuration &configuration);
     ~MainWindowWidgets();
     void add_dock(QDockWidget *widget);
+    /// As add_dock, building the dock contents only when it's first shown (i.e. not at all, if it's never opened)
+    void add_dock(QDockWidget *widget, const std::function<QWidget*()> &create_contents);
     void add_toolbar(QToolBar *toolbar, bool add_to_main_window = false);
     void save();
     void load();
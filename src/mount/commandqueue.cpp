@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 Filip Szczerek <ga.software@yahoo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "commandqueue.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace Mount
+{
+
+DPTR_IMPL(CommandQueue)
+{
+    struct Queued
+    {
+        Command command;
+        int key;
+    };
+    mutable mutex m;
+    condition_variable wake;
+    deque<Queued> guiding;
+    deque<Queued> normal;
+    bool stopping = false;
+    thread worker;
+
+    deque<Queued> &queue(Priority priority) { return priority == Priority::Guiding ? guiding : normal; }
+    void run();
+};
+
+
+CommandQueue::CommandQueue(): dptr()
+{
+    d->worker = thread{ &Private::run, d.get() };
+}
+
+
+CommandQueue::~CommandQueue()
+{
+    {
+        lock_guard<mutex> lock(d->m);
+        d->stopping = true;
+    }
+    d->wake.notify_one();
+    d->worker.join();
+}
+
+
+void CommandQueue::push(Priority priority, const Command &command, int key)
+{
+    {
+        lock_guard<mutex> lock(d->m);
+        auto &queue = d->queue(priority);
+        auto queued = key == 0 ? queue.end() : find_if(queue.begin(), queue.end(), [key](const Private::Queued &q) { return q.key == key; });
+        if (queued != queue.end())
+            queued->command = command;
+        else
+            queue.push_back({ command, key });
+    }
+    d->wake.notify_one();
+}
+
+
+int CommandQueue::pending() const
+{
+    lock_guard<mutex> lock(d->m);
+    return static_cast<int>(d->guiding.size() + d->normal.size());
+}
+
+
+void CommandQueue::Private::run()
+{
+    while (true)
+    {
+        Command command;
+        {
+            unique_lock<mutex> lock(m);
+            wake.wait(lock, [this] { return stopping || !guiding.empty() || !normal.empty(); });
+            if (stopping)
+                return;
+            auto &next = guiding.empty() ? normal : guiding;
+            command = next.front().command;
+            next.pop_front();
+        }
+        command();
+    }
+}
+
+} // namespace Mount
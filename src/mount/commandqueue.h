@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 Filip Szczerek <ga.software@yahoo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MOUNT_COMMANDQUEUE_H
+#define MOUNT_COMMANDQUEUE_H
+
+#include <functional>
+#include "c++/dptr.h"
+
+
+namespace Mount
+{
+
+/// Runs mount commands one at a time on its own thread, so that callers never wait for the mount
+/** Guiding commands go before any other queued command. A command queued with a non-zero 'key' replaces the
+    one with the same key still waiting, e.g. a newer correction for the same axis supersedes a stale one. */
+class CommandQueue
+{
+public:
+    enum class Priority { Guiding, Normal };
+    typedef std::function<void()> Command;
+
+    CommandQueue();
+    /// Waits for the running command; the queued ones are discarded
+    ~CommandQueue();
+
+    void push(Priority priority, const Command &command, int key = 0);
+    /// Number of commands waiting to be run
+    int pending() const;
+
+private:
+    DPTR
+};
+
+} // namespace Mount
+
+#endif // MOUNT_COMMANDQUEUE_H
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2018 Filip Szczerek <ga.software@yahoo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "guiding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <QDebug>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Mount
+{
+
+namespace
+{
+double length(const QPointF &p)
+{
+    return std::hypot(p.x(), p.y());
+}
+
+double cross(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.y() - a.y() * b.x();
+}
+
+/// Part of a pulse of 'duration' ms started at 'start' still to be performed at 'time'
+double remaining(double duration, qint64 start, qint64 time)
+{
+    const double elapsed = std::max<double>(0, time - start);
+    return std::copysign(std::max(0.0, std::abs(duration) - elapsed), duration);
+}
+
+void issue(PulseGuider &guider, const AxisPulses &pulses)
+{
+    if (pulses.ra != 0)
+        guider.pulse(pulses.ra > 0 ? GuideDirection::West : GuideDirection::East, milliseconds{ lround(std::abs(pulses.ra)) });
+    if (pulses.dec != 0)
+        guider.pulse(pulses.dec > 0 ? GuideDirection::North : GuideDirection::South, milliseconds{ lround(std::abs(pulses.dec)) });
+}
+} // namespace
+
+
+bool GuidingCalibration::valid() const
+{
+    // sin(30°) = 0.5
+    return length(ra) > 0 && length(dec) > 0 && std::abs(cross(ra, dec)) >= 0.5 * length(ra) * length(dec);
+}
+
+
+AxisPulses GuidingCalibration::pulsesFor(const QPointF &offset) const
+{
+    const double det = cross(ra, dec);
+    if (det == 0)
+        return {};
+    return { cross(offset, dec) / det, cross(ra, offset) / det };
+}
+
+
+QPointF GuidingCalibration::displacement(const AxisPulses &pulses) const
+{
+    return ra * pulses.ra + dec * pulses.dec;
+}
+
+
+DPTR_IMPL(GuidingCalibrator)
+{
+    const PulseGuider::ptr guider;
+    const GuidingCalibrator::Settings settings;
+    State state = State::Ra;
+    int step = 0;
+    QPointF origin;
+    qint64 ready_at = std::numeric_limits<qint64>::min(); ///< Frames taken before this do not show the last pulse yet
+    GuidingCalibration result;
+
+    void move(GuideDirection direction, qint64 now);
+};
+
+
+GuidingCalibrator::GuidingCalibrator(const PulseGuider::ptr &guider, const Settings &settings): dptr(guider, settings)
+{
+}
+
+
+GuidingCalibrator::~GuidingCalibrator()
+{
+}
+
+
+void GuidingCalibrator::Private::move(GuideDirection direction, qint64 now)
+{
+    guider->pulse(direction, settings.pulse);
+    step++;
+    ready_at = now + (settings.pulse + settings.settle).count();
+}
+
+
+GuidingCalibrator::State GuidingCalibrator::update(const QPointF &position, const QDateTime &frameTime, const QDateTime &now)
+{
+    if (d->state == State::Done || d->state == State::Failed || frameTime.toMSecsSinceEpoch() < d->ready_at)
+        return d->state;
+
+    const qint64 now_ms = now.toMSecsSinceEpoch();
+    const bool ra = d->state == State::Ra || d->state == State::RaReturn;
+
+    if (d->state == State::Ra || d->state == State::Dec)
+    {
+        if (d->step == 0)
+            d->origin = position;
+        if (d->step < d->settings.steps)
+        {
+            d->move(ra ? GuideDirection::West : GuideDirection::North, now_ms);
+            return d->state;
+        }
+
+        const QPointF moved = position - d->origin;
+        if (length(moved) < d->settings.min_displacement)
+            return d->state = State::Failed;
+        (ra ? d->result.ra : d->result.dec) = moved / (d->settings.steps * d->settings.pulse.count());
+        if (!ra && !d->result.valid())
+            return d->state = State::Failed;
+
+        d->state = ra ? State::RaReturn : State::DecReturn;
+        d->step = 0;
+    }
+
+    if (d->step < d->settings.steps)
+    {
+        d->move(ra ? GuideDirection::East : GuideDirection::South, now_ms);
+        return d->state;
+    }
+
+    d->step = 0;
+    if (!ra)
+        return d->state = State::Done;
+
+    d->state = State::Dec;
+    d->origin = position;
+    d->move(GuideDirection::North, now_ms);
+    return d->state;
+}
+
+
+GuidingCalibrator::State GuidingCalibrator::state() const
+{
+    return d->state;
+}
+
+
+GuidingCalibration GuidingCalibrator::calibration() const
+{
+    return d->result;
+}
+
+
+DPTR_IMPL(GuidingLoop)
+{
+    const PulseGuider::ptr guider;
+    const GuidingCalibration calibration;
+    const GuidingLoop::Parameters parameters;
+
+    struct Issued
+    {
+        qint64 start;
+        AxisPulses pulses;
+    };
+    std::deque<Issued> issued;
+
+    bool has_target = false;
+    QPointF target;
+    qint64 previous_frame = 0;
+    AxisPulses integral;
+    AxisPulses previous_error;
+
+    double correct(double error, double &integral, double previous, double dt) const;
+};
+
+
+GuidingLoop::GuidingLoop(const PulseGuider::ptr &guider, const GuidingCalibration &calibration, const Parameters &parameters)
+    : dptr(guider, calibration, parameters)
+{
+}
+
+
+GuidingLoop::~GuidingLoop()
+{
+}
+
+
+double GuidingLoop::Private::correct(double error, double &integral, double previous, double dt) const
+{
+    const double max_pulse = parameters.max_pulse.count();
+    double output = parameters.proportional * error;
+    if (dt > 0)
+    {
+        integral += error * dt;
+        // Anti-windup: the integral term alone never exceeds the longest pulse
+        if (parameters.integral > 0)
+            integral = std::max(-max_pulse / parameters.integral, std::min(max_pulse / parameters.integral, integral));
+        output += parameters.integral * integral + parameters.derivative * (error - previous) / dt;
+    }
+    output = std::max(-max_pulse, std::min(max_pulse, output));
+    return std::abs(output) < parameters.min_pulse.count() ? 0 : output;
+}
+
+
+AxisPulses GuidingLoop::update(const QPointF &position, const QDateTime &frameTime, const QDateTime &now)
+{
+    const qint64 frame_ms = frameTime.toMSecsSinceEpoch();
+    const qint64 now_ms = now.toMSecsSinceEpoch();
+    if (d->has_target && frame_ms <= d->previous_frame)
+        return {};
+
+    // Pulses, or their parts, performed after the frame was taken are not visible in it yet
+    AxisPulses pending, running;
+    d->issued.erase(std::remove_if(d->issued.begin(), d->issued.end(), [&](const Private::Issued &i) {
+        return remaining(i.pulses.ra, i.start, frame_ms) == 0 && remaining(i.pulses.dec, i.start, frame_ms) == 0;
+    }), d->issued.end());
+    for (const auto &i: d->issued)
+    {
+        pending.ra += remaining(i.pulses.ra, i.start, frame_ms);
+        pending.dec += remaining(i.pulses.dec, i.start, frame_ms);
+        running.ra += remaining(i.pulses.ra, i.start, now_ms);
+        running.dec += remaining(i.pulses.dec, i.start, now_ms);
+    }
+    const QPointF compensated = position + d->calibration.displacement(pending);
+
+    if (!d->has_target)
+    {
+        d->has_target = true;
+        d->target = compensated;
+        d->previous_frame = frame_ms;
+        return {};
+    }
+
+    const double dt = (frame_ms - d->previous_frame) / 1000.0;
+    d->previous_frame = frame_ms;
+    // Constant drift is left to the integral term: extrapolating it would amplify seeing
+    const AxisPulses error = d->calibration.pulsesFor(d->target - compensated);
+
+    AxisPulses output{
+        d->correct(error.ra, d->integral.ra, d->previous_error.ra, dt),
+        d->correct(error.dec, d->integral.dec, d->previous_error.dec, dt),
+    };
+    d->previous_error = error;
+    if (running.ra != 0)
+        output.ra = 0;
+    if (running.dec != 0)
+        output.dec = 0;
+
+    if (output.ra != 0 || output.dec != 0)
+    {
+        issue(*d->guider, output);
+        d->issued.push_back({ now_ms, output });
+    }
+    return output;
+}
+
+
+DPTR_IMPL(Guiding)
+{
+    const PulseGuider::ptr guider;
+    Guiding *q;
+    State state = State::Idle;
+    GuidingCalibration calibration;
+    std::unique_ptr<GuidingCalibrator> calibrator;
+    std::unique_ptr<GuidingLoop> loop;
+
+    void setState(State state);
+};
+
+
+Guiding::Guiding(const PulseGuider::ptr &guider, QObject *parent): QObject(parent), dptr(guider, this)
+{
+}
+
+
+Guiding::~Guiding()
+{
+}
+
+
+void Guiding::Private::setState(State state)
+{
+    if (state == this->state)
+        return;
+    this->state = state;
+    emit q->stateChanged(state);
+}
+
+
+Guiding::State Guiding::state() const
+{
+    return d->state;
+}
+
+
+GuidingCalibration Guiding::calibration() const
+{
+    return d->calibration;
+}
+
+
+void Guiding::calibrate(const GuidingCalibrator::Settings &settings)
+{
+    d->loop.reset();
+    d->calibrator.reset(new GuidingCalibrator{ d->guider, settings });
+    d->setState(State::Calibrating);
+}
+
+
+void Guiding::startGuiding(const GuidingLoop::Parameters &parameters)
+{
+    if (!d->calibration.valid())
+    {
+        qWarning() << "Cannot start guiding without a calibration";
+        return;
+    }
+    d->calibrator.reset();
+    d->loop.reset(new GuidingLoop{ d->guider, d->calibration, parameters });
+    d->setState(State::Guiding);
+}
+
+
+void Guiding::stop()
+{
+    d->calibrator.reset();
+    d->loop.reset();
+    d->setState(d->calibration.valid() ? State::Calibrated : State::Idle);
+}
+
+
+void Guiding::trackingPositionChanged(const QPointF &position, const QDateTime &frameTime)
+{
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    if (d->calibrator)
+    {
+        switch (d->calibrator->update(position, frameTime, now))
+        {
+            case GuidingCalibrator::State::Done:
+                d->calibration = d->calibrator->calibration();
+                stop();
+                break;
+            case GuidingCalibrator::State::Failed:
+                qWarning() << "Guiding calibration failed: the tracked position did not follow the pulses";
+                stop();
+                emit calibrationFailed();
+                break;
+            default:
+                break;
+        }
+    }
+    else if (d->loop)
+    {
+        const AxisPulses pulses = d->loop->update(position, frameTime, now);
+        if (pulses.ra != 0 || pulses.dec != 0)
+            emit pulsesIssued(pulses);
+    }
+}
+
+} // namespace Mount
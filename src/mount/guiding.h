@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2018 Filip Szczerek <ga.software@yahoo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MOUNT_GUIDING_H
+#define MOUNT_GUIDING_H
+
+#include <chrono>
+#include <memory>
+#include <QDateTime>
+#include <QObject>
+#include <QtCore/qpoint.h>
+#include "c++/dptr.h"
+
+
+namespace Mount
+{
+
+enum class GuideDirection { North, South, East, West };
+
+/// Issues timed guiding pulses to a mount
+class PulseGuider
+{
+public:
+    typedef std::shared_ptr<PulseGuider> ptr;
+    virtual ~PulseGuider() = default;
+
+    /// Starts moving the mount in 'direction' at guiding rate for 'duration'; does not wait for the pulse to end
+    virtual void pulse(GuideDirection direction, std::chrono::milliseconds duration) = 0;
+};
+
+/// Signed pulse durations in milliseconds; positive values are West (RA) and North (DEC)
+struct AxisPulses
+{
+    double ra = 0;
+    double dec = 0;
+};
+
+/// Maps image offsets onto RA/DEC guiding pulses
+struct GuidingCalibration
+{
+    QPointF ra;  ///< Image displacement in pixels per millisecond of West pulse
+    QPointF dec; ///< Image displacement in pixels per millisecond of North pulse
+
+    /// Returns 'true' if both axes moved the image, in directions at least 30 degrees apart
+    bool valid() const;
+
+    /// Returns the pulses moving the image by 'offset' pixels
+    AxisPulses pulsesFor(const QPointF &offset) const;
+
+    /// Returns the image displacement in pixels caused by 'pulses'
+    QPointF displacement(const AxisPulses &pulses) const;
+};
+
+/// Measures a GuidingCalibration by pulsing each axis and following the tracked position
+/** Each axis is pulsed 'steps' times away and then back, waiting for the first frame taken 'settle'
+    after a pulse ended before issuing the next one. */
+class GuidingCalibrator
+{
+public:
+    struct Settings
+    {
+        std::chrono::milliseconds pulse{1000};
+        int steps = 4;
+        std::chrono::milliseconds settle{1000};
+        double min_displacement = 5; ///< Minimum movement in pixels of each axis for the calibration to succeed
+    };
+    enum class State { Ra, RaReturn, Dec, DecReturn, Done, Failed };
+
+    GuidingCalibrator(const PulseGuider::ptr &guider, const Settings &settings);
+    ~GuidingCalibrator();
+
+    /// Feeds the tracked position in the frame taken at 'frameTime', possibly issuing the next pulse
+    State update(const QPointF &position, const QDateTime &frameTime, const QDateTime &now);
+    State state() const;
+    /// The measured calibration, meaningful once state() is Done
+    GuidingCalibration calibration() const;
+
+private:
+    DPTR
+};
+
+/// Closed guiding loop: a PID controller turning tracked positions into pulses
+/** The error is the offset from the position of the first frame, expressed as pulse durations.
+    Frame timestamps compensate the capture latency: the part of the issued pulses performed after
+    the frame was taken is added to the measured position, so corrections still in flight are not repeated. */
+class GuidingLoop
+{
+public:
+    struct Parameters
+    {
+        double proportional = 0.7; ///< Fraction of the error corrected on each frame
+        double integral = 0.05;    ///< 1/s
+        double derivative = 0;     ///< s
+        std::chrono::milliseconds min_pulse{20}; ///< Shorter corrections are not issued
+        std::chrono::milliseconds max_pulse{1000};
+    };
+
+    GuidingLoop(const PulseGuider::ptr &guider, const GuidingCalibration &calibration, const Parameters &parameters);
+    ~GuidingLoop();
+
+    /// Feeds the tracked position in the frame taken at 'frameTime'; returns the issued pulses
+    /** Frames older than the previous one are ignored. An axis with a pulse still running is not corrected. */
+    AxisPulses update(const QPointF &position, const QDateTime &frameTime, const QDateTime &now);
+
+private:
+    DPTR
+};
+
+/// Drives calibration and guiding from the tracker updates
+class Guiding: public QObject
+{
+    Q_OBJECT
+public:
+    enum class State { Idle, Calibrating, Calibrated, Guiding };
+
+    Guiding(const PulseGuider::ptr &guider, QObject *parent = nullptr);
+    ~Guiding();
+
+    State state() const;
+    GuidingCalibration calibration() const;
+
+    void calibrate(const GuidingCalibrator::Settings &settings = {});
+    /// Starts keeping the current position; requires a calibration
+    void startGuiding(const GuidingLoop::Parameters &parameters = {});
+    /// Stops calibrating or guiding; a completed calibration is kept
+    void stop();
+
+public slots:
+    void trackingPositionChanged(const QPointF &position, const QDateTime &frameTime);
+
+signals:
+    void stateChanged(State state);
+    void calibrationFailed();
+    void pulsesIssued(const AxisPulses &pulses);
+
+private:
+    DPTR
+};
+
+} // namespace Mount
+
+#endif // MOUNT_GUIDING_H
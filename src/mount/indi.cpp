@@ -17,13 +17,257 @@
  */
 
 #include "mount.h"
+#include "guiding.h"
+#include "commandqueue.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <QDebug>
+#include <baseclient.h>
+#include <basedevice.h>
 
 namespace Mount
 {
 
+namespace
+{
+/// Sends pulses through the TELESCOPE_TIMED_GUIDE_NS/WE properties, and caches EQUATORIAL_EOD_COORD
+/** INDI::BaseClient calls the new* functions on its own listening thread; commands, including connecting, run on the queue's one. */
+class IndiMount: public INDI::BaseClient, public MountConnection
+{
+public:
+    IndiMount(const char *hostname, unsigned port, const std::string &device);
+    ~IndiMount() override;
+
+    void pulse(GuideDirection direction, std::chrono::milliseconds duration) override;
+    MountStatus status() const override;
+
+protected:
+    void newDevice(INDI::BaseDevice *) override {}
+    void removeDevice(INDI::BaseDevice *) override {}
+    void newProperty(INDI::Property *property) override;
+    void removeProperty(INDI::Property *) override {}
+    void newBLOB(IBLOB *) override {}
+    void newSwitch(ISwitchVectorProperty *) override {}
+    void newNumber(INumberVectorProperty *property) override;
+    void newText(ITextVectorProperty *) override {}
+    void newLight(ILightVectorProperty *) override {}
+    void newMessage(INDI::BaseDevice *, int) override {}
+    void serverConnected() override;
+    void serverDisconnected(int) override;
+
+private:
+    void sendPulse(GuideDirection direction, std::chrono::milliseconds duration);
+    void updateStatus(const std::function<void(MountStatus &)> &update);
+    void updatePosition(INumberVectorProperty *property);
+
+    const std::string device;
+    mutable std::mutex statusMutex;
+    MountStatus cachedStatus;
+    /// Reset first when closing: a command can't run while the client is disconnecting
+    std::unique_ptr<CommandQueue> commands;
+};
+
+
+IndiMount::IndiMount(const char *hostname, unsigned port, const std::string &device): device(device), commands(new CommandQueue)
+{
+    setServer(hostname, port);
+    watchDevice(device.c_str());
+    const std::string host = hostname;
+    commands->push(CommandQueue::Priority::Normal, [this, host, port] {
+        if (!connectServer())
+        {
+            qWarning() << "Cannot connect to INDI server" << host.c_str() << port;
+            updateStatus([](MountStatus &status) { status.connection = MountStatus::Connection::Failed; });
+        }
+    });
+}
+
+
+IndiMount::~IndiMount()
+{
+    commands.reset();
+    disconnectServer();
+}
+
+
+void IndiMount::updateStatus(const std::function<void(MountStatus &)> &update)
+{
+    std::lock_guard<std::mutex> lock(statusMutex);
+    update(cachedStatus);
+}
+
+
+MountStatus IndiMount::status() const
+{
+    std::lock_guard<std::mutex> lock(statusMutex);
+    return cachedStatus;
+}
+
+
+void IndiMount::serverConnected()
+{
+    updateStatus([](MountStatus &status) { status.connection = MountStatus::Connection::Connected; });
+}
+
+
+void IndiMount::serverDisconnected(int)
+{
+    updateStatus([](MountStatus &status) { status.connection = MountStatus::Connection::Failed; });
+}
+
+
+void IndiMount::newProperty(INDI::Property *property)
+{
+    if (property->getType() == INDI_NUMBER)
+        newNumber(property->getNumber());
+}
+
+
+void IndiMount::newNumber(INumberVectorProperty *property)
+{
+    if (device == property->device && std::strcmp(property->name, "EQUATORIAL_EOD_COORD") == 0)
+        updatePosition(property);
+}
+
+
+void IndiMount::updatePosition(INumberVectorProperty *property)
+{
+    const INumber *ra = IUFindNumber(property, "RA");
+    const INumber *dec = IUFindNumber(property, "DEC");
+    if (!ra || !dec)
+        return;
+    updateStatus([&](MountStatus &status) {
+        status.position_known = true;
+        status.ra = ra->value;
+        status.dec = dec->value;
+        // Busy while the mount is slewing to a new target
+        status.slewing = property->s == IPS_BUSY;
+        status.updated = std::chrono::steady_clock::now();
+    });
+}
+
+
+void IndiMount::pulse(GuideDirection direction, std::chrono::milliseconds duration)
+{
+    if (status().connection != MountStatus::Connection::Connected)
+        return;
+    const bool declination = direction == GuideDirection::North || direction == GuideDirection::South;
+    // One queued correction per axis: a newer one makes the waiting one stale
+    commands->push(CommandQueue::Priority::Guiding, [this, direction, duration] { sendPulse(direction, duration); }, declination ? 1 : 2);
+}
+
+
+void IndiMount::sendPulse(GuideDirection direction, std::chrono::milliseconds duration)
+{
+    const bool declination = direction == GuideDirection::North || direction == GuideDirection::South;
+    INDI::BaseDevice *telescope = getDevice(device.c_str());
+    INumberVectorProperty *property = telescope ? telescope->getNumber(declination ? "TELESCOPE_TIMED_GUIDE_NS" : "TELESCOPE_TIMED_GUIDE_WE") : nullptr;
+    if (!property)
+    {
+        qWarning() << "INDI device" << device.c_str() << "does not accept guide pulses";
+        return;
+    }
+
+    const char *element = nullptr;
+    switch (direction)
+    {
+        case GuideDirection::North: element = "TIMED_GUIDE_N"; break;
+        case GuideDirection::South: element = "TIMED_GUIDE_S"; break;
+        case GuideDirection::East:  element = "TIMED_GUIDE_E"; break;
+        case GuideDirection::West:  element = "TIMED_GUIDE_W"; break;
+    }
+    for (int i = 0; i < property->nnp; i++)
+        property->np[i].value = std::strcmp(property->np[i].name, element) == 0 ? duration.count() : 0;
+    sendNewNumber(property);
+}
+
+
+/// Collects the devices accepting guide pulses, as the server defines their properties on connection
+class IndiDeviceScanner: public INDI::BaseClient
+{
+public:
+    /// The server sends all of its devices right after connecting, and nothing marks the end: the scan ends when no new property comes for a while
+    std::vector<std::string> scan(const char *hostname, unsigned port, std::chrono::milliseconds quiet, std::chrono::milliseconds timeout);
+
+protected:
+    void newDevice(INDI::BaseDevice *) override { touch(); }
+    void removeDevice(INDI::BaseDevice *) override {}
+    void newProperty(INDI::Property *property) override;
+    void removeProperty(INDI::Property *) override {}
+    void newBLOB(IBLOB *) override {}
+    void newSwitch(ISwitchVectorProperty *) override {}
+    void newNumber(INumberVectorProperty *) override {}
+    void newText(ITextVectorProperty *) override {}
+    void newLight(ILightVectorProperty *) override {}
+    void newMessage(INDI::BaseDevice *, int) override {}
+    void serverConnected() override {}
+    void serverDisconnected(int) override {}
+
+private:
+    void touch();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::chrono::steady_clock::time_point last_update;
+    std::vector<std::string> devices;
+};
+
+
+std::vector<std::string> IndiDeviceScanner::scan(const char *hostname, unsigned port, std::chrono::milliseconds quiet, std::chrono::milliseconds timeout)
+{
+    setServer(hostname, port);
+    const auto started = std::chrono::steady_clock::now();
+    last_update = started;
+    if (!connectServer())
+    {
+        qWarning() << "Cannot connect to INDI server" << hostname << port;
+        return {};
+    }
+    std::vector<std::string> found;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto deadline = started + timeout;
+        while (std::chrono::steady_clock::now() < std::min(last_update + quiet, deadline))
+            changed.wait_until(lock, std::min(last_update + quiet, deadline));
+        found = devices;
+    }
+    disconnectServer();
+    return found;
+}
+
+
+void IndiDeviceScanner::newProperty(INDI::Property *property)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::string name = property->getDeviceName();
+        if (std::strcmp(property->getName(), "TELESCOPE_TIMED_GUIDE_NS") == 0 && std::find(devices.begin(), devices.end(), name) == devices.end())
+            devices.push_back(name);
+    }
+    touch();
+}
+
+
+void IndiDeviceScanner::touch()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    last_update = std::chrono::steady_clock::now();
+    changed.notify_all();
+}
+} // namespace
+
 std::vector<std::string> getIndiDevices(const char *hostname, unsigned port)
 {
-    return { "some device 1" };
+    IndiDeviceScanner scanner;
+    return scanner.scan(hostname, port, std::chrono::milliseconds{500}, std::chrono::seconds{5});
+}
+
+MountConnection::ptr connectIndiMount(const char *hostname, unsigned port, const std::string &device)
+{
+    return std::make_shared<IndiMount>(hostname, port, device);
 }
 
 } // namespace Mount
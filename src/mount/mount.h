@@ -19,8 +19,11 @@
 #ifndef MOUNT_H
 #define MOUNT_H
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
+#include "guiding.h"
 
 
 namespace Mount
@@ -34,8 +37,37 @@ enum class ConnectionType
 
 bool isConnectionSupported(ConnectionType connType);
 
+/// Devices on the INDI server accepting guide pulses; blocks (up to a few seconds) while the server lists them. Empty when it can't connect
 std::vector<std::string> getIndiDevices(const char *hostname, unsigned port);
 
+/// Mount state, as last reported by the mount
+struct MountStatus
+{
+    enum class Connection { Connecting, Connected, Failed };
+    Connection connection = Connection::Connecting;
+    bool position_known = false;
+    double ra = 0;  ///< Hours, epoch of date
+    double dec = 0; ///< Degrees, epoch of date
+    bool slewing = false;
+    std::chrono::steady_clock::time_point updated; ///< Time of the last position update
+};
+
+/// Mount whose commands never block the caller
+/** Commands are queued to the mount's own thread (see CommandQueue), guide pulses first.
+    The status is a local copy, kept up to date as the mount reports changes. */
+class MountConnection: public PulseGuider
+{
+public:
+    typedef std::shared_ptr<MountConnection> ptr;
+
+    /// Returns the cached status without waiting for the mount; thread safe
+    virtual MountStatus status() const = 0;
+};
+
+/// Starts connecting to 'device' on the INDI server in the background and returns right away
+/** The connection outcome shows up in status(); pulses sent before it's connected are dropped. */
+MountConnection::ptr connectIndiMount(const char *hostname, unsigned port, const std::string &device);
+
 
 } // namespace Mount
 
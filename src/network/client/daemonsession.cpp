@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemonsession.h"
+#include <QDebug>
+#include "network/networkdispatcher.h"
+#include "network/networkpacket.h"
+#include "network/client/remotedriver.h"
+#include "network/client/remoteconfiguration.h"
+#include "network/protocol/driverprotocol.h"
+#include "network/protocol/savefileprotocol.h"
+#include "commons/frame.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+DPTR_IMPL(DaemonSession) {
+  DaemonSession *q;
+  const QString host;
+  const int port;
+  NetworkClientPtr client;
+  RemoteDriverPtr driver;
+  unique_ptr<RemoteConfiguration> configuration;
+  Telemetry telemetry;
+  bool focused = false;
+  double thumbnails_fps = 1;
+  int thumbnails_size = 240;
+  DriverProtocol::FrameDecoders decoders;
+  NetworkProtocol::FormatParameters thumbnails() const;
+  void frame(const NetworkPacketPtr &packet);
+  void camera_connected();
+};
+
+NetworkProtocol::FormatParameters DaemonSession::Private::thumbnails() const
+{
+  // JPEG is the cheapest for the daemon to encode, and the smallest to send
+  return { Configuration::Network_JPEG, false, true, 60, {thumbnails_size, thumbnails_size}, {}, thumbnails_fps };
+}
+
+DaemonSession::DaemonSession(const QString &host, int port, QObject *parent)
+  : QObject{parent}, NetworkReceiver{make_shared<NetworkDispatcher>()}, dptr(this, host, port)
+{
+  d->client = make_shared<NetworkClient>(dispatcher());
+  d->driver = make_shared<RemoteDriver>(dispatcher());
+  d->configuration = make_unique<RemoteConfiguration>(dispatcher());
+  connect(d->client.get(), &NetworkClient::statusChanged, this, [this](NetworkClient::Status status) {
+    d->telemetry.status = status;
+    if(status == NetworkClient::Connected)
+      d->telemetry.error.clear();
+    if(status == NetworkClient::Disconnected) {
+      // Nothing is known anymore, but why it went away
+      d->telemetry = {status, d->telemetry.error};
+      d->decoders.clear();
+      emit disconnected();
+    }
+    emit telemetryChanged();
+  });
+  connect(d->client.get(), &NetworkClient::error, this, [this](const QString &message) {
+    d->telemetry.error = message;
+    emit telemetryChanged();
+  });
+  connect(d->client.get(), &NetworkClient::connected, this, &DaemonSession::connected);
+
+  register_handler(NetworkProtocol::HelloReply, [this](const NetworkPacketPtr &packet) {
+    d->telemetry.imager_running = DriverProtocol::decodeStatus(packet).imager_running;
+    if(d->telemetry.imager_running && d->telemetry.camera.isEmpty())
+      d->camera_connected();
+    emit telemetryChanged();
+  });
+  register_handler(DriverProtocol::signalCameraConnected, [this](const NetworkPacketPtr &) {
+    d->telemetry.imager_running = true;
+    d->camera_connected();
+    emit telemetryChanged();
+  });
+  register_handler(DriverProtocol::GetCameraNameReply, [this](const NetworkPacketPtr &packet) {
+    d->telemetry.camera = packet->payloadVariant().toString();
+    emit telemetryChanged();
+  });
+  register_handler(DriverProtocol::signalDisconnected, [this](const NetworkPacketPtr &) {
+    d->telemetry.imager_running = false;
+    d->telemetry.camera.clear();
+    d->telemetry.capture_fps = 0;
+    d->telemetry.temperature = {};
+    emit telemetryChanged();
+  });
+  register_handler(DriverProtocol::signalImagerChanges, [this](const NetworkPacketPtr &packet) {
+    // Only fps and temperature: control values are deltas against descriptors the dashboard never asked for
+    const auto changes = packet->payloadVariant().toMap();
+    if(changes.contains("fps"))
+      d->telemetry.capture_fps = changes.value("fps").toDouble();
+    if(changes.contains("temperature"))
+      d->telemetry.temperature = changes.value("temperature");
+    if(changes.contains("fps") || changes.contains("temperature"))
+      emit telemetryChanged();
+  });
+  register_handler(SaveFileProtocol::signalRecording, [this](const NetworkPacketPtr &packet) {
+    d->telemetry.recording = true;
+    d->telemetry.recording_file = packet->payloadVariant().toString();
+    d->telemetry.saved_frames = 0;
+    d->telemetry.dropped_frames = 0;
+    emit telemetryChanged();
+  });
+  register_handler(SaveFileProtocol::signalFinished, [this](const NetworkPacketPtr &) {
+    d->telemetry.recording = false;
+    d->telemetry.save_fps = 0;
+    d->telemetry.load_shedding = 0;
+    emit telemetryChanged();
+  });
+  register_handler(SaveFileProtocol::signalRecordingStatus, [this](const NetworkPacketPtr &packet) {
+    const auto status = packet->payloadVariant().toMap();
+    d->telemetry.save_fps = status.value(SaveFileProtocol::SaveFPS, d->telemetry.save_fps).toDouble();
+    d->telemetry.saved_frames = status.value(SaveFileProtocol::SavedFrames, d->telemetry.saved_frames).toLongLong();
+    d->telemetry.dropped_frames = status.value(SaveFileProtocol::DroppedFrames, d->telemetry.dropped_frames).toLongLong();
+    d->telemetry.load_shedding = status.value(SaveFileProtocol::LoadShedding, d->telemetry.load_shedding).toInt();
+    emit telemetryChanged();
+  });
+  for(auto name: {DriverProtocol::SendFrame, DriverProtocol::SendCodedFrame})
+    register_handler(name, bind(&Private::frame, d.get(), std::placeholders::_1));
+}
+
+DaemonSession::~DaemonSession()
+{
+}
+
+void DaemonSession::Private::camera_connected()
+{
+  q->request(DriverProtocol::packetGetCameraName(), DriverProtocol::GetCameraNameReply);
+}
+
+void DaemonSession::Private::frame(const NetworkPacketPtr &packet)
+{
+  // The main window imager takes care of the full preview, and acknowledges it itself
+  if(focused)
+    return;
+  q->dispatcher()->queue_send(DriverProtocol::packetFrameReceived());
+  // Small and rare: decoded right away
+  auto frame = packet->name() == DriverProtocol::SendCodedFrame ? DriverProtocol::decodeCodedFrame(packet, decoders) : DriverProtocol::decodeFrame(packet);
+  if(frame)
+    emit q->thumbnail(frame);
+}
+
+QString DaemonSession::host() const
+{
+  return d->host;
+}
+
+int DaemonSession::port() const
+{
+  return d->port;
+}
+
+QString DaemonSession::address() const
+{
+  return "%1:%2"_q % d->host % d->port;
+}
+
+DaemonSession::Telemetry DaemonSession::telemetry() const
+{
+  return d->telemetry;
+}
+
+void DaemonSession::setThumbnails(double fps, int size)
+{
+  d->thumbnails_fps = fps;
+  d->thumbnails_size = size;
+  if(! d->focused)
+    d->client->setFormatParameters(d->thumbnails());
+}
+
+void DaemonSession::setFocused(bool focused, const NetworkProtocol::FormatParameters &preview)
+{
+  qDebug() << "Daemon" << address() << (focused ? "focused" : "back to thumbnails");
+  d->focused = focused;
+  d->decoders.clear();
+  d->client->setFormatParameters(focused ? preview : d->thumbnails());
+  emit telemetryChanged();
+}
+
+bool DaemonSession::focused() const
+{
+  return d->focused;
+}
+
+RemoteDriverPtr DaemonSession::driver() const
+{
+  return d->driver;
+}
+
+RemoteConfiguration &DaemonSession::configuration() const
+{
+  return *d->configuration;
+}
+
+void DaemonSession::connectToDaemon()
+{
+  d->telemetry.error.clear();
+  d->client->connectToHost(d->host, d->port, d->thumbnails());
+}
+
+void DaemonSession::disconnectFromDaemon()
+{
+  d->client->disconnectFromHost();
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DAEMONSESSION_H
+#define DAEMONSESSION_H
+
+#include <QObject>
+#include <QVariant>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+#include "network/client/networkclient.h"
+#include "network/protocol/protocol.h"
+
+FWD_PTR(DaemonSession)
+FWD_PTR(RemoteDriver)
+FWD_PTR(Frame)
+class RemoteConfiguration;
+
+/**
+ * One of the daemons on the frontend dashboard: a connection of its own, with its own dispatcher, driver and configuration.
+ * Unless focused, the daemon sends small frames at a low rate (thumbnails), and the session keeps its telemetry from the
+ * signals the daemon broadcasts anyway (imager changes, recording status): watching many daemons costs little bandwidth and CPU.
+ * A focused session asks for the full preview instead, for a main window built on top of it; only one should be at a time.
+ */
+class DaemonSession : public QObject, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  struct Telemetry {
+    NetworkClient::Status status = NetworkClient::Disconnected;
+    QString error;
+    bool imager_running = false;
+    QString camera;
+    double capture_fps = 0;
+    /// Null if the camera has no sensor
+    QVariant temperature;
+    bool recording = false;
+    QString recording_file;
+    double save_fps = 0;
+    qlonglong saved_frames = 0;
+    qlonglong dropped_frames = 0;
+    /// A LoadShedding::Level
+    int load_shedding = 0;
+  };
+  DaemonSession(const QString &host, int port, QObject *parent = nullptr);
+  ~DaemonSession();
+  QString host() const;
+  int port() const;
+  /// host:port
+  QString address() const;
+  Telemetry telemetry() const;
+  /// Thumbnails: at most fps frames per second, fitting size pixels on their longest side
+  void setThumbnails(double fps, int size);
+  /**
+   * Full preview, with preview parameters, for a main window; or back to thumbnails.
+   * Frames are left to the main window RemoteImager while focused, including their acknowledgements.
+   */
+  void setFocused(bool focused, const NetworkProtocol::FormatParameters &preview = {});
+  bool focused() const;
+  using NetworkReceiver::dispatcher;
+  RemoteDriverPtr driver() const;
+  RemoteConfiguration &configuration() const;
+public slots:
+  void connectToDaemon();
+  void disconnectFromDaemon();
+signals:
+  void thumbnail(const FrameConstPtr &frame);
+  void telemetryChanged();
+  void connected();
+  void disconnected();
+private:
+  DPTR
+};
+
+#endif // DAEMONSESSION_H
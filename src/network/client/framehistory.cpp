@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "framehistory.h"
+#include "network/networkpacket.h"
+#include "network/protocol/driverprotocol.h"
+#include "commons/frame.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <deque>
+
+using namespace std;
+
+DPTR_IMPL(FrameHistory) {
+  const size_t budget;
+  struct Entry {
+    quint64 number;
+    NetworkPacketPtr packet;
+    size_t bytes;
+    Clock::time_point received;
+  };
+  mutable QMutex mutex;
+  deque<Entry> entries;
+  size_t bytes = 0;
+  quint64 next = 1;
+  // Apart from the live ones: decoding here must not touch the state of the live stream
+  DriverProtocol::FrameDecoders decoders;
+  QMutex decoding;
+  FramePtr decode(const Entry &entry);
+};
+
+FramePtr FrameHistory::Private::decode(const Entry &entry)
+{
+  if(entry.packet->name() == DriverProtocol::SendCodedFrame)
+    return DriverProtocol::decodeCodedFrame(entry.packet, decoders);
+  return DriverProtocol::decodeFrame(entry.packet);
+}
+
+FrameHistory::FrameHistory(size_t budget_bytes) : dptr(budget_bytes)
+{
+}
+
+FrameHistory::~FrameHistory()
+{
+}
+
+void FrameHistory::add(const NetworkPacketPtr &packet)
+{
+  const size_t bytes = packet->payload().size();
+  QMutexLocker lock(&d->mutex);
+  d->entries.push_back({d->next++, packet, bytes, Clock::now()});
+  d->bytes += bytes;
+  while(d->bytes > d->budget && d->entries.size() > 1) {
+    d->bytes -= d->entries.front().bytes;
+    d->entries.pop_front();
+  }
+}
+
+quint64 FrameHistory::first() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->entries.empty() ? 0 : d->entries.front().number;
+}
+
+quint64 FrameHistory::last() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->entries.empty() ? 0 : d->entries.back().number;
+}
+
+size_t FrameHistory::bytes() const
+{
+  QMutexLocker lock(&d->mutex);
+  return d->bytes;
+}
+
+FrameHistory::Clock::time_point FrameHistory::received(quint64 number) const
+{
+  QMutexLocker lock(&d->mutex);
+  if(d->entries.empty() || number < d->entries.front().number || number > d->entries.back().number)
+    return {};
+  return d->entries[number - d->entries.front().number].received;
+}
+
+FramePtr FrameHistory::frame(quint64 number)
+{
+  QMutexLocker decoding(&d->decoding);
+  // Copies: the packets are shared, and new frames keep coming in while decoding
+  vector<Private::Entry> entries;
+  {
+    QMutexLocker lock(&d->mutex);
+    if(d->entries.empty() || number < d->entries.front().number || number > d->entries.back().number)
+      return {};
+    entries.assign(d->entries.begin(), d->entries.begin() + (number - d->entries.front().number) + 1);
+  }
+  // Fresh decoders every time, so that no state is left from a frame decoded before
+  d->decoders.clear();
+  auto frame = d->decode(entries.back());
+  if(frame)
+    return frame;
+  // A delta: back to the last keyframe before it, the only frame fresh decoders can rebuild (deltas fail early, on their header)
+  for(auto keyframe = entries.rbegin() + 1; keyframe != entries.rend(); ++keyframe) {
+    d->decoders.clear();
+    if(d->decode(*keyframe))
+      return d->decode(entries.back());
+  }
+  return {};
+}
+
+void FrameHistory::clear()
+{
+  QMutexLocker lock(&d->mutex);
+  d->entries.clear();
+  d->bytes = 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMEHISTORY_H
+#define FRAMEHISTORY_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include <chrono>
+#include <cstddef>
+#include <QtGlobal>
+
+FWD_PTR(NetworkPacket)
+FWD_PTR(Frame)
+FWD_PTR(FrameHistory)
+
+/**
+ * The last preview frames received from a remote imager, kept as they came over the network (compressed), within a memory budget:
+ * looking back at the last seconds (i.e. for a moment of good seeing) costs no traffic and no work on the daemon.
+ * Only the frame asked for is decoded. Raw frames, sent uncompressed, are not kept.
+ * Frames are numbered from 1 as they come, so numbers stay valid while older frames make room for new ones. Thread safe.
+ */
+class FrameHistory
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  explicit FrameHistory(std::size_t budget_bytes = 256 * 1024 * 1024);
+  ~FrameHistory();
+  /// Keeps a SendFrame or SendCodedFrame packet, dropping the oldest ones beyond the budget
+  void add(const NetworkPacketPtr &packet);
+  /// Number of the oldest and newest frames kept; both 0 when empty
+  quint64 first() const;
+  quint64 last() const;
+  std::size_t bytes() const;
+  /// When the frame was received; the epoch if it's gone
+  Clock::time_point received(quint64 number) const;
+  /**
+   * Decodes a frame, null if it's gone or can't be decoded. Frames from stateful codecs (deltas against a keyframe)
+   * are decoded replaying the kept frames before them. Any thread, one call at a time.
+   */
+  FramePtr frame(quint64 number);
+  void clear();
+private:
+  DPTR
+};
+
+#endif // FRAMEHISTORY_H
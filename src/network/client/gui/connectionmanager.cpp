@@ -36,13 +36,23 @@
 
 #include "network/protocol/protocol.h"
 #include "network/client/gui/remotefilesystembrowser.h"
+#include "network/client/remotemetricssource.h"
+#include "network/client/remotefocussource.h"
+#include "network/client/remotehistogram.h"
+#include "image_handlers/frontend/histogram.h"
+#include "network/client/daemonsession.h"
+#include "network/client/remoteimager.h"
+#include "network/client/gui/daemonsdashboard.h"
 #include "commons/configuration.h"
+#include "commons/autotuning.h"
 #include "planetaryimager.h"
+#include <QDebug>
 
 using namespace std;
 
 DPTR_IMPL(ConnectionManager) {
   ConnectionManager *q;
+  const bool auto_configure;
   unique_ptr<Ui::ConnectionManager> ui;
   NetworkDispatcherPtr dispatcher;
   RemoteDriverPtr remoteDriver;
@@ -50,20 +60,37 @@ DPTR_IMPL(ConnectionManager) {
   unique_ptr<RemoteConfiguration> configuration;
   
   PlanetaryImagerMainWindow *mainWindow = nullptr;
+  unique_ptr<RemoteHistogram> remoteHistogram;
   
   QHash<int, Configuration::NetworkImageFormat> formats_indexes;
   Configuration::NetworkImageFormat format() const;
+  NetworkProtocol::FormatParameters parameters() const;
   
   void onConnected();
   void adjustParametersVisibility();
+  void autoConfigure();
+
+  // Dashboard: many daemons at once, each with its own connection; one at a time gets a main window, and the full preview
+  QList<DaemonSessionPtr> sessions;
+  unique_ptr<DaemonsDashboard> dashboard;
+  DaemonSession *focused = nullptr;
+  PlanetaryImagerMainWindow *sessionWindow = nullptr;
+  PlanetaryImagerPtr sessionImager;
+  unique_ptr<RemoteHistogram> sessionHistogram;
+  void showDashboard();
+  void addDaemon(const QString &address);
+  void removeDaemon(DaemonSession *session);
+  void openDaemon(DaemonSession *session);
+  void closeDaemonWindow();
+  void saveDaemons();
 };
 
-ConnectionManager::ConnectionManager() : dptr(this)
+ConnectionManager::ConnectionManager(bool auto_configure) : dptr(this, auto_configure)
 {
   d->ui = make_unique<Ui::ConnectionManager>();
   d->ui->setupUi(this);
   
-  d->formats_indexes = { {0, Configuration::Network_RAW}, {1, Configuration::Network_JPEG} };
+  d->formats_indexes = { {0, Configuration::Network_RAW}, {1, Configuration::Network_JPEG}, {2, Configuration::Network_WebP}, {3, Configuration::Network_TileDelta} };
   
   d->dispatcher = make_shared<NetworkDispatcher>();
   d->client = make_shared<NetworkClient>(d->dispatcher);
@@ -74,15 +101,32 @@ ConnectionManager::ConnectionManager() : dptr(this)
     d->configuration->set_server_host(d->ui->host->text());
     d->configuration->set_server_port(d->ui->port->value());
     d->ui->status->setText(tr("Connecting to %1:%2") % d->ui->host->text() % d->ui->port->value());
-    NetworkProtocol::FormatParameters parameters{d->format(), d->ui->compression->isChecked(), d->ui->force8bit->isChecked(), d->ui->jpeg_quality->value()};
+    const auto parameters = d->parameters();
     d->configuration->set_server_image_format(parameters.format);
     d->configuration->set_server_compression(parameters.compression);
     d->configuration->set_server_force8bit(parameters.force8bit);
     d->configuration->set_server_jpeg_quality(parameters.jpegQuality);
+    d->configuration->set_server_preview_max_size(d->ui->preview_max_size->value());
+    d->configuration->set_server_udp_preview(d->ui->udp_preview->isChecked());
+    d->configuration->set_server_multicast_group(d->ui->multicast_group->text());
+    d->configuration->set_server_local_frames(d->ui->local_frames->isChecked());
+    d->configuration->set_record_on_client(d->ui->record_on_client->isChecked());
+    d->client->setUdpPreview(d->ui->udp_preview->isChecked(), d->ui->multicast_group->text().trimmed());
+    d->client->setLocalFrames(d->ui->local_frames->isChecked());
     d->client->connectToHost(d->ui->host->text(), d->ui->port->value(), parameters);
   });
+  auto addToDashboardButton = d->ui->buttonBox->addButton(tr("Add to dashboard"), QDialogButtonBox::ActionRole);
+  auto dashboardButton = d->ui->buttonBox->addButton(tr("Dashboard"), QDialogButtonBox::ActionRole);
+  connect(dashboardButton, &QPushButton::clicked, this, [=] {
+    d->showDashboard();
+  });
+  connect(addToDashboardButton, &QPushButton::clicked, this, [=] {
+    d->showDashboard();
+    d->addDaemon("%1:%2"_q % d->ui->host->text() % d->ui->port->value());
+  });
   connect(d->ui->host, &QLineEdit::textChanged, this, [=](const QString &newHost) {
     connectButton->setEnabled(! newHost.isEmpty());
+    addToDashboardButton->setEnabled(! newHost.isEmpty());
   });
   connect(d->client.get(), &NetworkClient::statusChanged, [=](NetworkClient::Status status){
     connectButton->setEnabled(status != NetworkClient::Connecting && status != NetworkClient::Connected);
@@ -110,6 +154,13 @@ ConnectionManager::ConnectionManager() : dptr(this)
   d->ui->compression->setChecked(d->configuration->server_compression());
   d->ui->force8bit->setChecked(d->configuration->server_force8bit());
   d->ui->jpeg_quality->setValue(d->configuration->server_jpeg_quality());
+  d->ui->preview_max_size->setValue(d->configuration->server_preview_max_size());
+  d->ui->udp_preview->setChecked(d->configuration->server_udp_preview());
+  d->ui->multicast_group->setText(d->configuration->server_multicast_group());
+  d->ui->local_frames->setChecked(d->configuration->server_local_frames());
+  d->ui->record_on_client->setChecked(d->configuration->record_on_client());
+  connect(d->ui->udp_preview, &QCheckBox::toggled, d->ui->multicast_group, &QWidget::setEnabled);
+  d->ui->multicast_group->setEnabled(d->ui->udp_preview->isChecked());
   
   d->adjustParametersVisibility();
 }
@@ -117,6 +168,7 @@ ConnectionManager::ConnectionManager() : dptr(this)
 ConnectionManager::~ConnectionManager()
 {
   LOG_F_SCOPE
+  d->closeDaemonWindow();
 }
 
 // TODO: change with remote
@@ -124,9 +176,16 @@ ConnectionManager::~ConnectionManager()
 void ConnectionManager::Private::onConnected()
 {
   ui->status->clear();
+  if(auto_configure)
+    autoConfigure();
   auto imageHandlers = make_shared<ImageHandlers>();
   auto planetaryImager = make_shared<PlanetaryImager>(remoteDriver, imageHandlers, make_shared<RemoteSaveImages>(dispatcher), *configuration);
-  mainWindow = new PlanetaryImagerMainWindow{planetaryImager, imageHandlers, make_shared<RemoteFilesystemBrowser>(dispatcher)};
+  mainWindow = new PlanetaryImagerMainWindow{planetaryImager, imageHandlers, make_shared<RemoteFilesystemBrowser>(dispatcher), make_shared<RemoteMetricsSource>(dispatcher), make_shared<RemoteFocusSource>(dispatcher)};
+  // Counted by the server on the raw frames, instead of on the previews
+  remoteHistogram = make_unique<RemoteHistogram>(dispatcher);
+  connect(remoteHistogram.get(), &RemoteHistogram::histogram, mainWindow, [histogram = mainWindow->histogram()](const QList<HistogramSummary> &channels) {
+    histogram->received(channels);
+  }, Qt::DirectConnection);
   mainWindow->show();
   q->hide();
   if(auto running_camera = remoteDriver->existing_running_camera()) {
@@ -135,17 +194,159 @@ void ConnectionManager::Private::onConnected()
   connect(mainWindow, &PlanetaryImagerMainWindow::quit, client.get(), &NetworkClient::disconnectFromHost);
 }
 
+void ConnectionManager::Private::autoConfigure()
+{
+  const auto link = client->probeLink();
+  if(! link.valid()) {
+    qWarning() << "Auto configuration: unable to measure the link to the daemon, keeping the preview settings";
+    return;
+  }
+  const auto settings = AutoTuning::recommend(link);
+  qWarning() << "Auto configuration: link at" << link.bytes_per_second / 1024 / 1024 << "MB/s, round trip" << link.rtt.count() << "ms, settings:" << AutoTuning::values(settings);
+  AutoTuning::apply(settings, *configuration);
+  ui->format->setCurrentIndex(formats_indexes.key(settings.server_image_format));
+  ui->jpeg_quality->setValue(settings.server_jpeg_quality);
+  ui->preview_max_size->setValue(settings.server_preview_max_size);
+  client->setFormatParameters(parameters());
+}
+
 Configuration::NetworkImageFormat ConnectionManager::Private::format() const
 {
   return formats_indexes[ui->format->currentIndex()];
 }
 
+NetworkProtocol::FormatParameters ConnectionManager::Private::parameters() const
+{
+  const int preview_max_size = ui->preview_max_size->value();
+  return { format(), ui->compression->isChecked(), ui->force8bit->isChecked(), ui->jpeg_quality->value(), {preview_max_size, preview_max_size}, {}, 0 };
+}
+
+void ConnectionManager::Private::showDashboard()
+{
+  if(! dashboard) {
+    dashboard = make_unique<DaemonsDashboard>();
+    connect(dashboard.get(), &DaemonsDashboard::openRequested, q, [this](DaemonSession *session) { openDaemon(session); });
+    connect(dashboard.get(), &DaemonsDashboard::removeRequested, q, [this](DaemonSession *session) { removeDaemon(session); });
+    // Back to the connection dialog: the daemons stay on the list for the next time, but are not watched anymore
+    connect(dashboard.get(), &DaemonsDashboard::closed, q, [this] {
+      closeDaemonWindow();
+      for(auto session: sessions) {
+        dashboard->remove(session.get());
+        session->disconnectFromDaemon();
+      }
+      sessions.clear();
+      q->show();
+    });
+  }
+  // The daemons of the last time come back with the dashboard
+  for(auto address: configuration->dashboard_daemons())
+    addDaemon(address);
+  dashboard->show();
+  dashboard->raise();
+  q->hide();
+}
+
+void ConnectionManager::Private::addDaemon(const QString &address)
+{
+  const int separator = address.lastIndexOf(':');
+  const QString host = separator > 0 ? address.left(separator) : address;
+  const int port = separator > 0 ? address.mid(separator + 1).toInt() : Configuration::DefaultServerPort;
+  if(host.isEmpty() || any_of(sessions.begin(), sessions.end(), [&](const DaemonSessionPtr &session) { return session->host() == host && session->port() == port; }))
+    return;
+  auto session = make_shared<DaemonSession>(host, port);
+  session->setThumbnails(configuration->dashboard_thumbnail_fps(), configuration->dashboard_thumbnail_size());
+  connect(session.get(), &DaemonSession::disconnected, q, [this, session = session.get()] {
+    if(session != focused)
+      return;
+    closeDaemonWindow();
+    dashboard->show();
+  });
+  sessions.push_back(session);
+  saveDaemons();
+  dashboard->add(session);
+  session->connectToDaemon();
+}
+
+void ConnectionManager::Private::removeDaemon(DaemonSession *session)
+{
+  auto found = find_if(sessions.begin(), sessions.end(), [=](const DaemonSessionPtr &s) { return s.get() == session; });
+  if(found == sessions.end())
+    return;
+  if(session == focused)
+    closeDaemonWindow();
+  dashboard->remove(session);
+  session->disconnectFromDaemon();
+  sessions.erase(found);
+  saveDaemons();
+}
+
+void ConnectionManager::Private::saveDaemons()
+{
+  QStringList addresses;
+  for(auto session: sessions)
+    addresses.push_back(session->address());
+  configuration->set_dashboard_daemons(addresses);
+}
+
+void ConnectionManager::Private::openDaemon(DaemonSession *session)
+{
+  if(session == focused && sessionWindow) {
+    sessionWindow->raise();
+    sessionWindow->activateWindow();
+    return;
+  }
+  closeDaemonWindow();
+  focused = session;
+  session->setFocused(true, parameters());
+  auto imageHandlers = make_shared<ImageHandlers>();
+  sessionImager = make_shared<PlanetaryImager>(session->driver(), imageHandlers, make_shared<RemoteSaveImages>(session->dispatcher()), session->configuration());
+  sessionWindow = new PlanetaryImagerMainWindow{sessionImager, imageHandlers, make_shared<RemoteFilesystemBrowser>(session->dispatcher()),
+    make_shared<RemoteMetricsSource>(session->dispatcher()), make_shared<RemoteFocusSource>(session->dispatcher())};
+  sessionHistogram = make_unique<RemoteHistogram>(session->dispatcher());
+  connect(sessionHistogram.get(), &RemoteHistogram::histogram, sessionWindow, [histogram = sessionWindow->histogram()](const QList<HistogramSummary> &channels) {
+    histogram->received(channels);
+  }, Qt::DirectConnection);
+  sessionWindow->show();
+  if(auto running_camera = session->driver()->existing_running_camera())
+    sessionWindow->connectCamera(running_camera);
+  // Quitting the main window only leaves the daemon: it's still on the dashboard
+  connect(sessionWindow, &PlanetaryImagerMainWindow::quit, q, [this] {
+    if(! sessionWindow)
+      return;
+    closeDaemonWindow();
+    dashboard->show();
+  });
+}
+
+void ConnectionManager::Private::closeDaemonWindow()
+{
+  if(! focused)
+    return;
+  auto window = sessionWindow;
+  auto session = focused;
+  sessionWindow = nullptr;
+  focused = nullptr;
+  // Leaving the window is not stopping the capture: the daemon might be recording on its own
+  if(auto imager = qobject_cast<RemoteImager*>(sessionImager->imager()))
+    imager->leaveCameraOpen();
+  sessionImager.reset();
+  sessionHistogram.reset();
+  // Closing emits quit again: the window and the session are already taken off above
+  if(window) {
+    window->close();
+    window->deleteLater();
+  }
+  session->setFocused(false);
+}
+
 
 void ConnectionManager::Private::adjustParametersVisibility()
 {
   auto format = this->format();
   ui->compression->setEnabled(format == Configuration::Network_RAW);
-  ui->force8bit->setEnabled(format == Configuration::Network_RAW);
-  ui->jpeg_quality->setEnabled(format == Configuration::Network_JPEG);
-  ui->jpeg_quality_label->setEnabled(format == Configuration::Network_JPEG);
+  ui->force8bit->setEnabled(format == Configuration::Network_RAW || format == Configuration::Network_TileDelta);
+  // For tile deltas, lower quality means small changes in a tile are not sent
+  const bool lossy = format == Configuration::Network_JPEG || format == Configuration::Network_WebP || format == Configuration::Network_TileDelta;
+  ui->jpeg_quality->setEnabled(lossy);
+  ui->jpeg_quality_label->setEnabled(lossy);
 }
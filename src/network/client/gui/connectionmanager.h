@@ -26,7 +26,8 @@ class ConnectionManager : public QDialog
 {
   Q_OBJECT
 public:
-  ConnectionManager();
+  /// auto_configure: the preview format and quality are picked for the link to the daemon, measured on every connection (see AutoTuning)
+  explicit ConnectionManager(bool auto_configure = false);
   ~ConnectionManager();
 private:
   DPTR
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemonsdashboard.h"
+#include <QCloseEvent>
+#include <QFrame>
+#include <QGridLayout>
+#include <QLabel>
+#include <QPixmap>
+#include <QPushButton>
+#include <QScrollArea>
+#include <QToolButton>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "network/client/daemonsession.h"
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/loadshedding.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+namespace {
+  const QSize thumbnail_size{240, 180};
+
+  // Copied, the frame can go away
+  QImage thumbnail_image(const FrameConstPtr &frame) {
+    const bool bayer = frame->channels() == 1 && frame->colorFormat() != Frame::Mono;
+    cv::Mat pixels = bayer ? frame->analysis().debayered_half() : frame->analysis().as_8bit();
+    if(pixels.channels() == 3 && frame->colorFormat() == Frame::BGR) {
+      cv::Mat rgb;
+      cv::cvtColor(pixels, rgb, cv::COLOR_BGR2RGB);
+      pixels = rgb;
+    }
+    if(pixels.empty() || (pixels.channels() != 1 && pixels.channels() != 3))
+      return {};
+    return QImage{pixels.data, pixels.cols, pixels.rows, static_cast<int>(pixels.step), pixels.channels() == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888}.copy();
+  }
+}
+
+DPTR_IMPL(DaemonsDashboard) {
+  DaemonsDashboard *q;
+  struct Tile {
+    DaemonSessionPtr session;
+    QFrame *frame;
+    QLabel *image;
+    QLabel *title;
+    QLabel *status;
+    QPushButton *open;
+  };
+  vector<Tile> tiles;
+  QGridLayout *grid;
+  QLabel *summary;
+  void update(Tile &tile);
+  void update_summary();
+  void layout_tiles();
+  Tile *tile(DaemonSession *session);
+  static QString status(const DaemonSession::Telemetry &telemetry);
+};
+
+DaemonsDashboard::DaemonsDashboard(QWidget *parent) : QWidget{parent}, dptr(this)
+{
+  setWindowTitle(tr("Planetary Imager daemons"));
+  auto layout = new QVBoxLayout(this);
+  d->summary = new QLabel;
+  layout->addWidget(d->summary);
+  auto scroll_area = new QScrollArea;
+  scroll_area->setWidgetResizable(true);
+  auto tiles = new QWidget;
+  d->grid = new QGridLayout(tiles);
+  scroll_area->setWidget(tiles);
+  layout->addWidget(scroll_area);
+  d->update_summary();
+}
+
+DaemonsDashboard::~DaemonsDashboard()
+{
+}
+
+void DaemonsDashboard::add(const DaemonSessionPtr &session)
+{
+  if(d->tile(session.get()))
+    return;
+  Private::Tile tile{session, new QFrame, new QLabel, new QLabel, new QLabel, new QPushButton};
+  tile.frame->setFrameShape(QFrame::StyledPanel);
+  auto layout = new QGridLayout(tile.frame);
+  tile.image->setFixedSize(thumbnail_size);
+  tile.image->setAlignment(Qt::AlignCenter);
+  tile.image->setStyleSheet("background-color: black; color: gray;");
+  tile.status->setWordWrap(true);
+  auto remove = new QToolButton;
+  remove->setIcon(QIcon::fromTheme("list-remove"));
+  remove->setToolTip(tr("Remove from the dashboard"));
+  layout->addWidget(tile.image, 0, 0, 1, 3);
+  layout->addWidget(tile.title, 1, 0, 1, 3);
+  layout->addWidget(tile.status, 2, 0, 1, 3);
+  layout->addWidget(tile.open, 3, 1);
+  layout->addWidget(remove, 3, 2);
+  auto raw_session = session.get();
+  connect(tile.open, &QPushButton::clicked, this, [this, raw_session] {
+    if(raw_session->telemetry().status == NetworkClient::Connected)
+      emit openRequested(raw_session);
+    else
+      raw_session->connectToDaemon();
+  });
+  connect(remove, &QToolButton::clicked, this, [this, raw_session] { emit removeRequested(raw_session); });
+  connect(raw_session, &DaemonSession::telemetryChanged, this, [this, raw_session] {
+    if(auto tile = d->tile(raw_session))
+      d->update(*tile);
+    d->update_summary();
+  });
+  connect(raw_session, &DaemonSession::thumbnail, this, [this, raw_session](const FrameConstPtr &frame) {
+    auto tile = d->tile(raw_session);
+    auto image = thumbnail_image(frame);
+    if(tile && ! image.isNull())
+      tile->image->setPixmap(QPixmap::fromImage(image).scaled(thumbnail_size, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+  });
+  d->tiles.push_back(tile);
+  d->update(d->tiles.back());
+  d->layout_tiles();
+  d->update_summary();
+}
+
+void DaemonsDashboard::remove(DaemonSession *session)
+{
+  auto tile = find_if(d->tiles.begin(), d->tiles.end(), [=](const Private::Tile &tile) { return tile.session.get() == session; });
+  if(tile == d->tiles.end())
+    return;
+  session->disconnect(this);
+  delete tile->frame;
+  d->tiles.erase(tile);
+  d->layout_tiles();
+  d->update_summary();
+}
+
+void DaemonsDashboard::closeEvent(QCloseEvent *event)
+{
+  QWidget::closeEvent(event);
+  emit closed();
+}
+
+DaemonsDashboard::Private::Tile *DaemonsDashboard::Private::tile(DaemonSession *session)
+{
+  auto tile = find_if(tiles.begin(), tiles.end(), [=](const Tile &tile) { return tile.session.get() == session; });
+  return tile == tiles.end() ? nullptr : &*tile;
+}
+
+void DaemonsDashboard::Private::layout_tiles()
+{
+  // Square-ish grid, filled row by row
+  const int columns = max(1, static_cast<int>(ceil(sqrt(tiles.size()))));
+  for(size_t i = 0; i < tiles.size(); i++) {
+    grid->removeWidget(tiles[i].frame);
+    grid->addWidget(tiles[i].frame, i / columns, i % columns);
+  }
+}
+
+QString DaemonsDashboard::Private::status(const DaemonSession::Telemetry &telemetry)
+{
+  switch(telemetry.status) {
+    case NetworkClient::Connecting:
+      return tr("connecting...");
+    case NetworkClient::Disconnected:
+    case NetworkClient::Error:
+      return telemetry.error.isEmpty() ? tr("disconnected") : tr("disconnected: %1") % telemetry.error;
+    default:
+      break;
+  }
+  if(! telemetry.imager_running)
+    return tr("no camera running");
+  QStringList lines{tr("%1 fps") % QString::number(telemetry.capture_fps, 'f', 1)};
+  if(! telemetry.temperature.isNull())
+    lines.back() += tr(", %1 °C") % QString::number(telemetry.temperature.toDouble(), 'f', 1);
+  if(telemetry.recording) {
+    lines.push_back(tr("recording: %1 frames, %2 fps, %3 dropped")
+      % telemetry.saved_frames % QString::number(telemetry.save_fps, 'f', 1) % telemetry.dropped_frames);
+    if(telemetry.load_shedding != LoadShedding::Normal)
+      lines.push_back(tr("writer falling behind"));
+  }
+  return lines.join('\n');
+}
+
+void DaemonsDashboard::Private::update(Tile &tile)
+{
+  const auto telemetry = tile.session->telemetry();
+  const bool connected = telemetry.status == NetworkClient::Connected;
+  tile.title->setText(telemetry.camera.isEmpty() ? tile.session->address() : "%1 - %2"_q % tile.session->address() % telemetry.camera);
+  tile.status->setText(status(telemetry));
+  tile.status->setToolTip(telemetry.recording_file);
+  tile.open->setText(connected ? tr("Open") : tr("Connect"));
+  tile.open->setEnabled(telemetry.status != NetworkClient::Connecting && ! tile.session->focused());
+  if(tile.session->focused())
+    tile.image->setText(tr("open in its own window"));
+  else if(! connected || ! telemetry.imager_running)
+    tile.image->clear();
+}
+
+void DaemonsDashboard::Private::update_summary()
+{
+  int connected = 0, recording = 0;
+  double save_fps = 0;
+  qlonglong dropped = 0;
+  for(const auto &tile: tiles) {
+    const auto telemetry = tile.session->telemetry();
+    connected += telemetry.status == NetworkClient::Connected;
+    recording += telemetry.recording;
+    save_fps += telemetry.save_fps;
+    dropped += telemetry.dropped_frames;
+  }
+  summary->setText(tr("%1 of %2 daemons connected, %3 recording (%4 fps saved, %5 frames dropped)")
+    % connected % static_cast<int>(tiles.size()) % recording % QString::number(save_fps, 'f', 1) % dropped);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DAEMONSDASHBOARD_H
+#define DAEMONSDASHBOARD_H
+
+#include <QWidget>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+
+FWD_PTR(DaemonSession)
+
+/**
+ * Grid of the daemons watched by the frontend: a thumbnail and the telemetry of each one, with totals for all of them.
+ * Sessions are owned by the caller; opening one (focusing it, with a main window) is left to the caller too.
+ */
+class DaemonsDashboard : public QWidget
+{
+  Q_OBJECT
+public:
+  DaemonsDashboard(QWidget *parent = nullptr);
+  ~DaemonsDashboard();
+  void add(const DaemonSessionPtr &session);
+  void remove(DaemonSession *session);
+signals:
+  void openRequested(DaemonSession *session);
+  void removeRequested(DaemonSession *session);
+  void closed();
+protected:
+  void closeEvent(QCloseEvent *event) override;
+private:
+  DPTR
+};
+
+#endif // DAEMONSDASHBOARD_H
@@ -18,10 +18,14 @@
 
 #include "pickdirectory.h"
 #include "network/client/remotefilesystem.h"
+#include "network/protocol/filesystemprotocol.h"
 #include "ui_pickdirectory.h"
 #include <QStandardItem>
 #include <QStandardItemModel>
+#include <QScrollBar>
 #include <QIcon>
+#include <QPointer>
+#include <QTimer>
 
 using namespace std;
 
@@ -32,8 +36,14 @@ DPTR_IMPL(PickDirectory) {
   RemoteFilesystemPtr filesystem;
   PickDirectory *q;
   void browse(const QString &path);
+  void load_more();
   static const int PathRole;
   QString currentPath;
+  // Pages of earlier paths arriving late are dropped
+  quint64 generation = 0;
+  int loaded = 0;
+  int total = 0;
+  bool loading = false;
 };
 
 const int PickDirectory::Private::PathRole = Qt::UserRole +1;
@@ -47,6 +57,17 @@ PickDirectory::PickDirectory(const RemoteFilesystemPtr& filesystem, const QStrin
   connect(d->ui->filesystem, &QListView::doubleClicked, [=](const QModelIndex &index) {
     d->browse(d->model->itemData(index)[Private::PathRole].toString());
   });
+  // Huge directories are loaded a page at a time, as they're scrolled through
+  connect(d->ui->filesystem->verticalScrollBar(), &QScrollBar::valueChanged, this, [=](int value) {
+    auto scrollbar = d->ui->filesystem->verticalScrollBar();
+    if(value >= scrollbar->maximum() - scrollbar->pageStep())
+      d->load_more();
+  });
+  QPointer<PickDirectory> self{this};
+  d->filesystem->onDirectoryChanged([self](const QString &path) {
+    if(self && path == self->d->currentPath)
+      self->d->browse(path);
+  });
   connect(this, &QDialog::accepted, this, [=]{ emit directoryPicked(d->currentPath); });
 }
 
@@ -55,15 +76,45 @@ void PickDirectory::Private::browse(const QString& path)
   currentPath = path;
   ui->path->setText(path);
   model->clear();
-  auto entry = filesystem->entry(path);
-  auto entries = entry->children();
-  for(auto entry: entries) {
-    if(entry->type() == FilesystemEntry::Directory) {
+  generation++;
+  loaded = total = 0;
+  loading = false;
+  load_more();
+}
+
+void PickDirectory::Private::load_more()
+{
+  if(loading || (loaded > 0 && loaded >= total))
+    return;
+  loading = true;
+  RemoteFilesystem::Filter filter;
+  filter.directories_only = true;
+  const auto requested = generation;
+  QPointer<PickDirectory> self{q};
+  filesystem->list(currentPath, filter, loaded, FilesystemProtocol::LISTING_PAGE_SIZE, [self, requested](const RemoteFilesystem::Page &page) {
+    if(! self || self->d->generation != requested)
+      return;
+    auto d = self->d.get();
+    d->loading = false;
+    d->total = page.total;
+    d->loaded += page.entries.size();
+    for(auto entry: page.entries) {
       auto item = new QStandardItem{QIcon(":/resources/folder.png"), entry->name()};
       item->setData(entry->path(), PathRole);
-      model->appendRow(item);
+      d->model->appendRow(item);
     }
-  }
+    if(page.entries.isEmpty())
+      return;
+    // Keep going until the view can scroll, or the directory is over; deferred, as cached pages come back right away
+    QTimer::singleShot(0, self, [self, requested]{
+      if(! self || self->d->generation != requested)
+        return;
+      self->d->ui->filesystem->doItemsLayout();
+      auto scrollbar = self->d->ui->filesystem->verticalScrollBar();
+      if(scrollbar->maximum() - scrollbar->value() <= scrollbar->pageStep())
+        self->d->load_more();
+    });
+  });
 }
 
 
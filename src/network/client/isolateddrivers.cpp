@@ -0,0 +1,326 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "isolateddrivers.h"
+#include "drivers/supporteddrivers.h"
+#include "network/client/networkclient.h"
+#include "network/client/remotedriver.h"
+#include "network/networkdispatcher.h"
+#include "image_handlers/backend/sharedmemoryframes.h"
+#include "commons/messageslogger.h"
+#include "commons/metrics.h"
+#include "Qt/qt_strings_helper.h"
+#include "Qt/qt_functional.h"
+#include <QCoreApplication>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTimer>
+#include <QThread>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QPointer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  const int START_TIMEOUT_MSECS = 10000;
+  const int CONNECT_RETRY_MSECS = 200;
+  const int MAX_RESTART_BACKOFF_MSECS = 30000;
+  // A helper running this long before dying was not crash looping: the next restart is immediate again
+  const int STABLE_RUN_MSECS = 60000;
+  const int SHARED_MEMORY_SLOTS = 4;
+
+  QString helper_program() {
+    const QString next_to_us = QCoreApplication::applicationDirPath() + "/planetary_imager_daemon";
+    return QFileInfo{next_to_us}.isExecutable() ? next_to_us : QString{"planetary_imager_daemon"};
+  }
+
+  /// A helper process running a single driver, and the connection to it
+  class DriverHost : public QObject, public enable_shared_from_this<DriverHost> {
+    Q_OBJECT
+  public:
+    DriverHost(const QString &driver, const QString &drivers_directory);
+    ~DriverHost();
+    QList<CameraPtr> cameras();
+    QList<CameraPtr> remote_cameras();
+    Imager *imager(const QString &camera, const ImageHandlerPtr &image_handler);
+    void stop();
+    Q_INVOKABLE bool start();
+  private:
+    const QString driver;
+    const QString drivers_directory;
+    const QString shared_memory;
+    Metrics::Counter &restarts_metric;
+    unique_ptr<QProcess> process;
+    QElapsedTimer running;
+    NetworkDispatcherPtr dispatcher;
+    NetworkClientPtr client;
+    RemoteDriverPtr remote_driver;
+    QPointer<Imager> current_imager;
+    QMutex mutex;
+    int restarts = 0;
+    bool restart_pending = false;
+    bool stopping = false;
+    bool ensure_started();
+    bool connect_to_helper(int port);
+    void finished(int exit_code, QProcess::ExitStatus exit_status);
+    void kill();
+  };
+
+  class IsolatedCamera : public Camera {
+  public:
+    IsolatedCamera(const QString &name, const shared_ptr<DriverHost> &host) : _name{name}, host{host} {}
+    QString name() const override { return _name; }
+    Imager *imager(const ImageHandlerPtr &imageHandler) const override { return host->imager(_name, imageHandler); }
+  private:
+    const QString _name;
+    const shared_ptr<DriverHost> host;
+  };
+}
+
+DriverHost::DriverHost(const QString &driver, const QString &drivers_directory)
+  : driver{driver},
+    drivers_directory{drivers_directory},
+    shared_memory{"/planetaryimager-%1-%2"_q % QString::number(QCoreApplication::applicationPid()) % driver},
+    restarts_metric{Metrics::instance().counter("driver_host_restarts_total", "Driver helper processes restarted after dying", "driver=\"%1\""_q % driver)}
+{
+}
+
+DriverHost::~DriverHost()
+{
+  stop();
+}
+
+bool DriverHost::ensure_started()
+{
+  bool started = false;
+  // Sources are scanned on pool threads: the helper process and its socket belong to this object thread
+  QMetaObject::invokeMethod(this, "start", QThread::currentThread() == thread() ? Qt::DirectConnection : Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, started));
+  return started;
+}
+
+bool DriverHost::start()
+{
+  if(stopping || restart_pending)
+    return false;
+  if(process && process->state() == QProcess::Running && dispatcher && dispatcher->is_connected())
+    return true;
+  kill();
+  QTcpServer probe;
+  if(! probe.listen(QHostAddress::LocalHost, 0)) {
+    qWarning() << "Unable to find a free port for the" << driver << "helper:" << probe.errorString();
+    return false;
+  }
+  const int port = probe.serverPort();
+  probe.close();
+
+  process = make_unique<QProcess>();
+  process->setProcessChannelMode(QProcess::ForwardedChannels);
+  connect(process.get(), F_PTR(QProcess, finished, int, QProcess::ExitStatus), this, &DriverHost::finished);
+  qDebug() << "Starting helper process for driver" << driver << "on port" << port;
+  process->start(helper_program(), {
+    "--driver-host", driver,
+    "--drivers", drivers_directory,
+    "--shared-memory-frames", shared_memory,
+    "--shared-memory-slots", QString::number(SHARED_MEMORY_SLOTS),
+    "--address", "127.0.0.1",
+    "--port", QString::number(port),
+  });
+  if(! process->waitForStarted(START_TIMEOUT_MSECS)) {
+    qWarning() << "Unable to start the helper process for driver" << driver << ":" << process->errorString();
+    process.reset();
+    return false;
+  }
+  running.start();
+  if(connect_to_helper(port))
+    return true;
+  qWarning() << "Helper process for driver" << driver << "not answering, killing it";
+  // Restarted, backing off, once it's gone
+  process->kill();
+  return false;
+}
+
+bool DriverHost::connect_to_helper(int port)
+{
+  auto new_dispatcher = make_shared<NetworkDispatcher>();
+  auto new_client = make_shared<NetworkClient>(new_dispatcher);
+  auto new_driver = make_shared<RemoteDriver>(new_dispatcher);
+  // Frames come through the shared memory ring: nothing to ask the helper for on the socket
+  const NetworkProtocol::FormatParameters parameters{Configuration::Network_RAW, false, false, 100, {}, {}, 0};
+  QElapsedTimer elapsed;
+  elapsed.start();
+  // The helper starts listening once its event loop is up
+  while(elapsed.elapsed() < START_TIMEOUT_MSECS && process && process->state() == QProcess::Running) {
+    QEventLoop loop;
+    connect(new_client.get(), &NetworkClient::connected, &loop, &QEventLoop::quit);
+    connect(new_client.get(), &NetworkClient::error, &loop, &QEventLoop::quit);
+    connect(process.get(), F_PTR(QProcess, finished, int, QProcess::ExitStatus), &loop, &QEventLoop::quit);
+    new_client->connectToHost("127.0.0.1", port, parameters);
+    loop.exec();
+    if(new_dispatcher->is_connected()) {
+      QMutexLocker lock(&mutex);
+      dispatcher = new_dispatcher;
+      client = new_client;
+      remote_driver = new_driver;
+      return true;
+    }
+    new_client->disconnectFromHost();
+    QThread::msleep(CONNECT_RETRY_MSECS);
+  }
+  return false;
+}
+
+void DriverHost::finished(int exit_code, QProcess::ExitStatus exit_status)
+{
+  if(stopping)
+    return;
+  SharedMemoryFrames::remove(shared_memory);
+  QPointer<Imager> imager;
+  {
+    QMutexLocker lock(&mutex);
+    remote_driver.reset();
+    imager = current_imager;
+  }
+  if(running.isValid() && running.elapsed() > STABLE_RUN_MSECS)
+    restarts = 0;
+  const int backoff = min(MAX_RESTART_BACKOFF_MSECS, restarts == 0 ? 0 : 1000 << min(restarts - 1, 5));
+  restarts++;
+  restarts_metric.add();
+  const QString reason = exit_status == QProcess::CrashExit ? tr("crashed") : tr("exited with code %1") % exit_code;
+  qWarning() << "Helper process for driver" << driver << reason << ", restarting in" << backoff << "ms";
+  MessagesLogger::queue(MessagesLogger::Error, tr("Driver Error"), tr("The %1 driver process %2, and will be restarted. The camera has to be opened again.") % driver % reason);
+  if(imager)
+    emit imager->disconnected();
+  restart_pending = true;
+  QTimer::singleShot(backoff, this, [this]{
+    restart_pending = false;
+    start();
+  });
+}
+
+void DriverHost::kill()
+{
+  if(! process)
+    return;
+  process->disconnect(this);
+  if(process->state() != QProcess::NotRunning) {
+    process->terminate();
+    if(! process->waitForFinished(3000)) {
+      process->kill();
+      process->waitForFinished(3000);
+    }
+  }
+  process.reset();
+  SharedMemoryFrames::remove(shared_memory);
+}
+
+void DriverHost::stop()
+{
+  stopping = true;
+  kill();
+}
+
+QList<CameraPtr> DriverHost::remote_cameras()
+{
+  if(! ensure_started())
+    return {};
+  RemoteDriverPtr driver;
+  {
+    QMutexLocker lock(&mutex);
+    driver = remote_driver;
+  }
+  return driver ? driver->cameras() : QList<CameraPtr>{};
+}
+
+QList<CameraPtr> DriverHost::cameras()
+{
+  QList<CameraPtr> cameras;
+  // By name: the camera found now is still there, the same way, once the helper has been restarted
+  for(auto camera: remote_cameras())
+    cameras.push_back(make_shared<IsolatedCamera>(camera->name(), shared_from_this()));
+  return cameras;
+}
+
+Imager *DriverHost::imager(const QString &camera, const ImageHandlerPtr &image_handler)
+{
+  for(auto remote_camera: remote_cameras()) {
+    if(remote_camera->name() != camera)
+      continue;
+    // Frames go to the image handler straight from the ring, controls go through the RemoteImager
+    auto reader = make_shared<SharedMemoryFramesReader>(shared_memory, image_handler);
+    auto imager = remote_camera->imager(image_handler);
+    connect(imager, &QObject::destroyed, [reader]{});
+    QMutexLocker lock(&mutex);
+    current_imager = imager;
+    return imager;
+  }
+  throw runtime_error(("Camera %1 not found by driver %2"_q % camera % driver).toStdString());
+}
+
+
+DPTR_IMPL(IsolatedDrivers) {
+  unique_ptr<SupportedDrivers> descriptions;
+  QList<shared_ptr<DriverHost>> hosts;
+};
+
+IsolatedDrivers::IsolatedDrivers(const QStringList &driversPath) : dptr(make_unique<SupportedDrivers>(driversPath))
+{
+  // The helpers look for their driver in the same directories (the build one is always added by the command line)
+  const QString drivers_directory = driversPath.value(0);
+  for(auto source: d->descriptions->sources())
+    d->hosts.push_back(make_shared<DriverHost>(source.name, drivers_directory));
+}
+
+IsolatedDrivers::~IsolatedDrivers()
+{
+}
+
+QList<CameraPtr> IsolatedDrivers::cameras() const
+{
+  QList<CameraPtr> cameras;
+  for(auto host: d->hosts)
+    cameras.append(host->cameras());
+  return cameras;
+}
+
+QList<Driver::Source> IsolatedDrivers::sources() const
+{
+  QList<Source> sources;
+  auto descriptions = d->descriptions->sources();
+  for(int index = 0; index < descriptions.size(); index++) {
+    auto source = descriptions[index];
+    auto host = d->hosts[index];
+    source.cameras = [host] { return host->cameras(); };
+    sources.push_back(source);
+  }
+  return sources;
+}
+
+void IsolatedDrivers::aboutToQuit()
+{
+  for(auto host: d->hosts)
+    host->stop();
+}
+
+#include "isolateddrivers.moc"
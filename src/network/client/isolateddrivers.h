@@ -0,0 +1,50 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ISOLATEDDRIVERS_H
+#define ISOLATEDDRIVERS_H
+
+#include "c++/dptr.h"
+#include "drivers/driver.h"
+#include "commons/fwd.h"
+
+FWD_PTR(IsolatedDrivers)
+
+/**
+ * Runs every driver found in the drivers directories in a helper process of its own (planetary_imager_daemon --driver-host),
+ * so that a crashing vendor SDK takes down the helper only. The helper is started when its cameras are first looked for,
+ * and restarted, backing off, whenever it dies: the camera open at that time is disconnected, and has to be opened again.
+ * Controls go through the network protocol over loopback; frames through the helper shared memory ring (see SharedMemoryFrames),
+ * read straight into the image handler given to the imager.
+ */
+class IsolatedDrivers : public Driver
+{
+  Q_OBJECT
+public:
+  IsolatedDrivers(const QStringList &driversPath);
+  ~IsolatedDrivers();
+  QList<CameraPtr> cameras() const override;
+  /// Same sources as SupportedDrivers, from the drivers descriptions: nothing is loaded in this process
+  QList<Source> sources() const override;
+  void aboutToQuit() override;
+private:
+  DPTR
+};
+
+#endif // ISOLATEDDRIVERS_H
@@ -19,11 +19,16 @@
 
 #include "network/client/networkclient.h"
 #include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QUdpSocket>
 #include "network/networkpacket.h"
 #include "network/networkdispatcher.h"
+#include "network/networkreply.h"
 #include "protocol/protocol.h"
 #include "protocol/driverprotocol.h"
+#include "protocol/framecodec.h"
 #include "Qt/qt_functional.h"
+#include <chrono>
+#include <vector>
 
 using namespace std;
 
@@ -32,6 +37,12 @@ DPTR_IMPL(NetworkClient) {
   unique_ptr<QTcpSocket> socket;
   bool imager_is_running = false;
   NetworkPacketPtr helloPacket;
+  NetworkProtocol::FormatParameters parameters{};
+  bool udp_preview = false;
+  bool local_frames = false;
+  QString multicast_group;
+  unique_ptr<QUdpSocket> udp_socket;
+  void open_udp_socket(NetworkProtocol::FormatParameters &parameters);
 };
 
 NetworkClient::NetworkClient(const NetworkDispatcherPtr &dispatcher, QObject *parent)
@@ -43,6 +54,9 @@ NetworkClient::NetworkClient(const NetworkDispatcherPtr &dispatcher, QObject *pa
     qRegisterMetaType<NetworkClient::Status>("NetworkClient::Status");
   }
   d->dispatcher->setSocket(d->socket.get());
+  register_handler(NetworkProtocol::HelloReply, [this](const NetworkPacketPtr &p) {
+    d->dispatcher->setPeerPacketTypes(d->socket.get(), NetworkProtocol::packetTypes(p));
+  });
   connect(d->socket.get(), &QTcpSocket::connected, [this]{
     d->dispatcher->send( d->helloPacket );
     DriverProtocol::setFormatParameters(NetworkProtocol::decodeHello(d->helloPacket));
@@ -67,11 +81,63 @@ NetworkClient::NetworkClient(const NetworkDispatcherPtr &dispatcher, QObject *pa
 
 NetworkClient::~NetworkClient()
 {
+  if(d->udp_socket)
+    d->dispatcher->setDatagramSocket(nullptr);
+}
+
+void NetworkClient::setUdpPreview(bool enabled, const QString &multicast_group)
+{
+  d->udp_preview = enabled;
+  d->multicast_group = multicast_group;
+}
+
+void NetworkClient::setLocalFrames(bool enabled)
+{
+  d->local_frames = enabled;
+}
+
+void NetworkClient::Private::open_udp_socket(NetworkProtocol::FormatParameters &parameters)
+{
+  dispatcher->setDatagramSocket(nullptr);
+  udp_socket.reset();
+  // Shared memory frames don't need the preview datagrams
+  if(! udp_preview || parameters.localFrames)
+    return;
+  QHostAddress group;
+  quint16 port = 0;
+  if(! multicast_group.isEmpty()) {
+    auto address_port = multicast_group.split(':');
+    if(address_port.size() != 2 || ! group.setAddress(address_port[0]) || ! group.isMulticast() || (port = address_port[1].toUShort()) == 0) {
+      qWarning() << "Invalid multicast group" << multicast_group << "(expected address:port), preview frames will come over TCP";
+      return;
+    }
+  }
+  udp_socket = make_unique<QUdpSocket>();
+  if(! udp_socket->bind(QHostAddress::AnyIPv4, port, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)
+    || (! group.isNull() && ! udp_socket->joinMulticastGroup(group))) {
+    qWarning() << "Error opening UDP preview socket:" << udp_socket->errorString() << ", preview frames will come over TCP";
+    udp_socket.reset();
+    return;
+  }
+  // A whole frame arrives as a burst of datagrams: the default buffer would overflow and drop most of them
+  udp_socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, 4 * 1024 * 1024);
+  dispatcher->setDatagramSocket(udp_socket.get());
+  parameters.udpPort = udp_socket->localPort();
+  parameters.udpGroup = group.isNull() ? QString{} : group.toString();
 }
 
 void NetworkClient::connectToHost(const QString& host, int port, const NetworkProtocol::FormatParameters &parameters)
 {
-  d->helloPacket = NetworkProtocol::hello(parameters);
+  auto hello_parameters = parameters;
+#ifdef Q_OS_UNIX
+  hello_parameters.localFrames = d->local_frames && (host == "localhost" || QHostAddress{host}.isLoopback());
+#endif
+  d->open_udp_socket(hello_parameters);
+  // Lets the server pick the codec for the requested format
+  for(auto codec: FrameCodec::available())
+    hello_parameters.codecs.push_back(codec);
+  d->parameters = hello_parameters;
+  d->helloPacket = NetworkProtocol::hello(hello_parameters);
   d->socket->connectToHost(host, port, QTcpSocket::ReadWrite);
   QTimer::singleShot(30000, [=]{
     if(d->socket->state() == QAbstractSocket::ConnectingState) {
@@ -81,7 +147,55 @@ void NetworkClient::connectToHost(const QString& host, int port, const NetworkPr
   });
 }
 
+void NetworkClient::setFormatParameters(const NetworkProtocol::FormatParameters &parameters)
+{
+  auto hello_parameters = parameters;
+  hello_parameters.udpPort = d->parameters.udpPort;
+  hello_parameters.udpGroup = d->parameters.udpGroup;
+  hello_parameters.codecs = d->parameters.codecs;
+  hello_parameters.localFrames = d->parameters.localFrames;
+  if(hello_parameters == d->parameters)
+    return;
+  d->parameters = hello_parameters;
+  // Still connecting: the Hello packet waiting for the connection asks for these instead
+  if(d->helloPacket) {
+    d->helloPacket = NetworkProtocol::hello(hello_parameters);
+    return;
+  }
+  if(d->socket->state() != QAbstractSocket::ConnectedState)
+    return;
+  d->dispatcher->send(NetworkProtocol::hello(hello_parameters));
+  DriverProtocol::setFormatParameters(hello_parameters);
+}
+
+NetworkProtocol::FormatParameters NetworkClient::formatParameters() const
+{
+  return d->parameters;
+}
+
 void NetworkClient::disconnectFromHost()
 {
   d->socket->close();
 }
+
+AutoTuning::Link NetworkClient::probeLink(qint64 bytes)
+{
+  typedef chrono::steady_clock Clock;
+  AutoTuning::Link link;
+  vector<double> round_trips;
+  for(int i = 0; i < 5; i++) {
+    const auto started = Clock::now();
+    if(! request(NetworkProtocol::packetping(), NetworkProtocol::pong)->wait(5000))
+      return link;
+    round_trips.push_back(chrono::duration<double, milli>{Clock::now() - started}.count());
+  }
+  link.rtt = chrono::duration<double, milli>{StorageProbe::percentile(round_trips, 50)};
+  const auto started = Clock::now();
+  auto pong = request(NetworkProtocol::packetping() << QVariant{bytes}, NetworkProtocol::pong)->wait();
+  // Older servers answer with an empty pong
+  if(! pong || pong->payload().size() < bytes)
+    return link;
+  const chrono::duration<double> elapsed = Clock::now() - started - link.rtt;
+  link.bytes_per_second = bytes / max(elapsed.count(), 1e-3);
+  return link;
+}
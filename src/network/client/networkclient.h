@@ -25,6 +25,7 @@
 #include "network/protocol/protocol.h"
 #include "network/networkreceiver.h"
 #include "commons/fwd.h"
+#include "commons/autotuning.h"
 
 FWD_PTR(NetworkDispatcher)
 FWD_PTR(NetworkClient)
@@ -36,6 +37,28 @@ public:
   NetworkClient(const NetworkDispatcherPtr &dispatcher, QObject *parent = nullptr);
   ~NetworkClient();
   enum Status { Connecting, Connected, Disconnected, Error};
+  /**
+   * Asks for preview frames over UDP on the next connection, joining multicast_group ("address:port") if not empty.
+   * Falls back to the TCP stream if the UDP socket can't be set up.
+   */
+  void setUdpPreview(bool enabled, const QString &multicast_group = {});
+  /**
+   * Asks for frames through shared memory on the next connection, when the server is on this host (a loopback address):
+   * full rate and bit depth, without encoding. The server decides, and sends frames over the network otherwise.
+   */
+  void setLocalFrames(bool enabled);
+  /**
+   * Asks for frames in another format on the running connection: the server replaces the subscription of the Hello packet.
+   * The transport (TCP or UDP) and the codecs stay the ones negotiated when connecting.
+   */
+  void setFormatParameters(const NetworkProtocol::FormatParameters &parameters);
+  /// Parameters the frames are asked with, as sent to the server
+  NetworkProtocol::FormatParameters formatParameters() const;
+  /**
+   * Measures the link to the connected server: the median of a few ping round trips, then a pong of bytes from the server.
+   * Runs the event loop until done. An invalid link when the server doesn't answer, or doesn't send pongs of a given size.
+   */
+  AutoTuning::Link probeLink(qint64 bytes = 8 * 1024 * 1024);
 public slots:
   void connectToHost(const QString &host, int port, const NetworkProtocol::FormatParameters &parameters);
   void disconnectFromHost();
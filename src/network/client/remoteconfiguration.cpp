@@ -32,7 +32,9 @@ DPTR_IMPL(RemoteConfiguration) {
   template<typename T> T get(const QString &name) const;
   template<typename T> void set(const QString &name, const T &value);
   void reset(const QString &name);
+  void fetch_snapshot() const;
   QVariantMap values;
+  bool values_complete = false;
 };
 
 RemoteConfiguration::RemoteConfiguration(const NetworkDispatcherPtr& dispatcher) : NetworkReceiver{dispatcher}, dptr(this)
@@ -43,7 +45,23 @@ RemoteConfiguration::RemoteConfiguration(const NetworkDispatcherPtr& dispatcher)
     ConfigurationProtocol::decodeGetReply(packet, name, value);
     d->values[name] = value;
   });
-  register_handler(ConfigurationProtocol::signalSettingsChanged, [this](const NetworkPacketPtr &) {
+  register_handler(ConfigurationProtocol::SnapshotReply, [this](const NetworkPacketPtr &packet) {
+    d->values = ConfigurationProtocol::decodeValues(packet);
+    d->values_complete = true;
+  });
+  register_handler(NetworkProtocol::HelloReply, [this](const NetworkPacketPtr &) {
+    // New connection, possibly to another server: cached values are stale
+    d->values.clear();
+    d->values_complete = false;
+    // Republishes the snapshot, and reloads the settings views, from the new server
+    QTimer::singleShot(10, qApp, [this]{
+      emit settings_changed();
+    });
+  });
+  register_handler(ConfigurationProtocol::signalSettingsChanged, [this](const NetworkPacketPtr &packet) {
+    auto changed = ConfigurationProtocol::decodeValues(packet);
+    for(auto it = changed.begin(); it != changed.end(); it++)
+      d->values[it.key()] = it.value();
     QTimer::singleShot(10, qApp, [this]{
       emit settings_changed();
     });
@@ -53,20 +71,34 @@ RemoteConfiguration::RemoteConfiguration(const NetworkDispatcherPtr& dispatcher)
 RemoteConfiguration::~RemoteConfiguration()
 {
 }
+void RemoteConfiguration::Private::fetch_snapshot() const
+{
+  q->dispatcher()->send(ConfigurationProtocol::packetSnapshot());
+  q->wait_for_processed(ConfigurationProtocol::SnapshotReply);
+}
+
+// Reads are served from the local cache: a single snapshot round trip fills it, and the server pushes changes as they happen
 template<typename T> T RemoteConfiguration::Private::get(const QString &name) const
 {
-  q->dispatcher()->send(ConfigurationProtocol::get(name));
-  q->wait_for_processed(ConfigurationProtocol::GetReply);
+  if(! values_complete)
+    fetch_snapshot();
+  if(! values.contains(name)) {
+    q->dispatcher()->send(ConfigurationProtocol::get(name));
+    q->wait_for_processed(ConfigurationProtocol::GetReply);
+  }
   return values[name].value<T>();
 }
 
 template<typename T> void RemoteConfiguration::Private::set(const QString &name, const T &value)
 {
+  values[name] = QVariant{value};
   q->dispatcher()->send(ConfigurationProtocol::set(name, QVariant{value}));
 }
 
 void RemoteConfiguration::Private::reset(const QString &name)
 {
+  // The default value lives on the server: the next read asks for it, unless it's pushed back first
+  values.remove(name);
   q->dispatcher()->send(ConfigurationProtocol::reset(name));
 }
 
@@ -81,7 +113,75 @@ void RemoteConfiguration::Private::reset(const QString &name)
 #define define_setting_enum(name, type) define_setting_enum_get(name, type)  define_setting_enum_set(name, type) define_setting_reset(name)
 
 define_setting(buffered_output, bool )
+define_setting(direct_io_output, bool )
+define_setting(ser_frames_metadata, bool )
+define_setting(ser_frame_hashes, bool )
+define_setting(ser_segment_max_size, long long )
+define_setting(ser_segment_max_frames, long long )
+define_setting(ser_stripe_directories, QStringList)
+define_setting(recording_sinks, QStringList)
+define_setting(recording_sinks_max_memory_usage, long long)
+define_setting(image_writer_threads, int )
+define_setting(compressed_ser_level, int )
+define_setting(compressed_ser_pack_pixels, bool )
+define_setting_enum(fits_compression, Configuration::FITSCompression)
+define_setting(fits_hcompress_scale, int )
+define_setting(png_compression_level, int )
+define_setting(tiff_compression, bool )
+define_setting(recording_crop_size, int )
+define_setting(recording_keep_best_percent, int )
+define_setting(recording_quality_window, int )
 define_setting(max_memory_usage, long long )
+define_setting_enum(recording_queue_overflow, Configuration::RecordingQueueOverflow)
+define_setting(recording_queue_block_msecs, int)
+define_setting(load_shedding, int)
+define_setting(load_shedding_display_fps, int)
+define_setting(cpu_governor, bool)
+define_setting(cpu_governor_reserve, int)
+define_setting(cpu_governor_priorities, QStringList)
+define_setting(pipeline, QString)
+define_setting(recording_spool_directory, QString)
+define_setting(recording_spool_threshold, int)
+define_setting(recording_spool_max_size, long long)
+define_setting(recording_queue_compression, bool)
+define_setting(recording_queue_compression_threshold, int)
+define_setting(recording_armed, bool)
+define_setting(recording_index, bool)
+define_setting(recording_pretrigger, bool)
+define_setting(pretrigger_seconds, double)
+define_setting(posttrigger_seconds, double)
+define_setting(pretrigger_max_memory_usage, long long)
+define_setting(recording_burst_to_ram, bool)
+define_setting(burst_max_memory_usage, long long)
+define_setting(burst_huge_pages, bool)
+define_setting(burst_lock_memory, bool)
+define_setting(frame_buffers_huge_pages, bool)
+define_setting(frame_buffers_lock_memory, bool)
+define_setting(memory_budget, long long)
+define_setting(flash_detector, bool)
+define_setting(flash_detector_sigma, double)
+define_setting(flash_detector_history, int)
+define_setting(flash_detector_frames, int)
+define_setting(flash_detector_pixels, int)
+define_setting(flash_detector_roi_size, int)
+define_setting(software_bin, int)
+define_setting_enum(software_bin_mode, Configuration::SoftwareBinMode)
+define_setting(software_roi, QRect)
+define_setting(calibration, bool)
+define_setting(calibration_directory, QString)
+define_setting(hot_pixels, bool)
+define_setting(hot_pixels_frames, int)
+define_setting(hot_pixels_sigma, double)
+define_setting(auto_exposure, bool)
+define_setting(auto_exposure_target, double)
+define_setting(auto_exposure_max_exposure, double)
+define_setting(auto_exposure_gain_per_doubling, double)
+define_setting(auto_exposure_roi_size, int)
+define_setting(roi_follow, bool)
+define_setting(roi_follow_margin, double)
+define_setting(focus_assist, bool)
+define_setting_enum(focus_assist_metric, Configuration::FocusMetric)
+define_setting(focus_assist_roi_size, int)
 
 define_setting_enum(recording_limit_type, Configuration::RecordingLimit)
 define_setting(recording_seconds_limit, double )
@@ -96,12 +196,20 @@ define_setting(save_file_suffix, QString )
 
 define_setting_enum(save_format, Configuration::SaveFormat)
 define_setting(video_codec, QString)
+define_setting(ffmpeg_video_codec, QString)
 define_setting(save_json_info_file, bool)
 define_setting(save_info_file, bool)
+define_setting(save_debayered, bool)
+define_setting_enum(save_debayer_algorithm, Configuration::DebayerAlgorithm)
+define_setting_enum(save_depth, Configuration::SaveDepth)
+define_setting(save_depth_black, int)
+define_setting(save_depth_white, int)
+define_setting(save_depth_dither, bool)
 
 define_setting(observer, QString)
 define_setting(telescope, QString)
 
 define_setting(timelapse_mode, bool)
 define_setting(timelapse_msecs, qlonglong)
+define_setting(timelapse_pause_capture, bool)
 define_setting(recording_pause_stops_timer, bool)
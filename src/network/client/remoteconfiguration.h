@@ -34,7 +34,75 @@ public:
   ~RemoteConfiguration();
   
   declare_setting(buffered_output, bool )
+  declare_setting(direct_io_output, bool )
+  declare_setting(ser_frames_metadata, bool )
+  declare_setting(ser_frame_hashes, bool )
+  declare_setting(ser_segment_max_size, long long )
+  declare_setting(ser_segment_max_frames, long long )
+  declare_setting(ser_stripe_directories, QStringList)
+  declare_setting(recording_sinks, QStringList)
+  declare_setting(recording_sinks_max_memory_usage, long long)
+  declare_setting(image_writer_threads, int )
+  declare_setting(compressed_ser_level, int )
+  declare_setting(compressed_ser_pack_pixels, bool )
+  declare_setting(fits_compression, FITSCompression)
+  declare_setting(fits_hcompress_scale, int )
+  declare_setting(png_compression_level, int )
+  declare_setting(tiff_compression, bool )
+  declare_setting(recording_crop_size, int )
+  declare_setting(recording_keep_best_percent, int )
+  declare_setting(recording_quality_window, int )
   declare_setting(max_memory_usage, long long )
+  declare_setting(recording_queue_overflow, RecordingQueueOverflow)
+  declare_setting(recording_queue_block_msecs, int)
+  declare_setting(load_shedding, int)
+  declare_setting(load_shedding_display_fps, int)
+  declare_setting(cpu_governor, bool)
+  declare_setting(cpu_governor_reserve, int)
+  declare_setting(cpu_governor_priorities, QStringList)
+  declare_setting(pipeline, QString)
+  declare_setting(recording_spool_directory, QString)
+  declare_setting(recording_spool_threshold, int)
+  declare_setting(recording_spool_max_size, long long)
+  declare_setting(recording_queue_compression, bool)
+  declare_setting(recording_queue_compression_threshold, int)
+  declare_setting(recording_armed, bool)
+  declare_setting(recording_index, bool)
+  declare_setting(recording_pretrigger, bool)
+  declare_setting(pretrigger_seconds, double)
+  declare_setting(posttrigger_seconds, double)
+  declare_setting(pretrigger_max_memory_usage, long long)
+  declare_setting(recording_burst_to_ram, bool)
+  declare_setting(burst_max_memory_usage, long long)
+  declare_setting(burst_huge_pages, bool)
+  declare_setting(burst_lock_memory, bool)
+  declare_setting(frame_buffers_huge_pages, bool)
+  declare_setting(frame_buffers_lock_memory, bool)
+  declare_setting(memory_budget, long long)
+  declare_setting(flash_detector, bool)
+  declare_setting(flash_detector_sigma, double)
+  declare_setting(flash_detector_history, int)
+  declare_setting(flash_detector_frames, int)
+  declare_setting(flash_detector_pixels, int)
+  declare_setting(flash_detector_roi_size, int)
+  declare_setting(software_bin, int)
+  declare_setting(software_bin_mode, SoftwareBinMode)
+  declare_setting(software_roi, QRect)
+  declare_setting(calibration, bool)
+  declare_setting(calibration_directory, QString)
+  declare_setting(hot_pixels, bool)
+  declare_setting(hot_pixels_frames, int)
+  declare_setting(hot_pixels_sigma, double)
+  declare_setting(auto_exposure, bool)
+  declare_setting(auto_exposure_target, double)
+  declare_setting(auto_exposure_max_exposure, double)
+  declare_setting(auto_exposure_gain_per_doubling, double)
+  declare_setting(auto_exposure_roi_size, int)
+  declare_setting(roi_follow, bool)
+  declare_setting(roi_follow_margin, double)
+  declare_setting(focus_assist, bool)
+  declare_setting(focus_assist_metric, FocusMetric)
+  declare_setting(focus_assist_roi_size, int)
   
   declare_setting(recording_limit_type, RecordingLimit)
   declare_setting(recording_seconds_limit, double )
@@ -49,13 +117,21 @@ public:
   
   declare_setting(save_format, SaveFormat)
   declare_setting(video_codec, QString)
+  declare_setting(ffmpeg_video_codec, QString)
   declare_setting(save_json_info_file, bool)
   declare_setting(save_info_file, bool)
+  declare_setting(save_debayered, bool)
+  declare_setting(save_debayer_algorithm, DebayerAlgorithm)
+  declare_setting(save_depth, SaveDepth)
+  declare_setting(save_depth_black, int)
+  declare_setting(save_depth_white, int)
+  declare_setting(save_depth_dither, bool)
   
   declare_setting(observer, QString)
   declare_setting(telescope, QString)
   declare_setting(timelapse_mode, bool)
   declare_setting(timelapse_msecs, qlonglong)
+  declare_setting(timelapse_pause_capture, bool)
   
   declare_setting(recording_pause_stops_timer, bool)
 private:
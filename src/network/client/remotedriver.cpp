@@ -23,28 +23,39 @@
 #include <QCoreApplication>
 #include "remoteimager.h"
 #include "network/networkpacket.h"
+#include "image_handlers/backend/sharedmemoryframes.h"
 
 using namespace std;
 
 DPTR_IMPL(RemoteDriver) {
   QList<CameraPtr> cameras;
   DriverProtocol::DriverStatus status;
+  // Server on this host: frames come through this shared memory ring instead of the socket (see NetworkClient::setLocalFrames)
+  QString shared_memory_frames;
 };
 
 class RemoteCamera : public Camera {
 public:
-  RemoteCamera(const QString &name, qlonglong address, const NetworkDispatcherPtr &dispatcher) : _name{name}, _address{address}, _dispatcher{dispatcher} {}
+  RemoteCamera(const QString &name, qlonglong address, const NetworkDispatcherPtr &dispatcher, const QString &shared_memory_frames)
+    : _name{name}, _address{address}, _dispatcher{dispatcher}, _shared_memory_frames{shared_memory_frames} {}
   Imager * imager(const ImageHandlerPtr & imageHandler) const override;
   QString name() const override { return _name; }
 private:
   const QString _name;
   const qlonglong _address;
   const NetworkDispatcherPtr _dispatcher;
+  const QString _shared_memory_frames;
 };
 
 Imager * RemoteCamera::imager(const ImageHandlerPtr& imageHandler) const
 {
-  return new RemoteImager{imageHandler, _dispatcher, _address};
+  auto imager = new RemoteImager{imageHandler, _dispatcher, _address};
+  if(! _shared_memory_frames.isEmpty()) {
+    // Frames go to the image handler straight from the ring, as long as the imager lives
+    auto reader = make_shared<SharedMemoryFramesReader>(_shared_memory_frames, imageHandler);
+    QObject::connect(imager, &QObject::destroyed, [reader]{});
+  }
+  return imager;
 }
 
 
@@ -54,11 +65,14 @@ RemoteDriver::RemoteDriver(const NetworkDispatcherPtr &dispatcher) : NetworkRece
   register_handler(DriverProtocol::CameraListReply, [this](const NetworkPacketPtr &packet){
     qDebug() << "Processing cameras: " << packet;
     d->cameras.clear();
-    DriverProtocol::decode(d->cameras, packet, [&](const QString &name, qlonglong address) { return make_shared<RemoteCamera>(name, address, this->dispatcher() ); });
+    DriverProtocol::decode(d->cameras, packet, [&](const QString &name, qlonglong address) { return make_shared<RemoteCamera>(name, address, this->dispatcher(), d->shared_memory_frames); });
   });
   register_handler(NetworkProtocol::HelloReply, [this](const NetworkPacketPtr &p) {
     qDebug() << "hello reply handler";
     d->status = DriverProtocol::decodeStatus(p);
+    d->shared_memory_frames = p->payloadVariant().toMap().value("sharedMemoryFrames").toString();
+    if(! d->shared_memory_frames.isEmpty())
+      qDebug() << "Frames from the server through shared memory:" << d->shared_memory_frames;
   });
 }
 
@@ -78,7 +92,7 @@ CameraPtr RemoteDriver::existing_running_camera() const
 {
   if(! d->status.imager_running)
     return {};
-  return make_shared<RemoteCamera>(QString{}, -1l, dispatcher());
+  return make_shared<RemoteCamera>(QString{}, -1l, dispatcher(), d->shared_memory_frames);
 }
 
 
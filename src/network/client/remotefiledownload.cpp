@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/client/remotefiledownload.h"
+#include "network/protocol/filesystemprotocol.h"
+#include "network/networkpacket.h"
+#include "network/networkreply.h"
+#include <QFile>
+#include <QTimer>
+#include <QQueue>
+#include <QPair>
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+// Chunks requested at once: enough to keep the link busy while the previous ones are written
+#define DOWNLOAD_PIPELINE 4
+#define DOWNLOAD_CHUNK_SIZE (1024 * 1024)
+#define DOWNLOAD_TIMEOUT_MS 30000
+#define TAIL_POLL_MS 1000
+
+DPTR_IMPL(RemoteFileDownload) {
+  RemoteFileDownload *q;
+  const QString remote_path;
+  const QString local_path;
+  const bool tail;
+  QFile file;
+  QQueue<QPair<qint64, NetworkReplyPtr>> pending;
+  qint64 requested = 0;
+  qint64 downloaded = 0;
+  qint64 total = 0;
+  bool running = false;
+  QTimer timeout;
+  void request_more();
+  void consume();
+  void fail(const QString &error);
+  void stop();
+};
+
+RemoteFileDownload::RemoteFileDownload(const NetworkDispatcherPtr& dispatcher, const QString& remote_path, const QString& local_path, bool tail, QObject* parent)
+  : QObject{parent}, NetworkReceiver{dispatcher}, dptr(this, remote_path, local_path, tail)
+{
+  d->file.setFileName(local_path);
+  d->timeout.setSingleShot(true);
+  d->timeout.setInterval(DOWNLOAD_TIMEOUT_MS);
+  connect(&d->timeout, &QTimer::timeout, this, [this]{ d->fail(tr("Timeout downloading %1").arg(d->remote_path)); });
+}
+
+RemoteFileDownload::~RemoteFileDownload()
+{
+}
+
+qint64 RemoteFileDownload::received() const
+{
+  return d->downloaded;
+}
+
+qint64 RemoteFileDownload::total() const
+{
+  return d->total;
+}
+
+void RemoteFileDownload::start()
+{
+  if(d->running)
+    return;
+  // Resumed from whatever was already downloaded
+  if(! d->file.open(QIODevice::ReadWrite)) {
+    emit failed(d->file.errorString());
+    return;
+  }
+  d->file.seek(d->file.size());
+  d->requested = d->downloaded = d->file.pos();
+  d->running = true;
+  d->request_more();
+}
+
+void RemoteFileDownload::cancel()
+{
+  d->stop();
+}
+
+void RemoteFileDownload::Private::stop()
+{
+  running = false;
+  pending.clear();
+  timeout.stop();
+  file.close();
+}
+
+void RemoteFileDownload::Private::fail(const QString& error)
+{
+  if(! running)
+    return;
+  stop();
+  emit q->failed(error);
+}
+
+void RemoteFileDownload::Private::request_more()
+{
+  // Until the first reply the size is unknown: a single chunk is requested
+  while(running && pending.size() < DOWNLOAD_PIPELINE && (pending.isEmpty() || requested < total)) {
+    auto reply = q->request(FilesystemProtocol::readFile(remote_path, requested, DOWNLOAD_CHUNK_SIZE), FilesystemProtocol::ReadFileReply);
+    pending.enqueue({requested, reply});
+    requested += DOWNLOAD_CHUNK_SIZE;
+    reply->then([this](const NetworkPacketPtr &) { consume(); });
+  }
+  if(running)
+    timeout.start();
+}
+
+void RemoteFileDownload::Private::consume()
+{
+  bool consumed = false;
+  // Replies come back in order, but are consumed strictly in request order anyway
+  while(running && ! pending.isEmpty() && pending.head().second->is_finished()) {
+    auto expected_offset = pending.head().first;
+    auto packet = pending.dequeue().second->packet();
+    consumed = true;
+    if(! packet)
+      return fail(tr("Connection lost downloading %1").arg(remote_path));
+    auto chunk = FilesystemProtocol::decodeReadFileReply(packet);
+    if(chunk.flags & FilesystemProtocol::FileChunk::Error)
+      return fail(QString::fromUtf8(chunk.data));
+    if(static_cast<qint64>(chunk.offset) != expected_offset || static_cast<qint64>(chunk.offset) != file.pos())
+      return fail(tr("Unexpected chunk at offset %1 downloading %2").arg(chunk.offset).arg(remote_path));
+    if(FilesystemProtocol::crc32(chunk.data.constData(), chunk.data.size()) != chunk.crc32)
+      return fail(tr("Checksum mismatch at offset %1 downloading %2").arg(chunk.offset).arg(remote_path));
+    if(file.write(chunk.data) != chunk.data.size())
+      return fail(file.errorString());
+    total = chunk.file_size;
+    downloaded = file.pos();
+    emit q->progress(downloaded, total);
+    if(! (chunk.flags & FilesystemProtocol::FileChunk::EndOfFile))
+      continue;
+    // Requests past the end of the file get empty chunks: start over from here, now or once it grew
+    pending.clear();
+    requested = file.pos();
+    if(tail && (chunk.flags & FilesystemProtocol::FileChunk::Growing)) {
+      timeout.stop();
+      QTimer::singleShot(TAIL_POLL_MS, q, [this]{ request_more(); });
+    } else {
+      stop();
+      emit q->finished();
+    }
+    return;
+  }
+  // Replies to requests dropped at the end of the file don't trigger new requests
+  if(consumed)
+    request_more();
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REMOTEFILEDOWNLOAD_H
+#define REMOTEFILEDOWNLOAD_H
+
+#include <QObject>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(NetworkDispatcher)
+FWD_PTR(RemoteFileDownload)
+
+/**
+ * Downloads a file from the server save directory, in checksummed chunks with a few requests in flight.
+ * Downloads resume from the size of an existing local file.
+ * With tail, a file still being written (i.e. the current recording) is followed until the server stops reporting it as growing.
+ */
+class RemoteFileDownload : public QObject, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  RemoteFileDownload(const NetworkDispatcherPtr &dispatcher, const QString &remote_path, const QString &local_path, bool tail = false, QObject *parent = nullptr);
+  ~RemoteFileDownload();
+  qint64 received() const;
+  /// Size of the remote file, as of the latest chunk (0 until the first one arrives)
+  qint64 total() const;
+public slots:
+  void start();
+  void cancel();
+signals:
+  void progress(qint64 received, qint64 total);
+  void finished();
+  void failed(const QString &error);
+private:
+  DPTR
+};
+
+#endif // REMOTEFILEDOWNLOAD_H
@@ -22,6 +22,9 @@
 #include "commons/utils.h"
 #include "network/networkdispatcher.h"
 #include "network/networkpacket.h"
+#include "network/networkreply.h"
+#include <QHash>
+#include "Qt/qt_strings_helper.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -104,6 +107,10 @@ DPTR_IMPL(RemoteFilesystem) {
   FilesystemEntry::List last_list;
   void fileInfoReply(const NetworkPacketPtr &p);
   void childrenReply(const NetworkPacketPtr &p);
+  /// Cached pages, by path, then by filter, offset and limit
+  QHash<QString, QHash<QString, Page>> pages;
+  QList<OnChanged> on_changed;
+  void directoryChanged(const NetworkPacketPtr &p);
 };
 
 
@@ -111,6 +118,7 @@ RemoteFilesystem::RemoteFilesystem(const NetworkDispatcherPtr& dispatcher) : Net
 {
   register_handler(FilesystemProtocol::FileInfoReply, bind(&Private::fileInfoReply, d.get(), _1));
   register_handler(FilesystemProtocol::ChildrenReply, bind(&Private::childrenReply, d.get(), _1));
+  register_handler(FilesystemProtocol::signalDirectoryChanged, bind(&Private::directoryChanged, d.get(), _1));
 }
 
 RemoteFilesystem::~RemoteFilesystem()
@@ -134,6 +142,54 @@ FilesystemEntry::List RemoteFilesystem::entries(const QString& parent_path)
   return d->last_list;
 }
 
+void RemoteFilesystem::list(const QString &parent_path, const Filter &filter, int offset, int limit, const OnPage &on_page)
+{
+  const auto key = "%1\n%2\n%3\n%4"_q % (filter.directories_only ? "directories" : "all") % filter.patterns.join('\n') % offset % limit;
+  const auto cached_pages = d->pages.value(parent_path);
+  const auto cached = cached_pages.constFind(key);
+  if(cached != cached_pages.constEnd()) {
+    on_page(*cached);
+    return;
+  }
+  FilesystemProtocol::Listing listing;
+  listing.path = parent_path;
+  listing.directories_only = filter.directories_only;
+  listing.patterns = filter.patterns;
+  listing.offset = offset;
+  listing.limit = limit;
+  auto self = shared_from_this();
+  request(FilesystemProtocol::listDirectory(listing), FilesystemProtocol::ListDirectoryReply)->then([self, parent_path, key, on_page](const NetworkPacketPtr &packet) {
+    if(! packet)
+      return;
+    Page page;
+    const auto reply = FilesystemProtocol::decodeListDirectoryReply(packet, bind(&Private::entry, self->d.get(), [&](const FilesystemEntryPtr &e){ page.entries.push_back(e); }, _1, _2, _3, _4));
+    page.offset = reply.offset;
+    page.total = reply.total;
+    self->d->pages[parent_path][key] = page;
+    on_page(page);
+  });
+}
+
+void RemoteFilesystem::onDirectoryChanged(const OnChanged &changed)
+{
+  d->on_changed.push_back(changed);
+}
+
+void RemoteFilesystem::Private::directoryChanged(const NetworkPacketPtr &p)
+{
+  const auto path = FilesystemProtocol::decodeDirectoryChanged(p);
+  // The server reports canonical paths: drop both, in case pages were asked for by another spelling
+  pages.remove(path);
+  for(auto it = pages.begin(); it != pages.end();) {
+    if(QDir{it.key()}.absolutePath() == path)
+      it = pages.erase(it);
+    else
+      ++it;
+  }
+  for(const auto &changed: on_changed)
+    changed(path);
+}
+
 void RemoteFilesystem::Private::entry(OnEntry onEntry, const QString& name, const QString& path, bool isFile, bool isDir)
 {
   onEntry(make_shared<FilesystemEntry>(name, path, isDir ? FilesystemEntry::Directory : FilesystemEntry::File, q->shared_from_this()));
@@ -21,6 +21,7 @@
 
 #include "c++/dptr.h"
 #include <QList>
+#include <QStringList>
 #include "commons/fwd.h"
 #include "network/networkreceiver.h"
 
@@ -53,6 +54,27 @@ public:
   
   FilesystemEntryPtr entry(const QString &path);
   FilesystemEntry::List entries(const QString &parent_path);
+
+  struct Filter {
+    bool directories_only = false;
+    /// Wildcards for file names (i.e. *.ser), see FilesystemProtocol::Listing
+    QStringList patterns;
+  };
+  struct Page {
+    FilesystemEntry::List entries;
+    int offset = 0;
+    /// Entries matching the filter in the whole directory
+    int total = 0;
+  };
+  typedef std::function<void(const Page &)> OnPage;
+  /**
+   * Lists limit entries of parent_path from offset, without blocking: on_page runs once the page arrives, or right away if it's cached.
+   * Pages stay cached until the server reports a change in the directory; on_page doesn't run if the request fails.
+   */
+  void list(const QString &parent_path, const Filter &filter, int offset, int limit, const OnPage &on_page);
+  typedef std::function<void(const QString &path)> OnChanged;
+  /// changed runs when a directory listed before changes on the server, after its cached pages are dropped
+  void onDirectoryChanged(const OnChanged &changed);
 private:
   DPTR
 };
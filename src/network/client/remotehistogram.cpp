@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/client/remotehistogram.h"
+#include "network/protocol/histogramprotocol.h"
+#include "network/networkdispatcher.h"
+
+using namespace std;
+
+RemoteHistogram::RemoteHistogram(const NetworkDispatcherPtr &dispatcher) : NetworkReceiver{dispatcher}
+{
+  register_handler(HistogramProtocol::signalHistogram, [this](const NetworkPacketPtr &packet) {
+    const auto channels = HistogramProtocol::decodeHistogram(packet);
+    if(! channels.isEmpty())
+      emit histogram(channels);
+  });
+  dispatcher->queue_send(HistogramProtocol::setHistogramEnabled(true));
+}
+
+RemoteHistogram::~RemoteHistogram()
+{
+  if(dispatcher()->is_connected())
+    dispatcher()->queue_send(HistogramProtocol::setHistogramEnabled(false));
+}
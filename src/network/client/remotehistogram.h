@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REMOTEHISTOGRAM_H
+#define REMOTEHISTOGRAM_H
+
+#include <QObject>
+#include <QList>
+#include "commons/fwd.h"
+#include "commons/histogramsummary.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(NetworkDispatcher)
+
+/// Histograms of the server raw frames (see HistogramForwarder), asked for as long as this lives: meant for Histogram::received
+class RemoteHistogram : public QObject, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  RemoteHistogram(const NetworkDispatcherPtr &dispatcher);
+  ~RemoteHistogram();
+signals:
+  /// Emitted from the packet handler: connect directly, Histogram::received is thread safe
+  void histogram(const QList<HistogramSummary> &channels);
+};
+
+#endif // REMOTEHISTOGRAM_H
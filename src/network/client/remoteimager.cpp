@@ -18,12 +18,18 @@
  */
 
 #include "remoteimager.h"
+#include "framehistory.h"
 #include "network/protocol/driverprotocol.h"
 #include "network/networkdispatcher.h"
 #include <QDebug>
 #include <QtConcurrent/QtConcurrent>
+#include <QThreadPool>
 #include "network/networkpacket.h"
+#include "network/networkreply.h"
 #include "image_handlers/imagehandler.h"
+#include "commons/framepool.h"
+#include "commons/metrics.h"
+#include <QMutex>
 
 using namespace std;
 
@@ -33,8 +39,53 @@ DPTR_IMPL(RemoteImager) {
   Properties properties;
   Controls controls;
   bool live_was_started = true;
+  bool close_camera = true;
+  FramePoolPtr frames_pool = std::make_shared<FramePool>();
+  NetworkReplyPtr prefetched_controls;
+  DriverProtocol::FrameDecoders decoders;
+  const FrameHistoryPtr history = make_shared<FrameHistory>();
+  // Depth 1 mailbox for the self contained frames: a newer one makes the one still waiting for the decoder obsolete
+  QMutex mailbox_mutex;
+  NetworkPacketPtr mailbox;
+  bool draining = false;
+  Metrics::Counter &superseded_metric = Metrics::instance().counter("remote_frames_superseded_total", "Remote frames dropped undecoded, replaced by a newer one");
+  void post(const NetworkPacketPtr &packet);
+  void drain();
+  // A single thread decodes all frames, so they're handled in order; coded frames can depend on the previous ones, and are never dropped.
+  // Last member, so it's done before the rest goes away.
+  unique_ptr<QThreadPool> decoder_thread;
 };
 
+void RemoteImager::Private::post(const NetworkPacketPtr &packet)
+{
+  QMutexLocker lock{&mailbox_mutex};
+  if(mailbox)
+    superseded_metric.add();
+  mailbox = packet;
+  if(draining)
+    return;
+  draining = true;
+  QtConcurrent::run(decoder_thread.get(), [this] { drain(); });
+}
+
+void RemoteImager::Private::drain()
+{
+  while(true) {
+    NetworkPacketPtr packet;
+    {
+      QMutexLocker lock{&mailbox_mutex};
+      packet.swap(mailbox);
+      if(! packet) {
+        draining = false;
+        return;
+      }
+    }
+    auto frame = DriverProtocol::decodeFrame(packet);
+    if(frame)
+      image_handler->handle(frame);
+  }
+}
+
 RemoteImager::RemoteImager(const ImageHandlerPtr& image_handler, const NetworkDispatcherPtr &dispatcher, qlonglong id) : Imager{image_handler}, NetworkReceiver{dispatcher}, dptr(image_handler)
 {
   register_handler(DriverProtocol::signalCameraConnected, [](const NetworkPacketPtr &) {});
@@ -49,32 +100,47 @@ RemoteImager::RemoteImager(const ImageHandlerPtr& image_handler, const NetworkDi
   });
   register_handler(DriverProtocol::SendFrame, [this](const NetworkPacketPtr &packet) {
     //qDebug() << "Got frame";
-    QtConcurrent::run([=] {
-      auto frame = DriverProtocol::decodeFrame(packet);
-      d->image_handler->handle(frame);
-    });
+    this->dispatcher()->queue_send(DriverProtocol::packetFrameReceived());
+    d->history->add(packet);
+    d->post(packet);
   });
-  register_handler(DriverProtocol::signalFPS, [this](const NetworkPacketPtr &packet) {
-    emit fps(packet->payloadVariant().toDouble());
+  dispatcher->setBodySink(DriverProtocol::SendRawFrame, DriverProtocol::rawFrameSink(d->frames_pool));
+  register_handler(DriverProtocol::SendRawFrame, [this](const NetworkPacketPtr &packet) {
+    this->dispatcher()->queue_send(DriverProtocol::packetFrameReceived());
+    d->post(packet);
   });
-  register_handler(DriverProtocol::signalTemperature, [this](const NetworkPacketPtr &packet) {
-    emit temperature(packet->payloadVariant().toDouble());
+  d->decoder_thread = make_unique<QThreadPool>();
+  d->decoder_thread->setMaxThreadCount(1);
+  register_handler(DriverProtocol::SendCodedFrame, [this](const NetworkPacketPtr &packet) {
+    this->dispatcher()->queue_send(DriverProtocol::packetFrameReceived());
+    d->history->add(packet);
+    QtConcurrent::run(d->decoder_thread.get(), [=] {
+      auto frame = DriverProtocol::decodeCodedFrame(packet, d->decoders, d->frames_pool);
+      if(frame)
+        d->image_handler->handle(frame);
+    });
   });
-  register_handler(DriverProtocol::signalDisconnected, [this](const NetworkPacketPtr &) { emit disconnected(); });
-  register_handler(DriverProtocol::signalControlChanged, [this](const NetworkPacketPtr &packet) {
-    auto control = DriverProtocol::decodeControl(packet) ;
-    emit changed( control );
+  register_handler(DriverProtocol::signalImagerChanges, [this](const NetworkPacketPtr &packet) {
+    auto changes = DriverProtocol::decodeImagerChanges(packet, d->controls);
+    if(! changes.fps.isNull())
+      emit fps(changes.fps.toDouble());
+    if(! changes.temperature.isNull())
+      emit temperature(changes.temperature.toDouble());
+    for(auto control: changes.controls)
+      emit changed(control);
   });
+  register_handler(DriverProtocol::signalDisconnected, [this](const NetworkPacketPtr &) { emit disconnected(); });
 
   if(id != -1) {
-    dispatcher->queue_send( DriverProtocol::packetConnectCamera() << id );
-    wait_for_processed(DriverProtocol::signalCameraConnected);
+    // The camera opens asynchronously on the server, which then broadcasts the signal
+    request(DriverProtocol::packetConnectCamera() << id, DriverProtocol::signalCameraConnected)->wait();
     d->live_was_started = false;
   }
-  dispatcher->queue_send(DriverProtocol::packetGetCameraName() );
-  wait_for_processed(DriverProtocol::GetCameraNameReply);
-  dispatcher->queue_send(DriverProtocol::packetGetProperties() );
-  wait_for_processed(DriverProtocol::GetPropertiesReply);
+  // Pipelined: a single round trip for all of them. Controls are asked for right away, the first controls() call will pick them up.
+  auto name = request(DriverProtocol::packetGetCameraName(), DriverProtocol::GetCameraNameReply);
+  auto properties = request(DriverProtocol::packetGetProperties(), DriverProtocol::GetPropertiesReply);
+  d->prefetched_controls = request(DriverProtocol::packetGetControls(), DriverProtocol::GetControlsReply);
+  NetworkReply::wait_all({name, properties});
 }
 
 #define LOG_TO_IMPLEMENT qDebug() << "***** TODO: implement " << __PRETTY_FUNCTION__;
@@ -82,15 +148,26 @@ RemoteImager::RemoteImager(const ImageHandlerPtr& image_handler, const NetworkDi
 
 RemoteImager::~RemoteImager()
 {
-  dispatcher()->queue_send(DriverProtocol::packetCloseCamera());
+  dispatcher()->removeBodySink(DriverProtocol::SendRawFrame);
+  if(d->close_camera)
+    dispatcher()->queue_send(DriverProtocol::packetCloseCamera());
+}
+
+void RemoteImager::leaveCameraOpen()
+{
+  d->close_camera = false;
+}
+
+FrameHistoryPtr RemoteImager::frameHistory() const
+{
+  return d->history;
 }
 
 
 void RemoteImager::startLive()
 {
   if(!d->live_was_started) { // TODO: fix the liveStarted: should be read from camera instead, and agreed in mainWindow
-    dispatcher()->queue_send(DriverProtocol::packetStartLive());
-    wait_for_processed(DriverProtocol::StartLiveReply);
+    request(DriverProtocol::packetStartLive(), DriverProtocol::StartLiveReply)->wait();
   }
 }
 
@@ -100,8 +177,9 @@ void RemoteImager::clearROI()
 }
 
 Imager::Controls RemoteImager::controls() const {
-  dispatcher()->queue_send(DriverProtocol::packetGetControls() );
-  wait_for_processed(DriverProtocol::GetControlsReply);
+  auto reply = d->prefetched_controls ? d->prefetched_controls : request(DriverProtocol::packetGetControls(), DriverProtocol::GetControlsReply);
+  d->prefetched_controls.reset();
+  reply->wait();
   return d->controls;
 }
 
@@ -120,6 +198,11 @@ void RemoteImager::setControl(const Imager::Control& control)
   dispatcher()->queue_send(DriverProtocol::setControl(control) );
 }
 
+void RemoteImager::setControls(const Imager::Controls& controls)
+{
+  dispatcher()->queue_send(DriverProtocol::setControls(controls) );
+}
+
 void RemoteImager::setROI(const QRect &roi)
 {
   dispatcher()->queue_send(DriverProtocol::packetSetROI() << roi);
@@ -25,6 +25,7 @@
 #include "network/networkreceiver.h"
 
 FWD_PTR(NetworkDispatcher)
+FWD_PTR(FrameHistory)
 
 class RemoteImager : public Imager, public NetworkReceiver
 {
@@ -35,10 +36,15 @@ public:
   Controls controls() const override;  
   QString name() const override;
   Properties properties() const override;
+  /// The server camera keeps running once this imager goes away (i.e. a dashboard viewer leaving), instead of being closed
+  void leaveCameraOpen();
+  /// The last preview frames received, kept compressed for looking back at them
+  FrameHistoryPtr frameHistory() const;
 public slots:
   void setROI(const QRect &roi) override;
   void clearROI() override;
   void setControl(const Imager::Control &control) override;
+  void setControls(const Imager::Controls &controls) override;
   void startLive() override;
 private:
   DPTR
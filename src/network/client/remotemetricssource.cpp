@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/client/remotemetricssource.h"
+#include <QElapsedTimer>
+#include "network/protocol/metricsprotocol.h"
+#include "network/networkreply.h"
+#include "commons/metrics.h"
+
+using namespace std;
+
+DPTR_IMPL(RemoteMetricsSource) {
+  RemoteMetricsSource *q;
+  NetworkReplyPtr pending;
+  QElapsedTimer requested;
+};
+
+// A reply lost with the connection shouldn't stop refreshes for good
+static const qint64 REQUEST_TIMEOUT_MSECS = 5000;
+
+RemoteMetricsSource::RemoteMetricsSource(const NetworkDispatcherPtr &dispatcher) : NetworkReceiver{dispatcher}, dptr(this)
+{
+}
+
+RemoteMetricsSource::~RemoteMetricsSource()
+{
+}
+
+void RemoteMetricsSource::refresh()
+{
+  // One request at a time, so that a slow link doesn't pile them up
+  if(d->pending && ! d->pending->is_finished() && d->requested.elapsed() < REQUEST_TIMEOUT_MSECS)
+    return;
+  d->requested.start();
+  d->pending = request(MetricsProtocol::packetGetMetrics(), MetricsProtocol::GetMetricsReply);
+  d->pending->then([this](const NetworkPacketPtr &packet) {
+    if(! packet)
+      return;
+    auto snapshot = MetricsProtocol::decodeMetricsReply(packet);
+    snapshot.append(Metrics::instance().snapshot());
+    emit metrics(snapshot);
+  });
+}
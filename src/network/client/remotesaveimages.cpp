@@ -19,40 +19,161 @@
 #include "remotesaveimages.h"
 #include "network/protocol/savefileprotocol.h"
 #include "network/networkpacket.h"
+#include "network/protocol/driverprotocol.h"
 #include "network/networkdispatcher.h"
+#include "image_handlers/backend/local_saveimages.h"
+#include "commons/configuration.h"
 
 using namespace std;
 
 DPTR_IMPL(RemoteSaveImages) {
   RemoteSaveImages *q;
+  // Settings of this computer, not the server's ones: record on client writes with the local save directory and format
+  Configuration local_configuration;
+  // Record on client only: writes the frames streamed by the server
+  shared_ptr<LocalSaveImages> local;
+  bool streaming = false;
+  int pending_credits = 0;
+  qint64 local_dropped = 0;
+  qint64 remote_dropped = 0;
+  // Frames the server can send ahead of the ones written here: enough to cover the link latency at high frame rates
+  static const int STREAM_CREDITS = 64;
+  void start_local(Imager *imager);
+  void end_stream();
 };
 
 RemoteSaveImages::RemoteSaveImages(const NetworkDispatcherPtr& dispatcher) : NetworkReceiver{dispatcher}, dptr(this)
 {
-  register_handler(SaveFileProtocol::signalSaveFPS, [this](const NetworkPacketPtr &p) { emit saveFPS(p->payloadVariant().toDouble()); });
-  register_handler(SaveFileProtocol::signalMeanFPS, [this](const NetworkPacketPtr &p) { emit meanFPS(p->payloadVariant().toDouble()); });
-  register_handler(SaveFileProtocol::signalSavedFrames, [this](const NetworkPacketPtr &p) { emit savedFrames(p->payloadVariant().toLongLong()); });
-  register_handler(SaveFileProtocol::signalDroppedFrames, [this](const NetworkPacketPtr &p) { emit droppedFrames(p->payloadVariant().toLongLong()); });
+  register_handler(SaveFileProtocol::signalRecordingStatus, [this](const NetworkPacketPtr &p) {
+    const auto status = p->payloadVariant().toMap();
+    if(status.contains(SaveFileProtocol::SaveFPS))
+      emit saveFPS(status[SaveFileProtocol::SaveFPS].toDouble());
+    if(status.contains(SaveFileProtocol::MeanFPS))
+      emit meanFPS(status[SaveFileProtocol::MeanFPS].toDouble());
+    if(status.contains(SaveFileProtocol::SavedFrames))
+      emit savedFrames(status[SaveFileProtocol::SavedFrames].toLongLong());
+    if(status.contains(SaveFileProtocol::DroppedFrames))
+      emit droppedFrames(status[SaveFileProtocol::DroppedFrames].toLongLong());
+    if(status.contains(SaveFileProtocol::QueueBytes))
+      emit queueUsage(status[SaveFileProtocol::QueueBytes].toLongLong(), status[SaveFileProtocol::QueuePeakBytes].toLongLong(), status[SaveFileProtocol::QueueMaxBytes].toLongLong());
+    if(status.contains(SaveFileProtocol::WriteThroughput))
+      emit writeThroughput(status[SaveFileProtocol::WriteThroughput].toDouble());
+    if(status.contains(SaveFileProtocol::PreTriggerBytes))
+      emit preTriggerBuffer(status[SaveFileProtocol::PreTriggerBytes].toLongLong(), status[SaveFileProtocol::PreTriggerSeconds].toDouble());
+    if(status.contains(SaveFileProtocol::DeferredPendingBytes))
+      emit deferredWrites(status[SaveFileProtocol::DeferredPendingBytes].toLongLong(), status[SaveFileProtocol::DeferredAvailableBytes].toLongLong());
+    if(status.contains(SaveFileProtocol::LoadShedding))
+      emit loadShedding(status[SaveFileProtocol::LoadShedding].toInt());
+  });
   register_handler(SaveFileProtocol::signalRecording, [this](const NetworkPacketPtr &p) { emit recording(p->payloadVariant().toString()); });
   register_handler(SaveFileProtocol::signalFinished, [this](const NetworkPacketPtr &) { emit finished(); });
+  register_handler(SaveFileProtocol::signalStorageProbed, [this](const NetworkPacketPtr &p) {
+    const auto probe = p->payloadVariant().toList();
+    if(probe.size() == 4)
+      emit storageProbed(probe[0].toDouble(), probe[1].toDouble(), probe[2].toDouble(), probe[3].toLongLong());
+  });
   
+  dispatcher->setBodySink(SaveFileProtocol::RecordingStreamFrame, DriverProtocol::rawFrameSink({}));
+  register_handler(SaveFileProtocol::RecordingStreamFrame, [this](const NetworkPacketPtr &packet) {
+    if(! d->streaming)
+      return;
+    if(auto frame = DriverProtocol::decodeRawFrame(packet))
+      d->local->handle(frame);
+    // Credits go back in batches, half the window at a time: the local recording queue takes care of slow disks, and drops honestly
+    if(++d->pending_credits >= Private::STREAM_CREDITS / 2) {
+      dispatcher()->queue_send(SaveFileProtocol::recordingStreamCredits(d->pending_credits));
+      d->pending_credits = 0;
+    }
+  });
+  register_handler(SaveFileProtocol::signalRecordingStreamDropped, [this](const NetworkPacketPtr &packet) {
+    d->remote_dropped = packet->payloadVariant().toLongLong();
+    emit droppedFrames(d->local_dropped + d->remote_dropped);
+  });
 }
 
 RemoteSaveImages::~RemoteSaveImages()
 {
+  d->end_stream();
+  dispatcher()->removeBodySink(SaveFileProtocol::RecordingStreamFrame);
+}
+
+void RemoteSaveImages::Private::start_local(Imager *imager)
+{
+  local = make_shared<LocalSaveImages>(local_configuration);
+  QObject::connect(local.get(), &SaveImages::saveFPS, q, &SaveImages::saveFPS);
+  QObject::connect(local.get(), &SaveImages::meanFPS, q, &SaveImages::meanFPS);
+  QObject::connect(local.get(), &SaveImages::savedFrames, q, &SaveImages::savedFrames);
+  QObject::connect(local.get(), &SaveImages::droppedFrames, q, [this](long frames) {
+    local_dropped = frames;
+    emit q->droppedFrames(local_dropped + remote_dropped);
+  });
+  QObject::connect(local.get(), &SaveImages::queueUsage, q, &SaveImages::queueUsage);
+  QObject::connect(local.get(), &SaveImages::writeThroughput, q, &SaveImages::writeThroughput);
+  QObject::connect(local.get(), &SaveImages::recording, q, &SaveImages::recording);
+  QObject::connect(local.get(), &SaveImages::preTriggerBuffer, q, &SaveImages::preTriggerBuffer);
+  QObject::connect(local.get(), &SaveImages::deferredWrites, q, &SaveImages::deferredWrites);
+  QObject::connect(local.get(), &SaveImages::loadShedding, q, &SaveImages::loadShedding);
+  // Frame or time limits end the recording locally: the server can stop streaming then
+  QObject::connect(local.get(), &SaveImages::finished, q, [this]{
+    end_stream();
+    emit q->finished();
+  });
+  pending_credits = 0;
+  local_dropped = 0;
+  remote_dropped = 0;
+  streaming = true;
+  local->startRecording(imager);
+  q->dispatcher()->queue_send(SaveFileProtocol::startRecordingStream(STREAM_CREDITS));
+}
+
+void RemoteSaveImages::Private::end_stream()
+{
+  if(! streaming)
+    return;
+  streaming = false;
+  q->dispatcher()->queue_send(SaveFileProtocol::packetEndRecordingStream());
 }
 
 void RemoteSaveImages::startRecording(Imager* imager)
 {
+  if(d->local_configuration.record_on_client()) {
+    d->start_local(imager);
+    return;
+  }
+  d->local.reset();
   dispatcher()->queue_send(SaveFileProtocol::packetStartRecording());
 }
 
 void RemoteSaveImages::endRecording()
 {
+  if(d->local) {
+    // Frames still on their way are not waited for: the recording ends when asked, as on the server
+    d->end_stream();
+    d->local->endRecording();
+    return;
+  }
   dispatcher()->queue_send(SaveFileProtocol::packetEndRecording());
 }
 
 void RemoteSaveImages::setPaused(bool paused)
 {
+  if(d->streaming) {
+    d->local->setPaused(paused);
+    return;
+  }
   dispatcher()->queue_send(SaveFileProtocol::setPaused(paused));
 }
+
+void RemoteSaveImages::trigger(const QVariantMap &event)
+{
+  if(d->streaming) {
+    d->local->trigger(event);
+    return;
+  }
+  dispatcher()->queue_send(SaveFileProtocol::packetTrigger() << QVariant{event});
+}
+
+void RemoteSaveImages::probeStorage()
+{
+  dispatcher()->queue_send(SaveFileProtocol::packetProbeStorage());
+}
@@ -26,6 +26,10 @@
 
 FWD_PTR(NetworkDispatcher)
 
+/**
+ * Records on the server, or with record_on_client on this computer: the server then streams every frame as it is (see RecordingStreamForwarder),
+ * and a LocalSaveImages writes them with the local settings. Frames dropped on either side are added up.
+ */
 class RemoteSaveImages : public SaveImages, public NetworkReceiver
 {
 Q_OBJECT
@@ -37,6 +41,11 @@ public slots:
   void startRecording(Imager * imager) override;
   void endRecording() override;
   void setPaused(bool paused) override;
+  void trigger(const QVariantMap &event = {}) override;
+  /// The server disk: record on client recordings are bound by the network link first
+  void probeStorage() override;
+  /// The server arms its own recordings, when its camera connects
+  void armRecording(Imager *) override {}
 private:
 
   void doHandle(FrameConstPtr frame) override { }
@@ -0,0 +1,129 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/framedatagrams.h"
+#include <QVector>
+#include <QtEndian>
+
+using namespace std;
+
+namespace {
+  const char MAGIC[] = {'P', 'I'};
+  const quint8 VERSION = 1;
+  const int MAX_CHUNKS = 0xFFFF;
+  // Datagrams of frames up to this much older than the current one are late arrivals; anything further back means the sender restarted
+  const qint32 REORDER_WINDOW = 64;
+}
+
+DPTR_IMPL(FrameDatagrams) {
+  bool started = false;
+  quint32 sequence = 0;
+  bool complete = false;
+  QByteArray data;
+  QVector<bool> received;
+  int missing = 0;
+  int last_chunk_size = 0;
+  quint64 dropped = 0;
+  void start(quint32 sequence, int chunks);
+};
+
+const int FrameDatagrams::header_size;
+const int FrameDatagrams::max_chunk_size;
+
+FrameDatagrams::FrameDatagrams() : dptr()
+{
+}
+
+FrameDatagrams::~FrameDatagrams()
+{
+}
+
+QList<QByteArray> FrameDatagrams::split(const QByteArray &data, quint32 sequence)
+{
+  const int chunks = max(1, (data.size() + max_chunk_size - 1) / max_chunk_size);
+  if(chunks > MAX_CHUNKS)
+    return {};
+  QList<QByteArray> datagrams;
+  for(int index = 0; index < chunks; index++) {
+    auto chunk = data.mid(index * max_chunk_size, max_chunk_size);
+    QByteArray datagram(header_size + chunk.size(), '\0');
+    auto header = reinterpret_cast<uchar*>(datagram.data());
+    header[0] = MAGIC[0];
+    header[1] = MAGIC[1];
+    header[2] = VERSION;
+    qToBigEndian<quint32>(sequence, header + 4);
+    qToBigEndian<quint16>(index, header + 8);
+    qToBigEndian<quint16>(chunks, header + 10);
+    std::copy(chunk.begin(), chunk.end(), datagram.begin() + header_size);
+    datagrams.push_back(datagram);
+  }
+  return datagrams;
+}
+
+void FrameDatagrams::Private::start(quint32 sequence, int chunks)
+{
+  if(started && ! complete)
+    dropped++;
+  started = true;
+  complete = false;
+  this->sequence = sequence;
+  data.resize(chunks * max_chunk_size);
+  received.fill(false, chunks);
+  missing = chunks;
+  last_chunk_size = 0;
+}
+
+QByteArray FrameDatagrams::add(const QByteArray &datagram)
+{
+  if(datagram.size() < header_size)
+    return {};
+  auto header = reinterpret_cast<const uchar*>(datagram.constData());
+  if(header[0] != MAGIC[0] || header[1] != MAGIC[1] || header[2] != VERSION)
+    return {};
+  const auto sequence = qFromBigEndian<quint32>(header + 4);
+  const int index = qFromBigEndian<quint16>(header + 8);
+  const int chunks = qFromBigEndian<quint16>(header + 10);
+  const int chunk_size = datagram.size() - header_size;
+  if(chunks == 0 || index >= chunks || chunk_size > max_chunk_size || (index < chunks - 1 && chunk_size != max_chunk_size))
+    return {};
+
+  if(! d->started || sequence != d->sequence) {
+    const qint32 age = static_cast<qint32>(d->sequence - sequence);
+    if(d->started && age > 0 && age < REORDER_WINDOW)
+      return {};
+    d->start(sequence, chunks);
+  }
+  if(d->complete || chunks != d->received.size() || d->received[index])
+    return {};
+  d->received[index] = true;
+  std::copy(datagram.begin() + header_size, datagram.end(), d->data.begin() + index * max_chunk_size);
+  if(index == chunks - 1)
+    d->last_chunk_size = chunk_size;
+  if(--d->missing > 0)
+    return {};
+  d->complete = true;
+  auto data = d->data;
+  data.resize((chunks - 1) * max_chunk_size + d->last_chunk_size);
+  return data;
+}
+
+quint64 FrameDatagrams::dropped_frames() const
+{
+  return d->dropped;
+}
@@ -0,0 +1,50 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMEDATAGRAMS_H
+#define FRAMEDATAGRAMS_H
+
+#include <QByteArray>
+#include <QList>
+#include "c++/dptr.h"
+
+/**
+ * Splits an encoded frame packet into sequenced datagrams for the UDP preview stream, and reassembles it on the receiving side.
+ * Lost datagrams are never retransmitted: an incomplete frame is dropped as soon as datagrams of a newer one arrive,
+ * so latency stays bounded on lossy links.
+ * Datagram header, big endian: "PI", version (1 byte), reserved (1 byte), frame sequence (4 bytes), chunk index (2 bytes), chunks count (2 bytes).
+ */
+class FrameDatagrams
+{
+public:
+  static const int header_size = 12;
+  /// Keeps datagrams within a 1500 bytes MTU, including IP and UDP headers
+  static const int max_chunk_size = 1400;
+  FrameDatagrams();
+  ~FrameDatagrams();
+  /// Returns an empty list when data doesn't fit in the maximum number of chunks
+  static QList<QByteArray> split(const QByteArray &data, quint32 sequence);
+  /// Returns the frame data once its last missing datagram arrives, otherwise an empty array
+  QByteArray add(const QByteArray &datagram);
+  quint64 dropped_frames() const;
+private:
+  DPTR
+};
+
+#endif // FRAMEDATAGRAMS_H
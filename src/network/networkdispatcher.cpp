@@ -20,10 +20,17 @@
 #include "networkdispatcher.h"
 #include "networkreceiver.h"
 #include "network/networkpacket.h"
+#include "network/framedatagrams.h"
 #include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QUdpSocket>
+#include <QBuffer>
 #include <QHash>
-#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <atomic>
 #include "commons/utils.h"
+#include "commons/memorygovernor.h"
 #include <QCoreApplication>
 #include "Qt/qt_strings_helper.h"
 #include "commons/definitions.h"
@@ -34,11 +41,38 @@
 using namespace std;
 
 DPTR_IMPL(NetworkDispatcher) {
+  struct Peer {
+    QTcpSocket *socket;
+    NetworkPacketPtr incoming;
+    atomic<qint64> written;
+    atomic<qint64> sent;
+    NetworkPacketTypes::Ids packet_ids;
+  };
+  typedef shared_ptr<Peer> PeerPtr;
   QSet<NetworkReceiver *> receivers;
-  QTcpSocket *socket = nullptr;
-  void readyRead();
-  uint64_t written;
-  uint64_t sent;
+  QHash<NetworkPacketType, QList<NetworkReceiver *>> routes;
+  QHash<quint32, NetworkReceiver *> pending_replies;
+  NetworkPacket::BodySinks body_sinks;
+  mutable QMutex peers_mutex;
+  QHash<QTcpSocket *, PeerPtr> peers;
+  QTcpSocket *current_peer = nullptr;
+  quint32 current_request_id = 0;
+  atomic<quint32> request_ids{0};
+  QUdpSocket *datagram_socket = nullptr;
+  unique_ptr<FrameDatagrams> datagrams;
+  QMutex outgoing_mutex;
+  // nullptr as target: every peer
+  QList<QPair<NetworkPacketPtr, QTcpSocket *>> outgoing;
+  bool send_scheduled = false;
+  uint64_t written = 0;
+  uint64_t sent = 0;
+  // Bytes written into the sockets, and not yet sent: the socket buffers
+  MemoryGovernor::Account &send_buffers = MemoryGovernor::instance().account("network send buffers", MemoryGovernor::Network);
+  void readyRead(const PeerPtr &peer);
+  void readDatagrams();
+  void deliver(const QList<NetworkPacketPtr> &packets, QTcpSocket *sender);
+  void write(const NetworkPacketPtr &packet, const PeerPtr &peer);
+  PeerPtr peer(QTcpSocket *socket) const;
   void debugPacket(const NetworkPacketPtr &packet, const QString &prefix);
 };
 
@@ -55,6 +89,9 @@ NetworkDispatcher::NetworkDispatcher(QObject* parent) : QObject{parent}, dptr()
 
 NetworkDispatcher::~NetworkDispatcher()
 {
+  for(auto peer: d->peers)
+    if(peer->written > peer->sent)
+      d->send_buffers.release(static_cast<size_t>(peer->written - peer->sent));
 }
 
 void NetworkDispatcher::attach(NetworkReceiver* receiver)
@@ -65,62 +102,279 @@ void NetworkDispatcher::attach(NetworkReceiver* receiver)
 void NetworkDispatcher::detach(NetworkReceiver* receiver)
 {
   d->receivers.remove(receiver);
+  for(auto &route: d->routes)
+    route.removeAll(receiver);
+  for(auto it = d->pending_replies.begin(); it != d->pending_replies.end(); ) {
+    if(it.value() == receiver)
+      it = d->pending_replies.erase(it);
+    else
+      ++it;
+  }
+}
+
+void NetworkDispatcher::subscribe(const NetworkPacketType& name, NetworkReceiver* receiver)
+{
+  auto &route = d->routes[name];
+  if(! route.contains(receiver))
+    route.push_back(receiver);
+}
+
+void NetworkDispatcher::expect_reply(quint32 request_id, NetworkReceiver* receiver)
+{
+  d->pending_replies[request_id] = receiver;
 }
 
 void NetworkDispatcher::setSocket(QTcpSocket* socket)
 {
-  //delete d->socket;
-  if(d->socket)
-    d->socket->disconnect(this, 0);
-  d->socket = socket;
-  if(! socket)
-    return;
+  for(auto peer: d->peers.keys())
+    removeSocket(peer);
   d->written = 0;
   d->sent = 0;
+  if(socket)
+    addSocket(socket);
+}
+
+void NetworkDispatcher::addSocket(QTcpSocket* socket)
+{
+  auto peer = make_shared<Private::Peer>();
+  peer->socket = socket;
+  peer->written = 0;
+  peer->sent = 0;
+  {
+    QMutexLocker lock(&d->peers_mutex);
+    d->peers[socket] = peer;
+  }
   connect(socket, &QTcpSocket::bytesWritten, this, [=](qint64 written){
+    d->send_buffers.release(static_cast<size_t>(written));
+    peer->sent += written;
     d->sent += written;
     emit bytes(d->written, d->sent);
   });
-  connect(socket, &QTcpSocket::readyRead, this, bind(&Private::readyRead, d.get()));
+  connect(socket, &QTcpSocket::readyRead, this, bind(&Private::readyRead, d.get(), peer));
+  // The types table belongs to the connection: a reconnected socket starts again with names
+  connect(socket, &QTcpSocket::disconnected, this, [=]{ peer->packet_ids.clear(); });
+}
+
+void NetworkDispatcher::setPeerPacketTypes(QTcpSocket* peer, const QStringList& types)
+{
+  if(auto found = d->peer(peer))
+    found->packet_ids = NetworkPacketTypes::ids(types);
+}
+
+void NetworkDispatcher::removeSocket(QTcpSocket* socket)
+{
+  QMutexLocker lock(&d->peers_mutex);
+  if(auto peer = d->peers.take(socket)) {
+    socket->disconnect(this, 0);
+    // Whatever is still buffered is not ours any more
+    if(peer->written > peer->sent)
+      d->send_buffers.release(static_cast<size_t>(peer->written - peer->sent));
+  }
+}
+
+void NetworkDispatcher::setDatagramSocket(QUdpSocket* socket)
+{
+  if(d->datagram_socket)
+    d->datagram_socket->disconnect(this, 0);
+  d->datagram_socket = socket;
+  d->datagrams = make_unique<FrameDatagrams>();
+  if(socket)
+    connect(socket, &QUdpSocket::readyRead, this, bind(&Private::readDatagrams, d.get()));
+}
+
+NetworkDispatcher::Private::PeerPtr NetworkDispatcher::Private::peer(QTcpSocket* socket) const
+{
+  QMutexLocker lock(&peers_mutex);
+  return peers.value(socket);
+}
+
+QTcpSocket * NetworkDispatcher::current_peer() const
+{
+  return d->current_peer;
+}
+
+quint32 NetworkDispatcher::current_request_id() const
+{
+  return d->current_request_id;
+}
+
+qint64 NetworkDispatcher::backlog(QTcpSocket* peer) const
+{
+  auto found = d->peer(peer);
+  return found ? found->written - found->sent : 0;
 }
 
 void NetworkDispatcher::send(const NetworkPacketPtr &packet) {
-  if(! is_connected() || ! packet)
+  if(! packet)
     return;
   //qDebug() << packet->name();
   d->debugPacket(packet, ">>>");
-  auto written = packet->sendTo(d->socket);
-  d->written += written;
+  for(auto peer: d->peers)
+    d->write(packet, peer);
+}
+
+void NetworkDispatcher::Private::write(const NetworkPacketPtr& packet, const PeerPtr& peer)
+{
+  if(! peer->socket->isValid() || ! peer->socket->isOpen())
+    return;
+  auto written = packet->sendTo(peer->socket, peer->packet_ids);
+  if(written > 0)
+    send_buffers.charge(static_cast<size_t>(written));
+  peer->written += written;
+  this->written += written;
 }
 
 void NetworkDispatcher::queue_send(const NetworkPacketPtr& packet)
 {
-  if(packet)
-    QMetaObject::invokeMethod(this, "send", Q_ARG(NetworkPacketPtr, packet) );
+  queue_send(packet, nullptr);
 }
 
+void NetworkDispatcher::queue_send(const NetworkPacketPtr& packet, QTcpSocket* peer)
+{
+  if(! packet)
+    return;
+  QMutexLocker lock(&d->outgoing_mutex);
+  d->outgoing.push_back({packet, peer});
+  if(! d->send_scheduled) {
+    d->send_scheduled = true;
+    QMetaObject::invokeMethod(this, "send_queued", Qt::QueuedConnection);
+  }
+}
+
+void NetworkDispatcher::reply(const NetworkPacketPtr& packet)
+{
+  if(! packet)
+    return;
+  if(auto peer = d->peer(d->current_peer)) {
+    if(! packet->requestId())
+      packet->setRequestId(d->current_request_id);
+    d->debugPacket(packet, ">>>");
+    d->write(packet, peer);
+  } else {
+    qWarning() << "Reply sent outside of a packet handler, dropped: " << packet->name();
+  }
+}
+
+quint32 NetworkDispatcher::next_request_id()
+{
+  quint32 id;
+  while((id = ++d->request_ids) == 0); // 0 is "no request", skipped on wrap around
+  return id;
+}
+
+void NetworkDispatcher::send_queued()
+{
+  QList<QPair<NetworkPacketPtr, QTcpSocket *>> packets;
+  {
+    QMutexLocker lock(&d->outgoing_mutex);
+    packets.swap(d->outgoing);
+    d->send_scheduled = false;
+  }
+  // Written back to back into the socket buffers, so small control packets share TCP segments
+  for(auto packet: packets) {
+    if(! packet.second) {
+      send(packet.first);
+    } else if(auto peer = d->peer(packet.second)) { // the peer may have disconnected since
+      d->debugPacket(packet.first, ">>>");
+      d->write(packet.first, peer);
+    }
+  }
+}
 
-void NetworkDispatcher::Private::readyRead()
+void NetworkDispatcher::setBodySink(const NetworkPacketType& name, const NetworkPacket::BodySink& sink)
+{
+  d->body_sinks[name] = sink;
+}
+
+void NetworkDispatcher::removeBodySink(const NetworkPacketType& name)
+{
+  d->body_sinks.remove(name);
+}
+
+
+void NetworkDispatcher::Private::readyRead(const PeerPtr &peer)
 {
   QList<NetworkPacketPtr> packets;
-  while(socket->bytesAvailable() > 0) {
-    //qDebug() << socket->bytesAvailable();
+  bool corrupt = false;
+  // Packets can span many readyRead notifications: the partially received one is kept until it's complete
+  try {
+    while(peer->socket->bytesAvailable() > 0) {
+      //qDebug() << socket->bytesAvailable();
+      if(! peer->incoming)
+        peer->incoming = make_shared<NetworkPacket>();
+      if(! peer->incoming->readFrom(peer->socket, body_sinks, NetworkPacketTypes::all()))
+        break;
+      packets.push_back(peer->incoming);
+      //qDebug() << peer->incoming->name();
+      peer->incoming.reset();
+    }
+  } catch(const std::exception &e) {
+    qWarning() << "Invalid data from" << peer->socket->peerAddress().toString() << ":" << e.what() << ", disconnecting";
+    peer->incoming.reset();
+    corrupt = true;
+  }
+  deliver(packets, peer->socket);
+  // Nothing after the bad packet can be parsed anymore
+  if(corrupt)
+    peer->socket->abort();
+}
+
+void NetworkDispatcher::Private::readDatagrams()
+{
+  QList<NetworkPacketPtr> packets;
+  while(datagram_socket->hasPendingDatagrams()) {
+    QByteArray datagram(datagram_socket->pendingDatagramSize(), '\0');
+    if(datagram_socket->readDatagram(datagram.data(), datagram.size()) < 0)
+      break;
+    auto data = datagrams->add(datagram);
+    if(data.isEmpty())
+      continue;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
     auto packet = make_shared<NetworkPacket>();
-    packet->receiveFrom(socket);
-    packets.push_back(packet);
-    //qDebug() << packet->name();
+    try {
+      if(packet->readFrom(&buffer, body_sinks, NetworkPacketTypes::all()))
+        packets.push_back(packet);
+      else
+        qWarning() << "Discarding truncated packet from datagrams";
+    } catch(const std::exception &e) {
+      qWarning() << "Discarding invalid packet from datagrams:" << e.what();
+    }
   }
-  for(auto packet: packets) {
-  debugPacket(packet, "<<<");
+  // Not bound to a peer: replies from their handlers are dropped, and queued packets go to all peers
+  deliver(packets, nullptr);
+}
 
-    for(auto receiver: receivers)
-      receiver->handle(packet);
+void NetworkDispatcher::Private::deliver(const QList<NetworkPacketPtr> &packets, QTcpSocket *sender)
+{
+  // Handlers waiting for replies run nested event loops, and can get here again: restore the outer packet's sender afterwards
+  auto outer_peer = current_peer;
+  auto outer_request_id = current_request_id;
+  for(auto packet: packets) {
+    debugPacket(packet, "<<<");
+    current_peer = sender;
+    current_request_id = packet->requestId();
+    // Copied: handlers can subscribe and detach receivers while the packet is delivered
+    auto targets = routes.value(packet->name());
+    if(auto requester = pending_replies.take(packet->requestId())) {
+      if(! targets.contains(requester))
+        targets.push_back(requester);
+    }
+    for(auto receiver: targets) {
+      if(receivers.contains(receiver))
+        receiver->handle(packet);
+    }
   }
+  current_peer = outer_peer;
+  current_request_id = outer_request_id;
 }
 
 bool NetworkDispatcher::is_connected() const
 {
-  return d->socket && d->socket->isValid() && d->socket->isOpen();
+  for(auto peer: d->peers)
+    if(peer->socket->isValid() && peer->socket->isOpen())
+      return true;
+  return false;
 }
 
 void NetworkDispatcher::Private::debugPacket(const NetworkPacketPtr& packet, const QString& prefix)
@@ -24,12 +24,20 @@
 #include <QObject>
 #include "c++/dptr.h"
 #include "commons/fwd.h"
+#include "network/networkpacket.h"
 
 FWD(NetworkReceiver)
 FWD_PTR(NetworkPacket)
 FWD_PTR(NetworkDispatcher)
 FWD(QTcpSocket)
+FWD(QUdpSocket)
 
+/**
+ * Routes packets between the network receivers and one or more connected peers (sockets).
+ * Clients have a single peer, set with setSocket; the server adds one peer per connected client.
+ * Packets are broadcast to every peer, unless sent with reply() while handling a packet (back to its sender) or to an explicit peer.
+ * Incoming packets are only delivered to the receivers that subscribed to their type, or that are waiting for their request id.
+ */
 class NetworkDispatcher : public QObject
 {
   Q_OBJECT
@@ -38,13 +46,41 @@ public:
   ~NetworkDispatcher();
   void attach(NetworkReceiver *receiver);
   void detach(NetworkReceiver *receiver);
+  /// Delivers packets named 'name' to receiver, until it's detached
+  void subscribe(const NetworkPacketType &name, NetworkReceiver *receiver);
+  /// Delivers the next packet tagged with request_id to receiver, even if it didn't subscribe to its type
+  void expect_reply(quint32 request_id, NetworkReceiver *receiver);
+  /// Replaces all peers with this socket (nullptr: none)
   void setSocket(QTcpSocket *socket);
+  void addSocket(QTcpSocket *socket);
+  void removeSocket(QTcpSocket *socket);
+  /// Types table announced by peer (see NetworkPacketTypes): packets sent to it from now on carry type ids instead of names
+  void setPeerPacketTypes(QTcpSocket *peer, const QStringList &types);
+  /// Packets split into datagrams (see FrameDatagrams) arriving on socket are handled as if they came from the peers (nullptr: none)
+  void setDatagramSocket(QUdpSocket *socket);
+  /// Peer that sent the packet currently being handled (nullptr outside of packet handlers)
+  QTcpSocket *current_peer() const;
+  /// Request id of the packet currently being handled (0: untagged, or outside of packet handlers)
+  quint32 current_request_id() const;
+  /// Thread safe: packets queued before the dispatcher's thread gets to them are written in a single batch
   void queue_send(const NetworkPacketPtr &packet);
+  void queue_send(const NetworkPacketPtr &packet, QTcpSocket *peer);
+  /// Sends packet only to the peer whose packet is being handled, tagged with the same request id. Must be called from a packet handler.
+  void reply(const NetworkPacketPtr &packet);
+  /// New id to correlate a request with its reply, unique for this dispatcher. Thread safe.
+  quint32 next_request_id();
+  /// Bytes written to the peer socket and not yet transmitted. Thread safe.
+  qint64 backlog(QTcpSocket *peer) const;
+  /// Incoming packets named 'name' get their body read straight into the buffers provided by sink
+  void setBodySink(const NetworkPacketType &name, const NetworkPacket::BodySink &sink);
+  void removeBodySink(const NetworkPacketType &name);
   bool is_connected() const;
 public slots:
   void send(const NetworkPacketPtr &packet);
 signals:
   void bytes(quint64 written, quint64 transmitted);
+private slots:
+  void send_queued();
 private:
   DPTR
 };
@@ -22,7 +22,6 @@
 #include <QDataStream>
 #include <QJsonDocument>
 #include "Qt/qt_strings_helper.h"
-#include <QCoreApplication>
 #include <QBuffer>
 
 using namespace std;
@@ -30,12 +29,34 @@ using namespace std;
 DPTR_IMPL(NetworkPacket) {
   NetworkPacketType name;
   QByteArray payload;
+  shared_ptr<const void> body;
+  const char *body_data = nullptr;
+  qint64 body_size = 0;
+  quint32 request_id = 0;
   static const int NAME_BYTES = 1;
   static const int PACKET_BYTES = 4;
-  template<typename T> QByteArray asFixedBytes(T number, int digits) const;
+  static const int REQUEST_ID_BYTES = 4;
+  static const int TYPE_ID_BYTES = 1;
+  static const uint8_t REQUEST_ID_FLAG = 0x80;
+  // Largest payload (body included) accepted from the wire, above a 16 bit RGB frame of the biggest sensors: bigger sizes come from a corrupt or hostile stream
+  static const qint64 MAX_PACKET_BYTES = 512ll * 1024 * 1024;
+  template<typename T> void toFixedBytes(T number, int digits, char *out) const;
   template<typename T> T fromFixedBytes(const QByteArray &bytes) const;
-  
-  QByteArray chunked_read(int bytes, QIODevice *device, int chunk_size = 1024);
+
+  // Incremental receive state: each stage reads 'size' bytes into 'target', possibly across many readyRead calls
+  enum Stage { NameSize, Name, TypeId, RequestId, PayloadSize, SinkHeader, Payload, Body, Done };
+  struct Reception {
+    Stage stage = NameSize;
+    QByteArray field = QByteArray(NAME_BYTES, '\0');
+    char *target = field.data();
+    qint64 size = NAME_BYTES;
+    qint64 done = 0;
+    qint64 data_size = 0;
+    bool has_request_id = false;
+    BodySink sink;
+  } reception;
+  void next_stage(const BodySinks &sinks, const QStringList &types);
+  void expect(char *target, qint64 size, qint64 done = 0);
 };
 
 NetworkPacket::NetworkPacket() : dptr()
@@ -44,20 +65,18 @@ NetworkPacket::NetworkPacket() : dptr()
 
 NetworkPacket::NetworkPacket(const NetworkPacketType& name) : NetworkPacket()
 {
-  if(name.size() > 255) {
-    throw runtime_error(("Packet name must be under 256 characters (was: %1)" % name).toStdString());
+  if(name.size() >= Private::REQUEST_ID_FLAG) {
+    throw runtime_error(("Packet name must be under %1 characters (was: %2)" % static_cast<int>(Private::REQUEST_ID_FLAG) % name).toStdString());
   }
   setName(name);
 }
 
-template<typename T> QByteArray NetworkPacket::Private::asFixedBytes(T number, int digits) const
+template<typename T> void NetworkPacket::Private::toFixedBytes(T number, int digits, char *out) const
 {
-  QByteArray out(digits, '\0');
   for(int i = digits-1; i >=0; i--) {
     out[i] = number % 256;
     number /= 256;
   }
-  return out;
 }
 
 template<typename T> T NetworkPacket::Private::fromFixedBytes(const QByteArray &bytes) const
@@ -78,44 +97,151 @@ NetworkPacket::~NetworkPacket()
 
 
 
-qint64 NetworkPacket::sendTo(QIODevice *device) const
+qint64 NetworkPacket::sendTo(QIODevice *device, const NetworkPacketTypes::Ids &ids) const
 {
-  qint64 wrote = device->write( d->asFixedBytes(d->name.size(), Private::NAME_BYTES));
-  wrote += device->write(d->name.toLatin1());
-  wrote += device->write(d->asFixedBytes(d->payload.size(), Private::PACKET_BYTES));
-  wrote += device->write(d->payload);
-  auto expected = d->name.size() + d->payload.size() + Private::PACKET_BYTES + Private::NAME_BYTES;
+  // Name length, name, request id and payload length go out in a single write, from a stack buffer
+  char preamble[Private::NAME_BYTES + Private::REQUEST_ID_FLAG + Private::REQUEST_ID_BYTES + Private::PACKET_BYTES];
+  const auto request_id_flag = d->request_id ? Private::REQUEST_ID_FLAG : 0;
+  int preamble_size = Private::NAME_BYTES;
+  auto id = ids.find(d->name);
+  if(id != ids.end()) {
+    d->toFixedBytes(request_id_flag, Private::NAME_BYTES, preamble);
+    d->toFixedBytes(id.value(), Private::TYPE_ID_BYTES, preamble + preamble_size);
+    preamble_size += Private::TYPE_ID_BYTES;
+  } else {
+    const auto name = d->name.toLatin1();
+    d->toFixedBytes(name.size() | request_id_flag, Private::NAME_BYTES, preamble);
+    std::copy(name.begin(), name.end(), preamble + preamble_size);
+    preamble_size += name.size();
+  }
+  if(d->request_id) {
+    d->toFixedBytes(d->request_id, Private::REQUEST_ID_BYTES, preamble + preamble_size);
+    preamble_size += Private::REQUEST_ID_BYTES;
+  }
+  d->toFixedBytes(d->payload.size() + d->body_size, Private::PACKET_BYTES, preamble + preamble_size);
+  preamble_size += Private::PACKET_BYTES;
+  qint64 wrote = device->write(preamble, preamble_size);
+  if(! d->payload.isEmpty())
+    wrote += device->write(d->payload);
+  if(d->body_size > 0)
+    wrote += device->write(d->body_data, d->body_size);
+  auto expected = preamble_size + d->payload.size() + d->body_size;
   
   if(wrote != expected)
-    qWarning() << "Wrote " << wrote << "bytes, expected " << d->payload.size();
+    qWarning() << "Wrote " << wrote << "bytes, expected " << expected;
   return wrote;
 }
 
 
-void NetworkPacket::receiveFrom(QIODevice *device)
+bool NetworkPacket::readFrom(QIODevice *device, const BodySinks &sinks, const QStringList &types)
 {
-  auto name_size = d->fromFixedBytes<int>(d->chunked_read(Private::NAME_BYTES, device));
-  auto name = d->chunked_read(name_size, device);
-  d->name = QString::fromLatin1(name);
-  
-  auto data_size = d->fromFixedBytes<int>(d->chunked_read(Private::PACKET_BYTES, device));
-  d->payload = d->chunked_read(data_size, device);
+  auto &r = d->reception;
+  while(r.stage != Private::Done) {
+    if(r.done < r.size) {
+      auto read = device->read(r.target + r.done, r.size - r.done);
+      if(read < 0)
+        throw runtime_error("Error reading network packet");
+      r.done += read;
+      if(r.done < r.size)
+        return false;
+    }
+    d->next_stage(sinks, types);
+  }
+  return true;
 }
 
-QByteArray NetworkPacket::Private::chunked_read(int bytes, QIODevice *device, int chunk_size)
+void NetworkPacket::receiveFrom(QIODevice *device, const BodySinks &sinks, const QStringList &types)
 {
-  QByteArray dest;
-  while(dest.size() < bytes) {
-    auto remaining = bytes - dest.size();
-    auto chunk = std::min(remaining, chunk_size);
-    while(device->bytesAvailable() < chunk)
-      qApp->processEvents();
-    dest.append(device->read(chunk));
+  while(! readFrom(device, sinks, types)) {
+    if(device->bytesAvailable() == 0 && ! device->waitForReadyRead(30000))
+      throw runtime_error("Timeout reading network packet");
   }
-  return dest;
 }
 
+void NetworkPacket::Private::expect(char *target, qint64 size, qint64 done)
+{
+  reception.target = target;
+  reception.size = size;
+  reception.done = done;
+}
 
+void NetworkPacket::Private::next_stage(const BodySinks &sinks, const QStringList &types)
+{
+  auto &r = reception;
+  switch(r.stage) {
+    case NameSize: {
+      auto name_size = fromFixedBytes<int>(r.field);
+      r.has_request_id = name_size & REQUEST_ID_FLAG;
+      name_size &= ~REQUEST_ID_FLAG;
+      // Names can't be empty: a zero size means an interned type id follows
+      r.field.resize(name_size > 0 ? name_size : TYPE_ID_BYTES);
+      expect(r.field.data(), r.field.size());
+      r.stage = name_size > 0 ? Name : TypeId;
+      break;
+    }
+    case Name:
+    case TypeId:
+      if(r.stage == Name) {
+        name = QString::fromLatin1(r.field);
+      } else {
+        auto id = fromFixedBytes<int>(r.field);
+        // The rest of the packet is still read, so that the stream stays in sync; no handler matches an empty name
+        name = types.value(id - 1);
+        if(name.isEmpty())
+          qWarning() << "Unknown packet type id" << id;
+      }
+      r.field.resize(r.has_request_id ? REQUEST_ID_BYTES : PACKET_BYTES);
+      expect(r.field.data(), r.field.size());
+      r.stage = r.has_request_id ? RequestId : PayloadSize;
+      break;
+    case RequestId:
+      request_id = fromFixedBytes<quint32>(r.field);
+      r.field.resize(PACKET_BYTES);
+      expect(r.field.data(), PACKET_BYTES);
+      r.stage = PayloadSize;
+      break;
+    case PayloadSize: {
+      r.data_size = fromFixedBytes<qint64>(r.field);
+      if(r.data_size < 0 || r.data_size > MAX_PACKET_BYTES)
+        throw runtime_error(("Network packet %1 too big: %2 bytes" % name % r.data_size).toStdString());
+      auto sink = sinks.find(name);
+      if(sink != sinks.end() && r.data_size >= sink->header_size) {
+        r.sink = *sink;
+        payload.resize(r.sink.header_size);
+        r.stage = SinkHeader;
+      } else {
+        payload.resize(r.data_size);
+        r.stage = Payload;
+      }
+      expect(payload.data(), payload.size());
+      break;
+    }
+    case SinkHeader: {
+      auto remaining = r.data_size - r.sink.header_size;
+      auto buffer = r.sink.buffer(payload, remaining);
+      if(buffer.first) {
+        body = buffer.second;
+        body_data = buffer.first;
+        body_size = remaining;
+        expect(buffer.first, remaining);
+        r.stage = Body;
+      } else {
+        payload.resize(r.data_size);
+        expect(payload.data(), r.data_size, r.sink.header_size);
+        r.stage = Payload;
+      }
+      break;
+    }
+    case Payload:
+    case Body:
+      r.field.clear();
+      r.sink = {};
+      r.stage = Done;
+      break;
+    case Done:
+      break;
+  }
+}
 
 NetworkPacketType NetworkPacket::name() const
 {
@@ -161,6 +287,33 @@ void NetworkPacket::movePayload(QByteArray && payload)
   d->payload = std::move(payload);
 }
 
+void NetworkPacket::setBody(const shared_ptr<const void> &owner, const char *data, qint64 size)
+{
+  d->body = owner;
+  d->body_data = data;
+  d->body_size = size;
+}
+
+void NetworkPacket::setRequestId(quint32 id)
+{
+  d->request_id = id;
+}
+
+quint32 NetworkPacket::requestId() const
+{
+  return d->request_id;
+}
+
+shared_ptr<const void> NetworkPacket::body() const
+{
+  return d->body;
+}
+
+qint64 NetworkPacket::bodySize() const
+{
+  return d->body_size;
+}
+
 
 QDebug operator<<(QDebug dbg, const NetworkPacket& packet)
 {
@@ -24,6 +24,9 @@
 #include <QString>
 #include <QVariant>
 #include <QDebug>
+#include <QHash>
+#include <functional>
+#include <memory>
 #include "commons/fwd.h"
 #include "network/protocol/networkpackettype.h"
 
@@ -36,8 +39,34 @@ public:
   NetworkPacket();
   NetworkPacket(const NetworkPacketType &name);
   ~NetworkPacket();
-  qint64 sendTo(QIODevice *device) const;
-  void receiveFrom(QIODevice *device);
+
+  /**
+   * Destination for the bulk of a received payload.
+   * Once the first header_size bytes are read, buffer() can hand out memory for the remaining body_size bytes,
+   * which are then read straight into it instead of being appended to the payload.
+   * The second member keeps the memory alive, and becomes the packet body().
+   * Returning a null buffer keeps the whole payload in payload().
+   */
+  struct BodySink {
+    typedef std::pair<char *, std::shared_ptr<const void>> Buffer;
+    int header_size;
+    std::function<Buffer(const QByteArray &header, qint64 body_size)> buffer;
+  };
+  typedef QHash<NetworkPacketType, BodySink> BodySinks;
+
+  /**
+   * Writes the packet to device. Names found in ids go out as a single id byte (a zero name size, followed by the id), as the receiving peer announced them.
+   */
+  qint64 sendTo(QIODevice *device, const NetworkPacketTypes::Ids &ids = {}) const;
+  /**
+   * Reads whatever part of the packet is available on device, without blocking.
+   * Returns true once the packet is complete; otherwise it keeps the partial state, and should be called again when more data arrives.
+   * Packet type ids are resolved through types (see NetworkPacketTypes::all).
+   * Read errors, and payload sizes over 512MB, throw std::runtime_error before anything is allocated: the stream can't be trusted anymore.
+   */
+  bool readFrom(QIODevice *device, const BodySinks &sinks = {}, const QStringList &types = {});
+  /// Blocking version of readFrom, waiting on the device for the rest of the packet
+  void receiveFrom(QIODevice *device, const BodySinks &sinks = {}, const QStringList &types = {});
   void setName(const NetworkPacketType &name);
   NetworkPacketType name() const;
   
@@ -47,6 +76,19 @@ public:
   
   QByteArray payload() const;
   QVariant payloadVariant() const;
+
+  /**
+   * Correlates a reply with its request (0: none).
+   * Only packets with a non zero id carry it on the wire, flagged in the name size byte, so packets without one keep the original format.
+   */
+  void setRequestId(quint32 id);
+  quint32 requestId() const;
+
+  /// Bytes sent right after the payload, without copying them into it. owner must keep data valid.
+  void setBody(const std::shared_ptr<const void> &owner, const char *data, qint64 size);
+  /// Owner of the body, when it was received through a BodySink.
+  std::shared_ptr<const void> body() const;
+  qint64 bodySize() const;
   
   friend QDebug operator<<(QDebug dbg, const NetworkPacket &packet);
 private:
@@ -20,7 +20,9 @@
 #include "network/networkdispatcher.h"
 #include "network/networkreceiver.h"
 #include "network/networkpacket.h"
+#include "network/networkreply.h"
 #include <QCoreApplication>
+#include <algorithm>
 
 using namespace std;
 
@@ -28,6 +30,13 @@ DPTR_IMPL(NetworkReceiver) {
   const NetworkDispatcherPtr dispatcher;
   QHash<NetworkPacketType, bool> packets_processed;
   QHash<NetworkPacketType, NetworkReceiver::HandlePacket> handlers;
+  struct Request {
+    quint32 id;
+    NetworkPacketType reply_name;
+    NetworkReplyPtr reply;
+  };
+  QList<Request> requests;
+  NetworkReplyPtr take_reply(const NetworkPacketPtr &packet);
 };
 
 NetworkReceiver::NetworkReceiver(const NetworkDispatcherPtr &dispatcher) : dptr(dispatcher)
@@ -50,24 +59,61 @@ void NetworkReceiver::wait_for_processed(const NetworkPacketType &name) const
 {
   if(! d->dispatcher->is_connected())
     return;
+  d->dispatcher->subscribe(name, const_cast<NetworkReceiver *>(this));
   d->packets_processed[name] = false;
   while(! d->packets_processed[name] && d->dispatcher->is_connected())
     qApp->processEvents();
+  d->packets_processed.remove(name);
 }
 
 
 
+NetworkReplyPtr NetworkReceiver::request(const NetworkPacketPtr &packet, const NetworkPacketType &reply_name) const
+{
+  auto reply = make_shared<NetworkReply>(d->dispatcher);
+  if(! d->dispatcher->is_connected()) {
+    reply->finish({});
+    return reply;
+  }
+  packet->setRequestId(d->dispatcher->next_request_id());
+  d->requests.push_back({packet->requestId(), reply_name, reply});
+  d->dispatcher->subscribe(reply_name, const_cast<NetworkReceiver *>(this));
+  d->dispatcher->expect_reply(packet->requestId(), const_cast<NetworkReceiver *>(this));
+  d->dispatcher->queue_send(packet);
+  return reply;
+}
+
+NetworkReplyPtr NetworkReceiver::Private::take_reply(const NetworkPacketPtr &packet)
+{
+  auto matches = [&](const Request &request) {
+    return packet->requestId() ? request.id == packet->requestId() : request.reply_name == packet->name();
+  };
+  auto found = find_if(requests.begin(), requests.end(), matches);
+  if(found == requests.end())
+    return {};
+  auto reply = found->reply;
+  requests.erase(found);
+  return reply;
+}
+
 void NetworkReceiver::register_handler(const NetworkPacketType& name, const HandlePacket handler)
 {
   d->handlers[name] = handler;
+  d->dispatcher->subscribe(name, this);
 }
 
 void NetworkReceiver::handle(const NetworkPacketPtr& packet)
 {
-  auto handler = d->handlers[packet->name()];
+  // Copied: handlers can register more handlers
+  auto handler = d->handlers.value(packet->name());
   if(handler)
     handler(packet);
-  d->packets_processed[packet->name()] = true;
+  // Only tracked while someone waits for it
+  auto processed = d->packets_processed.find(packet->name());
+  if(processed != d->packets_processed.end())
+    *processed = true;
+  if(auto reply = d->take_reply(packet))
+    reply->finish(packet);
 }
 
 
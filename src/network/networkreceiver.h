@@ -29,6 +29,7 @@
 FWD_PTR(NetworkDispatcher)
 FWD_PTR(NetworkReceiver)
 FWD_PTR(NetworkPacket)
+FWD_PTR(NetworkReply)
 
 class NetworkReceiver {
 public:
@@ -39,6 +40,12 @@ protected:
   typedef std::function<void(const NetworkPacketPtr &)> HandlePacket;
   void register_handler(const NetworkPacketType &name, const HandlePacket handler);
   void wait_for_processed(const NetworkPacketType &name) const;
+  /**
+   * Sends packet tagged with a new request id, without waiting: the returned reply is matched by id.
+   * Replies broadcast without an id (such as signals) are matched by reply_name instead, oldest request first.
+   * Registered handlers still see the reply packet, before the reply is finished.
+   */
+  NetworkReplyPtr request(const NetworkPacketPtr &packet, const NetworkPacketType &reply_name) const;
   NetworkDispatcherPtr dispatcher() const;
 private:
   DPTR
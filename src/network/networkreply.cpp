@@ -0,0 +1,115 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/networkreply.h"
+#include "network/networkdispatcher.h"
+#include "network/networkpacket.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QDebug>
+#include <algorithm>
+
+using namespace std;
+
+DPTR_IMPL(NetworkReply) {
+  const NetworkDispatcherPtr dispatcher;
+  bool finished;
+  NetworkPacketPtr packet;
+  QList<NetworkReply::Callback> callbacks;
+  static bool wait(const QList<NetworkReply *> &replies, int timeout_ms);
+};
+
+NetworkReply::NetworkReply(const NetworkDispatcherPtr &dispatcher) : dptr(dispatcher, false)
+{
+}
+
+NetworkReply::~NetworkReply()
+{
+}
+
+bool NetworkReply::is_finished() const
+{
+  return d->finished;
+}
+
+NetworkPacketPtr NetworkReply::packet() const
+{
+  return d->packet;
+}
+
+void NetworkReply::finish(const NetworkPacketPtr &packet)
+{
+  if(d->finished)
+    return;
+  d->finished = true;
+  d->packet = packet;
+  for(auto callback: d->callbacks)
+    callback(packet);
+  d->callbacks.clear();
+}
+
+void NetworkReply::then(const Callback &callback)
+{
+  if(d->finished)
+    callback(d->packet);
+  else
+    d->callbacks.push_back(callback);
+}
+
+NetworkPacketPtr NetworkReply::wait(int timeout_ms)
+{
+  Private::wait({this}, timeout_ms);
+  return d->packet;
+}
+
+bool NetworkReply::wait_all(const QList<NetworkReplyPtr> &replies, int timeout_ms)
+{
+  QList<NetworkReply *> pointers;
+  for(auto reply: replies)
+    pointers.push_back(reply.get());
+  return Private::wait(pointers, timeout_ms);
+}
+
+bool NetworkReply::Private::wait(const QList<NetworkReply *> &replies, int timeout_ms)
+{
+  auto pending = [&] {
+    return any_of(replies.begin(), replies.end(), [](NetworkReply *reply){
+      return ! reply->d->finished && reply->d->dispatcher->is_connected();
+    });
+  };
+  if(pending()) {
+    QElapsedTimer elapsed;
+    elapsed.start();
+    // Wakes the event loop up to check for timeouts even when nothing arrives
+    QTimer tick;
+    tick.start(100);
+    while(pending() && elapsed.elapsed() < timeout_ms)
+      qApp->processEvents(QEventLoop::WaitForMoreEvents);
+  }
+  bool all_received = true;
+  for(auto reply: replies) {
+    if(! reply->d->finished) {
+      qWarning() << "Network request not answered: timeout or connection lost";
+      reply->finish({});
+    }
+    all_received = all_received && reply->d->packet;
+  }
+  return all_received;
+}
@@ -0,0 +1,57 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NETWORKREPLY_H
+#define NETWORKREPLY_H
+
+#include <functional>
+#include <QList>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "network/protocol/networkpackettype.h"
+
+FWD_PTR(NetworkDispatcher)
+FWD_PTR(NetworkPacket)
+FWD_PTR(NetworkReply)
+
+/**
+ * Reply to a request sent with NetworkReceiver::request().
+ * Requests don't block: send all the independent ones first, then wait for them together, so they share a single round trip.
+ */
+class NetworkReply
+{
+public:
+  typedef std::function<void(const NetworkPacketPtr &)> Callback;
+  NetworkReply(const NetworkDispatcherPtr &dispatcher);
+  ~NetworkReply();
+  bool is_finished() const;
+  /// The reply packet: nullptr until it arrives, or if the request failed
+  NetworkPacketPtr packet() const;
+  /// Runs the event loop until the reply arrives, the connection drops, or timeout_ms expires. Returns the reply packet, or nullptr.
+  NetworkPacketPtr wait(int timeout_ms = 30000);
+  /// Waits for all the replies, sharing the same timeout. Returns true if they all arrived.
+  static bool wait_all(const QList<NetworkReplyPtr> &replies, int timeout_ms = 30000);
+  /// callback is invoked with the reply packet once it arrives, or right away if it already did
+  void then(const Callback &callback);
+  void finish(const NetworkPacketPtr &packet);
+private:
+  DPTR
+};
+
+#endif // NETWORKREPLY_H
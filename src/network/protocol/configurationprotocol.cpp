@@ -26,6 +26,8 @@ PROTOCOL_NAME_VALUE(Configuration, Get);
 PROTOCOL_NAME_VALUE(Configuration, GetReply);
 PROTOCOL_NAME_VALUE(Configuration, Set);
 PROTOCOL_NAME_VALUE(Configuration, Reset);
+PROTOCOL_NAME_VALUE(Configuration, Snapshot);
+PROTOCOL_NAME_VALUE(Configuration, SnapshotReply);
 PROTOCOL_NAME_VALUE(Configuration, signalSettingsChanged);
 
 
@@ -62,3 +64,18 @@ NetworkPacketPtr ConfigurationProtocol::encodeGetReply(const QString& name, cons
 {
   return packetGetReply() << QVariantMap {{"name", name}, {"value", value}};
 }
+
+NetworkPacketPtr ConfigurationProtocol::encodeSnapshotReply(const QVariantMap& values)
+{
+  return packetSnapshotReply() << QVariant{values};
+}
+
+NetworkPacketPtr ConfigurationProtocol::encodeSettingsChanged(const QVariantMap& changed)
+{
+  return packetsignalSettingsChanged() << QVariant{changed};
+}
+
+QVariantMap ConfigurationProtocol::decodeValues(const NetworkPacketPtr& packet)
+{
+  return packet->payloadVariant().toMap();
+}
@@ -33,6 +33,8 @@ public:
   ADD_PROTOCOL_PACKET_NAME(GetReply)
   ADD_PROTOCOL_PACKET_NAME(Set)
   ADD_PROTOCOL_PACKET_NAME(Reset)
+  ADD_PROTOCOL_PACKET_NAME(Snapshot)
+  ADD_PROTOCOL_PACKET_NAME(SnapshotReply)
   ADD_PROTOCOL_PACKET_NAME(signalSettingsChanged)
   
   static NetworkPacketPtr get(const QString name);
@@ -43,6 +45,11 @@ public:
   static NetworkPacketPtr encodeGetReply(const QString &name, const QVariant &value);
   
   static void decodeSet(const NetworkPacketPtr &packet, QString &name, QVariant &value);
+
+  /// Values of all the forwarded settings, or (in signalSettingsChanged) just the ones that changed
+  static NetworkPacketPtr encodeSnapshotReply(const QVariantMap &values);
+  static NetworkPacketPtr encodeSettingsChanged(const QVariantMap &changed);
+  static QVariantMap decodeValues(const NetworkPacketPtr &packet);
 };
 
 #endif // CONFIGURATIONPROTOCOL_H
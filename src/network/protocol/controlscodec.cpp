@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "network/protocol/controlscodec.h"
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace {
+  enum Wire : quint8 { Varint = 0, Double = 1, Bytes = 2 };
+  enum Field : quint8 {
+    Id = 1, Name = 2, Value = 3, Default = 4, Type = 5, Min = 6, Max = 7, Step = 8, Choice = 9, Decimals = 10, Flags = 11,
+    DurationUnit = 12, ValueFlags = 13,
+  };
+  enum ChoiceField : quint8 { ChoiceLabel = 1, ChoiceValue = 2 };
+  enum Flag : quint32 {
+    IsDuration = 1 << 0, SupportsAuto = 1 << 1, ReadOnly = 1 << 2, IsExposure = 1 << 3, SupportsOnOff = 1 << 4,
+  };
+  enum ValueFlag : quint32 { ValueAuto = 1 << 0, ValueOnOff = 1 << 1 };
+
+  class Writer {
+  public:
+    QByteArray data;
+    void varint(quint64 value) {
+      while(value >= 0x80) {
+        data.append(static_cast<char>(value | 0x80));
+        value >>= 7;
+      }
+      data.append(static_cast<char>(value));
+    }
+    void key(quint8 field, Wire wire) { varint(field << 3 | wire); }
+    void integer(quint8 field, qint64 value) {
+      key(field, Varint);
+      varint((static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63));
+    }
+    void real(quint8 field, double value) {
+      key(field, Double);
+      quint64 bits;
+      memcpy(&bits, &value, sizeof(bits));
+      boost::endian::native_to_little_inplace(bits);
+      data.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+    }
+    void bytes(quint8 field, const QByteArray &value) {
+      key(field, Bytes);
+      varint(value.size());
+      data.append(value);
+    }
+    void typed(quint8 field, const QVariant &value) {
+      switch(static_cast<QMetaType::Type>(value.type())) {
+        case QMetaType::UnknownType:
+          return;
+        case QMetaType::Double:
+        case QMetaType::Float:
+          return real(field, value.toDouble());
+        case QMetaType::QString:
+          return bytes(field, value.toString().toUtf8());
+        default:
+          return integer(field, value.toLongLong());
+      }
+    }
+  };
+
+  class Reader {
+  public:
+    Reader(const QByteArray &data) : data{data} {}
+    const QByteArray data;
+    int position = 0;
+    bool ok = true;
+    bool atEnd() const { return ! ok || position >= data.size(); }
+    quint64 varint() {
+      quint64 value = 0;
+      for(int shift = 0; shift < 64; shift += 7) {
+        if(position >= data.size())
+          break;
+        const auto byte = static_cast<quint8>(data[position++]);
+        value |= static_cast<quint64>(byte & 0x7f) << shift;
+        if(! (byte & 0x80))
+          return value;
+      }
+      ok = false;
+      return 0;
+    }
+    qint64 integer() {
+      const auto value = varint();
+      return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+    }
+    double real() {
+      if(position + 8 > data.size()) {
+        ok = false;
+        return 0;
+      }
+      quint64 bits;
+      memcpy(&bits, data.constData() + position, sizeof(bits));
+      position += 8;
+      boost::endian::little_to_native_inplace(bits);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    QByteArray bytes() {
+      const auto size = varint();
+      if(! ok || size > static_cast<quint64>(data.size() - position)) {
+        ok = false;
+        return {};
+      }
+      auto value = data.mid(position, static_cast<int>(size));
+      position += static_cast<int>(size);
+      return value;
+    }
+    QVariant typed(Wire wire) {
+      switch(wire) {
+        case Varint:
+          return integer();
+        case Double:
+          return real();
+        case Bytes:
+          return QString::fromUtf8(bytes());
+      }
+      ok = false;
+      return {};
+    }
+    /// Calls field(id, wire) for each field, which has to read its payload or return false to have it skipped
+    template<typename F> bool fields(F field) {
+      while(! atEnd()) {
+        const auto key = varint();
+        const auto wire = static_cast<Wire>(key & 0x7);
+        if(! ok || field(static_cast<quint8>(key >> 3), wire))
+          continue;
+        if(wire == Varint)
+          varint();
+        else if(wire == Double)
+          real();
+        else if(wire == Bytes)
+          bytes();
+        else
+          ok = false;
+      }
+      return ok;
+    }
+  };
+
+  quint32 value_flags(const Imager::Control &control) {
+    return (control.value_auto ? ValueAuto : 0) | (control.value_onOff ? ValueOnOff : 0);
+  }
+
+  void set_value_flags(Imager::Control &control, quint64 flags) {
+    control.value_auto = flags & ValueAuto;
+    control.value_onOff = flags & ValueOnOff;
+  }
+
+  QByteArray message(const Imager::Controls &controls, const function<void(Writer &, const Imager::Control &)> &encode) {
+    Writer writer;
+    writer.data.append(static_cast<char>(ControlsCodec::VERSION));
+    writer.varint(controls.size());
+    for(const auto &control: controls) {
+      Writer fields;
+      encode(fields, control);
+      writer.varint(fields.data.size());
+      writer.data.append(fields.data);
+    }
+    return writer.data;
+  }
+
+  bool messages(const QByteArray &data, const function<bool(Reader &)> &decode) {
+    if(data.isEmpty() || static_cast<quint8>(data[0]) != ControlsCodec::VERSION)
+      return false;
+    Reader reader{data};
+    reader.position = 1;
+    const auto count = reader.varint();
+    for(quint64 index = 0; reader.ok && index < count; index++) {
+      Reader control{reader.bytes()};
+      if(! reader.ok || ! decode(control))
+        return false;
+    }
+    return reader.ok;
+  }
+}
+
+QByteArray ControlsCodec::encode(const Imager::Controls &controls)
+{
+  return message(controls, [](Writer &writer, const Imager::Control &control) {
+    writer.integer(Id, control.id);
+    writer.bytes(Name, control.name.toUtf8());
+    writer.typed(Value, control.value);
+    writer.typed(Default, control.default_value);
+    writer.integer(Type, control.type);
+    writer.typed(Min, control.range.min);
+    writer.typed(Max, control.range.max);
+    writer.typed(Step, control.range.step);
+    for(const auto &choice: control.choices) {
+      Writer fields;
+      fields.bytes(ChoiceLabel, choice.label.toUtf8());
+      fields.typed(ChoiceValue, choice.value);
+      writer.bytes(Choice, fields.data);
+    }
+    writer.integer(Decimals, control.decimals);
+    writer.integer(Flags, (control.is_duration ? IsDuration : 0) | (control.supports_auto ? SupportsAuto : 0) | (control.readonly ? ReadOnly : 0)
+      | (control.is_exposure ? IsExposure : 0) | (control.supports_onOff ? SupportsOnOff : 0));
+    writer.real(DurationUnit, control.duration_unit.count());
+    writer.integer(ValueFlags, value_flags(control));
+  });
+}
+
+bool ControlsCodec::decode(const QByteArray &data, Imager::Controls &controls)
+{
+  Imager::Controls decoded;
+  bool valid = messages(data, [&](Reader &reader) {
+    Imager::Control control{};
+    auto fields_ok = reader.fields([&](quint8 field, Wire wire) {
+      if(field == Choice && wire == Bytes) {
+        Reader choice_reader{reader.bytes()};
+        Imager::Control::Choice choice;
+        choice_reader.fields([&](quint8 choice_field, Wire choice_wire) {
+          if(choice_field == ChoiceLabel && choice_wire == Bytes)
+            choice.label = QString::fromUtf8(choice_reader.bytes());
+          else if(choice_field == ChoiceValue)
+            choice.value = choice_reader.typed(choice_wire);
+          else
+            return false;
+          return true;
+        });
+        control.choices.push_back(choice);
+        return choice_reader.ok;
+      }
+      if(field == Name && wire == Bytes)
+        control.name = QString::fromUtf8(reader.bytes());
+      else if(field == Value)
+        control.value = reader.typed(wire);
+      else if(field == Default)
+        control.default_value = reader.typed(wire);
+      else if(field == Min)
+        control.range.min = reader.typed(wire);
+      else if(field == Max)
+        control.range.max = reader.typed(wire);
+      else if(field == Step)
+        control.range.step = reader.typed(wire);
+      else if(field == DurationUnit && wire == Double)
+        control.duration_unit = chrono::duration<double>{reader.real()};
+      else if(wire != Varint)
+        return false;
+      else if(field == Id)
+        control.id = reader.integer();
+      else if(field == Type)
+        control.type = static_cast<Imager::Control::Type>(reader.integer());
+      else if(field == Decimals)
+        control.decimals = static_cast<qint16>(reader.integer());
+      else if(field == Flags) {
+        const auto flags = reader.integer();
+        control.is_duration = flags & IsDuration;
+        control.supports_auto = flags & SupportsAuto;
+        control.readonly = flags & ReadOnly;
+        control.is_exposure = flags & IsExposure;
+        control.supports_onOff = flags & SupportsOnOff;
+      } else if(field == ValueFlags)
+        set_value_flags(control, reader.integer());
+      else
+        return false;
+      return true;
+    });
+    decoded.push_back(control);
+    return fields_ok;
+  });
+  if(valid)
+    controls = decoded;
+  return valid;
+}
+
+QByteArray ControlsCodec::encodeValues(const Imager::Controls &controls)
+{
+  return message(controls, [](Writer &writer, const Imager::Control &control) {
+    writer.integer(Id, control.id);
+    writer.typed(Value, control.value);
+    writer.integer(ValueFlags, value_flags(control));
+  });
+}
+
+bool ControlsCodec::applyValues(const QByteArray &data, Imager::Controls &known, Imager::Controls &changed)
+{
+  return messages(data, [&](Reader &reader) {
+    qlonglong id = 0;
+    QVariant value;
+    qint64 flags = -1;
+    auto fields_ok = reader.fields([&](quint8 field, Wire wire) {
+      if(field == Value)
+        value = reader.typed(wire);
+      else if(wire != Varint)
+        return false;
+      else if(field == Id)
+        id = reader.integer();
+      else if(field == ValueFlags)
+        flags = reader.integer();
+      else
+        return false;
+      return true;
+    });
+    auto control = find_if(known.begin(), known.end(), [&](const Imager::Control &c) { return c.id == id; });
+    if(fields_ok && control != known.end()) {
+      control->value = value;
+      if(flags >= 0)
+        set_value_flags(*control, flags);
+      changed.push_back(*control);
+    }
+    return fields_ok;
+  });
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CONTROLSCODEC_H
+#define CONTROLSCODEC_H
+
+#include <QByteArray>
+#include "drivers/imager.h"
+
+/**
+ * Compact binary encoding of camera controls, for the Driver packets.
+ *
+ * message := version (1 byte, VERSION) count (varint) control*
+ * control := length (varint) field*
+ * field := key (varint: field id << 3 | wire type) payload
+ *
+ * Wire types, as in protobuf: 0 varint (signed values zigzag encoded), 1 little endian double, 2 length delimited bytes.
+ * Typed values (value, default, range, choice values) are integers (bools too), doubles or UTF-8 strings, by wire type; absent means null.
+ * Decoders skip the fields they don't know, so fields can be added without a new version.
+ *
+ * Full descriptors are sent once (GetControlsReply); then changes only carry the id, the value and the value flags.
+ */
+namespace ControlsCodec {
+  static const quint8 VERSION = 1;
+
+  /// Full descriptors
+  QByteArray encode(const Imager::Controls &controls);
+  /// false if data isn't a valid message of a known version
+  bool decode(const QByteArray &data, Imager::Controls &controls);
+
+  /// Only ids, values, and auto and on/off states
+  QByteArray encodeValues(const Imager::Controls &controls);
+  /// Applies the values to the known descriptors, appending to changed the updated controls. Values of unknown controls are ignored
+  bool applyValues(const QByteArray &data, Imager::Controls &known, Imager::Controls &changed);
+}
+
+#endif // CONTROLSCODEC_H
@@ -21,10 +21,19 @@
 #include "network/networkpacket.h"
 #include <algorithm>
 #include <functional>
+#include <map>
 #include <opencv2/opencv.hpp>
 #include "commons/opencv_utils.h"
 #include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/framepool.h"
+#include "commons/pixel_kernels.h"
+#include "commons/tracing.h"
+#include "network/protocol/framecodec.h"
+#include "network/protocol/controlscodec.h"
 #include <QJsonDocument>
+#include <QDataStream>
+#include <boost/endian/conversion.hpp>
 #include "drivers/driver.h"
 
 using namespace std;
@@ -42,86 +51,176 @@ PROTOCOL_NAME_VALUE(Driver, ClearROI);
 PROTOCOL_NAME_VALUE(Driver, GetControls);
 PROTOCOL_NAME_VALUE(Driver, GetControlsReply);
 PROTOCOL_NAME_VALUE(Driver, SendFrame);
+PROTOCOL_NAME_VALUE(Driver, SendRawFrame);
+PROTOCOL_NAME_VALUE(Driver, SendCodedFrame);
+PROTOCOL_NAME_VALUE(Driver, FrameReceived);
 PROTOCOL_NAME_VALUE(Driver, SetControl);
+PROTOCOL_NAME_VALUE(Driver, SetControls);
 PROTOCOL_NAME_VALUE(Driver, SetROI);
-PROTOCOL_NAME_VALUE(Driver, signalFPS);
-PROTOCOL_NAME_VALUE(Driver, signalTemperature);
-PROTOCOL_NAME_VALUE(Driver, signalControlChanged);
+PROTOCOL_NAME_VALUE(Driver, signalImagerChanges);
 PROTOCOL_NAME_VALUE(Driver, signalDisconnected);
 PROTOCOL_NAME_VALUE(Driver, signalCameraConnected);
 PROTOCOL_NAME_VALUE(Driver, CloseCamera);
 
 namespace {
-  QVariant control2variant(const Imager::Control &control) {
-    QVariantList choices;
-    transform(begin(control.choices), end(control.choices), back_inserter(choices), [](const Imager::Control::Choice c){
-      return QVariantMap{ {"label", c.label}, {"val", c.value} };
-    });
-    return QVariantMap {
-      {"id",  control.id},
-      {"name",  control.name},
-      {"val",  control.value},
-      {"def",  control.default_value},
-      {"type",  static_cast<int>(control.type)},
-      {"min",  control.range.min},
-      {"max",  control.range.max},
-      {"step",  control.range.step},
-      {"choices", choices},
-      {"decimals", control.decimals},
-      {"is_duration", control.is_duration},
-      {"has_auto", control.supports_auto},
-      {"is_auto", control.value_auto},
-      {"ro", control.readonly},
-      {"duration_unit", control.duration_unit.count()},
-    };
-  }
+  static NetworkProtocol::FormatParameters format_parameters;
+
+  // SendRawFrame payload: this fixed size header, followed by the frame pixels exactly as they are in memory
+  struct RawFrameHeader {
+    static const quint8 VERSION = 3;
+    static const int SIZE = 1 + 4 + 4 + 1 + 1 + 1 + 8 + 8 + 8 + 8 + 8 + 8 + 8 + 4 + 4 + 2;
+    qint32 width;
+    qint32 height;
+    quint8 bpp;
+    quint8 color_format;
+    quint8 byte_order;
+    double exposure;
+    qint64 created_utc;
+    quint64 sequence;
+    qint64 device_timestamp; // microseconds, -1 if the driver doesn't report one
+    FrameMetadata metadata;
 
-  Imager::Control variant2control(const QVariant &variant) {
-    QVariantMap ctrl = variant.toMap();
-    Imager::Control::Choices choices;
-    for(auto c: ctrl["choices"].toList()) {
-      QVariantMap choice = c.toMap();
-      choices.push_back({choice["label"].toString(), choice["val"]});
-      qDebug() << "Choice: " << Imager::Control::Choice{choice["label"].toString(), choice["val"]};
+    RawFrameHeader() = default;
+    RawFrameHeader(const Frame &frame)
+      : width{frame.resolution().width()},
+      height{frame.resolution().height()},
+      bpp{frame.bpp()},
+      color_format{static_cast<quint8>(frame.colorFormat())},
+      byte_order{static_cast<quint8>(frame.byteOrder())},
+      exposure{frame.exposure().count()},
+      created_utc{frame.created_utc().toMSecsSinceEpoch()},
+      sequence{frame.sequence()},
+      device_timestamp{frame.has_device_timestamp() ? frame.device_timestamp().count() : -1},
+      metadata(frame.metadata()) {}
+
+    QByteArray encode() const {
+      QByteArray data;
+      QDataStream s(&data, QIODevice::WriteOnly);
+      s << VERSION << width << height << bpp << color_format << byte_order << exposure << created_utc << sequence << device_timestamp
+        << metadata.gain << metadata.temperature << metadata.driver_sequence << metadata.roi_x << metadata.roi_y << metadata.bin;
+      return data;
     }
-    return {
-      ctrl["id"].toLongLong(),
-      ctrl["name"].toString(),
-      static_cast<Imager::Control::Type>(ctrl["type"].toInt()),
-      ctrl["val"],
-      ctrl["def"],
-      { ctrl["min"], ctrl["max"], ctrl["step"] },
-      choices,
-      static_cast<qint16>(ctrl["decimals"].toInt()),
-      ctrl["is_duration"].toBool(),
-      ctrl["has_auto"].toBool(),
-      ctrl["is_auto"].toBool(),
-      ctrl["ro"].toBool(),
-      std::chrono::duration<double>{ctrl["duration_unit"].toDouble()},
-    };
+
+    bool decode(const QByteArray &data) {
+      QDataStream s(data);
+      quint8 version;
+      s >> version >> width >> height >> bpp >> color_format >> byte_order >> exposure >> created_utc >> sequence >> device_timestamp
+        >> metadata.gain >> metadata.temperature >> metadata.driver_sequence >> metadata.roi_x >> metadata.roi_y >> metadata.bin;
+      return s.status() == QDataStream::Ok && version == VERSION && width > 0 && height > 0 && (bpp == 8 || bpp == 16)
+        && color_format <= Frame::Bayer_BGGR && byte_order <= Frame::LittleEndian;
+    }
+
+    qint64 body_size() const {
+      int channels = color_format == Frame::RGB || color_format == Frame::BGR ? 3 : 1;
+      return qint64{width} * height * channels * (bpp / 8);
+    }
+
+    FramePtr frame(const FramePoolPtr &pool = {}) const {
+      auto format = static_cast<Frame::ColorFormat>(color_format);
+      auto order = static_cast<Frame::ByteOrder>(byte_order);
+      auto frame = pool ? pool->acquire(bpp, format, {width, height}, order) : make_shared<Frame>(bpp, format, QSize{width, height}, order);
+      frame->set_exposure(Frame::Seconds{exposure});
+      frame->set_created_utc(QDateTime::fromMSecsSinceEpoch(created_utc, Qt::UTC));
+      frame->set_sequence(sequence);
+      frame->set_metadata(metadata);
+      if(device_timestamp >= 0)
+        frame->set_device_timestamp(Frame::Timestamp{device_timestamp});
+      return frame;
+    }
+  };
+
+  // Crops to the client viewport and fits the client preview size, before any encoding
+  FrameConstPtr previewFrame(FrameConstPtr frame, const NetworkProtocol::FormatParameters &parameters)
+  {
+    const bool bayer = frame->colorFormat() != Frame::Mono && frame->colorFormat() != Frame::RGB && frame->colorFormat() != Frame::BGR;
+    if(! parameters.viewport.isEmpty()) {
+      auto viewport = parameters.viewport.intersected({{0, 0}, frame->resolution()});
+      if(bayer) // even offset and size keep the CFA pattern
+        viewport = {viewport.x() & ~1, viewport.y() & ~1, viewport.width() & ~1, viewport.height() & ~1};
+      if(! viewport.isEmpty() && viewport.size() != frame->resolution())
+        frame = frame->cropped({viewport.x(), viewport.y(), viewport.width(), viewport.height()});
+    }
+    const auto max_size = parameters.maxPreviewSize;
+    if(max_size.isEmpty() || (frame->resolution().width() <= max_size.width() && frame->resolution().height() <= max_size.height()))
+      return frame;
+
+    cv::Mat image = frame->mat();
+    const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+    const bool swap = image.depth() == CV_16U && (native_little_endian ? frame->byteOrder() == Frame::BigEndian : frame->byteOrder() == Frame::LittleEndian);
+    if(swap) {
+      image = image.clone();
+      auto begin = reinterpret_cast<uint16_t*>(image.data);
+      std::for_each(begin, begin + image.total() * image.channels(), [](uint16_t &v) { boost::endian::endian_reverse_inplace(v); });
+    }
+    auto color_format = frame->colorFormat();
+    if(bayer) {
+      // A scaled Bayer mosaic is no longer a mosaic: scaled previews are debayered first
+      static const map<Frame::ColorFormat, int> debayer {
+        {Frame::Bayer_RGGB, cv::COLOR_BayerRG2BGR},
+        {Frame::Bayer_GBRG, cv::COLOR_BayerGB2BGR},
+        {Frame::Bayer_GRBG, cv::COLOR_BayerGR2BGR},
+        {Frame::Bayer_BGGR, cv::COLOR_BayerBG2BGR},
+      };
+      cv::cvtColor(image, image, debayer.at(color_format));
+      color_format = Frame::BGR;
+    }
+    const double scale = min(static_cast<double>(max_size.width()) / image.cols, static_cast<double>(max_size.height()) / image.rows);
+    cv::Mat scaled;
+    cv::resize(image, scaled, {max(1, static_cast<int>(image.cols * scale)), max(1, static_cast<int>(image.rows * scale))}, 0, 0, cv::INTER_AREA);
+    auto preview = make_shared<Frame>(color_format, scaled, native_little_endian ? Frame::LittleEndian : Frame::BigEndian, Frame::ShareBuffer);
+    preview->copy_metadata(*frame);
+    return preview;
   }
-  static NetworkProtocol::FormatParameters format_parameters;
-  static vector<int> opencv_encode_parameters;
-}
 
-void DriverProtocol::setFormatParameters(const FormatParameters& parameters)
-{
-  format_parameters = parameters;
-  opencv_encode_parameters.clear();
-  if(parameters.format == Configuration::Network_JPEG) {
-    opencv_encode_parameters = {cv::IMWRITE_JPEG_QUALITY  , parameters.jpegQuality };
+  FrameConstPtr force8bit(FrameConstPtr frame)
+  {
+    if(frame->bpp() <= 8)
+      return frame;
+    auto converted = make_shared<Frame>(frame->colorFormat(), frame->analysis().as_8bit(), frame->byteOrder(), Frame::ShareBuffer);
+    converted->copy_metadata(*frame);
+    return converted;
   }
-  if(parameters.format == Configuration::Network_RAW) {
-    opencv_encode_parameters = {cv::IMWRITE_PXM_BINARY , 1 };
+
+  NetworkPacketPtr sendRawFrame(FrameConstPtr frame, const NetworkProtocol::FormatParameters &parameters)
+  {
+    if(parameters.force8bit)
+      frame = force8bit(frame);
+    return DriverProtocol::rawFrame(frame, DriverProtocol::packetSendRawFrame());
+  }
+
+  // SendCodedFrame payload: RawFrameHeader for the decoded frame, codec id, codec data
+  NetworkPacketPtr sendCodedFrame(FrameConstPtr frame, const NetworkProtocol::FormatParameters &parameters, int quality, double scale, FrameCodec &codec)
+  {
+    const bool lossy = codec.id() == FrameCodec::WebP || codec.id() == FrameCodec::Jpeg;
+    if(parameters.force8bit && ! lossy)
+      frame = force8bit(frame);
+    frame = codec.prepare(frame);
+    // Prepared WebP and JPEG frames are never Bayer, so they can be resized
+    if(lossy && scale < 1) {
+      cv::Mat scaled;
+      cv::resize(frame->mat(), scaled, cv::Size{}, scale, scale, cv::INTER_AREA);
+      auto resized = make_shared<Frame>(frame->colorFormat(), scaled, frame->byteOrder(), Frame::ShareBuffer);
+      resized->copy_metadata(*frame);
+      frame = resized;
+    }
+    auto data = codec.encode(*frame, quality);
+    if(data.isEmpty())
+      return {};
+    auto payload = RawFrameHeader{*frame}.encode();
+    payload.reserve(payload.size() + 1 + data.size());
+    payload.append(static_cast<char>(codec.id()));
+    payload.append(data);
+    auto packet = DriverProtocol::packetSendCodedFrame();
+    packet->movePayload(std::move(payload));
+    return packet;
   }
 }
 
-bool DriverProtocol::isForwardingEnabled()
+void DriverProtocol::setFormatParameters(const FormatParameters& parameters)
 {
-  return format_parameters.format != Configuration::Network_NoImage;
+  format_parameters = parameters;
 }
 
-
 NetworkPacketPtr DriverProtocol::sendCameraListReply(const QList<CameraPtr>& cameras)
 {
   QVariantList v_cameras;
@@ -180,49 +279,83 @@ void DriverProtocol::decode(Imager::Properties& properties, const NetworkPacketP
 
 NetworkPacketPtr DriverProtocol::sendGetControlsReply(const Imager::Controls& controls)
 {
-  QVariantList v;
-  transform(begin(controls), end(controls), back_inserter(v), bind(control2variant, _1));
-  //qDebug().noquote().nospace() << "controls encoded: " << QJsonDocument::fromVariant(v).toJson(QJsonDocument::Compact);
-  return packetGetControlsReply() << v;
-//   return packetGetControlsReply() << QJsonDocument::fromVariant(v).toBinaryData();
+  auto packet = packetGetControlsReply();
+  packet->movePayload(ControlsCodec::encode(controls));
+  return packet;
 }
 
 
 void DriverProtocol::decode(Imager::Controls& controls, const NetworkPacketPtr& packet)
 {
   controls.clear();
-//   QVariantList variant_controls = QJsonDocument::fromBinaryData(packet->payload()).toVariant().toList();
-  QVariantList variant_controls = packet->payloadVariant().toList();
-  //qDebug().noquote().nospace() << "controls to decode: " << QJsonDocument::fromVariant(variant_controls).toJson(QJsonDocument::Compact);
-  transform(begin(variant_controls), end(variant_controls), back_inserter(controls), bind(variant2control, _1));
+  if(! ControlsCodec::decode(packet->payload(), controls))
+    qWarning() << "Invalid controls packet, size: " << packet->payload().size();
 }
 
-NetworkPacketPtr DriverProtocol::sendFrame(FrameConstPtr frame)
+FrameCodecPtr DriverProtocol::frameCodec(const FormatParameters &parameters)
 {
-  if(format_parameters.format == Configuration::Network_NoImage)
+  auto client_decodes = [&](FrameCodec::Id id) { return parameters.codecs.contains(id); };
+  auto codec = [&](FrameCodec::Id id) { return client_decodes(id) ? FrameCodec::create(id, client_decodes(FrameCodec::Zstd)) : FrameCodecPtr{}; };
+  switch(parameters.format) {
+    case Configuration::Network_RAW:
+      // 8 bit frames stay RAW packets, sent without copying the pixels
+      if(! parameters.compression)
+        return parameters.force8bit ? FrameCodecPtr{} : codec(FrameCodec::Packed);
+      return codec(FrameCodec::Zstd);
+    case Configuration::Network_WebP:
+      return codec(FrameCodec::WebP);
+    case Configuration::Network_JPEG:
+      return codec(FrameCodec::Jpeg);
+    case Configuration::Network_TileDelta:
+      return codec(FrameCodec::TileDelta);
+    default:
+      return {};
+  }
+}
+
+NetworkPacketPtr DriverProtocol::sendFrame(FrameConstPtr frame, const FormatParameters &parameters, double jpeg_quality_factor, double scale, const FrameCodecPtr &codec)
+{
+  if(parameters.format == Configuration::Network_NoImage)
     return {};
+  Tracing::Span span{"DriverProtocol::sendFrame", frame->sequence()};
+  frame = previewFrame(frame, parameters);
+  const int quality = max(10, static_cast<int>(parameters.jpegQuality * jpeg_quality_factor));
+  // Packing only pays off for 16 bit frames; the others are sent as they are, without a copy
+  if(codec && ! (codec->id() == FrameCodec::Packed && frame->bpp() == 8))
+    return sendCodedFrame(frame, parameters, quality, scale, *codec);
+  // Without a codec negotiated, lossy formats fall back to JPEG, and lossless ones to RAW
+  if(parameters.format == Configuration::Network_TileDelta || (parameters.format == Configuration::Network_RAW && ! parameters.compression))
+    return sendRawFrame(frame, parameters);
 
   vector<uint8_t> data;
   QByteArray image;
   string extension;
 
 
-  if(format_parameters.format == Configuration::Network_JPEG) {
+  const bool jpeg = parameters.format == Configuration::Network_JPEG || parameters.format == Configuration::Network_WebP;
+  if(jpeg) {
     extension = ".jpg";
-  } else if(format_parameters.format == Configuration::Network_RAW) {
+  } else if(parameters.format == Configuration::Network_RAW) {
     extension = frame->channels() == 1 ? ".pgm" : ".ppm";
   };
   cv::Mat cv_image = frame->mat();
   if(
-    ( (format_parameters.force8bit && format_parameters.format == Configuration::Network_RAW) || format_parameters.format ==Configuration::Network_JPEG )
+    ( (parameters.force8bit && parameters.format == Configuration::Network_RAW) || jpeg )
     && frame->bpp() > 8
   ) {
-    cv_image.convertTo(cv_image, frame->channels() == 1 ? CV_8UC1 : CV_8UC3, 1./256.);
+    cv_image = PixelKernels::to8bit(cv_image);
+  }
+  vector<int> encode_parameters{cv::IMWRITE_PXM_BINARY, 1};
+  if(jpeg) {
+    encode_parameters = {cv::IMWRITE_JPEG_QUALITY, quality };
+    // Bayer frames would lose their pattern when resized
+    if(scale < 1 && (frame->colorFormat() == Frame::Mono || frame->colorFormat() == Frame::RGB || frame->colorFormat() == Frame::BGR))
+      cv::resize(cv_image, cv_image, cv::Size{}, scale, scale, cv::INTER_AREA);
   }
-  cv::imencode(extension, cv_image, data, opencv_encode_parameters );
+  cv::imencode(extension, cv_image, data, encode_parameters );
   image.resize(data.size());
   move(begin(data), end(data), begin(image));
-  if(format_parameters.compression && format_parameters.format == Configuration::Network_RAW) {
+  if(parameters.compression && parameters.format == Configuration::Network_RAW) {
     image = qCompress(image, 1);
   }
   //qDebug() << "FRAME data size: " << image.size() << ", bpp: " << frame->bpp() << ", res: " << frame->resolution() << ", channels: " << frame->channels();
@@ -231,33 +364,146 @@ NetworkPacketPtr DriverProtocol::sendFrame(FrameConstPtr frame)
   return packet;
 }
 
+NetworkPacketPtr DriverProtocol::rawFrame(FrameConstPtr frame, const NetworkPacketPtr &packet)
+{
+  if(! frame->mat().isContinuous()) {
+    auto copy = make_shared<Frame>(frame->colorFormat(), frame->mat(), frame->byteOrder());
+    copy->copy_metadata(*frame);
+    frame = copy;
+  }
+  packet->movePayload(RawFrameHeader{*frame}.encode());
+  // The packet holds a reference to the frame until it's written to the socket, so no copy of the pixels is needed
+  packet->setBody(frame, reinterpret_cast<const char *>(frame->mat().data), frame->size());
+  return packet;
+}
+
+FramePtr DriverProtocol::decodeRawFrame(const NetworkPacketPtr &packet)
+{
+  if(packet->body())
+    return const_pointer_cast<Frame>(static_pointer_cast<const Frame>(packet->body()));
+  RawFrameHeader header;
+  auto payload = packet->payload();
+  if(! header.decode(payload.left(RawFrameHeader::SIZE)) || header.body_size() != payload.size() - RawFrameHeader::SIZE) {
+    qWarning() << "Invalid raw frame packet, size: " << payload.size();
+    return {};
+  }
+  auto frame = header.frame();
+  std::copy(payload.begin() + RawFrameHeader::SIZE, payload.end(), frame->data());
+  return frame;
+}
+
 FramePtr DriverProtocol::decodeFrame(const NetworkPacketPtr& packet)
 {
+  if(packet->name() == SendRawFrame)
+    return decodeRawFrame(packet);
   QByteArray image = packet->payload();
   if(format_parameters.compression && format_parameters.format == Configuration::Network_RAW) {
     image = qUncompress(image);
   }
-  vector<uint8_t> data(image.size());
-  move(begin(image), end(image), begin(data));
-  auto mat = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+  auto mat = cv::imdecode(cv::Mat{1, image.size(), CV_8U, const_cast<char *>(image.constData())}, cv::IMREAD_UNCHANGED);
   auto frame = make_shared<Frame>(mat.channels() == 1 ? Frame::Mono : Frame::BGR, mat, Frame::LittleEndian);
   //qDebug() << "FRAME data size: " << image.size() << ", bpp: " << frame->bpp() << ", res: " << frame->resolution() << ", channels: " << frame->channels();
 
   return frame;
 }
 
+FramePtr DriverProtocol::decodeCodedFrame(const NetworkPacketPtr &packet, FrameDecoders &decoders, const FramePoolPtr &pool)
+{
+  auto payload = packet->payload();
+  RawFrameHeader header;
+  if(payload.size() <= RawFrameHeader::SIZE || ! header.decode(payload.left(RawFrameHeader::SIZE))) {
+    qWarning() << "Invalid coded frame packet, size: " << payload.size();
+    return {};
+  }
+  const int id = static_cast<quint8>(payload[RawFrameHeader::SIZE]);
+  auto &decoder = decoders[id];
+  if(! decoder)
+    decoder = FrameCodec::create(static_cast<FrameCodec::Id>(id));
+  if(! decoder) {
+    qWarning() << "Unsupported frame codec: " << id;
+    return {};
+  }
+  // Codecs that can, decode previews larger than this client wants at a lower resolution
+  const auto size = decoder->decodedSize({header.width, header.height}, format_parameters.maxPreviewSize);
+  header.width = size.width();
+  header.height = size.height();
+  auto frame = header.frame(pool);
+  if(! decoder->decode(payload.mid(RawFrameHeader::SIZE + 1), *frame))
+    return {};
+  return frame;
+}
+
+NetworkPacket::BodySink DriverProtocol::rawFrameSink(const FramePoolPtr &pool)
+{
+  return { RawFrameHeader::SIZE, [pool](const QByteArray &data, qint64 body_size) -> NetworkPacket::BodySink::Buffer {
+    RawFrameHeader header;
+    if(! header.decode(data) || header.body_size() != body_size)
+      return {nullptr, {}};
+    auto frame = header.frame(pool);
+    return { reinterpret_cast<char *>(frame->data()), frame };
+  }};
+}
+
 NetworkPacketPtr DriverProtocol::setControl(const Imager::Control& control)
 {
-  return packetSetControl() << control2variant(control);
+  auto packet = packetSetControl();
+  packet->movePayload(ControlsCodec::encode({control}));
+  return packet;
+}
+
+NetworkPacketPtr DriverProtocol::setControls(const Imager::Controls& controls)
+{
+  auto packet = packetSetControls();
+  packet->movePayload(ControlsCodec::encode(controls));
+  return packet;
 }
 
-NetworkPacketPtr DriverProtocol::controlChanged(const Imager::Control& control)
+NetworkPacketPtr DriverProtocol::imagerChanges(const ImagerChanges &changes)
 {
-  return packetsignalControlChanged() << control2variant(control);
+  QVariantMap data;
+  if(! changes.fps.isNull())
+    data["fps"] = changes.fps;
+  if(! changes.temperature.isNull())
+    data["temperature"] = changes.temperature;
+  if(! changes.descriptors.isEmpty())
+    data["controls"] = ControlsCodec::encode(changes.descriptors.values());
+  if(! changes.controls.isEmpty())
+    data["control_values"] = ControlsCodec::encodeValues(changes.controls.values());
+  return packetsignalImagerChanges() << QVariant{data};
+}
+
+DriverProtocol::ImagerChanges DriverProtocol::decodeImagerChanges(const NetworkPacketPtr &packet, Imager::Controls &known)
+{
+  auto data = packet->payloadVariant().toMap();
+  ImagerChanges changes{data.value("fps"), data.value("temperature")};
+  Imager::Controls changed;
+  if(data.contains("controls") && ControlsCodec::decode(data.value("controls").toByteArray(), changed)) {
+    for(auto control: changed) {
+      auto existing = find_if(known.begin(), known.end(), [&](const Imager::Control &c) { return c.id == control.id; });
+      if(existing != known.end())
+        *existing = control;
+      else
+        known.push_back(control);
+    }
+  }
+  if(data.contains("control_values") && ! ControlsCodec::applyValues(data.value("control_values").toByteArray(), known, changed))
+    qWarning() << "Invalid control values in imager changes";
+  for(auto control: changed)
+    changes.controls[control.id] = control;
+  return changes;
 }
 
 Imager::Control DriverProtocol::decodeControl(const NetworkPacketPtr &packet) {
-  return variant2control(packet->payloadVariant());
+  Imager::Controls controls;
+  if(! ControlsCodec::decode(packet->payload(), controls) || controls.isEmpty())
+    return {};
+  return controls.first();
+}
+
+Imager::Controls DriverProtocol::decodeControls(const NetworkPacketPtr &packet) {
+  Imager::Controls controls;
+  ControlsCodec::decode(packet->payload(), controls);
+  return controls;
 }
 
 DriverProtocol::DriverStatus DriverProtocol::decodeStatus(const NetworkPacketPtr& packet)
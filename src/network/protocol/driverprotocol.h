@@ -21,10 +21,15 @@
 #define DRIVERPROTOCOL_H
 #include "network/protocol/protocol.h"
 #include <QList>
+#include <QHash>
+#include <QMap>
 #include "commons/fwd.h"
 #include "drivers/imager.h"
+#include "network/networkpacket.h"
 
 FWD_PTR(Frame)
+FWD_PTR(FramePool)
+FWD_PTR(FrameCodec)
 FWD_PTR(Camera)
 FWD_PTR(NetworkPacket)
 
@@ -44,12 +49,14 @@ public:
   ADD_PROTOCOL_PACKET_NAME(GetControls)
   ADD_PROTOCOL_PACKET_NAME(GetControlsReply)
   ADD_PROTOCOL_PACKET_NAME(SendFrame)
+  ADD_PROTOCOL_PACKET_NAME(SendRawFrame)
+  ADD_PROTOCOL_PACKET_NAME(SendCodedFrame)
+  ADD_PROTOCOL_PACKET_NAME(FrameReceived)
   ADD_PROTOCOL_PACKET_NAME(SetControl)
+  ADD_PROTOCOL_PACKET_NAME(SetControls)
   ADD_PROTOCOL_PACKET_NAME(SetROI)
 
-  ADD_PROTOCOL_PACKET_NAME(signalFPS)
-  ADD_PROTOCOL_PACKET_NAME(signalTemperature)
-  ADD_PROTOCOL_PACKET_NAME(signalControlChanged)
+  ADD_PROTOCOL_PACKET_NAME(signalImagerChanges)
   ADD_PROTOCOL_PACKET_NAME(signalCameraConnected)
   ADD_PROTOCOL_PACKET_NAME(signalDisconnected)
 
@@ -66,14 +73,43 @@ public:
   static void decode(Imager::Controls &controls, const NetworkPacketPtr &packet);
 
   static NetworkPacketPtr setControl(const Imager::Control &control);
-  static NetworkPacketPtr controlChanged(const Imager::Control &control);
   static Imager::Control decodeControl(const NetworkPacketPtr &packet);
+  /// A whole batch of controls, applied server side with Imager::setControls
+  static NetworkPacketPtr setControls(const Imager::Controls &controls);
+  static Imager::Controls decodeControls(const NetworkPacketPtr &packet);
 
+  /// fps, temperature and control changes of a short time window, sent together. Only the last value of each is kept, null values didn't change.
+  struct ImagerChanges {
+    QVariant fps;
+    QVariant temperature;
+    /// Changed values, sent as value only deltas (see ControlsCodec::encodeValues): the clients already have their descriptors
+    QMap<qlonglong, Imager::Control> controls;
+    /// Controls whose descriptor changed too (i.e. a new range), sent in full
+    QMap<qlonglong, Imager::Control> descriptors;
+    bool isEmpty() const { return fps.isNull() && temperature.isNull() && controls.isEmpty() && descriptors.isEmpty(); }
+  };
+  static NetworkPacketPtr imagerChanges(const ImagerChanges &changes);
+  /// Applies descriptors and values to known, the controls from GetControlsReply; the decoded controls has all the updated ones, in full
+  static ImagerChanges decodeImagerChanges(const NetworkPacketPtr &packet, Imager::Controls &known);
+
+  /// Client side: parameters agreed with the server, used to decode frames
   static void setFormatParameters(const FormatParameters &parameters);
-  static NetworkPacketPtr sendFrame(FrameConstPtr frame);
+  /// Server side: new codec for a stream of frames with these parameters, when the client supports one for them (nullptr: RAW or JPEG packets)
+  static FrameCodecPtr frameCodec(const FormatParameters &parameters);
+  /**
+   * Encodes frame as requested by one client, with codec if not null (see frameCodec).
+   * On congested links, lossy frames can be sent with a lower quality and downscaled (RAW frames are always sent as they are)
+   */
+  static NetworkPacketPtr sendFrame(FrameConstPtr frame, const FormatParameters &parameters, double jpeg_quality_factor = 1, double scale = 1, const FrameCodecPtr &codec = {});
   static FramePtr decodeFrame(const NetworkPacketPtr &packet);
-
-  static bool isForwardingEnabled();
+  /// Fills packet with frame as it is in memory, as in SendRawFrame packets: receivers can read it with rawFrameSink and decodeRawFrame, whatever its name
+  static NetworkPacketPtr rawFrame(FrameConstPtr frame, const NetworkPacketPtr &packet);
+  static FramePtr decodeRawFrame(const NetworkPacketPtr &packet);
+  /// Client side decoders of SendCodedFrame packets, by codec id. Decoders keep state: packets must be decoded in order, one at a time.
+  typedef QHash<int, FrameCodecPtr> FrameDecoders;
+  static FramePtr decodeCodedFrame(const NetworkPacketPtr &packet, FrameDecoders &decoders, const FramePoolPtr &pool = {});
+  /// Client side receiver for SendRawFrame packets: pixels are read straight into frames from the pool
+  static NetworkPacket::BodySink rawFrameSink(const FramePoolPtr &pool);
 
   struct DriverStatus {
     bool imager_running;
@@ -19,6 +19,8 @@
 #include "filesystemprotocol.h"
 #include <QFileInfo>
 #include "network/networkpacket.h"
+#include <QtEndian>
+#include <array>
 
 using namespace std;
 using namespace std::placeholders;
@@ -26,6 +28,13 @@ PROTOCOL_NAME_VALUE(Filesystem, FileInfo);
 PROTOCOL_NAME_VALUE(Filesystem, FileInfoReply);
 PROTOCOL_NAME_VALUE(Filesystem, Children);
 PROTOCOL_NAME_VALUE(Filesystem, ChildrenReply);
+PROTOCOL_NAME_VALUE(Filesystem, ReadFile);
+PROTOCOL_NAME_VALUE(Filesystem, ReadFileReply);
+PROTOCOL_NAME_VALUE(Filesystem, ListDirectory);
+PROTOCOL_NAME_VALUE(Filesystem, ListDirectoryReply);
+PROTOCOL_NAME_VALUE(Filesystem, signalDirectoryChanged);
+const qint64 FilesystemProtocol::MAX_CHUNK_SIZE;
+const int FilesystemProtocol::LISTING_PAGE_SIZE;
 
 namespace {
   QVariantMap fileInfo2Map(const QFileInfo &fileInfo) {
@@ -39,6 +48,26 @@ namespace {
   void decodeFileInfo(const QVariantMap &m, FilesystemProtocol::CreateFileInfo &createFileInfo) {
     createFileInfo(m["name"].toString(), m["path"].toString(), m["isFile"].toBool(), m["isDir"].toBool());
   }
+  QVariantMap listing2Map(const FilesystemProtocol::Listing &listing) {
+    return {
+      {"path", listing.path},
+      {"directoriesOnly", listing.directories_only},
+      {"patterns", listing.patterns},
+      {"offset", listing.offset},
+      {"limit", listing.limit},
+      {"total", listing.total},
+    };
+  }
+  FilesystemProtocol::Listing map2Listing(const QVariantMap &m) {
+    FilesystemProtocol::Listing listing;
+    listing.path = m["path"].toString();
+    listing.directories_only = m["directoriesOnly"].toBool();
+    listing.patterns = m["patterns"].toStringList();
+    listing.offset = m["offset"].toInt();
+    listing.limit = m["limit"].toInt();
+    listing.total = m["total"].toInt();
+    return listing;
+  }
 }
 
 NetworkPacketPtr FilesystemProtocol::childrenReply(const QList<QFileInfo>& filesInfo)
@@ -68,3 +97,107 @@ void FilesystemProtocol::decodeChildrenReply(const NetworkPacketPtr& packet, Cre
   }
 }
 
+NetworkPacketPtr FilesystemProtocol::listDirectory(const Listing &listing)
+{
+  return packetListDirectory() << QVariant{listing2Map(listing)};
+}
+
+FilesystemProtocol::Listing FilesystemProtocol::decodeListDirectory(const NetworkPacketPtr &packet)
+{
+  return map2Listing(packet->payloadVariant().toMap());
+}
+
+NetworkPacketPtr FilesystemProtocol::listDirectoryReply(const Listing &listing, const QList<QFileInfo> &page)
+{
+  auto reply = listing2Map(listing);
+  QVariantList entries;
+  transform(page.begin(), page.end(), back_inserter(entries), fileInfo2Map);
+  reply["entries"] = entries;
+  return packetListDirectoryReply() << QVariant{reply};
+}
+
+FilesystemProtocol::Listing FilesystemProtocol::decodeListDirectoryReply(const NetworkPacketPtr &packet, CreateFileInfo createFileInfo)
+{
+  const auto reply = packet->payloadVariant().toMap();
+  for(const auto &entry: reply["entries"].toList())
+    decodeFileInfo(entry.toMap(), createFileInfo);
+  return map2Listing(reply);
+}
+
+NetworkPacketPtr FilesystemProtocol::directoryChanged(const QString &path)
+{
+  return packetsignalDirectoryChanged() << QVariant{path};
+}
+
+QString FilesystemProtocol::decodeDirectoryChanged(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toString();
+}
+
+NetworkPacketPtr FilesystemProtocol::readFile(const QString& path, qint64 offset, qint64 size)
+{
+  return packetReadFile() << QVariant{QVariantMap{
+    {"path", path},
+    {"offset", offset},
+    {"size", size},
+  }};
+}
+
+void FilesystemProtocol::decodeReadFile(const NetworkPacketPtr& packet, QString& path, qint64& offset, qint64& size)
+{
+  auto m = packet->payloadVariant().toMap();
+  path = m["path"].toString();
+  offset = m["offset"].toLongLong();
+  size = m["size"].toLongLong();
+}
+
+NetworkPacketPtr FilesystemProtocol::readFileReply(const FileChunk& chunk, const shared_ptr<const void>& owner, const char* data, qint64 size)
+{
+  QByteArray header(FileChunk::HEADER_SIZE, '\0');
+  auto out = reinterpret_cast<uchar *>(header.data());
+  qToBigEndian<quint64>(chunk.offset, out);
+  qToBigEndian<quint64>(chunk.file_size, out + 8);
+  qToBigEndian<quint32>(chunk.crc32, out + 16);
+  qToBigEndian<quint32>(chunk.flags, out + 20);
+  auto packet = packetReadFileReply();
+  packet->movePayload(move(header));
+  if(size > 0)
+    packet->setBody(owner, data, size);
+  return packet;
+}
+
+FilesystemProtocol::FileChunk FilesystemProtocol::decodeReadFileReply(const NetworkPacketPtr& packet)
+{
+  FileChunk chunk;
+  const auto payload = packet->payload();
+  if(payload.size() < FileChunk::HEADER_SIZE) {
+    chunk.flags = FileChunk::Error;
+    chunk.data = "Truncated file chunk";
+    return chunk;
+  }
+  auto in = reinterpret_cast<const uchar *>(payload.constData());
+  chunk.offset = qFromBigEndian<quint64>(in);
+  chunk.file_size = qFromBigEndian<quint64>(in + 8);
+  chunk.crc32 = qFromBigEndian<quint32>(in + 16);
+  chunk.flags = qFromBigEndian<quint32>(in + 20);
+  chunk.data = QByteArray::fromRawData(payload.constData() + FileChunk::HEADER_SIZE, payload.size() - FileChunk::HEADER_SIZE);
+  return chunk;
+}
+
+quint32 FilesystemProtocol::crc32(const char* data, qint64 size, quint32 crc)
+{
+  static const auto table = [] {
+    array<quint32, 256> table;
+    for(quint32 i = 0; i < 256; i++) {
+      quint32 c = i;
+      for(int bit = 0; bit < 8; bit++)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for(qint64 i = 0; i < size; i++)
+    crc = table[(crc ^ static_cast<uchar>(data[i])) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
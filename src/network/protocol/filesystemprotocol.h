@@ -20,6 +20,8 @@
 #define FILESYSTEMPROTOCOL_H
 #include "network/protocol/protocol.h"
 #include <QList>
+#include <QStringList>
+#include <memory>
 #include "commons/fwd.h"
 FWD_PTR(NetworkPacket)
 
@@ -32,6 +34,11 @@ public:
   ADD_PROTOCOL_PACKET_NAME(FileInfoReply)
   ADD_PROTOCOL_PACKET_NAME(Children)
   ADD_PROTOCOL_PACKET_NAME(ChildrenReply)
+  ADD_PROTOCOL_PACKET_NAME(ReadFile)
+  ADD_PROTOCOL_PACKET_NAME(ReadFileReply)
+  ADD_PROTOCOL_PACKET_NAME(ListDirectory)
+  ADD_PROTOCOL_PACKET_NAME(ListDirectoryReply)
+  ADD_PROTOCOL_PACKET_NAME(signalDirectoryChanged)
   
   typedef std::function<void(const QString &name, const QString &path, bool isFile, bool isDir)> CreateFileInfo;
   
@@ -39,6 +46,52 @@ public:
   static void decodeFileInfoReply(const NetworkPacketPtr &packet, CreateFileInfo createFileInfo);
   static NetworkPacketPtr childrenReply(const QList<QFileInfo> &filesInfo);
   static void decodeChildrenReply(const NetworkPacketPtr &packet, CreateFileInfo createFileInfo);
+
+  /**
+   * One page of a directory listing, directories first then by name. Filtering happens on the server, so that directories with
+   * hundreds of thousands of frames cost a page of entries, not the whole list. Name patterns (wildcards, as QDir::nameFilters)
+   * apply to files only, unless directories_only is set: subdirectories stay visible to browse into.
+   */
+  struct Listing {
+    QString path;
+    bool directories_only = false;
+    QStringList patterns;
+    int offset = 0;
+    int limit = 0;
+    /// Reply only: entries matching the filter in the whole directory
+    int total = 0;
+  };
+  static const int LISTING_PAGE_SIZE = 200;
+  static NetworkPacketPtr listDirectory(const Listing &listing);
+  static Listing decodeListDirectory(const NetworkPacketPtr &packet);
+  static NetworkPacketPtr listDirectoryReply(const Listing &listing, const QList<QFileInfo> &page);
+  static Listing decodeListDirectoryReply(const NetworkPacketPtr &packet, CreateFileInfo createFileInfo);
+  /// Broadcast when a directory listed by a client changes: cached pages of it are stale
+  static NetworkPacketPtr directoryChanged(const QString &path);
+  static QString decodeDirectoryChanged(const NetworkPacketPtr &packet);
+
+  /**
+   * A chunk of a file, read from offset: ReadFileReply carries a fixed size big endian header, followed by the data.
+   * Files still growing (recordings being written) can be tailed by asking again past the end, until Growing is no longer set.
+   */
+  struct FileChunk {
+    enum Flags { Error = 1, EndOfFile = 2, Growing = 4 };
+    static const int HEADER_SIZE = 24;
+    quint64 offset = 0;
+    quint64 file_size = 0;
+    /// CRC-32 (as in zlib) of the chunk data
+    quint32 crc32 = 0;
+    quint32 flags = 0;
+    /// Chunk data, or the error message. Decoded chunks point into the packet payload, and are only valid as long as the packet.
+    QByteArray data;
+  };
+  static const qint64 MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+  static NetworkPacketPtr readFile(const QString &path, qint64 offset, qint64 size);
+  static void decodeReadFile(const NetworkPacketPtr &packet, QString &path, qint64 &offset, qint64 &size);
+  /// The chunk data is sent straight from data, without copying it into the payload: owner must keep it valid
+  static NetworkPacketPtr readFileReply(const FileChunk &chunk, const std::shared_ptr<const void> &owner, const char *data, qint64 size);
+  static FileChunk decodeReadFileReply(const NetworkPacketPtr &packet);
+  static quint32 crc32(const char *data, qint64 size, quint32 crc = 0);
 };
 
 #endif // FILESYSTEMPROTOCOL_H
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "focusprotocol.h"
+#include "network/networkpacket.h"
+
+using namespace std;
+
+PROTOCOL_NAME_VALUE(Focus, GetFocus);
+PROTOCOL_NAME_VALUE(Focus, GetFocusReply);
+
+NetworkPacketPtr FocusProtocol::getFocus(quint64 after)
+{
+  return packetGetFocus() << QVariant{static_cast<qulonglong>(after)};
+}
+
+quint64 FocusProtocol::decodeGetFocus(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toULongLong();
+}
+
+NetworkPacketPtr FocusProtocol::focusReply(const QVariantList &measurements)
+{
+  return packetGetFocusReply() << QVariant{measurements};
+}
+
+QVariantList FocusProtocol::decodeFocusReply(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toList();
+}
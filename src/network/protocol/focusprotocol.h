@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FOCUSPROTOCOL_H
+#define FOCUSPROTOCOL_H
+#include "network/protocol/protocol.h"
+#include <QVariantList>
+#include "commons/fwd.h"
+FWD_PTR(NetworkPacket)
+
+class FocusProtocol : public NetworkProtocol
+{
+public:
+  ADD_PROTOCOL_PACKET_NAME(GetFocus)
+  ADD_PROTOCOL_PACKET_NAME(GetFocusReply)
+
+  /// Asks for the focus measurements of the frames after sequence
+  static NetworkPacketPtr getFocus(quint64 after);
+  static quint64 decodeGetFocus(const NetworkPacketPtr &packet);
+  /// measurements as returned by FocusAssist::measurements()
+  static NetworkPacketPtr focusReply(const QVariantList &measurements);
+  static QVariantList decodeFocusReply(const NetworkPacketPtr &packet);
+};
+
+#endif // FOCUSPROTOCOL_H
@@ -0,0 +1,421 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/protocol/framecodec.h"
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/compressedser.h"
+#include "commons/packedpixels.h"
+#include "commons/definitions.h"
+#include <opencv2/opencv.hpp>
+#include <boost/endian/conversion.hpp>
+#include <QDataStream>
+#include <QtEndian>
+#include <QDebug>
+#include <QVector>
+#include <algorithm>
+#include <map>
+
+#if HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+using namespace std;
+
+namespace {
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+
+  bool is_bayer(Frame::ColorFormat format) {
+    return format != Frame::Mono && format != Frame::RGB && format != Frame::BGR;
+  }
+
+  bool needs_swap(const Frame &frame) {
+    return frame.bpp() > 8 && (native_little_endian ? frame.byteOrder() == Frame::BigEndian : frame.byteOrder() == Frame::LittleEndian);
+  }
+
+  FramePtr converted(const Frame &source, Frame::ColorFormat format, const cv::Mat &image, Frame::ByteOrder byte_order) {
+    auto frame = make_shared<Frame>(format, image, byte_order, Frame::ShareBuffer);
+    frame->copy_metadata(source);
+    return frame;
+  }
+
+  /// 8 bit, and debayered: lossy compression would mix up the mosaic colours
+  FrameConstPtr lossy_8bit(const FrameConstPtr &frame) {
+    if(frame->bpp() == 8 && ! is_bayer(frame->colorFormat()))
+      return frame;
+    cv::Mat image = frame->analysis().as_8bit();
+    auto format = frame->colorFormat();
+    if(is_bayer(format)) {
+      static const map<Frame::ColorFormat, int> debayer {
+        {Frame::Bayer_RGGB, cv::COLOR_BayerRG2BGR},
+        {Frame::Bayer_GBRG, cv::COLOR_BayerGB2BGR},
+        {Frame::Bayer_GRBG, cv::COLOR_BayerGR2BGR},
+        {Frame::Bayer_BGGR, cv::COLOR_BayerBG2BGR},
+      };
+      cv::cvtColor(image, image, debayer.at(format));
+      format = Frame::BGR;
+    }
+    return converted(*frame, format, image, frame->byteOrder());
+  }
+
+  class ZstdCodec : public FrameCodec {
+  public:
+    Id id() const override { return Zstd; }
+    QByteArray encode(const Frame &frame, int) override {
+      return CompressedSER::compress(frame.mat().data, frame.size(), 1);
+    }
+    bool decode(const QByteArray &data, Frame &frame) override {
+      return CompressedSER::decompress(data, frame.data(), frame.size());
+    }
+  };
+
+  // Layout code, little endian, then the pixels
+  class PackedCodec : public FrameCodec {
+  public:
+    Id id() const override { return Packed; }
+    QByteArray encode(const Frame &frame, int) override {
+      const auto layout = PackedPixels::layout(frame);
+      const size_t count = frame.size() / sizeof(uint16_t);
+      const size_t size = layout.packed() ? PackedPixels::packed_size(count, layout) : frame.size();
+      QByteArray data(static_cast<int>(header_size + size), Qt::Uninitialized);
+      qToLittleEndian<quint16>(layout.code(), data.data());
+      auto pixels = reinterpret_cast<uint8_t*>(data.data() + header_size);
+      if(layout.packed())
+        PackedPixels::pack(reinterpret_cast<const uint16_t*>(frame.mat().data), pixels, count, layout, PackedPixels::needs_swap(frame));
+      else
+        std::copy(frame.mat().data, frame.mat().data + frame.size(), pixels);
+      return data;
+    }
+    bool decode(const QByteArray &data, Frame &frame) override {
+      if(data.size() < header_size)
+        return false;
+      const auto layout = PackedPixels::Layout::from_code(qFromLittleEndian<quint16>(data.constData()));
+      const size_t count = frame.size() / sizeof(uint16_t);
+      const size_t size = layout.packed() ? PackedPixels::packed_size(count, layout) : frame.size();
+      if(! layout.valid() || (layout.packed() && frame.bpp() != 16) || static_cast<size_t>(data.size() - header_size) != size)
+        return false;
+      auto pixels = reinterpret_cast<const uint8_t*>(data.constData() + header_size);
+      if(layout.packed())
+        PackedPixels::unpack(pixels, reinterpret_cast<uint16_t*>(frame.data()), count, layout, PackedPixels::needs_swap(frame));
+      else
+        std::copy(pixels, pixels + size, frame.data());
+      return true;
+    }
+  private:
+    static const int header_size = sizeof(quint16);
+  };
+
+  class WebPCodec : public FrameCodec {
+  public:
+    static bool supported() {
+      // OpenCV may be built without libwebp
+      static const bool supported = [] {
+        try {
+          vector<uchar> data;
+          return cv::imencode(".webp", cv::Mat{8, 8, CV_8UC3, cv::Scalar::all(0)}, data) && ! data.empty();
+        } catch(const cv::Exception &) {
+          return false;
+        }
+      }();
+      return supported;
+    }
+    Id id() const override { return WebP; }
+    FrameConstPtr prepare(const FrameConstPtr &frame) const override {
+      auto prepared = lossy_8bit(frame);
+      return prepared == frame ? FrameCodec::prepare(frame) : prepared;
+    }
+    QByteArray encode(const Frame &frame, int quality) override {
+      vector<uchar> data;
+      cv::imencode(".webp", frame.mat(), data, {cv::IMWRITE_WEBP_QUALITY, max(1, min(quality, 100))});
+      return QByteArray(reinterpret_cast<const char *>(data.data()), static_cast<int>(data.size()));
+    }
+    bool decode(const QByteArray &data, Frame &frame) override {
+      cv::Mat image = cv::imdecode(cv::Mat{1, data.size(), CV_8U, const_cast<char *>(data.constData())}, cv::IMREAD_UNCHANGED);
+      if(image.empty() || image.depth() != CV_8U || image.cols != frame.resolution().width() || image.rows != frame.resolution().height())
+        return false;
+      // Grayscale WebP images are decoded as colour ones
+      if(image.channels() != frame.channels()) {
+        static const map<pair<int, int>, int> conversions {
+          {{3, 1}, cv::COLOR_BGR2GRAY}, {{4, 1}, cv::COLOR_BGRA2GRAY}, {{4, 3}, cv::COLOR_BGRA2BGR}, {{1, 3}, cv::COLOR_GRAY2BGR},
+        };
+        auto conversion = conversions.find({image.channels(), frame.channels()});
+        if(conversion == conversions.end())
+          return false;
+        cv::cvtColor(image, image, conversion->second);
+      }
+      cv::Mat destination = frame.mat();
+      image.copyTo(destination);
+      return true;
+    }
+  };
+
+#if HAVE_TURBOJPEG
+  class JpegCodec : public FrameCodec {
+  public:
+    JpegCodec() : compressor{tjInitCompress()}, decompressor{tjInitDecompress()} {}
+    ~JpegCodec() {
+      if(compressor)
+        tjDestroy(compressor);
+      if(decompressor)
+        tjDestroy(decompressor);
+    }
+    Id id() const override { return Jpeg; }
+    FrameConstPtr prepare(const FrameConstPtr &frame) const override {
+      auto prepared = lossy_8bit(frame);
+      return prepared == frame ? FrameCodec::prepare(frame) : prepared;
+    }
+    QByteArray encode(const Frame &frame, int quality) override {
+      // Straight from the frame buffer: no intermediate copy, unlike cv::imencode
+      const cv::Mat image = frame.mat();
+      const int subsampling = frame.channels() == 1 ? TJSAMP_GRAY : quality >= 90 ? TJSAMP_444 : TJSAMP_420;
+      unsigned char *jpeg = nullptr;
+      unsigned long size = 0;
+      if(tjCompress2(compressor, image.data, image.cols, static_cast<int>(image.step), image.rows, pixel_format(frame), &jpeg, &size,
+                     subsampling, max(1, min(quality, 100)), TJFLAG_FASTDCT) != 0) {
+        qWarning() << "JPEG encoding failed:" << tjGetErrorStr();
+        tjFree(jpeg);
+        return {};
+      }
+      QByteArray data(reinterpret_cast<const char *>(jpeg), static_cast<int>(size));
+      tjFree(jpeg);
+      return data;
+    }
+    QSize decodedSize(const QSize &encoded, const QSize &fit) const override {
+      if(fit.isEmpty() || (encoded.width() <= fit.width() && encoded.height() <= fit.height()))
+        return encoded;
+      // The smallest DCT scaling still at least as big as the frame scaled to fit: the display does the rest
+      const double needed = min(static_cast<double>(fit.width()) / encoded.width(), static_cast<double>(fit.height()) / encoded.height());
+      int denominator = 1;
+      while(denominator < 8 && 1. / (denominator * 2) >= needed)
+        denominator *= 2;
+      const tjscalingfactor factor{1, denominator};
+      return {TJSCALED(encoded.width(), factor), TJSCALED(encoded.height(), factor)};
+    }
+    bool decode(const QByteArray &data, Frame &frame) override {
+      auto jpeg = reinterpret_cast<const unsigned char *>(data.constData());
+      int width, height, subsampling, colorspace;
+      if(tjDecompressHeader3(decompressor, jpeg, data.size(), &width, &height, &subsampling, &colorspace) != 0)
+        return false;
+      const cv::Mat destination = frame.mat();
+      static const int scalings[] = {1, 2, 4, 8};
+      const bool scaled_to_frame = any_of(begin(scalings), end(scalings), [&](int denominator) {
+        const tjscalingfactor factor{1, denominator};
+        return TJSCALED(width, factor) == destination.cols && TJSCALED(height, factor) == destination.rows;
+      });
+      if(frame.bpp() != 8 || ! scaled_to_frame)
+        return false;
+      // Given the frame geometry, libjpeg-turbo picks that same scaling, decoding straight into the frame buffer
+      if(tjDecompress2(decompressor, jpeg, data.size(), destination.data, destination.cols, static_cast<int>(destination.step), destination.rows,
+                       pixel_format(frame), TJFLAG_FASTDCT) != 0) {
+        qWarning() << "JPEG decoding failed:" << tjGetErrorStr();
+        return false;
+      }
+      return true;
+    }
+  private:
+    tjhandle compressor;
+    tjhandle decompressor;
+    static int pixel_format(const Frame &frame) {
+      return frame.channels() == 1 ? TJPF_GRAY : frame.colorFormat() == Frame::RGB ? TJPF_RGB : TJPF_BGR;
+    }
+  };
+#endif
+
+  class TileDeltaCodec : public FrameCodec {
+  public:
+    TileDeltaCodec(bool use_zstd) : use_zstd{use_zstd && CompressedSER::available()} {}
+    Id id() const override { return TileDelta; }
+    FrameConstPtr prepare(const FrameConstPtr &frame) const override;
+    QByteArray encode(const Frame &frame, int quality) override;
+    bool decode(const QByteArray &data, Frame &frame) override;
+  private:
+    enum Kind : quint8 { Keyframe, Delta };
+    enum Compression : quint8 { Zlib, ZstdCompression };
+    static const int tile_size = 32;
+    static const int keyframe_interval = 30;
+    const bool use_zstd;
+    cv::Mat keyframe;
+    quint32 keyframe_id = 0;
+    int deltas = 0;
+    static QVector<cv::Rect> tiles(const cv::Size &size, int tile_size);
+    QByteArray compress(const uchar *data, int size) const;
+    static bool decompress(quint8 compression, const QByteArray &data, uchar *destination, int size);
+  };
+}
+
+FrameCodec::~FrameCodec()
+{
+}
+
+FrameConstPtr FrameCodec::prepare(const FrameConstPtr &frame) const
+{
+  if(frame->mat().isContinuous())
+    return frame;
+  auto copy = converted(*frame, frame->colorFormat(), frame->mat().clone(), frame->byteOrder());
+  return copy;
+}
+
+FrameCodecPtr FrameCodec::create(Id id, bool use_zstd)
+{
+  switch(id) {
+    case Zstd:
+      return CompressedSER::available() ? make_shared<ZstdCodec>() : FrameCodecPtr{};
+    case WebP:
+      return WebPCodec::supported() ? make_shared<WebPCodec>() : FrameCodecPtr{};
+    case TileDelta:
+      return make_shared<TileDeltaCodec>(use_zstd);
+    case Packed:
+      return make_shared<PackedCodec>();
+    case Jpeg:
+#if HAVE_TURBOJPEG
+      return make_shared<JpegCodec>();
+#else
+      return {};
+#endif
+  }
+  return {};
+}
+
+QSize FrameCodec::decodedSize(const QSize &encoded, const QSize &) const
+{
+  return encoded;
+}
+
+QList<FrameCodec::Id> FrameCodec::available()
+{
+  QList<Id> ids;
+  for(auto id: {Zstd, WebP, TileDelta, Jpeg, Packed})
+    if(create(id))
+      ids.push_back(id);
+  return ids;
+}
+
+FrameConstPtr TileDeltaCodec::prepare(const FrameConstPtr &frame) const
+{
+  // Differences are measured on pixel values, so they must be in native byte order
+  if(! needs_swap(*frame))
+    return FrameCodec::prepare(frame);
+  return converted(*frame, frame->colorFormat(), frame->analysis().native_endian(), native_little_endian ? Frame::LittleEndian : Frame::BigEndian);
+}
+
+QVector<cv::Rect> TileDeltaCodec::tiles(const cv::Size &size, int tile_size)
+{
+  QVector<cv::Rect> tiles;
+  for(int y = 0; y < size.height; y += tile_size)
+    for(int x = 0; x < size.width; x += tile_size)
+      tiles.push_back({x, y, min(tile_size, size.width - x), min(tile_size, size.height - y)});
+  return tiles;
+}
+
+QByteArray TileDeltaCodec::compress(const uchar *data, int size) const
+{
+  return use_zstd ? CompressedSER::compress(data, size, 1) : qCompress(data, size, 1);
+}
+
+bool TileDeltaCodec::decompress(quint8 compression, const QByteArray &data, uchar *destination, int size)
+{
+  if(compression == ZstdCompression)
+    return CompressedSER::decompress(data, destination, size);
+  auto uncompressed = qUncompress(data);
+  if(uncompressed.size() != size)
+    return false;
+  std::copy(uncompressed.begin(), uncompressed.end(), destination);
+  return true;
+}
+
+QByteArray TileDeltaCodec::encode(const Frame &frame, int quality)
+{
+  const cv::Mat image = frame.mat();
+  const bool key = keyframe.empty() || keyframe.size() != image.size() || keyframe.type() != image.type() || deltas >= keyframe_interval;
+  QByteArray data;
+  QDataStream s(&data, QIODevice::WriteOnly);
+  s << static_cast<quint8>(key ? Keyframe : Delta) << static_cast<quint8>(use_zstd ? ZstdCompression : Zlib);
+  if(key) {
+    keyframe = image.clone();
+    keyframe_id++;
+    deltas = 0;
+    s << keyframe_id;
+    data.append(compress(keyframe.data, static_cast<int>(keyframe.total() * keyframe.elemSize())));
+    return data;
+  }
+  deltas++;
+  // Sensor noise changes every pixel a little: tiles changing less than this, on average, are left as in the keyframe. Quality 100 sends any change.
+  const double threshold = (100 - max(1, min(quality, 100))) / 20. * (image.depth() == CV_16U ? 256 : 1);
+  QVector<quint32> changed;
+  QByteArray pixels;
+  const auto all_tiles = tiles(image.size(), tile_size);
+  for(int index = 0; index < all_tiles.size(); index++) {
+    const auto &tile = all_tiles[index];
+    const double difference = cv::norm(image(tile), keyframe(tile), cv::NORM_L1) / (tile.area() * image.channels());
+    if(difference <= threshold)
+      continue;
+    changed.push_back(index);
+    const int row_bytes = tile.width * static_cast<int>(image.elemSize());
+    for(int row = tile.y; row < tile.y + tile.height; row++)
+      pixels.append(reinterpret_cast<const char *>(image.ptr(row, tile.x)), row_bytes);
+  }
+  s << keyframe_id << static_cast<quint16>(tile_size) << changed;
+  data.append(compress(reinterpret_cast<const uchar *>(pixels.constData()), pixels.size()));
+  return data;
+}
+
+bool TileDeltaCodec::decode(const QByteArray &data, Frame &frame)
+{
+  QDataStream s(data);
+  quint8 kind, compression;
+  quint32 id;
+  s >> kind >> compression >> id;
+  cv::Mat image = frame.mat();
+  if(s.status() != QDataStream::Ok || ! image.isContinuous())
+    return false;
+  if(kind == Keyframe) {
+    if(! decompress(compression, data.mid(s.device()->pos()), image.data, static_cast<int>(image.total() * image.elemSize())))
+      return false;
+    keyframe = image.clone();
+    keyframe_id = id;
+    return true;
+  }
+  // Frames before the first keyframe, or after a lost one, can't be rebuilt
+  if(kind != Delta || keyframe.empty() || id != keyframe_id || keyframe.size() != image.size() || keyframe.type() != image.type())
+    return false;
+  quint16 encoded_tile_size;
+  QVector<quint32> changed;
+  s >> encoded_tile_size >> changed;
+  if(s.status() != QDataStream::Ok || encoded_tile_size == 0)
+    return false;
+  const auto all_tiles = tiles(image.size(), encoded_tile_size);
+  int pixels_size = 0;
+  for(auto index: changed) {
+    if(index >= static_cast<quint32>(all_tiles.size()))
+      return false;
+    pixels_size += all_tiles[index].area() * static_cast<int>(image.elemSize());
+  }
+  QByteArray pixels(pixels_size, Qt::Uninitialized);
+  if(! decompress(compression, data.mid(s.device()->pos()), reinterpret_cast<uchar *>(pixels.data()), pixels_size))
+    return false;
+  keyframe.copyTo(image);
+  auto source = pixels.constData();
+  for(auto index: changed) {
+    const auto &tile = all_tiles[index];
+    const int row_bytes = tile.width * static_cast<int>(image.elemSize());
+    for(int row = tile.y; row < tile.y + tile.height; row++, source += row_bytes)
+      std::copy(source, source + row_bytes, reinterpret_cast<char *>(image.ptr(row, tile.x)));
+  }
+  return true;
+}
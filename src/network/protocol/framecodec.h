@@ -0,0 +1,69 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSize>
+#include "commons/fwd.h"
+
+FWD_PTR(Frame)
+FWD_PTR(FrameCodec)
+
+/**
+ * Preview frame encodings beyond the original RAW and JPEG packets, sent as DriverProtocol::SendCodedFrame.
+ * The packet header describes the decoded frame; codecs only deal with pixels.
+ * Clients list the codecs they can decode in Hello, and the server falls back to RAW or JPEG packets for the others.
+ * Codecs can be stateful (TileDelta keeps its keyframe): each stream needs its own instance on both ends, used by one thread at a time.
+ */
+class FrameCodec
+{
+public:
+  enum Id : quint8 {
+    /// Lossless, zstd compressed pixels
+    Zstd = 1,
+    /// Lossy, 8 bit, Bayer frames debayered first
+    WebP = 2,
+    /// Keyframes, then only the tiles that changed against the last keyframe, zstd (or zlib) compressed
+    TileDelta = 3,
+    /// Lossy, 8 bit, with libjpeg-turbo: Bayer frames debayered first, colour ones chroma subsampled. Decodable at 1/2, 1/4 or 1/8 of the size
+    Jpeg = 4,
+    /// Lossless, 16 bit pixels packed to 10 or 12 bits when they use no more (see PackedPixels), the others as they are
+    Packed = 5,
+  };
+  virtual ~FrameCodec();
+  virtual Id id() const = 0;
+  /// Frame that will actually be encoded, when the codec can't take frame as it is (i.e. WebP needs 8 bit)
+  virtual FrameConstPtr prepare(const FrameConstPtr &frame) const;
+  /// quality is 1-100, for lossy codecs
+  virtual QByteArray encode(const Frame &frame, int quality) = 0;
+  /// Decodes data into frame, already allocated with the encoded frame geometry, or the one from decodedSize. False if it can't be decoded (i.e. a delta without its keyframe)
+  virtual bool decode(const QByteArray &data, Frame &frame) = 0;
+  /// Resolution decode() produces for a frame encoded at encoded, when only a frame fitting fit is needed (empty: any size). Codecs that can't decode at a lower resolution return encoded
+  virtual QSize decodedSize(const QSize &encoded, const QSize &fit) const;
+
+  /// nullptr if id is unknown, or not available in this build. use_zstd selects the TileDelta compression
+  static FrameCodecPtr create(Id id, bool use_zstd = true);
+  /// Codecs this build can encode and decode
+  static QList<Id> available();
+};
+
+#endif // FRAMECODEC_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "histogramprotocol.h"
+#include "network/networkpacket.h"
+#include <QVariantList>
+
+using namespace std;
+
+PROTOCOL_NAME_VALUE(Histogram, SetHistogramEnabled);
+PROTOCOL_NAME_VALUE(Histogram, signalHistogram);
+
+NetworkPacketPtr HistogramProtocol::setHistogramEnabled(bool enabled)
+{
+  return packetSetHistogramEnabled() << QVariant{enabled};
+}
+
+bool HistogramProtocol::decodeSetHistogramEnabled(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toBool();
+}
+
+NetworkPacketPtr HistogramProtocol::histogram(const QList<HistogramSummary> &channels)
+{
+  QVariantList encoded;
+  for(const auto &channel: channels) {
+    const auto data = channel.encode();
+    encoded.push_back(QByteArray{reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size())});
+  }
+  return packetsignalHistogram() << QVariant{encoded};
+}
+
+QList<HistogramSummary> HistogramProtocol::decodeHistogram(const NetworkPacketPtr &packet)
+{
+  QList<HistogramSummary> channels;
+  for(const auto &encoded: packet->payloadVariant().toList()) {
+    const auto bytes = encoded.toByteArray();
+    HistogramSummary channel;
+    if(! HistogramSummary::decode(vector<uint8_t>(bytes.begin(), bytes.end()), channel))
+      return {};
+    channels.push_back(channel);
+  }
+  return channels;
+}
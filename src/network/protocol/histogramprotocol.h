@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTOGRAMPROTOCOL_H
+#define HISTOGRAMPROTOCOL_H
+#include "network/protocol/protocol.h"
+#include <QList>
+#include "commons/fwd.h"
+#include "commons/histogramsummary.h"
+FWD_PTR(NetworkPacket)
+
+class HistogramProtocol : public NetworkProtocol
+{
+public:
+  ADD_PROTOCOL_PACKET_NAME(SetHistogramEnabled)
+  ADD_PROTOCOL_PACKET_NAME(signalHistogram)
+
+  /// Clients showing the histogram get signalHistogram packets, at the histogram refresh rate, until they disable them
+  static NetworkPacketPtr setHistogramEnabled(bool enabled);
+  static bool decodeSetHistogramEnabled(const NetworkPacketPtr &packet);
+  /// Summaries of the raw frame: one for grayscale frames, red, green and blue otherwise
+  static NetworkPacketPtr histogram(const QList<HistogramSummary> &channels);
+  /// Empty on malformed packets
+  static QList<HistogramSummary> decodeHistogram(const NetworkPacketPtr &packet);
+};
+
+#endif // HISTOGRAMPROTOCOL_H
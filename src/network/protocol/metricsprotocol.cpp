@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "metricsprotocol.h"
+#include "network/networkpacket.h"
+
+using namespace std;
+
+PROTOCOL_NAME_VALUE(Metrics, GetMetrics);
+PROTOCOL_NAME_VALUE(Metrics, GetMetricsReply);
+
+NetworkPacketPtr MetricsProtocol::metricsReply(const QVariantList &snapshot)
+{
+  return packetGetMetricsReply() << QVariant{snapshot};
+}
+
+QVariantList MetricsProtocol::decodeMetricsReply(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toList();
+}
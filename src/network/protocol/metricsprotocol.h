@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICSPROTOCOL_H
+#define METRICSPROTOCOL_H
+#include "network/protocol/protocol.h"
+#include <QVariantList>
+#include "commons/fwd.h"
+FWD_PTR(NetworkPacket)
+
+class MetricsProtocol : public NetworkProtocol
+{
+public:
+  ADD_PROTOCOL_PACKET_NAME(GetMetrics)
+  ADD_PROTOCOL_PACKET_NAME(GetMetricsReply)
+
+  /// snapshot as returned by Metrics::snapshot()
+  static NetworkPacketPtr metricsReply(const QVariantList &snapshot);
+  static QVariantList decodeMetricsReply(const NetworkPacketPtr &packet);
+};
+
+#endif // METRICSPROTOCOL_H
@@ -0,0 +1,66 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2019  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/protocol/networkpackettype.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+  struct Registry {
+    QStringList types;
+    bool sealed = false;
+  };
+  // Function static: PROTOCOL_NAME_VALUE definitions in other translation units may be initialized first
+  Registry &registry() {
+    static Registry registry;
+    return registry;
+  }
+}
+
+NetworkPacketType NetworkPacketTypes::intern(const char *name)
+{
+  NetworkPacketType type = QString::fromLatin1(name);
+  auto &r = registry();
+  if(r.sealed)
+    qWarning() << "Packet type registered after the types table was announced, it will be sent by name:" << type;
+  else
+    r.types.push_back(type);
+  return type;
+}
+
+const QStringList &NetworkPacketTypes::all()
+{
+  auto &r = registry();
+  if(! r.sealed) {
+    r.sealed = true;
+    r.types.removeDuplicates();
+    std::sort(r.types.begin(), r.types.end());
+    if(r.types.size() > MAX_IDS)
+      r.types.erase(r.types.begin() + MAX_IDS, r.types.end());
+  }
+  return r.types;
+}
+
+NetworkPacketTypes::Ids NetworkPacketTypes::ids(const QStringList &table)
+{
+  Ids ids;
+  for(int i = 0; i < std::min(table.size(), MAX_IDS); i++)
+    ids[table[i]] = static_cast<quint8>(i + 1);
+  return ids;
+}
@@ -21,7 +21,25 @@
 #define NETWORK_PACKET_TYPE_H
 
 #include <QString>
+#include <QStringList>
+#include <QHash>
 
 typedef QString NetworkPacketType;
 
+/**
+ * Registry of the packet types known to this build, filled at static initialization by PROTOCOL_NAME_VALUE.
+ * Each peer announces its table in Hello/HelloReply: packets sent to it then carry a single id byte (the 1 based index in the table) instead of their name.
+ * Received ids resolve to the registered QString, so known packet names are never allocated again.
+ */
+namespace NetworkPacketTypes {
+  typedef QHash<NetworkPacketType, quint8> Ids;
+  static const int MAX_IDS = 255;
+  /// Registers name, and returns it
+  NetworkPacketType intern(const char *name);
+  /// Registered types, sorted, at most MAX_IDS. No more types can be registered after the first call.
+  const QStringList &all();
+  /// Outgoing ids for a peer that announced the types table
+  Ids ids(const QStringList &table);
+}
+
 #endif
@@ -29,23 +29,54 @@ NetworkPacketPtr NetworkProtocol::packet(const NetworkPacketType& name)
 
 NetworkPacketPtr NetworkProtocol::hello(const FormatParameters &parameters)
 {
+  QVariantList codecs;
+  for(auto codec: parameters.codecs)
+    codecs.push_back(codec);
   QVariantMap params {
     {"format", static_cast<int>(parameters.format) },
     {"compression", parameters.compression },
     {"force8bit", parameters.force8bit},
     {"jpegQuality", parameters.jpegQuality},
+    {"maxPreviewSize", parameters.maxPreviewSize},
+    {"viewport", parameters.viewport},
+    {"maxFrameRate", parameters.maxFrameRate},
+    {"udpPort", parameters.udpPort},
+    {"udpGroup", parameters.udpGroup},
+    {"codecs", codecs},
+    {"localFrames", parameters.localFrames},
   };
+  addPacketTypes(params);
   return packetHello() << params;
 }
 
+void NetworkProtocol::addPacketTypes(QVariantMap &payload)
+{
+  payload["packetTypes"] = NetworkPacketTypes::all();
+}
+
+QStringList NetworkProtocol::packetTypes(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toMap().value("packetTypes").toStringList();
+}
+
 NetworkProtocol::FormatParameters NetworkProtocol::decodeHello(const NetworkPacketPtr& packet)
 {
   QVariantMap params = packet->payloadVariant().toMap();
+  QList<int> codecs;
+  for(auto codec: params["codecs"].toList())
+    codecs.push_back(codec.toInt());
   return {
     static_cast<Configuration::NetworkImageFormat>(params["format"].toInt()),
     params["compression"].toBool(),
     params["force8bit"].toBool(),
     params["jpegQuality"].toInt(),
+    params["maxPreviewSize"].toSize(),
+    params["viewport"].toRect(),
+    params["maxFrameRate"].toDouble(),
+    static_cast<quint16>(params["udpPort"].toUInt()),
+    params["udpGroup"].toString(),
+    codecs,
+    params["localFrames"].toBool(),
   };
 }
 
@@ -21,6 +21,10 @@
 #define NETWORK_PROTOCOL_H
 
 #include <QString>
+#include <QSize>
+#include <QRect>
+#include <QList>
+#include <QVariantMap>
 #include "commons/configuration.h"
 #include "network/protocol/networkpackettype.h"
 #include "commons/fwd.h"
@@ -32,7 +36,7 @@ FWD_PTR(NetworkPacket)
 #define ADD_PROTOCOL_PACKET_NAME(name) ADD_PROTOCOL_NAME(name) \
 static NetworkPacketPtr packet ## name() { return NetworkProtocol::packet(name); }
 
-#define PROTOCOL_NAME__CUSTOM_VALUE(Area, name, value) const NetworkPacketType Area ## Protocol::name = value
+#define PROTOCOL_NAME__CUSTOM_VALUE(Area, name, value) const NetworkPacketType Area ## Protocol::name = NetworkPacketTypes::intern(value)
 #define PROTOCOL_NAME_VALUE(Area, name) PROTOCOL_NAME__CUSTOM_VALUE(Area, name, #Area "_" #name)
 
 
@@ -50,9 +54,35 @@ public:
     bool compression;
     bool force8bit;
     int jpegQuality;
+    /// Frames are scaled down to fit this size before encoding (empty: full resolution)
+    QSize maxPreviewSize;
+    /// Only this region of the frame is sent (empty: all of it)
+    QRect viewport;
+    /// Upper limit for frames sent to this client (0: as many as the link allows)
+    double maxFrameRate;
+    /// Preview frames are sent as datagrams to this UDP port instead of the TCP stream (0: TCP)
+    quint16 udpPort;
+    /// Multicast group receiving the UDP preview, shared by all the viewers joining it (empty: unicast to the client address)
+    QString udpGroup;
+    /// FrameCodec ids the client can decode, best first
+    QList<int> codecs;
+    /// Frames come through a shared memory ring (see SharedMemoryFrames) instead of the network, full rate and unencoded: honoured for clients on the server host only
+    bool localFrames;
+    /// Whether frames encoded for other can be sent as they are, whatever the transport
+    bool sameEncoding(const FormatParameters &other) const {
+      return format == other.format && compression == other.compression && force8bit == other.force8bit && jpegQuality == other.jpegQuality
+        && maxPreviewSize == other.maxPreviewSize && viewport == other.viewport && maxFrameRate == other.maxFrameRate && codecs == other.codecs;
+    }
+    bool operator==(const FormatParameters &other) const {
+      return sameEncoding(other) && udpPort == other.udpPort && udpGroup == other.udpGroup && localFrames == other.localFrames;
+    }
   };
   static NetworkPacketPtr hello(const FormatParameters &parameters);
   static FormatParameters decodeHello(const NetworkPacketPtr &packet);
+  /// Adds this side's packet types table (see NetworkPacketTypes) to a Hello or HelloReply payload
+  static void addPacketTypes(QVariantMap &payload);
+  /// Packet types table announced in a Hello or HelloReply packet: empty for peers sending names only
+  static QStringList packetTypes(const NetworkPacketPtr &packet);
   
 };
 
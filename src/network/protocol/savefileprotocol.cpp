@@ -23,16 +23,45 @@
 using namespace std;
 PROTOCOL_NAME_VALUE(SaveFile, StartRecording);
 PROTOCOL_NAME_VALUE(SaveFile, EndRecording);
-PROTOCOL_NAME_VALUE(SaveFile, signalSaveFPS);
-PROTOCOL_NAME_VALUE(SaveFile, signalMeanFPS);
-PROTOCOL_NAME_VALUE(SaveFile, signalSavedFrames);
-PROTOCOL_NAME_VALUE(SaveFile, signalDroppedFrames);
+PROTOCOL_NAME_VALUE(SaveFile, signalRecordingStatus);
 PROTOCOL_NAME_VALUE(SaveFile, signalRecording);
 PROTOCOL_NAME_VALUE(SaveFile, signalFinished);
 PROTOCOL_NAME_VALUE(SaveFile, slotSetPaused);
+PROTOCOL_NAME_VALUE(SaveFile, Trigger);
+PROTOCOL_NAME_VALUE(SaveFile, StartRecordingStream);
+PROTOCOL_NAME_VALUE(SaveFile, EndRecordingStream);
+PROTOCOL_NAME_VALUE(SaveFile, RecordingStreamCredits);
+PROTOCOL_NAME_VALUE(SaveFile, RecordingStreamFrame);
+PROTOCOL_NAME_VALUE(SaveFile, signalRecordingStreamDropped);
+PROTOCOL_NAME_VALUE(SaveFile, ProbeStorage);
+PROTOCOL_NAME_VALUE(SaveFile, signalStorageProbed);
+
+const QString SaveFileProtocol::SaveFPS = "saveFPS";
+const QString SaveFileProtocol::MeanFPS = "meanFPS";
+const QString SaveFileProtocol::SavedFrames = "savedFrames";
+const QString SaveFileProtocol::DroppedFrames = "droppedFrames";
+const QString SaveFileProtocol::QueueBytes = "queueBytes";
+const QString SaveFileProtocol::QueuePeakBytes = "queuePeakBytes";
+const QString SaveFileProtocol::QueueMaxBytes = "queueMaxBytes";
+const QString SaveFileProtocol::WriteThroughput = "writeThroughput";
+const QString SaveFileProtocol::PreTriggerBytes = "preTriggerBytes";
+const QString SaveFileProtocol::PreTriggerSeconds = "preTriggerSeconds";
+const QString SaveFileProtocol::DeferredPendingBytes = "deferredPendingBytes";
+const QString SaveFileProtocol::DeferredAvailableBytes = "deferredAvailableBytes";
+const QString SaveFileProtocol::LoadShedding = "loadShedding";
 
 
 NetworkPacketPtr SaveFileProtocol::setPaused(bool paused)
 {
   return packetslotSetPaused() << paused;
 }
+
+NetworkPacketPtr SaveFileProtocol::startRecordingStream(int credits)
+{
+  return packetStartRecordingStream() << credits;
+}
+
+NetworkPacketPtr SaveFileProtocol::recordingStreamCredits(int credits)
+{
+  return packetRecordingStreamCredits() << credits;
+}
@@ -30,13 +30,40 @@ public:
   ADD_PROTOCOL_PACKET_NAME(StartRecording)
   ADD_PROTOCOL_PACKET_NAME(EndRecording)
   ADD_PROTOCOL_PACKET_NAME(slotSetPaused)
-  ADD_PROTOCOL_PACKET_NAME(signalSaveFPS)
-  ADD_PROTOCOL_PACKET_NAME(signalMeanFPS)
-  ADD_PROTOCOL_PACKET_NAME(signalSavedFrames)
-  ADD_PROTOCOL_PACKET_NAME(signalDroppedFrames)
+  ADD_PROTOCOL_PACKET_NAME(Trigger)
+  ADD_PROTOCOL_PACKET_NAME(signalRecordingStatus)
   ADD_PROTOCOL_PACKET_NAME(signalRecording)
   ADD_PROTOCOL_PACKET_NAME(signalFinished)
+  /// Record on client: every frame is streamed, as it is, to the client asking for it, that writes it on its own disk
+  ADD_PROTOCOL_PACKET_NAME(StartRecordingStream)
+  ADD_PROTOCOL_PACKET_NAME(EndRecordingStream)
+  /// Client to server: these many more frames can be sent (see startRecordingStream)
+  ADD_PROTOCOL_PACKET_NAME(RecordingStreamCredits)
+  /// Raw frame (see DriverProtocol::rawFrame) of the recording stream
+  ADD_PROTOCOL_PACKET_NAME(RecordingStreamFrame)
+  /// Frames dropped by the server so far, since its buffer was full
+  ADD_PROTOCOL_PACKET_NAME(signalRecordingStreamDropped)
+  ADD_PROTOCOL_PACKET_NAME(ProbeStorage)
+  /// SaveImages::storageProbed arguments, as a list
+  ADD_PROTOCOL_PACKET_NAME(signalStorageProbed)
   static NetworkPacketPtr setPaused(bool paused);
+  /// The server sends up to credits frames, then buffers the following ones until the client grants more credits
+  static NetworkPacketPtr startRecordingStream(int credits);
+  static NetworkPacketPtr recordingStreamCredits(int credits);
+  /// signalRecordingStatus keys: only the values changed since the previous status packet are sent
+  static const QString SaveFPS;
+  static const QString MeanFPS;
+  static const QString SavedFrames;
+  static const QString DroppedFrames;
+  static const QString QueueBytes;
+  static const QString QueuePeakBytes;
+  static const QString QueueMaxBytes;
+  static const QString WriteThroughput;
+  static const QString PreTriggerBytes;
+  static const QString PreTriggerSeconds;
+  static const QString DeferredPendingBytes;
+  static const QString DeferredAvailableBytes;
+  static const QString LoadShedding;
 };
 
 #endif // SAVEFILEPROTOCOL_H
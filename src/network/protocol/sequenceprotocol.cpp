@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sequenceprotocol.h"
+#include "network/networkpacket.h"
+
+using namespace std;
+
+PROTOCOL_NAME_VALUE(Sequence, RunSequence);
+PROTOCOL_NAME_VALUE(Sequence, RunSequenceReply);
+PROTOCOL_NAME_VALUE(Sequence, AbortSequence);
+PROTOCOL_NAME_VALUE(Sequence, signalSequenceLog);
+PROTOCOL_NAME_VALUE(Sequence, signalSequenceFinished);
+
+NetworkPacketPtr SequenceProtocol::runSequence(const QString &script, const QString &name)
+{
+  return packetRunSequence() << QVariantMap{{"script", script}, {"name", name}};
+}
+
+void SequenceProtocol::decodeRunSequence(const NetworkPacketPtr &packet, QString &script, QString &name)
+{
+  auto data = packet->payloadVariant().toMap();
+  script = data["script"].toString();
+  name = data["name"].toString();
+}
+
+NetworkPacketPtr SequenceProtocol::runSequenceReply(const QString &error)
+{
+  return packetRunSequenceReply() << QVariantMap{{"started", error.isEmpty()}, {"error", error}};
+}
+
+QString SequenceProtocol::decodeRunSequenceReply(const NetworkPacketPtr &packet)
+{
+  return packet->payloadVariant().toMap()["error"].toString();
+}
+
+NetworkPacketPtr SequenceProtocol::sequenceFinished(const QString &name, bool success, const QString &result)
+{
+  return packetsignalSequenceFinished() << QVariantMap{{"name", name}, {"success", success}, {"result", result}};
+}
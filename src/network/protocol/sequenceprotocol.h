@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SEQUENCEPROTOCOL_H
+#define SEQUENCEPROTOCOL_H
+#include "network/protocol/protocol.h"
+#include <QVariantMap>
+#include "commons/fwd.h"
+FWD_PTR(NetworkPacket)
+
+/// Capture sequences: JavaScript run by the server next to the camera (see SequenceRunner)
+class SequenceProtocol : public NetworkProtocol
+{
+public:
+  ADD_PROTOCOL_PACKET_NAME(RunSequence)
+  ADD_PROTOCOL_PACKET_NAME(RunSequenceReply)
+  ADD_PROTOCOL_PACKET_NAME(AbortSequence)
+  ADD_PROTOCOL_PACKET_NAME(signalSequenceLog)
+  ADD_PROTOCOL_PACKET_NAME(signalSequenceFinished)
+
+  /// name shows up in error messages, along with the line number
+  static NetworkPacketPtr runSequence(const QString &script, const QString &name);
+  static void decodeRunSequence(const NetworkPacketPtr &packet, QString &script, QString &name);
+  /// An empty error means the sequence started
+  static NetworkPacketPtr runSequenceReply(const QString &error);
+  static QString decodeRunSequenceReply(const NetworkPacketPtr &packet);
+  /// result is the value of the script, or its error message when it failed
+  static NetworkPacketPtr sequenceFinished(const QString &name, bool success, const QString &result);
+};
+
+#endif // SEQUENCEPROTOCOL_H
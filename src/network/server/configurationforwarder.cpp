@@ -32,6 +32,9 @@ DPTR_IMPL(ConfigurationForwarder) {
   void set(const NetworkPacketPtr &packet);
   void reset(const NetworkPacketPtr &packet);
   void list(const NetworkPacketPtr &packet);
+  void snapshot(const NetworkPacketPtr &packet);
+  QVariantMap values() const;
+  void settings_changed();
   
   struct ConfigurationFunctions {
     function<QVariant()> get;
@@ -40,6 +43,7 @@ DPTR_IMPL(ConfigurationForwarder) {
   };
   QHash<QString, ConfigurationFunctions> names;
   QVariantMap settings_list;
+  QVariantMap sent_values;
 };
 
 #define register_conf_function(name, type) d->names[#name] = Private::ConfigurationFunctions{ \
@@ -61,9 +65,78 @@ ConfigurationForwarder::ConfigurationForwarder(Configuration &configuration, con
   register_handler(ConfigurationProtocol::Set, bind(&Private::set, d.get(), _1));
   register_handler(ConfigurationProtocol::Reset, bind(&Private::reset, d.get(), _1));
   register_handler(ConfigurationProtocol::List, bind(&Private::list, d.get(), _1));
+  register_handler(ConfigurationProtocol::Snapshot, bind(&Private::snapshot, d.get(), _1));
 
   register_conf_function(buffered_output, bool )
+  register_conf_function(direct_io_output, bool )
+  register_conf_function(ser_frames_metadata, bool )
+  register_conf_function(ser_frame_hashes, bool )
+  register_conf_function(ser_segment_max_size, long long )
+  register_conf_function(ser_segment_max_frames, long long )
+  register_conf_function(ser_stripe_directories, QStringList)
+  register_conf_function(recording_sinks, QStringList)
+  register_conf_function(recording_sinks_max_memory_usage, long long)
+  register_conf_function(image_writer_threads, int )
+  register_conf_function(compressed_ser_level, int )
+  register_conf_function(compressed_ser_pack_pixels, bool )
+  register_conf_function_enum(fits_compression, Configuration::FITSCompression)
+  register_conf_function(fits_hcompress_scale, int )
+  register_conf_function(png_compression_level, int )
+  register_conf_function(tiff_compression, bool )
+  register_conf_function(recording_crop_size, int )
+  register_conf_function(recording_keep_best_percent, int )
+  register_conf_function(recording_quality_window, int )
   register_conf_function(max_memory_usage, long long )
+  register_conf_function_enum(recording_queue_overflow, Configuration::RecordingQueueOverflow)
+  register_conf_function(recording_queue_block_msecs, int)
+  register_conf_function(load_shedding, int)
+  register_conf_function(load_shedding_display_fps, int)
+  register_conf_function(cpu_governor, bool)
+  register_conf_function(cpu_governor_reserve, int)
+  register_conf_function(cpu_governor_priorities, QStringList)
+  register_conf_function(pipeline, QString)
+  register_conf_function(recording_spool_directory, QString)
+  register_conf_function(recording_spool_threshold, int)
+  register_conf_function(recording_spool_max_size, long long)
+  register_conf_function(recording_queue_compression, bool)
+  register_conf_function(recording_queue_compression_threshold, int)
+  register_conf_function(recording_armed, bool)
+  register_conf_function(recording_index, bool)
+  register_conf_function(recording_pretrigger, bool)
+  register_conf_function(pretrigger_seconds, double)
+  register_conf_function(posttrigger_seconds, double)
+  register_conf_function(pretrigger_max_memory_usage, long long)
+  register_conf_function(recording_burst_to_ram, bool)
+  register_conf_function(burst_max_memory_usage, long long)
+  register_conf_function(burst_huge_pages, bool)
+  register_conf_function(burst_lock_memory, bool)
+  register_conf_function(frame_buffers_huge_pages, bool)
+  register_conf_function(frame_buffers_lock_memory, bool)
+  register_conf_function(memory_budget, long long)
+  register_conf_function(flash_detector, bool)
+  register_conf_function(flash_detector_sigma, double)
+  register_conf_function(flash_detector_history, int)
+  register_conf_function(flash_detector_frames, int)
+  register_conf_function(flash_detector_pixels, int)
+  register_conf_function(flash_detector_roi_size, int)
+  register_conf_function(software_bin, int)
+  register_conf_function_enum(software_bin_mode, Configuration::SoftwareBinMode)
+  register_conf_function(software_roi, QRect)
+  register_conf_function(calibration, bool)
+  register_conf_function(calibration_directory, QString)
+  register_conf_function(hot_pixels, bool)
+  register_conf_function(hot_pixels_frames, int)
+  register_conf_function(hot_pixels_sigma, double)
+  register_conf_function(auto_exposure, bool)
+  register_conf_function(auto_exposure_target, double)
+  register_conf_function(auto_exposure_max_exposure, double)
+  register_conf_function(auto_exposure_gain_per_doubling, double)
+  register_conf_function(auto_exposure_roi_size, int)
+  register_conf_function(roi_follow, bool)
+  register_conf_function(roi_follow_margin, double)
+  register_conf_function(focus_assist, bool)
+  register_conf_function_enum(focus_assist_metric, Configuration::FocusMetric)
+  register_conf_function(focus_assist_roi_size, int)
   
   register_conf_function_enum(recording_limit_type, Configuration::RecordingLimit)
   register_conf_function(recording_seconds_limit, double )
@@ -78,18 +151,24 @@ ConfigurationForwarder::ConfigurationForwarder(Configuration &configuration, con
   
   register_conf_function_enum(save_format, Configuration::SaveFormat)
   register_conf_function(video_codec, QString)
+  register_conf_function(ffmpeg_video_codec, QString)
   register_conf_function(save_json_info_file, bool)
   register_conf_function(save_info_file, bool)
+  register_conf_function(save_debayered, bool)
+  register_conf_function_enum(save_debayer_algorithm, Configuration::DebayerAlgorithm)
+  register_conf_function_enum(save_depth, Configuration::SaveDepth)
+  register_conf_function(save_depth_black, int)
+  register_conf_function(save_depth_white, int)
+  register_conf_function(save_depth_dither, bool)
   
   register_conf_function(observer, QString)
   register_conf_function(telescope, QString)
   
   register_conf_function(timelapse_mode, bool)
   register_conf_function(timelapse_msecs, qlonglong)
+  register_conf_function(timelapse_pause_capture, bool)
   register_conf_function(recording_pause_stops_timer, bool)
-  QObject::connect(&configuration, &Configuration::settings_changed, &configuration, [=]{
-    this->dispatcher()->queue_send(ConfigurationProtocol::packetsignalSettingsChanged());
-  });
+  QObject::connect(&configuration, &Configuration::settings_changed, &configuration, bind(&Private::settings_changed, d.get()));
 }
 
 ConfigurationForwarder::~ConfigurationForwarder()
@@ -101,7 +180,7 @@ void ConfigurationForwarder::Private::get(const NetworkPacketPtr& packet)
 {
   auto name = packet->payloadVariant().toString();
   auto value = names[name].get();
-  q->dispatcher()->queue_send(ConfigurationProtocol::encodeGetReply(name, value));
+  q->dispatcher()->reply(ConfigurationProtocol::encodeGetReply(name, value));
 }
 
 void ConfigurationForwarder::Private::reset(const NetworkPacketPtr& packet)
@@ -117,8 +196,49 @@ void ConfigurationForwarder::Private::set(const NetworkPacketPtr& packet)
   names[name].set(value);
 }
 
+QVariant ConfigurationForwarder::value(const QString &name) const
+{
+  return d->names.contains(name) ? d->names[name].get() : QVariant{};
+}
+
+bool ConfigurationForwarder::setValue(const QString &name, const QVariant &value)
+{
+  if(! d->names.contains(name))
+    return false;
+  d->names[name].set(value);
+  return true;
+}
+
 void ConfigurationForwarder::Private::list(const NetworkPacketPtr& packet)
 {
-  q->dispatcher()->queue_send(ConfigurationProtocol::packetListReply() << settings_list);
+  q->dispatcher()->reply(ConfigurationProtocol::packetListReply() << settings_list);
 }
 
+
+void ConfigurationForwarder::Private::snapshot(const NetworkPacketPtr&)
+{
+  sent_values = values();
+  q->dispatcher()->reply(ConfigurationProtocol::encodeSnapshotReply(sent_values));
+}
+
+QVariantMap ConfigurationForwarder::Private::values() const
+{
+  QVariantMap values;
+  for(auto it = names.begin(); it != names.end(); it++)
+    values[it.key()] = it.value().get();
+  return values;
+}
+
+void ConfigurationForwarder::Private::settings_changed()
+{
+  // Clients keep a cache of the last values they got: push them only what differs from it
+  QVariantMap changed;
+  auto current = values();
+  for(auto it = current.begin(); it != current.end(); it++) {
+    if(sent_values.value(it.key()) != it.value())
+      changed[it.key()] = it.value();
+  }
+  sent_values = current;
+  if(! changed.isEmpty())
+    q->dispatcher()->queue_send(ConfigurationProtocol::encodeSettingsChanged(changed));
+}
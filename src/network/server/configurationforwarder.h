@@ -32,6 +32,10 @@ class ConfigurationForwarder : public NetworkReceiver
 public:
   ConfigurationForwarder(Configuration &configuration, const NetworkDispatcherPtr &dispatcher);
   ~ConfigurationForwarder();
+  /// Value of the setting called name, as clients get it (null for unknown settings)
+  QVariant value(const QString &name) const;
+  /// Changes the setting called name, as a client setting it would; false for unknown settings
+  bool setValue(const QString &name, const QVariant &value);
 private:
   DPTR
 };
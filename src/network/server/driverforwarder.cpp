@@ -21,19 +21,25 @@
 #include <QObject>
 #include "driverforwarder.h"
 #include "network/protocol/driverprotocol.h"
+#include "network/protocol/controlscodec.h"
 #include "network/networkpacket.h"
 #include "network/networkdispatcher.h"
 #include "Qt/qt_functional.h"
 #include "planetaryimager.h"
+#include <QTimer>
+#include <QHash>
 
 using namespace std;
 using namespace std::placeholders;
+using namespace std::chrono_literals;
 
 #define DECLARE_HANDLER(name) void name(const NetworkPacketPtr &p);
 DPTR_IMPL(DriverForwarder) {
   PlanetaryImagerPtr planetaryImager;
   DriverForwarder *q;
   QList<CameraPtr> cameras;
+  // Tagged camera list requests, answered with their own request id once the scan completes
+  QList<QPair<QTcpSocket *, quint32>> camera_list_requests;
   DECLARE_HANDLER(CameraList)
   DECLARE_HANDLER(ConnectCamera)
   DECLARE_HANDLER(GetCameraName)
@@ -43,18 +49,34 @@ DPTR_IMPL(DriverForwarder) {
   DECLARE_HANDLER(SetROI)
   DECLARE_HANDLER(GetControls)
   DECLARE_HANDLER(SetControl)
+  DECLARE_HANDLER(SetControls)
   DECLARE_HANDLER(CloseCamera)
   void sendFPS(double fps);
   void sendTemperature(double temperature);
   void sendDisconnected();
   void sendControlChanged(const Imager::Control &control);
+  // Auto exposure/gain cameras change controls in bursts: changes are held back this long, and sent as one packet
+  static constexpr chrono::milliseconds coalescing_window = 100ms;
+  DriverProtocol::ImagerChanges pending_changes;
+  // Descriptors (controls without their values) the clients have, so that changes only need to carry the values
+  QHash<qlonglong, QByteArray> described;
+  static QByteArray descriptor(Imager::Control control);
+  unique_ptr<QTimer> changes_timer;
+  void queue_changes();
+  void send_changes();
 };
 
+constexpr chrono::milliseconds DriverForwarder::Private::coalescing_window;
+
 #define REGISTER_HANDLER(protocol, name) register_handler(protocol::name, bind(&Private::name, d.get(), _1));
 
 DriverForwarder::DriverForwarder(const NetworkDispatcherPtr &dispatcher, const PlanetaryImagerPtr &planetaryImager) 
   : NetworkReceiver{dispatcher}, dptr(planetaryImager, this)
 {
+  d->changes_timer = make_unique<QTimer>();
+  d->changes_timer->setSingleShot(true);
+  d->changes_timer->setInterval(Private::coalescing_window.count());
+  QObject::connect(d->changes_timer.get(), &QTimer::timeout, bind(&Private::send_changes, d.get()));
   REGISTER_HANDLER(DriverProtocol, CameraList)
   REGISTER_HANDLER(DriverProtocol, ConnectCamera)
   REGISTER_HANDLER(DriverProtocol, GetCameraName)
@@ -64,12 +86,22 @@ DriverForwarder::DriverForwarder(const NetworkDispatcherPtr &dispatcher, const P
   REGISTER_HANDLER(DriverProtocol, SetROI)
   REGISTER_HANDLER(DriverProtocol, GetControls)
   REGISTER_HANDLER(DriverProtocol, SetControl)
+  REGISTER_HANDLER(DriverProtocol, SetControls)
   REGISTER_HANDLER(DriverProtocol, CloseCamera)
-  QObject::connect(planetaryImager.get(), &PlanetaryImager::camerasChanged, dispatcher.get(), [this] {
+  // Clients take the first camera list they get as the answer: only send complete ones
+  QObject::connect(planetaryImager.get(), &PlanetaryImager::camerasScanned, dispatcher.get(), [this] {
     d->cameras = d->planetaryImager->cameras();
+    for(auto request: d->camera_list_requests) {
+      auto reply = DriverProtocol::sendCameraListReply(d->cameras);
+      reply->setRequestId(request.second);
+      this->dispatcher()->queue_send(reply, request.first);
+    }
+    d->camera_list_requests.clear();
+    // Untagged, for the clients only listening to camera lists (and the older ones)
     this->dispatcher()->send(DriverProtocol::sendCameraListReply(d->cameras));
   });
   QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, dispatcher.get(), [this] {
+    d->described.clear();
     this->dispatcher()->send(DriverProtocol::packetsignalCameraConnected());
     QObject::connect(d->planetaryImager->imager(), &Imager::fps, this->dispatcher().get(), bind(&Private::sendFPS, d.get(), _1));
     QObject::connect(d->planetaryImager->imager(), &Imager::temperature, this->dispatcher().get(), bind(&Private::sendTemperature, d.get(), _1));
@@ -84,6 +116,8 @@ DriverForwarder::~DriverForwarder()
 
 void DriverForwarder::Private::CameraList(const NetworkPacketPtr& p)
 {
+  if(auto request_id = q->dispatcher()->current_request_id())
+    camera_list_requests.push_back({q->dispatcher()->current_peer(), request_id});
   planetaryImager->scanCameras();
 }
 
@@ -101,7 +135,7 @@ void DriverForwarder::Private::ConnectCamera(const NetworkPacketPtr& p)
 
 void DriverForwarder::Private::GetCameraName(const NetworkPacketPtr& p)
 {
-  q->dispatcher()->send(DriverProtocol::packetGetCameraNameReply() << planetaryImager->imager()->name());
+  q->dispatcher()->reply(DriverProtocol::packetGetCameraNameReply() << planetaryImager->imager()->name());
 }
 
 void DriverForwarder::Private::CloseCamera(const NetworkPacketPtr& p)
@@ -118,44 +152,89 @@ void DriverForwarder::Private::ClearROI(const NetworkPacketPtr& p)
 
 void DriverForwarder::Private::GetProperties(const NetworkPacketPtr& p)
 {
-  q->dispatcher()->send( DriverProtocol::sendGetPropertiesReply(planetaryImager->imager()->properties() ) );
+  q->dispatcher()->reply( DriverProtocol::sendGetPropertiesReply(planetaryImager->imager()->properties() ) );
 }
 
 void DriverForwarder::Private::StartLive(const NetworkPacketPtr& p)
 {
   planetaryImager->imager()->startLive();
-  q->dispatcher()->send( DriverProtocol::packetStartLiveReply() );
+  q->dispatcher()->reply( DriverProtocol::packetStartLiveReply() );
 }
 
 void DriverForwarder::Private::GetControls(const NetworkPacketPtr& p)
 {
-  q->dispatcher()->send(DriverProtocol::sendGetControlsReply(planetaryImager->imager()->controls()));
+  auto controls = planetaryImager->imager()->controls();
+  for(auto control: controls)
+    described[control.id] = descriptor(control);
+  q->dispatcher()->reply(DriverProtocol::sendGetControlsReply(controls));
 }
 
 void DriverForwarder::Private::SetControl(const NetworkPacketPtr& p)
 {
-  planetaryImager->imager()->setControl(DriverProtocol::decodeControl(p));
+  auto control = DriverProtocol::decodeControl(p);
+  if(control.valid())
+    planetaryImager->imager()->setControl(control);
+}
+
+void DriverForwarder::Private::SetControls(const NetworkPacketPtr& p)
+{
+  planetaryImager->imager()->setControls(DriverProtocol::decodeControls(p));
 }
 
 
 void DriverForwarder::Private::sendFPS(double fps)
 {
-  q->dispatcher()->send( DriverProtocol::packetsignalFPS() << QVariant{fps});
+  pending_changes.fps = fps;
+  queue_changes();
 }
 
 void DriverForwarder::Private::sendTemperature(double temperature)
 {
-  q->dispatcher()->send( DriverProtocol::packetsignalTemperature() << QVariant{temperature});
+  pending_changes.temperature = temperature;
+  queue_changes();
 }
 
 void DriverForwarder::Private::sendDisconnected()
 {
+  // Changes still pending happened before the disconnection
+  send_changes();
   q->dispatcher()->send( DriverProtocol::packetsignalDisconnected());
 }
 
 void DriverForwarder::Private::sendControlChanged(const Imager::Control &control)
 {
-  q->dispatcher()->send( DriverProtocol::controlChanged(control));
+  auto control_descriptor = descriptor(control);
+  if(pending_changes.descriptors.contains(control.id) || described.value(control.id) != control_descriptor) {
+    described[control.id] = control_descriptor;
+    pending_changes.controls.remove(control.id);
+    pending_changes.descriptors[control.id] = control;
+  } else {
+    pending_changes.controls[control.id] = control;
+  }
+  queue_changes();
+}
+
+QByteArray DriverForwarder::Private::descriptor(Imager::Control control)
+{
+  control.value = {};
+  control.value_auto = control.value_onOff = false;
+  return ControlsCodec::encode({control});
+}
+
+void DriverForwarder::Private::queue_changes()
+{
+  // Not restarted on every change, or a steady stream of changes would never be sent
+  if(! changes_timer->isActive())
+    changes_timer->start();
+}
+
+void DriverForwarder::Private::send_changes()
+{
+  changes_timer->stop();
+  if(pending_changes.isEmpty())
+    return;
+  q->dispatcher()->send( DriverProtocol::imagerChanges(pending_changes));
+  pending_changes = {};
 }
 
 void DriverForwarder::getStatus(QVariantMap& status)
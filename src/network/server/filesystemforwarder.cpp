@@ -23,20 +23,59 @@
 #include <QFileInfo>
 #include <QDir>
 #include "commons/utils.h"
+#include <QFile>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QSet>
+#include "Qt/qt_strings_helper.h"
 
 using namespace std;
 using namespace std::placeholders;
 
+// Files modified more recently than this are reported as still being written
+#define GROWING_FILE_SECONDS 5
+// Sorted listings kept for paging, and directories watched for changes
+#define CACHED_LISTINGS 8
+#define WATCHED_DIRECTORIES 64
+// Directories being recorded into change all the time: notifications go out at most this often
+#define CHANGES_INTERVAL_MS 1000
+
 DPTR_IMPL(FilesystemForwarder) {
   FilesystemForwarder *q;
+  const Configuration &configuration;
+  unique_ptr<QFileSystemWatcher> watcher;
+  unique_ptr<QTimer> changes_timer;
+  struct CachedListing {
+    QString key;
+    QString path;
+    QFileInfoList entries;
+  };
+  QList<CachedListing> listings;
+  QStringList watched;
+  QSet<QString> changed;
   void entry(const NetworkPacketPtr &packet);
   void listChildren(const NetworkPacketPtr &packet);
+  void listDirectory(const NetworkPacketPtr &packet);
+  const QFileInfoList &sorted_entries(const FilesystemProtocol::Listing &listing);
+  void watch(const QString &path);
+  void directory_changed(const QString &path);
+  void send_changes();
+  void readFile(const NetworkPacketPtr &packet);
+  bool downloadable(const QFileInfo &info) const;
 };
 
-FilesystemForwarder::FilesystemForwarder(const NetworkDispatcherPtr& dispatcher) : NetworkReceiver{dispatcher}, dptr(this)
+FilesystemForwarder::FilesystemForwarder(const NetworkDispatcherPtr& dispatcher, const Configuration &configuration)
+  : NetworkReceiver{dispatcher}, dptr(this, configuration, make_unique<QFileSystemWatcher>(), make_unique<QTimer>())
 {
+  d->changes_timer->setSingleShot(true);
+  d->changes_timer->setInterval(CHANGES_INTERVAL_MS);
+  QObject::connect(d->changes_timer.get(), &QTimer::timeout, [this]{ d->send_changes(); });
+  QObject::connect(d->watcher.get(), &QFileSystemWatcher::directoryChanged, [this](const QString &path){ d->directory_changed(path); });
+  register_handler(FilesystemProtocol::ListDirectory, bind(&Private::listDirectory, d.get(), _1));
   register_handler(FilesystemProtocol::FileInfo, bind(&Private::entry, d.get(), _1));
   register_handler(FilesystemProtocol::Children, bind(&Private::listChildren, d.get(), _1));
+  register_handler(FilesystemProtocol::ReadFile, bind(&Private::readFile, d.get(), _1));
 }
 
 FilesystemForwarder::~FilesystemForwarder()
@@ -47,12 +86,110 @@ void FilesystemForwarder::Private::entry(const NetworkPacketPtr& packet)
 {
   LOG_F_SCOPE
   QFileInfo info{packet->payloadVariant().toString()};
-  q->dispatcher()->send(FilesystemProtocol::fileInfoReply(info));
+  q->dispatcher()->reply(FilesystemProtocol::fileInfoReply(info));
 }
 
 void FilesystemForwarder::Private::listChildren(const NetworkPacketPtr& packet)
 {
   LOG_F_SCOPE
   QDir dir{packet->payloadVariant().toString()};
-  q->dispatcher()->send(FilesystemProtocol::childrenReply(dir.entryInfoList()));
+  q->dispatcher()->reply(FilesystemProtocol::childrenReply(dir.entryInfoList()));
+}
+
+void FilesystemForwarder::Private::listDirectory(const NetworkPacketPtr &packet)
+{
+  auto listing = FilesystemProtocol::decodeListDirectory(packet);
+  listing.path = QDir{listing.path}.canonicalPath();
+  const auto &entries = sorted_entries(listing);
+  listing.total = entries.size();
+  listing.offset = max(0, min(listing.offset, listing.total));
+  const int limit = listing.limit > 0 ? min(listing.limit, FilesystemProtocol::LISTING_PAGE_SIZE * 10) : FilesystemProtocol::LISTING_PAGE_SIZE;
+  listing.limit = min(limit, listing.total - listing.offset);
+  q->dispatcher()->reply(FilesystemProtocol::listDirectoryReply(listing, entries.mid(listing.offset, listing.limit)));
+}
+
+const QFileInfoList &FilesystemForwarder::Private::sorted_entries(const FilesystemProtocol::Listing &listing)
+{
+  // Next pages of the same listing are served from the sorted list, instead of reading and sorting the directory again
+  const auto key = "%1\n%2\n%3"_q % listing.path % (listing.directories_only ? "directories" : "all") % listing.patterns.join('\n');
+  auto cached = find_if(listings.begin(), listings.end(), [&](const CachedListing &l) { return l.key == key; });
+  if(cached != listings.end()) {
+    listings.move(cached - listings.begin(), 0);
+    return listings.first().entries;
+  }
+  QDir dir{listing.path};
+  dir.setNameFilters(listing.patterns);
+  dir.setFilter(listing.directories_only ? QDir::Dirs | QDir::NoDotAndDotDot : QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::DirsFirst | QDir::Name | QDir::IgnoreCase);
+  listings.prepend({key, listing.path, dir.entryInfoList()});
+  while(listings.size() > CACHED_LISTINGS)
+    listings.removeLast();
+  watch(listing.path);
+  return listings.first().entries;
+}
+
+void FilesystemForwarder::Private::watch(const QString &path)
+{
+  if(path.isEmpty() || watched.contains(path))
+    return;
+  if(watched.size() >= WATCHED_DIRECTORIES)
+    watcher->removePath(watched.takeFirst());
+  if(watcher->addPath(path))
+    watched.append(path);
+}
+
+void FilesystemForwarder::Private::directory_changed(const QString &path)
+{
+  listings.erase(remove_if(listings.begin(), listings.end(), [&](const CachedListing &l) { return l.path == path; }), listings.end());
+  changed.insert(path);
+  if(! changes_timer->isActive())
+    changes_timer->start();
+}
+
+void FilesystemForwarder::Private::send_changes()
+{
+  for(const auto &path: changed)
+    q->dispatcher()->send(FilesystemProtocol::directoryChanged(path));
+  changed.clear();
+}
+
+bool FilesystemForwarder::Private::downloadable(const QFileInfo& info) const
+{
+  auto save_directory = QFileInfo{configuration.save_directory()}.canonicalFilePath();
+  return info.isFile() && ! save_directory.isEmpty() && info.canonicalFilePath().startsWith(save_directory + "/");
+}
+
+void FilesystemForwarder::Private::readFile(const NetworkPacketPtr& packet)
+{
+  QString path;
+  qint64 offset, size;
+  FilesystemProtocol::decodeReadFile(packet, path, offset, size);
+  FilesystemProtocol::FileChunk chunk;
+  chunk.offset = static_cast<quint64>(max<qint64>(offset, 0));
+  auto fail = [&](const QString &error) {
+    chunk.flags = FilesystemProtocol::FileChunk::Error;
+    auto message = make_shared<QByteArray>(error.toUtf8());
+    q->dispatcher()->reply(FilesystemProtocol::readFileReply(chunk, message, message->constData(), message->size()));
+  };
+  QFileInfo info{path};
+  if(! downloadable(info))
+    return fail("%1 is not a file in the save directory"_q % path);
+  auto file = make_shared<QFile>(info.canonicalFilePath());
+  if(! file->open(QIODevice::ReadOnly))
+    return fail(file->errorString());
+  chunk.file_size = file->size();
+  if(info.lastModified().secsTo(QDateTime::currentDateTime()) < GROWING_FILE_SECONDS)
+    chunk.flags |= FilesystemProtocol::FileChunk::Growing;
+  size = max<qint64>(0, min({size, FilesystemProtocol::MAX_CHUNK_SIZE, static_cast<qint64>(chunk.file_size) - static_cast<qint64>(chunk.offset)}));
+  if(chunk.offset + size >= chunk.file_size)
+    chunk.flags |= FilesystemProtocol::FileChunk::EndOfFile;
+  const char *data = nullptr;
+  if(size > 0) {
+    // Mapped, and written from the mapping straight into the socket buffer: the mapping lives as long as the packet (owning the file)
+    data = reinterpret_cast<const char *>(file->map(chunk.offset, size));
+    if(! data)
+      return fail(file->errorString());
+    chunk.crc32 = FilesystemProtocol::crc32(data, size);
+  }
+  q->dispatcher()->reply(FilesystemProtocol::readFileReply(chunk, file, data, size));
 }
@@ -22,6 +22,7 @@
 #include "c++/dptr.h"
 #include "commons/fwd.h"
 #include "network/networkreceiver.h"
+#include "commons/configuration.h"
 
 FWD_PTR(FilesystemForwarder)
 FWD_PTR(NetworkDispatcher)
@@ -29,7 +30,8 @@ FWD_PTR(NetworkDispatcher)
 class FilesystemForwarder : public NetworkReceiver
 {
 public:
-  FilesystemForwarder(const NetworkDispatcherPtr &dispatcher);
+  /// Files can be downloaded only from the configured save directory
+  FilesystemForwarder(const NetworkDispatcherPtr &dispatcher, const Configuration &configuration);
   ~FilesystemForwarder();
 private:
   DPTR
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/focusforwarder.h"
+#include "network/protocol/focusprotocol.h"
+#include "network/networkdispatcher.h"
+#include "image_handlers/backend/focusassist.h"
+
+using namespace std;
+
+FocusForwarder::FocusForwarder(const NetworkDispatcherPtr& dispatcher, const FocusAssistPtr &focus_assist) : NetworkReceiver{dispatcher}
+{
+  register_handler(FocusProtocol::GetFocus, [this, focus_assist](const NetworkPacketPtr &packet) {
+    this->dispatcher()->reply(FocusProtocol::focusReply(focus_assist->measurements(FocusProtocol::decodeGetFocus(packet))));
+  });
+}
+
+FocusForwarder::~FocusForwarder()
+{
+}
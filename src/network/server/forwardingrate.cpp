@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/forwardingrate.h"
+#include <deque>
+#include <algorithm>
+
+using namespace std;
+
+DPTR_IMPL(ForwardingRate) {
+  Settings settings;
+  deque<Clock::time_point> in_flight;
+  Clock::time_point last_sent;
+  Clock::duration latency = Clock::duration::zero();
+  double average_bytes = 0;
+  int level = 0;
+  int samples_since_change = 0;
+  void sample(const Clock::duration &delay);
+};
+
+namespace {
+  // Changing level needs some samples with the new encoding before judging it
+  const int samples_per_change = 4;
+  const double quality_factors[] = {1, 0.8, 0.65, 0.55, 0.45};
+  const double scales[] = {1, 1, 0.75, 0.5, 0.35};
+  // Backlog tolerated, in frames worth of bytes, and at least this many bytes
+  const double backlog_frames = 2;
+  const int64_t min_backlog_bytes = 64 * 1024;
+}
+
+const int ForwardingRate::max_level;
+
+ForwardingRate::ForwardingRate(const Settings &settings) : dptr(settings)
+{
+}
+
+ForwardingRate::~ForwardingRate()
+{
+}
+
+void ForwardingRate::set_min_interval(const Clock::duration& interval)
+{
+  d->settings.min_interval = interval;
+}
+
+void ForwardingRate::set_ack_timeout(const Clock::duration& timeout)
+{
+  d->settings.ack_timeout = timeout;
+}
+
+bool ForwardingRate::accept(const Clock::time_point& now, int64_t backlog_bytes)
+{
+  while(! d->in_flight.empty() && now - d->in_flight.front() > d->settings.ack_timeout) {
+    d->in_flight.pop_front();
+    d->sample(d->settings.ack_timeout);
+  }
+  if(backlog_bytes > max(min_backlog_bytes, static_cast<int64_t>(backlog_frames * d->average_bytes)))
+    return false;
+  if(static_cast<int>(d->in_flight.size()) >= d->settings.max_in_flight)
+    return false;
+  return d->last_sent == Clock::time_point{} || now - d->last_sent >= d->settings.min_interval;
+}
+
+void ForwardingRate::sent(const Clock::time_point& now, int64_t bytes)
+{
+  d->in_flight.push_back(now);
+  d->last_sent = now;
+  d->average_bytes = d->average_bytes == 0 ? bytes : 0.8 * d->average_bytes + 0.2 * bytes;
+}
+
+void ForwardingRate::acknowledged(const Clock::time_point& now)
+{
+  if(d->in_flight.empty())
+    return;
+  auto delay = now - d->in_flight.front();
+  d->in_flight.pop_front();
+  d->sample(delay);
+}
+
+void ForwardingRate::Private::sample(const Clock::duration& delay)
+{
+  latency = latency == Clock::duration::zero() ? delay : (latency * 7 + delay) / 8;
+  if(++samples_since_change < samples_per_change)
+    return;
+  int previous = level;
+  if(latency > settings.target_latency)
+    level = min(level + 1, max_level);
+  else if(latency < settings.target_latency / 2)
+    level = max(level - 1, 0);
+  if(level != previous)
+    samples_since_change = 0;
+}
+
+ForwardingRate::Clock::duration ForwardingRate::latency() const
+{
+  return d->latency;
+}
+
+int ForwardingRate::level() const
+{
+  return d->level;
+}
+
+double ForwardingRate::jpeg_quality_factor() const
+{
+  return quality_factors[d->level];
+}
+
+double ForwardingRate::scale() const
+{
+  return scales[d->level];
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FORWARDINGRATE_H
+#define FORWARDINGRATE_H
+
+#include "c++/dptr.h"
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Congestion control for frames forwarded to a network client.
+ * Frames are only sent while few of them are waiting for the client acknowledgement, and while the socket backlog is small,
+ * so that they are dropped at the source instead of piling up in the send buffer.
+ * The smoothed acknowledgement delay drives a degradation level, mapped to lower JPEG quality and smaller images
+ * when the link can't keep up with the target latency, and restored when it can.
+ * Not thread safe: callers must serialise access.
+ */
+class ForwardingRate
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+  struct Settings {
+    Clock::duration min_interval;
+    Clock::duration target_latency;
+    /// Frames not acknowledged within this time are considered lost
+    Clock::duration ack_timeout;
+    int max_in_flight;
+  };
+  static const int max_level = 4;
+  ForwardingRate(const Settings &settings = {std::chrono::milliseconds{50}, std::chrono::milliseconds{250}, std::chrono::seconds{2}, 2});
+  ~ForwardingRate();
+  void set_min_interval(const Clock::duration &interval);
+  void set_ack_timeout(const Clock::duration &timeout);
+
+  /// Whether a frame should be sent now, given the bytes still queued in the socket
+  bool accept(const Clock::time_point &now, std::int64_t backlog_bytes);
+  void sent(const Clock::time_point &now, std::int64_t bytes);
+  void acknowledged(const Clock::time_point &now);
+
+  Clock::duration latency() const;
+  /// 0 is full quality, up to max_level
+  int level() const;
+  double jpeg_quality_factor() const;
+  double scale() const;
+private:
+  DPTR
+};
+
+#endif // FORWARDINGRATE_H
@@ -18,13 +18,27 @@
 
 
 #include "network/server/framesforwarder.h"
+#include "network/server/forwardingrate.h"
 #include "network/protocol/driverprotocol.h"
+#include "network/networkpacket.h"
+#include "network/framedatagrams.h"
+#include "network/protocol/framecodec.h"
 #include <QObject>
-#include <QElapsedTimer>
-#include <QtConcurrent/QtConcurrent>
+#include <QBuffer>
+#include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QUdpSocket>
+#include <QMutex>
+#include <QMutexLocker>
 #include <atomic>
+#include <algorithm>
 #include "commons/frame.h"
+#include "commons/metrics.h"
+#include "commons/executor.h"
+#include "commons/memorygovernor.h"
 #include "network/networkdispatcher.h"
+#include "image_handlers/backend/sharedmemoryframes.h"
+#include "Qt/qt_strings_helper.h"
+#include <QCoreApplication>
 
 using namespace std;
 
@@ -32,26 +46,221 @@ DPTR_IMPL(FramesForwarder) {
   NetworkDispatcherPtr dispatcher;
   atomic_bool enabled;
   FramesForwarder *q;
-  QElapsedTimer elapsed;
+  atomic_bool encoding;
+  struct Subscriber {
+    NetworkProtocol::FormatParameters parameters;
+    ForwardingRate rate;
+    // Null for frames over TCP
+    QHostAddress udp_address;
+    // Clients on this host: frames go here, never on the socket
+    SharedMemoryFramesPtr shared_memory;
+    QString shared_memory_name;
+  };
+  typedef QPair<QHostAddress, quint16> DatagramTarget;
+  typedef shared_ptr<Subscriber> SubscriberPtr;
+  QMutex mutex;
+  QHash<QTcpSocket *, SubscriberPtr> subscribers;
   bool recording = false;
+  int shared_memory_rings = 0;
+  // Subscribers sharing these are sent the very same packet
+  struct Encoding {
+    NetworkProtocol::FormatParameters parameters;
+    double quality_factor;
+    double scale;
+    QList<QTcpSocket *> peers;
+    QList<QTcpSocket *> tcp_peers;
+    QList<DatagramTarget> datagram_targets;
+    FrameCodecPtr codec;
+  };
+  // Codecs can keep state between frames (i.e. delta encoding), so each encoding keeps its own one across frames
+  vector<Encoding> codecs;
+  FrameCodecPtr codec_for(const Encoding &encoding);
+  void prune_codecs();
+  void update_interval(Subscriber &subscriber) const;
+  unique_ptr<QUdpSocket> udp_socket;
+  atomic<quint32> datagram_sequence;
+  QMutex datagrams_mutex;
+  QList<QPair<QList<QByteArray>, QList<DatagramTarget>>> datagrams;
+  void queue_datagrams(const NetworkPacketPtr &packet, const QList<DatagramTarget> &targets);
+  Metrics::Histogram &encode_metric = Metrics::instance().histogram("network_encode_seconds", "Time spent encoding a frame for network clients");
+  Metrics::Counter &sent_frames_metric = Metrics::instance().counter("network_frames_sent_total", "Frame packets sent to network clients");
+  Metrics::Counter &sent_bytes_metric = Metrics::instance().counter("network_sent_bytes_total", "Frame bytes sent to network clients");
+  Metrics::Counter &skipped_frames_metric = Metrics::instance().counter("network_frames_skipped_total", "Frames not forwarded because the encoder was busy");
+  Metrics::Counter &over_budget_metric = Metrics::instance().counter("network_frames_over_budget_total", "Frames not forwarded because the process memory budget was full");
+  MemoryGovernor::Account &send_buffers = MemoryGovernor::instance().account("network send buffers", MemoryGovernor::Network);
 };
 
-FramesForwarder::FramesForwarder(const NetworkDispatcherPtr& dispatcher) : dptr(dispatcher, {true}, this)
+FramesForwarder::FramesForwarder(const NetworkDispatcherPtr& dispatcher) : NetworkReceiver{dispatcher}, dptr(dispatcher, {true}, this, {false})
 {
-  d->elapsed.restart();
+  d->udp_socket = make_unique<QUdpSocket>();
+  d->datagram_sequence = 0;
+  register_handler(DriverProtocol::FrameReceived, [this](const NetworkPacketPtr &) {
+    QMutexLocker lock(&d->mutex);
+    if(auto subscriber = d->subscribers.value(d->dispatcher->current_peer()))
+      subscriber->rate.acknowledged(ForwardingRate::Clock::now());
+  });
 }
 
 FramesForwarder::~FramesForwarder()
 {
 }
 
+QString FramesForwarder::subscribe(QTcpSocket *peer, const NetworkProtocol::FormatParameters &parameters)
+{
+  QMutexLocker lock(&d->mutex);
+  // Control only clients (i.e. scripts) don't get frames at all
+  if(parameters.format == Configuration::Network_NoImage) {
+    d->subscribers.remove(peer);
+    return {};
+  }
+  auto previous = d->subscribers.value(peer);
+  auto subscriber = make_shared<Private::Subscriber>();
+  subscriber->parameters = parameters;
+  // Dual stack servers see IPv4 clients as IPv4 mapped addresses
+  bool peer_is_ipv4 = false;
+  const QHostAddress peer_ipv4{peer->peerAddress().toIPv4Address(&peer_is_ipv4)};
+  if(parameters.localFrames && (peer->peerAddress().isLoopback() || (peer_is_ipv4 && peer_ipv4.isLoopback()))) {
+    if(previous && previous->shared_memory) {
+      // The client keeps following the same ring
+      subscriber->shared_memory = previous->shared_memory;
+      subscriber->shared_memory_name = previous->shared_memory_name;
+    } else {
+      subscriber->shared_memory_name = "/planetaryimager-%1-%2"_q % QCoreApplication::applicationPid() % ++d->shared_memory_rings;
+      subscriber->shared_memory = make_shared<SharedMemoryFrames>(subscriber->shared_memory_name);
+    }
+  } else if(parameters.udpPort) {
+    subscriber->udp_address = parameters.udpGroup.isEmpty() ? peer->peerAddress() : QHostAddress{parameters.udpGroup};
+    // Clients of a dual stack server show up as IPv4 mapped addresses, not usable as IPv4 datagram destinations
+    bool is_ipv4 = false;
+    auto ipv4 = subscriber->udp_address.toIPv4Address(&is_ipv4);
+    if(is_ipv4)
+      subscriber->udp_address = QHostAddress{ipv4};
+    // Lost datagrams mean lost frames, never acknowledged: don't wait long for them
+    subscriber->rate.set_ack_timeout(chrono::milliseconds{500});
+  }
+  d->update_interval(*subscriber);
+  d->subscribers[peer] = subscriber;
+  d->prune_codecs();
+  return subscriber->shared_memory_name;
+}
+
+void FramesForwarder::unsubscribe(QTcpSocket *peer)
+{
+  QMutexLocker lock(&d->mutex);
+  d->subscribers.remove(peer);
+  d->prune_codecs();
+}
+
+FrameCodecPtr FramesForwarder::Private::codec_for(const Encoding &encoding)
+{
+  auto codec = find_if(codecs.begin(), codecs.end(), [&](const Encoding &e) {
+    return e.parameters.sameEncoding(encoding.parameters) && e.quality_factor == encoding.quality_factor && e.scale == encoding.scale;
+  });
+  if(codec != codecs.end())
+    return codec->codec;
+  Encoding created{encoding.parameters, encoding.quality_factor, encoding.scale};
+  created.codec = DriverProtocol::frameCodec(encoding.parameters);
+  codecs.push_back(created);
+  return created.codec;
+}
+
+void FramesForwarder::Private::prune_codecs()
+{
+  codecs.erase(remove_if(codecs.begin(), codecs.end(), [this](const Encoding &e) {
+    return none_of(subscribers.begin(), subscribers.end(), [&](const SubscriberPtr &subscriber) { return subscriber->parameters.sameEncoding(e.parameters); });
+  }), codecs.end());
+}
+
+void FramesForwarder::Private::update_interval(Subscriber &subscriber) const
+{
+  // While recording, the preview shouldn't compete with the capture for bandwidth and CPU
+  chrono::milliseconds interval{recording ? 2000 : 50};
+  if(subscriber.parameters.maxFrameRate > 0)
+    interval = max(interval, chrono::milliseconds{static_cast<qint64>(1000. / subscriber.parameters.maxFrameRate)});
+  subscriber.rate.set_min_interval(interval);
+}
+
 void FramesForwarder::doHandle(FrameConstPtr frame)
 {
-  if(! DriverProtocol::isForwardingEnabled() || d->elapsed.elapsed() < (d->recording ? 2000 : 50 ) || ! d->enabled) // TODO: variable rate, depending on network delay?
+  vector<SharedMemoryFramesPtr> shared_memory;
+  {
+    QMutexLocker lock(&d->mutex);
+    for(auto subscriber: d->subscribers)
+      if(subscriber->shared_memory)
+        shared_memory.push_back(subscriber->shared_memory);
+  }
+  // A copy into each ring, whatever the network links and the encoder are up to
+  for(const auto &ring: shared_memory)
+    ring->handle(frame);
+  // Frames are dropped here, at the source, whenever the links or the encoder can't keep up
+  if(! d->enabled)
+    return;
+  if(d->encoding) {
+    d->skipped_frames_metric.add();
     return;
-  QtConcurrent::run([this, frame]{
-    d->dispatcher->queue_send(DriverProtocol::sendFrame(frame));
-    d->elapsed.restart();
+  }
+  // The raw frame bounds what its encoded packets add to the send buffers
+  if(! d->send_buffers.fits(frame->size())) {
+    d->over_budget_metric.add();
+    return;
+  }
+  vector<Private::Encoding> encodings;
+  {
+    QMutexLocker lock(&d->mutex);
+    const auto now = ForwardingRate::Clock::now();
+    for(auto it = d->subscribers.begin(); it != d->subscribers.end(); it++) {
+      if(it.value()->shared_memory)
+        continue;
+      auto &rate = it.value()->rate;
+      const bool udp = ! it.value()->udp_address.isNull();
+      // Datagrams don't queue up behind the control connection
+      if(! rate.accept(now, udp ? 0 : d->dispatcher->backlog(it.key())))
+        continue;
+      const auto &parameters = it.value()->parameters;
+      auto encoding = find_if(encodings.begin(), encodings.end(), [&](const Private::Encoding &e) {
+        return e.parameters.sameEncoding(parameters) && e.quality_factor == rate.jpeg_quality_factor() && e.scale == rate.scale();
+      });
+      if(encoding == encodings.end()) {
+        encodings.push_back({parameters, rate.jpeg_quality_factor(), rate.scale()});
+        encoding = encodings.end() - 1;
+        encoding->codec = d->codec_for(*encoding);
+      }
+      encoding->peers.push_back(it.key());
+      const Private::DatagramTarget target{it.value()->udp_address, parameters.udpPort};
+      if(! udp)
+        encoding->tcp_peers.push_back(it.key());
+      else if(! encoding->datagram_targets.contains(target)) // viewers of the same multicast group share the datagrams
+        encoding->datagram_targets.push_back(target);
+    }
+  }
+  if(encodings.empty())
+    return;
+  d->encoding = true;
+  Executor::instance(Executor::NetworkEncode).run([this, frame, encodings]{
+    for(const auto &encoding: encodings) {
+      NetworkPacketPtr packet;
+      {
+        Metrics::Timer timer{d->encode_metric};
+        packet = DriverProtocol::sendFrame(frame, encoding.parameters, encoding.quality_factor, encoding.scale, encoding.codec);
+      }
+      if(! packet)
+        continue;
+      const auto bytes = packet->payload().size() + packet->bodySize();
+      d->sent_frames_metric.add(encoding.peers.size());
+      d->sent_bytes_metric.add(bytes * encoding.peers.size());
+      {
+        QMutexLocker lock(&d->mutex);
+        const auto now = ForwardingRate::Clock::now();
+        for(auto peer: encoding.peers)
+          if(auto subscriber = d->subscribers.value(peer))
+            subscriber->rate.sent(now, bytes);
+      }
+      for(auto peer: encoding.tcp_peers)
+        d->dispatcher->queue_send(packet, peer);
+      if(! encoding.datagram_targets.isEmpty())
+        d->queue_datagrams(packet, encoding.datagram_targets);
+    }
+    d->encoding = false;
   });
 }
 
@@ -66,5 +275,43 @@ bool FramesForwarder::enabled() const {
 
 void FramesForwarder::recordingMode(bool recording)
 {
+  QMutexLocker lock(&d->mutex);
   d->recording = recording;
+  for(auto subscriber: d->subscribers)
+    d->update_interval(*subscriber);
+}
+
+void FramesForwarder::Private::queue_datagrams(const NetworkPacketPtr& packet, const QList<DatagramTarget> &targets)
+{
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  packet->sendTo(&buffer);
+  auto split = FrameDatagrams::split(data, ++datagram_sequence);
+  if(split.isEmpty()) {
+    qWarning() << "Frame too large for UDP preview, dropped:" << data.size() << "bytes";
+    return;
+  }
+  QMutexLocker lock(&datagrams_mutex);
+  datagrams.push_back({split, targets});
+  // The socket belongs to the forwarder's thread, datagrams are written there
+  QMetaObject::invokeMethod(q, "send_datagrams", Qt::QueuedConnection);
+}
+
+void FramesForwarder::send_datagrams()
+{
+  QList<QPair<QList<QByteArray>, QList<Private::DatagramTarget>>> frames;
+  {
+    QMutexLocker lock(&d->datagrams_mutex);
+    frames.swap(d->datagrams);
+  }
+  for(const auto &frame: frames) {
+    for(const auto &target: frame.second) {
+      for(const auto &datagram: frame.first) {
+        // A full send buffer loses the rest of the frame anyway: no point in sending it
+        if(d->udp_socket->writeDatagram(datagram, target.first, target.second) < 0)
+          break;
+      }
+    }
+  }
 }
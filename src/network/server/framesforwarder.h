@@ -22,17 +22,28 @@
 #include "c++/dptr.h"
 #include <QObject>
 #include "commons/fwd.h"
+#include "network/networkreceiver.h"
+#include "network/protocol/protocol.h"
 
 FWD_PTR(NetworkDispatcher)
 FWD_PTR(FramesForwarder)
+FWD(QTcpSocket)
 
-class FramesForwarder : public QObject, public ImageHandler
+class FramesForwarder : public QObject, public ImageHandler, public NetworkReceiver
 {
 Q_OBJECT
 public:
   FramesForwarder(const NetworkDispatcherPtr &dispatcher);
   ~FramesForwarder();
   bool enabled() const;
+  /**
+   * Each connected client gets frames encoded as it asked in its Hello packet; frames are encoded once for clients asking the same.
+   * Clients asking for UDP preview get frames as datagrams, sent once per multicast group.
+   * Clients on this host asking for local frames get every frame, as it is, in a shared memory ring of their own (see SharedMemoryFrames),
+   * kept across format changes: its name is returned, empty for frames going through the network.
+   */
+  QString subscribe(QTcpSocket *peer, const NetworkProtocol::FormatParameters &parameters);
+  void unsubscribe(QTcpSocket *peer);
 private:
 
   void doHandle(FrameConstPtr frame) override;
@@ -41,6 +52,8 @@ private:
 public slots:
   void setEnabled(bool enabled);
   void recordingMode(bool recording);
+private slots:
+  void send_datagrams();
 };
 
 #endif // FRAMESFORWARDER_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/histogramforwarder.h"
+#include "network/protocol/histogramprotocol.h"
+#include "network/networkdispatcher.h"
+#include "commons/configuration.h"
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/debayer.h"
+#include "commons/metrics.h"
+#include <QtNetwork/QTcpSocket>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <atomic>
+
+using namespace std;
+
+DPTR_IMPL(HistogramForwarder) {
+  const Configuration &configuration;
+  HistogramForwarder *q;
+  QMutex mutex;
+  QList<QTcpSocket*> peers;
+  // Peers whose disconnection is followed
+  QList<QTcpSocket*> watched;
+  QElapsedTimer last;
+  atomic_bool recording{false};
+  cv::Rect region(const FrameConstPtr &frame, const Configuration::Snapshot &settings) const;
+  Metrics::Counter &sent_metric = Metrics::instance().counter("histogram_packets_sent_total", "Histograms of the raw frames sent to the clients showing one");
+};
+
+HistogramForwarder::HistogramForwarder(const NetworkDispatcherPtr &dispatcher, const Configuration &configuration)
+  : NetworkReceiver{dispatcher}, dptr(configuration, this)
+{
+  register_handler(HistogramProtocol::SetHistogramEnabled, [this](const NetworkPacketPtr &packet) {
+    auto peer = this->dispatcher()->current_peer();
+    QMutexLocker lock(&d->mutex);
+    d->peers.removeAll(peer);
+    if(! HistogramProtocol::decodeSetHistogramEnabled(packet))
+      return;
+    d->peers.push_back(peer);
+    // The new client gets the next frame
+    d->last.invalidate();
+    if(d->watched.contains(peer))
+      return;
+    d->watched.push_back(peer);
+    connect(peer, &QTcpSocket::disconnected, this, [this, peer]{
+      QMutexLocker lock(&d->mutex);
+      d->peers.removeAll(peer);
+      d->watched.removeAll(peer);
+    });
+  });
+}
+
+HistogramForwarder::~HistogramForwarder()
+{
+}
+
+void HistogramForwarder::recordingMode(bool recording)
+{
+  d->recording = recording;
+}
+
+cv::Rect HistogramForwarder::Private::region(const FrameConstPtr &frame, const Configuration::Snapshot &settings) const
+{
+  const cv::Rect whole{0, 0, frame->mat().cols, frame->mat().rows};
+  switch(settings.histogram_region) {
+    case Configuration::HistogramRectangle: {
+      const QRect &rect = settings.histogram_region_rect;
+      cv::Rect region = cv::Rect{rect.x(), rect.y(), rect.width(), rect.height()} & whole;
+      if(region.area() <= 0)
+        return whole;
+      // Whole Bayer cells, so that the colours keep their proportions
+      if(frame->channels() == 1 && frame->colorFormat() != Frame::Mono) {
+        region.x &= ~1;
+        region.y &= ~1;
+      }
+      return region;
+    }
+    case Configuration::HistogramTracked:
+    case Configuration::HistogramCentroid:
+      return settings.histogram_region_size > 0 ? frame->analysis().centred_window(settings.histogram_region_size) : whole;
+    default:
+      return whole;
+  }
+}
+
+void HistogramForwarder::doHandle(FrameConstPtr frame)
+{
+  QList<QTcpSocket*> peers;
+  const auto settings = d->configuration.snapshot();
+  {
+    QMutexLocker lock(&d->mutex);
+    if(d->peers.isEmpty())
+      return;
+    if(d->recording && settings->histogram_disable_on_recording)
+      return;
+    const qint64 interval = d->recording ? settings->histogram_timeout_recording : settings->histogram_timeout;
+    if(d->last.isValid() && d->last.elapsed() < interval)
+      return;
+    d->last.start();
+    peers = d->peers;
+  }
+  // Same pass as the local histogram, on the frame at its full depth
+  const auto &counts = frame->analysis().histogram(d->region(frame, *settings), settings->histogram_sampling_step, settings->histogram_debayer);
+  auto format = frame->colorFormat();
+  if(counts.size() == 3 && Debayer::is_bayer(format))
+    format = Frame::RGB;
+  QList<HistogramSummary> channels;
+  if(counts.size() == 1)
+    channels.push_back(HistogramSummary::from_counts(counts[0], frame->bpp()));
+  else if(counts.size() == 3)
+    for(int channel: format == Frame::BGR ? QList<int>{2, 1, 0} : QList<int>{0, 1, 2})
+      channels.push_back(HistogramSummary::from_counts(counts[channel], frame->bpp()));
+  const auto packet = HistogramProtocol::histogram(channels);
+  for(auto peer: peers)
+    dispatcher()->queue_send(packet, peer);
+  d->sent_metric.add(peers.size());
+}
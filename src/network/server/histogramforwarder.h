@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTOGRAMFORWARDER_H
+#define HISTOGRAMFORWARDER_H
+
+#include "image_handlers/imagehandler.h"
+#include "c++/dptr.h"
+#include <QObject>
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(NetworkDispatcher)
+FWD_PTR(HistogramForwarder)
+class Configuration;
+
+/**
+ * Histograms of the raw frames for the clients showing one (see HistogramProtocol): remote sessions otherwise only have the previews,
+ * 8 bit, lossy and rate limited, to count. Frames are counted with the same region, sampling and refresh settings as a local histogram;
+ * around the tracked target becomes around the brightness centroid, as tracking runs on the client. Nothing is computed while no client asks.
+ */
+class HistogramForwarder : public QObject, public ImageHandler, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  HistogramForwarder(const NetworkDispatcherPtr &dispatcher, const Configuration &configuration);
+  ~HistogramForwarder();
+public slots:
+  void recordingMode(bool recording);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // HISTOGRAMFORWARDER_H
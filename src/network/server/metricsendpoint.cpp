@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/metricsendpoint.h"
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QDebug>
+#include <QHash>
+#include "commons/metrics.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+DPTR_IMPL(MetricsEndpoint) {
+  MetricsEndpoint *q;
+  unique_ptr<QTcpServer> server;
+  struct Page {
+    QByteArray content_type;
+    function<QByteArray()> build;
+  };
+  QHash<QByteArray, Page> pages;
+  void new_connection();
+  void read_request(QTcpSocket *socket);
+  static void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &content_type, const QByteArray &body);
+};
+
+// Requests are tiny: anything larger isn't a scraper
+static const int MAX_REQUEST_SIZE = 8192;
+
+MetricsEndpoint::MetricsEndpoint(QObject *parent) : QObject{parent}, dptr(this, make_unique<QTcpServer>())
+{
+  connect(d->server.get(), &QTcpServer::newConnection, this, [this]{ d->new_connection(); });
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+}
+
+bool MetricsEndpoint::listen(const QString &address, int port)
+{
+  if(! d->server->listen(QHostAddress{address}, port)) {
+    qWarning() << "Unable to serve metrics on %1:%2:"_q % address % port << d->server->errorString();
+    return false;
+  }
+  qDebug() << "Serving metrics on http://%1:%2/metrics"_q % address % port;
+  return true;
+}
+
+void MetricsEndpoint::add_page(const QString &path, const QByteArray &content_type, const function<QByteArray()> &page)
+{
+  d->pages[path.toUtf8()] = {content_type, page};
+}
+
+void MetricsEndpoint::Private::new_connection()
+{
+  while(auto socket = server->nextPendingConnection()) {
+    QObject::connect(socket, &QTcpSocket::readyRead, q, [this, socket]{ read_request(socket); });
+    QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+void MetricsEndpoint::Private::read_request(QTcpSocket *socket)
+{
+  // Wait for the whole header: only the request line matters, the rest is ignored
+  if(! socket->canReadLine() || ! socket->peek(MAX_REQUEST_SIZE).contains("\r\n\r\n")) {
+    if(socket->bytesAvailable() > MAX_REQUEST_SIZE)
+      respond(socket, "413 Payload Too Large", "text/plain", "Request too large\n");
+    return;
+  }
+  auto request = socket->readLine().trimmed().split(' ');
+  socket->readAll();
+  if(request.size() < 2 || request[0] != "GET") {
+    respond(socket, "405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+    return;
+  }
+  const auto path = request[1].split('?').first();
+  if(pages.contains(path)) {
+    const auto &page = pages[path];
+    respond(socket, "200 OK", page.content_type, page.build());
+    return;
+  }
+  if(path != "/metrics") {
+    respond(socket, "404 Not Found", "text/plain", "Metrics are at /metrics\n");
+    return;
+  }
+  respond(socket, "200 OK", "text/plain; version=0.0.4; charset=utf-8", Metrics::exposition(Metrics::instance().snapshot()));
+}
+
+void MetricsEndpoint::Private::respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &content_type, const QByteArray &body)
+{
+  socket->write("HTTP/1.1 " + status + "\r\n");
+  socket->write("Content-Type: " + content_type + "\r\n");
+  socket->write("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+  socket->write("Connection: close\r\n\r\n");
+  socket->write(body);
+  socket->disconnectFromHost();
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICSENDPOINT_H
+#define METRICSENDPOINT_H
+#include <QObject>
+#include <functional>
+#include "c++/dptr.h"
+
+/**
+ * Minimal HTTP server exposing the metrics at /metrics, in the Prometheus text format, for monitoring unattended setups.
+ * Each connection gets a single response and is then closed. Other pages (i.e. the frames pipeline) can be added at their own paths.
+ */
+class MetricsEndpoint : public QObject
+{
+  Q_OBJECT
+public:
+  MetricsEndpoint(QObject *parent = nullptr);
+  ~MetricsEndpoint();
+  bool listen(const QString &address, int port);
+  /// Served at path, built on the endpoint thread for each request
+  void add_page(const QString &path, const QByteArray &content_type, const std::function<QByteArray()> &page);
+private:
+  DPTR
+};
+
+#endif // METRICSENDPOINT_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICSFORWARDER_H
+#define METRICSFORWARDER_H
+
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(MetricsForwarder)
+FWD_PTR(NetworkDispatcher)
+
+/// Answers clients asking for the server metrics
+class MetricsForwarder : public NetworkReceiver
+{
+public:
+  MetricsForwarder(const NetworkDispatcherPtr &dispatcher);
+  ~MetricsForwarder();
+};
+
+#endif // METRICSFORWARDER_H
@@ -29,6 +29,7 @@
 #include "Qt/qt_strings_helper.h"
 #include <QElapsedTimer>
 #include "network/server/filesystemforwarder.h"
+#include "network/server/metricsforwarder.h"
 #include "image_handlers/saveimages.h"
 #include "planetaryimager.h"
 #include "commons/definitions.h"
@@ -44,6 +45,7 @@ DPTR_IMPL(NetworkServer) {
   unique_ptr<QTcpServer> server;
   DriverForwarderPtr forwarder;
   FilesystemForwarderPtr filesystemForwarder;
+  MetricsForwarderPtr metricsForwarder;
   void new_connection();
   void bytes_sent(quint64 written, quint64 sent);
   QElapsedTimer elapsed;
@@ -58,19 +60,25 @@ NetworkServer::NetworkServer(
   QObject *parent)
   : QObject{parent}, NetworkReceiver{dispatcher}, dptr(this, planetaryImager, dispatcher, framesForwarder, make_unique<QTcpServer>())
 {
-  d->server->setMaxPendingConnections(1);
-  d->filesystemForwarder = make_shared<FilesystemForwarder>(dispatcher);
+  d->filesystemForwarder = make_shared<FilesystemForwarder>(dispatcher, planetaryImager->configuration());
+  d->metricsForwarder = make_shared<MetricsForwarder>(dispatcher);
   connect(d->server.get(), &QTcpServer::newConnection, bind(&Private::new_connection, d.get()));
   d->forwarder = make_shared<DriverForwarder>(dispatcher, planetaryImager);
   register_handler(NetworkProtocol::Hello, [this](const NetworkPacketPtr &p){
-    DriverProtocol::setFormatParameters(NetworkProtocol::decodeHello(p));
+    const auto shared_memory = d->framesForwarder->subscribe(d->dispatcher->current_peer(), NetworkProtocol::decodeHello(p));
+    d->dispatcher->setPeerPacketTypes(d->dispatcher->current_peer(), NetworkProtocol::packetTypes(p));
     QVariantMap status;
     d->forwarder->getStatus(status);
-    d->dispatcher->send(NetworkProtocol::packetHelloReply() << status);
+    if(! shared_memory.isEmpty())
+      status["sharedMemoryFrames"] = shared_memory;
+    NetworkProtocol::addPacketTypes(status);
+    d->dispatcher->reply(NetworkProtocol::packetHelloReply() << status);
   });
   
-  register_handler(NetworkProtocol::ping, [this](const NetworkPacketPtr &) {
-    d->dispatcher->send(NetworkProtocol::packetpong());
+  register_handler(NetworkProtocol::ping, [this](const NetworkPacketPtr &packet) {
+    // Clients measuring the link (see NetworkClient::probeLink) ask for a pong of that many bytes
+    const qint64 bytes = qBound<qint64>(0, packet->payloadVariant().toLongLong(), 64 * 1024 * 1024);
+    d->dispatcher->reply(bytes > 0 ? NetworkProtocol::packetpong() << QByteArray(static_cast<int>(bytes), '\0') : NetworkProtocol::packetpong());
   });
   register_handler(DriverProtocol::StartLive, [this](const NetworkPacketPtr &){
       d->elapsed.restart();
@@ -91,15 +99,18 @@ void NetworkServer::listen(const QString& address, int port)
 
 void NetworkServer::Private::new_connection()
 {
-  auto socket = server->nextPendingConnection();
-  QObject::connect(socket, &QTcpSocket::disconnected, q, [this, socket] {
-    qDebug() << "Client disconnected";
-    dispatcher->setSocket(nullptr);
-  });
-  dispatcher->setSocket(socket);
-  socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
-  
-  q->wait_for_processed(NetworkProtocol::Hello);
+  // Any number of clients: a GUI, scripts and monitors can be connected at the same time
+  while(auto socket = server->nextPendingConnection()) {
+    qDebug() << "Client connected: " << socket->peerAddress().toString();
+    QObject::connect(socket, &QTcpSocket::disconnected, q, [this, socket] {
+      qDebug() << "Client disconnected";
+      framesForwarder->unsubscribe(socket);
+      dispatcher->removeSocket(socket);
+      socket->deleteLater();
+    });
+    dispatcher->addSocket(socket);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+  }
 }
 
 namespace {
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/previewendpoint.h"
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QDebug>
+#include <atomic>
+#include <chrono>
+#include <opencv2/opencv.hpp>
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/debayer.h"
+#include "commons/metrics.h"
+#include "commons/tracing.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+namespace {
+// Requests are tiny: anything larger isn't a browser
+const int MAX_REQUEST_SIZE = 8192;
+// Previews wider than this are scaled down before encoding
+const int MAX_PREVIEW_WIDTH = 1280;
+const int JPEG_QUALITY = 80;
+const QByteArray boundary = "planetaryimagerframe";
+const QByteArray page = R"(<!DOCTYPE html>
+<html><head><title>PlanetaryImager</title>
+<style>body { margin: 0; background: #000; } img { display: block; margin: auto; max-width: 100vw; max-height: 100vh; }</style>
+</head><body><img src="/stream" alt="Live view"></body></html>
+)";
+}
+
+DPTR_IMPL(PreviewEndpoint) {
+  PreviewEndpoint *q;
+  const chrono::steady_clock::duration interval;
+  unique_ptr<QTcpServer> server;
+  Metrics::Counter &encoded;
+  Metrics::Counter &sent;
+  Metrics::Counter &dropped;
+  Metrics::Gauge &viewers_gauge;
+  QList<QTcpSocket*> viewers;
+  QByteArray latest;
+  // Read on the frames thread: nothing gets encoded without viewers
+  atomic_int watching{0};
+  chrono::steady_clock::time_point last_encoded;
+  void new_connection();
+  void read_request(QTcpSocket *socket);
+  void start_stream(QTcpSocket *socket);
+  void remove_viewer(QTcpSocket *socket);
+  static void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &content_type, const QByteArray &body);
+  static QByteArray part(const QByteArray &jpeg);
+};
+
+PreviewEndpoint::PreviewEndpoint(int fps, QObject *parent) : QObject{parent}, dptr(this,
+  chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1. / max(fps, 1))),
+  make_unique<QTcpServer>(),
+  Metrics::instance().counter("preview_frames_encoded_total", "Frames encoded for the HTTP preview, once for all the viewers"),
+  Metrics::instance().counter("preview_frames_sent_total", "Frames sent to HTTP preview viewers"),
+  Metrics::instance().counter("preview_frames_dropped_total", "Frames skipped for HTTP preview viewers still receiving the previous one"),
+  Metrics::instance().gauge("preview_viewers", "HTTP preview viewers connected"))
+{
+  connect(d->server.get(), &QTcpServer::newConnection, this, [this]{ d->new_connection(); });
+}
+
+PreviewEndpoint::~PreviewEndpoint()
+{
+}
+
+bool PreviewEndpoint::listen(const QString &address, int port)
+{
+  if(! d->server->listen(QHostAddress{address}, port)) {
+    qWarning() << "Unable to serve the preview on %1:%2:"_q % address % port << d->server->errorString();
+    return false;
+  }
+  qDebug() << "Serving the preview on http://%1:%2/"_q % address % port;
+  return true;
+}
+
+void PreviewEndpoint::doHandle(FrameConstPtr frame)
+{
+  if(d->watching == 0)
+    return;
+  const auto now = chrono::steady_clock::now();
+  if(now - d->last_encoded < d->interval)
+    return;
+  d->last_encoded = now;
+  Tracing::Span span{"PreviewEndpoint::doHandle", frame->sequence()};
+  // The views are shared with the other consumers of the frame: colour conversions go to a matrix of our own
+  cv::Mat image;
+  auto &analysis = frame->analysis();
+  if(Debayer::is_bayer(frame->colorFormat())) {
+    // Superpixel halves the size, which a preview would lose anyway, for the cheapest debayer there is
+    const cv::Mat &rgb = analysis.debayered_half();
+    if(! rgb.empty())
+      cv::cvtColor(rgb, image, cv::COLOR_RGB2BGR);
+  } else if(frame->colorFormat() == Frame::RGB) {
+    cv::cvtColor(analysis.as_8bit(), image, cv::COLOR_RGB2BGR);
+  } else {
+    image = analysis.as_8bit();
+  }
+  if(image.empty())
+    return;
+  if(image.cols > MAX_PREVIEW_WIDTH) {
+    const double scale = static_cast<double>(MAX_PREVIEW_WIDTH) / image.cols;
+    cv::resize(image, image, cv::Size{}, scale, scale, cv::INTER_AREA);
+  }
+  vector<uchar> data;
+  if(! cv::imencode(".jpg", image, data, {cv::IMWRITE_JPEG_QUALITY, JPEG_QUALITY}))
+    return;
+  d->encoded.add();
+  QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection, Q_ARG(QByteArray, QByteArray(reinterpret_cast<const char*>(data.data()), data.size())));
+}
+
+void PreviewEndpoint::publish(const QByteArray &jpeg)
+{
+  d->latest = jpeg;
+  const auto frame_part = Private::part(jpeg);
+  for(auto viewer: d->viewers) {
+    // Still busy with an earlier frame: only this viewer misses this one
+    if(viewer->bytesToWrite() > 0) {
+      d->dropped.add();
+      continue;
+    }
+    viewer->write(frame_part);
+    d->sent.add();
+  }
+}
+
+QByteArray PreviewEndpoint::Private::part(const QByteArray &jpeg)
+{
+  return "--" + boundary + "\r\nContent-Type: image/jpeg\r\nContent-Length: " + QByteArray::number(jpeg.size()) + "\r\n\r\n" + jpeg + "\r\n";
+}
+
+void PreviewEndpoint::Private::new_connection()
+{
+  while(auto socket = server->nextPendingConnection()) {
+    QObject::connect(socket, &QTcpSocket::readyRead, q, [this, socket]{ read_request(socket); });
+    QObject::connect(socket, &QTcpSocket::disconnected, q, [this, socket]{ remove_viewer(socket); });
+    QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+void PreviewEndpoint::Private::read_request(QTcpSocket *socket)
+{
+  // Viewers don't send anything else once streaming
+  if(viewers.contains(socket)) {
+    socket->readAll();
+    return;
+  }
+  if(! socket->canReadLine() || ! socket->peek(MAX_REQUEST_SIZE).contains("\r\n\r\n")) {
+    if(socket->bytesAvailable() > MAX_REQUEST_SIZE)
+      respond(socket, "413 Payload Too Large", "text/plain", "Request too large\n");
+    return;
+  }
+  auto request = socket->readLine().trimmed().split(' ');
+  socket->readAll();
+  if(request.size() < 2 || request[0] != "GET") {
+    respond(socket, "405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+    return;
+  }
+  const auto path = request[1].split('?').first();
+  if(path == "/")
+    respond(socket, "200 OK", "text/html; charset=utf-8", page);
+  else if(path == "/stream")
+    start_stream(socket);
+  else if(path == "/snapshot.jpg" && ! latest.isEmpty())
+    respond(socket, "200 OK", "image/jpeg", latest);
+  else if(path == "/snapshot.jpg")
+    respond(socket, "503 Service Unavailable", "text/plain", "No frames yet\n");
+  else
+    respond(socket, "404 Not Found", "text/plain", "The live view is at /\n");
+}
+
+void PreviewEndpoint::Private::start_stream(QTcpSocket *socket)
+{
+  socket->write("HTTP/1.1 200 OK\r\n"
+                "Content-Type: multipart/x-mixed-replace; boundary=" + boundary + "\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Connection: close\r\n\r\n");
+  if(! latest.isEmpty())
+    socket->write(part(latest));
+  viewers.append(socket);
+  watching = viewers.size();
+  viewers_gauge.set(viewers.size());
+}
+
+void PreviewEndpoint::Private::remove_viewer(QTcpSocket *socket)
+{
+  if(! viewers.removeOne(socket))
+    return;
+  watching = viewers.size();
+  viewers_gauge.set(viewers.size());
+}
+
+void PreviewEndpoint::Private::respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &content_type, const QByteArray &body)
+{
+  socket->write("HTTP/1.1 " + status + "\r\n");
+  socket->write("Content-Type: " + content_type + "\r\n");
+  socket->write("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+  socket->write("Connection: close\r\n\r\n");
+  socket->write(body);
+  socket->disconnectFromHost();
+}
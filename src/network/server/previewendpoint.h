@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PREVIEWENDPOINT_H
+#define PREVIEWENDPOINT_H
+#include <QObject>
+#include "c++/dptr.h"
+#include "image_handlers/imagehandler.h"
+
+/**
+ * Browser live view over HTTP: an MJPEG stream (multipart/x-mixed-replace) at /stream, the latest frame at /snapshot.jpg,
+ * and a page showing the stream at /.
+ * Each preview frame is encoded once, at most fps times per second and only while somebody is watching, then written to every viewer.
+ * A viewer still receiving the previous frame skips the new one: slow viewers drop frames, without holding back the others.
+ */
+class PreviewEndpoint : public QObject, public ImageHandler
+{
+  Q_OBJECT
+public:
+  PreviewEndpoint(int fps, QObject *parent = nullptr);
+  ~PreviewEndpoint();
+  bool listen(const QString &address, int port);
+private:
+  void doHandle(FrameConstPtr frame) override;
+  Q_INVOKABLE void publish(const QByteArray &jpeg);
+  DPTR
+};
+
+#endif // PREVIEWENDPOINT_H
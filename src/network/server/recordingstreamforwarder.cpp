@@ -0,0 +1,131 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/server/recordingstreamforwarder.h"
+#include "network/protocol/savefileprotocol.h"
+#include "network/protocol/driverprotocol.h"
+#include "network/networkdispatcher.h"
+#include "network/networkpacket.h"
+#include "commons/configuration.h"
+#include "commons/frame.h"
+#include "commons/metrics.h"
+#include <QtNetwork/QTcpSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <deque>
+
+using namespace std;
+
+DPTR_IMPL(RecordingStreamForwarder) {
+  Configuration &configuration;
+  RecordingStreamForwarder *q;
+  QMutex mutex;
+  // Only one client at a time records on its own disk
+  QTcpSocket *peer = nullptr;
+  qint64 credits = 0;
+  deque<FrameConstPtr> frames;
+  qint64 queued_bytes = 0;
+  qint64 max_bytes = 0;
+  qint64 dropped = 0;
+  qint64 reported_dropped = 0;
+  QMetaObject::Connection peer_disconnected;
+  void send_queued();
+  void stop();
+  Metrics::Counter &sent_frames_metric = Metrics::instance().counter("recording_stream_frames_sent_total", "Frames streamed to clients recording on their own disk");
+  Metrics::Counter &dropped_frames_metric = Metrics::instance().counter("recording_stream_frames_dropped_total", "Frames not streamed to clients recording on their own disk, since the buffer was full");
+  Metrics::Gauge &queued_bytes_metric = Metrics::instance().gauge("recording_stream_queued_bytes", "Bytes of frames waiting for credits from the client recording on its own disk");
+};
+
+RecordingStreamForwarder::RecordingStreamForwarder(const NetworkDispatcherPtr &dispatcher, Configuration &configuration)
+  : NetworkReceiver{dispatcher}, dptr(configuration, this)
+{
+  register_handler(SaveFileProtocol::StartRecordingStream, [this](const NetworkPacketPtr &packet) {
+    auto peer = this->dispatcher()->current_peer();
+    QMutexLocker lock(&d->mutex);
+    d->stop();
+    d->peer = peer;
+    d->credits = packet->payloadVariant().toInt();
+    d->max_bytes = d->configuration.max_memory_usage();
+    d->peer_disconnected = connect(peer, &QTcpSocket::disconnected, this, [this]{
+      QMutexLocker lock(&d->mutex);
+      d->stop();
+    });
+  });
+  register_handler(SaveFileProtocol::EndRecordingStream, [this](const NetworkPacketPtr &) {
+    QMutexLocker lock(&d->mutex);
+    if(this->dispatcher()->current_peer() == d->peer)
+      d->stop();
+  });
+  register_handler(SaveFileProtocol::RecordingStreamCredits, [this](const NetworkPacketPtr &packet) {
+    QMutexLocker lock(&d->mutex);
+    if(this->dispatcher()->current_peer() != d->peer)
+      return;
+    d->credits += packet->payloadVariant().toInt();
+    d->send_queued();
+  });
+}
+
+RecordingStreamForwarder::~RecordingStreamForwarder()
+{
+}
+
+void RecordingStreamForwarder::Private::stop()
+{
+  QObject::disconnect(peer_disconnected);
+  peer = nullptr;
+  credits = 0;
+  frames.clear();
+  queued_bytes = 0;
+  queued_bytes_metric.set(0);
+  dropped = 0;
+  reported_dropped = 0;
+}
+
+void RecordingStreamForwarder::Private::send_queued()
+{
+  while(credits > 0 && ! frames.empty()) {
+    auto frame = frames.front();
+    frames.pop_front();
+    queued_bytes -= frame->size();
+    credits--;
+    q->dispatcher()->queue_send(DriverProtocol::rawFrame(frame, SaveFileProtocol::packetRecordingStreamFrame()), peer);
+    sent_frames_metric.add();
+  }
+  queued_bytes_metric.set(queued_bytes);
+  // Sent along with the frames, so that the client counters are at most one packet behind
+  if(dropped != reported_dropped) {
+    q->dispatcher()->queue_send(SaveFileProtocol::packetsignalRecordingStreamDropped() << QVariant{dropped}, peer);
+    reported_dropped = dropped;
+  }
+}
+
+void RecordingStreamForwarder::doHandle(FrameConstPtr frame)
+{
+  QMutexLocker lock(&d->mutex);
+  if(! d->peer)
+    return;
+  // A busy client disk or a slow link only costs frames once the buffer is full; they're never lost silently
+  if(d->queued_bytes + static_cast<qint64>(frame->size()) > d->max_bytes) {
+    d->dropped++;
+    d->dropped_frames_metric.add();
+  } else {
+    d->frames.push_back(frame);
+    d->queued_bytes += frame->size();
+  }
+  d->send_queued();
+}
@@ -0,0 +1,49 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDINGSTREAMFORWARDER_H
+#define RECORDINGSTREAMFORWARDER_H
+
+#include "image_handlers/imagehandler.h"
+#include "c++/dptr.h"
+#include <QObject>
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(NetworkDispatcher)
+FWD_PTR(RecordingStreamForwarder)
+class Configuration;
+
+/**
+ * Record on client: streams every frame, lossless, to the client that asked for it (see SaveFileProtocol::StartRecordingStream).
+ * Frames are sent as long as the client grants credits; while it doesn't, they wait in memory, up to max_memory_usage bytes.
+ * Frames that don't fit are dropped, and the client is told how many.
+ * Must see every frame: add it to the frames fanout inline, it only queues them.
+ */
+class RecordingStreamForwarder : public QObject, public ImageHandler, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  RecordingStreamForwarder(const NetworkDispatcherPtr &dispatcher, Configuration &configuration);
+  ~RecordingStreamForwarder();
+private:
+  void doHandle(FrameConstPtr frame) override;
+  DPTR
+};
+
+#endif // RECORDINGSTREAMFORWARDER_H
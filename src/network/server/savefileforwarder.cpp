@@ -23,32 +23,78 @@
 #include "image_handlers/saveimages.h"
 #include "network/networkdispatcher.h"
 #include "network/networkpacket.h"
+#include "commons/configuration.h"
+#include <QTimer>
+#include <functional>
+
+using namespace std;
 
 DPTR_IMPL(SaveFileForwarder) {
   const SaveImagesPtr save_images;
+  Configuration &configuration;
   SaveFileForwarder *q;
   Imager *imager = nullptr;
+  // Values changed since the last status packet: recording signals can come for every single frame
+  QVariantMap status;
+  QTimer *status_timer;
+  void send_status();
 };
 
-SaveFileForwarder::SaveFileForwarder(const SaveImagesPtr& save_images, const NetworkDispatcherPtr& dispatcher) : NetworkReceiver{dispatcher}, dptr(save_images)
+SaveFileForwarder::SaveFileForwarder(const SaveImagesPtr& save_images, const NetworkDispatcherPtr& dispatcher, Configuration &configuration)
+  : NetworkReceiver{dispatcher}, dptr(save_images, configuration, this)
 {
+  d->status_timer = new QTimer{this};
+  connect(d->status_timer, &QTimer::timeout, this, bind(&Private::send_status, d.get()));
   register_handler(SaveFileProtocol::StartRecording, [this](const NetworkPacketPtr &) { d->save_images->startRecording(d->imager); });
   register_handler(SaveFileProtocol::slotSetPaused, [this](const NetworkPacketPtr &p) { d->save_images->setPaused(p->payloadVariant().toBool()); });
   register_handler(SaveFileProtocol::EndRecording, [this](const NetworkPacketPtr &) { d->save_images->endRecording(); });
-  QObject::connect(save_images.get(), &SaveImages::saveFPS, save_images.get(), [this](double fps) { this->dispatcher()->queue_send(SaveFileProtocol::packetsignalSaveFPS() << QVariant{fps}); } );
-  QObject::connect(save_images.get(), &SaveImages::meanFPS, save_images.get(), [this](double fps) { this->dispatcher()->queue_send(SaveFileProtocol::packetsignalMeanFPS() << QVariant{fps}); } );
-  QObject::connect(save_images.get(), &SaveImages::savedFrames, save_images.get(), [this](long frames) { this->dispatcher()->queue_send(SaveFileProtocol::packetsignalSavedFrames() << QVariant{static_cast<qlonglong>(frames)}); } );
-  QObject::connect(save_images.get(), &SaveImages::droppedFrames, save_images.get(), [this](long frames) { this->dispatcher()->queue_send(SaveFileProtocol::packetsignalDroppedFrames() << QVariant{static_cast<qlonglong>(frames)}); } );
-  QObject::connect(save_images.get(), &SaveImages::recording, save_images.get(), [this](const QString &file) {
+  register_handler(SaveFileProtocol::Trigger, [this](const NetworkPacketPtr &p) { d->save_images->trigger(p->payloadVariant().toMap()); });
+  register_handler(SaveFileProtocol::ProbeStorage, [this](const NetworkPacketPtr &) { d->save_images->probeStorage(); });
+  QObject::connect(save_images.get(), &SaveImages::saveFPS, this, [this](double fps) { d->status[SaveFileProtocol::SaveFPS] = fps; } );
+  QObject::connect(save_images.get(), &SaveImages::meanFPS, this, [this](double fps) { d->status[SaveFileProtocol::MeanFPS] = fps; } );
+  QObject::connect(save_images.get(), &SaveImages::savedFrames, this, [this](long frames) { d->status[SaveFileProtocol::SavedFrames] = static_cast<qlonglong>(frames); } );
+  QObject::connect(save_images.get(), &SaveImages::droppedFrames, this, [this](long frames) { d->status[SaveFileProtocol::DroppedFrames] = static_cast<qlonglong>(frames); } );
+  QObject::connect(save_images.get(), &SaveImages::queueUsage, this, [this](qint64 bytes, qint64 peak_bytes, qint64 max_bytes) {
+    d->status[SaveFileProtocol::QueueBytes] = bytes;
+    d->status[SaveFileProtocol::QueuePeakBytes] = peak_bytes;
+    d->status[SaveFileProtocol::QueueMaxBytes] = max_bytes;
+  } );
+  QObject::connect(save_images.get(), &SaveImages::writeThroughput, this, [this](double bytes_per_second) { d->status[SaveFileProtocol::WriteThroughput] = bytes_per_second; } );
+  QObject::connect(save_images.get(), &SaveImages::preTriggerBuffer, this, [this](qint64 bytes, double seconds) {
+    d->status[SaveFileProtocol::PreTriggerBytes] = bytes;
+    d->status[SaveFileProtocol::PreTriggerSeconds] = seconds;
+  } );
+  QObject::connect(save_images.get(), &SaveImages::deferredWrites, this, [this](qint64 pending_bytes, qint64 available_bytes) {
+    d->status[SaveFileProtocol::DeferredPendingBytes] = pending_bytes;
+    d->status[SaveFileProtocol::DeferredAvailableBytes] = available_bytes;
+  } );
+  QObject::connect(save_images.get(), &SaveImages::loadShedding, this, [this](int level) { d->status[SaveFileProtocol::LoadShedding] = level; } );
+  QObject::connect(save_images.get(), &SaveImages::storageProbed, this, [this](double bytes_per_second, double latency_p99_ms, double capture_fps, qint64 frame_bytes) {
+    this->dispatcher()->queue_send(SaveFileProtocol::packetsignalStorageProbed() << QVariant{QVariantList{bytes_per_second, latency_p99_ms, capture_fps, frame_bytes}});
+  } );
+  QObject::connect(save_images.get(), &SaveImages::recording, this, [this](const QString &file) {
     emit isRecording(true);
+    d->status.clear();
+    d->status_timer->start(1000 / qBound(1, d->configuration.server_recording_status_rate(), 100));
     this->dispatcher()->queue_send(SaveFileProtocol::packetsignalRecording() << QVariant{file});
   } );
-  QObject::connect(save_images.get(), &SaveImages::finished, save_images.get(), [this]{
+  QObject::connect(save_images.get(), &SaveImages::finished, this, [this]{
+    // Final counters before the end of the recording
+    d->send_status();
+    d->status_timer->stop();
     this->dispatcher()->queue_send(SaveFileProtocol::packetsignalFinished());
     emit isRecording(false);
   } );
 }
 
+void SaveFileForwarder::Private::send_status()
+{
+  if(status.isEmpty())
+    return;
+  q->dispatcher()->queue_send(SaveFileProtocol::packetsignalRecordingStatus() << QVariant{status});
+  status.clear();
+}
+
 void SaveFileForwarder::setImager(Imager* imager)
 {
   d->imager = imager;
@@ -29,12 +29,13 @@ FWD_PTR(SaveImages)
 FWD(Imager)
 FWD_PTR(NetworkDispatcher)
 FWD_PTR(SaveFileForwarder)
+class Configuration;
 
 class SaveFileForwarder : public QObject, public NetworkReceiver
 {
   Q_OBJECT
 public:
-  SaveFileForwarder(const SaveImagesPtr &save_images, const NetworkDispatcherPtr &dispatcher);
+  SaveFileForwarder(const SaveImagesPtr &save_images, const NetworkDispatcherPtr &dispatcher, Configuration &configuration);
   ~SaveFileForwarder();
   void setImager(Imager *imager);
 signals:
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/sequenceforwarder.h"
+#include "network/server/sequencerunner.h"
+#include "network/protocol/sequenceprotocol.h"
+#include "network/networkdispatcher.h"
+#include "network/networkpacket.h"
+#include <QDebug>
+
+using namespace std;
+
+DPTR_IMPL(SequenceForwarder) {
+  const PlanetaryImagerPtr planetaryImager;
+  const ConfigurationForwarderPtr configuration;
+  SequenceRunner runner{planetaryImager, configuration};
+};
+
+SequenceForwarder::SequenceForwarder(const NetworkDispatcherPtr &dispatcher, const PlanetaryImagerPtr &planetaryImager, const ConfigurationForwarderPtr &configuration)
+  : NetworkReceiver{dispatcher}, dptr(planetaryImager, configuration)
+{
+  register_handler(SequenceProtocol::RunSequence, [this](const NetworkPacketPtr &packet) {
+    QString script, name;
+    SequenceProtocol::decodeRunSequence(packet, script, name);
+    qDebug() << "Running sequence" << name;
+    this->dispatcher()->reply(SequenceProtocol::runSequenceReply(d->runner.start(script, name)));
+  });
+  register_handler(SequenceProtocol::AbortSequence, [this](const NetworkPacketPtr &) { d->runner.abort(); });
+  connect(&d->runner, &SequenceRunner::log, this, [this](const QString &message) {
+    this->dispatcher()->queue_send(SequenceProtocol::packetsignalSequenceLog() << QVariant{message});
+  });
+  connect(&d->runner, &SequenceRunner::finished, this, [this](const QString &name, bool success, const QString &result) {
+    qDebug() << "Sequence" << name << (success ? "finished:" : "failed:") << result;
+    this->dispatcher()->queue_send(SequenceProtocol::sequenceFinished(name, success, result));
+  });
+}
+
+SequenceForwarder::~SequenceForwarder()
+{
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SEQUENCEFORWARDER_H
+#define SEQUENCEFORWARDER_H
+
+#include <QObject>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+#include "network/networkreceiver.h"
+
+FWD_PTR(SequenceForwarder)
+FWD_PTR(NetworkDispatcher)
+FWD_PTR(PlanetaryImager)
+FWD_PTR(ConfigurationForwarder)
+
+/// Runs the capture sequences uploaded by clients (see SequenceRunner); log lines and results go to all of them
+class SequenceForwarder : public QObject, public NetworkReceiver
+{
+  Q_OBJECT
+public:
+  SequenceForwarder(const NetworkDispatcherPtr &dispatcher, const PlanetaryImagerPtr &planetaryImager, const ConfigurationForwarderPtr &configuration);
+  ~SequenceForwarder();
+private:
+  DPTR
+};
+
+#endif // SEQUENCEFORWARDER_H
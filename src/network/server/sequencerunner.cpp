@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "network/server/sequencerunner.h"
+#include "network/server/configurationforwarder.h"
+#include "planetaryimager.h"
+#include "image_handlers/saveimages.h"
+#include "drivers/imager.h"
+#include "Qt/qt_strings_helper.h"
+#include <QtQml/QJSEngine>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+typedef function<void()> MainThreadJob;
+Q_DECLARE_METATYPE(MainThreadJob)
+
+namespace {
+  // Anything touching the imager or the recording runs on the main thread, as the network requests do
+  class MainThread : public QObject {
+    Q_OBJECT
+  public:
+    Q_INVOKABLE void run(const MainThreadJob &job) { job(); }
+  };
+
+  // Shared by the runner and the pi object of the running script
+  struct SequenceContext {
+    SequenceContext(const PlanetaryImagerPtr &planetaryImager, const ConfigurationForwarderPtr &configuration, SequenceRunner *runner)
+      : planetaryImager{planetaryImager}, configuration{configuration}, runner{runner} {}
+    const PlanetaryImagerPtr planetaryImager;
+    const ConfigurationForwarderPtr configuration;
+    SequenceRunner *runner;
+    MainThread main_thread;
+    atomic_bool aborting{false};
+    QSemaphore recording_finished;
+    QMutex mutex;
+    QString recording_file;
+    void on_main(const MainThreadJob &job);
+    /// false when aborted, or on timeout (timeout <= 0: none)
+    bool wait(QSemaphore &semaphore, double timeout_seconds);
+  };
+
+  /// The scripts' pi object, living in the sequence thread
+  class SequenceApi : public QObject {
+    Q_OBJECT
+  public:
+    SequenceApi(SequenceContext &context, QObject *parent) : QObject{parent}, context(context) {}
+    Q_INVOKABLE void log(const QString &message) { emit context.runner->log(message); }
+    Q_INVOKABLE bool aborted() const { return context.aborting; }
+    Q_INVOKABLE bool sleep(double seconds) {
+      QSemaphore never;
+      context.wait(never, seconds);
+      return ! context.aborting;
+    }
+    Q_INVOKABLE QVariantList controls() {
+      QVariantList controls;
+      context.on_main([&]{
+        if(auto imager = context.planetaryImager->imager())
+          for(auto control: imager->controls())
+            controls.append(QVariantMap{{"id", control.id}, {"name", control.name}, {"value", control.value}});
+      });
+      return controls;
+    }
+    Q_INVOKABLE bool setControl(const QString &name, const QVariant &value) {
+      bool found = false;
+      context.on_main([&]{
+        auto imager = context.planetaryImager->imager();
+        if(! imager)
+          return;
+        for(auto control: imager->controls()) {
+          if(control.name.compare(name, Qt::CaseInsensitive) == 0) {
+            control.value = value;
+            imager->setControl(control);
+            found = true;
+            return;
+          }
+        }
+      });
+      if(! found)
+        log("Control not found: %1"_q % name);
+      return found;
+    }
+    Q_INVOKABLE QVariant configuration(const QString &name) {
+      QVariant value;
+      context.on_main([&]{ value = context.configuration->value(name); });
+      return value;
+    }
+    Q_INVOKABLE bool setConfiguration(const QString &name, const QVariant &value) {
+      bool set = false;
+      context.on_main([&]{ set = context.configuration->setValue(name, value); });
+      if(! set)
+        log("Unknown setting: %1"_q % name);
+      return set;
+    }
+    Q_INVOKABLE void startRecording() {
+      context.recording_finished.tryAcquire(context.recording_finished.available());
+      {
+        QMutexLocker lock(&context.mutex);
+        context.recording_file.clear();
+      }
+      context.on_main([this]{ context.planetaryImager->startRecording(); });
+    }
+    Q_INVOKABLE void stopRecording() {
+      context.on_main([this]{ context.planetaryImager->stopRecording(); });
+    }
+    Q_INVOKABLE bool waitRecording(double timeout_seconds = 0) {
+      return context.wait(context.recording_finished, timeout_seconds);
+    }
+    Q_INVOKABLE QString record(double timeout_seconds = 0) {
+      startRecording();
+      if(! waitRecording(timeout_seconds)) {
+        stopRecording();
+        return {};
+      }
+      QMutexLocker lock(&context.mutex);
+      return context.recording_file;
+    }
+  private:
+    SequenceContext &context;
+  };
+}
+
+DPTR_IMPL(SequenceRunner) {
+  SequenceRunner *q;
+  unique_ptr<SequenceContext> context;
+  QThreadPool thread;
+  atomic_bool running{false};
+  QJSEngine *engine = nullptr;
+};
+
+void SequenceContext::on_main(const MainThreadJob &job)
+{
+  if(aborting)
+    return;
+  if(QThread::currentThread() == main_thread.thread())
+    job();
+  else
+    QMetaObject::invokeMethod(&main_thread, "run", Qt::BlockingQueuedConnection, Q_ARG(MainThreadJob, [this, job]{
+      if(! aborting)
+        job();
+    }));
+}
+
+bool SequenceContext::wait(QSemaphore &semaphore, double timeout_seconds)
+{
+  QElapsedTimer elapsed;
+  elapsed.start();
+  while(! aborting) {
+    if(semaphore.tryAcquire(1, 50))
+      return true;
+    if(timeout_seconds > 0 && elapsed.elapsed() >= timeout_seconds * 1000)
+      return false;
+  }
+  return false;
+}
+
+SequenceRunner::SequenceRunner(const PlanetaryImagerPtr &planetaryImager, const ConfigurationForwarderPtr &configuration) : dptr(this)
+{
+  qRegisterMetaType<MainThreadJob>("MainThreadJob");
+  d->context = make_unique<SequenceContext>(planetaryImager, configuration, this);
+  d->thread.setMaxThreadCount(1);
+  // The recording signals come from the writer thread
+  connect(planetaryImager->saveImages().get(), &SaveImages::recording, this, [this](const QString &file) {
+    QMutexLocker lock(&d->context->mutex);
+    if(! file.isEmpty())
+      d->context->recording_file = file;
+  }, Qt::DirectConnection);
+  connect(planetaryImager->saveImages().get(), &SaveImages::finished, this, [this]{ d->context->recording_finished.release(); }, Qt::DirectConnection);
+}
+
+SequenceRunner::~SequenceRunner()
+{
+  abort();
+  // The sequence may be waiting for a main thread call: those give up once aborted, but they still need the events processed
+  while(! d->thread.waitForDone(50))
+    QCoreApplication::processEvents();
+}
+
+bool SequenceRunner::running() const
+{
+  return d->running;
+}
+
+QString SequenceRunner::start(const QString &script, const QString &name)
+{
+  bool idle = false;
+  if(! d->running.compare_exchange_strong(idle, true))
+    return tr("A sequence is already running");
+  d->context->aborting = false;
+  QtConcurrent::run(&d->thread, [this, script, name]{
+    QObject owner; // parented objects stay owned by C++, not by the garbage collector
+    QJSEngine engine;
+    engine.globalObject().setProperty("pi", engine.newQObject(new SequenceApi{*d->context, &owner}));
+    {
+      QMutexLocker lock(&d->context->mutex);
+      d->engine = &engine;
+    }
+    const auto result = engine.evaluate(script, name);
+    {
+      QMutexLocker lock(&d->context->mutex);
+      d->engine = nullptr;
+    }
+    d->running = false;
+    if(result.isError())
+      emit finished(name, false, "%1:%2: %3"_q % name % result.property("lineNumber").toInt() % result.toString());
+    else
+      emit finished(name, true, result.toString());
+  });
+  return {};
+}
+
+void SequenceRunner::abort()
+{
+  d->context->aborting = true;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  QMutexLocker lock(&d->context->mutex);
+  if(d->engine)
+    d->engine->setInterrupted(true);
+#endif
+}
+
+#include "sequencerunner.moc"
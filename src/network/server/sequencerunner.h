@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SEQUENCERUNNER_H
+#define SEQUENCERUNNER_H
+
+#include <QObject>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+
+FWD_PTR(PlanetaryImager)
+FWD_PTR(ConfigurationForwarder)
+FWD_PTR(SequenceRunner)
+
+/**
+ * Runs capture sequences on the server: JavaScript calling straight into the imager and the recording, with no network round trip between steps.
+ * Scripts run on their own thread, with a global "pi" object:
+ *   pi.log(message), pi.sleep(seconds)
+ *   pi.controls(): [{id, name, value}], pi.setControl(name, value)
+ *   pi.configuration(name), pi.setConfiguration(name, value): the settings clients see (see ConfigurationForwarder)
+ *   pi.startRecording(), pi.stopRecording(), pi.waitRecording(timeout_seconds): false on timeout (0: no timeout)
+ *   pi.record(timeout_seconds): starts a recording, limited by the configuration, waits for it and returns its file name
+ *   pi.aborted(): true once abort() was called; waiting calls return right away then
+ * One sequence at a time.
+ */
+class SequenceRunner : public QObject
+{
+  Q_OBJECT
+public:
+  SequenceRunner(const PlanetaryImagerPtr &planetaryImager, const ConfigurationForwarderPtr &configuration);
+  ~SequenceRunner();
+  bool running() const;
+  /// An empty string when the sequence started, or why it didn't
+  QString start(const QString &script, const QString &name);
+  /// pi calls become no-ops, waits end, and scripts stuck in their own loops are interrupted where Qt supports it (5.14)
+  void abort();
+signals:
+  void log(const QString &message);
+  /// result is the script's value, or its error message
+  void finished(const QString &name, bool success, const QString &result);
+private:
+  DPTR
+};
+
+#endif // SEQUENCERUNNER_H
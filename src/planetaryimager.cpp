@@ -18,13 +18,22 @@
  */
 
 #include "planetaryimager.h"
-#include "Qt/qt_functional.h"
 #include "commons/messageslogger.h"
 #include <QThread>
 #include <QTimer>
 #include "image_handlers/saveimages.h"
 #include "drivers/driver.h"
 #include "commons/definitions.h"
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <algorithm>
+#include "Qt/qt_strings_helper.h"
+#include "commons/capturetransform.h"
+#include "commons/usbhotplug.h"
+#include "commons/executor.h"
+#include "commons/framepool.h"
+#include "commons/memorygovernor.h"
 
 #if STATIC_QT_WINDOWS == 1
 #pragma message("Initializing Qt static plugins")
@@ -40,8 +49,30 @@ DPTR_IMPL(PlanetaryImager) {
   PlanetaryImager *q;
   QList<CameraPtr> cameras;
   Imager *imager = nullptr;
+  CaptureTransform::Settings software_transform;
+
+  // Cameras found by each driver source, kept until the source is scanned again
+  struct SourceScan {
+    Driver::Source source;
+    QList<CameraPtr> cameras;
+    bool scanning;
+    bool rescan; ///< Asked again while scanning
+  };
+  QList<SourceScan> sources;
+  QHash<QString, QString> usb_devices; ///< sysfs entry -> idVendor
+  bool usb_devices_known = false;
+  QSet<QString> hotplug_vendors; ///< Notified by UsbHotplug, waiting for the rescan
 
   void initDevicesWatcher();
+  void init_sources();
+  void scan(int index);
+  void scan_finished(int index, const QList<CameraPtr> &cameras);
+  void usb_devices_changed(const QSet<QString> &vendors);
+  bool may_have_cameras(const Driver::Source &source) const;
+  void collect_cameras();
+  static QHash<QString, QString> read_usb_devices(const QString &usbfsdir);
+  CaptureTransform::Settings configured_transform() const;
+  void software_transform_changed();
 };
 
 PlanetaryImager::PlanetaryImager(
@@ -51,8 +82,42 @@ PlanetaryImager::PlanetaryImager(
   Configuration &configuration
 ) : QObject{}, dptr(driver, imageHandler, saveImages, configuration, this)
 {
+  // Only long running loops (i.e. the image display) are left on the global pool: the rest goes to Executor
   QThreadPool::globalInstance()->setMaxThreadCount(std::max(5, QThread::idealThreadCount()));
   d->initDevicesWatcher();
+  d->software_transform = d->configured_transform();
+  connect(&configuration, &Configuration::settings_changed, this, [this] { d->software_transform_changed(); });
+  auto place_network_threads = [this] { Executor::instance(Executor::NetworkEncode).setCpus(d->configuration.thread_placement().network); };
+  place_network_threads();
+  connect(&configuration, &Configuration::settings_changed, this, place_network_threads);
+  auto back_frame_buffers = [this] {
+    const bool lock = d->configuration.frame_buffers_lock_memory();
+    FramePool::set_backing({d->configuration.frame_buffers_huge_pages(), lock ? static_cast<size_t>(d->configuration.max_memory_usage()) : 0});
+  };
+  back_frame_buffers();
+  connect(&configuration, &Configuration::settings_changed, this, back_frame_buffers);
+  auto budget_memory = [this] { MemoryGovernor::instance().set_budget(static_cast<size_t>(std::max(0ll, d->configuration.memory_budget()))); };
+  budget_memory();
+  connect(&configuration, &Configuration::settings_changed, this, budget_memory);
+}
+
+CaptureTransform::Settings PlanetaryImager::Private::configured_transform() const
+{
+  return {
+    configuration.software_roi(),
+    std::max(1, std::min(4, configuration.software_bin())),
+    configuration.software_bin_mode() == Configuration::SoftwareBinSum ? CaptureTransform::Sum : CaptureTransform::Average,
+  };
+}
+
+void PlanetaryImager::Private::software_transform_changed()
+{
+  auto settings = configured_transform();
+  if(settings.roi == software_transform.roi && settings.bin == software_transform.bin && settings.mode == software_transform.mode)
+    return;
+  software_transform = settings;
+  if(imager)
+    imager->setSoftwareTransform(software_transform);
 }
 
 PlanetaryImager::~PlanetaryImager()
@@ -97,10 +162,117 @@ void PlanetaryImager::stopRecording()
 
 void PlanetaryImager::scanCameras()
 {
-  GuLinux::qAsyncR<QList<CameraPtr>>([this] { return d->driver->cameras(); }, [this](const QList<CameraPtr> &cameras) {
-    d->cameras = cameras;
+  d->init_sources();
+  if(d->sources.isEmpty()) {
+    d->cameras.clear();
+    emit camerasChanged();
+    emit camerasScanned();
+    return;
+  }
+  for(int index = 0; index < d->sources.size(); index++)
+    d->scan(index);
+  // Sources skipped without scanning
+  if(none_of(d->sources.begin(), d->sources.end(), [](const Private::SourceScan &s) { return s.scanning; })) {
+    d->collect_cameras();
     emit camerasChanged();
-  }, this);
+    emit camerasScanned();
+  }
+}
+
+void PlanetaryImager::Private::init_sources()
+{
+  if(! sources.isEmpty())
+    return;
+  for(auto source: driver->sources())
+    sources.push_back({source, {}, false, false});
+}
+
+void PlanetaryImager::Private::scan(int index)
+{
+  auto &scan = sources[index];
+  if(scan.scanning) {
+    scan.rescan = true;
+    return;
+  }
+  if(! may_have_cameras(scan.source)) {
+    qDebug() << "No USB devices for" << scan.source.name << ", not scanning";
+    if(! scan.cameras.isEmpty()) {
+      scan.cameras.clear();
+      collect_cameras();
+      emit q->camerasChanged();
+    }
+    return;
+  }
+  scan.scanning = true;
+  auto source = scan.source;
+  // Each source on its own pool thread: a slow SDK doesn't hold back the cameras found by the others
+  Executor::instance(Executor::BackgroundIO).run<QList<CameraPtr>>([source] {
+    try {
+      return source.cameras();
+    } catch(const std::exception &e) {
+      qWarning() << "Error scanning cameras on" << source.name << ":" << e.what();
+      return QList<CameraPtr>{};
+    }
+  }, [this, index](const QList<CameraPtr> &cameras) { scan_finished(index, cameras); }, q);
+}
+
+void PlanetaryImager::Private::scan_finished(int index, const QList<CameraPtr> &found)
+{
+  auto &scan = sources[index];
+  scan.cameras = found;
+  scan.scanning = false;
+  collect_cameras();
+  emit q->camerasChanged();
+  if(scan.rescan) {
+    scan.rescan = false;
+    this->scan(index);
+    return;
+  }
+  if(none_of(sources.begin(), sources.end(), [](const SourceScan &s) { return s.scanning; }))
+    emit q->camerasScanned();
+}
+
+void PlanetaryImager::Private::usb_devices_changed(const QSet<QString> &vendors)
+{
+  init_sources();
+  // Devices without an idVendor might be anything
+  const bool unknown = vendors.contains({});
+  for(int index = 0; index < sources.size(); index++) {
+    const auto &source = sources[index].source;
+    if(! source.hotplug)
+      continue;
+    if(unknown || source.usb_vendors.isEmpty() || any_of(source.usb_vendors.begin(), source.usb_vendors.end(), [&](const QString &v) { return vendors.contains(v); }))
+      scan(index);
+  }
+}
+
+void PlanetaryImager::Private::collect_cameras()
+{
+  cameras.clear();
+  for(auto source: sources)
+    cameras.append(source.cameras);
+}
+
+bool PlanetaryImager::Private::may_have_cameras(const Driver::Source &source) const
+{
+  if(! source.usb_only || ! usb_devices_known)
+    return true;
+  return any_of(usb_devices.begin(), usb_devices.end(), [&](const QString &vendor) {
+    // Devices without an idVendor might be anything
+    return vendor.isEmpty() || source.usb_vendors.contains(vendor);
+  });
+}
+
+QHash<QString, QString> PlanetaryImager::Private::read_usb_devices(const QString &usbfsdir)
+{
+  QHash<QString, QString> devices;
+  for(auto entry: QDir(usbfsdir).entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+    if(entry.contains(':')) // interfaces of a device
+      continue;
+    QFile vendor{"%1/%2/idVendor"_q % usbfsdir % entry};
+    devices[entry] = vendor.open(QIODevice::ReadOnly) ? QString::fromLatin1(vendor.readAll()).trimmed().toLower() : QString{};
+  }
+  return devices;
 }
 
 void PlanetaryImager::open(const CameraPtr& camera)
@@ -111,6 +283,11 @@ void PlanetaryImager::open(const CameraPtr& camera)
     try {
       auto imager = camera->imager(d->imageHandler);
       imager->setCaptureEndianess(d->configuration.capture_endianess());
+      imager->setNativeByteOrder(d->configuration.capture_native_byte_order());
+      imager->setCaptureThreadScheduling(d->configuration.capture_thread_realtime(), d->configuration.thread_placement().capture);
+      imager->setCaptureBatch(d->configuration.capture_batch_frames());
+      imager->setControlsCache(d->configuration.camera_controls_cache());
+      imager->setSoftwareTransform(d->software_transform);
       imager->moveToThread(this->thread());
       imager->setParent(this);
       return imager;
@@ -124,10 +301,14 @@ void PlanetaryImager::open(const CameraPtr& camera)
     d->imager = imager;
     if(imager) {
       connect(imager, &Imager::disconnected, this, &PlanetaryImager::cameraDisconnected);
+      // Fewer sensor reads while recording
+      connect(d->saveImages.get(), &SaveImages::recording, imager, [imager]{ imager->setRecording(true); });
+      connect(d->saveImages.get(), &SaveImages::finished, imager, [imager]{ imager->setRecording(false); });
+      d->saveImages->armRecording(imager);
       emit cameraConnected();
     }
   };
-  GuLinux::qAsyncR<Imager *>(openImager, onImagerOpened, this);
+  Executor::instance(Executor::BackgroundIO).run<Imager *>(openImager, onImagerOpened, this);
 }
 
 void PlanetaryImager::closeImager()
@@ -143,7 +324,6 @@ void PlanetaryImager::closeImager()
 void PlanetaryImager::Private::initDevicesWatcher()
 {
   #ifdef Q_OS_LINUX
-  auto notifyTimer = new QTimer(q);
   QString usbfsdir;
   for(auto path: QStringList{"/proc/bus/usb/devices", "/sys/bus/usb/devices"}) {
     if(QDir(path).exists())
@@ -152,15 +332,47 @@ void PlanetaryImager::Private::initDevicesWatcher()
   if(usbfsdir.isEmpty())
     return;
 
-  static QStringList entries = QDir(usbfsdir).entryList();
+  usb_devices = read_usb_devices(usbfsdir);
+  usb_devices_known = true;
 
+  auto hotplug = new UsbHotplug(q);
+  if(hotplug->isValid()) {
+    // The kernel tells which device changed: no polling, and a single vendor to rescan for
+    connect(hotplug, &UsbHotplug::changed, q, [=](UsbHotplug::Action action, const QString &device, const QString &vendor) {
+      qDebug() << "usb device" << device << (action == UsbHotplug::Added ? "added" : "removed") << ", vendor:" << vendor;
+      if(action == UsbHotplug::Added)
+        usb_devices[device] = vendor;
+      else
+        usb_devices.remove(device);
+      // udev applies the device permissions only after the kernel event: give it time before the SDKs look for the camera
+      if(hotplug_vendors.isEmpty())
+        QTimer::singleShot(1000, q, [=] {
+          auto vendors = hotplug_vendors;
+          hotplug_vendors.clear();
+          usb_devices_changed(vendors);
+        });
+      hotplug_vendors.insert(vendor);
+    });
+    return;
+  }
+  delete hotplug;
+
+  auto notifyTimer = new QTimer(q);
   connect(notifyTimer, &QTimer::timeout, [=]{
-    auto current = QDir(usbfsdir).entryList();
-    if(current != entries) {
-      qDebug() << "usb devices changed";
-      entries = current;
-      q->scanCameras();
-    }
+    auto current = read_usb_devices(usbfsdir);
+    if(current == usb_devices)
+      return;
+    // Only the drivers for the vendors of devices plugged or unplugged need a rescan
+    QSet<QString> vendors;
+    for(auto it = current.begin(); it != current.end(); ++it)
+      if(usb_devices.value(it.key(), "-") != it.value())
+        vendors.insert(it.value());
+    for(auto it = usb_devices.begin(); it != usb_devices.end(); ++it)
+      if(! current.contains(it.key()))
+        vendors.insert(it.value());
+    qDebug() << "usb devices changed, vendors:" << vendors;
+    usb_devices = current;
+    usb_devices_changed(vendors);
   });
   notifyTimer->start(1500);
   #endif
@@ -56,7 +56,10 @@ public slots:
   void stopRecording();
   void quit();
 signals:
+  /// Emitted as each driver finishes scanning (cameras() has the cameras found so far)
   void camerasChanged();
+  /// No driver is scanning anymore
+  void camerasScanned();
   void cameraConnected();
   void cameraDisconnected();
 private:
@@ -21,23 +21,82 @@
 #include <iostream>
 #include <QDebug>
 #include <QCommandLineParser>
+#include <QJsonDocument>
 #include "commons/crashhandler.h"
 #include "commons/loghandler.h"
+#include "commons/tracing.h"
 #include "network/server/networkserver.h"
 #include "network/server/configurationforwarder.h"
+#include "network/server/focusforwarder.h"
+#include "network/server/histogramforwarder.h"
+#include "network/server/sequenceforwarder.h"
 #include "image_handlers/backend/local_saveimages.h"
+#include "image_handlers/backend/multicamerasaveimages.h"
+#include "image_handlers/backend/flashdetector.h"
+#include "image_handlers/backend/calibration.h"
+#include "image_handlers/backend/autoexposure.h"
+#include "image_handlers/backend/roifollower.h"
+#include "image_handlers/loadshedder.h"
+#include "image_handlers/cpugovernor.h"
+#include "image_handlers/backend/focusassist.h"
+#include "image_handlers/backend/sharedmemoryframes.h"
+#include "image_handlers/framesfanout.h"
+#include "image_handlers/pluginimagehandler.h"
 #include "network/server/savefileforwarder.h"
 #include "network/server/framesforwarder.h"
+#include "network/server/recordingstreamforwarder.h"
+#include "network/server/metricsendpoint.h"
+#include "network/server/previewendpoint.h"
 #include "drivers/supporteddrivers.h"
 #include "planetaryimager.h"
 #include "Qt/qt_strings_helper.h"
 #include "commons/commandline.h"
+#include "commons/modules.h"
+#include "commons/autotuning.h"
 #include "commons/definitions.h"
 #include "commons/frame.h"
 #include "network/networkdispatcher.h"
+#include <QTimer>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+namespace {
+/**
+ * Helper process of IsolatedDrivers (--driver-host): a single driver, controlled over loopback, publishing frames to shared memory only.
+ * Calibration, recording and every other frame consumer live in the host process.
+ */
+int driver_host(QCoreApplication &app, CommandLine &commandLine)
+{
+  Configuration configuration;
+  auto driver = make_shared<SupportedDrivers>(commandLine.driversDirectories(), QStringList{commandLine.driverHost()});
+  auto dispatcher = make_shared<NetworkDispatcher>();
+  // Never recording here, but the network protocol expects it
+  auto save_images = make_shared<LocalSaveImages>(configuration);
+  auto frames_forwarder = make_shared<FramesForwarder>(dispatcher);
+  // Inline: a single copy into the ring on the capture thread, the host wakes up and takes it from there
+  auto shared_memory_frames = make_shared<SharedMemoryFrames>(commandLine.sharedMemoryFrames(), commandLine.sharedMemorySlots());
+  auto imageHandlers = make_shared<FramesFanout>();
+  imageHandlers->add("shared memory", shared_memory_frames, FramesFanout::Inline);
+  auto planetaryImager = make_shared<PlanetaryImager>(driver, imageHandlers, save_images, configuration);
+  auto server = make_shared<NetworkServer>(planetaryImager, dispatcher, frames_forwarder);
+  QMetaObject::invokeMethod(server.get(), "listen", Q_ARG(QString, commandLine.address()), Q_ARG(int, commandLine.port()));
+#ifdef Q_OS_UNIX
+  // Don't outlive the host, even when it dies without stopping us
+  const auto host = getppid();
+  QTimer orphan_check;
+  QObject::connect(&orphan_check, &QTimer::timeout, &app, [&]{
+    if(getppid() != host)
+      app.quit();
+  });
+  orphan_check.start(1000);
+#endif
+  return app.exec();
+}
+}
+
 
 int main(int argc, char** argv)
 {
@@ -53,18 +112,65 @@ int main(int argc, char** argv)
     commandLine.daemon("0.0.0.0").process();
 
     LogHandler log_handler{commandLine};
+    Tracing::Session tracing{commandLine.traceFile()};
+    if(! commandLine.driverHost().isEmpty())
+      return driver_host(app, commandLine);
 
+    Modules::instance().set_directories(commandLine.modulesDirectories());
     Configuration configuration;
+    if(commandLine.autoConfigure())
+      AutoTuning::configure(configuration);
     auto driver = make_shared<SupportedDrivers>(commandLine.driversDirectories());
     auto dispatcher = make_shared<NetworkDispatcher>();
     auto save_images = make_shared<LocalSaveImages>(configuration);
+    // Recording controls go here, to start and stop the secondary cameras too
+    auto recordings = make_shared<MultiCameraSaveImages>(save_images, configuration);
     auto frames_forwarder = make_shared<FramesForwarder>(dispatcher);
-    auto imageHandlers = make_shared<ImageHandlers>(QList<ImageHandlerPtr>{frames_forwarder, save_images});
+    auto recording_stream_forwarder = make_shared<RecordingStreamForwarder>(dispatcher, configuration);
+    // Slow consumers only skip frames, the capture thread never waits for them
+    auto imageHandlers = make_shared<FramesFanout>();
+    imageHandlers->set_graph(PipelineGraph::from_setting(configuration.pipeline()));
+    imageHandlers->add("recording", save_images, FramesFanout::Inline);
+    imageHandlers->add("network", frames_forwarder, FramesFanout::Latest, 2, MemoryGovernor::Network);
+    // Remote histograms, counted on the raw frames: idle until a client shows one
+    auto histogram_forwarder = make_shared<HistogramForwarder>(dispatcher, configuration);
+    imageHandlers->add("histogram", histogram_forwarder, FramesFanout::Latest, 1, MemoryGovernor::Preview);
+    // Clients recording on their own disk need every frame: it only queues them, sending within their credits
+    imageHandlers->add("recording stream", recording_stream_forwarder, FramesFanout::Inline);
+    // Sees every frame it can keep up with: detections need consecutive frames
+    auto flash_detector = make_shared<FlashDetector>(configuration);
+    QObject::connect(flash_detector.get(), &FlashDetector::flash, save_images.get(), &SaveImages::trigger, Qt::DirectConnection);
+    imageHandlers->add("flash detector", flash_detector, FramesFanout::Queue, 8, MemoryGovernor::Analysis);
+    auto auto_exposure = make_shared<AutoExposure>(configuration);
+    imageHandlers->add("auto exposure", auto_exposure, FramesFanout::Latest, 2, MemoryGovernor::Analysis);
+    auto roi_follower = make_shared<ROIFollower>(configuration);
+    imageHandlers->add("roi follower", roi_follower, FramesFanout::Latest, 1, MemoryGovernor::Analysis);
+    // Measures the latest frame only: a slow metric just makes the focus plot sparser
+    auto focus_assist = make_shared<FocusAssist>(configuration);
+    imageHandlers->add("focus assist", focus_assist, FramesFanout::Latest, 1, MemoryGovernor::Analysis);
+    // Third party stages, where their execution class says (see imagehandlerplugin.h)
+    PluginImageHandler::load(commandLine.pluginsDirectories(), *imageHandlers);
+    if(! commandLine.sharedMemoryFrames().isEmpty())
+      imageHandlers->add("shared memory", make_shared<SharedMemoryFrames>(commandLine.sharedMemoryFrames(), commandLine.sharedMemorySlots()), FramesFanout::Queue, commandLine.sharedMemorySlots(), MemoryGovernor::Network);
+    // Encodes once for all the browsers watching, and only while there are any
+    auto preview_endpoint = make_shared<PreviewEndpoint>(commandLine.previewFps());
+    if(commandLine.previewPort() > 0 && preview_endpoint->listen(commandLine.address(), commandLine.previewPort()))
+      imageHandlers->add("preview", preview_endpoint, FramesFanout::Latest, 1, MemoryGovernor::Preview);
+    // Previews give way while the recording writer falls behind
+    auto load_shedder = make_shared<LoadShedder>(imageHandlers, configuration);
+    QObject::connect(save_images.get(), &SaveImages::loadShedding, load_shedder.get(), &LoadShedder::setLevel, Qt::QueuedConnection);
+    // ...and while the CPU runs short, when enabled
+    auto cpu_governor = make_shared<CpuGovernor>(imageHandlers, configuration);
     auto configuration_forwarder = make_shared<ConfigurationForwarder>(configuration, dispatcher);
-    auto save_files_forwarder = make_shared<SaveFileForwarder>(save_images, dispatcher);
-    auto planetaryImager = make_shared<PlanetaryImager>(driver, imageHandlers, save_images, configuration);
+    auto save_files_forwarder = make_shared<SaveFileForwarder>(recordings, dispatcher, configuration);
+    // Darks and flats come off every frame before anybody sees it
+    auto calibration = make_shared<Calibration>(configuration, imageHandlers);
+    auto planetaryImager = make_shared<PlanetaryImager>(driver, calibration, recordings, configuration);
     auto server = make_shared<NetworkServer>(planetaryImager, dispatcher, frames_forwarder);
+    auto focus_forwarder = make_shared<FocusForwarder>(dispatcher, focus_assist);
+    auto sequence_forwarder = make_shared<SequenceForwarder>(dispatcher, planetaryImager, configuration_forwarder);
     QObject::connect(save_files_forwarder.get(), &SaveFileForwarder::isRecording, frames_forwarder.get(), &FramesForwarder::recordingMode);
+    QObject::connect(save_files_forwarder.get(), &SaveFileForwarder::isRecording, histogram_forwarder.get(), &HistogramForwarder::recordingMode);
 
     QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, save_files_forwarder.get(), [&]{
       save_files_forwarder->setImager(planetaryImager->imager());
@@ -72,9 +178,32 @@ int main(int argc, char** argv)
     QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, save_files_forwarder.get(), [&]{
       save_files_forwarder->setImager(nullptr);
     });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, auto_exposure.get(), [&]{
+      auto_exposure->setImager(planetaryImager->imager());
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, auto_exposure.get(), [&]{
+      auto_exposure->setImager(nullptr);
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, roi_follower.get(), [&]{
+      roi_follower->setImager(planetaryImager->imager());
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, roi_follower.get(), [&]{
+      roi_follower->setImager(nullptr);
+    });
+    auto secondary_cameras = commandLine.secondaryCameras();
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::camerasScanned, recordings.get(), [&]{
+      secondary_cameras = recordings->openSecondaries(secondary_cameras, planetaryImager->cameras());
+    });
+    // Nobody else may ask for a camera list before they're needed
+    if(! secondary_cameras.isEmpty())
+      QMetaObject::invokeMethod(planetaryImager.get(), "scanCameras", Qt::QueuedConnection);
 
 
     QMetaObject::invokeMethod(server.get(), "listen", Q_ARG(QString, commandLine.address()), Q_ARG(int, commandLine.port()));
+    MetricsEndpoint metrics_endpoint;
+    metrics_endpoint.add_page("/pipeline", "application/json", [&]{ return QJsonDocument::fromVariant(imageHandlers->describe()).toJson(); });
+    if(commandLine.metricsPort() > 0)
+      metrics_endpoint.listen(commandLine.address(), commandLine.metricsPort());
 
     return app.exec();
 }
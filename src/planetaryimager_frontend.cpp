@@ -21,6 +21,7 @@
 #include <QDebug>
 #include "commons/frame.h"
 #include "commons/loghandler.h"
+#include "commons/tracing.h"
 #include "commons/crashhandler.h"
 #include <QMenuBar>
 #include <QMenu>
@@ -48,8 +49,9 @@ int main(int argc, char** argv)
     commandLine.frontend().process();
 
     LogHandler log_handler{commandLine};
+    Tracing::Session tracing{commandLine.traceFile()};
     app.setQuitOnLastWindowClosed(false);
 
-    (new ConnectionManager())->show();
+    (new ConnectionManager(commandLine.autoConfigure()))->show();
     return app.exec();
 }
@@ -22,15 +22,33 @@
 #include <QDebug>
 #include "drivers/supporteddrivers.h"
 #include "commons/loghandler.h"
+#include "commons/tracing.h"
 #include "commons/crashhandler.h"
 #include "image_handlers/backend/local_saveimages.h"
+#include "image_handlers/backend/multicamerasaveimages.h"
+#include "image_handlers/backend/flashdetector.h"
+#include "image_handlers/backend/calibration.h"
+#include "image_handlers/backend/autoexposure.h"
+#include "image_handlers/backend/roifollower.h"
+#include "image_handlers/loadshedder.h"
+#include "image_handlers/cpugovernor.h"
+#include "image_handlers/backend/focusassist.h"
 #include "widgets/localfilesystembrowser.h"
 #include "commons/commandline.h"
+#include "commons/modules.h"
+#include "commons/autotuning.h"
 #include "network/server/networkserver.h"
 #include "network/server/savefileforwarder.h"
 #include "network/server/configurationforwarder.h"
+#include "network/server/focusforwarder.h"
+#include "network/server/histogramforwarder.h"
+#include "network/server/sequenceforwarder.h"
 #include "network/server/framesforwarder.h"
-#include "image_handlers/threadimagehandler.h"
+#include "network/server/recordingstreamforwarder.h"
+#include "network/client/isolateddrivers.h"
+#include "image_handlers/framesfanout.h"
+#include "image_handlers/pluginimagehandler.h"
+#include "commons/metricssource.h"
 #include "commons/frame.h"
 #include "network/networkdispatcher.h"
 #include "commons/definitions.h"
@@ -53,31 +71,92 @@ int main(int argc, char** argv)
     CommandLine commandLine(app);
     commandLine.backend().daemon("127.0.0.1").process();
     LogHandler log_handler{commandLine};
+    Tracing::Session tracing{commandLine.traceFile()};
 
+    Modules::instance().set_directories(commandLine.modulesDirectories());
     Configuration configuration;
+    if(commandLine.autoConfigure())
+      AutoTuning::configure(configuration);
     auto save_images = make_shared<LocalSaveImages>(configuration);
-    auto drivers = make_shared<SupportedDrivers>(commandLine.driversDirectories());
+    // Recording controls go here, to start and stop the secondary cameras too
+    auto recordings = make_shared<MultiCameraSaveImages>(save_images, configuration);
+    DriverPtr drivers;
+    if(commandLine.isolateDrivers())
+      drivers = make_shared<IsolatedDrivers>(commandLine.driversDirectories());
+    else
+      drivers = make_shared<SupportedDrivers>(commandLine.driversDirectories());
 
     auto dispatcher = make_shared<NetworkDispatcher>();
-    auto save_files_forwarder = make_shared<SaveFileForwarder>(save_images, dispatcher);
+    auto save_files_forwarder = make_shared<SaveFileForwarder>(recordings, dispatcher, configuration);
     auto configuration_forwarder = make_shared<ConfigurationForwarder>(configuration, dispatcher);
     auto frames_forwarder = make_shared<FramesForwarder>(dispatcher);
+    auto recording_stream_forwarder = make_shared<RecordingStreamForwarder>(dispatcher, configuration);
 
-    auto compositeImageHandler = make_shared<ImageHandlers>(QList<ImageHandlerPtr>{save_images, frames_forwarder});
-    auto threadedImageHandler = ImageHandlerPtr{new ThreadImageHandler{compositeImageHandler}};
+    // The main window adds the display handlers here
+    auto frontendImageHandlers = make_shared<ImageHandlers>();
+    // Slow consumers only skip frames, the capture thread never waits for them
+    auto framesFanout = make_shared<FramesFanout>();
+    framesFanout->set_graph(PipelineGraph::from_setting(configuration.pipeline()));
+    framesFanout->add("recording", save_images, FramesFanout::Inline);
+    framesFanout->add("network", frames_forwarder, FramesFanout::Latest, 2, MemoryGovernor::Network);
+    // Remote histograms, counted on the raw frames: idle until a client shows one
+    auto histogram_forwarder = make_shared<HistogramForwarder>(dispatcher, configuration);
+    framesFanout->add("histogram", histogram_forwarder, FramesFanout::Latest, 1, MemoryGovernor::Preview);
+    // Clients recording on their own disk need every frame: it only queues them, sending within their credits
+    framesFanout->add("recording stream", recording_stream_forwarder, FramesFanout::Inline);
+    // Sees every frame it can keep up with: detections need consecutive frames
+    auto flash_detector = make_shared<FlashDetector>(configuration);
+    QObject::connect(flash_detector.get(), &FlashDetector::flash, save_images.get(), &SaveImages::trigger, Qt::DirectConnection);
+    framesFanout->add("flash detector", flash_detector, FramesFanout::Queue, 8, MemoryGovernor::Analysis);
+    auto auto_exposure = make_shared<AutoExposure>(configuration);
+    framesFanout->add("auto exposure", auto_exposure, FramesFanout::Latest, 2, MemoryGovernor::Analysis);
+    auto roi_follower = make_shared<ROIFollower>(configuration);
+    framesFanout->add("roi follower", roi_follower, FramesFanout::Latest, 1, MemoryGovernor::Analysis);
+    // Measures the latest frame only: a slow metric just makes the focus plot sparser
+    auto focus_assist = make_shared<FocusAssist>(configuration);
+    framesFanout->add("focus assist", focus_assist, FramesFanout::Latest, 1, MemoryGovernor::Analysis);
+    // Third party stages, where their execution class says (see imagehandlerplugin.h)
+    PluginImageHandler::load(commandLine.pluginsDirectories(), *framesFanout);
+    framesFanout->add("frontend", frontendImageHandlers, FramesFanout::Latest, 2);
+    // Previews, then the display, give way while the recording writer falls behind
+    auto load_shedder = make_shared<LoadShedder>(framesFanout, configuration);
+    QObject::connect(save_images.get(), &SaveImages::loadShedding, load_shedder.get(), &LoadShedder::setLevel, Qt::QueuedConnection);
+    // ...and while the CPU runs short, when enabled
+    auto cpu_governor = make_shared<CpuGovernor>(framesFanout, configuration);
 
-    auto planetaryImager = make_shared<PlanetaryImager>(drivers, threadedImageHandler, save_images, configuration);
+    // Darks and flats come off every frame before anybody sees it
+    auto calibration = make_shared<Calibration>(configuration, framesFanout);
+    auto planetaryImager = make_shared<PlanetaryImager>(drivers, calibration, recordings, configuration);
 
 
     auto server = make_shared<NetworkServer>(planetaryImager, dispatcher, frames_forwarder);
+    auto focus_forwarder = make_shared<FocusForwarder>(dispatcher, focus_assist);
+    auto sequence_forwarder = make_shared<SequenceForwarder>(dispatcher, planetaryImager, configuration_forwarder);
     QObject::connect(save_files_forwarder.get(), &SaveFileForwarder::isRecording, frames_forwarder.get(), &FramesForwarder::recordingMode);
+    QObject::connect(save_files_forwarder.get(), &SaveFileForwarder::isRecording, histogram_forwarder.get(), &HistogramForwarder::recordingMode);
     QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, save_files_forwarder.get(), [&]{
       save_files_forwarder->setImager(planetaryImager->imager());
     });
     QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, save_files_forwarder.get(), [&]{
       save_files_forwarder->setImager(nullptr);
     });
-    PlanetaryImagerMainWindow mainWindow{planetaryImager, compositeImageHandler, make_shared<LocalFilesystemBrowser>(), commandLine.logfile() };
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, auto_exposure.get(), [&]{
+      auto_exposure->setImager(planetaryImager->imager());
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, auto_exposure.get(), [&]{
+      auto_exposure->setImager(nullptr);
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraConnected, roi_follower.get(), [&]{
+      roi_follower->setImager(planetaryImager->imager());
+    });
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::cameraDisconnected, roi_follower.get(), [&]{
+      roi_follower->setImager(nullptr);
+    });
+    auto secondary_cameras = commandLine.secondaryCameras();
+    QObject::connect(planetaryImager.get(), &PlanetaryImager::camerasScanned, recordings.get(), [&]{
+      secondary_cameras = recordings->openSecondaries(secondary_cameras, planetaryImager->cameras());
+    });
+    PlanetaryImagerMainWindow mainWindow{planetaryImager, frontendImageHandlers, make_shared<LocalFilesystemBrowser>(), make_shared<LocalMetricsSource>(), make_shared<LocalFocusSource>(focus_assist), commandLine.logfile() };
 
     QMetaObject::invokeMethod(server.get(), "listen", Q_ARG(QString, commandLine.address()), Q_ARG(int, commandLine.port()));
 
@@ -38,8 +38,15 @@
 #include "widgets/recordingpanel.h"
 #include "widgets/camerainfowidget.h"
 #include "widgets/histogramwidget.h"
+#include "widgets/livestackwidget.h"
+#include "widgets/diagnosticswidget.h"
+#include "widgets/framehistorybar.h"
+#include "widgets/focuswidget.h"
 #include "widgets/mount_widget.h"
 #include "Qt/zoomableimage.h"
+#include "widgets/glframeitem.h"
+#include "widgets/displaysurfaceitem.h"
+#include <QOpenGLWidget>
 #include <QGridLayout>
 #include <QToolBar>
 #include <QWhatsThis>
@@ -52,14 +59,17 @@
 #include <vector>
 #include <QGraphicsEllipseItem>
 #include <QGraphicsRectItem>
+#include <QScrollBar>
 
 #include "widgets/editroidialog.h"
 
 #include "image_handlers/imagehandler.h"
 #include "image_handlers/frontend/histogram.h"
 #include "image_handlers/frontend/displayimage.h"
+#include "image_handlers/frontend/livestacker.h"
 #include "image_handlers/saveimages.h"
 #include "image_handlers/threadimagehandler.h"
+#include "network/client/remoteimager.h"
 
 #include "commons/messageslogger.h"
 #include "commons/definitions.h"
@@ -72,6 +82,8 @@
 #include "planetaryimager.h"
 #include "drivers/driver.h"
 #include "mainwindowwidgets.h"
+#include "commons/updatescoalescer.h"
+#include "commons/loadshedding.h"
 
 using namespace GuLinux;
 using namespace std;
@@ -91,7 +103,12 @@ DPTR_IMPL(PlanetaryImagerMainWindow) {
   void saveWindowGeometry();
 
   StatusBarInfoWidget *statusbar_info_widget;
+  /// Status bar values, repainted once per tick of the UpdatesCoalescer however often they come in
+  Published<double> capture_fps, display_fps, temperature;
   shared_ptr<DisplayImage> displayImage;
+  /// Renders the live stack, separately from the raw feed
+  shared_ptr<DisplayImage> stackDisplayImage;
+  LiveStackerPtr liveStacker;
   HistogramPtr histogram;
   shared_ptr<ImgTracker> imgTracker;
   CameraControlsWidget* cameraSettingsWidget = nullptr;
@@ -103,7 +120,7 @@ DPTR_IMPL(PlanetaryImagerMainWindow) {
   RecordingPanel* recording_panel;
   ExposureTimer exposure_timer;
 
-  MountWidget* mount_widget;
+  MountWidget* mount_widget = nullptr;
   ImageHandlerPtr imageHandler;
 
   /// Contains elements of the "informational overlay", added to the graphics scene of 'displayImage'
@@ -117,11 +134,21 @@ DPTR_IMPL(PlanetaryImagerMainWindow) {
   void enableUIWidgets(bool cameraConnected);
   void editROI();
   ZoomableImage *image_widget;
+  /// Looking back at the last frames of remote imagers
+  FrameHistoryBar *frame_history_bar = nullptr;
+  GLFrameItem *gl_frame_item = nullptr;
+  /// Shows downscaled or partial previews over a transparent placeholder of the frame size
+  DisplaySurfaceItem *surface_item = nullptr;
+  QSize display_frame_size;
+  void showImage();
+  void updateDisplayViewport();
+  QSize gl_frame_size;
+  void setupOpenGLView();
 
   void onImagerInitialized(Imager *imager);
   void onCamerasFound();
 
-  enum class SelectionMode { None, ROI, AddTrackingTarget, SelectCentroidRect } selection_mode = SelectionMode::None;
+  enum class SelectionMode { None, ROI, AddTrackingTarget, SelectCentroidRect, HistogramRect } selection_mode = SelectionMode::None;
 };
 
 PlanetaryImagerMainWindow *PlanetaryImagerMainWindow::Private::q = nullptr;
@@ -141,6 +168,11 @@ void PlanetaryImagerMainWindow::updateInfoOverlay()
         }
         break;
 
+    case ImgTracker::TrackingMode::PhaseCorrelation:
+        if (!d->infoOverlay.trackingTargets.empty())
+            d->infoOverlay.trackingTargets[0]->setPos(d->image_widget->getImgTransform().map(d->imgTracker->getTrackingPosition()));
+        break;
+
     case ImgTracker::TrackingMode::Centroid:
         {
             const auto imgT = d->image_widget->getImgTransform();
@@ -175,6 +207,7 @@ PlanetaryImagerMainWindow::~PlanetaryImagerMainWindow()
       d->imager->destroy();
   }
   d->displayImage->quit();
+  d->stackDisplayImage->quit();
   d->planetaryImager->quit();
 }
 
@@ -188,6 +221,8 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
       const PlanetaryImagerPtr &planetaryImager,
       const ImageHandlersPtr &imageHandlers,
       const FilesystemBrowserPtr &filesystemBrowser,
+      const MetricsSourcePtr &metricsSource,
+      const FocusSourcePtr &focusSource,
       const QString &logFilePath,
       QWidget* parent,
       Qt::WindowFlags flags
@@ -206,18 +241,27 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     d->configurationDialog = new ConfigurationDialog(d->planetaryImager->configuration(), this);
     d->displayImage = make_shared<DisplayImage>(d->planetaryImager->configuration());
     d->histogram = make_shared<Histogram>(d->planetaryImager->configuration());
-    d->ui->histogram->setWidget(d->histogramWidget = new HistogramWidget(d->histogram, d->planetaryImager->configuration()));
     d->ui->statusbar->addPermanentWidget(d->statusbar_info_widget = new StatusBarInfoWidget(), 1);
 
-    if(HAVE_LIBINDI == 1) {
-        d->ui->mount->setWidget(d->mount_widget = new MountWidget());
-    }
-
     d->imgTracker = make_shared<ImgTracker>();
 
-    imageHandlers->push_back(d->displayImage);
-    imageHandlers->push_back(d->histogram);
-    imageHandlers->push_back(d->imgTracker);
+    d->stackDisplayImage = make_shared<DisplayImage>(d->planetaryImager->configuration());
+    d->liveStacker = make_shared<LiveStacker>(d->planetaryImager->configuration(), d->imgTracker, d->stackDisplayImage);
+    d->ui->live_stack->setWidget(new LiveStackWidget(d->liveStacker, d->stackDisplayImage));
+    d->ui->diagnostics->setWidget(new DiagnosticsWidget(metricsSource));
+    d->ui->focus->setWidget(new FocusWidget(focusSource));
+    // The stacker pairs the tracked positions with the frames it already received
+    connect(d->imgTracker.get(), &ImgTracker::trackingPositionChanged, d->liveStacker.get(), &LiveStacker::trackingPositionChanged, Qt::DirectConnection);
+    connect(d->imgTracker.get(), &ImgTracker::trackingPositionChanged, d->histogram.get(), &Histogram::trackingPositionChanged, Qt::DirectConnection);
+
+    // Display and histogram only need to keep up with the latest frames; stacking and tracking need all of them
+    imageHandlers->push_back(d->displayImage, ImageHandlers::BestEffort, "display");
+    // The stacker must get each frame before the tracker reports its position
+    auto stackingHandlers = make_shared<ImageHandlers>();
+    stackingHandlers->push_back(d->liveStacker, ImageHandlers::MustComplete, "live stacking");
+    stackingHandlers->push_back(d->imgTracker, ImageHandlers::MustComplete, "tracking");
+    imageHandlers->push_back(stackingHandlers, ImageHandlers::MustComplete, "stacking and tracking");
+    imageHandlers->setParallel(d->planetaryImager->configuration().parallel_image_handlers());
 
     connect(d->planetaryImager.get(), &PlanetaryImager::camerasChanged, this, bind(&Private::onCamerasFound, d.get()));
     connect(d->planetaryImager.get(), &PlanetaryImager::cameraConnected, this, [=]{ d->onImagerInitialized(d->planetaryImager->imager()); });
@@ -225,6 +269,8 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     d->ui->image->layout()->setMargin(0);
     d->ui->image->layout()->setSpacing(0);
     d->ui->image->layout()->addWidget(d->image_widget = new ZoomableImage(false));
+    d->ui->image->layout()->addWidget(d->frame_history_bar = new FrameHistoryBar(d->displayImage));
+    d->frame_history_bar->hide();
     d->image_widget->scene()->setBackgroundBrush(QBrush{Qt::black, Qt::Dense4Pattern});
     connect(d->image_widget, &ZoomableImage::zoomLevelChanged, d->statusbar_info_widget, &StatusBarInfoWidget::zoom);
     d->statusbar_info_widget->zoom(d->image_widget->zoomLevel());
@@ -261,17 +307,20 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     connect(d->ui->actionAbout_Qt, &QAction::triggered, &QApplication::aboutQt);
     connect(d->ui->action_devices_rescan, &QAction::triggered, bind(&Private::rescan_devices, d.get()));
     connect(d->ui->actionShow_settings, &QAction::triggered, bind(&QDialog::show, d->configurationDialog));
-    connect(d->configurationDialog, &QDialog::accepted, this, bind(&DisplayImage::read_settings, d->displayImage), Qt::DirectConnection);
-    connect(d->configurationDialog, &QDialog::accepted, this, bind(&Histogram::read_settings, d->histogram), Qt::DirectConnection);
     connect(d->configurationDialog, &QDialog::accepted, this,
             [this]() {
                 auto *imager = d->planetaryImager->imager();
-                if (imager) imager->setCaptureEndianess(d->planetaryImager->configuration().capture_endianess());
+                if (imager) {
+                    imager->setCaptureEndianess(d->planetaryImager->configuration().capture_endianess());
+                    imager->setNativeByteOrder(d->planetaryImager->configuration().capture_native_byte_order());
+                }
             });
 
     connect(d->recording_panel, &RecordingPanel::start, [=]{d->planetaryImager->saveImages()->startRecording(d->imager);});
     connect(d->recording_panel, &RecordingPanel::stop, bind(&SaveImages::endRecording, d->planetaryImager->saveImages()));
     connect(d->recording_panel, &RecordingPanel::setPaused, bind(&SaveImages::setPaused, d->planetaryImager->saveImages(), _1));
+    connect(d->recording_panel, &RecordingPanel::trigger, bind(&SaveImages::trigger, d->planetaryImager->saveImages(), QVariantMap{}));
+    connect(d->recording_panel, &RecordingPanel::probeStorage, bind(&SaveImages::probeStorage, d->planetaryImager->saveImages()));
 
     connect(d->planetaryImager->saveImages().get(), &SaveImages::recording, this, bind(&DisplayImage::setRecording, d->displayImage, true), Qt::QueuedConnection);
     connect(d->planetaryImager->saveImages().get(), &SaveImages::recording, this, bind(&Histogram::setRecording, d->histogram, true), Qt::QueuedConnection);
@@ -286,9 +335,21 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     d->main_window_widgets->add_dock(d->ui->chipInfoWidget);
     d->main_window_widgets->add_dock(d->ui->camera_settings);
     d->main_window_widgets->add_dock(d->ui->recording);
-    d->main_window_widgets->add_dock(d->ui->histogram);
+    // Built when first shown: startup doesn't pay for panels that are closed, or tabbed behind others
+    d->main_window_widgets->add_dock(d->ui->histogram, [=]{
+        // Histograms aren't computed until there's a panel showing them
+        imageHandlers->push_back(d->histogram, ImageHandlers::BestEffort, "histogram");
+        return d->histogramWidget = new HistogramWidget(d->histogram, d->planetaryImager->configuration());
+    });
+    d->main_window_widgets->add_dock(d->ui->live_stack);
+    d->main_window_widgets->add_dock(d->ui->diagnostics);
+    d->main_window_widgets->add_dock(d->ui->focus);
     if(DISABLE_TRACKING == 0 && HAVE_LIBINDI == 1) {
-        d->main_window_widgets->add_dock(d->ui->mount);
+        d->main_window_widgets->add_dock(d->ui->mount, [=]{
+          d->mount_widget = new MountWidget(d->imgTracker);
+          d->mount_widget->setImager(d->imager);
+          return d->mount_widget;
+        });
     }
     else {
         d->ui->mount->hide();
@@ -319,8 +380,16 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
 #endif
     });
     connect(MessagesLogger::instance(), &MessagesLogger::message, this, bind(&PlanetaryImagerMainWindow::notify, this, _1, _2, _3, _4), Qt::QueuedConnection);
-    connect(d->displayImage.get(), &DisplayImage::gotImage, this, bind(&ZoomableImage::setImage, d->image_widget, _1), Qt::QueuedConnection);
-    connect(d->displayImage.get(), &DisplayImage::gotImage, this, bind(&PlanetaryImagerMainWindow::updateInfoOverlay, this), Qt::QueuedConnection);
+    connect(d->displayImage.get(), &DisplayImage::imageReady, this, [=] {
+      d->showImage();
+      d->displayImage->imageShown();
+    }, Qt::QueuedConnection);
+    connect(d->image_widget, &ZoomableImage::zoomLevelChanged, this, bind(&Private::updateDisplayViewport, d.get()));
+    connect(d->image_widget->horizontalScrollBar(), &QScrollBar::valueChanged, this, bind(&Private::updateDisplayViewport, d.get()));
+    connect(d->image_widget->verticalScrollBar(), &QScrollBar::valueChanged, this, bind(&Private::updateDisplayViewport, d.get()));
+    connect(d->displayImage.get(), &DisplayImage::imageReady, this, bind(&PlanetaryImagerMainWindow::updateInfoOverlay, this), Qt::QueuedConnection);
+    if(d->planetaryImager->configuration().opengl_live_view())
+      d->setupOpenGLView();
     connect(d->imgTracker.get(), &ImgTracker::targetLost, this, bind(&PlanetaryImagerMainWindow::updateInfoOverlay, this), Qt::QueuedConnection);
 
     connect(d->ui->actionNight_Mode, &QAction::toggled, this, [=](bool checked) {
@@ -330,11 +399,22 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     });
 
 
-    connect(d->displayImage.get(), &DisplayImage::displayFPS, d->statusbar_info_widget, &StatusBarInfoWidget::displayFPS, Qt::QueuedConnection);
+    connect(d->displayImage.get(), &DisplayImage::displayFPS, this, [this](double fps) { d->display_fps.publish(fps); }, Qt::DirectConnection);
+    UpdatesCoalescer::instance().add(this, [this] {
+      d->capture_fps.take([this](double fps) { d->statusbar_info_widget->captureFPS(fps); });
+      d->display_fps.take([this](double fps) { d->statusbar_info_widget->displayFPS(fps); });
+      d->temperature.take([this](double celsius) { d->statusbar_info_widget->temperature(celsius, false); });
+    });
     connect(d->planetaryImager->saveImages().get(), &SaveImages::saveFPS, d->recording_panel, &RecordingPanel::saveFPS, Qt::QueuedConnection);
     connect(d->planetaryImager->saveImages().get(), &SaveImages::meanFPS, d->recording_panel, &RecordingPanel::meanFPS, Qt::QueuedConnection);
     connect(d->planetaryImager->saveImages().get(), &SaveImages::savedFrames, d->recording_panel, &RecordingPanel::saved, Qt::QueuedConnection);
     connect(d->planetaryImager->saveImages().get(), &SaveImages::droppedFrames, d->recording_panel, &RecordingPanel::dropped, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::queueUsage, d->recording_panel, &RecordingPanel::queueUsage, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::preTriggerBuffer, d->recording_panel, &RecordingPanel::preTriggerBuffer, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::deferredWrites, d->recording_panel, &RecordingPanel::deferredWrites, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::storageProbed, d->recording_panel, &RecordingPanel::storageProbed, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::loadShedding, d->recording_panel, &RecordingPanel::loadShedding, Qt::QueuedConnection);
+    connect(d->planetaryImager->saveImages().get(), &SaveImages::loadShedding, this, [this](int level) { d->histogram->setSuspended(level >= LoadShedding::NoPreviews); }, Qt::QueuedConnection);
     connect(d->ui->actionDisconnect, &QAction::triggered, d->planetaryImager.get(), &PlanetaryImager::closeImager);
 
     connect(d->ui->actionQuit, &QAction::triggered, this, &QWidget::close);
@@ -342,6 +422,7 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     d->enableUIWidgets(false);
 
     QtConcurrent::run(bind(&DisplayImage::create_qimages, d->displayImage));
+    QtConcurrent::run(bind(&DisplayImage::create_qimages, d->stackDisplayImage));
 
 
     connect(d->ui->actionEdges_Detection, &QAction::toggled, d->displayImage.get(), &DisplayImage::detectEdges);
@@ -356,9 +437,17 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     });
 
     connect(d->ui->actionEdit_ROI, &QAction::triggered, this, bind(&Private::editROI, d.get()));
+    connect(d->ui->actionSelect_histogram_area, &QAction::triggered, [&] {
+      d->selection_mode = Private::SelectionMode::HistogramRect;
+      d->image_widget->startSelectionMode(ZoomableImage::SelectionMode::Rect);
+    });
     QMap<Private::SelectionMode, function<void(const QRect &)>> handle_selection {
       {Private::SelectionMode::None, [](const QRect&) {}},
       {Private::SelectionMode::ROI, [&](const QRect &rect) { d->imager->setROI(rect.normalized()); }},
+      {Private::SelectionMode::HistogramRect, [&](const QRect &rect) {
+        d->planetaryImager->configuration().set_histogram_region_rect(rect.normalized());
+        d->planetaryImager->configuration().set_histogram_region(Configuration::HistogramRectangle);
+      }},
       {Private::SelectionMode::SelectCentroidRect, [&](const QRect &rect) {
 
           if (d->imgTracker->setCentroidCalcRect(rect))
@@ -395,16 +484,13 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
     connect(&d->exposure_timer, &ExposureTimer::progress, [=](double , double elapsed, double remaining){
       d->statusbar_info_widget->showMessage("Exposure: %1s, remaining: %2s"_q % QString::number(elapsed, 'f', 1) % QString::number(remaining, 'f', 1), 1000);
     });
+    connect(&d->exposure_timer, &ExposureTimer::readingOut, [=](double total){
+      d->statusbar_info_widget->showMessage("Exposure: %1s, reading out"_q % QString::number(total, 'f', 1), 1000);
+    });
     connect(&d->exposure_timer, &ExposureTimer::finished, [=]{ d->statusbar_info_widget->clearMessage(); });
 
     d->editROIDialog = new EditROIDialog(this);
     connect(d->editROIDialog, &EditROIDialog::roiSelected, this, [=](const QRect &roi){ d->imager->setROI(roi); });
-    auto readTemperature = new QTimer{this};
-    connect(readTemperature, &QTimer::timeout, this, [=] {
-        if(d->imager)
-            QMetaObject::invokeMethod(d->imager, "readTemperature", Qt::QueuedConnection);
-    });
-
     connect(d->ui->actionAddTrackingTarget, &QAction::triggered, [&] {
         d->selection_mode = Private::SelectionMode::AddTrackingTarget;
         d->image_widget->startSelectionMode(ZoomableImage::SelectionMode::Point);
@@ -415,6 +501,34 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
         d->image_widget->startSelectionMode(ZoomableImage::SelectionMode::Rect);
     });
 
+    connect(d->ui->actionTrackWholeFrame, &QAction::triggered, [&] {
+        if (!d->imgTracker->setPhaseCorrelation())
+            return;
+        for (auto *i: d->infoOverlay.trackingTargets)
+        {
+            d->image_widget->scene()->removeItem(i);
+            delete i;
+        }
+        d->infoOverlay.trackingTargets.clear();
+        if (d->infoOverlay.centroidArea)
+        {
+            d->image_widget->scene()->removeItem(d->infoOverlay.centroidArea);
+            delete d->infoOverlay.centroidArea;
+            d->infoOverlay.centroidArea = nullptr;
+        }
+
+        // Marks where the centre of the reference frame went
+        auto item = new QGraphicsEllipseItem(-10, -10, 20, 20);
+        item->setPos(d->image_widget->getImgTransform().map(d->imgTracker->getTrackingPosition()));
+        item->setPen(QPen{ QColor{ 0, 255, 0, 255 } });
+        item->setBrush(QBrush{ Qt::NoBrush });
+        item->setZValue(1);
+        d->infoOverlay.trackingTargets.push_back(item);
+        d->image_widget->scene()->addItem(item);
+
+        d->ui->actionDisableTracking->setEnabled(true);
+    });
+
     connect(d->image_widget, &ZoomableImage::selectedPoint, [this](const QPointF &p) {
         if (d->selection_mode == Private::SelectionMode::AddTrackingTarget)
         {
@@ -447,7 +561,6 @@ PlanetaryImagerMainWindow::PlanetaryImagerMainWindow(
         updateInfoOverlay();
     });
 
-    readTemperature->start(2000);
     d->rescan_devices();
     if(DISABLE_TRACKING == 1) {
         delete d->ui->menuTracking;
@@ -473,6 +586,11 @@ ImageHandlerPtr PlanetaryImagerMainWindow::imageHandler() const
   return d->imageHandler;
 }
 
+HistogramPtr PlanetaryImagerMainWindow::histogram() const
+{
+  return d->histogram;
+}
+
 
 Imager * PlanetaryImagerMainWindow::imager() const
 {
@@ -519,8 +637,8 @@ void PlanetaryImagerMainWindow::Private::onImagerInitialized(Imager * imager)
     imager->startLive();
     statusbar_info_widget->deviceConnected(imager->name());
     connect(imager, &Imager::disconnected, q, bind(&Private::cameraDisconnected, this), Qt::QueuedConnection);
-    connect(imager, &Imager::fps, statusbar_info_widget, &StatusBarInfoWidget::captureFPS, Qt::QueuedConnection);
-    connect(imager, &Imager::temperature, statusbar_info_widget, bind(&StatusBarInfoWidget::temperature, statusbar_info_widget, _1, false), Qt::QueuedConnection);
+    connect(imager, &Imager::fps, q, [this](double fps) { capture_fps.publish(fps); }, Qt::DirectConnection);
+    connect(imager, &Imager::temperature, q, [this](double celsius) { temperature.publish(celsius); }, Qt::DirectConnection);
 
     ui->settings_container->setWidget(cameraSettingsWidget = new CameraControlsWidget(imager, planetaryImager->configuration(), filesystemBrowser));
     ui->chipInfoWidget->setWidget(cameraInfoWidget = new CameraInfoWidget(imager));
@@ -530,6 +648,12 @@ void PlanetaryImagerMainWindow::Private::onImagerInitialized(Imager * imager)
     ui->actionClear_ROI->setEnabled(imager->supports(Imager::ROI));
     ui->actionAddTrackingTarget->setEnabled(true);
     ui->actionSetCentroidArea->setEnabled(true);
+    ui->actionTrackWholeFrame->setEnabled(true);
+    if(mount_widget)
+      mount_widget->setImager(imager);
+    auto remote_imager = dynamic_cast<RemoteImager*>(imager);
+    frame_history_bar->setHistory(remote_imager ? remote_imager->frameHistory() : FrameHistoryPtr{});
+    frame_history_bar->setVisible(remote_imager);
 }
 
 // TODO: sync issues when images are sent after the imagerDisconnected signal
@@ -543,7 +667,12 @@ void PlanetaryImagerMainWindow::Private::cameraDisconnected()
   ui->actionClear_ROI->setEnabled(false);
   ui->actionAddTrackingTarget->setEnabled(false);
   ui->actionSetCentroidArea->setEnabled(false);
+  ui->actionTrackWholeFrame->setEnabled(false);
   ui->actionDisableTracking->setEnabled(false);
+  if(mount_widget)
+    mount_widget->setImager(nullptr);
+  frame_history_bar->setHistory({});
+  frame_history_bar->hide();
 
   delete cameraSettingsWidget;
   cameraSettingsWidget = nullptr;
@@ -573,6 +702,78 @@ void PlanetaryImagerMainWindow::notify(const QDateTime &when, MessagesLogger::Ty
 }
 
 
+void PlanetaryImagerMainWindow::Private::showImage()
+{
+  if(! surface_item) {
+    surface_item = new DisplaySurfaceItem{displayImage->surface()};
+    // Below the tracking overlays
+    surface_item->setZValue(-1);
+    image_widget->scene()->addItem(surface_item);
+  }
+  if(! surface_item->swap())
+    return;
+  const QSize frameSize = displayImage->surface()->front().frameSize;
+  const bool size_changed = frameSize != display_frame_size;
+  display_frame_size = frameSize;
+  if(size_changed) {
+    // A transparent image of the frame size keeps zoom, scene rect and selections working, while the item paints the frames
+    QImage placeholder{frameSize, QImage::Format_ARGB32};
+    placeholder.fill(Qt::transparent);
+    image_widget->setImage(placeholder);
+    updateDisplayViewport();
+  }
+  surface_item->setTransform(image_widget->getImgTransform());
+}
+
+void PlanetaryImagerMainWindow::Private::updateDisplayViewport()
+{
+  if(display_frame_size.isEmpty())
+    return;
+  bool invertible;
+  const auto scene_to_frame = image_widget->getImgTransform().inverted(&invertible);
+  const auto visible_scene = image_widget->mapToScene(image_widget->viewport()->rect()).boundingRect();
+  displayImage->setViewport(image_widget->zoomLevel(), invertible ? scene_to_frame.mapRect(visible_scene) : QRectF{});
+}
+
+void PlanetaryImagerMainWindow::Private::setupOpenGLView()
+{
+  image_widget->setViewport(new QOpenGLWidget);
+  image_widget->setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+  gl_frame_item = new GLFrameItem;
+  // Below the image placeholder and the tracking overlays
+  gl_frame_item->setZValue(-1);
+  image_widget->scene()->addItem(gl_frame_item);
+  gl_frame_item->setDebayer(planetaryImager->configuration().debayer());
+  gl_frame_item->setEdgeDetection(ui->actionEdges_Detection->isChecked());
+  gl_frame_item->setStretch(ui->actionStretch_histogram->isChecked());
+  gl_frame_item->setMaximumSaturation(ui->actionStretch_colour_saturation->isChecked());
+  connect(ui->actionEdges_Detection, &QAction::toggled, gl_frame_item, &GLFrameItem::setEdgeDetection);
+  connect(ui->actionStretch_histogram, &QAction::toggled, gl_frame_item, &GLFrameItem::setStretch);
+  connect(ui->actionStretch_colour_saturation, &QAction::toggled, gl_frame_item, &GLFrameItem::setMaximumSaturation);
+  connect(configurationDialog, &QDialog::accepted, gl_frame_item, [=]{ gl_frame_item->setDebayer(planetaryImager->configuration().debayer()); });
+
+  connect(displayImage.get(), &DisplayImage::gotFrame, q, [=](const FrameConstPtr &frame) {
+    if(frame->resolution() != gl_frame_size) {
+      // A transparent image of the frame size keeps zoom, scene rect and selections working as with CPU rendering
+      gl_frame_size = frame->resolution();
+      QImage placeholder{gl_frame_size, QImage::Format_ARGB32};
+      placeholder.fill(Qt::transparent);
+      image_widget->setImage(placeholder);
+      gl_frame_item->setTransform(image_widget->getImgTransform());
+    }
+    gl_frame_item->setFrame(frame);
+    displayImage->imageShown();
+    q->updateInfoOverlay();
+  }, Qt::QueuedConnection);
+  connect(gl_frame_item, &GLFrameItem::unsupported, q, [=]{
+    MessagesLogger::instance()->queue(MessagesLogger::Warning, tr("OpenGL live view"), tr("Desktop OpenGL is not available, falling back to CPU rendering"));
+    displayImage->setRawFrames(false);
+    gl_frame_item->hide();
+    gl_frame_size = {};
+  }, Qt::QueuedConnection);
+  displayImage->setRawFrames(true);
+}
+
 void PlanetaryImagerMainWindow::Private::editROI()
 {
   auto resolution = imager->properties().resolution();
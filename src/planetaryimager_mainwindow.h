@@ -30,6 +30,9 @@ FWD_PTR(PlanetaryImager)
 FWD_PTR(Imager)
 FWD_PTR(Camera)
 FWD_PTR(FilesystemBrowser)
+FWD_PTR(MetricsSource)
+FWD_PTR(FocusSource)
+FWD_PTR(Histogram)
 
 namespace Ui
 {
@@ -45,12 +48,16 @@ public:
       const PlanetaryImagerPtr &planetaryImager,
       const ImageHandlersPtr &imageHandlers,
       const FilesystemBrowserPtr &filesystemBrowser,
+      const MetricsSourcePtr &metricsSource,
+      const FocusSourcePtr &focusSource,
       const QString &logFilePath = {},
       QWidget* parent = 0,
       Qt::WindowFlags flags = 0
   );
   void connectCamera(const CameraPtr &camera);
   ImageHandlerPtr imageHandler() const;
+  /// Remote sessions feed it with the server histograms (see RemoteHistogram)
+  HistogramPtr histogram() const;
   Imager *imager() const;
 public slots:
   void setImager(Imager *imager);
@@ -40,6 +40,8 @@
 #include "Qt/qt_functional.h"
 #include <QSortFilterProxyModel>
 #include "commons/filesystembrowser.h"
+#include "commons/inflightcoalescer.h"
+#include <QTimer>
 
 using namespace std;
 using namespace std::placeholders;
@@ -65,6 +67,11 @@ private:
   Imager::Control new_value;
   Imager *imager;
   void set_value(const Imager::Control & value);
+  /// Changes made while another is on its way to the imager wait for it, the latest one winning: dragging a slider doesn't flood the imager thread or the network
+  InFlightCoalescer<Imager::Control> in_flight;
+  /// Imagers not confirming a change (i.e. a value out of range) don't hold the next ones back for long
+  QTimer *in_flight_timeout;
+  void sent();
   ControlWidget *control_widget;
   QCheckBox *auto_value_widget;
   QCheckBox *on_off_value_widget;
@@ -113,6 +120,18 @@ CameraControl::CameraControl(const Imager::Control& control, Imager* imager, QWi
 
   control_widget->setEnabled(!control.readonly && ! control.value_auto && !(control.supports_onOff && !control.value_onOff));
   connect(imager, &Imager::changed, this, &CameraControl::control_updated, Qt::QueuedConnection);
+  in_flight_timeout = new QTimer(this);
+  in_flight_timeout->setSingleShot(true);
+  in_flight_timeout->setInterval(2000);
+  connect(in_flight_timeout, &QTimer::timeout, this, &CameraControl::sent);
+}
+
+void CameraControl::sent()
+{
+  in_flight_timeout->stop();
+  Imager::Control next;
+  if(in_flight.acknowledged(next))
+    set_value(next);
 }
 
 void CameraControl::auto_changed(bool isAuto)
@@ -150,6 +169,13 @@ void CameraControl::control_updated(const Imager::Control& changed_control)
   static QPixmap green_dot{":/resources/dot_green.png"};
   if(changed_control.id != control.id)
     return;
+  if(in_flight.in_flight()) {
+    control = changed_control;
+    sent();
+    // A newer value is on its way: the widget stays on it
+    if(in_flight.in_flight())
+      return;
+  }
   bool is_expected_value = changed_control.same_value(new_value);
   qDebug() << "control changed: incoming =" << changed_control;
   qDebug() << "control changed: expected =" << new_value;
@@ -195,11 +221,14 @@ void CameraControl::restore()
 
 void CameraControl::set_value(const Imager::Control &value)
 {
-  if(control.same_value(value)) {
+  if(! in_flight.in_flight() && control.same_value(value)) {
     new_value = value;
     return;
   }
+  if(! in_flight.offer(value))
+    return;
   qDebug() << "GUI: setting control " << control << " to " << value;
+  in_flight_timeout->start();
   imager->setControl(value);
   control_widget->update(value);
 }
@@ -284,7 +313,7 @@ CameraControlsWidget::CameraControlsWidget(Imager *imager, Configuration &config
 
   auto grid = new QGridLayout(d->ui->controls_box);
   int row = 0;
-  for(auto imager_control: imager->controls()) {
+  for(auto imager_control: imager->controls_snapshot()) {
     qDebug() << "adding setting: " << imager_control;
     auto control = new CameraControl(imager_control, imager, this);
     d->control_widgets.push_back(control);
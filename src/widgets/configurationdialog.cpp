@@ -17,6 +17,7 @@
  */
 
 #include "configurationdialog.h"
+#include "commons/loadshedding.h"
 #include "commons/configuration.h"
 #include "ui_configurationdialog.h"
 #include "commons/utils.h"
@@ -24,9 +25,11 @@
 #include <QButtonGroup>
 #include <QSpinBox>
 #include <QMessageBox>
+#include <QFileDialog>
 #include <QButtonGroup>
 #include "Qt/qt_strings_helper.h"
 #include "Qt/qt_functional.h"
+#include "commons/definitions.h"
 
 using namespace std::placeholders;
 using namespace std;
@@ -47,6 +50,43 @@ ConfigurationDialog::ConfigurationDialog(Configuration &configuration, QWidget*
     d->ui->setupUi(this);
     connect(d->ui->debayer, &QCheckBox::toggled, bind(&Configuration::set_debayer, &d->configuration, _1));
     d->ui->debayer->setChecked(d->configuration.debayer());
+    for(auto combo: {d->ui->display_debayer_algorithm, d->ui->save_debayer_algorithm}) {
+      combo->addItem(tr("superpixel (half resolution)"), static_cast<int>(Configuration::DebayerSuperpixel));
+      combo->addItem(tr("bilinear"), static_cast<int>(Configuration::DebayerBilinear));
+      combo->addItem(tr("edge aware"), static_cast<int>(Configuration::DebayerEdgeAware));
+    }
+    d->ui->display_debayer_algorithm->setCurrentIndex(d->ui->display_debayer_algorithm->findData(static_cast<int>(d->configuration.display_debayer_algorithm())));
+    connect(d->ui->display_debayer_algorithm, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_display_debayer_algorithm(static_cast<Configuration::DebayerAlgorithm>(d->ui->display_debayer_algorithm->itemData(index).toInt()));
+    });
+    d->ui->save_debayered->setChecked(d->configuration.save_debayered());
+    connect(d->ui->save_debayered, &QCheckBox::toggled, bind(&Configuration::set_save_debayered, &d->configuration, _1));
+    d->ui->save_debayer_algorithm->setCurrentIndex(d->ui->save_debayer_algorithm->findData(static_cast<int>(d->configuration.save_debayer_algorithm())));
+    connect(d->ui->save_debayer_algorithm, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_save_debayer_algorithm(static_cast<Configuration::DebayerAlgorithm>(d->ui->save_debayer_algorithm->itemData(index).toInt()));
+    });
+    d->ui->save_depth->addItem(tr("16 bit"), static_cast<int>(Configuration::SaveDepthNative));
+    d->ui->save_depth->addItem(tr("8 bit, fixed range"), static_cast<int>(Configuration::SaveDepth8BitFixed));
+    d->ui->save_depth->addItem(tr("8 bit, range from the first frame"), static_cast<int>(Configuration::SaveDepth8BitHistogram));
+    auto save_depth_changed = [=] {
+      d->ui->save_depth_black->setEnabled(d->configuration.save_depth() == Configuration::SaveDepth8BitFixed);
+      d->ui->save_depth_white->setEnabled(d->configuration.save_depth() == Configuration::SaveDepth8BitFixed);
+      d->ui->save_depth_dither->setEnabled(d->configuration.save_depth() != Configuration::SaveDepthNative);
+    };
+    d->ui->save_depth->setCurrentIndex(d->ui->save_depth->findData(static_cast<int>(d->configuration.save_depth())));
+    connect(d->ui->save_depth, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_save_depth(static_cast<Configuration::SaveDepth>(d->ui->save_depth->itemData(index).toInt()));
+      save_depth_changed();
+    });
+    d->ui->save_depth_black->setValue(d->configuration.save_depth_black());
+    connect(d->ui->save_depth_black, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_save_depth_black, &d->configuration, _1));
+    d->ui->save_depth_white->setValue(d->configuration.save_depth_white());
+    connect(d->ui->save_depth_white, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_save_depth_white, &d->configuration, _1));
+    d->ui->save_depth_dither->setChecked(d->configuration.save_depth_dither());
+    connect(d->ui->save_depth_dither, &QCheckBox::toggled, bind(&Configuration::set_save_depth_dither, &d->configuration, _1));
+    save_depth_changed();
+    connect(d->ui->opengl_live_view, &QCheckBox::toggled, bind(&Configuration::set_opengl_live_view, &d->configuration, _1));
+    d->ui->opengl_live_view->setChecked(d->configuration.opengl_live_view());
     d->ui->pauseShouldStopRecordingTimeout->setChecked(d->configuration.recording_pause_stops_timer());
     connect(d->ui->pauseShouldStopRecordingTimeout, &QCheckBox::toggled, bind(&Configuration::set_recording_pause_stops_timer, &d->configuration, _1));
     
@@ -135,6 +175,36 @@ ConfigurationDialog::ConfigurationDialog(Configuration &configuration, QWidget*
     d->ui->histogram_timeout_recording->setEnabled(! d->configuration.histogram_disable_on_recording());
     d->ui->histogram_timeout_recording->setValue(d->configuration.histogram_timeout_recording() / 1000.);
     connect(d->ui->histogram_timeout_recording, F_PTR(QDoubleSpinBox, valueChanged, double), [this](double v) { d->configuration.set_histogram_timeout_recording(v*1000); });
+    d->ui->histogram_sampling_step->setValue(d->configuration.histogram_sampling_step());
+    connect(d->ui->histogram_sampling_step, F_PTR(QSpinBox, valueChanged, int), [this](int v) { d->configuration.set_histogram_sampling_step(v); });
+    d->ui->histogram_cpu_budget->setValue(d->configuration.histogram_cpu_budget());
+    connect(d->ui->histogram_cpu_budget, F_PTR(QSpinBox, valueChanged, int), [this](int v) { d->configuration.set_histogram_cpu_budget(v); });
+    d->ui->histogram_region->addItem(tr("the whole frame"), static_cast<int>(Configuration::HistogramWholeFrame));
+    d->ui->histogram_region->addItem(tr("a rectangle"), static_cast<int>(Configuration::HistogramRectangle));
+    d->ui->histogram_region->addItem(tr("the tracked target"), static_cast<int>(Configuration::HistogramTracked));
+    d->ui->histogram_region->addItem(tr("the brightness centroid"), static_cast<int>(Configuration::HistogramCentroid));
+    d->ui->histogram_region->setCurrentIndex(d->ui->histogram_region->findData(static_cast<int>(d->configuration.histogram_region())));
+    connect(d->ui->histogram_region, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_histogram_region(static_cast<Configuration::HistogramRegion>(d->ui->histogram_region->itemData(index).toInt()));
+    });
+    d->ui->histogram_debayer->setChecked(d->configuration.histogram_debayer());
+    connect(d->ui->histogram_debayer, &QCheckBox::toggled, bind(&Configuration::set_histogram_debayer, &d->configuration, _1));
+    d->ui->histogram_region_size->setValue(d->configuration.histogram_region_size());
+    connect(d->ui->histogram_region_size, F_PTR(QSpinBox, valueChanged, int), [this](int v) { d->configuration.set_histogram_region_size(v); });
+    const QRect histogram_region_rect = d->configuration.histogram_region_rect();
+    if(! histogram_region_rect.isEmpty())
+      d->ui->histogram_region_rect->setText("%1, %2, %3, %4"_q % histogram_region_rect.x() % histogram_region_rect.y() % histogram_region_rect.width() % histogram_region_rect.height());
+    connect(d->ui->histogram_region_rect, &QLineEdit::editingFinished, [=] {
+      const auto values = d->ui->histogram_region_rect->text().split(',', QString::SkipEmptyParts);
+      QList<int> numbers;
+      for(auto value: values)
+        numbers.append(value.trimmed().toInt());
+      d->configuration.set_histogram_region_rect(numbers.size() == 4 ? QRect{numbers[0], numbers[1], numbers[2], numbers[3]} : QRect{});
+    });
+    d->ui->live_stacking_keep_best_percent->setValue(d->configuration.live_stacking_keep_best_percent());
+    connect(d->ui->live_stacking_keep_best_percent, F_PTR(QSpinBox, valueChanged, int), [this](int v) { d->configuration.set_live_stacking_keep_best_percent(v); });
+    d->ui->live_stacking_sigma->setValue(d->configuration.live_stacking_sigma());
+    connect(d->ui->live_stacking_sigma, F_PTR(QDoubleSpinBox, valueChanged, double), [this](double v) { d->configuration.set_live_stacking_sigma(v); });
     
     auto set_memory_limit = [=](int value) {
       if(value < 1024)
@@ -146,8 +216,175 @@ ConfigurationDialog::ConfigurationDialog(Configuration &configuration, QWidget*
     d->ui->memory_limit->setRange(0, 8*1024);
     connect(d->ui->memory_limit, &QSlider::valueChanged, set_memory_limit);
     connect(d->ui->buffered_file, &QCheckBox::toggled, bind(&Configuration::set_buffered_output, &d->configuration, _1));
+#ifdef Q_OS_LINUX
+    d->ui->direct_io_output->setChecked(d->configuration.direct_io_output());
+    connect(d->ui->direct_io_output, &QCheckBox::toggled, bind(&Configuration::set_direct_io_output, &d->configuration, _1));
+#else
+    d->ui->direct_io_output->hide();
+#endif
+    d->ui->ser_frames_metadata->setChecked(d->configuration.ser_frames_metadata());
+    connect(d->ui->ser_frames_metadata, &QCheckBox::toggled, bind(&Configuration::set_ser_frames_metadata, &d->configuration, _1));
+    d->ui->ser_frame_hashes->setChecked(d->configuration.ser_frame_hashes());
+    connect(d->ui->ser_frame_hashes, &QCheckBox::toggled, bind(&Configuration::set_ser_frame_hashes, &d->configuration, _1));
+    d->ui->ser_segment_max_size->setValue(d->configuration.ser_segment_max_size() / 1024 / 1024);
+    connect(d->ui->ser_segment_max_size, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_ser_segment_max_size(static_cast<long long>(value) * 1024ll * 1024ll); });
+    d->ui->ser_segment_max_frames->setValue(d->configuration.ser_segment_max_frames());
+    connect(d->ui->ser_segment_max_frames, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_ser_segment_max_frames(value); });
+    d->ui->ser_stripe_directories->setText(d->configuration.ser_stripe_directories().join(';'));
+    connect(d->ui->ser_stripe_directories, &QLineEdit::editingFinished, [=] {
+      d->configuration.set_ser_stripe_directories(d->ui->ser_stripe_directories->text().split(';', QString::SkipEmptyParts));
+    });
+    connect(d->ui->ser_stripe_directories_add, &QToolButton::clicked, [=] {
+      auto directory = QFileDialog::getExistingDirectory(this, tr("Add SER stripe directory"));
+      if(directory.isEmpty())
+        return;
+      auto directories = d->configuration.ser_stripe_directories() << directory;
+      d->ui->ser_stripe_directories->setText(directories.join(';'));
+      d->configuration.set_ser_stripe_directories(directories);
+    });
+    d->ui->recording_sinks->setText(d->configuration.recording_sinks().join(';'));
+    connect(d->ui->recording_sinks, &QLineEdit::editingFinished, [=] {
+      d->configuration.set_recording_sinks(d->ui->recording_sinks->text().remove(' ').split(';', QString::SkipEmptyParts));
+    });
+    d->ui->recording_sinks_max_memory_usage->setValue(d->configuration.recording_sinks_max_memory_usage() / 1024 / 1024);
+    connect(d->ui->recording_sinks_max_memory_usage, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_recording_sinks_max_memory_usage(static_cast<long long>(value) * 1024ll * 1024ll); });
+    d->ui->recording_crop_size->setValue(d->configuration.recording_crop_size());
+    connect(d->ui->recording_crop_size, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_crop_size, &d->configuration, _1));
+    d->ui->recording_keep_best_percent->setValue(d->configuration.recording_keep_best_percent());
+    connect(d->ui->recording_keep_best_percent, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_keep_best_percent, &d->configuration, _1));
+    d->ui->recording_quality_window->setValue(d->configuration.recording_quality_window());
+    connect(d->ui->recording_quality_window, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_quality_window, &d->configuration, _1));
+    d->ui->recording_pretrigger->setChecked(d->configuration.recording_pretrigger());
+    connect(d->ui->recording_pretrigger, &QCheckBox::toggled, bind(&Configuration::set_recording_pretrigger, &d->configuration, _1));
+    d->ui->pretrigger_seconds->setValue(d->configuration.pretrigger_seconds());
+    connect(d->ui->pretrigger_seconds, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_pretrigger_seconds, &d->configuration, _1));
+    d->ui->posttrigger_seconds->setValue(d->configuration.posttrigger_seconds());
+    connect(d->ui->posttrigger_seconds, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_posttrigger_seconds, &d->configuration, _1));
+    d->ui->pretrigger_max_memory_usage->setValue(d->configuration.pretrigger_max_memory_usage() / 1024 / 1024);
+    connect(d->ui->pretrigger_max_memory_usage, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_pretrigger_max_memory_usage(static_cast<long long>(value) * 1024ll * 1024ll); });
+    d->ui->flash_detector->setChecked(d->configuration.flash_detector());
+    connect(d->ui->flash_detector, &QCheckBox::toggled, bind(&Configuration::set_flash_detector, &d->configuration, _1));
+    d->ui->flash_detector_sigma->setValue(d->configuration.flash_detector_sigma());
+    connect(d->ui->flash_detector_sigma, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_flash_detector_sigma, &d->configuration, _1));
+    d->ui->flash_detector_pixels->setValue(d->configuration.flash_detector_pixels());
+    connect(d->ui->flash_detector_pixels, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_flash_detector_pixels, &d->configuration, _1));
+    d->ui->flash_detector_frames->setValue(d->configuration.flash_detector_frames());
+    connect(d->ui->flash_detector_frames, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_flash_detector_frames, &d->configuration, _1));
+    d->ui->flash_detector_history->setValue(d->configuration.flash_detector_history());
+    connect(d->ui->flash_detector_history, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_flash_detector_history, &d->configuration, _1));
+    d->ui->flash_detector_roi_size->setValue(d->configuration.flash_detector_roi_size());
+    connect(d->ui->flash_detector_roi_size, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_flash_detector_roi_size, &d->configuration, _1));
+    d->ui->recording_burst_to_ram->setChecked(d->configuration.recording_burst_to_ram());
+    connect(d->ui->recording_burst_to_ram, &QCheckBox::toggled, bind(&Configuration::set_recording_burst_to_ram, &d->configuration, _1));
+    d->ui->burst_max_memory_usage->setValue(d->configuration.burst_max_memory_usage() / 1024 / 1024);
+    connect(d->ui->burst_max_memory_usage, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_burst_max_memory_usage(static_cast<long long>(value) * 1024ll * 1024ll); });
+#ifdef Q_OS_LINUX
+    d->ui->burst_huge_pages->setChecked(d->configuration.burst_huge_pages());
+    connect(d->ui->burst_huge_pages, &QCheckBox::toggled, bind(&Configuration::set_burst_huge_pages, &d->configuration, _1));
+#else
+    d->ui->burst_huge_pages->hide();
+#endif
+    d->ui->burst_lock_memory->setChecked(d->configuration.burst_lock_memory());
+    connect(d->ui->burst_lock_memory, &QCheckBox::toggled, bind(&Configuration::set_burst_lock_memory, &d->configuration, _1));
+    d->ui->frame_buffers_huge_pages->setChecked(d->configuration.frame_buffers_huge_pages());
+    connect(d->ui->frame_buffers_huge_pages, &QCheckBox::toggled, bind(&Configuration::set_frame_buffers_huge_pages, &d->configuration, _1));
+    d->ui->frame_buffers_lock_memory->setChecked(d->configuration.frame_buffers_lock_memory());
+    connect(d->ui->frame_buffers_lock_memory, &QCheckBox::toggled, bind(&Configuration::set_frame_buffers_lock_memory, &d->configuration, _1));
+    d->ui->memory_budget->setValue(d->configuration.memory_budget() / 1024 / 1024);
+    connect(d->ui->memory_budget, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_memory_budget(static_cast<long long>(value) * 1024ll * 1024ll); });
+    d->ui->image_writer_threads->setValue(d->configuration.image_writer_threads());
+    connect(d->ui->image_writer_threads, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_image_writer_threads, &d->configuration, _1));
+#if HAVE_ZSTD
+    d->ui->compressed_ser_level->setValue(d->configuration.compressed_ser_level());
+    connect(d->ui->compressed_ser_level, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_compressed_ser_level, &d->configuration, _1));
+    d->ui->compressed_ser_pack_pixels->setChecked(d->configuration.compressed_ser_pack_pixels());
+    connect(d->ui->compressed_ser_pack_pixels, &QCheckBox::toggled, bind(&Configuration::set_compressed_ser_pack_pixels, &d->configuration, _1));
+#else
+    d->ui->compressed_ser_level_widget->hide();
+#endif
+    d->ui->fits_compression->addItem(tr("none"), static_cast<int>(Configuration::FITSUncompressed));
+    d->ui->fits_compression->addItem(tr("Rice (lossless)"), static_cast<int>(Configuration::FITSRice));
+    d->ui->fits_compression->addItem(tr("HCOMPRESS"), static_cast<int>(Configuration::FITSHCompress));
+    d->ui->fits_compression->setCurrentIndex(d->ui->fits_compression->findData(static_cast<int>(d->configuration.fits_compression())));
+    d->ui->fits_hcompress_scale->setValue(d->configuration.fits_hcompress_scale());
+    d->ui->fits_hcompress_scale->setEnabled(d->configuration.fits_compression() == Configuration::FITSHCompress);
+    connect(d->ui->fits_compression, F_PTR(QComboBox, activated, int), [=](int index) {
+      auto compression = static_cast<Configuration::FITSCompression>(d->ui->fits_compression->itemData(index).toInt());
+      d->configuration.set_fits_compression(compression);
+      d->ui->fits_hcompress_scale->setEnabled(compression == Configuration::FITSHCompress);
+    });
+    connect(d->ui->fits_hcompress_scale, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_fits_hcompress_scale, &d->configuration, _1));
+    d->ui->png_compression_level->setValue(d->configuration.png_compression_level());
+    connect(d->ui->png_compression_level, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_png_compression_level, &d->configuration, _1));
+    d->ui->tiff_compression->setChecked(d->configuration.tiff_compression());
+    connect(d->ui->tiff_compression, &QCheckBox::toggled, bind(&Configuration::set_tiff_compression, &d->configuration, _1));
     d->ui->memory_limit->setValue(d->configuration.max_memory_usage() / 1024 / 1024 );
     set_memory_limit(d->ui->memory_limit->value());
+    d->ui->recording_queue_overflow->addItem(tr("drop newest frame"), static_cast<int>(Configuration::QueueDropNewest));
+    d->ui->recording_queue_overflow->addItem(tr("drop oldest frame"), static_cast<int>(Configuration::QueueDropOldest));
+    d->ui->recording_queue_overflow->addItem(tr("wait for the writer"), static_cast<int>(Configuration::QueueBlockProducer));
+    d->ui->recording_queue_overflow->setCurrentIndex(d->ui->recording_queue_overflow->findData(static_cast<int>(d->configuration.recording_queue_overflow())));
+    d->ui->recording_queue_block_msecs->setValue(d->configuration.recording_queue_block_msecs());
+    d->ui->recording_queue_block_msecs->setEnabled(d->configuration.recording_queue_overflow() == Configuration::QueueBlockProducer);
+    connect(d->ui->recording_queue_overflow, F_PTR(QComboBox, activated, int), [=](int index) {
+      auto policy = static_cast<Configuration::RecordingQueueOverflow>(d->ui->recording_queue_overflow->itemData(index).toInt());
+      d->configuration.set_recording_queue_overflow(policy);
+      d->ui->recording_queue_block_msecs->setEnabled(policy == Configuration::QueueBlockProducer);
+    });
+    connect(d->ui->recording_queue_block_msecs, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_queue_block_msecs, &d->configuration, _1));
+    d->ui->load_shedding->addItem(tr("drop frames"), static_cast<int>(LoadShedding::Normal));
+    d->ui->load_shedding->addItem(tr("stop previews"), static_cast<int>(LoadShedding::NoPreviews));
+    d->ui->load_shedding->addItem(tr("stop previews, then slow the display down"), static_cast<int>(LoadShedding::SlowDisplay));
+    d->ui->load_shedding->addItem(tr("stop previews, slow the display down, then stop it"), static_cast<int>(LoadShedding::NoDisplay));
+    d->ui->load_shedding->setCurrentIndex(d->ui->load_shedding->findData(d->configuration.load_shedding()));
+    d->ui->load_shedding_display_fps->setValue(d->configuration.load_shedding_display_fps());
+    connect(d->ui->load_shedding, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_load_shedding(d->ui->load_shedding->itemData(index).toInt());
+    });
+    connect(d->ui->load_shedding_display_fps, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_load_shedding_display_fps, &d->configuration, _1));
+    d->ui->cpu_governor->setChecked(d->configuration.cpu_governor());
+    d->ui->cpu_governor_reserve->setValue(d->configuration.cpu_governor_reserve());
+    d->ui->cpu_governor_priorities->setText(d->configuration.cpu_governor_priorities().join(", "));
+    connect(d->ui->cpu_governor, &QCheckBox::toggled, bind(&Configuration::set_cpu_governor, &d->configuration, _1));
+    connect(d->ui->cpu_governor_reserve, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_cpu_governor_reserve, &d->configuration, _1));
+    connect(d->ui->cpu_governor_priorities, &QLineEdit::editingFinished, [=] {
+      QStringList priorities;
+      for(const auto &name: d->ui->cpu_governor_priorities->text().split(',', QString::SkipEmptyParts))
+        if(! name.trimmed().isEmpty())
+          priorities.append(name.trimmed());
+      d->configuration.set_cpu_governor_priorities(priorities);
+    });
+    d->ui->pipeline->setText(d->configuration.pipeline());
+    connect(d->ui->pipeline, &QLineEdit::editingFinished, [=] {
+      d->configuration.set_pipeline(d->ui->pipeline->text().trimmed());
+    });
+    d->ui->recording_spool_directory->setText(d->configuration.recording_spool_directory());
+    connect(d->ui->recording_spool_directory, &QLineEdit::editingFinished, [=] { d->configuration.set_recording_spool_directory(d->ui->recording_spool_directory->text()); });
+    connect(d->ui->recording_spool_directory_browse, &QToolButton::clicked, [=] {
+      auto directory = QFileDialog::getExistingDirectory(this, tr("Recording spool directory"), d->ui->recording_spool_directory->text());
+      if(directory.isEmpty())
+        return;
+      d->ui->recording_spool_directory->setText(directory);
+      d->configuration.set_recording_spool_directory(directory);
+    });
+    d->ui->recording_spool_threshold->setValue(d->configuration.recording_spool_threshold());
+    connect(d->ui->recording_spool_threshold, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_spool_threshold, &d->configuration, _1));
+    d->ui->recording_spool_max_size->setValue(d->configuration.recording_spool_max_size() / 1024 / 1024 / 1024);
+    connect(d->ui->recording_spool_max_size, F_PTR(QSpinBox, valueChanged, int), [this](int value) { d->configuration.set_recording_spool_max_size(static_cast<long long>(value) * 1024ll * 1024ll * 1024ll); });
+#if HAVE_LZ4
+    d->ui->recording_queue_compression->setChecked(d->configuration.recording_queue_compression());
+    connect(d->ui->recording_queue_compression, &QCheckBox::toggled, bind(&Configuration::set_recording_queue_compression, &d->configuration, _1));
+    d->ui->recording_queue_compression_threshold->setValue(d->configuration.recording_queue_compression_threshold());
+    connect(d->ui->recording_queue_compression_threshold, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_recording_queue_compression_threshold, &d->configuration, _1));
+#else
+    d->ui->recording_queue_compression->setEnabled(false);
+    d->ui->recording_queue_compression->setToolTip(tr("PlanetaryImager was built without LZ4"));
+    d->ui->recording_queue_compression_threshold->setEnabled(false);
+#endif
+    d->ui->recording_armed->setChecked(d->configuration.recording_armed());
+    connect(d->ui->recording_armed, &QCheckBox::toggled, bind(&Configuration::set_recording_armed, &d->configuration, _1));
+    d->ui->recording_index->setChecked(d->configuration.recording_index());
+    connect(d->ui->recording_index, &QCheckBox::toggled, bind(&Configuration::set_recording_index, &d->configuration, _1));
         
     d->ui->telescope->setText(d->configuration.telescope());
     d->ui->observer->setText(d->configuration.observer());
@@ -168,6 +405,24 @@ ConfigurationDialog::ConfigurationDialog(Configuration &configuration, QWidget*
     }
     d->ui->video_codec->setCurrentIndex(d->ui->video_codec->findData(d->configuration.video_codec()));
     connect(d->ui->video_codec, F_PTR(QComboBox, activated, int), [=](int index){ d->configuration.set_video_codec(d->ui->video_codec->itemData(index).toString()); });
+#if HAVE_LIBAV
+    for(auto codec: QList<QPair<QString,QString>>{
+        {"ffv1", tr("Lossless, 8 and 16 bit")},
+        {"utvideo", tr("Lossless, 8 bit, fast")},
+        {"h264_nvenc", tr("NVIDIA H.264, quick-look")},
+        {"hevc_nvenc", tr("NVIDIA HEVC, quick-look")},
+        {"h264_qsv", tr("Intel QuickSync H.264, quick-look")},
+        {"hevc_qsv", tr("Intel QuickSync HEVC, quick-look")},
+        {"h264_vaapi", tr("VA-API H.264, quick-look")},
+        {"hevc_vaapi", tr("VA-API HEVC, quick-look")},
+    }) {
+        d->ui->ffmpeg_video_codec->addItem("%1 (%2)"_q % codec.first % codec.second, codec.first);
+    }
+    d->ui->ffmpeg_video_codec->setCurrentIndex(d->ui->ffmpeg_video_codec->findData(d->configuration.ffmpeg_video_codec()));
+    connect(d->ui->ffmpeg_video_codec, F_PTR(QComboBox, activated, int), [=](int index){ d->configuration.set_ffmpeg_video_codec(d->ui->ffmpeg_video_codec->itemData(index).toString()); });
+#else
+    d->ui->ffmpeg_video_codec_widget->hide();
+#endif
 
     d->ui->pixelDataEndianess->addItem("camera default", static_cast<int>(Configuration::CaptureEndianess::CameraDefault));
     d->ui->pixelDataEndianess->addItem("little-endian",  static_cast<int>(Configuration::CaptureEndianess::Little));
@@ -176,4 +431,71 @@ ConfigurationDialog::ConfigurationDialog(Configuration &configuration, QWidget*
 
     connect(d->ui->pixelDataEndianess, F_PTR(QComboBox, activated, int),
             [=](int index) { d->configuration.set_capture_endianess(static_cast<Configuration::CaptureEndianess>(d->ui->pixelDataEndianess->itemData(index).toInt())); });
+    d->ui->capture_native_byte_order->setChecked(d->configuration.capture_native_byte_order());
+    connect(d->ui->capture_native_byte_order, &QCheckBox::toggled, bind(&Configuration::set_capture_native_byte_order, &d->configuration, _1));
+
+    d->ui->software_bin->addItem(tr("off"), 1);
+    for(int bin: {2, 3, 4})
+      d->ui->software_bin->addItem("%1x%1"_q % bin, bin);
+    d->ui->software_bin->setCurrentIndex(d->ui->software_bin->findData(d->configuration.software_bin()));
+    connect(d->ui->software_bin, F_PTR(QComboBox, activated, int), [=](int index) { d->configuration.set_software_bin(d->ui->software_bin->itemData(index).toInt()); });
+    d->ui->software_bin_mode->addItem(tr("average"), static_cast<int>(Configuration::SoftwareBinAverage));
+    d->ui->software_bin_mode->addItem(tr("sum"), static_cast<int>(Configuration::SoftwareBinSum));
+    d->ui->software_bin_mode->setCurrentIndex(d->ui->software_bin_mode->findData(static_cast<int>(d->configuration.software_bin_mode())));
+    connect(d->ui->software_bin_mode, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_software_bin_mode(static_cast<Configuration::SoftwareBinMode>(d->ui->software_bin_mode->itemData(index).toInt()));
+    });
+    const QRect software_roi = d->configuration.software_roi();
+    if(! software_roi.isEmpty())
+      d->ui->software_roi->setText("%1, %2, %3, %4"_q % software_roi.x() % software_roi.y() % software_roi.width() % software_roi.height());
+    connect(d->ui->software_roi, &QLineEdit::editingFinished, [=] {
+      const auto values = d->ui->software_roi->text().split(',', QString::SkipEmptyParts);
+      QList<int> numbers;
+      for(auto value: values)
+        numbers.append(value.trimmed().toInt());
+      d->configuration.set_software_roi(numbers.size() == 4 ? QRect{numbers[0], numbers[1], numbers[2], numbers[3]} : QRect{});
+    });
+    d->ui->calibration->setChecked(d->configuration.calibration());
+    connect(d->ui->calibration, &QCheckBox::toggled, bind(&Configuration::set_calibration, &d->configuration, _1));
+    d->ui->calibration_directory->setText(d->configuration.calibration_directory());
+    connect(d->ui->calibration_directory, &QLineEdit::editingFinished, [=] { d->configuration.set_calibration_directory(d->ui->calibration_directory->text()); });
+    connect(d->ui->calibration_directory_browse, &QToolButton::clicked, [=] {
+      auto directory = QFileDialog::getExistingDirectory(this, tr("Calibration masters directory"), d->ui->calibration_directory->text());
+      if(directory.isEmpty())
+        return;
+      d->ui->calibration_directory->setText(directory);
+      d->configuration.set_calibration_directory(directory);
+    });
+    d->ui->hot_pixels->setChecked(d->configuration.hot_pixels());
+    connect(d->ui->hot_pixels, &QCheckBox::toggled, bind(&Configuration::set_hot_pixels, &d->configuration, _1));
+    d->ui->hot_pixels_frames->setValue(d->configuration.hot_pixels_frames());
+    connect(d->ui->hot_pixels_frames, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_hot_pixels_frames, &d->configuration, _1));
+    d->ui->hot_pixels_sigma->setValue(d->configuration.hot_pixels_sigma());
+    connect(d->ui->hot_pixels_sigma, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_hot_pixels_sigma, &d->configuration, _1));
+    d->ui->auto_exposure->setChecked(d->configuration.auto_exposure());
+    connect(d->ui->auto_exposure, &QCheckBox::toggled, bind(&Configuration::set_auto_exposure, &d->configuration, _1));
+    d->ui->auto_exposure_target->setValue(d->configuration.auto_exposure_target());
+    connect(d->ui->auto_exposure_target, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_auto_exposure_target, &d->configuration, _1));
+    d->ui->auto_exposure_max_exposure->setValue(d->configuration.auto_exposure_max_exposure());
+    connect(d->ui->auto_exposure_max_exposure, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_auto_exposure_max_exposure, &d->configuration, _1));
+    d->ui->auto_exposure_gain_per_doubling->setValue(d->configuration.auto_exposure_gain_per_doubling());
+    connect(d->ui->auto_exposure_gain_per_doubling, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_auto_exposure_gain_per_doubling, &d->configuration, _1));
+    d->ui->auto_exposure_roi_size->setValue(d->configuration.auto_exposure_roi_size());
+    connect(d->ui->auto_exposure_roi_size, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_auto_exposure_roi_size, &d->configuration, _1));
+    d->ui->roi_follow->setChecked(d->configuration.roi_follow());
+    connect(d->ui->roi_follow, &QCheckBox::toggled, bind(&Configuration::set_roi_follow, &d->configuration, _1));
+    d->ui->roi_follow_margin->setValue(d->configuration.roi_follow_margin());
+    connect(d->ui->roi_follow_margin, F_PTR(QDoubleSpinBox, valueChanged, double), bind(&Configuration::set_roi_follow_margin, &d->configuration, _1));
+    d->ui->focus_assist->setChecked(d->configuration.focus_assist());
+    connect(d->ui->focus_assist, &QCheckBox::toggled, bind(&Configuration::set_focus_assist, &d->configuration, _1));
+    d->ui->focus_assist_metric->addItem(tr("Laplacian"), static_cast<int>(Configuration::FocusLaplacian));
+    d->ui->focus_assist_metric->addItem(tr("Brenner"), static_cast<int>(Configuration::FocusBrenner));
+    d->ui->focus_assist_metric->addItem(tr("Half flux diameter"), static_cast<int>(Configuration::FocusHFD));
+    d->ui->focus_assist_metric->addItem(tr("FWHM"), static_cast<int>(Configuration::FocusFWHM));
+    d->ui->focus_assist_metric->setCurrentIndex(d->ui->focus_assist_metric->findData(static_cast<int>(d->configuration.focus_assist_metric())));
+    connect(d->ui->focus_assist_metric, F_PTR(QComboBox, activated, int), [=](int index) {
+      d->configuration.set_focus_assist_metric(static_cast<Configuration::FocusMetric>(d->ui->focus_assist_metric->itemData(index).toInt()));
+    });
+    d->ui->focus_assist_roi_size->setValue(d->configuration.focus_assist_roi_size());
+    connect(d->ui->focus_assist_roi_size, F_PTR(QSpinBox, valueChanged, int), bind(&Configuration::set_focus_assist_roi_size, &d->configuration, _1));
 }
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "diagnosticswidget.h"
+#include <QHeaderView>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include "commons/metricssource.h"
+#include "Qt/qt_strings_helper.h"
+
+using namespace std;
+
+DPTR_IMPL(DiagnosticsWidget) {
+  MetricsSourcePtr source;
+  DiagnosticsWidget *q;
+  QTreeWidget *tree;
+  unique_ptr<QTimer> refresh_timer;
+  void show(const QVariantList &snapshot);
+};
+
+namespace {
+  enum Column { Name, Value, P50, P99, Max };
+  QString milliseconds(const QVariant &us) {
+    return QString::number(us.toULongLong() / 1000., 'f', 2);
+  }
+}
+
+DiagnosticsWidget::~DiagnosticsWidget()
+{
+}
+
+DiagnosticsWidget::DiagnosticsWidget(const MetricsSourcePtr &source, QWidget* parent) : QWidget(parent), dptr(source, this, new QTreeWidget, make_unique<QTimer>())
+{
+  auto layout = new QVBoxLayout(this);
+  layout->addWidget(d->tree);
+  d->tree->setHeaderLabels({tr("Metric"), tr("Value"), tr("p50 (ms)"), tr("p99 (ms)"), tr("max (ms)")});
+  d->tree->setRootIsDecorated(false);
+  d->tree->header()->setSectionResizeMode(Name, QHeaderView::Stretch);
+  d->tree->header()->setStretchLastSection(false);
+  d->refresh_timer->setInterval(1000);
+  connect(d->refresh_timer.get(), &QTimer::timeout, d->source.get(), &MetricsSource::refresh);
+  connect(d->source.get(), &MetricsSource::metrics, this, [this](const QVariantList &snapshot) { d->show(snapshot); }, Qt::QueuedConnection);
+}
+
+void DiagnosticsWidget::showEvent(QShowEvent *event)
+{
+  QWidget::showEvent(event);
+  d->source->refresh();
+  d->refresh_timer->start();
+}
+
+void DiagnosticsWidget::hideEvent(QHideEvent *event)
+{
+  QWidget::hideEvent(event);
+  d->refresh_timer->stop();
+}
+
+void DiagnosticsWidget::Private::show(const QVariantList &snapshot)
+{
+  // Same metrics in the same order on every refresh, most of the time: items are reused, so that selection and scrolling stay put
+  while(tree->topLevelItemCount() > snapshot.size())
+    delete tree->takeTopLevelItem(tree->topLevelItemCount() - 1);
+  for(int i = 0; i < snapshot.size(); i++) {
+    auto metric = snapshot[i].toMap();
+    auto item = tree->topLevelItem(i);
+    if(! item)
+      tree->addTopLevelItem(item = new QTreeWidgetItem);
+    auto labels = metric["labels"].toString();
+    item->setText(Name, labels.isEmpty() ? metric["name"].toString() : "%1{%2}"_q % metric["name"].toString() % labels);
+    item->setToolTip(Name, metric["help"].toString());
+    if(metric["type"].toString() == "histogram") {
+      item->setText(Value, tr("%1 samples").arg(metric["count"].toULongLong()));
+      item->setText(P50, milliseconds(metric["p50_us"]));
+      item->setText(P99, milliseconds(metric["p99_us"]));
+      item->setText(Max, milliseconds(metric["max_us"]));
+    } else {
+      item->setText(Value, metric["value"].toString());
+      for(auto column: {P50, P99, Max})
+        item->setText(column, {});
+    }
+  }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "displaysurfaceitem.h"
+#include <QPainter>
+
+DisplaySurfaceItem::DisplaySurfaceItem(const DisplaySurfacePtr &surface, QGraphicsItem *parent) : QGraphicsItem{parent}, surface{surface}
+{
+}
+
+QRectF DisplaySurfaceItem::boundingRect() const
+{
+  return rect;
+}
+
+void DisplaySurfaceItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+  const auto &front = surface->front();
+  if(front.image.isNull())
+    return;
+  // Downscaled images (binned views) are stretched back over the frame area they come from
+  painter->setRenderHint(QPainter::SmoothPixmapTransform, front.image.width() < front.frameRect.width());
+  painter->drawImage(rect, front.image);
+}
+
+bool DisplaySurfaceItem::swap()
+{
+  if(! surface->swap())
+    return false;
+  const QRectF frameRect = surface->front().frameRect;
+  if(frameRect != rect) {
+    prepareGeometryChange();
+    rect = frameRect;
+  }
+  update();
+  return true;
+}
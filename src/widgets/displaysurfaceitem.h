@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISPLAYSURFACEITEM_H
+#define DISPLAYSURFACEITEM_H
+
+#include <QGraphicsItem>
+#include "image_handlers/frontend/displaysurface.h"
+
+/**
+ * Scene item painting the front image of a DisplaySurface straight from its pixels, with no QPixmap conversion in between.
+ * Placed over the part of the frame the image shows (DisplaySurface::Image::frameRect), in frame coordinates.
+ */
+class DisplaySurfaceItem : public QGraphicsItem
+{
+public:
+  DisplaySurfaceItem(const DisplaySurfacePtr &surface, QGraphicsItem *parent = nullptr);
+  QRectF boundingRect() const override;
+  void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+  /// Brings the latest image of the surface in front and schedules a repaint; false if there was no new image
+  bool swap();
+private:
+  const DisplaySurfacePtr surface;
+  QRectF rect;
+};
+
+#endif // DISPLAYSURFACEITEM_H
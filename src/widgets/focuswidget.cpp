@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "focuswidget.h"
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QVariantMap>
+#include <algorithm>
+#include <deque>
+#include "commons/focussource.h"
+
+using namespace std;
+
+namespace {
+// Points on the plot: a few seconds of a fast planetary capture, or a long star autofocus run
+const size_t max_points = 600;
+
+/// Values scaled to the plot height between their minimum and maximum; painting is a single polyline, cheap at any rate
+class Plot : public QWidget {
+public:
+  Plot(const deque<double> &values) : values(values) {
+    setMinimumSize(200, 100);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+  }
+protected:
+  void paintEvent(QPaintEvent *) override {
+    QPainter painter{this};
+    painter.fillRect(rect(), palette().base());
+    if(values.size() < 2)
+      return;
+    const auto range = minmax_element(values.begin(), values.end());
+    const double low = *range.first, span = max(*range.second - low, 1e-12);
+    const double x_step = static_cast<double>(width() - 1) / (max_points - 1), height = this->height() - 1;
+    QPolygonF line;
+    line.reserve(values.size());
+    double x = width() - 1 - x_step * (values.size() - 1);
+    for(auto value: values) {
+      line.append({x, height - (value - low) / span * height});
+      x += x_step;
+    }
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen{palette().text(), 1.5});
+    painter.drawPolyline(line);
+  }
+private:
+  const deque<double> &values;
+};
+}
+
+DPTR_IMPL(FocusWidget) {
+  FocusSourcePtr source;
+  FocusWidget *q;
+  unique_ptr<QTimer> refresh_timer;
+  deque<double> values;
+  QString metric;
+  double best = 0;
+  Plot *plot;
+  QLabel *current_label, *best_label;
+  void add(const QVariantList &measurements);
+  void reset();
+  bool lower_is_better() const { return metric == "hfd" || metric == "fwhm"; }
+};
+
+FocusWidget::~FocusWidget()
+{
+}
+
+FocusWidget::FocusWidget(const FocusSourcePtr &source, QWidget* parent) : QWidget(parent), dptr(source, this, make_unique<QTimer>())
+{
+  auto layout = new QVBoxLayout(this);
+  auto values_layout = new QHBoxLayout;
+  values_layout->addWidget(d->current_label = new QLabel);
+  values_layout->addWidget(d->best_label = new QLabel);
+  values_layout->addStretch();
+  auto reset = new QPushButton(tr("Reset"));
+  reset->setToolTip(tr("Forget the plotted values and the best one, i.e. after moving to another target"));
+  values_layout->addWidget(reset);
+  layout->addLayout(values_layout);
+  layout->addWidget(d->plot = new Plot{d->values});
+  d->reset();
+  connect(reset, &QPushButton::clicked, this, [this]{ d->reset(); });
+  d->refresh_timer->setInterval(50);
+  connect(d->refresh_timer.get(), &QTimer::timeout, d->source.get(), &FocusSource::refresh);
+  connect(d->source.get(), &FocusSource::measurements, this, [this](const QVariantList &measurements) { d->add(measurements); }, Qt::QueuedConnection);
+}
+
+void FocusWidget::showEvent(QShowEvent *event)
+{
+  QWidget::showEvent(event);
+  d->source->refresh();
+  d->refresh_timer->start();
+}
+
+void FocusWidget::hideEvent(QHideEvent *event)
+{
+  QWidget::hideEvent(event);
+  d->refresh_timer->stop();
+}
+
+void FocusWidget::Private::reset()
+{
+  values.clear();
+  current_label->setText(FocusWidget::tr("Enable focus assist in the configuration to measure"));
+  best_label->clear();
+  plot->update();
+}
+
+void FocusWidget::Private::add(const QVariantList &measurements)
+{
+  for(const auto &item: measurements) {
+    const auto measurement = item.toMap();
+    const auto measurement_metric = measurement.value("metric").toString();
+    const double value = measurement.value("value").toDouble();
+    if(measurement_metric != metric) {
+      metric = measurement_metric;
+      values.clear();
+    }
+    if(values.empty() || (lower_is_better() ? value < best : value > best))
+      best = value;
+    values.push_back(value);
+    if(values.size() > max_points)
+      values.pop_front();
+  }
+  if(values.empty())
+    return;
+  current_label->setText(FocusWidget::tr("%1: <b>%2</b>").arg(metric).arg(values.back(), 0, 'g', 4));
+  best_label->setText(FocusWidget::tr("best: %1").arg(best, 0, 'g', 4));
+  plot->update();
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FOCUSWIDGET_H
+#define FOCUSWIDGET_H
+
+#include <QWidget>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+
+FWD_PTR(FocusSource)
+
+/// Focus metric of the latest frames as a running plot, with the current and best values, refreshed 20 times a second while shown
+class FocusWidget : public QWidget
+{
+    Q_OBJECT
+public:
+~FocusWidget();
+FocusWidget(const FocusSourcePtr &source, QWidget* parent = 0);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    DPTR
+};
+
+#endif // FOCUSWIDGET_H
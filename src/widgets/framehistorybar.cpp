@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "framehistorybar.h"
+#include "network/client/framehistory.h"
+#include "image_handlers/frontend/displayimage.h"
+#include "commons/inflightcoalescer.h"
+#include "commons/frame.h"
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSignalBlocker>
+#include <QSlider>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrent>
+
+using namespace std;
+
+DPTR_IMPL(FrameHistoryBar) {
+  const DisplayImagePtr displayImage;
+  FrameHistoryBar *q;
+  FrameHistoryPtr history;
+  QSlider *slider;
+  QLabel *label;
+  QTimer *refresh_timer;
+  bool frozen = false;
+  // A single decoding at a time, the latest slider position winning meanwhile
+  InFlightCoalescer<quint64> decoding;
+  unique_ptr<QThreadPool> decoder_thread;
+  void refresh();
+  void moved(int value);
+  void decode(quint64 number);
+  void decoded(quint64 number, const FrameConstPtr &frame);
+};
+
+FrameHistoryBar::FrameHistoryBar(const DisplayImagePtr &displayImage, QWidget *parent)
+  : QWidget(parent), dptr(displayImage, this, {}, new QSlider(Qt::Horizontal), new QLabel, new QTimer(this))
+{
+  d->decoder_thread = make_unique<QThreadPool>();
+  d->decoder_thread->setMaxThreadCount(1);
+  auto layout = new QHBoxLayout(this);
+  layout->setContentsMargins(2, 0, 2, 0);
+  auto live_button = new QPushButton(tr("Live"));
+  live_button->setToolTip(tr("Back to the live frames"));
+  layout->addWidget(d->slider, 1);
+  layout->addWidget(d->label);
+  layout->addWidget(live_button);
+  d->slider->setToolTip(tr("Drag back to look at the last frames received"));
+  connect(d->slider, &QSlider::valueChanged, this, [this](int value) { d->moved(value); });
+  connect(live_button, &QPushButton::clicked, this, &FrameHistoryBar::live);
+  connect(this, &FrameHistoryBar::frameDecoded, this, [this](quint64 number, const FrameConstPtr &frame) { d->decoded(number, frame); }, Qt::QueuedConnection);
+  d->refresh_timer->setInterval(250);
+  connect(d->refresh_timer, &QTimer::timeout, this, [this] { d->refresh(); });
+  setHistory({});
+}
+
+FrameHistoryBar::~FrameHistoryBar()
+{
+  d->decoder_thread->waitForDone();
+}
+
+void FrameHistoryBar::setHistory(const FrameHistoryPtr &history)
+{
+  live();
+  d->history = history;
+  if(history)
+    d->refresh_timer->start();
+  else
+    d->refresh_timer->stop();
+  d->refresh();
+}
+
+void FrameHistoryBar::live()
+{
+  if(d->frozen)
+    d->displayImage->unfreeze();
+  d->frozen = false;
+  d->refresh();
+}
+
+// Frame numbers go past the int range of the slider after a long session: positions are relative to the oldest frame kept
+void FrameHistoryBar::Private::refresh()
+{
+  const quint64 first = history ? history->first() : 0;
+  const quint64 last = history ? history->last() : 0;
+  const quint64 shown = frozen ? first + slider->value() : last;
+  QSignalBlocker block{slider};
+  slider->setEnabled(last > 0);
+  slider->setRange(0, static_cast<int>(last - first));
+  slider->setValue(frozen ? static_cast<int>(max(shown, first) - first) : slider->maximum());
+  const QString size = QString::number(history ? history->bytes() / 1024. / 1024. : 0, 'f', 1);
+  if(! frozen || last == 0) {
+    label->setText(tr("Live (%1 frames, %2 MB)").arg(last ? last - first + 1 : 0).arg(size));
+    return;
+  }
+  const double ago = chrono::duration<double>(history->received(last) - history->received(max(shown, first))).count();
+  label->setText(tr("-%1 s (%2 MB)").arg(ago, 0, 'f', 1).arg(size));
+}
+
+void FrameHistoryBar::Private::moved(int value)
+{
+  if(! history || history->last() == 0)
+    return;
+  if(value == slider->maximum()) {
+    q->live();
+    return;
+  }
+  frozen = true;
+  const quint64 number = history->first() + value;
+  if(decoding.offer(number))
+    decode(number);
+  refresh();
+}
+
+void FrameHistoryBar::Private::decode(quint64 number)
+{
+  auto history = this->history;
+  QtConcurrent::run(decoder_thread.get(), [=] {
+    emit q->frameDecoded(number, history->frame(number));
+  });
+}
+
+void FrameHistoryBar::Private::decoded(quint64, const FrameConstPtr &frame)
+{
+  if(frozen && frame)
+    displayImage->freeze(frame);
+  quint64 next;
+  if(decoding.acknowledged(next) && frozen && history) {
+    decoding.offer(next);
+    decode(next);
+  }
+}
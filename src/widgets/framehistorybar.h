@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAMEHISTORYBAR_H
+#define FRAMEHISTORYBAR_H
+
+#include <QWidget>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+
+FWD_PTR(FrameHistory)
+FWD_PTR(DisplayImage)
+FWD_PTR(Frame)
+
+/**
+ * Scrub bar over the frames history of a remote imager: dragging it back freezes the view on a past frame, decoded on demand
+ * (only the frame under the slider, the latest one while dragging); the right end, or the Live button, goes back to the live frames.
+ */
+class FrameHistoryBar : public QWidget
+{
+  Q_OBJECT
+public:
+  FrameHistoryBar(const DisplayImagePtr &displayImage, QWidget *parent = nullptr);
+  ~FrameHistoryBar();
+  /// Null to detach it, when the imager goes away
+  void setHistory(const FrameHistoryPtr &history);
+public slots:
+  void live();
+signals:
+  void frameDecoded(quint64 number, const FrameConstPtr &frame);
+private:
+  DPTR
+};
+
+#endif // FRAMEHISTORYBAR_H
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "glframeitem.h"
+#include <boost/endian/conversion.hpp>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLWidget>
+#include <QPainter>
+#include <QPointer>
+#include <QMatrix4x4>
+#include <QDebug>
+#include "c++/stlutils.h"
+#include <cstring>
+
+// Desktop OpenGL only formats, missing from OpenGL ES headers (ES contexts are rejected at runtime)
+#ifndef GL_LUMINANCE8
+#define GL_LUMINANCE8 0x8040
+#endif
+#ifndef GL_LUMINANCE16
+#define GL_LUMINANCE16 0x8042
+#endif
+#ifndef GL_RGB8
+#define GL_RGB8 0x8051
+#endif
+#ifndef GL_RGB16
+#define GL_RGB16 0x8054
+#endif
+#ifndef GL_BGR
+#define GL_BGR 0x80E0
+#endif
+#ifndef GL_UNPACK_SWAP_BYTES
+#define GL_UNPACK_SWAP_BYTES 0x0CF0
+#endif
+
+using namespace std;
+
+namespace {
+const char *vertex_shader = R"_(
+attribute vec2 position;
+uniform mat4 mvp;
+varying vec2 pixel;
+void main() {
+  pixel = position;
+  gl_Position = mvp * vec4(position, 0.0, 1.0);
+}
+)_";
+
+// mode: 0 mono, 1 bayer, 2 colour. first_red: position of the red pixel in the 2x2 bayer cell.
+const char *fragment_shader = R"_(
+uniform sampler2D frame;
+uniform vec2 size;
+uniform int mode;
+uniform vec2 first_red;
+uniform float black;
+uniform float white;
+uniform bool edges;
+uniform bool saturate;
+varying vec2 pixel;
+
+float raw(vec2 p) {
+  return texture2D(frame, (clamp(p, vec2(0.0), size - 1.0) + 0.5) / size).r;
+}
+
+// Bilinear demosaicing
+vec3 colour(vec2 p) {
+  if(mode == 2)
+    return texture2D(frame, (clamp(p, vec2(0.0), size - 1.0) + 0.5) / size).rgb;
+  float centre = raw(p);
+  if(mode == 0)
+    return vec3(centre);
+  float horizontal = (raw(p + vec2(-1.0, 0.0)) + raw(p + vec2(1.0, 0.0))) * 0.5;
+  float vertical = (raw(p + vec2(0.0, -1.0)) + raw(p + vec2(0.0, 1.0))) * 0.5;
+  float neighbours = (horizontal + vertical) * 0.5;
+  float diagonals = (raw(p + vec2(-1.0, -1.0)) + raw(p + vec2(1.0, -1.0)) + raw(p + vec2(-1.0, 1.0)) + raw(p + vec2(1.0, 1.0))) * 0.25;
+  vec2 parity = mod(p + first_red, 2.0);
+  if(parity.x < 0.5 && parity.y < 0.5)
+    return vec3(centre, neighbours, diagonals);
+  if(parity.x > 0.5 && parity.y > 0.5)
+    return vec3(diagonals, neighbours, centre);
+  if(parity.y < 0.5)
+    return vec3(horizontal, centre, vertical);
+  return vec3(vertical, centre, horizontal);
+}
+
+vec3 stretched(vec2 p) {
+  return clamp((colour(p) - black) / (white - black), 0.0, 1.0);
+}
+
+float luminance(vec2 p) {
+  return dot(stretched(p), vec3(0.299, 0.587, 0.114));
+}
+
+void main() {
+  vec2 p = floor(pixel);
+  vec3 result;
+  if(edges) {
+    float top_left = luminance(p + vec2(-1.0, -1.0)), top = luminance(p + vec2(0.0, -1.0)), top_right = luminance(p + vec2(1.0, -1.0));
+    float left = luminance(p + vec2(-1.0, 0.0)), right = luminance(p + vec2(1.0, 0.0));
+    float bottom_left = luminance(p + vec2(-1.0, 1.0)), bottom = luminance(p + vec2(0.0, 1.0)), bottom_right = luminance(p + vec2(1.0, 1.0));
+    float gradient_x = (top_right + 2.0 * right + bottom_right) - (top_left + 2.0 * left + bottom_left);
+    float gradient_y = (bottom_left + 2.0 * bottom + bottom_right) - (top_left + 2.0 * top + top_right);
+    result = vec3(clamp((abs(gradient_x) + abs(gradient_y)) * 0.5, 0.0, 1.0));
+  } else {
+    result = stretched(p);
+  }
+  // Same as setting S to the maximum in HSV space: the darkest channel goes to 0, hue and value are kept
+  if(saturate && mode != 0 && ! edges) {
+    float maximum = max(result.r, max(result.g, result.b));
+    float minimum = min(result.r, min(result.g, result.b));
+    result = maximum > minimum ? maximum * (result - minimum) / (maximum - minimum) : vec3(maximum, 0.0, 0.0);
+  }
+  gl_FragColor = vec4(result, 1.0);
+}
+)_";
+
+struct TextureFormat {
+  GLint internal_format;
+  GLenum format;
+  GLenum type;
+  bool operator==(const TextureFormat &other) const { return internal_format == other.internal_format && format == other.format && type == other.type; }
+  bool operator!=(const TextureFormat &other) const { return ! (*this == other); }
+};
+}
+
+DPTR_IMPL(GLFrameItem) {
+  GLFrameItem *q;
+  FrameConstPtr frame;
+  bool frame_uploaded = false;
+  bool debayer = true;
+  bool edges = false;
+  bool stretch = false;
+  bool saturate = false;
+  float black = 0;
+  float white = 1;
+  bool swap_bytes = false;
+  bool failed = false;
+
+  QPointer<QOpenGLWidget> viewport;
+  unique_ptr<QOpenGLShaderProgram> program;
+  unique_ptr<QOpenGLBuffer> pixel_buffer;
+  GLuint texture = 0;
+  QSize texture_size;
+  TextureFormat texture_format{0, 0, 0};
+
+  bool initialize(QOpenGLContext *context);
+  void upload(QOpenGLFunctions *f);
+  void release_gl();
+};
+
+GLFrameItem::GLFrameItem(QGraphicsItem* parent) : QGraphicsObject(parent), dptr(this)
+{
+}
+
+GLFrameItem::~GLFrameItem()
+{
+  d->release_gl();
+}
+
+void GLFrameItem::Private::release_gl()
+{
+  if(! viewport || ! texture)
+    return;
+  viewport->makeCurrent();
+  viewport->context()->functions()->glDeleteTextures(1, &texture);
+  pixel_buffer.reset();
+  program.reset();
+  viewport->doneCurrent();
+  texture = 0;
+}
+
+QRectF GLFrameItem::boundingRect() const
+{
+  return d->frame ? QRectF{{0, 0}, d->frame->resolution()} : QRectF{};
+}
+
+void GLFrameItem::setFrame(const FrameConstPtr& frame)
+{
+  if(! d->frame || d->frame->resolution() != frame->resolution())
+    prepareGeometryChange();
+  d->frame = frame;
+  d->frame_uploaded = false;
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  d->swap_bytes = frame->mat().depth() == CV_16U && (native_little_endian ? frame->byteOrder() == Frame::BigEndian : frame->byteOrder() == Frame::LittleEndian);
+  d->black = 0;
+  d->white = 1;
+  if(d->stretch) {
+    cv::Mat values = frame->mat().reshape(1);
+    if(d->swap_bytes) {
+      // Levels only: a sparse sample is enough, and keeps the GUI thread from swapping the whole frame
+      cv::Mat sample;
+      cv::resize(values, sample, {}, 0.25, 0.25, cv::INTER_NEAREST);
+      for(auto it = sample.begin<uint16_t>(); it != sample.end<uint16_t>(); ++it)
+        *it = boost::endian::endian_reverse(*it);
+      values = sample;
+    }
+    double minimum, maximum;
+    cv::minMaxLoc(values, &minimum, &maximum);
+    const double range = values.depth() == CV_16U ? 65535. : 255.;
+    if(maximum > minimum) {
+      d->black = minimum / range;
+      d->white = maximum / range;
+    }
+  }
+  update();
+}
+
+void GLFrameItem::setDebayer(bool debayer)
+{
+  d->debayer = debayer;
+  update();
+}
+
+void GLFrameItem::setEdgeDetection(bool enable)
+{
+  d->edges = enable;
+  update();
+}
+
+void GLFrameItem::setStretch(bool enable)
+{
+  d->stretch = enable;
+  update();
+}
+
+void GLFrameItem::setMaximumSaturation(bool enable)
+{
+  d->saturate = enable;
+  update();
+}
+
+bool GLFrameItem::Private::initialize(QOpenGLContext* context)
+{
+  if(program)
+    return true;
+  if(! context || context->isOpenGLES() || ! viewport)
+    return false;
+  program.reset(new QOpenGLShaderProgram);
+  if(! program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader) ||
+     ! program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader) ||
+     ! program->link()) {
+    qWarning() << "Unable to build live view shaders:" << program->log();
+    program.reset();
+    return false;
+  }
+  pixel_buffer.reset(new QOpenGLBuffer{QOpenGLBuffer::PixelUnpackBuffer});
+  pixel_buffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+  if(! pixel_buffer->create()) {
+    program.reset();
+    pixel_buffer.reset();
+    return false;
+  }
+  context->functions()->glGenTextures(1, &texture);
+  return true;
+}
+
+void GLFrameItem::Private::upload(QOpenGLFunctions *f)
+{
+  f->glBindTexture(GL_TEXTURE_2D, texture);
+  if(frame_uploaded)
+    return;
+  const cv::Mat mat = frame->mat();
+  const bool sixteen_bit = mat.depth() == CV_16U;
+  TextureFormat format{0, 0, static_cast<GLenum>(sixteen_bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE)};
+  if(mat.channels() == 1) {
+    format.internal_format = sixteen_bit ? GL_LUMINANCE16 : GL_LUMINANCE8;
+    format.format = GL_LUMINANCE;
+  } else {
+    format.internal_format = sixteen_bit ? GL_RGB16 : GL_RGB8;
+    format.format = frame->colorFormat() == Frame::BGR ? GL_BGR : GL_RGB;
+  }
+  const QSize size = frame->resolution();
+  if(size != texture_size || format != texture_format) {
+    f->glTexImage2D(GL_TEXTURE_2D, 0, format.internal_format, size.width(), size.height(), 0, format.format, format.type, nullptr);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    texture_size = size;
+    texture_format = format;
+  }
+  // Orphan the previous buffer so the driver doesn't stall on a transfer still in flight
+  const int row_bytes = mat.cols * mat.elemSize();
+  pixel_buffer->bind();
+  pixel_buffer->allocate(row_bytes * mat.rows);
+  auto destination = reinterpret_cast<uint8_t*>(pixel_buffer->map(QOpenGLBuffer::WriteOnly));
+  if(destination) {
+    for(int row = 0; row < mat.rows; row++)
+      memcpy(destination + row * row_bytes, mat.ptr(row), row_bytes);
+    pixel_buffer->unmap();
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    f->glPixelStorei(GL_UNPACK_SWAP_BYTES, swap_bytes ? GL_TRUE : GL_FALSE);
+    f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width(), size.height(), format.format, format.type, nullptr);
+    f->glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+  pixel_buffer->release();
+  frame_uploaded = true;
+}
+
+void GLFrameItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget* widget)
+{
+  if(! d->frame || d->failed)
+    return;
+  d->viewport = qobject_cast<QOpenGLWidget*>(widget);
+  painter->beginNativePainting();
+  GuLinux::Scope end_native_painting{[=]{ painter->endNativePainting(); }};
+  auto context = QOpenGLContext::currentContext();
+  if(! d->initialize(context)) {
+    d->failed = true;
+    emit unsupported();
+    return;
+  }
+  auto f = context->functions();
+  f->glActiveTexture(GL_TEXTURE0);
+  d->upload(f);
+
+  static const QHash<Frame::ColorFormat, QPointF> first_red {
+    {Frame::Bayer_RGGB, {0, 0}},
+    {Frame::Bayer_GRBG, {1, 0}},
+    {Frame::Bayer_GBRG, {0, 1}},
+    {Frame::Bayer_BGGR, {1, 1}},
+  };
+  const auto colorFormat = d->frame->colorFormat();
+  const bool bayer = first_red.contains(colorFormat);
+  const int mode = d->frame->channels() == 3 ? 2 : (bayer && d->debayer ? 1 : 0);
+
+  QMatrix4x4 projection;
+  projection.ortho(0, widget->width(), widget->height(), 0, -1, 1);
+  const QSizeF size = d->frame->resolution();
+  const GLfloat vertices[] = {
+    0, 0,
+    static_cast<GLfloat>(size.width()), 0,
+    0, static_cast<GLfloat>(size.height()),
+    static_cast<GLfloat>(size.width()), static_cast<GLfloat>(size.height()),
+  };
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+  d->program->bind();
+  d->program->setUniformValue("mvp", projection * QMatrix4x4{painter->combinedTransform()});
+  d->program->setUniformValue("frame", 0);
+  d->program->setUniformValue("size", size);
+  d->program->setUniformValue("mode", mode);
+  d->program->setUniformValue("first_red", bayer ? first_red[colorFormat] : QPointF{});
+  d->program->setUniformValue("black", d->black);
+  d->program->setUniformValue("white", d->white);
+  d->program->setUniformValue("edges", static_cast<GLint>(d->edges));
+  d->program->setUniformValue("saturate", static_cast<GLint>(d->saturate));
+  d->program->enableAttributeArray("position");
+  d->program->setAttributeArray("position", vertices, 2);
+  f->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  d->program->disableAttributeArray("position");
+  d->program->release();
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFRAMEITEM_H
+#define GLFRAMEITEM_H
+
+#include <QGraphicsObject>
+#include "dptr.h"
+#include "commons/frame.h"
+
+/**
+ * Scene item drawing raw frames with OpenGL, for views using a QOpenGLWidget viewport.
+ * Mono, bayer and colour frames (8 or 16 bit) are uploaded as they are through a pixel buffer object;
+ * debayering, stretching, saturation and edge detection are done in the fragment shader,
+ * and zooming is just the view transform applied to the textured quad.
+ */
+class GLFrameItem : public QGraphicsObject
+{
+  Q_OBJECT
+public:
+  GLFrameItem(QGraphicsItem *parent = nullptr);
+  ~GLFrameItem();
+  QRectF boundingRect() const override;
+  void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+public slots:
+  void setFrame(const FrameConstPtr &frame);
+  void setDebayer(bool debayer);
+  void setEdgeDetection(bool enable);
+  /// Linear stretch between the darkest and brightest pixel of each frame
+  void setStretch(bool enable);
+  void setMaximumSaturation(bool enable);
+signals:
+  /// The viewport has no usable desktop OpenGL context: frames can't be drawn by this item
+  void unsupported();
+private:
+  DPTR
+};
+
+#endif // GLFRAMEITEM_H
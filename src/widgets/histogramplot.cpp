@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "histogramplot.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+const int border = 15;
+const QMap<Histogram::Channel, QColor> colors {
+  {Histogram::Grayscale, Qt::white},
+  {Histogram::Red, Qt::red},
+  {Histogram::Green, Qt::green},
+  {Histogram::Blue, Qt::blue},
+};
+}
+
+HistogramPlot::HistogramPlot(QWidget *parent) : QWidget{parent}
+{
+  setMinimumSize(400, 300);
+  setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+  setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void HistogramPlot::setBins(const QMap<Histogram::Channel, QVector<float>> &bins)
+{
+  this->bins = bins;
+  update();
+}
+
+void HistogramPlot::paintEvent(QPaintEvent *)
+{
+  QPainter painter{this};
+  painter.fillRect(rect(), Qt::black);
+  const QRectF plot = QRectF{rect()}.adjusted(border, border, -border, -border);
+  painter.setPen(Qt::white);
+  painter.drawLine(plot.bottomLeft(), plot.bottomRight());
+  if(bins.isEmpty() || plot.width() <= 0 || plot.height() <= 0)
+    return;
+
+  // All channels on the same scale, as they come from the same pixels
+  float top = 0;
+  for(const auto &channel: bins)
+    for(auto value: channel)
+      top = max(top, value);
+  if(top <= 0)
+    return;
+
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setCompositionMode(QPainter::CompositionMode_Plus);
+  painter.setPen(Qt::NoPen);
+  for(auto channel = bins.begin(); channel != bins.end(); ++channel) {
+    const auto &values = channel.value();
+    const double bin_width = plot.width() / values.size();
+    // Steps rather than a polyline, so that each bin reads as a bar of its own
+    QPainterPath path{plot.bottomLeft()};
+    for(int bin = 0; bin < values.size(); bin++) {
+      const double y = plot.bottom() - plot.height() * values[bin] / top;
+      path.lineTo(plot.left() + bin * bin_width, y);
+      path.lineTo(plot.left() + (bin + 1) * bin_width, y);
+    }
+    path.lineTo(plot.bottomRight());
+    path.closeSubpath();
+    painter.setBrush(colors.value(channel.key(), Qt::white));
+    painter.drawPath(path);
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTOGRAMPLOT_H
+#define HISTOGRAMPLOT_H
+
+#include <QWidget>
+#include <QMap>
+#include <QVector>
+#include "image_handlers/frontend/histogram.h"
+
+/// Histogram bins painted as filled paths at the widget size: colour channels are added up, so that overlaps show as mixed colours
+class HistogramPlot : public QWidget
+{
+  Q_OBJECT
+public:
+  HistogramPlot(QWidget *parent = nullptr);
+  void setBins(const QMap<Histogram::Channel, QVector<float>> &bins);
+protected:
+  void paintEvent(QPaintEvent *event) override;
+private:
+  QMap<Histogram::Channel, QVector<float>> bins;
+};
+
+#endif // HISTOGRAMPLOT_H
@@ -21,8 +21,8 @@
 #include "commons/configuration.h"
 #include "Qt/qt_functional.h"
 #include <QMap>
-#include <opencv2/opencv.hpp>
 #include "histogramstatswidget.h"
+#include "histogramplot.h"
 #include "image_handlers/frontend/histogram.h"
 
 using namespace std;
@@ -33,7 +33,8 @@ DPTR_IMPL(HistogramWidget) {
   Configuration  &configuration;
   HistogramWidget *q;
   std::unique_ptr<Ui::HistogramWidget> ui;
-  void got_histogram(const QImage& histogram, const QMap<Histogram::Channel, QVariantMap> &stats, Histogram::Channel channel);
+  HistogramPlot *plot;
+  void got_histogram(const QMap<Histogram::Channel, QVector<float>> &bins, const QMap<Histogram::Channel, QVariantMap> &stats, Histogram::Channel channel);
   void toggle_histogram_logarithmic(bool logarithmic);
   QMap<Histogram::Channel, int> channel_combo_indexes;
   QList<shared_ptr<HistogramStatsWidget>> statsWidgets;
@@ -53,6 +54,7 @@ HistogramWidget::HistogramWidget(const HistogramPtr &histogram, Configuration &c
     };
     d->ui.reset(new Ui::HistogramWidget);
     d->ui->setupUi(this);
+    d->ui->verticalLayout_2->insertWidget(0, d->plot = new HistogramPlot, 1);
     d->ui->histogram_bins->setValue(d->configuration.histogram_bins());
     
     auto update_bins = [&]{
@@ -77,10 +79,10 @@ void HistogramWidget::Private::toggle_histogram_logarithmic(bool logarithmic)
 }
 
 
-void HistogramWidget::Private::got_histogram(const QImage& histogram, const QMap<Histogram::Channel, QVariantMap>& stats, Histogram::Channel channel)
+void HistogramWidget::Private::got_histogram(const QMap<Histogram::Channel, QVector<float>> &bins, const QMap<Histogram::Channel, QVariantMap>& stats, Histogram::Channel channel)
 {
   ui->channel->setCurrentIndex(channel_combo_indexes[channel]);
-  ui->histogram_plot->setPixmap(QPixmap::fromImage(histogram));
+  plot->setBins(bins);
   statsWidgets.clear();
   for(auto channel: stats.keys()) {
     auto widget = make_shared<HistogramStatsWidget>(channel, stats[channel], ui->statsWidget);
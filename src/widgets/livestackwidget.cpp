@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "livestackwidget.h"
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include "Qt/zoomableimage.h"
+#include "image_handlers/frontend/displayimage.h"
+#include "image_handlers/frontend/livestacker.h"
+#include "image_handlers/frontend/displaysurface.h"
+#include "widgets/displaysurfaceitem.h"
+
+using namespace std;
+
+DPTR_IMPL(LiveStackWidget) {
+  LiveStackerPtr stacker;
+  DisplayImagePtr display;
+  LiveStackWidget *q;
+  ZoomableImage *image;
+  QLabel *status;
+  DisplaySurfaceItem *surface_item;
+  QSize frame_size;
+};
+
+LiveStackWidget::~LiveStackWidget()
+{
+}
+
+LiveStackWidget::LiveStackWidget(const LiveStackerPtr &stacker, const DisplayImagePtr &display, QWidget* parent) : QWidget(parent), dptr(stacker, display, this)
+{
+  auto layout = new QVBoxLayout(this);
+  auto controls = new QHBoxLayout;
+  auto enable = new QCheckBox(tr("Stack"));
+  auto reset = new QPushButton(tr("Reset"));
+  controls->addWidget(enable);
+  controls->addWidget(reset);
+  controls->addWidget(d->status = new QLabel, 1);
+  layout->addLayout(controls);
+  layout->addWidget(d->image = new ZoomableImage(false), 1);
+  d->image->scene()->addItem(d->surface_item = new DisplaySurfaceItem{d->display->surface()});
+
+  connect(enable, &QCheckBox::toggled, d->stacker.get(), &LiveStacker::setEnabled);
+  connect(reset, &QPushButton::clicked, d->stacker.get(), &LiveStacker::reset);
+  connect(d->stacker.get(), &LiveStacker::stacked, this, [this](int frames, int rejected) {
+    d->status->setText(tr("%1 frames stacked, %2 rejected").arg(frames).arg(rejected));
+  }, Qt::QueuedConnection);
+  connect(d->display.get(), &DisplayImage::imageReady, this, [this] {
+    if(d->surface_item->swap() && d->display->surface()->front().frameSize != d->frame_size) {
+      // Transparent, only there for the zoom and the scene rect: the item paints the stacked images
+      d->frame_size = d->display->surface()->front().frameSize;
+      QImage placeholder{d->frame_size, QImage::Format_ARGB32};
+      placeholder.fill(Qt::transparent);
+      d->image->setImage(placeholder);
+      d->surface_item->setTransform(d->image->getImgTransform());
+    }
+    d->display->imageShown();
+  }, Qt::QueuedConnection);
+}
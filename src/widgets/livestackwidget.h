@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIVESTACKWIDGET_H
+#define LIVESTACKWIDGET_H
+
+#include <QWidget>
+#include "c++/dptr.h"
+#include "commons/fwd.h"
+
+FWD_PTR(LiveStacker)
+FWD_PTR(DisplayImage)
+
+/// Live stacking controls, and the stacked image as rendered by its own DisplayImage
+class LiveStackWidget : public QWidget
+{
+    Q_OBJECT
+public:
+~LiveStackWidget();
+LiveStackWidget(const LiveStackerPtr &stacker, const DisplayImagePtr &display, QWidget* parent = 0);
+
+private:
+    DPTR
+};
+
+#endif // LIVESTACKWIDGET_H
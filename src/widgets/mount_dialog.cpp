@@ -16,7 +16,9 @@
  *
  */
 
+#include <functional>
 #include <memory>
+#include <QDebug>
 
 #include "mount/mount.h"
 #include "mount_dialog.h"
@@ -31,20 +33,20 @@ DPTR_IMPL(MountDialog) {
 
     void setupIndiTab();
     void setupSWTab();
+    void connectToMount();
 };
 
 void MountDialog::Private::setupIndiTab()
 {
     connect(ui->btnScan, &QPushButton::clicked, q, [this](bool checked)
         {
-            const auto devices = Mount::getIndiDevices("test", 0);
-            if (!devices.empty())
-            {
-                indiMountsFound = true;
-                ui->indiDevices->clear();
-                for (const auto &dev: devices)
-                    ui->indiDevices->addItem(dev.c_str());
-            }
+            const auto devices = Mount::getIndiDevices(ui->lineEdit->text().toLocal8Bit().constData(), ui->lineEdit_2->text().toUInt());
+            indiMountsFound = !devices.empty();
+            ui->indiDevices->clear();
+            for (const auto &dev: devices)
+                ui->indiDevices->addItem(dev.c_str());
+            if (!indiMountsFound)
+                qWarning() << "No INDI devices accepting guide pulses found";
         });
 }
 
@@ -52,6 +54,19 @@ void MountDialog::Private::setupSWTab()
 {
 }
 
+void MountDialog::Private::connectToMount()
+{
+    if (ui->tabWidget->currentWidget() != ui->tabIndi || !indiMountsFound)
+    {
+        qWarning() << "No mount selected";
+        return;
+    }
+    const auto mount = Mount::connectIndiMount(ui->lineEdit->text().toLocal8Bit().constData(), ui->lineEdit_2->text().toUInt(),
+                                               ui->indiDevices->currentText().toStdString());
+    emit q->mountConnected(mount);
+    q->accept();
+}
+
 MountDialog::~MountDialog()
 {
 }
@@ -69,4 +84,7 @@ MountDialog::MountDialog(QWidget *parent): QDialog(parent), dptr(this)
 
     d->setupIndiTab();
     d->setupSWTab();
+
+    connect(d->ui->buttonBox, &QDialogButtonBox::accepted, this, std::bind(&Private::connectToMount, d.get()));
+    connect(d->ui->buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
 }
@@ -22,6 +22,7 @@
 #include <QDialog>
 #include "dptr.h"
 #include "commons/configuration.h"
+#include "mount/mount.h"
 
 class MountDialog: public QDialog
 {
@@ -31,6 +32,10 @@ public:
     MountDialog(QWidget* parent = nullptr);
     ~MountDialog();
 
+signals:
+    /// Emitted on acceptance, while the connection to the selected mount goes on in the background
+    void mountConnected(const Mount::MountConnection::ptr &mount);
+
 private:
   DPTR
 };
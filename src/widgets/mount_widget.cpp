@@ -19,25 +19,76 @@
 
 #include <mount_widget.h>
 #include <functional>
+#include <map>
 #include <memory>
 #include <QDebug>
+#include <QPointer>
+#include <QSignalBlocker>
+#include <QTimer>
 
+#include "commons/tracking.h"
+#include "drivers/imager.h"
+#include "mount/guiding.h"
+#include "mount/mount.h"
 #include "mount_dialog.h"
 #include "ui_mountwidget.h"
 
+namespace
+{
+
+/// Pulses through the camera guide port (see Imager::guidePulse), on the imager thread: connected as long as the camera is, with no position
+class CameraGuidePort: public Mount::MountConnection
+{
+public:
+    CameraGuidePort(Imager *imager): imager{imager} {}
+
+    void pulse(Mount::GuideDirection direction, std::chrono::milliseconds duration) override
+    {
+        static const std::map<Mount::GuideDirection, ImagerThread::GuideDirection> directions {
+            { Mount::GuideDirection::North, ImagerThread::GuideDirection::North },
+            { Mount::GuideDirection::South, ImagerThread::GuideDirection::South },
+            { Mount::GuideDirection::East, ImagerThread::GuideDirection::East },
+            { Mount::GuideDirection::West, ImagerThread::GuideDirection::West },
+        };
+        if (imager)
+            imager->guidePulse(directions.at(direction), duration);
+    }
+
+    Mount::MountStatus status() const override
+    {
+        Mount::MountStatus status;
+        status.connection = imager ? Mount::MountStatus::Connection::Connected : Mount::MountStatus::Connection::Failed;
+        return status;
+    }
+
+private:
+    const QPointer<Imager> imager;
+};
+
+} // namespace
 
 DPTR_IMPL(MountWidget)
 {
+    const std::shared_ptr<ImgTracker> tracker;
+    MountWidget *q;
     std::unique_ptr<Ui::MountWidget> ui;
 
     MountDialog *mountDialog;
+    Mount::MountConnection::ptr mount;
+    QPointer<Imager> imager;
+    Mount::Guiding *guiding = nullptr;
+    QTimer *statusTimer;
+
+    void connected(const Mount::MountConnection::ptr &mount);
+    void guidingStateChanged(Mount::Guiding::State state);
+    void showStatus();
 };
 
 MountWidget::~MountWidget()
 {
 }
 
-MountWidget::MountWidget(QWidget *parent): QWidget(parent), dptr()
+MountWidget::MountWidget(const std::shared_ptr<ImgTracker> &tracker, QWidget *parent): QWidget(parent), dptr(tracker, this)
 {
     d->ui.reset(new Ui::MountWidget);
     d->ui->setupUi(this);
@@ -46,4 +97,85 @@ MountWidget::MountWidget(QWidget *parent): QWidget(parent), dptr()
 
     d->mountDialog = new MountDialog(this);
     connect(d->ui->btnConnect, &QPushButton::clicked, this, std::bind(&QDialog::open, d->mountDialog));
+    connect(d->mountDialog, &MountDialog::mountConnected, this, std::bind(&Private::connected, d.get(), std::placeholders::_1));
+    // No mount round trip: the corrections measured on a frame reach the guide port before the next frame
+    connect(d->ui->btnCameraGuidePort, &QPushButton::clicked, this, [this] {
+        if (d->imager)
+            d->connected(std::make_shared<CameraGuidePort>(d->imager));
+    });
+    // Reads the locally cached mount status only: a slow or unreachable INDI server never stalls the GUI
+    d->statusTimer = new QTimer(this);
+    d->statusTimer->setInterval(500);
+    connect(d->statusTimer, &QTimer::timeout, this, std::bind(&Private::showStatus, d.get()));
+    connect(d->ui->btnCalibrate, &QPushButton::clicked, this, [this] {
+        if (d->guiding->state() == Mount::Guiding::State::Calibrating)
+            d->guiding->stop();
+        else
+            d->guiding->calibrate();
+    });
+    connect(d->ui->btnGuide, &QPushButton::toggled, this, [this](bool checked) {
+        if (checked)
+            d->guiding->startGuiding();
+        else
+            d->guiding->stop();
+    });
+}
+
+void MountWidget::setImager(Imager *imager)
+{
+    d->imager = imager;
+    d->ui->btnCameraGuidePort->setEnabled(imager && imager->supports(Imager::GuidePort));
+}
+
+void MountWidget::Private::connected(const Mount::MountConnection::ptr &mount)
+{
+    delete guiding;
+    this->mount = mount;
+    guiding = new Mount::Guiding{ mount, q };
+    QObject::connect(tracker.get(), &ImgTracker::trackingPositionChanged, guiding, &Mount::Guiding::trackingPositionChanged, Qt::QueuedConnection);
+    QObject::connect(guiding, &Mount::Guiding::stateChanged, q, std::bind(&Private::guidingStateChanged, this, std::placeholders::_1));
+    QObject::connect(guiding, &Mount::Guiding::calibrationFailed, q, [this] { ui->info->setText(MountWidget::tr("Status: guiding calibration failed")); });
+    guidingStateChanged(guiding->state());
+    statusTimer->start();
+    showStatus();
+}
+
+void MountWidget::Private::showStatus()
+{
+    const auto status = mount->status();
+    if (status.connection == Mount::MountStatus::Connection::Failed)
+    {
+        ui->info->setText(std::dynamic_pointer_cast<CameraGuidePort>(mount) ? MountWidget::tr("Status: camera disconnected") : MountWidget::tr("Status: cannot connect to the mount"));
+        ui->position->setText(MountWidget::tr("RA: -, DEC: -"));
+        return;
+    }
+    if (!status.position_known)
+    {
+        ui->position->setText(MountWidget::tr("RA: -, DEC: -"));
+        return;
+    }
+    const QString position = MountWidget::tr("RA: %1h, DEC: %2°").arg(status.ra, 0, 'f', 4).arg(status.dec, 0, 'f', 3);
+    ui->position->setText(status.slewing ? MountWidget::tr("%1 (slewing)").arg(position) : position);
+    // Corrections measured while the mount slews to another target would fight the slew
+    if (status.slewing && guiding->state() == Mount::Guiding::State::Guiding)
+    {
+        guiding->stop();
+        ui->info->setText(MountWidget::tr("Status: guiding stopped, the mount is slewing"));
+    }
+}
+
+void MountWidget::Private::guidingStateChanged(Mount::Guiding::State state)
+{
+    static const std::map<Mount::Guiding::State, QString> status {
+        { Mount::Guiding::State::Idle, MountWidget::tr("Status: connected") },
+        { Mount::Guiding::State::Calibrating, MountWidget::tr("Status: calibrating guiding") },
+        { Mount::Guiding::State::Calibrated, MountWidget::tr("Status: calibrated") },
+        { Mount::Guiding::State::Guiding, MountWidget::tr("Status: guiding") },
+    };
+    ui->info->setText(status.at(state));
+    ui->btnCalibrate->setEnabled(state != Mount::Guiding::State::Guiding);
+    ui->btnCalibrate->setText(state == Mount::Guiding::State::Calibrating ? MountWidget::tr("Stop calibration") : MountWidget::tr("Calibrate guiding"));
+    ui->btnGuide->setEnabled(state == Mount::Guiding::State::Calibrated || state == Mount::Guiding::State::Guiding);
+    QSignalBlocker block(ui->btnGuide);
+    ui->btnGuide->setChecked(state == Mount::Guiding::State::Guiding);
 }
@@ -20,16 +20,23 @@
 #ifndef MOUNTWIDGET_H
 #define MOUNTWIDGET_H
 
+#include <memory>
 #include <QWidget>
 #include "c++/dptr.h"
 
+class ImgTracker;
+class Imager;
+
 
 class MountWidget: public QWidget
 {
     Q_OBJECT
 public:
-    MountWidget(QWidget *parent = nullptr);
+    /// Guiding follows the positions reported by 'tracker'
+    MountWidget(const std::shared_ptr<ImgTracker> &tracker, QWidget *parent = nullptr);
     ~MountWidget();
+    /// Camera whose guide port (ST4) can be used instead of a mount connection, when it has one; nullptr when disconnected
+    void setImager(Imager *imager);
 private:
     DPTR;
 };
@@ -22,6 +22,7 @@
 #include "savefileconfiguration.h"
 #include "commons/messageslogger.h"
 #include "Qt/qt_functional.h"
+#include "Qt/qt_strings_helper.h"
 #include <QAction>
 #include <QDir>
 #include <QDialog>
@@ -34,6 +35,9 @@
 #include "commons/elapsedtimer.h"
 #include "commons/filesystembrowser.h"
 #include "c++/stlutils.h"
+#include "commons/definitions.h"
+#include "commons/storageprobe.h"
+#include "commons/loadshedding.h"
 
 using namespace std;
 
@@ -55,6 +59,14 @@ vector<Configuration::SaveFormat> RecordingPanel::Private::format_combo_index =
   Configuration::Video,
   Configuration::PNG,
   Configuration::FITS,
+  Configuration::TIFF,
+#if HAVE_LIBAV
+  Configuration::FFmpegVideo,
+#endif
+#if HAVE_ZSTD
+  Configuration::CompressedSER,
+#endif
+  Configuration::FITSCube,
 };
 
 RecordingPanel::~RecordingPanel()
@@ -66,6 +78,13 @@ RecordingPanel::RecordingPanel(Configuration &configuration, const FilesystemBro
 {
   d->ui = make_unique<Ui::RecordingPanel>();
   d->ui->setupUi(this);
+#if HAVE_LIBAV
+  d->ui->videoOutputType->addItem(tr("Video File (FFmpeg)"));
+#endif
+#if HAVE_ZSTD
+  d->ui->videoOutputType->addItem(tr("Compressed SER"));
+#endif
+  d->ui->videoOutputType->addItem(tr("FITS Cube"));
   d->recording_elapsed_timer = make_unique<QTimer>();
   connect(d->recording_elapsed_timer.get(), &QTimer::timeout, this, [this]{
     d->ui->elapsed->setText(QTime{0,0,0}.addMSecs(d->recording_elapsed.milliseconds()).toString());
@@ -143,9 +162,15 @@ The best file format for planetary imaging is SER. You can also save frames as P
   connect(d->ui->start_recording, &QPushButton::clicked, this, &RecordingPanel::start);
   connect(d->ui->stop_recording, &QPushButton::clicked, this, &RecordingPanel::stop);
   connect(d->ui->pause_recording, &QPushButton::toggled, this, &RecordingPanel::setPaused);
+  connect(d->ui->trigger_recording, &QPushButton::clicked, this, &RecordingPanel::trigger);
+  connect(d->ui->probe_storage, &QPushButton::clicked, this, [this] {
+    d->ui->probe_storage->setEnabled(false);
+    d->ui->storage_probe->setText(tr("checking..."));
+    emit probeStorage();
+  });
   connect(this, &RecordingPanel::setPaused, this, [=, &configuration](bool paused) {
     d->ui->pause_recording->setIcon(QIcon{paused ? ":/resources/play.png" : ":/resources/pause.png"});
-    if(configuration.recording_pause_stops_timer()) {
+    if(configuration.snapshot()->recording_pause_stops_timer) {
       if(paused)
         d->recording_elapsed.pause();
       else
@@ -174,6 +199,9 @@ The best file format for planetary imaging is SER. You can also save frames as P
   connect(d->ui->timelapse_duration, &QTimeEdit::timeChanged, this, [=, &configuration](const QTime &time) {
     configuration.set_timelapse_msecs(QTime{0,0,0}.msecsTo(time));
   });
+  connect(d->ui->timelapse_pause_capture, &QCheckBox::toggled, this, [=, &configuration](bool checked) {
+    configuration.set_timelapse_pause_capture(checked);
+  });
 
   d->reload_config();
   connect(&configuration, &Configuration::settings_changed, this, bind(&Private::reload_config, d.get()));
@@ -186,6 +214,7 @@ void RecordingPanel::Private::reload_config()
   
   ui->timelapse->setChecked(configuration.timelapse_mode());
   ui->timelapse_duration->setTime(QTime{0,0,0}.addMSecs(configuration.timelapse_msecs()));
+  ui->timelapse_pause_capture->setChecked(configuration.timelapse_pause_capture());
   ui->saveDirectory->setText(configuration.save_directory());
   ui->duration_limit->setValue(configuration.recording_seconds_limit());
   ui->saveFramesLimit->setCurrentText(QString::number(configuration.recording_frames_limit()));
@@ -212,9 +241,14 @@ void RecordingPanel::recording(bool recording, const QString& filename)
   saveFPS(0);
   dropped(0);
   d->ui->recordingBox->setVisible(recording);
-  d->ui->filename->setText(filename);
+  // Pre-trigger recordings go back to an empty filename while waiting for the next trigger
+  d->ui->filename->setText(recording && filename.isEmpty() ? tr("waiting for trigger") : filename);
+  d->ui->trigger_recording->setVisible(recording && d->configuration.recording_pretrigger());
+  d->ui->deferred_writes->hide();
+  d->ui->load_shedding->hide();
   d->ui->recordingButtons->setCurrentIndex(recording ? 1 : 0);
-  for(auto widget: QList<QWidget*>{d->ui->saveDirectory, d->ui->filePrefix, d->ui->fileSuffix, d->ui->saveFramesLimit})
+  // The disk check would compete with the recording for the disk, and measure neither
+  for(auto widget: QList<QWidget*>{d->ui->saveDirectory, d->ui->filePrefix, d->ui->fileSuffix, d->ui->saveFramesLimit, d->ui->probe_storage})
     widget->setEnabled(!recording);
   if(recording) {
     d->recording_elapsed.start();
@@ -240,6 +274,60 @@ void RecordingPanel::dropped(long frames)
   d->ui->dropped->setText(QString::number(frames));
 }
 
+void RecordingPanel::queueUsage(qint64 bytes, qint64 peak_bytes, qint64 max_bytes)
+{
+  auto mb = [](qint64 bytes) { return QString::number(static_cast<double>(bytes) / 1024. / 1024., 'f', 1); };
+  d->ui->dropped->setToolTip(tr("Recording queue: %1 MB used, peak %2 MB, limit %3 MB") % mb(bytes) % mb(peak_bytes) % mb(max_bytes));
+}
+
+void RecordingPanel::preTriggerBuffer(qint64 bytes, double seconds)
+{
+  d->ui->filename->setText(tr("waiting for trigger: %1 s buffered, %2 MB") % QString::number(seconds, 'f', 1) % QString::number(static_cast<double>(bytes) / 1024. / 1024., 'f', 1));
+}
+
+void RecordingPanel::deferredWrites(qint64 pending_bytes, qint64 available_bytes)
+{
+  const int pending_mb = pending_bytes / 1024 / 1024;
+  const int available_mb = available_bytes / 1024 / 1024;
+  d->ui->deferred_writes->show();
+  d->ui->deferred_writes->setMaximum(max(1, pending_mb + available_mb));
+  d->ui->deferred_writes->setValue(pending_mb);
+  d->ui->deferred_writes->setFormat(tr("%1 MB to write, %2 MB free") % QString::number(pending_mb) % QString::number(available_mb));
+}
+
+void RecordingPanel::loadShedding(int level)
+{
+  static const QMap<int, QString> steps{
+    {LoadShedding::NoPreviews, tr("previews stopped")},
+    {LoadShedding::SlowDisplay, tr("previews stopped, display slowed down")},
+    {LoadShedding::NoDisplay, tr("previews and display stopped")},
+  };
+  d->ui->load_shedding->setVisible(steps.contains(level));
+  d->ui->load_shedding->setText(tr("Writer falling behind: %1") % steps.value(level));
+}
+
+void RecordingPanel::storageProbed(double bytes_per_second, double latency_p99_ms, double capture_fps, qint64 frame_bytes)
+{
+  d->ui->probe_storage->setEnabled(! d->recording);
+  if(bytes_per_second <= 0) {
+    d->ui->storage_probe->setText(tr("unable to write to the save directory"));
+    return;
+  }
+  auto mb = [](double bytes) { return QString::number(bytes / 1024. / 1024., 'f', 1); };
+  auto measured = tr("%1 MB/s, 99% of writes within %2 ms") % mb(bytes_per_second) % QString::number(latency_p99_ms, 'f', 1);
+  StorageProbe::Result probe;
+  probe.bytes_per_second = bytes_per_second;
+  const double required = StorageProbe::required_bytes_per_second(capture_fps, frame_bytes);
+  if(required <= 0)
+    d->ui->storage_probe->setText(measured);
+  else if(StorageProbe::sustains(probe, required))
+    d->ui->storage_probe->setText(tr("%1: enough for the %2 MB/s of the camera") % measured % mb(required));
+  else
+    d->ui->storage_probe->setText(tr("<font color='red'>%1: too slow for the %2 MB/s of the camera, it keeps up with up to %3 fps at this frame size. "
+                                     "Consider a smaller ROI, a lower bit depth, or burst to RAM.</font>")
+      % measured % mb(required) % QString::number(StorageProbe::sustained_fps(probe, frame_bytes), 'f', 1));
+}
+
 void RecordingPanel::saved(long frames)
 {
   d->ui->frames->setText(QString::number(frames));
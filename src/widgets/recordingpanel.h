@@ -39,10 +39,18 @@ public slots:
   void meanFPS(double fps);
   void saved(long frames);
   void dropped(long frames);
+  void queueUsage(qint64 bytes, qint64 peak_bytes, qint64 max_bytes);
+  void preTriggerBuffer(qint64 bytes, double seconds);
+  void deferredWrites(qint64 pending_bytes, qint64 available_bytes);
+  void storageProbed(double bytes_per_second, double latency_p99_ms, double capture_fps, qint64 frame_bytes);
+  /// A LoadShedding::Level
+  void loadShedding(int level);
 signals:
   void start();
   void stop();
   void setPaused(bool);
+  void trigger();
+  void probeStorage();
 private:
   DPTR;
 };
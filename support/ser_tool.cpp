@@ -0,0 +1,653 @@
+/*
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * SER post-processing: frames extraction and quality based culling, on plain (.ser) and compressed (.zser) files, merging of striped recordings,
+ * recovery of recordings that were never closed, verification against the frame hashes side-car, and export to FITS, PNG and TIFF files
+ * or a FITS cube through the recording writers.
+ * Selections are handled as spans of consecutive frames, copied in kernel (copy_file_range) where available, or between
+ * memory mappings otherwise, together with their timestamps.
+ */
+
+#include "commons/ser_header.h"
+#include "commons/compressedser.h"
+#include "commons/frame.h"
+#include "commons/frame_quality.h"
+#include "commons/crc32c.h"
+#include "commons/configuration.h"
+#include "commons/definitions.h"
+#include "commons/modules.h"
+#include "image_handlers/saveimages.h"
+#include "image_handlers/output_writers/filewriter.h"
+#include "Qt/qt_strings_helper.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QtConcurrent/QtConcurrent>
+#include <QThread>
+#include <QAtomicInteger>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace std;
+
+namespace {
+/// Consecutive frames, 0 based and inclusive
+struct Span {
+  qint64 first, last;
+  qint64 size() const { return last - first + 1; }
+};
+typedef vector<Span> Spans;
+
+int fail(const QString &message) {
+  QTextStream(stderr) << message << endl;
+  return 1;
+}
+
+/// Sorts spans, merging the overlapping and adjacent ones
+Spans coalesce(Spans spans) {
+  sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.first < b.first; });
+  Spans merged;
+  for(const auto &span: spans) {
+    if(! merged.empty() && span.first <= merged.back().last + 1)
+      merged.back().last = max(merged.back().last, span.last);
+    else
+      merged.push_back(span);
+  }
+  return merged;
+}
+
+Spans spans_of(const vector<bool> &keep) {
+  Spans spans;
+  for(qint64 frame = 0; frame < static_cast<qint64>(keep.size()); frame++) {
+    if(! keep[frame])
+      continue;
+    if(! spans.empty() && spans.back().last == frame - 1)
+      spans.back().last = frame;
+    else
+      spans.push_back({frame, frame});
+  }
+  return spans;
+}
+
+qint64 frames_count(const Spans &spans) {
+  return accumulate(spans.begin(), spans.end(), qint64{0}, [](qint64 total, const Span &span) { return total + span.size(); });
+}
+
+/// Parses frame numbers ("N") and ranges ("A-B"), 1 based as shown by SER players, limited to the frames available
+bool parse_frames(const QStringList &arguments, qint64 frames, Spans &spans, QString &error) {
+  static const QRegularExpression selection{"^(\\d+)(?:-(\\d+))?$"};
+  for(const auto &argument: arguments) {
+    auto match = selection.match(argument);
+    if(! match.hasMatch()) {
+      error = "Invalid frames selection: %1"_q % argument;
+      return false;
+    }
+    const qint64 first = match.captured(1).toLongLong();
+    const qint64 last = match.captured(2).isEmpty() ? first : match.captured(2).toLongLong();
+    if(first < 1 || last < first || first > frames) {
+      error = "Invalid frames selection: %1 (file has %2 frames)"_q % argument % frames;
+      return false;
+    }
+    spans.push_back({first - 1, min(last, frames) - 1});
+  }
+  spans = coalesce(spans);
+  return true;
+}
+
+struct Input {
+  QFile file;
+  SER_Header header;
+  /// Whole file, for plain SER files
+  const uchar *mapped = nullptr;
+  unique_ptr<CompressedSERReader> compressed;
+  vector<SER_Timestamp> compressed_timestamps;
+  /// Recovered recordings: timestamps from the journal, the trailer was never written
+  vector<SER_Timestamp> journal_timestamps;
+  bool has_timestamps = false;
+
+  qint64 frame_size() const { return header.frame_size(); }
+  qint64 frame_offset(qint64 frame) const { return sizeof(SER_Header) + frame * frame_size(); }
+  const char *timestamps(qint64 frame) const {
+    if(compressed)
+      return reinterpret_cast<const char*>(compressed_timestamps.data() + frame);
+    if(! journal_timestamps.empty())
+      return reinterpret_cast<const char*>(journal_timestamps.data() + frame);
+    return reinterpret_cast<const char*>(mapped + frame_offset(header.frames) + frame * sizeof(SER_Timestamp));
+  }
+
+  bool open(const QString &filename, QString &error, bool recover = false) {
+    if(CompressedSERReader::is_compressed(filename)) {
+      compressed = make_unique<CompressedSERReader>(filename);
+      if(! compressed->isOpen()) {
+        error = "Unable to open compressed input file %1: %2"_q % filename % compressed->errorString();
+        return false;
+      }
+      header = compressed->header();
+      compressed_timestamps = compressed->timestamps();
+      has_timestamps = compressed_timestamps.size() == header.frames;
+      return true;
+    }
+    file.setFileName(filename);
+    if(! file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(SER_Header))) {
+      error = "Unable to open input file %1: %2"_q % filename % file.errorString();
+      return false;
+    }
+    mapped = file.map(0, file.size());
+    if(! mapped) {
+      error = "Unable to map input file %1: %2"_q % filename % file.errorString();
+      return false;
+    }
+    memcpy(&header, mapped, sizeof(header));
+    if(recover)
+      return this->recover(filename, error);
+    if(header.frames <= 0 || file.size() < frame_offset(header.frames)) {
+      error = "Invalid SER file %1: %2 frames declared, file size is %3"_q % filename % header.frames % file.size();
+      return false;
+    }
+    has_timestamps = file.size() == frame_offset(header.frames) + static_cast<qint64>(sizeof(SER_Timestamp)) * header.frames;
+    return true;
+  }
+
+  /**
+   * Recording interrupted by a crash or power loss: SERWriter checkpoints the header frames count and the timestamps
+   * journal (<file>.timestamps) every few seconds, after syncing the frames. Frames found in the file but past the last
+   * checkpoint are kept too, as long as the journal has their timestamps.
+   */
+  bool recover(const QString &filename, QString &error) {
+    if(header.imageWidth <= 0 || header.imageHeight <= 0 || frame_size() <= 0) {
+      error = "Unable to recover %1: no frame format in the header, the recording ended before its first checkpoint"_q % filename;
+      return false;
+    }
+    QFile journal{filename + ".timestamps"};
+    if(journal.open(QIODevice::ReadOnly)) {
+      const auto data = journal.readAll();
+      journal_timestamps.resize(data.size() / sizeof(SER_Timestamp));
+      memcpy(journal_timestamps.data(), data.constData(), journal_timestamps.size() * sizeof(SER_Timestamp));
+    }
+    const qint64 in_file = (file.size() - static_cast<qint64>(sizeof(SER_Header))) / frame_size();
+    header.frames = min(in_file, max<qint64>(header.frames, journal_timestamps.size()));
+    if(header.frames <= 0) {
+      error = "Unable to recover %1: no frames were checkpointed"_q % filename;
+      return false;
+    }
+    // A closed file has its trailer, and no journal anymore
+    if(journal_timestamps.empty())
+      has_timestamps = file.size() >= frame_offset(header.frames) + static_cast<qint64>(sizeof(SER_Timestamp)) * header.frames;
+    else
+      has_timestamps = static_cast<qint64>(journal_timestamps.size()) >= header.frames;
+    if(! has_timestamps)
+      journal_timestamps.clear();
+    return true;
+  }
+
+  /// Frame number index; plain SER frames share the mapped pixels
+  FramePtr frame(qint64 index) {
+    // Recorders write the native (little endian) byte order, whatever the header endian field says
+    if(compressed) {
+      auto frame = make_shared<Frame>(header.pixelDepth, header.frame_color_format(), QSize(header.imageWidth, header.imageHeight), Frame::LittleEndian);
+      if(! compressed->read_frame(index, frame->data()))
+        return {};
+      return frame;
+    }
+    const cv::Mat mat(header.imageHeight, header.imageWidth, CV_MAKETYPE(header.pixelDepth <= 8 ? CV_8U : CV_16U, header.channels()), const_cast<uchar*>(mapped + frame_offset(index)));
+    return make_shared<Frame>(header.frame_color_format(), mat, Frame::LittleEndian, Frame::ShareBuffer);
+  }
+};
+
+/// Copies size bytes at source in input to destination in output (mapped at output_data)
+bool copy_range(Input &input, qint64 source, QFile &output, uchar *output_data, qint64 destination, qint64 size) {
+#ifdef Q_OS_LINUX
+  // In kernel copy: pages don't go through user space, and filesystems supporting it share extents instead of copying them
+  static bool copy_file_range_supported = true;
+  if(copy_file_range_supported) {
+    loff_t in = source, out = destination;
+    while(size > 0) {
+      auto copied = copy_file_range(input.file.handle(), &in, output.handle(), &out, size, 0);
+      if(copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+        copy_file_range_supported = false;
+        break;
+      }
+      if(copied <= 0)
+        return false;
+      size -= copied;
+    }
+    source = in;
+    destination = out;
+  }
+#else
+  Q_UNUSED(output)
+#endif
+  memcpy(output_data + destination, input.mapped + source, size);
+  return true;
+}
+
+/// Writes the selected frames to a new SER file, with their timestamps
+int write_output(Input &input, const Spans &spans, const QString &filename) {
+  QFile output{filename};
+  if(output.exists())
+    return fail("Output file %1 already exists"_q % filename);
+  const qint64 frames = frames_count(spans);
+  const qint64 frames_end = sizeof(SER_Header) + frames * input.frame_size();
+  const qint64 size = frames_end + (input.has_timestamps ? frames * static_cast<qint64>(sizeof(SER_Timestamp)) : 0);
+  if(! output.open(QIODevice::ReadWrite) || ! output.resize(size))
+    return fail("Unable to open output file %1 for writing: %2"_q % filename % output.errorString());
+  auto data = output.map(0, size);
+  if(! data)
+    return fail("Unable to map output file %1: %2"_q % filename % output.errorString());
+
+  SER_Header header = input.header;
+  header.frames = frames;
+  memcpy(data, &header, sizeof(header));
+  qint64 written = 0;
+  for(const auto &span: spans) {
+    const qint64 destination = sizeof(SER_Header) + written * input.frame_size();
+    if(input.compressed) {
+      for(auto frame = span.first; frame <= span.last; frame++)
+        if(! input.compressed->read_frame(frame, data + destination + (frame - span.first) * input.frame_size()))
+          return fail("Unable to read frame %1"_q % (frame + 1));
+    } else if(! copy_range(input, input.frame_offset(span.first), output, data, destination, span.size() * input.frame_size())) {
+      return fail("Unable to copy frames %1-%2: %3"_q % (span.first + 1) % (span.last + 1) % strerror(errno));
+    }
+    if(input.has_timestamps)
+      memcpy(data + frames_end + written * sizeof(SER_Timestamp), input.timestamps(span.first), span.size() * sizeof(SER_Timestamp));
+    written += span.size();
+    qDebug() << "written frames" << span.first + 1 << "-" << span.last + 1 << "(" << written << "of" << frames << ")";
+  }
+  if(! input.has_timestamps)
+    qDebug() << "found invalid or not existing footer, skipping";
+  output.unmap(data);
+  return 0;
+}
+
+/// Lucky imaging on recorded files: frames are scored in parallel with the same sharpness measure used while recording
+int cull(Input &input, const QString &output, int percent, int window) {
+  const qint64 frames = input.header.frames;
+  vector<double> scores(frames);
+  if(input.compressed) {
+    // The decompressor isn't thread safe: frames are decoded in order, and sharpness() still spreads each frame on all cores
+    for(qint64 frame = 0; frame < frames; frame++) {
+      auto decoded = input.frame(frame);
+      if(! decoded)
+        return fail("Unable to read frame %1"_q % (frame + 1));
+      scores[frame] = FrameQuality::sharpness(decoded);
+    }
+  } else {
+    // Frames are handed out one at a time, so that reads from the mapping stay roughly sequential
+    QAtomicInteger<qint64> next_frame{0};
+    QList<QFuture<void>> workers;
+    for(int worker = 0; worker < QThread::idealThreadCount(); worker++)
+      workers.append(QtConcurrent::run([&]{
+        for(qint64 frame = next_frame++; frame < frames; frame = next_frame++)
+          scores[frame] = FrameQuality::sharpness(input.frame(frame));
+      }));
+    for(auto &worker: workers)
+      worker.waitForFinished();
+  }
+
+  vector<bool> keep(frames, false);
+  if(window > 0) {
+    // Sliding window, exactly as the recording side selector does
+    FrameQuality::Selector selector{percent, static_cast<size_t>(window)};
+    for(qint64 frame = 0; frame < frames; frame++)
+      keep[frame] = selector.keep(scores[frame]);
+  } else {
+    const qint64 kept = max<qint64>(1, (frames * percent + 99) / 100);
+    vector<qint64> ranked(frames);
+    iota(ranked.begin(), ranked.end(), 0);
+    nth_element(ranked.begin(), ranked.begin() + (kept - 1), ranked.end(), [&](qint64 a, qint64 b) { return scores[a] > scores[b]; });
+    for_each(ranked.begin(), ranked.begin() + kept, [&](qint64 frame) { keep[frame] = true; });
+  }
+  auto spans = spans_of(keep);
+  QTextStream(stdout) << "Keeping " << frames_count(spans) << " of " << frames << " frames, in " << spans.size() << " spans" << endl;
+  return write_output(input, spans, output);
+}
+
+/// Interleaves the records of the stripes metadata side-cars, when all of them have one
+void merge_frames_metadata(const SER_StripesIndex &index, qint64 frames, const QString &filename) {
+  vector<QByteArray> records;
+  const SER_FramesHeader header;
+  for(const auto &stripe: index.stripes) {
+    QFile side_car{stripe + ".frames"};
+    if(! side_car.open(QIODevice::ReadOnly))
+      return;
+    records.push_back(side_car.readAll());
+    SER_FramesHeader stripe_header;
+    if(records.back().size() < static_cast<int>(sizeof(header)))
+      return;
+    memcpy(&stripe_header, records.back().constData(), sizeof(stripe_header));
+    if(memcmp(stripe_header.fileId, header.fileId, sizeof(header.fileId)) || stripe_header.recordSize != header.recordSize)
+      return;
+  }
+  QFile output{filename + ".frames"};
+  if(! output.open(QIODevice::WriteOnly))
+    return;
+  output.write(records.front().constData(), sizeof(header));
+  for(qint64 frame = 0; frame < frames; frame++) {
+    const auto location = index.locate(frame);
+    const qint64 offset = sizeof(header) + location.second * header.recordSize;
+    // Metadata is best effort: a short side-car ends the merged one
+    if(records[location.first].size() < offset + header.recordSize)
+      break;
+    output.write(records[location.first].constData() + offset, header.recordSize);
+  }
+}
+
+/// Joins the stripes of a striped recording (see StripedSERWriter) into a single SER file, with frames and timestamps in recording order
+int merge(const QString &index_file, const QString &filename) {
+  SER_StripesIndex index;
+  QString error;
+  if(! index.load(index_file, error))
+    return fail("Unable to read stripes index %1: %2"_q % index_file % error);
+  vector<unique_ptr<Input>> stripes;
+  // An interrupted recording leaves the stripes a frame apart at most: the merged file stops at the first missing frame
+  qint64 frames = numeric_limits<qint64>::max();
+  bool has_timestamps = true;
+  for(const auto &stripe: index.stripes) {
+    stripes.push_back(make_unique<Input>());
+    auto &input = *stripes.back();
+    if(! input.open(stripe, error))
+      return fail(error);
+    if(input.compressed)
+      return fail("Compressed stripe %1: stripes are plain SER files"_q % stripe);
+    const auto &first = stripes.front()->header;
+    if(input.header.imageWidth != first.imageWidth || input.header.imageHeight != first.imageHeight || input.header.pixelDepth != first.pixelDepth || input.header.colorId != first.colorId)
+      return fail("Stripe %1 has a different frame format"_q % stripe);
+    frames = min(frames, static_cast<qint64>(stripes.size() - 1 + input.header.frames * index.stripes.size()));
+    has_timestamps = has_timestamps && input.has_timestamps;
+  }
+
+  QFile output{filename};
+  if(output.exists())
+    return fail("Output file %1 already exists"_q % filename);
+  const qint64 frame_size = stripes.front()->frame_size();
+  const qint64 frames_end = sizeof(SER_Header) + frames * frame_size;
+  const qint64 size = frames_end + (has_timestamps ? frames * static_cast<qint64>(sizeof(SER_Timestamp)) : 0);
+  if(! output.open(QIODevice::ReadWrite) || ! output.resize(size))
+    return fail("Unable to open output file %1 for writing: %2"_q % filename % output.errorString());
+  auto data = output.map(0, size);
+  if(! data)
+    return fail("Unable to map output file %1: %2"_q % filename % output.errorString());
+
+  SER_Header header = stripes.front()->header;
+  header.frames = frames;
+  memcpy(data, &header, sizeof(header));
+  for(qint64 frame = 0; frame < frames; frame++) {
+    const auto location = index.locate(frame);
+    auto &input = *stripes[location.first];
+    if(! copy_range(input, input.frame_offset(location.second), output, data, sizeof(SER_Header) + frame * frame_size, frame_size))
+      return fail("Unable to copy frame %1: %2"_q % (frame + 1) % strerror(errno));
+    if(has_timestamps)
+      memcpy(data + frames_end + frame * sizeof(SER_Timestamp), input.timestamps(location.second), sizeof(SER_Timestamp));
+  }
+  output.unmap(data);
+  merge_frames_metadata(index, frames, filename);
+  QTextStream(stdout) << "Merged " << frames << " frames from " << stripes.size() << " stripes" << endl;
+  return 0;
+}
+
+/// Checks every frame against its CRC32C in the hashes side-car (see SER_HashesHeader), hashing frames in parallel straight from the mapping
+int verify(Input &input, const QString &filename) {
+  QFile side_car{filename + ".hashes"};
+  if(! side_car.open(QIODevice::ReadOnly))
+    return fail("Unable to open frame hashes %1: %2"_q % side_car.fileName() % side_car.errorString());
+  const auto data = side_car.readAll();
+  const SER_HashesHeader expected_header;
+  SER_HashesHeader header;
+  if(data.size() < static_cast<int>(sizeof(header)))
+    return fail("Invalid frame hashes file %1"_q % side_car.fileName());
+  memcpy(&header, data.constData(), sizeof(header));
+  if(memcmp(header.fileId, expected_header.fileId, sizeof(header.fileId)) || header.algorithm != SER_HashesHeader::CRC32C || header.recordSize != sizeof(quint32))
+    return fail("Unsupported frame hashes file %1"_q % side_car.fileName());
+  const qint64 hashes = (data.size() - sizeof(header)) / sizeof(quint32);
+  const qint64 frames = min<qint64>(input.header.frames, hashes);
+  // Not a vector<bool>, that packs bits: workers write bytes of their own
+  vector<char> results(frames, 0);
+  auto check = [&](qint64 frame, const void *pixels) {
+    quint32 hash;
+    memcpy(&hash, data.constData() + sizeof(header) + frame * sizeof(hash), sizeof(hash));
+    results[frame] = CRC32C::checksum(pixels, input.frame_size()) != qFromLittleEndian(hash);
+  };
+  if(input.compressed) {
+    vector<uchar> pixels(input.frame_size());
+    for(qint64 frame = 0; frame < frames; frame++) {
+      if(! input.compressed->read_frame(frame, pixels.data()))
+        return fail("Unable to read frame %1"_q % (frame + 1));
+      check(frame, pixels.data());
+    }
+  } else {
+    QAtomicInteger<qint64> next_frame{0};
+    QList<QFuture<void>> workers;
+    for(int worker = 0; worker < QThread::idealThreadCount(); worker++)
+      workers.append(QtConcurrent::run([&]{
+        for(qint64 frame = next_frame++; frame < frames; frame = next_frame++)
+          check(frame, input.mapped + input.frame_offset(frame));
+      }));
+    for(auto &worker: workers)
+      worker.waitForFinished();
+  }
+
+  QTextStream out(stdout);
+  const auto corrupted = spans_of({results.begin(), results.end()});
+  for(const auto &span: corrupted)
+    out << "Corrupted frames: " << span.first + 1 << "-" << span.last + 1 << endl;
+  if(hashes != input.header.frames)
+    out << "Hashes for " << hashes << " frames, file has " << input.header.frames << endl;
+  out << "Verified " << frames << " frames (" << CRC32C::implementation() << "): " << (corrupted.empty() ? "ok"_q : "%1 corrupted"_q % frames_count(corrupted)) << endl;
+  return corrupted.empty() && hashes == input.header.frames ? 0 : 2;
+}
+
+/// Metadata side-car records of filename (see SER_FramesHeader), one for each frame; none when missing, short, or from a different machine
+vector<SER_FrameRecord> frames_metadata(const QString &filename, qint64 frames) {
+  QFile side_car{filename + ".frames"};
+  if(! side_car.open(QIODevice::ReadOnly))
+    return {};
+  const auto data = side_car.readAll();
+  const SER_FramesHeader expected;
+  SER_FramesHeader header;
+  if(data.size() < static_cast<int>(sizeof(header)))
+    return {};
+  memcpy(&header, data.constData(), sizeof(header));
+  if(memcmp(header.fileId, expected.fileId, sizeof(header.fileId)) || header.littleEndian != expected.littleEndian || header.recordSize != sizeof(SER_FrameRecord)
+    || (data.size() - static_cast<qint64>(sizeof(header))) / static_cast<qint64>(sizeof(SER_FrameRecord)) < frames)
+    return {};
+  vector<SER_FrameRecord> records(frames);
+  memcpy(records.data(), data.constData() + sizeof(header), frames * sizeof(SER_FrameRecord));
+  return records;
+}
+
+/// Writer settings (compression, FITS header keys) at their defaults, with the output directory, format and threads of the command line
+class ExportConfiguration : public Configuration {
+public:
+  ExportConfiguration(const QString &directory, SaveFormat format, int threads) : directory{directory}, format{format}, threads{threads} {}
+  QString save_directory() const override { return directory; }
+  QString save_file_prefix() const override { return {}; }
+  QString save_file_suffix() const override { return {}; }
+  SaveFormat save_format() const override { return format; }
+  int image_writer_threads() const override { return threads; }
+private:
+  const QString directory;
+  const SaveFormat format;
+  const int threads;
+};
+
+/**
+ * Hands the selected frames to the recording writer of format, with their capture time from the SER timestamps, and exposure, gain and
+ * temperature from the metadata side-car when there's one. Plain SER frames go straight from the mapping; the image writers encode them
+ * on a pool of threads (threads, 0 for all the cores), keeping a few frames in flight.
+ */
+int export_frames(Input &input, const QString &filename, const Spans &spans, const QString &directory, Configuration::SaveFormat format, int threads) {
+  auto factory = FileWriter::factory(format);
+  if(! factory)
+    return fail("Export format not available: writer module not found (see --modules)"_q);
+  if(! QDir{}.mkpath(directory))
+    return fail("Unable to create output directory %1"_q % directory);
+  ExportConfiguration configuration{QDir{directory}.absolutePath(), format, threads};
+  const auto records = frames_metadata(filename, input.header.frames);
+  const auto camera = QString::fromLatin1(input.header.camera, qstrnlen(input.header.camera, sizeof(input.header.camera)));
+  QStringList files;
+  try {
+    auto writer = factory(camera, &configuration);
+    if(! writer)
+      return fail("Unable to create the writer"_q);
+    for(const auto &span: spans) {
+      for(auto index = span.first; index <= span.last; index++) {
+        auto frame = input.frame(index);
+        if(! frame)
+          return fail("Unable to read frame %1"_q % (index + 1));
+        if(input.has_timestamps) {
+          SER_Timestamp timestamp;
+          memcpy(&timestamp, input.timestamps(index), sizeof(timestamp));
+          frame->set_created_utc(SER_Header::qdatetime(timestamp));
+        } else if(input.header.datetime_utc) {
+          frame->set_created_utc(SER_Header::qdatetime(input.header.datetime_utc));
+        }
+        frame->set_sequence(index);
+        if(! records.empty()) {
+          frame->set_exposure(Frame::Seconds{records[index].exposure});
+          frame->set_metadata(records[index].metadata);
+        }
+        writer->handle(frame);
+      }
+    }
+    writer->flush();
+    files = writer->files();
+    // Plain SER frames point into the input mapping: the writer lets them go here, before the input is closed
+  } catch(const SaveImages::Error &e) {
+    return fail(QString::fromStdString(e.what()));
+  }
+  QTextStream(stdout) << "Exported " << frames_count(spans) << " frames" << (input.has_timestamps ? "" : ", without timestamps") << " to " << files.join(", ") << endl;
+  return 0;
+}
+
+int info(Input &input) {
+  QTextStream out(stdout);
+  out << "Frames: " << input.header.frames << endl
+      << "Resolution: " << input.header.imageWidth << "x" << input.header.imageHeight << ", " << input.header.pixelDepth << " bits, "
+      << input.header.channels() << " channels (color id " << input.header.colorId << ")" << endl
+      << "Camera: " << QString::fromLatin1(input.header.camera, qstrnlen(input.header.camera, sizeof(input.header.camera))) << endl
+      << "Compressed: " << (input.compressed ? "yes" : "no") << endl
+      << "Timestamps: " << (input.has_timestamps ? "yes" : "no") << endl;
+  if(input.has_timestamps && input.header.frames > 1) {
+    SER_Timestamp first, last;
+    memcpy(&first, input.timestamps(0), sizeof(first));
+    memcpy(&last, input.timestamps(input.header.frames - 1), sizeof(last));
+    const double seconds = (last - first) / 1e7;
+    out << "Duration: " << seconds << "s, " << (input.header.frames - 1) / seconds << " fps" << endl;
+  }
+  return 0;
+}
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationName("ser_tool");
+  QCommandLineParser parser;
+  parser.setApplicationDescription("SER files post-processing.\n"
+    "  info <input>\n"
+    "  extract <input> <output> <frames>...: frames are numbers or ranges (i.e. 1-500), starting from 1\n"
+    "  cull <input> <output>: keeps the sharpest frames\n"
+    "  merge <index> <output>: joins the stripes of a striped recording (<file>.ser.stripes) into a single SER file\n"
+    "  verify <input>: checks the frames against the hashes saved while recording (<file>.ser.hashes)\n"
+    "  recover <input> <output>: rebuilds a recording that was never closed (i.e. after a crash) up to its last checkpoint\n"
+    "  export <input> <directory> [frames]...: writes the frames (all of them by default) as FITS, PNG or TIFF files, or a FITS cube");
+  parser.addHelpOption();
+  parser.addOptions({
+    {"keep-percent", "cull: percentage of frames to keep (default: 20)", "percent", "20"},
+    {"window", "cull: rank frames among the last N, as while recording (default: 0, the whole file)", "frames", "0"},
+    {"format", "export: fits, png, tiff or fits-cube (default: fits)", "format", "fits"},
+    {"threads", "export: encoding threads (default: 0, all the cores)", "threads", "0"},
+    {"modules", "export: writer modules directory", "modules_directory_path", MODULES_DIRECTORY},
+  });
+  parser.addPositionalArgument("command", "info, extract, cull, merge, verify, recover, export");
+  parser.addPositionalArgument("input", "input SER file");
+  parser.process(app);
+
+  auto arguments = parser.positionalArguments();
+  if(arguments.size() < 2)
+    parser.showHelp(1);
+  const auto command = arguments.takeFirst();
+  if(command == "merge") {
+    if(arguments.size() != 2)
+      parser.showHelp(1);
+    return merge(arguments[0], arguments[1]);
+  }
+  Input input;
+  QString error;
+  const auto filename = arguments.takeFirst();
+  if(! input.open(filename, error, command == "recover"))
+    return fail(error);
+
+  if(command == "info")
+    return info(input);
+  if(command == "verify")
+    return verify(input, filename);
+  if(arguments.isEmpty())
+    parser.showHelp(1);
+  const auto output = arguments.takeFirst();
+  if(command == "extract") {
+    Spans spans;
+    if(arguments.isEmpty() || ! parse_frames(arguments, input.header.frames, spans, error))
+      return fail(error.isEmpty() ? "No frames selected"_q : error);
+    return write_output(input, spans, output);
+  }
+  if(command == "cull") {
+    const int percent = parser.value("keep-percent").toInt();
+    if(percent < 1 || percent > 100)
+      return fail("Invalid percentage: %1"_q % parser.value("keep-percent"));
+    return cull(input, output, percent, parser.value("window").toInt());
+  }
+  if(command == "export") {
+    static const QMap<QString, Configuration::SaveFormat> formats {
+      {"fits", Configuration::FITS}, {"png", Configuration::PNG}, {"tiff", Configuration::TIFF}, {"fits-cube", Configuration::FITSCube},
+    };
+    if(! formats.contains(parser.value("format")))
+      return fail("Invalid export format: %1"_q % parser.value("format"));
+    Spans spans;
+    if(arguments.isEmpty())
+      spans.push_back({0, input.header.frames - 1});
+    else if(! parse_frames(arguments, input.header.frames, spans, error))
+      return fail(error);
+    QStringList modules{parser.value("modules")};
+    if(ADD_DRIVERS_BUILD_DIRECTORY == 1)
+      modules << ADDITIONAL_MODULES_DIRECTORY;
+    Modules::instance().set_directories(modules);
+    return export_frames(input, filename, spans, output, formats[parser.value("format")], parser.value("threads").toInt());
+  }
+  if(command == "recover") {
+    if(input.compressed)
+      return fail("Compressed files can't be recovered"_q);
+    QTextStream(stdout) << "Recovered " << input.header.frames << " frames" << (input.has_timestamps ? "" : ", without timestamps") << endl;
+    return write_output(input, {{0, input.header.frames - 1}}, output);
+  }
+  parser.showHelp(1);
+}
@@ -0,0 +1,82 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "commons/autotuning.h"
+
+namespace {
+  const qint64 MB = 1024 * 1024;
+  AutoTuning::Host host(int cores, qint64 memory, double pixels_per_second, double disk_bytes_per_second) {
+    AutoTuning::Host host;
+    host.cores = cores;
+    host.memory = memory;
+    host.pixels_per_second = pixels_per_second;
+    host.disk.bytes_per_second = disk_bytes_per_second;
+    return host;
+  }
+}
+
+TEST(TestAutoTuning, testKeepsTheDefaultsWhenNothingIsKnown)
+{
+  const auto settings = AutoTuning::recommend(AutoTuning::Host{});
+  ASSERT_EQ(1024 * MB, settings.max_memory_usage);
+  ASSERT_TRUE(settings.buffered_output);
+  ASSERT_EQ(30, settings.max_display_fps);
+  ASSERT_EQ(15, settings.max_display_fps_recording);
+}
+
+TEST(TestAutoTuning, testScalesWithTheMachine)
+{
+  const auto small = AutoTuning::recommend(host(2, 1024 * MB, 100e6, 20 * MB));
+  ASSERT_EQ(256 * MB, small.max_memory_usage);
+  ASSERT_TRUE(small.buffered_output);
+  ASSERT_EQ(10, small.max_display_fps);
+  ASSERT_EQ(5, small.max_display_fps_recording);
+  ASSERT_EQ(4000, small.histogram_timeout);
+
+  const auto large = AutoTuning::recommend(host(16, 64 * 1024 * MB, 4e9, 2000 * MB));
+  ASSERT_EQ(16 * 1024 * MB, large.max_memory_usage);
+  ASSERT_FALSE(large.buffered_output);
+  ASSERT_EQ(60, large.max_display_fps);
+  ASSERT_EQ(30, large.max_display_fps_recording);
+  ASSERT_EQ(1000, large.histogram_timeout);
+  ASSERT_EQ(2000, large.histogram_timeout_recording);
+}
+
+TEST(TestAutoTuning, testPicksThePreviewFormatForTheLink)
+{
+  AutoTuning::Link link;
+  ASSERT_EQ(Configuration::Network_JPEG, AutoTuning::recommend(link).server_image_format);
+  link.bytes_per_second = 110 * MB;
+  link.rtt = std::chrono::milliseconds{1};
+  ASSERT_EQ(Configuration::Network_RAW, AutoTuning::recommend(link).server_image_format);
+  link.bytes_per_second = 13 * MB;
+  const auto lan = AutoTuning::recommend(link);
+  ASSERT_EQ(Configuration::Network_JPEG, lan.server_image_format);
+  ASSERT_EQ(0, lan.server_preview_max_size);
+  link.bytes_per_second = 4 * MB;
+  ASSERT_EQ(1280, AutoTuning::recommend(link).server_preview_max_size);
+  // Same bandwidth, far away: a frame per round trip at most, so frames can be larger
+  link.rtt = std::chrono::milliseconds{200};
+  ASSERT_EQ(0, AutoTuning::recommend(link).server_preview_max_size);
+  link.bytes_per_second = 512 * 1024;
+  link.rtt = std::chrono::milliseconds{10};
+  const auto slow = AutoTuning::recommend(link);
+  ASSERT_EQ(800, slow.server_preview_max_size);
+  ASSERT_EQ(70, slow.server_jpeg_quality);
+}
@@ -0,0 +1,121 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "drivers/bandwidthtuner.h"
+#include <functional>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+BandwidthTuner::Range range(bool higher_is_faster = true) {
+  BandwidthTuner::Range range;
+  range.min = 40;
+  range.max = 100;
+  range.step = 20;
+  range.higher_is_faster = higher_is_faster;
+  range.window = 1s;
+  return range;
+}
+
+// Feeds the tuner for a while, with the camera behaviour at each value (fps, and whether the SDK drops frames), applying its changes
+struct Camera {
+  BandwidthTuner &tuner;
+  function<double(long)> fps;
+  function<bool(long)> drops;
+  BandwidthTuner::Clock::time_point now = BandwidthTuner::Clock::now();
+  uint64_t dropped = 0;
+  long value;
+  Camera(BandwidthTuner &tuner, function<double(long)> fps, function<bool(long)> drops) : tuner{tuner}, fps{fps}, drops{drops}, value{tuner.value()} {}
+  void run(chrono::seconds duration) {
+    const auto end = now + duration;
+    while(now < end) {
+      now += chrono::duration_cast<BandwidthTuner::Clock::duration>(chrono::duration<double>(1. / fps(value)));
+      if(drops(value))
+        dropped++;
+      tuner.frame(now, dropped, value);
+    }
+  }
+};
+}
+
+TEST(TestBandwidthTuner, testStartsFromTheSlowestValue)
+{
+  ASSERT_EQ(40, BandwidthTuner{range()}.value());
+  ASSERT_EQ(100, BandwidthTuner{range(false)}.value());
+}
+
+TEST(TestBandwidthTuner, testRampsToTheFastestWithoutDrops)
+{
+  BandwidthTuner tuner{range()};
+  Camera camera{tuner, [](long value) { return value; }, [](long) { return false; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(100, camera.value);
+}
+
+TEST(TestBandwidthTuner, testRampsDownWhenLowerIsFaster)
+{
+  BandwidthTuner tuner{range(false)};
+  Camera camera{tuner, [](long value) { return 200 - value; }, [](long) { return false; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(40, camera.value);
+}
+
+TEST(TestBandwidthTuner, testBacksOffToTheLastStableValueOnDrops)
+{
+  BandwidthTuner tuner{range()};
+  Camera camera{tuner, [](long value) { return value; }, [](long value) { return value > 60; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(60, camera.value);
+}
+
+TEST(TestBandwidthTuner, testBacksOffWhenFramesSlowDown)
+{
+  BandwidthTuner tuner{range()};
+  Camera camera{tuner, [](long value) { return value >= 80 ? 20 : value; }, [](long) { return false; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(60, camera.value);
+}
+
+TEST(TestBandwidthTuner, testStepsBackWhenDropsStartOnceSettled)
+{
+  BandwidthTuner tuner{range()};
+  bool host_busy = false;
+  Camera camera{tuner, [](long) { return 50; }, [&](long value) { return host_busy && value > 40; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(100, camera.value);
+  host_busy = true;
+  camera.run(30s);
+  ASSERT_EQ(40, camera.value);
+}
+
+TEST(TestBandwidthTuner, testResetStartsOver)
+{
+  BandwidthTuner tuner{range()};
+  Camera camera{tuner, [](long) { return 50; }, [](long) { return false; }};
+  camera.run(30s);
+  ASSERT_TRUE(tuner.settled());
+  ASSERT_EQ(40, tuner.reset());
+  ASSERT_FALSE(tuner.settled());
+}
@@ -0,0 +1,113 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <boost/endian/conversion.hpp>
+#include "commons/capturetransform.h"
+#include "commons/frame.h"
+#include "commons/framepool.h"
+
+using namespace std;
+
+namespace {
+FramePtr mono16(const cv::Mat &image) {
+  return make_shared<Frame>(Frame::Mono, image, Frame::LittleEndian);
+}
+}
+
+TEST(TestCaptureTransform, testInactiveSettingsReturnTheSameFrame) {
+  auto frame = mono16(cv::Mat(4, 4, CV_16UC1, cv::Scalar{10}));
+  ASSERT_EQ(frame, CaptureTransform::apply(frame, {}));
+}
+
+TEST(TestCaptureTransform, testAverageBinning) {
+  cv::Mat image = (cv::Mat_<uint16_t>(2, 4) << 1, 2, 10, 20,
+                                               3, 5, 30, 41);
+  auto binned = CaptureTransform::apply(mono16(image), {{}, 2, CaptureTransform::Average});
+  ASSERT_EQ(QSize(2, 1), binned->resolution());
+  ASSERT_EQ(3, binned->mat().at<uint16_t>(0, 0));  // 11 / 4, rounded
+  ASSERT_EQ(25, binned->mat().at<uint16_t>(0, 1)); // 101 / 4, rounded
+}
+
+TEST(TestCaptureTransform, testSumBinningSaturates) {
+  cv::Mat image = (cv::Mat_<uint8_t>(3, 3) << 100, 100, 100,
+                                              100, 1, 1,
+                                              100, 1, 1);
+  auto binned = CaptureTransform::apply(make_shared<Frame>(Frame::Mono, image), {{}, 3, CaptureTransform::Sum});
+  ASSERT_EQ(QSize(1, 1), binned->resolution());
+  ASSERT_EQ(255, binned->mat().at<uint8_t>(0, 0));
+  binned = CaptureTransform::apply(make_shared<Frame>(Frame::Mono, image(cv::Rect{1, 1, 2, 2})), {{}, 2, CaptureTransform::Sum});
+  ASSERT_EQ(4, binned->mat().at<uint8_t>(0, 0));
+}
+
+TEST(TestCaptureTransform, testBayerBinningKeepsThePattern) {
+  // RGGB 4x4: R=10, G1=20, G2=30, B=40 in every cell
+  cv::Mat image(4, 4, CV_8UC1);
+  for(int y = 0; y < 4; y++)
+    for(int x = 0; x < 4; x++)
+      image.at<uint8_t>(y, x) = (y % 2 ? (x % 2 ? 40 : 30) : (x % 2 ? 20 : 10));
+  auto binned = CaptureTransform::apply(make_shared<Frame>(Frame::Bayer_RGGB, image), {{}, 2, CaptureTransform::Average});
+  ASSERT_EQ(QSize(2, 2), binned->resolution());
+  ASSERT_EQ(Frame::Bayer_RGGB, binned->colorFormat());
+  ASSERT_EQ((vector<uint8_t>{10, 20, 30, 40}), vector<uint8_t>(binned->mat().begin<uint8_t>(), binned->mat().end<uint8_t>()));
+}
+
+TEST(TestCaptureTransform, testBigEndianFramesAreBinnedInNativeOrder) {
+  cv::Mat image(2, 2, CV_16UC1, cv::Scalar{0x0100}); // 1 in big endian order, read on a little endian host
+  auto binned = CaptureTransform::apply(make_shared<Frame>(Frame::Mono, image, Frame::BigEndian), {{}, 2, CaptureTransform::Sum});
+  const bool native_little_endian = boost::endian::order::native == boost::endian::order::little;
+  ASSERT_EQ(native_little_endian ? Frame::LittleEndian : Frame::BigEndian, binned->byteOrder());
+  ASSERT_EQ(native_little_endian ? 4 : 0x0400, binned->mat().at<uint16_t>(0, 0));
+}
+
+TEST(TestCaptureTransform, testRoiCrop) {
+  cv::Mat image(10, 10, CV_16UC1);
+  for(int y = 0; y < 10; y++)
+    for(int x = 0; x < 10; x++)
+      image.at<uint16_t>(y, x) = y * 10 + x;
+  auto source = mono16(image);
+  source->set_sequence(42);
+  auto pool = make_shared<FramePool>();
+  auto cropped = CaptureTransform::apply(source, {QRect{3, 2, 4, 5}, 1, CaptureTransform::Average}, pool);
+  ASSERT_EQ(QSize(4, 5), cropped->resolution());
+  ASSERT_EQ(23, cropped->mat().at<uint16_t>(0, 0));
+  ASSERT_EQ(66, cropped->mat().at<uint16_t>(4, 3));
+  ASSERT_EQ(Frame::LittleEndian, cropped->byteOrder());
+  ASSERT_EQ(source->sequence(), cropped->sequence());
+  // The crop is clipped to the frame
+  cropped = CaptureTransform::apply(source, {QRect{8, 8, 20, 20}, 1, CaptureTransform::Average}, pool);
+  ASSERT_EQ(QSize(2, 2), cropped->resolution());
+  ASSERT_EQ(88, cropped->mat().at<uint16_t>(0, 0));
+}
+
+TEST(TestCaptureTransform, testMetadataFollowsTheTransform) {
+  auto source = mono16(cv::Mat(8, 8, CV_16UC1, cv::Scalar{1}));
+  source->metadata().gain = 120;
+  source->metadata().roi_x = 100;
+  source->metadata().roi_y = 50;
+  source->metadata().bin = 1;
+  auto transformed = CaptureTransform::apply(source, {QRect{2, 4, 4, 4}, 2, CaptureTransform::Average});
+  ASSERT_EQ(120, transformed->metadata().gain);
+  ASSERT_EQ(51, transformed->metadata().roi_x);
+  ASSERT_EQ(27, transformed->metadata().roi_y);
+  ASSERT_EQ(2, transformed->metadata().bin);
+  // Unknown geometry stays unknown
+  auto unknown = CaptureTransform::apply(mono16(cv::Mat(8, 8, CV_16UC1, cv::Scalar{1})), {QRect{2, 4, 4, 4}, 2, CaptureTransform::Average});
+  ASSERT_FALSE(unknown->metadata().has_roi_offset());
+  ASSERT_EQ(0, unknown->metadata().bin);
+}
@@ -0,0 +1,117 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include "commons/compressedframesqueue.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// Flat frames: they compress very well
+FramePtr test_frame(uint8_t value, quint64 sequence) {
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{64, 64}, Frame::LittleEndian);
+  frame->mat().setTo(value);
+  frame->set_sequence(sequence);
+  return frame;
+}
+
+bool wait_compressed(const CompressedFramesQueue &queue, size_t raw_bytes) {
+  for(int i = 0; i < 1000 && queue.bytes() >= raw_bytes; i++)
+    this_thread::sleep_for(1ms);
+  return queue.bytes() < raw_bytes;
+}
+}
+
+TEST(TestCompressedFramesQueue, testPopTimesOutWhenEmpty)
+{
+  CompressedFramesQueue queue{0, 0};
+  ASSERT_TRUE(queue.empty());
+  ASSERT_FALSE(queue.pop(1ms));
+}
+
+TEST(TestCompressedFramesQueue, testFramesComeBackInOrder)
+{
+  CompressedFramesQueue queue{0, 0};
+  auto first = test_frame(1, 10);
+  first->set_exposure(Frame::Seconds{0.02});
+  first->set_device_timestamp(Frame::Timestamp{5000});
+  first->metadata().gain = 200;
+  for(quint64 sequence = 10; sequence < 20; sequence++)
+    ASSERT_TRUE(queue.push(sequence == 10 ? first : test_frame(sequence, sequence)));
+  ASSERT_EQ(10u, queue.size());
+  ASSERT_TRUE(wait_compressed(queue, 10 * first->size()));
+  for(quint64 sequence = 10; sequence < 20; sequence++) {
+    auto frame = queue.pop(1s);
+    ASSERT_TRUE(frame);
+    ASSERT_NE(first, frame);
+    ASSERT_EQ(sequence, frame->sequence());
+    ASSERT_EQ(QSize(64, 64), frame->resolution());
+    ASSERT_EQ(Frame::LittleEndian, frame->byteOrder());
+    ASSERT_EQ(sequence, frame->mat().at<uint8_t>(63, 63));
+    if(sequence == 10) {
+      ASSERT_EQ(first->exposure(), frame->exposure());
+      ASSERT_EQ(first->created_utc(), frame->created_utc());
+      ASSERT_EQ(first->captured(), frame->captured());
+      ASSERT_EQ(Frame::Timestamp{5000}, frame->device_timestamp());
+      ASSERT_EQ(200, frame->metadata().gain);
+    }
+  }
+  ASSERT_TRUE(queue.empty());
+  ASSERT_EQ(0u, queue.bytes());
+  ASSERT_GT(queue.ratio(), 4);
+  ASSERT_EQ(0u, queue.lost());
+}
+
+TEST(TestCompressedFramesQueue, testCompressedFramesTakeLessOfTheBudget)
+{
+  const size_t frame_size = test_frame(0, 0)->size();
+  CompressedFramesQueue queue{frame_size * 2, 0};
+  ASSERT_TRUE(queue.push(test_frame(0, 1)));
+  ASSERT_TRUE(queue.push(test_frame(0, 2)));
+  ASSERT_TRUE(wait_compressed(queue, frame_size));
+  // Raw, they would take four times the budget
+  for(quint64 sequence = 3; sequence <= 8; sequence++) {
+    ASSERT_TRUE(queue.push(test_frame(0, sequence)));
+    ASSERT_TRUE(wait_compressed(queue, frame_size));
+  }
+  ASSERT_EQ(8u, queue.size());
+}
+
+TEST(TestCompressedFramesQueue, testRefusesFramesBeyondTheBudget)
+{
+  // Always room for one frame
+  CompressedFramesQueue queue{1, 0};
+  ASSERT_TRUE(queue.push(test_frame(0, 1)));
+  ASSERT_FALSE(queue.push(test_frame(0, 2)));
+  ASSERT_EQ(1u, queue.pop(1s)->sequence());
+  ASSERT_TRUE(queue.empty());
+}
+
+TEST(TestCompressedFramesQueue, testIncompressibleFramesStayRaw)
+{
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{64, 64}, Frame::LittleEndian);
+  cv::randu(frame->mat(), 0, 256);
+  CompressedFramesQueue queue{0, 0};
+  ASSERT_TRUE(queue.push(frame));
+  this_thread::sleep_for(50ms);
+  ASSERT_EQ(frame->size(), queue.bytes());
+  ASSERT_EQ(frame, queue.pop(1s));
+}
@@ -0,0 +1,146 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <QTemporaryDir>
+#include <QFile>
+#include <numeric>
+#include "commons/compressedser.h"
+#include "commons/packedpixels.h"
+#include <boost/endian/conversion.hpp>
+
+using namespace std;
+
+namespace {
+vector<uint8_t> test_frame(uint8_t seed) {
+  // Mostly black, like a planetary frame
+  vector<uint8_t> data(64 * 32, 0);
+  iota(data.begin() + 1000, data.begin() + 1100, seed);
+  return data;
+}
+}
+
+TEST(TestCompressedSER, testCompressAndDecompress) {
+  auto frame = test_frame(3);
+  auto compressed = CompressedSER::compress(frame.data(), frame.size(), 1);
+  ASSERT_FALSE(compressed.isEmpty());
+  ASSERT_LT(compressed.size(), static_cast<int>(frame.size()));
+  vector<uint8_t> decompressed(frame.size());
+  ASSERT_TRUE(CompressedSER::decompress(compressed, decompressed.data(), decompressed.size()));
+  ASSERT_EQ(frame, decompressed);
+}
+
+TEST(TestCompressedSER, testDecompressRejectsWrongSize) {
+  auto frame = test_frame(3);
+  auto compressed = CompressedSER::compress(frame.data(), frame.size(), 1);
+  vector<uint8_t> decompressed(frame.size() * 2);
+  ASSERT_FALSE(CompressedSER::decompress(compressed, decompressed.data(), decompressed.size()));
+}
+
+TEST(TestCompressedSER, testReadBackFile) {
+  QTemporaryDir directory;
+  QString filename = directory.path() + "/test.zser";
+  CompressedSER_Header header;
+  header.ser.imageWidth = 64;
+  header.ser.imageHeight = 32;
+  header.ser.pixelDepth = 8;
+  header.ser.frames = 2;
+  vector<CompressedSER_IndexEntry> index;
+  vector<SER_Timestamp> timestamps{10, 20};
+  {
+    QFile file(filename);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(uint8_t seed: {1, 2}) {
+      auto frame = test_frame(seed);
+      auto compressed = CompressedSER::compress(frame.data(), frame.size(), 1);
+      index.push_back({static_cast<quint64>(file.pos()), static_cast<quint32>(compressed.size()), 0});
+      file.write(compressed);
+    }
+    header.index_offset = file.pos();
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(CompressedSER_IndexEntry));
+    file.write(reinterpret_cast<const char*>(timestamps.data()), timestamps.size() * sizeof(SER_Timestamp));
+    file.seek(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  ASSERT_TRUE(CompressedSERReader::is_compressed(filename));
+  CompressedSERReader reader(filename);
+  ASSERT_TRUE(reader.isOpen());
+  quint32 frames = reader.header().frames;
+  ASSERT_EQ(2u, frames);
+  ASSERT_EQ(timestamps, reader.timestamps());
+  vector<uint8_t> frame(reader.header().frame_size());
+  ASSERT_TRUE(reader.read_frame(1, frame.data()));
+  ASSERT_EQ(test_frame(2), frame);
+  ASSERT_FALSE(reader.read_frame(2, frame.data()));
+}
+
+TEST(TestCompressedSER, testPlainSerIsNotCompressed) {
+  QTemporaryDir directory;
+  QString filename = directory.path() + "/test.ser";
+  QFile file(filename);
+  ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+  SER_Header header;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.close();
+  ASSERT_FALSE(CompressedSERReader::is_compressed(filename));
+  ASSERT_FALSE(CompressedSERReader(filename).isOpen());
+}
+
+TEST(TestCompressedSER, testReadBackPackedFrames) {
+  QTemporaryDir directory;
+  QString filename = directory.path() + "/test.zser";
+  CompressedSER_Header header;
+  header.codec = CompressedSER_Header::ZstdPacked;
+  header.ser.imageWidth = 64;
+  header.ser.imageHeight = 32;
+  header.ser.pixelDepth = 16;
+  header.ser.frames = 2;
+  // Native values: the reader swaps them only if the file byte order is not the native one
+  header.ser.endian = boost::endian::order::native == boost::endian::order::little ? SER_Header::BigEndian : SER_Header::LittleEndian;
+  vector<uint16_t> frame(64 * 32);
+  for(size_t i = 0; i < frame.size(); i++)
+    frame[i] = static_cast<uint16_t>((i * 37 % 1024) << 6);
+  const PackedPixels::Layout layout{10, 6};
+  ASSERT_EQ(layout, PackedPixels::layout(frame.data(), frame.size(), false));
+  vector<CompressedSER_IndexEntry> index;
+  {
+    QFile file(filename);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // One packed frame, and one left unpacked
+    vector<uint8_t> packed(PackedPixels::packed_size(frame.size(), layout));
+    PackedPixels::pack(frame.data(), packed.data(), frame.size(), layout, false);
+    auto compressed = CompressedSER::compress(packed.data(), packed.size(), 1);
+    index.push_back({static_cast<quint64>(file.pos()), static_cast<quint32>(compressed.size()), layout.code()});
+    file.write(compressed);
+    compressed = CompressedSER::compress(reinterpret_cast<const uint8_t*>(frame.data()), frame.size() * 2, 1);
+    index.push_back({static_cast<quint64>(file.pos()), static_cast<quint32>(compressed.size()), 0});
+    file.write(compressed);
+    header.index_offset = file.pos();
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(CompressedSER_IndexEntry));
+    file.seek(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  CompressedSERReader reader(filename);
+  ASSERT_TRUE(reader.isOpen());
+  vector<uint16_t> read(frame.size());
+  for(quint32 i: {0, 1}) {
+    ASSERT_TRUE(reader.read_frame(i, reinterpret_cast<uint8_t*>(read.data())));
+    ASSERT_EQ(frame, read) << "frame " << i;
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "drivers/controlscache.h"
+#include <QTemporaryDir>
+
+namespace {
+Imager::Controls controls() {
+  auto exposure = Imager::Control{1, "Exposure"}.set_range(32ll, 2000000000ll, 1ll).set_value(20000ll).set_default_value(10000ll).set_decimals(0)
+    .set_supports_auto(true).set_is_exposure(true).set_duration_unit(1e-6);
+  exposure.is_duration = true;
+  auto format = Imager::Control{2, "Format", Imager::Control::Combo}.add_choice("RAW8", 0).add_choice("RAW16", 2).set_value(2);
+  return {exposure, format};
+}
+
+Imager::Properties properties(const QString &serial) {
+  Imager::Properties properties;
+  properties << Imager::Properties::Property{"Serial Number", serial} << Imager::Properties::Property{"Camera Type", "mono"};
+  return properties;
+}
+}
+
+TEST(TestControlsCache, testStoredControlsLoadBack) {
+  QTemporaryDir directory;
+  ControlsCache cache{directory.path()};
+  ASSERT_TRUE(cache.store("camera", controls()));
+  Imager::Controls loaded;
+  ASSERT_TRUE(cache.load("camera", loaded));
+  ASSERT_EQ(2, loaded.size());
+  for(int index = 0; index < loaded.size(); index++) {
+    ASSERT_TRUE(ControlsCache::same_descriptor(controls()[index], loaded[index]));
+    ASSERT_TRUE(controls()[index].same_value(loaded[index]));
+  }
+  ASSERT_EQ(QVariant::LongLong, loaded[0].value.type());
+  ASSERT_DOUBLE_EQ(1e-6, loaded[0].duration_unit.count());
+  ASSERT_EQ(QString{"RAW16"}, loaded[1].choices[1].label);
+}
+
+TEST(TestControlsCache, testUnknownCamerasAreNotFound) {
+  QTemporaryDir directory;
+  ControlsCache cache{directory.path()};
+  Imager::Controls loaded;
+  ASSERT_FALSE(cache.load("camera", loaded));
+  ASSERT_TRUE(cache.store("camera", controls()));
+  ASSERT_FALSE(cache.load("another camera", loaded));
+  ASSERT_TRUE(loaded.isEmpty());
+}
+
+TEST(TestControlsCache, testKeyTellsSerialNumbersApart) {
+  ASSERT_NE(ControlsCache::key("ZWO ASI224MC", properties("1234")), ControlsCache::key("ZWO ASI224MC", properties("5678")));
+  ASSERT_EQ(ControlsCache::key("ZWO ASI224MC", properties("1234")), ControlsCache::key("ZWO ASI224MC", properties("1234")));
+}
+
+TEST(TestControlsCache, testDescriptorChangesAreDetected) {
+  auto changed = controls();
+  changed[0].range.max = 1000000ll;
+  ASSERT_FALSE(ControlsCache::same_descriptor(controls()[0], changed[0]));
+  changed = controls();
+  changed[0].value = 1000ll;
+  ASSERT_TRUE(ControlsCache::same_descriptor(controls()[0], changed[0]));
+}
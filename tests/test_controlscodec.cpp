@@ -0,0 +1,85 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "network/protocol/controlscodec.h"
+
+namespace {
+Imager::Control exposure() {
+  auto control = Imager::Control{1, "Exposure"}.set_range(32ll, 2000000000ll, 1ll).set_value(20000ll).set_default_value(10000ll).set_decimals(0)
+    .set_supports_auto(true).set_value_auto(true).set_is_exposure(true).set_duration_unit(1e-6);
+  control.is_duration = true;
+  return control;
+}
+
+Imager::Control flip() {
+  return Imager::Control{2, "Flip", Imager::Control::Combo}.add_choice("no", 0ll).add_choice(QString::fromUtf8("é"), 3ll).set_value(3ll);
+}
+}
+
+TEST(TestControlsCodec, testDescriptorsRoundTrip) {
+  Imager::Controls decoded;
+  ASSERT_TRUE(ControlsCodec::decode(ControlsCodec::encode({exposure(), flip()}), decoded));
+  ASSERT_EQ(2, decoded.size());
+  auto control = decoded[0];
+  ASSERT_EQ(1, control.id);
+  ASSERT_EQ(QString{"Exposure"}, control.name);
+  ASSERT_EQ(20000, control.value.toLongLong());
+  ASSERT_EQ(10000, control.default_value.toLongLong());
+  ASSERT_EQ(2000000000ll, control.range.max.toLongLong());
+  ASSERT_TRUE(control.is_duration && control.is_exposure && control.supports_auto && control.value_auto);
+  ASSERT_FALSE(control.readonly);
+  ASSERT_DOUBLE_EQ(1e-6, control.duration_unit.count());
+  ASSERT_EQ(Imager::Control::Combo, decoded[1].type);
+  ASSERT_EQ(2, decoded[1].choices.size());
+  ASSERT_EQ(QString::fromUtf8("é"), decoded[1].choices[1].label);
+  ASSERT_EQ(3, decoded[1].choices[1].value.toLongLong());
+}
+
+TEST(TestControlsCodec, testDoublesAndNegativesKeepTheirType) {
+  auto control = Imager::Control{-7, "Temperature"}.set_value(-12.5);
+  Imager::Controls decoded;
+  ASSERT_TRUE(ControlsCodec::decode(ControlsCodec::encode({control}), decoded));
+  ASSERT_EQ(-7, decoded[0].id);
+  ASSERT_EQ(QVariant::Double, decoded[0].value.type());
+  ASSERT_DOUBLE_EQ(-12.5, decoded[0].value.toDouble());
+  ASSERT_TRUE(decoded[0].range.min.isNull());
+}
+
+TEST(TestControlsCodec, testValuesApplyToKnownDescriptors) {
+  Imager::Controls known{exposure(), flip()};
+  auto changed_exposure = exposure().set_value(500ll).set_value_auto(false);
+  auto unknown = Imager::Control{99, "Unknown"}.set_value(1ll);
+  const auto values = ControlsCodec::encodeValues({changed_exposure, unknown});
+  ASSERT_LT(values.size(), ControlsCodec::encode({changed_exposure}).size());
+  Imager::Controls changed;
+  ASSERT_TRUE(ControlsCodec::applyValues(values, known, changed));
+  ASSERT_EQ(1, changed.size());
+  ASSERT_EQ(500, known[0].value.toLongLong());
+  ASSERT_FALSE(known[0].value_auto);
+  ASSERT_EQ(QString{"Exposure"}, changed[0].name);
+  ASSERT_DOUBLE_EQ(1e-6, changed[0].duration_unit.count());
+}
+
+TEST(TestControlsCodec, testRejectsTruncatedAndUnknownVersions) {
+  Imager::Controls decoded;
+  auto data = ControlsCodec::encode({exposure()});
+  ASSERT_FALSE(ControlsCodec::decode(data.left(data.size() - 3), decoded));
+  data[0] = ControlsCodec::VERSION + 1;
+  ASSERT_FALSE(ControlsCodec::decode(data, decoded));
+  ASSERT_FALSE(ControlsCodec::decode({}, decoded));
+}
@@ -0,0 +1,76 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/cpubudget.h"
+
+using namespace std;
+
+TEST(TestCpuBudget, testIdleMachineLimitsNothing)
+{
+  CpuBudget budget{4};
+  // Display at 0.01s per frame and network at 0.005s, both at 50fps
+  const auto rates = budget.update(1.5, {{50, 50, 0.5}, {50, 50, 0.25}});
+  ASSERT_EQ(2u, rates.size());
+  ASSERT_EQ(0, rates[0]);
+  ASSERT_EQ(0, rates[1]);
+  // Half of the cores are reserved, and the rest only uses 0.75 of them
+  ASSERT_DOUBLE_EQ(2, budget.budget());
+  ASSERT_DOUBLE_EQ(0.01, budget.costs()[0]);
+}
+
+TEST(TestCpuBudget, testLowerPrioritiesGiveWayFirst)
+{
+  CpuBudget budget{2};
+  // The rest uses 1.25 cores, more than the reserve; both stages cost 0.005s per frame
+  const auto rates = budget.update(2, {{100, 100, 0.5}, {100, 50, 0.25}});
+  ASSERT_DOUBLE_EQ(0.75, budget.budget());
+  ASSERT_EQ(0, rates[0]);
+  // Only 0.25 cores left
+  ASSERT_DOUBLE_EQ(50, rates[1]);
+}
+
+TEST(TestCpuBudget, testBusyRestShrinksTheBudget)
+{
+  CpuBudget budget{{0.25, 2, 1}, 4};
+  // Capture, saving and other processes take 3.2 cores, more than the reserve
+  const auto rates = budget.update(4, {{100, 100, 0.8}});
+  ASSERT_NEAR(0.8, budget.budget(), 1e-9);
+  ASSERT_EQ(0, rates[0]);
+  const auto limited = budget.update(4, {{100, 100, 0.4}, {100, 50, 0.4}});
+  ASSERT_NEAR(0.8, budget.budget(), 1e-9);
+  ASSERT_NEAR(0.004, budget.costs()[0], 1e-9);
+  ASSERT_EQ(0, limited[0]);
+  // 0.4 cores left at 0.008s per frame
+  ASSERT_NEAR(50, limited[1], 1e-9);
+  // No cores left at all: limited stages still get min_fps
+  const auto starved = budget.update(4, {{100, 0, 0}, {100, 0, 0}});
+  ASSERT_EQ(0, budget.budget());
+  ASSERT_EQ(2, starved[0]);
+  ASSERT_EQ(2, starved[1]);
+}
+
+TEST(TestCpuBudget, testCostsAreSmoothed)
+{
+  CpuBudget budget{{0.5, 1, 0.5}, 2};
+  budget.update(0.5, {{10, 10, 0.1}});
+  budget.update(0.5, {{10, 10, 0.3}});
+  ASSERT_NEAR(0.02, budget.costs()[0], 1e-9);
+  // Stages handling no frames keep their cost
+  budget.update(0.5, {{0, 0, 0}});
+  ASSERT_NEAR(0.02, budget.costs()[0], 1e-9);
+}
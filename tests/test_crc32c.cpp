@@ -0,0 +1,41 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "commons/crc32c.h"
+#include <vector>
+
+using namespace std;
+
+TEST(TestCRC32C, testCheckValue)
+{
+  ASSERT_EQ(0xe3069283u, CRC32C::checksum("123456789", 9));
+  ASSERT_EQ(0u, CRC32C::checksum(nullptr, 0));
+}
+
+TEST(TestCRC32C, testUpdateInPiecesMatchesOneGo)
+{
+  vector<uint8_t> data(100003);
+  for(size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<uint8_t>(i * 7 + 3);
+  const uint32_t whole = CRC32C::checksum(data.data(), data.size());
+  // Odd split points exercise the unaligned heads and tails
+  ASSERT_EQ(whole, CRC32C::update(CRC32C::checksum(data.data(), 5001), data.data() + 5001, data.size() - 5001));
+  data[777] ^= 1;
+  ASSERT_NE(whole, CRC32C::checksum(data.data(), data.size()));
+}
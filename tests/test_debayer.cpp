@@ -0,0 +1,137 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/debayer.h"
+
+namespace {
+// RGGB mosaic of a flat colour
+cv::Mat flat_mosaic(int rows, int cols, int depth, int red, int green, int blue) {
+  cv::Mat bayer(rows, cols, CV_MAKETYPE(depth, 1));
+  for(int y = 0; y < rows; y++)
+    for(int x = 0; x < cols; x++) {
+      const int value = y % 2 == 0 ? (x % 2 == 0 ? red : green) : (x % 2 == 0 ? green : blue);
+      if(depth == CV_8U)
+        bayer.at<uint8_t>(y, x) = value;
+      else
+        bayer.at<uint16_t>(y, x) = value;
+    }
+  return bayer;
+}
+
+cv::Mat swapped(const cv::Mat &native) {
+  cv::Mat swapped = native.clone();
+  for(auto it = swapped.begin<uint16_t>(); it != swapped.end<uint16_t>(); it++)
+    *it = static_cast<uint16_t>((*it >> 8) | (*it << 8));
+  return swapped;
+}
+
+cv::Mat noise(int rows, int cols, int depth) {
+  cv::Mat bayer(rows, cols, CV_MAKETYPE(depth, 1));
+  cv::RNG rng{42};
+  rng.fill(bayer, cv::RNG::UNIFORM, 0, depth == CV_8U ? 256 : 65536);
+  return bayer;
+}
+}
+
+TEST(TestDebayer, testSuperpixelCells) {
+  cv::Mat bayer = (cv::Mat_<uint8_t>(2, 4) <<
+    10, 20, 30, 40,
+    21, 50, 41, 60);
+  auto rgb = Debayer::debayer(bayer, Frame::Bayer_RGGB, {Debayer::Superpixel, false, false});
+  ASSERT_EQ(1, rgb.rows);
+  ASSERT_EQ(2, rgb.cols);
+  ASSERT_EQ(CV_8UC3, rgb.type());
+  ASSERT_EQ(cv::Vec3b(10, 21, 50), rgb.at<cv::Vec3b>(0, 0));
+  ASSERT_EQ(cv::Vec3b(30, 41, 60), rgb.at<cv::Vec3b>(0, 1));
+
+  auto bggr = Debayer::debayer(bayer, Frame::Bayer_BGGR, {Debayer::Superpixel, false, false});
+  ASSERT_EQ(cv::Vec3b(50, 21, 10), bggr.at<cv::Vec3b>(0, 0));
+}
+
+TEST(TestDebayer, testFlatColourIsKeptEverywhere) {
+  for(auto algorithm: {Debayer::Superpixel, Debayer::Bilinear, Debayer::EdgeAware}) {
+    auto rgb = Debayer::debayer(flat_mosaic(10, 12, CV_16U, 1000, 2000, 3000), Frame::Bayer_RGGB, {algorithm, false, false});
+    ASSERT_EQ(CV_16UC3, rgb.type());
+    for(auto it = rgb.begin<cv::Vec3w>(); it != rgb.end<cv::Vec3w>(); it++)
+      ASSERT_EQ(cv::Vec3w(1000, 2000, 3000), *it);
+  }
+}
+
+TEST(TestDebayer, testSwappedInputMatchesNative) {
+  auto native = noise(16, 20, CV_16U);
+  for(auto algorithm: {Debayer::Superpixel, Debayer::Bilinear, Debayer::EdgeAware}) {
+    for(bool to8bit: {false, true}) {
+      auto expected = Debayer::debayer(native, Frame::Bayer_GRBG, {algorithm, false, to8bit});
+      auto actual = Debayer::debayer(swapped(native), Frame::Bayer_GRBG, {algorithm, true, to8bit});
+      ASSERT_EQ(0, cv::norm(expected, actual, cv::NORM_INF));
+    }
+  }
+}
+
+TEST(TestDebayer, testEightBitOutputIsRounded) {
+  auto rgb = Debayer::debayer(flat_mosaic(4, 4, CV_16U, 127, 128, 65535), Frame::Bayer_RGGB, {Debayer::Bilinear, false, true});
+  ASSERT_EQ(CV_8UC3, rgb.type());
+  ASSERT_EQ(cv::Vec3b(0, 1, 255), rgb.at<cv::Vec3b>(1, 1));
+}
+
+TEST(TestDebayer, testBilinearMatchesOpenCVInside) {
+  auto bayer = noise(32, 40, CV_8U);
+  cv::Mat expected;
+  // OpenCV names the patterns from the second row: its BG2BGR is RGGB to RGB
+  cv::cvtColor(bayer, expected, cv::COLOR_BayerBG2RGB);
+  auto rgb = Debayer::debayer(bayer, Frame::Bayer_RGGB, {Debayer::Bilinear, false, false});
+  const cv::Rect inside{2, 2, bayer.cols - 4, bayer.rows - 4};
+  ASSERT_LE(cv::norm(expected(inside), rgb(inside), cv::NORM_INF), 1);
+}
+
+TEST(TestDebayer, testEdgeAwareFollowsEdges) {
+  // Vertical edge on a grey mosaic: bilinear blends the green across it, edge aware doesn't
+  cv::Mat bayer(8, 8, CV_8UC1);
+  for(int x = 0; x < bayer.cols; x++)
+    bayer.col(x).setTo(x < 4 ? 40 : 200);
+  auto rgb = Debayer::debayer(bayer, Frame::Bayer_RGGB, {Debayer::EdgeAware, false, false});
+  for(int y = 2; y < 6; y++) {
+    ASSERT_EQ(40, rgb.at<cv::Vec3b>(y, 3)[1]);
+    ASSERT_EQ(200, rgb.at<cv::Vec3b>(y, 4)[1]);
+  }
+}
+
+TEST(TestDebayer, testOtherFormatsAndTinyAreas) {
+  ASSERT_TRUE(Debayer::debayer(cv::Mat(4, 4, CV_8UC1, cv::Scalar{1}), Frame::Mono, {Debayer::Bilinear, false, false}).empty());
+  ASSERT_TRUE(Debayer::debayer(cv::Mat(1, 4, CV_8UC1, cv::Scalar{1}), Frame::Bayer_RGGB, {Debayer::Bilinear, false, false}).empty());
+
+  auto mono = std::make_shared<Frame>(Frame::Mono, cv::Mat(4, 4, CV_16UC1, cv::Scalar{7}));
+  ASSERT_EQ(mono, Debayer::debayer(mono, Debayer::EdgeAware));
+  auto frame = std::make_shared<Frame>(Frame::Bayer_RGGB, flat_mosaic(4, 6, CV_16U, 1, 2, 3), Frame::BigEndian);
+  auto rgb = Debayer::debayer(frame, Debayer::Bilinear);
+  ASSERT_EQ(Frame::RGB, rgb->colorFormat());
+  ASSERT_EQ(3, rgb->channels());
+  ASSERT_EQ(frame->sequence(), rgb->sequence());
+}
+
+TEST(TestDebayer, testOutputMemoryIsReused) {
+  auto bayer = noise(8, 8, CV_16U);
+  cv::Mat rgb;
+  Debayer::debayer(bayer, Frame::Bayer_RGGB, {Debayer::Bilinear, false, true}, rgb);
+  const uchar *data = rgb.data;
+  Debayer::debayer(noise(8, 8, CV_16U), Frame::Bayer_RGGB, {Debayer::EdgeAware, false, true}, rgb);
+  ASSERT_EQ(data, rgb.data);
+  Debayer::debayer(bayer, Frame::Mono, {Debayer::Bilinear, false, true}, rgb);
+  ASSERT_TRUE(rgb.empty());
+}
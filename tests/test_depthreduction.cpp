@@ -0,0 +1,105 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2016  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include "commons/depthreduction.h"
+
+using namespace std;
+
+namespace {
+vector<vector<uint32_t>> histogram(const vector<pair<uint16_t, uint32_t>> &counts) {
+  vector<vector<uint32_t>> channels(1, vector<uint32_t>(65536, 0));
+  for(const auto &count: counts)
+    channels[0][count.first] = count.second;
+  return channels;
+}
+}
+
+TEST(TestDepthReduction, testBlueNoiseHasEveryThresholdEquallyOften) {
+  const auto &noise = DepthReduction::blue_noise();
+  ASSERT_EQ(static_cast<size_t>(DepthReduction::blue_noise_size * DepthReduction::blue_noise_size), noise.size());
+  vector<int> counts(256, 0);
+  for(auto threshold: noise)
+    counts[threshold]++;
+  ASSERT_EQ(*min_element(counts.begin(), counts.end()), *max_element(counts.begin(), counts.end()));
+}
+
+TEST(TestDepthReduction, testBlueNoiseHasNoLowFrequencies) {
+  // The mean of every 8x8 block stays close to the middle: some white noise blocks would be 20 levels off or more
+  const auto &noise = DepthReduction::blue_noise();
+  const int size = DepthReduction::blue_noise_size;
+  for(int y = 0; y < size; y += 8)
+    for(int x = 0; x < size; x += 8) {
+      double sum = 0;
+      for(int row = y; row < y + 8; row++)
+        for(int column = x; column < x + 8; column++)
+          sum += noise[row * size + column];
+      ASSERT_NEAR(127.5, sum / 64, 10) << "block " << x << "," << y;
+    }
+}
+
+TEST(TestDepthReduction, testHistogramRangeLeavesOutHotAndDeadPixels) {
+  auto mapping = DepthReduction::from_histogram(histogram({{3, 1}, {200, 10000}, {1000, 50000}, {4000, 9998}, {65535, 1}}), true);
+  ASSERT_EQ(200, mapping.black);
+  ASSERT_EQ(4000, mapping.white);
+  ASSERT_TRUE(mapping.dither);
+}
+
+TEST(TestDepthReduction, testHistogramRangeOfAFlatFrame) {
+  auto mapping = DepthReduction::from_histogram(histogram({{500, 1000}}), false);
+  ASSERT_EQ(500, mapping.black);
+  ASSERT_EQ(501, mapping.white);
+}
+
+TEST(TestDepthReduction, testReducesToEightBitKeepingFormatAndMetadata) {
+  cv::Mat image(4, 6, CV_16UC3, cv::Scalar(0, 2048, 4095));
+  auto frame = make_shared<Frame>(Frame::RGB, image, Frame::LittleEndian);
+  frame->set_sequence(42);
+  DepthReduction reduction{DepthReduction::Mapping{0, 4095, false}};
+  auto reduced = reduction.reduce(frame);
+  ASSERT_EQ(8, reduced->bpp());
+  ASSERT_EQ(Frame::RGB, reduced->colorFormat());
+  ASSERT_EQ(frame->resolution(), reduced->resolution());
+  ASSERT_EQ(42u, reduced->sequence());
+  ASSERT_EQ(cv::Vec3b(0, 128, 255), reduced->mat().at<cv::Vec3b>(3, 5));
+}
+
+TEST(TestDepthReduction, testReducesBigEndianFrames) {
+  cv::Mat image(2, 70, CV_16UC1, cv::Scalar(0x0004)); // 1024, big endian
+  auto frame = make_shared<Frame>(Frame::Mono, image, Frame::BigEndian);
+  auto reduced = DepthReduction{DepthReduction::Mapping{1024, 2047, false}}.reduce(frame);
+  ASSERT_EQ(0, cv::countNonZero(reduced->mat()));
+}
+
+TEST(TestDepthReduction, testDitherKeepsTheMeanOfSmoothAreas) {
+  // 10.5 levels: rounding alone would band it all to 11
+  cv::Mat image(64, 64, CV_16UC1, cv::Scalar(42));
+  auto frame = make_shared<Frame>(Frame::Mono, image, Frame::LittleEndian);
+  auto reduced = DepthReduction{DepthReduction::Mapping{0, 1020, true}}.reduce(frame);
+  double minimum, maximum;
+  cv::minMaxLoc(reduced->mat(), &minimum, &maximum);
+  ASSERT_EQ(10, minimum);
+  ASSERT_EQ(11, maximum);
+  ASSERT_NEAR(10.5, cv::mean(reduced->mat())[0], 0.05);
+}
+
+TEST(TestDepthReduction, testLeavesEightBitFramesAlone) {
+  auto frame = make_shared<Frame>(Frame::Mono, cv::Mat(2, 2, CV_8UC1, cv::Scalar(7)));
+  ASSERT_EQ(frame, DepthReduction{DepthReduction::Mapping{}}.reduce(frame));
+}
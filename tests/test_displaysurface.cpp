@@ -0,0 +1,67 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/core/core.hpp>
+#include <QList>
+#include "image_handlers/frontend/displaysurface.h"
+
+TEST(TestDisplaySurface, testSwapsOnlyPublishedImages) {
+  DisplaySurface surface;
+  ASSERT_FALSE(surface.swap());
+  surface.back() = cv::Mat(4, 6, CV_8UC3, cv::Scalar::all(1));
+  surface.publish({2, 2, 12, 8}, {100, 80});
+  ASSERT_TRUE(surface.swap());
+  ASSERT_FALSE(surface.swap());
+  ASSERT_EQ(QSize(6, 4), surface.front().image.size());
+  ASSERT_EQ(QImage::Format_RGB888, surface.front().image.format());
+  ASSERT_EQ(QRect(2, 2, 12, 8), surface.front().frameRect);
+  ASSERT_EQ(QSize(100, 80), surface.front().frameSize);
+}
+
+TEST(TestDisplaySurface, testFrontIsNeverRenderedInto) {
+  DisplaySurface surface;
+  surface.back() = cv::Mat(4, 4, CV_8UC1, cv::Scalar{1});
+  surface.publish({0, 0, 4, 4}, {4, 4});
+  ASSERT_TRUE(surface.swap());
+  const uchar *front = surface.front().image.constBits();
+  // The worker keeps going without the view swapping: older published images are dropped, the front one stays
+  for(int value = 2; value < 6; value++) {
+    ASSERT_NE(front, surface.back().data);
+    surface.back().create(4, 4, CV_8UC1);
+    surface.back().setTo(cv::Scalar{value});
+    surface.publish({0, 0, 4, 4}, {4, 4});
+  }
+  ASSERT_EQ(1, front[0]);
+  ASSERT_EQ(front, surface.front().image.constBits());
+  ASSERT_TRUE(surface.swap());
+  ASSERT_EQ(5, surface.front().image.constBits()[0]);
+  ASSERT_EQ(QImage::Format_Grayscale8, surface.front().image.format());
+}
+
+TEST(TestDisplaySurface, testBuffersAreReused) {
+  DisplaySurface surface;
+  QList<const uchar*> buffers;
+  for(int frame = 0; frame < 9; frame++) {
+    surface.back().create(16, 16, CV_8UC3);
+    if(! buffers.contains(surface.back().data))
+      buffers.push_back(surface.back().data);
+    surface.publish({0, 0, 16, 16}, {16, 16});
+    surface.swap();
+  }
+  ASSERT_EQ(3, buffers.size());
+}
@@ -0,0 +1,94 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "image_handlers/frontend/edgedetection.h"
+
+namespace {
+cv::Mat test_image(int channels) {
+  cv::Mat image(120, 160, CV_8UC(channels));
+  cv::randu(image, 0, 64);
+  cv::circle(image, {80, 60}, 30, cv::Scalar::all(220), -1);
+  return image;
+}
+
+cv::Mat reference_sobel(const cv::Mat &source, int blur_size, int kernel_size, double scale, double delta) {
+  cv::Mat blurred, gray, grad_x, grad_y, result;
+  cv::GaussianBlur(source, blurred, {blur_size, blur_size}, 0, 0);
+  if(blurred.channels() == 1)
+    gray = blurred;
+  else
+    cv::cvtColor(blurred, gray, cv::COLOR_RGB2GRAY);
+  cv::Sobel(gray, grad_x, CV_32F, 1, 0, kernel_size, scale, delta);
+  cv::Sobel(gray, grad_y, CV_32F, 0, 1, kernel_size, scale, delta);
+  cv::convertScaleAbs(grad_x, grad_x);
+  cv::convertScaleAbs(grad_y, grad_y);
+  cv::addWeighted(grad_x, 0.5, grad_y, 0.5, 0, result);
+  return result;
+}
+
+cv::Mat reference_canny(const cv::Mat &source, double low_threshold, double ratio, int kernel_size, int blur_size) {
+  cv::Mat gray, edges;
+  if(source.channels() == 1)
+    gray = source;
+  else
+    cv::cvtColor(source, gray, cv::COLOR_RGB2GRAY);
+  cv::blur(gray, edges, {blur_size, blur_size});
+  cv::Canny(edges, edges, low_threshold, low_threshold * ratio, kernel_size);
+  cv::Mat result = cv::Mat::zeros(source.size(), source.type());
+  source.copyTo(result, edges);
+  return result;
+}
+
+bool same(const cv::Mat &a, const cv::Mat &b) {
+  return a.size() == b.size() && a.type() == b.type() && cv::countNonZero(a.reshape(1) != b.reshape(1)) == 0;
+}
+}
+
+TEST(TestEdgeDetection, testSobelMatchesOpenCV) {
+  EdgeDetection edges;
+  edges.setOpenCL(false);
+  for(int channels: {1, 3}) {
+    auto source = test_image(channels);
+    cv::Mat image = source.clone();
+    edges.sobel(image, 3, 3, 1, 0);
+    ASSERT_TRUE(same(reference_sobel(source, 3, 3, 1, 0), image));
+  }
+}
+
+TEST(TestEdgeDetection, testCannyMatchesOpenCV) {
+  EdgeDetection edges;
+  edges.setOpenCL(false);
+  for(int channels: {3, 1, 3}) {
+    auto source = test_image(channels);
+    cv::Mat image = source.clone();
+    edges.canny(image, 20, 3, 3, 3);
+    ASSERT_TRUE(same(reference_canny(source, 20, 3, 3, 3), image));
+  }
+}
+
+TEST(TestEdgeDetection, testBuffersFollowSizeChanges) {
+  EdgeDetection edges;
+  edges.setOpenCL(false);
+  cv::Mat image = test_image(3);
+  edges.sobel(image, 3, 3, 1, 0);
+  cv::Mat smaller = test_image(3)(cv::Rect{0, 0, 64, 48}).clone();
+  cv::Mat expected = reference_sobel(smaller, 3, 3, 1, 0);
+  edges.sobel(smaller, 3, 3, 1, 0);
+  ASSERT_TRUE(same(expected, smaller));
+}
@@ -0,0 +1,46 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <future>
+#include "commons/executor.h"
+
+TEST(TestExecutor, testReturnsTheJobResult) {
+  Executor executor{"test_result", 2, 4, 0};
+  auto future = executor.run([]{ return 42; });
+  ASSERT_EQ(42, future.result());
+  executor.waitForDone();
+  ASSERT_EQ(0, executor.queued());
+}
+
+TEST(TestExecutor, testRejectsJobsOverCapacity) {
+  Executor executor{"test_capacity", 1, 2, 0};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::atomic_int done{0};
+  ASSERT_TRUE(executor.tryRun([&, released]{ released.wait(); ++done; }));
+  ASSERT_TRUE(executor.tryRun([&]{ ++done; }));
+  ASSERT_EQ(2, executor.queued());
+  ASSERT_FALSE(executor.tryRun([&]{ ++done; }));
+  release.set_value();
+  executor.waitForDone();
+  ASSERT_EQ(2, done.load());
+  ASSERT_EQ(0, executor.queued());
+  ASSERT_TRUE(executor.tryRun([&]{ ++done; }));
+  executor.waitForDone();
+  ASSERT_EQ(3, done.load());
+}
@@ -0,0 +1,58 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <cmath>
+#include "commons/exposurecontrol.h"
+
+namespace {
+const ExposureControl::Limits exposure_only{0.0001, 0.02, 0, 0, 0};
+const ExposureControl::Limits with_gain{0.0001, 0.02, 0, 300, 60};
+}
+
+TEST(TestExposureControl, testHysteresis) {
+  ExposureControl control{0.7, 0.05};
+  const ExposureControl::Point current{0.01, 0};
+  // Within 3 tolerances: left alone
+  ASSERT_DOUBLE_EQ(0.01, control.next(current, 0.8, exposure_only).exposure);
+  ASSERT_FALSE(control.adjusting());
+  // Further off: corrected, and then again until within one tolerance
+  ASSERT_DOUBLE_EQ(0.01 * 0.7 / 0.9, control.next(current, 0.9, exposure_only).exposure);
+  ASSERT_TRUE(control.adjusting());
+  ASSERT_DOUBLE_EQ(0.01 * 0.7 / 0.8, control.next(current, 0.8, exposure_only).exposure);
+  ASSERT_DOUBLE_EQ(0.01, control.next(current, 0.74, exposure_only).exposure);
+  ASSERT_FALSE(control.adjusting());
+}
+
+TEST(TestExposureControl, testStepsAreLimited) {
+  ExposureControl control;
+  ASSERT_DOUBLE_EQ(0.005, control.next({0.01, 0}, 1, exposure_only).exposure);
+  ASSERT_DOUBLE_EQ(0.002, control.next({0.001, 0}, 0.01, exposure_only).exposure);
+  ASSERT_DOUBLE_EQ(0.002, control.next({0.001, 0}, 0, exposure_only).exposure);
+}
+
+TEST(TestExposureControl, testGainOnlyPastTheExposureLimit) {
+  ExposureControl control;
+  // 0.35 -> 0.7 needs twice the light: exposure goes to its 20ms limit, gain makes up for the other 4/3
+  auto next = control.next({0.015, 100}, 0.35, with_gain);
+  ASSERT_DOUBLE_EQ(0.02, next.exposure);
+  ASSERT_NEAR(100 + 60 * std::log2(1.5), next.gain, 1e-9);
+  // Darker: gain goes down first, to its minimum, then exposure
+  next = control.next({0.02, 30}, 1, with_gain);
+  ASSERT_DOUBLE_EQ(0, next.gain);
+  ASSERT_NEAR(0.02 / std::sqrt(2.), next.exposure, 1e-12);
+}
@@ -0,0 +1,77 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include "commons/exposureprogress.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+TEST(TestExposureProgress, testFollowsOneExposure) {
+  ExposureProgress progress;
+  const auto start = ExposureProgress::Clock::now();
+  ASSERT_EQ(ExposureProgress::Idle, progress.status(start).state);
+
+  progress.started(5s, start);
+  auto status = progress.status(start + 2s);
+  ASSERT_EQ(ExposureProgress::Exposing, status.state);
+  ASSERT_DOUBLE_EQ(5, status.exposure.count());
+  ASSERT_DOUBLE_EQ(2, status.elapsed.count());
+  ASSERT_DOUBLE_EQ(3, status.remaining().count());
+  ASSERT_EQ(1u, status.shot);
+  // Runs late: no negative remaining time
+  ASSERT_DOUBLE_EQ(0, progress.status(start + 7s).remaining().count());
+
+  progress.reading_out();
+  status = progress.status(start + 6s);
+  ASSERT_EQ(ExposureProgress::ReadingOut, status.state);
+  ASSERT_DOUBLE_EQ(0, status.remaining().count());
+
+  progress.finished();
+  ASSERT_EQ(ExposureProgress::Idle, progress.status(start + 8s).state);
+  progress.started(5s, start + 8s);
+  ASSERT_EQ(2u, progress.status(start + 9s).shot);
+}
+
+TEST(TestExposureProgress, testReadoutWithoutExposureIsIgnored) {
+  ExposureProgress progress;
+  progress.reading_out();
+  ASSERT_EQ(ExposureProgress::Idle, progress.status().state);
+}
+
+TEST(TestExposureProgress, testReadersNeverSeeHalfWrittenExposures) {
+  ExposureProgress progress;
+  const ExposureProgress::Clock::time_point epoch{};
+  atomic_bool running{true};
+  // Each exposure starts k seconds after the epoch and lasts k seconds: elapsed + exposure is always the same
+  thread writer{[&]{
+    for(int k = 1; running; k = k % 500 + 1) {
+      progress.started(chrono::seconds{k}, epoch + chrono::seconds{k});
+      progress.finished();
+    }
+  }};
+  for(int i = 0; i < 100000; i++) {
+    const auto status = progress.status(epoch + 1000s);
+    if(status.state == ExposureProgress::Exposing) {
+      ASSERT_DOUBLE_EQ(1000, status.elapsed.count() + status.exposure.count());
+    }
+  }
+  running = false;
+  writer.join();
+}
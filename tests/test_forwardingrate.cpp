@@ -0,0 +1,85 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "network/server/forwardingrate.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+const auto start = ForwardingRate::Clock::time_point{} + hours{1};
+}
+
+TEST(TestForwardingRate, testRespectsMinimumInterval) {
+  ForwardingRate rate;
+  ASSERT_TRUE(rate.accept(start, 0));
+  rate.sent(start, 1000);
+  rate.acknowledged(start + milliseconds{5});
+  ASSERT_FALSE(rate.accept(start + milliseconds{20}, 0));
+  ASSERT_TRUE(rate.accept(start + milliseconds{50}, 0));
+}
+
+TEST(TestForwardingRate, testDropsWhenTooManyFramesAreUnacknowledged) {
+  ForwardingRate rate;
+  auto now = start;
+  for(int i = 0; i < 2; i++) {
+    ASSERT_TRUE(rate.accept(now, 0));
+    rate.sent(now, 1000);
+    now += milliseconds{60};
+  }
+  ASSERT_FALSE(rate.accept(now, 0));
+  rate.acknowledged(now);
+  ASSERT_TRUE(rate.accept(now, 0));
+}
+
+TEST(TestForwardingRate, testDropsWhenBacklogGrows) {
+  ForwardingRate rate;
+  rate.sent(start, 1000000);
+  rate.acknowledged(start + milliseconds{10});
+  ASSERT_FALSE(rate.accept(start + seconds{1}, 3000000));
+  ASSERT_TRUE(rate.accept(start + seconds{1}, 1000000));
+}
+
+TEST(TestForwardingRate, testUnacknowledgedFramesExpire) {
+  ForwardingRate rate;
+  rate.sent(start, 1000);
+  rate.sent(start + milliseconds{60}, 1000);
+  ASSERT_FALSE(rate.accept(start + milliseconds{500}, 0));
+  ASSERT_TRUE(rate.accept(start + seconds{3}, 0));
+}
+
+TEST(TestForwardingRate, testSlowLinkDegradesAndRecovers) {
+  ForwardingRate rate;
+  auto now = start;
+  auto exchange = [&](milliseconds delay) {
+    rate.sent(now, 100000);
+    now += delay;
+    rate.acknowledged(now);
+  };
+  for(int i = 0; i < 40; i++)
+    exchange(milliseconds{800});
+  ASSERT_EQ(ForwardingRate::max_level, rate.level());
+  ASSERT_LT(rate.scale(), 1);
+  ASSERT_LT(rate.jpeg_quality_factor(), 1);
+
+  for(int i = 0; i < 80; i++)
+    exchange(milliseconds{20});
+  ASSERT_EQ(0, rate.level());
+  ASSERT_DOUBLE_EQ(1, rate.scale());
+  ASSERT_DOUBLE_EQ(1, rate.jpeg_quality_factor());
+}
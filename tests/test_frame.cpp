@@ -19,6 +19,7 @@
 #include "gtest/gtest.h"
 #include <opencv2/opencv.hpp>
 #include "commons/frame.h"
+#include "commons/framesequence.h"
 
 using namespace std;
 
@@ -44,3 +45,81 @@ TEST(TestFrame, testFrameMatConstructor)
     for(int y=0; y < testImage.rows; y++)
       ASSERT_EQ(testImage.at<cv::Vec3b>(cv::Point(x, y)), frame->mat().at<cv::Vec3b>(cv::Point(x, y)));
 }
+
+TEST(TestFrame, testCropped)
+{
+  auto testImage = testMat();
+  auto frame = make_shared<Frame>(Frame::ColorFormat::BGR, testImage, Frame::LittleEndian);
+  frame->set_exposure(Frame::Seconds{0.5});
+  frame->set_sequence(42);
+  frame->set_device_timestamp(Frame::Timestamp{123456});
+  auto cropped = frame->cropped(cv::Rect{1, 0, 2, 2});
+  ASSERT_EQ(QSize(2, 2), cropped->resolution());
+  ASSERT_EQ(frame->created_utc(), cropped->created_utc());
+  ASSERT_EQ(frame->exposure(), cropped->exposure());
+  ASSERT_EQ(frame->captured(), cropped->captured());
+  ASSERT_EQ(42u, cropped->sequence());
+  ASSERT_TRUE(cropped->has_device_timestamp());
+  ASSERT_EQ(Frame::Timestamp{123456}, cropped->device_timestamp());
+  ASSERT_EQ(Frame::LittleEndian, cropped->byteOrder());
+  ASSERT_EQ(testImage.at<cv::Vec3b>(cv::Point(1, 1)), cropped->mat().at<cv::Vec3b>(cv::Point(0, 1)));
+  // The crop is a copy
+  cropped->mat().at<cv::Vec3b>(cv::Point(0, 0)) = cv::Vec3b(1, 1, 1);
+  ASSERT_EQ(cv::Vec3b(0, 255, 0), frame->mat().at<cv::Vec3b>(cv::Point(1, 0)));
+}
+
+TEST(TestFrame, testCopyMetadata)
+{
+  auto frame = make_shared<Frame>(Frame::ColorFormat::BGR, testMat(), Frame::LittleEndian);
+  ASSERT_EQ(0u, frame->sequence());
+  ASSERT_FALSE(frame->has_device_timestamp());
+  frame->set_sequence(7);
+  frame->set_exposure(Frame::Seconds{0.01});
+  auto derived = make_shared<Frame>(Frame::ColorFormat::Mono, cv::Mat{cv::Size{3, 2}, CV_8UC1}, Frame::LittleEndian);
+  derived->copy_metadata(*frame);
+  ASSERT_EQ(7u, derived->sequence());
+  ASSERT_EQ(frame->exposure(), derived->exposure());
+  ASSERT_EQ(frame->created_utc(), derived->created_utc());
+  ASSERT_EQ(frame->captured(), derived->captured());
+  ASSERT_FALSE(derived->has_device_timestamp());
+}
+
+TEST(TestFrame, testMetadata)
+{
+  auto frame = make_shared<Frame>(Frame::ColorFormat::BGR, testMat(), Frame::LittleEndian);
+  ASSERT_FALSE(frame->metadata().has_gain());
+  ASSERT_FALSE(frame->metadata().has_temperature());
+  ASSERT_FALSE(frame->metadata().has_roi_offset());
+  Frame::Metadata metadata;
+  metadata.gain = 250;
+  metadata.temperature = -10.5;
+  metadata.driver_sequence = 1234;
+  metadata.roi_x = 64;
+  metadata.roi_y = 32;
+  metadata.bin = 2;
+  frame->set_metadata(metadata);
+  auto derived = make_shared<Frame>(Frame::ColorFormat::Mono, cv::Mat{cv::Size{3, 2}, CV_8UC1}, Frame::LittleEndian);
+  derived->copy_metadata(*frame);
+  ASSERT_EQ(250, derived->metadata().gain);
+  ASSERT_EQ(-10.5, derived->metadata().temperature);
+  ASSERT_EQ(1234u, derived->metadata().driver_sequence);
+  // Crops move the ROI offset
+  auto cropped = frame->cropped(cv::Rect{1, 1, 2, 1});
+  ASSERT_EQ(65, cropped->metadata().roi_x);
+  ASSERT_EQ(33, cropped->metadata().roi_y);
+  ASSERT_EQ(2, cropped->metadata().bin);
+  ASSERT_EQ(250, cropped->metadata().gain);
+}
+
+TEST(TestFrame, testSequenceGaps)
+{
+  FrameSequence sequence;
+  ASSERT_EQ(0u, sequence.next(1));
+  ASSERT_EQ(0u, sequence.next(2));
+  ASSERT_EQ(2u, sequence.next(5));
+  ASSERT_EQ(0u, sequence.next(0)); // unknown sequence, ignored
+  ASSERT_EQ(0u, sequence.next(1)); // starting over
+  ASSERT_EQ(1u, sequence.next(3));
+  ASSERT_EQ(5u, sequence.received());
+  ASSERT_EQ(3u, sequence.missing());
+}
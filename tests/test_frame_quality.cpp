@@ -0,0 +1,123 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <random>
+#include "commons/frame.h"
+#include "commons/frame_quality.h"
+
+using namespace std;
+
+namespace {
+cv::Mat disc(int blur) {
+  cv::Mat image{cv::Size{200, 160}, CV_16UC1, cv::Scalar{1000}};
+  cv::circle(image, cv::Point{100, 80}, 50, cv::Scalar{40000}, -1);
+  if(blur > 0)
+    cv::GaussianBlur(image, image, cv::Size{0, 0}, blur);
+  return image;
+}
+
+cv::Mat star(double sigma, const cv::Point2d &centre = {60.3, 50.7}) {
+  cv::Mat image{cv::Size{120, 100}, CV_32FC1};
+  for(int y = 0; y < image.rows; y++)
+    for(int x = 0; x < image.cols; x++)
+      image.at<float>(y, x) = 100 + 1000 * exp(-((x - centre.x) * (x - centre.x) + (y - centre.y) * (y - centre.y)) / (2 * sigma * sigma));
+  return image;
+}
+}
+
+TEST(TestFrameQuality, testBlurLowersSharpness) {
+  const auto sharp = FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, disc(0), Frame::LittleEndian));
+  const auto soft = FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, disc(2), Frame::LittleEndian));
+  const auto softer = FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, disc(4), Frame::LittleEndian));
+  ASSERT_GT(sharp, soft);
+  ASSERT_GT(soft, softer);
+}
+
+TEST(TestFrameQuality, testIndependentOfBrightnessAndByteOrder) {
+  cv::Mat dimmer;
+  disc(2).convertTo(dimmer, CV_16U, 0.5);
+  const auto reference = FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, disc(2), Frame::LittleEndian));
+  ASSERT_NEAR(reference, FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, dimmer, Frame::LittleEndian)), reference * 1e-2);
+  cv::Mat swapped = disc(2);
+  for(auto it = swapped.begin<uint16_t>(); it != swapped.end<uint16_t>(); ++it)
+    *it = static_cast<uint16_t>((*it >> 8) | (*it << 8));
+  ASSERT_NEAR(reference, FrameQuality::sharpness(make_shared<Frame>(Frame::Mono, swapped, Frame::BigEndian)), reference * 1e-3);
+}
+
+TEST(TestFrameQuality, testBayerPatternIsNotSharpness) {
+  // A flat field seen through the colour filter: full of pixel to pixel steps, but no detail
+  cv::Mat bayer{cv::Size{64, 64}, CV_8UC1};
+  for(int y = 0; y < bayer.rows; y++)
+    for(int x = 0; x < bayer.cols; x++)
+      bayer.at<uint8_t>(y, x) = (x % 2 == y % 2) ? 200 : 50;
+  ASSERT_NEAR(0, FrameQuality::sharpness(make_shared<Frame>(Frame::Bayer_RGGB, bayer)), 1e-9);
+}
+
+TEST(TestFrameQuality, testBrennerFallsWithBlur) {
+  const auto gray = [](const cv::Mat &image) { return FrameQuality::gray(make_shared<Frame>(Frame::Mono, image, Frame::LittleEndian)); };
+  const auto sharp = FrameQuality::brenner(gray(disc(0))), soft = FrameQuality::brenner(gray(disc(2))), softer = FrameQuality::brenner(gray(disc(4)));
+  ASSERT_GT(sharp, soft);
+  ASSERT_GT(soft, softer);
+}
+
+TEST(TestFrameQuality, testGrayCropsToWholeBayerCells) {
+  cv::Mat bayer{cv::Size{64, 64}, CV_8UC1, cv::Scalar{10}};
+  bayer(cv::Rect{20, 20, 10, 10}).setTo(cv::Scalar{200});
+  const auto gray = FrameQuality::gray(make_shared<Frame>(Frame::Bayer_RGGB, bayer), cv::Rect{21, 21, 9, 9});
+  ASSERT_EQ(cv::Size(5, 5), gray.size());
+  ASSERT_FLOAT_EQ(200, gray.at<float>(0, 0));
+}
+
+TEST(TestFrameQuality, testStarSizes) {
+  const auto measured = FrameQuality::star(star(2.5));
+  // Both are 2.355 sigma for a gaussian star
+  ASSERT_NEAR(5.89, measured.fwhm, 0.6);
+  ASSERT_NEAR(5.89, measured.hfd, 0.6);
+  ASSERT_NEAR(60.3, measured.centre.x, 0.1);
+  ASSERT_NEAR(50.7, measured.centre.y, 0.1);
+  const auto defocused = FrameQuality::star(star(4));
+  ASSERT_GT(defocused.hfd, measured.hfd * 1.4);
+  ASSERT_GT(defocused.fwhm, measured.fwhm * 1.4);
+}
+
+TEST(TestFrameQuality, testNoStarOnAnEmptySky) {
+  const auto measured = FrameQuality::star(cv::Mat{cv::Size{64, 64}, CV_32FC1, cv::Scalar{100}});
+  ASSERT_EQ(0, measured.hfd);
+  ASSERT_EQ(0, measured.fwhm);
+}
+
+TEST(TestFrameQuality, testSelectorKeepsTheTopPercentage) {
+  FrameQuality::Selector selector{10, 100};
+  mt19937 generator{42};
+  uniform_real_distribution<double> scores{0, 1};
+  for(int i = 0; i < 100; i++)
+    selector.keep(scores(generator));
+  int kept = 0;
+  for(int i = 0; i < 10000; i++)
+    kept += selector.keep(scores(generator));
+  ASSERT_NEAR(1000, kept, 150);
+}
+
+TEST(TestFrameQuality, testSelectorAlwaysKeepsTheBest) {
+  FrameQuality::Selector selector{1, 1000};
+  ASSERT_TRUE(selector.keep(1));
+  ASSERT_FALSE(selector.keep(0.5));
+  ASSERT_TRUE(selector.keep(2));
+}
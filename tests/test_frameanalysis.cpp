@@ -0,0 +1,100 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+#include "commons/frame.h"
+#include "commons/frameanalysis.h"
+#include "commons/frame_quality.h"
+
+using namespace std;
+
+namespace {
+cv::Mat disc(const cv::Point &centre = {100, 80}) {
+  cv::Mat image{cv::Size{200, 160}, CV_16UC1, cv::Scalar{1000}};
+  cv::circle(image, centre, 20, cv::Scalar{40000}, -1);
+  cv::GaussianBlur(image, image, cv::Size{0, 0}, 2);
+  return image;
+}
+}
+
+TEST(TestFrameAnalysis, testProductsAreComputedOnce) {
+  auto frame = make_shared<Frame>(Frame::Mono, disc(), Frame::LittleEndian);
+  const auto &first = frame->analysis().histogram({}, 2);
+  const auto &second = frame->analysis().histogram({}, 2);
+  ASSERT_EQ(&first, &second);
+  ASSERT_NE(&first, &frame->analysis().histogram({}, 1));
+  ASSERT_EQ(&frame->analysis().gray(), &frame->analysis().gray({0, 0, 200, 160}));
+}
+
+TEST(TestFrameAnalysis, testMatchesTheStandaloneMeasures) {
+  auto frame = make_shared<Frame>(Frame::Mono, disc(), Frame::LittleEndian);
+  ASSERT_DOUBLE_EQ(FrameQuality::sharpness(frame), frame->analysis().sharpness());
+  const auto &counts = frame->analysis().histogram();
+  ASSERT_EQ(1u, counts.size());
+  ASSERT_EQ(65536u, counts[0].size());
+  const auto &statistics = frame->analysis().statistics();
+  ASSERT_NEAR(1000, statistics[0].minimum, 1);
+  ASSERT_GT(statistics[0].maximum, 39000);
+}
+
+TEST(TestFrameAnalysis, testWindowFollowsTheCentroid) {
+  auto frame = make_shared<Frame>(Frame::Bayer_RGGB, disc({151, 41}), Frame::LittleEndian);
+  const auto window = frame->analysis().centred_window(40);
+  ASSERT_EQ(40, window.width);
+  ASSERT_EQ(40, window.height);
+  ASSERT_EQ(0, window.x % 2);
+  ASSERT_EQ(0, window.y % 2);
+  ASSERT_NEAR(131, window.x, 2);
+  ASSERT_NEAR(21, window.y, 2);
+  ASSERT_EQ(cv::Rect(0, 0, 200, 160), frame->analysis().centred_window(0));
+}
+
+TEST(TestFrameAnalysis, testConcurrentStagesShareOneProduct) {
+  auto frame = make_shared<Frame>(Frame::Mono, disc(), Frame::LittleEndian);
+  vector<const cv::Mat*> seen(8);
+  vector<thread> stages;
+  for(size_t i = 0; i < seen.size(); i++)
+    stages.emplace_back([&, i]{ seen[i] = &frame->analysis().gray(); });
+  for(auto &stage: stages)
+    stage.join();
+  for(auto gray: seen)
+    ASSERT_EQ(seen[0], gray);
+}
+
+TEST(TestFrameAnalysis, testFormatViewsAreSharedAndConvertedOnce) {
+  cv::Mat swapped = disc();
+  for(auto it = swapped.begin<uint16_t>(); it != swapped.end<uint16_t>(); ++it)
+    *it = static_cast<uint16_t>((*it >> 8) | (*it << 8));
+  auto frame = make_shared<Frame>(Frame::Bayer_RGGB, swapped, Frame::BigEndian);
+  const auto &native = frame->analysis().native_endian();
+  ASSERT_NE(frame->mat().data, native.data);
+  ASSERT_EQ(1000, native.at<uint16_t>(0, 0));
+  const auto &eight_bit = frame->analysis().as_8bit();
+  ASSERT_EQ(CV_8UC1, eight_bit.type());
+  ASSERT_EQ(4, eight_bit.at<uint8_t>(0, 0));
+  ASSERT_EQ(&eight_bit, &frame->analysis().as_8bit());
+  const auto &half = frame->analysis().debayered_half();
+  ASSERT_EQ(CV_8UC3, half.type());
+  ASSERT_EQ(cv::Size(100, 80), half.size());
+
+  auto mono = make_shared<Frame>(Frame::Mono, cv::Mat{cv::Size{8, 8}, CV_8UC1, cv::Scalar{7}});
+  ASSERT_EQ(mono->mat().data, mono->analysis().as_8bit().data);
+  ASSERT_TRUE(mono->analysis().debayered_half().empty());
+}
@@ -0,0 +1,77 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/framearena.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// 64 bytes per frame, the arena alignment
+FrameConstPtr test_frame(uint8_t value) {
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{8, 8});
+  frame->mat().setTo(value);
+  frame->set_sequence(value);
+  return frame;
+}
+}
+
+TEST(TestFrameArena, testStoreCopiesPixelsAndMetadata)
+{
+  FrameArena arena{1024};
+  auto source = test_frame(42);
+  auto copy = arena.store(source);
+  ASSERT_TRUE(copy);
+  ASSERT_NE(source->mat().data, copy->mat().data);
+  ASSERT_EQ(0, cv::countNonZero(copy->mat() != 42));
+  ASSERT_EQ(42, copy->sequence());
+  ASSERT_EQ(source->captured(), copy->captured());
+  ASSERT_EQ(64, arena.used());
+}
+
+TEST(TestFrameArena, testFullArena)
+{
+  FrameArena arena{64 * 3};
+  auto first = arena.store(test_frame(1));
+  auto second = arena.store(test_frame(2));
+  auto third = arena.store(test_frame(3));
+  ASSERT_TRUE(third);
+  ASSERT_FALSE(arena.store(test_frame(4)));
+  first.reset();
+  ASSERT_EQ(64 * 2, arena.used());
+  // Wraps around to the room given back by the first frame
+  auto fourth = arena.store(test_frame(4));
+  ASSERT_TRUE(fourth);
+  ASSERT_EQ(0, cv::countNonZero(second->mat() != 2));
+  ASSERT_EQ(0, cv::countNonZero(third->mat() != 3));
+}
+
+TEST(TestFrameArena, testOutOfOrderRelease)
+{
+  FrameArena arena{64 * 2};
+  auto first = arena.store(test_frame(1));
+  auto second = arena.store(test_frame(2));
+  second.reset();
+  // The oldest frame still holds the beginning of the region
+  ASSERT_FALSE(arena.store(test_frame(3)));
+  first.reset();
+  ASSERT_EQ(0, arena.used());
+  ASSERT_TRUE(arena.store(test_frame(5)));
+}
@@ -0,0 +1,95 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include "network/framedatagrams.h"
+
+namespace {
+  QByteArray frameData(int size, char fill = 'x') {
+    QByteArray data(size, fill);
+    for(int i = 0; i < size; i += 97)
+      data[i] = static_cast<char>(i / 97);
+    return data;
+  }
+}
+
+TEST(TestFrameDatagrams, testSplitSizes)
+{
+  auto datagrams = FrameDatagrams::split(frameData(FrameDatagrams::max_chunk_size * 2 + 10), 1);
+  ASSERT_EQ(3, datagrams.size());
+  ASSERT_EQ(FrameDatagrams::header_size + FrameDatagrams::max_chunk_size, datagrams[0].size());
+  ASSERT_EQ(FrameDatagrams::header_size + 10, datagrams[2].size());
+}
+
+TEST(TestFrameDatagrams, testReassembleOutOfOrder)
+{
+  auto data = frameData(5000);
+  auto datagrams = FrameDatagrams::split(data, 7);
+  FrameDatagrams receiver;
+  ASSERT_TRUE(receiver.add(datagrams[3]).isEmpty());
+  ASSERT_TRUE(receiver.add(datagrams[0]).isEmpty());
+  ASSERT_TRUE(receiver.add(datagrams[2]).isEmpty());
+  ASSERT_EQ(data, receiver.add(datagrams[1]));
+  ASSERT_EQ(0u, receiver.dropped_frames());
+}
+
+TEST(TestFrameDatagrams, testDuplicatesIgnored)
+{
+  auto data = frameData(3000);
+  auto datagrams = FrameDatagrams::split(data, 1);
+  FrameDatagrams receiver;
+  receiver.add(datagrams[0]);
+  receiver.add(datagrams[0]);
+  receiver.add(datagrams[1]);
+  ASSERT_EQ(data, receiver.add(datagrams[2]));
+  ASSERT_TRUE(receiver.add(datagrams[2]).isEmpty());
+}
+
+TEST(TestFrameDatagrams, testLostDatagramDropsFrame)
+{
+  auto first = FrameDatagrams::split(frameData(3000, 'a'), 1);
+  auto second_data = frameData(3000, 'b');
+  auto second = FrameDatagrams::split(second_data, 2);
+  FrameDatagrams receiver;
+  receiver.add(first[0]);
+  receiver.add(first[2]);
+  for(int i = 0; i < second.size() - 1; i++)
+    ASSERT_TRUE(receiver.add(second[i]).isEmpty());
+  // The missing datagram of the first frame arrives late: it's not retransmitted, and not waited for
+  ASSERT_TRUE(receiver.add(first[1]).isEmpty());
+  ASSERT_EQ(second_data, receiver.add(second.last()));
+  ASSERT_EQ(1u, receiver.dropped_frames());
+}
+
+TEST(TestFrameDatagrams, testSenderRestart)
+{
+  auto old_frame = FrameDatagrams::split(frameData(10), 5000);
+  auto new_frame = FrameDatagrams::split(frameData(20), 1);
+  FrameDatagrams receiver;
+  ASSERT_FALSE(receiver.add(old_frame[0]).isEmpty());
+  ASSERT_EQ(frameData(20), receiver.add(new_frame[0]));
+}
+
+TEST(TestFrameDatagrams, testInvalidDatagrams)
+{
+  FrameDatagrams receiver;
+  ASSERT_TRUE(receiver.add(QByteArray("PI")).isEmpty());
+  auto datagram = FrameDatagrams::split(frameData(10), 1)[0];
+  datagram[0] = 'X';
+  ASSERT_TRUE(receiver.add(datagram).isEmpty());
+}
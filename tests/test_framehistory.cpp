@@ -0,0 +1,67 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "network/client/framehistory.h"
+#include "network/networkpacket.h"
+#include "network/protocol/driverprotocol.h"
+
+namespace {
+  NetworkPacketPtr packet(int bytes) {
+    auto packet = std::make_shared<NetworkPacket>(DriverProtocol::SendCodedFrame);
+    packet->setPayload(QByteArray(bytes, 'x'));
+    return packet;
+  }
+}
+
+TEST(TestFrameHistory, testNumbersFramesAsTheyCome)
+{
+  FrameHistory history;
+  ASSERT_EQ(0u, history.first());
+  ASSERT_EQ(0u, history.last());
+  for(int i = 0; i < 3; i++)
+    history.add(packet(100));
+  ASSERT_EQ(1u, history.first());
+  ASSERT_EQ(3u, history.last());
+  ASSERT_EQ(300u, history.bytes());
+  ASSERT_LE(history.received(1), history.received(3));
+  ASSERT_EQ(FrameHistory::Clock::time_point{}, history.received(4));
+}
+
+TEST(TestFrameHistory, testDropsTheOldestFramesBeyondTheBudget)
+{
+  FrameHistory history{250};
+  for(int i = 0; i < 5; i++)
+    history.add(packet(100));
+  ASSERT_EQ(4u, history.first());
+  ASSERT_EQ(5u, history.last());
+  ASSERT_EQ(200u, history.bytes());
+  ASSERT_FALSE(history.frame(3));
+  history.clear();
+  ASSERT_EQ(0u, history.last());
+  ASSERT_EQ(0u, history.bytes());
+}
+
+TEST(TestFrameHistory, testKeepsAFrameLargerThanTheBudget)
+{
+  FrameHistory history{50};
+  history.add(packet(100));
+  history.add(packet(100));
+  ASSERT_EQ(2u, history.first());
+  ASSERT_EQ(100u, history.bytes());
+}
@@ -0,0 +1,111 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "drivers/simulator/framepacer.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+const FramePacer::Clock::time_point start = FramePacer::Clock::now();
+}
+
+TEST(TestFramePacer, testFlatOut)
+{
+  FramePacer pacer;
+  FramePacer::Settings settings;
+  for(int i = 0; i < 10; i++)
+    ASSERT_EQ(start + i * 1ms, pacer.next(settings, start + i * 1ms));
+}
+
+TEST(TestFramePacer, testTargetRate)
+{
+  FramePacer pacer;
+  FramePacer::Settings settings;
+  settings.fps = 100;
+  auto deadline = pacer.next(settings, start);
+  ASSERT_EQ(start, deadline);
+  for(int i = 1; i < 10; i++) {
+    auto next = pacer.next(settings, deadline);
+    ASSERT_EQ(10ms, chrono::duration_cast<chrono::milliseconds>(next - deadline));
+    deadline = next;
+  }
+}
+
+TEST(TestFramePacer, testJitterWithinBounds)
+{
+  FramePacer pacer{1};
+  FramePacer::Settings settings;
+  settings.fps = 100;
+  settings.jitter = 0.5;
+  auto deadline = pacer.next(settings, start);
+  bool varies = false;
+  for(int i = 1; i < 100; i++) {
+    auto next = pacer.next(settings, deadline);
+    ASSERT_GE(next - deadline, 5ms);
+    ASSERT_LE(next - deadline, 15ms);
+    varies = varies || chrono::duration_cast<chrono::microseconds>(next - deadline) != 10ms;
+    deadline = next;
+  }
+  ASSERT_TRUE(varies);
+}
+
+TEST(TestFramePacer, testLateFramesDontCatchUp)
+{
+  FramePacer pacer;
+  FramePacer::Settings settings;
+  settings.fps = 100;
+  pacer.next(settings, start);
+  // One second late: the next frame is due now, then the rate restarts from there
+  auto late = start + 1s;
+  auto deadline = pacer.next(settings, late);
+  ASSERT_LE(deadline, late);
+  ASSERT_GE(deadline, late - 10ms);
+  ASSERT_EQ(deadline + 10ms, pacer.next(settings, deadline));
+}
+
+TEST(TestFramePacer, testBursts)
+{
+  FramePacer pacer;
+  FramePacer::Settings settings;
+  settings.fps = 10;
+  settings.burst_every = 5;
+  settings.burst_length = 3;
+  auto now = start;
+  for(int frame = 1; frame < 10; frame++) {
+    auto deadline = pacer.next(settings, now);
+    if(frame == 1 || (frame >= 5 && frame <= 7))
+      ASSERT_EQ(now, deadline) << "frame " << frame;
+    else
+      ASSERT_EQ(now + 100ms, deadline) << "frame " << frame;
+    now = deadline;
+  }
+}
+
+TEST(TestFramePacer, testStalls)
+{
+  FramePacer pacer;
+  FramePacer::Settings settings;
+  settings.stall_every = 3;
+  settings.stall = 500ms;
+  ASSERT_EQ(start, pacer.next(settings, start));
+  ASSERT_EQ(start, pacer.next(settings, start));
+  ASSERT_EQ(start + 500ms, pacer.next(settings, start));
+  ASSERT_EQ(start + 500ms, pacer.next(settings, start + 500ms));
+}
@@ -0,0 +1,140 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/framepool.h"
+
+using namespace std;
+
+TEST(TestFramePool, testBufferIsRecycled)
+{
+  FramePool pool;
+  auto frame = pool.acquire(8, Frame::Mono, {320, 240});
+  auto data = frame->data();
+  frame.reset();
+  ASSERT_EQ(1, pool.free_buffers());
+  frame = pool.acquire(8, Frame::Mono, {320, 240});
+  ASSERT_EQ(data, frame->data());
+  ASSERT_EQ(1, pool.allocations());
+  ASSERT_EQ(1, pool.recycled());
+  ASSERT_EQ(0, pool.free_buffers());
+}
+
+TEST(TestFramePool, testReferencedBufferIsNotRecycled)
+{
+  FramePool pool;
+  auto frame = pool.acquire(16, Frame::Mono, {320, 240});
+  cv::Mat still_referenced = frame->mat();
+  frame.reset();
+  ASSERT_EQ(0, pool.free_buffers());
+}
+
+TEST(TestFramePool, testResolutionChangeDropsBuffers)
+{
+  FramePool pool;
+  pool.acquire(8, Frame::BGR, {320, 240});
+  ASSERT_EQ(1, pool.free_buffers());
+  auto frame = pool.acquire(8, Frame::BGR, {640, 480});
+  ASSERT_EQ(0, pool.free_buffers());
+  ASSERT_EQ(2, pool.allocations());
+  ASSERT_EQ(3, frame->channels());
+  frame.reset();
+  ASSERT_EQ(1, pool.free_buffers());
+}
+
+TEST(TestFramePool, testFramesOutliveThePool)
+{
+  auto pool = make_shared<FramePool>();
+  auto frame = pool->acquire(8, Frame::Mono, {32, 32});
+  pool.reset();
+  ASSERT_EQ(32 * 32, frame->size());
+}
+
+TEST(TestFramePool, testFrameObjectIsRecycled)
+{
+  FramePool pool;
+  auto frame = pool.acquire(8, Frame::Mono, {32, 32});
+  auto object = frame.get();
+  frame.reset();
+  frame = pool.acquire(8, Frame::Mono, {32, 32});
+  ASSERT_EQ(object, frame.get());
+  ASSERT_EQ(0, frame->sequence());
+  ASSERT_EQ(8, frame->bpp());
+}
+
+TEST(TestFramePool, testPagedBuffersAreRecycledAndAccounted)
+{
+  // Whatever the privileges: without them, buffers fall back to regular pages, not locked
+  FramePool::set_backing({true, 1024 * 1024});
+  {
+    FramePool pool;
+    auto frame = pool.acquire(16, Frame::Mono, {320, 240});
+    auto stats = FramePool::backing_stats();
+    ASSERT_GE(stats.huge_pages + stats.transparent_huge_pages + stats.regular, frame->size());
+    ASSERT_LE(stats.locked, 1024 * 1024);
+    auto data = frame->data();
+    frame.reset();
+    frame = pool.acquire(16, Frame::Mono, {320, 240});
+    ASSERT_EQ(data, frame->data());
+    ASSERT_EQ(1, pool.allocations());
+  }
+  FramePool::set_backing({});
+  auto stats = FramePool::backing_stats();
+  ASSERT_EQ(0, stats.huge_pages + stats.transparent_huge_pages + stats.regular);
+  ASSERT_EQ(0, stats.locked);
+}
+
+namespace {
+struct CountingAllocator : public FramePool::BufferAllocator {
+  size_t acquired = 0;
+  size_t released = 0;
+  size_t alignment = 0;
+  void *acquire(size_t size, size_t alignment) override {
+    acquired += size;
+    this->alignment = alignment;
+    return ::operator new(size);
+  }
+  void release(void *buffer, size_t size) override {
+    released += size;
+    ::operator delete(buffer);
+  }
+};
+}
+
+TEST(TestFramePool, testHostAllocatorProvidesBuffers)
+{
+  auto allocator = make_shared<CountingAllocator>();
+  FramePool::set_buffer_allocator(allocator);
+  {
+    FramePool pool;
+    auto frame = pool.acquire(8, Frame::Mono, {320, 240});
+    ASSERT_EQ(frame->size(), allocator->acquired);
+    ASSERT_GT(allocator->alignment, 0);
+    ASSERT_EQ(frame->size(), FramePool::backing_stats().host);
+    auto data = frame->data();
+    frame.reset();
+    frame = pool.acquire(8, Frame::Mono, {320, 240});
+    ASSERT_EQ(data, frame->data());
+    ASSERT_EQ(frame->size(), allocator->acquired);
+    // Replacing the allocator doesn't take the buffers away from the old one
+    FramePool::set_buffer_allocator({});
+  }
+  ASSERT_EQ(allocator->acquired, allocator->released);
+  ASSERT_EQ(0, FramePool::backing_stats().host);
+}
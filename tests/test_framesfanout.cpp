@@ -0,0 +1,163 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <QSemaphore>
+#include <QMutex>
+#include <QMutexLocker>
+#include "image_handlers/framesfanout.h"
+#include "commons/frame.h"
+
+using namespace std;
+
+namespace {
+FrameConstPtr test_frame() {
+  return make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+}
+
+// Optionally holds each frame until let through, so that tests control how far behind the consumer is
+class TestHandler : public ImageHandler {
+public:
+  TestHandler(bool gated = false) : gated{gated} {}
+  QList<FrameConstPtr> frames() {
+    QMutexLocker lock(&mutex);
+    return received;
+  }
+  const bool gated;
+  QSemaphore entered;
+  QSemaphore gate;
+  QSemaphore handled;
+private:
+  void doHandle(FrameConstPtr frame) override {
+    entered.release();
+    if(gated)
+      gate.acquire();
+    {
+      QMutexLocker lock(&mutex);
+      received.push_back(frame);
+    }
+    handled.release();
+  }
+  QMutex mutex;
+  QList<FrameConstPtr> received;
+};
+}
+
+TEST(TestFramesFanout, testInlineHandlesRightAway)
+{
+  auto handler = make_shared<TestHandler>();
+  FramesFanout fanout;
+  fanout.add("inline", handler, FramesFanout::Inline);
+  auto frame = test_frame();
+  fanout.handle(frame);
+  ASSERT_EQ(QList<FrameConstPtr>{frame}, handler->frames());
+}
+
+TEST(TestFramesFanout, testQueueDropsNewFramesWhenFull)
+{
+  auto handler = make_shared<TestHandler>(true);
+  FramesFanout fanout;
+  fanout.add("queue", handler, FramesFanout::Queue, 2);
+  QList<FrameConstPtr> frames{test_frame(), test_frame(), test_frame(), test_frame()};
+  fanout.handle(frames[0]);
+  ASSERT_TRUE(handler->entered.tryAcquire(1, 1000));
+  for(int i = 1; i < frames.size(); i++)
+    fanout.handle(frames[i]);
+  handler->gate.release(3);
+  ASSERT_TRUE(handler->handled.tryAcquire(3, 1000));
+  ASSERT_EQ(frames.mid(0, 3), handler->frames());
+  ASSERT_EQ(1, fanout.dropped_frames().value(0).second);
+}
+
+TEST(TestFramesFanout, testLatestSkipsToMostRecentFrame)
+{
+  auto handler = make_shared<TestHandler>(true);
+  FramesFanout fanout;
+  fanout.add("latest", handler, FramesFanout::Latest, 4);
+  QList<FrameConstPtr> frames{test_frame(), test_frame(), test_frame(), test_frame()};
+  fanout.handle(frames[0]);
+  ASSERT_TRUE(handler->entered.tryAcquire(1, 1000));
+  for(int i = 1; i < frames.size(); i++)
+    fanout.handle(frames[i]);
+  handler->gate.release(2);
+  ASSERT_TRUE(handler->handled.tryAcquire(2, 1000));
+  ASSERT_EQ((QList<FrameConstPtr>{frames[0], frames[3]}), handler->frames());
+  ASSERT_EQ(2, fanout.dropped_frames().value(0).second);
+}
+
+TEST(TestFramesFanout, testSlowConsumerDoesntHoldBackOthers)
+{
+  auto slow = make_shared<TestHandler>(true);
+  auto fast = make_shared<TestHandler>();
+  FramesFanout fanout;
+  fanout.add("slow", slow, FramesFanout::Latest, 1);
+  fanout.add("fast", fast, FramesFanout::Queue, 8);
+  for(int i = 0; i < 5; i++)
+    fanout.handle(test_frame());
+  ASSERT_TRUE(fast->handled.tryAcquire(5, 1000));
+  slow->gate.release(5);
+}
+
+TEST(TestFramesFanout, testBatchReachesEachConsumerByPolicy)
+{
+  auto inline_handler = make_shared<TestHandler>();
+  auto queued = make_shared<TestHandler>();
+  auto latest = make_shared<TestHandler>();
+  FramesFanout fanout;
+  fanout.add("inline", inline_handler, FramesFanout::Inline);
+  fanout.add("queue", queued, FramesFanout::Queue, 8);
+  fanout.add("latest", latest, FramesFanout::Latest, 8);
+  FrameBatch batch{test_frame(), test_frame(), test_frame()};
+  fanout.handle_batch(batch);
+  const QList<FrameConstPtr> frames{batch[0], batch[1], batch[2]};
+  ASSERT_EQ(frames, inline_handler->frames());
+  ASSERT_TRUE(queued->handled.tryAcquire(3, 1000));
+  ASSERT_EQ(frames, queued->frames());
+  // Only the newest frame of a batch is worth showing
+  ASSERT_TRUE(latest->handled.tryAcquire(1, 1000));
+  ASSERT_EQ(QList<FrameConstPtr>{batch[2]}, latest->frames());
+}
+
+TEST(TestFramesFanout, testSuspendedAndSlowedConsumers)
+{
+  auto recording = make_shared<TestHandler>();
+  auto preview = make_shared<TestHandler>();
+  auto display = make_shared<TestHandler>();
+  FramesFanout fanout;
+  fanout.add("recording", recording, FramesFanout::Inline);
+  fanout.add("preview", preview, FramesFanout::Queue, 8);
+  fanout.add("display", display, FramesFanout::Queue, 8);
+  fanout.set_suspended("recording", true);
+  fanout.set_suspended("preview", true);
+  fanout.set_max_fps("display", 0.1);
+  fanout.set_suspended("unknown", true);
+  for(int i = 0; i < 4; i++)
+    fanout.handle(test_frame());
+  ASSERT_EQ(4, recording->frames().size());
+  // Only the first frame within ten seconds
+  ASSERT_TRUE(display->handled.tryAcquire(1, 1000));
+  ASSERT_FALSE(display->handled.tryAcquire(1, 100));
+  ASSERT_TRUE(preview->frames().isEmpty());
+  fanout.set_suspended("preview", false);
+  auto resumed = test_frame();
+  fanout.handle(resumed);
+  ASSERT_TRUE(preview->handled.tryAcquire(1, 1000));
+  ASSERT_EQ(QList<FrameConstPtr>{resumed}, preview->frames());
+  ASSERT_EQ(0, fanout.dropped_frames().value(1).second);
+}
@@ -0,0 +1,109 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include "commons/framesqueue.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+FrameConstPtr test_frame() {
+  return make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+}
+}
+
+TEST(TestFramesQueue, testPopTimesOutWhenEmpty)
+{
+  FramesQueue queue{2};
+  ASSERT_FALSE(queue.pop(1ms));
+}
+
+TEST(TestFramesQueue, testDropNewest)
+{
+  FramesQueue queue{2, FramesQueue::DropNewest};
+  auto first = test_frame();
+  ASSERT_TRUE(queue.push(first));
+  ASSERT_TRUE(queue.push(test_frame()));
+  ASSERT_FALSE(queue.push(test_frame()));
+  ASSERT_EQ(2, queue.size());
+  ASSERT_EQ(first, queue.pop(1ms));
+}
+
+TEST(TestFramesQueue, testDropOldest)
+{
+  FramesQueue queue{2, FramesQueue::DropOldest};
+  queue.push(test_frame());
+  auto second = test_frame();
+  queue.push(second);
+  ASSERT_FALSE(queue.push(test_frame()));
+  ASSERT_EQ(2, queue.size());
+  ASSERT_EQ(second, queue.pop(1ms));
+}
+
+TEST(TestFramesQueue, testBlockProducerWaitsForConsumer)
+{
+  FramesQueue queue{1, FramesQueue::BlockProducer, 2000ms};
+  queue.push(test_frame());
+  thread consumer{[&]{
+    this_thread::sleep_for(20ms);
+    queue.pop(1ms);
+  }};
+  ASSERT_TRUE(queue.push(test_frame()));
+  consumer.join();
+  ASSERT_EQ(1, queue.size());
+}
+
+TEST(TestFramesQueue, testBlockProducerGivesUp)
+{
+  FramesQueue queue{1, FramesQueue::BlockProducer, 10ms};
+  queue.push(test_frame());
+  ASSERT_FALSE(queue.push(test_frame()));
+  ASSERT_EQ(1, queue.size());
+}
+
+TEST(TestFramesQueue, testBytesBudget)
+{
+  FramesQueue queue{0};
+  auto frame = test_frame();
+  queue.set_max_bytes(frame->size() * 2);
+  ASSERT_TRUE(queue.push(frame));
+  ASSERT_TRUE(queue.push(test_frame()));
+  ASSERT_FALSE(queue.push(test_frame()));
+  ASSERT_EQ(frame->size() * 2, queue.bytes());
+  queue.pop(1ms);
+  ASSERT_EQ(frame->size(), queue.bytes());
+  ASSERT_EQ(frame->size() * 2, queue.peak_bytes());
+  queue.reset_peak_bytes();
+  ASSERT_EQ(frame->size(), queue.peak_bytes());
+}
+
+TEST(TestFramesQueue, testBytesBudgetFollowsFrameSize)
+{
+  FramesQueue queue{0, FramesQueue::DropOldest};
+  queue.set_max_bytes(64);
+  queue.push(make_shared<Frame>(8, Frame::Mono, QSize{4, 4}));
+  queue.push(make_shared<Frame>(8, Frame::Mono, QSize{4, 4}));
+  ASSERT_EQ(2, queue.size());
+  ASSERT_FALSE(queue.push(make_shared<Frame>(8, Frame::Mono, QSize{8, 8})));
+  ASSERT_EQ(1, queue.size());
+  ASSERT_EQ(64, queue.bytes());
+}
@@ -0,0 +1,94 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <QTemporaryDir>
+#include "commons/framesspool.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+FramePtr test_frame(uint8_t value, quint64 sequence) {
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{4, 4}, Frame::LittleEndian);
+  frame->mat().setTo(value);
+  frame->set_sequence(sequence);
+  return frame;
+}
+}
+
+TEST(TestFramesSpool, testPopTimesOutWhenEmpty)
+{
+  QTemporaryDir directory;
+  FramesSpool spool{directory.path(), 0, 0};
+  ASSERT_TRUE(spool.isOpen());
+  ASSERT_TRUE(spool.empty());
+  ASSERT_FALSE(spool.pop(1ms));
+}
+
+TEST(TestFramesSpool, testFramesComeBackInOrder)
+{
+  QTemporaryDir directory;
+  FramesSpool spool{directory.path(), 0, 0};
+  auto first = test_frame(1, 10);
+  first->set_exposure(Frame::Seconds{0.02});
+  first->set_device_timestamp(Frame::Timestamp{5000});
+  first->metadata().gain = 200;
+  for(quint64 sequence = 10; sequence < 20; sequence++)
+    ASSERT_TRUE(spool.push(sequence == 10 ? first : test_frame(sequence, sequence)));
+  ASSERT_EQ(10u, spool.size());
+  for(quint64 sequence = 10; sequence < 20; sequence++) {
+    auto frame = spool.pop(1s);
+    ASSERT_TRUE(frame);
+    ASSERT_EQ(sequence, frame->sequence());
+    ASSERT_EQ(QSize(4, 4), frame->resolution());
+    if(sequence == 10) {
+      ASSERT_EQ(first->exposure(), frame->exposure());
+      ASSERT_EQ(first->created_utc(), frame->created_utc());
+      ASSERT_EQ(first->captured(), frame->captured());
+      ASSERT_EQ(Frame::Timestamp{5000}, frame->device_timestamp());
+      ASSERT_EQ(200, frame->metadata().gain);
+      ASSERT_EQ(1, frame->mat().at<uint8_t>(3, 3));
+    } else {
+      ASSERT_EQ(sequence, frame->mat().at<uint8_t>(0, 0));
+    }
+  }
+  ASSERT_TRUE(spool.empty());
+  ASSERT_EQ(0, spool.bytes());
+  ASSERT_EQ(0u, spool.lost());
+}
+
+TEST(TestFramesSpool, testMaxBytes)
+{
+  QTemporaryDir directory;
+  FramesSpool spool{directory.path(), 32, 0};
+  ASSERT_TRUE(spool.push(test_frame(0, 1)));
+  ASSERT_TRUE(spool.push(test_frame(0, 2)));
+  ASSERT_FALSE(spool.push(test_frame(0, 3)));
+  ASSERT_EQ(32, spool.bytes());
+  ASSERT_EQ(1u, spool.pop(1s)->sequence());
+  ASSERT_TRUE(spool.push(test_frame(0, 4)));
+}
+
+TEST(TestFramesSpool, testMissingDirectory)
+{
+  FramesSpool spool{"/nonexistent/planetaryimager", 0, 0};
+  ASSERT_FALSE(spool.isOpen());
+  ASSERT_FALSE(spool.push(test_frame(0, 1)));
+}
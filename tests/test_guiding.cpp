@@ -0,0 +1,141 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "mount/guiding.h"
+
+using namespace std;
+using namespace Mount;
+
+namespace {
+double distance(const QPointF &a, const QPointF &b) {
+  return hypot(a.x() - b.x(), a.y() - b.y());
+}
+
+// Image of a star on a mount drifting at a constant rate and moved by the guiding pulses
+struct SimulatedMount : public PulseGuider {
+  qint64 now = 0;
+  QPointF ra{0.02, 0.005};
+  QPointF dec{-0.004, 0.015};
+  QPointF drift;
+  QPointF offset{100, 100};
+  struct Pulse { qint64 start; GuideDirection direction; qint64 duration; };
+  vector<Pulse> pulses;
+
+  void pulse(GuideDirection direction, chrono::milliseconds duration) override {
+    pulses.push_back({now, direction, duration.count()});
+  }
+
+  QPointF position(qint64 time) const {
+    QPointF p = offset + drift * time;
+    for(const auto &pulse: pulses) {
+      const double done = max<qint64>(0, min(time - pulse.start, pulse.duration));
+      switch(pulse.direction) {
+        case GuideDirection::West: p += ra * done; break;
+        case GuideDirection::East: p += ra * -done; break;
+        case GuideDirection::North: p += dec * done; break;
+        case GuideDirection::South: p += dec * -done; break;
+      }
+    }
+    return p;
+  }
+};
+
+// Runs 'update' on frames taken every 'interval' ms and received 'latency' ms later
+template<typename F> void run_frames(SimulatedMount &mount, int frames, qint64 interval, qint64 latency, F update) {
+  for(int i = 0; i < frames; i++) {
+    mount.now += interval;
+    const qint64 frame_time = mount.now - latency;
+    if(!update(mount.position(frame_time), QDateTime::fromMSecsSinceEpoch(frame_time), QDateTime::fromMSecsSinceEpoch(mount.now)))
+      return;
+  }
+}
+}
+
+TEST(TestGuiding, testCalibrationMapsOffsetsToPulses) {
+  const GuidingCalibration calibration{{0.02, 0.005}, {-0.004, 0.015}};
+  ASSERT_TRUE(calibration.valid());
+  const AxisPulses pulses = calibration.pulsesFor({3, -2});
+  ASSERT_NEAR(3, calibration.displacement(pulses).x(), 1e-9);
+  ASSERT_NEAR(-2, calibration.displacement(pulses).y(), 1e-9);
+  ASSERT_FALSE((GuidingCalibration{{0.02, 0.005}, {0.04, 0.011}}.valid()));
+  ASSERT_FALSE((GuidingCalibration{{0.02, 0.005}, {}}.valid()));
+}
+
+TEST(TestGuiding, testCalibratorMeasuresBothAxes) {
+  auto mount = make_shared<SimulatedMount>();
+  GuidingCalibrator calibrator{mount, {}};
+  const QPointF start = mount->position(0);
+  run_frames(*mount, 1000, 200, 150, [&](const QPointF &position, const QDateTime &frameTime, const QDateTime &now) {
+    return calibrator.update(position, frameTime, now) != GuidingCalibrator::State::Done;
+  });
+  ASSERT_EQ(GuidingCalibrator::State::Done, calibrator.state());
+  ASSERT_NEAR(mount->ra.x(), calibrator.calibration().ra.x(), 1e-6);
+  ASSERT_NEAR(mount->ra.y(), calibrator.calibration().ra.y(), 1e-6);
+  ASSERT_NEAR(mount->dec.x(), calibrator.calibration().dec.x(), 1e-6);
+  ASSERT_NEAR(mount->dec.y(), calibrator.calibration().dec.y(), 1e-6);
+  ASSERT_EQ(16, mount->pulses.size());
+  ASSERT_NEAR(0, distance(start, mount->position(mount->now)), 1e-6);
+}
+
+TEST(TestGuiding, testCalibratorFailsIfTheImageDoesNotMove) {
+  auto mount = make_shared<SimulatedMount>();
+  mount->ra = {};
+  GuidingCalibrator calibrator{mount, {}};
+  run_frames(*mount, 1000, 200, 150, [&](const QPointF &position, const QDateTime &frameTime, const QDateTime &now) {
+    return calibrator.update(position, frameTime, now) != GuidingCalibrator::State::Failed;
+  });
+  ASSERT_EQ(GuidingCalibrator::State::Failed, calibrator.state());
+}
+
+TEST(TestGuiding, testLoopCancelsDrift) {
+  auto mount = make_shared<SimulatedMount>();
+  mount->drift = {0.001, -0.0005};
+  GuidingLoop loop{mount, {mount->ra, mount->dec}, {}};
+  const QPointF target = mount->position(0);
+  double last_error = 0;
+  run_frames(*mount, 400, 500, 300, [&](const QPointF &position, const QDateTime &frameTime, const QDateTime &now) {
+    loop.update(position, frameTime, now);
+    last_error = distance(target, position);
+    return true;
+  });
+  // Unguided, the image would have moved by more than 200 pixels
+  ASSERT_LT(last_error, 1);
+}
+
+TEST(TestGuiding, testLoopDoesNotRepeatCorrectionsStillInFlight) {
+  auto mount = make_shared<SimulatedMount>();
+  GuidingLoop loop{mount, {mount->ra, mount->dec}, {}};
+  const QPointF target = mount->position(0);
+  run_frames(*mount, 1, 200, 800, [&](const QPointF &position, const QDateTime &frameTime, const QDateTime &now) {
+    loop.update(position, frameTime, now);
+    return true;
+  });
+  mount->offset += QPointF{10, 0};
+  double max_overshoot = 0;
+  run_frames(*mount, 100, 200, 800, [&](const QPointF &position, const QDateTime &frameTime, const QDateTime &now) {
+    loop.update(position, frameTime, now);
+    max_overshoot = max(max_overshoot, target.x() - mount->position(mount->now).x());
+    return true;
+  });
+  ASSERT_LT(max_overshoot, 1);
+  ASSERT_LT(distance(target, mount->position(mount->now)), 0.5);
+}
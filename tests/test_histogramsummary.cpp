@@ -0,0 +1,74 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/histogramsummary.h"
+
+using namespace std;
+
+TEST(TestHistogramSummary, testSixteenBitCountsGoToEightBitBins)
+{
+  vector<uint32_t> counts(65536, 0);
+  counts[100] = 3;
+  counts[1000] = 5;
+  counts[65535] = 7;
+  const auto summary = HistogramSummary::from_counts(counts, 16);
+  ASSERT_EQ(256u, summary.bins.size());
+  ASSERT_EQ(3u, summary.bins[0]);
+  // (1000 + 128) >> 8
+  ASSERT_EQ(5u, summary.bins[4]);
+  ASSERT_EQ(7u, summary.bins[255]);
+  ASSERT_EQ(100, summary.shadows_value);
+  ASSERT_EQ(3u, summary.shadows_count);
+  ASSERT_EQ(65535, summary.highlights_value);
+  ASSERT_EQ(7u, summary.highlights_count);
+  ASSERT_EQ(15u, summary.pixels);
+}
+
+TEST(TestHistogramSummary, testEncodesInFewBytes)
+{
+  vector<uint32_t> counts(256, 0);
+  for(int value = 20; value < 80; value++)
+    counts[value] = 100000 + value;
+  const auto summary = HistogramSummary::from_counts(counts, 8);
+  const auto data = summary.encode();
+  // Empty bins take a byte, full ones three
+  ASSERT_LT(data.size(), 450u);
+  HistogramSummary decoded;
+  ASSERT_TRUE(HistogramSummary::decode(data, decoded));
+  ASSERT_EQ(summary.bins, decoded.bins);
+  ASSERT_EQ(8, decoded.bpp);
+  ASSERT_EQ(20, decoded.shadows_value);
+  ASSERT_EQ(100020u, decoded.shadows_count);
+  ASSERT_EQ(79, decoded.highlights_value);
+  ASSERT_EQ(100079u, decoded.highlights_count);
+  ASSERT_EQ(summary.pixels, decoded.pixels);
+}
+
+TEST(TestHistogramSummary, testRejectsMalformedData)
+{
+  HistogramSummary decoded;
+  auto data = HistogramSummary::from_counts(vector<uint32_t>(256, 1), 8).encode();
+  ASSERT_TRUE(HistogramSummary::decode(data, decoded));
+  ASSERT_FALSE(HistogramSummary::decode({data.begin(), data.end() - 1}, decoded));
+  data.push_back(0);
+  ASSERT_FALSE(HistogramSummary::decode(data, decoded));
+  ASSERT_FALSE(HistogramSummary::decode({}, decoded));
+  ASSERT_FALSE(HistogramSummary::decode(vector<uint8_t>(300, 0x80), decoded));
+  // Failed decodes leave the summary alone
+  ASSERT_EQ(256u, decoded.pixels);
+}
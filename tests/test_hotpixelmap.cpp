@@ -0,0 +1,80 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <random>
+#include "commons/hotpixelmap.h"
+
+using namespace std;
+
+namespace {
+/// Noisy dark frame around 1000, with a hot pixel at (10, 12) and a bright star moving one pixel per frame
+cv::Mat dark_frame(mt19937 &generator, int index) {
+  normal_distribution<double> noise{1000, 10};
+  cv::Mat frame(32, 32, CV_16UC1);
+  for(auto it = frame.begin<uint16_t>(); it != frame.end<uint16_t>(); it++)
+    *it = static_cast<uint16_t>(noise(generator));
+  frame.at<uint16_t>(12, 10) = 3000;
+  frame.at<uint16_t>(20, 5 + index) = 5000;
+  return frame;
+}
+}
+
+TEST(TestHotPixelMap, testLearnsHotPixelsAndIgnoresMovingDetail) {
+  mt19937 generator{3};
+  HotPixelMap map;
+  map.learn(8, 8);
+  for(int index = 0; index < 7; index++)
+    ASSERT_FALSE(map.add(dark_frame(generator, index), 1));
+  ASSERT_TRUE(map.add(dark_frame(generator, 7), 1));
+  ASSERT_TRUE(map.ready());
+  ASSERT_EQ((vector<cv::Point>{{10, 12}}), map.pixels());
+
+  auto frame = dark_frame(generator, 8);
+  map.correct(frame, 1);
+  ASSERT_NEAR(1000, frame.at<uint16_t>(12, 10), 40);
+  ASSERT_EQ(5000, frame.at<uint16_t>(20, 13));
+}
+
+TEST(TestHotPixelMap, testCorrectsWithSameColourNeighbourMedian) {
+  // Bayer: only the pixels 2 apart count, the others are of another colour
+  cv::Mat frame(5, 5, CV_8UC1, cv::Scalar{200});
+  for(int y = 0; y < 5; y += 2)
+    for(int x = 0; x < 5; x += 2)
+      frame.at<uint8_t>(y, x) = 10 + y * 5 + x;
+  frame.at<uint8_t>(2, 2) = 255;
+  cv::Mat mask = cv::Mat::zeros(5, 5, CV_8UC1);
+  mask.at<uint8_t>(2, 2) = 1;
+  mask.at<uint8_t>(0, 0) = 1; // Mapped neighbours are left out
+  HotPixelMap map;
+  map.set(mask);
+  ASSERT_TRUE(map.ready());
+  map.correct(frame, 2);
+  // Neighbours left: 12, 14, 20, 24, 30, 32, 34: median 24
+  ASSERT_EQ(24, frame.at<uint8_t>(2, 2));
+  ASSERT_EQ(200, frame.at<uint8_t>(2, 1));
+}
+
+TEST(TestHotPixelMap, testRestartsLearningOnNewSize) {
+  HotPixelMap map;
+  map.learn(2, 8);
+  ASSERT_FALSE(map.add(cv::Mat(8, 8, CV_8UC1, cv::Scalar{10}), 1));
+  ASSERT_FALSE(map.add(cv::Mat(6, 6, CV_8UC1, cv::Scalar{10}), 1));
+  ASSERT_TRUE(map.add(cv::Mat(6, 6, CV_8UC1, cv::Scalar{10}), 1));
+  ASSERT_TRUE(map.pixels().empty());
+}
@@ -0,0 +1,43 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "commons/inflightcoalescer.h"
+
+TEST(TestInFlightCoalescer, testSendsRightAwayWhenIdle) {
+  InFlightCoalescer<int> coalescer;
+  ASSERT_TRUE(coalescer.offer(1));
+  ASSERT_TRUE(coalescer.in_flight());
+  int next = 0;
+  ASSERT_FALSE(coalescer.acknowledged(next));
+  ASSERT_FALSE(coalescer.in_flight());
+  ASSERT_TRUE(coalescer.offer(2));
+}
+
+TEST(TestInFlightCoalescer, testLatestValueWinsWhileInFlight) {
+  InFlightCoalescer<int> coalescer;
+  ASSERT_TRUE(coalescer.offer(1));
+  for(int value = 2; value <= 10; value++)
+    ASSERT_FALSE(coalescer.offer(value));
+  int next = 0;
+  ASSERT_TRUE(coalescer.acknowledged(next));
+  ASSERT_EQ(10, next);
+  ASSERT_FALSE(coalescer.in_flight());
+  ASSERT_TRUE(coalescer.offer(next));
+  ASSERT_FALSE(coalescer.acknowledged(next));
+}
@@ -0,0 +1,60 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/loadshedding.h"
+
+using namespace std::chrono_literals;
+
+TEST(TestLoadShedding, testStepsUpWhileOverloaded)
+{
+  LoadShedding shedding;
+  const auto start = LoadShedding::Clock::now();
+  ASSERT_EQ(LoadShedding::Normal, shedding.update(0.8, start));
+  ASSERT_EQ(LoadShedding::Normal, shedding.update(0.8, start + 500ms));
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.8, start + 1s));
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.9, start + 1500ms));
+  ASSERT_EQ(LoadShedding::SlowDisplay, shedding.update(0.9, start + 2s));
+  // Not past the configured last step
+  ASSERT_EQ(LoadShedding::SlowDisplay, shedding.update(1, start + 10s));
+}
+
+TEST(TestLoadShedding, testStepsBackOncePressureEases)
+{
+  LoadShedding shedding{{LoadShedding::NoDisplay}};
+  const auto start = LoadShedding::Clock::now();
+  shedding.update(1, start);
+  shedding.update(1, start + 1s);
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.level());
+  // Between the thresholds nothing changes
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.3, start + 2s));
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.3, start + 20s));
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.1, start + 21s));
+  ASSERT_EQ(LoadShedding::NoPreviews, shedding.update(0.1, start + 25s));
+  ASSERT_EQ(LoadShedding::Normal, shedding.update(0.1, start + 26s));
+}
+
+TEST(TestLoadShedding, testShortSpikesAreIgnored)
+{
+  LoadShedding shedding;
+  const auto start = LoadShedding::Clock::now();
+  shedding.update(0.9, start);
+  shedding.update(0.3, start + 500ms);
+  ASSERT_EQ(LoadShedding::Normal, shedding.update(0.9, start + 1s));
+  ASSERT_EQ(LoadShedding::Normal, shedding.update(0.9, start + 1800ms));
+  ASSERT_EQ(LoadShedding::Normal, LoadShedding{{LoadShedding::Normal}}.update(1, start));
+}
@@ -0,0 +1,123 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/memorygovernor.h"
+#include "commons/framesqueue.h"
+#include "commons/pretriggerbuffer.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// 16 bytes per frame
+FrameConstPtr test_frame(const Frame::Clock::time_point &captured = Frame::Clock::now()) {
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+  frame->set_captured(captured);
+  return frame;
+}
+
+// The governor is process wide: each test gets accounts of its own, and leaves no budget behind
+struct Budget {
+  Budget(size_t bytes) { MemoryGovernor::instance().set_budget(MemoryGovernor::instance().used() + bytes); }
+  ~Budget() { MemoryGovernor::instance().set_budget(0); }
+};
+}
+
+TEST(TestMemoryGovernor, testNoBudgetAlwaysFits)
+{
+  auto &account = MemoryGovernor::instance().account("no budget", MemoryGovernor::Display);
+  ASSERT_TRUE(account.reserve(1ull << 40));
+  ASSERT_EQ(1ull << 40, account.current());
+  account.release(1ull << 40);
+  ASSERT_EQ(0, account.current());
+  ASSERT_EQ(1ull << 40, account.peak());
+}
+
+TEST(TestMemoryGovernor, testRefusesOverBudget)
+{
+  auto &account = MemoryGovernor::instance().account("refused", MemoryGovernor::Display);
+  Budget budget{100};
+  ASSERT_TRUE(account.reserve(60));
+  ASSERT_FALSE(account.reserve(60));
+  ASSERT_TRUE(account.fits(40));
+  ASSERT_EQ(60, account.current());
+  account.charge(60);
+  ASSERT_EQ(120, account.current());
+  account.release(120);
+}
+
+TEST(TestMemoryGovernor, testReclaimsLowerPrioritiesOnly)
+{
+  auto &preview = MemoryGovernor::instance().account("reclaimed preview", MemoryGovernor::Preview);
+  auto &recording = MemoryGovernor::instance().account("reclaiming recording", MemoryGovernor::Recording);
+  Budget budget{100};
+  size_t asked = 0;
+  MemoryGovernor::Reclaimer reclaimer{preview, [&](size_t bytes) {
+    asked = bytes;
+    preview.release(50);
+  }};
+  ASSERT_TRUE(preview.reserve(80));
+  // Nothing lower than the preview to take memory from
+  ASSERT_FALSE(preview.reserve(40));
+  ASSERT_EQ(0, asked);
+  ASSERT_TRUE(recording.reserve(40));
+  ASSERT_EQ(20, asked);
+  ASSERT_EQ(30, preview.current());
+  preview.release(30);
+  recording.release(40);
+}
+
+TEST(TestMemoryGovernor, testQueueCountsRefusalsAsFull)
+{
+  auto &account = MemoryGovernor::instance().account("queue", MemoryGovernor::Recording);
+  Budget budget{16 * 3};
+  FramesQueue queue{0, FramesQueue::DropNewest};
+  queue.set_memory_account(account);
+  for(int i = 0; i < 3; i++)
+    ASSERT_TRUE(queue.push(test_frame()));
+  ASSERT_FALSE(queue.push(test_frame()));
+  ASSERT_EQ(16 * 3, account.current());
+  queue.pop(0ms);
+  ASSERT_EQ(16 * 2, account.current());
+  queue.clear();
+  ASSERT_EQ(0, account.current());
+}
+
+TEST(TestMemoryGovernor, testRecordingEvictsPreTriggerFrames)
+{
+  auto &pretrigger = MemoryGovernor::instance().account("evicted pre-trigger", MemoryGovernor::PreTrigger);
+  auto &recording = MemoryGovernor::instance().account("evicting recording", MemoryGovernor::Recording);
+  Budget budget{16 * 4};
+  PreTriggerBuffer buffer{0, 10s};
+  buffer.set_memory_account(pretrigger);
+  const auto start = Frame::Clock::now();
+  for(int i = 0; i < 6; i++)
+    buffer.push(test_frame(start + i * 1ms));
+  // The process budget bounds the ring, as its own budget would
+  ASSERT_EQ(4, buffer.size());
+  ASSERT_EQ(2, buffer.evicted_over_budget());
+  FramesQueue queue{0};
+  queue.set_memory_account(recording);
+  ASSERT_TRUE(queue.push(test_frame()));
+  ASSERT_TRUE(queue.push(test_frame()));
+  ASSERT_EQ(2, buffer.size());
+  ASSERT_EQ(16 * 2, pretrigger.current());
+  ASSERT_EQ(4, buffer.evicted_over_budget());
+}
@@ -0,0 +1,91 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <limits>
+#include "commons/metrics.h"
+
+using namespace std;
+
+TEST(TestMetrics, testBucketsCoverEveryValue)
+{
+  for(quint64 value = 0; value < 100000; value++) {
+    auto bucket = Metrics::Histogram::bucket(value);
+    ASSERT_GE(Metrics::Histogram::bucket_upper_bound(bucket), value);
+    if(bucket > 0)
+      ASSERT_LT(Metrics::Histogram::bucket_upper_bound(bucket - 1), value);
+  }
+  ASSERT_EQ(Metrics::Histogram::BUCKETS - 1, Metrics::Histogram::bucket(numeric_limits<quint64>::max()));
+}
+
+TEST(TestMetrics, testPercentiles)
+{
+  Metrics::Histogram histogram;
+  for(int i = 1; i <= 1000; i++)
+    histogram.record(chrono::microseconds{i});
+  auto snapshot = histogram.snapshot();
+  ASSERT_EQ(1000, snapshot.count);
+  ASSERT_EQ(500500, snapshot.sum_us);
+  ASSERT_EQ(1000, snapshot.max_us);
+  ASSERT_NEAR(500, snapshot.percentile_us(0.5), 500 / 16);
+  ASSERT_NEAR(990, snapshot.percentile_us(0.99), 990 / 16);
+  ASSERT_EQ(1000, snapshot.percentile_us(1));
+  ASSERT_EQ(15, snapshot.count_below(15));
+  // 100 shares its bucket with 101-103: only whole buckets count
+  ASSERT_EQ(99, snapshot.count_below(100));
+}
+
+TEST(TestMetrics, testRegistryReturnsTheSameMetric)
+{
+  auto &counter = Metrics::instance().counter("test_registry_total", "Test counter");
+  counter.add(2);
+  ASSERT_EQ(&counter, &Metrics::instance().counter("test_registry_total", "Test counter"));
+  ASSERT_NE(&counter, &Metrics::instance().counter("test_registry_total", "Test counter", "label=\"other\""));
+  ASSERT_EQ(2, Metrics::instance().counter("test_registry_total", "Test counter").value());
+}
+
+TEST(TestMetrics, testExposition)
+{
+  Metrics::instance().gauge("test_exposition_gauge", "Test gauge").set(-3);
+  auto &histogram = Metrics::instance().histogram("test_exposition_seconds", "Test histogram", "stage=\"test\"");
+  histogram.record(chrono::milliseconds{2});
+  histogram.record(chrono::milliseconds{20});
+  auto text = QString::fromUtf8(Metrics::exposition(Metrics::instance().snapshot()));
+  ASSERT_TRUE(text.contains("# TYPE test_exposition_gauge gauge\ntest_exposition_gauge -3\n"));
+  ASSERT_TRUE(text.contains("# TYPE test_exposition_seconds histogram\n"));
+  ASSERT_TRUE(text.contains("test_exposition_seconds_bucket{stage=\"test\",le=\"0.001\"} 0\n"));
+  ASSERT_TRUE(text.contains("test_exposition_seconds_bucket{stage=\"test\",le=\"0.005\"} 1\n"));
+  ASSERT_TRUE(text.contains("test_exposition_seconds_bucket{stage=\"test\",le=\"+Inf\"} 2\n"));
+  ASSERT_TRUE(text.contains("test_exposition_seconds_count{stage=\"test\"} 2\n"));
+  ASSERT_TRUE(text.contains("test_exposition_seconds_sum{stage=\"test\"} 0.022\n"));
+}
+
+TEST(TestMetrics, testExpositionWritesEachFamilyOnce)
+{
+  Metrics::instance().counter("test_family", "Test family").add(1);
+  Metrics::instance().counter("test_family", "Test family", "kind=\"labelled\"").add(2);
+  // Sorts between the unlabelled and the labelled test_family series as a plain string
+  Metrics::instance().counter("test_family_other", "Other test family").add(3);
+  auto text = QString::fromUtf8(Metrics::exposition(Metrics::instance().snapshot()));
+  ASSERT_EQ(1, text.count("# TYPE test_family counter\n"));
+  ASSERT_TRUE(text.contains("# TYPE test_family counter\ntest_family 1\ntest_family{kind=\"labelled\"} 2\n"));
+  auto shuffled = Metrics::instance().snapshot();
+  std::reverse(shuffled.begin(), shuffled.end());
+  ASSERT_EQ(1, QString::fromUtf8(Metrics::exposition(shuffled)).count("# HELP test_family Test family\n"));
+}
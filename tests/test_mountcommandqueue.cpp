@@ -0,0 +1,83 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mount/commandqueue.h"
+
+using namespace std;
+using namespace Mount;
+
+namespace {
+// Keeps the worker busy until released, so that the following commands pile up in the queue
+struct Recorder {
+  mutex m;
+  vector<string> order;
+  promise<void> release;
+  promise<void> blocked;
+  promise<void> done;
+
+  CommandQueue::Command record(const string &name) {
+    return [this, name] {
+      lock_guard<mutex> lock(m);
+      order.push_back(name);
+    };
+  }
+  void block(CommandQueue &queue) {
+    auto released = release.get_future().share();
+    queue.push(CommandQueue::Priority::Normal, [this, released] {
+      blocked.set_value();
+      released.wait();
+    });
+    blocked.get_future().wait();
+  }
+  void finish(CommandQueue &queue) {
+    queue.push(CommandQueue::Priority::Normal, [this] { done.set_value(); });
+    release.set_value();
+    done.get_future().wait();
+  }
+};
+}
+
+TEST(TestMountCommandQueue, testRunsGuidingCommandsFirst) {
+  CommandQueue queue;
+  Recorder recorder;
+  recorder.block(queue);
+  queue.push(CommandQueue::Priority::Normal, recorder.record("normal 1"));
+  queue.push(CommandQueue::Priority::Guiding, recorder.record("guiding 1"));
+  queue.push(CommandQueue::Priority::Normal, recorder.record("normal 2"));
+  queue.push(CommandQueue::Priority::Guiding, recorder.record("guiding 2"));
+  ASSERT_EQ(4, queue.pending());
+  recorder.finish(queue);
+  ASSERT_EQ((vector<string>{"guiding 1", "guiding 2", "normal 1", "normal 2"}), recorder.order);
+}
+
+TEST(TestMountCommandQueue, testNewerCommandReplacesTheQueuedOneWithTheSameKey) {
+  CommandQueue queue;
+  Recorder recorder;
+  recorder.block(queue);
+  queue.push(CommandQueue::Priority::Guiding, recorder.record("ra 1"), 1);
+  queue.push(CommandQueue::Priority::Guiding, recorder.record("dec 1"), 2);
+  queue.push(CommandQueue::Priority::Guiding, recorder.record("ra 2"), 1);
+  ASSERT_EQ(2, queue.pending());
+  recorder.finish(queue);
+  ASSERT_EQ((vector<string>{"ra 2", "dec 1"}), recorder.order);
+}
@@ -0,0 +1,134 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <QSemaphore>
+#include <QMutex>
+#include <QMutexLocker>
+#include <stdexcept>
+#include "image_handlers/output_writers/multisinkwriter.h"
+#include "commons/frame.h"
+
+using namespace std;
+
+namespace {
+FrameConstPtr test_frame() {
+  return make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+}
+
+// Optionally holds each frame until let through, or fails on every frame
+class TestWriter : public FileWriter {
+public:
+  TestWriter(const QString &name, bool gated = false, bool failing = false) : name{name}, gated{gated}, failing{failing} {}
+  QString filename() const override { return name; }
+  QList<FrameConstPtr> frames() {
+    QMutexLocker lock(&mutex);
+    return received;
+  }
+  const QString name;
+  const bool gated;
+  const bool failing;
+  QSemaphore entered;
+  QSemaphore gate;
+private:
+  void doHandle(FrameConstPtr frame) override {
+    entered.release();
+    if(gated)
+      gate.acquire();
+    if(failing)
+      throw runtime_error("disk full");
+    QMutexLocker lock(&mutex);
+    received.push_back(frame);
+  }
+  QMutex mutex;
+  QList<FrameConstPtr> received;
+};
+typedef shared_ptr<TestWriter> TestWriterPtr;
+}
+
+TEST(TestMultiSinkWriter, testSinksKeepOneFrameEvery)
+{
+  auto primary = make_shared<TestWriter>("main.ser");
+  auto sink = make_shared<TestWriter>("sample");
+  MultiSinkWriter writer{primary, {{"PNG:3", {}, sink, 3, 0}}};
+  QList<FrameConstPtr> frames;
+  for(int i = 0; i < 7; i++) {
+    frames.push_back(test_frame());
+    writer.handle(frames.back());
+  }
+  writer.close();
+  ASSERT_EQ(frames, primary->frames());
+  // The very same frames, not copies
+  ASSERT_EQ((QList<FrameConstPtr>{frames[0], frames[3], frames[6]}), sink->frames());
+  const auto stats = writer.stats();
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(3, stats[0].written);
+  ASSERT_EQ(0, stats[0].dropped);
+  ASSERT_FALSE(stats[0].failed);
+}
+
+TEST(TestMultiSinkWriter, testSlowSinkDropsOnlyItsOwnFrames)
+{
+  auto primary = make_shared<TestWriter>("main.ser");
+  auto slow = make_shared<TestWriter>("slow", true);
+  auto fast = make_shared<TestWriter>("fast");
+  auto first = test_frame();
+  // Room for a single frame waiting
+  MultiSinkWriter writer{primary, {{"slow", {}, slow, 1, first->size()}, {"fast", {}, fast, 1, 0}}};
+  writer.handle(first);
+  ASSERT_TRUE(slow->entered.tryAcquire(1, 1000));
+  QList<FrameConstPtr> frames{first, test_frame(), test_frame(), test_frame()};
+  for(int i = 1; i < frames.size(); i++)
+    writer.handle(frames[i]);
+  ASSERT_EQ(frames, primary->frames());
+  slow->gate.release(frames.size());
+  writer.close();
+  ASSERT_EQ(frames, fast->frames());
+  ASSERT_EQ(frames.mid(0, 2), slow->frames());
+  const auto stats = writer.stats();
+  ASSERT_EQ(2, stats[0].written);
+  ASSERT_EQ(2, stats[0].dropped);
+  ASSERT_EQ(4, stats[1].written);
+  ASSERT_EQ(0, stats[1].dropped);
+}
+
+TEST(TestMultiSinkWriter, testFailingSinkIsGivenUp)
+{
+  auto primary = make_shared<TestWriter>("main.ser");
+  auto failing = make_shared<TestWriter>("failing", false, true);
+  MultiSinkWriter writer{primary, {{"failing", {}, failing, 1, 0}}};
+  QList<FrameConstPtr> frames{test_frame(), test_frame(), test_frame()};
+  for(auto frame: frames)
+    writer.handle(frame);
+  writer.close();
+  ASSERT_EQ(frames, primary->frames());
+  const auto stats = writer.stats();
+  ASSERT_TRUE(stats[0].failed);
+  ASSERT_EQ(0, stats[0].written);
+  ASSERT_EQ(3, stats[0].dropped);
+}
+
+TEST(TestMultiSinkWriter, testFilesOfAllWriters)
+{
+  auto primary = make_shared<TestWriter>("main.ser");
+  MultiSinkWriter writer{primary, {{"PNG:10", {}, make_shared<TestWriter>("sample"), 10, 0}, {"Video:2", {}, make_shared<TestWriter>("quicklook.mkv"), 2, 0}}};
+  ASSERT_EQ("main.ser", writer.filename());
+  ASSERT_EQ((QStringList{"main.ser", "sample", "quicklook.mkv"}), writer.files());
+  ASSERT_EQ(primary, writer.primary());
+}
@@ -126,3 +126,176 @@ TEST(TestNetworkPacket, testPacketDecodeWithLongerPayload)
   ASSERT_EQ("hello", packet.name());
   ASSERT_EQ(expected_payload, packet.payload());
 }
+
+TEST(TestNetworkPacket, testPacketEncodeWithBody)
+{
+  auto expected = emptyPayloadData("hello");
+  QByteArray payload("ab");
+  auto body = std::make_shared<QByteArray>("cdef");
+  expected[expected.size() - 1] = static_cast<char>(payload.size() + body->size());
+  expected.append(payload);
+  expected.append(*body);
+
+  NetworkPacket packet("hello");
+  packet.setPayload(payload);
+  packet.setBody(body, body->constData(), body->size());
+  auto buffer = writeBuffer();
+  packet.sendTo(buffer);
+
+  ASSERT_EQ(expected, buffer->data());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeIntoBodySink)
+{
+  auto data = emptyPayloadData("hello");
+  QByteArray header("ab");
+  QByteArray body("x", 200);
+  data[data.size() - 1] = static_cast<char>(header.size() + body.size());
+  data.append(header);
+  data.append(body);
+
+  auto destination = std::make_shared<std::vector<char>>();
+  NetworkPacket::BodySinks sinks;
+  sinks["hello"] = { 2, [=](const QByteArray &received_header, qint64 body_size) -> NetworkPacket::BodySink::Buffer {
+    EXPECT_EQ(QByteArray("ab"), received_header);
+    destination->resize(body_size);
+    return { destination->data(), destination };
+  }};
+  NetworkPacket packet;
+  auto buffer = readBuffer(data);
+  packet.receiveFrom(buffer, sinks);
+
+  ASSERT_EQ("hello", packet.name());
+  ASSERT_EQ(header, packet.payload());
+  ASSERT_EQ(destination, packet.body());
+  ASSERT_EQ(body.size(), packet.bodySize());
+  ASSERT_EQ(body, QByteArray(destination->data(), destination->size()));
+}
+
+TEST(TestNetworkPacket, testPacketDecodeWithDeclinedBodySink)
+{
+  auto data = emptyPayloadData("hello");
+  QByteArray expected_payload("abcdef");
+  data[data.size() - 1] = static_cast<char>(expected_payload.size());
+  data.append(expected_payload);
+
+  NetworkPacket::BodySinks sinks;
+  sinks["hello"] = { 2, [](const QByteArray &, qint64) -> NetworkPacket::BodySink::Buffer { return {nullptr, {}}; } };
+  NetworkPacket packet;
+  auto buffer = readBuffer(data);
+  packet.receiveFrom(buffer, sinks);
+
+  ASSERT_EQ(expected_payload, packet.payload());
+  ASSERT_FALSE(packet.body());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeIncrementally)
+{
+  auto data = emptyPayloadData("hello");
+  QByteArray expected_payload("z", 200);
+  data[data.size() - 1] = static_cast<char>(expected_payload.size());
+  data.append(expected_payload);
+
+  NetworkPacket packet;
+  auto buffer = readBuffer({});
+  for(int sent = 0; sent < data.size(); sent += 7) {
+    ASSERT_FALSE(packet.readFrom(buffer));
+    buffer->buffer().append(data.mid(sent, 7));
+  }
+  ASSERT_TRUE(packet.readFrom(buffer));
+  ASSERT_EQ("hello", packet.name());
+  ASSERT_EQ(expected_payload, packet.payload());
+}
+
+TEST(TestNetworkPacket, testPacketEncodeWithRequestId)
+{
+  QByteArray expected;
+  expected.append(static_cast<char>(0x80 | 5)).append("hello").append("\x00\x01\x02\x03", 4).append("\x00\x00\x00\x02", 4).append("ab");
+
+  NetworkPacket packet("hello");
+  packet.setRequestId(0x010203);
+  packet.setPayload(QByteArray("ab"));
+  auto buffer = writeBuffer();
+  packet.sendTo(buffer);
+
+  ASSERT_EQ(expected, buffer->data());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeWithRequestId)
+{
+  NetworkPacket sent("hello");
+  sent.setRequestId(42);
+  sent.setPayload(QByteArray("abc"));
+  auto write = writeBuffer();
+  sent.sendTo(write);
+
+  NetworkPacket packet;
+  auto buffer = readBuffer(write->data());
+  packet.receiveFrom(buffer);
+  ASSERT_EQ("hello", packet.name());
+  ASSERT_EQ(42u, packet.requestId());
+  ASSERT_EQ(QByteArray("abc"), packet.payload());
+}
+
+TEST(TestNetworkPacket, testPacketEncodeWithTypeId)
+{
+  QByteArray expected;
+  expected.append('\0');
+  expected.append(static_cast<char>(3));
+  expected.append(QByteArray(3, '\0'));
+  expected.append(static_cast<char>(2));
+  expected.append("ab");
+
+  NetworkPacket packet("hello");
+  packet.setPayload(QByteArray("ab"));
+  auto buffer = writeBuffer();
+  packet.sendTo(buffer, {{"hello", 3}});
+
+  ASSERT_EQ(expected, buffer->data());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeWithTypeId)
+{
+  QStringList types{"another", "hello"};
+  NetworkPacket sent("hello");
+  sent.setRequestId(42);
+  sent.setPayload(QByteArray("abc"));
+  auto write = writeBuffer();
+  sent.sendTo(write, {{"hello", 2}});
+
+  NetworkPacket packet;
+  auto buffer = readBuffer(write->data());
+  packet.receiveFrom(buffer, {}, types);
+  ASSERT_EQ("hello", packet.name());
+  ASSERT_EQ(42u, packet.requestId());
+  ASSERT_EQ(QByteArray("abc"), packet.payload());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeWithUnknownTypeId)
+{
+  NetworkPacket sent("hello");
+  sent.setPayload(QByteArray("abc"));
+  auto write = writeBuffer();
+  sent.sendTo(write, {{"hello", 5}});
+  sent.sendTo(write);
+
+  auto buffer = readBuffer(write->data());
+  NetworkPacket unknown;
+  unknown.receiveFrom(buffer, {}, {"hello"});
+  ASSERT_TRUE(unknown.name().isEmpty());
+  NetworkPacket next;
+  next.receiveFrom(buffer, {}, {"hello"});
+  ASSERT_EQ("hello", next.name());
+  ASSERT_EQ(QByteArray("abc"), next.payload());
+}
+
+TEST(TestNetworkPacket, testPacketDecodeRejectsHugePayloadSize)
+{
+  auto data = emptyPayloadData("hello");
+  for(int i = data.size() - 4; i < data.size(); i++)
+    data[i] = static_cast<char>(0xff);
+
+  NetworkPacket packet;
+  auto buffer = readBuffer(data);
+  ASSERT_THROW(packet.readFrom(buffer), std::runtime_error);
+}
@@ -0,0 +1,60 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "image_handlers/pipelinegraph.h"
+
+TEST(TestPipelineGraph, testParsesNodes)
+{
+  PipelineGraph graph;
+  QString error;
+  ASSERT_TRUE(PipelineGraph::parse("frontend: latest depth=3 cpus=2-3; focus assist: off ;network:queue", graph, error));
+  ASSERT_EQ(3, graph.nodes().size());
+  const auto frontend = graph.node("frontend");
+  ASSERT_EQ(PipelineGraph::Latest, frontend.policy);
+  ASSERT_EQ(3u, frontend.depth);
+  ASSERT_EQ((QList<int>{2, 3}), frontend.cpus);
+  ASSERT_EQ(PipelineGraph::Off, graph.node("focus assist").policy);
+  ASSERT_EQ(PipelineGraph::Queue, graph.node("network").policy);
+  ASSERT_EQ(0u, graph.node("network").depth);
+}
+
+TEST(TestPipelineGraph, testMissingNodesKeepDefaults)
+{
+  PipelineGraph graph;
+  QString error;
+  ASSERT_TRUE(PipelineGraph::parse("", graph, error));
+  const auto node = graph.node("preview");
+  ASSERT_EQ(QString{"preview"}, node.name);
+  ASSERT_EQ(PipelineGraph::Default, node.policy);
+  ASSERT_EQ(0u, node.depth);
+  ASSERT_TRUE(node.cpus.isEmpty());
+}
+
+TEST(TestPipelineGraph, testRejectsBadSpecs)
+{
+  PipelineGraph graph;
+  QString error;
+  ASSERT_TRUE(PipelineGraph::parse("network: latest", graph, error));
+  ASSERT_FALSE(PipelineGraph::parse("frontend: depth=0", graph, error));
+  ASSERT_FALSE(PipelineGraph::parse("frontend: cpus=", graph, error));
+  ASSERT_FALSE(PipelineGraph::parse("frontend: fast", graph, error));
+  ASSERT_FALSE(PipelineGraph::parse("latest depth=2", graph, error));
+  ASSERT_FALSE(error.isEmpty());
+  // Failed parses leave the graph alone
+  ASSERT_EQ(PipelineGraph::Latest, graph.node("network").policy);
+}
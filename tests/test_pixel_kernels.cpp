@@ -0,0 +1,311 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "commons/pixel_kernels.h"
+
+using namespace std;
+
+namespace {
+uint16_t swapped(uint16_t value) {
+  return static_cast<uint16_t>((value >> 8) | (value << 8));
+}
+
+vector<uint16_t> random_values(size_t count) {
+  mt19937 generator{42};
+  vector<uint16_t> values(count);
+  for(auto &value: values)
+    value = static_cast<uint16_t>(generator());
+  // Rounding edge cases
+  vector<uint16_t> edges{0, 127, 128, 383, 384, 65407, 65408, 65535};
+  copy_n(edges.begin(), min(edges.size(), count), values.begin());
+  return values;
+}
+}
+
+TEST(TestPixelKernels, testSwap16) {
+  // Odd sizes exercise the scalar tails of the vectorised implementations
+  for(size_t count: {0, 1, 7, 8, 17, 33, 1000}) {
+    auto values = random_values(count);
+    vector<uint16_t> result(count);
+    PixelKernels::swap16(values.data(), result.data(), count);
+    for(size_t i = 0; i < count; i++)
+      ASSERT_EQ(swapped(values[i]), result[i]) << PixelKernels::implementation() << ", count " << count << ", index " << i;
+  }
+}
+
+TEST(TestPixelKernels, testTo8bitMatchesConvertTo) {
+  for(size_t count: {1, 15, 16, 31, 32, 65, 1000}) {
+    auto values = random_values(count);
+    cv::Mat source(1, count, CV_16UC1, values.data());
+    cv::Mat expected;
+    source.convertTo(expected, CV_8U, 1./256.);
+    auto result = PixelKernels::to8bit(source);
+    ASSERT_EQ(CV_8UC1, result.type());
+    for(size_t i = 0; i < count; i++) {
+      // convertTo rounds half to even, the kernels round half up
+      ASSERT_NEAR(expected.at<uint8_t>(i), result.at<uint8_t>(i), 1) << PixelKernels::implementation() << ", value " << values[i];
+      ASSERT_EQ(min(255u, (values[i] + 128u) >> 8), result.at<uint8_t>(i)) << PixelKernels::implementation() << ", value " << values[i];
+    }
+  }
+}
+
+TEST(TestPixelKernels, testTo8bitSwapped) {
+  auto values = random_values(100);
+  vector<uint8_t> result(values.size());
+  PixelKernels::to8bit(values.data(), result.data(), values.size(), true);
+  for(size_t i = 0; i < values.size(); i++)
+    ASSERT_EQ(min(255u, (swapped(values[i]) + 128u) >> 8), result[i]);
+}
+
+TEST(TestPixelKernels, testRowConverter) {
+  auto values = random_values(1000);
+  for(bool swap: {false, true}) {
+    vector<uint8_t> result(values.size());
+    PixelKernels::row_converter(CV_16U, swap)(values.data(), result.data(), values.size());
+    for(size_t i = 0; i < values.size(); i++)
+      ASSERT_EQ(min(255u, ((swap ? swapped(values[i]) : values[i]) + 128u) >> 8), result[i]) << PixelKernels::implementation() << ", swap " << swap;
+  }
+  vector<uint8_t> eight_bit{1, 2, 3}, copied(3);
+  PixelKernels::row_converter(CV_8U, true)(eight_bit.data(), copied.data(), copied.size());
+  ASSERT_EQ(eight_bit, copied);
+}
+
+TEST(TestPixelKernels, testTo8bitIntoRegion) {
+  cv::Mat source(6, 8, CV_16UC3, cv::Scalar(256, 512, 65535));
+  cv::Mat destination;
+  PixelKernels::to8bit(source(cv::Rect{1, 1, 5, 4}), destination, PixelKernels::row_converter(CV_16U, false));
+  ASSERT_EQ(CV_8UC3, destination.type());
+  ASSERT_EQ(cv::Size(5, 4), destination.size());
+  ASSERT_EQ(cv::Vec3b(1, 2, 255), destination.at<cv::Vec3b>(3, 4));
+}
+
+TEST(TestPixelKernels, testTo8bitLut) {
+  auto values = random_values(5000);
+  vector<uint8_t> lut(256);
+  for(int i = 0; i < 256; i++)
+    lut[i] = static_cast<uint8_t>(255 - i);
+  vector<uint8_t> result(values.size());
+  PixelKernels::to8bit_lut(values.data(), result.data(), values.size(), false, lut.data());
+  for(size_t i = 0; i < values.size(); i++)
+    ASSERT_EQ(255 - min(255u, (values[i] + 128u) >> 8), result[i]);
+}
+
+TEST(TestPixelKernels, testScale8) {
+  for(const auto &range: vector<pair<uint16_t, uint16_t>>{{0, 65535}, {0, 4095}, {64, 1023}, {1000, 1100}, {65500, 65535}}) {
+    const auto scale = PixelKernels::scale8(range.first, range.second);
+    const double black = scale.black, white = scale.black + scale.range;
+    for(size_t count: {1, 15, 16, 31, 32, 65, 1000}) {
+      auto values = random_values(count);
+      vector<uint8_t> rounded(count, 128), result(count);
+      PixelKernels::scale8(values.data(), result.data(), count, false, scale, rounded.data());
+      for(size_t i = 0; i < count; i++) {
+        const double expected = 255. * (min(max<double>(values[i], black), white) - black) / (white - black);
+        ASSERT_NEAR(expected, result[i], 0.51 + 2. / 128) << PixelKernels::implementation() << ", value " << values[i] << ", range " << range.first << "-" << range.second;
+      }
+    }
+  }
+}
+
+TEST(TestPixelKernels, testScale8ClipsAndSwaps) {
+  const auto scale = PixelKernels::scale8(100, 1123);
+  vector<uint16_t> values{0, 99, 100, 1123, 1124, 65535};
+  vector<uint16_t> swapped_values(values.size());
+  transform(values.begin(), values.end(), swapped_values.begin(), swapped);
+  vector<uint8_t> rounded(values.size(), 128), result(values.size());
+  PixelKernels::scale8(swapped_values.data(), result.data(), values.size(), true, scale, rounded.data());
+  ASSERT_EQ((vector<uint8_t>{0, 0, 0, 255, 255, 255}), result);
+}
+
+TEST(TestPixelKernels, testScale8DitherIsUnbiased) {
+  // A value right between two 8 bit levels ends up on either, evenly over all the thresholds
+  const auto scale = PixelKernels::scale8(0, 255 * 4);
+  vector<uint16_t> values(256 + 17, 2 + 4 * 10);
+  vector<uint8_t> thresholds(values.size()), result(values.size());
+  for(size_t i = 0; i < thresholds.size(); i++)
+    thresholds[i] = static_cast<uint8_t>(i);
+  PixelKernels::scale8(values.data(), result.data(), values.size(), false, scale, thresholds.data());
+  size_t above = 0;
+  for(size_t i = 0; i < 256; i++) {
+    ASSERT_TRUE(result[i] == 10 || result[i] == 11) << PixelKernels::implementation() << ", threshold " << i;
+    above += result[i] == 11;
+  }
+  ASSERT_NEAR(128, above, 2);
+}
+
+TEST(TestPixelKernels, testTo8bitKeepsChannelsAnd8bitInput) {
+  cv::Mat colour(4, 5, CV_16UC3, cv::Scalar(256, 512, 65535));
+  auto result = PixelKernels::to8bit(colour);
+  ASSERT_EQ(CV_8UC3, result.type());
+  ASSERT_EQ(cv::Vec3b(1, 2, 255), result.at<cv::Vec3b>(3, 4));
+  cv::Mat eight_bit(2, 2, CV_8UC1, cv::Scalar(7));
+  ASSERT_EQ(eight_bit.data, PixelKernels::to8bit(eight_bit).data);
+}
+
+TEST(TestPixelKernels, testHistogram) {
+  auto values = random_values(999);
+  cv::Mat source(1, values.size(), CV_16UC1, values.data());
+  auto histograms = PixelKernels::histogram(source);
+  ASSERT_EQ(1, histograms.size());
+  ASSERT_EQ(65536, histograms[0].size());
+  vector<uint32_t> expected(65536);
+  for(auto value: values)
+    ++expected[value];
+  ASSERT_EQ(expected, histograms[0]);
+
+  auto swapped_histograms = PixelKernels::histogram(source, true);
+  for(auto value: values)
+    ASSERT_EQ(expected[value], swapped_histograms[0][swapped(value)]);
+}
+
+TEST(TestPixelKernels, testHistogramChannelsAndStep) {
+  cv::Mat colour(6, 6, CV_8UC3, cv::Scalar(1, 2, 3));
+  colour.at<cv::Vec3b>(1, 1) = cv::Vec3b(4, 5, 6);
+  auto histograms = PixelKernels::histogram(colour);
+  ASSERT_EQ(3, histograms.size());
+  ASSERT_EQ(256, histograms[0].size());
+  ASSERT_EQ(35, histograms[0][1]);
+  ASSERT_EQ(1, histograms[0][4]);
+  ASSERT_EQ(35, histograms[2][3]);
+  ASSERT_EQ(1, histograms[2][6]);
+
+  // Rows and columns 0, 2, 4: the odd pixel is skipped
+  auto sampled = PixelKernels::histogram(colour, false, 2);
+  ASSERT_EQ(9, sampled[1][2]);
+  ASSERT_EQ(0, sampled[1][5]);
+}
+
+TEST(TestPixelKernels, testBackgroundUpdate) {
+  for(size_t count: {1, 3, 4, 9, 17, 1000}) {
+    vector<float> values(count, 110), mean(count, 100), variance(count, 4);
+    vector<uint8_t> flags(count, 1);
+    // Every fifth value is a 20 sigma spike
+    for(size_t i = 0; i < count; i += 5)
+      values[i] = 140;
+    auto flagged = PixelKernels::background_update(values.data(), mean.data(), variance.data(), flags.data(), count, 25, 1, 0.5);
+    ASSERT_EQ((count + 4) / 5, flagged) << PixelKernels::implementation() << ", count " << count;
+    for(size_t i = 0; i < count; i++) {
+      if(i % 5 == 0) {
+        ASSERT_EQ(255, flags[i]) << "index " << i;
+        ASSERT_FLOAT_EQ(100, mean[i]);
+        ASSERT_FLOAT_EQ(4, variance[i]);
+      } else {
+        ASSERT_EQ(0, flags[i]) << "index " << i;
+        ASSERT_FLOAT_EQ(105, mean[i]);
+        ASSERT_FLOAT_EQ(52, variance[i]);
+      }
+    }
+  }
+}
+
+TEST(TestPixelKernels, testBackgroundUpdateIgnoresDarkValuesAndUsesVarianceFloor) {
+  vector<float> values{0, 103, 103}, mean{100, 100, 100}, variance{0, 0, 16};
+  vector<uint8_t> flags(3);
+  // sigma floor 2, k = 1: 3 is above it, but not above the 4 sigma of the third value; darker values are never flagged
+  ASSERT_EQ(1, PixelKernels::background_update(values.data(), mean.data(), variance.data(), flags.data(), 3, 1, 4, 0.1));
+  ASSERT_EQ((vector<uint8_t>{0, 255, 0}), flags);
+}
+
+TEST(TestPixelKernels, testAccumulate) {
+  for(size_t count: {1, 7, 8, 17, 33, 1000}) {
+    auto values = random_values(count);
+    vector<uint8_t> bytes(count);
+    vector<uint32_t> sums(count, 70000), expected(count);
+    for(size_t i = 0; i < count; i++) {
+      bytes[i] = static_cast<uint8_t>(values[i]);
+      expected[i] = 70000 + values[i] + bytes[i];
+    }
+    PixelKernels::accumulate(values.data(), sums.data(), count);
+    PixelKernels::accumulate(bytes.data(), sums.data(), count);
+    ASSERT_EQ(expected, sums) << PixelKernels::implementation() << ", count " << count;
+  }
+}
+
+TEST(TestPixelKernels, testCalibrate16) {
+  mt19937 generator{7};
+  for(size_t count: {1, 7, 8, 17, 33, 1000}) {
+    auto values = random_values(count);
+    vector<uint16_t> dark(count), gain(count), expected(count);
+    for(size_t i = 0; i < count; i++) {
+      dark[i] = generator() % 4096;
+      gain[i] = static_cast<uint16_t>(generator());
+      const uint32_t value = values[i] > dark[i] ? values[i] - dark[i] : 0;
+      expected[i] = static_cast<uint16_t>(min<uint32_t>(value * gain[i] >> PixelKernels::calibration_gain_bits, 65535));
+    }
+    // In place, as the calibration stage does
+    PixelKernels::calibrate16(values.data(), dark.data(), gain.data(), values.data(), count);
+    ASSERT_EQ(expected, values) << PixelKernels::implementation() << ", count " << count;
+  }
+}
+
+TEST(TestPixelKernels, testYuyvLuminance) {
+  for(size_t count: {0, 1, 15, 16, 17, 33, 64, 1000}) {
+    auto values = random_values(count);
+    // Y0 U Y1 V...
+    const uint8_t *yuyv = reinterpret_cast<const uint8_t*>(values.data());
+    vector<uint8_t> result(count);
+    PixelKernels::yuyv_luminance(yuyv, result.data(), count);
+    for(size_t i = 0; i < count; i++)
+      ASSERT_EQ(yuyv[i * 2], result[i]) << PixelKernels::implementation() << ", count " << count << ", index " << i;
+  }
+}
+
+TEST(TestPixelKernels, testUsedBits) {
+  for(size_t count: {0, 1, 7, 8, 17, 33, 1000}) {
+    auto values = random_values(count);
+    uint16_t expected = 0;
+    for(auto value: values)
+      expected |= value;
+    ASSERT_EQ(expected, PixelKernels::used_bits(values.data(), count)) << PixelKernels::implementation() << ", count " << count;
+  }
+  const vector<uint16_t> high_aligned{0x0010, 0xfff0, 0x8000};
+  ASSERT_EQ(0xfff0, PixelKernels::used_bits(high_aligned.data(), high_aligned.size()));
+}
+
+TEST(TestPixelKernels, testPackAndUnpack) {
+  for(int bits: {10, 12}) {
+    for(int shift: {0, 16 - bits}) {
+      // Odd sizes exercise the scalar tails, and packed streams not ending on a byte boundary
+      for(size_t count: {1, 3, 7, 8, 15, 16, 17, 33, 1000}) {
+        auto values = random_values(count);
+        for(auto &value: values)
+          value = static_cast<uint16_t>((value & ((1 << bits) - 1)) << shift);
+        // Guard bytes, to catch the vectorised implementations writing past the packed size
+        vector<uint8_t> packed(PixelKernels::packed_size(count, bits) + 16, 0xa5);
+        PixelKernels::pack(values.data(), packed.data(), count, bits, shift);
+        for(size_t i = PixelKernels::packed_size(count, bits); i < packed.size(); i++)
+          ASSERT_EQ(0xa5, packed[i]) << bits << " bits, count " << count;
+        vector<uint16_t> result(count + 8, 0xa5a5);
+        PixelKernels::unpack(packed.data(), result.data(), count, bits, shift);
+        ASSERT_EQ(values, vector<uint16_t>(result.begin(), result.begin() + count)) << PixelKernels::implementation() << ", " << bits << " bits, shift " << shift << ", count " << count;
+        ASSERT_TRUE(all_of(result.begin() + count, result.end(), [](uint16_t value){ return value == 0xa5a5; }));
+      }
+    }
+  }
+}
+
+TEST(TestPixelKernels, testPackedBitStreamIsLittleEndian) {
+  const vector<uint16_t> values{0x3ff, 0x001, 0x000, 0x200};
+  vector<uint8_t> packed(PixelKernels::packed_size(values.size(), 10));
+  ASSERT_EQ(5u, packed.size());
+  PixelKernels::pack(values.data(), packed.data(), values.size(), 10, 0);
+  ASSERT_EQ((vector<uint8_t>{0xff, 0x07, 0x00, 0x00, 0x80}), packed);
+}
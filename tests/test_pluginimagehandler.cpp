@@ -0,0 +1,135 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "image_handlers/pluginimagehandler.h"
+#include "commons/frame.h"
+#include "commons/metrics.h"
+
+using namespace std;
+
+namespace {
+// What the test plugin saw, shared with the tests
+struct Seen {
+  const PIHost *host = nullptr;
+  const uint8_t *data = nullptr;
+  PIFrame last;
+  PIFrame *retained = nullptr;
+  bool retain = false;
+  int frames = 0;
+  int destroyed = 0;
+  bool fail_create = false;
+} seen;
+
+PIImageHandlerPlugin test_plugin(PIExecutionClass execution = PI_EXECUTION_ASYNC) {
+  PIImageHandlerPlugin plugin{};
+  plugin.abi_version = PI_IMAGE_HANDLER_PLUGIN_ABI_VERSION;
+  plugin.name = "test";
+  plugin.execution = execution;
+  plugin.queue_depth = 6;
+  plugin.create = [](const PIHost *host) -> void* { seen.host = host; return seen.fail_create ? nullptr : &seen; };
+  plugin.destroy = [](void *) { seen.destroyed++; };
+  plugin.handle = [](void *, const PIFrame *frame) {
+    seen.frames++;
+    seen.last = *frame;
+    seen.data = frame->data;
+    if(seen.retain)
+      seen.retained = seen.host->retain(seen.host->context, frame);
+    seen.host->counter_add(seen.host->context, "detections total", 2);
+  };
+  return plugin;
+}
+
+class TestPluginImageHandler : public ::testing::Test {
+protected:
+  void SetUp() override { seen = Seen{}; }
+};
+}
+
+TEST_F(TestPluginImageHandler, testFramesReachThePluginInPlaceWithTheirMetadata) {
+  const auto plugin = test_plugin();
+  auto frame = make_shared<Frame>(16, Frame::Bayer_RGGB, QSize{8, 4}, Frame::LittleEndian);
+  frame->set_sequence(42);
+  frame->metadata().gain = 120;
+  frame->metadata().roi_x = 10;
+  frame->metadata().roi_y = 20;
+  {
+    PluginImageHandler handler{&plugin};
+    handler.handle(frame);
+    ASSERT_EQ(1, seen.frames);
+    ASSERT_EQ(frame->mat().data, seen.data);
+    ASSERT_EQ(8, seen.last.width);
+    ASSERT_EQ(4, seen.last.height);
+    ASSERT_EQ(16, seen.last.bpp);
+    ASSERT_EQ(16u, seen.last.stride);
+    ASSERT_EQ(PI_COLOR_BAYER_RGGB, seen.last.color_format);
+    ASSERT_EQ(PI_LITTLE_ENDIAN, seen.last.byte_order);
+    ASSERT_EQ(42u, seen.last.sequence);
+    ASSERT_EQ(120., seen.last.gain);
+    ASSERT_EQ(10, seen.last.roi_x);
+    ASSERT_EQ(20, seen.last.roi_y);
+  }
+  ASSERT_EQ(1, seen.destroyed);
+}
+
+TEST_F(TestPluginImageHandler, testRetainedFramesOutliveTheCall) {
+  const auto plugin = test_plugin();
+  PluginImageHandler handler{&plugin};
+  seen.retain = true;
+  weak_ptr<Frame> weak;
+  {
+    auto frame = make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+    weak = frame;
+    handler.handle(frame);
+  }
+  ASSERT_FALSE(weak.expired());
+  ASSERT_EQ(weak.lock()->mat().data, seen.retained->data);
+  seen.host->release(seen.host->context, seen.retained);
+  ASSERT_TRUE(weak.expired());
+}
+
+TEST_F(TestPluginImageHandler, testExecutionClassSetsTheFanoutPolicy) {
+  const auto inline_plugin = test_plugin(PI_EXECUTION_INLINE);
+  const auto async_plugin = test_plugin(PI_EXECUTION_ASYNC);
+  const auto best_effort_plugin = test_plugin(PI_EXECUTION_BEST_EFFORT);
+  ASSERT_EQ(FramesFanout::Inline, PluginImageHandler{&inline_plugin}.policy());
+  PluginImageHandler async{&async_plugin};
+  ASSERT_EQ(FramesFanout::Queue, async.policy());
+  ASSERT_EQ(6u, async.capacity());
+  PluginImageHandler best_effort{&best_effort_plugin};
+  ASSERT_EQ(FramesFanout::Latest, best_effort.policy());
+  ASSERT_EQ(1u, best_effort.capacity());
+}
+
+TEST_F(TestPluginImageHandler, testTelemetryIsLabelledWithThePluginName) {
+  const auto plugin = test_plugin();
+  PluginImageHandler handler{&plugin};
+  handler.handle(make_shared<Frame>(8, Frame::Mono, QSize{4, 4}));
+  ASSERT_EQ(2u, Metrics::instance().counter("plugin_detections_total", {}, "plugin=\"test\"").value());
+  ASSERT_EQ(1u, Metrics::instance().counter("plugin_frames_total", {}, "plugin=\"test\"").value());
+}
+
+TEST_F(TestPluginImageHandler, testIncompatibleOrFailingPluginsAreRefused) {
+  auto plugin = test_plugin();
+  plugin.abi_version = PI_IMAGE_HANDLER_PLUGIN_ABI_VERSION + 1;
+  ASSERT_THROW(PluginImageHandler{&plugin}, std::runtime_error);
+  plugin = test_plugin();
+  seen.fail_create = true;
+  ASSERT_THROW(PluginImageHandler{&plugin}, std::runtime_error);
+}
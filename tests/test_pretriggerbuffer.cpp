@@ -0,0 +1,80 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/pretriggerbuffer.h"
+#include "commons/frame.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// 16 bytes per frame
+FrameConstPtr test_frame(const Frame::Clock::time_point &captured) {
+  auto frame = make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+  frame->set_captured(captured);
+  return frame;
+}
+}
+
+TEST(TestPreTriggerBuffer, testKeepsTheWindow)
+{
+  PreTriggerBuffer buffer{0, 1s};
+  const auto start = Frame::Clock::now();
+  for(int i = 0; i <= 30; i++)
+    buffer.push(test_frame(start + i * 100ms));
+  // Frames from 2s to 3s
+  ASSERT_EQ(11, buffer.size());
+  ASSERT_DOUBLE_EQ(1., buffer.span().count());
+  ASSERT_EQ(0, buffer.evicted_over_budget());
+}
+
+TEST(TestPreTriggerBuffer, testMemoryBudget)
+{
+  PreTriggerBuffer buffer{16 * 5, 1s};
+  const auto start = Frame::Clock::now();
+  for(int i = 0; i < 8; i++)
+    buffer.push(test_frame(start + i * 1ms));
+  ASSERT_EQ(5, buffer.size());
+  ASSERT_EQ(16 * 5, buffer.bytes());
+  ASSERT_EQ(3, buffer.evicted_over_budget());
+}
+
+TEST(TestPreTriggerBuffer, testKeepsNewestFrameOverBudget)
+{
+  PreTriggerBuffer buffer{8, 1s};
+  auto frame = test_frame(Frame::Clock::now());
+  buffer.push(frame);
+  ASSERT_EQ(1, buffer.size());
+}
+
+TEST(TestPreTriggerBuffer, testTakeOldestFirst)
+{
+  PreTriggerBuffer buffer{0, 1s};
+  const auto start = Frame::Clock::now();
+  auto first = test_frame(start);
+  auto second = test_frame(start + 10ms);
+  buffer.push(first);
+  buffer.push(second);
+  auto frames = buffer.take();
+  ASSERT_EQ(2, frames.size());
+  ASSERT_EQ(first, frames.front());
+  ASSERT_EQ(second, frames.back());
+  ASSERT_EQ(0, buffer.size());
+  ASSERT_EQ(0, buffer.bytes());
+}
@@ -0,0 +1,89 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "drivers/pulsetimer.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// Switch events, in order
+struct Port {
+  mutex events_mutex;
+  vector<string> events;
+  PulseTimer::Action action(const string &event) {
+    return [=]{
+      lock_guard<mutex> lock(events_mutex);
+      events.push_back(event);
+    };
+  }
+  vector<string> taken() {
+    lock_guard<mutex> lock(events_mutex);
+    return events;
+  }
+};
+}
+
+TEST(TestPulseTimer, testPulseEndsAfterItsDuration)
+{
+  Port port;
+  PulseTimer timer;
+  const auto started = PulseTimer::Clock::now();
+  PulseTimer::Clock::time_point ended;
+  timer.start(0, 50ms, port.action("north on"), [&]{ ended = PulseTimer::Clock::now(); port.action("north off")(); });
+  ASSERT_EQ(1, timer.running());
+  ASSERT_EQ(vector<string>{"north on"}, port.taken());
+  this_thread::sleep_for(300ms);
+  ASSERT_EQ(0, timer.running());
+  ASSERT_EQ((vector<string>{"north on", "north off"}), port.taken());
+  ASSERT_GE(ended - started, 50ms);
+}
+
+TEST(TestPulseTimer, testNewPulseOnTheSameAxisEndsThePreviousOne)
+{
+  Port port;
+  PulseTimer timer;
+  timer.start(0, 10s, port.action("north on"), port.action("north off"));
+  timer.start(1, 10s, port.action("west on"), port.action("west off"));
+  timer.start(0, 10s, port.action("south on"), port.action("south off"));
+  ASSERT_EQ(2, timer.running());
+  ASSERT_EQ((vector<string>{"north on", "west on", "north off", "south on"}), port.taken());
+}
+
+TEST(TestPulseTimer, testRunningPulsesEndOnDestruction)
+{
+  Port port;
+  {
+    PulseTimer timer;
+    timer.start(1, 10s, port.action("east on"), port.action("east off"));
+  }
+  ASSERT_EQ((vector<string>{"east on", "east off"}), port.taken());
+}
+
+TEST(TestPulseTimer, testFailedPulseIsNotScheduled)
+{
+  Port port;
+  PulseTimer timer;
+  ASSERT_THROW(timer.start(0, 10ms, []{ throw runtime_error("no ST4 port"); }, port.action("north off")), runtime_error);
+  ASSERT_EQ(0, timer.running());
+  this_thread::sleep_for(50ms);
+  ASSERT_TRUE(port.taken().empty());
+}
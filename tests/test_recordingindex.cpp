@@ -0,0 +1,138 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "commons/recordingindex.h"
+#include "commons/ser_header.h"
+#include "commons/frame.h"
+#include <opencv2/opencv.hpp>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <ctime>
+#include <utime.h>
+
+using namespace std;
+
+namespace {
+// An 8 bit mono SER, with a gradient in every frame and timestamps one second apart
+void write_ser(const QString &path, int frames) {
+  SER_Header header;
+  header.imageWidth = 320;
+  header.imageHeight = 240;
+  header.pixelDepth = 8;
+  header.frames = frames;
+  QFile file{path};
+  ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  QByteArray frame(header.frame_size(), 0);
+  for(int index = 0; index < frame.size(); index++)
+    frame[index] = static_cast<char>(index % header.imageWidth);
+  for(int index = 0; index < frames; index++)
+    file.write(frame);
+  for(int index = 0; index < frames; index++) {
+    const SER_Timestamp timestamp = 636000000000000000ull + index * 10000000ull;
+    file.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+  }
+}
+// Files just written are left alone as still growing
+void age(const QString &path) {
+  const auto minute_ago = time(nullptr) - 60;
+  const utimbuf times{minute_ago, minute_ago};
+  ASSERT_EQ(0, utime(path.toLocal8Bit().constData(), &times));
+}
+}
+
+TEST(TestRecordingIndex, testQualitySummaryCountsScoresInBins) {
+  const auto summary = RecordingIndex::quality_summary({1., 2., 3., 4., 10.}, 3);
+  ASSERT_EQ(5, summary["scores"].toInt());
+  ASSERT_DOUBLE_EQ(1, summary["min"].toDouble());
+  ASSERT_DOUBLE_EQ(10, summary["max"].toDouble());
+  ASSERT_DOUBLE_EQ(3, summary["median"].toDouble());
+  ASSERT_EQ((QVariantList{4, 0, 1}), summary["histogram"].toList());
+  ASSERT_TRUE(RecordingIndex::quality_summary({}).isEmpty());
+}
+
+TEST(TestRecordingIndex, testFinishedRecordingsAreAddedWithTheirInformation) {
+  QTemporaryDir directory;
+  QFile recording{QDir{directory.path()}.filePath("jupiter.ser")};
+  ASSERT_TRUE(recording.open(QIODevice::WriteOnly));
+  recording.write(QByteArray(1000, 0));
+  recording.close();
+  const QVariantMap information{
+    {"started", "2017-03-01T22:00:00"},
+    {"ended", "2017-03-01T22:01:30"},
+    {"camera", "ZWO ASI224MC"},
+    {"total-frames", 9000},
+    {"quality", QVariantMap{{"scores", QVariantList{1., 2., 3.}}}},
+    {"performance", QVariantMap{{"drops", QVariantMap{{"queue", 3}}}}},
+    {"controls", QVariantList{QVariantMap{{"name", "Gain"}}}},
+  };
+  RecordingIndex index{directory.path()};
+  index.add("jupiter.ser", information, cv::Mat{48, 64, CV_8UC1, cv::Scalar{128}});
+  const auto entries = RecordingIndex{directory.path()}.entries();
+  ASSERT_EQ(1, entries.size());
+  const auto entry = entries["jupiter.ser"];
+  ASSERT_EQ(9000, entry["frames"].toInt());
+  ASSERT_DOUBLE_EQ(90, entry["duration"].toDouble());
+  ASSERT_EQ(QString{"ZWO ASI224MC"}, entry["camera"].toString());
+  ASSERT_EQ(1000, entry["size"].toLongLong());
+  ASSERT_DOUBLE_EQ(2, entry["quality"].toMap()["median"].toDouble());
+  ASSERT_EQ(3, entry["performance"].toMap()["drops"].toMap()["queue"].toInt());
+  ASSERT_FALSE(entry.contains("controls"));
+  ASSERT_TRUE(QFileInfo::exists(index.thumbnail_path(entry)));
+}
+
+TEST(TestRecordingIndex, testExistingRecordingsAreIndexedFromTheirHeader) {
+  QTemporaryDir directory;
+  const auto path = QDir{directory.path()}.filePath("saturn.ser");
+  write_ser(path, 5);
+  RecordingIndex index{directory.path()};
+  ASSERT_EQ(0, index.update());
+  age(path);
+  ASSERT_EQ(1, index.update());
+  auto entry = index.entries()["saturn.ser"];
+  ASSERT_EQ(5, entry["frames"].toInt());
+  ASSERT_EQ(320, entry["width"].toInt());
+  ASSERT_EQ(8, entry["bpp"].toInt());
+  ASSERT_DOUBLE_EQ(4, entry["duration"].toDouble());
+  ASSERT_EQ(QFileInfo{path}.size(), entry["size"].toLongLong());
+  const auto thumbnail = cv::imread(index.thumbnail_path(entry).toStdString(), cv::IMREAD_UNCHANGED);
+  ASSERT_EQ(RecordingIndex::ThumbnailSize, thumbnail.cols);
+  ASSERT_EQ(120, thumbnail.rows);
+  // Up to date: not read again
+  ASSERT_EQ(0, index.update());
+  ASSERT_TRUE(QFile::remove(path));
+  index.update();
+  ASSERT_TRUE(index.entries().isEmpty());
+  ASSERT_FALSE(QFileInfo::exists(index.thumbnail_path(entry)));
+}
+
+TEST(TestRecordingIndex, testThumbnailsAreStretched) {
+  cv::Mat dim{100, 400, CV_16UC1, cv::Scalar{0}};
+  dim(cv::Rect{0, 0, 200, 100}).setTo(cv::Scalar{1000});
+  const auto thumbnail = RecordingIndex::thumbnail(Frame{Frame::Mono, dim, Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? Frame::LittleEndian : Frame::BigEndian});
+  ASSERT_EQ(RecordingIndex::ThumbnailSize, thumbnail.cols);
+  ASSERT_EQ(40, thumbnail.rows);
+  ASSERT_EQ(CV_8UC1, thumbnail.type());
+  double low, high;
+  cv::minMaxLoc(thumbnail, &low, &high);
+  ASSERT_DOUBLE_EQ(0, low);
+  ASSERT_DOUBLE_EQ(255, high);
+}
@@ -0,0 +1,68 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/recordingperformance.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+const RecordingPerformance::Clock::time_point start{1000s};
+}
+
+TEST(TestRecordingPerformance, testFpsPercentilesShowStalls) {
+  RecordingPerformance performance;
+  // 10 seconds at 100 fps, but for a second with only 10 frames, and a last second cut short
+  for(int second = 0; second < 11; second++) {
+    const int frames = second == 5 ? 10 : second == 10 ? 3 : 100;
+    for(int frame = 0; frame < frames; frame++)
+      performance.captured(start + std::chrono::seconds{second} + std::chrono::milliseconds{frame * 1000 / frames});
+  }
+  const auto fps = performance.summary()["capture-fps"].toMap();
+  ASSERT_DOUBLE_EQ(100, fps["p50"].toDouble());
+  ASSERT_DOUBLE_EQ(100, fps["p95"].toDouble());
+  ASSERT_DOUBLE_EQ(10, fps["p5"].toDouble());
+}
+
+TEST(TestRecordingPerformance, testWriteLatencies) {
+  RecordingPerformance performance;
+  for(int frame = 0; frame < 100; frame++)
+    performance.written(start + std::chrono::milliseconds{frame * 10}, frame == 99 ? 200ms : 1ms);
+  const auto summary = performance.summary();
+  const auto latency = summary["write-latency-ms"].toMap();
+  ASSERT_NEAR(1, latency["p50"].toDouble(), 0.1);
+  ASSERT_NEAR(200, latency["max"].toDouble(), 0.1);
+  ASSERT_GT(latency["mean"].toDouble(), 1);
+  ASSERT_NEAR(100, summary["save-fps"].toMap()["mean"].toDouble(), 2);
+}
+
+TEST(TestRecordingPerformance, testQueueDropsAreNotCountedAsCaptureDrops) {
+  RecordingPerformance performance;
+  performance.add_drops(RecordingPerformance::Capture, 12);
+  performance.add_drops(RecordingPerformance::Queue, 10);
+  performance.add_drops(RecordingPerformance::SDK, 3);
+  performance.set_queue_peak(2048, 4096);
+  performance.add_load_shedding_step();
+  const auto summary = performance.summary();
+  const auto drops = summary["drops"].toMap();
+  ASSERT_EQ(2, drops["capture"].toULongLong());
+  ASSERT_EQ(10, drops["queue"].toULongLong());
+  ASSERT_EQ(3, drops["sdk"].toULongLong());
+  ASSERT_EQ(0, drops["writer"].toULongLong());
+  ASSERT_EQ(2048, summary["queue-peak-bytes"].toULongLong());
+  ASSERT_EQ(1, summary["load-shedding-steps"].toInt());
+}
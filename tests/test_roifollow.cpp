@@ -0,0 +1,42 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/roifollow.h"
+
+TEST(TestROIFollow, testStaysWhileInside)
+{
+  ROIFollow follow{0.2};
+  ASSERT_EQ(QPoint(), follow.shift({128, 128}, {256, 256}));
+  ASSERT_EQ(QPoint(), follow.shift({60, 200}, {256, 256}));
+}
+
+TEST(TestROIFollow, testCentresTargetNearAnEdge)
+{
+  ROIFollow follow{0.2};
+  ASSERT_EQ(QPoint(100, 22), follow.shift({228, 150}, {256, 256}));
+  ASSERT_EQ(QPoint(-2, -108), follow.shift({126, 20}, {256, 256}));
+}
+
+TEST(TestROIFollow, testClampsMargin)
+{
+  ROIFollow follow{2};
+  // At most 45%: the very centre never moves
+  ASSERT_EQ(QPoint(), follow.shift({64, 32}, {128, 64}));
+  ASSERT_EQ(QPoint(-7, 0), follow.shift({57, 32}, {128, 64}));
+  ASSERT_EQ(QPoint(), ROIFollow{}.shift({10, 10}, {}));
+}
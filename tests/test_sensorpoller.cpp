@@ -0,0 +1,114 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "drivers/sensorpoller.h"
+#include <map>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+// Ticks the poller every tick for the given time, counting the reads of each sensor
+map<int, int> run(SensorPoller &poller, SensorPoller::Clock::time_point &now, chrono::milliseconds duration) {
+  map<int, int> reads;
+  for(const auto end = now + duration; now < end; now += poller.tick_interval())
+    for(auto id: poller.tick(now))
+      reads[id]++;
+  return reads;
+}
+}
+
+TEST(TestSensorPoller, testSensorsReadAtTheirOwnInterval)
+{
+  SensorPoller poller{100ms, 8};
+  const int temperature = poller.add({200ms});
+  const int cooler = poller.add({1000ms});
+  // Longer than a turn of the wheel
+  const int humidity = poller.add({2000ms});
+  SensorPoller::Clock::time_point now{};
+  now += 1s;
+  auto reads = run(poller, now, 4s);
+  ASSERT_EQ(20, reads[temperature]);
+  ASSERT_EQ(4, reads[cooler]);
+  ASSERT_EQ(2, reads[humidity]);
+}
+
+TEST(TestSensorPoller, testSensorsDueTogetherComeInOneTick)
+{
+  SensorPoller poller{100ms, 8};
+  const int temperature = poller.add({500ms});
+  const int cooler = poller.add({500ms});
+  SensorPoller::Clock::time_point now{};
+  now += 1s;
+  ASSERT_EQ((vector<int>{temperature, cooler}), poller.tick(now));
+  for(int i = 0; i < 4; i++) {
+    now += 100ms;
+    ASSERT_TRUE(poller.tick(now).empty());
+  }
+  now += 100ms;
+  ASSERT_EQ((vector<int>{temperature, cooler}), poller.tick(now));
+}
+
+TEST(TestSensorPoller, testRecordingSlowsDown)
+{
+  SensorPoller poller{100ms, 8};
+  const int temperature = poller.add({200ms, 5});
+  SensorPoller::Clock::time_point now{};
+  now += 1s;
+  poller.set_recording(true);
+  ASSERT_EQ(4, run(poller, now, 4s)[temperature]);
+  poller.set_recording(false);
+  // The read already scheduled keeps the recording interval
+  ASSERT_EQ(5, run(poller, now, 1s)[temperature]);
+}
+
+TEST(TestSensorPoller, testPollNow)
+{
+  SensorPoller poller{100ms, 8};
+  const int temperature = poller.add({2000ms});
+  SensorPoller::Clock::time_point now{};
+  now += 1s;
+  ASSERT_EQ(vector<int>{temperature}, poller.tick(now));
+  now += 100ms;
+  ASSERT_TRUE(poller.tick(now).empty());
+  poller.poll_now(temperature);
+  now += 100ms;
+  ASSERT_EQ(vector<int>{temperature}, poller.tick(now));
+  // Rescheduled from there, not read twice
+  ASSERT_EQ(0, run(poller, now, 2000ms)[temperature]);
+  ASSERT_EQ(vector<int>{temperature}, poller.tick(now));
+}
+
+TEST(TestSensorPoller, testStalledTicksReadEachSensorOnce)
+{
+  SensorPoller poller{100ms, 8};
+  const int temperature = poller.add({100ms});
+  const int cooler = poller.add({300ms});
+  SensorPoller::Clock::time_point now{};
+  now += 1s;
+  poller.tick(now);
+  // The capture thread was busy for a while
+  now += 5s;
+  ASSERT_EQ((vector<int>{temperature, cooler}), poller.tick(now));
+  // Back on schedule from there
+  now += 100ms;
+  auto reads = run(poller, now, 300ms);
+  ASSERT_EQ(3, reads[temperature]);
+  ASSERT_EQ(1, reads[cooler]);
+}
@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "commons/ser_header.h"
 #include <QDateTime>
+#include <QTemporaryDir>
 #include <QDebug>
 using namespace std;
 
@@ -50,3 +51,42 @@ INSTANTIATE_TEST_SUITE_P(SerHeaderColorValuesTest, SerHeaderColor, ::testing::Va
   pair<qint32, Frame::ColorFormat>{SER_Header::RGB, Frame::RGB},
   pair<qint32, Frame::ColorFormat>{SER_Header::BGR, Frame::BGR}
 ));
+
+TEST(TestSerFramesSideCar, testRecordFromFrame) {
+  Frame frame{Frame::Mono, cv::Mat(2, 2, CV_8UC1)};
+  frame.set_sequence(9);
+  frame.set_exposure(Frame::Seconds{0.25});
+  frame.metadata().gain = 300;
+  frame.metadata().bin = 2;
+  SER_FrameRecord record{frame};
+  ASSERT_EQ(9u, record.sequence);
+  ASSERT_EQ(0.25, record.exposure);
+  ASSERT_EQ(300, record.metadata.gain);
+  ASSERT_EQ(2, record.metadata.bin);
+  ASSERT_FALSE(record.metadata.has_temperature());
+  ASSERT_EQ(sizeof(SER_FrameRecord), SER_FramesHeader{}.recordSize);
+}
+
+
+TEST(TestSerStripesIndex, testFramesGoToTheStripesInTurn) {
+  SER_StripesIndex index;
+  index.stripes = QStringList{"/disk1/a.stripe1.ser", "/disk2/a.stripe2.ser", "/disk3/a.stripe3.ser"};
+  ASSERT_EQ(make_pair(0, qint64{0}), index.locate(0));
+  ASSERT_EQ(make_pair(2, qint64{0}), index.locate(2));
+  ASSERT_EQ(make_pair(1, qint64{3}), index.locate(10));
+}
+
+TEST(TestSerStripesIndex, testSaveAndLoad) {
+  QTemporaryDir directory;
+  ASSERT_TRUE(directory.isValid());
+  SER_StripesIndex index;
+  index.stripes = QStringList{"/disk1/a.stripe1.ser", "a.stripe2.ser"};
+  QString error;
+  const auto filename = directory.filePath("a.ser.stripes");
+  ASSERT_TRUE(index.save(filename, error));
+  SER_StripesIndex loaded;
+  ASSERT_TRUE(loaded.load(filename, error));
+  // Relative stripes are next to the index
+  ASSERT_EQ((QStringList{"/disk1/a.stripe1.ser", directory.filePath("a.stripe2.ser")}), loaded.stripes);
+  ASSERT_FALSE(loaded.load(directory.filePath("missing.stripes"), error));
+}
@@ -0,0 +1,59 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/storageprobe.h"
+#include <QTemporaryDir>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+TEST(TestStorageProbe, testPercentile) {
+  ASSERT_EQ(0, StorageProbe::percentile({}, 99));
+  vector<double> values(100);
+  for(size_t index = 0; index < values.size(); index++)
+    values[index] = values.size() - index;
+  ASSERT_EQ(99, StorageProbe::percentile(values, 99));
+  ASSERT_EQ(50, StorageProbe::percentile(values, 50));
+  ASSERT_EQ(100, StorageProbe::percentile(values, 100));
+  ASSERT_EQ(7, StorageProbe::percentile({7}, 99));
+}
+
+TEST(TestStorageProbe, testProbesAndCachesPerDevice) {
+  QTemporaryDir directory;
+  ASSERT_TRUE(directory.isValid());
+  ASSERT_FALSE(StorageProbe::cached(directory.path(), 10000).valid());
+  auto result = StorageProbe::run(directory.path(), 10000, 100ms, 1024 * 1024);
+  ASSERT_TRUE(result.valid()) << result.error.toStdString();
+  // Page aligned writes
+  ASSERT_EQ(12288, result.block_size);
+  ASSERT_GT(result.bytes, 0);
+  ASSERT_LE(result.bytes, 1024 * 1024);
+  ASSERT_TRUE(StorageProbe::sustains(result, result.bytes_per_second / 2));
+  ASSERT_FALSE(StorageProbe::sustains(result, result.bytes_per_second));
+  // The temporary file is gone
+  ASSERT_TRUE(QDir{directory.path()}.entryList(QDir::Files | QDir::Hidden).isEmpty());
+  QTemporaryDir subdirectory{directory.filePath("sub-XXXXXX")};
+  ASSERT_EQ(result.bytes_per_second, StorageProbe::cached(subdirectory.path(), 10000).bytes_per_second);
+  ASSERT_FALSE(StorageProbe::cached(directory.path(), 20000).valid());
+}
+
+TEST(TestStorageProbe, testReportsUnwritableDirectories) {
+  auto result = StorageProbe::run("/nonexistent/planetaryimager", 4096, 10ms);
+  ASSERT_FALSE(result.valid());
+  ASSERT_FALSE(result.error.isEmpty());
+}
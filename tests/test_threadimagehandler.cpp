@@ -0,0 +1,94 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include <QSemaphore>
+#include <QMutex>
+#include <QMutexLocker>
+#include "image_handlers/threadimagehandler.h"
+#include "commons/frame.h"
+
+using namespace std;
+
+namespace {
+FrameConstPtr test_frame() {
+  return make_shared<Frame>(8, Frame::Mono, QSize{4, 4});
+}
+
+// Holds each frame until let through, so that tests control how far behind the handler is
+class GatedHandler : public ImageHandler {
+public:
+  QList<FrameConstPtr> frames() {
+    QMutexLocker lock(&mutex);
+    return received;
+  }
+  QSemaphore entered;
+  QSemaphore gate;
+  QSemaphore handled;
+private:
+  void doHandle(FrameConstPtr frame) override {
+    entered.release();
+    gate.acquire();
+    {
+      QMutexLocker lock(&mutex);
+      received.push_back(frame);
+    }
+    handled.release();
+  }
+  QMutex mutex;
+  QList<FrameConstPtr> received;
+};
+}
+
+TEST(TestThreadImageHandler, testDropOldestKeepsMostRecentFrames)
+{
+  auto handler = make_shared<GatedHandler>();
+  ThreadImageHandler threadHandler{handler, 2, 0, FramesQueue::DropOldest};
+  QList<FrameConstPtr> frames{test_frame(), test_frame(), test_frame(), test_frame(), test_frame()};
+  threadHandler.handle(frames[0]);
+  ASSERT_TRUE(handler->entered.tryAcquire(1, 1000));
+  for(int i = 1; i < frames.size(); i++)
+    threadHandler.handle(frames[i]);
+  ASSERT_EQ(2, threadHandler.queue_depth());
+  ASSERT_EQ(2 * frames[0]->size(), threadHandler.queue_bytes());
+  ASSERT_EQ(2, threadHandler.dropped_frames());
+  handler->gate.release(3);
+  ASSERT_TRUE(handler->handled.tryAcquire(3, 1000));
+  ASSERT_EQ((QList<FrameConstPtr>{frames[0], frames[3], frames[4]}), handler->frames());
+  ASSERT_EQ(0, threadHandler.queue_depth());
+}
+
+TEST(TestThreadImageHandler, testByteBoundDropsNewestAndSignals)
+{
+  auto handler = make_shared<GatedHandler>();
+  auto frame_size = test_frame()->size();
+  ThreadImageHandler threadHandler{handler, 0, 2 * frame_size, FramesQueue::DropNewest};
+  quint64 signalled = 0;
+  QObject::connect(&threadHandler, &ThreadImageHandler::droppedFrames, [&](quint64 total) { signalled = total; });
+  QList<FrameConstPtr> frames{test_frame(), test_frame(), test_frame(), test_frame()};
+  threadHandler.handle(frames[0]);
+  ASSERT_TRUE(handler->entered.tryAcquire(1, 1000));
+  for(int i = 1; i < frames.size(); i++)
+    threadHandler.handle(frames[i]);
+  ASSERT_EQ(2 * frame_size, threadHandler.queue_bytes());
+  ASSERT_EQ(1, signalled);
+  handler->gate.release(3);
+  ASSERT_TRUE(handler->handled.tryAcquire(3, 1000));
+  ASSERT_EQ(frames.mid(0, 3), handler->frames());
+}
@@ -0,0 +1,86 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/threadplacement.h"
+
+using namespace ThreadPlacement;
+
+namespace {
+Topology topology(int cpus, const QList<int> &isolated = {}, const QList<int> &nodes = {}) {
+  Topology topology;
+  topology.cpus = cpus;
+  topology.isolated = isolated;
+  topology.nodes = nodes;
+  return topology;
+}
+}
+
+TEST(TestThreadPlacement, testParsesCpuLists) {
+  ASSERT_EQ((QList<int>{0, 1, 2, 5}), parse_cpu_list("0-2,5\n"));
+  ASSERT_EQ(QList<int>{}, parse_cpu_list("\n"));
+  ASSERT_EQ(QList<int>{3}, parse_cpu_list("3,x,1-"));
+}
+
+TEST(TestThreadPlacement, testManualPlacementKeepsValidCpusOnly) {
+  Settings settings;
+  settings.capture = 1;
+  settings.recording = 9;
+  settings.display = 0;
+  auto placement = resolve(settings, topology(4));
+  ASSERT_EQ(1, placement.capture);
+  ASSERT_EQ(-1, placement.recording);
+  ASSERT_EQ(QList<int>{0}, placement.display);
+  ASSERT_TRUE(placement.network.isEmpty());
+}
+
+TEST(TestThreadPlacement, testAutomaticPlacementSeparatesCaptureAndRecording) {
+  Settings settings;
+  settings.automatic = true;
+  auto placement = resolve(settings, topology(4));
+  ASSERT_EQ(3, placement.capture);
+  ASSERT_EQ(2, placement.recording);
+  ASSERT_EQ((QList<int>{0, 1}), placement.display);
+  ASSERT_EQ((QList<int>{0, 1}), placement.network);
+}
+
+TEST(TestThreadPlacement, testAutomaticPlacementPrefersIsolatedCpus) {
+  Settings settings;
+  settings.automatic = true;
+  auto placement = resolve(settings, topology(8, {2, 3}, {0, 0, 0, 0, 1, 1, 1, 1}));
+  ASSERT_EQ(2, placement.capture);
+  ASSERT_EQ(3, placement.recording);
+  ASSERT_EQ((QList<int>{0, 1, 4, 5, 6, 7}), placement.display);
+}
+
+TEST(TestThreadPlacement, testAutomaticRecordingStaysOnTheCaptureNode) {
+  Settings settings;
+  settings.automatic = true;
+  settings.capture = 1;
+  settings.network = 5;
+  auto placement = resolve(settings, topology(8, {}, {0, 0, 0, 0, 1, 1, 1, 1}));
+  ASSERT_EQ(1, placement.capture);
+  ASSERT_EQ(3, placement.recording);
+  ASSERT_EQ((QList<int>{0, 2, 4, 5, 6, 7}), placement.display);
+  ASSERT_EQ(QList<int>{5}, placement.network);
+}
+
+TEST(TestThreadPlacement, testAutomaticPlacementNeedsThreeCpus) {
+  Settings settings;
+  settings.automatic = true;
+  ASSERT_TRUE(resolve(settings, topology(2)) == Placement{});
+}
@@ -0,0 +1,98 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+#include <QSet>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "commons/tracing.h"
+
+using namespace std;
+
+namespace {
+QList<QJsonObject> spans(const QString &name) {
+  QList<QJsonObject> found;
+  for(auto event: QJsonDocument::fromJson(Tracing::instance().chrome_trace()).object()["traceEvents"].toArray()) {
+    auto object = event.toObject();
+    if(object["ph"].toString() == "X" && object["name"].toString() == name)
+      found.append(object);
+  }
+  return found;
+}
+}
+
+// The tracer is a process wide singleton: tests below share its ring, and run in order
+
+TEST(TestTracing, testNothingRecordedWhileDisabled)
+{
+  ASSERT_FALSE(Tracing::instance().enabled());
+  {
+    Tracing::Span span{"disabled", 1};
+  }
+  ASSERT_EQ(0, spans("disabled").size());
+}
+
+TEST(TestTracing, testSpansCarryFrameAndDuration)
+{
+  Tracing::instance().set_enabled(true);
+  {
+    Tracing::Span span{"enabled", 42};
+    this_thread::sleep_for(chrono::milliseconds{2});
+  }
+  auto found = spans("enabled");
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(42, found[0]["args"].toObject()["frame"].toInt());
+  ASSERT_GE(found[0]["dur"].toDouble(), 2000.);
+  ASSERT_EQ(1, found[0]["pid"].toInt());
+}
+
+TEST(TestTracing, testConcurrentWriters)
+{
+  Tracing::instance().set_enabled(true);
+  vector<thread> writers;
+  for(int t = 0; t < 4; t++)
+    writers.emplace_back([]{
+      for(int i = 0; i < 1000; i++)
+        Tracing::Span span{"concurrent", static_cast<quint64>(i)};
+    });
+  for(auto &writer: writers)
+    writer.join();
+  auto found = spans("concurrent");
+  ASSERT_EQ(4000, found.size());
+  QSet<int> threads;
+  for(auto span: found)
+    threads.insert(span["tid"].toInt());
+  ASSERT_EQ(4, threads.size());
+}
+
+TEST(TestTracing, testRingKeepsLatestSpans)
+{
+  Tracing::instance().set_enabled(true);
+  const auto now = Tracing::Clock::now();
+  for(quint64 frame = 0; frame < 70000; frame++)
+    Tracing::instance().record("wrapped", frame, now, now);
+  auto found = spans("wrapped");
+  ASSERT_EQ(65536, found.size());
+  ASSERT_EQ(70000 - 65536, found.first()["args"].toObject()["frame"].toInt());
+  ASSERT_EQ(69999, found.last()["args"].toObject()["frame"].toInt());
+  ASSERT_EQ(0, spans("concurrent").size());
+  Tracing::instance().set_enabled(false);
+}
@@ -0,0 +1,75 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <opencv2/opencv.hpp>
+#include "commons/tracking.h"
+
+using namespace std;
+
+namespace {
+// Blurred noise, as a stand-in for lunar or solar surface detail filling the frame
+cv::Mat surface(int seed = 1) {
+  cv::Mat image{cv::Size{640, 520}, CV_32FC1};
+  cv::theRNG().state = seed;
+  cv::randu(image, 0, 1);
+  cv::GaussianBlur(image, image, cv::Size{0, 0}, 3);
+  cv::normalize(image, image, 0, 60000, cv::NORM_MINMAX);
+  cv::Mat converted;
+  image.convertTo(converted, CV_16U);
+  return converted;
+}
+}
+
+TEST(TestPhaseCorrelation, testFindsWholePixelShifts) {
+  const auto big = surface();
+  const cv::Mat reference = big(cv::Rect{50, 50, 512, 384});
+  // Contents move 9 pixels right and 6 up
+  const cv::Mat moved = big(cv::Rect{41, 56, 512, 384});
+  PhaseCorrelation correlation;
+  ASSERT_TRUE(correlation.setReference(reference));
+  cv::Point2d shift;
+  double response = 0;
+  ASSERT_TRUE(correlation.findShift(moved, shift, response));
+  ASSERT_NEAR(9, shift.x, 0.5);
+  ASSERT_NEAR(-6, shift.y, 0.5);
+  ASSERT_GT(response, 0.1);
+}
+
+TEST(TestPhaseCorrelation, testFindsSubPixelShifts) {
+  const cv::Mat reference = surface()(cv::Rect{0, 0, 512, 384}).clone();
+  cv::Mat moved;
+  const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, 3.5, 0, 1, 2.25);
+  cv::warpAffine(reference, moved, translation, reference.size(), cv::INTER_CUBIC, cv::BORDER_REFLECT);
+  PhaseCorrelation correlation;
+  ASSERT_TRUE(correlation.setReference(reference));
+  cv::Point2d shift;
+  double response = 0;
+  ASSERT_TRUE(correlation.findShift(moved, shift, response));
+  ASSERT_NEAR(3.5, shift.x, 0.5);
+  ASSERT_NEAR(2.25, shift.y, 0.5);
+}
+
+TEST(TestPhaseCorrelation, testUnrelatedFramesHaveNoPeak) {
+  PhaseCorrelation correlation;
+  ASSERT_TRUE(correlation.setReference(surface(1)(cv::Rect{0, 0, 512, 384})));
+  cv::Point2d shift;
+  double response = 1;
+  ASSERT_TRUE(correlation.findShift(surface(2)(cv::Rect{0, 0, 512, 384}), shift, response));
+  ASSERT_LT(response, 0.05);
+  ASSERT_FALSE(correlation.findShift(surface(1)(cv::Rect{0, 0, 256, 256}), shift, response));
+}
@@ -0,0 +1,55 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+#include "commons/updatescoalescer.h"
+
+using namespace std;
+
+TEST(TestPublished, testTakesOnlyChangedValues) {
+  Published<long> published;
+  vector<long> taken;
+  published.take([&](long value) { taken.push_back(value); });
+  ASSERT_TRUE(taken.empty());
+  published.publish(1);
+  published.publish(2);
+  published.take([&](long value) { taken.push_back(value); });
+  published.take([&](long value) { taken.push_back(value); });
+  ASSERT_EQ(vector<long>{2}, taken);
+}
+
+TEST(TestPublished, testLastValueFromAnotherThreadIsNotLost) {
+  Published<long> published;
+  thread publisher{[&]{
+    for(long value = 1; value <= 100000; value++)
+      published.publish(value);
+  }};
+  long last = 0;
+  int takes = 0;
+  while(last < 100000) {
+    published.take([&](long value) {
+      ASSERT_GE(value, last);
+      last = value;
+      takes++;
+    });
+  }
+  publisher.join();
+  ASSERT_EQ(100000, last);
+  ASSERT_GT(takes, 0);
+}
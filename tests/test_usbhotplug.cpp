@@ -0,0 +1,53 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "commons/usbhotplug.h"
+
+namespace {
+QByteArray uevent(const QList<QByteArray> &fields) {
+  QByteArray event;
+  for(auto field: fields)
+    event.append(field).append('\0');
+  return event;
+}
+}
+
+TEST(TestUsbHotplug, testParsesDeviceAdded) {
+  auto event = UsbHotplug::parse(uevent({"add@/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1.2", "ACTION=add",
+    "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1.2", "SUBSYSTEM=usb", "DEVTYPE=usb_device", "PRODUCT=3c3/120a/0", "SEQNUM=4242"}));
+  ASSERT_TRUE(event.valid);
+  ASSERT_EQ(UsbHotplug::Added, event.action);
+  ASSERT_EQ(QString{"1-1.2"}, event.device);
+  ASSERT_EQ(QString{"03c3"}, event.vendor);
+}
+
+TEST(TestUsbHotplug, testParsesDeviceRemovedWithoutProduct) {
+  auto event = UsbHotplug::parse(uevent({"remove@/devices/usb2/2-1", "ACTION=remove", "DEVPATH=/devices/usb2/2-1", "SUBSYSTEM=usb", "DEVTYPE=usb_device"}));
+  ASSERT_TRUE(event.valid);
+  ASSERT_EQ(UsbHotplug::Removed, event.action);
+  ASSERT_EQ(QString{"2-1"}, event.device);
+  ASSERT_TRUE(event.vendor.isEmpty());
+}
+
+TEST(TestUsbHotplug, testIgnoresInterfacesAndOtherSubsystems) {
+  ASSERT_FALSE(UsbHotplug::parse(uevent({"add@/devices/usb1/1-1/1-1:1.0", "ACTION=add", "DEVPATH=/devices/usb1/1-1/1-1:1.0",
+    "SUBSYSTEM=usb", "DEVTYPE=usb_interface", "PRODUCT=3c3/120a/0"})).valid);
+  ASSERT_FALSE(UsbHotplug::parse(uevent({"add@/devices/virtual/net/tun0", "ACTION=add", "DEVPATH=/devices/virtual/net/tun0", "SUBSYSTEM=net"})).valid);
+  ASSERT_FALSE(UsbHotplug::parse(uevent({"bind@/devices/usb1/1-1", "ACTION=bind", "DEVPATH=/devices/usb1/1-1", "SUBSYSTEM=usb", "DEVTYPE=usb_device"})).valid);
+  ASSERT_FALSE(UsbHotplug::parse(QByteArray{"libudev\0garbage", 15}).valid);
+}
@@ -0,0 +1,62 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include <linux/videodev2.h>
+#include "drivers/v4l2/v4l2modes.h"
+
+using namespace std;
+
+namespace {
+// A typical UVC webcam: raw YUYV is limited by the USB bandwidth at high resolutions, MJPEG isn't
+const vector<V4L2Modes::Mode> webcam{
+  {V4L2_PIX_FMT_YUYV, 640, 480, 30},
+  {V4L2_PIX_FMT_YUYV, 1920, 1080, 5},
+  {V4L2_PIX_FMT_MJPEG, 640, 480, 30},
+  {V4L2_PIX_FMT_MJPEG, 1920, 1080, 30},
+  {V4L2_PIX_FMT_MJPEG, 320, 240, 60},
+};
+}
+
+TEST(TestV4L2Modes, testDeliverableFpsIsCappedByTheProcessingCost) {
+  ASSERT_DOUBLE_EQ(30, V4L2Modes::deliverable_fps({V4L2_PIX_FMT_YUYV, 640, 480, 30}, true));
+  ASSERT_LT(V4L2Modes::deliverable_fps({V4L2_PIX_FMT_MJPEG, 3840, 2160, 60}, true), 60);
+  ASSERT_LT(V4L2Modes::deliverable_fps({V4L2_PIX_FMT_MJPEG, 3840, 2160, 60}, false), V4L2Modes::deliverable_fps({V4L2_PIX_FMT_MJPEG, 3840, 2160, 60}, true));
+  ASSERT_EQ(0, V4L2Modes::deliverable_fps({V4L2_PIX_FMT_H264, 640, 480, 30}, true));
+}
+
+TEST(TestV4L2Modes, testMaxFpsPrefersTheFastestModeThenTheLargest) {
+  ASSERT_EQ(4, V4L2Modes::best(webcam, V4L2Modes::MaxFps, true));
+  auto without_fast_mode = webcam;
+  without_fast_mode.pop_back();
+  // Same rate: the largest frame, then the cheapest format
+  ASSERT_EQ(3, V4L2Modes::best(without_fast_mode, V4L2Modes::MaxFps, true));
+  without_fast_mode.pop_back();
+  ASSERT_EQ(0, V4L2Modes::best(without_fast_mode, V4L2Modes::MaxFps, true));
+}
+
+TEST(TestV4L2Modes, testMaxQualityPrefersLargeUncompressedFramesAtAUsableRate) {
+  // YUYV at 1080p is still usable at 5 fps, and lossless
+  ASSERT_EQ(1, V4L2Modes::best(webcam, V4L2Modes::MaxQuality, true));
+  auto slow = webcam;
+  slow[1].fps = 2;
+  ASSERT_EQ(3, V4L2Modes::best(slow, V4L2Modes::MaxQuality, true));
+  const vector<V4L2Modes::Mode> mono{{V4L2_PIX_FMT_GREY, 1280, 960, 30}, {V4L2_PIX_FMT_Y16, 1280, 960, 15}};
+  ASSERT_EQ(1, V4L2Modes::best(mono, V4L2Modes::MaxQuality, true));
+  ASSERT_EQ(-1, V4L2Modes::best({{V4L2_PIX_FMT_H264, 640, 480, 30}}, V4L2Modes::MaxQuality, true));
+}
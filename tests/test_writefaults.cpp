@@ -0,0 +1,92 @@
+/*
+ * GuLinux Planetary Imager - https://github.com/GuLinux/PlanetaryImager
+ * Copyright (C) 2017  Marco Gulino <marco@gulinux.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "image_handlers/output_writers/writefaults.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+TEST(TestWriteFaults, testParse)
+{
+  WriteFaults::Settings settings;
+  QString error;
+  ASSERT_TRUE(WriteFaults::parse("latency=2, jitter=10,stall_every=500,stall=3000,mbps=40,fail_every=1000,seed=7", settings, error));
+  ASSERT_EQ(2, settings.latency.count());
+  ASSERT_EQ(10, settings.jitter.count());
+  ASSERT_EQ(3000, settings.stall.count());
+  ASSERT_EQ(500u, settings.stall_every);
+  ASSERT_EQ(1000u, settings.fail_every);
+  ASSERT_EQ(40, settings.mb_per_second);
+  ASSERT_EQ(7u, settings.seed);
+  ASSERT_TRUE(settings.active());
+  ASSERT_TRUE(WriteFaults::parse("", settings, error));
+  ASSERT_FALSE(settings.active());
+  ASSERT_FALSE(WriteFaults::parse("latency=2,slow=1", settings, error));
+  ASSERT_FALSE(WriteFaults::parse("latency=fast", settings, error));
+  ASSERT_FALSE(WriteFaults::parse("latency=-1", settings, error));
+}
+
+TEST(TestWriteFaults, testSameSeedSameDelays)
+{
+  WriteFaults::Settings settings;
+  settings.latency = WriteFaults::Milliseconds{1};
+  settings.jitter = WriteFaults::Milliseconds{5};
+  WriteFaults first{settings}, second{settings};
+  const auto now = WriteFaults::Clock::now();
+  vector<WriteFaults::Clock::duration> delays;
+  for(int i = 0; i < 100; i++) {
+    const auto fault = first.next(1024, now);
+    ASSERT_GE(fault.delay, 1ms);
+    ASSERT_EQ(fault.delay, second.next(1024, now).delay);
+    delays.push_back(fault.delay);
+  }
+  // Jitter actually varies
+  ASSERT_NE(*min_element(delays.begin(), delays.end()), *max_element(delays.begin(), delays.end()));
+}
+
+TEST(TestWriteFaults, testStallsAndErrors)
+{
+  WriteFaults::Settings settings;
+  settings.stall = WriteFaults::Milliseconds{500};
+  settings.stall_every = 3;
+  settings.fail_every = 4;
+  WriteFaults faults{settings};
+  const auto now = WriteFaults::Clock::now();
+  for(int frame = 1; frame <= 12; frame++) {
+    const auto fault = faults.next(1024, now);
+    ASSERT_EQ(frame % 3 == 0 ? WriteFaults::Clock::duration{500ms} : WriteFaults::Clock::duration::zero(), fault.delay);
+    ASSERT_EQ(frame % 4 == 0, fault.fail);
+  }
+  ASSERT_EQ(12u, faults.frames());
+}
+
+TEST(TestWriteFaults, testThroughputCap)
+{
+  WriteFaults::Settings settings;
+  settings.mb_per_second = 10;
+  WriteFaults faults{settings};
+  const auto now = WriteFaults::Clock::now();
+  // Handed over all at once: each one waits for the ones before it
+  for(int frame = 1; frame <= 10; frame++)
+    ASSERT_EQ(chrono::duration_cast<chrono::milliseconds>(faults.next(1000 * 1000, now).delay).count(), frame * 100);
+  // Once the disk caught up there's no backlog left
+  ASSERT_EQ(100, chrono::duration_cast<chrono::milliseconds>(faults.next(1000 * 1000, now + 5s).delay).count());
+}